@@ -33,10 +33,15 @@
 #include <seastar/core/with_scheduling_group.hh>
 #include <seastar/core/metrics_api.hh>
 #include <seastar/core/io_intent.hh>
+#include <seastar/core/gate.hh>
 #include <seastar/util/assert.hh>
 #include <seastar/util/later.hh>
+#include <algorithm>
 #include <chrono>
+#include <fstream>
+#include <memory>
 #include <optional>
+#include <sstream>
 #include <ranges>
 #include <utility>
 #include <unordered_set>
@@ -72,7 +77,7 @@ static auto random_seed = std::chrono::duration_cast<std::chrono::microseconds>(
 static thread_local std::default_random_engine random_generator(random_seed);
 
 class context;
-enum class request_type { seqread, seqwrite, randread, randwrite, append, cpu, unlink };
+enum class request_type { seqread, seqwrite, randread, randwrite, append, cpu, unlink, replay };
 
 namespace std {
 
@@ -241,6 +246,55 @@ struct options {
 
 class class_data;
 
+// One request of a recorded I/O trace
+struct trace_record {
+    // arrival time, since the beginning of the trace
+    std::chrono::microseconds at;
+    bool write;
+    uint64_t offset;
+    uint64_t size;
+};
+
+using io_trace = std::vector<trace_record>;
+
+// Reads a trace in text form, one request per line:
+//
+//   <arrival time, usec> <R|W> <offset> <size> [<class>]
+//
+// Lines starting with # are skipped. If trace_class is set, only the
+// requests of that class are kept.
+static std::shared_ptr<const io_trace> load_trace(const std::string& path, const std::optional<std::string>& trace_class) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error(format("Cannot open trace {}", path));
+    }
+    io_trace trace;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream ls(line);
+        uint64_t at;
+        std::string op, cls;
+        trace_record rec;
+        if (!(ls >> at >> op >> rec.offset >> rec.size) || (op != "R" && op != "W")) {
+            throw std::runtime_error(format("Malformed trace line '{}' in {}", line, path));
+        }
+        if (trace_class && (!(ls >> cls) || cls != *trace_class)) {
+            continue;
+        }
+        rec.at = std::chrono::microseconds(at);
+        rec.write = op == "W";
+        trace.push_back(rec);
+    }
+    std::ranges::stable_sort(trace, std::less<>(), &trace_record::at);
+    if (trace.empty()) {
+        throw std::runtime_error(format("No requests to replay in {}", path));
+    }
+    return std::make_shared<const io_trace>(std::move(trace));
+}
+
 struct job_config {
     std::string name;
     request_type type;
@@ -259,6 +313,10 @@ struct job_config {
     // remaining operations utilize only one file per shard
     std::optional<uint64_t> files_count;
     uint64_t offset_in_bdev;
+    // the trace replayed by request_type::replay, shared by all shards
+    std::string trace_file;
+    std::optional<std::string> trace_class;
+    std::shared_ptr<const io_trace> trace;
     std::unique_ptr<class_data> gen_class_data();
 };
 
@@ -319,7 +377,6 @@ class class_data {
     virtual ~class_data() = default;
 
 private:
-
     void think_tick() {
         if (_think) {
             _think = false;
@@ -330,6 +387,7 @@ class class_data {
         }
     }
 
+protected:
     future<> issue_request(char* buf, io_intent* intent, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point stop) {
         return issue_request(buf, intent).then([this, start, stop] (auto size) {
             auto now = std::chrono::steady_clock::now();
@@ -340,6 +398,7 @@ class class_data {
         });
     }
 
+private:
     future<> issue_requests_in_parallel(std::chrono::steady_clock::time_point stop) {
         return parallel_for_each(std::views::iota(0u, parallelism()), [this, stop] (auto dummy) mutable {
             auto bufptr = allocate_aligned_buffer<char>(this->req_size(), _alignment);
@@ -391,15 +450,20 @@ class class_data {
         });
     }
 
+protected:
+    virtual future<> do_issue_requests(std::chrono::steady_clock::time_point stop) {
+        if (rps() == 0) {
+            return issue_requests_in_parallel(stop);
+        } else {
+            return issue_requests_at_rate(stop);
+        }
+    }
+
 public:
     future<> issue_requests(std::chrono::steady_clock::time_point stop) {
         _start = std::chrono::steady_clock::now();
         return with_scheduling_group(_sg, [this, stop] {
-            if (rps() == 0) {
-                return issue_requests_in_parallel(stop);
-            } else {
-                return issue_requests_at_rate(stop);
-            }
+            return do_issue_requests(stop);
         }).then([this] {
             _total_duration = std::chrono::steady_clock::now() - _start;
         });
@@ -422,6 +486,7 @@ class class_data {
     // random writes     : will overwrite the file at a random position, between 0 and EOF
     // append            : will write to the file from pos = EOF onwards, always appending to the end.
     // unlink            : will unlink files created at the beginning of the execution
+    // replay            : will read and write the file as the trace says, wrapping offsets around EOF
     // cpu               : CPU-only load, file is not created.
     future<> start(sstring dir, directory_entry_type type) {
         return do_start(dir, type).then([this] {
@@ -453,6 +518,7 @@ class class_data {
             { request_type::append , "APPEND" },
             { request_type::cpu , "CPU" },
             { request_type::unlink, "UNLINK" },
+            { request_type::replay, "REPLAY" },
         }[_config.type];;
     }
 
@@ -737,6 +803,71 @@ class write_io_class_data : public io_class_data {
     }
 };
 
+// Replays a recorded trace open-loop: every request is issued at its arrival
+// time, whether or not the previous ones have completed, and its latency
+// is counted from that time, so falling behind the trace shows up as
+// latency rather than as a slower replay
+class replay_io_class_data : public io_class_data {
+    size_t _next = 0;
+    gate _in_flight;
+    std::exception_ptr _error;
+
+    const io_trace& trace() const noexcept {
+        return *_config.trace;
+    }
+
+public:
+    replay_io_class_data(job_config cfg) : io_class_data(std::move(cfg)) {
+        if (!_config.trace) {
+            throw std::runtime_error("request_type::replay requires specifying 'trace'");
+        }
+    }
+
+    using class_data::issue_request;
+
+    // Issues the next request of the trace
+    future<size_t> issue_request(char *buf, io_intent* intent) override {
+        auto& rec = trace()[_next++];
+        auto size = std::min(align_up(std::max(rec.size, _alignment), _alignment), max_req_size());
+        auto pos = align_down(rec.offset % (_config.file_size - size + 1), _alignment) + _offset;
+        auto f = rec.write ? _file.dma_write(pos, buf, size, intent) : _file.dma_read(pos, buf, size, intent);
+        return on_io_completed(std::move(f));
+    }
+
+private:
+    uint64_t max_req_size() const noexcept {
+        return std::min(std::ranges::max(trace() | std::views::transform(&trace_record::size)), _config.file_size);
+    }
+
+    future<> do_issue_requests(std::chrono::steady_clock::time_point stop) override {
+        auto size = align_up(max_req_size(), _alignment);
+        return do_with(allocate_aligned_buffer<char>(size, _alignment), [this, stop] (auto& bufptr) {
+            auto buf = bufptr.get();
+            return do_until([this, stop] { return _next == trace().size() || std::chrono::steady_clock::now() > stop; }, [this, buf, stop] {
+                auto at = _start + trace()[_next].at;
+                auto now = std::chrono::steady_clock::now();
+                auto f = at > now ? _sleep_fn(at, now) : make_ready_future<>();
+                return f.then([this, buf, at, stop] {
+                    if (std::chrono::steady_clock::now() <= stop) {
+                        (void)with_gate(_in_flight, [this, buf, at, stop] {
+                            return issue_request(buf, nullptr, at, stop);
+                        }).handle_exception([this] (std::exception_ptr ex) {
+                            _error = std::move(ex);
+                        });
+                    }
+                });
+            }).finally([this] {
+                return _in_flight.close();
+            }).then([this] {
+                if (_error) {
+                    return make_exception_future<>(_error);
+                }
+                return make_ready_future<>();
+            });
+        });
+    }
+};
+
 class unlink_class_data : public class_data {
 private:
     sstring _dir_path{};
@@ -864,6 +995,8 @@ std::unique_ptr<class_data> job_config::gen_class_data() {
         return std::make_unique<cpu_class_data>(*this);
     } else if (type == request_type::unlink) {
         return std::make_unique<unlink_class_data>(*this);
+    } else if (type == request_type::replay) {
+        return std::make_unique<replay_io_class_data>(*this);
     } else if ((type == request_type::seqread) || (type == request_type::randread)) {
         return std::make_unique<read_io_class_data>(*this);
     } else {
@@ -946,6 +1079,7 @@ struct convert<request_type> {
             { "append", request_type::append},
             { "cpu", request_type::cpu},
             { "unlink", request_type::unlink },
+            { "replay", request_type::replay },
         };
         auto reqstr = node.as<std::string>();
         if (!mappings.count(reqstr)) {
@@ -1057,6 +1191,16 @@ struct convert<job_config> {
             cl.files_count = node["files_count"].as<uint64_t>();
         }
 
+        // A replay job takes its requests from a trace file, optionally
+        // only those of one class, so that several jobs with different
+        // shares can replay the classes of one trace side by side
+        if (node["trace"]) {
+            cl.trace_file = node["trace"].as<std::string>();
+        }
+        if (node["trace_class"]) {
+            cl.trace_class = node["trace_class"].as<std::string>();
+        }
+
         if (node["shard_info"]) {
             cl.shard_info = node["shard_info"].as<shard_info>();
         }
@@ -1177,6 +1321,11 @@ int main(int ac, char** av) {
             auto& yaml = opts["conf"].as<sstring>();
             YAML::Node doc = YAML::LoadFile(yaml);
             auto reqs = doc.as<std::vector<job_config>>();
+            for (job_config& r : reqs) {
+                if (!r.trace_file.empty()) {
+                    r.trace = load_trace(r.trace_file, r.trace_class);
+                }
+            }
 
             struct sched_class {
                 seastar::scheduling_group sg;
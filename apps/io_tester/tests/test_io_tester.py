@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+#
+# This file is open source software, licensed to you under the terms
+# of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+# distributed with this work for additional information regarding copyright
+# ownership.  You may not use this file except in compliance with the License.
+#
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+#
+# Copyright (C) 2024 Scylladb, Ltd.
+#
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import unittest
+import yaml
+
+
+class TestReplay(unittest.TestCase):
+    io_tester_path = None
+
+    def setUp(self) -> None:
+        self.dir = tempfile.TemporaryDirectory()
+
+    def tearDown(self) -> None:
+        self.dir.cleanup()
+
+    def _path(self, name: str) -> str:
+        return os.path.join(self.dir.name, name)
+
+    def _write_trace(self, lines: list[str]) -> str:
+        path = self._path('trace.txt')
+        with open(path, 'w') as f:
+            f.write('# usec op offset size class\n')
+            f.write('\n'.join(lines) + '\n')
+        return path
+
+    def _run(self, jobs: list[dict]) -> subprocess.CompletedProcess:
+        conf = self._path('conf.yaml')
+        with open(conf, 'w') as f:
+            yaml.safe_dump(jobs, f)
+        storage = self._path('storage')
+        os.makedirs(storage, exist_ok=True)
+        return subprocess.run([self.io_tester_path, '--storage', storage, '--conf', conf,
+                               '--duration', '5', '--smp=1', '--default-log-level=error'],
+                              capture_output=True, text=True, timeout=120)
+
+    @staticmethod
+    def _results(out: str) -> dict:
+        # The results follow the progress messages
+        shards = yaml.safe_load(out[out.index('---'):])
+        return shards[0]
+
+    @staticmethod
+    def _replay_job(name: str, trace: str, trace_class: str) -> dict:
+        return {
+            'name': name,
+            'shards': [0],
+            'type': 'replay',
+            'data_size': '16MB',
+            'trace': trace,
+            'trace_class': trace_class,
+            'shard_info': {'shares': 100},
+        }
+
+    def test_replay_classes(self) -> None:
+        # 200 requests over half a second, alternating between two classes,
+        # written out of order
+        lines = []
+        for i in reversed(range(200)):
+            cls = 'fg' if i % 2 == 0 else 'bg'
+            op = 'R' if i % 3 else 'W'
+            lines.append(f'{i * 2500} {op} {i * 65536} {4096 * (1 + i % 4)} {cls}')
+        trace = self._write_trace(lines)
+        res = self._run([self._replay_job('fg', trace, 'fg'),
+                         self._replay_job('bg', trace, 'bg')])
+        self.assertEqual(res.returncode, 0, res.stderr)
+        results = self._results(res.stdout)
+        # Each job replays all the requests of its class, and only them
+        for name in ('fg', 'bg'):
+            job = results[name]
+            self.assertEqual(job['stats']['total_requests'], 100)
+            self.assertGreater(job['latencies']['max'], 0)
+
+    def test_malformed_trace(self) -> None:
+        trace = self._write_trace(['0 R 0 4096 fg', '10 X 0 4096 fg'])
+        res = self._run([self._replay_job('fg', trace, 'fg')])
+        self.assertNotEqual(res.returncode, 0)
+        self.assertIn('Malformed trace line', res.stdout + res.stderr)
+
+    def test_no_requests_of_class(self) -> None:
+        trace = self._write_trace(['0 R 0 4096 fg'])
+        res = self._run([self._replay_job('bg', trace, 'bg')])
+        self.assertNotEqual(res.returncode, 0)
+        self.assertIn('No requests to replay', res.stdout + res.stderr)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--io-tester',
+                        required=True,
+                        help='Path to the io_tester executable')
+    opts, remaining = parser.parse_known_args()
+    remaining.insert(0, sys.argv[0])
+    TestReplay.io_tester_path = opts.io_tester
+    unittest.main(argv=remaining)
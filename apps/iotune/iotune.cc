@@ -28,7 +28,9 @@
 #include <memory>
 #include <ranges>
 #include <vector>
+#include <array>
 #include <cmath>
+#include <bit>
 #include <sys/vfs.h>
 #include <sys/sysmacros.h>
 #include <boost/program_options.hpp>
@@ -48,10 +50,12 @@
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/fsqual.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/when_all.hh>
 #include <seastar/util/defer.hh>
 #include <seastar/util/log.hh>
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/read_first_line.hh>
+#include <seastar/util/conversions.hh>
 
 using namespace seastar;
 using namespace std::chrono_literals;
@@ -206,6 +210,56 @@ struct io_rates {
     }
 };
 
+// Latencies in usec, in buckets of 1/8th of a power of two
+class latency_histogram {
+    static constexpr unsigned sub_bucket_bits = 3;
+    static constexpr unsigned sub_buckets = 1 << sub_bucket_bits;
+    std::array<uint64_t, 64 * sub_buckets> _buckets = {};
+    uint64_t _count = 0;
+
+    static unsigned bucket_of(uint64_t usec) noexcept {
+        if (usec < sub_buckets) {
+            return usec;
+        }
+        unsigned shift = std::bit_width(usec) - 1 - sub_bucket_bits;
+        return (shift + 1) * sub_buckets + ((usec >> shift) - sub_buckets);
+    }
+
+    // the upper bound of the bucket
+    static uint64_t value_of(unsigned bucket) noexcept {
+        if (bucket < sub_buckets) {
+            return bucket;
+        }
+        unsigned shift = bucket / sub_buckets - 1;
+        return ((uint64_t(bucket % sub_buckets + sub_buckets + 1)) << shift) - 1;
+    }
+
+public:
+    void add(std::chrono::duration<double> latency) noexcept {
+        _buckets[bucket_of(std::chrono::duration_cast<std::chrono::microseconds>(latency).count())]++;
+        _count++;
+    }
+
+    latency_histogram& operator+=(const latency_histogram& o) noexcept {
+        for (unsigned i = 0; i < _buckets.size(); i++) {
+            _buckets[i] += o._buckets[i];
+        }
+        _count += o._count;
+        return *this;
+    }
+
+    uint64_t quantile(double q) const noexcept {
+        uint64_t seen = 0;
+        for (unsigned i = 0; i < _buckets.size(); i++) {
+            seen += _buckets[i];
+            if (seen > 0 && seen >= q * _count) {
+                return value_of(i);
+            }
+        }
+        return 0;
+    }
+};
+
 struct row_stats {
     size_t points;
     double average;
@@ -355,6 +409,7 @@ class io_worker {
     uint64_t _bytes = 0;
     uint64_t _max_offset = 0;
     unsigned _requests = 0;
+    latency_histogram _latencies;
     size_t _buffer_size;
     std::chrono::time_point<iotune_clock, std::chrono::duration<double>> _start_measuring;
     std::chrono::time_point<iotune_clock, std::chrono::duration<double>> _end_measuring;
@@ -391,18 +446,20 @@ class io_worker {
 
     future<> issue_request(char* buf) {
         uint64_t pos = _pos_impl->get_pos();
-        return _req_impl->issue_request(pos, buf, _buffer_size).then([this, pos] (size_t size) {
+        return _req_impl->issue_request(pos, buf, _buffer_size).then([this, pos, start = iotune_clock::now()] (size_t size) {
             auto now = iotune_clock::now();
             _max_offset = std::max(_max_offset, pos + size);
             if ((now > _start_measuring) && (now < _end_measuring)) {
                 _last_time_seen = now;
                 _bytes += size;
                 _requests++;
+                _latencies.add(now - start);
             }
         });
     }
 
     uint64_t max_offset() const noexcept { return _max_offset; }
+    const latency_histogram& latencies() const noexcept { return _latencies; }
 
     io_rates get_io_rates() const {
         io_rates rates;
@@ -416,6 +473,22 @@ class io_worker {
     }
 };
 
+// Reads and writes running side by side
+struct mixed_rates {
+    io_rates read;
+    io_rates write;
+    latency_histogram read_latencies;
+    latency_histogram write_latencies;
+
+    mixed_rates& operator+=(const mixed_rates& o) {
+        read += o.read;
+        write += o.write;
+        read_latencies += o.read_latencies;
+        write_latencies += o.write_latencies;
+        return *this;
+    }
+};
+
 class test_file {
 public:
     enum class pattern { sequential, random };
@@ -468,7 +541,7 @@ class test_file {
         });
     }
 
-    future<io_rates> do_workload(std::unique_ptr<io_worker> worker_ptr, unsigned max_os_concurrency, bool update_file_size = false) {
+    future<io_rates> do_workload(std::unique_ptr<io_worker> worker_ptr, unsigned max_os_concurrency, bool update_file_size = false, latency_histogram* latencies = nullptr) {
         if (update_file_size) {
             _file_size = 0;
         }
@@ -481,7 +554,7 @@ class test_file {
             return do_until([worker] { return worker->should_stop(); }, [buf, worker] {
                 return worker->issue_request(buf);
             }).finally([alive = std::move(bufptr)] {});
-        }).then_wrapped([this, worker = std::move(worker_ptr), update_file_size] (future<> f) {
+        }).then_wrapped([this, worker = std::move(worker_ptr), update_file_size, latencies] (future<> f) {
             try {
                 f.get();
             } catch (invalid_position& ip) {
@@ -494,6 +567,9 @@ class test_file {
             if (update_file_size) {
                 _file_size = worker->max_offset();
             }
+            if (latencies) {
+                *latencies = worker->latencies();
+            }
             return make_ready_future<io_rates>(worker->get_io_rates());
         });
     }
@@ -515,6 +591,29 @@ class test_file {
         });
     }
 
+    // Random reads and random writes at the same time, each with their
+    // share of the concurrency
+    future<mixed_rates> mixed_workload(size_t buffer_size, unsigned read_concurrency, unsigned write_concurrency, std::chrono::duration<double> duration) {
+        auto read_buffer_size = calculate_buffer_size(pattern::random, buffer_size, _file.disk_read_dma_alignment());
+        auto write_buffer_size = calculate_buffer_size(pattern::random, buffer_size, _file.disk_write_dma_alignment());
+        return do_with(mixed_rates{}, std::vector<unsigned>(), std::vector<unsigned>(),
+                [this, read_buffer_size, write_buffer_size, read_concurrency, write_concurrency, duration] (mixed_rates& res, auto& read_rates, auto& write_rates) {
+            auto reader = std::make_unique<io_worker>(read_buffer_size, duration, std::make_unique<read_request_issuer>(_file), get_position_generator(read_buffer_size, pattern::random), read_rates);
+            auto writer = std::make_unique<io_worker>(write_buffer_size, duration, std::make_unique<write_request_issuer>(_file), get_position_generator(write_buffer_size, pattern::random), write_rates);
+            auto reads = do_workload(std::move(reader), read_concurrency, false, &res.read_latencies);
+            auto writes = do_workload(std::move(writer), write_concurrency, false, &res.write_latencies);
+            return when_all_succeed(std::move(reads), std::move(writes)).then_unpack([&res] (io_rates r, io_rates w) {
+                res.read = r;
+                res.write = w;
+                return res;
+            });
+        }).then([this] (mixed_rates res) {
+            return _file.flush().then([res = std::move(res)] () mutable {
+                return std::move(res);
+            });
+        });
+    }
+
     future<> stop() {
         return _file ? _file.close() : make_ready_future<>();
     }
@@ -605,6 +704,25 @@ class iotune_multi_shard_context {
         }, io_rates(), std::plus<io_rates>());
     }
 
+    // Runs random reads and writes on all shards, with up to iodepth
+    // requests in flight on each, write_share of them writes
+    future<mixed_rates> mixed_random_data(size_t buffer_size, float write_share, unsigned iodepth, std::chrono::duration<double> duration) {
+        return _iotune_test_file.map_reduce0([this, buffer_size, write_share, iodepth, duration] (test_file& tf) {
+            const auto shard_io_depth = std::min(iodepth, per_shard_io_depth());
+            if (shard_io_depth < 2) {
+                return make_ready_future<mixed_rates>();
+            }
+            auto writes = std::clamp(unsigned(std::round(shard_io_depth * write_share)), 1u, shard_io_depth - 1);
+            return tf.mixed_workload(buffer_size, shard_io_depth - writes, writes, duration);
+        }, mixed_rates{}, [] (mixed_rates res, const mixed_rates& shard) {
+            return res += shard;
+        });
+    }
+
+    unsigned max_per_shard_io_depth() const {
+        return std::min((_test_directory.max_iodepth() + smp::count - 1) / smp::count, 128u);
+    }
+
 private:
     template <typename Fn>
     future<uint64_t> saturate(float rate_threshold, size_t buffer_size, std::chrono::duration<double> duration, Fn&& workload) {
@@ -645,6 +763,18 @@ struct disk_descriptor {
     uint64_t write_bw;
     std::optional<uint64_t> read_sat_len;
     std::optional<uint64_t> write_sat_len;
+    // How much more than measured alone a write costs when mixed with reads
+    std::optional<float> write_interference;
+    struct mixed_point {
+        float write_share;
+        unsigned iodepth;
+        uint64_t read_iops;
+        uint64_t write_iops;
+        uint64_t read_p50;
+        uint64_t read_p99;
+        uint64_t write_p99;
+    };
+    std::vector<mixed_point> mixed_load;
 };
 
 void string_to_file(sstring conf_file, sstring buf) {
@@ -683,6 +813,25 @@ void write_property_file(sstring conf_file, std::vector<disk_descriptor> disk_de
         if (desc.write_sat_len) {
             out << YAML::Key << "write_saturation_length" << YAML::Value << *desc.write_sat_len;
         }
+        if (desc.write_interference) {
+            out << YAML::Key << "write_interference_factor" << YAML::Value << *desc.write_interference;
+        }
+        if (!desc.mixed_load.empty()) {
+            // Informational, the latency-vs-load curves of the mixed workload
+            out << YAML::Key << "mixed_load" << YAML::BeginSeq;
+            for (auto& p : desc.mixed_load) {
+                out << YAML::Flow << YAML::BeginMap;
+                out << YAML::Key << "write_share" << YAML::Value << p.write_share;
+                out << YAML::Key << "iodepth" << YAML::Value << p.iodepth;
+                out << YAML::Key << "read_iops" << YAML::Value << p.read_iops;
+                out << YAML::Key << "write_iops" << YAML::Value << p.write_iops;
+                out << YAML::Key << "read_p50_usec" << YAML::Value << p.read_p50;
+                out << YAML::Key << "read_p99_usec" << YAML::Value << p.read_p99;
+                out << YAML::Key << "write_p99_usec" << YAML::Value << p.write_p99;
+                out << YAML::EndMap;
+            }
+            out << YAML::EndSeq;
+        }
         out << YAML::EndMap;
     }
     out << YAML::EndSeq;
@@ -692,6 +841,33 @@ void write_property_file(sstring conf_file, std::vector<disk_descriptor> disk_de
     string_to_file(conf_file, sstring(out.c_str(), out.size()));
 }
 
+std::unordered_map<std::string, disk_descriptor> read_property_file(sstring conf_file) {
+    std::unordered_map<std::string, disk_descriptor> ret;
+    YAML::Node doc = YAML::LoadFile(conf_file);
+    for (auto&& node : doc["disks"]) {
+        if (!node["mountpoint"]) {
+            continue;
+        }
+        disk_descriptor desc;
+        desc.mountpoint = node["mountpoint"].as<std::string>();
+        desc.read_iops = parse_memory_size(node["read_iops"].as<std::string>());
+        desc.read_bw = parse_memory_size(node["read_bandwidth"].as<std::string>());
+        desc.write_iops = parse_memory_size(node["write_iops"].as<std::string>());
+        desc.write_bw = parse_memory_size(node["write_bandwidth"].as<std::string>());
+        if (node["read_saturation_length"]) {
+            desc.read_sat_len = parse_memory_size(node["read_saturation_length"].as<std::string>());
+        }
+        if (node["write_saturation_length"]) {
+            desc.write_sat_len = parse_memory_size(node["write_saturation_length"].as<std::string>());
+        }
+        if (node["write_interference_factor"]) {
+            desc.write_interference = node["write_interference_factor"].as<float>();
+        }
+        ret.emplace(desc.mountpoint, std::move(desc));
+    }
+    return ret;
+}
+
 // Returns the mountpoint of a path. It works by walking backwards from the canonical path
 // (absolute, with symlinks resolved), until we find a point that crosses a device ID.
 fs::path mountpoint_of(sstring filename) {
@@ -715,6 +891,8 @@ fs::path mountpoint_of(sstring filename) {
 int main(int ac, char** av) {
     namespace bpo = boost::program_options;
     bool fs_check = false;
+    bool mixed = false;
+    bool quick = false;
 
     app_template::config app_cfg;
     app_cfg.name = "IOTune";
@@ -732,6 +910,10 @@ int main(int ac, char** av) {
         ("saturation", bpo::value<sstring>()->default_value(""), "measure saturation lengths (read | write | both) (this is very slow!)")
         ("random-io-buffer-size", bpo::value<unsigned>()->default_value(0), "force buffer size for random write and random read")
         ("force-io-depth", bpo::value<unsigned>()->default_value(0), "force io depth to a certain size (overriding auto detection logic)")
+        ("mixed", bpo::bool_switch(&mixed), "measure how writes slow reads down, sweeping read/write mixes and queue depths (this is slow!)")
+        ("quick", bpo::bool_switch(&quick), "probe the values stored in --properties-file briefly, and only measure again those which diverge")
+        ("quick-duration", bpo::value<unsigned>()->default_value(10), "time, in seconds, for which to probe in quick mode")
+        ("tolerance", bpo::value<unsigned>()->default_value(10), "divergence from the stored values (percents) accepted in quick mode")
     ;
 
     return app.run(ac, av, [&] {
@@ -744,6 +926,22 @@ int main(int ac, char** av) {
             auto saturation = configuration["saturation"].as<sstring>();
             auto random_io_buffer_size = configuration["random-io-buffer-size"].as<unsigned>();
             auto force_io_depth = configuration["force-io-depth"].as<unsigned>();
+            auto quick_duration = std::chrono::duration<double>(configuration["quick-duration"].as<unsigned>() * 1s);
+            auto tolerance = configuration["tolerance"].as<unsigned>() / 100.0;
+
+            std::unordered_map<std::string, disk_descriptor> stored_descriptors;
+            if (quick) {
+                if (!configuration.count("properties-file")) {
+                    fmt::print("--quick needs --properties-file\n");
+                    return 1;
+                }
+                auto properties_file = configuration["properties-file"].as<sstring>();
+                if (fs::exists(properties_file.c_str())) {
+                    stored_descriptors = read_property_file(properties_file);
+                } else {
+                    iotune_logger.warn("{} does not exist, measuring everything", properties_file);
+                }
+            }
 
             bool read_saturation, write_saturation;
             if (saturation == "") {
@@ -840,61 +1038,132 @@ int main(int ac, char** av) {
 
                 iotune_tests.create_data_file().get();
 
+                // In quick mode the values stored for this mountpoint are
+                // probed briefly, and only those that diverge are measured
+                // again for the full duration
+                const disk_descriptor* stored = nullptr;
+                if (auto it = stored_descriptors.find(mountpoint); it != stored_descriptors.end()) {
+                    stored = &it->second;
+                }
+                auto measure = [&] (const char* what, const char* unit, double unit_size, std::optional<uint64_t> stored_value, auto&& fn) {
+                    fmt::print("Measuring {}: ", what);
+                    std::cout.flush();
+                    if (stored_value) {
+                        auto probe = fn(quick_duration);
+                        if (std::abs(probe - *stored_value) <= *stored_value * tolerance) {
+                            fmt::print("{} {} (stored, probed {} {})\n", uint64_t(*stored_value / unit_size), unit, uint64_t(probe / unit_size), unit);
+                            return float(*stored_value);
+                        }
+                        fmt::print("probed {} {}, stored {} {}, re-measuring: ", uint64_t(probe / unit_size), unit, uint64_t(*stored_value / unit_size), unit);
+                        std::cout.flush();
+                    }
+                    auto value = fn(duration);
+                    fmt::print("{} {}{}\n", uint64_t(value / unit_size), unit, accuracy_msg());
+                    return value;
+                };
+                auto stored_value = [stored] (uint64_t disk_descriptor::* field) -> std::optional<uint64_t> {
+                    return stored ? std::make_optional(stored->*field) : std::nullopt;
+                };
+
                 fmt::print("Starting Evaluation. This may take a while...\n");
-                fmt::print("Measuring sequential write bandwidth: ");
-                std::cout.flush();
-                io_rates write_bw;
                 size_t sequential_buffer_size = 1 << 20;
-                for (unsigned shard = 0; shard < smp::count; ++shard) {
-                    write_bw += iotune_tests.write_sequential_data(shard, sequential_buffer_size, duration * 0.70 / smp::count).get();
-                }
-                write_bw.bytes_per_sec /= smp::count;
-                rates = iotune_tests.get_serial_rates().get();
-                fmt::print("{} MiB/s{}\n", uint64_t(write_bw.bytes_per_sec / (1024 * 1024)), accuracy_msg());
+                auto write_bw = measure("sequential write bandwidth", "MiB/s", 1024 * 1024, stored_value(&disk_descriptor::write_bw), [&] (std::chrono::duration<double> d) {
+                    io_rates bw;
+                    for (unsigned shard = 0; shard < smp::count; ++shard) {
+                        bw += iotune_tests.write_sequential_data(shard, sequential_buffer_size, d * 0.70 / smp::count).get();
+                    }
+                    rates = iotune_tests.get_serial_rates().get();
+                    return bw.bytes_per_sec / smp::count;
+                });
 
                 std::optional<uint64_t> write_sat;
 
                 if (write_saturation) {
                     fmt::print("Measuring write saturation length: ");
                     std::cout.flush();
-                    write_sat = iotune_tests.saturate_write(write_bw.bytes_per_sec * (1.0 - rates.stdev_percents()), sequential_buffer_size/2, duration * 0.70).get();
+                    write_sat = iotune_tests.saturate_write(write_bw * (1.0 - rates.stdev_percents()), sequential_buffer_size/2, duration * 0.70).get();
                     fmt::print("{}\n", *write_sat);
+                } else if (stored) {
+                    write_sat = stored->write_sat_len;
                 }
 
-                fmt::print("Measuring sequential read bandwidth: ");
-                std::cout.flush();
-                auto read_bw = iotune_tests.read_sequential_data(0, sequential_buffer_size, duration * 0.1).get();
-                rates = iotune_tests.get_serial_rates().get();
-                fmt::print("{} MiB/s{}\n", uint64_t(read_bw.bytes_per_sec / (1024 * 1024)), accuracy_msg());
+                auto read_bw = measure("sequential read bandwidth", "MiB/s", 1024 * 1024, stored_value(&disk_descriptor::read_bw), [&] (std::chrono::duration<double> d) {
+                    auto bw = iotune_tests.read_sequential_data(0, sequential_buffer_size, d * 0.1).get();
+                    rates = iotune_tests.get_serial_rates().get();
+                    return bw.bytes_per_sec;
+                });
 
                 std::optional<uint64_t> read_sat;
 
                 if (read_saturation) {
                     fmt::print("Measuring read saturation length: ");
                     std::cout.flush();
-                    read_sat = iotune_tests.saturate_read(read_bw.bytes_per_sec * (1.0 - rates.stdev_percents()), sequential_buffer_size/2, duration * 0.1).get();
+                    read_sat = iotune_tests.saturate_read(read_bw * (1.0 - rates.stdev_percents()), sequential_buffer_size/2, duration * 0.1).get();
                     fmt::print("{}\n", *read_sat);
+                } else if (stored) {
+                    read_sat = stored->read_sat_len;
                 }
 
-                fmt::print("Measuring random write IOPS: ");
-                std::cout.flush();
-                auto write_iops = iotune_tests.write_random_data(test_directory.minimum_io_size(), duration * 0.1).get();
-                rates = iotune_tests.get_sharded_worst_rates().get();
-                fmt::print("{} IOPS{}\n", uint64_t(write_iops.iops), accuracy_msg());
+                auto write_iops = measure("random write IOPS", "IOPS", 1, stored_value(&disk_descriptor::write_iops), [&] (std::chrono::duration<double> d) {
+                    auto iops = iotune_tests.write_random_data(test_directory.minimum_io_size(), d * 0.1).get();
+                    rates = iotune_tests.get_sharded_worst_rates().get();
+                    return iops.iops;
+                });
 
-                fmt::print("Measuring random read IOPS: ");
-                std::cout.flush();
-                auto read_iops = iotune_tests.read_random_data(test_directory.minimum_io_size(), duration * 0.1).get();
-                rates = iotune_tests.get_sharded_worst_rates().get();
-                fmt::print("{} IOPS{}\n", uint64_t(read_iops.iops), accuracy_msg());
+                auto read_iops = measure("random read IOPS", "IOPS", 1, stored_value(&disk_descriptor::read_iops), [&] (std::chrono::duration<double> d) {
+                    auto iops = iotune_tests.read_random_data(test_directory.minimum_io_size(), d * 0.1).get();
+                    rates = iotune_tests.get_sharded_worst_rates().get();
+                    return iops.iops;
+                });
 
                 struct disk_descriptor desc;
+                if (stored) {
+                    desc.write_interference = stored->write_interference;
+                }
+                if (mixed && iotune_tests.max_per_shard_io_depth() >= 2) {
+                    // The cost model assumes that a mix of reads and writes
+                    // fills the disk when r/R + w/W reaches 1. When writes hurt
+                    // reads more than that, the saturated mix falls short, and
+                    // the factor by which writes need to be more expensive for
+                    // it to add up is the interference
+                    fmt::print("Measuring mixed random read/write IOPS:\n");
+                    float interference = 1.0;
+                    for (float write_share : { 0.25f, 0.5f, 0.75f }) {
+                        mixed_rates saturated;
+                        for (unsigned depth = 2; ; depth = std::min(depth * 2, iotune_tests.max_per_shard_io_depth())) {
+                            auto res = iotune_tests.mixed_random_data(test_directory.minimum_io_size(), write_share, depth, duration * 0.02).get();
+                            auto& p = desc.mixed_load.emplace_back(disk_descriptor::mixed_point{
+                                .write_share = write_share,
+                                .iodepth = depth,
+                                .read_iops = uint64_t(res.read.iops),
+                                .write_iops = uint64_t(res.write.iops),
+                                .read_p50 = res.read_latencies.quantile(0.5),
+                                .read_p99 = res.read_latencies.quantile(0.99),
+                                .write_p99 = res.write_latencies.quantile(0.99),
+                            });
+                            fmt::print("  {}% writes, iodepth {}: {} read IOPS (p50 {} usec, p99 {} usec), {} write IOPS (p99 {} usec)\n",
+                                    int(write_share * 100), depth, p.read_iops, p.read_p50, p.read_p99, p.write_iops, p.write_p99);
+                            saturated = std::move(res);
+                            if (depth == iotune_tests.max_per_shard_io_depth()) {
+                                break;
+                            }
+                        }
+                        if (saturated.write.iops > 0 && saturated.read.iops < read_iops) {
+                            auto factor = (1.0 - saturated.read.iops / read_iops) / (saturated.write.iops / write_iops);
+                            interference = std::max<float>(interference, factor);
+                        }
+                    }
+                    desc.write_interference = interference;
+                    fmt::print("Write interference factor: {:.2f}\n", interference);
+                }
+
+
                 desc.mountpoint = mountpoint;
-                desc.read_iops = read_iops.iops;
-                desc.read_bw = read_bw.bytes_per_sec;
+                desc.read_iops = read_iops;
+                desc.read_bw = read_bw;
                 desc.read_sat_len = read_sat;
-                desc.write_iops = write_iops.iops;
-                desc.write_bw = write_bw.bytes_per_sec;
+                desc.write_iops = write_iops;
+                desc.write_bw = write_bw;
                 desc.write_sat_len = write_sat;
                 disk_descriptors.push_back(std::move(desc));
             }
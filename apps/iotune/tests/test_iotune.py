@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+#
+# This file is open source software, licensed to you under the terms
+# of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+# distributed with this work for additional information regarding copyright
+# ownership.  You may not use this file except in compliance with the License.
+#
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+#
+# Copyright (C) 2024 Scylladb, Ltd.
+#
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import unittest
+import yaml
+
+
+VALUES = ('read_iops', 'read_bandwidth', 'write_iops', 'write_bandwidth')
+
+
+class TestQuickMode(unittest.TestCase):
+    iotune_path = None
+    # iotune needs a filesystem with good AIO support, which the default
+    # temporary directory may not be on
+    base_dir = None
+
+    def setUp(self) -> None:
+        self.dir = tempfile.TemporaryDirectory(dir=self.base_dir)
+        self.eval_dir = os.path.join(self.dir.name, 'eval')
+        os.makedirs(self.eval_dir)
+        self.properties = os.path.join(self.dir.name, 'io_properties.yaml')
+
+    def tearDown(self) -> None:
+        self.dir.cleanup()
+
+    def _iotune(self, *args: str) -> str:
+        res = subprocess.run([self.iotune_path, '--evaluation-directory', self.eval_dir,
+                              '--properties-file', self.properties, '--smp=1', *args],
+                             capture_output=True, text=True, timeout=300)
+        out = res.stdout + res.stderr
+        if 'AIO is not supported' in out:
+            self.skipTest(f'{self.eval_dir} does not support AIO')
+        self.assertEqual(res.returncode, 0, out)
+        return out
+
+    def _read_properties(self) -> dict:
+        with open(self.properties) as f:
+            disks = yaml.safe_load(f)['disks']
+        self.assertEqual(len(disks), 1)
+        return disks[0]
+
+    def _write_properties(self, disk: dict) -> None:
+        with open(self.properties, 'w') as f:
+            yaml.safe_dump({'disks': [disk]}, f)
+
+    def test_keeps_values_within_tolerance(self) -> None:
+        self._iotune('--duration', '2')
+        stored = self._read_properties()
+        # Whatever the probes find is within this tolerance
+        out = self._iotune('--quick', '--quick-duration', '1', '--tolerance', '1000000')
+        self.assertEqual(out.count('(stored, probed'), len(VALUES))
+        self.assertNotIn('re-measuring', out)
+        disk = self._read_properties()
+        for v in VALUES:
+            self.assertEqual(disk[v], stored[v])
+
+    def test_remeasures_diverging_values(self) -> None:
+        self._iotune('--duration', '2')
+        stored = self._read_properties()
+        # No disk does a million times what it did a moment ago
+        stored['write_iops'] *= 1000000
+        self._write_properties(stored)
+        out = self._iotune('--quick', '--quick-duration', '1', '--duration', '2', '--tolerance', '1000')
+        self.assertEqual(out.count('re-measuring'), 1)
+        self.assertEqual(out.count('(stored, probed'), len(VALUES) - 1)
+        disk = self._read_properties()
+        self.assertLess(disk['write_iops'], stored['write_iops'])
+        for v in ('read_iops', 'read_bandwidth', 'write_bandwidth'):
+            self.assertEqual(disk[v], stored[v])
+
+    def test_measures_everything_without_stored_values(self) -> None:
+        out = self._iotune('--quick', '--quick-duration', '1', '--duration', '2')
+        self.assertNotIn('(stored, probed', out)
+        self.assertNotIn('re-measuring', out)
+        disk = self._read_properties()
+        for v in VALUES:
+            self.assertGreater(disk[v], 0)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--iotune',
+                        required=True,
+                        help='Path to the iotune executable')
+    parser.add_argument('--base-dir',
+                        default='.',
+                        help='Directory in which to run the evaluation')
+    opts, remaining = parser.parse_known_args()
+    remaining.insert(0, sys.argv[0])
+    TestQuickMode.iotune_path = opts.iotune
+    TestQuickMode.base_dir = opts.base_dir
+    unittest.main(argv=remaining)
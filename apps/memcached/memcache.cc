@@ -23,6 +23,8 @@
 #include <boost/intrusive/list.hpp>
 #include <boost/intrusive_ptr.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/range/irange.hpp>
+#include <charconv>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -36,8 +38,10 @@
 #include <seastar/core/memory.hh>
 #include <seastar/core/units.hh>
 #include <seastar/core/distributed.hh>
+#include <seastar/core/sharded_router.hh>
 #include <seastar/core/vector-data-sink.hh>
 #include <seastar/core/bitops.hh>
+#include <seastar/core/byteorder.hh>
 #include <seastar/core/slab.hh>
 #include <seastar/core/align.hh>
 #include <seastar/core/print.hh>
@@ -316,6 +320,10 @@ struct cache_stats {
     size_t _resize_failure {};
     size_t _size {};
     size_t _reclaims{};
+    size_t _spill_items {};
+    size_t _spill_appended {};
+    size_t _spill_dropped {};
+    size_t _spill_hits {};
 
     void operator+=(const cache_stats& o) {
         _get_hits += o._get_hits;
@@ -337,6 +345,10 @@ struct cache_stats {
         _resize_failure += o._resize_failure;
         _size += o._size;
         _reclaims += o._reclaims;
+        _spill_items += o._spill_items;
+        _spill_appended += o._spill_appended;
+        _spill_dropped += o._spill_dropped;
+        _spill_hits += o._spill_hits;
     }
 };
 
@@ -367,6 +379,256 @@ struct item_insertion_data {
     expiration expiry;
 };
 
+struct spill_config {
+    // directory of the per-shard log files; empty disables the second tier
+    sstring dir;
+    // size of the log of each shard
+    uint64_t size = 0;
+    // writes to the logs run in this group, and so in its I/O class
+    scheduling_group sg;
+};
+
+//
+// The second tier of the cache. Items evicted from memory are appended to a
+// per-shard log file, and looking one up reads it back to memory.
+//
+// Items are packed into segments of a memory buffer, each written to the
+// file in the background once full. The file is used as a ring of segments:
+// reusing a segment drops the items still indexed in it, so items leave the
+// log in the order they entered it. Items which can't be written because
+// too many segments are being written are dropped too.
+//
+// The file isn't meant to outlive the process: records hold clock_type time
+// points, and the index only lives in memory.
+//
+class item_log {
+public:
+    struct record {
+        item_key key;
+        sstring ascii_prefix;
+        sstring data;
+        expiration expiry;
+        item::version_type version;
+    };
+private:
+    static constexpr size_t segment_size = 1 << 20;
+    static constexpr size_t max_writes = 4;
+    static constexpr size_t record_alignment = 8;
+
+    struct record_header {
+        // of the record, header included
+        uint32_t size;
+        uint32_t value_size;
+        uint8_t key_size;
+        uint8_t ascii_prefix_size;
+        item::version_type version;
+        clock_type::duration::rep expiry;
+    };
+
+    struct location {
+        // in the log, which wraps around the file
+        uint64_t pos;
+        uint32_t size;
+    };
+
+    struct key_hash {
+        size_t operator()(const item_key& key) const {
+            return key.hash();
+        }
+    };
+
+    sstring _path;
+    file _file;
+    uint64_t _segments;
+    scheduling_group _sg;
+    std::unordered_map<item_key, location, key_hash> _index;
+    // the keys appended to each segment of the file
+    std::vector<std::vector<sstring>> _segment_keys;
+    // the segment being filled, and its position in the log
+    temporary_buffer<char> _current;
+    uint64_t _current_segment = 0;
+    size_t _current_used = 0;
+    // the segments being written, by position in the log
+    std::unordered_map<uint64_t, temporary_buffer<char>> _writing;
+    gate _gate;
+    uint64_t _appended = 0;
+    uint64_t _dropped = 0;
+private:
+    // Unindexes the items still pointing into a segment which is reused,
+    // or couldn't be written
+    void drop_segment_keys(uint64_t segment) {
+        auto& keys = _segment_keys[segment % _segments];
+        for (auto& k : keys) {
+            auto i = _index.find(item_key(std::move(k)));
+            if (i != _index.end() && i->second.pos / segment_size == segment) {
+                _index.erase(i);
+            }
+        }
+        keys.clear();
+    }
+
+    // Starts writing the current segment and moves to the next one, if
+    // not too many writes are in flight already
+    bool seal() {
+        if (_writing.size() >= max_writes || _gate.is_closed()) {
+            return false;
+        }
+        auto segment = _current_segment;
+        auto buf = std::exchange(_current, temporary_buffer<char>::aligned(_file.memory_dma_alignment(), segment_size));
+        std::memset(buf.get_write() + _current_used, 0, segment_size - _current_used);
+        auto data = buf.get();
+        _writing.emplace(segment, std::move(buf));
+        _current_segment++;
+        _current_used = 0;
+        if (_current_segment >= _segments) {
+            drop_segment_keys(_current_segment - _segments);
+        }
+        (void)with_gate(_gate, [this, segment, data] {
+            return with_scheduling_group(_sg, [this, segment, data] {
+                return _file.dma_write(segment % _segments * segment_size, data, segment_size);
+            }).handle_exception([] (std::exception_ptr) {
+                return size_t(0);
+            }).then([this, segment] (size_t written) {
+                if (written != segment_size) {
+                    drop_segment_keys(segment);
+                }
+                _writing.erase(segment);
+            });
+        });
+        return true;
+    }
+
+    static std::optional<record> parse(const char* p, location loc, const item_key& key) {
+        record_header h;
+        std::memcpy(&h, p, sizeof(h));
+        if (h.size != loc.size || h.key_size != key.key().size() ||
+                std::string_view(p + sizeof(h), h.key_size) != key.key()) {
+            return std::nullopt;
+        }
+        p += sizeof(h) + h.key_size;
+        record r {
+            .key = item_key(key.key()),
+            .ascii_prefix = sstring(p, h.ascii_prefix_size),
+            .data = sstring(p + h.ascii_prefix_size, h.value_size),
+            .version = h.version,
+        };
+        r.expiry._time = clock_type::time_point(clock_type::duration(h.expiry));
+        return r;
+    }
+public:
+    item_log(sstring path, uint64_t size, scheduling_group sg)
+        : _path(std::move(path))
+        , _segments(std::max(size / segment_size, uint64_t(max_writes + 1)))
+        , _sg(sg)
+        , _segment_keys(_segments)
+    {}
+
+    future<> open() {
+        return open_file_dma(_path, open_flags::rw | open_flags::create | open_flags::truncate).then([this] (file f) {
+            _file = std::move(f);
+            _current = temporary_buffer<char>::aligned(_file.memory_dma_alignment(), segment_size);
+            return _file.truncate(_segments * segment_size);
+        });
+    }
+
+    future<> close() {
+        return _gate.close().then([this] {
+            return _file.close();
+        }).then([this] {
+            return remove_file(_path);
+        });
+    }
+
+    void append(item& item_ref) {
+        auto key = item_ref.key();
+        auto prefix = item_ref.ascii_prefix();
+        auto value = item_ref.value();
+        auto size = align_up(sizeof(record_header) + key.size() + prefix.size() + value.size(), record_alignment);
+        if (size > segment_size || (_current_used + size > segment_size && !seal())) {
+            _dropped++;
+            return;
+        }
+        record_header h {
+            .size = uint32_t(size),
+            .value_size = uint32_t(value.size()),
+            .key_size = uint8_t(key.size()),
+            .ascii_prefix_size = uint8_t(prefix.size()),
+            .version = item_ref.version(),
+            .expiry = item_ref.get_timeout().time_since_epoch().count(),
+        };
+        auto p = _current.get_write() + _current_used;
+        std::memcpy(p, &h, sizeof(h));
+        p += sizeof(h);
+        p = std::copy(key.begin(), key.end(), p);
+        p = std::copy(prefix.begin(), prefix.end(), p);
+        std::copy(value.begin(), value.end(), p);
+        sstring k(key);
+        _index.insert_or_assign(item_key(k), location{_current_segment * segment_size + _current_used, uint32_t(size)});
+        _segment_keys[_current_segment % _segments].push_back(std::move(k));
+        _current_used += size;
+        _appended++;
+    }
+
+    bool contains(const item_key& key) const {
+        return _index.contains(key);
+    }
+
+    void erase(const item_key& key) {
+        _index.erase(key);
+    }
+
+    void clear() {
+        _index.clear();
+    }
+
+    // Reads the item back and removes it from the log. Returns nothing if
+    // the item isn't there, or was removed or written again meanwhile.
+    //
+    // The caller must keep @key live until the resulting future resolves.
+    future<std::optional<record>> take(const item_key& key) {
+        auto i = _index.find(key);
+        if (i == _index.end()) {
+            return make_ready_future<std::optional<record>>();
+        }
+        auto loc = i->second;
+        auto still_there = [this, &key, loc] {
+            auto i = _index.find(key);
+            if (i == _index.end() || i->second.pos != loc.pos) {
+                return false;
+            }
+            _index.erase(i);
+            return true;
+        };
+        auto segment = loc.pos / segment_size;
+        auto offset = loc.pos % segment_size;
+        if (segment == _current_segment) {
+            still_there();
+            return make_ready_future<std::optional<record>>(parse(_current.get() + offset, loc, key));
+        }
+        if (auto w = _writing.find(segment); w != _writing.end()) {
+            still_there();
+            return make_ready_future<std::optional<record>>(parse(w->second.get() + offset, loc, key));
+        }
+        return _file.dma_read_exactly<char>(segment % _segments * segment_size + offset, loc.size).then(
+                [&key, loc, still_there = std::move(still_there)] (temporary_buffer<char> buf) -> std::optional<record> {
+            if (!still_there()) {
+                return std::nullopt;
+            }
+            return parse(buf.get(), loc, key);
+        });
+    }
+
+    size_t size() const {
+        return _index.size();
+    }
+    uint64_t appended() const {
+        return _appended;
+    }
+    uint64_t dropped() const {
+        return _dropped;
+    }
+};
+
 class cache {
 private:
     using cache_type = bi::unordered_set<item,
@@ -385,6 +647,7 @@ class cache {
     clock_type::duration _wc_to_clock_type_delta;
     cache_stats _stats;
     timer<clock_type> _flush_timer;
+    std::unique_ptr<item_log> _log;
 private:
     size_t item_size(item& item_ref) {
         constexpr size_t field_alignment = alignof(void*);
@@ -480,10 +743,13 @@ class cache {
 
     template <typename Origin>
     inline
-    void add_new(item_insertion_data& insertion) {
+    void add_new(item_insertion_data& insertion, item::version_type version = 1) {
+        if (_log) {
+            _log->erase(insertion.key);
+        }
         size_t size = item_size(insertion);
         auto new_item = slab->create(size, Origin::move_if_local(insertion.key), Origin::move_if_local(insertion.ascii_prefix),
-            Origin::move_if_local(insertion.data), insertion.expiry);
+            Origin::move_if_local(insertion.data), insertion.expiry, version);
         intrusive_ptr_add_ref(new_item);
         auto& item_ref = *new_item;
         _cache.insert(item_ref);
@@ -508,8 +774,34 @@ class cache {
             _resize_up_threshold = _cache.bucket_count() * load_factor;
         }
     }
+
+    void evict(item& item_ref) {
+        if (_log && (!item_ref._expiry.ever_expires() || item_ref.get_timeout() > clock_type::now())) {
+            _log->append(item_ref);
+        }
+        erase<true, true, false>(item_ref);
+        _stats._evicted++;
+    }
+
+    // Moves the item back to memory, if it was spilled to the log
+    future<> load(const item_key& key) {
+        return _log->take(key).then([this] (std::optional<item_log::record> r) {
+            if (!r || find(r->key) != _cache.end() ||
+                    (r->expiry.ever_expires() && r->expiry.to_time_point() <= clock_type::now())) {
+                return;
+            }
+            _stats._spill_hits++;
+            item_insertion_data insertion {
+                .key = std::move(r->key),
+                .ascii_prefix = std::move(r->ascii_prefix),
+                .data = std::move(r->data),
+                .expiry = r->expiry
+            };
+            add_new<local_origin_tag>(insertion, r->version);
+        });
+    }
 public:
-    cache(uint64_t per_cpu_slab_size, uint64_t slab_page_size)
+    cache(uint64_t per_cpu_slab_size, uint64_t slab_page_size, spill_config spill)
         : _buckets(initial_bucket_count)
         , _cache(cache_type::bucket_traits(_buckets.data(), initial_bucket_count))
     {
@@ -523,8 +815,11 @@ class cache {
 
         // initialize per-thread slab allocator.
         slab_holder = std::make_unique<slab_allocator<item>>(default_slab_growth_factor, per_cpu_slab_size, slab_page_size,
-                [this](item& item_ref) { erase<true, true, false>(item_ref); _stats._evicted++; });
+                [this](item& item_ref) { evict(item_ref); });
         slab = slab_holder.get();
+        if (!spill.dir.empty()) {
+            _log = std::make_unique<item_log>(format("{}/memcached-{}.log", spill.dir, this_shard_id()), spill.size, spill.sg);
+        }
 #ifdef __DEBUG__
         static bool print_slab_classes = true;
         if (print_slab_classes) {
@@ -538,8 +833,44 @@ class cache {
        flush_all();
     }
 
+    future<> start() {
+        return _log ? _log->open() : make_ready_future<>();
+    }
+
+    // Runs @func once the item with @key is in memory, if it was spilled
+    // to the log. The caller must keep @key live until the resulting
+    // future resolves.
+    template <typename Func>
+    futurize_t<std::invoke_result_t<Func>> with_loaded(const item_key& key, Func func) {
+        if (!_log || !_log->contains(key)) {
+            return futurize_invoke(func);
+        }
+        return load(key).then(std::move(func));
+    }
+
+    // The caller must keep @keys live until the resulting future resolves.
+    future<std::vector<item_ptr>> get_multi(const std::vector<item_key>& keys, const std::vector<uint32_t>& indices) {
+        auto get_all = [this, &keys, &indices] {
+            std::vector<item_ptr> found;
+            found.reserve(indices.size());
+            for (auto i : indices) {
+                found.push_back(get(keys[i]));
+            }
+            return found;
+        };
+        if (!_log) {
+            return make_ready_future<std::vector<item_ptr>>(get_all());
+        }
+        return parallel_for_each(indices, [this, &keys] (uint32_t i) {
+            return with_loaded(keys[i], [] {});
+        }).then(std::move(get_all));
+    }
+
     void flush_all() {
         _flush_timer.cancel();
+        if (_log) {
+            _log->clear();
+        }
         _cache.erase_and_dispose(_cache.begin(), _cache.end(), [this] (item* it) {
             erase<false, true>(*it);
         });
@@ -591,6 +922,11 @@ class cache {
     bool remove(const item_key& key) {
         auto i = find(key);
         if (i == _cache.end()) {
+            if (_log && _log->contains(key)) {
+                _log->erase(key);
+                _stats._delete_hits++;
+                return true;
+            }
             _stats._delete_misses++;
             return false;
         }
@@ -638,6 +974,11 @@ class cache {
 
     cache_stats stats() {
         _stats._size = size();
+        if (_log) {
+            _stats._spill_items = _log->size();
+            _stats._spill_appended = _log->appended();
+            _stats._spill_dropped = _log->dropped();
+        }
         return _stats;
     }
 
@@ -728,7 +1069,9 @@ class cache {
         return {this_shard_id(), make_foreign(make_lw_shared<std::string>(ss.str()))};
     }
 
-    future<> stop() { return make_ready_future<>(); }
+    future<> stop() {
+        return _log ? _log->close() : make_ready_future<>();
+    }
     clock_type::duration get_wc_to_clock_type_delta() { return _wc_to_clock_type_delta; }
 };
 
@@ -736,9 +1079,12 @@ class sharded_cache {
 private:
     distributed<cache>& _peers;
 
+    // Jump hashing places the keys as evenly as modulo does, and would keep
+    // most of them on their shard if the shards kept their items across a
+    // change of their number
     inline
     unsigned get_cpu(const item_key& key) {
-        return std::hash<item_key>()(key) % smp::count;
+        return jump_consistent_hash(std::hash<item_key>()(key), smp::count);
     }
 public:
     sharded_cache(distributed<cache>& peers) : _peers(peers) {}
@@ -766,18 +1112,24 @@ class sharded_cache {
     future<bool> add(item_insertion_data& insertion) {
         auto cpu = get_cpu(insertion.key);
         if (this_shard_id() == cpu) {
-            return make_ready_future<bool>(_peers.local().add(insertion));
+            auto& c = _peers.local();
+            return c.with_loaded(insertion.key, [&c, &insertion] { return c.add(insertion); });
         }
-        return _peers.invoke_on(cpu, &cache::add<remote_origin_tag>, std::ref(insertion));
+        return _peers.invoke_on(cpu, [&insertion] (cache& c) {
+            return c.with_loaded(insertion.key, [&c, &insertion] { return c.add<remote_origin_tag>(insertion); });
+        });
     }
 
     // The caller must keep @insertion live until the resulting future resolves.
     future<bool> replace(item_insertion_data& insertion) {
         auto cpu = get_cpu(insertion.key);
         if (this_shard_id() == cpu) {
-            return make_ready_future<bool>(_peers.local().replace(insertion));
+            auto& c = _peers.local();
+            return c.with_loaded(insertion.key, [&c, &insertion] { return c.replace(insertion); });
         }
-        return _peers.invoke_on(cpu, &cache::replace<remote_origin_tag>, std::ref(insertion));
+        return _peers.invoke_on(cpu, [&insertion] (cache& c) {
+            return c.with_loaded(insertion.key, [&c, &insertion] { return c.replace<remote_origin_tag>(insertion); });
+        });
     }
 
     // The caller must keep @key live until the resulting future resolves.
@@ -789,16 +1141,57 @@ class sharded_cache {
     // The caller must keep @key live until the resulting future resolves.
     future<item_ptr> get(const item_key& key) {
         auto cpu = get_cpu(key);
-        return _peers.invoke_on(cpu, &cache::get, std::ref(key));
+        return _peers.invoke_on(cpu, [&key] (cache& c) {
+            return c.with_loaded(key, [&c, &key] { return c.get(key); });
+        });
+    }
+
+    // Looks up several keys with one message per shard owning any of them,
+    // rather than one per key. The items are returned in the order of @keys,
+    // null where a key was not found.
+    //
+    // The caller must keep @keys live until the resulting future resolves.
+    future<std::vector<item_ptr>> get_multi(const std::vector<item_key>& keys) {
+        if (keys.size() == 1) {
+            return get(keys[0]).then([] (item_ptr item) {
+                std::vector<item_ptr> items;
+                items.push_back(std::move(item));
+                return items;
+            });
+        }
+        std::vector<std::vector<uint32_t>> indices(smp::count);
+        for (uint32_t i = 0; i < keys.size(); i++) {
+            indices[get_cpu(keys[i])].push_back(i);
+        }
+        return do_with(std::move(indices), std::vector<item_ptr>(keys.size()),
+                [this, &keys] (std::vector<std::vector<uint32_t>>& indices, std::vector<item_ptr>& items) {
+            return parallel_for_each(boost::irange(0u, smp::count), [this, &keys, &indices, &items] (unsigned cpu) {
+                if (indices[cpu].empty()) {
+                    return make_ready_future<>();
+                }
+                return _peers.invoke_on(cpu, [&keys, &idx = indices[cpu]] (cache& c) {
+                    return c.get_multi(keys, idx);
+                }).then([&idx = indices[cpu], &items] (std::vector<item_ptr> found) {
+                    for (size_t i = 0; i < idx.size(); i++) {
+                        items[idx[i]] = std::move(found[i]);
+                    }
+                });
+            }).then([&items] {
+                return std::move(items);
+            });
+        });
     }
 
     // The caller must keep @insertion live until the resulting future resolves.
     future<cas_result> cas(item_insertion_data& insertion, item::version_type version) {
         auto cpu = get_cpu(insertion.key);
         if (this_shard_id() == cpu) {
-            return make_ready_future<cas_result>(_peers.local().cas(insertion, version));
+            auto& c = _peers.local();
+            return c.with_loaded(insertion.key, [&c, &insertion, version] { return c.cas(insertion, version); });
         }
-        return _peers.invoke_on(cpu, &cache::cas<remote_origin_tag>, std::ref(insertion), std::move(version));
+        return _peers.invoke_on(cpu, [&insertion, version] (cache& c) {
+            return c.with_loaded(insertion.key, [&c, &insertion, version] { return c.cas<remote_origin_tag>(insertion, version); });
+        });
     }
 
     future<cache_stats> stats() {
@@ -809,20 +1202,24 @@ class sharded_cache {
     future<std::pair<item_ptr, bool>> incr(item_key& key, uint64_t delta) {
         auto cpu = get_cpu(key);
         if (this_shard_id() == cpu) {
-            return make_ready_future<std::pair<item_ptr, bool>>(
-                _peers.local().incr<local_origin_tag>(key, delta));
+            auto& c = _peers.local();
+            return c.with_loaded(key, [&c, &key, delta] { return c.incr<local_origin_tag>(key, delta); });
         }
-        return _peers.invoke_on(cpu, &cache::incr<remote_origin_tag>, std::ref(key), std::move(delta));
+        return _peers.invoke_on(cpu, [&key, delta] (cache& c) {
+            return c.with_loaded(key, [&c, &key, delta] { return c.incr<remote_origin_tag>(key, delta); });
+        });
     }
 
     // The caller must keep @key live until the resulting future resolves.
     future<std::pair<item_ptr, bool>> decr(item_key& key, uint64_t delta) {
         auto cpu = get_cpu(key);
         if (this_shard_id() == cpu) {
-            return make_ready_future<std::pair<item_ptr, bool>>(
-                _peers.local().decr(key, delta));
+            auto& c = _peers.local();
+            return c.with_loaded(key, [&c, &key, delta] { return c.decr(key, delta); });
         }
-        return _peers.invoke_on(cpu, &cache::decr<remote_origin_tag>, std::ref(key), std::move(delta));
+        return _peers.invoke_on(cpu, [&key, delta] (cache& c) {
+            return c.with_loaded(key, [&c, &key, delta] { return c.decr<remote_origin_tag>(key, delta); });
+        });
     }
 
     future<> print_hash_stats(output_stream<char>& out) {
@@ -871,7 +1268,6 @@ class ascii_protocol {
     memcache_ascii_parser _parser;
     item_key _item_key;
     item_insertion_data _insertion;
-    std::vector<item_ptr> _items;
 private:
     static constexpr const char *msg_crlf = "\r\n";
     static constexpr const char *msg_error = "ERROR\r\n";
@@ -920,14 +1316,9 @@ class ascii_protocol {
                 return out.write(std::move(msg));
             });
         } else {
-            _items.clear();
-            return parallel_for_each(_parser._keys.begin(), _parser._keys.end(), [this] (const auto& key) {
-                return _cache.get(key).then([this] (auto item) {
-                    _items.emplace_back(std::move(item));
-                });
-            }).then([this, &out] () {
+            return _cache.get_multi(_parser._keys).then([&out] (std::vector<item_ptr> items) {
                 scattered_message<char> msg;
-                for (auto& item : _items) {
+                for (auto& item : items) {
                     append_item<WithVersion>(msg, std::move(item));
                 }
                 msg.append_static(msg_end);
@@ -1021,6 +1412,14 @@ class ascii_protocol {
                             return print_stat(out, "evictions", v);
                         }).then([&out, v = all_cache_stats._bytes] {
                             return print_stat(out, "bytes", v);
+                        }).then([&out, v = all_cache_stats._spill_items] {
+                            return print_stat(out, "seastar.spill_items", v);
+                        }).then([&out, v = all_cache_stats._spill_appended] {
+                            return print_stat(out, "seastar.spill_appended", v);
+                        }).then([&out, v = all_cache_stats._spill_dropped] {
+                            return print_stat(out, "seastar.spill_dropped", v);
+                        }).then([&out, v = all_cache_stats._spill_hits] {
+                            return print_stat(out, "seastar.spill_hits", v);
                         }).then([&out] {
                             return out.write(msg_end);
                         });
@@ -1220,6 +1619,414 @@ class ascii_protocol {
     };
 };
 
+// The binary protocol, as described in
+// https://github.com/memcached/memcached/wiki/BinaryProtocolRevamped
+//
+// Quiet gets (getq, getkq) are not answered right away: the keys of a run of
+// them are looked up together, with one message per shard, when the first
+// other command arrives. Clients pipelining a multi-get usually end the run
+// with a noop or a non-quiet get.
+class binary_protocol {
+public:
+    static constexpr uint8_t magic_request = 0x80;
+private:
+    using this_type = binary_protocol;
+    static constexpr uint8_t magic_response = 0x81;
+    static constexpr size_t header_size = 24;
+    // bounds the memory held by a run of quiet gets
+    static constexpr size_t max_pending_gets = 1024;
+    // bounds the memory a request is read into: memcached's default item
+    // size limit, and room for the key and extras
+    static constexpr uint32_t max_body_length = (1 << 20) + 512;
+
+    enum opcode : uint8_t {
+        op_get = 0x00,
+        op_set = 0x01,
+        op_add = 0x02,
+        op_replace = 0x03,
+        op_delete = 0x04,
+        op_increment = 0x05,
+        op_decrement = 0x06,
+        op_quit = 0x07,
+        op_flush = 0x08,
+        op_getq = 0x09,
+        op_noop = 0x0a,
+        op_version = 0x0b,
+        op_getk = 0x0c,
+        op_getkq = 0x0d,
+        op_setq = 0x11,
+        op_addq = 0x12,
+        op_replaceq = 0x13,
+        op_deleteq = 0x14,
+        op_incrementq = 0x15,
+        op_decrementq = 0x16,
+        op_quitq = 0x17,
+        op_flushq = 0x18,
+    };
+
+    enum status : uint16_t {
+        status_no_error = 0x0000,
+        status_key_not_found = 0x0001,
+        status_key_exists = 0x0002,
+        status_value_too_large = 0x0003,
+        status_invalid_arguments = 0x0004,
+        status_item_not_stored = 0x0005,
+        status_non_numeric_value = 0x0006,
+        status_unknown_command = 0x0081,
+        status_out_of_memory = 0x0082,
+    };
+
+    struct request {
+        uint8_t opcode;
+        uint8_t extras_length;
+        uint16_t key_length;
+        uint32_t body_length;
+        uint32_t opaque;
+        uint64_t cas;
+        temporary_buffer<char> body;
+
+        std::string_view extras() const {
+            return std::string_view(body.get(), extras_length);
+        }
+        std::string_view key() const {
+            return std::string_view(body.get() + extras_length, key_length);
+        }
+        std::string_view value() const {
+            return std::string_view(body.get() + extras_length + key_length, body_length - extras_length - key_length);
+        }
+    };
+
+    struct pending_get {
+        uint8_t opcode;
+        uint32_t opaque;
+    };
+
+    sharded_cache& _cache;
+    distributed<system_stats>& _system_stats;
+    item_key _item_key;
+    item_insertion_data _insertion;
+    // quiet gets not answered yet, and the keys they look up
+    std::vector<pending_get> _gets;
+    std::vector<item_key> _keys;
+    bool _quit = false;
+private:
+    static bool is_quiet(uint8_t op) {
+        switch (op) {
+        case op_getq: case op_getkq: case op_setq: case op_addq: case op_replaceq:
+        case op_deleteq: case op_incrementq: case op_decrementq: case op_quitq: case op_flushq:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static sstring make_header(uint8_t op, uint16_t st, uint32_t opaque, uint64_t cas,
+            size_t key_length, size_t extras_length, size_t value_length) {
+        auto header = uninitialized_string(header_size + extras_length);
+        auto p = header.data();
+        p[0] = magic_response;
+        p[1] = op;
+        write_be<uint16_t>(p + 2, key_length);
+        p[4] = extras_length;
+        p[5] = 0;
+        write_be<uint16_t>(p + 6, st);
+        write_be<uint32_t>(p + 8, key_length + extras_length + value_length);
+        write_be<uint32_t>(p + 12, opaque);
+        write_be<uint64_t>(p + 16, cas);
+        return header;
+    }
+
+    static future<> respond(output_stream<char>& out, uint8_t op, uint32_t opaque, uint16_t st,
+            uint64_t cas = 0, std::string_view value = {}) {
+        auto response = make_header(op, st, opaque, cas, 0, 0, value.size());
+        response.append(value.data(), value.size());
+        return out.write(std::move(response));
+    }
+
+    // The flags are kept as text, in the ascii prefix of the item: " <flags> <size>"
+    static uint32_t item_flags(const item& it) {
+        auto prefix = it.ascii_prefix();
+        uint32_t flags = 0;
+        std::from_chars(prefix.data() + 1, prefix.data() + prefix.size(), flags);
+        return flags;
+    }
+
+    static void append_item(scattered_message<char>& msg, const pending_get& get, const item_key& key, item_ptr item) {
+        bool with_key = get.opcode == op_getk || get.opcode == op_getkq;
+        if (!item) {
+            if (!is_quiet(get.opcode)) {
+                auto k = with_key ? key.key() : sstring();
+                msg.append(make_header(get.opcode, status_key_not_found, get.opaque, 0, k.size(), 0, 0) + k);
+            }
+            return;
+        }
+        auto k = with_key ? item->key() : std::string_view();
+        auto header = make_header(get.opcode, status_no_error, get.opaque, item->version(), k.size(), 4, item->value_size());
+        write_be<uint32_t>(header.data() + header_size, item_flags(*item));
+        msg.append(std::move(header));
+        msg.append_static(k);
+        msg.append_static(item->value());
+        msg.on_delete([item = std::move(item)] {});
+    }
+
+    // Answers the pending gets, in the order they were received
+    future<> run_gets(output_stream<char>& out) {
+        if (_gets.empty()) {
+            return make_ready_future<>();
+        }
+        _system_stats.local()._cmd_get += _gets.size();
+        return _cache.get_multi(_keys).then([this, &out] (std::vector<item_ptr> items) {
+            scattered_message<char> msg;
+            for (size_t i = 0; i < items.size(); i++) {
+                append_item(msg, _gets[i], _keys[i], std::move(items[i]));
+            }
+            _gets.clear();
+            _keys.clear();
+            if (!msg.size()) {
+                return make_ready_future<>();
+            }
+            return out.write(std::move(msg));
+        });
+    }
+
+    void prepare_insertion(const request& req) {
+        auto value = req.value();
+        _insertion = item_insertion_data{
+            .key = item_key(sstring(req.key())),
+            .ascii_prefix = make_sstring(" ", to_sstring(read_be<uint32_t>(req.extras().data())), " ", to_sstring(value.size())),
+            .data = sstring(value),
+            .expiry = expiration(_cache.get_wc_to_clock_type_delta(), read_be<uint32_t>(req.extras().data() + 4))
+        };
+    }
+
+    future<> handle_store(const request& req, output_stream<char>& out) {
+        auto op = req.opcode;
+        auto opaque = req.opaque;
+        if (req.extras_length != 8 || req.key_length == 0) {
+            return respond(out, op, opaque, status_invalid_arguments);
+        }
+        _system_stats.local()._cmd_set++;
+        prepare_insertion(req);
+        future<uint16_t> f = make_ready_future<uint16_t>(status_no_error);
+        if (req.cas) {
+            f = _cache.cas(_insertion, req.cas).then([] (cas_result result) {
+                switch (result) {
+                case cas_result::stored:
+                    return uint16_t(status_no_error);
+                case cas_result::not_found:
+                    return uint16_t(status_key_not_found);
+                case cas_result::bad_version:
+                    return uint16_t(status_key_exists);
+                default:
+                    std::abort();
+                }
+            });
+        } else if (op == op_set || op == op_setq) {
+            f = _cache.set(_insertion).then([] (bool) { return uint16_t(status_no_error); });
+        } else if (op == op_add || op == op_addq) {
+            f = _cache.add(_insertion).then([] (bool added) {
+                return uint16_t(added ? status_no_error : status_key_exists);
+            });
+        } else {
+            f = _cache.replace(_insertion).then([] (bool replaced) {
+                return uint16_t(replaced ? status_no_error : status_key_not_found);
+            });
+        }
+        return std::move(f).then([&out, op, opaque] (uint16_t st) {
+            if (st == status_no_error && is_quiet(op)) {
+                return make_ready_future<>();
+            }
+            return respond(out, op, opaque, st);
+        });
+    }
+
+    future<> handle_arithmetic(const request& req, output_stream<char>& out) {
+        auto op = req.opcode;
+        auto opaque = req.opaque;
+        if (req.extras_length != 20 || req.key_length == 0) {
+            return respond(out, op, opaque, status_invalid_arguments);
+        }
+        auto extras = req.extras().data();
+        auto delta = read_be<uint64_t>(extras);
+        auto initial = read_be<uint64_t>(extras + 8);
+        auto exptime = read_be<uint32_t>(extras + 16);
+        _item_key = item_key(sstring(req.key()));
+        auto f = (op == op_increment || op == op_incrementq) ? _cache.incr(_item_key, delta) : _cache.decr(_item_key, delta);
+        return std::move(f).then([this, &out, op, opaque, initial, exptime] (std::pair<item_ptr, bool> result) {
+            auto& item = result.first;
+            if (item && !result.second) {
+                return respond(out, op, opaque, status_non_numeric_value);
+            }
+            if (item) {
+                if (is_quiet(op)) {
+                    return make_ready_future<>();
+                }
+                char value[8];
+                write_be<uint64_t>(value, item->data_as_integral().value_or(0));
+                return respond(out, op, opaque, status_no_error, item->version(), std::string_view(value, sizeof(value)));
+            }
+            // A miss creates the counter, unless the expiration is all ones
+            if (exptime == 0xffffffff) {
+                return respond(out, op, opaque, status_key_not_found);
+            }
+            auto data = to_sstring(initial);
+            _insertion = item_insertion_data{
+                .key = std::move(_item_key),
+                .ascii_prefix = make_sstring(" 0 ", to_sstring(data.size())),
+                .data = std::move(data),
+                .expiry = expiration(_cache.get_wc_to_clock_type_delta(), exptime)
+            };
+            return _cache.add(_insertion).then([&out, op, opaque, initial] (bool added) {
+                if (!added) {
+                    // lost a race with another client creating it
+                    return respond(out, op, opaque, status_item_not_stored);
+                }
+                if (is_quiet(op)) {
+                    return make_ready_future<>();
+                }
+                char value[8];
+                write_be<uint64_t>(value, initial);
+                return respond(out, op, opaque, status_no_error, 0, std::string_view(value, sizeof(value)));
+            });
+        });
+    }
+
+    future<> handle_command(const request& req, output_stream<char>& out) {
+        auto op = req.opcode;
+        auto opaque = req.opaque;
+        switch (op) {
+        case op_set: case op_setq:
+        case op_add: case op_addq:
+        case op_replace: case op_replaceq:
+            return handle_store(req, out);
+
+        case op_delete: case op_deleteq:
+        {
+            if (req.key_length == 0) {
+                return respond(out, op, opaque, status_invalid_arguments);
+            }
+            _item_key = item_key(sstring(req.key()));
+            return _cache.remove(_item_key).then([&out, op, opaque] (bool removed) {
+                if (removed && is_quiet(op)) {
+                    return make_ready_future<>();
+                }
+                return respond(out, op, opaque, removed ? status_no_error : status_key_not_found);
+            });
+        }
+
+        case op_increment: case op_incrementq:
+        case op_decrement: case op_decrementq:
+            return handle_arithmetic(req, out);
+
+        case op_flush: case op_flushq:
+        {
+            _system_stats.local()._cmd_flush++;
+            uint32_t exptime = req.extras_length == 4 ? read_be<uint32_t>(req.extras().data()) : 0;
+            auto f = exptime ? _cache.flush_at(exptime) : _cache.flush_all();
+            return std::move(f).then([&out, op, opaque] {
+                if (is_quiet(op)) {
+                    return make_ready_future<>();
+                }
+                return respond(out, op, opaque, status_no_error);
+            });
+        }
+
+        case op_noop:
+            return respond(out, op, opaque, status_no_error);
+
+        case op_version:
+            return respond(out, op, opaque, status_no_error, 0, VERSION_STRING);
+
+        case op_quit: case op_quitq:
+            _quit = true;
+            if (is_quiet(op)) {
+                return make_ready_future<>();
+            }
+            return respond(out, op, opaque, status_no_error);
+
+        default:
+            return respond(out, op, opaque, status_unknown_command);
+        }
+    }
+
+    future<> handle_request(request req, output_stream<char>& out) {
+        if (size_t(req.extras_length) + req.key_length > req.body_length) {
+            return run_gets(out).then([&out, op = req.opcode, opaque = req.opaque] {
+                return respond(out, op, opaque, status_invalid_arguments);
+            });
+        }
+        switch (req.opcode) {
+        case op_get: case op_getq:
+        case op_getk: case op_getkq:
+            _gets.push_back(pending_get{req.opcode, req.opaque});
+            _keys.emplace_back(sstring(req.key()));
+            if (is_quiet(req.opcode) && _gets.size() < max_pending_gets) {
+                return make_ready_future<>();
+            }
+            return run_gets(out);
+        default:
+            return run_gets(out).then([this, &out, req = std::move(req)] {
+                return handle_command(req, out);
+            });
+        }
+    }
+public:
+    binary_protocol(sharded_cache& cache, distributed<system_stats>& system_stats)
+        : _cache(cache)
+        , _system_stats(system_stats)
+    {}
+
+    // Set after a quit command, or a request the protocol can't make
+    // sense of; the connection should be closed
+    bool quit() const {
+        return _quit;
+    }
+
+    future<> handle(input_stream<char>& in, output_stream<char>& out) {
+        return in.read_exactly(header_size).then([this, &in, &out] (temporary_buffer<char> header) {
+            if (header.size() < header_size) {
+                // eof, perhaps in the middle of a request
+                return run_gets(out);
+            }
+            if (uint8_t(header[0]) != magic_request) {
+                _quit = true;
+                return run_gets(out);
+            }
+            request req;
+            req.opcode = header[1];
+            req.key_length = read_be<uint16_t>(header.get() + 2);
+            req.extras_length = header[4];
+            req.body_length = read_be<uint32_t>(header.get() + 8);
+            req.opaque = read_be<uint32_t>(header.get() + 12);
+            req.cas = read_be<uint64_t>(header.get() + 16);
+            if (req.body_length > max_body_length) {
+                // skipped rather than read into memory
+                return in.skip(req.body_length).then([this, &out, op = req.opcode, opaque = req.opaque] {
+                    return run_gets(out).then([&out, op, opaque] {
+                        return respond(out, op, opaque, status_value_too_large);
+                    });
+                });
+            }
+            return in.read_exactly(req.body_length).then([this, &out, req = std::move(req)] (temporary_buffer<char> body) mutable {
+                if (body.size() < req.body_length) {
+                    return run_gets(out);
+                }
+                req.body = std::move(body);
+                return handle_request(std::move(req), out);
+            });
+        }).then_wrapped([this, &out] (auto&& f) -> future<> {
+            try {
+                f.get();
+            } catch (std::bad_alloc& e) {
+                _gets.clear();
+                _keys.clear();
+                return respond(out, op_noop, 0, status_out_of_memory);
+            }
+            return make_ready_future<>();
+        });
+    }
+};
+
 class udp_server {
 public:
     static const size_t default_max_datagram_size = 1400;
@@ -1348,6 +2155,7 @@ class tcp_server {
         input_stream<char> _in;
         output_stream<char> _out;
         ascii_protocol _proto;
+        binary_protocol _binary_proto;
         distributed<system_stats>& _system_stats;
         connection(connected_socket&& socket, socket_address addr, sharded_cache& c, distributed<system_stats>& system_stats)
             : _socket(std::move(socket))
@@ -1355,6 +2163,7 @@ class tcp_server {
             , _in(_socket.input())
             , _out(_socket.output())
             , _proto(c, system_stats)
+            , _binary_proto(c, system_stats)
             , _system_stats(system_stats)
         {
             _system_stats.local()._curr_connections++;
@@ -1364,6 +2173,23 @@ class tcp_server {
             _system_stats.local()._curr_connections--;
         }
     };
+
+    // Binary requests start with a magic byte no ascii command starts with.
+    // Looks at the first byte of the stream without consuming it.
+    static future<bool> is_binary(input_stream<char>& in) {
+        struct peek {
+            bool binary = false;
+            future<consumption_result<char>> operator()(temporary_buffer<char> buf) {
+                binary = !buf.empty() && uint8_t(buf[0]) == binary_protocol::magic_request;
+                return make_ready_future<consumption_result<char>>(stop_consuming<char>(std::move(buf)));
+            }
+        };
+        return do_with(peek(), [&in] (peek& p) {
+            return in.consume(p).then([&p] {
+                return p.binary;
+            });
+        });
+    }
 public:
     tcp_server(sharded_cache& cache, distributed<system_stats>& system_stats, uint16_t port = 11211)
         : _cache(cache)
@@ -1381,9 +2207,18 @@ class tcp_server {
                 connected_socket fd = std::move(ar.connection);
                 socket_address addr = std::move(ar.remote_address);
                 auto conn = make_lw_shared<connection>(std::move(fd), addr, _cache, _system_stats);
-                (void)do_until([conn] { return conn->_in.eof(); }, [conn] {
-                    return conn->_proto.handle(conn->_in, conn->_out).then([conn] {
-                        return conn->_out.flush();
+                (void)is_binary(conn->_in).then([conn] (bool binary) {
+                    if (binary) {
+                        return do_until([conn] { return conn->_in.eof() || conn->_binary_proto.quit(); }, [conn] {
+                            return conn->_binary_proto.handle(conn->_in, conn->_out).then([conn] {
+                                return conn->_out.flush();
+                            });
+                        });
+                    }
+                    return do_until([conn] { return conn->_in.eof(); }, [conn] {
+                        return conn->_proto.handle(conn->_in, conn->_out).then([conn] {
+                            return conn->_out.flush();
+                        });
                     });
                 }).finally([conn] {
                     return conn->_out.close().finally([conn]{});
@@ -1451,6 +2286,12 @@ int main(int ac, char** av) {
              "Print basic statistics periodically (every second)")
         ("port", bpo::value<uint16_t>()->default_value(11211),
              "Specify UDP and TCP ports for memcached server to listen on")
+        ("spill-dir", bpo::value<sstring>()->default_value(""),
+             "Directory to spill items evicted from memory to, in a log file per shard (disabled if empty)")
+        ("spill-size", bpo::value<uint64_t>()->default_value(1024),
+             "Size of the spill log of each shard (value in megabytes)")
+        ("spill-shares", bpo::value<float>()->default_value(100),
+             "Shares of the scheduling group, and so of the I/O class, writing the spill logs")
         ;
 
     return app.run_deprecated(ac, av, [&] {
@@ -1463,7 +2304,18 @@ int main(int ac, char** av) {
         uint16_t port = config["port"].as<uint16_t>();
         uint64_t per_cpu_slab_size = config["max-slab-size"].as<uint64_t>() * MB;
         uint64_t slab_page_size = config["slab-page-size"].as<uint64_t>() * MB;
-        return cache_peers.start(std::move(per_cpu_slab_size), std::move(slab_page_size)).then([&system_stats] {
+        memcache::spill_config spill {
+            .dir = config["spill-dir"].as<sstring>(),
+            .size = config["spill-size"].as<uint64_t>() * MB,
+        };
+        auto sg = spill.dir.empty() ? make_ready_future<scheduling_group>() :
+                create_scheduling_group("memcached_spill", config["spill-shares"].as<float>());
+        return sg.then([&, per_cpu_slab_size, slab_page_size, spill] (scheduling_group sg) mutable {
+            spill.sg = sg;
+            return cache_peers.start(per_cpu_slab_size, slab_page_size, spill);
+        }).then([&cache_peers] {
+            return cache_peers.invoke_on_all(&memcache::cache::start);
+        }).then([&system_stats] {
             return system_stats.start(memcache::clock_type::now());
         }).then([&] {
             std::cout << PLATFORM << " memcached " << VERSION << "\n";
@@ -38,7 +38,7 @@ class item_key {
         : _key(key)
         , _hash(std::hash<sstring>()(key))
     {}
-    item_key(item_key&& other)
+    item_key(item_key&& other) noexcept
         : _key(std::move(other._key))
         , _hash(other._hash)
     {
@@ -53,7 +53,7 @@ class item_key {
     bool operator==(const item_key& other) const {
         return other._hash == _hash && other._key == _key;
     }
-    void operator=(item_key&& other) {
+    void operator=(item_key&& other) noexcept {
         _key = std::move(other._key);
         _hash = other._hash;
         other._hash = 0;
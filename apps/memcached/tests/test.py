@@ -21,11 +21,12 @@ import sys
 import os
 import argparse
 import subprocess
+import tempfile
 
 DIR_PATH = os.path.dirname(os.path.realpath(__file__))
 
-def run(args, cmd):
-    mc = subprocess.Popen([args.memcached, '--smp=2'])
+def run(args, cmd, memcached_args=[]):
+    mc = subprocess.Popen([args.memcached, '--smp=2'] + memcached_args)
     print('Memcached started.')
     try:
         cmdline = [DIR_PATH + '/test_memcached.py'] + cmd
@@ -47,3 +48,5 @@ if __name__ == "__main__":
 
     run(args, [])
     run(args, ['-U'])
+    with tempfile.TemporaryDirectory() as spill_dir:
+        run(args, ['--spill'], ['--max-slab-size=4', '--spill-dir', spill_dir, '--spill-size=64'])
@@ -22,6 +22,8 @@
 #include <iostream>
 #include <vector>
 #include <chrono>
+#include <deque>
+#include <algorithm>
 #include <random>
 #include <ranges>
 #include <yaml-cpp/yaml.h>
@@ -43,6 +45,8 @@
 #include <seastar/core/with_scheduling_group.hh>
 #include <seastar/core/sleep.hh>
 #include <seastar/rpc/rpc.hh>
+#include <seastar/rpc/lz4_compressor.hh>
+#include <seastar/rpc/lz4_fragmented_compressor.hh>
 #include <seastar/util/assert.hh>
 
 using namespace seastar;
@@ -166,14 +170,82 @@ std::unique_ptr<pause_distribution> make_uniform_pause(duration_range range) {
     return std::make_unique<uniform_process>(range.min, range.max);
 }
 
+class size_distribution {
+public:
+    virtual size_t get() = 0;
+    virtual size_t max() const = 0;
+    virtual ~size_distribution() {}
+};
+
+class steady_size : public size_distribution {
+    size_t _size;
+public:
+    steady_size(size_t size) : _size(size) { }
+    size_t get() override { return _size; }
+    size_t max() const override { return _size; }
+};
+
+class uniform_size : public size_distribution {
+    std::random_device _rd;
+    std::mt19937 _rng;
+    std::uniform_int_distribution<size_t> _range;
+public:
+    uniform_size(size_t min, size_t max) : _rng(_rd()), _range(min, max) { }
+    size_t get() override { return _range(_rng); }
+    size_t max() const override { return _range.max(); }
+};
+
+struct weighted_size {
+    size_t size;
+    double weight;
+};
+
+// Picks among a few sizes with the given weights, to replay the shape of
+// real traffic
+class weighted_sizes : public size_distribution {
+    std::random_device _rd;
+    std::mt19937 _rng;
+    std::vector<size_t> _sizes;
+    std::discrete_distribution<size_t> _pick;
+public:
+    weighted_sizes(const std::vector<weighted_size>& sizes)
+            : _rng(_rd())
+    {
+        std::vector<double> weights;
+        for (auto& ws : sizes) {
+            _sizes.push_back(ws.size);
+            weights.push_back(ws.weight);
+        }
+        _pick = std::discrete_distribution<size_t>(weights.begin(), weights.end());
+    }
+    size_t get() override { return _sizes[_pick(_rng)]; }
+    size_t max() const override { return std::ranges::max(_sizes); }
+};
+
 struct client_config {
     bool nodelay = true;
+    // none, lz4 or lz4_fragmented
+    std::string compression = "none";
 };
 
 struct server_config {
     bool nodelay = true;
+    std::string compression = "none";
 };
 
+std::unique_ptr<rpc::compressor::factory> make_compressor_factory(const std::string& name) {
+    if (name == "none") {
+        return nullptr;
+    }
+    if (name == "lz4") {
+        return std::make_unique<rpc::lz4_compressor::factory>();
+    }
+    if (name == "lz4_fragmented") {
+        return std::make_unique<rpc::lz4_fragmented_compressor::factory>();
+    }
+    throw std::runtime_error("unknown compression");
+}
+
 struct job_config {
     std::string name;
     std::string type;
@@ -185,7 +257,13 @@ struct job_config {
     std::optional<std::chrono::duration<double>> sleep_time;
     std::optional<duration_range> sleep_time_range;
     std::optional<std::chrono::duration<double>> timeout;
-    size_t payload;
+    size_t payload = 0;
+    std::optional<std::pair<size_t, size_t>> payload_range;
+    std::vector<weighted_size> payload_sizes;
+    // zero-filled payloads, which compress to almost nothing, or random ones
+    bool compressible = true;
+    // messages in flight on each stream
+    unsigned window = 1;
 
     bool client = false;
     bool server = false;
@@ -217,6 +295,9 @@ struct convert<client_config> {
         if (node["nodelay"]) {
             cfg.nodelay = node["nodelay"].as<bool>();
         }
+        if (node["compression"]) {
+            cfg.compression = node["compression"].as<std::string>();
+        }
         return true;
     }
 };
@@ -227,6 +308,9 @@ struct convert<server_config> {
         if (node["nodelay"]) {
             cfg.nodelay = node["nodelay"].as<bool>();
         }
+        if (node["compression"]) {
+            cfg.compression = node["compression"].as<std::string>();
+        }
         return true;
     }
 };
@@ -239,7 +323,19 @@ struct convert<job_config> {
         cfg.parallelism = node["parallelism"].as<unsigned>();
         if (cfg.type == "rpc") {
             cfg.verb = node["verb"].as<std::string>();
-            cfg.payload = node["payload"].as<byte_size>().size;
+            if (node["payload_sizes"]) {
+                cfg.payload_sizes = node["payload_sizes"].as<std::vector<weighted_size>>();
+            } else if (node["payload_min"] && node["payload_max"]) {
+                cfg.payload_range = std::make_pair(node["payload_min"].as<byte_size>().size, node["payload_max"].as<byte_size>().size);
+            } else if (node["payload"]) {
+                cfg.payload = node["payload"].as<byte_size>().size;
+            }
+            if (node["compressible"]) {
+                cfg.compressible = node["compressible"].as<bool>();
+            }
+            if (node["window"]) {
+                cfg.window = node["window"].as<unsigned>();
+            }
             cfg.client = true;
             if (node["sleep_time"]) {
                 cfg.sleep_time = node["sleep_time"].as<duration_time>().time;
@@ -327,6 +423,15 @@ struct convert<duration_time> {
     }
 };
 
+template<>
+struct convert<weighted_size> {
+    static bool decode(const Node& node, weighted_size& ws) {
+        ws.size = node["size"].as<byte_size>().size;
+        ws.weight = node["weight"] ? node["weight"].as<double>() : 1.0;
+        return ws.weight >= 0;
+    }
+};
+
 template<>
 struct convert<byte_size> {
     static bool decode(const Node& node, byte_size& bs) {
@@ -352,6 +457,7 @@ enum class rpc_verb : int32_t {
     BYE = 1,
     ECHO = 2,
     WRITE = 3,
+    STREAM = 4,
 };
 
 using rpc_protocol = rpc::protocol<serializer, rpc_verb>;
@@ -372,11 +478,33 @@ class job_rpc : public job {
     socket_address _caddr;
     client_config _ccfg;
     rpc_protocol& _rpc;
+    std::unique_ptr<rpc::compressor::factory> _compressor;
     std::unique_ptr<rpc_protocol::client> _client;
     std::function<future<>(unsigned)> _call;
     std::chrono::steady_clock::time_point _stop;
     uint64_t _total_messages = 0;
+    uint64_t _total_bytes = 0;
     accumulator_type _latencies;
+    std::unique_ptr<size_distribution> _size;
+    // payloads are cut from here, so that random ones are not regenerated
+    // on every call
+    payload_t _pattern;
+
+    std::unique_ptr<size_distribution> make_size() {
+        if (!_cfg.payload_sizes.empty()) {
+            return std::make_unique<weighted_sizes>(_cfg.payload_sizes);
+        }
+        if (_cfg.payload_range) {
+            return std::make_unique<uniform_size>(_cfg.payload_range->first, _cfg.payload_range->second);
+        }
+        return std::make_unique<steady_size>(_cfg.payload);
+    }
+
+    payload_t make_payload() {
+        auto len = _size->get() / sizeof(payload_t::value_type);
+        _total_bytes += len * sizeof(payload_t::value_type);
+        return payload_t(_pattern.begin(), _pattern.begin() + len);
+    }
 
     future<> call_echo(unsigned dummy) {
         auto cln = _rpc.make_client<uint64_t(uint64_t)>(rpc_verb::ECHO);
@@ -394,21 +522,70 @@ class job_rpc : public job {
         });
     }
 
+    // Sends payloads over one stream, with up to window of them not yet
+    // acknowledged by the server, and measures the time to each ack
+    future<> run_stream() {
+        return seastar::async([this] {
+            auto sink = _client->make_stream_sink<serializer, payload_t>().get();
+            auto source = _rpc.make_client<rpc::source<uint64_t>(rpc::sink<payload_t>)>(rpc_verb::STREAM)(*_client, sink).get();
+            semaphore window(_cfg.window);
+            std::deque<std::chrono::steady_clock::time_point> in_flight;
+            auto acks = seastar::async([this, &source, &window, &in_flight] {
+                while (source().get()) {
+                    auto lat = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - in_flight.front());
+                    in_flight.pop_front();
+                    _latencies(lat.count());
+                    window.signal();
+                }
+            });
+            std::exception_ptr ex;
+            try {
+                while (std::chrono::steady_clock::now() <= _stop) {
+                    window.wait().get();
+                    auto pl = make_payload();
+                    _total_messages++;
+                    in_flight.push_back(std::chrono::steady_clock::now());
+                    sink(pl).get();
+                    if (_cfg.sleep_time) {
+                        seastar::sleep(std::chrono::duration_cast<std::chrono::nanoseconds>(*_cfg.sleep_time)).get();
+                    }
+                }
+            } catch (...) {
+                ex = std::current_exception();
+            }
+            // the server closes its side once it sees the end of ours
+            sink.close().get();
+            acks.get();
+            if (ex) {
+                std::rethrow_exception(ex);
+            }
+        });
+    }
+
 public:
     job_rpc(job_config cfg, rpc_protocol& rpc, client_config ccfg, socket_address caddr)
             : _cfg(cfg)
             , _caddr(std::move(caddr))
             , _ccfg(ccfg)
             , _rpc(rpc)
+            , _compressor(make_compressor_factory(_ccfg.compression))
             , _stop(std::chrono::steady_clock::now() + _cfg.duration)
             , _latencies(extended_p_square_probabilities = quantiles)
+            , _size(make_size())
+            , _pattern(_size->max() / sizeof(payload_t::value_type), 0)
     {
+        if (!_cfg.compressible) {
+            std::independent_bits_engine<std::default_random_engine, 64, uint64_t> rng(std::random_device{}());
+            std::ranges::generate(_pattern, std::ref(rng));
+        }
         if (_cfg.verb == "echo") {
             _call = [this] (unsigned x) { return call_echo(x); };
         } else if (_cfg.verb == "write") {
-            payload_t payload;
-            payload.resize(_cfg.payload / sizeof(payload_t::value_type), 0);
-            _call = [this, payload = std::move(payload)] (unsigned x) { return call_write(x, payload); };
+            _call = [this] (unsigned x) { return call_write(x, make_payload()); };
+        } else if (_cfg.verb == "stream") {
+            if (!_cfg.window) {
+                throw std::runtime_error("stream window must not be zero");
+            }
         } else if (_cfg.verb == "vecho") {
             _call = [this] (unsigned x) {
                 fmt::print("{}.{} send echo\n", this_shard_id(), x);
@@ -430,8 +607,12 @@ class job_rpc : public job {
         rpc::client_options co;
         co.tcp_nodelay = _ccfg.nodelay;
         co.isolation_cookie = _cfg.sg_name;
+        co.compressor_factory = _compressor.get();
         _client = std::make_unique<rpc_protocol::client>(_rpc, co, _caddr);
         return parallel_for_each(std::views::iota(0u, _cfg.parallelism), [this] (auto dummy) {
+          if (!_call) {
+              return run_stream();
+          }
           auto f = make_ready_future<>();
           if (_cfg.sleep_time) {
               // Do initial small delay to de-synchronize fibers
@@ -463,6 +644,7 @@ class job_rpc : public job {
 
     virtual void emit_result(YAML::Emitter& out) const override {
         out << YAML::Key << "messages" << YAML::Value << _total_messages;
+        out << YAML::Key << "bytes" << YAML::Value << _total_bytes;
         out << YAML::Key << "latencies" << YAML::Comment("usec");
         out << YAML::BeginMap;
         out << YAML::Key << "average" << YAML::Value << (uint64_t)mean(_latencies);
@@ -537,6 +719,8 @@ class job_cpu : public job {
 
 class context {
     std::unique_ptr<rpc_protocol> _rpc;
+    std::unique_ptr<rpc::compressor::factory> _server_compressor;
+    std::unique_ptr<rpc::compressor::factory> _client_compressor;
     std::unique_ptr<rpc_protocol::server> _server;
     std::unique_ptr<rpc_protocol::client> _client;
     promise<> _bye;
@@ -590,10 +774,31 @@ class context {
         _rpc->register_handler(rpc_verb::WRITE, [] (payload_t val) {
             return make_ready_future<uint64_t>(val.size());
         });
+        _rpc->register_handler(rpc_verb::STREAM, [] (rpc::source<payload_t> source) {
+            auto sink = source.make_sink<serializer, uint64_t>();
+            // Acks every message with its size, until the client closes its end
+            (void)repeat([source, sink] () mutable {
+                return source().then([sink] (auto val) mutable {
+                    if (!val) {
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
+                    }
+                    return sink(std::get<0>(*val).size()).then([] {
+                        return stop_iteration::no;
+                    });
+                });
+            }).finally([sink] () mutable {
+                return sink.close();
+            }).handle_exception([] (auto ex) {
+                fmt::print("stream failed: {}\n", ex);
+            });
+            return sink;
+        });
 
         if (laddr) {
             rpc::server_options so;
             so.tcp_nodelay = _cfg.server.nodelay;
+            _server_compressor = make_compressor_factory(_cfg.server.compression);
+            so.compressor_factory = _server_compressor.get();
             rpc::resource_limits limits;
             limits.isolate_connection = [this] (sstring cookie) { return isolate_connection(cookie); };
             _server = std::make_unique<rpc_protocol::server>(*_rpc, so, *laddr, limits);
@@ -608,6 +813,8 @@ class context {
         if (caddr) {
             rpc::client_options co;
             co.tcp_nodelay = _cfg.client.nodelay;
+            _client_compressor = make_compressor_factory(_cfg.client.compression);
+            co.compressor_factory = _client_compressor.get();
             _client = std::make_unique<rpc_protocol::client>(*_rpc, co, *caddr);
 
             for (auto&& jc : _cfg.jobs) {
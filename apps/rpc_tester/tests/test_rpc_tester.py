@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+#
+# This file is open source software, licensed to you under the terms
+# of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+# distributed with this work for additional information regarding copyright
+# ownership.  You may not use this file except in compliance with the License.
+#
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied.  See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+#
+# Copyright (C) 2024 Scylladb, Ltd.
+#
+
+import argparse
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+import unittest
+import yaml
+
+
+class TestRpcTester(unittest.TestCase):
+    rpc_tester_path = None
+    port = 10123
+
+    def _wait_listening(self, server: subprocess.Popen) -> None:
+        for _ in range(100):
+            self.assertIsNone(server.poll(), 'server exited')
+            try:
+                with socket.create_connection(('127.0.0.1', self.port), timeout=1):
+                    return
+            except OSError:
+                time.sleep(0.1)
+        self.fail('server is not listening')
+
+    # Runs a server and a client with the given config, and returns the
+    # client's results of its single shard
+    def _run(self, conf: dict) -> dict:
+        with tempfile.NamedTemporaryFile('w', suffix='.yaml') as f:
+            yaml.safe_dump(conf, f)
+            f.flush()
+            common = [self.rpc_tester_path, '--conf', f.name, '--port', f'{self.port}', '--smp=1']
+            server = subprocess.Popen(common + ['--listen', '127.0.0.1'],
+                                      stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+            try:
+                self._wait_listening(server)
+                client = subprocess.run(common + ['--connect', '127.0.0.1', '--duration', '1'],
+                                        capture_output=True, text=True, timeout=60)
+                self.assertEqual(client.returncode, 0, client.stderr)
+                # the server exits once the client says bye
+                self.assertEqual(server.wait(timeout=30), 0)
+            finally:
+                if server.poll() is None:
+                    server.kill()
+                    server.wait()
+        # The results follow the progress messages
+        results = yaml.safe_load(client.stdout[client.stdout.index('---'):])
+        self.assertEqual(len(results), 1)
+        return results[0]
+
+    def _check_sizes(self, job: dict, min_size: int, max_size: int) -> None:
+        self.assertGreater(job['messages'], 0)
+        # sizes are rounded down to whole payload elements
+        self.assertGreaterEqual(job['bytes'], job['messages'] * (min_size // 8 * 8))
+        self.assertLessEqual(job['bytes'], job['messages'] * max_size)
+
+    def test_stream(self) -> None:
+        conf = {
+            'client': {'compression': 'lz4_fragmented'},
+            'server': {'compression': 'lz4_fragmented'},
+            'jobs': [{
+                'name': 'stream',
+                'type': 'rpc',
+                'verb': 'stream',
+                'parallelism': 2,
+                'window': 8,
+                'compressible': False,
+                'payload_sizes': [{'size': '1kB', 'weight': 3}, {'size': '64kB'}],
+            }],
+        }
+        job = self._run(conf)['stream']
+        self._check_sizes(job, 1 << 10, 64 << 10)
+        # Some of the many messages were big, and most of them small
+        self.assertGreater(job['bytes'], job['messages'] * (1 << 10))
+        self.assertLess(job['bytes'], job['messages'] * (32 << 10))
+
+    def test_write_payload_range(self) -> None:
+        conf = {
+            'client': {'compression': 'lz4'},
+            'server': {'compression': 'lz4'},
+            'jobs': [{
+                'name': 'write',
+                'type': 'rpc',
+                'verb': 'write',
+                'parallelism': 4,
+                'payload_min': '1000',
+                'payload_max': '4kB',
+            }],
+        }
+        job = self._run(conf)['write']
+        self._check_sizes(job, 1000, 4 << 10)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--rpc-tester',
+                        required=True,
+                        help='Path to the rpc_tester executable')
+    opts, remaining = parser.parse_known_args()
+    remaining.insert(0, sys.argv[0])
+    TestRpcTester.rpc_tester_path = opts.rpc_tester
+    unittest.main(argv=remaining)
@@ -0,0 +1,98 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/bitops.hh>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace seastar {
+
+// Latencies in nanoseconds, counted in log-linear buckets like HdrHistogram
+// does: each power of two range is split in 64 buckets, so values are kept
+// with a relative error below 1/64.
+class latency_histogram {
+    static constexpr unsigned sub_bucket_bits = 6;
+    static constexpr uint64_t sub_buckets = 1 << sub_bucket_bits;
+    std::vector<uint64_t> _counts = std::vector<uint64_t>(2 * sub_buckets + (63 - sub_bucket_bits) * sub_buckets);
+    uint64_t _total = 0;
+    uint64_t _max = 0;
+
+    static size_t index_of(uint64_t v) {
+        if (v < 2 * sub_buckets) {
+            return v;
+        }
+        unsigned shift = 63 - count_leading_zeros(v) - sub_bucket_bits;
+        return 2 * sub_buckets + (shift - 1) * sub_buckets + ((v >> shift) - sub_buckets);
+    }
+
+    // The highest value counted in a bucket
+    static uint64_t value_of(size_t index) {
+        if (index < 2 * sub_buckets) {
+            return index;
+        }
+        unsigned shift = (index - 2 * sub_buckets) / sub_buckets + 1;
+        uint64_t top = (index - 2 * sub_buckets) % sub_buckets + sub_buckets;
+        return ((top + 1) << shift) - 1;
+    }
+public:
+    void record(std::chrono::nanoseconds latency) {
+        uint64_t v = std::max<int64_t>(latency.count(), 0);
+        _counts[index_of(v)]++;
+        _total++;
+        _max = std::max(_max, v);
+    }
+
+    uint64_t total() const {
+        return _total;
+    }
+
+    std::chrono::nanoseconds max() const {
+        return std::chrono::nanoseconds(_max);
+    }
+
+    std::chrono::nanoseconds percentile(double p) const {
+        uint64_t rank = std::max<uint64_t>(std::ceil(p / 100 * _total), 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < _counts.size(); i++) {
+            seen += _counts[i];
+            if (seen >= rank) {
+                return std::chrono::nanoseconds(std::min(value_of(i), _max));
+            }
+        }
+        return max();
+    }
+
+    latency_histogram& operator+=(const latency_histogram& o) {
+        for (size_t i = 0; i < _counts.size(); i++) {
+            _counts[i] += o._counts[i];
+        }
+        _total += o._total;
+        _max = std::max(_max, o._max);
+        return *this;
+    }
+};
+
+}
@@ -24,9 +24,15 @@
 #include <seastar/core/seastar.hh>
 #include <seastar/core/print.hh>
 #include <seastar/core/app-template.hh>
+#include <seastar/core/condition-variable.hh>
 #include <seastar/core/distributed.hh>
+#include <seastar/core/loop.hh>
 #include <seastar/core/semaphore.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/when_all.hh>
+#include "latency_histogram.hh"
 #include <chrono>
+#include <deque>
 
 using namespace seastar;
 
@@ -37,11 +43,24 @@ void http_debug(const char* fmt, Args&&... args) {
 #endif
 }
 
+struct http_client_config {
+    unsigned duration;
+    unsigned total_conn;
+    unsigned reqs_per_conn;
+    // requests per second, over all the shards; 0 for a closed loop
+    double rate;
+    // requests in flight on a connection
+    unsigned pipeline;
+    bool keep_alive;
+};
+
 class http_client {
 private:
-    unsigned _duration;
+    using clock_type = steady_clock_type;
+
+    http_client_config _cfg;
     unsigned _conn_per_core;
-    unsigned _reqs_per_conn;
+    ipv4_addr _server_addr;
     std::vector<connected_socket> _sockets;
     semaphore _conn_connected{0};
     semaphore _conn_finished{0};
@@ -49,15 +68,24 @@ class http_client {
     bool _timer_based;
     bool _timer_done{false};
     uint64_t _total_reqs{0};
+    latency_histogram _latencies;
+    // open loop: requests which can be sent on any connection
+    semaphore _free_slots{0};
+    uint64_t _late_reqs{0};
 public:
-    http_client(unsigned duration, unsigned total_conn, unsigned reqs_per_conn)
-        : _duration(duration)
-        , _conn_per_core(total_conn / smp::count)
-        , _reqs_per_conn(reqs_per_conn)
+    http_client(http_client_config cfg)
+        : _cfg(cfg)
+        , _conn_per_core(cfg.total_conn / smp::count)
         , _run_timer([this] { _timer_done = true; })
-        , _timer_based(reqs_per_conn == 0) {
+        , _timer_based(cfg.reqs_per_conn == 0 || cfg.rate) {
     }
 
+    // Requests are written as soon as there's room in the pipeline, and
+    // their responses read in order by a separate fiber. The latency of a
+    // request is counted from the time it was meant to be sent: right away
+    // in a closed loop, the time of the timetable in an open loop, so that
+    // requests delayed by slow responses count the delay too (the
+    // coordinated omission correction).
     class connection {
     private:
         connected_socket _fd;
@@ -65,50 +93,137 @@ class http_client {
         output_stream<char> _write_buf;
         http_response_parser _parser;
         http_client* _http_client;
+        // room in the pipeline
+        semaphore _window;
+        semaphore _write_lock{1};
+        std::deque<clock_type::time_point> _in_flight;
+        condition_variable _sent;
+        uint64_t _nr_sent{0};
         uint64_t _nr_done{0};
+        bool _sending_done{false};
+        bool _reading_done{false};
     public:
         connection(connected_socket&& fd, http_client* client)
             : _fd(std::move(fd))
             , _read_buf(_fd.input())
             , _write_buf(_fd.output())
-            , _http_client(client){
+            , _http_client(client)
+            , _window(client->_cfg.pipeline) {
         }
 
         uint64_t nr_done() {
             return _nr_done;
         }
 
-        future<> do_req() {
-            return _write_buf.write("GET / HTTP/1.1\r\nHost: 127.0.0.1:10000\r\n\r\n").then([this] {
-                return _write_buf.flush();
-            }).then([this] {
-                _parser.init();
-                return _read_buf.consume(_parser).then([this] {
-                    // Read HTTP response header first
-                    if (_parser.eof()) {
+        bool has_room() {
+            return !_reading_done && _window.available_units() > 0;
+        }
+
+        void take_room() {
+            _window.consume(1);
+        }
+
+        // The caller must have taken room in the pipeline
+        future<> send(clock_type::time_point intended) {
+            _nr_sent++;
+            // requests are written in this order, the write lock being fair
+            _in_flight.push_back(intended);
+            _sent.signal();
+            return with_semaphore(_write_lock, 1, [this] {
+                return _write_buf.write(_http_client->_cfg.keep_alive
+                        ? "GET / HTTP/1.1\r\nHost: 127.0.0.1:10000\r\n\r\n"
+                        : "GET / HTTP/1.1\r\nHost: 127.0.0.1:10000\r\nConnection: close\r\n\r\n").then([this] {
+                    return _write_buf.flush();
+                });
+            });
+        }
+
+        // Closed loop: keeps the pipeline full until the client is done
+        future<> send_requests() {
+            return do_until([this] { return _http_client->done(_nr_sent); }, [this] {
+                return _window.wait(1).then([this] {
+                    if (_http_client->done(_nr_sent)) {
+                        _window.signal(1);
                         return make_ready_future<>();
                     }
-                    auto _rsp = _parser.get_parsed_response();
-                    auto it = _rsp->_headers.find("Content-Length");
-                    if (it == _rsp->_headers.end()) {
-                        fmt::print("Error: HTTP response does not contain: Content-Length\n");
-                        return make_ready_future<>();
+                    return send(clock_type::now());
+                });
+            }).handle_exception_type([] (const broken_semaphore&) {
+                // the server closed the connection
+            }).finally([this] {
+                stop_sending();
+            });
+        }
+
+        void stop_sending() {
+            _sending_done = true;
+            _sent.signal();
+        }
+
+        future<> read_responses() {
+            return repeat([this] {
+                if (_in_flight.empty()) {
+                    if (_sending_done) {
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
                     }
-                    auto content_len = std::stoi(it->second);
-                    http_debug("Content-Length = %d\n", content_len);
-                    // Read HTTP response body
-                    return _read_buf.read_exactly(content_len).then([this] (temporary_buffer<char> buf) {
-                        _nr_done++;
-                        http_debug("%s\n", buf.get());
-                        if (_http_client->done(_nr_done)) {
-                            return make_ready_future();
-                        } else {
-                            return do_req();
-                        }
+                    return _sent.wait().then([] {
+                        return stop_iteration::no;
                     });
+                }
+                return read_response().then([] (bool ok) {
+                    return ok ? stop_iteration::no : stop_iteration::yes;
                 });
+            }).finally([this] {
+                _reading_done = true;
+                // unblocks send_requests()
+                _window.broken();
             });
         }
+
+        future<bool> read_response() {
+            _parser.init();
+            return _read_buf.consume(_parser).then([this] {
+                // Read HTTP response header first
+                if (_parser.eof()) {
+                    return make_ready_future<bool>(false);
+                }
+                auto _rsp = _parser.get_parsed_response();
+                auto it = _rsp->_headers.find("Content-Length");
+                if (it == _rsp->_headers.end()) {
+                    fmt::print("Error: HTTP response does not contain: Content-Length\n");
+                    return make_ready_future<bool>(false);
+                }
+                auto content_len = std::stoi(it->second);
+                http_debug("Content-Length = %d\n", content_len);
+                // Read HTTP response body
+                return _read_buf.read_exactly(content_len).then([this] (temporary_buffer<char> buf) {
+                    _nr_done++;
+                    http_debug("%s\n", buf.get());
+                    _http_client->_latencies.record(clock_type::now() - _in_flight.front());
+                    _in_flight.pop_front();
+                    auto f = _http_client->_cfg.keep_alive ? make_ready_future<>() : reconnect();
+                    return f.then([this] {
+                        _window.signal(1);
+                        _http_client->_free_slots.signal(1);
+                        return true;
+                    });
+                });
+            });
+        }
+
+        future<> reconnect() {
+            return _write_buf.close().then([this] {
+                return seastar::connect(make_ipv4_address(_http_client->_server_addr));
+            }).then([this] (connected_socket fd) {
+                _fd = std::move(fd);
+                _read_buf = _fd.input();
+                _write_buf = _fd.output();
+            });
+        }
+
+        future<> close() {
+            return _write_buf.close();
+        }
     };
 
     future<uint64_t> total_reqs() {
@@ -116,15 +231,24 @@ class http_client {
         return make_ready_future<uint64_t>(_total_reqs);
     }
 
-    bool done(uint64_t nr_done) {
+    latency_histogram latencies() {
+        return _latencies;
+    }
+
+    uint64_t late_reqs() {
+        return _late_reqs;
+    }
+
+    bool done(uint64_t nr_sent) {
         if (_timer_based) {
             return _timer_done;
         } else {
-            return nr_done >= _reqs_per_conn;
+            return nr_sent >= _cfg.reqs_per_conn;
         }
     }
 
     future<> connect(ipv4_addr server_addr) {
+        _server_addr = server_addr;
         // Establish all the TCP connections first
         for (unsigned i = 0; i < _conn_per_core; i++) {
             // Connect in the background, signal _conn_connected when done.
@@ -137,32 +261,82 @@ class http_client {
         return _conn_connected.wait(_conn_per_core);
     }
 
+    // Open loop: sends requests on a fixed timetable, on any connection
+    // with room in its pipeline, whether or not the previous ones were
+    // answered
+    future<> send_on_timetable(std::vector<connection*>& conns) {
+        auto interval = std::chrono::duration_cast<clock_type::duration>(
+                std::chrono::duration<double>(smp::count / _cfg.rate));
+        auto start = clock_type::now();
+        return do_with(uint64_t(0), size_t(0), [this, &conns, interval, start] (uint64_t& i, size_t& next_conn) {
+            return do_until([this] { return _timer_done; }, [this, &conns, interval, start, &i, &next_conn] {
+                auto intended = start + interval * i++;
+                auto now = clock_type::now();
+                auto f = intended > now ? seastar::sleep(intended - now) : make_ready_future<>();
+                return f.then([this] {
+                    if (!_free_slots.available_units()) {
+                        _late_reqs++;
+                    }
+                    return _free_slots.wait(1);
+                }).then([this, &conns, &next_conn, intended] {
+                    for (size_t tried = 0; tried < conns.size(); tried++) {
+                        auto conn = conns[next_conn];
+                        next_conn = (next_conn + 1) % conns.size();
+                        if (conn->has_room()) {
+                            conn->take_room();
+                            // Sent in the background, not to delay the next ones
+                            (void)conn->send(intended).handle_exception([] (std::exception_ptr ex) {
+                                fmt::print("http request error: {}\n", ex);
+                            });
+                            return;
+                        }
+                    }
+                    // only connections closed by the server are left
+                    _free_slots.signal(1);
+                });
+            });
+        }).finally([&conns] {
+            for (auto conn : conns) {
+                conn->stop_sending();
+            }
+        });
+    }
+
     future<> run() {
         // All connected, start HTTP request
         http_debug("Established all %6d tcp connections on cpu %3d\n", _conn_per_core, this_shard_id());
         if (_timer_based) {
-            _run_timer.arm(std::chrono::seconds(_duration));
-        }
-        for (auto&& fd : _sockets) {
-            auto conn = new connection(std::move(fd), this);
-            // Run in the background, signal _conn_finished when done.
-            (void)conn->do_req().then_wrapped([this, conn] (auto&& f) {
-                http_debug("Finished connection %6d on cpu %3d\n", _conn_finished.current(), this_shard_id());
-                _total_reqs += conn->nr_done();
-                _conn_finished.signal();
-                delete conn;
-                // FIXME: should _conn_finished.signal be called only after this?
-                // nothing seems to synchronize with this background work.
-                try {
-                    f.get();
-                } catch (std::exception& ex) {
-                    fmt::print("http request error: {}\n", ex.what());
-                }
-            });
+            _run_timer.arm(std::chrono::seconds(_cfg.duration));
         }
-
-        // All finished
-        return _conn_finished.wait(_conn_per_core);
+        _free_slots.signal(_conn_per_core * _cfg.pipeline);
+        return do_with(std::vector<connection*>(), [this] (std::vector<connection*>& conns) {
+            for (auto&& fd : _sockets) {
+                conns.push_back(new connection(std::move(fd), this));
+            }
+            _sockets.clear();
+            for (auto conn : conns) {
+                auto sending = _cfg.rate ? make_ready_future<>() : conn->send_requests();
+                // Run in the background, signal _conn_finished when done.
+                (void)when_all_succeed(std::move(sending), conn->read_responses()).discard_result().then_wrapped([this, conn] (auto&& f) {
+                    http_debug("Finished connection %6d on cpu %3d\n", _conn_finished.current(), this_shard_id());
+                    _total_reqs += conn->nr_done();
+                    try {
+                        f.get();
+                    } catch (std::exception& ex) {
+                        fmt::print("http request error: {}\n", ex.what());
+                    }
+                    return conn->close().handle_exception([] (std::exception_ptr) {}).finally([this, conn] {
+                        delete conn;
+                        _conn_finished.signal();
+                    });
+                });
+            }
+            auto sending = _cfg.rate ? send_on_timetable(conns) : make_ready_future<>();
+            return sending.then([this] {
+                // All finished
+                return _conn_finished.wait(_conn_per_core);
+            });
+        });
     }
     future<> stop() {
         return make_ready_future();
@@ -171,6 +345,17 @@ class http_client {
 
 namespace bpo = boost::program_options;
 
+static void print_latencies(const latency_histogram& latencies) {
+    auto ms = [] (std::chrono::nanoseconds d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    };
+    fmt::print("Latency (ms):");
+    for (auto p : {50.0, 90.0, 99.0, 99.9, 99.99}) {
+        fmt::print(" p{}={:.3f}", p, ms(latencies.percentile(p)));
+    }
+    fmt::print(" max={:.3f}\n", ms(latencies.max()));
+}
+
 int main(int ac, char** av) {
     app_template::config app_cfg;
     app_cfg.auto_handle_sigint_sigterm = false;
@@ -180,19 +365,34 @@ int main(int ac, char** av) {
         ("server,s", bpo::value<std::string>()->default_value("192.168.66.100:10000"), "Server address")
         ("conn,c", bpo::value<unsigned>()->default_value(100), "total connections")
         ("reqs,r", bpo::value<unsigned>()->default_value(0), "reqs per connection")
-        ("duration,d", bpo::value<unsigned>()->default_value(10), "duration of the test in seconds)");
+        ("duration,d", bpo::value<unsigned>()->default_value(10), "duration of the test in seconds)")
+        ("rate", bpo::value<double>()->default_value(0),
+            "send this many requests per second in total, on a fixed timetable, whatever the latency (open loop); "
+            "0 sends the next request when a response arrives (closed loop)")
+        ("pipeline", bpo::value<unsigned>()->default_value(1), "requests in flight on each connection")
+        ("keep-alive", bpo::value<bool>()->default_value(true),
+            "reuse connections; otherwise ask the server to close the connection after each response, and reconnect");
 
     return app.run(ac, av, [&app] () -> future<int> {
         auto& config = app.configuration();
         auto server = config["server"].as<std::string>();
-        auto reqs_per_conn = config["reqs"].as<unsigned>();
-        auto total_conn= config["conn"].as<unsigned>();
-        auto duration = config["duration"].as<unsigned>();
+        http_client_config cfg {
+            .duration = config["duration"].as<unsigned>(),
+            .total_conn = config["conn"].as<unsigned>(),
+            .reqs_per_conn = config["reqs"].as<unsigned>(),
+            .rate = config["rate"].as<double>(),
+            .pipeline = config["pipeline"].as<unsigned>(),
+            .keep_alive = config["keep-alive"].as<bool>(),
+        };
 
-        if (total_conn % smp::count != 0) {
+        if (cfg.total_conn % smp::count != 0) {
             fmt::print("Error: conn needs to be n * cpu_nr\n");
             return make_ready_future<int>(-1);
         }
+        if (cfg.pipeline == 0 || (!cfg.keep_alive && cfg.pipeline > 1)) {
+            fmt::print("Error: pipeline needs to be 1 without keep-alive, and at least 1 otherwise\n");
+            return make_ready_future<int>(-1);
+        }
 
         auto http_clients = new distributed<http_client>;
 
@@ -200,15 +400,28 @@ int main(int ac, char** av) {
         auto started = steady_clock_type::now();
         fmt::print("========== http_client ============\n");
         fmt::print("Server: {}\n", server);
-        fmt::print("Connections: {:d}\n", total_conn);
-        fmt::print("Requests/connection: {}\n", reqs_per_conn == 0 ? "dynamic (timer based)" : std::to_string(reqs_per_conn));
-        return http_clients->start(std::move(duration), std::move(total_conn), std::move(reqs_per_conn)).then([http_clients, server] {
+        fmt::print("Connections: {:d}\n", cfg.total_conn);
+        if (cfg.rate) {
+            fmt::print("Rate: {} requests/sec (open loop)\n", cfg.rate);
+        } else {
+            fmt::print("Requests/connection: {}\n", cfg.reqs_per_conn == 0 ? "dynamic (timer based)" : std::to_string(cfg.reqs_per_conn));
+        }
+        fmt::print("Pipeline: {:d}{}\n", cfg.pipeline, cfg.keep_alive ? "" : ", no keep-alive");
+        return http_clients->start(cfg).then([http_clients, server] {
             return http_clients->invoke_on_all(&http_client::connect, ipv4_addr{server});
         }).then([http_clients] {
             return http_clients->invoke_on_all(&http_client::run);
         }).then([http_clients] {
             return http_clients->map_reduce(adder<uint64_t>(), &http_client::total_reqs);
-        }).then([http_clients, started] (auto total_reqs) {
+        }).then([http_clients] (auto total_reqs) {
+            return http_clients->map_reduce0(std::mem_fn(&http_client::latencies), latency_histogram(),
+                    [] (latency_histogram a, const latency_histogram& b) { return std::move(a += b); }).then([http_clients, total_reqs] (latency_histogram latencies) {
+                return http_clients->map_reduce(adder<uint64_t>(), &http_client::late_reqs).then([total_reqs, latencies = std::move(latencies)] (uint64_t late_reqs) {
+                    return std::make_tuple(total_reqs, std::move(latencies), late_reqs);
+                });
+            });
+        }).then([http_clients, started, rate = cfg.rate] (std::tuple<uint64_t, latency_histogram, uint64_t> results) {
+           auto& [total_reqs, latencies, late_reqs] = results;
            // All the http requests are finished
            auto finished = steady_clock_type::now();
            auto elapsed = finished - started;
@@ -217,6 +430,10 @@ int main(int ac, char** av) {
            fmt::print("Total requests: {:d}\n", total_reqs);
            fmt::print("Total time: {:f}\n", secs);
            fmt::print("Requests/sec: {:f}\n", static_cast<double>(total_reqs) / secs);
+           print_latencies(latencies);
+           if (rate) {
+               fmt::print("Requests sent late, for lack of a free connection: {:d}\n", late_reqs);
+           }
            fmt::print("==========     done     ============\n");
            return http_clients->stop().then([http_clients] {
                // FIXME: If we call engine().exit(0) here to exit when
@@ -0,0 +1,239 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+// Measures the latency and throughput of smp::submit_to() between every
+// pair of shards, one pair at a time, and groups the results by how close
+// the shards are on the machine: siblings of a core, sharing a last-level
+// cache, on the same NUMA node, or on different ones.
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <ranges>
+#include <vector>
+#include <fmt/core.h>
+#include <seastar/core/app-template.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/temporary_buffer.hh>
+
+using namespace seastar;
+using namespace std::chrono;
+
+struct test_config {
+    unsigned pings;
+    steady_clock::duration duration;
+    unsigned concurrency;
+    size_t payload;
+};
+
+struct pair_result {
+    // round trips of a single message at a time
+    double latency_avg_us = 0;
+    double latency_p99_us = 0;
+    // round trips of concurrency messages at a time
+    double throughput_kmps = 0;
+    double bandwidth_mbps = 0;
+};
+
+enum class distance { smt, cache, numa, remote };
+
+static const char* distance_name(distance d) {
+    switch (d) {
+    case distance::smt: return "smt siblings";
+    case distance::cache: return "same cache";
+    case distance::numa: return "same node";
+    case distance::remote: return "other node";
+    }
+    __builtin_unreachable();
+}
+
+static distance distance_between(const cpu_topology& a, const cpu_topology& b) {
+    if (a.core == b.core) {
+        return distance::smt;
+    }
+    if (a.cache_domain == b.cache_domain) {
+        return distance::cache;
+    }
+    if (a.numa_node == b.numa_node) {
+        return distance::numa;
+    }
+    return distance::remote;
+}
+
+static future<size_t> send(shard_id to, size_t payload) {
+    if (!payload) {
+        return smp::submit_to(to, [] { return size_t(0); });
+    }
+    // The receiver reads the data, as it would to use it
+    return smp::submit_to(to, [buf = temporary_buffer<char>(payload)] {
+        static thread_local size_t checksum;
+        checksum += std::accumulate(buf.begin(), buf.end(), size_t(0));
+        return buf.size();
+    });
+}
+
+// Runs on the sending shard
+static future<pair_result> measure(shard_id to, test_config cfg) {
+    pair_result res;
+
+    std::vector<steady_clock::duration> samples;
+    samples.reserve(cfg.pings);
+    for (unsigned i = 0; i < cfg.pings; i++) {
+        auto start = steady_clock::now();
+        co_await send(to, cfg.payload);
+        samples.push_back(steady_clock::now() - start);
+    }
+    if (!samples.empty()) {
+        std::ranges::sort(samples);
+        auto sum = std::accumulate(samples.begin(), samples.end(), steady_clock::duration(0));
+        res.latency_avg_us = duration<double, std::micro>(sum).count() / samples.size();
+        res.latency_p99_us = duration<double, std::micro>(samples[samples.size() * 99 / 100]).count();
+    }
+
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    auto start = steady_clock::now();
+    auto deadline = start + cfg.duration;
+    co_await parallel_for_each(std::views::iota(0u, cfg.concurrency), [&] (unsigned) {
+        return do_until([deadline] { return steady_clock::now() >= deadline; }, [&] {
+            return send(to, cfg.payload).then([&] (size_t len) {
+                messages++;
+                bytes += len;
+            });
+        });
+    });
+    auto elapsed = duration<double>(steady_clock::now() - start).count();
+    res.throughput_kmps = messages / elapsed / 1000;
+    res.bandwidth_mbps = bytes / elapsed / (1 << 20);
+    co_return res;
+}
+
+static void print_matrix(const char* title, const std::vector<std::vector<pair_result>>& results, double pair_result::* field) {
+    fmt::print("\n{}\n{:>7}", title, "from\\to");
+    for (shard_id to = 0; to < smp::count; to++) {
+        fmt::print(" {:>9}", to);
+    }
+    fmt::print("\n");
+    for (shard_id from = 0; from < smp::count; from++) {
+        fmt::print("{:>7}", from);
+        for (shard_id to = 0; to < smp::count; to++) {
+            if (from == to) {
+                fmt::print(" {:>9}", "-");
+            } else {
+                fmt::print(" {:>9.2f}", results[from][to].*field);
+            }
+        }
+        fmt::print("\n");
+    }
+}
+
+struct group_stats {
+    unsigned pairs = 0;
+    double min = std::numeric_limits<double>::max();
+    double max = 0;
+    double sum = 0;
+
+    void add(double v) {
+        pairs++;
+        min = std::min(min, v);
+        max = std::max(max, v);
+        sum += v;
+    }
+};
+
+static void print_groups(const std::vector<std::vector<pair_result>>& results) {
+    auto topology = engine().smp().shard_topology();
+    std::map<distance, std::pair<group_stats, group_stats>> groups;
+    for (shard_id from = 0; from < smp::count; from++) {
+        for (shard_id to = 0; to < smp::count; to++) {
+            if (from == to) {
+                continue;
+            }
+            auto& g = groups[distance_between(topology[from], topology[to])];
+            g.first.add(results[from][to].latency_avg_us);
+            g.second.add(results[from][to].throughput_kmps);
+        }
+    }
+    fmt::print("\n{:<14} {:>6} {:>30} {:>37}\n", "distance", "pairs", "latency min/avg/max (us)", "throughput min/avg/max (kmsg/s)");
+    for (auto& [d, g] : groups) {
+        auto& [lat, tput] = g;
+        fmt::print("{:<14} {:>6} {:>10.2f}{:>10.2f}{:>10.2f} {:>12.1f}{:>12.1f}{:>12.1f}\n", distance_name(d), lat.pairs,
+                lat.min, lat.sum / lat.pairs, lat.max, tput.min, tput.sum / tput.pairs, tput.max);
+    }
+}
+
+int main(int ac, char** av) {
+    app_template app;
+    namespace bpo = boost::program_options;
+    app.add_options()
+        ("pings", bpo::value<unsigned>()->default_value(1000), "messages sent one at a time to measure the latency of each pair")
+        ("duration", bpo::value<unsigned>()->default_value(100), "time (ms) to measure the throughput of each pair for")
+        ("concurrency", bpo::value<unsigned>()->default_value(128), "messages in flight when measuring the throughput")
+        ("payload", bpo::value<size_t>()->default_value(0), "bytes each message carries, read by the receiving shard")
+        ;
+
+    return app.run(ac, av, [&app] () -> future<> {
+        auto& conf = app.configuration();
+        test_config cfg{
+            .pings = conf["pings"].as<unsigned>(),
+            .duration = milliseconds(conf["duration"].as<unsigned>()),
+            .concurrency = std::max(conf["concurrency"].as<unsigned>(), 1u),
+            .payload = conf["payload"].as<size_t>(),
+        };
+
+        auto topology = engine().smp().shard_topology();
+        fmt::print("{:>5} {:>5} {:>5} {:>6} {:>5}\n", "shard", "cpu", "core", "cache", "node");
+        for (shard_id s = 0; s < smp::count; s++) {
+            auto& t = topology[s];
+            fmt::print("{:>5} {:>5} {:>5} {:>6} {:>5}\n", s, t.cpu, t.core, t.cache_domain, t.numa_node);
+        }
+
+        // One pair at a time, so that pairs don't compete for the caches
+        // and the interconnect
+        std::vector<std::vector<pair_result>> results(smp::count, std::vector<pair_result>(smp::count));
+        for (shard_id from = 0; from < smp::count; from++) {
+            for (shard_id to = 0; to < smp::count; to++) {
+                if (from != to) {
+                    results[from][to] = co_await smp::submit_to(from, [to, cfg] {
+                        return measure(to, cfg);
+                    });
+                }
+            }
+        }
+
+        if (smp::count < 2) {
+            fmt::print("\nno shard pairs, run with --smp 2 or more\n");
+            co_return;
+        }
+        print_matrix("latency avg (us)", results, &pair_result::latency_avg_us);
+        print_matrix("latency p99 (us)", results, &pair_result::latency_p99_us);
+        print_matrix("throughput (kmsg/s)", results, &pair_result::throughput_kmps);
+        if (cfg.payload) {
+            print_matrix("bandwidth (MB/s)", results, &pair_result::bandwidth_mbps);
+        }
+        print_groups(results);
+    });
+}
@@ -88,7 +88,11 @@ macro (seastar_find_dependencies)
   endif()
   seastar_find_dep (fmt 8.1.1 REQUIRED)
   seastar_find_dep (lz4 1.7.3 REQUIRED)
+  # also used for hashing outside of seastar::tls
   seastar_find_dep (GnuTLS 3.3.26 REQUIRED)
+  if (Seastar_WITH_OSSL)
+    seastar_find_dep (OpenSSL 3.0 REQUIRED)
+  endif ()
   if (Seastar_IO_URING)
     seastar_find_dep (LibUring 2.0 REQUIRED)
   endif()
@@ -105,6 +109,10 @@ macro (seastar_find_dependencies)
   seastar_find_dep (ucontext REQUIRED)
   seastar_find_dep (yaml-cpp REQUIRED
     VERSION 0.5.1)
+  seastar_find_dep (ZLIB REQUIRED)
+  if (Seastar_ZSTD)
+    seastar_find_dep (zstd 1.4.0 REQUIRED)
+  endif ()
 
   # workaround for https://gitlab.kitware.com/cmake/cmake/-/issues/25079
   # since protobuf v22.0, it started using abseil, see
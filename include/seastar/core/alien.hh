@@ -24,10 +24,13 @@
 
 #ifndef SEASTAR_MODULE
 #include <atomic>
+#include <chrono>
 #include <concepts>
+#include <cstdint>
 #include <future>
 #include <memory>
 #include <type_traits>
+#include <vector>
 #include <boost/lockfree/queue.hpp>
 #endif
 
@@ -47,6 +50,8 @@ class reactor;
 /// \brief Integration with non-seastar applications.
 namespace alien {
 
+class batch;
+
 class message_queue {
     static constexpr size_t batch_size = 128;
     static constexpr size_t prefetch_cnt = 2;
@@ -64,6 +69,18 @@ class message_queue {
     struct alignas(seastar::cache_line_size) {
         std::atomic<size_t> value{0};
     } _sent;
+    struct alignas(seastar::cache_line_size) {
+        // Messages pushed and not yet processed. Senders only wake the
+        // shard up when it was not positive, as otherwise the shard has
+        // yet to account for a message and will poll the queue again
+        // before sleeping. A message is counted after it is pushed, so the
+        // count can transiently go below zero.
+        std::atomic<int64_t> queued{0};
+        // senders waiting for room in a bounded queue
+        std::atomic<unsigned> blocked{0};
+        // 0 for an unbounded queue
+        std::atomic<size_t> max_pending{0};
+    } _flow;
     // keep this between two structures with statistics
     // this makes sure that they have at least one cache line
     // between them, so hw prefetcher will not accidentally prefetch
@@ -85,18 +102,36 @@ class message_queue {
             _func();
         }
     };
+    template <typename Func>
+    static std::unique_ptr<work_item> make_work_item(Func&& func) {
+        return std::make_unique<async_work_item<Func>>(std::forward<Func>(func));
+    }
     template<typename Func>
     size_t process_queue(lf_queue& q, Func process);
+    bool has_room(size_t nr) const noexcept;
+    void wait_for_room(size_t nr);
+    void queued(size_t nr) noexcept;
     void submit_item(std::unique_ptr<work_item> wi);
+    bool try_submit_item(std::unique_ptr<work_item>& wi);
+    void submit_items(std::vector<std::unique_ptr<work_item>>& items);
+
+    friend class batch;
 public:
     message_queue(reactor *to);
     void start();
     void stop();
     template <typename Func>
     void submit(Func&& func) {
-        auto wi = std::make_unique<async_work_item<Func>>(std::forward<Func>(func));
-        submit_item(std::move(wi));
+        submit_item(make_work_item(std::forward<Func>(func)));
+    }
+    template <typename Func>
+    bool try_submit(Func&& func) {
+        auto wi = make_work_item(std::forward<Func>(func));
+        return try_submit_item(wi);
     }
+    /// Bounds the number of messages waiting to be processed, 0 for none.
+    /// Senders wait for room while the queue is full.
+    void set_max_pending(size_t max_pending) noexcept;
     size_t process_incoming();
     bool pure_poll_rx() const;
 };
@@ -123,6 +158,20 @@ class instance {
     qs _qs;
     bool poll_queues();
     bool pure_poll_queues();
+
+    /// Bounds the number of messages waiting to be processed by each shard.
+    ///
+    /// When a shard's queue holds \c max_pending messages, run_on() and
+    /// submit_to() block the calling thread until the shard processed some
+    /// of them, and try_run_on() fails, so that fast producers cannot grow
+    /// the queues without limit. The bound may be exceeded by the messages
+    /// of senders racing each other, and a \ref batch larger than the bound
+    /// is sent once the queue is empty. 0, the default, leaves the queues
+    /// unbounded.
+    ///
+    /// \note with a bounded queue, a shard must not send messages to itself
+    ///       with the functions of this namespace, or it may block forever.
+    void set_max_pending(size_t max_pending) noexcept;
 };
 
 namespace internal {
@@ -150,6 +199,19 @@ void run_on(instance& instance, unsigned shard, Func func) {
     instance._qs[shard].submit(std::move(func));
 }
 
+/// Runs a function on a remote shard from an alien thread, unless its queue is full.
+///
+/// Like run_on(), but fails instead of blocking when the queue of \c shard holds
+/// as many messages as instance::set_max_pending() allows.
+///
+/// \return whether \c func was sent to \c shard
+SEASTAR_MODULE_EXPORT
+template <typename Func>
+requires std::is_nothrow_invocable_r_v<void, Func>
+bool try_run_on(instance& instance, unsigned shard, Func func) {
+    return instance._qs[shard].try_submit(std::move(func));
+}
+
 /// Runs a function on a remote shard from an alien thread where engine() is not available.
 ///
 /// \param shard designates the shard to run the function on
@@ -188,6 +250,21 @@ struct return_type_of<Func, false> {
     }
 };
 template <typename Func> using return_type_t = typename return_type_of<Func>::type;
+
+// Wraps \c func into a message fulfilling \c pr with its result
+template <typename Func, typename T>
+auto make_submit_func(std::promise<T> pr, Func func) {
+    return [pr = std::move(pr), func = std::move(func)] () mutable noexcept {
+        // std::future returned via std::promise above.
+        (void)func().then_wrapped([pr = std::move(pr)] (auto&& result) mutable {
+            try {
+                return_type_of<Func>::set(pr, result.get());
+            } catch (...) {
+                pr.set_exception(std::current_exception());
+            }
+        });
+    };
+}
 }
 
 /// Runs a function on a remote shard from an alien thread where engine() is not available.
@@ -204,16 +281,7 @@ template<std::invocable Func, typename T = internal::return_type_t<Func>>
 std::future<T> submit_to(instance& instance, unsigned shard, Func func) {
     std::promise<T> pr;
     auto fut = pr.get_future();
-    run_on(instance, shard, [pr = std::move(pr), func = std::move(func)] () mutable noexcept {
-        // std::future returned via std::promise above.
-        (void)func().then_wrapped([pr = std::move(pr)] (auto&& result) mutable {
-            try {
-                internal::return_type_of<Func>::set(pr, result.get());
-            } catch (...) {
-                pr.set_exception(std::current_exception());
-            }
-        });
-    });
+    run_on(instance, shard, internal::make_submit_func(std::move(pr), std::move(func)));
     return fut;
 }
 
@@ -231,5 +299,92 @@ std::future<T> submit_to(unsigned shard, Func func) {
     return submit_to(*internal::default_instance, shard, std::move(func));
 }
 
+/// Sends messages from an alien thread to a shard in batches.
+///
+/// Every run_on() and submit_to() call pushes a message and, if the shard
+/// sleeps, wakes it up with a system call, so a thread sending a stream of
+/// small messages keeps waking up an otherwise idle shard. A batch buffers
+/// the messages instead, and sends them with a single wakeup when it holds
+/// \c max_messages of them, or on the first message added \c window or more
+/// after the oldest one it buffers. Messages are only sent as other ones are
+/// added, so the producer must call flush() when it is done for now. The
+/// destructor flushes too, but can only log a failure to send, and the
+/// messages it could not send are dropped; call flush() to see errors.
+///
+/// A batch is used by a single thread. Messages are processed in order.
+///
+/// ```
+/// alien::batch b(app.alien(), shard, 64, 200us);
+/// for (auto& req : incoming) {
+///     b.run_on([req = std::move(req)] () mutable noexcept { process(std::move(req)); });
+/// }
+/// b.flush();
+/// ```
+SEASTAR_MODULE_EXPORT
+class batch {
+public:
+    using clock = std::chrono::steady_clock;
+private:
+    message_queue& _queue;
+    const size_t _max_messages;
+    const clock::duration _window;
+    clock::time_point _oldest;
+    std::vector<std::unique_ptr<message_queue::work_item>> _messages;
+
+    void add(std::unique_ptr<message_queue::work_item> wi) {
+        auto now = clock::now();
+        if (_messages.empty()) {
+            _oldest = now;
+        }
+        _messages.push_back(std::move(wi));
+        if (_messages.size() >= _max_messages || now - _oldest >= _window) {
+            flush();
+        }
+    }
+public:
+    /// \param instance designates the Seastar instance to process the messages
+    /// \param shard designates the shard to run the messages on
+    /// \param max_messages number of buffered messages sent at once
+    /// \param window how long a message may be buffered while others are added;
+    ///        with a zero window, every message is sent right away
+    batch(instance& instance, unsigned shard, size_t max_messages = 128, clock::duration window = std::chrono::microseconds(100))
+        : _queue(instance._qs[shard])
+        , _max_messages(max_messages)
+        , _window(window) {
+        _messages.reserve(max_messages);
+    }
+    batch(batch&&) = default;
+    ~batch();
+
+    /// Adds a message running \c func on the shard, as run_on() would
+    template <typename Func>
+    requires std::is_nothrow_invocable_r_v<void, Func>
+    void run_on(Func func) {
+        add(message_queue::make_work_item(std::move(func)));
+    }
+
+    /// Adds a message running \c func on the shard, as submit_to() would
+    ///
+    /// \return whatever \c func returns, as a \c std::future<>, which is only
+    ///         ready after the message was flushed
+    template<std::invocable Func, typename T = internal::return_type_t<Func>>
+    std::future<T> submit_to(Func func) {
+        std::promise<T> pr;
+        auto fut = pr.get_future();
+        run_on(internal::make_submit_func(std::move(pr), std::move(func)));
+        return fut;
+    }
+
+    /// Sends the buffered messages, waiting for room in a bounded queue
+    void flush() {
+        if (!_messages.empty()) {
+            _queue.submit_items(_messages);
+        }
+    }
+
+    /// Returns the number of buffered messages
+    size_t size() const noexcept { return _messages.size(); }
+};
+
 }
 }
@@ -0,0 +1,129 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#include <memory>
+#endif
+
+#include <seastar/core/file.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+/// \addtogroup fileio-module
+/// @{
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// How a \ref block_cache chooses the blocks to evict
+enum class block_cache_eviction {
+    lru, ///< the least recently used block
+    /// Adaptive Replacement Cache: recency and frequency are balanced after
+    /// the recently evicted blocks, so a scan does not flush the blocks
+    /// that are read again and again.
+    arc,
+};
+
+/// Configuration of a \ref block_cache
+struct block_cache_config {
+    /// The memory the cached blocks may use, in bytes
+    size_t capacity = 64 << 20;
+    /// The unit of caching and of the reads of the underlying files, must be
+    /// a multiple of their disk read alignment
+    size_t block_size = 64 << 10;
+    block_cache_eviction eviction = block_cache_eviction::arc;
+    /// The priority of the memory reclaimer that evicts blocks when the
+    /// shard runs low on memory, see memory::reclaimer
+    unsigned reclaimer_priority = memory::reclaimer::default_priority;
+};
+
+/// A per-shard cache of file blocks, shared by the files made with
+/// make_cached_file().
+///
+/// Reads of cached files are served in whole blocks: a block that is not
+/// cached is read from the underlying file once, with concurrent reads of
+/// it waiting for that read, and is then kept until evicted. The last block
+/// of a file is not kept when it is short, as the file may grow. Blocks are
+/// evicted to stay within the configured capacity, and when the shard runs
+/// low on memory.
+///
+/// The cache must be used on the shard it was created on, and outlive its
+/// files. Its hits, misses and usage are exported as metrics of the
+/// "block_cache" group, labelled by the cache name.
+class block_cache {
+public:
+    struct stats {
+        uint64_t hits = 0; ///< block lookups served from memory
+        uint64_t misses = 0; ///< block lookups that read the underlying file
+        uint64_t coalesced = 0; ///< block lookups that waited for another's read
+        uint64_t evictions = 0; ///< blocks evicted to make room
+        uint64_t reclaimed = 0; ///< blocks evicted by the memory reclaimer
+        uint64_t invalidations = 0; ///< blocks dropped by writes, truncation or close
+    };
+    class impl;
+private:
+    std::unique_ptr<impl> _impl;
+public:
+    /// \param name labels the metrics of the cache
+    /// \param cfg the cache configuration
+    explicit block_cache(sstring name, block_cache_config cfg = {});
+    ~block_cache();
+    block_cache(const block_cache&) = delete;
+
+    const block_cache_config& config() const noexcept;
+    const stats& get_stats() const noexcept;
+    /// The memory used by the cached blocks, in bytes
+    size_t memory_used() const noexcept;
+    /// Drops all the cached blocks
+    void clear() noexcept;
+
+    /// \cond internal
+    impl& get_impl() noexcept { return *_impl; }
+    /// \endcond
+};
+
+/// Wraps a file so that its reads go through a block cache.
+///
+/// Writes, discards and truncations through the returned file drop the
+/// blocks they cover, and closing it drops all its blocks. Modifications
+/// made through other file objects, including other cached files of the
+/// same path, are not seen, so this is meant for files that are read
+/// mostly, or written through this file only.
+///
+/// As a block read may be shared by several reads, the io_intent of a read
+/// does not apply to the reads of the underlying file it causes.
+///
+/// \param f the file to cache
+/// \param cache the cache to use, which must outlive the returned file
+/// \throws std::invalid_argument if the block size of the cache is not a
+///         multiple of the disk read alignment of \c f
+file make_cached_file(file f, block_cache& cache);
+
+SEASTAR_MODULE_EXPORT_END
+
+/// @}
+
+}
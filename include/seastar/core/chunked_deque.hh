@@ -0,0 +1,312 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/circular_buffer.hh>
+#include <seastar/core/bitops.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <compare>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#endif
+
+namespace seastar {
+
+/// A double-ended queue stored in fixed-size chunks.
+///
+/// Like circular_buffer, chunked_deque supports O(1) push and pop at both
+/// ends and O(1) random access, but it never reallocates its elements:
+/// they are stored in chunks of \c items_per_chunk elements, allocated and
+/// freed as the queue grows and shrinks at either end, and only an array of
+/// pointers to the chunks (a circular_buffer) grows exponentially. Growing
+/// a queue to millions of elements thus neither moves them nor needs a
+/// contiguous allocation larger than a chunk and that array, which is
+/// \c items_per_chunk times smaller than the storage of a circular_buffer.
+/// One freed chunk is kept aside, so that a queue whose size oscillates
+/// around a chunk boundary does not allocate on every push.
+///
+/// chunked_fifo is cheaper still when elements are only pushed at the back
+/// and popped at the front; chunked_deque also allows push_front(),
+/// pop_back() and indexing, as the reactor's task queues need.
+///
+/// Adding elements invalidates iterators but not references. Removing
+/// elements only invalidates the iterators and references to them.
+///
+/// \tparam T the type of the elements
+/// \tparam items_per_chunk number of elements in a chunk, a power of two
+SEASTAR_MODULE_EXPORT
+template <typename T, size_t items_per_chunk = 128>
+class chunked_deque {
+    static_assert((items_per_chunk & (items_per_chunk - 1)) == 0, "items_per_chunk must be a power of two");
+    static constexpr size_t chunk_shift = log2floor(items_per_chunk);
+    static constexpr size_t chunk_mask = items_per_chunk - 1;
+
+    union maybe_item {
+        maybe_item() noexcept {}
+        ~maybe_item() {}
+        T data;
+    };
+    struct chunk {
+        maybe_item items[items_per_chunk];
+    };
+
+    circular_buffer<chunk*> _chunks;
+    // index of the front element in the first chunk, below items_per_chunk
+    size_t _front = 0;
+    size_t _size = 0;
+    chunk* _spare = nullptr;
+
+    T& item(size_t idx) const noexcept {
+        auto pos = _front + idx;
+        return _chunks[pos >> chunk_shift]->items[pos & chunk_mask].data;
+    }
+
+    chunk* get_chunk() {
+        if (_spare) {
+            return std::exchange(_spare, nullptr);
+        }
+        return new chunk;
+    }
+
+    void put_chunk(chunk* c) noexcept {
+        if (_spare) {
+            delete c;
+        } else {
+            _spare = c;
+        }
+    }
+
+    // Makes room for an element at the back, returning where it goes
+    T* back_slot() {
+        auto pos = _front + _size;
+        if (pos == _chunks.size() << chunk_shift) {
+            auto c = get_chunk();
+            try {
+                _chunks.push_back(c);
+            } catch (...) {
+                put_chunk(c);
+                throw;
+            }
+        }
+        return &_chunks[pos >> chunk_shift]->items[pos & chunk_mask].data;
+    }
+
+    // Makes room for an element at the front, returning where it goes
+    T* front_slot() {
+        if (_front == 0) {
+            auto c = get_chunk();
+            try {
+                _chunks.push_front(c);
+            } catch (...) {
+                put_chunk(c);
+                throw;
+            }
+            return &c->items[items_per_chunk - 1].data;
+        }
+        return &_chunks.front()->items[_front - 1].data;
+    }
+
+    void front_added() noexcept {
+        _front = (_front == 0 ? items_per_chunk : _front) - 1;
+        ++_size;
+    }
+
+    template <typename CD, typename ValueType>
+    class iterator_base {
+        CD* _deque = nullptr;
+        size_t _idx = 0;
+
+        iterator_base(CD* deque, size_t idx) noexcept : _deque(deque), _idx(idx) {}
+        friend class chunked_deque;
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = std::remove_const_t<ValueType>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = ValueType*;
+        using reference = ValueType&;
+
+        iterator_base() noexcept = default;
+        template <typename OtherCD, typename OtherValueType>
+        requires std::is_const_v<ValueType> && (!std::is_const_v<OtherValueType>)
+        iterator_base(const iterator_base<OtherCD, OtherValueType>& o) noexcept : iterator_base(o._deque, o._idx) {}
+
+        reference operator*() const noexcept { return _deque->item(_idx); }
+        pointer operator->() const noexcept { return &_deque->item(_idx); }
+        reference operator[](difference_type n) const noexcept { return _deque->item(_idx + n); }
+        iterator_base& operator++() noexcept { ++_idx; return *this; }
+        iterator_base operator++(int) noexcept { auto it = *this; ++_idx; return it; }
+        iterator_base& operator--() noexcept { --_idx; return *this; }
+        iterator_base operator--(int) noexcept { auto it = *this; --_idx; return it; }
+        iterator_base& operator+=(difference_type n) noexcept { _idx += n; return *this; }
+        iterator_base& operator-=(difference_type n) noexcept { _idx -= n; return *this; }
+        iterator_base operator+(difference_type n) const noexcept { return {_deque, _idx + n}; }
+        friend iterator_base operator+(difference_type n, const iterator_base& it) noexcept { return it + n; }
+        iterator_base operator-(difference_type n) const noexcept { return {_deque, _idx - n}; }
+        difference_type operator-(const iterator_base& o) const noexcept { return difference_type(_idx) - difference_type(o._idx); }
+        bool operator==(const iterator_base& o) const noexcept { return _idx == o._idx; }
+        auto operator<=>(const iterator_base& o) const noexcept { return _idx <=> o._idx; }
+
+        template <typename, typename>
+        friend class iterator_base;
+    };
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using reference = T&;
+    using pointer = T*;
+    using const_reference = const T&;
+    using const_pointer = const T*;
+    using iterator = iterator_base<chunked_deque, T>;
+    using const_iterator = iterator_base<const chunked_deque, const T>;
+
+    chunked_deque() noexcept = default;
+    chunked_deque(chunked_deque&& o) noexcept
+        : _chunks(std::move(o._chunks))
+        , _front(std::exchange(o._front, 0))
+        , _size(std::exchange(o._size, 0))
+        , _spare(std::exchange(o._spare, nullptr)) {
+    }
+    chunked_deque(const chunked_deque&) = delete;
+    chunked_deque& operator=(const chunked_deque&) = delete;
+    chunked_deque& operator=(chunked_deque&& o) noexcept {
+        if (this != &o) {
+            this->~chunked_deque();
+            new (this) chunked_deque(std::move(o));
+        }
+        return *this;
+    }
+    ~chunked_deque() {
+        clear();
+        delete _spare;
+    }
+
+    bool empty() const noexcept { return !_size; }
+    size_t size() const noexcept { return _size; }
+
+    T& front() noexcept { return item(0); }
+    const T& front() const noexcept { return item(0); }
+    T& back() noexcept { return item(_size - 1); }
+    const T& back() const noexcept { return item(_size - 1); }
+    T& operator[](size_t idx) noexcept { return item(idx); }
+    const T& operator[](size_t idx) const noexcept { return item(idx); }
+
+    template <typename... A>
+    T& emplace_back(A&&... args) {
+        auto p = back_slot();
+        try {
+            new (p) T(std::forward<A>(args)...);
+        } catch (...) {
+            if (((_front + _size) & chunk_mask) == 0) {
+                put_chunk(_chunks.back());
+                _chunks.pop_back();
+            }
+            throw;
+        }
+        ++_size;
+        return *p;
+    }
+    void push_back(const T& data) { emplace_back(data); }
+    void push_back(T&& data) { emplace_back(std::move(data)); }
+
+    template <typename... A>
+    T& emplace_front(A&&... args) {
+        auto p = front_slot();
+        try {
+            new (p) T(std::forward<A>(args)...);
+        } catch (...) {
+            if (_front == 0) {
+                put_chunk(_chunks.front());
+                _chunks.pop_front();
+            }
+            throw;
+        }
+        front_added();
+        return *p;
+    }
+    void push_front(const T& data) { emplace_front(data); }
+    void push_front(T&& data) { emplace_front(std::move(data)); }
+
+    void pop_front() noexcept {
+        std::destroy_at(&front());
+        --_size;
+        if (++_front == items_per_chunk) {
+            put_chunk(_chunks.front());
+            _chunks.pop_front();
+            _front = 0;
+        } else if (!_size) {
+            // The only chunk left is reused from its start
+            _front = 0;
+        }
+    }
+
+    void pop_front_n(size_t n) noexcept {
+        while (n--) {
+            pop_front();
+        }
+    }
+
+    void pop_back() noexcept {
+        std::destroy_at(&back());
+        --_size;
+        if (((_front + _size) & chunk_mask) == 0 && _front + _size < _chunks.size() << chunk_shift) {
+            put_chunk(_chunks.back());
+            _chunks.pop_back();
+            if (_chunks.empty()) {
+                _front = 0;
+            }
+        }
+    }
+
+    void clear() noexcept {
+        if constexpr (std::is_trivially_destructible_v<T>) {
+            _size = 0;
+        } else {
+            while (_size) {
+                pop_back();
+            }
+        }
+        while (!_chunks.empty()) {
+            put_chunk(_chunks.back());
+            _chunks.pop_back();
+        }
+        _front = 0;
+        _size = 0;
+    }
+
+    /// Makes room for \c n elements in the array of chunk pointers; the
+    /// chunks themselves are still allocated as elements are added
+    void reserve(size_t n) {
+        _chunks.reserve((n + items_per_chunk - 1) / items_per_chunk + 1);
+    }
+
+    iterator begin() noexcept { return {this, 0}; }
+    iterator end() noexcept { return {this, _size}; }
+    const_iterator begin() const noexcept { return {this, 0}; }
+    const_iterator end() const noexcept { return {this, _size}; }
+    const_iterator cbegin() const noexcept { return begin(); }
+    const_iterator cend() const noexcept { return end(); }
+};
+
+}
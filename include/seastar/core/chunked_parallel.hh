@@ -0,0 +1,191 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/coroutine/maybe_yield.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <ranges>
+#include <vector>
+#endif
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup future-util
+/// @{
+
+/// How the chunked_parallel algorithms split their work
+struct chunked_parallel_options {
+    /// The number of consecutive elements a task processes. The task yields
+    /// whenever preemption is due within the chunk, so the size bounds the
+    /// granularity of the work, not the latency of the shard.
+    size_t chunk_size = 16 * 1024;
+    /// The number of chunks processed at once, 0 for one per shard when
+    /// \c across_shards is set, and one otherwise
+    size_t max_concurrent = 0;
+    /// Spread the chunks round-robin over all shards with \ref smp::submit_to(),
+    /// for CPU-bound work. The function is then called concurrently from several
+    /// shards, so it, and the elements it touches, must be safe to use from them.
+    bool across_shards = false;
+};
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+namespace internal {
+
+inline size_t chunked_parallel_nr_chunks(size_t size, const chunked_parallel_options& opts) noexcept {
+    auto chunk_size = std::max<size_t>(opts.chunk_size, 1);
+    return (size + chunk_size - 1) / chunk_size;
+}
+
+// Calls func(i) for i in [first, last), yielding when preemption is due
+template <typename Func>
+future<> chunked_parallel_process(size_t first, size_t last, const Func& func) {
+    for (; first != last; ++first) {
+        func(first);
+        co_await coroutine::maybe_yield();
+    }
+}
+
+// Calls func(chunk, i) for i in [0, size), chunk by chunk
+template <typename Func>
+future<> chunked_parallel_run(size_t size, chunked_parallel_options opts, Func func) {
+    auto chunk_size = std::max<size_t>(opts.chunk_size, 1);
+    auto nr_chunks = chunked_parallel_nr_chunks(size, opts);
+    auto concurrency = opts.max_concurrent ? opts.max_concurrent : opts.across_shards ? smp::count : 1;
+    auto origin = this_shard_id();
+    co_await max_concurrent_for_each(std::views::iota(size_t(0), nr_chunks), concurrency, [&] (size_t chunk) {
+        auto process = [&func, chunk, first = chunk * chunk_size, last = std::min(chunk * chunk_size + chunk_size, size)] {
+            return chunked_parallel_process(first, last, [&func, chunk] (size_t i) {
+                func(chunk, i);
+            });
+        };
+        if (!opts.across_shards) {
+            return process();
+        }
+        return smp::submit_to((origin + chunk) % smp::count, std::move(process));
+    });
+}
+
+}
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup future-util
+/// @{
+
+/// Calls a function for each element of a range, in chunks (range version).
+///
+/// Unlike \ref parallel_for_each(), which makes a task per element, the range
+/// is split into chunks of consecutive elements, each processed by a single
+/// task that yields when preemption is due. That makes it suitable for large
+/// ranges and for synchronous, CPU-bound functions.
+///
+/// The caller must keep the range alive until the returned future resolves.
+///
+/// \param range a random-access range
+/// \param func a synchronous function to invoke with each element of the range
+/// \param opts how to split the work, see \ref chunked_parallel_options
+/// \return a \c future<> that resolves when all the chunks are processed. If
+///         \c func throws, the return value contains one of the exceptions.
+template <std::ranges::random_access_range Range, typename Func>
+requires std::ranges::sized_range<Range> && std::invocable<const Func&, std::ranges::range_reference_t<Range>>
+future<> chunked_parallel_for_each(Range& range, Func func, chunked_parallel_options opts = {}) {
+    auto first = std::ranges::begin(range);
+    co_await internal::chunked_parallel_run(std::ranges::size(range), opts, [&] (size_t, size_t i) {
+        std::invoke(func, first[i]);
+    });
+}
+
+/// Transforms the elements of a range into an output range, in chunks.
+///
+/// Writes \c func(range[i]) to \c out[i], with the work split as by
+/// \ref chunked_parallel_for_each(). The output must have room for as many
+/// elements as the range, and the caller must keep both alive until the
+/// returned future resolves.
+///
+/// \param range a random-access range
+/// \param out the beginning of the output range
+/// \param func a synchronous function to invoke with each element of the range
+/// \param opts how to split the work, see \ref chunked_parallel_options
+template <std::ranges::random_access_range Range, std::random_access_iterator OutputIt, typename Func>
+requires std::ranges::sized_range<Range> && std::invocable<const Func&, std::ranges::range_reference_t<Range>>
+future<> chunked_parallel_transform(Range& range, OutputIt out, Func func, chunked_parallel_options opts = {}) {
+    auto first = std::ranges::begin(range);
+    co_await internal::chunked_parallel_run(std::ranges::size(range), opts, [&] (size_t, size_t i) {
+        out[i] = std::invoke(func, first[i]);
+    });
+}
+
+/// Maps the elements of a range and reduces the results, in chunks.
+///
+/// Each chunk is reduced on its own starting from \c identity, and the partial
+/// results are reduced in the order of the chunks, so \c reduce must be
+/// associative and \c identity must be its identity element, as for
+/// std::transform_reduce(). The work is split as by \ref chunked_parallel_for_each().
+///
+/// \param range a random-access range
+/// \param identity the identity element of \c reduce
+/// \param reduce a function taking two values of \c T and returning their reduction
+/// \param map a function taking an element of the range and returning a value
+///            that \c reduce accepts
+/// \param opts how to split the work, see \ref chunked_parallel_options
+/// \return the reduction of all the mapped elements
+template <std::ranges::random_access_range Range, typename T, typename Reduce, typename Map>
+requires std::ranges::sized_range<Range> && std::invocable<const Map&, std::ranges::range_reference_t<Range>>
+future<T> chunked_parallel_transform_reduce(Range& range, T identity, Reduce reduce, Map map, chunked_parallel_options opts = {}) {
+    auto first = std::ranges::begin(range);
+    std::vector<T> partials(internal::chunked_parallel_nr_chunks(std::ranges::size(range), opts), identity);
+    co_await internal::chunked_parallel_run(std::ranges::size(range), opts, [&] (size_t chunk, size_t i) {
+        partials[chunk] = std::invoke(reduce, std::move(partials[chunk]), std::invoke(map, first[i]));
+    });
+    for (auto& p : partials) {
+        identity = std::invoke(reduce, std::move(identity), std::move(p));
+    }
+    co_return identity;
+}
+
+/// Reduces the elements of a range, in chunks.
+///
+/// The same as \ref chunked_parallel_transform_reduce() with the elements
+/// reduced as they are.
+template <std::ranges::random_access_range Range, typename T, typename Reduce>
+requires std::ranges::sized_range<Range>
+future<T> chunked_parallel_reduce(Range& range, T identity, Reduce reduce, chunked_parallel_options opts = {}) {
+    return chunked_parallel_transform_reduce(range, std::move(identity), std::move(reduce), std::identity{}, opts);
+}
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+} // namespace seastar
@@ -36,22 +36,113 @@ namespace seastar {
 
 namespace internal {
 
+// Coroutine frames are recycled through per-shard free lists, one per size
+// class, instead of going through the general allocator for each call.
+// Frames larger than the largest size class are not pooled.
+void* allocate_coroutine_frame(size_t size);
+void free_coroutine_frame(void* frame, size_t size) noexcept;
+
+struct coroutine_frame_stats {
+    uint64_t allocations = 0;
+    // allocations served from the free lists
+    uint64_t pool_hits = 0;
+    // bytes kept in the free lists
+    size_t pooled_bytes = 0;
+};
+
+coroutine_frame_stats get_coroutine_frame_stats() noexcept;
+
+// Makes the reactor see a task as the running one, see
+// reactor::set_current_task()
+void set_current_task(task* t) noexcept;
+
+// The base of the promise types of seastar::future coroutines. When such a
+// coroutine completes and the task waiting for its result is another one,
+// the waiting coroutine is resumed directly by symmetric transfer instead
+// of being scheduled, so a chain of nested coroutines unwinds within one
+// task. It is scheduled as usual when the task quota is exhausted or it
+// runs in another scheduling group, tracing span or CPU accounting tag.
+class coroutine_task : public task {
+protected:
+    std::coroutine_handle<> _coroutine;
+    // The task waiting for the result, taken from the promise on return
+    // so that final_suspend() decides how to run it
+    task* _waiter = nullptr;
+
+    explicit coroutine_task(std::coroutine_handle<> coroutine) noexcept : _coroutine(coroutine) {
+        _is_coroutine = true;
+    }
+    ~coroutine_task() = default;
+
+    static std::coroutine_handle<> continuation(task* waiter) noexcept {
+        if (!waiter) {
+            return std::noop_coroutine();
+        }
+        if (waiter->_is_coroutine && !need_preempt() && waiter->group() == current_scheduling_group()
+                && waiter->_trace_slot == *current_trace_slot_ptr() && waiter->_cpu_tag_slot == *current_cpu_tag_slot_ptr()) {
+            // The coroutine which completed is gone
+            set_current_task(waiter);
+            return static_cast<coroutine_task*>(waiter)->_coroutine;
+        }
+        schedule(waiter);
+        return std::noop_coroutine();
+    }
+
+    struct final_awaiter {
+        task* waiter;
+
+        bool await_ready() const noexcept { return false; }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> coroutine) noexcept {
+            auto w = waiter;
+            // Destroys this awaiter too
+            coroutine.destroy();
+            return continuation(w);
+        }
+        void await_resume() const noexcept { }
+    };
+public:
+    virtual void run_and_dispose() noexcept override final {
+        _coroutine.resume();
+    }
+
+    // The address of the function resuming the coroutine of a task, which
+    // symbolizes to the coroutine, or 0 if the task is not a coroutine.
+    // Both GCC and Clang put the resume function first in the frame.
+    static uintptr_t resume_address(const task& t) noexcept {
+        if (!t._is_coroutine) {
+            return 0;
+        }
+        auto frame = static_cast<const coroutine_task&>(t)._coroutine.address();
+        return reinterpret_cast<uintptr_t>(*static_cast<void* const*>(frame));
+    }
+};
+
 template <typename T = void>
 class coroutine_traits_base {
 public:
-    class promise_type final : public seastar::task {
+    class promise_type final : public coroutine_task {
         seastar::promise<T> _promise;
     public:
-        promise_type() = default;
+        promise_type() noexcept : coroutine_task(std::coroutine_handle<promise_type>::from_promise(*this)) { }
         promise_type(promise_type&&) = delete;
         promise_type(const promise_type&) = delete;
 
+        // Frames come from a per-shard pool, see allocate_coroutine_frame()
+        static void* operator new(size_t size) {
+            return allocate_coroutine_frame(size);
+        }
+        static void operator delete(void* frame, size_t size) noexcept {
+            free_coroutine_frame(frame, size);
+        }
+
         template<typename... U>
         void return_value(U&&... value) {
+            _waiter = _promise.release_waiting_task();
             _promise.set_value(std::forward<U>(value)...);
         }
 
         void return_value(coroutine::exception ce) noexcept {
+            _waiter = _promise.release_waiting_task();
             _promise.set_exception(std::move(ce.eptr));
         }
 
@@ -65,6 +156,7 @@ class coroutine_traits_base {
         }
 
         void unhandled_exception() noexcept {
+            _waiter = _promise.release_waiting_task();
             _promise.set_exception(std::current_exception());
         }
 
@@ -73,14 +165,9 @@ class coroutine_traits_base {
         }
 
         std::suspend_never initial_suspend() noexcept { return { }; }
-        std::suspend_never final_suspend() noexcept { return { }; }
+        final_awaiter final_suspend() noexcept { return { _waiter }; }
 
-        virtual void run_and_dispose() noexcept override {
-            auto handle = std::coroutine_handle<promise_type>::from_promise(*this);
-            handle.resume();
-        }
-
-        task* waiting_task() noexcept override { return _promise.waiting_task(); }
+        task* waiting_task() noexcept override { return _waiter ? _waiter : _promise.waiting_task(); }
 
         scheduling_group set_scheduling_group(scheduling_group sg) noexcept {
             return std::exchange(this->_sg, sg);
@@ -91,14 +178,23 @@ class coroutine_traits_base {
 template <>
 class coroutine_traits_base<> {
 public:
-   class promise_type final : public seastar::task {
+   class promise_type final : public coroutine_task {
         seastar::promise<> _promise;
     public:
-        promise_type() = default;
+        promise_type() noexcept : coroutine_task(std::coroutine_handle<promise_type>::from_promise(*this)) { }
         promise_type(promise_type&&) = delete;
         promise_type(const promise_type&) = delete;
 
+        // Frames come from a per-shard pool, see allocate_coroutine_frame()
+        static void* operator new(size_t size) {
+            return allocate_coroutine_frame(size);
+        }
+        static void operator delete(void* frame, size_t size) noexcept {
+            free_coroutine_frame(frame, size);
+        }
+
         void return_void() noexcept {
+            _waiter = _promise.release_waiting_task();
             _promise.set_value();
         }
 
@@ -107,6 +203,7 @@ class coroutine_traits_base<> {
         }
 
         void unhandled_exception() noexcept {
+            _waiter = _promise.release_waiting_task();
             _promise.set_exception(std::current_exception());
         }
 
@@ -115,14 +212,9 @@ class coroutine_traits_base<> {
         }
 
         std::suspend_never initial_suspend() noexcept { return { }; }
-        std::suspend_never final_suspend() noexcept { return { }; }
-
-        virtual void run_and_dispose() noexcept override {
-            auto handle = std::coroutine_handle<promise_type>::from_promise(*this);
-            handle.resume();
-        }
+        final_awaiter final_suspend() noexcept { return { _waiter }; }
 
-        task* waiting_task() noexcept override { return _promise.waiting_task(); }
+        task* waiting_task() noexcept override { return _waiter ? _waiter : _promise.waiting_task(); }
 
         scheduling_group set_scheduling_group(scheduling_group new_sg) noexcept {
             return task::set_scheduling_group(new_sg);
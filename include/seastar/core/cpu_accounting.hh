@@ -0,0 +1,138 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#endif
+
+#include <seastar/core/future.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace metrics {
+class metric_groups;
+}
+
+/// Attribution of the CPU time of the reactor to tags, such as the tenant
+/// or the kind of request on whose behalf tasks run
+///
+/// A tag is made current for a fiber with with_tag(), and stays current
+/// for all the tasks the fiber creates from then on, the way the
+/// scheduling group does, including the tasks which run on other shards
+/// through \ref smp::submit_to(). The time of each task is charged to the
+/// tag it runs in, on the shard it runs on; the clock is only read when
+/// the reactor switches from a tag to another. A task which outlives the
+/// fiber its tag was made current for, and runs once the tag is current
+/// in no fiber, is charged to no tag.
+///
+/// Tags are meant to be few, such as tenants or request classes, rather
+/// than one per request: each shard keeps the usage of all the tags it
+/// ever ran, and up to 255 of them can be current in fibers at the same
+/// time. Fibers beyond that run in the tag of their caller.
+///
+/// The tags which used the most time on a shard are exported as the
+/// cpu_accounting_tag_runtime_ms{tag=...} metric, see set_exported_tags().
+namespace cpu_accounting {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// The CPU time charged to a tag on a shard
+struct tag_usage {
+    sstring tag;
+    /// Reactor time of the tasks which ran in the tag
+    std::chrono::nanoseconds runtime{0};
+    /// Number of times the reactor switched to the tag
+    uint64_t switches = 0;
+};
+
+/// The tag of the fiber, nullptr without one
+const sstring* current_tag() noexcept;
+
+/// The usage of a tag on this shard, std::nullopt if it was never current on it
+std::optional<tag_usage> usage(const sstring& tag);
+
+/// The usage of the \c n tags which used the most time on this shard,
+/// in decreasing order
+std::vector<tag_usage> top(size_t n);
+
+/// Sets the number of tags exported as metrics by this shard, 10 by
+/// default. The exported tags are the top() ones, reevaluated every 10
+/// seconds.
+void set_exported_tags(size_t n) noexcept;
+
+SEASTAR_MODULE_EXPORT_END
+
+/// \cond internal
+namespace internal {
+
+struct tag_state;
+
+// Makes the tag current, storing what was current before in previous,
+// which exit_tag() restores. Returns the state to release_tag() once the
+// fiber is done, or nullptr if the tag could not be made current.
+tag_state* enter_tag(const sstring& tag, uint16_t& previous) noexcept;
+void exit_tag(uint16_t previous) noexcept;
+void release_tag(tag_state* st) noexcept;
+
+// Charges the time since the previous switch to the tag switched from.
+// Called by the reactor when it runs a task of another tag than the
+// previous one, with 0 when it's done running tasks, and by enter_tag()
+// and exit_tag(). A slot whose generation is stale stands for no tag.
+void switch_tag(uint16_t slot) noexcept;
+
+// Replaces the metrics of the exported tags in mg by those of the current
+// top ones, if they changed
+void export_top_tags(metrics::metric_groups& mg);
+
+}
+/// \endcond
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// Runs a function with a tag current, so that its time and the time of
+/// the tasks it creates, directly or not, is charged to the tag
+template <typename Func>
+futurize_t<std::invoke_result_t<Func>> with_tag(const sstring& tag, Func&& func) noexcept {
+    uint16_t previous;
+    auto st = internal::enter_tag(tag, previous);
+    auto f = futurize_invoke(std::forward<Func>(func));
+    if (!st) {
+        return f;
+    }
+    internal::exit_tag(previous);
+    return f.then_wrapped([st] (auto f) {
+        internal::release_tag(st);
+        return f;
+    });
+}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
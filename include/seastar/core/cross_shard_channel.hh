@@ -0,0 +1,79 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/iostream.hh>
+#include <seastar/core/shard_id.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#endif
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup fiber-module
+/// @{
+
+struct cross_shard_channel_config {
+    /// Bytes the source may hold before the sink waits, though a buffer is
+    /// always let in when the channel is empty
+    size_t max_bytes = 1 << 20;
+    /// Buffers the source may hold before the sink waits
+    size_t max_buffers = 128;
+};
+
+/// The two ends of a channel made by make_cross_shard_channel()
+struct cross_shard_channel {
+    /// Used on the shard the channel was made on
+    data_sink sink;
+    /// Used on the shard the channel was made for
+    data_source source;
+};
+
+/// \brief Makes a channel carrying buffers from this shard to another one,
+/// without copying them.
+///
+/// The buffers put into the sink are handed out by the source sharing their
+/// memory, and are destroyed on this shard once the source side has
+/// released them, in batches. The buffers the source handed out must be
+/// released on its shard.
+///
+/// The ends exchange buffers through lock-free rings, and only message each
+/// other to wake the end waiting for them: the source when there is no
+/// buffer to get, the sink when the source holds more than \c cfg allows,
+/// which is how the sink is backpressured.
+///
+/// Closing the sink ends the stream of the source, and resolves once the
+/// buffers it carried were released, which has to be waited for before it
+/// is destroyed. Once the source is closed, putting into the sink fails
+/// with \ref broken_pipe_exception.
+///
+/// \param to the shard the source is moved to, and used on
+cross_shard_channel make_cross_shard_channel(shard_id to, cross_shard_channel_config cfg = {});
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
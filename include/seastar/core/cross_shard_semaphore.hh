@@ -0,0 +1,217 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/cacheline.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <atomic>
+#include <map>
+#include <memory>
+#include <utility>
+#endif
+
+namespace seastar {
+
+class cross_shard_semaphore;
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup fiber-module
+/// @{
+
+/// The units of a node-wide semaphore, shared by the \ref cross_shard_semaphore
+/// of every shard.
+///
+/// The pool is created once, before the semaphores, and must outlive them.
+class cross_shard_semaphore_pool {
+    struct alignas(cache_line_size) shard_slot {
+        cross_shard_semaphore* sem = nullptr;
+        // units cached by the shard which it would give back, published so
+        // that a waiting shard knows whom to ask for them
+        std::atomic<size_t> spare{0};
+        // the shard has waiters it could not get units for
+        std::atomic<bool> waiting{false};
+        // a message asking the shard to rebalance is on its way
+        std::atomic<bool> poked{false};
+    };
+
+    const size_t _capacity;
+    alignas(cache_line_size) std::atomic<size_t> _units;
+    alignas(cache_line_size) std::atomic<unsigned> _waiting_shards{0};
+    std::unique_ptr<shard_slot[]> _shards;
+
+    friend class cross_shard_semaphore;
+public:
+    /// Creates a pool of \c units units, for all the shards
+    explicit cross_shard_semaphore_pool(size_t units);
+
+    /// The number of units the pool was created with
+    size_t capacity() const noexcept { return _capacity; }
+
+    /// The number of units in the pool, not cached by any shard
+    size_t available_units() const noexcept { return _units.load(std::memory_order_relaxed); }
+};
+
+/// \brief A counting semaphore whose units are shared by all shards.
+///
+/// \ref semaphore limits are per shard, so a node-wide limit (concurrent
+/// compactions, in-flight bytes) has to be split evenly between the shards,
+/// however unevenly they are loaded. A cross_shard_semaphore, constructed
+/// on every shard over the same \ref cross_shard_semaphore_pool, draws its
+/// units from the pool instead.
+///
+/// Each shard caches units locally: an acquisition is served from the
+/// cache when it can, and only takes units from the pool, with an atomic
+/// operation, when the cache runs dry, taking up to \c batch more units
+/// than it needs. Released units go back to the cache, and the units
+/// exceeding twice \c batch go back to the pool. A shard which cannot get
+/// the units its first waiter needs from the pool sets a flag in it and
+/// asks the shards caching spare units to return them; the shards
+/// returning units to the pool then send it a message, so crossing shards
+/// only happens when units are short. Units are taken from the pool all at
+/// once, and a waiting shard gives back the units it cached for its first
+/// waiter when another shard waits too, so that shards never deadlock
+/// each holding a part of what they wait for.
+///
+/// Waiters are served in FIFO order within a shard, but not across shards.
+/// Units acquired on a shard may be released on another one.
+///
+/// Usually used through \ref sharded:
+/// ```
+/// static cross_shard_semaphore_pool pool(max_concurrent_compactions);
+/// sharded<cross_shard_semaphore> sem;
+/// co_await sem.start(std::ref(pool), 1);
+/// co_await sem.local().wait();
+/// ```
+class cross_shard_semaphore {
+public:
+    using clock = semaphore::clock;
+    using time_point = semaphore::time_point;
+    using duration = semaphore::duration;
+
+    struct stats {
+        /// Times units were taken from the pool
+        uint64_t refills = 0;
+        /// Times units were returned to the pool
+        uint64_t returns = 0;
+        /// Messages sent to other shards to wake their waiters or to
+        /// reclaim their spare units
+        uint64_t messages_sent = 0;
+    };
+private:
+    cross_shard_semaphore_pool& _pool;
+    cross_shard_semaphore_pool::shard_slot& _slot;
+    const size_t _batch;
+    semaphore _local{0};
+    // units the waiters of _local wait for, in total and each, by arrival
+    size_t _waited_units = 0;
+    std::map<uint64_t, size_t> _waiters;
+    uint64_t _next_waiter = 0;
+    stats _stats;
+    gate _messages;
+
+    size_t idle_units() const noexcept;
+    size_t deficit() const noexcept;
+    void publish_spare() noexcept;
+    bool others_waiting() const noexcept;
+    bool refill(size_t needed) noexcept;
+    void return_units(size_t units) noexcept;
+    void stop_waiting() noexcept;
+    void poke(unsigned shard) noexcept;
+    void wake_waiting_shards() noexcept;
+    void rebalance() noexcept;
+    future<> waited(future<> f, uint64_t id, size_t nr) noexcept;
+
+    template <typename... Args>
+    future<> do_wait(size_t nr, Args&&... args) noexcept {
+        if (try_wait(nr)) {
+            return make_ready_future<>();
+        }
+        auto id = _next_waiter++;
+        try {
+            _waiters.emplace(id, nr);
+        } catch (...) {
+            return current_exception_as_future();
+        }
+        _waited_units += nr;
+        auto f = _local.wait(std::forward<Args>(args)..., nr);
+        rebalance();
+        return waited(std::move(f), id, nr);
+    }
+public:
+    /// Constructs the semaphore of the current shard
+    ///
+    /// \param pool the units shared by all shards
+    /// \param batch number of units taken from the pool in excess of what
+    ///        an acquisition needs, and kept cached when released
+    cross_shard_semaphore(cross_shard_semaphore_pool& pool, size_t batch);
+    cross_shard_semaphore(cross_shard_semaphore&&) = delete;
+    /// Returns the cached units to the pool. There must be no waiters left.
+    ~cross_shard_semaphore();
+
+    /// Waits for the messages this shard sent to other shards, to be
+    /// called before the semaphores and the pool are destroyed
+    future<> stop() noexcept;
+
+    /// Waits until \c nr units are acquired
+    future<> wait(size_t nr = 1) noexcept {
+        return do_wait(nr);
+    }
+    /// Waits until \c nr units are acquired, failing with \ref semaphore_timed_out
+    /// at \c timeout
+    future<> wait(time_point timeout, size_t nr = 1) noexcept {
+        return do_wait(nr, timeout);
+    }
+    /// Waits until \c nr units are acquired, failing with \ref semaphore_timed_out
+    /// after \c timeout
+    future<> wait(duration timeout, size_t nr = 1) noexcept {
+        return do_wait(nr, clock::now() + timeout);
+    }
+    /// Waits until \c nr units are acquired, failing with \ref semaphore_aborted
+    /// when \c as is aborted
+    future<> wait(abort_source& as, size_t nr = 1) noexcept {
+        return do_wait(nr, as);
+    }
+
+    /// Acquires \c nr units if they are available without waiting
+    bool try_wait(size_t nr = 1) noexcept;
+
+    /// Releases \c nr units
+    void signal(size_t nr = 1) noexcept;
+
+    /// Returns the number of units cached by this shard
+    size_t cached_units() const noexcept { return _local.current(); }
+
+    /// Returns the number of waiters on this shard
+    size_t waiters() const noexcept { return _local.waiters(); }
+
+    const stats& get_stats() const noexcept { return _stats; }
+};
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
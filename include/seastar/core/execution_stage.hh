@@ -60,6 +60,12 @@ namespace seastar {
 /// would execute these function calls is scheduled. Execution stages are also
 /// flushed when the reactor polls for events.
 ///
+/// The number of calls a stage queues before executing them on the spot
+/// adapts to the observed cost of a call, so that executing a full batch
+/// takes about execution_stage::batch_latency_goal: cheap calls are batched
+/// up to execution_stage::max_batch_size, expensive ones in batches of at
+/// least execution_stage::min_batch_size.
+///
 /// When calling a function that is wrapped inside execution stage it is
 /// important to remember that the actual function call will happen at some
 /// later time and it has to be guaranteed the objects passed by lvalue
@@ -125,16 +131,43 @@ class execution_stage {
         uint64_t tasks_preempted = 0;
         uint64_t function_calls_enqueued = 0;
         uint64_t function_calls_executed = 0;
+        /// Batches of calls executed, the average batch size being
+        /// function_calls_executed / batches_executed
+        uint64_t batches_executed = 0;
+        /// Sum of the time the oldest call of each batch spent queued
+        sched_clock::duration queueing_delay{};
+        /// Time spent executing calls
+        sched_clock::duration execution_time{};
     };
+
+    static constexpr size_t min_batch_size = 16;
+    static constexpr size_t max_batch_size = 1024;
+    static constexpr sched_clock::duration batch_latency_goal = std::chrono::microseconds(250);
 protected:
     bool _empty = true;
     bool _flush_scheduled = false;
     scheduling_group _sg;
     stats _stats;
+    // when the oldest queued call was enqueued
+    sched_clock::time_point _oldest_enqueued;
+    // moving average of the cost of a call
+    sched_clock::duration _call_cost{};
+    size_t _batch_size_limit = max_batch_size;
     sstring _name;
     metrics::metric_group _metric_group;
 protected:
     virtual void do_flush() noexcept = 0;
+
+    void enqueued() noexcept {
+        if (_empty) {
+            _oldest_enqueued = sched_clock::now();
+            _empty = false;
+        }
+        _stats.function_calls_enqueued++;
+    }
+    // Accounts for a batch of calls executed since start, and adapts the
+    // batch size limit to their cost
+    void executed(sched_clock::time_point start, size_t calls) noexcept;
 public:
     explicit execution_stage(const sstring& name, scheduling_group sg = {});
     virtual ~execution_stage();
@@ -155,6 +188,10 @@ class execution_stage {
     /// Returns execution stage usage statistics
     const stats& get_stats() const noexcept { return _stats; }
 
+    /// Returns the number of queued calls above which they are executed
+    /// on the spot rather than in a separate task
+    size_t batch_size_limit() const noexcept { return _batch_size_limit; }
+
     /// Flushes execution stage
     ///
     /// Ensures that a task which would execute all queued operations is
@@ -212,7 +249,6 @@ class concrete_execution_stage final : public execution_stage {
                   "Function arguments need to be nothrow move constructible");
 
     static constexpr size_t flush_threshold = 128;
-    static constexpr size_t max_queue_length = 1024;
 
     using return_type = futurize_t<ReturnType>;
     using promise_type = typename return_type::promise_type;
@@ -239,13 +275,15 @@ class concrete_execution_stage final : public execution_stage {
     }
 
     virtual void do_flush() noexcept override {
+        auto start = sched_clock::now();
+        size_t calls = 0;
         while (!_queue.empty()) {
             auto& wi = _queue.front();
             auto wi_in = std::move(wi._in);
             auto wi_ready = std::move(wi._ready);
             _queue.pop_front();
             futurize<ReturnType>::apply(_function, unwrap(std::move(wi_in))).forward_to(std::move(wi_ready));
-            _stats.function_calls_executed++;
+            calls++;
 
             if (internal::scheduler_need_preempt()) {
                 _stats.tasks_preempted++;
@@ -253,6 +291,7 @@ class concrete_execution_stage final : public execution_stage {
             }
         }
         _empty = _queue.empty();
+        executed(start, calls);
     }
 public:
     explicit concrete_execution_stage(const sstring& name, scheduling_group sg, noncopyable_function<ReturnType (Args...)> f)
@@ -287,12 +326,11 @@ class concrete_execution_stage final : public execution_stage {
     /// \param args arguments passed to the stage's function
     /// \return future containing the result of the call to the stage's function
     return_type operator()(typename internal::wrap_for_es<Args>::type... args) {
-        if (_queue.size() >= max_queue_length) {
+        if (_queue.size() >= _batch_size_limit) {
             do_flush();
         }
         _queue.emplace_back(std::move(args)...);
-        _empty = false;
-        _stats.function_calls_enqueued++;
+        enqueued();
         auto f = _queue.back()._ready.get_future();
         flush();
         return f;
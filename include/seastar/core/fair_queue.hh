@@ -109,11 +109,13 @@ class fair_queue_entry {
     // a 'normalized' form -- converted from floating-point to fixed-point number
     // and scaled accrding to fair-group's token-bucket duration
     using capacity_t = uint64_t;
+    using clock_type = std::chrono::steady_clock;
     friend class fair_queue;
 
 private:
     capacity_t _capacity;
     bi::slist_member_hook<> _hook;
+    clock_type::time_point _deadline = clock_type::time_point::max();
 
 public:
     explicit fair_queue_entry(capacity_t c) noexcept
@@ -124,6 +126,12 @@ class fair_queue_entry {
             bi::member_hook<fair_queue_entry, bi::slist_member_hook<>, &fair_queue_entry::_hook>>;
 
     capacity_t capacity() const noexcept { return _capacity; }
+
+    /// Sets the time by which the entry should be dispatched. Must be called
+    /// before the entry is queued. See \ref fair_queue::config::deadline_scheduling.
+    void set_deadline(clock_type::time_point deadline) noexcept { _deadline = deadline; }
+    clock_type::time_point deadline() const noexcept { return _deadline; }
+    bool has_deadline() const noexcept { return _deadline != clock_type::time_point::max(); }
 };
 
 /// \brief Group of queues class
@@ -267,6 +275,12 @@ class fair_group {
     }
 
     const token_bucket_t& token_bucket() const noexcept { return _token_bucket; }
+
+    // Scales the replenish rate relative to the configured one, the
+    // latter corresponds to the factor of 1.0
+    void set_rate_factor(double factor) noexcept {
+        _token_bucket.update_rate(fixed_point_factor * factor);
+    }
 };
 
 /// \brief Fair queuing class
@@ -288,6 +302,10 @@ class fair_group {
 /// When the classes that lag behind start seeing requests, the fair queue will serve
 /// them first, until balance is restored. This balancing is expected to happen within
 /// a certain time window that obeys an exponential decay.
+///
+/// Classes can be nested into priority groups. A group has shares of its own and
+/// competes with its siblings the same way classes do, while the capacity given to
+/// the group is split between its children proportionally to their shares.
 class fair_queue {
 public:
     /// \brief Fair Queue configuration structure.
@@ -297,6 +315,13 @@ class fair_queue {
     struct config {
         sstring label = "";
         std::chrono::microseconds tau = std::chrono::milliseconds(5);
+        /// When set, entries with a deadline are dispatched ahead of the
+        /// other entries of their class once their deadline is less than
+        /// \c deadline_window away, earliest deadline first. This only
+        /// reorders requests within a class, the share of the class is not
+        /// affected. When not set, deadlines only feed the deadline metrics.
+        bool deadline_scheduling = false;
+        std::chrono::microseconds deadline_window = std::chrono::milliseconds(5);
     };
 
     using class_id = unsigned int;
@@ -355,6 +380,13 @@ class fair_queue {
     // Total capacity of all requests waiting in the queue.
     capacity_t _queued_capacity = 0;
 
+    // The heap the class competes in and the accumulator of that heap, i.e.
+    // the parent group's ones or the top-level ones
+    priority_queue& heap_of(priority_class_data& pc) noexcept;
+    capacity_t& last_accumulated_of(priority_class_data& pc) noexcept;
+    void register_priority_node(class_id c, uint32_t shares, std::optional<class_id> parent, bool group);
+    void charge_priority_class(priority_class_data& pc, capacity_t cap) noexcept;
+
     void push_priority_class(priority_class_data& pc) noexcept;
     void push_priority_class_from_idle(priority_class_data& pc) noexcept;
     void pop_priority_class(priority_class_data& pc) noexcept;
@@ -375,6 +407,8 @@ class fair_queue {
         bool our_turn_has_come;
     };
     reap_result reap_pending_capacity() noexcept;
+    // The queue of the class to dispatch the next request from
+    fair_queue_entry::container_list_t& next_queue(priority_class_data& pc, clock_type::time_point now) const noexcept;
 public:
     /// Constructs a fair queue with configuration parameters \c cfg.
     ///
@@ -388,11 +422,23 @@ class fair_queue {
     /// Registers a priority class against this fair queue.
     ///
     /// \param shares how many shares to create this class with
-    void register_priority_class(class_id c, uint32_t shares);
+    /// \param parent the group to nest the class into, top-level if not set
+    void register_priority_class(class_id c, uint32_t shares, std::optional<class_id> parent = std::nullopt);
+
+    /// Registers a priority group against this fair queue.
+    ///
+    /// The group cannot have requests queued into it, instead the classes and
+    /// groups registered with it as a parent share the group's capacity.
+    /// Groups and classes use the same identifiers space.
+    ///
+    /// \param shares how many shares to create this group with
+    /// \param parent the group to nest the group into, top-level if not set
+    void register_priority_group(class_id c, uint32_t shares, std::optional<class_id> parent = std::nullopt);
 
-    /// Unregister a priority class.
+    /// Unregister a priority class or group.
     ///
-    /// It is illegal to unregister a priority class that still have pending requests.
+    /// It is illegal to unregister a priority class that still have pending requests
+    /// or a group that still has classes or groups nested into it.
     void unregister_priority_class(class_id c);
 
     void update_shares_for_class(class_id c, uint32_t new_shares);
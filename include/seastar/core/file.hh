@@ -32,6 +32,7 @@
 #include <seastar/core/io_priority_class.hh>
 #include <seastar/core/file-types.hh>
 #include <seastar/core/circular_buffer.hh>
+#include <seastar/core/mapped_file.hh>
 #include <seastar/util/modules.hh>
 #ifndef SEASTAR_MODULE
 #include <sys/statvfs.h>
@@ -100,6 +101,13 @@ struct file_open_options {
     uint64_t sloppy_size_hint = 1 << 20; ///< Hint as to what the eventual file size will be
     file_permissions create_permissions = file_permissions::default_file_permissions; ///< File permissions to use when creating a file
     bool append_is_unlikely = false; ///< Hint that user promises (or at least tries hard) not to write behind file size
+    /// Map the file when it's on a DAX filesystem, such as one on persistent
+    /// memory, and read and write it with CPU loads and stores rather than
+    /// I/O requests, at any byte offset. Writes are durable once they
+    /// complete. Applies to the reads and writes within the file size, which
+    /// is best set ahead with \ref file::truncate(); the others are I/O
+    /// requests. Only available on x86-64.
+    bool dax = false;
 
     // The fsxattr.fsx_extsize is 32-bit
     static constexpr uint64_t max_extent_allocation_size_hint = 1 << 31;
@@ -109,6 +117,69 @@ struct file_open_options {
     static constexpr uint32_t min_extent_size_hint_alignment{128u << 10}; // 128KB
 };
 
+/// How durable a write must be when it completes
+///
+/// \ref file
+enum class write_durability {
+    none, ///< the data may be lost on power failure until a \ref file::flush()
+    /// the data, and the metadata needed to read it back, is stable on
+    /// completion, as with O_DSYNC. Block devices do this with FUA writes
+    /// instead of flushing their whole cache.
+    data,
+};
+
+/// A write of \ref file::dma_write_ordered()
+///
+/// \ref file
+struct ordered_write {
+    uint64_t pos; ///< offset to write into, aligned to \ref file::disk_write_dma_alignment()
+    const void* buffer; ///< aligned address of the data, which must exist until the write completes
+    size_t len; ///< number of bytes to write, aligned
+};
+
+/// The type of a zone of a zoned block device
+///
+/// \ref file::report_zones()
+enum class zone_type {
+    conventional, ///< written anywhere, like the rest of a regular device
+    sequential_write_required, ///< written at the write pointer only
+    sequential_write_preferred, ///< written anywhere, but best at the write pointer
+};
+
+/// The condition of a zone of a zoned block device
+///
+/// \ref file::report_zones()
+enum class zone_condition {
+    not_write_pointer, ///< a conventional zone
+    empty,
+    implicitly_open, ///< open since it was written
+    explicitly_open, ///< open since it was opened with \ref zone_action::open
+    closed, ///< partially written, without the resources of an open zone
+    read_only,
+    full,
+    offline,
+};
+
+/// A zone of a zoned block device, with its offsets and lengths in bytes
+///
+/// \ref file::report_zones()
+struct zone_info {
+    uint64_t start;
+    uint64_t length;
+    uint64_t capacity; ///< bytes writable from the start of the zone, up to its length
+    uint64_t write_pointer; ///< where the zone is written next, meaningless for conventional zones
+    zone_type type;
+    zone_condition condition;
+};
+
+/// What \ref file::manage_zones() does to zones
+enum class zone_action {
+    open, ///< opens the zones, holding the resources of the device they need to be written
+    close, ///< releases the resources of open zones, which stay writable
+    finish, ///< makes the zones full, moving their write pointers to their end
+    reset, ///< empties the zones, moving their write pointers back to their start
+};
+
 class file;
 class file_impl;
 class io_intent;
@@ -140,6 +211,12 @@ class file_impl {
 
     virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, io_intent*) = 0;
     virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, io_intent*) = 0;
+    // Writes that are stable on completion, by default a write followed by a flush
+    virtual future<size_t> write_dma_dsync(uint64_t pos, const void* buffer, size_t len, io_intent*);
+    virtual future<size_t> write_dma_dsync(uint64_t pos, std::vector<iovec> iov, io_intent*);
+    // Writes one after the other, by default each once the one before it completed,
+    // followed by a flush for write_durability::data
+    virtual future<size_t> write_dma_ordered(std::vector<ordered_write> writes, write_durability durability, io_intent*);
     virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, io_intent*) = 0;
     virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, io_intent*) = 0;
     virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, io_intent*) = 0;
@@ -148,6 +225,10 @@ class file_impl {
     virtual future<struct stat> stat() = 0;
     virtual future<> truncate(uint64_t length) = 0;
     virtual future<> discard(uint64_t offset, uint64_t length) = 0;
+    // Zoned block devices only, the others fail with ENOTSUP
+    virtual future<std::vector<zone_info>> report_zones(uint64_t offset, size_t max_zones);
+    virtual future<> manage_zones(zone_action action, uint64_t offset, uint64_t length);
+    virtual future<uint64_t> zone_append_dma(uint64_t zone_start, const void* buffer, size_t len, io_intent*);
     virtual future<int> ioctl(uint64_t cmd, void* argp) noexcept;
     virtual future<int> ioctl_short(uint64_t cmd, void* argp) noexcept;
     virtual future<int> fcntl(int op, uintptr_t arg) noexcept;
@@ -379,6 +460,67 @@ class file {
         return dma_write_impl(pos, std::move(iov), internal::maybe_priority_class_ref(), intent);
     }
 
+    /// Performs a DMA write from the specified buffer, with the given durability.
+    ///
+    /// With \ref write_durability::data the written data is stable on persistent
+    /// storage when the returned future resolves, without the need of a \ref flush().
+    /// The kernel is asked to do so with RWF_DSYNC, which block devices serve with a
+    /// FUA write, falling back to a write and a flush when it cannot be.
+    ///
+    /// \param pos offset to write into.  Must be aligned to \ref disk_write_dma_alignment.
+    /// \param buffer aligned address of buffer to read from.  Buffer must exists
+    ///               until the future is made ready.
+    /// \param len number of bytes to write.  Must be aligned.
+    /// \param durability how durable the data must be when the write completes
+    /// \param intent the IO intention confirmation (\ref seastar::io_intent)
+    ///
+    /// \return a future representing the number of bytes actually written.  A short
+    ///         write may happen due to an I/O error.
+    template <typename CharType>
+    future<size_t> dma_write(uint64_t pos, const CharType* buffer, size_t len, write_durability durability, io_intent* intent = nullptr) noexcept {
+        return dma_write_impl(pos, reinterpret_cast<const uint8_t*>(buffer), len, durability, intent);
+    }
+
+    /// Performs a DMA write to the specified iovec, with the given durability.
+    ///
+    /// See the buffer overload for the meaning of \c durability.
+    ///
+    /// \param pos offset to write into.  Must be aligned to \ref disk_write_dma_alignment.
+    /// \param iov vector of address/size pairs to write from.  Addresses must be
+    ///            aligned.
+    /// \param durability how durable the data must be when the write completes
+    /// \param intent the IO intention confirmation (\ref seastar::io_intent)
+    ///
+    /// \return a future representing the number of bytes actually written.  A short
+    ///         write may happen due to an I/O error.
+    future<size_t> dma_write(uint64_t pos, std::vector<iovec> iov, write_durability durability, io_intent* intent = nullptr) noexcept {
+        return dma_write_impl(pos, std::move(iov), durability, intent);
+    }
+
+    /// Performs DMA writes in order, each starting once the one before it
+    /// completed in full, with the given durability.
+    ///
+    /// With \ref write_durability::data the written data is stable on
+    /// persistent storage when the returned future resolves, as if the writes
+    /// were followed by a \ref flush().
+    ///
+    /// The writes and the flush are queued as a single request. On io_uring,
+    /// they are submitted to the kernel together as linked requests, which the
+    /// kernel runs in order, saving the round trip to the reactor between each
+    /// of them. Elsewhere, the next one is submitted when one completes.
+    ///
+    /// \param writes the writes, in the order they must reach the file,
+    ///               up to \ref io_queue::max_chain_length of them, one less
+    ///               with \ref write_durability::data. Longer lists are written
+    ///               one write at a time.
+    /// \param durability how durable the data must be when the writes complete
+    /// \param intent the IO intention confirmation (\ref seastar::io_intent)
+    ///
+    /// \return a future representing the number of bytes written, which stop
+    ///         at the first short write. If a write or the flush fails, the
+    ///         future fails, even if the writes before it completed.
+    future<size_t> dma_write_ordered(std::vector<ordered_write> writes, write_durability durability = write_durability::none, io_intent* intent = nullptr) noexcept;
+
     /// Causes any previously written data to be made stable on persistent storage.
     ///
     /// Prior to a flush, written data may or may not survive a power failure.  After
@@ -409,8 +551,71 @@ class file {
     ///
     /// The discard operation tells the file system that a range of offsets
     /// (which be aligned) is no longer needed and can be reused.
+    ///
+    /// Discards are scheduled by the I/O queue of the file's device in the
+    /// current scheduling group, like reads and writes, and the adjacent ones
+    /// dispatched together are merged.
     future<> discard(uint64_t offset, uint64_t length) noexcept;
 
+    /// Reports the zones of a zoned block device (ZNS or SMR).
+    ///
+    /// \param offset offset in the zone to report first
+    /// \param max_zones maximum number of zones to report
+    /// \return the zones from the one containing \c offset on, in order,
+    ///         fewer than \c max_zones at the end of the device. Fails with
+    ///         \c ENOTSUP if the file isn't a block device, and with the error
+    ///         of the kernel if it isn't zoned.
+    future<std::vector<zone_info>> report_zones(uint64_t offset = 0, size_t max_zones = 1024) noexcept;
+
+    /// Opens, closes, finishes or resets the zones of a zoned block device.
+    ///
+    /// The appends to the zones (see \ref dma_zone_append()) must have
+    /// completed.
+    ///
+    /// \param action what to do to the zones
+    /// \param offset start of the first zone
+    /// \param length length of the zones, a multiple of the zone length
+    future<> manage_zones(zone_action action, uint64_t offset, uint64_t length) noexcept;
+
+    /// Appends data to a sequential zone of a zoned block device, at its
+    /// write pointer.
+    ///
+    /// Zones must be written in order, at their write pointer, which a
+    /// device does not find out of order writes at. The appends to a zone
+    /// are written one at a time, in the order they were made, by the I/O
+    /// queue of the device, which keeps track of the write pointer: it's
+    /// read from the device on the first append to the zone, after an
+    /// append failed, and after \ref manage_zones(). The appends to different
+    /// zones run concurrently, so the zones written at the same time should
+    /// be many for throughput.
+    ///
+    /// The zone must only be written by the appends of a single shard, and
+    /// not by \ref dma_write().
+    ///
+    /// \param zone_start start of the zone, as reported by \ref report_zones()
+    /// \param buffer aligned address of the data, which must exist until the
+    ///               append completes
+    /// \param len number of bytes to write, aligned
+    /// \param intent the IO intention confirmation (\ref seastar::io_intent)
+    ///
+    /// \return a future with the offset the data was written at. Fails with
+    ///         \c ENOSPC if the data doesn't fit in the rest of the zone.
+    future<uint64_t> dma_zone_append(uint64_t zone_start, const void* buffer, size_t len, io_intent* intent = nullptr) noexcept;
+
+    /// Maps a range of the file into memory, read-only.
+    ///
+    /// Meant for read-mostly data that fits in memory, like indexes, which
+    /// can then be looked up without a read request per access once the
+    /// pages are resident. See \ref mapped_file for how to avoid stalling
+    /// the reactor on page faults. Only files opened with open_file_dma()
+    /// can be mapped.
+    ///
+    /// \param offset offset of the range in the file, need not be aligned
+    /// \param length length of the range, the mapping is shorter if the
+    ///        file ends before it
+    /// \return future that becomes ready with the mapping.
+    future<mapped_file> map(uint64_t offset, size_t length) noexcept;
+
     /// Generic ioctl syscall support for special file handling.
     ///
     /// This interface is useful for many non-standard operations on seastar::file.
@@ -540,6 +745,44 @@ class file {
         });
     }
 
+    /// The default size of the buffers returned by \ref dma_read_bulk_fragmented()
+    static constexpr size_t default_read_fragment_size = 128 << 10;
+
+    /**
+     * Read a range of the file into a series of buffers of at most
+     * fragment_size bytes each, rather than into a single one like
+     * \ref dma_read_bulk() does.
+     *
+     * Large reads thus need no large contiguous allocation. The buffers are
+     * allocated with the alignment the file requires, and read in a single
+     * vectored read; the range need not be aligned.
+     *
+     * @param offset starting address of the range to read
+     * @param range_size size of the range
+     * @param fragment_size the maximum size of a buffer, rounded up to the
+     *        file alignments
+     * @param intent the IO intention confirmation (\ref seastar::io_intent)
+     *
+     * @return the buffers holding the range in order, fewer bytes than
+     *        range_size only when the range goes past the end of the file,
+     *        or an exceptional future holding a system_error exception in
+     *        case of I/O error.
+     */
+    template <typename CharType>
+    future<std::vector<temporary_buffer<CharType>>>
+    dma_read_bulk_fragmented(uint64_t offset, size_t range_size, size_t fragment_size = default_read_fragment_size, io_intent* intent = nullptr) noexcept {
+        return futurize_invoke([&] {
+            return dma_read_bulk_fragmented_impl(offset, range_size, fragment_size, intent);
+        }).then([] (std::vector<temporary_buffer<uint8_t>> bufs) {
+            std::vector<temporary_buffer<CharType>> res;
+            res.reserve(bufs.size());
+            for (auto& t : bufs) {
+                res.emplace_back(reinterpret_cast<CharType*>(t.get_write()), t.size(), t.release());
+            }
+            return res;
+        });
+    }
+
     /// \brief Creates a handle that can be transported across shards.
     ///
     /// Creates a handle that can be transported across shards, and then
@@ -559,6 +802,12 @@ class file {
     future<size_t>
     dma_write_impl(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
 
+    future<size_t>
+    dma_write_impl(uint64_t pos, const uint8_t* buffer, size_t len, write_durability durability, io_intent* intent) noexcept;
+
+    future<size_t>
+    dma_write_impl(uint64_t pos, std::vector<iovec> iov, write_durability durability, io_intent* intent) noexcept;
+
     future<temporary_buffer<uint8_t>>
     dma_read_impl(uint64_t pos, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
 
@@ -571,6 +820,9 @@ class file {
     future<temporary_buffer<uint8_t>>
     dma_read_exactly_impl(uint64_t pos, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
 
+    future<std::vector<temporary_buffer<uint8_t>>>
+    dma_read_bulk_fragmented_impl(uint64_t offset, size_t range_size, size_t fragment_size, io_intent* intent);
+
     future<uint64_t> get_lifetime_hint_impl(int op) noexcept;
     future<> set_lifetime_hint_impl(int op, uint64_t hint) noexcept;
 
@@ -0,0 +1,631 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/bitops.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#endif
+
+namespace seastar {
+
+/// \cond internal
+namespace internal {
+
+// Every slot of a flat_hash_map has a control byte, holding 7 bits of the
+// hash of the key in the slot, or telling the slot is empty or was erased.
+// Both of the latter have the sign bit set.
+using hash_ctrl_t = int8_t;
+constexpr hash_ctrl_t hash_ctrl_empty = -128;
+constexpr hash_ctrl_t hash_ctrl_deleted = -2;
+
+// The control bytes of a group of slots, probed together
+struct hash_group {
+    static constexpr size_t width = 16;
+
+    const hash_ctrl_t* ctrl;
+
+#if defined(__SSE2__)
+    __m128i load() const noexcept {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+    }
+
+    unsigned match(hash_ctrl_t h) const noexcept {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h), load()));
+    }
+
+    unsigned match_free() const noexcept {
+        return _mm_movemask_epi8(load());
+    }
+#else
+    unsigned match(hash_ctrl_t h) const noexcept {
+        unsigned mask = 0;
+        for (size_t i = 0; i < width; ++i) {
+            mask |= unsigned(ctrl[i] == h) << i;
+        }
+        return mask;
+    }
+
+    unsigned match_free() const noexcept {
+        unsigned mask = 0;
+        for (size_t i = 0; i < width; ++i) {
+            mask |= unsigned(ctrl[i] < 0) << i;
+        }
+        return mask;
+    }
+#endif
+
+    unsigned match_empty() const noexcept {
+        return match(hash_ctrl_empty);
+    }
+
+    unsigned match_full() const noexcept {
+        return ~match_free() & ((1u << width) - 1);
+    }
+};
+
+}
+/// \endcond
+
+/// An open-addressing hash map, for shard-local data.
+///
+/// The elements are stored in a flat array of slots, split into groups of
+/// 16 slots whose control bytes, holding 7 bits of the hash of their keys,
+/// are matched at once (with SSE2 where available). A lookup hence usually
+/// costs a single group probe and a single key comparison, with no pointer
+/// chasing, unlike std::unordered_map which allocates a node per element.
+///
+/// The map grows by allocating a table twice as large and moving the
+/// elements to it incrementally: every insertion moves the elements of a
+/// couple of groups of the old table, and lookups search both tables until
+/// the old one is drained. The latency of an insertion is thus bounded,
+/// whatever the size of the map, rather than stalling the reactor while
+/// millions of elements are rehashed. reserve() rehashes synchronously.
+///
+/// Insertions invalidate all iterators and references, since they may move
+/// elements between the tables. Erasing an element only invalidates the
+/// iterators and references to it.
+///
+/// Keys and values have to be nothrow move constructible.
+///
+/// \tparam Key the type of the keys
+/// \tparam T the type of the mapped values
+/// \tparam Hash hashes keys, the hash is mixed so that an identity hash is fine
+/// \tparam KeyEqual compares keys
+/// \tparam Allocator allocates the control bytes and the slots
+SEASTAR_MODULE_EXPORT
+template <typename Key, typename T, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>,
+          typename Allocator = std::allocator<std::pair<const Key, T>>>
+class flat_hash_map {
+    static_assert(std::is_nothrow_move_constructible_v<Key> && std::is_nothrow_move_constructible_v<T>,
+                  "flat_hash_map moves its elements while it grows");
+public:
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = std::pair<const Key, T>;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+    using allocator_type = Allocator;
+    using reference = value_type&;
+    using const_reference = const value_type&;
+private:
+    using ctrl_t = internal::hash_ctrl_t;
+    using group = internal::hash_group;
+    using ctrl_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<ctrl_t>;
+    using slot_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<value_type>;
+    using slot_traits = std::allocator_traits<slot_allocator>;
+
+    static constexpr size_t width = group::width;
+    // Groups of the old table moved with every insertion while growing
+    static constexpr size_t groups_migrated_per_insert = 2;
+
+    struct table {
+        ctrl_t* ctrl = nullptr;
+        value_type* slots = nullptr;
+        size_t group_mask = 0;
+        size_t size = 0;
+        // Empty slots which can still be filled before the table is
+        // considered full, at 7/8 of its capacity
+        size_t growth_left = 0;
+
+        size_t groups() const noexcept {
+            return ctrl ? group_mask + 1 : 0;
+        }
+        size_t capacity() const noexcept {
+            return groups() * width;
+        }
+        bool full(size_t i) const noexcept {
+            return ctrl[i] >= 0;
+        }
+    };
+
+    struct position {
+        size_t group;
+        ctrl_t h2;
+    };
+
+    table _table;
+    // The table the elements are moved from while growing
+    table _old;
+    size_t _migrated_groups = 0;
+    [[no_unique_address]] Hash _hash;
+    [[no_unique_address]] KeyEqual _eq;
+    [[no_unique_address]] Allocator _alloc;
+
+    template <bool Const>
+    class iterator_base {
+        using map_type = std::conditional_t<Const, const flat_hash_map, flat_hash_map>;
+        using table_type = std::conditional_t<Const, const table, table>;
+
+        map_type* _map = nullptr;
+        table_type* _table = nullptr;
+        size_t _index = 0;
+
+        iterator_base(map_type* map, table_type* t, size_t index) noexcept
+            : _map(map), _table(t), _index(index) {}
+
+        // Moves to the first full slot from the current one, going from
+        // the current table to the old one
+        void settle() noexcept {
+            while (_table) {
+                for (; _index < _table->capacity(); ++_index) {
+                    if (_table->full(_index)) {
+                        return;
+                    }
+                }
+                _table = (_table == &_map->_table && _map->_old.ctrl) ? &_map->_old : nullptr;
+                _index = 0;
+            }
+        }
+
+        friend class flat_hash_map;
+        template <bool>
+        friend class iterator_base;
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = flat_hash_map::value_type;
+        using difference_type = ptrdiff_t;
+        using pointer = std::conditional_t<Const, const value_type*, value_type*>;
+        using reference = std::conditional_t<Const, const value_type&, value_type&>;
+
+        iterator_base() noexcept = default;
+        template <bool C = Const>
+        requires C
+        iterator_base(const iterator_base<false>& o) noexcept
+            : _map(o._map), _table(o._table), _index(o._index) {}
+
+        reference operator*() const noexcept {
+            return _table->slots[_index];
+        }
+        pointer operator->() const noexcept {
+            return &_table->slots[_index];
+        }
+        iterator_base& operator++() noexcept {
+            ++_index;
+            settle();
+            return *this;
+        }
+        iterator_base operator++(int) noexcept {
+            auto it = *this;
+            ++*this;
+            return it;
+        }
+        bool operator==(const iterator_base& o) const noexcept {
+            return _table == o._table && (!_table || _index == o._index);
+        }
+    };
+public:
+    using iterator = iterator_base<false>;
+    using const_iterator = iterator_base<true>;
+private:
+    position get_position(const Key& key) const {
+        uint64_t h = uint64_t(_hash(key)) * 0x9e3779b97f4a7c15;
+        return {size_t(h ^ (h >> 32)), ctrl_t(h >> 57)};
+    }
+
+    static size_t next_group(const table& t, size_t g, size_t step) noexcept {
+        // Triangular steps visit every group of a power of two number of them
+        return (g + step) & t.group_mask;
+    }
+
+    size_t find_in(const table& t, const Key& key, position pos) const {
+        if (!t.size) {
+            return t.capacity();
+        }
+        size_t g = pos.group & t.group_mask;
+        for (size_t step = 1; ; ++step) {
+            group grp{t.ctrl + g * width};
+            for (auto m = grp.match(pos.h2); m; m &= m - 1) {
+                auto i = g * width + count_trailing_zeros(m);
+                if (_eq(t.slots[i].first, key)) {
+                    return i;
+                }
+            }
+            if (grp.match_empty()) {
+                return t.capacity();
+            }
+            g = next_group(t, g, step);
+        }
+    }
+
+    static size_t find_free(const table& t, position pos) noexcept {
+        size_t g = pos.group & t.group_mask;
+        for (size_t step = 1; ; ++step) {
+            if (auto m = group{t.ctrl + g * width}.match_free()) {
+                return g * width + count_trailing_zeros(m);
+            }
+            g = next_group(t, g, step);
+        }
+    }
+
+    static void mark_full(table& t, size_t i, ctrl_t h2) noexcept {
+        t.growth_left -= t.ctrl[i] == internal::hash_ctrl_empty;
+        t.ctrl[i] = h2;
+        t.size++;
+    }
+
+    void erase_at(table& t, size_t i) noexcept {
+        slot_allocator sa(_alloc);
+        slot_traits::destroy(sa, &t.slots[i]);
+        // A group which still has an empty slot never made a probe go on
+        // past it, so the slot can be made empty again
+        if (group{t.ctrl + (i & ~(width - 1))}.match_empty()) {
+            t.ctrl[i] = internal::hash_ctrl_empty;
+            t.growth_left++;
+        } else {
+            t.ctrl[i] = internal::hash_ctrl_deleted;
+        }
+        t.size--;
+    }
+
+    table allocate_table(size_t groups) {
+        table t;
+        auto capacity = groups * width;
+        ctrl_allocator ca(_alloc);
+        t.ctrl = std::allocator_traits<ctrl_allocator>::allocate(ca, capacity);
+        try {
+            slot_allocator sa(_alloc);
+            t.slots = slot_traits::allocate(sa, capacity);
+        } catch (...) {
+            std::allocator_traits<ctrl_allocator>::deallocate(ca, t.ctrl, capacity);
+            throw;
+        }
+        std::memset(t.ctrl, internal::hash_ctrl_empty, capacity);
+        t.group_mask = groups - 1;
+        t.growth_left = capacity - capacity / 8;
+        return t;
+    }
+
+    void destroy_table(table& t) noexcept {
+        if (!t.ctrl) {
+            return;
+        }
+        slot_allocator sa(_alloc);
+        for (size_t i = 0; t.size && i < t.capacity(); ++i) {
+            if (t.full(i)) {
+                slot_traits::destroy(sa, &t.slots[i]);
+                t.size--;
+            }
+        }
+        auto capacity = t.capacity();
+        slot_traits::deallocate(sa, t.slots, capacity);
+        ctrl_allocator ca(_alloc);
+        std::allocator_traits<ctrl_allocator>::deallocate(ca, t.ctrl, capacity);
+        t = table();
+    }
+
+    // Moves the elements of the next groups of the old table to the
+    // current one
+    void migrate(size_t groups) {
+        if (!_old.ctrl) {
+            return;
+        }
+        slot_allocator sa(_alloc);
+        auto end = std::min(_migrated_groups + groups, _old.groups());
+        for (; _migrated_groups < end; ++_migrated_groups) {
+            auto base = _migrated_groups * width;
+            for (auto m = group{_old.ctrl + base}.match_full(); m; m &= m - 1) {
+                auto i = base + count_trailing_zeros(m);
+                auto& v = _old.slots[i];
+                auto pos = get_position(v.first);
+                auto j = find_free(_table, pos);
+                slot_traits::construct(sa, &_table.slots[j], std::move(const_cast<Key&>(v.first)), std::move(v.second));
+                mark_full(_table, j, pos.h2);
+                slot_traits::destroy(sa, &v);
+                // Left deleted, so that probes for the elements not moved
+                // yet still go past it
+                _old.ctrl[i] = internal::hash_ctrl_deleted;
+                _old.size--;
+            }
+        }
+        if (_migrated_groups == _old.groups()) {
+            destroy_table(_old);
+        }
+    }
+
+    void rehash_to(size_t groups) {
+        migrate(_old.groups());
+        _old = std::exchange(_table, allocate_table(groups));
+        _migrated_groups = 0;
+    }
+
+    void grow_if_needed() {
+        if (_table.growth_left) {
+            return;
+        }
+        migrate(_old.groups());
+        auto groups = _table.groups();
+        // A table mostly filled with erased slots is rehashed at the same size
+        rehash_to(!groups ? 1 : _table.size * 2 > _table.capacity() - _table.capacity() / 8 ? groups * 2 : groups);
+    }
+
+    template <typename K, typename... Args>
+    std::pair<iterator, bool> do_try_emplace(K&& key, Args&&... args) {
+        // Looked up before migrating: the key may be one of the elements,
+        // as in m[m.begin()->first], which migrate() moves away. A key that
+        // isn't found isn't one of them, so it stays valid from then on.
+        auto pos = get_position(key);
+        if (auto i = find_in(_table, key, pos); i != _table.capacity()) {
+            return {iterator(this, &_table, i), false};
+        }
+        if (auto i = find_in(_old, key, pos); i != _old.capacity()) {
+            return {iterator(this, &_old, i), false};
+        }
+        migrate(groups_migrated_per_insert);
+        grow_if_needed();
+        auto i = find_free(_table, pos);
+        slot_allocator sa(_alloc);
+        slot_traits::construct(sa, &_table.slots[i], std::piecewise_construct,
+                std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+        mark_full(_table, i, pos.h2);
+        return {iterator(this, &_table, i), true};
+    }
+
+    template <typename Self>
+    static auto do_find(Self& self, const Key& key) {
+        using it_type = std::conditional_t<std::is_const_v<Self>, const_iterator, iterator>;
+        auto pos = self.get_position(key);
+        if (auto i = self.find_in(self._table, key, pos); i != self._table.capacity()) {
+            return it_type(&self, &self._table, i);
+        }
+        if (auto i = self.find_in(self._old, key, pos); i != self._old.capacity()) {
+            return it_type(&self, &self._old, i);
+        }
+        return it_type();
+    }
+public:
+    flat_hash_map() = default;
+
+    explicit flat_hash_map(size_t capacity, const Hash& hash = Hash(), const KeyEqual& eq = KeyEqual(),
+                           const Allocator& alloc = Allocator())
+        : _hash(hash), _eq(eq), _alloc(alloc) {
+        reserve(capacity);
+    }
+
+    flat_hash_map(std::initializer_list<value_type> init) {
+        reserve(init.size());
+        for (auto& v : init) {
+            insert(v);
+        }
+    }
+
+    flat_hash_map(const flat_hash_map& o)
+        : _hash(o._hash), _eq(o._eq)
+        , _alloc(std::allocator_traits<Allocator>::select_on_container_copy_construction(o._alloc)) {
+        reserve(o.size());
+        for (auto& v : o) {
+            insert(v);
+        }
+    }
+
+    flat_hash_map(flat_hash_map&& o) noexcept
+        : _table(std::exchange(o._table, table()))
+        , _old(std::exchange(o._old, table()))
+        , _migrated_groups(o._migrated_groups)
+        , _hash(std::move(o._hash)), _eq(std::move(o._eq)), _alloc(std::move(o._alloc)) {
+    }
+
+    flat_hash_map& operator=(const flat_hash_map& o) {
+        if (this != &o) {
+            auto copy = o;
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    flat_hash_map& operator=(flat_hash_map&& o) noexcept {
+        if (this != &o) {
+            this->~flat_hash_map();
+            new (this) flat_hash_map(std::move(o));
+        }
+        return *this;
+    }
+
+    ~flat_hash_map() {
+        destroy_table(_old);
+        destroy_table(_table);
+    }
+
+    size_t size() const noexcept {
+        return _table.size + _old.size;
+    }
+
+    bool empty() const noexcept {
+        return !size();
+    }
+
+    /// The number of slots of the current table
+    size_t capacity() const noexcept {
+        return _table.capacity();
+    }
+
+    /// Tells whether elements are still being moved from a smaller table
+    bool rehash_in_progress() const noexcept {
+        return _old.ctrl;
+    }
+
+    /// Makes room for \c n elements, moving all the elements to a new table
+    /// at once if the current one is too small
+    void reserve(size_t n) {
+        migrate(_old.groups());
+        if (n <= _table.capacity() - _table.capacity() / 8) {
+            return;
+        }
+        n = std::max(n, size());
+        size_t groups = 1;
+        while (groups * width - groups * width / 8 < n) {
+            groups *= 2;
+        }
+        rehash_to(groups);
+        migrate(_old.groups());
+    }
+
+    iterator begin() noexcept {
+        iterator it(this, &_table, 0);
+        it.settle();
+        return it;
+    }
+    iterator end() noexcept {
+        return iterator();
+    }
+    const_iterator begin() const noexcept {
+        const_iterator it(this, &_table, 0);
+        it.settle();
+        return it;
+    }
+    const_iterator end() const noexcept {
+        return const_iterator();
+    }
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+    iterator find(const Key& key) {
+        return do_find(*this, key);
+    }
+    const_iterator find(const Key& key) const {
+        return do_find(*this, key);
+    }
+
+    bool contains(const Key& key) const {
+        return find(key) != end();
+    }
+
+    size_t count(const Key& key) const {
+        return contains(key);
+    }
+
+    T& at(const Key& key) {
+        auto it = find(key);
+        if (it == end()) {
+            throw std::out_of_range("flat_hash_map::at");
+        }
+        return it->second;
+    }
+
+    const T& at(const Key& key) const {
+        auto it = find(key);
+        if (it == end()) {
+            throw std::out_of_range("flat_hash_map::at");
+        }
+        return it->second;
+    }
+
+    T& operator[](const Key& key) {
+        return try_emplace(key).first->second;
+    }
+    T& operator[](Key&& key) {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+        return do_try_emplace(key, std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args) {
+        return do_try_emplace(std::move(key), std::forward<Args>(args)...);
+    }
+
+    std::pair<iterator, bool> insert(const value_type& v) {
+        return do_try_emplace(v.first, v.second);
+    }
+    std::pair<iterator, bool> insert(value_type&& v) {
+        return do_try_emplace(std::move(const_cast<Key&>(v.first)), std::move(v.second));
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        return insert(value_type(std::forward<Args>(args)...));
+    }
+
+    /// Erases the element \c it points to. Other iterators stay valid.
+    void erase(const_iterator it) noexcept {
+        erase_at(const_cast<table&>(*it._table), it._index);
+    }
+
+    size_t erase(const Key& key) {
+        auto it = find(key);
+        if (it == end()) {
+            return 0;
+        }
+        erase(it);
+        return 1;
+    }
+
+    void clear() noexcept {
+        destroy_table(_old);
+        if (!_table.ctrl) {
+            return;
+        }
+        slot_allocator sa(_alloc);
+        for (size_t i = 0; _table.size && i < _table.capacity(); ++i) {
+            if (_table.full(i)) {
+                slot_traits::destroy(sa, &_table.slots[i]);
+                _table.size--;
+            }
+        }
+        auto capacity = _table.capacity();
+        std::memset(_table.ctrl, internal::hash_ctrl_empty, capacity);
+        _table.growth_left = capacity - capacity / 8;
+    }
+};
+
+}
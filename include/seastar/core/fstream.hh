@@ -37,12 +37,34 @@
 
 #ifndef SEASTAR_MODULE
 #include <cstdint>
+#include <stdexcept>
+#include <vector>
 #endif
 
 namespace seastar {
 
 SEASTAR_MODULE_EXPORT_BEGIN
 
+/// CRC32C checksums of the consecutive blocks of a file, see \ref crc32c
+///
+/// File streams given one compute the checksums of the data as it goes
+/// through them: output streams record them, input streams verify the
+/// blocks they have a checksum for, and record those that follow.
+struct file_checksums {
+    size_t block_size = 4096; ///< Bytes per block, the last block of a file may be shorter
+    std::vector<uint32_t> blocks; ///< Checksum of each block, from the start of the file
+    uint64_t size = 0; ///< Bytes the blocks cover, which tells where a short last block ends
+};
+
+/// Thrown by file input streams reading data that does not match its checksum
+class checksum_error : public std::runtime_error {
+    uint64_t _block;
+public:
+    explicit checksum_error(uint64_t block);
+    /// The index of the block that does not match
+    uint64_t block() const noexcept { return _block; }
+};
+
 class file_input_stream_history {
     static constexpr uint64_t window_size = 4 * 1024 * 1024;
     struct window {
@@ -61,6 +83,24 @@ struct file_input_stream_options {
     size_t buffer_size = 8192;    ///< I/O buffer size
     unsigned read_ahead = 0;      ///< Maximum number of extra read-ahead operations
     lw_shared_ptr<file_input_stream_history> dynamic_adjustments = { }; ///< Input stream history, if null dynamic adjustments are disabled
+    /// \brief Adapt the reads to the access pattern and to their latency
+    ///
+    /// The stream starts with small buffers and no read-ahead. Once the
+    /// reads are sequential, the buffers double up to \ref buffer_size,
+    /// and enough reads are issued ahead to cover their latency, as
+    /// observed against the time the consumer takes to process a buffer,
+    /// up to \ref read_ahead. A skip beyond the data read goes back to
+    /// small buffers, and cancels the reads ahead it drops, so they don't
+    /// cost bandwidth if not yet dispatched.
+    ///
+    /// \ref dynamic_adjustments is ignored in this mode.
+    bool adaptive = false;
+    /// If set, the checksums the blocks read are verified against; a block
+    /// is verified when the stream reads all of it, up to
+    /// file_checksums::size for a short last block, and the blocks past
+    /// those known are recorded. A mismatch fails the read with
+    /// \ref checksum_error.
+    lw_shared_ptr<file_checksums> checksums = {};
 };
 
 /// \brief Creates an input_stream to read a portion of a file.
@@ -99,6 +139,14 @@ data_source make_file_data_source(file, uint64_t offset, uint64_t len, file_inpu
 /// Create a data_source for reading the whole file from start to end
 data_source make_file_data_source(file, file_input_stream_options);
 
+/// What an adaptive file output stream achieved, see \ref file_output_stream_options::adaptive
+struct file_output_stream_stats {
+    uint64_t bytes_written = 0; ///< Bytes whose write completed
+    double throughput = 0; ///< Bytes per second written over the last measurement window
+    size_t write_size = 0; ///< Current size of the writes issued
+    unsigned write_behind = 0; ///< Current number of writes issued in parallel
+};
+
 struct file_output_stream_options {
     // For small files, setting preallocation_size can make it impossible for XFS to find
     // an aligned extent. On the other hand, without it, XFS will divide the file into
@@ -110,6 +158,27 @@ struct file_output_stream_options {
     unsigned buffer_size = 65536;
     unsigned preallocation_size = 0; ///< Preallocate extents. For large files, set to a large number (a few megabytes) to reduce fragmentation
     unsigned write_behind = 1; ///< Number of buffers to write in parallel
+    /// \brief Adapt the writes to the bandwidth the file sustains
+    ///
+    /// The buffers of the stream are gathered into writes of up to
+    /// \ref max_write_size, issued in parallel up to \ref max_write_behind,
+    /// without copying them. The writes start at \ref buffer_size and
+    /// \ref write_behind, and grow while the stream waits for them and
+    /// their throughput stays below \ref bandwidth_target: first the
+    /// write size doubles, then more writes are issued in parallel.
+    ///
+    /// Appending writes in parallel is best combined with
+    /// file_open_options::sloppy_size, so the file size does not have to
+    /// follow each of them.
+    bool adaptive = false;
+    unsigned max_write_size = 1 << 20; ///< In adaptive mode, the largest write, a multiple of \ref buffer_size
+    unsigned max_write_behind = 16; ///< In adaptive mode, the most writes in parallel
+    uint64_t bandwidth_target = 0; ///< In adaptive mode, the bytes per second above which the writes stop growing, 0 for no target
+    lw_shared_ptr<file_output_stream_stats> stats = {}; ///< In adaptive mode, updated with the achieved throughput, if set
+    /// If set, records the checksums of the blocks written, computed as
+    /// each buffer is handed to the file. A short last block is recorded
+    /// on close(), a flush() does not end the block it is in.
+    lw_shared_ptr<file_checksums> checksums = {};
 };
 
 /// Create an output_stream for writing starting at the position zero of a
@@ -237,6 +237,8 @@ namespace internal {
 template <class T = void>
 class promise_base_with_type;
 class promise_base;
+template <typename T>
+class coroutine_traits_base;
 
 struct monostate {};
 
@@ -708,6 +710,29 @@ class continuation_base_with_promise : public continuation_base<T> {
     Promise _pr;
 };
 
+namespace internal {
+
+// Continuations attached to the future of a continuation that was just
+// allocated, as in f.then(a).then(b).then(c) on an unavailable f, are
+// carved from an arena shared by the chain instead of being allocated one
+// by one. The arena is freed with the last of its continuations.
+// \c chained_to is the promise of the future the continuation is attached to.
+inline constexpr size_t continuation_alignment = 16;
+void* allocate_continuation(size_t size, const void* chained_to);
+void free_continuation(void* p) noexcept;
+
+struct continuation_chain_stats {
+    uint64_t allocations = 0;
+    // continuations carved from the arena of their chain
+    uint64_t chained = 0;
+    // arenas allocated for chains
+    uint64_t arenas = 0;
+};
+
+continuation_chain_stats get_continuation_chain_stats() noexcept;
+
+}
+
 template <typename Promise, typename Func, typename Wrapper, typename T = void>
 struct continuation final : continuation_base_with_promise<Promise, T> {
     // Func is the original function passed to then/then_wrapped. The
@@ -724,13 +749,28 @@ struct continuation final : continuation_base_with_promise<Promise, T> {
         : continuation_base_with_promise<Promise, T>(std::move(pr))
         , _func(std::move(func))
         , _wrapper(std::move(wrapper)) {}
+    // Over-aligned continuations are left to the general allocator
+    static constexpr bool chainable = alignof(continuation) <= internal::continuation_alignment;
+    static continuation* make(Promise&& pr, Func&& func, Wrapper&& wrapper, const void* chained_to) {
+        if constexpr (chainable) {
+            return new (internal::allocate_continuation(sizeof(continuation), chained_to))
+                    continuation(std::move(pr), std::move(func), std::move(wrapper));
+        } else {
+            return new continuation(std::move(pr), std::move(func), std::move(wrapper));
+        }
+    }
     virtual void run_and_dispose() noexcept override {
         try {
             _wrapper(std::move(this->_pr), _func, std::move(this->_state));
         } catch (...) {
             this->_pr.set_to_current_exception();
         }
-        delete this;
+        if constexpr (chainable) {
+            this->~continuation();
+            internal::free_continuation(this);
+        } else {
+            delete this;
+        }
     }
     Func _func;
     [[no_unique_address]] Wrapper _wrapper;
@@ -838,6 +878,14 @@ class promise_base {
 
     /// Returns the task which is waiting for this promise to resolve, or nullptr.
     task* waiting_task() const noexcept { return _task; }
+
+protected:
+    // Detaches the waiting task, which is then not scheduled when the
+    // promise resolves, but left to the caller to run
+    task* release_waiting_task() noexcept {
+        assert_task_shard();
+        return std::exchange(_task, nullptr);
+    }
 };
 
 /// \brief A promise with type but no local data.
@@ -992,6 +1040,8 @@ class promise : private internal::promise_base_with_type<T> {
 
     template <typename U>
     friend class future;
+    template <typename U>
+    friend class internal::coroutine_traits_base;
 };
 
 /// @}
@@ -1235,7 +1285,7 @@ class [[nodiscard]] future : private internal::future_base {
         // and we cannot break the chain. Since this function is
         // noexcept, it will call std::terminate if new throws.
         memory::scoped_critical_alloc_section _;
-        auto tws = new continuation<Pr, Func, Wrapper, T>(std::move(pr), std::move(func), std::move(wrapper));
+        auto tws = continuation<Pr, Func, Wrapper, T>::make(std::move(pr), std::move(func), std::move(wrapper), _promise);
         // In a debug build we schedule ready futures, but not in
         // other build modes.
 #ifdef SEASTAR_DEBUG
@@ -0,0 +1,113 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <signal.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#endif
+#include <seastar/core/metrics_registration.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/backtrace.hh>
+
+namespace seastar {
+
+class reactor;
+
+namespace internal {
+
+// One backtrace seen by the CPU profiler, with the number of times it was
+// sampled
+struct cpu_profile_entry {
+    simple_backtrace backtrace;
+    // name of the scheduling group (and so of the task queue) which was running
+    sstring scheduling_group;
+    // the sample was taken while the stall detector was reporting the task
+    bool stalled = false;
+    uint64_t samples = 0;
+};
+
+// Samples the backtrace of the reactor thread every period of cpu time it
+// uses, on average, from a signal handler.
+//
+// The handler stores the samples in a ring, without allocating or locking;
+// the reactor moves them into an aggregate of the backtraces seen since the
+// profile was last read every second and when the profile is read. Samples
+// which do not fit in the ring are dropped and counted; so are the samples
+// of an aggregate which fills up, which then starts over.
+class cpu_profiler {
+    static constexpr size_t ring_size = 256;
+    static constexpr size_t max_backtraces = 10000;
+
+    struct sample {
+        simple_backtrace backtrace;
+        unsigned sg_id = 0;
+        bool stalled = false;
+        bool operator==(const sample&) const = default;
+    };
+    struct sample_hash {
+        size_t operator()(const sample& s) const noexcept {
+            return s.backtrace.hash() ^ (size_t(s.sg_id) << 1 | s.stalled);
+        }
+    };
+
+    timer_t _timer;
+    std::chrono::nanoseconds _period{0};
+    uint64_t _rand_state;
+    std::unique_ptr<sample[]> _ring;
+    // written by the signal handler and the reactor respectively, on the
+    // same thread
+    std::atomic<uint64_t> _head{0};
+    std::atomic<uint64_t> _tail{0};
+    std::unordered_map<sample, uint64_t, sample_hash> _backtraces;
+    // samples in _backtraces
+    uint64_t _aggregated = 0;
+    uint64_t _samples = 0;
+    std::atomic<uint64_t> _dropped{0};
+    metrics::metric_groups _metrics;
+
+    void arm_timer() noexcept;
+public:
+    cpu_profiler();
+    ~cpu_profiler();
+    static int signal_number() { return SIGRTMIN + 2; }
+
+    // 0 disables the profiler
+    void set_period(std::chrono::nanoseconds period);
+    std::chrono::nanoseconds period() const noexcept { return _period; }
+
+    // Called from the signal handler; \c pc is the interrupted instruction
+    void on_signal(uintptr_t pc, bool stalled) noexcept;
+    // Moves the samples from the ring to the aggregate
+    void drain();
+    // The backtraces sampled since the profile was last read
+    std::vector<cpu_profile_entry> profile();
+};
+
+}
+}
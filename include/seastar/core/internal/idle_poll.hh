@@ -0,0 +1,62 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <chrono>
+#endif
+
+namespace seastar::internal {
+
+// Learns how long a shard usually stays idle before work arrives, for the
+// reactor to poll an idle shard only about that long
+// (reactor_config::idle_poll_adaptive).
+class idle_poll_estimator {
+    std::chrono::nanoseconds _max_poll_time;
+    // Moving average of the idle periods that ended with work arriving
+    std::chrono::nanoseconds _avg{0};
+public:
+    explicit idle_poll_estimator(std::chrono::nanoseconds max_poll_time) noexcept
+        : _max_poll_time(max_poll_time) {}
+
+    void learn(std::chrono::nanoseconds period) noexcept {
+        // Periods past the longest poll all mean "sleep", so clamp them for a
+        // single long sleep not to keep the average up for long
+        period = std::min(period, _max_poll_time);
+        _avg += (period - _avg) / 8;
+    }
+
+    std::chrono::nanoseconds average() const noexcept {
+        return _avg;
+    }
+
+    // Work usually comes within the average idle period; poll for twice as
+    // long unless that exceeds the limit, in which case polling is unlikely
+    // to catch it and sleeping right away is cheaper
+    std::chrono::nanoseconds poll_time() const noexcept {
+        auto t = _avg * 2;
+        return t <= _max_poll_time ? t : std::chrono::nanoseconds(0);
+    }
+};
+
+}
@@ -38,6 +38,19 @@ class io_intent;
 
 namespace internal {
 
+/*
+ * A request of a cancellable queue which was dispatched to the kernel. It
+ * can't be taken back anymore, but the kernel can be asked to abort it.
+ */
+class cancellable_io : public bi::list_base_hook<bi::link_mode<bi::auto_unlink>> {
+public:
+    using container_type = bi::list<cancellable_io, bi::constant_time_size<false>>;
+
+    virtual void cancel_in_kernel() noexcept = 0;
+protected:
+    ~cancellable_io() = default;
+};
+
 /*
  * The tracker of cancellable sub-queue of requests.
  *
@@ -66,10 +79,12 @@ class cancellable_queue {
             cq.push_back(*this);
         }
 
-        void maybe_dequeue() noexcept {
-            if (_ref != nullptr) {
-                _ref->pop_front();
+        cancellable_queue* maybe_dequeue() noexcept {
+            auto cq = _ref;
+            if (cq != nullptr) {
+                cq->pop_front();
             }
+            return cq;
         }
     };
 
@@ -82,6 +97,9 @@ class cancellable_queue {
 
     link* _first;
     list_of_links_t _rest;
+    // The requests dispatched from the queue which didn't complete yet,
+    // aborted in the kernel when the queue is cancelled
+    cancellable_io::container_type _dispatched;
 
     void push_back(link& il) noexcept;
     void pop_front() noexcept;
@@ -92,6 +110,10 @@ class cancellable_queue {
     cancellable_queue(cancellable_queue&& o) noexcept;
     cancellable_queue& operator=(cancellable_queue&& o) noexcept;
     ~cancellable_queue();
+
+    void track_dispatched(cancellable_io& io) noexcept {
+        _dispatched.push_back(io);
+    }
 };
 
 /*
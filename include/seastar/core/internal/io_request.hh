@@ -28,24 +28,33 @@
 #include <vector>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 
 namespace seastar {
 extern logger io_log;
 
 namespace internal {
 
+class io_chain;
+
 class io_request {
 public:
-    enum class operation : char { read, readv, write, writev, fdatasync, recv, recvmsg, send, sendmsg, accept, connect, poll_add, poll_remove, cancel };
+    enum class operation : char { read, readv, write, writev, fdatasync, recv, recvmsg, send, sendmsg, accept, connect, poll_add, poll_remove, cancel,
+            openat, statx, unlinkat, renameat, fallocate, discard, chain, nvme };
 private:
     // the upper layers give us void pointers, but storing void pointers here is just
     // dangerous. The constructors seem to be happy to convert other pointers to void*,
     // even if they are marked as explicit, and then you end up losing approximately 3 hours
     // and 15 minutes (hypothetically, of course), trying to chase the weirdest bug.
     // Let's store a char* for safety, and cast it back to void* in the accessor.
+    //
+    // File I/O requests have a link count, the number of requests submitted
+    // right after them that may only start once they succeeded (see make_chain())
     struct read_op {
         operation op;
         bool nowait_works;
+        bool dsync;
+        uint8_t link;
         int fd;
         uint64_t pos;
         char* addr;
@@ -54,6 +63,8 @@ class io_request {
     struct readv_op {
         operation op;
         bool nowait_works;
+        bool dsync;
+        uint8_t link;
         int fd;
         uint64_t pos;
         ::iovec* iovec;
@@ -78,6 +89,7 @@ class io_request {
     using writev_op = readv_op;
     struct fdatasync_op {
         operation op;
+        uint8_t link;
         int fd;
     };
     struct accept_op {
@@ -108,6 +120,75 @@ class io_request {
         int fd;
         char* addr;
     };
+    // Paths of the file metadata operations are relative to the current
+    // working directory, like those of the plain syscalls.
+    struct openat_op {
+        operation op;
+        int flags;
+        mode_t mode;
+        char* path;
+    };
+    struct statx_op {
+        operation op;
+        int fd;
+        int flags;
+        unsigned mask;
+        char* path;
+        struct ::statx* statx;
+    };
+    struct unlinkat_op {
+        operation op;
+        int flags;
+        char* path;
+    };
+    struct renameat_op {
+        operation op;
+        int flags;
+        char* oldpath;
+        char* newpath;
+    };
+    struct fallocate_op {
+        operation op;
+        int fd;
+        int mode;
+        uint64_t pos;
+        uint64_t len;
+    };
+    struct discard_op {
+        operation op;
+        bool blockdev;
+        int fd;
+        uint64_t pos;
+        uint64_t len;
+    };
+    struct chain_op {
+        operation op;
+        io_chain* chain;
+    };
+    struct nvme_op {
+        operation op;
+        bool write;
+        bool fua;
+        uint8_t lba_shift;
+        int fd;
+        uint64_t pos;
+        char* addr;
+        uint32_t size;
+        uint32_t nsid;
+
+        // The NVM command set read or write
+        uint8_t nvme_opcode() const noexcept {
+            return write ? 0x01 : 0x02;
+        }
+        // The starting LBA, which goes in cdw10-11
+        uint64_t slba() const noexcept {
+            return pos >> lba_shift;
+        }
+        // The 0's based number of blocks, and forced unit access in bit 30
+        uint32_t cdw12() const noexcept {
+            return ((size >> lba_shift) - 1) | (uint32_t(fua) << 30);
+        }
+    };
 
     union {
         read_op _read;
@@ -124,6 +205,14 @@ class io_request {
         poll_add_op _poll_add;
         poll_remove_op _poll_remove;
         cancel_op _cancel;
+        openat_op _openat;
+        statx_op _statx;
+        unlinkat_op _unlinkat;
+        renameat_op _renameat;
+        fallocate_op _fallocate;
+        discard_op _discard;
+        chain_op _chain;
+        nvme_op _nvme;
     };
 
 public:
@@ -199,11 +288,12 @@ class io_request {
         return req;
     }
 
-    static io_request make_write(int fd, uint64_t pos, const void* address, size_t size, bool nowait_works) {
+    static io_request make_write(int fd, uint64_t pos, const void* address, size_t size, bool nowait_works, bool dsync = false) {
         io_request req;
         req._write = {
           .op = operation::write,
           .nowait_works = nowait_works,
+          .dsync = dsync,
           .fd = fd,
           .pos = pos,
           .addr = const_cast<char*>(reinterpret_cast<const char*>(address)),
@@ -212,11 +302,12 @@ class io_request {
         return req;
     }
 
-    static io_request make_writev(int fd, uint64_t pos, std::vector<iovec>& iov, bool nowait_works) {
+    static io_request make_writev(int fd, uint64_t pos, std::vector<iovec>& iov, bool nowait_works, bool dsync = false) {
         io_request req;
         req._writev = {
           .op = operation::writev,
           .nowait_works = nowait_works,
+          .dsync = dsync,
           .fd = fd,
           .pos = pos,
           .iovec = iov.data(),
@@ -287,6 +378,113 @@ class io_request {
         return req;
     }
 
+    static io_request make_openat(const char* path, int flags, mode_t mode) {
+        io_request req;
+        req._openat = {
+          .op = operation::openat,
+          .flags = flags,
+          .mode = mode,
+          .path = const_cast<char*>(path),
+        };
+        return req;
+    }
+
+    // Stats path, or fd itself if path is empty and flags has AT_EMPTY_PATH
+    static io_request make_statx(int fd, const char* path, int flags, unsigned mask, struct ::statx* buf) {
+        io_request req;
+        req._statx = {
+          .op = operation::statx,
+          .fd = fd,
+          .flags = flags,
+          .mask = mask,
+          .path = const_cast<char*>(path),
+          .statx = buf,
+        };
+        return req;
+    }
+
+    static io_request make_unlinkat(const char* path, int flags) {
+        io_request req;
+        req._unlinkat = {
+          .op = operation::unlinkat,
+          .flags = flags,
+          .path = const_cast<char*>(path),
+        };
+        return req;
+    }
+
+    static io_request make_renameat(const char* oldpath, const char* newpath, int flags) {
+        io_request req;
+        req._renameat = {
+          .op = operation::renameat,
+          .flags = flags,
+          .oldpath = const_cast<char*>(oldpath),
+          .newpath = const_cast<char*>(newpath),
+        };
+        return req;
+    }
+
+    static io_request make_fallocate(int fd, int mode, uint64_t pos, uint64_t len) {
+        io_request req;
+        req._fallocate = {
+          .op = operation::fallocate,
+          .fd = fd,
+          .mode = mode,
+          .pos = pos,
+          .len = len,
+        };
+        return req;
+    }
+
+    // Discards are scheduled by the io_queue, which runs them in the syscall
+    // thread: BLKDISCARD for block devices, punching a hole for files
+    static io_request make_discard(int fd, uint64_t pos, uint64_t len, bool blockdev) {
+        io_request req;
+        req._discard = {
+          .op = operation::discard,
+          .blockdev = blockdev,
+          .fd = fd,
+          .pos = pos,
+          .len = len,
+        };
+        return req;
+    }
+
+    // Requests of the io_queue that run in order, one once the one before it
+    // succeeded, and complete together. The backends never see the chain
+    // itself, the io_queue submits its requests, linked if the backend can
+    // link them (see reactor_backend::links_file_io()).
+    static io_request make_chain(io_chain* chain) {
+        io_request req;
+        req._chain = {
+          .op = operation::chain,
+          .chain = chain,
+        };
+        return req;
+    }
+
+    // An NVMe read or write command passed through to the driver on the
+    // generic character device of the namespace, which only io_uring can
+    // submit (see reactor_backend::supports_nvme_passthrough()). The position
+    // and size are in bytes, multiples of the logical block size (1 << lba_shift).
+    // Completes with 0, or with the positive NVMe status if the command failed.
+    // It is never split, and must fit the maximum transfer of the device.
+    static io_request make_nvme(int fd, uint32_t nsid, unsigned lba_shift, uint64_t pos, const void* address, size_t size, bool write, bool fua = false) {
+        io_request req;
+        req._nvme = {
+          .op = operation::nvme,
+          .write = write,
+          .fua = fua,
+          .lba_shift = uint8_t(lba_shift),
+          .fd = fd,
+          .pos = pos,
+          .addr = const_cast<char*>(reinterpret_cast<const char*>(address)),
+          .size = uint32_t(size),
+          .nsid = nsid,
+        };
+        return req;
+    }
+
     bool is_read() const {
         switch (opcode()) {
         case operation::read:
@@ -294,6 +492,8 @@ class io_request {
         case operation::recvmsg:
         case operation::recv:
             return true;
+        case operation::nvme:
+            return !_nvme.write;
         default:
             return false;
         }
@@ -306,6 +506,8 @@ class io_request {
         case operation::send:
         case operation::sendmsg:
             return true;
+        case operation::nvme:
+            return _nvme.write;
         default:
             return false;
         }
@@ -320,6 +522,55 @@ class io_request {
         return _read.op;
     }
 
+    // Whether this is a write that must be stable on completion (RWF_DSYNC)
+    bool dsync() const noexcept {
+        switch (opcode()) {
+        case operation::write:
+            return _write.dsync;
+        case operation::writev:
+            return _writev.dsync;
+        case operation::nvme:
+            return _nvme.fua;
+        default:
+            return false;
+        }
+    }
+
+    // How many of the requests submitted right after this one are linked to
+    // it, and must not be submitted to the kernel apart from it
+    unsigned linked() const noexcept {
+        switch (opcode()) {
+        case operation::read:
+        case operation::write:
+            return _read.link;
+        case operation::readv:
+        case operation::writev:
+            return _readv.link;
+        case operation::fdatasync:
+            return _fdatasync.link;
+        default:
+            return 0;
+        }
+    }
+
+    void set_linked(uint8_t link) noexcept {
+        switch (opcode()) {
+        case operation::read:
+        case operation::write:
+            _read.link = link;
+            break;
+        case operation::readv:
+        case operation::writev:
+            _readv.link = link;
+            break;
+        case operation::fdatasync:
+            _fdatasync.link = link;
+            break;
+        default:
+            break;
+        }
+    }
+
     template <operation Op>
     auto& as() const {
         if constexpr (Op == operation::read) {
@@ -364,6 +615,30 @@ class io_request {
         if constexpr (Op == operation::cancel) {
             return _cancel;
         }
+        if constexpr (Op == operation::openat) {
+            return _openat;
+        }
+        if constexpr (Op == operation::statx) {
+            return _statx;
+        }
+        if constexpr (Op == operation::unlinkat) {
+            return _unlinkat;
+        }
+        if constexpr (Op == operation::renameat) {
+            return _renameat;
+        }
+        if constexpr (Op == operation::fallocate) {
+            return _fallocate;
+        }
+        if constexpr (Op == operation::discard) {
+            return _discard;
+        }
+        if constexpr (Op == operation::chain) {
+            return _chain;
+        }
+        if constexpr (Op == operation::nvme) {
+            return _nvme;
+        }
     }
 
     struct part;
@@ -379,6 +654,7 @@ class io_request {
         sub_op = {
           .op = op.op,
           .nowait_works = op.nowait_works,
+          .dsync = op.dsync,
           .fd = op.fd,
           .pos = op.pos + pos,
           .addr = op.addr + pos,
@@ -397,6 +673,7 @@ class io_request {
         sub_op = {
           .op = op.op,
           .nowait_works = op.nowait_works,
+          .dsync = op.dsync,
           .fd = op.fd,
           .pos = op.pos + pos,
           .iovec = iov.data(),
@@ -24,6 +24,7 @@
 #include <seastar/core/chunked_fifo.hh>
 #include <seastar/core/internal/io_request.hh>
 
+#include <chrono>
 #include <concepts>
 #include <cstddef>
 #include <type_traits>
@@ -40,18 +41,23 @@ class io_sink;
 class pending_io_request : private internal::io_request {
     friend class io_sink;
     io_completion* _completion;
+    std::chrono::steady_clock::time_point* _submitted;
 
 public:
-    pending_io_request(internal::io_request req, io_completion* desc) noexcept
+    pending_io_request(internal::io_request req, io_completion* desc, std::chrono::steady_clock::time_point* submitted) noexcept
             : io_request(std::move(req))
             , _completion(desc)
+            , _submitted(submitted)
     { }
 };
 
 class io_sink {
     chunked_fifo<pending_io_request> _pending_io;
 public:
-    void submit(io_completion* desc, internal::io_request req) noexcept;
+    // If \c submitted is set, it's updated with the time the request
+    // is handed over to the kernel. Cancellation requests have no
+    // completion.
+    void submit(io_completion* desc, internal::io_request req, std::chrono::steady_clock::time_point* submitted = nullptr) noexcept;
 
     template <typename Fn>
     // Fn should return whether the request was consumed and
@@ -59,8 +65,16 @@ class io_sink {
     requires std::is_invocable_r<bool, Fn, internal::io_request&, io_completion*>::value
     size_t drain(Fn&& consume) {
         size_t drained = 0;
+        std::chrono::steady_clock::time_point now;
 
         for (auto& req : _pending_io) {
+            // The completion may be gone once consumed
+            if (req._submitted) {
+                if (now == std::chrono::steady_clock::time_point()) {
+                    now = std::chrono::steady_clock::now();
+                }
+                *req._submitted = now;
+            }
             if (!consume(req, req._completion)) {
                 break;
             }
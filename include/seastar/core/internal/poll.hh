@@ -23,7 +23,27 @@
 
 namespace seastar {
 
+namespace internal {
+
+// What the reactor loop spends its time on, see reactor::poll_once()
+enum class loop_phase {
+    smp,        // polling the queues from the other shards
+    alien,      // polling the queues from non-seastar threads
+    io,         // submitting and reaping kernel events, disk I/O and syscall completions
+    network,    // flushing batched sends, polling network devices
+    timers,     // expiring lowres timers
+    other,      // any other poller
+    tasks,      // running tasks
+    count,
+};
+
+}
+
 struct pollfn {
+    // Where the time spent in poll() is accounted
+    const internal::loop_phase phase;
+
+    explicit pollfn(internal::loop_phase phase = internal::loop_phase::other) noexcept : phase(phase) {}
     virtual ~pollfn() {}
     // Returns true if work was done (false = idle)
     virtual bool poll() = 0;
@@ -46,6 +66,7 @@ struct pollfn {
 // nothing on wakeup.
 template <bool Passive>
 struct simple_pollfn : public pollfn {
+    using pollfn::pollfn;
     virtual bool pure_poll() override final {
         return poll();
     }
@@ -61,15 +82,39 @@ namespace internal {
 template <typename Func>
 requires std::is_invocable_r_v<bool, Func>
 inline
-std::unique_ptr<seastar::pollfn> make_pollfn(Func&& func) {
+std::unique_ptr<seastar::pollfn> make_pollfn(Func&& func, loop_phase phase = loop_phase::other) {
     struct the_pollfn : simple_pollfn<false> {
-        the_pollfn(Func&& func) : func(std::forward<Func>(func)) {}
+        the_pollfn(Func&& func, loop_phase phase) : simple_pollfn<false>(phase), func(std::forward<Func>(func)) {}
         Func func;
         virtual bool poll() override final {
             return func();
         }
     };
-    return std::make_unique<the_pollfn>(std::forward<Func>(func));
+    return std::make_unique<the_pollfn>(std::forward<Func>(func), phase);
+}
+
+// Like make_pollfn(), but lets the reactor sleep once the function finds
+// nothing to do, for work which only comes up while the reactor is awake
+template <typename Func>
+requires std::is_invocable_r_v<bool, Func>
+inline
+std::unique_ptr<seastar::pollfn> make_idle_pollfn(Func&& func, loop_phase phase = loop_phase::other) {
+    struct the_pollfn : pollfn {
+        the_pollfn(Func&& func, loop_phase phase) : pollfn(phase), func(std::forward<Func>(func)) {}
+        Func func;
+        virtual bool poll() override final {
+            return func();
+        }
+        virtual bool pure_poll() override final {
+            return func();
+        }
+        virtual bool try_enter_interrupt_mode() override final {
+            return !func();
+        }
+        virtual void exit_interrupt_mode() override final {
+        }
+    };
+    return std::make_unique<the_pollfn>(std::forward<Func>(func), phase);
 }
 
 class poller {
@@ -80,8 +125,8 @@ class poller {
 public:
     template <typename Func>
     requires std::is_invocable_r_v<bool, Func>
-    static poller simple(Func&& poll) {
-        return poller(make_pollfn(std::forward<Func>(poll)));
+    static poller simple(Func&& poll, loop_phase phase = loop_phase::other) {
+        return poller(make_pollfn(std::forward<Func>(poll), phase));
     }
     poller(std::unique_ptr<pollfn> fn)
             : _pollfn(std::move(fn)) {
@@ -116,6 +116,7 @@ class pollable_fd_state {
     future<size_t> sendmsg(struct msghdr *msg);
     future<size_t> recvmsg(struct msghdr *msg);
     future<size_t> sendto(socket_address addr, const void* buf, size_t len);
+    future<size_t> sendfile(int in_fd, uint64_t offset, size_t len);
     future<> poll_rdhup();
 
 protected:
@@ -190,6 +191,10 @@ class pollable_fd {
     future<size_t> sendto(socket_address addr, const void* buf, size_t len) {
         return _s->sendto(addr, buf, len);
     }
+    // Sends up to len bytes of in_fd starting at offset, see sendfile(2)
+    future<size_t> sendfile(int in_fd, uint64_t offset, size_t len) {
+        return _s->sendfile(in_fd, offset, len);
+    }
     file_desc& get_file_desc() const { return _s->fd; }
     using shutdown_kernel_only = bool_class<struct shutdown_kernel_only_tag>;
     void shutdown(int how, shutdown_kernel_only kernel_only = shutdown_kernel_only::yes);
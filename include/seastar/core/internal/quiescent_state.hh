@@ -0,0 +1,65 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/cacheline.hh>
+#ifndef SEASTAR_MODULE
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#endif
+
+namespace seastar::internal {
+
+// Quiescent-state based reclamation, for what replicated<T> replaces.
+//
+// Each shard publishes an epoch, which its reactor advances every time it
+// goes around its event loop, in between runs of tasks, where the shard
+// holds no reference to what other shards may free. An odd epoch means that
+// the shard sleeps or doesn't run its loop, and holds no references either.
+//
+// The reactor updates its epoch with plain stores. Those reclaiming
+// something pay for the synchronization instead: after unpublishing it,
+// they sample the epochs of all shards behind a system-wide memory barrier,
+// and free it once every shard which was running moved past its sample.
+struct alignas(cache_line_size) quiescent_epoch {
+    std::atomic<uint64_t> value{1};
+
+    // Between runs of tasks
+    void pass() noexcept {
+        value.store((value.load(std::memory_order_relaxed) | 1) + 1, std::memory_order_release);
+    }
+    // Before sleeping
+    void idle() noexcept {
+        value.store(value.load(std::memory_order_relaxed) | 1, std::memory_order_release);
+    }
+};
+
+// Sizes the epochs for the number of shards, before the reactors start
+void configure_quiescent_epochs(unsigned shards);
+quiescent_epoch& local_quiescent_epoch() noexcept;
+// The epochs of all shards, after a system-wide memory barrier
+std::vector<uint64_t> sample_quiescent_epochs();
+// Every shard went through a quiescent state since the epochs were sampled
+bool grace_period_elapsed(const std::vector<uint64_t>& sampled) noexcept;
+
+}
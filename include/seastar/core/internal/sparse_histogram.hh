@@ -0,0 +1,208 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <seastar/core/metrics_types.hh>
+
+namespace seastar::metrics::internal {
+
+/**
+ * A sparse exponential histogram, reported as a Prometheus native histogram.
+ *
+ * Unlike approximate_exponential_histogram, the range is not fixed: the
+ * buckets follow the observed values. With schema n, each power of 2 is
+ * divided into 2^n buckets, bucket i holding the values in
+ * (2^((i-1) * 2^-n), 2^(i * 2^-n)], so the relative error of a value is
+ * bounded by the schema alone.
+ *
+ * Values no larger than the zero threshold, negative ones included, are
+ * counted in a zero bucket: the histogram is meant for non-negative values
+ * like latencies.
+ *
+ * The buckets between the smallest and the largest observed value are kept
+ * in a vector. When there would be more than max_buckets of them, the
+ * resolution is halved (the schema reduced by one) until they fit, so
+ * memory is bounded whatever the values.
+ *
+ * Only the nonempty buckets are reported, so a histogram costs a single
+ * series, however fine its resolution.
+ */
+class sparse_histogram {
+    int32_t _schema;
+    double _zero_threshold;
+    size_t _max_buckets;
+    uint64_t _count = 0;
+    double _sum = 0;
+    uint64_t _zero_count = 0;
+    // the index of _buckets[0]
+    int32_t _first_index = 0;
+    std::vector<uint64_t> _buckets;
+
+    static int32_t bucket_index(double v, int32_t schema) noexcept {
+        double index = std::ceil(std::ldexp(std::log2(v), schema));
+        // infinity falls in the bucket of the largest double
+        return int32_t(std::min(index, std::ldexp(1024.0, schema)));
+    }
+
+    // halves the resolution until the buckets fit
+    void downscale(int32_t schema) {
+        if (schema >= _schema) {
+            return;
+        }
+        auto shift = _schema - schema;
+        _schema = schema;
+        if (_buckets.empty()) {
+            return;
+        }
+        // bucket i of schema s is in bucket ((i - 1) >> d) + 1 of schema s - d
+        auto downscaled = [shift] (int32_t index) {
+            return ((index - 1) >> shift) + 1;
+        };
+        auto first = downscaled(_first_index);
+        std::vector<uint64_t> res(downscaled(_first_index + int32_t(_buckets.size()) - 1) - first + 1);
+        for (size_t i = 0; i < _buckets.size(); ++i) {
+            res[downscaled(_first_index + int32_t(i)) - first] += _buckets[i];
+        }
+        _first_index = first;
+        _buckets = std::move(res);
+    }
+
+    void fit() {
+        while (_buckets.size() > _max_buckets) {
+            downscale(_schema - 1);
+        }
+    }
+
+    uint64_t& bucket(int32_t index) {
+        if (_buckets.empty()) {
+            _first_index = index;
+            _buckets.resize(1);
+        } else if (index < _first_index) {
+            _buckets.insert(_buckets.begin(), _first_index - index, 0);
+            _first_index = index;
+        } else if (index >= _first_index + int32_t(_buckets.size())) {
+            _buckets.resize(index - _first_index + 1);
+        }
+        return _buckets[index - _first_index];
+    }
+public:
+    static constexpr int32_t max_schema = 8;
+    static constexpr int32_t min_schema = -4;
+
+    /*!
+     * \param schema the initial resolution, from -4 to 8: each power of 2 is divided into 2^schema buckets
+     * \param zero_threshold the values no larger than it are counted in the zero bucket
+     * \param max_buckets the number of buckets above which the resolution is reduced
+     */
+    explicit sparse_histogram(int32_t schema = 3, double zero_threshold = 0, size_t max_buckets = 160)
+            : _schema(schema), _zero_threshold(zero_threshold), _max_buckets(max_buckets) {
+        if (schema < min_schema || schema > max_schema) {
+            throw std::invalid_argument("sparse_histogram schema must be between -4 and 8");
+        }
+        if (max_buckets == 0) {
+            throw std::invalid_argument("sparse_histogram needs at least one bucket");
+        }
+    }
+
+    /*!
+     * \brief Add an item to the histogram
+     */
+    void add(double v) {
+        ++_count;
+        _sum += v;
+        if (!(v > _zero_threshold)) {
+            ++_zero_count;
+            return;
+        }
+        ++bucket(bucket_index(v, _schema));
+        fit();
+    }
+
+    /*!
+     * \brief Merge the values of another histogram into this one
+     *
+     * The result has the coarser of the two schemas. Both histograms
+     * must have the same zero threshold.
+     */
+    sparse_histogram& merge(const sparse_histogram& b) {
+        if (_zero_threshold != b._zero_threshold) {
+            throw std::invalid_argument("Trying to merge sparse histograms with different zero thresholds");
+        }
+        if (&b == this) {
+            return merge(sparse_histogram(b));
+        }
+        downscale(b._schema);
+        auto shift = b._schema - _schema;
+        for (size_t i = 0; i < b._buckets.size(); ++i) {
+            if (b._buckets[i]) {
+                bucket(((b._first_index + int32_t(i) - 1) >> shift) + 1) += b._buckets[i];
+            }
+        }
+        _count += b._count;
+        _sum += b._sum;
+        _zero_count += b._zero_count;
+        fit();
+        return *this;
+    }
+
+    void clear() noexcept {
+        _count = 0;
+        _sum = 0;
+        _zero_count = 0;
+        _buckets.clear();
+    }
+
+    uint64_t count() const noexcept {
+        return _count;
+    }
+
+    double sum() const noexcept {
+        return _sum;
+    }
+
+    int32_t schema() const noexcept {
+        return _schema;
+    }
+
+    seastar::metrics::histogram to_metrics_histogram() const {
+        seastar::metrics::histogram res;
+        res.sample_count = _count;
+        res.sample_sum = _sum;
+        seastar::metrics::native_histogram_info info{_schema, _first_index};
+        info.zero_threshold = _zero_threshold;
+        info.zero_count = _zero_count;
+        for (size_t i = 0; i < _buckets.size(); ++i) {
+            if (_buckets[i]) {
+                info.sparse_buckets.push_back({_first_index + int32_t(i), _buckets[i]});
+            }
+        }
+        res.native_histogram = std::move(info);
+        return res;
+    }
+};
+
+}
@@ -63,6 +63,8 @@ class cpu_stall_detector {
     unsigned _shard_id;
     unsigned _thread_id;
     unsigned _report_at{};
+    // tasks_processed() when the last stall was reported
+    uint64_t _stalled_at = 0;
     sched_clock::time_point _minute_mark{};
     sched_clock::time_point _rearm_timer_at{};
     sched_clock::time_point _run_started_at{};
@@ -77,6 +79,7 @@ class cpu_stall_detector {
     virtual void maybe_report_kernel_trace(backtrace_buffer& buf) {}
 private:
     void maybe_report();
+    static void append_loop_phases(backtrace_buffer& buf) noexcept;
     virtual void arm_timer() = 0;
     void report_suppressions(sched_clock::time_point now);
     void reset_suppression_state(sched_clock::time_point now);
@@ -92,6 +95,8 @@ class cpu_stall_detector {
     void update_config(cpu_stall_detector_config cfg);
     cpu_stall_detector_config get_config() const;
     void on_signal();
+    // Whether a stall was reported in the task running now
+    bool in_stall() const noexcept;
     virtual void start_sleep() = 0;
     void end_sleep();
 };
@@ -0,0 +1,99 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#include <cstdint>
+#include <typeinfo>
+#include <vector>
+#endif
+#include <seastar/core/sstring.hh>
+
+namespace seastar {
+
+namespace internal {
+
+// One entry of the trace ring. Everything is recorded once it ended, with
+// its start, so that an entry stands on its own when older ones were
+// overwritten.
+struct task_trace_event {
+    enum class kind : uint8_t {
+        task,               // arg: scheduling group index
+        scheduling_group,   // a run of the tasks of a queue, arg: scheduling group index
+        io_read,            // from dispatch to completion, arg: length
+        io_write,           // ditto
+        smp_message,        // from sending to completion, arg: destination shard
+        smp_receive,        // instant, arg: source shard
+    };
+    kind what;
+    uint32_t arg;
+    // std::chrono::steady_clock, in nanoseconds
+    uint64_t start;
+    uint64_t end;
+    // Type of the task, and of the task it runs for (task::waiting_task())
+    const std::type_info* type;
+    const std::type_info* waiting;
+};
+
+// What a shard traced, with the names needed to make sense of it
+struct task_trace {
+    std::vector<task_trace_event> events;
+    // Indexed by scheduling group index
+    std::vector<sstring> scheduling_groups;
+    // Events overwritten since tracing was enabled
+    uint64_t dropped = 0;
+};
+
+// Records what the reactor of a shard executes into a fixed size ring,
+// without allocating: tasks with their type and scheduling group, runs of
+// task queues, I/O requests and cross-shard messages. The reactor only
+// calls into it while tracing is enabled, so that it costs a branch
+// otherwise.
+class task_tracer {
+    using clock = std::chrono::steady_clock;
+    std::vector<task_trace_event> _ring;
+    uint64_t _head = 0;
+
+    static uint64_t ns(clock::time_point tp) noexcept {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(tp.time_since_epoch()).count();
+    }
+public:
+    // The capacity is rounded up to a power of 2
+    explicit task_tracer(size_t max_events);
+
+    void record(task_trace_event::kind what, clock::time_point start, clock::time_point end, uint32_t arg,
+            const std::type_info* type = nullptr, const std::type_info* waiting = nullptr) noexcept {
+        _ring[_head++ & (_ring.size() - 1)] = task_trace_event{what, arg, ns(start), ns(end), type, waiting};
+    }
+
+    task_trace trace() const;
+};
+
+// Formats the traces of all shards, indexed by shard, in the Chrome trace
+// event JSON format, which Perfetto (https://ui.perfetto.dev) and
+// chrome://tracing open
+sstring format_chrome_trace(const std::vector<task_trace>& shards);
+
+}
+
+}
@@ -0,0 +1,104 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace seastar::internal {
+
+// A clock extrapolating steady_clock from the CPU's time stamp counter
+// (rdtsc on x86, the virtual counter on aarch64), which is much cheaper to
+// read. The reactor reads it many times per task for its accounting. Each
+// thread calibrates the rate of the counter against steady_clock with
+// tsc_resync(), and reads steady_clock until it did twice.
+struct tsc_calibration {
+    struct params {
+        uint64_t base_counter = 0;
+        int64_t base_ns = 0;
+        // Nanoseconds per tick, as a 32.32 fixed point number, 0 while uncalibrated
+        uint64_t mult = 0;
+    };
+    // tsc_resync() fills the parameters not in use and then switches to
+    // them, so that a signal handler interrupting it, which may read the
+    // clock, sees either the old or the new ones, not a mix
+    params slots[2];
+    std::atomic<unsigned> current = 0;
+
+    const params& get() const noexcept {
+        return slots[current.load(std::memory_order_acquire)];
+    }
+};
+
+#ifdef SEASTAR_BUILD_SHARED_LIBS
+tsc_calibration*
+current_tsc_calibration() noexcept;
+#else
+inline
+tsc_calibration*
+current_tsc_calibration() noexcept {
+    static thread_local tsc_calibration calibration;
+    return &calibration;
+}
+#endif
+
+inline uint64_t read_tsc() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t counter;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(counter));
+    return counter;
+#else
+    return 0;
+#endif
+}
+
+// Whether the CPU has a counter of a constant rate, shared by all CPUs,
+// which the kernel trusts as its clock source
+bool tsc_supported() noexcept;
+
+inline std::chrono::steady_clock::time_point tsc_now() noexcept {
+    auto& c = current_tsc_calibration()->get();
+    if (!c.mult) [[unlikely]] {
+        return std::chrono::steady_clock::now();
+    }
+    // A thread moved to a CPU whose counter lags a bit doesn't go back
+    auto ticks = int64_t(read_tsc() - c.base_counter);
+    auto ns = c.base_ns + int64_t((unsigned __int128)(ticks > 0 ? ticks : 0) * c.mult >> 32);
+    return std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(ns)));
+}
+
+// Samples the counter and steady_clock, and from the second call on has
+// tsc_now() extrapolate from them, at the rate measured since the first
+// one. Meant to be called periodically, to keep the clocks together. The
+// clock never goes back: when ahead of steady_clock, it slows down until
+// steady_clock catches up.
+void tsc_resync() noexcept;
+
+}
@@ -0,0 +1,195 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <compare>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
+#endif
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+template <typename T>
+class intrusive_ptr;
+
+/// Base class of the objects managed by \ref intrusive_ptr.
+///
+/// The reference count lives in the object, so an \ref intrusive_ptr is a
+/// single pointer and copying or destroying it touches one counter, with
+/// no control block, no type-erased deleter and no atomic operations (like
+/// \ref lw_shared_ptr, it must not be shared between shards). The object is
+/// destroyed with \c Deleter, known at compile time, when the last
+/// reference goes away. An intrusive_ptr can also be made from a plain
+/// \c this pointer, which is what \ref enable_lw_shared_from_this is for
+/// with \ref lw_shared_ptr.
+///
+/// Weak references cost nothing unless requested: a class which needs
+/// them also inherits from \ref weakly_referencable, whose \ref weak_ptr
+/// instances are cleared when the object is destroyed.
+///
+/// ```
+/// class packet_state : public intrusive_refcounted<packet_state>,
+///                      public weakly_referencable<packet_state> { ... };
+/// auto p = make_intrusive<packet_state>();
+/// weak_ptr<packet_state> w = p->weak_from_this();
+/// ```
+///
+/// \tparam T the class deriving from intrusive_refcounted
+/// \tparam Deleter called with a \c T* to destroy the object
+template <typename T, typename Deleter = std::default_delete<T>>
+class intrusive_refcounted {
+    mutable long _count = 0;
+
+    void add_ref() const noexcept {
+        ++_count;
+    }
+    void drop_ref() const noexcept {
+        if (--_count == 0) {
+            Deleter()(static_cast<T*>(const_cast<intrusive_refcounted*>(this)));
+        }
+    }
+
+    template <typename U>
+    friend class intrusive_ptr;
+protected:
+    intrusive_refcounted() noexcept = default;
+    // References are to an object, not to its value
+    intrusive_refcounted(const intrusive_refcounted&) noexcept {}
+    intrusive_refcounted& operator=(const intrusive_refcounted&) noexcept { return *this; }
+    ~intrusive_refcounted() = default;
+public:
+    long use_count() const noexcept { return _count; }
+
+    intrusive_ptr<T> shared_from_this() noexcept {
+        return intrusive_ptr<T>(static_cast<T*>(this));
+    }
+    intrusive_ptr<const T> shared_from_this() const noexcept {
+        return intrusive_ptr<const T>(static_cast<const T*>(this));
+    }
+};
+
+/// A reference-counted pointer to an object deriving from
+/// \ref intrusive_refcounted.
+///
+/// \see intrusive_refcounted
+template <typename T>
+class intrusive_ptr {
+    T* _p = nullptr;
+
+    template <typename U>
+    friend class intrusive_ptr;
+public:
+    using element_type = T;
+
+    intrusive_ptr() noexcept = default;
+    intrusive_ptr(std::nullptr_t) noexcept {}
+    /// Takes a new reference to \c p, which may already be referenced
+    explicit intrusive_ptr(T* p) noexcept : _p(p) {
+        if (_p) {
+            _p->add_ref();
+        }
+    }
+    intrusive_ptr(const intrusive_ptr& o) noexcept : intrusive_ptr(o._p) {}
+    intrusive_ptr(intrusive_ptr&& o) noexcept : _p(std::exchange(o._p, nullptr)) {}
+    template <typename U>
+    requires std::convertible_to<U*, T*>
+    intrusive_ptr(const intrusive_ptr<U>& o) noexcept : intrusive_ptr(o._p) {}
+    template <typename U>
+    requires std::convertible_to<U*, T*>
+    intrusive_ptr(intrusive_ptr<U>&& o) noexcept : _p(std::exchange(o._p, nullptr)) {}
+    ~intrusive_ptr() {
+        if (_p) {
+            _p->drop_ref();
+        }
+    }
+
+    intrusive_ptr& operator=(const intrusive_ptr& o) noexcept {
+        intrusive_ptr(o).swap(*this);
+        return *this;
+    }
+    intrusive_ptr& operator=(intrusive_ptr&& o) noexcept {
+        intrusive_ptr(std::move(o)).swap(*this);
+        return *this;
+    }
+    intrusive_ptr& operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    void reset() noexcept {
+        intrusive_ptr().swap(*this);
+    }
+    void swap(intrusive_ptr& o) noexcept {
+        std::swap(_p, o._p);
+    }
+
+    T* get() const noexcept { return _p; }
+    T& operator*() const noexcept { return *_p; }
+    T* operator->() const noexcept { return _p; }
+    explicit operator bool() const noexcept { return _p; }
+    long use_count() const noexcept { return _p ? _p->use_count() : 0; }
+
+    template <typename U>
+    bool operator==(const intrusive_ptr<U>& o) const noexcept { return _p == o._p; }
+    bool operator==(std::nullptr_t) const noexcept { return !_p; }
+    template <typename U>
+    auto operator<=>(const intrusive_ptr<U>& o) const noexcept { return std::compare_three_way()(_p, o._p); }
+};
+
+/// Allocates a \c T and returns the only reference to it
+template <typename T, typename... A>
+intrusive_ptr<T> make_intrusive(A&&... a) {
+    return intrusive_ptr<T>(new T(std::forward<A>(a)...));
+}
+
+template <typename T, typename U>
+intrusive_ptr<T> static_pointer_cast(const intrusive_ptr<U>& p) noexcept {
+    return intrusive_ptr<T>(static_cast<T*>(p.get()));
+}
+
+template <typename T, typename U>
+intrusive_ptr<T> const_pointer_cast(const intrusive_ptr<U>& p) noexcept {
+    return intrusive_ptr<T>(const_cast<T*>(p.get()));
+}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+namespace std {
+
+SEASTAR_MODULE_EXPORT
+template <typename T>
+struct hash<seastar::intrusive_ptr<T>> : private hash<T*> {
+    size_t operator()(const seastar::intrusive_ptr<T>& p) const {
+        return hash<T*>::operator()(p.get());
+    }
+};
+
+}
@@ -25,6 +25,7 @@
 #include <seastar/core/io_priority_class.hh>
 #include <seastar/util/modules.hh>
 #ifndef SEASTAR_MODULE
+#include <chrono>
 #include <boost/container/small_vector.hpp>
 #endif
 
@@ -40,6 +41,17 @@ namespace seastar {
 ///
 /// If no intent is provided, then the request is processed till its
 /// completion be it success or error
+///
+/// Requests already handed over to the kernel when the intent is cancelled
+/// are aborted there when the kernel supports it (io_uring does, linux-aio
+/// only does for a few drivers), resolving into the \ref cancelled_error
+/// "cancelled_error" as soon as the kernel gives them up. The ones it
+/// doesn't give up complete as usual.
+///
+/// An intent may also carry a deadline, by which its requests should be
+/// dispatched. Requests with a deadline feed the deadline metrics of their
+/// class, and overtake the other requests of the class as the deadline
+/// nears when the I/O queue does deadline scheduling.
 SEASTAR_MODULE_EXPORT
 class io_intent {
     struct intents_for_queue {
@@ -72,6 +84,7 @@ class io_intent {
 
     boost::container::small_vector<intents_for_queue, 1> _intents;
     references _refs;
+    std::chrono::steady_clock::time_point _deadline = std::chrono::steady_clock::time_point::max();
     friend internal::intent_reference::intent_reference(io_intent*) noexcept;
 
 public:
@@ -81,7 +94,7 @@ class io_intent {
     io_intent(const io_intent&) = delete;
     io_intent& operator=(const io_intent&) = delete;
     io_intent& operator=(io_intent&&) = delete;
-    io_intent(io_intent&& o) noexcept : _intents(std::move(o._intents)), _refs(std::move(o._refs)) {
+    io_intent(io_intent&& o) noexcept : _intents(std::move(o._intents)), _refs(std::move(o._refs)), _deadline(o._deadline) {
         for (auto&& r : _refs.list) {
             r._intent = this;
         }
@@ -95,6 +108,14 @@ class io_intent {
         _intents.clear();
     }
 
+    /// Sets the time by which the requests issued with this intent from now
+    /// on should be dispatched
+    void set_deadline(std::chrono::steady_clock::time_point deadline) noexcept {
+        _deadline = deadline;
+    }
+    std::chrono::steady_clock::time_point deadline() const noexcept { return _deadline; }
+    bool has_deadline() const noexcept { return _deadline != std::chrono::steady_clock::time_point::max(); }
+
     /// @private
     internal::cancellable_queue& find_or_create_cancellable_queue(unsigned qid, io_priority_class_id cid) {
         for (auto&& i : _intents) {
@@ -23,9 +23,13 @@
 
 #ifndef SEASTAR_MODULE
 #include <boost/container/static_vector.hpp>
+#include <atomic>
 #include <chrono>
+#include <map>
 #include <memory>
+#include <utility>
 #include <vector>
+#include <sys/types.h>
 #include <sys/uio.h>
 #endif
 #include <seastar/core/sstring.hh>
@@ -36,6 +40,7 @@
 #include <seastar/core/lowres_clock.hh>
 #include <seastar/util/spinlock.hh>
 #include <seastar/util/modules.hh>
+#include <seastar/util/noncopyable_function.hh>
 
 struct io_queue_for_tests;
 
@@ -64,6 +69,7 @@ using io_group_ptr = std::shared_ptr<io_group>;
 using iovec_keeper = std::vector<::iovec>;
 
 namespace internal {
+class io_chain;
 struct maybe_priority_class_ref;
 class priority_class {
     unsigned _id;
@@ -80,6 +86,8 @@ class io_queue {
 
 private:
     std::vector<std::unique_ptr<priority_class_data>> _priority_classes;
+    // Indices of the scheduling supergroups registered in the streams
+    std::vector<unsigned> _supergroups;
     io_group_ptr _group;
     const unsigned _id;
     boost::container::static_vector<fair_queue, 2> _streams;
@@ -89,8 +97,10 @@ class io_queue {
     friend const fair_group& internal::get_fair_group(const io_queue& ioq, unsigned stream);
 
     priority_class_data& find_or_create_class(internal::priority_class pc);
+    fair_queue::class_id find_or_create_supergroup(unsigned index);
     future<size_t> queue_request(internal::priority_class pc, internal::io_direction_and_length dnl, internal::io_request req, io_intent* intent, iovec_keeper iovs) noexcept;
-    future<size_t> queue_one_request(internal::priority_class pc, internal::io_direction_and_length dnl, internal::io_request req, io_intent* intent, iovec_keeper iovs) noexcept;
+    future<size_t> queue_one_request(internal::priority_class pc, internal::io_direction_and_length dnl, internal::io_request req, io_intent* intent, iovec_keeper iovs,
+            std::unique_ptr<internal::io_chain> chain = nullptr) noexcept;
 
     // The fields below are going away, they are just here so we can implement deprecated
     // functions that used to be provided by the fair_queue and are going away (from both
@@ -106,13 +116,46 @@ class io_queue {
     uint64_t _prev_completed = 0;
     double _flow_ratio = 1.0;
 
+    // Online calibration samples, collected between averaging ticks
+    std::chrono::duration<double> _calibration_delay = {};
+    uint64_t _calibration_completions = 0;
+    bool _calibration_backlogged = false;
+
+    unsigned _latency_trace_counter = 0;
+
+    // Reads dispatched by the current poll, kept to merge the adjacent ones
+    // when config::max_merged_read_length is set
+    struct dispatched_request {
+        io_desc_read_write* desc;
+        internal::io_request req;
+    };
+    std::vector<dispatched_request> _dispatched_reads;
+    uint64_t _merged_reads = 0;
+    size_t max_merged_read_length() const noexcept;
+    void submit_dispatched_reads() noexcept;
+
+    // Discards dispatched by the current poll, the adjacent ones of a file
+    // are merged into one call
+    std::vector<dispatched_request> _dispatched_discards;
+    uint64_t _merged_discards = 0;
+    void submit_dispatched_discards() noexcept;
+
+    // Appends to the zones of zoned block devices, by device and zone start
+    class zone_writer;
+    std::map<std::pair<dev_t, uint64_t>, std::unique_ptr<zone_writer>> _zones;
+
     timer<lowres_clock> _averaging_decay_timer;
+    // Runs control_latency(), armed once a class has a latency target
+    timer<lowres_clock> _latency_controller;
 
     const std::chrono::milliseconds _stall_threshold_min;
     std::chrono::milliseconds _stall_threshold;
 
     void update_flow_ratio() noexcept;
     void lower_stall_threshold() noexcept;
+    void report_calibration() noexcept;
+    void control_latency() noexcept;
+    void apply_shares(priority_class_data& pc) noexcept;
 
     metrics::metric_groups _metric_groups;
 public:
@@ -146,6 +189,33 @@ class io_queue {
         double flow_ratio_ema_factor = 0.95;
         double flow_ratio_backpressure_threshold = 1.1;
         std::chrono::milliseconds stall_threshold = std::chrono::milliseconds(100);
+        // Bounds for the online calibration of the rate, the calibration is
+        // off when both are 1.0 (see io_group::calibrate())
+        double calibration_min_factor = 1.0;
+        double calibration_max_factor = 1.0;
+        double calibration_decrease_step = 0.1;
+        double calibration_increase_step = 0.02;
+        // Trace the latency breakdown of every Nth request, 0 turns tracing off
+        unsigned latency_trace_period = 0;
+        // Adjacent reads of a file dispatched by the same poll are merged
+        // into requests of up to this length, 0 turns merging off
+        size_t max_merged_read_length = 0;
+        // Discards are queued in chunks of up to this length, each costing
+        // as much as a write of discard_cost_factor of its length
+        size_t max_discard_length = 32 << 20;
+        double discard_cost_factor = 0.1;
+        // The latency controller lowers the shares of the classes which have
+        // minimum shares by this factor every period a latency target was
+        // missed in, and raises them by this factor (and one share) back to
+        // their configured shares every period the targets were met in
+        std::chrono::milliseconds latency_control_period = std::chrono::milliseconds(100);
+        double latency_control_decrease_factor = 0.7;
+        double latency_control_increase_factor = 1.1;
+        // Requests whose io_intent has a deadline are dispatched ahead of
+        // the others of their class once it is less than deadline_window
+        // away (see fair_queue::config::deadline_scheduling)
+        bool deadline_scheduling = false;
+        std::chrono::microseconds deadline_window = std::chrono::milliseconds(5);
     };
 
     io_queue(io_group_ptr group, internal::io_sink& sink);
@@ -157,11 +227,40 @@ class io_queue {
             size_t len, internal::io_request req, io_intent* intent, iovec_keeper iovs = {}) noexcept;
     future<size_t> submit_io_write(internal::priority_class priority_class,
             size_t len, internal::io_request req, io_intent* intent, iovec_keeper iovs = {}) noexcept;
+    future<> submit_io_discard(internal::priority_class priority_class, internal::io_request req) noexcept;
+    // Queues writes and fdatasyncs as a single request, in which they run in
+    // order, each once the one before it succeeded, and the result is the
+    // length written up to the first short write. Writes longer than a
+    // request can be are split, and a chain costing more than the fair queue
+    // grants at once is queued as several, each once the one before it
+    // completed.
+    static constexpr size_t max_chain_length = 16;
+    future<size_t> submit_io_chain(internal::priority_class priority_class, std::vector<internal::io_request> reqs, io_intent* intent) noexcept;
+    // Runs write at the write pointer of a zone of a zoned block device, once
+    // the appends made to the zone before it completed, whatever class their
+    // requests are queued in, and moves the pointer past the data. Resolves
+    // with the position written at, fails with ENOSPC if the data doesn't fit
+    // the rest of the zone. The write pointer and the end of the zone are
+    // loaded the first time, and again after an append failed or the zone
+    // was forgotten.
+    using zone_loader = noncopyable_function<future<std::pair<uint64_t, uint64_t>> ()>;
+    future<uint64_t> append_to_zone(dev_t dev, uint64_t zone_start, size_t len, zone_loader load,
+            noncopyable_function<future<> (uint64_t pos)> write) noexcept;
+    // Makes the next appends to the zones starting in [start, end) load their
+    // write pointers, after they were moved by other means than appends
+    void forget_zones(dev_t dev, uint64_t start, uint64_t end) noexcept;
+    // Accounts I/O done without requests, such as the loads and stores to
+    // the files mapped from persistent memory, in the statistics of the
+    // class and of the reactor. The I/O isn't scheduled.
+    void account_direct(internal::priority_class priority_class, internal::io_direction_and_length dnl) noexcept;
 
     void submit_request(io_desc_read_write* desc, internal::io_request req) noexcept;
     void cancel_request(queued_io_request& req) noexcept;
+    void cancel_dispatched_request(io_desc_read_write& desc) noexcept;
     void complete_cancelled_request(queued_io_request& req) noexcept;
     void complete_request(io_desc_read_write& desc, std::chrono::duration<double> delay) noexcept;
+    // Whether the next request should have its latency breakdown traced
+    bool sample_latency() noexcept;
 
     [[deprecated("I/O queue users should not track individual requests, but resources (weight, size) passing through the queue")]]
     size_t queued_requests() const {
@@ -178,13 +277,28 @@ class io_queue {
     void poll_io_queue();
 
     clock_type::time_point next_pending_aio() const noexcept;
+    // Ratio of dispatched to completed requests, above 1 when the
+    // completions are reaped late
+    double flow_ratio() const noexcept { return _flow_ratio; }
     fair_queue_entry::capacity_t request_capacity(internal::io_direction_and_length dnl) const noexcept;
 
     sstring mountpoint() const;
     unsigned id() const noexcept { return _id; }
 
     void update_shares_for_class(internal::priority_class pc, size_t new_shares);
+    void update_shares_for_supergroup(unsigned index, size_t new_shares);
+    // See scheduling_group::set_io_latency_target(), a zero latency removes
+    // the target
+    void update_latency_target_for_class(internal::priority_class pc, std::chrono::microseconds latency, double percentile);
+    // See scheduling_group::set_io_min_shares(), 0 keeps the shares fixed
+    void update_min_shares_for_class(internal::priority_class pc, uint32_t min_shares);
+    // The shares the class is scheduled with, below the configured ones
+    // while the latency controller lowers them
+    uint32_t dynamic_shares_for_class(internal::priority_class pc);
     future<> update_bandwidth_for_class(internal::priority_class pc, uint64_t new_bandwidth);
+    // Caps the bandwidth of the class summed over all queues of all devices,
+    // on top of the per-device limit. The maximum value lifts the cap
+    static void update_bandwidth_budget(internal::priority_class pc, uint64_t bandwidth);
     void rename_priority_class(internal::priority_class pc, sstring new_name);
     void throttle_priority_class(const priority_class_data& pc) noexcept;
     void unthrottle_priority_class(const priority_class_data& pc) noexcept;
@@ -210,6 +324,12 @@ class io_group {
 
     std::chrono::duration<double> io_latency_goal() const noexcept;
 
+    // The factor the configured rate is currently scaled by
+    double rate_factor() const noexcept { return _rate_factor.load(std::memory_order_relaxed); }
+    // Feeds the average completion latency observed by one of the queues
+    // into the online calibration of the rate
+    void calibrate(std::chrono::duration<double> latency, bool backlogged) noexcept;
+
 private:
     friend class io_queue;
     friend struct ::io_queue_for_tests;
@@ -221,6 +341,10 @@ class io_group {
     std::vector<std::unique_ptr<priority_class_data>> _priority_classes;
     util::spinlock _lock;
     const shard_id _allocated_on;
+    const unsigned _nr_queues;
+    // The latency goal as configured, it's the calibration target
+    std::chrono::duration<double> _calibration_target;
+    std::atomic<double> _rate_factor = 1.0;
 
     static fair_group::config make_fair_group_config(const io_queue::config& qcfg) noexcept;
     priority_class_data& find_or_create_class(internal::priority_class pc);
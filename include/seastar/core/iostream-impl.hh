@@ -152,6 +152,25 @@ future<> output_stream<CharType>::write(temporary_buffer<CharType> p) noexcept {
   }
 }
 
+template<typename CharType>
+future<> output_stream<CharType>::write_file(file& f, uint64_t pos, uint64_t len) noexcept {
+    static_assert(std::is_same_v<CharType, char>, "file works on char");
+    // The buffered data has to reach the sink before the file does
+    if (_end) {
+        _buf.trim(_end);
+        _end = 0;
+        co_await put(std::move(_buf));
+    } else if (_zc_bufs) {
+        co_await zero_copy_put(std::move(_zc_bufs));
+    } else {
+        _flush = false;
+        if (_flushing) {
+            co_await _in_batch.value().get_future();
+        }
+    }
+    co_await _fd.put_file(f, pos, len);
+}
+
 template <typename CharType>
 future<temporary_buffer<CharType>>
 input_stream<CharType>::read_exactly_part(size_t n) noexcept {
@@ -208,6 +227,67 @@ input_stream<CharType>::read_exactly(size_t n) noexcept {
     }
 }
 
+template <typename CharType>
+future<std::vector<temporary_buffer<CharType>>>
+input_stream<CharType>::read_exactly_fragmented(size_t n) noexcept {
+    std::vector<tmp_buf> ret;
+    while (n) {
+        if (_buf.empty()) {
+            _buf = co_await _fd.get();
+            if (_buf.empty()) {
+                _eof = true;
+                break;
+            }
+        }
+        auto now = std::min(n, _buf.size());
+        ret.push_back(_buf.share(0, now));
+        _buf.trim_front(now);
+        n -= now;
+    }
+    co_return ret;
+}
+
+template <typename CharType>
+template <typename Consumer>
+requires FragmentedInputStreamConsumer<Consumer, CharType>
+future<>
+input_stream<CharType>::consume_fragmented(Consumer consumer) noexcept(std::is_nothrow_move_constructible_v<Consumer>) {
+    input_fragments<CharType> data;
+    data.append(std::move(_buf));
+    data._eof = _eof;
+    while (true) {
+        if (data.empty() && !data._eof) {
+            auto buf = co_await _fd.get();
+            data._eof = _eof = buf.empty();
+            data.append(std::move(buf));
+            continue;
+        }
+        fragmented_consumption_result result;
+        try {
+            result = co_await consumer(std::as_const(data));
+        } catch (...) {
+            _buf = data.linearize(0, data.size());
+            throw;
+        }
+        data.consume(result.consumed);
+        if (result.stop) {
+            break;
+        }
+        // What is left may hold more records, which must not wait for more
+        // data to arrive, or be lost at the end of the stream
+        if (result.consumed && !data.empty()) {
+            continue;
+        }
+        if (data._eof) {
+            break;
+        }
+        auto buf = co_await _fd.get();
+        data._eof = _eof = buf.empty();
+        data.append(std::move(buf));
+    }
+    _buf = data.linearize(0, data.size());
+}
+
 template <typename CharType>
 template <typename Consumer>
 requires InputStreamConsumer<Consumer, CharType> || ObsoleteInputStreamConsumer<Consumer, CharType>
@@ -322,6 +402,12 @@ input_stream<CharType>::detach() && {
     return std::move(_fd);
 }
 
+template <typename CharType>
+std::pair<data_source, temporary_buffer<CharType>>
+input_stream<CharType>::detach_buffered() && noexcept {
+    return {std::move(_fd), std::move(_buf)};
+}
+
 // Writes @buf in chunks of _size length. The last chunk is buffered if smaller.
 template <typename CharType>
 future<>
@@ -412,6 +498,8 @@ output_stream<CharType>::slow_write(const char_type* buf, size_t n) noexcept {
 
 namespace internal {
 void add_to_flush_poller(output_stream<char>& x) noexcept;
+void account_batch_flush(size_t bytes) noexcept;
+void account_merged_flush() noexcept;
 }
 
 template <typename CharType>
@@ -441,6 +529,9 @@ output_stream<CharType>::flush() noexcept {
             // flush is a good time to deliver outstanding errors
             return make_exception_future<>(std::move(_ex));
         } else {
+            if (_flush) {
+                internal::account_merged_flush();
+            }
             _flush = true;
             if (!_in_batch) {
                 internal::add_to_flush_poller(*this);
@@ -479,6 +570,7 @@ output_stream<CharType>::poll_flush() noexcept {
 
     _flush = false;
     _flushing = true; // make whoever wants to write into the fd to wait for flush to complete
+    internal::account_batch_flush(_end + (_zc_bufs ? _zc_bufs.len() : 0));
 
     // FIXME: future is discarded
     (void)do_flush().then_wrapped([this] (future<> f) {
@@ -488,8 +580,15 @@ output_stream<CharType>::poll_flush() noexcept {
             _ex = std::current_exception();
             _fd.on_batch_flush_error();
         }
-        // if flush() was called while flushing flush once more
-        poll_flush();
+        if (_flush) {
+            // flush() was called while flushing. Rather than flushing again
+            // right away, let the writes of other fibers pile up until the
+            // next poll, so that they go out together.
+            _flushing = false;
+            internal::add_to_flush_poller(*this);
+        } else {
+            poll_flush();
+        }
     });
 }
 
@@ -37,6 +37,7 @@
 
 #include <seastar/core/future.hh>
 #include <seastar/core/coroutine.hh>
+#include <seastar/core/loop.hh>
 #include <seastar/core/temporary_buffer.hh>
 #include <seastar/core/scattered_message.hh>
 #include <seastar/util/assert.hh>
@@ -47,6 +48,7 @@
 #include <algorithm>
 #include <memory>
 #include <optional>
+#include <utility>
 #include <variant>
 #include <vector>
 #endif
@@ -58,6 +60,7 @@ namespace seastar {
 SEASTAR_MODULE_EXPORT_BEGIN
 
 namespace net { class packet; }
+class file;
 namespace testing {
 class input_stream_test;
 class output_stream_test;
@@ -124,6 +127,11 @@ class data_sink_impl {
     virtual future<> put(temporary_buffer<char> buf) {
         return put(net::packet(net::fragment{buf.get_write(), buf.size()}, buf.release()));
     }
+    // Writes the \c len bytes of \c f starting at \c pos, which the caller
+    // keeps alive until the returned future resolves. Sinks that can have
+    // the kernel move the data (e.g. with sendfile(2)) override this; by
+    // default the range is read into buffers and put().
+    virtual future<> put_file(file& f, uint64_t pos, uint64_t len);
     virtual future<> flush() {
         return make_ready_future<>();
     }
@@ -196,6 +204,13 @@ class data_sink {
         return current_exception_as_future();
       }
     }
+    future<> put_file(file& f, uint64_t pos, uint64_t len) noexcept {
+      try {
+        return _dsi->put_file(f, pos, len);
+      } catch (...) {
+        return current_exception_as_future();
+      }
+    }
     future<> flush() noexcept {
       try {
         return _dsi->flush();
@@ -292,6 +307,138 @@ concept ObsoleteInputStreamConsumer = requires (Consumer c) {
     { c(temporary_buffer<CharType>{}) } -> std::same_as<future<std::optional<temporary_buffer<CharType>>>>;
 };
 
+/// The data an \ref input_stream has received and not consumed yet, as the
+/// buffers it arrived in.
+///
+/// Handed to the consumer of \ref input_stream::consume_fragmented(), which
+/// can parse records that span buffers without first copying them into one,
+/// and keep zero-copy references to parts of them with share().
+template <typename CharType>
+class input_fragments {
+    std::vector<temporary_buffer<CharType>> _bufs;
+    size_t _size = 0;
+    bool _eof = false;
+
+    template <typename Func>
+    void for_each_range(size_t pos, size_t len, Func&& func) const {
+        for (auto& b : _bufs) {
+            if (!len) {
+                break;
+            }
+            if (pos >= b.size()) {
+                pos -= b.size();
+                continue;
+            }
+            auto now = std::min(len, b.size() - pos);
+            func(b, pos, now);
+            pos = 0;
+            len -= now;
+        }
+    }
+public:
+    /// Total size of the data, in bytes.
+    size_t size() const noexcept { return _size; }
+    bool empty() const noexcept { return _size == 0; }
+    /// True when the stream has ended, so no more data will follow.
+    bool eof() const noexcept { return _eof; }
+    /// The buffers holding the data, in order. None of them is empty.
+    const std::vector<temporary_buffer<CharType>>& fragments() const noexcept { return _bufs; }
+
+    /// Returns the byte at \c pos. Finding the buffer holding it is linear
+    /// in the number of buffers.
+    CharType operator[](size_t pos) const noexcept {
+        for (auto& b : _bufs) {
+            if (pos < b.size()) {
+                return b[pos];
+            }
+            pos -= b.size();
+        }
+        SEASTAR_ASSERT(false && "input_fragments index out of range");
+        return CharType();
+    }
+
+    /// Returns the position of the first \c c at or after \c pos, or
+    /// \c size() if there is none.
+    size_t find(CharType c, size_t pos = 0) const noexcept {
+        size_t base = 0;
+        for (auto& b : _bufs) {
+            if (pos < base + b.size()) {
+                auto from = b.begin() + (pos > base ? pos - base : 0);
+                if (auto it = std::find(from, b.end(), c); it != b.end()) {
+                    return base + (it - b.begin());
+                }
+            }
+            base += b.size();
+        }
+        return _size;
+    }
+
+    /// Returns \c len bytes at \c pos as buffers sharing the received ones,
+    /// without copying.
+    std::vector<temporary_buffer<CharType>> share(size_t pos, size_t len) const {
+        SEASTAR_ASSERT(pos + len <= _size);
+        std::vector<temporary_buffer<CharType>> ret;
+        for_each_range(pos, len, [&ret] (const temporary_buffer<CharType>& b, size_t pos, size_t len) {
+            ret.push_back(const_cast<temporary_buffer<CharType>&>(b).share(pos, len));
+        });
+        return ret;
+    }
+
+    /// Returns \c len bytes at \c pos in one buffer. It shares the received
+    /// one if they are all in it, and only copies them otherwise.
+    temporary_buffer<CharType> linearize(size_t pos, size_t len) const {
+        SEASTAR_ASSERT(pos + len <= _size);
+        auto parts = share(pos, len);
+        if (parts.size() == 1) {
+            return std::move(parts.front());
+        }
+        temporary_buffer<CharType> ret(len);
+        auto out = ret.get_write();
+        for (auto& p : parts) {
+            out = std::copy(p.begin(), p.end(), out);
+        }
+        return ret;
+    }
+
+private:
+    void append(temporary_buffer<CharType> buf) {
+        if (!buf.empty()) {
+            _size += buf.size();
+            _bufs.push_back(std::move(buf));
+        }
+    }
+    void consume(size_t n) noexcept {
+        SEASTAR_ASSERT(n <= _size);
+        _size -= n;
+        auto it = _bufs.begin();
+        while (n && n >= it->size()) {
+            n -= it->size();
+            ++it;
+        }
+        if (n) {
+            it->trim_front(n);
+        }
+        _bufs.erase(_bufs.begin(), it);
+    }
+    template <typename> friend class input_stream;
+};
+
+/// What the consumer of \ref input_stream::consume_fragmented() did with the
+/// data it was given.
+struct fragmented_consumption_result {
+    /// How many bytes, from the front of the data, the consumer is done with.
+    /// They are dropped before it is called again.
+    size_t consumed = 0;
+    /// stop_iteration::no to be called again once more data arrived,
+    /// stop_iteration::yes when done.
+    stop_iteration stop = stop_iteration::no;
+};
+
+template <typename Consumer, typename CharType>
+concept FragmentedInputStreamConsumer = requires (Consumer c, const input_fragments<CharType>& data) {
+    { c(data) } -> std::same_as<future<fragmented_consumption_result>>;
+};
+
 /// Buffers data from a data_source and provides a stream interface to the user.
 ///
 /// \note All methods must be called sequentially.  That is, no method may be
@@ -328,12 +475,30 @@ class input_stream final {
     /// \throws if an I/O error occurs during the read. As explained above,
     /// prematurely reaching the end of stream is *not* an I/O error.
     future<temporary_buffer<CharType>> read_exactly(size_t n) noexcept;
+    /// Reads n bytes from the stream, or fewer if reached the end of stream,
+    /// like read_exactly(), but as the buffers they were received in rather
+    /// than copied into one.
+    future<std::vector<temporary_buffer<CharType>>> read_exactly_fragmented(size_t n) noexcept;
     template <typename Consumer>
     requires InputStreamConsumer<Consumer, CharType> || ObsoleteInputStreamConsumer<Consumer, CharType>
     future<> consume(Consumer&& c) noexcept(std::is_nothrow_move_constructible_v<Consumer>);
     template <typename Consumer>
     requires InputStreamConsumer<Consumer, CharType> || ObsoleteInputStreamConsumer<Consumer, CharType>
     future<> consume(Consumer& c) noexcept(std::is_nothrow_move_constructible_v<Consumer>);
+    /// Feeds the stream to the consumer, which is given all the data received
+    /// and not consumed so far, possibly in several buffers.
+    ///
+    /// The consumer reports how much of the front of the data it is done with,
+    /// and whether it wants to be called again. It is called again on the
+    /// data left as long as it consumes some, and otherwise once more data
+    /// arrives, which lets it wait for the rest of a record without copying
+    /// its beginning. At the end of the stream, it is called with eof() set
+    /// until it consumes nothing more.
+    /// When it stops, the data it did not consume is left in the stream; if
+    /// that spans several buffers it is copied into one.
+    template <typename Consumer>
+    requires FragmentedInputStreamConsumer<Consumer, CharType>
+    future<> consume_fragmented(Consumer consumer) noexcept(std::is_nothrow_move_constructible_v<Consumer>);
     /// Returns true if the end-of-file flag is set on the stream.
     /// Note that the eof flag is only set after a previous attempt to read
     /// from the stream noticed the end of the stream. In other words, it is
@@ -373,6 +538,16 @@ class input_stream final {
     ///
     /// \returns the data_source
     data_source detach() &&;
+
+    /// Detaches the underlying \c data_source from the \c input_stream,
+    /// along with the data the stream read from it and was not consumed
+    /// yet, which comes before what the source returns next.
+    ///
+    /// After calling \c detach_buffered() the \c input_stream is in an
+    /// unusable, moved-from state.
+    ///
+    /// \returns the data_source and the buffered data
+    std::pair<data_source, temporary_buffer<CharType>> detach_buffered() && noexcept;
 private:
     future<temporary_buffer<CharType>> read_exactly_part(size_t n) noexcept;
     friend class testing::input_stream_test;
@@ -381,7 +556,14 @@ class input_stream final {
 struct output_stream_options {
     bool trim_to_size = false; ///< Make sure that buffers put into sink haven't
                                ///< grown larger than the configured size
-    bool batch_flushes = false; ///< Try to merge flushes with each other
+    bool batch_flushes = false; ///< Try to merge flushes with each other.
+                                ///< flush() returns at once and the data is
+                                ///< sent from the reactor's flush poller, at
+                                ///< most one poll period (bounded by the task
+                                ///< quota, see --task-quota-ms) later. A flush
+                                ///< requested while a batched flush is in
+                                ///< flight waits for it to complete and then
+                                ///< for the next poll.
 };
 
 /// Facilitates data buffering before it's handed over to data_sink.
@@ -475,6 +657,15 @@ class output_stream final {
     future<> write(scattered_message<char_type> msg) noexcept;
     /// Appends the temporary buffer as zero-copy buffer
     future<> write(temporary_buffer<char_type>) noexcept;
+    /// Writes \c len bytes of the file, starting at \c pos
+    ///
+    /// Anything buffered in the stream is written out first. The file
+    /// range then goes straight to the underlying data sink, which on the
+    /// posix network stack lets the kernel send it without copying it
+    /// through user space (see \c sendfile(2)). Fails if the file ends
+    /// before the range does. The file must be kept alive until the
+    /// returned future resolves.
+    future<> write_file(file& f, uint64_t pos, uint64_t len) noexcept;
 
     future<> flush() noexcept;
 
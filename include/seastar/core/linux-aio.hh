@@ -97,6 +97,7 @@ linux_abi::iocb make_poll_iocb(int fd, uint32_t events);
 
 void set_user_data(linux_abi::iocb& iocb, void* data);
 void set_nowait(linux_abi::iocb& iocb, bool nowait);
+void set_dsync(linux_abi::iocb& iocb, bool dsync);
 
 void set_eventfd_notification(linux_abi::iocb& iocb, int eventfd);
 
@@ -229,6 +230,18 @@ set_nowait(linux_abi::iocb& iocb, bool nowait) {
 #endif
 }
 
+inline
+void
+set_dsync(linux_abi::iocb& iocb, bool dsync) {
+#ifdef RWF_DSYNC
+    if (dsync) {
+        iocb.aio_rw_flags |= RWF_DSYNC;
+    } else {
+        iocb.aio_rw_flags &= ~RWF_DSYNC;
+    }
+#endif
+}
+
 }
 
 
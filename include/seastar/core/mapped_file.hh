@@ -0,0 +1,101 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#include <cstdint>
+#endif
+
+namespace seastar {
+
+class file;
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup fileio-module
+/// @{
+
+/// A read-only memory mapping of a range of a file, see \ref file::map()
+///
+/// Touching a page of the mapping that is not resident stalls the reactor
+/// for a disk read. The mapping keeps track of the pages known to be
+/// resident, so that lookups can access those directly, and have read()
+/// fault the others in on the syscall thread. The tracking is a hint, a
+/// page the kernel evicted since is read from the disk when touched.
+class mapped_file {
+    struct mapping;
+    lw_shared_ptr<mapping> _m;
+
+    explicit mapped_file(lw_shared_ptr<mapping> m) noexcept;
+    static future<mapped_file> map(int fd, uint64_t offset, size_t length) noexcept;
+    friend class file;
+public:
+    mapped_file(mapped_file&&) noexcept;
+    mapped_file& operator=(mapped_file&&) noexcept;
+    ~mapped_file();
+
+    /// The mapped range of the file. It stays valid as long as the mapping
+    /// or any of the buffers returned by read() is alive.
+    const char* data() const noexcept;
+    /// Length of the mapped range, up to the end of the file when it was
+    /// mapped. Accessing data past it, or past the end of a file which
+    /// was truncated since, raises SIGBUS.
+    size_t size() const noexcept;
+
+    /// Whether all pages of the range are known to be resident, as of the
+    /// last refresh_residency() or read() of them
+    ///
+    /// \param pos offset of the range, from the start of the mapping
+    /// \param len length of the range
+    bool resident(uint64_t pos, size_t len) const noexcept;
+
+    /// Finds out which pages of the mapping are resident with mincore(2),
+    /// on the syscall thread
+    future<> refresh_residency() noexcept;
+
+    /// Asks the kernel to read the range ahead with madvise(MADV_WILLNEED),
+    /// on the syscall thread
+    ///
+    /// \param pos offset of the range, from the start of the mapping
+    /// \param len length of the range
+    future<> prefetch(uint64_t pos, size_t len) noexcept;
+
+    /// Returns the range of the mapping without copying it
+    ///
+    /// The buffer is ready at once when the range is known to be resident,
+    /// otherwise its pages are faulted in on the syscall thread first.
+    ///
+    /// \param pos offset of the range, from the start of the mapping
+    /// \param len length of the range
+    future<temporary_buffer<char>> read(uint64_t pos, size_t len) noexcept;
+};
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
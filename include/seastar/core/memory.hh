@@ -23,6 +23,7 @@
 
 #include <seastar/core/resource.hh>
 #include <seastar/core/bitops.hh>
+#include <seastar/core/metrics_types.hh>
 #include <seastar/util/backtrace.hh>
 #include <seastar/util/modules.hh>
 #include <seastar/util/sampler.hh>
@@ -30,6 +31,8 @@
 #include <new>
 #include <cstdint>
 #include <functional>
+#include <limits>
+#include <memory_resource>
 #include <optional>
 #include <string>
 #include <vector>
@@ -37,6 +40,8 @@
 
 namespace seastar {
 
+class scheduling_group;
+
 /// \defgroup memory-module Memory management
 ///
 /// Functions and classes for managing memory.
@@ -161,9 +166,13 @@ numa_layout merge(numa_layout one, numa_layout two);
 
 }
 
+// If hugetlb_page_size is set (2M or 1G), memory is mapped with explicit
+// MAP_HUGETLB pages of up to that size, falling back to smaller pages when the
+// kernel's hugepage pool runs out. Ignored if hugetlbfs_path is set.
 internal::numa_layout configure(std::vector<resource::memory> m, bool mbind,
         bool transparent_hugepages,
-        std::optional<std::string> hugetlbfs_path = {});
+        std::optional<std::string> hugetlbfs_path = {},
+        size_t hugetlb_page_size = 0);
 
 void configure_minimal();
 
@@ -219,23 +228,33 @@ class reclaimer {
         size_t bytes_to_reclaim;
     };
     using reclaim_fn = std::function<reclaiming_result ()>;
+    static constexpr unsigned default_priority = 100;
 private:
     std::function<reclaiming_result (request)> _reclaim;
     reclaimer_scope _scope;
+    unsigned _priority;
 public:
     // Installs new reclaimer which will be invoked when system is falling
     // low on memory. 'scope' determines when reclaimer can be executed.
-    reclaimer(std::function<reclaiming_result ()> reclaim, reclaimer_scope scope = reclaimer_scope::async);
-    reclaimer(std::function<reclaiming_result (request)> reclaim, reclaimer_scope scope = reclaimer_scope::async);
+    // Reclaimers are invoked in decreasing order of 'priority', and
+    // lower priority reclaimers are only asked for memory if the higher
+    // priority ones did not release enough. Reclaimers of equal priority
+    // are invoked in the order they were installed.
+    reclaimer(std::function<reclaiming_result ()> reclaim, reclaimer_scope scope = reclaimer_scope::async,
+            unsigned priority = default_priority);
+    reclaimer(std::function<reclaiming_result (request)> reclaim, reclaimer_scope scope = reclaimer_scope::async,
+            unsigned priority = default_priority);
     ~reclaimer();
     reclaiming_result do_reclaim(size_t bytes_to_reclaim) { return _reclaim(request{bytes_to_reclaim}); }
     reclaimer_scope scope() const { return _scope; }
+    unsigned priority() const { return _priority; }
 };
 
 extern std::pmr::polymorphic_allocator<char>* malloc_allocator;
 
 // Call periodically to recycle objects that were freed
-// on cpu other than the one they were allocated on.
+// on cpu other than the one they were allocated on, and to
+// hand over objects freed here to the cpus that own them.
 //
 // Returns @true if any work was actually performed.
 bool drain_cross_cpu_freelist();
@@ -250,6 +269,14 @@ bool drain_cross_cpu_freelist();
 void set_reclaim_hook(
         std::function<void (std::function<void ()>)> hook);
 
+// Like set_reclaim_hook(), but for reclaim that runs ahead of memory
+// exhaustion (free memory is between the low and the high watermarks).
+// Such reclaim is not urgent, so \c fn should be run behind already
+// queued work rather than ahead of it. If not set, the hook installed
+// with set_reclaim_hook() is used.
+void set_background_reclaim_hook(
+        std::function<void (std::function<void ()>)> hook);
+
 /// \endcond
 
 SEASTAR_MODULE_EXPORT_BEGIN
@@ -288,6 +315,7 @@ class statistics {
     uint64_t _mallocs;
     uint64_t _frees;
     uint64_t _cross_cpu_frees;
+    uint64_t _cross_cpu_free_batches;
     size_t _total_memory;
     size_t _free_memory;
     uint64_t _reclaims;
@@ -298,11 +326,11 @@ class statistics {
     uint64_t _foreign_frees;
     uint64_t _foreign_cross_frees;
 private:
-    statistics(uint64_t mallocs, uint64_t frees, uint64_t cross_cpu_frees,
+    statistics(uint64_t mallocs, uint64_t frees, uint64_t cross_cpu_frees, uint64_t cross_cpu_free_batches,
             uint64_t total_memory, uint64_t free_memory, uint64_t reclaims,
             uint64_t large_allocs, uint64_t failed_allocs,
             uint64_t foreign_mallocs, uint64_t foreign_frees, uint64_t foreign_cross_frees)
-        : _mallocs(mallocs), _frees(frees), _cross_cpu_frees(cross_cpu_frees)
+        : _mallocs(mallocs), _frees(frees), _cross_cpu_frees(cross_cpu_frees), _cross_cpu_free_batches(cross_cpu_free_batches)
         , _total_memory(total_memory), _free_memory(free_memory), _reclaims(reclaims)
         , _large_allocs(large_allocs), _failed_allocs(failed_allocs)
         , _foreign_mallocs(foreign_mallocs), _foreign_frees(foreign_frees)
@@ -315,6 +343,10 @@ class statistics {
     /// Total number of memory deallocations that occured on a different lcore
     /// than the one on which they were allocated.
     uint64_t cross_cpu_frees() const { return _cross_cpu_frees; }
+    /// Number of batches in which the objects counted by cross_cpu_frees()
+    /// were handed over to the lcores they were allocated on. Each batch
+    /// costs one atomic operation on the owner's free list.
+    uint64_t cross_cpu_free_batches() const { return _cross_cpu_free_batches; }
     /// Total number of objects which were allocated but not freed.
     size_t live_objects() const { return mallocs() - frees(); }
     /// Total free memory (in bytes)
@@ -339,6 +371,56 @@ class statistics {
     friend statistics stats();
 };
 
+/// Allocation statistics of a single small object size class (pool) of
+/// this lcore, see \ref small_pool_statistics().
+struct small_pool_stats {
+    /// Size of the objects in the pool, requests are rounded up to it
+    size_t object_size = 0;
+    /// Number of objects allocated from the pool
+    uint64_t allocs = 0;
+    /// Number of objects returned to the pool
+    uint64_t frees = 0;
+    /// Number of live objects
+    size_t use_count = 0;
+    /// Memory held by the pool (in bytes)
+    size_t memory = 0;
+    /// Memory held by the pool but not used by live objects (in bytes)
+    size_t unused = 0;
+};
+
+/// How the memory of this lcore is backed, in bytes.
+struct memory_backing_stats {
+    /// Explicit 2MB huge pages, see \ref smp_options::hugetlb_page_size
+    size_t hugetlb_2m = 0;
+    /// Explicit 1GB huge pages, see \ref smp_options::hugetlb_page_size
+    size_t hugetlb_1g = 0;
+    /// Files on a hugetlbfs mount, see \ref smp_options::hugepages
+    size_t hugetlbfs = 0;
+    /// Regular pages, which the kernel may back with transparent huge pages
+    size_t regular = 0;
+    /// Free memory handed over to the other lcores and released to the OS,
+    /// see \ref lend_free_memory()
+    size_t lent = 0;
+    /// Memory the lcore grew by to take over memory lent by the others,
+    /// see \ref borrow_memory()
+    size_t borrowed = 0;
+};
+
+/// Capture a snapshot of how the memory of this lcore is backed.
+memory_backing_stats backing_stats() noexcept;
+
+/// Number of small object size classes, see \ref small_pool_statistics().
+///
+/// Returns 0 when the seastar allocator is not compiled in.
+unsigned small_pool_count() noexcept;
+
+/// Capture a snapshot of the allocation statistics of small object pool
+/// \p idx (0 <= idx < \ref small_pool_count()) for this lcore.
+///
+/// Walks the pool's spans to compute its fragmentation, so it is meant for
+/// monitoring and not for frequent calls.
+small_pool_stats small_pool_statistics(unsigned idx) noexcept;
+
 struct memory_layout {
     uintptr_t start;
     uintptr_t end;
@@ -358,6 +440,87 @@ size_t min_free_memory();
 /// Sets the value of free memory low water mark in memory::page_size units.
 void set_min_free_pages(size_t pages);
 
+/// Returns the value of free memory high water mark in bytes.
+/// When free memory drops halfway from this value to min_free_memory(),
+/// reclaimers are invoked in the background, in small steps, until it
+/// goes above this value again. This lets reclaim run ahead of the low
+/// water mark instead of synchronously with the allocation that crosses
+/// it, while the gap keeps steady allocation just below the high water
+/// mark from waking reclaim over and over. Never lower than
+/// min_free_memory().
+size_t high_free_memory();
+
+/// Sets the value of free memory high water mark in memory::page_size units.
+void set_high_free_pages(size_t pages);
+
+/// Hands free memory of this lcore over to the other lcores
+///
+/// Up to \c max_bytes of the free memory above \c keep_free bytes (and
+/// never below the high water mark) are released to the OS, in whole units
+/// of 32MB, and the released amount becomes available to \ref borrow_memory()
+/// on any lcore. The spans keep belonging to this lcore: borrowing them back
+/// is cheap, while another lcore takes the memory over by growing its own
+/// range, so objects are always freed to the lcore whose range they are in.
+/// An lcore never grows past the memory of the machine.
+///
+/// \return the number of bytes lent
+size_t lend_free_memory(size_t keep_free, size_t max_bytes = std::numeric_limits<size_t>::max());
+
+/// Takes over \c bytes, rounded up to whole units of 32MB, or whatever
+/// is left of the memory lent by the lcores, this one included, with
+/// \ref lend_free_memory()
+///
+/// \return the number of bytes borrowed, which the free memory grew by
+size_t borrow_memory(size_t bytes);
+
+/// Whether this lcore borrows lent memory when its free memory drops below
+/// the high water mark, before asking the reclaimers for it. Borrowing is
+/// done by the background reclaim steps, not by the allocation which found
+/// memory short.
+void set_memory_borrowing(bool enabled);
+
+/// Memory lent by all lcores and not borrowed yet, in bytes
+size_t lendable_memory() noexcept;
+
+namespace internal {
+
+// Times free memory of this lcore dropped low enough to start background
+// reclaim, see high_free_memory()
+uint64_t free_memory_shortages() noexcept;
+
+// Whether p was allocated by this lcore, so that keeping it for reuse here
+// does not hold on to the memory of another one. Always true with the
+// default allocator.
+bool is_local(const void* p) noexcept;
+
+}
+
+/// Memory held by the large allocations made on this lcore by tasks of the
+/// given scheduling group, in bytes
+///
+/// Allocations too large for the small object pools are charged to the
+/// group current when they are made, until they are freed, on whatever
+/// lcore and group that happens. The small ones are not charged, so this
+/// is the bulk of the memory of groups that work with buffers, such as
+/// those of files and sockets, rather than all of it.
+size_t scheduling_group_memory(scheduling_group sg) noexcept;
+
+/// Sets a soft limit on \ref scheduling_group_memory() of a group, on this lcore
+///
+/// Allocations don't fail because of the limit. Instead, when the memory of
+/// the group grows above it, \c on_exceeded is called soon after, in a task
+/// of its own, for the application to have the group hold back, e.g. by
+/// pausing background work. It is called again only after the memory drops
+/// back to the limit and grows above it once more.
+///
+/// \param limit the limit in bytes, zero for none
+void set_scheduling_group_memory_limit(scheduling_group sg, size_t limit, std::function<void ()> on_exceeded);
+
+/// Reclaim latencies, in microseconds, for reclaim that ran in the given
+/// \c scope: synchronously with an allocation (reclaimer_scope::sync) or
+/// in a background step (reclaimer_scope::async).
+seastar::metrics::histogram reclaim_latency_histogram(reclaimer_scope scope);
+
 /// Enable the large allocation warning threshold.
 ///
 /// Warn when allocation above a given threshold are performed.
@@ -498,6 +661,147 @@ class scoped_heap_profiling {
     ~scoped_heap_profiling();
 };
 
+/// \brief A bump-pointer arena for memory that shares a lifetime.
+///
+/// Memory is carved sequentially out of chunks of whole pages taken from the
+/// shard's page allocator, bypassing the small object pools, and is only
+/// returned when the arena is reset or destroyed; there is no per-object
+/// deallocation. This makes an allocation little more than a pointer bump,
+/// and avoids fragmenting the small pools with short-lived objects, such as
+/// everything parsed out of a single request.
+///
+/// Destructors of objects placed in the arena are not run by it. An arena
+/// must only be used on the shard that created it.
+class arena {
+    struct chunk {
+        chunk* next;
+        size_t size; // including this header
+    };
+    chunk* _chunks = nullptr;
+    char* _pos = nullptr;
+    char* _end = nullptr;
+    size_t _next_chunk_size;
+    size_t _memory = 0;
+public:
+    static constexpr size_t default_chunk_size = 4 * page_size;
+    static constexpr size_t max_chunk_size = 256 * page_size;
+
+    /// Constructs an empty arena. The first chunk is allocated on first use.
+    ///
+    /// \param chunk_size size of the first chunk, later ones double in size
+    ///        up to \ref max_chunk_size.
+    explicit arena(size_t chunk_size = default_chunk_size) noexcept;
+    arena(arena&& x) noexcept;
+    arena& operator=(arena&& x) noexcept;
+    ~arena();
+
+    /// Allocates \p size bytes aligned to \p align, which must be a power
+    /// of two. Throws std::bad_alloc if memory is exhausted.
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        auto p = (reinterpret_cast<uintptr_t>(_pos) + align - 1) & ~(align - 1);
+        if (__builtin_expect(p <= reinterpret_cast<uintptr_t>(_end) && size <= reinterpret_cast<uintptr_t>(_end) - p, true)) {
+            _pos = reinterpret_cast<char*>(p + size);
+            return reinterpret_cast<void*>(p);
+        }
+        return allocate_slow(size, align);
+    }
+    /// Frees all the memory allocated from the arena, except for the most
+    /// recent chunk, which is kept for reuse.
+    void reset() noexcept;
+    /// Memory held by the arena (in bytes), including unused chunk space.
+    size_t memory_held() const noexcept { return _memory; }
+private:
+    [[gnu::noinline]] void* allocate_slow(size_t size, size_t align);
+    void free_chunks(chunk* c) noexcept;
+};
+
+/// A std::pmr::memory_resource that allocates from an \ref arena.
+///
+/// Deallocation is a no-op, memory is returned when the arena is reset or
+/// destroyed. The arena must outlive the resource and everything allocated
+/// from it.
+class arena_resource final : public std::pmr::memory_resource {
+    arena& _arena;
+public:
+    explicit arena_resource(arena& a) noexcept : _arena(a) {}
+    seastar::memory::arena& get_arena() const noexcept { return _arena; }
+private:
+    virtual void* do_allocate(size_t bytes, size_t alignment) override {
+        return _arena.allocate(bytes, alignment);
+    }
+    virtual void do_deallocate(void*, size_t, size_t) noexcept override {}
+    virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        auto o = dynamic_cast<const arena_resource*>(&other);
+        return o && &o->_arena == &_arena;
+    }
+};
+
+/// \brief NUMA placement of memory allocated with \ref allocate_numa().
+///
+/// Shard memory is always placed on the shard's own node. Data that is read
+/// by all shards, such as a large read-mostly lookup table shared with
+/// \ref foreign_ptr, is better spread across nodes, or placed on a given
+/// node regardless of which shard builds it.
+class numa_policy {
+public:
+    enum class kind {
+        /// On the node of the CPU calling \ref allocate_numa().
+        local,
+        /// Page by page round robin across all nodes the process may use.
+        interleave,
+        /// On a given node, falling back to other nodes if it is full.
+        node,
+    };
+private:
+    kind _kind;
+    unsigned _node;
+    numa_policy(kind k, unsigned node) noexcept : _kind(k), _node(node) {}
+public:
+    static numa_policy local() noexcept { return {kind::local, 0}; }
+    static numa_policy interleave() noexcept { return {kind::interleave, 0}; }
+    static numa_policy on_node(unsigned node) noexcept { return {kind::node, node}; }
+    kind get_kind() const noexcept { return _kind; }
+    /// The node for kind::node.
+    unsigned node() const noexcept { return _node; }
+};
+
+/// \brief Allocates memory outside of the shard's memory, with explicit NUMA placement.
+///
+/// \c size is rounded up to whole pages, so this is meant for a few large
+/// allocations; see \ref numa_memory_resource for containers. The memory is
+/// zeroed and faulted in before returning, so its placement is settled and
+/// readers never fault on it. It is not accounted in \ref stats(), and
+/// may be freed with \ref free_numa() from any shard or thread.
+///
+/// Throws std::bad_alloc if the memory cannot be mapped, and std::system_error
+/// if the policy cannot be applied (for example, the node does not exist).
+void* allocate_numa(size_t size, numa_policy policy);
+
+/// Frees memory allocated with \ref allocate_numa(), \c size must be the
+/// one passed to it.
+void free_numa(void* ptr, size_t size) noexcept;
+
+/// A std::pmr::memory_resource that allocates with \ref allocate_numa().
+///
+/// Every allocation takes whole pages, so wrap it in a
+/// std::pmr::monotonic_buffer_resource or a pool resource to place many
+/// small objects. Memory may be deallocated on any shard.
+class numa_memory_resource final : public std::pmr::memory_resource {
+    numa_policy _policy;
+public:
+    explicit numa_memory_resource(numa_policy policy) noexcept : _policy(policy) {}
+    numa_policy policy() const noexcept { return _policy; }
+private:
+    virtual void* do_allocate(size_t bytes, size_t alignment) override;
+    virtual void do_deallocate(void* p, size_t bytes, size_t alignment) noexcept override {
+        free_numa(p, bytes);
+    }
+    virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        // Placement only matters on allocation, any instance can free
+        return dynamic_cast<const numa_memory_resource*>(&other);
+    }
+};
+
 SEASTAR_MODULE_EXPORT_END
 
 }
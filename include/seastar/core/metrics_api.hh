@@ -30,6 +30,7 @@
 #endif
 
 #include <deque>
+#include <span>
 
 /*!
  * \file metrics_api.hh
@@ -237,10 +238,13 @@ inline bool operator<(const internalized_holder& lhs, const internalized_holder&
 
 
 class impl;
+class metric_family;
 
 class registered_metric final {
     metric_info _info;
     metric_function _f;
+    // The family the metric is registered in, nullptr once unregistered
+    metric_family* _family = nullptr;
 public:
     registered_metric(metric_id id, metric_function f, bool enabled=true, skip_when_empty skip=skip_when_empty::no);
     metric_value operator()() const {
@@ -270,6 +274,12 @@ class registered_metric final {
     const metric_function& get_function() const {
         return _f;
     }
+    metric_family* family() const noexcept {
+        return _family;
+    }
+    void set_family(metric_family* family) noexcept {
+        _family = family;
+    }
 };
 
 using register_ref = shared_ptr<registered_metric>;
@@ -287,6 +297,9 @@ class metric_groups_impl : public metric_groups_def {
     metric_groups_impl& add_metric(group_name_type name, const metric_definition& md);
     metric_groups_impl& add_group(group_name_type name, const std::initializer_list<metric_definition>& l);
     metric_groups_impl& add_group(group_name_type name, const std::vector<metric_definition>& l);
+private:
+    // Registers the metrics of a group in one pass, see impl::register_metric()
+    metric_groups_impl& add_definitions(const group_name_type& name, std::span<const metric_definition> l);
 };
 
 class metric_family {
@@ -404,6 +417,10 @@ class metric_series_metadata {
     group_name_type name() const {
         return _id.name();
     }
+
+    const metric_id& id() const {
+        return _id;
+    }
 };
 
 using metric_metadata_fifo = std::deque<metric_series_metadata>;
@@ -440,6 +457,25 @@ using metric_values = std::deque<value_vector>;
 struct values_copy {
     shared_ptr<metric_metadata> metadata;
     metric_values values;
+    // changes whenever the metadata of the shard is rebuilt, i.e. when the
+    // registered metrics change, see impl::metadata_generation()
+    uint64_t metadata_generation = 0;
+};
+
+/*!
+ * \brief the series of a shard, once summed over the aggregate labels of
+ * their families
+ *
+ * The families are those of impl::metadata(), in the same order. The series
+ * of the families with aggregate labels are replaced by one series for each
+ * of their values of the other labels.
+ */
+struct series_aggregation {
+    uint64_t generation = 0;
+    shared_ptr<metric_metadata> metadata;
+    // for each family, the aggregated series each of its series is added
+    // to, or nothing if the family has no aggregate labels
+    std::vector<std::vector<uint32_t>> slots;
 };
 
 struct config {
@@ -453,11 +489,13 @@ class impl {
     config _config;
     bool _dirty = true;
     shared_ptr<metric_metadata> _metadata;
+    uint64_t _metadata_generation = 0;
     std::set<sstring> _labels;
     std::vector<std::deque<metric_function>> _current_metrics;
     std::vector<relabel_config> _relabel_configs;
     std::vector<metric_family_config> _metric_family_configs;
     internalized_set _internalized_labels;
+    series_aggregation _aggregation;
 public:
     value_map& get_value_map() {
         return _value_map;
@@ -468,8 +506,19 @@ class impl {
     }
 
     register_ref add_registration(const metric_id& id, const metric_type& type, metric_function f, const description& d, bool enabled, skip_when_empty skip, const std::vector<std::string>& aggregate_labels);
+    /*!
+     * \brief add_registration(), without marking the metadata for rebuild
+     *
+     * For registering many metrics at once, calling dirty() once for them all.
+     */
+    register_ref register_metric(const metric_id& id, const metric_type& type, metric_function f, const description& d, bool enabled, skip_when_empty skip, const std::vector<std::string>& aggregate_labels);
     internalized_labels_ref internalize_labels(labels_type labels);
     void remove_registration(const metric_id& id);
+    /*!
+     * \brief unregisters metrics through the families they are registered
+     * in, taking O(log(series of the family)) each
+     */
+    void remove_registrations(const metrics_registration& registrations);
     future<> stop() {
         return make_ready_future<>();
     }
@@ -484,8 +533,25 @@ class impl {
 
     std::vector<std::deque<metric_function>>& functions();
 
+    /*!
+     * \brief a number that changes each time metadata() is rebuilt
+     *
+     * Never 0 once metadata() was called, so scrape handlers can use it to
+     * know when what they derived from the metadata is stale.
+     */
+    uint64_t metadata_generation() const noexcept {
+        return _metadata_generation;
+    }
+
     void update_metrics_if_needed();
 
+    /*!
+     * \brief how the series are summed by get_aggregated_values()
+     *
+     * Rebuilt when the metadata or the aggregate labels change.
+     */
+    const series_aggregation& aggregation();
+
     void dirty() {
         _dirty = true;
     }
@@ -517,6 +583,21 @@ using values_reference = shared_ptr<values_copy>;
 
 foreign_ptr<values_reference> get_values();
 
+/*!
+ * \brief get the values of the shard, with the series of each family
+ * summed over its aggregate labels
+ *
+ * This is what summing the values returned by get_values() over the
+ * aggregate labels gives, except that the series skipped when empty are
+ * left out of the sums, and an aggregated series is only skipped when
+ * empty if all of its series are. Scrape handlers aggregating the families
+ * use it to move and hold fewer values.
+ *
+ * The series of the families without aggregate labels are those of
+ * get_values(), and so is the metadata generation.
+ */
+foreign_ptr<values_reference> get_aggregated_values();
+
 shared_ptr<impl> get_local_impl();
 
 void unregister_metric(const metric_id & id);
@@ -22,6 +22,7 @@
 #pragma once
 
 #ifndef SEASTAR_MODULE
+#include <cmath>
 #include <cstdint>
 #include <vector>
 #include <seastar/util/modules.hh>
@@ -43,6 +44,14 @@ struct histogram_bucket {
     uint64_t count = 0; // number of events.
     double upper_bound = 0;      // Inclusive.
 };
+/*!
+ * \brief a nonempty bucket of a sparse native histogram
+ */
+struct native_histogram_bucket {
+    int32_t index;
+    uint64_t count; // number of events in this bucket alone, not cumulative
+};
+
 /*!
  * \brief native histogram specific information
  *
@@ -57,6 +66,23 @@ struct native_histogram_info {
     int32_t schema;
     // min_id is the first bucket id of a given schema.
     int32_t min_id;
+
+    // The rest is only used by sparse histograms, see histogram::is_sparse().
+
+    // The nonempty buckets, in increasing order of index.
+    std::vector<native_histogram_bucket> sparse_buckets;
+    // Values no larger than zero_threshold are counted in the zero bucket.
+    double zero_threshold = 0;
+    uint64_t zero_count = 0;
+
+    /*!
+     * \brief the upper bound of a bucket, 2^(index * 2^-schema)
+     *
+     * Bucket index holds the values in (upper_bound(index - 1), upper_bound(index)].
+     */
+    static double upper_bound(int32_t schema, int32_t index) noexcept {
+        return std::exp2(std::ldexp(double(index), -schema));
+    }
 };
 
 /*!
@@ -99,6 +125,17 @@ struct histogram {
 
     // Native histograms are an experimental Prometheus feature.
     std::optional<native_histogram_info> native_histogram;
+
+    /*!
+     * \brief whether this is a sparse native histogram
+     *
+     * A sparse histogram has no explicit buckets, its nonempty buckets
+     * are in native_histogram->sparse_buckets. Adding sparse histograms
+     * of different schemas reduces the finer one to the coarser schema.
+     */
+    bool is_sparse() const noexcept {
+        return native_histogram && buckets.empty();
+    }
 };
 
 SEASTAR_MODULE_EXPORT_END
@@ -0,0 +1,119 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#include <map>
+#include <memory>
+#include <optional>
+#endif
+
+#include <seastar/core/future.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/http/client.hh>
+#include <seastar/net/socket_defs.hh>
+#include <seastar/net/tls.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+/// OpenTelemetry metrics export
+namespace otlp {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/*!
+ * How the values of counters and histograms are reported, see the
+ * OpenTelemetry AggregationTemporality. The values are those of the
+ * protocol.
+ */
+enum class aggregation_temporality {
+    delta = 1, //!< the change since the previous successful export
+    cumulative = 2, //!< the total since the exporter started
+};
+
+/*!
+ * Holds the OTLP exporter configuration
+ */
+struct config {
+    sstring host; //!< the Host header of the requests
+    sstring path = "/v1/metrics"; //!< the path the metrics are posted to
+    std::chrono::milliseconds interval = std::chrono::seconds(10); //!< time between two exports
+    aggregation_temporality temporality = aggregation_temporality::delta;
+    sstring prefix = "seastar"; //!< a prefix that will be added to metric names, like prometheus::config::prefix
+    std::map<sstring, sstring> resource_attributes; //!< attributes of the exported resource, e.g. service.name
+    bool aggregate = true; //!< sum the series of a family over its aggregate labels, like the prometheus endpoint does
+    std::optional<scheduling_group> sched_group; //!< the group exports run in on all shards, better one with few shares. Defaults to the group start() is called in
+};
+
+/*!
+ * \brief pushes the metrics of all shards to an OpenTelemetry collector
+ *
+ * Every config::interval, the values of the metrics of all shards are
+ * collected, aggregated as configured, and posted in a single OTLP/HTTP
+ * request, in the JSON encoding.
+ *
+ * Gauges are reported as gauges, counters as monotonic sums, histograms
+ * as histograms, or exponential histograms for sparse native ones, and
+ * summaries as summaries. With delta temporality the exporter keeps the
+ * values of the last successful export, so a failed export is covered by
+ * the next one. A counter that went back is taken as reset.
+ *
+ * The exporter works from the shard it was created on.
+ */
+class exporter {
+public:
+    class impl;
+private:
+    std::unique_ptr<impl> _impl;
+public:
+    exporter(socket_address addr, config cfg);
+    exporter(socket_address addr, shared_ptr<tls::certificate_credentials> creds, config cfg);
+    exporter(std::unique_ptr<http::experimental::connection_factory> f, config cfg);
+    ~exporter();
+
+    /*!
+     * \brief start exporting every config::interval
+     */
+    void start();
+
+    /*!
+     * \brief export the current values now
+     *
+     * Resolves when the collector accepted them, fails otherwise.
+     */
+    future<> push();
+
+    /*!
+     * \brief stop exporting, waits for an export in progress
+     */
+    future<> stop();
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
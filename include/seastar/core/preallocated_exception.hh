@@ -0,0 +1,67 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <exception>
+#include <type_traits>
+#endif
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup future-util
+/// @{
+
+/// \brief The exception of type \c E, made once per shard.
+///
+/// Failing a future with it, e.g. with make_exception_future(), copies a
+/// \c std::exception_ptr, which neither allocates nor throws, where making
+/// an exception each time allocates it. Futures propagate it through
+/// \c then() as is, and \ref coroutine::try_future through coroutines,
+/// and is_preallocated_exception() recognizes it without rethrowing it.
+///
+/// Meant for the errors that carry no state and are reported at a high
+/// rate under overload, such as timeouts and rejections. Since it is
+/// shared, it must not be modified by the code that catches it.
+template <typename E>
+requires std::is_default_constructible_v<E>
+const std::exception_ptr& preallocated_exception() {
+    static thread_local const std::exception_ptr ex = std::make_exception_ptr(E());
+    return ex;
+}
+
+/// Tells whether \c ex is the preallocated_exception() of type \c E, with no
+/// rethrow
+template <typename E>
+requires std::is_default_constructible_v<E>
+bool is_preallocated_exception(const std::exception_ptr& ex) {
+    return ex == preallocated_exception<E>();
+}
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
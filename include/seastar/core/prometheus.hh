@@ -44,12 +44,42 @@ struct config {
     std::optional<metrics::label_instance> label; //!< A label that will be added to all metrics, we advice not to use it and set it on the prometheus server
     sstring prefix = "seastar"; //!< a prefix that will be added to metric names
     bool allow_protobuf = false; // protobuf support is experimental and off by default
+    bool heap_profile = false; //!< also serve the sampled heap profile of all shards, in pprof format, at /debug/pprof/heap
+    bool cpu_profile = false; //!< also serve the CPU profile of all shards, in pprof format, at /debug/pprof/profile
+    bool task_trace = false; //!< also serve the task trace of all shards, in Chrome trace format, at /debug/trace
+    bool cache_series_names = false; //!< keep the rendered names and labels of the series between text format scrapes, which then only format the values. Each serving shard keeps those of all shards
 };
 
 future<> start(httpd::http_server_control& http_server, config ctx);
 
 /// \defgroup add_prometheus_routes adds a /metrics endpoint that returns prometheus metrics
 ///    both in txt format and in protobuf according to the prometheus spec
+///
+/// If \ref config::heap_profile is set, a /debug/pprof/heap endpoint is added as well.
+/// It returns the heap profile sampled so far on all shards (see
+/// \ref memory::set_heap_profiling_sampling_rate()) in the legacy text format
+/// understood by pprof, e.g. `pprof -http=: http://host:port/debug/pprof/heap`.
+/// Passing the `sample_rate` query parameter first changes the sampling rate
+/// on all shards (0 disables sampling). Sampling is only available when seastar
+/// is built with heap profiling support.
+///
+/// If \ref config::cpu_profile is set, a /debug/pprof/profile endpoint is added too.
+/// It returns the backtraces sampled by the CPU profiler of all shards (see
+/// \ref reactor_options::cpu_profiler_period_us), labeled with their shard,
+/// scheduling group and, for those sampled in a stall reported by the stall
+/// detector, `stalled`, e.g. `pprof -tagfocus=scheduling_group=main
+/// http://host:port/debug/pprof/profile?seconds=30`. With the `seconds` query
+/// parameter, only the samples taken during that many seconds are returned,
+/// otherwise those taken since the profile was last read. Passing `period_us` first changes the sampling
+/// period on all shards (0 disables the profiler).
+///
+/// If \ref config::task_trace is set, a /debug/trace endpoint is added too.
+/// It returns what the shards traced (see \ref reactor::enable_task_tracing())
+/// as Chrome trace event JSON, with a track per shard, which Perfetto opens,
+/// e.g. `curl -o trace.json http://host:port/debug/trace?seconds=1`. With the
+/// `seconds` query parameter, tracing is enabled on all shards for that many
+/// seconds first, keeping the last `max_events` events of each (64k by
+/// default), otherwise the trace recorded so far is returned.
 /// @{
 future<> add_prometheus_routes(distributed<httpd::http_server>& server, config ctx);
 future<> add_prometheus_routes(httpd::http_server& server, config ctx);
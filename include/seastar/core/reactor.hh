@@ -25,6 +25,7 @@
 #include <seastar/core/cacheline.hh>
 #include <seastar/core/circular_buffer.hh>
 #include <seastar/core/circular_buffer_fixed_capacity.hh>
+#include <seastar/core/chunked_deque.hh>
 #include <seastar/core/condition-variable.hh>
 #include <seastar/core/enum.hh>
 #include <seastar/core/file.hh>
@@ -40,6 +41,9 @@
 #include <seastar/core/memory.hh>
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/core/internal/idle_poll.hh>
+#include <seastar/core/internal/poll.hh>
+#include <seastar/core/internal/tsc_clock.hh>
 #include <seastar/core/posix.hh>
 #include <seastar/core/reactor_config.hh>
 #include <seastar/core/scattered_message.hh>
@@ -62,6 +66,7 @@
 #include "internal/pollable_fd.hh"
 
 #ifndef SEASTAR_MODULE
+#include <array>
 #include <atomic>
 #include <cassert>
 #include <chrono>
@@ -115,11 +120,20 @@ class reactor_backend_selector;
 
 class reactor_backend;
 struct pollfn;
+template <typename T>
+struct syscall_result;
 
 namespace internal {
 
 class reactor_stall_sampler;
 class cpu_stall_detector;
+class cpu_profiler;
+struct cpu_profile_entry;
+std::vector<cpu_profile_entry> cpu_profile();
+class task_tracer;
+struct task_trace;
+task_trace local_task_trace();
+struct quiescent_epoch;
 class buffer_allocator;
 class priority_class;
 class poller;
@@ -151,13 +165,16 @@ class io_completion : public kernel_completion {
 SEASTAR_MODULE_EXPORT
 class reactor {
 private:
+    struct sched_entity;
     struct task_queue;
-    using task_queue_list = circular_buffer_fixed_capacity<task_queue*, 1 << log2ceil(max_scheduling_groups())>;
+    struct task_queue_group;
+    using task_queue_list = circular_buffer_fixed_capacity<sched_entity*, 1 << log2ceil(max_scheduling_groups())>;
     using pollfn = seastar::pollfn;
 
     class signal_pollfn;
     class batch_flush_pollfn;
     class smp_pollfn;
+    class alien_pollfn;
     class drain_cross_cpu_freelist_pollfn;
     class lowres_timer_pollfn;
     class manual_timer_pollfn;
@@ -172,6 +189,7 @@ class reactor {
     friend void internal::at_exit(noncopyable_function<future<> ()> func);
     friend class manual_clock;
     friend class file_data_source_impl; // for fstream statistics
+    friend class append_challenged_posix_file_impl; // for fsync statistics
     friend class internal::reactor_stall_sampler;
     friend class preempt_io_context;
     friend struct hrtimer_aio_completion;
@@ -201,6 +219,8 @@ class reactor {
         uint64_t fstream_read_bytes_blocked = 0;
         uint64_t fstream_read_aheads_discarded = 0;
         uint64_t fstream_read_ahead_discarded_bytes = 0;
+        uint64_t fsyncs = 0;
+        uint64_t fsyncs_coalesced = 0;
     };
     /// Scheduling statistics.
     struct sched_stats {
@@ -231,8 +251,13 @@ class reactor {
 
     // Each mountpouint is controlled by its own io_queue, but ...
     std::unordered_map<dev_t, seastar::shared_ptr<io_queue>> _io_queues;
+    // Devices resolved to the queue of another one by discover_io_queue(),
+    // kept apart so that the loops over the queues don't visit them again
+    std::unordered_map<dev_t, io_queue*> _io_queue_aliases;
     // ... when dispatched all requests get into this single sink
     internal::io_sink _io_sink;
+    io_queue& discover_io_queue(dev_t devid);
+    seastar::shared_ptr<io_queue> find_disk_io_queue(dev_t devid, unsigned depth) const;
     unsigned _num_io_groups = 0;
 
     std::vector<noncopyable_function<future<> ()>> _exit_funcs;
@@ -247,42 +272,110 @@ class reactor {
     internal::preemption_monitor _preemption_monitor{};
     uint64_t _global_tasks_processed = 0;
     uint64_t _polls = 0;
+    // Time of the reactor loop by phase. Pollers are timed in one call of
+    // poll_once() out of loop_phase_sample_interval, to keep the clock
+    // reads off most polls, and their time is scaled accordingly.
+    using loop_phase_times = std::array<sched_clock::duration, size_t(internal::loop_phase::count)>;
+    static constexpr unsigned loop_phase_sample_interval = 16;
+    unsigned _loop_phase_sample = 0;
+    loop_phase_times _loop_phase_time{};
+    // As of the last stall report, which breaks down the time since
+    loop_phase_times _loop_phase_time_reported{};
+    // What the loop is doing now, for stall reports
+    internal::loop_phase _loop_phase = internal::loop_phase::other;
+    // Advanced in between runs of tasks, see replicated<T>
+    internal::quiescent_epoch* _quiescent_epoch = nullptr;
+    // Used when reactor_config::idle_poll_adaptive is set
+    internal::idle_poll_estimator _idle_poll;
+    // The task quota in effect, tuned between the configured bounds when
+    // reactor_config::task_quota_auto is set
+    sched_clock::duration _task_quota;
+    // What run_some_tasks() observed since the task quota was last tuned
+    struct task_quota_window {
+        uint64_t runs = 0;
+        uint64_t preempted_runs = 0;
+        uint64_t active_queues = 0;
+        sched_clock::duration max_run = {};
+    } _task_quota_window;
     metrics::internal::time_estimated_histogram _stalls_histogram;
     std::unique_ptr<internal::cpu_stall_detector> _cpu_stall_detector;
+    std::unique_ptr<internal::cpu_profiler> _cpu_profiler;
+    // Kept when tracing is disabled, so that the trace can still be read
+    std::unique_ptr<internal::task_tracer> _task_tracer;
+    // Set while tracing is enabled
+    internal::task_tracer* _tracing = nullptr;
+    // The CPU accounting tag the running tasks are charged to, see
+    // cpu_accounting::internal::switch_tag()
+    uint16_t _cpu_tag_charged = 0;
 
     timer<>::set_t _timers;
     timer<>::set_t::timer_list_t _expired_timers;
+    uint64_t _hrtimer_wakeups = 0;
+    uint64_t _hrtimer_reprograms = 0;
+    // timers expiring in the wakeup of another timer
+    uint64_t _timers_coalesced = 0;
     timer<lowres_clock>::set_t _lowres_timers;
     timer<lowres_clock>::set_t::timer_list_t _expired_lowres_timers;
     timer<manual_clock>::set_t _manual_timers;
     timer<manual_clock>::set_t::timer_list_t _expired_manual_timers;
     io_stats _io_stats;
-    uint64_t _fsyncs = 0;
     uint64_t _cxx_exceptions = 0;
     uint64_t _internal_errors = 0;
     uint64_t _abandoned_failed_futures = 0;
-    struct task_queue {
-        explicit task_queue(unsigned id, sstring name, sstring shortname, float shares);
+    // A task queue, or a group of them, competing with its siblings for
+    // the CPU time of its parent group by vruntime
+    struct sched_entity {
+        sched_entity(float shares, task_queue_group* parent, bool is_group) noexcept;
         int64_t _vruntime = 0;
         float _shares;
         int64_t _reciprocal_shares_times_2_power_32;
         bool _active = false;
+        // the group the entity is in, nullptr for the root group
+        task_queue_group* const _parent;
+        const bool _is_group;
+        int64_t to_vruntime(sched_clock::duration runtime) const;
+        void set_shares(float shares) noexcept;
+        struct indirect_compare;
+    };
+    // The task queues of a scheduling supergroup, or the root group
+    struct task_queue_group final : sched_entity {
+        task_queue_group(float shares, task_queue_group* parent) noexcept : sched_entity(shares, parent, true) {}
+        int64_t _last_vruntime = 0;
+        task_queue_list _active_task_queues;
+        task_queue_list _activating_task_queues;
+        bool has_tasks() const noexcept {
+            return _active_task_queues.size() + _activating_task_queues.size();
+        }
+        void insert_active(sched_entity* e);
+        void insert_activating();
+        sched_entity* pop_active() noexcept;
+    };
+    // The period over which the CPU limits of the task queues are enforced
+    static constexpr sched_clock::duration cpu_limit_period = std::chrono::milliseconds(100);
+    struct task_queue final : sched_entity {
+        explicit task_queue(unsigned id, sstring name, sstring shortname, float shares, task_queue_group& group);
         const uint8_t _id;
         sched_clock::time_point _ts; // to help calculating wait/starve-times
         sched_clock::duration _runtime = {};
         sched_clock::duration _waittime = {};
         sched_clock::duration _starvetime = {};
         uint64_t _tasks_processed = 0;
-        circular_buffer<task*> _q;
+        unsigned _supergroup = 0;
+        chunked_deque<task*> _q;
         sstring _name;
         // the shortened version of scheduling_gruop's name, only the first 4
         // chars are used.
         static constexpr size_t shortname_size = 4;
         sstring _shortname;
-        int64_t to_vruntime(sched_clock::duration runtime) const;
-        void set_shares(float shares) noexcept;
-        struct indirect_compare;
         sched_clock::duration _time_spent_on_task_quota_violations = {};
+        // fraction of each cpu_limit_period the queue may run for, 0 if unlimited
+        float _cpu_limit = 0;
+        sched_clock::time_point _period_start;
+        sched_clock::duration _period_runtime = {};
+        bool _throttled = false;
+        sched_clock::duration _throttled_time = {};
+        uint64_t _throttles = 0;
+        timer<> _unthrottle_timer;
         seastar::metrics::metric_groups _metrics;
         void rename(sstring new_name, sstring new_shortname);
     private:
@@ -290,11 +383,11 @@ class reactor {
     };
 
     std::array<std::unique_ptr<task_queue>, max_scheduling_groups()> _task_queues;
+    std::array<float, max_scheduling_groups()> _io_supergroup_shares = {};
+    // indexed by supergroup, the root group first
+    std::array<std::unique_ptr<task_queue_group>, max_scheduling_groups()> _task_queue_groups;
     internal::scheduling_group_specific_thread_local_data _scheduling_group_specific_data;
     shared_mutex _scheduling_group_keys_mutex;
-    int64_t _last_vruntime = 0;
-    task_queue_list _active_task_queues;
-    task_queue_list _activating_task_queues;
     task_queue* _at_destroy_tasks;
     task* _current_task = nullptr;
     /// Handler that will be called when there is no task to execute on cpu.
@@ -324,6 +417,11 @@ class reactor {
     sched_clock::duration _total_sleep{0};
     sched_clock::time_point _start_time = now();
     output_stream<char>::batch_flush_list_t _flush_batching;
+    struct {
+        uint64_t flushes = 0;
+        uint64_t bytes = 0;
+        uint64_t merged = 0;
+    } _flush_batching_stats;
     std::atomic<bool> _sleeping alignas(seastar::cache_line_size){0};
     std::atomic<bool> _dying{false};
     gate _background_gate;
@@ -339,6 +437,7 @@ class reactor {
 private:
     static std::chrono::nanoseconds calculate_poll_time();
     static void block_notifier(int);
+    static void cpu_profiler_notifier(int, siginfo_t*, void*);
     bool flush_pending_aio();
     steady_clock_type::time_point next_pending_aio() const noexcept;
     bool reap_kernel_completions();
@@ -394,21 +493,26 @@ class reactor {
     friend class thread_pool;
     friend class thread_context;
     friend class internal::cpu_stall_detector;
+    friend std::vector<internal::cpu_profile_entry> internal::cpu_profile();
+    friend internal::task_trace internal::local_task_trace();
 
     friend void handle_signal(int signo, noncopyable_function<void ()>&& handler, bool once);
 
     uint64_t pending_task_count() const;
     void run_tasks(task_queue& tq);
+    void run_traced_task(task& t, unsigned sg_index) noexcept;
     bool have_more_tasks() const;
     bool posix_reuseport_detect();
     void run_some_tasks();
     void activate(task_queue& tq);
-    void insert_active_task_queue(task_queue* tq);
     task_queue* pop_active_task_queue(sched_clock::time_point now);
-    void insert_activating_task_queues();
+    void requeue(task_queue& tq);
+    void charge_cpu_limit(task_queue& tq, sched_clock::time_point now, sched_clock::duration runtime);
+    void unthrottle(task_queue& tq);
     void account_runtime(task_queue& tq, sched_clock::duration runtime);
+    bool tune_task_quota() noexcept;
     future<> rename_scheduling_group_specific_data(scheduling_group sg);
-    future<> init_scheduling_group(scheduling_group sg, sstring name, sstring shortname, float shares);
+    future<> init_scheduling_group(scheduling_group sg, sstring name, sstring shortname, float shares, scheduling_supergroup parent);
     future<> init_new_scheduling_group_key(scheduling_group_key key, scheduling_group_key_config cfg);
     future<> destroy_scheduling_group(scheduling_group sg) noexcept;
     uint64_t tasks_processed() const;
@@ -449,19 +553,26 @@ class reactor {
     void operator=(const reactor&) = delete;
 
     static sched_clock::time_point now() noexcept {
-        return sched_clock::now();
+        // sched_clock::now(), until calibrated with --tsc-clock
+        return internal::tsc_now();
     }
     sched_clock::duration uptime() {
         return now() - _start_time;
     }
 
+    // Devices without a queue of their own (partitions, device-mapper or md
+    // devices of a configured disk) are resolved to the queue of the disk,
+    // unknown ones get the default queue
     io_queue& get_io_queue(dev_t devid = 0) {
         auto queue = _io_queues.find(devid);
-        if (queue == _io_queues.end()) {
-            return *_io_queues.at(0);
-        } else {
+        if (queue != _io_queues.end()) {
             return *(queue->second);
         }
+        auto alias = _io_queue_aliases.find(devid);
+        if (alias != _io_queue_aliases.end()) {
+            return *alias->second;
+        }
+        return discover_io_queue(devid);
     }
 
     /// @private
@@ -470,19 +581,30 @@ class reactor {
     void rename_queues(internal::priority_class pc, sstring new_name);
     /// @private
     void update_shares_for_queues(internal::priority_class pc, uint32_t shares);
+    void update_latency_target_for_queues(internal::priority_class pc, std::chrono::microseconds latency, double percentile);
+    void update_min_shares_for_queues(internal::priority_class pc, uint32_t min_shares);
+    /// @private
+    void update_shares_for_supergroup_queues(unsigned index, uint32_t shares);
 
     server_socket listen(socket_address sa, listen_options opts = {});
 
     future<connected_socket> connect(socket_address sa);
     future<connected_socket> connect(socket_address, socket_address, transport proto = transport::TCP);
 
-    pollable_fd posix_listen(socket_address sa, listen_options opts = {});
+    // With reuseport the socket joins the SO_REUSEPORT group of the address
+    pollable_fd posix_listen(socket_address sa, listen_options opts = {}, bool reuseport = false);
+    /// @private
+    // The listening socket of posix_listen(), not registered with this
+    // reactor yet, so that it can be handed to another shard
+    file_desc posix_listen_socket(socket_address sa, listen_options opts = {}, bool reuseport = false);
 
     // FIXME: reuseport currently leads to heavy load imbalance.
     // Until we fix that, just disable it unconditionally.
     bool posix_reuseport_available() const { return false; }
 
     pollable_fd make_pollable_fd(socket_address sa, int proto);
+    // Of a socket this reactor didn't open, e.g. received from another process
+    pollable_fd adopt_pollable_fd(file_desc fd);
 
     future<> posix_connect(pollable_fd pfd, socket_address sa, socket_address local);
 
@@ -607,6 +729,8 @@ template <typename Func>
     const seastar::smp& smp() const noexcept;
 
     void try_sleep();
+    std::chrono::nanoseconds idle_poll_time() const noexcept;
+    static void idle_pause(unsigned polls) noexcept;
 
     steady_clock_type::duration total_idle_time();
     steady_clock_type::duration total_busy_time();
@@ -638,6 +762,12 @@ template <typename Func>
     future<> send_all_part(pollable_fd_state& fd, const void* buffer, size_t size, size_t completed);
 
     future<> fdatasync(int fd) noexcept;
+    // Runs a file metadata operation of io_request through the backend,
+    // which must support it (see reactor_backend::submits_file_metadata_ops()).
+    // The result is reported like that of the syscall.
+    future<syscall_result<int>> submit_file_metadata_op(internal::io_request req) noexcept;
+    future<syscall_result<int>> fallocate(int fd, int mode, uint64_t position, uint64_t length) noexcept;
+    future<file> open_file_dma_async(sstring name, int open_flags, file_open_options options);
 
     void add_timer(timer<steady_clock_type>*) noexcept;
     bool queue_timer(timer<steady_clock_type>*) noexcept;
@@ -654,6 +784,7 @@ template <typename Func>
     friend class pollable_fd;
     friend class pollable_fd_state;
     friend class posix_file_impl;
+    friend class mapped_file;
     friend class blockdev_file_impl;
     friend class timer<>;
     friend class timer<lowres_clock>;
@@ -661,12 +792,16 @@ template <typename Func>
     friend class smp;
     friend class internal::poller;
     friend class scheduling_group;
+    friend class scheduling_supergroup;
     friend void internal::add_to_flush_poller(output_stream<char>& os) noexcept;
+    friend void internal::account_batch_flush(size_t bytes) noexcept;
+    friend void internal::account_merged_flush() noexcept;
     friend void seastar::internal::increase_thrown_exceptions_counter() noexcept;
     friend void seastar::internal::increase_internal_errors_counter() noexcept;
     friend void internal::report_failed_future(const std::exception_ptr& eptr) noexcept;
     metrics::metric_groups _metric_groups;
-    friend future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares) noexcept;
+    friend future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares, scheduling_supergroup parent) noexcept;
+    friend future<scheduling_supergroup> create_scheduling_supergroup(float shares) noexcept;
     friend future<> seastar::destroy_scheduling_group(scheduling_group) noexcept;
     friend future<> seastar::rename_scheduling_group(scheduling_group sg, sstring new_name, sstring new_shortname) noexcept;
     friend future<scheduling_group_key> scheduling_group_key_create(scheduling_group_key_config cfg) noexcept;
@@ -693,6 +828,21 @@ template <typename Func>
     void set_bypass_fsync(bool value);
     void update_blocked_reactor_notify_ms(std::chrono::milliseconds ms);
     std::chrono::milliseconds get_blocked_reactor_notify_ms() const;
+    /// Sets the average cpu time between two samples of the CPU profiler of
+    /// this shard, 0 disabling it (see \ref reactor_options::cpu_profiler_period_us)
+    void set_cpu_profiler_period(std::chrono::microseconds period);
+    std::chrono::microseconds get_cpu_profiler_period() const;
+    /// Starts recording the tasks this shard runs, with their type and
+    /// scheduling group, the runs of the task queues, I/O requests and
+    /// cross-shard messages into a ring of \c max_events, dropping what was
+    /// recorded before
+    void enable_task_tracing(size_t max_events = 64 * 1024);
+    /// Stops recording, keeping what was recorded so far
+    void disable_task_tracing() noexcept;
+    bool task_tracing_enabled() const noexcept { return _tracing; }
+    /// \cond internal
+    internal::task_tracer* tracing() const noexcept { return _tracing; }
+    /// \endcond
 
     class test {
     public:
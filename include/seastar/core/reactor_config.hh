@@ -25,13 +25,20 @@
 #include <seastar/util/memory_diagnostics.hh>
 #include <seastar/util/modules.hh>
 #include <seastar/core/scheduling.hh>
+#ifndef SEASTAR_MODULE
+#include <optional>
+#endif
 
 namespace seastar {
 
 /// \cond internal
 struct reactor_config {
     sched_clock::duration task_quota;
+    bool task_quota_auto = false;
+    sched_clock::duration task_quota_min = {};
+    sched_clock::duration task_quota_max = {};
     std::chrono::nanoseconds max_poll_time;
+    bool idle_poll_adaptive = false;
     bool handle_sigint = true;
     bool auto_handle_sigint_sigterm = true;
     unsigned max_networking_aio_io_control_blocks = 10000;
@@ -39,9 +46,24 @@ struct reactor_config {
     bool kernel_page_cache = false;
     bool have_aio_fsync = false;
     unsigned max_task_backlog = 1000;
+    bool tsc_clock = false;
     bool strict_o_direct = true;
     bool bypass_fsync = false;
     bool no_poll_aio = false;
+    bool uring_fixed_buffers = false;
+    bool uring_fixed_files = false;
+    bool uring_sqpoll = false;
+    unsigned uring_sqpoll_idle_ms = 0;
+    bool uring_sqpoll_pin_sibling = false;
+    bool uring_multishot_net = false;
+    bool uring_nvme_passthrough = false;
+    size_t zerocopy_send_threshold = 0;
+    unsigned syscall_threads = 0;
+    // The CPU to pin the syscall threads of the shard to, if any
+    std::optional<unsigned> syscall_threads_cpu;
+    unsigned thread_stack_cache = 16;
+    bool thread_stack_mmap = false;
+    bool memory_rebalance = false;
 };
 /// \endcond
 
@@ -65,6 +87,16 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Reduce for overprovisioned environments or laptops.
     program_options::value<unsigned> idle_poll_time_us;
+    /// \brief Adapt the idle polling time to the workload of each shard.
+    ///
+    /// Each shard learns how long it usually stays idle before work arrives.
+    /// It polls for twice that, up to \ref idle_poll_time_us, and goes to
+    /// sleep right away when work usually takes longer to come. Between
+    /// polls it waits with \p TPAUSE where the CPU supports it, or with a
+    /// backing off \p PAUSE, to save power and leave the core to its SMT
+    /// sibling.
+    /// Default: \p false.
+    program_options::value<bool> idle_poll_adaptive;
     /// \brief Busy-poll for disk I/O.
     ///
     /// Reduces latency and increases throughput.
@@ -73,9 +105,42 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Default: 0.5.
     program_options::value<double> task_quota_ms;
+    /// \brief Tune the task quota of each shard to its workload.
+    ///
+    /// The quota starts at \ref task_quota_ms and is lowered when the shard's
+    /// I/O completions are reaped late, polls are delayed past
+    /// \ref task_quota_max_ms or several scheduling groups compete for the
+    /// CPU, and raised while the shard runs CPU-bound work uncontended. It is
+    /// kept between \ref task_quota_min_ms and \ref task_quota_max_ms.
+    ///
+    /// Default: false.
+    program_options::value<bool> task_quota_auto;
+    /// \brief The lowest task quota (ms) \ref task_quota_auto may choose.
+    ///
+    /// Must be positive and not above \ref task_quota_max_ms.
+    ///
+    /// Default: 0.1.
+    program_options::value<double> task_quota_min_ms;
+    /// \brief The highest task quota (ms) \ref task_quota_auto may choose.
+    ///
+    /// Default: 2.
+    program_options::value<double> task_quota_max_ms;
+    /// \brief Read the time from the CPU's time stamp counter.
+    ///
+    /// The reactor reads the time several times per task, to account the
+    /// runtime of the scheduling groups, enforce the task quota and detect
+    /// stalls. When the CPU has an invariant time stamp counter (or on
+    /// aarch64, a generic timer), the time is extrapolated from it instead of
+    /// read from the system's monotonic clock, which costs a fraction of it.
+    /// Each shard calibrates the counter against the monotonic clock every
+    /// second, and uses the monotonic clock for its first second.
+    ///
+    /// Default: \p true.
+    program_options::value<bool> tsc_clock;
     /// \brief Max time (ms) IO operations must take.
     ///
-    /// Default: 1.5 * task_quota_ms value
+    /// Default: 1.5 * task_quota_ms value, or 1.5 * task_quota_max_ms when
+    /// \ref task_quota_auto is set
     program_options::value<double> io_latency_goal_ms;
     /// \bried Dispatch rate to completion rate ratio threshold
     ///
@@ -90,6 +155,53 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Default: infinite (detection is OFF)
     program_options::value<unsigned> io_completion_notify_ms;
+    /// \brief Continuously calibrate the disk model from completion latencies
+    ///
+    /// When enabled, the rate derived from the io-properties is scaled up while
+    /// requests complete within the latency goal and the queues are backlogged,
+    /// and scaled down when completions start exceeding the goal.
+    ///
+    /// Default: false
+    program_options::value<bool> io_online_calibration;
+    /// \brief The lowest factor the calibration may scale the io-properties rate by
+    ///
+    /// Default: 0.5
+    program_options::value<double> io_calibration_min_factor;
+    /// \brief The highest factor the calibration may scale the io-properties rate by
+    ///
+    /// Default: 2.0
+    program_options::value<double> io_calibration_max_factor;
+    /// \brief Fraction of I/O requests to trace the latency breakdown of
+    ///
+    /// The sampled requests have their time in the I/O queue, time till
+    /// submission to the kernel and time in the kernel exported as per-class
+    /// histograms.
+    ///
+    /// Default: 0 (tracing is OFF)
+    program_options::value<double> io_latency_sample_rate;
+    /// \brief Length up to which adjacent reads are merged
+    ///
+    /// Reads of neighbouring ranges of a file that are dispatched together
+    /// are submitted as a single request of up to this many bytes, which
+    /// saves IOPS on devices that are limited by them.
+    ///
+    /// Default: 0 (merging is OFF)
+    program_options::value<unsigned> io_max_merged_read_length;
+    /// \brief Cost of discards relative to writes of the same length
+    ///
+    /// Discards are scheduled by the I/O queues along with the other requests,
+    /// in chunks that are accounted as writes of this fraction of their length.
+    ///
+    /// Default: 0.1
+    program_options::value<double> io_discard_cost_factor;
+    /// \brief Dispatch the requests with a deadline first within their class
+    ///
+    /// Requests issued with an \ref io_intent that has a deadline overtake
+    /// the other requests of their scheduling group once the deadline is
+    /// near, earliest deadline first. The share of each group is unchanged.
+    ///
+    /// Default: false
+    program_options::value<bool> io_deadline_scheduling;
     /// \brief Maximum number of task backlog to allow.
     ///
     /// When the number of tasks grow above this, we stop polling (e.g. I/O)
@@ -109,6 +221,16 @@ struct reactor_options : public program_options::option_group {
     ///
     /// Default: \p true.
     program_options::value<bool> blocked_reactor_report_format_oneline;
+    /// \brief Average cpu time in microseconds between two backtraces
+    /// sampled by the CPU profiler of each shard.
+    ///
+    /// The samples are aggregated by backtrace, scheduling group and whether
+    /// the stall detector was reporting the task, and can be read in pprof
+    /// format (see \ref prometheus::config::cpu_profile). 0 disables the
+    /// profiler.
+    ///
+    /// Default: 0.
+    program_options::value<unsigned> cpu_profiler_period_us;
     /// \brief Allow using buffered I/O if DMA is not available (reduces performance).
     program_options::value<> relaxed_dma;
     /// \brief Use the Linux NOWAIT AIO feature, which reduces reactor stalls due
@@ -180,6 +302,121 @@ struct reactor_options : public program_options::option_group {
     ///
     /// \see max_networking_io_control_blocks
     program_options::value<unsigned> reserve_io_control_blocks;
+    /// \brief Register the shard's memory with io_uring as fixed buffers.
+    ///
+    /// Disk reads and writes into seastar-allocated memory are then submitted
+    /// as \p IORING_OP_READ_FIXED / \p IORING_OP_WRITE_FIXED, which saves the
+    /// kernel from pinning and unpinning the pages on every request. All of
+    /// the shard's memory gets pinned up front, which requires a sufficient
+    /// \p RLIMIT_MEMLOCK (or \p CAP_IPC_LOCK). Only valid for the \p io_uring
+    /// reactor backend (see \ref reactor_backend).
+    ///
+    /// Default: \p false.
+    program_options::value<bool> io_uring_fixed_buffers;
+    /// \brief Register open files with io_uring as fixed files.
+    ///
+    /// Saves the kernel from looking up the file descriptor on every disk
+    /// request. Only valid for the \p io_uring reactor backend (see
+    /// \ref reactor_backend).
+    ///
+    /// Default: \p false.
+    program_options::value<bool> io_uring_fixed_files;
+    /// \brief Submit io_uring requests through a kernel polling thread.
+    ///
+    /// Each shard's ring gets a kernel thread (\p IORING_SETUP_SQPOLL) that
+    /// picks up submissions, so the reactor only enters the kernel to wake
+    /// it up after it went idle. Trades a CPU for far fewer system calls.
+    /// Requires Linux 5.11 or later. Only valid for the \p io_uring reactor
+    /// backend (see \ref reactor_backend).
+    ///
+    /// Default: \p false.
+    program_options::value<bool> io_uring_sqpoll;
+    /// \brief Idle time (ms) after which the io_uring polling thread sleeps.
+    ///
+    /// See \ref io_uring_sqpoll.
+    ///
+    /// Default: 10.
+    program_options::value<unsigned> io_uring_sqpoll_idle_ms;
+    /// \brief Pin the io_uring polling thread to a hyperthread sibling of
+    /// the shard's CPU.
+    ///
+    /// See \ref io_uring_sqpoll. Requires \ref smp_options::thread_affinity.
+    ///
+    /// Default: \p false.
+    program_options::value<bool> io_uring_sqpoll_pin_sibling;
+    /// \brief Use multishot io_uring requests for socket accept and receive.
+    ///
+    /// Each socket arms a single multishot request that keeps delivering
+    /// data into a ring of buffers provided to the kernel up front, instead
+    /// of waiting for readiness and issuing a request per read. Requires Linux
+    /// 6.0 or later. Only valid for the \p io_uring reactor backend (see
+    /// \ref reactor_backend).
+    ///
+    /// Default: \p false.
+    program_options::value<bool> io_uring_multishot_net;
+    /// \brief Pass the I/O of NVMe block devices through to the driver.
+    ///
+    /// Block devices of whole NVMe namespaces, such as \p /dev/nvme0n1, are
+    /// read and written with NVMe commands submitted on their generic
+    /// character device (\p /dev/ng0n1) by io_uring, bypassing the block
+    /// layer. The requests are scheduled by the I/O queue of the device like
+    /// any other. Requests the commands cannot carry (vectored, unaligned to
+    /// the logical block size, or larger than the device transfers at once)
+    /// go through the block layer, as do all requests when the character
+    /// device can't be opened. Requires Linux 5.19 or later and access to
+    /// the character device. Only valid for the \p io_uring reactor backend
+    /// (see \ref reactor_backend).
+    ///
+    /// Default: \p false.
+    program_options::value<bool> io_uring_nvme_passthrough;
+    /// \brief Send large packets on TCP sockets without copying them into the kernel.
+    ///
+    /// Packets of at least this many bytes are sent with \p MSG_ZEROCOPY (or
+    /// \p IORING_OP_SENDMSG_ZC on the \p io_uring reactor backend), and their
+    /// buffers are held until the kernel reports it is done with them. This
+    /// trades a notification per send for the copy, so it only pays off for
+    /// large packets. Not supported by the \p linux-aio reactor backend (see
+    /// \ref reactor_backend), which keeps copying. Zero disables zero-copy sends.
+    ///
+    /// Default: 0.
+    program_options::value<unsigned> zerocopy_send_threshold;
+    /// \brief Number of threads serving each kind of blocking work.
+    ///
+    /// Blocking work, like file operations the reactor backend cannot submit
+    /// asynchronously or process management, is run on helper threads. Zero
+    /// runs all of it on a single thread per shard. Otherwise each kind of
+    /// work gets this many threads of its own, so that one kind cannot hold
+    /// up the others, and work goes to the least busy one: 1 makes three
+    /// threads per shard.
+    ///
+    /// Default: 0.
+    program_options::value<unsigned> syscall_threads;
+    /// \brief Pin the syscall threads of each shard to a hyperthread sibling
+    /// of the shard's CPU.
+    ///
+    /// By default they share the CPU of the shard. Best combined with
+    /// \ref smp_options::shard_placement set to \p one-per-core, so that the
+    /// sibling doesn't host another shard. Requires
+    /// \ref smp_options::thread_affinity.
+    ///
+    /// Default: \p false.
+    program_options::value<bool> syscall_threads_pin_sibling;
+    /// \brief Number of stacks of each size class kept for reuse by seastar threads.
+    ///
+    /// The stacks of exited threads are kept per shard, in power-of-two size
+    /// classes up to 1MiB, and handed to the next threads asking for a stack
+    /// of the same class. Zero frees every stack as its thread exits.
+    ///
+    /// Default: 16.
+    program_options::value<unsigned> thread_stack_cache;
+    /// \brief Map the stacks of seastar threads with mmap().
+    ///
+    /// The stacks are then allocated outside the seastar heap, their pages
+    /// committed only as the threads touch them, and an inaccessible page
+    /// below each of them catches overflows.
+    ///
+    /// Default: false.
+    program_options::value<bool> thread_stack_mmap;
     /// \brief Enable seastar heap profiling.
     ///
     /// Allocations will be sampled every N bytes on average. Zero means off.
@@ -0,0 +1,188 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/shard_id.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/util/assert.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+#endif
+
+namespace seastar {
+
+/// \cond internal
+namespace internal {
+
+// The part of replicated<T> which doesn't depend on T: the snapshots it
+// replaced, which the owner shard frees once every shard went through a
+// quiescent state (see internal::quiescent_epoch) since they were
+// replaced, and thus dropped the references it had to them.
+class replicated_base {
+    using dispose_fn = void (*)(const void*) noexcept;
+    struct retired_snapshot {
+        const void* snapshot = nullptr;
+        dispose_fn dispose = nullptr;
+        // The epochs of the shards sampled after the snapshot was
+        // replaced, shared by the snapshots retired in between two
+        // samplings. Sampling costs a system-wide memory barrier, so it is
+        // done when reclaiming rather than on each publication.
+        lw_shared_ptr<std::vector<uint64_t>> epochs;
+    };
+    const shard_id _owner;
+    std::deque<retired_snapshot> _retired;
+    timer<lowres_clock> _reclaim_timer;
+    std::optional<shared_promise<>> _reclaimed;
+
+    void reclaim() noexcept;
+protected:
+    replicated_base();
+    // Frees the retired snapshots without waiting
+    ~replicated_base();
+
+    shard_id owner() const noexcept { return _owner; }
+    // Makes room for retiring a snapshot, so that retire() doesn't fail
+    void prepare_retire();
+    // Retires the snapshot prepare_retire() made room for
+    void retire(const void* snapshot, dispose_fn dispose) noexcept;
+    // Resolves once all the retired snapshots are freed
+    future<> wait_reclaimed() noexcept;
+};
+
+}
+/// \endcond
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup smp-module
+/// @{
+
+/// \brief Read-mostly state shared by all shards, replaced by publishing
+/// immutable snapshots of it.
+///
+/// Replicating read-mostly state (schemas, routing tables, configuration)
+/// with \ref sharded keeps a copy on every shard, which each update has to
+/// reach with a message. A replicated object keeps a single copy instead,
+/// which every shard reads directly, without any atomic read-modify-write
+/// or cross-shard reference counting.
+///
+/// Updates are made on the shard which created the object, the owner, by
+/// publishing a new snapshot. Readers which got the previous snapshot may
+/// go on using it until they return to the reactor: the owner frees it
+/// once every shard went through its event loop since, or was asleep.
+/// References obtained with get() must therefore not be kept across a
+/// preemption point, e.g. a continuation or a \c co_await; copy what is
+/// needed instead.
+///
+/// \code
+/// static replicated<routing_table> routes(initial_routes);
+/// // on any shard
+/// auto shard = routes->lookup(key);
+/// // on the owner
+/// routes.update([&] (routing_table& t) { t.add(range, shard); });
+/// \endcode
+///
+/// The object must outlive the readers of all shards, and stop() must be
+/// called before it is destroyed when other shards may have read it.
+template <typename T>
+class replicated : private internal::replicated_base {
+    std::atomic<const T*> _current;
+
+    static void dispose(const void* snapshot) noexcept {
+        delete static_cast<const T*>(snapshot);
+    }
+public:
+    /// Constructs the first snapshot from \c args. The calling shard
+    /// becomes the owner.
+    template <typename... Args>
+    explicit replicated(Args&&... args)
+        : _current(new T(std::forward<Args>(args)...))
+    {}
+    replicated(replicated&&) = delete;
+    ~replicated() {
+        delete _current.load(std::memory_order_relaxed);
+    }
+
+    /// The shard which created the object, where it is updated
+    using internal::replicated_base::owner;
+
+    /// The current snapshot, from any shard. The reference stays valid
+    /// until the calling task returns to the reactor.
+    const T& get() const noexcept {
+        return *_current.load(std::memory_order_acquire);
+    }
+    const T& operator*() const noexcept { return get(); }
+    const T* operator->() const noexcept { return &get(); }
+
+    /// Replaces the snapshot, on the owner shard. The previous one is freed
+    /// once no shard can refer to it anymore.
+    void publish(std::unique_ptr<const T> snapshot) {
+        SEASTAR_ASSERT(this_shard_id() == owner());
+        SEASTAR_ASSERT(snapshot);
+        prepare_retire();
+        retire(_current.exchange(snapshot.release(), std::memory_order_seq_cst), dispose);
+    }
+    void publish(T value) {
+        publish(std::make_unique<const T>(std::move(value)));
+    }
+
+    /// Publishes a copy of the current snapshot, modified by
+    /// \c func(T&), on the owner shard
+    template <typename Func>
+    void update(Func&& func) {
+        auto copy = std::make_unique<T>(get());
+        std::forward<Func>(func)(*copy);
+        publish(std::unique_ptr<const T>(std::move(copy)));
+    }
+
+    /// Frees all the snapshots, the current one included, once no shard
+    /// can refer to them anymore, on the owner shard. To be called before
+    /// the object is destroyed, once no new reads can start; get() must not
+    /// be called from then on.
+    future<> stop() noexcept {
+        if (_current.load(std::memory_order_relaxed)) {
+            try {
+                prepare_retire();
+            } catch (...) {
+                return current_exception_as_future();
+            }
+            retire(_current.exchange(nullptr, std::memory_order_seq_cst), dispose);
+        }
+        return wait_reclaimed();
+    }
+};
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
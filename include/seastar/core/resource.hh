@@ -90,6 +90,15 @@ struct topology_holder {};
 
 SEASTAR_MODULE_EXPORT_BEGIN
 
+/// How shards are placed on the CPUs of the cpuset
+enum class shard_placement {
+    /// Any hardware thread may host a shard
+    spread,
+    /// One shard per physical core, on its first hardware thread, leaving
+    /// the SMT siblings to interrupts, syscall threads and other processes
+    one_per_core,
+};
+
 struct configuration {
     optional<size_t> total_memory;
     optional<size_t> reserve_memory;  // if total_memory not specified
@@ -99,6 +108,7 @@ struct configuration {
     bool assign_orphan_cpus = false;
     std::vector<unsigned> io_queues;
     unsigned num_io_groups;
+    shard_placement placement = shard_placement::spread;
     hwloc::internal::topology_holder topology;
 };
 
@@ -125,6 +135,15 @@ struct io_queue_topology {
 struct cpu {
     unsigned cpu_id;
     std::vector<memory> mem;
+    /// The physical core of the CPU (hwloc logical index)
+    unsigned core = 0;
+    /// The last-level cache the CPU shares with other cores, e.g. the L3 of
+    /// a CCX on AMD chiplet CPUs (hwloc logical index)
+    unsigned cache_domain = 0;
+    /// The NUMA node of the CPU
+    unsigned numa_node = 0;
+    /// The other hardware threads of the core that are in the cpuset
+    std::vector<unsigned> siblings;
 };
 
 struct resources {
@@ -135,6 +154,8 @@ struct resources {
 
 resources allocate(configuration& c);
 unsigned nr_processing_units(configuration& c);
+/// The number of physical cores the cpuset of the configuration spans
+unsigned nr_physical_cores(configuration& c);
 
 SEASTAR_MODULE_EXPORT_END
 
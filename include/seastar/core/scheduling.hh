@@ -44,6 +44,7 @@ class future;
 class reactor;
 
 class scheduling_group;
+class scheduling_supergroup;
 class scheduling_group_key;
 
 using sched_clock = std::chrono::steady_clock;
@@ -55,6 +56,10 @@ namespace internal {
 unsigned scheduling_group_index(scheduling_group sg) noexcept;
 scheduling_group scheduling_group_from_index(unsigned index) noexcept;
 
+// Returns an index between 1 and max_scheduling_groups(), 0 stands for the root
+unsigned scheduling_supergroup_index(scheduling_supergroup sg) noexcept;
+scheduling_supergroup scheduling_supergroup_from_index(unsigned index) noexcept;
+
 unsigned long scheduling_group_key_id(scheduling_group_key) noexcept;
 
 template<typename T>
@@ -91,6 +96,26 @@ future<scheduling_group> create_scheduling_group(sstring name, float shares) noe
 /// \return a scheduling group that can be used on any shard
 future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares) noexcept;
 
+/// Creates a scheduling group nested into a supergroup.
+///
+/// Same as \ref create_scheduling_group(sstring, sstring, float), but the CPU
+/// time and the I/O of the new group are accounted against the \c parent
+/// supergroup, see \ref scheduling_supergroup.
+///
+/// \param parent the supergroup to nest the new group into
+/// \return a scheduling group that can be used on any shard
+future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares, scheduling_supergroup parent) noexcept;
+
+/// Creates a scheduling supergroup with a specified number of shares.
+///
+/// The operation is global and affects all shards. The returned supergroup
+/// can then be used as a parent for scheduling groups on any shard.
+///
+/// \param shares number of shares of the CPU time and of the I/O capacity allotted
+///               to the supergroup as a whole; Use numbers in the 1-1000 range (but can go above).
+/// \return a scheduling supergroup that can be used on any shard
+future<scheduling_supergroup> create_scheduling_supergroup(float shares) noexcept;
+
 /// Destroys a scheduling group.
 ///
 /// Destroys a \ref scheduling_group previously created with create_scheduling_group().
@@ -334,6 +359,48 @@ class scheduling_group {
     /// the calling shard
     float get_shares() const noexcept;
 
+    /// Limits the CPU time the group may use.
+    ///
+    /// Shares only divide the CPU time between the groups that compete for it,
+    /// a group with few shares still consumes all of the CPU when the others are
+    /// idle. A limit caps the group's runtime to the given fraction of every 100ms
+    /// period even if the CPU would otherwise be idle, which leaves headroom for
+    /// load that can appear suddenly in other groups. Once the group exhausts its
+    /// limit, its tasks are not run until the period ends. The adjustment is local
+    /// to the shard.
+    ///
+    /// \param fraction the fraction of the CPU time allotted to the group, in the
+    ///                 (0, 1) range; 0 or 1 remove the limit.
+    void set_cpu_limit(float fraction) noexcept;
+
+    /// Returns the fraction of the CPU time the group is limited to, 0 if unlimited
+    ///
+    /// Similarly to the \ref set_cpu_limit, the returned value is only relevant to
+    /// the calling shard
+    float get_cpu_limit() const noexcept;
+
+    /// Sets a target of the latency of the group's IO requests
+    ///
+    /// Every period the IO queues check the latency of the requests of the
+    /// groups which have a target, from queueing till completion, at the given
+    /// percentile. While any target is missed, the IO shares of the groups which
+    /// have minimum shares (see \ref set_io_min_shares) are lowered towards
+    /// their minimum, and once all are met they recover to the group's shares
+    /// again. The adjustment is local to the shard.
+    ///
+    /// \param latency the target, 0 removes it
+    /// \param percentile the percentile of the latencies, in the [0, 1] range
+    void set_io_latency_target(std::chrono::microseconds latency, double percentile = 0.99);
+
+    /// Lets the IO queues lower the group's IO shares down to the given value
+    /// to meet the latency targets of other groups
+    ///
+    /// See \ref set_io_latency_target. Calling \ref set_shares restores the
+    /// group's shares.
+    ///
+    /// \param min_shares the lowest shares, 0 keeps the shares fixed
+    void set_io_min_shares(float min_shares);
+
     /// \brief Updates the current IO bandwidth for a given scheduling group
     ///
     /// The bandwidth applied is NOT shard-local, instead it is applied so that
@@ -343,7 +410,23 @@ class scheduling_group {
     /// \return a future that is ready when the bandwidth update is applied
     future<> update_io_bandwidth(uint64_t bandwidth) const;
 
-    friend future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares) noexcept;
+    /// \brief Caps the IO bandwidth of a scheduling group across all devices
+    ///
+    /// Unlike \ref update_io_bandwidth, which limits the group on each device
+    /// separately, the budget is shared by all devices and all shards, so that
+    /// the group cannot consume more bytes-per-second on all disks altogether.
+    /// Both limits apply when set. The maximum uint64_t value lifts the budget
+    ///
+    /// \param bandwidth the new budget in bytes/second
+    /// \return a future that is ready when the budget is applied
+    future<> update_io_bandwidth_budget(uint64_t bandwidth) const;
+
+    /// Returns the supergroup the group was created in
+    ///
+    /// A group created without a supergroup belongs to the root one.
+    scheduling_supergroup io_supergroup() const noexcept;
+
+    friend future<scheduling_group> create_scheduling_group(sstring name, sstring shortname, float shares, scheduling_supergroup parent) noexcept;
     friend future<> destroy_scheduling_group(scheduling_group sg) noexcept;
     friend future<> rename_scheduling_group(scheduling_group sg, sstring new_name, sstring new_shortname) noexcept;
     friend class reactor;
@@ -367,6 +450,43 @@ class scheduling_group {
 
 };
 
+/// \brief Identifies a set of scheduling groups sharing the CPU and the I/O capacity
+///
+/// Supergroups allow building two-level hierarchies, for example one supergroup
+/// per tenant with the tenant's workloads as the scheduling groups in it. The
+/// supergroup competes for the CPU and the disk with the other supergroups and
+/// the groups that are not nested into any supergroup, and the time and
+/// capacity it gets are split between its groups proportionally to their
+/// shares. The shares of nested groups therefore only matter relative to
+/// the other groups of the same supergroup.
+class scheduling_supergroup {
+    unsigned _id;
+private:
+    explicit scheduling_supergroup(unsigned id) noexcept : _id(id) {}
+public:
+    /// Creates a `scheduling_supergroup` object denoting the root, i.e. no supergroup
+    constexpr scheduling_supergroup() noexcept : _id(0) {}
+    bool operator==(scheduling_supergroup x) const noexcept { return _id == x._id; }
+    bool operator!=(scheduling_supergroup x) const noexcept { return _id != x._id; }
+    bool is_root() const noexcept { return _id == 0; }
+
+    /// Adjusts the number of shares allotted to the supergroup.
+    ///
+    /// Similarly to \ref scheduling_group::set_shares, the adjustment is local
+    /// to the shard. Must not be called on the root supergroup.
+    ///
+    /// \param shares number of shares allotted to the supergroup. Use numbers
+    ///               in the 1-1000 range.
+    void set_shares(float shares) noexcept;
+
+    /// Returns the number of shares the supergroup has on the calling shard
+    float get_shares() const noexcept;
+
+    friend future<scheduling_supergroup> create_scheduling_supergroup(float shares) noexcept;
+    friend unsigned internal::scheduling_supergroup_index(scheduling_supergroup sg) noexcept;
+    friend scheduling_supergroup internal::scheduling_supergroup_from_index(unsigned index) noexcept;
+};
+
 /// \cond internal
 SEASTAR_MODULE_EXPORT_END
 namespace internal {
@@ -383,6 +503,18 @@ scheduling_group_from_index(unsigned index) noexcept {
     return scheduling_group(index);
 }
 
+inline
+unsigned
+scheduling_supergroup_index(scheduling_supergroup sg) noexcept {
+    return sg._id;
+}
+
+inline
+scheduling_supergroup
+scheduling_supergroup_from_index(unsigned index) noexcept {
+    return scheduling_supergroup(index);
+}
+
 #ifdef SEASTAR_BUILD_SHARED_LIBS
 scheduling_group*
 current_scheduling_group_ptr() noexcept;
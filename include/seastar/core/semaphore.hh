@@ -28,6 +28,7 @@
 #include <seastar/core/abortable_fifo.hh>
 #include <seastar/core/timed_out_error.hh>
 #include <seastar/core/abort_on_expiry.hh>
+#include <seastar/core/preallocated_exception.hh>
 #include <seastar/util/assert.hh>
 #include <seastar/util/modules.hh>
 #ifndef SEASTAR_MODULE
@@ -35,6 +36,7 @@
 #include <optional>
 #include <stdexcept>
 #include <utility>
+#include <variant>
 #endif
 
 namespace seastar {
@@ -131,6 +133,16 @@ struct named_semaphore_exception_factory {
     named_semaphore_aborted aborted() const noexcept;
 };
 
+/// Outcome of a \ref basic_semaphore::wait_nothrow() call
+enum class semaphore_wait_result {
+    /// The units were acquired
+    acquired,
+    /// The timeout expired before the units could be acquired
+    timed_out,
+    /// The abort source was triggered before the units could be acquired
+    aborted,
+};
+
 /// \brief Counted resource guard.
 ///
 /// This is a standard computer science semaphore, adapted
@@ -161,12 +173,39 @@ class basic_semaphore : private ExceptionFactory {
     ssize_t _count;
     std::exception_ptr _ex;
     struct entry {
-        promise<> pr;
+        // waiters of wait_nothrow() are told of timeouts and aborts by value
+        std::variant<promise<>, promise<semaphore_wait_result>> pr;
         size_t nr;
         std::optional<abort_on_expiry<clock>> timer;
         entry(promise<>&& pr_, size_t nr_) noexcept : pr(std::move(pr_)), nr(nr_) {}
+        entry(promise<semaphore_wait_result>&& pr_, size_t nr_) noexcept : pr(std::move(pr_)), nr(nr_) {}
+
+        void set_value() noexcept {
+            if (auto p = std::get_if<promise<>>(&pr)) [[likely]] {
+                p->set_value();
+            } else {
+                std::get<promise<semaphore_wait_result>>(pr).set_value(semaphore_wait_result::acquired);
+            }
+        }
+        void set_exception(std::exception_ptr ex) noexcept {
+            std::visit([&ex] (auto& p) { p.set_exception(std::move(ex)); }, pr);
+        }
+        // Fails the wait with either the result, for wait_nothrow(), or
+        // the exception the factory makes
+        template <typename MakeException>
+        void fail(semaphore_wait_result result, MakeException&& make_exception) noexcept {
+            if (auto p = std::get_if<promise<semaphore_wait_result>>(&pr)) {
+                p->set_value(result);
+            } else {
+                std::get<promise<>>(pr).set_exception(make_exception());
+            }
+        }
     };
     std::exception_ptr get_timeout_exception() {
+        // shedding waiters on overload fails many of them
+        if constexpr (std::is_same_v<exception_factory, semaphore_default_exception_factory>) {
+            return preallocated_exception<semaphore_timed_out>();
+        }
         try {
             return std::make_exception_ptr(this->timeout());
         } catch (...) {
@@ -174,7 +213,9 @@ class basic_semaphore : private ExceptionFactory {
         }
     }
     std::exception_ptr get_aborted_exception() {
-        if constexpr (internal::has_aborted<exception_factory>::value) {
+        if constexpr (std::is_same_v<exception_factory, semaphore_default_exception_factory>) {
+            return preallocated_exception<semaphore_aborted>();
+        } else if constexpr (internal::has_aborted<exception_factory>::value) {
             try {
                 return std::make_exception_ptr(this->aborted());
             } catch (...) {
@@ -188,13 +229,13 @@ class basic_semaphore : private ExceptionFactory {
         basic_semaphore& sem;
         void operator()(entry& e, const std::optional<std::exception_ptr>& ex) noexcept {
             if (e.timer) {
-                e.pr.set_exception(sem.get_timeout_exception());
+                e.fail(semaphore_wait_result::timed_out, [this] { return sem.get_timeout_exception(); });
             } else if (ex) {
-                e.pr.set_exception(*ex);
+                e.fail(semaphore_wait_result::aborted, [&ex] { return *ex; });
             } else if (sem._ex) {
-                e.pr.set_exception(sem._ex);
+                e.set_exception(sem._ex);
             } else {
-                e.pr.set_exception(sem.get_aborted_exception());
+                e.fail(semaphore_wait_result::aborted, [this] { return sem.get_aborted_exception(); });
             }
         }
     };
@@ -234,6 +275,27 @@ class basic_semaphore : private ExceptionFactory {
     bool may_proceed(size_t nr) const noexcept {
         return has_available_units(nr) && _wait_list.empty();
     }
+
+    template <typename... T>
+    future<T...> enqueue(time_point timeout, size_t nr) {
+        entry& e = _wait_list.emplace_back(promise<T...>(), nr);
+        auto f = std::get<promise<T...>>(e.pr).get_future();
+        if (timeout != time_point::max()) {
+            e.timer.emplace(timeout);
+            abort_source& as = e.timer->abort_source();
+            _wait_list.make_back_abortable(as);
+        }
+        return f;
+    }
+
+    template <typename... T>
+    future<T...> enqueue(abort_source& as, size_t nr) {
+        entry& e = _wait_list.emplace_back(promise<T...>(), nr);
+        // taking future here since make_back_abortable may expire the entry
+        auto f = std::get<promise<T...>>(e.pr).get_future();
+        _wait_list.make_back_abortable(as);
+        return f;
+    }
 public:
     /// Returns the maximum number of units the semaphore counter can hold
     static constexpr size_t max_counter() noexcept {
@@ -333,14 +395,7 @@ class basic_semaphore : private ExceptionFactory {
             return make_exception_future(get_timeout_exception());
         }
         try {
-            entry& e = _wait_list.emplace_back(promise<>(), nr);
-            auto f = e.pr.get_future();
-            if (timeout != time_point::max()) {
-                e.timer.emplace(timeout);
-                abort_source& as = e.timer->abort_source();
-                _wait_list.make_back_abortable(as);
-            }
-            return f;
+            return enqueue<>(timeout, nr);
         } catch (...) {
             return make_exception_future(std::current_exception());
         }
@@ -372,11 +427,7 @@ class basic_semaphore : private ExceptionFactory {
             return make_exception_future(get_aborted_exception());
         }
         try {
-            entry& e = _wait_list.emplace_back(promise<>(), nr);
-            // taking future here since make_back_abortable may expire the entry
-            auto f = e.pr.get_future();
-            _wait_list.make_back_abortable(as);
-            return f;
+            return enqueue<>(as, nr);
         } catch (...) {
             return make_exception_future(std::current_exception());
         }
@@ -398,6 +449,73 @@ class basic_semaphore : private ExceptionFactory {
     future<> wait(duration timeout, size_t nr = 1) noexcept {
         return wait(clock::now() + timeout, nr);
     }
+
+    /// Waits until at least a specific number of units are available in the
+    /// counter, and reduces the counter by that amount of units, reporting a
+    /// timeout by value rather than by exception.
+    ///
+    /// Unlike \ref wait(time_point, size_t), no exception is created when the
+    /// wait times out, which matters when many waiters time out at once
+    /// under overload.
+    ///
+    /// \param timeout expiration time.
+    /// \param nr Amount of units to wait for (default 1).
+    /// \return a future holding \ref semaphore_wait_result::acquired once the
+    ///         units are acquired, or \ref semaphore_wait_result::timed_out.
+    ///         If the semaphore was \ref broken(), contains the exception it
+    ///         was broken with.
+    future<semaphore_wait_result> wait_nothrow(time_point timeout, size_t nr = 1) noexcept {
+        _used.use();
+        if (may_proceed(nr)) {
+            _count -= nr;
+            return make_ready_future<semaphore_wait_result>(semaphore_wait_result::acquired);
+        }
+        if (_ex) {
+            return make_exception_future<semaphore_wait_result>(_ex);
+        }
+        if (Clock::now() >= timeout) [[unlikely]] {
+            return make_ready_future<semaphore_wait_result>(semaphore_wait_result::timed_out);
+        }
+        try {
+            return enqueue<semaphore_wait_result>(timeout, nr);
+        } catch (...) {
+            return current_exception_as_future<semaphore_wait_result>();
+        }
+    }
+
+    /// Like \ref wait_nothrow(time_point, size_t), with a timeout relative to now.
+    future<semaphore_wait_result> wait_nothrow(duration timeout, size_t nr = 1) noexcept {
+        return wait_nothrow(clock::now() + timeout, nr);
+    }
+
+    /// Waits until at least a specific number of units are available in the
+    /// counter, and reduces the counter by that amount of units, reporting an
+    /// abort by value rather than by exception.
+    ///
+    /// \param as abort source.
+    /// \param nr Amount of units to wait for (default 1).
+    /// \return a future holding \ref semaphore_wait_result::acquired once the
+    ///         units are acquired, or \ref semaphore_wait_result::aborted.
+    ///         If the semaphore was \ref broken(), contains the exception it
+    ///         was broken with.
+    future<semaphore_wait_result> wait_nothrow(abort_source& as, size_t nr = 1) noexcept {
+        _used.use();
+        if (may_proceed(nr)) {
+            _count -= nr;
+            return make_ready_future<semaphore_wait_result>(semaphore_wait_result::acquired);
+        }
+        if (_ex) {
+            return make_exception_future<semaphore_wait_result>(_ex);
+        }
+        if (as.abort_requested()) [[unlikely]] {
+            return make_ready_future<semaphore_wait_result>(semaphore_wait_result::aborted);
+        }
+        try {
+            return enqueue<semaphore_wait_result>(as, nr);
+        } catch (...) {
+            return current_exception_as_future<semaphore_wait_result>();
+        }
+    }
     /// Deposits a specified number of units into the counter.
     ///
     /// The counter is incremented by the specified number of units.
@@ -415,7 +533,7 @@ class basic_semaphore : private ExceptionFactory {
         while (!_wait_list.empty() && has_available_units(_wait_list.front().nr)) {
             auto& x = _wait_list.front();
             _count -= x.nr;
-            x.pr.set_value();
+            x.set_value();
             _wait_list.pop_front();
         }
     }
@@ -514,7 +632,7 @@ basic_semaphore<ExceptionFactory, Clock>::broken(std::exception_ptr xp) noexcept
     _count = 0;
     while (!_wait_list.empty()) {
         auto& x = _wait_list.front();
-        x.pr.set_exception(xp);
+        x.set_exception(xp);
         _wait_list.pop_front();
     }
 }
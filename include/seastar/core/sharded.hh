@@ -28,6 +28,7 @@
 #include <seastar/util/is_smart_ptr.hh>
 #include <seastar/util/tuple_utils.hh>
 #include <seastar/core/do_with.hh>
+#include <seastar/core/when_all.hh>
 #include <seastar/util/assert.hh>
 #include <seastar/util/log.hh>
 #include <seastar/util/modules.hh>
@@ -37,6 +38,7 @@
 #include <functional>
 #include <ranges>
 #include <type_traits>
+#include <vector>
 #endif
 
 /// \defgroup smp-module Multicore
@@ -106,6 +108,21 @@ template<typename R>
 concept unsigned_range = std::ranges::range<R>
     && std::is_unsigned_v<std::ranges::range_value_t<R>>;
 
+// The shards in the order sharded::tree_map_reduce() combines their results,
+// with the shards of a NUMA node next to each other
+struct shard_reduction_tree {
+    std::vector<unsigned> shards;
+    // The NUMA node of each of the shards above
+    std::vector<unsigned> nodes;
+
+    // Where the results of the shards in [lo, hi) are split in two halves,
+    // on a NUMA node boundary if the range spans several nodes, so that
+    // results only cross nodes in the last rounds
+    size_t split(size_t lo, size_t hi) const noexcept;
+};
+
+shard_reduction_tree make_shard_reduction_tree(unsigned nr_shards);
+
 } // internal
 
 
@@ -462,6 +479,31 @@ class sharded {
                             std::move(reduce));
     }
 
+    /// Applies a map function to all shards, then reduces the results
+    /// pairwise, in a tree.
+    ///
+    /// \ref map_reduce0() gathers the results of all shards on the calling
+    /// shard, which folds them one at a time. Here each shard reduces its own
+    /// result with those of up to log2(smp::count) others, the shards of a NUMA
+    /// node among themselves first, so the reductions run in parallel and
+    /// results only cross nodes in the last rounds. That pays off for large
+    /// results, such as histograms or top-K sets.
+    ///
+    /// \param map callable with the signature `Value (Service&)` or
+    ///            `future<Value> (Service&)` (for some `Value` type).
+    /// \param reduce callable with the signature `Value (Value, Value)` or
+    ///            `future<Value> (Value, Value)`. The results are combined in
+    ///            the order of the topology rather than of the shards, so it
+    ///            must be associative and commutative.
+    ///
+    /// \c map and \c reduce are called on all shards through a const reference
+    /// to the copies held by the calling shard, so they must be safe for that.
+    ///
+    /// \return the reduction of the results of \c map on all shards
+    template <typename Mapper, typename Reduce, typename Future = futurize_t<std::invoke_result_t<const Mapper&, Service&>>,
+              typename Value = decltype(internal::untuple(std::declval<typename Future::tuple_type>()))>
+    future<Value> tree_map_reduce(Mapper map, Reduce reduce);
+
     /// The const version of \ref map_reduce0(Mapper map, Initial initial, Reduce reduce)
     template <typename Mapper, typename Initial, typename Reduce>
     future<Initial>
@@ -670,6 +712,42 @@ sharded<Service>::start_single(Args&&... args) noexcept {
   }
 }
 
+template <typename Service>
+template <typename Mapper, typename Reduce, typename Future, typename Value>
+future<Value>
+sharded<Service>::tree_map_reduce(Mapper map, Reduce reduce) {
+    struct context {
+        sharded& self;
+        Mapper map;
+        Reduce reduce;
+        internal::shard_reduction_tree tree;
+
+        // Reduces the results of the shards in [lo, hi) of the tree, on the
+        // first of them
+        future<Value> run(size_t lo, size_t hi) const {
+            if (hi - lo == 1) {
+                return futurize_invoke(map, *self.get_local_service());
+            }
+            auto mid = tree.split(lo, hi);
+            return when_all_succeed(run(lo, mid), smp::submit_to(tree.shards[mid], [this, mid, hi] {
+                return run(mid, hi);
+            })).then_unpack([this] (Value left, Value right) {
+                return futurize_invoke(reduce, std::move(left), std::move(right));
+            });
+        }
+    };
+
+  try {
+    return do_with(context{*this, std::move(map), std::move(reduce), internal::make_shard_reduction_tree(_instances.size())}, [] (context& ctx) {
+        return smp::submit_to(ctx.tree.shards.front(), [&ctx] {
+            return ctx.run(0, ctx.tree.shards.size());
+        });
+    });
+  } catch (...) {
+    return current_exception_as_future<Value>();
+  }
+}
+
 namespace internal {
 
 // Helper check if Service::stop exists
@@ -952,10 +1030,30 @@ class foreign_ptr {
     PtrType _value;
     unsigned _cpu;
 private:
+    struct destroy_item final : internal::cross_shard_destroy_item {
+        PtrType value;
+        explicit destroy_item(PtrType&& p) noexcept : value(std::move(p)) {}
+        void destroy() noexcept override {
+            value = {};
+        }
+    };
+
     void destroy(PtrType p, unsigned cpu) noexcept {
         // `destroy()` is called from the destructor and other
         // synchronous methods (like `reset()`), that have no way to
-        // wait for this future.
+        // wait for this future. Nobody waits, so the destruction is
+        // batched with the others queued for the same shard.
+        if constexpr (std::is_nothrow_move_constructible_v<PtrType>) {
+            if (p && cpu != this_shard_id()) {
+                try {
+                    // p is only moved from once the item is allocated
+                    smp::destroy_on(cpu, std::make_unique<destroy_item>(std::move(p)));
+                    return;
+                } catch (...) {
+                    // fall back to a message of its own
+                }
+            }
+        }
         auto f = destroy_on(std::move(p), cpu);
         if (!f.available() || f.failed()) {
             internal::run_in_background(std::move(f));
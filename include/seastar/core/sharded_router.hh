@@ -0,0 +1,244 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/gate.hh>
+#include <seastar/core/make_task.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/util/noncopyable_function.hh>
+#include <seastar/util/modules.hh>
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#endif
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// \addtogroup smp-module
+/// @{
+
+/// Places a key hash on one of \c buckets with jump consistent hashing
+/// (Lamping and Veach): when the number of buckets grows by one, only the
+/// keys moving to the new bucket change place. Takes O(log(buckets)).
+inline unsigned jump_consistent_hash(uint64_t hash, unsigned buckets) noexcept {
+    int64_t b = -1;
+    int64_t j = 0;
+    while (j < int64_t(buckets)) {
+        b = j;
+        hash = hash * 2862933555777941757ULL + 1;
+        j = (b + 1) * (double(int64_t(1) << 31) / double((hash >> 33) + 1));
+    }
+    return b;
+}
+
+/// Places a key hash on one of \c buckets with rendezvous (highest random
+/// weight) hashing: the key goes to the bucket it scores highest with, so
+/// that adding or removing any bucket only moves the keys of that bucket.
+/// Takes O(buckets).
+inline unsigned rendezvous_hash(uint64_t hash, unsigned buckets) noexcept {
+    unsigned best = 0;
+    uint64_t best_score = 0;
+    for (unsigned b = 0; b < buckets; b++) {
+        // splitmix64 finalizer of the key and the bucket
+        uint64_t z = hash ^ ((b + 1) * 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z ^= z >> 31;
+        if (b == 0 || z > best_score) {
+            best = b;
+            best_score = z;
+        }
+    }
+    return best;
+}
+
+/// Placement of \ref sharded_router with \ref jump_consistent_hash()
+struct jump_hash_placement {
+    unsigned operator()(uint64_t hash, unsigned shards) const noexcept {
+        return jump_consistent_hash(hash, shards);
+    }
+};
+
+/// Placement of \ref sharded_router with \ref rendezvous_hash()
+struct rendezvous_placement {
+    unsigned operator()(uint64_t hash, unsigned shards) const noexcept {
+        return rendezvous_hash(hash, shards);
+    }
+};
+
+/// Statistics of a \ref sharded_router
+struct sharded_router_stats {
+    uint64_t local = 0; ///< operations run on the calling shard
+    uint64_t forwarded = 0; ///< operations sent to another shard
+    uint64_t batches = 0; ///< messages carrying batched operations
+
+    /// The share of operations sent to another shard
+    double forwarding_ratio() const noexcept {
+        auto total = local + forwarded;
+        return total ? double(forwarded) / total : 0.0;
+    }
+};
+
+/// Routes keyed operations to the shard of a \ref sharded service owning
+/// the key.
+///
+/// The key is hashed with \c Hash, and the hash placed on a shard with
+/// \c Placement, called with the hash and \ref smp::count. The consistent
+/// placements, \ref jump_hash_placement and \ref rendezvous_placement, move
+/// few keys when the number of shards changes, which keeps the data of a
+/// service persisted per shard mostly in place across such restarts.
+///
+/// Operations run right away on the calling shard when it owns the key.
+/// invoke_on() sends the others in a message each, while invoke_batched()
+/// queues them until the tasks already scheduled ran, and sends those for
+/// the same shard in a single message.
+///
+/// A router is used on the shard it was made on, typically one per shard,
+/// and must be stopped with stop() before it's destroyed.
+template <typename Service, typename Key, typename Hash = std::hash<Key>, typename Placement = jump_hash_placement>
+class sharded_router {
+    using completion = noncopyable_function<void ()>;
+    // Runs on the owning shard, and makes what completes the operation on
+    // the calling one
+    using operation = noncopyable_function<future<completion> (Service&)>;
+
+    sharded<Service>& _service;
+    Hash _hash;
+    Placement _placement;
+    std::vector<std::vector<operation>> _pending;
+    bool _flush_scheduled = false;
+    sharded_router_stats _stats;
+    gate _gate;
+
+    void flush(const gate::holder& h) {
+        _flush_scheduled = false;
+        for (shard_id shard = 0; shard < _pending.size(); shard++) {
+            if (_pending[shard].empty()) {
+                continue;
+            }
+            _stats.batches++;
+            auto ops = std::exchange(_pending[shard], {});
+            (void)_service.invoke_on(shard, [ops = std::move(ops)] (Service& s) mutable {
+                std::vector<future<completion>> done;
+                done.reserve(ops.size());
+                for (auto& op : ops) {
+                    done.push_back(op(s));
+                }
+                return when_all(done.begin(), done.end());
+            }).then([h] (std::vector<future<completion>> done) {
+                for (auto& f : done) {
+                    f.get()();
+                }
+            });
+        }
+    }
+
+    void schedule_flush() {
+        if (!_flush_scheduled) {
+            // fails once stopped
+            auto h = _gate.hold();
+            schedule(make_task([this, h = std::move(h)] {
+                flush(h);
+            }));
+            _flush_scheduled = true;
+        }
+    }
+public:
+    explicit sharded_router(sharded<Service>& service, Hash hash = {}, Placement placement = {})
+        : _service(service)
+        , _hash(std::move(hash))
+        , _placement(std::move(placement))
+        , _pending(smp::count)
+    {}
+
+    sharded_router(sharded_router&&) = delete;
+
+    /// The shard owning \c key
+    shard_id shard_of(const Key& key) const noexcept {
+        return _placement(uint64_t(_hash(key)), smp::count);
+    }
+
+    /// Runs \c func with the service of the shard owning \c key, in a
+    /// message of its own if it's another shard. See \ref sharded::invoke_on().
+    ///
+    /// \c func and its result are moved across shards, \c key is not.
+    template <typename Func>
+    futurize_t<std::invoke_result_t<Func, Service&>> invoke_on(const Key& key, Func&& func) {
+        auto shard = shard_of(key);
+        if (shard == this_shard_id()) {
+            _stats.local++;
+            return futurize_invoke(std::forward<Func>(func), _service.local());
+        }
+        _stats.forwarded++;
+        return _service.invoke_on(shard, std::forward<Func>(func));
+    }
+
+    /// Like invoke_on(), but the operations for another shard are queued
+    /// until the tasks already scheduled ran, and sent together, saving a
+    /// message each. The operations of a batch run concurrently.
+    template <typename Func>
+    futurize_t<std::invoke_result_t<Func, Service&>> invoke_batched(const Key& key, Func func) {
+        using futurator = futurize<std::invoke_result_t<Func, Service&>>;
+        auto shard = shard_of(key);
+        if (shard == this_shard_id()) {
+            _stats.local++;
+            return futurize_invoke(std::move(func), _service.local());
+        }
+        _stats.forwarded++;
+        return futurator::invoke([this, shard, &func] {
+            schedule_flush();
+            auto pr = std::make_unique<typename futurator::promise_type>();
+            auto f = pr->get_future();
+            _pending[shard].push_back([func = std::move(func), pr = pr.get()] (Service& s) mutable {
+                return futurize_invoke(func, s).then_wrapped([pr] (typename futurator::type f) {
+                    return completion([pr, f = std::move(f)] () mutable {
+                        f.forward_to(std::move(*pr));
+                        delete pr;
+                    });
+                });
+            });
+            pr.release();
+            return f;
+        });
+    }
+
+    const sharded_router_stats& stats() const noexcept {
+        return _stats;
+    }
+
+    /// Waits for the batched operations to complete. The router must not
+    /// be used afterwards.
+    future<> stop() {
+        return _gate.close();
+    }
+};
+
+/// @}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
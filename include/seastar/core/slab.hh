@@ -142,6 +142,9 @@ class slab_class {
         &slab_item_base::_lru_link>> _lru;
     size_t _size; // size of objects
     uint8_t _slab_class_id;
+    size_t _pages = 0;
+    // items evicted from the LRU since pages were last moved between classes
+    size_t _evictions = 0;
 private:
     template<typename... Args>
     inline
@@ -163,6 +166,7 @@ class slab_class {
         _lru.erase(_lru.iterator_to(reinterpret_cast<slab_item_base&>(victim)));
         // WARNING: You need to make sure that erase_func will not release victim back to slab.
         erase_func(victim);
+        _evictions++;
 
         return { reinterpret_cast<void*>(&victim), index };
     }
@@ -190,6 +194,23 @@ class slab_class {
         return _lru.empty();
     }
 
+    size_t pages() const {
+        return _pages;
+    }
+
+    size_t evictions() const {
+        return _evictions;
+    }
+
+    void reset_evictions() {
+        _evictions = 0;
+    }
+
+    // The least recently used item, or nullptr if there's none to evict
+    Item* lru_tail() {
+        return _lru.empty() ? nullptr : &reinterpret_cast<Item&>(_lru.back());
+    }
+
     template<typename... Args>
     Item *create(Args&&... args) {
         SEASTAR_ASSERT(!_free_slab_pages.empty());
@@ -213,6 +234,16 @@ class slab_class {
         if (!slab_page) {
             throw std::bad_alloc{};
         }
+        return create_from_page(slab_page, max_object_size, slab_page_index, std::move(insert_slab_page_desc),
+                                std::forward<Args>(args)...);
+    }
+
+    // Takes ownership of slab_page, which may have belonged to another class
+    template<typename... Args>
+    Item *create_from_page(void *slab_page, uint64_t max_object_size, uint32_t slab_page_index,
+                           std::function<void (slab_page_desc& desc)> insert_slab_page_desc,
+                           Args&&... args) {
+        constexpr size_t alignment = std::alignment_of_v<Item>;
         // allocate descriptor to slab page.
         slab_page_desc *desc = nullptr;
         SEASTAR_ASSERT(_size % alignment == 0);
@@ -230,6 +261,7 @@ class slab_class {
             _free_slab_pages.push_front(*desc);
         }
         insert_slab_page_desc(*desc);
+        _pages++;
 
         // first object from the allocated slab page is returned.
         return create_item(slab_page, slab_page_index, std::forward<Args>(args)...);
@@ -274,6 +306,10 @@ class slab_class {
         SEASTAR_ASSERT(desc.slab_class_id() == _slab_class_id);
         _free_slab_pages.erase(_free_slab_pages.iterator_to(desc));
     }
+
+    void remove_page() {
+        _pages--;
+    }
 };
 
 template<typename Item>
@@ -293,19 +329,16 @@ class slab_allocator {
     struct collectd_stats {
         uint64_t allocs;
         uint64_t frees;
-    } _stats;
+        uint64_t page_moves;
+    } _stats{};
     memory::reclaimer *_reclaimer = nullptr;
     bool _reclaimed = false;
 private:
-    memory::reclaiming_result evict_lru_slab_page() {
-        if (_slab_page_desc_lru.empty()) {
-            // NOTE: Nothing to evict. If this happens, it implies that all
-            // slab pages in the slab are being used at the same time.
-            // That being said, this event is very unlikely to happen.
-            return memory::reclaiming_result::reclaimed_nothing;
-        }
-        // get descriptor of the least-recently-used slab page and related info.
-        auto& desc = _slab_page_desc_lru.back();
+    /*
+     * Erase the items of an unused slab page and free its descriptor, returning
+     * the memory of the page.
+     */
+    void* evict_slab_page(slab_page_desc& desc) {
         SEASTAR_ASSERT(desc.refcnt() == 0);
         uint8_t slab_class_id = desc.slab_class_id();
         auto slab_class = get_slab_class(slab_class_id);
@@ -319,7 +352,9 @@ class slab_allocator {
             std::sort(free_objects.begin(), free_objects.end());
         }
         // remove desc from the list of slab page descriptors.
-        _slab_page_desc_lru.erase(_slab_page_desc_lru.iterator_to(desc));
+        if (desc._lru_link.is_linked()) {
+            _slab_page_desc_lru.erase(_slab_page_desc_lru.iterator_to(desc));
+        }
         // remove desc from the slab page vector.
         _slab_pages_vector[desc.index()] = nullptr;
 
@@ -343,20 +378,100 @@ class slab_allocator {
             _stats.frees++;
         }
 #ifdef SEASTAR_DEBUG
-        printf("lru slab page eviction succeeded! desc_empty?=%d\n", desc.empty());
+        printf("slab page eviction succeeded! desc_empty?=%d\n", desc.empty());
 #endif
-        ::free(slab_page); // free slab page object
+        slab_class->remove_page();
         delete &desc; // free its descriptor
+        return slab_page;
+    }
+
+    memory::reclaiming_result evict_lru_slab_page() {
+        if (_slab_page_desc_lru.empty()) {
+            // NOTE: Nothing to evict. If this happens, it implies that all
+            // slab pages in the slab are being used at the same time.
+            // That being said, this event is very unlikely to happen.
+            return memory::reclaiming_result::reclaimed_nothing;
+        }
+        // get descriptor of the least-recently-used slab page.
+        ::free(evict_slab_page(_slab_page_desc_lru.back()));
         return memory::reclaiming_result::reclaimed_something;
     }
 
     /*
-     * Reclaim the least recently used slab page that is unused.
+     * A class is short of memory once it evicted a slab page worth of items
+     * since pages were last moved between classes, or if it has no pages.
+     */
+    bool starving(slab_class<Item>& sc) {
+        return sc.pages() == 0 || sc.evictions() >= _max_object_size / sc.size();
+    }
+
+    /*
+     * The class which needs its memory the least: the one with the most
+     * slab pages among those which evicted nothing since pages were last
+     * moved. Returns the page of its least recently used item, if unused.
+     * A class always keeps one page.
+     */
+    slab_page_desc* pick_donor_page(const slab_class<Item>* except) {
+        slab_class<Item>* donor = nullptr;
+        for (auto& sc : _slab_classes) {
+            if (&sc != except && !sc.evictions() && sc.pages() > 1 && sc.lru_tail()
+                    && (!donor || sc.pages() > donor->pages())) {
+                donor = &sc;
+            }
+        }
+        if (!donor) {
+            return nullptr;
+        }
+        auto& desc = get_slab_page_desc(donor->lru_tail());
+        return desc.refcnt() ? nullptr : &desc;
+    }
+
+    /*
+     * Move a slab page from the class which needs it the least to a starving
+     * one, creating the item in it.
+     */
+    template<typename... Args>
+    Item* create_from_donor(slab_class<Item>& sc, Args&&... args) {
+        auto desc = pick_donor_page(&sc);
+        if (!desc) {
+            return nullptr;
+        }
+        auto index = desc->index();
+        auto slab_page = evict_slab_page(*desc);
+        for (auto& c : _slab_classes) {
+            c.reset_evictions();
+        }
+        _stats.page_moves++;
+        return sc.create_from_page(slab_page, _max_object_size, index,
+            [this](slab_page_desc& desc) { insert_slab_page_desc(desc); },
+            std::forward<Args>(args)...);
+    }
+
+    void insert_slab_page_desc(slab_page_desc& desc) {
+        if (_reclaimer) {
+            // insert desc into the LRU list of slab page descriptors.
+            _slab_page_desc_lru.push_front(desc);
+        }
+        // insert desc into the slab page vector, reusing the slot of a moved page.
+        if (desc.index() < _slab_pages_vector.size()) {
+            _slab_pages_vector[desc.index()] = &desc;
+        } else {
+            _slab_pages_vector.push_back(&desc);
+        }
+    }
+
+    /*
+     * Reclaim a slab page that is unused, preferably from the class which
+     * needs its memory the least, not to starve classes under pressure.
      */
     memory::reclaiming_result reclaim() {
         // once reclaimer was called, slab pages should no longer be allocated, as the
         // memory used by slab is supposed to be calibrated.
         _reclaimed = true;
+        if (auto desc = pick_donor_page(nullptr)) {
+            ::free(evict_slab_page(*desc));
+            return memory::reclaiming_result::reclaimed_something;
+        }
         // FIXME: Should reclaim() only evict a single slab page at a time?
         return evict_lru_slab_page();
     }
@@ -406,6 +521,7 @@ class slab_allocator {
         _metrics.add_group("slab", {
             sm::make_counter("malloc_total_operations", sm::description("Total number of slab malloc operations"), _stats.allocs),
             sm::make_counter("free_total_operations", sm::description("Total number of slab free operations"), _stats.frees),
+            sm::make_counter("page_moves", sm::description("Total number of slab pages moved from one slab class to another"), _stats.page_moves),
             sm::make_gauge("malloc_objects", sm::description("Number of slab created objects currently in memory"), [this] {
                 return _stats.allocs - _stats.frees;
             })
@@ -474,21 +590,24 @@ class slab_allocator {
             if (can_allocate_page(*slab_class)) {
                 auto index_to_insert = _slab_pages_vector.size();
                 item = slab_class->create_from_new_page(_max_object_size, index_to_insert,
-                    [this](slab_page_desc& desc) {
-                        if (_reclaimer) {
-                            // insert desc into the LRU list of slab page descriptors.
-                            _slab_page_desc_lru.push_front(desc);
-                        }
-                        // insert desc into the slab page vector.
-                        _slab_pages_vector.push_back(&desc);
-                    },
+                    [this](slab_page_desc& desc) { insert_slab_page_desc(desc); },
                     std::forward<Args>(args)...);
                 if (_available_slab_pages > 0) {
                     _available_slab_pages--;
                 }
                 _stats.allocs++;
             } else if (_erase_func) {
-                item = slab_class->create_from_lru(_erase_func, std::forward<Args>(args)...);
+                // The value size distribution shifts over time: rather than
+                // keep recycling its own items, a starving class takes memory
+                // from the other classes.
+                if (starving(*slab_class)) {
+                    item = create_from_donor(*slab_class, std::forward<Args>(args)...);
+                }
+                if (item) {
+                    _stats.allocs++;
+                } else {
+                    item = slab_class->create_from_lru(_erase_func, std::forward<Args>(args)...);
+                }
             }
         }
         return item;
@@ -496,13 +615,10 @@ class slab_allocator {
 
     void lock_item(Item *item) {
         auto& desc = get_slab_page_desc(item);
-        if (_reclaimer) {
-            auto& refcnt = desc.refcnt();
-
-            if (++refcnt == 1) {
-                // remove slab page descriptor from list of slab page descriptors.
-                _slab_page_desc_lru.erase(_slab_page_desc_lru.iterator_to(desc));
-            }
+        // a page with locked items can't be moved to another class either.
+        if (++desc.refcnt() == 1 && _reclaimer) {
+            // remove slab page descriptor from list of slab page descriptors.
+            _slab_page_desc_lru.erase(_slab_page_desc_lru.iterator_to(desc));
         }
         // remove item from the lru of its slab class.
         auto slab_class = get_slab_class(desc.slab_class_id());
@@ -511,13 +627,9 @@ class slab_allocator {
 
     void unlock_item(Item *item) {
         auto& desc = get_slab_page_desc(item);
-        if (_reclaimer) {
-            auto& refcnt = desc.refcnt();
-
-            if (--refcnt == 0) {
-                // insert slab page descriptor back into list of slab page descriptors.
-                _slab_page_desc_lru.push_front(desc);
-            }
+        if (--desc.refcnt() == 0 && _reclaimer) {
+            // insert slab page descriptor back into list of slab page descriptors.
+            _slab_page_desc_lru.push_front(desc);
         }
         // insert item into the lru of its slab class.
         auto slab_class = get_slab_class(desc.slab_class_id());
@@ -21,20 +21,24 @@
 
 #pragma once
 
+#include <seastar/core/cpu_accounting.hh>
 #include <seastar/core/future.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/core/semaphore.hh>
 #include <seastar/core/metrics_registration.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
 #include <seastar/core/posix.hh>
 #include <seastar/core/reactor_config.hh>
 #include <seastar/core/resource.hh>
 #include <seastar/core/shard_id.hh>
+#include <seastar/core/with_scheduling_group.hh>
 #include <seastar/util/modules.hh>
 
 #ifndef SEASTAR_MODULE
 #include <boost/lockfree/spsc_queue.hpp>
 #include <boost/thread/barrier.hpp>
 #include <deque>
+#include <memory>
 #include <optional>
 #include <thread>
 #include <ranges>
@@ -63,6 +67,16 @@ unsigned smp_service_group_id(smp_service_group ssg) noexcept;
 
 class memory_prefaulter;
 
+// An object to be destroyed on another shard, queued by
+// smp::destroy_on() until the next poll of the smp queues
+struct cross_shard_destroy_item {
+    cross_shard_destroy_item* next = nullptr;
+    virtual ~cross_shard_destroy_item() = default;
+    // Runs on the destination shard; the item itself is deleted
+    // on the shard which queued it
+    virtual void destroy() noexcept = 0;
+};
+
 }
 
 namespace memory::internal {
@@ -172,6 +186,11 @@ struct smp_submit_to_options {
     /// processed by the remote shard, and *not* to the time it takes to be
     /// executed there.
     smp_timeout_clock::time_point timeout = smp_no_timeout;
+    /// The scheduling group to run the function in on the target shard, which
+    /// also determines the I/O class of the I/O it issues. When unset, the
+    /// function inherits the caller's scheduling group, so that work done on
+    /// behalf of a foreground group stays foreground across shards.
+    std::optional<scheduling_group> sched_group;
 
     smp_submit_to_options(smp_service_group service_group = default_smp_service_group(), smp_timeout_clock::time_point timeout = smp_no_timeout) noexcept
         : service_group(service_group)
@@ -186,7 +205,15 @@ smp_service_group_semaphore& get_smp_service_groups_semaphore(unsigned ssg_id, s
 class smp_message_queue {
     static constexpr size_t queue_length = 128;
     static constexpr size_t batch_size = 16;
+    // Bounds for the adaptive request batch size, see adjust_batch_size()
+    static constexpr size_t min_batch_size = 1;
+    static constexpr size_t max_batch_size = queue_length / 4;
     static constexpr size_t prefetch_cnt = 2;
+    using clock_type = std::chrono::steady_clock;
+    // 512ns .. 33ms
+    using latency_histogram = metrics::internal::approximate_exponential_histogram<512, 33554432, 2>;
+    // 1 .. 4096 requests in flight
+    using occupancy_histogram = metrics::internal::approximate_exponential_histogram<1, 4096, 1>;
     struct work_item;
     struct lf_queue_remote {
         reactor* remote;
@@ -207,7 +234,17 @@ class smp_message_queue {
         size_t _last_snt_batch = 0;
         size_t _last_cmpl_batch = 0;
         size_t _current_queue_length = 0;
+        // Requests are pushed to the remote shard once this many are
+        // pending, or when the smp queues are polled, whichever comes first
+        size_t _batch_size = batch_size;
+        // Lower bound for _batch_size, raised for queues crossing NUMA nodes
+        size_t _min_batch_size = min_batch_size;
+        // Times the ring was found full when pushing requests
+        size_t _queue_full = 0;
     };
+    // Sender side, updated on completion
+    latency_histogram _latency;
+    occupancy_histogram _occupancy;
     // keep this between two structures with statistics
     // this makes sure that they have at least one cache line
     // between them, so hw prefetcher will not accidentally prefetch
@@ -218,8 +255,16 @@ class smp_message_queue {
         size_t _last_rcv_batch = 0;
     };
     struct work_item : public task {
-        explicit work_item(smp_service_group ssg) : task(current_scheduling_group()), ssg(ssg) {}
+        work_item(smp_service_group ssg, scheduling_group sg) : task(sg), ssg(ssg) {
+            clear_cpu_tag();
+        }
         smp_service_group ssg;
+        // The CPU accounting tag of the caller, made current on the remote
+        // shard. Tags are never removed, so it outlives the item.
+        const sstring* cpu_tag = nullptr;
+        clock_type::time_point queued_at;    // added to the pending fifo
+        clock_type::time_point sent_at;      // pushed to the ring
+        clock_type::time_point received_at;  // popped by the remote shard
         virtual ~work_item() {}
         virtual void fail_with(std::exception_ptr) = 0;
         void process();
@@ -235,7 +280,7 @@ class smp_message_queue {
         std::optional<value_type> _result;
         std::exception_ptr _ex; // if !_result
         typename futurator::promise_type _promise; // used on local side
-        async_work_item(smp_message_queue& queue, smp_service_group ssg, Func&& func) : work_item(ssg), _queue(queue), _func(std::move(func)) {}
+        async_work_item(smp_message_queue& queue, smp_service_group ssg, scheduling_group sg, Func&& func) : work_item(ssg, sg), _queue(queue), _func(std::move(func)) {}
         virtual void fail_with(std::exception_ptr ex) override {
             _promise.set_exception(std::move(ex));
         }
@@ -246,7 +291,8 @@ class smp_message_queue {
         virtual void run_and_dispose() noexcept override {
             // _queue.respond() below forwards the continuation chain back to the
             // calling shard.
-            (void)futurator::invoke(this->_func).then_wrapped([this] (auto f) {
+            auto f = this->cpu_tag ? cpu_accounting::with_tag(*this->cpu_tag, this->_func) : futurator::invoke(this->_func);
+            (void)std::move(f).then_wrapped([this] (auto f) {
                 if (f.failed()) {
                     _ex = f.get_exception();
                 } else {
@@ -273,6 +319,11 @@ class smp_message_queue {
         void init() { new (&a) aa; }
         struct aa {
             std::deque<work_item*> pending_fifo;
+            // Destructions queued by smp::destroy_on(), in order, shipped
+            // in a single request ahead of the next message to the shard
+            // or when the queues are polled, whichever comes first
+            internal::cross_shard_destroy_item* pending_destroys = nullptr;
+            internal::cross_shard_destroy_item* pending_destroys_tail = nullptr;
         } a;
     } _tx;
     std::vector<work_item*> _completed_fifo;
@@ -282,7 +333,13 @@ class smp_message_queue {
     template <typename Func>
     futurize_t<std::invoke_result_t<Func>> submit(shard_id t, smp_submit_to_options options, Func&& func) noexcept {
         memory::scoped_critical_alloc_section _;
-        auto wi = std::make_unique<async_work_item<Func>>(*this, options.service_group, std::forward<Func>(func));
+        // Destructions queued before this message must not overtake it
+        if (_tx.a.pending_destroys) [[unlikely]] {
+            flush_destroy_batch(t);
+        }
+        auto sg = options.sched_group.value_or(current_scheduling_group());
+        auto wi = std::make_unique<async_work_item<Func>>(*this, options.service_group, sg, std::forward<Func>(func));
+        wi->cpu_tag = cpu_accounting::current_tag();
         auto fut = wi->get_future();
         submit_item(t, options.timeout, std::move(wi));
         return fut;
@@ -290,7 +347,7 @@ class smp_message_queue {
     void start(unsigned cpuid);
     template<size_t PrefetchCnt, typename Func>
     size_t process_queue(lf_queue& q, Func process);
-    size_t process_incoming();
+    size_t process_incoming(shard_id from);
     size_t process_completions(shard_id t);
     void stop();
 private:
@@ -298,7 +355,11 @@ class smp_message_queue {
     void submit_item(shard_id t, smp_timeout_clock::time_point timeout, std::unique_ptr<work_item> wi);
     void respond(work_item* wi);
     void move_pending();
+    void set_min_batch_size(size_t n) noexcept;
+    void adjust_batch_size(clock_type::duration batching, clock_type::duration delivery) noexcept;
     void flush_request_batch();
+    void queue_destroy(internal::cross_shard_destroy_item* item) noexcept;
+    void flush_destroy_batch(shard_id t) noexcept;
     void flush_response_batch();
     bool has_unflushed_responses() const;
     bool pure_poll_rx() const;
@@ -307,10 +368,131 @@ class smp_message_queue {
     friend class smp;
 };
 
+namespace internal {
+
+// Shard-agnostic work, see smp::submit_stealable_to(). It runs as a task
+// on whichever shard takes it off the queue, and the result is posted
+// back to the submitting shard.
+struct stealable_work_item : public task {
+    shard_id origin;
+    stealable_work_item* next = nullptr;
+    stealable_work_item() noexcept : task(current_scheduling_group()), origin(this_shard_id()) {
+        // Runs untagged, on a shard not known in advance
+        clear_cpu_tag();
+    }
+    virtual ~stealable_work_item() {}
+    virtual task* waiting_task() noexcept override {
+        return nullptr;
+    }
+    // Called on the origin shard once the result is in
+    virtual void complete() noexcept = 0;
+protected:
+    void respond() noexcept;
+};
+
+template <typename Func>
+struct stealable_async_work_item final : stealable_work_item {
+    Func _func;
+    using futurator = futurize<std::invoke_result_t<Func>>;
+    using future_type = typename futurator::type;
+    using value_type = typename future_type::value_type;
+    std::optional<value_type> _result;
+    std::exception_ptr _ex; // if !_result
+    typename futurator::promise_type _promise; // used on the origin shard
+    explicit stealable_async_work_item(Func&& func) : _func(std::move(func)) {}
+    virtual void run_and_dispose() noexcept override {
+        (void)futurator::invoke(_func).then_wrapped([this] (auto f) {
+            if (f.failed()) {
+                _ex = f.get_exception();
+            } else {
+                _result = f.get();
+            }
+            respond();
+        });
+        // Deleted on the origin shard by complete()
+    }
+    virtual void complete() noexcept override {
+        if (_result) {
+            _promise.set_value(std::move(*_result));
+        } else {
+            _promise.set_exception(std::move(_ex));
+        }
+        delete this;
+    }
+    future_type get_future() { return _promise.get_future(); }
+};
+
+struct stealable_queue;
+
+struct broadcast_message;
+
+// One per destination shard, allocated along with the message
+struct broadcast_node final : public task {
+    broadcast_message* msg = nullptr;
+    broadcast_node* next = nullptr;
+    broadcast_node() noexcept {
+        clear_cpu_tag();
+    }
+    virtual void run_and_dispose() noexcept override;
+    virtual task* waiting_task() noexcept override {
+        return nullptr;
+    }
+};
+
+// A message published to all shards by smp::broadcast(). It is shared by
+// all shards and destroyed on the origin shard once every shard is done
+// with it.
+struct broadcast_message {
+    shard_id origin;
+    std::atomic<unsigned> remaining;
+    std::atomic<bool> failed = false;
+    std::exception_ptr ex; // written by whoever sets failed
+    promise<> pr;
+    std::unique_ptr<broadcast_node[]> nodes;
+
+    explicit broadcast_message(unsigned nr_shards);
+    virtual ~broadcast_message() = default;
+    // Runs the function on the current shard
+    virtual future<> invoke() noexcept = 0;
+    void shard_done(std::exception_ptr ex) noexcept;
+    void complete() noexcept;
+};
+
+template <typename Func>
+struct broadcast_message_impl final : broadcast_message {
+    const Func func;
+    broadcast_message_impl(unsigned nr_shards, Func&& func) : broadcast_message(nr_shards), func(std::move(func)) {}
+    virtual future<> invoke() noexcept override {
+        return futurize_invoke(func);
+    }
+};
+
+struct broadcast_inbox;
+
+}
+
 class smp_message_queue;
 struct reactor_options;
 struct smp_options;
 
+/// Where a shard runs, see \ref smp::shard_topology()
+///
+/// Shards that cooperate closely exchange messages faster when they share
+/// a cache domain, and even more so a NUMA node.
+struct cpu_topology {
+    /// The CPU the shard is placed on
+    unsigned cpu;
+    /// The physical core of the CPU
+    unsigned core;
+    /// The last-level cache the CPU shares with other cores, e.g. the L3 of
+    /// a CCX on AMD chiplet CPUs
+    unsigned cache_domain;
+    /// The NUMA node of the CPU
+    unsigned numa_node;
+    /// The other hardware threads of the core that are in the cpuset
+    std::vector<unsigned> siblings;
+};
+
 class smp : public std::enable_shared_from_this<smp> {
     alien::instance& _alien;
     std::vector<posix_thread> _threads;
@@ -322,9 +504,16 @@ class smp : public std::enable_shared_from_this<smp> {
     };
     std::unique_ptr<smp_message_queue*[], qs_deleter> _qs_owner;
     static thread_local smp_message_queue**_qs;
+    std::unique_ptr<internal::stealable_queue[]> _stealable_qs_owner;
+    static thread_local internal::stealable_queue* _stealable_qs;
+    std::unique_ptr<internal::broadcast_inbox[]> _broadcast_inboxes_owner;
+    static thread_local internal::broadcast_inbox* _broadcast_inboxes;
     static thread_local std::thread::id _tmain;
     bool _using_dpdk = false;
     std::vector<unsigned> _shard_to_numa_node_mapping;
+    std::vector<cpu_topology> _shard_topology;
+    // The shard pinned to each CPU, empty without thread affinity
+    static std::vector<std::optional<shard_id>> _cpu_to_shard;
 
 private:
     void setup_prefaulter(const seastar::resource::resources& res, seastar::memory::internal::numa_layout layout);
@@ -341,8 +530,17 @@ class smp : public std::enable_shared_from_this<smp> {
     /// \returns A integer span of size smp::count, with nth integer being the ID of nth shard's NUMA node.
     std::span<const unsigned> shard_to_numa_node_mapping() const noexcept;
 
+    /// \returns A span of size smp::count, with nth element describing where nth shard runs.
+    /// The topology is only known when seastar is built with hwloc; otherwise
+    /// every CPU is a core of its own, without siblings, in cache domain and
+    /// NUMA node 0.
+    std::span<const cpu_topology> shard_topology() const noexcept;
+
     /// Runs a function on a remote core.
     ///
+    /// \c func runs in the caller's scheduling group, unless
+    /// \ref smp_submit_to_options::sched_group says otherwise.
+    ///
     /// \param t designates the core to run the function on (may be a remote
     ///          core or the local core).
     /// \param options an \ref smp_submit_to_options that contains options for this call.
@@ -359,7 +557,15 @@ class smp : public std::enable_shared_from_this<smp> {
         using ret_type = std::invoke_result_t<Func>;
         if (t == this_shard_id()) {
             try {
-                if (!is_future<ret_type>::value) {
+                if (options.sched_group && !options.sched_group->active()) {
+                    // Switch groups the same way a remote core would
+                    if constexpr (std::is_lvalue_reference_v<Func>) {
+                        return with_scheduling_group(*options.sched_group, [&func] { return futurize<ret_type>::invoke(func); });
+                    } else {
+                        auto w = std::make_unique<std::decay_t<Func>>(std::move(func));
+                        return with_scheduling_group(*options.sched_group, [w = std::move(w)] { return futurize<ret_type>::invoke(*w); });
+                    }
+                } else if (!is_future<ret_type>::value) {
                     // Non-deferring function, so don't worry about func lifetime
                     return futurize<ret_type>::invoke(std::forward<Func>(func));
                 } else if (std::is_lvalue_reference_v<Func>) {
@@ -397,11 +603,78 @@ class smp : public std::enable_shared_from_this<smp> {
     static futurize_t<std::invoke_result_t<Func>> submit_to(unsigned t, Func&& func) noexcept {
         return submit_to(t, default_smp_service_group(), std::forward<Func>(func));
     }
+    /// Runs a function on a core, or on whichever core gets to it first.
+    ///
+    /// Like \ref submit_to(), but \c func is only queued on core \c t, and
+    /// other cores that run out of work take from that queue before going
+    /// idle. This spreads CPU-heavy work (checksumming, compression, ...)
+    /// away from a busy shard. Since the core that runs \c func is not known
+    /// in advance, \c func must not use shard-local state, and whatever it
+    /// returns is moved back to the calling core.
+    ///
+    /// Stealable work is not subject to smp_service_group limits, and it runs
+    /// in the caller's scheduling group.
+    ///
+    /// \param t designates the core to queue the function on (may be the
+    ///          local core).
+    /// \param func a callable to run. It is moved into the queue, and
+    ///          destroyed on the calling core.
+    /// \return whatever \c func returns, as a future<>
+    template <typename Func>
+    static futurize_t<std::invoke_result_t<Func>> submit_stealable_to(unsigned t, Func&& func) noexcept {
+        using item_type = internal::stealable_async_work_item<std::decay_t<Func>>;
+        memory::scoped_critical_alloc_section _;
+        auto wi = new item_type(std::decay_t<Func>(std::forward<Func>(func)));
+        auto fut = wi->get_future();
+        submit_stealable(t, wi);
+        return fut;
+    }
+    /// Runs one item of stealable work queued on another core, if there is
+    /// any. Called by the reactor when it has nothing else to do.
+    ///
+    /// \return whether any work was taken
+    static bool steal_work();
+    /// Destroys an object on shard \c t, without waiting for it.
+    ///
+    /// Rather than sending a message per object, the destructions queued
+    /// for a shard are sent together in one message the next time the
+    /// smp queues are polled, so that tearing down many \ref foreign_ptr
+    /// objects does not flood the queue. They are sent before any message
+    /// submitted to that shard afterwards, so they are not reordered with
+    /// respect to it, and right away once the reactor is stopping.
+    static void destroy_on(shard_id t, std::unique_ptr<internal::cross_shard_destroy_item> item) noexcept;
     static bool poll_queues();
     static bool pure_poll_queues();
     static std::ranges::range auto all_cpus() noexcept {
         return std::views::iota(0u, count);
     }
+    /// Runs a function on all shards, sharing a single copy of it.
+    ///
+    /// Unlike \ref invoke_on_all(), which sends a separate copy of \c func
+    /// to every shard, this publishes one immutable message that all shards
+    /// consume, and only the final completion travels back to the calling
+    /// shard. This makes it cheap enough for frequent fan-out such as
+    /// configuration updates or cache invalidations on machines with many
+    /// shards.
+    ///
+    /// \c func is called through a const reference, possibly on several
+    /// shards at the same time, so it must not modify its own captures.
+    /// It is destroyed on the calling shard. Broadcasts are not subject to
+    /// smp_service_group limits.
+    ///
+    /// \param func the function to be invoked on each shard. May return void
+    ///         or future<>.
+    /// \returns a future that resolves when all invocations finish. If any of
+    ///         them fail, one of the exceptions is returned.
+    template<typename Func>
+    requires std::is_same_v<future<>, futurize_t<std::invoke_result_t<const Func&>>>
+    static future<> broadcast(Func&& func) noexcept {
+        memory::scoped_critical_alloc_section _;
+        auto msg = new internal::broadcast_message_impl<std::decay_t<Func>>(count, std::decay_t<Func>(std::forward<Func>(func)));
+        auto fut = msg->pr.get_future();
+        post_broadcast(msg);
+        return fut;
+    }
     /// Invokes func on all shards.
     ///
     /// \param options the options to forward to the \ref smp::submit_to()
@@ -479,6 +752,16 @@ class smp : public std::enable_shared_from_this<smp> {
     }
 private:
     void start_all_queues();
+    void allocate_queues_to(shard_id to, const std::vector<reactor*>& reactors, size_t cross_node_batch_size);
+    void setup_stealable_queues(const std::vector<reactor*>& reactors);
+    static void submit_stealable(unsigned t, internal::stealable_work_item* wi) noexcept;
+    static bool poll_stealable_queue();
+    static bool pure_poll_stealable_queue() noexcept;
+    void setup_broadcast_inboxes(const std::vector<reactor*>& reactors);
+    static void post_broadcast(internal::broadcast_message* msg) noexcept;
+    static bool poll_broadcast_inbox() noexcept;
+    static bool pure_poll_broadcast_inbox() noexcept;
+    static void flush_destroy_batches() noexcept;
     void pin(unsigned cpu_id);
     void allocate_reactor(unsigned id, reactor_backend_selector rbs, reactor_config cfg);
     void create_thread(std::function<void ()> thread_loop);
@@ -486,6 +769,13 @@ class smp : public std::enable_shared_from_this<smp> {
     static void log_aiocbs(log_level level, unsigned storage, unsigned preempt, unsigned network, unsigned reserve);
 public:
     static unsigned count;
+    /// Returns the shard whose thread is pinned to the given CPU.
+    ///
+    /// \return the shard, or \c std::nullopt if no shard runs on the CPU or
+    ///         the shards are not pinned to CPUs (thread affinity is off)
+    static std::optional<shard_id> shard_of_cpu(unsigned cpu) noexcept {
+        return cpu < _cpu_to_shard.size() ? _cpu_to_shard[cpu] : std::nullopt;
+    }
 };
 
 SEASTAR_MODULE_EXPORT_END
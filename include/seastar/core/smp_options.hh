@@ -56,6 +56,14 @@ struct smp_options : public program_options::option_group {
     program_options::value<std::string> reserve_memory;
     /// Path to accessible hugetlbfs mount (typically /dev/hugepages/something).
     program_options::value<std::string> hugepages;
+    /// \brief Back memory with explicit huge pages of this size (2M or 1G).
+    ///
+    /// Unlike transparent huge pages, these are never split by the kernel.
+    /// They must be reserved beforehand (see /sys/kernel/mm/hugepages); once
+    /// the reserved pages run out, smaller huge pages and then regular pages
+    /// are used. See the \p memory_backed_memory metric for the coverage
+    /// achieved. Mutually exclusive with \ref hugepages.
+    program_options::value<std::string> hugetlb_page_size;
     /// Lock all memory (prevents swapping).
     program_options::value<bool> lock_memory;
     /// Pin threads to their cpus (disable for overprovisioning).
@@ -85,6 +93,41 @@ struct smp_options : public program_options::option_group {
     /// them to remote ones.
     /// \note Unused when seastar is compiled without \p HWLOC support.
     program_options::value<bool> allow_cpus_in_remote_numa_nodes;
+    /// \brief Minimal number of messages batched together before being sent
+    /// to a shard on another NUMA node.
+    ///
+    /// Messages to other shards are sent in batches, which are flushed when
+    /// they grow large enough or when the sender polls its queues. Raising the
+    /// batch size for queues that cross NUMA nodes makes the cross-socket cache
+    /// line transfers happen less often, at the cost of some latency.
+    ///
+    /// Default: \p 0 (same as within a node).
+    program_options::value<unsigned> cross_node_batch_size;
+    /// \brief How shards are placed on the CPUs of the cpuset.
+    ///
+    /// * \p spread - any hardware thread may host a shard;
+    /// * \p one-per-core - one shard per physical core, leaving the SMT
+    ///   siblings to interrupts, syscall threads (see
+    ///   \ref reactor_options::syscall_threads_pin_sibling) and other
+    ///   processes. The number of shards defaults to the number of cores.
+    ///
+    /// Default: \p spread.
+    /// \note Without \p HWLOC support the cores are not known and every CPU
+    /// counts as one.
+    program_options::value<std::string> shard_placement;
+    /// \brief Rebalance free memory between shards at runtime.
+    ///
+    /// Each shard gets an equal share of \ref memory at startup. With this
+    /// option, shards lend the free memory they hold beyond a quarter of their
+    /// share to the other shards, up to 64MB a second and only while they do
+    /// not run short of it themselves, and borrow lent memory before
+    /// reclaiming when under memory pressure, so that shards serving a larger
+    /// part of the load end up with more memory. See
+    /// \ref memory::lend_free_memory(). Not compatible with
+    /// \ref reactor_options::io_uring_fixed_buffers.
+    ///
+    /// Default: \p false.
+    program_options::value<bool> memory_rebalance;
 
     /// Memory allocator to use.
     ///
@@ -25,16 +25,60 @@
 #include <seastar/util/backtrace.hh>
 
 #ifndef SEASTAR_MODULE
+#include <cstdint>
 #include <utility>
 #endif
 
 namespace seastar {
 
+namespace internal {
+class coroutine_task;
+
+// The slot of the current tracing span of the running task (see
+// tracing::with_span()) in the low 16 bits, 0 for none, and the generation
+// of the slot in the high ones. Tasks inherit it from the task that creates
+// them, like the scheduling group.
+#ifdef SEASTAR_BUILD_SHARED_LIBS
+uint32_t*
+current_trace_slot_ptr() noexcept;
+#else
+inline
+uint32_t*
+current_trace_slot_ptr() noexcept {
+    static thread_local uint32_t slot;
+    return &slot;
+}
+#endif
+
+// The slot of the current CPU accounting tag of the running task (see
+// cpu_accounting::with_tag()) in the low 8 bits, 0 for none, and the
+// generation of the slot in the high ones, inherited the same way
+#ifdef SEASTAR_BUILD_SHARED_LIBS
+uint16_t*
+current_cpu_tag_slot_ptr() noexcept;
+#else
+inline
+uint16_t*
+current_cpu_tag_slot_ptr() noexcept {
+    static thread_local uint16_t slot;
+    return &slot;
+}
+#endif
+}
+
 SEASTAR_MODULE_EXPORT
 class task {
 protected:
     scheduling_group _sg;
 private:
+    // Set for the coroutines that can be resumed directly, see
+    // internal::coroutine_task
+    bool _is_coroutine = false;
+    // Both with the generation of the slot, so that a task which outlived
+    // its tag or span is not charged to, or run in, the one reusing the slot
+    uint16_t _cpu_tag_slot;
+    uint32_t _trace_slot;
+    friend class internal::coroutine_task;
 #ifdef SEASTAR_TASK_BACKTRACE
     shared_backtrace _bt;
 #endif
@@ -48,12 +92,20 @@ class task {
     scheduling_group set_scheduling_group(scheduling_group new_sg) noexcept{
         return std::exchange(_sg, new_sg);
     }
+    // For tasks which run on another shard than the one they are made on,
+    // where the slot stands for another tag
+    void clear_cpu_tag() noexcept {
+        _cpu_tag_slot = 0;
+    }
 public:
-    explicit task(scheduling_group sg = current_scheduling_group()) noexcept : _sg(sg) {}
+    explicit task(scheduling_group sg = current_scheduling_group()) noexcept
+        : _sg(sg), _cpu_tag_slot(*internal::current_cpu_tag_slot_ptr()), _trace_slot(*internal::current_trace_slot_ptr()) {}
     virtual void run_and_dispose() noexcept = 0;
     /// Returns the next task which is waiting for this task to complete execution, or nullptr.
     virtual task* waiting_task() noexcept = 0;
     scheduling_group group() const { return _sg; }
+    uint32_t trace_slot() const noexcept { return _trace_slot; }
+    uint16_t cpu_tag_slot() const noexcept { return _cpu_tag_slot; }
     shared_backtrace get_backtrace() const;
 #ifdef SEASTAR_TASK_BACKTRACE
     void make_backtrace() noexcept;
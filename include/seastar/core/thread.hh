@@ -95,7 +95,9 @@ class thread_context final : private task {
     struct stack_deleter {
         void operator()(char *ptr) const noexcept;
         int valgrind_id;
-        stack_deleter(int valgrind_id);
+        size_t size;
+        bool mmapped;
+        stack_deleter(int valgrind_id, size_t size, bool mmapped);
     };
     using stack_holder = std::unique_ptr<char[], stack_deleter>;
 
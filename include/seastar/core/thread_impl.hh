@@ -75,7 +75,8 @@ scheduling_group sched_group(const thread_context*);
 void yield();
 void switch_in(thread_context* to);
 void switch_out(thread_context* from);
-void init();
+void init(unsigned cached_stacks, bool mmap_stacks);
+void exit();
 
 }
 }
@@ -230,11 +230,18 @@ class timer_set {
         return exp;
     }
 
+    /**
+     * Expires the active timers and runs their callbacks, then calls enable_fn.
+     *
+     * Returns the number of timers expired.
+     */
     template <typename EnableFunc>
-    void complete(timer_list_t& expired_timers, EnableFunc&& enable_fn) noexcept(noexcept(enable_fn())) {
+    size_t complete(timer_list_t& expired_timers, EnableFunc&& enable_fn) noexcept(noexcept(enable_fn())) {
         expired_timers = expire(this->now());
+        size_t nr_expired = 0;
         for (auto& t : expired_timers) {
             t._expired = true;
+            nr_expired++;
         }
         const auto prev_sg = current_scheduling_group();
         while (!expired_timers.empty()) {
@@ -258,6 +265,7 @@ class timer_set {
         // as well so we need to restore the previous scheduling group (set by run_tasks()).
         *internal::current_scheduling_group_ptr() = prev_sg;
         enable_fn();
+        return nr_expired;
     }
 
     /**
@@ -0,0 +1,356 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/bitops.hh>
+#include <seastar/core/scheduling.hh>
+#ifndef SEASTAR_MODULE
+#include <boost/intrusive/list.hpp>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <limits>
+#include <type_traits>
+#endif
+
+namespace seastar {
+
+namespace internal {
+void log_timer_callback_exception(std::exception_ptr) noexcept;
+}
+
+/**
+ * A hierarchical timing wheel holding and expiring timers, with the
+ * interface of timer_set.
+ *
+ * Time is cut into ticks of about a millisecond. The wheel has levels of
+ * 64 slots each, where a slot of level N spans 64^N ticks; a timer sits in
+ * the level of the highest bits in which its tick differs from the current
+ * one, in the slot given by those bits. Inserting and removing a timer is
+ * then O(1) whatever the number of armed timers, and expiring only visits
+ * the slots the clock advanced over, a timer being moved down a level at
+ * most once per level on its way to expiry. timer_set keeps one list per
+ * differing bit, which it has to walk on expiry, and which gets long when
+ * millions of timeouts are armed.
+ *
+ * Timers expire exactly at their timeout, the current tick's slot being
+ * checked timer by timer.
+ */
+template<typename Timer, boost::intrusive::list_member_hook<> Timer::*link>
+class timer_wheel {
+public:
+    using time_point = typename Timer::time_point;
+    using timer_list_t = boost::intrusive::list<Timer, boost::intrusive::member_hook<Timer, boost::intrusive::list_member_hook<>, link>>;
+private:
+    using duration = typename Timer::duration;
+    using timestamp_t = typename Timer::duration::rep;
+    using tick_t = std::make_unsigned_t<timestamp_t>;
+
+    static constexpr timestamp_t max_timestamp = std::numeric_limits<timestamp_t>::max();
+
+    // The largest power of two of clock units not exceeding a millisecond
+    static constexpr unsigned tick_shift = log2floor(tick_t(std::max<timestamp_t>(
+            std::chrono::duration_cast<duration>(std::chrono::milliseconds(1)).count(), 1)));
+    static constexpr unsigned slot_bits = 6;
+    static constexpr unsigned n_slots = 1 << slot_bits;
+    static constexpr unsigned n_levels = (std::numeric_limits<timestamp_t>::digits - tick_shift + slot_bits - 1) / slot_bits;
+
+    std::array<std::array<timer_list_t, n_slots>, n_levels> _wheel;
+    std::array<uint64_t, n_levels> _non_empty_slots = {};
+    tick_t _tick;
+    timestamp_t _last;
+    timestamp_t _next;
+private:
+    static timestamp_t get_timestamp(time_point _time_point) noexcept
+    {
+        return _time_point.time_since_epoch().count();
+    }
+
+    static timestamp_t get_timestamp(Timer& timer) noexcept
+    {
+        return get_timestamp(timer.get_timeout());
+    }
+
+    static tick_t get_tick(timestamp_t timestamp) noexcept
+    {
+        return timestamp <= 0 ? 0 : tick_t(timestamp) >> tick_shift;
+    }
+
+    static unsigned get_slot(tick_t tick, unsigned level) noexcept
+    {
+        return (tick >> (level * slot_bits)) & (n_slots - 1);
+    }
+
+    // Timers already due are kept in the current tick's slot
+    std::pair<unsigned, unsigned> get_position(timestamp_t timestamp) const noexcept
+    {
+        auto tick = std::max(get_tick(timestamp), _tick);
+        auto diff = tick ^ _tick;
+        unsigned level = diff ? log2floor(diff) / slot_bits : 0;
+        return {level, get_slot(tick, level)};
+    }
+
+    void link_timer(Timer& timer) noexcept
+    {
+        auto [level, slot] = get_position(get_timestamp(timer));
+        _wheel[level][slot].push_back(timer);
+        _non_empty_slots[level] |= uint64_t(1) << slot;
+    }
+
+    void take_slots(timer_list_t& exp, unsigned level, uint64_t slots) noexcept
+    {
+        _non_empty_slots[level] &= ~slots;
+        while (slots) {
+            auto slot = count_trailing_zeros(slots);
+            slots &= slots - 1;
+            exp.splice(exp.end(), _wheel[level][slot]);
+        }
+    }
+
+    // The earliest timeout is in the first non-empty slot of the lowest
+    // non-empty level: slots never lie behind the current tick
+    timestamp_t find_next() const noexcept
+    {
+        for (unsigned level = 0; level < n_levels; ++level) {
+            if (auto slots = _non_empty_slots[level]) {
+                timestamp_t next = max_timestamp;
+                for (auto& timer : _wheel[level][count_trailing_zeros(slots)]) {
+                    next = std::min(next, get_timestamp(timer.get_timeout()));
+                }
+                return next;
+            }
+        }
+        return max_timestamp;
+    }
+
+public:
+    timer_wheel() noexcept
+        : _tick(0)
+        , _last(0)
+        , _next(max_timestamp)
+    {
+    }
+
+    ~timer_wheel() {
+        for (auto&& level : _wheel) {
+            for (auto&& list : level) {
+                while (!list.empty()) {
+                    auto& timer = *list.begin();
+                    timer.cancel();
+                }
+            }
+        }
+    }
+
+    /**
+     * Adds timer to the active set, see timer_set::insert().
+     *
+     * Returns true if and only if this timer's timeout is less than get_next_timeout().
+     */
+    bool insert(Timer& timer) noexcept
+    {
+        auto timestamp = get_timestamp(timer);
+        link_timer(timer);
+
+        if (timestamp < _next) {
+            _next = timestamp;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Removes timer from the active set, see timer_set::remove().
+     */
+    void remove(Timer& timer) noexcept
+    {
+        auto [level, slot] = get_position(get_timestamp(timer));
+        auto& list = _wheel[level][slot];
+        list.erase(list.iterator_to(timer));
+        if (list.empty()) {
+            _non_empty_slots[level] &= ~(uint64_t(1) << slot);
+        }
+    }
+
+    /**
+     * Removes timer from the active set or the expired list, if the timer is expired
+     */
+    void remove(Timer& timer, timer_list_t& expired) noexcept
+    {
+        if (timer._expired) {
+            expired.erase(expired.iterator_to(timer));
+            timer._expired = false;
+        } else {
+            remove(timer);
+        }
+    }
+
+    /**
+     * Expires active timers, see timer_set::expire().
+     */
+    timer_list_t expire(time_point now) noexcept
+    {
+        timer_list_t exp;
+        auto timestamp = get_timestamp(now);
+
+        if (timestamp < _last) {
+            abort();
+        }
+
+        auto tick = std::max(get_tick(timestamp), _tick);
+        if (tick != _tick) {
+            // Everything below the highest level the tick changed in is due,
+            // as is everything on that level up to the new tick's slot. The
+            // timers of that slot are spread over the lower levels.
+            unsigned level = log2floor(tick ^ _tick) / slot_bits;
+            for (unsigned l = 0; l < level; ++l) {
+                take_slots(exp, l, _non_empty_slots[l]);
+            }
+            auto from = get_slot(_tick, level);
+            auto to = get_slot(tick, level);
+            take_slots(exp, level, _non_empty_slots[level] & ((uint64_t(1) << to) - (uint64_t(1) << from)));
+            _tick = tick;
+            if (level > 0 && (_non_empty_slots[level] & (uint64_t(1) << to))) {
+                timer_list_t cascade;
+                take_slots(cascade, level, uint64_t(1) << to);
+                while (!cascade.empty()) {
+                    auto& timer = *cascade.begin();
+                    cascade.pop_front();
+                    link_timer(timer);
+                }
+            }
+        }
+
+        _last = timestamp;
+
+        auto slot = get_slot(_tick, 0);
+        auto& list = _wheel[0][slot];
+        for (auto it = list.begin(); it != list.end();) {
+            auto& timer = *it;
+            if (timer.get_timeout() <= now) {
+                it = list.erase(it);
+                exp.push_back(timer);
+            } else {
+                ++it;
+            }
+        }
+        if (list.empty()) {
+            _non_empty_slots[0] &= ~(uint64_t(1) << slot);
+        }
+
+        _next = find_next();
+        return exp;
+    }
+
+    /**
+     * Expires the active timers and runs their callbacks, then calls enable_fn.
+     *
+     * Returns the number of timers expired.
+     */
+    template <typename EnableFunc>
+    size_t complete(timer_list_t& expired_timers, EnableFunc&& enable_fn) noexcept(noexcept(enable_fn())) {
+        expired_timers = expire(this->now());
+        size_t nr_expired = 0;
+        for (auto& t : expired_timers) {
+            t._expired = true;
+            nr_expired++;
+        }
+        const auto prev_sg = current_scheduling_group();
+        while (!expired_timers.empty()) {
+            auto t = &*expired_timers.begin();
+            expired_timers.pop_front();
+            t->_queued = false;
+            if (t->_armed) {
+                t->_armed = false;
+                if (t->_period) {
+                    t->readd_periodic();
+                }
+                try {
+                    *internal::current_scheduling_group_ptr() = t->_sg;
+                    t->_callback();
+                } catch (...) {
+                    internal::log_timer_callback_exception(std::current_exception());
+                }
+            }
+        }
+        // complete_timers() can be called from the context of run_tasks()
+        // as well so we need to restore the previous scheduling group (set by run_tasks()).
+        *internal::current_scheduling_group_ptr() = prev_sg;
+        enable_fn();
+        return nr_expired;
+    }
+
+    /**
+     * Returns a time point at which expire() should be called
+     * in order to ensure timers are expired in a timely manner.
+     *
+     * Returned values are monotonically increasing.
+     */
+    time_point get_next_timeout() const noexcept
+    {
+        return time_point(duration(std::max(_last, _next)));
+    }
+
+    /**
+     * Clears both active and expired timer sets.
+     */
+    void clear() noexcept
+    {
+        for (unsigned level = 0; level < n_levels; ++level) {
+            for (auto slots = _non_empty_slots[level]; slots; slots &= slots - 1) {
+                _wheel[level][count_trailing_zeros(slots)].clear();
+            }
+            _non_empty_slots[level] = 0;
+        }
+    }
+
+    size_t size() const noexcept
+    {
+        size_t res = 0;
+        for (unsigned level = 0; level < n_levels; ++level) {
+            for (auto slots = _non_empty_slots[level]; slots; slots &= slots - 1) {
+                res += _wheel[level][count_trailing_zeros(slots)].size();
+            }
+        }
+        return res;
+    }
+
+    /**
+     * Returns true if and only if there are no timers in the active set.
+     */
+    bool empty() const noexcept
+    {
+        for (auto slots : _non_empty_slots) {
+            if (slots) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    time_point now() noexcept {
+        return Timer::clock::now();
+    }
+};
+}
@@ -24,13 +24,17 @@
 #include <seastar/core/future.hh>
 #include <seastar/core/scheduling.hh>
 #include <seastar/core/timer-set.hh>
+#include <seastar/core/timer-wheel.hh>
 #include <seastar/util/assert.hh>
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/modules.hh>
 #ifndef SEASTAR_MODULE
 #include <boost/intrusive/list.hpp>
+#include <bit>
 #include <chrono>
+#include <limits>
 #include <optional>
+#include <type_traits>
 #endif
 
 /// \file
@@ -52,6 +56,21 @@
 
 namespace seastar {
 
+class lowres_clock;
+
+namespace internal {
+
+// Whether the timers of a clock are kept in a timer_wheel rather than a timer_set
+template <typename Clock>
+inline constexpr bool use_timer_wheel =
+#ifdef SEASTAR_LOWRES_TIMER_WHEEL
+        std::is_same_v<Clock, lowres_clock>;
+#else
+        false;
+#endif
+
+}
+
 SEASTAR_MODULE_EXPORT_BEGIN
 
 using steady_clock_type = std::chrono::steady_clock;
@@ -93,16 +112,35 @@ class timer {
     callback_t _callback;
     time_point _expiry;
     std::optional<duration> _period;
+    duration _slack = duration::zero();
     bool _armed = false;
     bool _queued = false;
     bool _expired = false;
     void readd_periodic() noexcept;
+    // Rounds until up to a multiple of the largest power of two of clock
+    // units within the slack, where the timers armed for about the same
+    // time meet
+    time_point coalesce(time_point until) const noexcept {
+        if (_slack <= duration::zero()) {
+            return until;
+        }
+        using rep = typename duration::rep;
+        auto granularity = rep(std::bit_floor(std::make_unsigned_t<rep>(_slack.count())));
+        auto t = until.time_since_epoch().count();
+        auto rem = t % granularity;
+        if (rem > 0 && t <= std::numeric_limits<rep>::max() - (granularity - rem)) {
+            t += granularity - rem;
+        } else if (rem < 0) {
+            t -= rem;
+        }
+        return time_point(duration(t));
+    }
     void arm_state(time_point until, std::optional<duration> period) noexcept {
         SEASTAR_ASSERT(!_armed);
         _period = period;
         _armed = true;
         _expired = false;
-        _expiry = until;
+        _expiry = coalesce(until);
         _queued = true;
     }
 public:
@@ -114,7 +152,7 @@ class timer {
     /// \note care should be taken when moving a timer whose callback captures `this`,
     ///       since the object pointed to by `this` may have been moved as well.
     timer(timer&& t) noexcept : _sg(t._sg), _callback(std::move(t._callback)), _expiry(std::move(t._expiry)), _period(std::move(t._period)),
-            _armed(t._armed), _queued(t._queued), _expired(t._expired) {
+            _slack(t._slack), _armed(t._armed), _queued(t._queued), _expired(t._expired) {
         _link.swap_nodes(t._link);
         t._queued = false;
         t._armed = false;
@@ -200,6 +238,26 @@ class timer {
         }
         arm_periodic(delta);
     }
+    /// Allows the timer to expire up to \c slack after the time it is armed for
+    ///
+    /// The expiration time is rounded up to a multiple of the largest power
+    /// of two of clock units not exceeding \c slack. Timers armed for about
+    /// the same time then expire together, so that the reactor is woken up,
+    /// and for `timer<std::chrono::steady_clock>` reprograms its high
+    /// resolution timer, once for all of them. This suits timeouts that need
+    /// not be precise, such as idle connection timers. The slack applies to
+    /// the following arm() calls, including the automatic rearming of
+    /// periodic timers.
+    ///
+    /// \param slack how late the timer may expire, zero (the default) for
+    ///        expiring at the exact time
+    void set_slack(duration slack) noexcept {
+        _slack = slack;
+    }
+    /// Returns the slack the timer is armed with, see set_slack()
+    duration get_slack() const noexcept {
+        return _slack;
+    }
     /// Returns whether the timer is armed
     ///
     /// \return `true` if the timer is armed and has not expired yet.
@@ -214,13 +272,15 @@ class timer {
     /// Gets the expiration time of an armed timer.
     ///
     /// \return the time at which the timer is scheduled to expire (undefined if the
-    ///       timer is not armed).
+    ///       timer is not armed), rounded up according to the slack (see set_slack()).
     time_point get_timeout() const noexcept {
         return _expiry;
     }
 
     friend class timer_set<timer, &timer::_link>;
-    using set_t = timer_set<timer, &timer::_link>;
+    friend class timer_wheel<timer, &timer::_link>;
+    using set_t = std::conditional_t<internal::use_timer_wheel<Clock>,
+            timer_wheel<timer, &timer::_link>, timer_set<timer, &timer::_link>>;
 };
 
 extern template class timer<steady_clock_type>;
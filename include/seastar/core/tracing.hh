@@ -0,0 +1,188 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+#endif
+
+#include <seastar/core/future.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+/// Distributed tracing, compatible with the W3C Trace Context
+/// (https://www.w3.org/TR/trace-context/)
+///
+/// A span is made current for a fiber with with_span(), and stays current
+/// for all the tasks the fiber creates from then on, the way the
+/// scheduling group does, so that code deep down the call chain can find
+/// it with current_context() without it being passed around. The RPC
+/// client and the HTTP client send the current context along with their
+/// requests, and the RPC and HTTP servers run the handlers of requests
+/// that carry one in a span child of it.
+///
+/// Spans which are sampled are handed to the \ref span_sink of their shard
+/// when they end.
+namespace tracing {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// The identity of a span, as propagated between processes
+struct trace_context {
+    using trace_id_type = std::array<uint8_t, 16>;
+    using span_id_type = std::array<uint8_t, 8>;
+    static constexpr uint8_t sampled_flag = 0x01;
+    /// Size of the binary form, see write() and read()
+    static constexpr size_t serialized_size = 16 + 8 + 1;
+
+    trace_id_type trace_id = {};
+    span_id_type span_id = {};
+    uint8_t flags = 0;
+
+    /// Neither id is all zeros
+    bool valid() const noexcept;
+    bool sampled() const noexcept { return flags & sampled_flag; }
+    /// The value of the traceparent header, e.g.
+    /// 00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01
+    sstring traceparent() const;
+    /// Parses a traceparent header, std::nullopt if malformed or invalid
+    static std::optional<trace_context> from_traceparent(std::string_view value) noexcept;
+    /// Writes serialized_size bytes
+    void write(char* p) const noexcept;
+    /// Reads serialized_size bytes, std::nullopt if invalid
+    static std::optional<trace_context> read(const char* p) noexcept;
+
+    bool operator==(const trace_context&) const noexcept = default;
+};
+
+/// A span which ended
+struct span_data {
+    sstring name;
+    trace_context context;
+    /// All zeros for the root span of a trace
+    trace_context::span_id_type parent_span_id = {};
+    std::chrono::system_clock::time_point start;
+    std::chrono::system_clock::time_point end;
+    std::vector<std::pair<sstring, sstring>> attributes;
+    /// The operation of the span failed
+    bool failed = false;
+};
+
+/// Receives the sampled spans of a shard
+class span_sink {
+public:
+    virtual ~span_sink() = default;
+    /// Called on the shard the span ran on, when it ends
+    virtual void consume(span_data&& span) noexcept = 0;
+};
+
+/// Sets the sink of the spans of this shard, nullptr drops them
+void set_span_sink(shared_ptr<span_sink> sink) noexcept;
+
+/// Sets the probability that a trace started on this shard is sampled,
+/// 0 (the default) disabling the spans of the servers which have no
+/// parent. Traces continued from a remote parent follow its decision.
+void set_root_sampling_probability(double p) noexcept;
+double root_sampling_probability() noexcept;
+
+SEASTAR_MODULE_EXPORT_END
+
+/// \cond internal
+namespace internal {
+struct span_state;
+}
+/// \endcond
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// A span of a trace, ending when destroyed or end() is called
+class span {
+    std::unique_ptr<internal::span_state> _state;
+
+    friend uint32_t enter_span(span& s) noexcept;
+public:
+    /// A span child of the current one of the fiber, or otherwise the root
+    /// of a new trace, sampled with root_sampling_probability()
+    explicit span(sstring name);
+    /// A span child of a span of another process, e.g. the one a request
+    /// came with, or the same as span(sstring) without one
+    span(sstring name, const std::optional<trace_context>& parent);
+    span(span&&) noexcept;
+    span& operator=(span&&) noexcept;
+    ~span();
+
+    const trace_context& context() const noexcept;
+    /// Attributes of spans which are not sampled are dropped
+    void set_attribute(sstring key, sstring value);
+    void set_failed() noexcept;
+    /// Hands the span to the sink of the shard if it is sampled. Further
+    /// calls have no effect.
+    void end() noexcept;
+};
+
+/// The context of the current span of the fiber, nullptr without one
+const trace_context* current_context() noexcept;
+/// Sets an attribute of the current span of the fiber, if there is one
+/// and it is sampled
+void set_attribute(sstring key, sstring value);
+
+/// \cond internal
+// Makes the span current, returning what was current before, which
+// exit_span() restores
+uint32_t enter_span(span& s) noexcept;
+void exit_span(uint32_t previous) noexcept;
+/// \endcond
+
+/// Runs a function with a span current, so that it and the tasks it
+/// creates, directly or not, see it as current_context()
+///
+/// The span ends when the returned future resolves, failed if the future
+/// did.
+template <typename Func>
+futurize_t<std::invoke_result_t<Func>> with_span(span s, Func&& func) noexcept {
+    auto previous = enter_span(s);
+    auto f = futurize_invoke(std::forward<Func>(func));
+    exit_span(previous);
+    return f.then_wrapped([s = std::move(s)] (auto f) mutable {
+        if (f.failed()) {
+            s.set_failed();
+        }
+        s.end();
+        return f;
+    });
+}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
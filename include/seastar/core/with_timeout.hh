@@ -27,6 +27,7 @@
 #include <chrono>
 
 #include <seastar/core/future.hh>
+#include <seastar/core/preallocated_exception.hh>
 #include <seastar/core/timed_out_error.hh>
 #include <seastar/core/timer.hh>
 #include <seastar/util/modules.hh>
@@ -58,7 +59,11 @@ future<T...> with_timeout(std::chrono::time_point<Clock, Duration> timeout, futu
     auto pr = std::make_unique<promise<T...>>();
     auto result = pr->get_future();
     timer<Clock> timer([&pr = *pr] {
-        pr.set_exception(std::make_exception_ptr(ExceptionFactory::timeout()));
+        if constexpr (std::is_same_v<ExceptionFactory, default_timeout_exception_factory>) {
+            pr.set_exception(preallocated_exception<timed_out_error>());
+        } else {
+            pr.set_exception(std::make_exception_ptr(ExceptionFactory::timeout()));
+        }
     });
     timer.arm(timeout);
     // Future is returned indirectly.
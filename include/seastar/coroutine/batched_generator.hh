@@ -0,0 +1,315 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+#include <seastar/core/future.hh>
+#include <seastar/util/assert.hh>
+
+namespace seastar::coroutine::experimental {
+
+/// The first parameter of a \ref batched_generator coroutine, sizing the
+/// batches it produces.
+struct batch_config {
+    /// Number of elements in a batch
+    size_t batch_size;
+    /// Number of full batches the generator may produce ahead of its caller
+    size_t lookahead = 1;
+};
+
+template <typename T>
+class batched_generator;
+
+namespace internal {
+
+template <typename T>
+class batched_generator_promise;
+
+template <typename T>
+struct batch_yield_awaiter final {
+    seastar::future<> _future;
+
+    bool await_ready() const noexcept {
+        return _future.available() && !seastar::need_preempt();
+    }
+
+    void await_suspend(std::coroutine_handle<batched_generator_promise<T>> coro) noexcept {
+        if (_future.available()) {
+            seastar::schedule(&coro.promise());
+        } else {
+            _future.set_coroutine(coro.promise());
+        }
+    }
+
+    void await_resume() noexcept { }
+};
+
+template <typename T>
+struct next_batch_awaiter final {
+    batched_generator_promise<T>* const _promise;
+    seastar::future<> _future;
+
+    next_batch_awaiter(batched_generator_promise<T>* promise, seastar::future<>&& f) noexcept
+        : _promise(promise)
+        , _future(std::move(f)) {}
+    next_batch_awaiter(const next_batch_awaiter&) = delete;
+    next_batch_awaiter(next_batch_awaiter&&) = delete;
+
+    bool await_ready() const noexcept {
+        return _future.available() && !seastar::need_preempt();
+    }
+
+    template <typename Promise>
+    void await_suspend(std::coroutine_handle<Promise> coro) noexcept {
+        if (_future.available()) {
+            seastar::schedule(&coro.promise());
+        } else {
+            _future.set_coroutine(coro.promise());
+        }
+    }
+
+    std::span<T> await_resume() {
+        return _promise ? _promise->take_batch() : std::span<T>();
+    }
+};
+
+// The produced batches live in the promise, and the coroutine stays
+// suspended at its final point until the generator is destroyed, so that
+// the caller can drain them after the coroutine is done.
+template <typename T>
+class batched_generator_promise final : public seastar::task {
+    using batch = std::vector<T>;
+
+    const size_t _batch_size;
+    const size_t _lookahead;
+    batch _filling;
+    std::deque<batch> _full;
+    // the batch last handed to the caller, recycled on the next call
+    batch _taken;
+    std::vector<batch> _free;
+    std::exception_ptr _ex;
+    bool _started = false;
+    bool _finished = false;
+    std::optional<seastar::promise<>> _wait_for_batch;
+    std::optional<seastar::promise<>> _wait_for_space;
+
+    void publish() {
+        _full.push_back(std::move(_filling));
+        if (_free.empty()) {
+            _filling = batch();
+            _filling.reserve(_batch_size);
+        } else {
+            _filling = std::move(_free.back());
+            _free.pop_back();
+        }
+        wake_caller();
+    }
+
+    void wake_caller() noexcept {
+        if (_wait_for_batch) {
+            _wait_for_batch->set_value();
+            _wait_for_batch = {};
+        }
+    }
+
+    void finish() noexcept {
+        if (!_filling.empty()) {
+            _full.push_back(std::move(_filling));
+        }
+        _finished = true;
+        wake_caller();
+    }
+
+public:
+    template <typename... Args>
+    explicit batched_generator_promise(batch_config cfg, Args&&...)
+            : _batch_size(std::max<size_t>(cfg.batch_size, 1))
+            , _lookahead(std::max<size_t>(cfg.lookahead, 1)) {
+        _filling.reserve(_batch_size);
+    }
+    batched_generator_promise(batched_generator_promise&&) = delete;
+    batched_generator_promise(const batched_generator_promise&) = delete;
+
+    template <std::convertible_to<T> U>
+    batch_yield_awaiter<T> yield_value(U&& value) {
+        _filling.push_back(std::forward<U>(value));
+        if (_filling.size() < _batch_size) {
+            return {make_ready_future<>()};
+        }
+        publish();
+        if (_full.size() < _lookahead) {
+            return {make_ready_future<>()};
+        }
+        return {_wait_for_space.emplace().get_future()};
+    }
+
+    void return_void() noexcept {
+        finish();
+    }
+
+    void unhandled_exception() noexcept {
+        _ex = std::current_exception();
+        finish();
+    }
+
+    batched_generator<T> get_return_object() noexcept;
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    std::suspend_always final_suspend() const noexcept { return {}; }
+
+    seastar::future<> next_batch() noexcept {
+        if (!_full.empty() || _finished) {
+            return make_ready_future<>();
+        }
+        if (!_started) {
+            _started = true;
+            seastar::schedule(this);
+        }
+        SEASTAR_ASSERT(!_wait_for_batch);
+        return _wait_for_batch.emplace().get_future();
+    }
+
+    std::span<T> take_batch() {
+        if (!_taken.empty()) {
+            _taken.clear();
+            _free.push_back(std::move(_taken));
+        }
+        if (!_full.empty()) {
+            _taken = std::move(_full.front());
+            _full.pop_front();
+            if (_wait_for_space) {
+                _wait_for_space->set_value();
+                _wait_for_space = {};
+            }
+            return std::span<T>(_taken);
+        }
+        if (_ex) {
+            std::rethrow_exception(std::exchange(_ex, nullptr));
+        }
+        return {};
+    }
+
+    void run_and_dispose() noexcept final {
+        std::coroutine_handle<batched_generator_promise>::from_promise(*this).resume();
+    }
+
+    seastar::task* waiting_task() noexcept final {
+        return _wait_for_batch ? _wait_for_batch->waiting_task() : nullptr;
+    }
+};
+
+} // namespace internal
+
+/// `seastar::coroutine::experimental::batched_generator<T>` is a generator
+/// which hands its values to the caller in batches.
+///
+/// The coroutine takes a \ref batch_config as its first parameter and
+/// `co_yield`s the values one by one. They are collected into batches of
+/// \c batch_size values, and the coroutine is only suspended when \c lookahead
+/// full batches wait for the caller, so a value costs a push into a vector
+/// rather than a switch between the coroutine and its caller. The caller
+/// gets the batches as spans, which stay valid until it asks for the next
+/// one; the vectors backing them are reused. An empty span marks the end of
+/// the sequence. If the coroutine fails, the exception is rethrown to the
+/// caller after the batches produced before the failure.
+///
+/// As with \ref generator, the generator must outlive any asynchronous
+/// operation the coroutine is suspended on.
+///
+/// Example
+///
+/// ```
+/// auto parse_rows = [&in] (coroutine::experimental::batch_config)
+///         -> coroutine::experimental::batched_generator<row> {
+///     while (auto buf = co_await in.read()) {
+///         for (auto& r : parse(buf)) {
+///             co_yield std::move(r);
+///         }
+///     }
+/// };
+///
+/// auto rows = parse_rows({.batch_size = 1024, .lookahead = 2});
+/// while (true) {
+///     auto batch = co_await rows();
+///     if (batch.empty()) {
+///         break;
+///     }
+///     for (auto& r : batch) {
+///         process(r);
+///     }
+/// }
+/// ```
+template <typename T>
+class batched_generator {
+public:
+    using promise_type = internal::batched_generator_promise<T>;
+
+private:
+    std::coroutine_handle<promise_type> _coro;
+
+public:
+    explicit batched_generator(std::coroutine_handle<promise_type> coro) noexcept : _coro(coro) {}
+    batched_generator(const batched_generator&) = delete;
+    batched_generator(batched_generator&& other) noexcept : _coro(std::exchange(other._coro, {})) {}
+    batched_generator& operator=(batched_generator&& other) noexcept {
+        if (std::addressof(other) != this) {
+            if (_coro) {
+                _coro.destroy();
+            }
+            _coro = std::exchange(other._coro, {});
+        }
+        return *this;
+    }
+    ~batched_generator() {
+        if (_coro) {
+            _coro.destroy();
+        }
+    }
+
+    /// Waits for the next batch of values, an empty span at the end
+    internal::next_batch_awaiter<T> operator()() noexcept {
+        if (!_coro) {
+            return {nullptr, make_ready_future<>()};
+        }
+        return {&_coro.promise(), _coro.promise().next_batch()};
+    }
+};
+
+namespace internal {
+
+template <typename T>
+batched_generator<T> batched_generator_promise<T>::get_return_object() noexcept {
+    return batched_generator<T>(std::coroutine_handle<batched_generator_promise>::from_promise(*this));
+}
+
+} // namespace internal
+
+} // namespace seastar::coroutine::experimental
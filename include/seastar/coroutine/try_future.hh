@@ -0,0 +1,142 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/coroutine.hh>
+
+namespace seastar {
+
+namespace internal {
+
+// Waits for the future as a task of its own, so that when the future fails
+// the coroutine can be failed with its exception, and destroyed, instead of
+// being resumed to rethrow it.
+template <bool CheckPreempt, typename T>
+class [[nodiscard]] try_future_awaiter : public task {
+    seastar::future<T> _future;
+    std::coroutine_handle<> _coroutine;
+    task* _waiting_task = nullptr;
+    void (*_fail)(std::coroutine_handle<>, std::exception_ptr&&) noexcept = nullptr;
+
+    template <typename U>
+    static void fail(std::coroutine_handle<> h, std::exception_ptr&& ex) noexcept {
+        auto hndl = std::coroutine_handle<U>::from_address(h.address());
+        hndl.promise().set_exception(std::move(ex));
+        hndl.destroy();
+    }
+public:
+    explicit try_future_awaiter(seastar::future<T>&& f) noexcept : _future(std::move(f)) {}
+
+    try_future_awaiter(const try_future_awaiter&) = delete;
+    try_future_awaiter(try_future_awaiter&&) = delete;
+
+    bool await_ready() const noexcept {
+        return _future.available() && !_future.failed() && (!CheckPreempt || !need_preempt());
+    }
+
+    template<typename U>
+    void await_suspend(std::coroutine_handle<U> hndl) noexcept {
+        if (_future.failed()) {
+            fail<U>(hndl, _future.get_exception());
+            return;
+        }
+        if (_future.available()) {
+            schedule(&hndl.promise());
+            return;
+        }
+        _coroutine = hndl;
+        _waiting_task = &hndl.promise();
+        _fail = fail<U>;
+        set_scheduling_group(_waiting_task->group());
+        _future.set_coroutine(*this);
+    }
+
+    T await_resume() {
+        if constexpr (std::is_void_v<T>) {
+            _future.get();
+        } else {
+            return _future.get();
+        }
+    }
+
+    virtual void run_and_dispose() noexcept override {
+        if (_future.failed()) {
+            // destroys *this, along with the coroutine frame
+            _fail(_coroutine, _future.get_exception());
+        } else {
+            _coroutine.resume();
+        }
+    }
+
+    virtual task* waiting_task() noexcept override {
+        return _waiting_task;
+    }
+};
+
+} // namespace seastar::internal
+
+namespace coroutine {
+
+/// \brief co_await:s a \ref future, returning its value, or failing the
+/// coroutine with its exception without rethrowing it.
+///
+/// co_await-ing a failed future rethrows its exception inside the
+/// coroutine, to be caught by the coroutine and stored into the future it
+/// returns. With `coroutine::try_future`, the exception is moved into that
+/// future directly, and the coroutine is destroyed, so that no exception is
+/// thrown, which makes failing cheap when coupled with
+/// \ref preallocated_exception.
+///
+/// For example:
+/// ```
+/// future<int> get_value() {
+///     // fails get_value() if lookup() fails
+///     auto v = co_await coroutine::try_future(lookup());
+///     co_return v + 1;
+/// }
+/// ```
+///
+/// The coroutine's local objects are destroyed when it is failed this way,
+/// as they are when it returns, but code that would catch the exception
+/// inside the coroutine doesn't run.
+///
+/// Note that by default, `try_future` checks if the task quota is depleted,
+/// which means that it will yield if the future is ready and \ref seastar::need_preempt()
+/// returns true.  Use \ref coroutine::try_future_without_preemption_check
+/// to disable preemption checking.
+template<typename T = void>
+class [[nodiscard]] try_future : public seastar::internal::try_future_awaiter<true, T> {
+public:
+    explicit try_future(seastar::future<T>&& f) noexcept : seastar::internal::try_future_awaiter<true, T>(std::move(f)) {}
+};
+
+/// \brief co_await:s a \ref future like \ref coroutine::try_future, without
+/// checking if preemption is needed.
+template<typename T = void>
+class [[nodiscard]] try_future_without_preemption_check : public seastar::internal::try_future_awaiter<false, T> {
+public:
+    explicit try_future_without_preemption_check(seastar::future<T>&& f) noexcept : seastar::internal::try_future_awaiter<false, T>(std::move(f)) {}
+};
+
+} // namespace seastar::coroutine
+
+} // namespace seastar
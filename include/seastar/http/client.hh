@@ -22,13 +22,19 @@
 #pragma once
 
 #ifndef SEASTAR_MODULE
+#include <algorithm>
 #include <boost/intrusive/list.hpp>
+#include <vector>
 #endif
 #include <seastar/net/api.hh>
 #include <seastar/http/connection_factory.hh>
 #include <seastar/http/reply.hh>
 #include <seastar/core/condition-variable.hh>
+#include <seastar/core/gate.hh>
 #include <seastar/core/iostream.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
 #include <seastar/util/modules.hh>
 
 namespace bi = boost::intrusive;
@@ -75,12 +81,20 @@ class connection : public enable_shared_from_this<connection> {
     input_stream<char> _read_buf;
     output_stream<char> _write_buf;
     hook_t _hook;
+    // When the connection was last put back to the pool
+    lowres_clock::time_point _idle_since;
     future<> _closed;
     internal::client_ref _ref;
     // Client sends HTTP-1.1 version and assumes the server is 1.1-compatible
     // too and thus the connection will be persistent by default. If the server
     // responds with older version, this flag will be dropped (see recv_reply())
     bool _persistent = true;
+    // Requests pipelined on the connection take turns, each one is sent after
+    // the previous one was, and reads its reply after the previous reply was
+    // consumed (see client::set_pipeline_depth())
+    future<> _send_turn = make_ready_future<>();
+    future<> _recv_turn = make_ready_future<>();
+    unsigned _pipelined = 0;
 
 public:
     /**
@@ -128,6 +142,7 @@ class connection : public enable_shared_from_this<connection> {
 
 private:
     future<reply_ptr> do_make_request(request& rq);
+    future<reply_ptr> send_request(request& rq);
     void setup_request(request& rq);
     future<> send_request_head(const request& rq);
     future<reply_ptr> maybe_wait_for_continue(const request& req);
@@ -164,16 +179,44 @@ class client {
     unsigned _max_connections;
     size_t _max_bytes_to_drain;
     unsigned long _total_new_connections = 0;
+    unsigned long _connection_waits = 0;
+    unsigned long _evicted_connections = 0;
+    std::chrono::steady_clock::duration _connection_wait_time{};
     const retry_requests _retry;
     condition_variable _wait_con;
     connections_list_t _pool;
+    lowres_clock::duration _idle_timeout{};
+    timer<lowres_clock> _idle_timer;
+    gate _bg;
 
     using connection_ptr = seastar::shared_ptr<connection>;
 
+    unsigned _pipeline_depth = 1;
+    // Connections busy with pipelined requests, which may take more of them
+    std::vector<connection_ptr> _pipelining;
+    unsigned long _pipelined_requests = 0;
+
+    // An HTTP/2 connection, see set_http2()
+    class h2_connection;
+    using h2_connection_ptr = seastar::shared_ptr<h2_connection>;
+    bool _http2 = false;
+    std::vector<h2_connection_ptr> _h2_connections;
+
+    // Hedging of idempotent requests, see set_hedging()
+    class hedged_request;
+    std::chrono::steady_clock::duration _hedging_delay{};
+    std::optional<double> _hedging_percentile;
+    std::chrono::steady_clock::duration _hedging_estimate{};
+    metrics::internal::time_estimated_histogram _hedging_latencies;
+    unsigned long _hedged_requests = 0;
+    unsigned long _hedge_wins = 0;
+
     future<connection_ptr> get_connection(abort_source* as);
     future<connection_ptr> make_connection(abort_source* as);
     future<> put_connection(connection_ptr con);
     future<> shrink_connections();
+    void evict_idle_connections();
+    future<> close_pool();
 
     template <std::invocable<connection&> Fn>
     auto with_connection(Fn&& fn, abort_source*);
@@ -182,8 +225,25 @@ class client {
     requires std::invocable<Fn, connection&>
     auto with_new_connection(Fn&& fn, abort_source*);
 
+    future<connection_ptr> get_pipelined_connection(abort_source* as);
+    template <std::invocable<connection&> Fn>
+    auto with_pipelined_connection(Fn&& fn, abort_source*);
+    bool can_pipeline(const request& req) const;
+
+    future<> make_h1_request(request& req, reply_handler& handle, std::optional<reply::status_type> expected, abort_source* as, bool pipeline);
+    bool can_hedge(const request& req) const;
+    std::chrono::steady_clock::duration hedging_delay() const noexcept;
+    void update_hedging_estimate(std::chrono::steady_clock::duration latency);
+    future<> make_hedged_request(request& req, reply_handler& handle, std::optional<reply::status_type> expected, abort_source* as);
+
     future<> do_make_request(connection& con, request& req, reply_handler& handle, abort_source*, std::optional<reply::status_type> expected);
 
+    future<h2_connection_ptr> get_h2_connection(abort_source* as);
+    future<h2_connection_ptr> make_h2_connection(abort_source* as);
+    future<> make_h2_request(request& req, reply_handler& handle, std::optional<reply::status_type> expected, abort_source* as);
+    future<> do_make_h2_request(h2_connection& con, request& req, reply_handler& handle, abort_source*, std::optional<reply::status_type> expected);
+    future<> close_h2_connections();
+
 public:
     /**
      * \brief Construct a simple client
@@ -287,6 +347,96 @@ class client {
      */
     future<> set_maximum_connections(unsigned nr);
 
+    /**
+     * \brief Opens connections ahead of demand
+     *
+     * Makes up to \p nr new connections in parallel and puts them into the pool, so
+     * that the following requests don't pay for the connection setup (and the TLS
+     * handshake). The maximum number of connections is respected. The returned future
+     * resolves when all connections are made, or with the first error if some of them
+     * couldn't be, the successfully made ones still go to the pool.
+     *
+     * \param nr -- the number of connections to make
+     * \param as -- abort source that aborts connecting
+     */
+    future<> prewarm(unsigned nr, abort_source* as = nullptr);
+
+    /**
+     * \brief Sets the time after which idle pooled connections are closed
+     *
+     * Servers close keep-alive connections after some idle time on their own, so
+     * a client would otherwise find them broken when it comes back. The pool hands
+     * out the most recently used connection first, so when the load drops, the
+     * unneeded connections age out. Zero (the default) keeps idle connections
+     * forever.
+     *
+     * \param timeout -- idle time after which a pooled connection is closed
+     */
+    void set_idle_timeout(lowres_clock::duration timeout);
+
+    /**
+     * \brief Make requests over HTTP/2
+     *
+     * When enabled, requests are sent as HTTP/2 streams multiplexed over a few connections
+     * instead of each taking a pooled connection of its own. The server must accept HTTP/2
+     * with prior knowledge, i.e. either cleartext h2c or "h2" selected with ALPN, for which
+     * the connection factory has to offer it in tls::tls_options::alpn_protocols.
+     *
+     * A new connection is only made when the existing ones reached the server's limit of
+     * concurrent streams, and the maximum number of connections still applies. Replies whose
+     * body the handler didn't read entirely just have their stream cancelled, so there's
+     * nothing to drain. Expect: 100-continue is not supported in this mode.
+     *
+     * Must be called before the first request is made
+     *
+     * \param enable -- whether to use HTTP/2
+     */
+    void set_http2(bool enable) noexcept {
+        _http2 = enable;
+    }
+
+    /**
+     * \brief Pipeline requests on HTTP/1.1 connections
+     *
+     * When the depth is above one, an idempotent request (GET, HEAD, OPTIONS,
+     * TRACE, PUT or DELETE) that finds no idle connection in the pool is sent
+     * over a connection already busy with such requests, as long as there are
+     * fewer than \c depth of them on it. It doesn't wait for the replies to the
+     * previous ones, which saves a round trip per request. The replies are read
+     * in order, so a slow reply delays the ones behind it. Requests expecting
+     * 100-continue are never pipelined.
+     *
+     * If the connection breaks, all the requests pipelined on it fail, and they
+     * are retried over new connections when the client retries requests.
+     *
+     * \param depth -- the maximum number of requests in flight on a connection
+     */
+    void set_pipeline_depth(unsigned depth) noexcept {
+        _pipeline_depth = std::max(depth, 1u);
+    }
+
+    /**
+     * \brief Hedge idempotent requests
+     *
+     * When the delay is above zero, an idempotent request (see \ref set_pipeline_depth())
+     * that got no reply within the delay is sent once more, over another connection,
+     * and whichever reply comes first is passed to the handler. The connection the
+     * other request went over is closed, which is the only way to cancel a request in
+     * HTTP/1.1, so hedging trades extra requests and connections for a shorter tail.
+     *
+     * With a percentile, the request is sent again once it has taken longer than this
+     * percentile of the recent requests took to get a reply, but never sooner than the
+     * delay, so that only the slowest requests are sent twice. The delay applies alone
+     * until enough replies have been seen.
+     *
+     * Requests with a body writer or expecting 100-continue are not hedged, and neither
+     * are HTTP/2 requests.
+     *
+     * \param delay -- the time to wait for a reply before hedging, zero disables hedging
+     * \param percentile -- the optional percentile of the reply latency, in the [0, 1] range
+     */
+    void set_hedging(std::chrono::steady_clock::duration delay, std::optional<double> percentile = std::nullopt);
+
     /**
      * \brief Closes the client
      *
@@ -320,6 +470,57 @@ class client {
     unsigned long total_new_connections_nr() const noexcept {
         return _total_new_connections;
     }
+
+    /**
+     * \brief Returns the number of requests that couldn't take a pooled connection right away
+     *
+     * Such requests waited either for a new connection to be made or for another
+     * request to release its connection.
+     */
+
+    unsigned long connection_waits_nr() const noexcept {
+        return _connection_waits;
+    }
+
+    /**
+     * \brief Returns the total time requests spent waiting for a connection
+     */
+
+    std::chrono::steady_clock::duration total_connection_wait_time() const noexcept {
+        return _connection_wait_time;
+    }
+
+    /**
+     * \brief Returns the number of pooled connections closed because of the idle timeout
+     */
+
+    unsigned long evicted_connections_nr() const noexcept {
+        return _evicted_connections;
+    }
+
+    /**
+     * \brief Returns the number of requests sent over a connection busy with other requests
+     */
+
+    unsigned long pipelined_requests_nr() const noexcept {
+        return _pipelined_requests;
+    }
+
+    /**
+     * \brief Returns the number of requests sent again because their reply was late
+     */
+
+    unsigned long hedged_requests_nr() const noexcept {
+        return _hedged_requests;
+    }
+
+    /**
+     * \brief Returns the number of hedged requests whose second copy replied first
+     */
+
+    unsigned long hedge_wins_nr() const noexcept {
+        return _hedge_wins;
+    }
 };
 
 } // experimental namespace
@@ -0,0 +1,104 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <string_view>
+#include <vector>
+#endif
+
+#include <seastar/core/iostream.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace http {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// Content codings of reply bodies, RFC 9110 Section 8.4.1
+enum class content_encoding {
+    identity,
+    gzip,
+    deflate,
+    zstd, ///< only available when seastar is built with zstd support
+};
+
+/// The name of the coding, as used in the Content-Encoding header
+std::string_view to_string(content_encoding enc) noexcept;
+
+/// Settings of reply body compression, see \ref httpd::http_server::set_compression()
+struct compression_config {
+    /// The codings the server may use, most preferred first. The preference
+    /// breaks ties between the codings the client accepts equally.
+    std::vector<content_encoding> encodings = {
+#ifdef SEASTAR_HAVE_ZSTD
+        content_encoding::zstd,
+#endif
+        content_encoding::gzip,
+        content_encoding::deflate,
+    };
+    /// Bodies set as a string shorter than that are sent as is, since the
+    /// coding overhead would outweigh the savings. Streamed bodies are
+    /// always compressed, as their length is not known upfront.
+    size_t min_size = 1024;
+    /// Compression level of gzip and deflate, 1 (fastest) to 9 (smallest)
+    int zlib_level = 6;
+    /// Compression level of zstd
+    int zstd_level = 3;
+    /// The scheduling group compression runs in, so that it competes with
+    /// the rest of the work of the shard for CPU under its own shares.
+    scheduling_group sched_group = current_scheduling_group();
+};
+
+/// Picks the coding of a reply from the Accept-Encoding header of the request
+///
+/// \param accept_encoding the value of the Accept-Encoding header
+/// \param supported the codings to choose from, most preferred first
+/// \return the supported coding with the highest quality value,
+///         content_encoding::identity if none is acceptable
+content_encoding negotiate_content_encoding(std::string_view accept_encoding,
+        const std::vector<content_encoding>& supported);
+
+/// Whether bodies of the media type are worth compressing
+///
+/// Textual types are, while most binary formats are compressed already.
+bool is_compressible(std::string_view content_type) noexcept;
+
+/// Makes a stream that compresses what is written to it into \c out
+///
+/// Flushing the stream emits all data written so far, at some cost to the
+/// compression ratio, and closing it finishes the coded body and closes
+/// \c out. Compression runs in \c cfg.sched_group.
+output_stream<char> make_compressed_output_stream(output_stream<char> out, content_encoding enc,
+        const compression_config& cfg);
+
+/// Compresses a whole body, preempting as needed, in \c cfg.sched_group
+future<sstring> compress(sstring content, content_encoding enc, const compression_config& cfg);
+
+SEASTAR_MODULE_EXPORT_END
+
+} // namespace http
+
+} // namespace seastar
@@ -44,14 +44,25 @@ class connection_factory {
 };
 
 class basic_connection_factory : public connection_factory {
-    socket_address _addr;
+    std::vector<socket_address> _addrs;
+    connect_any_options _opts;
 public:
     explicit basic_connection_factory(socket_address addr)
-        : _addr(std::move(addr))
+        : _addrs({std::move(addr)})
+    {
+    }
+    /**
+     * \brief Connects to whichever of the server's \c addrs answers first
+     *
+     * \see connect_any()
+     */
+    explicit basic_connection_factory(std::vector<socket_address> addrs, connect_any_options opts = {})
+        : _addrs(std::move(addrs))
+        , _opts(std::move(opts))
     {
     }
     virtual future<connected_socket> make(abort_source* as) override {
-        return seastar::connect(_addr, {}, transport::TCP);
+        return connect_any(_addrs, _opts);
     }
 };
 
@@ -82,6 +82,19 @@ class file_interaction_handler : public handler_base {
         return this;
     }
 
+    /**
+     * Allows serving precompressed siblings of the files, e.g. style.css.zst
+     * or style.css.gz for style.css, to clients that accept their coding.
+     * They are sent with a Content-Encoding header, so the server doesn't
+     * compress them again. Ignored when a transformer is set.
+     * @param b whether to look for precompressed files
+     * @return this
+     */
+    file_interaction_handler* set_precompressed(bool b) {
+        precompressed = b;
+        return this;
+    }
+
     /**
      * if the url ends without a slash redirect
      * @param req the request
@@ -108,9 +121,13 @@ class file_interaction_handler : public handler_base {
     future<std::unique_ptr<http::reply> > read(sstring file,
             std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep);
     file_transformer* transformer;
+    bool precompressed = false;
 
     output_stream<char> get_stream(std::unique_ptr<http::request> req,
             const sstring& extension, output_stream<char>&& s);
+private:
+    std::unique_ptr<http::reply> write_file(sstring file_name, sstring extension,
+            std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep);
 };
 
 /**
@@ -25,6 +25,12 @@
 #include <seastar/http/common.hh>
 #include <seastar/http/exception.hh>
 #include <seastar/http/reply.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/core/metrics_registration.hh>
+
+#ifndef SEASTAR_MODULE
+#include <chrono>
+#endif
 
 
 namespace seastar {
@@ -33,6 +39,20 @@ namespace httpd {
 
 typedef const http::request& const_req;
 
+/**
+ * Statistics of the requests the server routed to a handler
+ */
+struct handler_stats {
+    /// Requests admitted and not replied to yet
+    uint64_t in_flight = 0;
+    /// Requests replied to by the handler
+    uint64_t requests = 0;
+    /// Requests rejected with 503, as the handler was at its concurrency limit
+    uint64_t shed = 0;
+    /// Time from admitting a request, before its body is read, to its reply being ready
+    metrics::internal::time_estimated_histogram latency;
+};
+
 /**
  * handlers holds the logic for serving an incoming request.
  * All handlers inherit from the base handler_base and
@@ -41,9 +61,18 @@ typedef const http::request& const_req;
  */
 class handler_base {
     std::vector<sstring> _mandatory_param;
+    bool _streams_content = false;
+    size_t _max_concurrency = 0;
+    handler_stats _stats;
+    metrics::metric_groups _metrics;
 protected:
     handler_base() = default;
-    handler_base(const handler_base&) = default;
+    // The copy starts with its own statistics, and no metrics
+    handler_base(const handler_base& o)
+            : _mandatory_param(o._mandatory_param)
+            , _streams_content(o._streams_content)
+            , _max_concurrency(o._max_concurrency) {
+    }
 public:
     virtual ~handler_base() = default;
     /**
@@ -67,6 +96,77 @@ class handler_base {
         return *this;
     }
 
+    /**
+     * Make the handler read the request body from request::content_stream
+     * instead of request::content, even when the server doesn't stream content.
+     * The body then isn't accumulated in memory before the handler is called.
+     * @param b whether the handler streams the content
+     * @return a reference to the handler
+     */
+    handler_base& stream_content(bool b = true) noexcept {
+        _streams_content = b;
+        return *this;
+    }
+
+    bool streams_content() const noexcept {
+        return _streams_content;
+    }
+
+    /**
+     * Limit the number of requests the handler serves at once. Requests
+     * past the limit are rejected with 503 (Service Unavailable) as soon
+     * as their headers are parsed, before their body is read.
+     * @param n the maximal number of requests in flight, 0 for no limit
+     * @return a reference to the handler
+     */
+    handler_base& max_concurrency(size_t n) noexcept {
+        _max_concurrency = n;
+        return *this;
+    }
+
+    size_t get_max_concurrency() const noexcept {
+        return _max_concurrency;
+    }
+
+    const handler_stats& stats() const noexcept {
+        return _stats;
+    }
+
+    /**
+     * Export the statistics of the handler in the "httpd" metrics group,
+     * as the route_* metrics labelled with the service and the route.
+     * @param service the name of the server, as given to http_server
+     * @param route the name of the route in the metrics
+     * @return a reference to the handler
+     */
+    handler_base& register_metrics(const sstring& service, const sstring& route);
+
+    /**
+     * Account a request routed to the handler, called by the server before
+     * the request body is read
+     * @return false if the handler is at its concurrency limit, in which
+     * case the request is counted as shed
+     */
+    bool try_admit() noexcept {
+        if (_max_concurrency && _stats.in_flight >= _max_concurrency) {
+            ++_stats.shed;
+            return false;
+        }
+        ++_stats.in_flight;
+        return true;
+    }
+
+    /**
+     * Account the end of an admitted request, called by the server when
+     * the reply is ready
+     * @param latency the time since the request was admitted
+     */
+    void release(std::chrono::steady_clock::duration latency) noexcept {
+        --_stats.in_flight;
+        ++_stats.requests;
+        _stats.latency.add(latency);
+    }
+
     /**
      * Check if all mandatory parameters exist in the request. if any param
      * does not exist, the function would throw a @c missing_param_exception
@@ -24,11 +24,13 @@
 #ifndef SEASTAR_MODULE
 #include <limits>
 #include <cctype>
+#include <optional>
 #include <vector>
 #include <boost/intrusive/list.hpp>
 #endif
 #include <seastar/http/request_parser.hh>
 #include <seastar/http/request.hh>
+#include <seastar/http/compression.hh>
 #include <seastar/core/seastar.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/distributed.hh>
@@ -46,6 +48,7 @@ namespace seastar {
 namespace http {
 SEASTAR_MODULE_EXPORT
 struct reply;
+namespace internal::http2 { class stream; }
 }
 
 namespace httpd {
@@ -75,10 +78,31 @@ class connection : public boost::intrusive::list_base_hook<> {
     using tmp_buf = temporary_buffer<char>;
     http_request_parser _parser;
     std::unique_ptr<http::reply> _resp;
-    // null element marks eof
-    queue<std::unique_ptr<http::reply>> _replies { 10 };
+    // A reply, which is still in the works if the request was pipelined
+    struct pending_reply {
+        future<std::unique_ptr<http::reply>> reply;
+        pending_reply(std::unique_ptr<http::reply> rep = {})
+                : reply(make_ready_future<std::unique_ptr<http::reply>>(std::move(rep))) {}
+        pending_reply(future<std::unique_ptr<http::reply>> f) : reply(std::move(f)) {}
+    };
+    // Replies in the order of the requests. Null element marks eof
+    queue<pending_reply> _replies { 10 };
+    // Handlers of pipelined requests running
+    gate _pipelined;
     bool _done = false;
     const bool _tls;
+    // Keeps a request accounted in flight, by the server and by the handler
+    // it is routed to, until its reply is ready
+    class admission {
+        http_server* _server;
+        handler_base* _handler;
+        std::chrono::steady_clock::time_point _start;
+    public:
+        admission(http_server& server, handler_base* handler) noexcept;
+        admission(admission&& o) noexcept;
+        admission& operator=(admission&&) = delete;
+        ~admission();
+    };
 public:
     [[deprecated("use connection(http_server&, connected_socket&&, bool tls)")]]
     connection(http_server& server, connected_socket&& fd, socket_address, bool tls)
@@ -108,6 +132,9 @@ class connection : public boost::intrusive::list_base_hook<> {
     void on_new_connection();
 
     future<> process();
+    future<> process_http1();
+    future<> process_http2();
+    future<bool> detect_http2();
     void shutdown();
     future<> read();
     future<> read_one();
@@ -119,10 +146,20 @@ class connection : public boost::intrusive::list_base_hook<> {
     future<> start_response();
 
     future<bool> generate_reply(std::unique_ptr<http::request> req);
+    future<std::unique_ptr<http::reply>> handle_request(std::unique_ptr<http::request> req);
+    bool dispatch_request(std::unique_ptr<http::request> req, std::optional<admission> adm = std::nullopt);
+    std::optional<admission> admit(handler_base* handler);
+    future<> shed_request(std::unique_ptr<http::request> req);
     void generate_error_reply_and_close(std::unique_ptr<http::request> req, http::reply::status_type status, const sstring& msg);
 
     future<> write_body();
 
+    http::content_encoding negotiate_encoding(const http::request& req) const;
+    future<> compress_reply(http::reply& rep, http::content_encoding enc);
+
+    future<> handle_http2_stream(lw_shared_ptr<http::internal::http2::stream> s);
+    future<> write_http2_reply(lw_shared_ptr<http::internal::http2::stream> s, std::unique_ptr<http::reply> rep);
+
     output_stream<char>& out();
 };
 
@@ -134,6 +171,8 @@ class http_server {
     uint64_t _total_connections = 0;
     uint64_t _current_connections = 0;
     uint64_t _requests_served = 0;
+    uint64_t _requests_in_flight = 0;
+    uint64_t _requests_shed = 0;
     uint64_t _read_errors = 0;
     uint64_t _respond_errors = 0;
     shared_ptr<seastar::tls::server_credentials> _credentials;
@@ -141,6 +180,10 @@ class http_server {
     timer<> _date_format_timer { [this] {_date = http_date();} };
     size_t _content_length_limit = std::numeric_limits<size_t>::max();
     bool _content_streaming = false;
+    bool _http2 = false;
+    size_t _pipeline_depth = 1;
+    size_t _max_concurrent_requests = 0;
+    std::optional<http::compression_config> _compression;
     gate _task_gate;
 public:
     routes _routes;
@@ -186,6 +229,67 @@ class http_server {
 
     void set_content_streaming(bool b);
 
+    size_t get_pipeline_depth() const;
+
+    /*!
+     * \brief handle pipelined requests concurrently
+     *
+     * HTTP/1.1 clients may send requests without waiting for the replies to
+     * the previous ones. By default the server handles them one after another.
+     * With a depth above one, the server goes on parsing the requests of a
+     * connection while the previous ones are being handled, running up to
+     * \c depth of them (counting the replies waiting to be written) at once.
+     * The replies are still sent in the order of the requests. A request with
+     * its body streamed to the handler is waited for, since the next request
+     * only starts where the handler stops reading. Applies to the connections
+     * accepted afterwards.
+     */
+    void set_pipeline_depth(size_t depth);
+
+    bool get_http2() const;
+
+    /*!
+     * \brief accept HTTP/2 connections
+     *
+     * When enabled, connections that start with the HTTP/2 client preface are
+     * served as HTTP/2, with requests multiplexed as streams over the connection.
+     * This covers cleartext clients with prior knowledge (h2c) and TLS clients
+     * that negotiated "h2". For the latter add "h2" to the ALPN protocols of the
+     * server credentials. Other connections keep being served as HTTP/1.x.
+     */
+    void set_http2(bool b);
+
+    const std::optional<http::compression_config>& get_compression() const;
+
+    /*!
+     * \brief compress reply bodies
+     *
+     * When set, the bodies of replies with a compressible content type are
+     * compressed with the coding picked from the Accept-Encoding header of
+     * the request. Bodies written with reply::write_body() are compressed
+     * as they are streamed, string bodies at once unless they are shorter
+     * than \c min_size. Replies that already carry a Content-Encoding header
+     * (e.g. precompressed files) are sent as is. Pass std::nullopt to
+     * disable compression, which is the default.
+     */
+    void set_compression(std::optional<http::compression_config> cfg);
+
+    size_t get_max_concurrent_requests() const;
+
+    /*!
+     * \brief shed requests past a concurrency limit
+     *
+     * Requests that arrive while \c n requests of the server are in flight
+     * are rejected with 503 (Service Unavailable) as soon as their headers
+     * are parsed, without reading their body, so that an overloaded server
+     * spends as little as possible on work it can't take. Routes can have
+     * limits of their own, see handler_base::max_concurrency(). An HTTP/1
+     * connection is closed after a rejected request that has a body. A
+     * request counts as in flight until its reply is ready. 0, the default,
+     * means no limit.
+     */
+    void set_max_concurrent_requests(size_t n);
+
     future<> listen(socket_address addr, server_credentials_ptr credentials);
     future<> listen(socket_address addr, listen_options lo, server_credentials_ptr credentials);
     future<> listen(socket_address addr, listen_options lo);
@@ -198,6 +302,8 @@ class http_server {
     uint64_t total_connections() const;
     uint64_t current_connections() const;
     uint64_t requests_served() const;
+    uint64_t requests_in_flight() const;
+    uint64_t requests_shed() const;
     uint64_t read_errors() const;
     uint64_t reply_errors() const;
     // Write the current date in the specific "preferred format" defined in
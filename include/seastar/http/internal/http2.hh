@@ -0,0 +1,346 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2026 ScyllaDB
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#endif
+#include <seastar/core/circular_buffer.hh>
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/util/noncopyable_function.hh>
+
+// HTTP/2 (RFC 9113) framing and HPACK (RFC 7541) header compression, shared
+// by httpd::http_server and http::experimental::client.
+//
+// A session runs one HTTP/2 connection over an input/output stream pair and
+// multiplexes streams over it. Each stream is a request/response exchange
+// with its own flow control window; the session serializes frame writes and
+// dispatches incoming frames to the streams from a single read loop.
+
+namespace seastar::http::internal::http2 {
+
+// RFC 9113 Section 3.4
+constexpr std::string_view client_preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+constexpr size_t frame_header_size = 9;
+constexpr uint32_t default_window_size = 65535;
+constexpr uint32_t default_max_frame_size = 16384;
+constexpr uint32_t max_max_frame_size = (1 << 24) - 1;
+constexpr int64_t max_window_size = 0x7fffffff;
+
+enum class frame_type : uint8_t {
+    data = 0x0,
+    headers = 0x1,
+    priority = 0x2,
+    rst_stream = 0x3,
+    settings = 0x4,
+    push_promise = 0x5,
+    ping = 0x6,
+    goaway = 0x7,
+    window_update = 0x8,
+    continuation = 0x9,
+};
+
+namespace frame_flags {
+constexpr uint8_t end_stream = 0x1;
+constexpr uint8_t ack = 0x1;
+constexpr uint8_t end_headers = 0x4;
+constexpr uint8_t padded = 0x8;
+constexpr uint8_t priority = 0x20;
+}
+
+enum class error_code : uint32_t {
+    no_error = 0x0,
+    protocol_error = 0x1,
+    internal_error = 0x2,
+    flow_control_error = 0x3,
+    settings_timeout = 0x4,
+    stream_closed = 0x5,
+    frame_size_error = 0x6,
+    refused_stream = 0x7,
+    cancel = 0x8,
+    compression_error = 0x9,
+    connect_error = 0xa,
+    enhance_your_calm = 0xb,
+    inadequate_security = 0xc,
+    http_1_1_required = 0xd,
+};
+
+enum class setting_id : uint16_t {
+    header_table_size = 0x1,
+    enable_push = 0x2,
+    max_concurrent_streams = 0x3,
+    initial_window_size = 0x4,
+    max_frame_size = 0x5,
+    max_header_list_size = 0x6,
+};
+
+struct frame_header {
+    uint32_t length = 0;
+    frame_type type = frame_type::data;
+    uint8_t flags = 0;
+    uint32_t stream_id = 0;
+
+    static frame_header decode(const char* p) noexcept;
+    void encode(char* p) const noexcept;
+};
+
+// Values of the SETTINGS parameters, defaults are the ones from RFC 9113
+// Section 6.5.2 that are in effect until the peer says otherwise.
+struct settings {
+    uint32_t header_table_size = 4096;
+    bool enable_push = true;
+    uint32_t max_concurrent_streams = std::numeric_limits<uint32_t>::max();
+    uint32_t initial_window_size = default_window_size;
+    uint32_t max_frame_size = default_max_frame_size;
+    uint32_t max_header_list_size = std::numeric_limits<uint32_t>::max();
+};
+
+// A connection error, the session is torn down with a GOAWAY carrying the code
+class connection_error : public std::runtime_error {
+    error_code _code;
+public:
+    connection_error(error_code code, const std::string& msg) : std::runtime_error(msg), _code(code) {}
+    error_code code() const noexcept { return _code; }
+};
+
+// The stream was reset by RST_STREAM, either by the peer or locally
+class stream_reset : public std::runtime_error {
+    error_code _code;
+public:
+    stream_reset(error_code code, const std::string& msg) : std::runtime_error(msg), _code(code) {}
+    error_code code() const noexcept { return _code; }
+};
+
+using header_list = std::vector<std::pair<sstring, sstring>>;
+
+// Header field names are lowercase on the wire
+sstring header_name(std::string_view name);
+// Fields that only make sense for HTTP/1.x and must not be sent, RFC 9113 Section 8.2.2
+bool is_connection_specific_header(std::string_view name) noexcept;
+
+void huffman_encode(std::string_view in, std::string& out);
+size_t huffman_encoded_size(std::string_view in) noexcept;
+// Throws connection_error(compression_error) on malformed input
+sstring huffman_decode(std::string_view in);
+
+// HPACK dynamic table, entry 0 is the most recently added one
+class hpack_table {
+    std::deque<std::pair<sstring, sstring>> _entries;
+    size_t _size = 0;
+    size_t _max_size;
+public:
+    static constexpr size_t entry_overhead = 32;
+
+    explicit hpack_table(size_t max_size = 4096) noexcept : _max_size(max_size) {}
+    void add(sstring name, sstring value);
+    void set_max_size(size_t size);
+    size_t max_size() const noexcept { return _max_size; }
+    size_t size() const noexcept { return _size; }
+    size_t entries() const noexcept { return _entries.size(); }
+    const std::pair<sstring, sstring>& operator[](size_t idx) const noexcept { return _entries[idx]; }
+private:
+    void evict(size_t room);
+};
+
+class hpack_decoder {
+    hpack_table _table;
+    // The limit we advertised with SETTINGS_HEADER_TABLE_SIZE
+    size_t _max_table_size;
+public:
+    explicit hpack_decoder(size_t max_table_size = 4096) noexcept
+        : _table(max_table_size), _max_table_size(max_table_size) {}
+    // Decodes a complete header block. Throws connection_error(compression_error)
+    // as any failure leaves the table out of sync with the peer's encoder.
+    header_list decode(std::string_view block);
+private:
+    std::pair<std::string_view, std::string_view> lookup(uint64_t idx) const;
+};
+
+class hpack_encoder {
+    hpack_table _table;
+    std::optional<size_t> _pending_size_update;
+public:
+    // The encoder never grows its table beyond this, whatever the peer allows
+    static constexpr size_t max_table_size = 4096;
+
+    // Applies the peer's SETTINGS_HEADER_TABLE_SIZE
+    void set_max_table_size(size_t size);
+    // Appends the header block for the given headers to out. Names
+    // must already be lowercase.
+    void encode(const header_list& headers, std::string& out);
+private:
+    void encode_header(std::string_view name, std::string_view value, std::string& out);
+};
+
+class session;
+
+// One HTTP/2 stream, shared between the session that feeds it with
+// frames and the code that handles the exchange on it
+class stream : public enable_lw_shared_from_this<stream> {
+    friend class session;
+
+    session& _session;
+    const uint32_t _id;
+    int64_t _send_window;
+    int64_t _recv_window;
+    uint32_t _recv_unacked = 0;
+    header_list _headers;
+    header_list _trailers;
+    bool _headers_received = false;
+    std::optional<promise<>> _waiter;
+    circular_buffer<temporary_buffer<char>> _data;
+    bool _remote_closed = false;
+    bool _local_closed = false;
+    std::exception_ptr _ex;
+public:
+    stream(session& s, uint32_t id, int64_t send_window, int64_t recv_window) noexcept
+        : _session(s), _id(id), _send_window(send_window), _recv_window(recv_window) {}
+
+    uint32_t id() const noexcept { return _id; }
+    // Resolves once the peer's (non-informational) header block arrived
+    future<> wait_headers();
+    bool headers_received() const noexcept { return _headers_received; }
+    const header_list& headers() const noexcept { return _headers; }
+    const header_list& trailers() const noexcept { return _trailers; }
+    // Returns the next chunk of the peer's message body, an empty buffer
+    // marks its end. The consumed data is returned to the peer's window.
+    future<temporary_buffer<char>> read();
+    bool remote_closed() const noexcept { return _remote_closed; }
+    bool local_closed() const noexcept { return _local_closed; }
+    bool failed() const noexcept { return bool(_ex); }
+
+    // Sends DATA frames, the last one carries END_STREAM when end_stream is set
+    future<> send(temporary_buffer<char> buf, bool end_stream);
+    future<> send_headers(header_list headers, bool end_stream);
+    future<> reset(error_code code);
+
+    input_stream<char> make_input_stream(noncopyable_function<void(const header_list&)> on_trailers = {});
+    output_stream<char> make_output_stream();
+private:
+    void wake() noexcept;
+    void fail(std::exception_ptr ex) noexcept;
+};
+
+class session {
+public:
+    enum class role { client, server };
+    // Called on the server side for every stream the peer opens, once
+    // its header block is complete
+    using stream_handler = noncopyable_function<future<>(lw_shared_ptr<stream>)>;
+    // Receive window advertised for the connection as a whole, stream windows
+    // come from settings::initial_window_size
+    static constexpr uint32_t connection_window = 16 << 20;
+private:
+    friend class stream;
+
+    input_stream<char> _in;
+    output_stream<char> _out;
+    const role _role;
+    const settings _local;
+    settings _remote;
+    hpack_encoder _encoder;
+    hpack_decoder _decoder;
+    stream_handler _on_stream;
+    std::unordered_map<uint32_t, lw_shared_ptr<stream>> _streams;
+    uint32_t _next_stream_id;
+    uint32_t _last_peer_stream_id = 0;
+    uint32_t _local_streams = 0;
+    int64_t _send_window = default_window_size;
+    int64_t _recv_window = default_window_size;
+    uint32_t _recv_unacked = 0;
+    // Header block being reassembled from HEADERS and CONTINUATION frames
+    uint32_t _continuation_stream = 0;
+    uint8_t _continuation_flags = 0;
+    std::string _header_block;
+    semaphore _write_lock{1};
+    condition_variable _window_cv;
+    condition_variable _slots_cv;
+    gate _bg;
+    bool _goaway = false;
+    bool _goaway_sent = false;
+    bool _closed = false;
+public:
+    session(input_stream<char> in, output_stream<char> out, role r, settings local, stream_handler on_stream = {});
+    ~session();
+
+    // Exchanges the connection prefaces and runs the read loop. Resolves when
+    // the connection is done, after the background handlers completed and the
+    // streams were closed.
+    future<> run();
+    // Opens a stream and sends the request headers on it, waiting for the
+    // peer's concurrency limit when necessary (client side)
+    future<lw_shared_ptr<stream>> open_stream(header_list headers, bool end_stream);
+    // Sends GOAWAY and stops accepting new streams; the ones in flight
+    // are completed
+    future<> shutdown(error_code code = error_code::no_error);
+
+    bool closed() const noexcept { return _closed || _goaway; }
+    // Whether open_stream() can proceed without waiting
+    bool has_capacity() const noexcept { return !closed() && _local_streams < _remote.max_concurrent_streams; }
+    size_t active_streams() const noexcept { return _streams.size(); }
+    const settings& remote_settings() const noexcept { return _remote; }
+private:
+    future<> read_loop();
+    future<> handle_frame(frame_header fh, temporary_buffer<char> payload);
+    future<> handle_data(frame_header fh, temporary_buffer<char> payload);
+    future<> handle_headers(frame_header fh, temporary_buffer<char> payload);
+    future<> handle_header_block(uint32_t stream_id, uint8_t flags);
+    future<> handle_settings(frame_header fh, temporary_buffer<char> payload);
+    void handle_window_update(frame_header fh, const temporary_buffer<char>& payload);
+    void handle_rst_stream(frame_header fh, const temporary_buffer<char>& payload);
+    void handle_goaway(frame_header fh, const temporary_buffer<char>& payload);
+
+    future<> write_frame(frame_type type, uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+    future<> write_frame_locked(frame_type type, uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+    future<> write_headers_locked(stream& s, const header_list& headers, bool end_stream);
+    future<> flush_locked();
+    future<> send_headers(stream& s, header_list headers, bool end_stream);
+    future<> send_data(stream& s, temporary_buffer<char> buf, bool end_stream);
+    future<> send_window_update(uint32_t stream_id, uint32_t increment);
+    future<> reset_stream(stream& s, error_code code);
+    void run_in_background(noncopyable_function<future<>()> fn);
+    void consumed(size_t len);
+    void consumed(stream& s, size_t len);
+    bool is_local(uint32_t stream_id) const noexcept;
+    bool is_idle(uint32_t stream_id) const noexcept;
+    void maybe_close_stream(stream& s);
+    void close_stream(stream& s);
+    void fail_all(std::exception_ptr ex);
+};
+
+}
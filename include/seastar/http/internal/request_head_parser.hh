@@ -0,0 +1,58 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace seastar {
+
+namespace http {
+
+struct request;
+
+namespace internal {
+
+/*
+ * Fast path of http_request_parser (see request_parser.rl), for request
+ * heads that arrive whole in one buffer. Scans for line ends and invalid
+ * characters with SIMD where available, instead of stepping the state
+ * machine a byte at a time.
+ *
+ * Parses the request line and headers in [p, pe) into req, and returns
+ * the end of the head (past the empty line). Returns nullptr, leaving req
+ * in an unspecified state, if the head is incomplete, or uses something
+ * unusual for the fast path (e.g. obs-fold lines or control characters
+ * in the URI), or is invalid: the state machine handles those.
+ */
+const char* parse_request_head(const char* p, const char* pe, request& req);
+
+/*
+ * Returns the first character in [p, pe) below min, or DEL (0x7f),
+ * or pe if there is none. Characters above 0x7f are never matched.
+ */
+const char* find_control_char(const char* p, const char* pe, unsigned char min) noexcept;
+
+}
+
+}
+
+}
@@ -78,6 +78,14 @@ class param_matcher : public matcher {
 
     virtual size_t match(const sstring& url, size_t ind, parameters& param)
             override;
+
+    const sstring& name() const {
+        return _name;
+    }
+
+    bool entire_path() const {
+        return _entire_path;
+    }
 private:
     sstring _name;
     bool _entire_path;
@@ -101,6 +109,10 @@ class str_matcher : public matcher {
 
     virtual size_t match(const sstring& url, size_t ind, parameters& param)
             override;
+
+    const sstring& str() const {
+        return _cmp;
+    }
 private:
     sstring _cmp;
     unsigned _len;
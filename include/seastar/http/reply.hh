@@ -50,6 +50,7 @@ namespace httpd {
 
 class connection;
 class routes;
+class static_response_handler;
 
 }
 
@@ -282,8 +283,12 @@ struct reply {
     future<> write_reply_headers(httpd::connection& connection);
 
     noncopyable_function<future<>(output_stream<char>&&)> _body_writer;
+    // The whole response, serialized ahead, which is written as is instead
+    // of the fields above when set
+    temporary_buffer<char> _serialized;
     friend class httpd::routes;
     friend class httpd::connection;
+    friend class httpd::static_response_handler;
 };
 
 std::ostream& operator<<(std::ostream& os, reply::status_type st);
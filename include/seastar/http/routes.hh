@@ -23,6 +23,7 @@
 
 #ifndef SEASTAR_MODULE
 #include <boost/program_options/variables_map.hpp>
+#include <memory>
 #include <unordered_map>
 #endif
 
@@ -76,7 +77,10 @@ struct path_description;
  * It uses two decision mechanism exact match, if a url matches exactly
  * (an optional leading slash is permitted) it is chosen
  * If not, the matching rules are used.
- * matching rules are evaluated by their insertion order
+ * matching rules are evaluated by their insertion order, the first
+ * matching rule is chosen. Rules made of url strings and parameters
+ * are looked up together in a tree of path segments rather than tried
+ * one by one.
  */
 class routes {
 public:
@@ -113,10 +117,11 @@ class routes {
      * @param type the operation type
      * @return itself
      * @attention This method takes ownership of the match_rule pointer. It will be automatically deleted when the
-     * routes instance is destroyed.
+     * routes instance is destroyed. The rule must not be changed once added.
      */
     routes& add(match_rule* rule, operation_type type = GET) {
         _rules[type][_rover++] = rule;
+        rules_changed(type);
         return *this;
     }
 
@@ -147,11 +152,19 @@ class routes {
      * the method takes the headers from the request and find the
      * right handler.
      * It then calls the handler with the parameters (if they exist) found in the url
+     *
+     * The handler runs in a tracing span (see \ref tracing::with_span()) if
+     * the request carries a W3C traceparent header, or with the probability
+     * of \ref tracing::set_root_sampling_probability() otherwise.
      * @param path the url path found
      * @param req the http request
      * @param rep the http reply
      */
     future<std::unique_ptr<http::reply> > handle(const sstring& path, std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep);
+private:
+    future<std::unique_ptr<http::reply>> call_handler(handler_base* handler, const sstring& path,
+            std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep);
+public:
 
     /**
      * Search and return an exact match
@@ -173,6 +186,20 @@ class routes {
     handler_base* get_handler(operation_type type, const sstring& url,
             parameters& params);
 
+    /**
+     * Search the handler the request is routed to, before the request is handled
+     * @param req the http request, its body is not read yet
+     * @return the handler, or nullptr if there is none
+     */
+    handler_base* get_handler(const http::request& req);
+
+    /**
+     * Check if the handler the request is routed to reads the content as a stream
+     * @param req the http request, its body is not read yet
+     * @return true if the handler was marked with handler_base::stream_content()
+     */
+    bool streams_content(const http::request& req);
+
 private:
     /**
      * Normalize the url to remove the last / if exists
@@ -188,6 +215,11 @@ class routes {
 private:
     rule_cookie _rover = 0;
     std::map<rule_cookie, match_rule*> _rules[NUM_OPERATION];
+    // The rules compiled into a tree of path segments, built on the first
+    // lookup after the rules of the operation change. See routes.cc.
+    class rule_tree;
+    std::unique_ptr<rule_tree> _rule_trees[NUM_OPERATION];
+    void rules_changed(operation_type type);
     //default Handler -- for any HTTP Method and Path (/*)
     handler_base* _default_handler = nullptr;
 public:
@@ -234,11 +266,12 @@ class routes {
      * @param type the operation type
      * @return a cookie using which the rule can be removed
      * @attention This method takes ownership of the match_rule pointer. It will be automatically deleted when the
-     * routes instance is destroyed.
+     * routes instance is destroyed. The rule must not be changed once added.
      */
     rule_cookie add_cookie(match_rule* rule, operation_type type) {
         auto pos = _rover++;
         _rules[type][pos] = rule;
+        rules_changed(type);
         return pos;
     }
 
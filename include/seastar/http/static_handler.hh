@@ -0,0 +1,72 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/http/handlers.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace httpd {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/**
+ * A handler that replies with the same response to every request, such
+ * as a health check.
+ *
+ * The response, status line, headers and body, is serialized once and
+ * written to HTTP/1.1 connections from a shared buffer, without building
+ * the headers or copying the body per request. The Date header of the
+ * serialized response is refreshed every second. HTTP/1.0 and HEAD requests,
+ * and HTTP/2 streams, get an ordinary reply with the same content.
+ * The serialized response is never compressed.
+ */
+class static_response_handler : public handler_base {
+    http::reply::status_type _status;
+    sstring _type;
+    sstring _content;
+    temporary_buffer<char> _serialized;
+    timer<lowres_clock> _refresh;
+
+    void serialize();
+public:
+    /**
+     * @param content the body of the response
+     * @param type the extension of the content type, i.e. "txt", "json", etc'
+     * @param status the status of the response
+     */
+    explicit static_response_handler(sstring content, sstring type = "txt",
+            http::reply::status_type status = http::reply::status_type::ok);
+
+    future<std::unique_ptr<http::reply>> handle(const sstring& path,
+            std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) override;
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
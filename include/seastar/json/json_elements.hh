@@ -22,7 +22,9 @@
 #pragma once
 
 #ifndef SEASTAR_MODULE
+#include <concepts>
 #include <string>
+#include <string_view>
 #include <vector>
 #endif
 
@@ -32,10 +34,47 @@
 #include <seastar/core/loop.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/json/formatter.hh>
+#include <seastar/json/stream_parser.hh>
+#include <seastar/json/stream_writer.hh>
 #include <seastar/util/modules.hh>
 
 namespace seastar {
 
+/// \cond internal
+namespace internal {
+
+// Decodes a json string into the value of an element, false if T isn't
+// decoded from strings
+template <typename T>
+bool parse_json_string_into(T& v, std::string_view s) {
+    if constexpr (std::same_as<T, sstring> || std::same_as<T, std::string>) {
+        v = T(s);
+        return true;
+    } else if constexpr (std::same_as<T, json::date_time>) {
+        parse_json_date_time(s, v);
+        return true;
+    } else if constexpr (requires { { T::from_json_string(s) } -> std::same_as<T>; }) {
+        // the enum wrappers seastar-json2code.py generates
+        v = T::from_json_string(s);
+        return true;
+    } else {
+        return false;
+    }
+}
+
+template <typename T>
+bool parse_json_number_into(T& v, std::string_view n) {
+    if constexpr (std::is_arithmetic_v<T> && !std::same_as<T, bool>) {
+        v = parse_json_number<T>(n);
+        return true;
+    } else {
+        return false;
+    }
+}
+
+}
+/// \endcond
+
 namespace json {
 
 SEASTAR_MODULE_EXPORT_BEGIN
@@ -48,7 +87,7 @@ SEASTAR_MODULE_EXPORT_BEGIN
  * When a mandatory element is not set
  * this is not a valid object
  */
-class json_base_element {
+class json_base_element : public value_sink {
 protected:
     /**
      * The constructors
@@ -86,6 +125,12 @@ class json_base_element {
     virtual std::string to_string() = 0;
 
     virtual future<> write(output_stream<char>& s) const = 0;
+
+    /**
+     * write the value with a stream_writer. The default
+     * implementation writes what to_string() returns.
+     */
+    virtual void write_to(stream_writer& w) const;
     std::string _name;
     bool _mandatory;
     bool _set;
@@ -145,6 +190,42 @@ class json_element : public json_base_element {
     virtual future<> write(output_stream<char>& s) const override {
         return formatter::write(s, _value);
     }
+
+    virtual void write_to(stream_writer& w) const override {
+        w.write(_value);
+    }
+
+    virtual void on_string(std::string_view s) override {
+        if (!internal::parse_json_string_into(_value, s)) {
+            value_sink::on_string(s);
+        }
+        _set = true;
+    }
+
+    virtual void on_number(std::string_view n) override {
+        if (!internal::parse_json_number_into(_value, n)) {
+            value_sink::on_number(n);
+        }
+        _set = true;
+    }
+
+    virtual void on_bool(bool b) override {
+        if constexpr (std::same_as<T, bool>) {
+            _value = b;
+            _set = true;
+        } else {
+            value_sink::on_bool(b);
+        }
+    }
+
+    virtual value_sink* on_begin_object() override {
+        if constexpr (std::derived_from<T, value_sink>) {
+            _set = true;
+            return _value.on_begin_object();
+        } else {
+            return value_sink::on_begin_object();
+        }
+    }
 private:
     T _value;
 };
@@ -200,7 +281,67 @@ class json_list_template : public json_base_element {
         return formatter::write(s, _elements);
     }
 
+    virtual void write_to(stream_writer& w) const override {
+        w.write(_elements);
+    }
+
+    virtual value_sink* on_begin_array() override {
+        _elements.clear();
+        _set = true;
+        _parsing = true;
+        return this;
+    }
+
+    virtual value_sink* on_element() override {
+        if constexpr (std::derived_from<T, value_sink>) {
+            _elements.emplace_back();
+            return &_elements.back();
+        } else {
+            // the scalars are decoded by on_string() and on_number() below
+            return this;
+        }
+    }
+
+    virtual void on_end_array() override {
+        _parsing = false;
+    }
+
+    virtual void on_string(std::string_view s) override {
+        if constexpr (!std::derived_from<T, value_sink>) {
+            T v;
+            if (_parsing && internal::parse_json_string_into(v, s)) {
+                _elements.push_back(std::move(v));
+                return;
+            }
+        }
+        value_sink::on_string(s);
+    }
+
+    virtual void on_number(std::string_view n) override {
+        if constexpr (!std::derived_from<T, value_sink>) {
+            T v;
+            if (_parsing && internal::parse_json_number_into(v, n)) {
+                _elements.push_back(std::move(v));
+                return;
+            }
+        }
+        value_sink::on_number(n);
+    }
+
+    virtual void on_bool(bool b) override {
+        if constexpr (std::same_as<T, bool>) {
+            if (_parsing) {
+                _elements.push_back(b);
+                return;
+            }
+        }
+        value_sink::on_bool(b);
+    }
+
     Container _elements;
+private:
+    // between on_begin_array() and on_end_array()
+    bool _parsing = false;
 };
 
 template <typename T>
@@ -230,6 +371,15 @@ class jsonable {
     virtual future<> write(output_stream<char>& s) const {
         return s.write(to_json());
     }
+
+    /*!
+     * \brief write an object with a stream_writer
+     *
+     * The default implementation writes what to_json returns.
+     */
+    virtual void write_to(stream_writer& w) const {
+        w.raw(to_json());
+    }
 };
 
 /**
@@ -242,7 +392,7 @@ class jsonable {
  * are known in advance and in practice mimic
  * reflection
  */
-struct json_base : public jsonable {
+struct json_base : public jsonable, public value_sink {
 
     virtual ~json_base() = default;
 
@@ -263,6 +413,11 @@ struct json_base : public jsonable {
      */
     virtual future<> write(output_stream<char>&) const;
 
+    /*!
+     * \brief write with a stream_writer
+     */
+    virtual void write_to(stream_writer& w) const;
+
     /**
      * Check that all mandatory elements are set
      * @return true if all mandatory parameters are set
@@ -278,6 +433,12 @@ struct json_base : public jsonable {
     virtual void add(json_base_element* element, std::string name,
             bool mandatory = false);
 
+    virtual value_sink* on_begin_object() override;
+    /// Returns the element named key, nullptr for unknown keys
+    virtual value_sink* on_member(std::string_view key) override;
+    /// \throws parse_error if a mandatory element is missing
+    virtual void on_end_object() override;
+
     std::vector<json_base_element*> _elements;
 };
 
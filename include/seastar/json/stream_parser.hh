@@ -0,0 +1,192 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <charconv>
+#include <concepts>
+#include <cstdint>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#endif
+
+#include <seastar/core/future.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace json {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// Thrown for malformed json, and for values that don't fit what they
+/// are decoded into
+class parse_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * Receives the values a stream_parser decodes.
+ *
+ * Scalars are handed to the sink of the value, and the sink of an array or
+ * an object provides the sinks of its elements or members. The default
+ * implementations reject all but null, which is ignored, so that a sink
+ * only overrides what it accepts. json_base and the json elements are
+ * sinks, which is how request bodies are decoded straight into the types
+ * seastar-json2code.py generates.
+ */
+class value_sink {
+public:
+    virtual ~value_sink() = default;
+
+    /// The string is only valid during the call
+    virtual void on_string(std::string_view s);
+    /// Gets the number as it is written, e.g. "-1.5e3"
+    virtual void on_number(std::string_view n);
+    virtual void on_bool(bool b);
+    virtual void on_null();
+
+    /// Returns the sink which receives the members of the object
+    virtual value_sink* on_begin_object();
+    /// Returns the sink of the value of the member, nullptr skips it
+    virtual value_sink* on_member(std::string_view key);
+    virtual void on_end_object();
+
+    /// Returns the sink which receives the elements of the array
+    virtual value_sink* on_begin_array();
+    /// Returns the sink of the next element, nullptr skips it
+    virtual value_sink* on_element();
+    virtual void on_end_array();
+};
+
+/**
+ * An incremental json parser, which is fed the input in fragments of any
+ * size, e.g. the buffers of an input_stream, and decodes it into a sink
+ * without building a document.
+ *
+ * Only the token a fragment ends in is copied, to be completed by the next
+ * one. Strings are scanned 8 bytes at a time for the quote, backslash and
+ * control characters that end a run of plain characters, and strings which
+ * have no escapes and lie within a fragment are handed to the sink with no
+ * copy at all.
+ */
+class stream_parser {
+    enum class state : uint8_t {
+        value,          // expecting a value
+        first_element,  // after [, expecting a value or ]
+        first_key,      // after {, expecting a key or }
+        key,            // after a comma in an object
+        colon,
+        next,           // after a value, expecting a comma or a close
+        string,
+        number,
+        literal,
+        done,
+    };
+    struct frame {
+        // nullptr while skipping the container
+        value_sink* sink;
+        bool array;
+    };
+
+    std::vector<frame> _stack;
+    // of the value being parsed, nullptr to skip it
+    value_sink* _target;
+    state _state = state::value;
+    bool _in_key = false;
+    // of the current string, number or literal, when it spans fragments
+    // or, for strings, has escapes
+    std::string _token;
+    // of the \u escape being decoded
+    std::string _escape;
+    bool _escaped = false;
+    uint32_t _high_surrogate = 0;
+    size_t _max_depth;
+    uint64_t _offset = 0;
+
+    [[noreturn]] void fail(const char* what, size_t pos) const;
+    size_t skip_whitespace(std::string_view in, size_t pos) const noexcept;
+    size_t begin_string(std::string_view in, size_t pos);
+    size_t parse_string(std::string_view in, size_t pos);
+    size_t parse_escape(std::string_view in, size_t pos);
+    void end_string(std::string_view s);
+    void end_scalar(std::string_view token, size_t pos);
+    void begin_value();
+    void end_value();
+    void begin_container(bool array, size_t pos);
+    void end_container(bool array, size_t pos);
+public:
+    static constexpr size_t default_max_depth = 64;
+
+    /// \param root receives the top level value, and must outlive the parser
+    /// \param max_depth how deep arrays and objects may nest
+    explicit stream_parser(value_sink& root, size_t max_depth = default_max_depth);
+
+    /// Parses the next fragment of the input. The fragment needs not outlive
+    /// the call.
+    ///
+    /// \throws parse_error, or what the sinks throw
+    void feed(std::string_view fragment);
+    /// Checks that the input ended with a complete value
+    ///
+    /// \throws parse_error
+    void finish();
+};
+
+/// Decodes the json read from a stream into a sink, e.g. a type generated
+/// by seastar-json2code.py, till the end of the stream. The stream isn't
+/// closed.
+///
+/// \throws parse_error when the json is malformed, doesn't fit the sink or,
+///         when the sink is a json_base, misses mandatory members
+future<> parse(input_stream<char>& in, value_sink& sink, size_t max_depth = stream_parser::default_max_depth);
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+/// \cond internal
+namespace internal {
+
+template <typename T>
+requires std::is_arithmetic_v<T>
+T parse_json_number(std::string_view n) {
+    T v;
+    auto [ptr, ec] = std::from_chars(n.data(), n.data() + n.size(), v);
+    if (ec != std::errc() || ptr != n.data() + n.size()) {
+        throw json::parse_error("number out of range or of the wrong type");
+    }
+    return v;
+}
+
+// Parses the format of json::formatter::to_json(const date_time&)
+void parse_json_date_time(std::string_view s, std::tm& d);
+
+}
+/// \endcond
+
+}
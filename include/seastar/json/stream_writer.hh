@@ -0,0 +1,291 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <charconv>
+#include <concepts>
+#include <functional>
+#include <ranges>
+#include <string_view>
+#include <vector>
+#include <fmt/format.h>
+#endif
+
+#include <seastar/core/do_with.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/coroutine/maybe_yield.hh>
+#include <seastar/json/formatter.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+namespace json {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/**
+ * A json writer that serializes values straight into an output_stream.
+ *
+ * Values are formatted in place into buffers of chunk_size bytes, with no
+ * intermediate strings. Writing a value never waits: full buffers are
+ * queued and handed to the stream by maybe_flush(), so callers writing
+ * much data call it between values (write_range() does so between the
+ * elements of a range). The stream is not flushed nor closed, except by
+ * flush().
+ *
+ * Commas and colons are added as needed, e.g.
+ *
+ *     w.begin_object();
+ *     w.key("count");
+ *     w.value(3);
+ *     w.end_object();
+ *
+ * writes {"count":3}.
+ */
+class stream_writer {
+    output_stream<char>& _out;
+    size_t _chunk_size;
+    temporary_buffer<char> _buf;
+    size_t _pos = 0;
+    // full buffers, waiting for maybe_flush()
+    std::vector<temporary_buffer<char>> _full;
+    // whether each of the open arrays and objects already has a value
+    std::vector<bool> _nonempty;
+    bool _after_key = false;
+
+    // returns room for n contiguous bytes at the end of the buffer
+    char* reserve(size_t n) {
+        if (_buf.size() - _pos < n) {
+            next_buffer(n);
+        }
+        return _buf.get_write() + _pos;
+    }
+    void next_buffer(size_t n);
+    void append(std::string_view s);
+    void append(char c) {
+        *reserve(1) = c;
+        ++_pos;
+    }
+    // adds the separator a value needs in the current array or object
+    void separate() {
+        if (_after_key) {
+            _after_key = false;
+        } else if (!_nonempty.empty()) {
+            if (_nonempty.back()) {
+                append(',');
+            }
+            _nonempty.back() = true;
+        }
+    }
+    void write_string(std::string_view s);
+    template <typename T>
+    void write_number(T v) {
+        separate();
+        // enough for any integer and for the shortest form of any double
+        constexpr size_t max_size = 32;
+        char* p = reserve(max_size);
+        auto res = std::to_chars(p, p + max_size, v);
+        _pos += res.ptr - p;
+    }
+    future<> write_full();
+public:
+    static constexpr size_t default_chunk_size = 32 * 1024;
+
+    /**
+     * @param out the stream to write to, which must outlive the writer
+     * @param chunk_size size of the buffers handed to the stream
+     */
+    explicit stream_writer(output_stream<char>& out, size_t chunk_size = default_chunk_size);
+    stream_writer(stream_writer&&) = default;
+
+    void begin_array();
+    void end_array();
+    void begin_object();
+    void end_object();
+
+    /**
+     * write the name of the next member of an object
+     */
+    void key(std::string_view name);
+
+    /**
+     * write the name of the next member of an object, from a non
+     * string map key
+     */
+    template <typename K>
+    requires (!std::convertible_to<const K&, std::string_view>)
+    void key(const K& name) {
+        key(std::string_view(fmt::format("{}", name)));
+    }
+
+    void value(std::string_view s);
+    void value(const char* s) {
+        value(std::string_view(s));
+    }
+    void value(bool b);
+    template <std::integral T>
+    requires (!std::same_as<T, bool>)
+    void value(T n) {
+        write_number(n);
+    }
+    /**
+     * write a double, in its shortest form that reads back the same,
+     * throws for infinite and NaN values like \ref formatter does.
+     */
+    void value(double d);
+    void value(float f);
+    void value(const date_time& d);
+    void null();
+
+    /**
+     * write an already json formatted value
+     */
+    void raw(std::string_view json);
+
+    /**
+     * write any value \ref formatter supports: strings, numbers, bools,
+     * dates, jsonable objects, pairs and ranges. Ranges of pairs,
+     * like std::map, are written as objects, other ranges as arrays.
+     */
+    template <typename T>
+    void write(const T& v);
+
+    /**
+     * write a range as write() does, handing the full buffers
+     * to the stream between elements, and yielding if needed.
+     */
+    template <std::ranges::input_range Range>
+    requires (!std::convertible_to<const Range&, std::string_view>)
+    future<> write_range(const Range& range);
+
+    /**
+     * hand the full buffers to the stream
+     */
+    future<> maybe_flush() {
+        if (_full.empty()) {
+            return make_ready_future<>();
+        }
+        return write_full();
+    }
+
+    /**
+     * hand all the buffered data to the stream and flush it
+     */
+    future<> flush();
+};
+
+template <typename T>
+void stream_writer::write(const T& v) {
+    if constexpr (std::derived_from<T, jsonable>) {
+        v.write_to(*this);
+    } else if constexpr (std::convertible_to<const T&, std::string_view>) {
+        value(std::string_view(v));
+    } else if constexpr (std::ranges::input_range<const T>) {
+        if constexpr (internal::is_map<T>) {
+            begin_object();
+            for (const auto& [k, e] : v) {
+                key(k);
+                write(e);
+            }
+            end_object();
+        } else {
+            begin_array();
+            for (const auto& e : v) {
+                write(e);
+            }
+            end_array();
+        }
+    } else if constexpr (internal::is_pair_like<T>) {
+        // same as formatter, a pair in an array is an object
+        const auto& [k, e] = v;
+        begin_object();
+        key(k);
+        write(e);
+        end_object();
+    } else {
+        value(v);
+    }
+}
+
+template <std::ranges::input_range Range>
+requires (!std::convertible_to<const Range&, std::string_view>)
+future<> stream_writer::write_range(const Range& range) {
+    constexpr bool is_map = internal::is_map<Range>;
+    if constexpr (is_map) {
+        begin_object();
+    } else {
+        begin_array();
+    }
+    for (const auto& e : range) {
+        if constexpr (is_map) {
+            const auto& [k, v] = e;
+            key(k);
+            write(v);
+        } else {
+            write(e);
+        }
+        co_await maybe_flush();
+        co_await coroutine::maybe_yield();
+    }
+    if constexpr (is_map) {
+        end_object();
+    } else {
+        end_array();
+    }
+}
+
+/*!
+ * \brief capture a value and return a function streaming it with a
+ * \ref stream_writer, which json_return_type accepts.
+ *
+ * Ranges are streamed an element at a time, so a long listing is never
+ * fully formatted in memory.
+ *
+ * return make_ready_future<json::json_return_type>(json::stream_value(std::move(res)));
+ */
+template <typename T>
+std::function<future<>(output_stream<char>&&)> stream_value(T val) {
+    return [val = std::move(val)] (output_stream<char>&& s) mutable {
+        return do_with(output_stream<char>(std::move(s)), T(std::move(val)), [] (output_stream<char>& s, const T& val) {
+            return do_with(stream_writer(s), [&val] (stream_writer& w) {
+                if constexpr (std::ranges::input_range<const T> && !std::convertible_to<const T&, std::string_view>) {
+                    return w.write_range(val).then([&w] {
+                        return w.flush();
+                    });
+                } else {
+                    w.write(val);
+                    return w.flush();
+                }
+            }).finally([&s] {
+                return s.close();
+            });
+        });
+    };
+}
+
+SEASTAR_MODULE_EXPORT_END
+
+}
+
+}
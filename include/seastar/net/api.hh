@@ -113,6 +113,12 @@ class datagram final {
 
 using udp_datagram = datagram;
 
+/// A datagram to send with \ref datagram_channel::send_batch()
+struct outgoing_datagram {
+    socket_address dst;
+    packet data;
+};
+
 class datagram_channel {
 private:
     std::unique_ptr<datagram_channel_impl> _impl;
@@ -129,6 +135,18 @@ class datagram_channel {
     future<datagram> receive();
     future<> send(const socket_address& dst, const char* msg);
     future<> send(const socket_address& dst, packet p);
+    /// Receives up to \c max datagrams, waiting only for the first one.
+    ///
+    /// Where the stack can take several datagrams off the socket at once
+    /// (recvmmsg() and UDP GRO on the posix stack), all those already queued
+    /// are returned, up to \c max; otherwise this returns one datagram.
+    future<std::vector<datagram>> receive_batch(size_t max);
+    /// Sends the datagrams, in order.
+    ///
+    /// The posix stack sends them with as few sendmmsg() calls as possible,
+    /// and lets the kernel segment runs of equally sized datagrams to the same
+    /// destination (UDP GSO) where it can.
+    future<> send_batch(std::vector<outgoing_datagram> datagrams);
     bool is_closed() const;
     /// Causes a pending receive() to complete (possibly with an exception)
     void shutdown_input();
@@ -311,6 +329,34 @@ class socket {
     void shutdown();
 };
 
+/// Options of \ref connect_any()
+struct connect_any_options {
+    /// Time to wait for a connection attempt before starting the next one
+    /// in parallel, the "Connection Attempt Delay" of RFC 8305
+    std::chrono::milliseconds attempt_delay = std::chrono::milliseconds(250);
+    /// Local endpoint of the connections
+    socket_address local = {};
+    transport proto = transport::TCP;
+};
+
+/// Connects to whichever of several addresses of a host answers first.
+///
+/// Connection attempts are started one by one, in the order of \c addrs
+/// but alternating between IPv6 and IPv4 addresses, as Happy Eyeballs
+/// (RFC 8305) does: the next attempt starts when the previous one fails,
+/// or after \c opts.attempt_delay if it has not completed by then, with
+/// the earlier ones still running. The first connection established wins,
+/// and the attempts still in progress are cancelled. A black-holed address
+/// thus delays the connection by \c attempt_delay rather than by the
+/// whole TCP connection timeout.
+///
+/// \param addrs the addresses to connect to, in order of preference
+/// \param opts options of the connection attempts
+///
+/// \return the first connection established, or the error of the last
+///         attempt if they all fail
+future<connected_socket> connect_any(std::vector<socket_address> addrs, connect_any_options opts = {});
+
 /// @}
 
 /// \addtogroup networking-module
@@ -324,6 +370,7 @@ struct accept_result {
 
 /// A listening socket, waiting to accept incoming network connections.
 class server_socket {
+    friend class net::get_impl;
     std::unique_ptr<net::server_socket_impl> _ssi;
     bool _aborted = false;
 public:
@@ -338,6 +385,15 @@ class server_socket {
         port,
         // This algorithm distributes all new connections to listen_options::fixed_cpu shard only.
         fixed,
+        // This algorithm sends a new connection to the shard running on the CPU that processed
+        // its packets in the kernel (SO_INCOMING_CPU). With the NIC queue interrupts affined to
+        // the shards' CPUs, or with ntuple/aRFS rules steering the flows there, the connection
+        // lands where its packets arrive. Needs thread affinity, connections coming in on a CPU
+        // with no shard are distributed like with connection_distribution.
+        // On TCP and SCTP every shard gets its own SO_REUSEPORT listening socket and a classic
+        // BPF program makes the kernel queue the connection on the socket of the shard, so it
+        // is accepted there and not handed over; all shards have to listen then.
+        incoming_cpu,
         default_ = connection_distribution
     };
     /// Constructs a \c server_socket without being bound to any address
@@ -46,6 +46,10 @@ namespace net {
         bool event_index{ true };
         bool csum_offload{ true };
         std::optional<unsigned> ring_size;
+        // Idle time before an RX queue switches to interrupt mode, 0 polls
+        unsigned rx_interrupt_idle_ms{ 0 };
+        // Period of the RSS redirection table rebalancing, 0 keeps it fixed
+        unsigned rss_rebalance_period_ms{ 0 };
     };
 
     struct device_config {
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <system_error>
 #include <vector>
 #include <unordered_map>
@@ -87,6 +88,27 @@ class dns_resolver {
             tcp_port, udp_port;
         std::optional<std::vector<sstring>>
             domains;
+        /// Upper bound on how long a resolved name is cached, below the
+        /// TTL of its records. Zero disables the cache. Default: 5 minutes.
+        std::optional<std::chrono::seconds>
+            cache_max_ttl;
+        /// How long a name found not to exist is cached. Default: 5 seconds.
+        std::optional<std::chrono::seconds>
+            negative_cache_ttl;
+        /// Maximum number of names cached. Default: 1024.
+        std::optional<size_t>
+            cache_size;
+    };
+
+    struct cache_stats {
+        /// Names found in the cache
+        uint64_t hits = 0;
+        /// Names found in the cache as not existing
+        uint64_t negative_hits = 0;
+        /// Names already being queried, whose query was joined
+        uint64_t coalesced = 0;
+        /// Names queried
+        uint64_t misses = 0;
     };
 
     enum class srv_proto {
@@ -127,6 +149,13 @@ class dns_resolver {
                                         const sstring& service,
                                         const sstring& domain);
 
+    /**
+     * Statistics of the cache of get_host_by_name() and resolve_name()
+     * results, which honors the TTL of the records, caches names which
+     * do not exist and joins concurrent queries for the same name.
+     */
+    const cache_stats& get_cache_stats() const noexcept;
+
     /**
      * Shuts the object down. Great for tests.
      */
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <seastar/net/config.hh>
 #include <seastar/net/net.hh>
@@ -41,6 +42,20 @@ struct dpdk_options : public program_options::option_group {
     ///
     /// Default: \p on.
     program_options::value<std::string> hw_fc;
+    /// \brief Switch an RX queue to interrupt mode after it was idle for this
+    /// many milliseconds, letting its shard sleep until traffic arrives. 0
+    /// polls the queue continuously.
+    ///
+    /// Default: \p 0.
+    program_options::value<unsigned> rx_interrupt_idle_ms;
+    /// \brief Rebalance the RSS redirection table this often, in
+    /// milliseconds, moving the entries without open TCP connections from
+    /// the queues which receive the most packets to the ones which receive
+    /// the least, so that the new connections land on the least loaded
+    /// shards. Needs a queue per shard. 0 keeps the table fixed.
+    ///
+    /// Default: \p 0.
+    program_options::value<unsigned> rss_rebalance_period_ms;
 
     /// \cond internal
     dpdk_options(program_options::option_group* parent_group);
@@ -57,7 +72,9 @@ std::unique_ptr<net::device> create_dpdk_net_device(
                                     uint16_t port_idx = 0,
                                     uint16_t num_queues = 1,
                                     bool use_lro = true,
-                                    bool enable_fc = true);
+                                    bool enable_fc = true,
+                                    std::chrono::milliseconds rx_interrupt_idle = std::chrono::milliseconds(0),
+                                    std::chrono::milliseconds rss_rebalance_period = std::chrono::milliseconds(0));
 
 std::unique_ptr<net::device> create_dpdk_net_device(
                                     const net::hw_config& hw_cfg);
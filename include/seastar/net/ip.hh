@@ -30,6 +30,7 @@
 #include <array>
 #include <map>
 #include <list>
+#include <optional>
 #include <chrono>
 #endif
 
@@ -42,6 +43,8 @@
 #include <seastar/net/packet-util.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/net/toeplitz.hh>
+#include <seastar/net/tcp-gro.hh>
+#include <seastar/core/internal/poll.hh>
 #include <seastar/net/udp.hh>
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/util/modules.hh>
@@ -77,6 +80,7 @@ struct ipv4_traits {
         csum.sum_many(src.ip.raw, dst.ip.raw, uint8_t(0), uint8_t(ip_protocol_num::udp), len);
     }
     static constexpr uint8_t ip_hdr_len_min = ipv4_hdr_len_min;
+    static constexpr const char* tcp_metrics_group = "tcp";
 };
 
 template <ip_protocol_num ProtoNum>
@@ -124,12 +128,22 @@ struct l4connid {
 
     uint32_t hash(rss_key_type rss_key) {
         forward_hash hash_data;
-        hash_data.push_back(hton(foreign_ip.ip));
-        hash_data.push_back(hton(local_ip.ip));
+        push_address(hash_data, foreign_ip);
+        push_address(hash_data, local_ip);
         hash_data.push_back(hton(foreign_port));
         hash_data.push_back(hton(local_port));
         return toeplitz_hash(rss_key, hash_data);
     }
+private:
+    // Addresses are hashed in network byte order
+    static void push_address(forward_hash& hash_data, ipv4_address a) {
+        hash_data.push_back(hton(a.ip));
+    }
+    static void push_address(forward_hash& hash_data, const ipv6_address& a) {
+        for (auto b : a.ip) {
+            hash_data.push_back(b);
+        }
+    }
 };
 
 class ipv4_tcp final : public ip_protocol {
@@ -315,6 +329,9 @@ class ipv4 {
     timer<lowres_clock> _frag_timer;
     circular_buffer<l3_protocol::l3packet> _packetq;
     unsigned _pkt_provider_idx = 0;
+    // Coalesces the received TCP segments of a poll batch
+    std::optional<ipv4_tcp_gro> _gro;
+    std::optional<internal::poller> _gro_poller;
     metrics::metric_groups _metrics;
 private:
     future<> handle_received_packet(packet p, ethernet_address from);
@@ -336,6 +353,9 @@ class ipv4 {
     explicit ipv4(interface* netif);
     void set_host_address(ipv4_address ip);
     ipv4_address host_address() const;
+    ipv4_address source_address_for(ipv4_address) const {
+        return _host_address;
+    }
     void set_gw_address(ipv4_address ip);
     ipv4_address gw_address() const;
     void set_netmask_address(ipv4_address ip);
@@ -348,6 +368,8 @@ class ipv4 {
     // But for now, a simple single raw pointer suffices
     void set_packet_filter(ip_packet_filter *);
     ip_packet_filter * packet_filter() const;
+    // Enables or disables the software receive coalescing of TCP segments
+    void set_gro(bool enabled);
     void send(ipv4_address to, ip_protocol_num proto_num, packet p, ethernet_address e_dst);
     tcp<ipv4_traits>& get_tcp() { return *_tcp._tcp; }
     ipv4_udp& get_udp() { return _udp; }
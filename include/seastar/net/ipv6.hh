@@ -0,0 +1,277 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#endif
+
+#include <seastar/net/ip.hh>
+
+namespace seastar {
+
+namespace net {
+
+class ipv6;
+template <ip_protocol_num ProtoNum>
+class ipv6_l4;
+
+constexpr uint8_t ipv6_hdr_len = 40;
+
+struct ipv6_traits {
+    using address_type = ipv6_address;
+    using inet_type = ipv6_l4<ip_protocol_num::tcp>;
+    struct l4packet {
+        ipv6_address to;
+        packet p;
+        ethernet_address e_dst;
+        ip_protocol_num proto_num;
+    };
+    using packet_provider_type = std::function<std::optional<l4packet> ()>;
+    // RFC 8200, section 8.1
+    static void pseudo_header_checksum(checksummer& csum, const ipv6_address& src, const ipv6_address& dst,
+            uint32_t len, ip_protocol_num proto) {
+        csum.sum(reinterpret_cast<const char*>(src.ip.data()), src.ip.size());
+        csum.sum(reinterpret_cast<const char*>(dst.ip.data()), dst.ip.size());
+        csum.sum_many(len, uint32_t(uint8_t(proto)));
+    }
+    static void tcp_pseudo_header_checksum(checksummer& csum, ipv6_address src, ipv6_address dst, uint16_t len) {
+        pseudo_header_checksum(csum, src, dst, len, ip_protocol_num::tcp);
+    }
+    static void udp_pseudo_header_checksum(checksummer& csum, ipv6_address src, ipv6_address dst, uint16_t len) {
+        pseudo_header_checksum(csum, src, dst, len, ip_protocol_num::udp);
+    }
+    static constexpr uint8_t ip_hdr_len_min = ipv6_hdr_len;
+    static constexpr const char* tcp_metrics_group = "tcp6";
+};
+
+template <ip_protocol_num ProtoNum>
+class ipv6_l4 {
+public:
+    ipv6& _inet;
+public:
+    ipv6_l4(ipv6& inet) : _inet(inet) {}
+    void register_packet_provider(ipv6_traits::packet_provider_type func);
+    future<ethernet_address> get_l2_dst_address(ipv6_address to);
+    const ipv6& inet() const {
+        return _inet;
+    }
+};
+
+class ipv6_tcp {
+    ipv6_l4<ip_protocol_num::tcp> _inet_l4;
+    std::unique_ptr<tcp<ipv6_traits>> _tcp;
+public:
+    ipv6_tcp(ipv6& inet);
+    ~ipv6_tcp();
+    void received(packet p, ipv6_address from, ipv6_address to);
+    bool forward(forward_hash& out_hash_data, packet& p, size_t off);
+    friend class ipv6;
+};
+
+struct ipv6_hdr {
+    packed<uint32_t> ver_tc_flow;
+    packed<uint16_t> payload_len;
+    uint8_t next_header;
+    uint8_t hop_limit;
+    // Addresses are byte arrays, they are not touched by ntoh()/hton()
+    ipv6_address src_ip;
+    ipv6_address dst_ip;
+    template <typename Adjuster>
+    auto adjust_endianness(Adjuster a) {
+        return a(ver_tc_flow, payload_len);
+    }
+    uint8_t version() const { return uint32_t(ver_tc_flow) >> 28; }
+} __attribute__((packed));
+
+static_assert(sizeof(ipv6_hdr) == ipv6_hdr_len);
+
+struct icmpv6_hdr {
+    enum class msg_type : uint8_t {
+        echo_request = 128,
+        echo_reply = 129,
+        neighbor_solicitation = 135,
+        neighbor_advertisement = 136,
+    };
+    msg_type type;
+    uint8_t code;
+    packed<uint16_t> csum;
+    template <typename Adjuster>
+    auto adjust_endianness(Adjuster a) {
+        return a(csum);
+    }
+} __attribute__((packed));
+
+/// Link-local address derived from the MAC with modified EUI-64 (RFC 4291, appendix A).
+inline ipv6_address ipv6_link_local_address(ethernet_address mac) {
+    ipv6_address::ipv6_bytes b{};
+    b[0] = 0xfe;
+    b[1] = 0x80;
+    b[8] = mac.mac[0] ^ 0x02;
+    b[9] = mac.mac[1];
+    b[10] = mac.mac[2];
+    b[11] = 0xff;
+    b[12] = 0xfe;
+    b[13] = mac.mac[3];
+    b[14] = mac.mac[4];
+    b[15] = mac.mac[5];
+    return ipv6_address(b);
+}
+
+/// Solicited-node multicast group of an address (RFC 4291, section 2.7.1).
+inline ipv6_address ipv6_solicited_node_address(const ipv6_address& a) {
+    ipv6_address::ipv6_bytes b{0xff, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01, 0xff};
+    b[13] = a.ip[13];
+    b[14] = a.ip[14];
+    b[15] = a.ip[15];
+    return ipv6_address(b);
+}
+
+/// Ethernet destination of an IPv6 multicast group (RFC 2464, section 7).
+inline ethernet_address ipv6_multicast_mac(const ipv6_address& a) {
+    return ethernet_address{0x33, 0x33, a.ip[12], a.ip[13], a.ip[14], a.ip[15]};
+}
+
+inline bool ipv6_is_multicast(const ipv6_address& a) {
+    return a.ip[0] == 0xff;
+}
+
+inline bool ipv6_is_link_local(const ipv6_address& a) {
+    return a.ip[0] == 0xfe && (a.ip[1] & 0xc0) == 0x80;
+}
+
+class ndp_timeout_error : public std::runtime_error {
+public:
+    ndp_timeout_error() : std::runtime_error("NDP timeout") {}
+};
+
+class ndp_queue_full_error : public std::runtime_error {
+public:
+    ndp_queue_full_error() : std::runtime_error("NDP waiter's queue is full") {}
+};
+
+/// IPv6 layer of the native stack.
+///
+/// Addresses are resolved with neighbour discovery (RFC 4861) instead of
+/// ARP, the interface answers echo requests and neighbour solicitations
+/// for its link-local and configured addresses. Extension headers and
+/// fragments are not supported and are dropped, so is router discovery:
+/// the prefix and the gateway are configured statically.
+class ipv6 {
+public:
+    using clock_type = lowres_clock;
+    using address_type = ipv6_address;
+private:
+    static constexpr auto max_waiters = 512;
+    static constexpr uint8_t default_hop_limit = 64;
+    // Neighbour discovery messages are sent and accepted with the maximum
+    // hop limit only, so that they can't come from off-link
+    static constexpr uint8_t nd_hop_limit = 255;
+    struct resolution {
+        std::vector<promise<ethernet_address>> _waiters;
+        timer<> _timeout_timer;
+    };
+    interface* _netif;
+    net::hw_features _hw_features;
+    std::vector<ipv6_traits::packet_provider_type> _pkt_providers;
+    ipv6_address _link_local;
+    ipv6_address _host_address;
+    ipv6_address _gw_address;
+    unsigned _prefix_len = 64;
+    l3_protocol _l3;
+    ipv6_tcp _tcp;
+    std::unordered_map<ipv6_address, ethernet_address> _neighbours;
+    std::unordered_map<ipv6_address, resolution> _in_progress;
+    circular_buffer<l3_protocol::l3packet> _packetq;
+    unsigned _pkt_provider_idx = 0;
+private:
+    future<> handle_received_packet(packet p, ethernet_address from);
+    bool forward(forward_hash& out_hash_data, packet& p, size_t off);
+    std::optional<l3_protocol::l3packet> get_packet();
+    bool is_my_address(const ipv6_address& a) const;
+    bool on_link(const ipv6_address& a) const;
+    void send(ipv6_address to, ip_protocol_num proto_num, packet p, ethernet_address e_dst, uint8_t hop_limit);
+    void icmpv6_received(packet p, ipv6_address from, ipv6_address to, uint8_t hop_limit, ethernet_address from_mac);
+    void send_icmpv6(ipv6_address to, packet p, ethernet_address e_dst, uint8_t hop_limit);
+    void send_solicitation(const ipv6_address& target);
+    void handle_solicitation(packet& p, ipv6_address from, ethernet_address from_mac);
+    void handle_advertisement(packet& p, ethernet_address from_mac);
+public:
+    explicit ipv6(interface* netif);
+    void set_host_address(ipv6_address ip);
+    // The configured address, or the link-local one without it
+    ipv6_address host_address() const;
+    // Packets sent to the given address are sourced from this one
+    ipv6_address source_address_for(const ipv6_address& to) const;
+    ipv6_address link_local_address() const {
+        return _link_local;
+    }
+    void set_gw_address(ipv6_address ip);
+    ipv6_address gw_address() const;
+    void set_prefix_length(unsigned len);
+    unsigned prefix_length() const {
+        return _prefix_len;
+    }
+    interface * netif() const {
+        return _netif;
+    }
+    // The offloads of the device that apply to IPv6 as well
+    const net::hw_features& hw_features() const { return _hw_features; }
+    void send(ipv6_address to, ip_protocol_num proto_num, packet p, ethernet_address e_dst) {
+        send(to, proto_num, std::move(p), e_dst, default_hop_limit);
+    }
+    tcp<ipv6_traits>& get_tcp() { return *_tcp._tcp; }
+    void learn(ethernet_address l2, ipv6_address l3);
+    void register_packet_provider(ipv6_traits::packet_provider_type&& func) {
+        _pkt_providers.push_back(std::move(func));
+    }
+    future<ethernet_address> get_l2_dst_address(ipv6_address to);
+};
+
+template <ip_protocol_num ProtoNum>
+inline
+void ipv6_l4<ProtoNum>::register_packet_provider(ipv6_traits::packet_provider_type func) {
+    _inet.register_packet_provider([func = std::move(func)] {
+        auto l4p = func();
+        if (l4p) {
+            l4p.value().proto_num = ProtoNum;
+        }
+        return l4p;
+    });
+}
+
+template <ip_protocol_num ProtoNum>
+inline
+future<ethernet_address> ipv6_l4<ProtoNum>::get_l2_dst_address(ipv6_address to) {
+    return _inet.get_l2_dst_address(to);
+}
+
+void ndp_learn(ethernet_address l2, ipv6_address l3);
+
+}
+
+}
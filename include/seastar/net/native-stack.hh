@@ -24,6 +24,7 @@
 #include <seastar/net/net.hh>
 #include <seastar/net/virtio.hh>
 #include <seastar/net/dpdk.hh>
+#include <seastar/net/xdp.hh>
 #include <seastar/util/program-options.hh>
 
 namespace seastar {
@@ -52,6 +53,16 @@ struct native_stack_options : public program_options::option_group {
     ///
     /// Default: \p 255.255.255.0.
     program_options::value<std::string> netmask_ipv4_addr;
+    /// \brief Static IPv6 address to use.
+    ///
+    /// Only the link-local address derived from the MAC is used when unset.
+    program_options::value<std::string> host_ipv6_addr;
+    /// \brief Static IPv6 gateway to use.
+    program_options::value<std::string> gw_ipv6_addr;
+    /// \brief Length of the on-link prefix of \ref host_ipv6_addr.
+    ///
+    /// Default: \p 64.
+    program_options::value<unsigned> ipv6_prefix_length;
     /// \brief Default size of the UDPv4 per-channel packet queue.
     ///
     /// Default: \ref ipv4_udp::default_queue_size.
@@ -76,6 +87,31 @@ struct native_stack_options : public program_options::option_group {
     ///
     /// Default: \p on.
     program_options::value<std::string> lro;
+    /// \brief Enable software coalescing of received TCP segments (on/off).
+    ///
+    /// Merges the in-order segments of a flow received in one poll batch
+    /// before the TCP input. Not used when the device does LRO.
+    ///
+    /// Default: \p on.
+    program_options::value<std::string> gro;
+    /// \brief TCP congestion control algorithm (reno, cubic or bbr).
+    ///
+    /// Can be changed per connection with the \c TCP_CONGESTION socket option.
+    ///
+    /// Default: \p reno.
+    program_options::value<std::string> tcp_congestion_control;
+    /// \brief Tune native TCP loss detection for datacenter round trip times.
+    ///
+    /// Enables RFC 7323 timestamps for microsecond RTT samples, RFC 8985
+    /// RACK-TLP loss detection on connections with SACK and lowers the
+    /// minimum retransmission timeout to 5ms unless \ref tcp_min_rto_ms is set.
+    ///
+    /// Default: \p false.
+    program_options::value<bool> tcp_datacenter_mode;
+    /// \brief Minimum TCP retransmission timeout, in milliseconds.
+    ///
+    /// Default: \p 1000, or \p 5 with \ref tcp_datacenter_mode.
+    program_options::value<float> tcp_min_rto_ms;
 
     /// Virtio configuration.
     virtio_options virtio_opts;
@@ -83,6 +119,10 @@ struct native_stack_options : public program_options::option_group {
     ///
     /// \note Unused when seastar is compiled without DPDK support.
     dpdk_options dpdk_opts;
+    /// AF_XDP configuration.
+    ///
+    /// \note Unused when seastar is compiled without AF_XDP support.
+    xdp_options xdp_opts;
 
     /// \cond internal
     bool _hugepages;
@@ -135,6 +135,9 @@ class interface {
             std::function<bool (forward_hash&, packet&, size_t)> forward);
     void forward(unsigned cpuid, packet p);
     unsigned hash2cpu(uint32_t hash);
+    bool dynamic_rss() const;
+    void flow_opened(uint32_t hash);
+    void flow_closed(uint32_t hash);
     void register_packet_provider(l3_protocol::packet_provider_type func) {
         _pkt_providers.push_back(std::move(func));
     }
@@ -265,6 +268,8 @@ class device {
 protected:
     std::unique_ptr<qp*[]> _queues;
     size_t _rss_table_bits = 0;
+    // hash2qid() may change at run time, see forward_dst()
+    bool _dynamic_rss = false;
 public:
     device() {
         _queues = std::make_unique<qp*[]>(smp::count);
@@ -289,6 +294,28 @@ class device {
     void set_local_queue(std::unique_ptr<qp> dev);
     template <typename Func>
     unsigned forward_dst(unsigned src_cpuid, Func&& hashfn) {
+        if (_dynamic_rss) {
+            // The hardware may still steer the packet to the queue which
+            // owned its hash before hash2qid() changed
+            return hash2cpu(hashfn());
+        }
+        return proxy_dst(src_cpuid, std::forward<Func>(hashfn));
+    }
+    virtual unsigned hash2cpu(uint32_t hash) {
+        // there is an assumption here that qid == cpu_id which will
+        // not necessary be true in the future
+        return proxy_dst(hash2qid(hash), [hash] { return hash; });
+    }
+    bool dynamic_rss() const noexcept { return _dynamic_rss; }
+    // Called with the RSS hash of a connection on the shard owning it when
+    // it is opened and closed, by the stacks running over a device with
+    // dynamic_rss(), which must not move the hashes of open connections to
+    // another shard
+    virtual void flow_opened(uint32_t hash) {}
+    virtual void flow_closed(uint32_t hash) {}
+private:
+    template <typename Func>
+    unsigned proxy_dst(unsigned src_cpuid, Func&& hashfn) {
         auto& qp = queue_for_cpu(src_cpuid);
         if (!qp._sw_reta) {
             return src_cpuid;
@@ -297,11 +324,6 @@ class device {
         auto& reta = *qp._sw_reta;
         return reta[hash % reta.size()];
     }
-    virtual unsigned hash2cpu(uint32_t hash) {
-        // there is an assumption here that qid == cpu_id which will
-        // not necessary be true in the future
-        return forward_dst(hash2qid(hash), [hash] { return hash; });
-    }
 };
 
 }
@@ -55,7 +55,11 @@ struct offload_info {
     uint8_t tcp_hdr_len = 20;
     uint8_t udp_hdr_len = 8;
     bool needs_ip_csum = false;
+    // The packet is carried over IPv6 (ip_hdr_len is then the IPv6 header)
+    bool ipv6 = false;
     bool reassembled = false;
+    // The L4 checksum of a received packet was verified in software already
+    bool rx_csum_verified = false;
     uint16_t tso_seg_size = 0;
     // HW stripped VLAN header (CPU order)
     std::optional<uint16_t> vlan_tci;
@@ -82,7 +86,12 @@ struct offload_info {
 //
 // As an optimization, when we allocate small fragments, we allocate some
 // extra space, so prepending to the packet does not require extra
-// allocations.  This is useful when adding headers.
+// allocations.  This is useful when adding headers. The fragment array
+// shares that space, so that packets which don't use it can hold more
+// fragments.
+//
+// The impls are recycled through per-shard pools, one per fragment count
+// class, since building a message often takes a few of them.
 //
 class packet final {
     // enough for lots of headers, not quite two cache lines:
@@ -104,32 +113,42 @@ class packet final {
         deleter _deleter;
         unsigned _len = 0;
         uint16_t _nr_frags = 0;
-        uint16_t _allocated_frags;
+        // The pool the impl goes back to, or no_pool
+        uint8_t _pool_class;
         offload_info _offload_info;
         std::optional<uint32_t> _rss_hash;
-        char _data[internal_data_size]; // only _frags[0] may use
-        unsigned _headroom = internal_data_size; // in _data
-        // FIXME: share _data/_frags space
+        // Bytes of storage in _frags. The fragment array fills it from its
+        // start, and the internal data, which only _frags[0] may use,
+        // grows down from its end, within its last internal_data_size
+        // bytes. Fragments may use these bytes while the internal data
+        // doesn't.
+        uint32_t _storage_size;
 
         fragment _frags[];
 
-        impl(size_t nr_frags = default_nr_frags) noexcept;
+        static constexpr uint8_t no_pool = 0xff;
+
+        impl(uint32_t storage_size, uint8_t pool_class) noexcept
+            : _pool_class(pool_class), _storage_size(storage_size) {}
         impl(const impl&) = delete;
-        impl(fragment frag, size_t nr_frags = default_nr_frags);
 
         pseudo_vector fragments() noexcept { return { _frags, _nr_frags }; }
 
-        static std::unique_ptr<impl> allocate(size_t nr_frags) {
-            nr_frags = std::max(nr_frags, default_nr_frags);
-            return std::unique_ptr<impl>(new (nr_frags) impl(nr_frags));
-        }
+        char* storage() noexcept { return reinterpret_cast<char*>(_frags); }
+        char* storage_end() noexcept { return storage() + _storage_size; }
+        char* internal_data() noexcept { return storage_end() - internal_data_size; }
+
+        // Room for nr_frags fragments and the internal data, taken from the
+        // pool of the shard
+        static std::unique_ptr<impl> allocate(size_t nr_frags);
+        // Returns the impl to the pool of the shard
+        void operator delete(impl* p, std::destroying_delete_t) noexcept;
 
         static std::unique_ptr<impl> copy(impl* old, size_t nr) {
             auto n = allocate(nr);
             n->_deleter = std::move(old->_deleter);
             n->_len = old->_len;
             n->_nr_frags = old->_nr_frags;
-            n->_headroom = old->_headroom;
             n->_offload_info = old->_offload_info;
             n->_rss_hash = old->_rss_hash;
             std::copy(old->_frags, old->_frags + old->_nr_frags, n->_frags);
@@ -141,29 +160,28 @@ class packet final {
             return copy(old, old->_nr_frags);
         }
 
+        // The number of fragments there is room for
+        size_t max_frags() noexcept {
+            auto end = using_internal_data() ? _frags[0].base : storage_end();
+            return (end - storage()) / sizeof(fragment);
+        }
+
         static std::unique_ptr<impl> allocate_if_needed(std::unique_ptr<impl> old, size_t extra_frags) {
-            if (old->_allocated_frags >= old->_nr_frags + extra_frags) {
+            if (old->max_frags() >= old->_nr_frags + extra_frags) {
                 return old;
             }
             return copy(old.get(), std::max<size_t>(old->_nr_frags + extra_frags, 2 * old->_nr_frags));
         }
-        void* operator new(size_t size, size_t nr_frags = default_nr_frags) {
-            SEASTAR_ASSERT(nr_frags == uint16_t(nr_frags));
-            return ::operator new(size + nr_frags * sizeof(fragment));
-        }
-        // Matching the operator new above
-        void operator delete(void* ptr, size_t) {
-            return ::operator delete(ptr);
-        }
-        // Since the above "placement delete" hides the global one, expose it
-        void operator delete(void* ptr) {
-            return ::operator delete(ptr);
-        }
 
-        bool using_internal_data() const noexcept {
+        bool using_internal_data() noexcept {
             return _nr_frags
-                    && _frags[0].base >= _data
-                    && _frags[0].base < _data + internal_data_size;
+                    && _frags[0].base >= internal_data()
+                    && _frags[0].base < storage_end();
+        }
+
+        // Room in front of the internal data, which is in use
+        size_t headroom() noexcept {
+            return _frags[0].base - std::max(internal_data(), reinterpret_cast<char*>(_frags + _nr_frags));
         }
 
         void unuse_internal_data() {
@@ -179,13 +197,13 @@ class packet final {
             _frags[0].base = buf;
             d.append(std::move(_deleter));
             _deleter = std::move(d);
-            _headroom = internal_data_size;
         }
+        // At the same distance from the end of the storage
         void copy_internal_fragment_to(impl* to) noexcept {
             if (!using_internal_data()) {
                 return;
             }
-            to->_frags[0].base = to->_data + _headroom;
+            to->_frags[0].base = to->storage_end() - (storage_end() - _frags[0].base);
             std::copy(_frags[0].base, _frags[0].base + _frags[0].size,
                     to->_frags[0].base);
         }
@@ -334,31 +352,6 @@ packet::packet(packet&& x) noexcept
     : _impl(std::move(x._impl)) {
 }
 
-inline
-packet::impl::impl(size_t nr_frags) noexcept
-    : _len(0), _allocated_frags(nr_frags) {
-}
-
-inline
-packet::impl::impl(fragment frag, size_t nr_frags)
-    : _len(frag.size), _allocated_frags(nr_frags) {
-    SEASTAR_ASSERT(_allocated_frags > _nr_frags);
-    if (frag.size <= internal_data_size) {
-        _headroom -= frag.size;
-        _frags[0] = { _data + _headroom, frag.size };
-    } else {
-        auto buf = static_cast<char*>(::malloc(frag.size));
-        if (!buf) {
-            throw std::bad_alloc();
-        }
-        deleter d = make_free_deleter(buf);
-        _frags[0] = { buf, frag.size };
-        _deleter.append(std::move(d));
-    }
-    std::copy(frag.base, frag.base + frag.size, _frags[0].base);
-    ++_nr_frags;
-}
-
 inline
 packet::packet()
     : _impl(impl::allocate(1)) {
@@ -370,7 +363,20 @@ packet::packet(size_t nr_frags)
 }
 
 inline
-packet::packet(fragment frag) : _impl(new impl(frag)) {
+packet::packet(fragment frag) : _impl(impl::allocate(1)) {
+    if (frag.size <= internal_data_size) {
+        _impl->_frags[0] = { _impl->storage_end() - frag.size, frag.size };
+    } else {
+        auto buf = static_cast<char*>(::malloc(frag.size));
+        if (!buf) {
+            throw std::bad_alloc();
+        }
+        _impl->_deleter = make_free_deleter(buf);
+        _impl->_frags[0] = { buf, frag.size };
+    }
+    std::copy(frag.base, frag.base + frag.size, _impl->_frags[0].base);
+    _impl->_nr_frags = 1;
+    _impl->_len = frag.size;
 }
 
 inline
@@ -425,22 +431,27 @@ packet::packet(packet&& x, fragment frag)
 inline
 bool
 packet::allocate_headroom(size_t size) {
-    if (_impl->_headroom >= size) {
-        _impl->_len += size;
-        if (!_impl->using_internal_data()) {
-            _impl = impl::allocate_if_needed(std::move(_impl), 1);
-            std::copy_backward(_impl->_frags, _impl->_frags + _impl->_nr_frags,
-                    _impl->_frags + _impl->_nr_frags + 1);
-            _impl->_frags[0] = { _impl->_data + internal_data_size, 0 };
-            ++_impl->_nr_frags;
+    if (_impl->using_internal_data()) {
+        if (_impl->headroom() < size) {
+            return false;
         }
-        _impl->_headroom -= size;
-        _impl->_frags[0].base -= size;
-        _impl->_frags[0].size += size;
-        return true;
     } else {
-        return false;
+        if (size > internal_data_size) {
+            return false;
+        }
+        // A new internal fragment, leaving room for the fragments
+        if ((_impl->_nr_frags + size_t(1)) * sizeof(fragment) + size > _impl->_storage_size) {
+            _impl = impl::copy(_impl.get(), _impl->_nr_frags + 1);
+        }
+        std::copy_backward(_impl->_frags, _impl->_frags + _impl->_nr_frags,
+                _impl->_frags + _impl->_nr_frags + 1);
+        _impl->_frags[0] = { _impl->storage_end(), 0 };
+        ++_impl->_nr_frags;
     }
+    _impl->_len += size;
+    _impl->_frags[0].base -= size;
+    _impl->_frags[0].size += size;
+    return true;
 }
 
 
@@ -541,13 +552,7 @@ void packet::trim_front(size_t how_much) noexcept {
     }
     std::copy(_impl->_frags + i, _impl->_frags + _impl->_nr_frags, _impl->_frags);
     _impl->_nr_frags -= i;
-    if (!_impl->using_internal_data()) {
-        _impl->_headroom = internal_data_size;
-    }
     if (how_much) {
-        if (_impl->using_internal_data()) {
-            _impl->_headroom += how_much;
-        }
         _impl->_frags[0].base += how_much;
         _impl->_frags[0].size -= how_much;
     }
@@ -564,9 +569,6 @@ void packet::trim_back(size_t how_much) noexcept {
     _impl->_nr_frags = i + 1;
     if (how_much) {
         _impl->_frags[i].size -= how_much;
-        if (i == 0 && _impl->using_internal_data()) {
-            _impl->_headroom += how_much;
-        }
     }
 }
 
@@ -21,6 +21,7 @@
 
 #pragma once
 #ifndef SEASTAR_MODULE
+#include <memory>
 #include <unordered_set>
 #endif
 #include <seastar/core/sharded.hh>
@@ -38,6 +39,30 @@ namespace net {
 
 using namespace seastar;
 
+/// Posix stack configuration.
+struct posix_stack_options : public program_options::option_group {
+    /// \brief Busy poll the NIC queues of the sockets, in microseconds.
+    ///
+    /// Sets \c SO_BUSY_POLL and \c SO_PREFER_BUSY_POLL on the TCP and SCTP
+    /// sockets and makes every shard run a round of NAPI busy polling for
+    /// its sockets from the reactor poll loop, which pays off the most with
+    /// \c --poll-mode. Busy polling longer than \c net.core.busy_read
+    /// needs \c CAP_NET_ADMIN.
+    ///
+    /// Default: 0 (off).
+    program_options::value<unsigned> busy_poll_us;
+    /// \brief Packets processed in a round of busy polling (\c SO_BUSY_POLL_BUDGET).
+    ///
+    /// Default: 8.
+    program_options::value<unsigned> busy_poll_budget;
+
+    /// \cond internal
+    posix_stack_options();
+    /// \endcond
+};
+
+class busy_poller;
+
 // We can't keep this in any of the socket servers as instance members, because a connection can
 // outlive the socket server. To avoid having the whole socket_server tracked as a shared pointer,
 // we will have a conntrack structure.
@@ -96,6 +121,18 @@ class conntrack {
         shard_id cpu() {
             return _target_cpu;
         }
+        // Counts the connection on another shard, once it moved there.
+        // The handle must be kept until the returned future resolves.
+        future<> retarget(shard_id cpu) {
+            auto old = std::exchange(_target_cpu, cpu);
+            if (!_lb || old == cpu) {
+                return make_ready_future<>();
+            }
+            return smp::submit_to(_host_cpu, [old, cpu, lb = _lb.get()] {
+                lb->closed_cpu(old);
+                lb->force_cpu(cpu);
+            });
+        }
     };
     friend class handle;
 
@@ -131,6 +168,7 @@ class posix_data_sink_impl : public data_sink_impl {
     using data_sink_impl::put;
     future<> put(packet p) override;
     future<> put(temporary_buffer<char> buf) override;
+    future<> put_file(file& f, uint64_t pos, uint64_t len) override;
     future<> close() override;
     bool can_batch_flushes() const noexcept override { return true; }
     void on_batch_flush_error() noexcept override;
@@ -182,6 +220,9 @@ class posix_server_socket_impl : public server_socket_impl {
     virtual future<accept_result> accept() override;
     virtual void abort_accept() override;
     virtual socket_address local_address() const override;
+    virtual int native_fd() const noexcept override {
+        return _lfd.get_file_desc().get();
+    }
 };
 
 class posix_reuseport_server_socket_impl : public server_socket_impl {
@@ -195,15 +236,20 @@ class posix_reuseport_server_socket_impl : public server_socket_impl {
     virtual future<accept_result> accept() override;
     virtual void abort_accept() override;
     virtual socket_address local_address() const override;
+    virtual int native_fd() const noexcept override {
+        return _lfd.get_file_desc().get();
+    }
 };
 
 class posix_network_stack : public network_stack {
 private:
     const bool _reuseport;
+    std::unique_ptr<busy_poller> _busy_poller;
 protected:
     std::pmr::polymorphic_allocator<char>* _allocator;
 public:
     explicit posix_network_stack(const program_options::option_group& opts, std::pmr::polymorphic_allocator<char>* allocator=memory::malloc_allocator);
+    ~posix_network_stack();
     virtual server_socket listen(socket_address sa, listen_options opts) override;
     virtual ::seastar::socket socket() override;
     virtual net::udp_channel make_udp_channel(const socket_address&) override;
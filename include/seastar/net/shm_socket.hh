@@ -0,0 +1,86 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/net/api.hh>
+#include <seastar/net/socket_defs.hh>
+
+/*! \file
+  \brief Shared-memory stream sockets for processes running on the same host.
+
+  A connection is a pair of single-producer single-consumer rings in a
+  memfd segment mapped by both processes, with an eventfd per side to wake
+  it up when the peer produced data or released space. The client creates
+  the segment and the eventfds and passes them to the server over a
+  unix-domain socket (the "rendezvous" address), which then stays open to
+  detect that the peer went away.
+
+  The connections are exposed as regular \ref connected_socket, \ref socket
+  and \ref server_socket objects, so that stream users such as RPC can use
+  them instead of TCP without changes:
+
+  \code
+  auto ss = net::shm_listen(socket_address(unix_domain_addr("/run/app/rpc.sock")));
+  rpc::protocol<serializer>::server server(proto, std::move(ss));
+
+  rpc::protocol<serializer>::client client(proto, {}, net::shm_socket(),
+          socket_address(unix_domain_addr("/run/app/rpc.sock")));
+  \endcode
+
+  The options of the TCP sockets (nodelay, keepalive, socket options) don't
+  apply and are ignored.
+*/
+
+namespace seastar {
+
+namespace net {
+
+/// \addtogroup networking-module
+/// @{
+
+/// Options of the client side of shared-memory connections
+struct shm_options {
+    /// Capacity of each direction of a connection, rounded up to a power
+    /// of two
+    size_t ring_size = 1 << 20;
+};
+
+/// Listens for shared-memory connections.
+///
+/// \param sa the unix-domain address the clients connect to
+server_socket shm_listen(socket_address sa);
+
+/// Creates a socket that connects to a server created with shm_listen().
+///
+/// The address passed to socket::connect() must be the unix-domain address
+/// of the server, the local address and the transport are ignored.
+socket shm_socket(shm_options opts = {});
+
+/// Connects to a server created with shm_listen().
+future<connected_socket> shm_connect(socket_address sa, shm_options opts = {});
+
+/// @}
+
+}
+
+}
@@ -0,0 +1,166 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/future.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/core/shard_id.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/net/api.hh>
+#include <seastar/net/socket_defs.hh>
+#include <seastar/util/noncopyable_function.hh>
+#include <vector>
+
+/*! \file
+  \brief Handing sockets off to another process, for restarts that keep them open,
+  and connections to another shard.
+
+  The process being replaced serves a unix-domain address, and the one
+  replacing it connects to it and receives the sockets it chose to hand
+  off, with SCM_RIGHTS. The sockets stay open throughout, so clients don't
+  see the listening ones close, nor have their connections reset:
+
+  \code
+  // old process, when told to restart
+  co_await net::serve_handoff(sa, [&] {
+      std::vector<net::handoff_socket> sockets;
+      sockets.push_back(net::make_handoff_socket("http", listener));
+      return make_ready_future<std::vector<net::handoff_socket>>(std::move(sockets));
+  });
+  listener.abort_accept();
+
+  // new process
+  auto sockets = co_await net::request_handoff(sa);
+  // on the handoff_socket::shard of each
+  auto listener = net::adopt_server_socket(std::move(sockets[0]));
+  \endcode
+
+  The sockets of other shards are made with make_handoff_socket() on their
+  shard, and collected with e.g. \ref smp::submit_to().
+
+  Only sockets of the posix network stack can be handed off. A connection
+  is handed off as a plain stream: whatever the sender read from it and
+  did not process is lost, so it must be handed off at a request boundary,
+  and the state of a TLS session on top of it can't be carried, which is
+  why \ref make_handoff_socket() refuses TLS sockets.
+
+  Within a process, migrate_connected_socket() moves a connection to the
+  shard which turns out to own what the client works on once its first
+  request was read, rather than forwarding each of its requests there:
+
+  \code
+  auto req = co_await read_request(in);
+  auto owner = shard_of(req.key);
+  if (owner != this_shard_id()) {
+      out = {}; // dropped, not closed
+      co_return co_await net::migrate_connected_socket(std::move(conn), std::move(in), owner, [req] (connected_socket conn) {
+          return serve(std::move(conn), std::move(req));
+      });
+  }
+  \endcode
+*/
+
+namespace seastar {
+
+namespace net {
+
+/// \addtogroup networking-module
+/// @{
+
+/// A socket handed off from one process to another
+struct handoff_socket {
+    /// Chosen by the sender, for the receiver to tell the sockets apart
+    sstring name;
+    /// The shard that used the socket in the sender, for the receiver to
+    /// use it on the same one
+    shard_id shard;
+    file_desc fd;
+};
+
+/// Makes a listening socket ready to be handed off.
+///
+/// The socket keeps accepting connections in this process until it is
+/// closed, which should happen once the handoff completed, for the
+/// receiver to get the connections from then on.
+///
+/// Without SO_REUSEPORT, only the shard that listens has a descriptor, the
+/// other shards get their connections from it and have nothing to hand
+/// off: the receiver listens on them as usual.
+///
+/// \throws std::invalid_argument if the socket has no descriptor of its own
+handoff_socket make_handoff_socket(sstring name, server_socket& ss);
+
+/// Makes a connection ready to be handed off.
+///
+/// The caller must stop using the connection, and close it once the
+/// handoff completed.
+///
+/// \throws std::invalid_argument if the connection isn't a plain posix
+///         socket, such as a TLS one
+handoff_socket make_handoff_socket(sstring name, connected_socket& cs);
+
+/// Hands sockets off to the process that calls request_handoff() on \c sa.
+///
+/// Waits for a process of the same user to connect, calls \c collect to
+/// get the sockets, and sends them. The returned future resolves once the
+/// receiver acknowledged them, when the sockets may be closed here.
+///
+/// \param sa the unix-domain address to wait on, preferably in the
+///           abstract namespace so that there is no file left behind
+future<> serve_handoff(socket_address sa, noncopyable_function<future<std::vector<handoff_socket>>()> collect);
+
+/// Receives the sockets of the process serving serve_handoff() on \c sa.
+future<std::vector<handoff_socket>> request_handoff(socket_address sa);
+
+/// Makes a server socket of a listening socket handed off by another
+/// process, to be called on the shard it was used on by the sender.
+///
+/// \param opts only the load balancing options apply, to the sockets
+///             that dispatch connections to other shards
+server_socket adopt_server_socket(handoff_socket s, listen_options opts = {});
+
+/// Makes a connection of one handed off by another process.
+connected_socket adopt_connected_socket(handoff_socket s);
+
+/// Moves a connection of the posix network stack to shard \c to of this
+/// process, and runs \c func there with it.
+///
+/// The data \c in received and the caller did not consume is read first
+/// from the connection on the new shard, so a request boundary need not be
+/// awaited. There must be no read nor write in progress, and the output
+/// stream of the connection must be flushed and dropped beforehand, but
+/// neither stream may be closed, as that would shut the connection down.
+/// With \ref server_socket::load_balancing_algorithm::connection_distribution, the
+/// connection counts against the shard it moved to from then on.
+///
+/// \param in the input stream of \c cs, or a default-constructed one if
+///           it was never made
+/// \returns the result of \c func, failed with std::invalid_argument if
+///          the connection isn't a plain posix socket, such as a TLS one
+future<> migrate_connected_socket(connected_socket cs, input_stream<char> in, shard_id to,
+        noncopyable_function<future<> (connected_socket)> func) noexcept;
+
+/// @}
+
+}
+
+}
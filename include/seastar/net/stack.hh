@@ -49,6 +49,8 @@ class connected_socket_impl {
     virtual socket_address local_address() const noexcept = 0;
     virtual socket_address remote_address() const noexcept = 0;
     virtual future<> wait_input_shutdown() = 0;
+    // The OS socket descriptor, or -1 if the socket isn't backed by one
+    virtual int native_fd() const noexcept { return -1; }
 };
 
 class socket_impl {
@@ -70,6 +72,9 @@ class server_socket_impl {
     virtual future<accept_result> accept() = 0;
     virtual void abort_accept() = 0;
     virtual socket_address local_address() const = 0;
+    // The OS socket descriptor, or -1 if the socket isn't backed by one of
+    // its own
+    virtual int native_fd() const noexcept { return -1; }
 };
 
 class datagram_channel_impl {
@@ -79,6 +84,9 @@ class datagram_channel_impl {
     virtual future<datagram> receive() = 0;
     virtual future<> send(const socket_address& dst, const char* msg) = 0;
     virtual future<> send(const socket_address& dst, packet p) = 0;
+    // Default to one datagram at a time, for stacks that cannot batch
+    virtual future<std::vector<datagram>> receive_batch(size_t max);
+    virtual future<> send_batch(std::vector<outgoing_datagram> datagrams);
     virtual void shutdown_input() = 0;
     virtual void shutdown_output() = 0;
     virtual bool is_closed() const = 0;
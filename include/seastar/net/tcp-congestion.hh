@@ -0,0 +1,159 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+// congestion control algorithms of the native tcp stack
+
+#pragma once
+
+#include <seastar/core/lowres_clock.hh>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+namespace seastar {
+
+namespace net {
+
+/// Congestion control algorithms available to the native TCP stack
+enum class tcp_congestion_algorithm {
+    reno,
+    cubic,
+    bbr,
+};
+
+/// Returns the algorithm by its name, as used with the \c TCP_CONGESTION socket
+/// option. Throws std::invalid_argument for an unknown name.
+tcp_congestion_algorithm parse_tcp_congestion_algorithm(std::string_view name);
+std::string_view tcp_congestion_algorithm_name(tcp_congestion_algorithm algo) noexcept;
+
+/// Congestion state of a native TCP connection
+struct tcp_congestion_info {
+    tcp_congestion_algorithm algorithm;
+    uint32_t cwnd;
+    uint32_t ssthresh;
+    /// Smoothed round-trip time, zero if not yet sampled
+    std::chrono::microseconds srtt;
+    std::chrono::microseconds rttvar;
+};
+
+/// \cond internal
+
+// The congestion window policy of a connection.
+//
+// The tcb keeps the loss recovery (RFC 5681 fast retransmit and RFC 6582
+// NewReno fast recovery) to itself for all the algorithms. The controller
+// decides how the window grows when new data is acknowledged and what the
+// slow start threshold becomes when a loss is detected.
+class tcp_congestion_control {
+public:
+    using clock_type = lowres_clock;
+
+    virtual ~tcp_congestion_control() = default;
+    virtual tcp_congestion_algorithm algorithm() const noexcept = 0;
+    // New data was acknowledged
+    virtual void on_ack(uint32_t& cwnd, uint32_t ssthresh, uint32_t mss, uint32_t acked_bytes, clock_type::time_point now) noexcept = 0;
+    // The round trip was measured on a segment that was not retransmitted
+    virtual void on_rtt_sample(std::chrono::microseconds rtt, clock_type::time_point now) noexcept {}
+    // A loss was detected by duplicate ACKs or by the retransmission timeout,
+    // returns the new slow start threshold
+    virtual uint32_t on_loss(uint32_t cwnd, uint32_t flight_size, uint32_t mss, bool timeout, clock_type::time_point now) noexcept = 0;
+};
+
+// RFC 5681 slow start and congestion avoidance
+class tcp_reno final : public tcp_congestion_control {
+public:
+    virtual tcp_congestion_algorithm algorithm() const noexcept override { return tcp_congestion_algorithm::reno; }
+    virtual void on_ack(uint32_t& cwnd, uint32_t ssthresh, uint32_t mss, uint32_t acked_bytes, clock_type::time_point now) noexcept override;
+    virtual uint32_t on_loss(uint32_t cwnd, uint32_t flight_size, uint32_t mss, bool timeout, clock_type::time_point now) noexcept override;
+};
+
+// RFC 8312 CUBIC, including the TCP-friendly region and fast convergence
+class tcp_cubic final : public tcp_congestion_control {
+    static constexpr double beta = 0.7;
+    static constexpr double c = 0.4;
+
+    // Window before the last reduction, segments
+    double _w_max = 0;
+    // Reno-equivalent window estimate, segments
+    double _w_est = 0;
+    // Time to grow back to _w_max, seconds
+    double _k = 0;
+    // Window growth not applied yet, bytes
+    double _credit = 0;
+    std::optional<clock_type::time_point> _epoch_start;
+    std::chrono::microseconds _min_rtt = std::chrono::microseconds::max();
+public:
+    virtual tcp_congestion_algorithm algorithm() const noexcept override { return tcp_congestion_algorithm::cubic; }
+    virtual void on_ack(uint32_t& cwnd, uint32_t ssthresh, uint32_t mss, uint32_t acked_bytes, clock_type::time_point now) noexcept override;
+    virtual void on_rtt_sample(std::chrono::microseconds rtt, clock_type::time_point now) noexcept override;
+    virtual uint32_t on_loss(uint32_t cwnd, uint32_t flight_size, uint32_t mss, bool timeout, clock_type::time_point now) noexcept override;
+};
+
+// BBR-style model based control. The bottleneck bandwidth is the maximum
+// delivery rate seen over the recent rounds, the round trip propagation time
+// is the minimum RTT seen over the last min_rtt_window. Once the bandwidth
+// stops growing the window is kept at cwnd_gain times their product, and
+// losses don't reduce it below that.
+//
+// The native stack doesn't pace its output, so unlike the full BBR the model
+// only drives the window.
+class tcp_bbr final : public tcp_congestion_control {
+    static constexpr double cwnd_gain = 2.0;
+    static constexpr double full_bw_growth = 1.25;
+    static constexpr unsigned full_bw_rounds = 3;
+    static constexpr unsigned bw_window_rounds = 10;
+    static constexpr auto min_rtt_window = std::chrono::seconds(10);
+
+    // Delivery rate of the recent rounds, bytes per second
+    std::array<double, bw_window_rounds> _bw_samples = {};
+    unsigned _round = 0;
+    uint64_t _delivered = 0;
+    uint64_t _round_start_delivered = 0;
+    clock_type::time_point _round_start;
+    std::chrono::microseconds _min_rtt = std::chrono::microseconds::max();
+    clock_type::time_point _min_rtt_stamp;
+    // Startup ends when the bandwidth doesn't grow for full_bw_rounds
+    bool _filled_pipe = false;
+    double _full_bw = 0;
+    unsigned _full_bw_count = 0;
+
+    double max_bw() const noexcept;
+    void end_round(clock_type::time_point now) noexcept;
+public:
+    virtual tcp_congestion_algorithm algorithm() const noexcept override { return tcp_congestion_algorithm::bbr; }
+    virtual void on_ack(uint32_t& cwnd, uint32_t ssthresh, uint32_t mss, uint32_t acked_bytes, clock_type::time_point now) noexcept override;
+    virtual void on_rtt_sample(std::chrono::microseconds rtt, clock_type::time_point now) noexcept override;
+    virtual uint32_t on_loss(uint32_t cwnd, uint32_t flight_size, uint32_t mss, bool timeout, clock_type::time_point now) noexcept override;
+    // The window the model is after, zero until it has the estimates
+    uint32_t target_cwnd(uint32_t mss) const noexcept;
+};
+
+std::unique_ptr<tcp_congestion_control> make_tcp_congestion_control(tcp_congestion_algorithm algo);
+
+/// \endcond
+
+}
+
+}
@@ -0,0 +1,98 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+// software receive coalescing of the native tcp stack
+
+#pragma once
+
+#include <seastar/net/const.hh>
+#include <seastar/net/packet.hh>
+#include <seastar/net/ipv4_address.hh>
+#include <seastar/util/noncopyable_function.hh>
+
+#include <cstdint>
+#include <vector>
+
+namespace seastar {
+
+namespace net {
+
+/// \cond internal
+
+// Software generic receive offload for TCP over IPv4.
+//
+// The received segments are held per flow until the end of the poll batch
+// and the in-order data segments of the same flow are merged into one
+// packet with multiple fragments, so the tcb input path runs once for all
+// of them. A segment that can't be merged releases what its flow holds
+// first, so the flow sees the segments in the order they came.
+//
+// Only the segments that carry data and nothing but the ACK and PSH flags
+// are merged, and only when their ACK numbers and options are the same.
+// The merged packet has the header of the first segment with the window
+// and PSH of the last one.
+class ipv4_tcp_gro {
+public:
+    using deliver_fn = noncopyable_function<void (packet p, ipv4_address from, ipv4_address to)>;
+    // Flows held at a time, the oldest one is released to make room
+    static constexpr size_t max_flows = 8;
+    // The largest merged segment, so that it still fits an IP datagram
+    static constexpr size_t max_segment_len = ip_packet_len_max - ipv4_hdr_len_min;
+private:
+    struct flow {
+        ipv4_address from;
+        ipv4_address to;
+        uint16_t src_port;
+        uint16_t dst_port;
+        uint32_t next_seq;
+        uint32_t ack;
+        uint16_t hdr_len;
+        packet p;
+    };
+    deliver_fn _deliver;
+    bool _verify_csum;
+    std::vector<flow> _flows;
+    // The flows being released by flush()
+    std::vector<flow> _flushing;
+    uint64_t _merged_segments = 0;
+    uint64_t _packets = 0;
+
+    void release(std::vector<flow>::iterator it);
+public:
+    // With verify_csum the TCP checksum is checked here, as the merged
+    // packet can't be checked later
+    ipv4_tcp_gro(deliver_fn deliver, bool verify_csum);
+    // Takes a TCP segment with the IP header trimmed
+    void receive(packet p, ipv4_address from, ipv4_address to);
+    // Releases the held segments, returns true if there were any
+    bool flush();
+    bool empty() const noexcept { return _flows.empty(); }
+    // Segments merged into the packets of others
+    uint64_t merged_segments() const noexcept { return _merged_segments; }
+    // Packets passed on after the coalescing
+    uint64_t packets() const noexcept { return _packets; }
+};
+
+/// \endcond
+
+}
+
+}
@@ -46,6 +46,14 @@ tcpv4_listen(tcp<ipv4_traits>& tcpv4, uint16_t port, listen_options opts);
 seastar::socket
 tcpv4_socket(tcp<ipv4_traits>& tcpv4);
 
+struct ipv6_traits;
+
+server_socket
+tcpv6_listen(tcp<ipv6_traits>& tcpv6, uint16_t port, listen_options opts);
+
+seastar::socket
+tcpv6_socket(tcp<ipv6_traits>& tcpv6);
+
 }
 
 }
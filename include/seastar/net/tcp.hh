@@ -22,11 +22,13 @@
 #pragma once
 
 #ifndef SEASTAR_MODULE
+#include <array>
 #include <unordered_map>
 #include <map>
 #include <functional>
 #include <deque>
 #include <chrono>
+#include <optional>
 #include <random>
 #include <stdexcept>
 #include <system_error>
@@ -37,11 +39,13 @@
 #include <seastar/core/semaphore.hh>
 #include <seastar/core/byteorder.hh>
 #include <seastar/core/metrics.hh>
+#include <seastar/core/timer.hh>
 #include <seastar/net/net.hh>
 #include <seastar/net/ip_checksum.hh>
 #include <seastar/net/ip.hh>
 #include <seastar/net/const.hh>
 #include <seastar/net/packet-util.hh>
+#include <seastar/net/tcp-congestion.hh>
 #include <seastar/util/assert.hh>
 #include <seastar/util/std-compat.hh>
 
@@ -96,7 +100,7 @@ void tcp_debug(const char* fmt, Args&&... args) {
 
 struct tcp_option {
     // The kind and len field are fixed and defined in TCP protocol
-    enum class option_kind: uint8_t { mss = 2, win_scale = 3, sack = 4, timestamps = 8,  nop = 1, eol = 0 };
+    enum class option_kind: uint8_t { mss = 2, win_scale = 3, sack = 4, sack_blocks = 5, timestamps = 8,  nop = 1, eol = 0 };
     enum class option_len:  uint8_t { mss = 4, win_scale = 3, sack = 2, timestamps = 10, nop = 1, eol = 1 };
     static void write(char* p, option_kind kind, option_len len) {
         p[0] = static_cast<uint8_t>(kind);
@@ -142,6 +146,17 @@ struct tcp_option {
             tcp_option::write(p, kind, len);
         }
     };
+    // RFC 2018 SACK option, the left and right edges of the blocks of data
+    // received out of order. Without timestamps four blocks fit the 40 bytes
+    // of option space.
+    struct sack_blocks {
+        static constexpr option_kind kind = option_kind::sack_blocks;
+        static constexpr uint8_t max_blocks = 4;
+        static constexpr uint8_t len(uint8_t nr_blocks) {
+            return 2 + 8 * nr_blocks;
+        }
+    };
+    using sack_block = std::pair<uint32_t, uint32_t>;
     struct timestamps {
         static constexpr option_kind kind = option_kind::timestamps;
         static constexpr option_len len = option_len::timestamps;
@@ -178,18 +193,40 @@ struct tcp_option {
     void parse(uint8_t* beg, uint8_t* end);
     uint8_t fill(void* h, const tcp_hdr* th, uint8_t option_size);
     uint8_t get_size(bool syn_on, bool ack_on);
+    bool timestamps_enabled() const noexcept {
+        return _local_timestamps && _timestamps_received;
+    }
+    // The timestamps take away the room of one SACK block
+    uint8_t max_sack_blocks() const noexcept {
+        return timestamps_enabled() ? sack_blocks::max_blocks - 1 : sack_blocks::max_blocks;
+    }
 
     // For option negotiattion
     bool _mss_received = false;
     bool _win_scale_received = false;
     bool _timestamps_received = false;
     bool _sack_received = false;
+    // Offer RFC 7323 timestamps
+    bool _local_timestamps = false;
 
     // Option data
     uint16_t _remote_mss = 536;
     uint16_t _local_mss;
     uint8_t _remote_win_scale = 0;
     uint8_t _local_win_scale = 0;
+    // SACK blocks to send with the next segment
+    std::array<sack_block, sack_blocks::max_blocks> _local_sack_blocks;
+    uint8_t _nr_local_sack_blocks = 0;
+    // SACK blocks of the last parsed segment
+    std::array<sack_block, sack_blocks::max_blocks> _remote_sack_blocks;
+    uint8_t _nr_remote_sack_blocks = 0;
+    // Timestamps to send with the next segment
+    uint32_t _local_ts_val = 0;
+    uint32_t _local_ts_ecr = 0;
+    // Timestamps of the last parsed segment
+    bool _remote_ts_present = false;
+    uint32_t _remote_ts_val = 0;
+    uint32_t _remote_ts_ecr = 0;
 };
 inline char*& operator+=(char*& x, tcp_option::option_len len) { x += uint8_t(len); return x; }
 inline const char*& operator+=(const char*& x, tcp_option::option_len len) { x += uint8_t(len); return x; }
@@ -288,6 +325,103 @@ struct tcp_hdr {
 struct tcp_tag {};
 using tcp_packet_merger = packet_merger<tcp_seq, tcp_tag>;
 
+/// Loss detection parameters of the native TCP stack
+struct tcp_tuning {
+    /// Lower bound of the retransmission timeout. The timer fires with the
+    /// granularity of \ref lowres_clock, about a task quota.
+    std::chrono::microseconds min_rto = std::chrono::seconds(1);
+    /// How long the peer may delay an ACK, added to the tail loss probe
+    /// timeout when a single segment is in flight
+    std::chrono::microseconds max_ack_delay = std::chrono::milliseconds(200);
+    /// Offer RFC 7323 timestamps and take microsecond RTT samples from them
+    bool timestamps = false;
+    /// RFC 8985 RACK-TLP loss detection, used on connections with SACK
+    bool rack_tlp = false;
+    /// Receive buffer of a new connection. It grows with what the
+    /// application consumes per round trip, up to max_receive_buffer.
+    size_t initial_receive_buffer = 128 * 1024;
+    size_t max_receive_buffer = 6 * 1024 * 1024;
+
+    /// Tuning for networks with RTTs in the tens of microseconds
+    static tcp_tuning datacenter() noexcept {
+        tcp_tuning t;
+        t.min_rto = std::chrono::milliseconds(5);
+        t.max_ack_delay = std::chrono::milliseconds(1);
+        t.timestamps = true;
+        t.rack_tlp = true;
+        return t;
+    }
+};
+
+/// Receive buffer auto-tuning, after Linux's tcp_rcv_space_adjust()
+///
+/// Every round trip, the buffer grows to twice what the application
+/// consumed in the last one, so that the advertised window keeps up with
+/// the bandwidth-delay product of the connection without each connection
+/// reserving the maximum up front.
+class tcp_receive_space {
+public:
+    using clock_type = steady_clock_type;
+private:
+    size_t _buffer;
+    size_t _max;
+    // What the application consumed in the last measured round trip
+    size_t _space;
+    uint64_t _consumed = 0;
+    uint64_t _measured_consumed = 0;
+    std::optional<clock_type::time_point> _measured_at;
+    std::chrono::microseconds _rtt{0};
+public:
+    tcp_receive_space(size_t initial, size_t max) noexcept
+        : _buffer(std::min(initial, max)), _max(max), _space(_buffer / 2) {}
+    /// A receiver side RTT sample. A sample taken as the time to receive a
+    /// window worth of data is an upper bound, and only lowers the estimate.
+    void on_rtt_sample(std::chrono::microseconds rtt, bool upper_bound) noexcept;
+    /// The application consumed \c len bytes, returns whether the buffer grew
+    bool on_consumed(size_t len, uint16_t mss, clock_type::time_point now) noexcept;
+    size_t buffer_size() const noexcept { return _buffer; }
+    std::chrono::microseconds rtt() const noexcept { return _rtt; }
+};
+
+/// When to acknowledge received data, after Linux's delayed ACK
+///
+/// The ACK timeout follows the interval between received segments. A
+/// connection which starts, or receives after being idle, acknowledges
+/// its first segments right away (quick ACK mode), so that a sender in
+/// slow start is not held back by delayed ACKs. A connection which sends
+/// data shortly after receiving some is interactive (ping-pong mode), and
+/// delays its ACKs so that they go out with the response.
+class tcp_ack_policy {
+public:
+    using clock_type = steady_clock_type;
+    static constexpr std::chrono::microseconds min_ack_timeout = std::chrono::milliseconds(40);
+    static constexpr uint16_t max_quick_acks = 16;
+private:
+    std::chrono::microseconds _max_delay;
+    // The ACK timeout estimate, 0 before data was received
+    std::chrono::microseconds _ato{0};
+    clock_type::time_point _last_received;
+    uint16_t _quick_acks = 0;
+    bool _pingpong = false;
+
+    std::chrono::microseconds min_delay() const noexcept { return std::min(min_ack_timeout, _max_delay); }
+    void enter_quick_ack(uint32_t window, uint16_t mss) noexcept;
+public:
+    /// \param max_delay the longest an ACK may be delayed
+    explicit tcp_ack_policy(std::chrono::microseconds max_delay) noexcept : _max_delay(max_delay) {}
+    /// Data was received, \c window being the receive window
+    void on_data_received(clock_type::time_point now, uint32_t window, uint16_t mss, std::chrono::microseconds rto) noexcept;
+    /// The application sent data
+    void on_data_sent(clock_type::time_point now) noexcept;
+    /// An ACK was delayed until the timeout
+    void on_ack_timeout() noexcept;
+    /// Whether to acknowledge the segment just received right away
+    bool take_quick_ack() noexcept;
+    /// How long to delay an ACK otherwise
+    std::chrono::microseconds ack_timeout() const noexcept { return std::clamp(_ato, min_delay(), _max_delay); }
+    bool interactive() const noexcept { return _pingpong; }
+};
+
 template <typename InetTraits>
 class tcp {
 public:
@@ -326,7 +460,22 @@ class tcp {
             packet p;
             uint16_t data_len;
             unsigned nr_transmits;
-            clock_type::time_point tx_time;
+            // The time of the last (re)transmission
+            steady_clock_type::time_point tx_time;
+            tcp_seq seq;
+            // Reported received by a SACK block
+            bool sacked = false;
+            // Deemed lost by RACK and not retransmitted since
+            bool lost = false;
+        };
+        // RFC 6675 view of the retransmission queue in loss recovery
+        struct sack_scoreboard {
+            // Data in flight
+            uint32_t pipe = 0;
+            // The first segment considered lost and not retransmitted yet
+            unacked_segment* lost = nullptr;
+            // The first hole below the highest SACKed segment, not retransmitted yet
+            unacked_segment* hole = nullptr;
         };
         struct send {
             tcp_seq unacknowledged;
@@ -351,11 +500,11 @@ class tcp {
             // wait for there is at least one byte available in the queue
             std::optional<promise<>> _send_available_promise;
             // Round-trip time variation
-            std::chrono::milliseconds rttvar;
+            std::chrono::microseconds rttvar;
             // Smoothed round-trip time
-            std::chrono::milliseconds srtt;
+            std::chrono::microseconds srtt;
             bool first_rto_sample = true;
-            clock_type::time_point syn_tx_time;
+            steady_clock_type::time_point syn_tx_time;
             // Congestion window
             uint32_t cwnd;
             // Slow start threshold
@@ -367,6 +516,8 @@ class tcp {
             uint32_t limited_transfer = 0;
             uint32_t partial_ack = 0;
             tcp_seq recover;
+            // Everything below was retransmitted in the current loss recovery
+            tcp_seq high_rxt;
             bool window_probe = false;
             uint8_t zero_window_probing_out = 0;
         } _snd;
@@ -382,23 +533,47 @@ class tcp {
             size_t data_size = 0;
             tcp_packet_merger out_of_order;
             std::optional<promise<>> _data_received_promise;
-            // The maximun memory buffer size allowed for receiving
-            // Currently, it is the same as default receive window size when window scaling is enabled
-            size_t max_receive_buf_size = 3737600;
+            // The start of the last segment received out of order
+            tcp_seq last_out_of_order;
+            // The timestamp to echo, RFC7323 TS.Recent
+            uint32_t ts_recent = 0;
+            // Measures the time to receive a window worth of data, an
+            // upper bound of the round trip time
+            tcp_seq rtt_seq;
+            std::optional<steady_clock_type::time_point> rtt_start;
         } _rcv;
+        tcp_receive_space _rcv_space;
         tcp_option _option;
+        tcp_ack_policy _ack_policy;
         timer<lowres_clock> _delayed_ack;
         // Retransmission timeout
-        std::chrono::milliseconds _rto{1000};
-        std::chrono::milliseconds _persist_time_out{1000};
-        static constexpr std::chrono::milliseconds _rto_min{1000};
-        static constexpr std::chrono::milliseconds _rto_max{60000};
+        std::chrono::microseconds _rto = std::chrono::seconds(1);
+        std::chrono::microseconds _persist_time_out = std::chrono::seconds(1);
+        static constexpr std::chrono::microseconds _rto_max = std::chrono::seconds(60);
         // Clock granularity
-        static constexpr std::chrono::milliseconds _rto_clk_granularity{1};
+        static constexpr std::chrono::microseconds _rto_clk_granularity = std::chrono::milliseconds(1);
         static constexpr uint16_t _max_nr_retransmit{5};
+        // Duplicate ACKs or SACKed segments indicating a loss
+        static constexpr uint16_t _dupthresh{3};
         timer<lowres_clock> _retransmit;
+        // The retransmission timer is armed for a tail loss probe
+        bool _pto_armed = false;
         timer<lowres_clock> _persist;
+        // RFC8985 RACK, the most recently sent segment known to be delivered
+        struct rack {
+            bool sampled = false;
+            steady_clock_type::time_point xmit_ts;
+            tcp_seq end_seq;
+            std::chrono::microseconds rtt{0};
+            std::chrono::microseconds min_rtt = std::chrono::microseconds::max();
+            // A tail loss probe is in flight
+            bool tlp_outstanding = false;
+            bool tlp_is_retransmit = false;
+            tcp_seq tlp_end_seq;
+        } _rack;
+        timer<lowres_clock> _rack_timer;
         uint16_t _nr_full_seg_received = 0;
+        std::unique_ptr<tcp_congestion_control> _cc;
         struct isn_secret {
             // 512 bits secretkey for ISN generating
             uint32_t key[16];
@@ -415,22 +590,23 @@ class tcp {
         tcp_seq get_isn();
         circular_buffer<typename InetTraits::l4packet> _packetq;
         bool _poll_active = false;
+        // The receive window with an empty receive buffer
         uint32_t get_default_receive_window_size() {
-            // Linux's default window size
-            constexpr uint32_t size = 29200;
-            return size << _rcv.window_scale;
+            return std::min<size_t>(_rcv_space.buffer_size(), size_t(0xffff) << _rcv.window_scale);
         }
         // Returns the current receive window according to available receiving buffer size
         uint32_t get_modified_receive_window_size() {
-            uint32_t left =  _rcv.data_size > _rcv.max_receive_buf_size ? 0 : _rcv.max_receive_buf_size - _rcv.data_size;
+            auto buf_size = _rcv_space.buffer_size();
+            uint32_t left =  _rcv.data_size > buf_size ? 0 : buf_size - _rcv.data_size;
             return std::min(left, get_default_receive_window_size());
         }
+        void receive_rtt_measure(uint32_t seg_len);
     public:
         tcb(tcp& t, connid id);
         void input_handle_listen_state(tcp_hdr* th, packet p);
         void input_handle_syn_sent_state(tcp_hdr* th, packet p);
         void input_handle_other_state(tcp_hdr* th, packet p);
-        void output_one(bool data_retransmit = false);
+        void output_one(unacked_segment* retransmit_seg = nullptr);
         future<> wait_for_data();
         future<> wait_input_shutdown();
         void abort_reader() noexcept;
@@ -442,7 +618,9 @@ class tcp {
         void close() noexcept;
         void remove_from_tcbs() {
             auto id = connid{_local_ip, _foreign_ip, _local_port, _foreign_port};
-            _tcp._tcbs.erase(id);
+            if (_tcp._tcbs.erase(id)) {
+                _tcp.flow_closed(id);
+            }
         }
         std::optional<typename InetTraits::l4packet> get_packet();
         void output() {
@@ -472,6 +650,18 @@ class tcp {
         tcp_state& state() {
             return _state;
         }
+        void set_congestion_control(tcp_congestion_algorithm algo) {
+            _cc = make_tcp_congestion_control(algo);
+        }
+        tcp_congestion_info congestion_info() const noexcept {
+            return tcp_congestion_info{
+                .algorithm = _cc->algorithm(),
+                .cwnd = _snd.cwnd,
+                .ssthresh = _snd.ssthresh,
+                .srtt = _snd.first_rto_sample ? std::chrono::microseconds(0) : _snd.srtt,
+                .rttvar = _snd.first_rto_sample ? std::chrono::microseconds(0) : _snd.rttvar,
+            };
+        }
     private:
         void respond_with_reset(tcp_hdr* th);
         bool merge_out_of_order();
@@ -481,19 +671,51 @@ class tcp {
         void clear_delayed_ack() noexcept;
         packet get_transmit_packet();
         void retransmit_one() {
-            bool data_retransmit = true;
-            output_one(data_retransmit);
+            output_one(&_snd.data.front());
+        }
+        bool sack_enabled() const noexcept {
+            return _option._sack_received;
+        }
+        void update_local_sack_blocks();
+        bool update_sack_scoreboard();
+        void clear_sack_scoreboard() noexcept {
+            for (auto& seg : _snd.data) {
+                seg.sacked = false;
+            }
+        }
+        bool sack_front_lost() const noexcept;
+        sack_scoreboard scan_sack_scoreboard();
+        unacked_segment* sack_next_retransmit();
+        void sack_retransmit(unacked_segment& seg);
+        bool rack_enabled() const noexcept {
+            return _tcp._tuning.rack_tlp && sack_enabled();
+        }
+        void rack_update(const unacked_segment& seg, steady_clock_type::time_point now) noexcept;
+        bool rack_detect_loss();
+        void rack_enter_recovery();
+        void rack_timeout();
+        std::optional<std::chrono::microseconds> probe_timeout() const noexcept;
+        void tail_loss_probe();
+        static uint32_t timestamp_now() noexcept {
+            return std::chrono::duration_cast<std::chrono::microseconds>(steady_clock_type::now().time_since_epoch()).count();
+        }
+        uint16_t segment_payload_limit() {
+            return std::min(uint16_t(_tcp.hw_features().mtu - net::tcp_hdr_len_min - InetTraits::ip_hdr_len_min), _snd.mss);
         }
         void start_retransmit_timer() {
             auto now = clock_type::now();
             start_retransmit_timer(now);
         };
         void start_retransmit_timer(clock_type::time_point now) {
-            auto tp = now + _rto;
+            // RFC8985 Section 7.2, a tail loss probe goes before the RTO
+            auto pto = probe_timeout();
+            _pto_armed = bool(pto);
+            auto tp = now + (pto ? *pto : _rto);
             _retransmit.rearm(tp);
         };
         void stop_retransmit_timer() noexcept {
             _retransmit.cancel();
+            _pto_armed = false;
         };
         void start_persist_timer() {
             auto now = clock_type::now();
@@ -509,7 +731,7 @@ class tcp {
         void persist();
         void retransmit();
         void fast_retransmit();
-        void update_rto(clock_type::time_point tx_time);
+        void update_rto(std::chrono::microseconds R);
         void update_cwnd(uint32_t acked_bytes);
         void cleanup();
         uint32_t can_send() {
@@ -540,6 +762,14 @@ class tcp {
                 auto max = _snd.cwnd + 2 * _snd.mss;
                 x = flight <= max ? std::min(x, max - flight) : 0;
                 _snd.limited_transfer += x;
+            } else if (_snd.dupacks >= 3 && sack_enabled()) {
+                // RFC6675 Step (C), send while cwnd - pipe >= 1 SMSS,
+                // retransmissions of the lost segments go first
+                auto sb = scan_sack_scoreboard();
+                if (sb.lost || sb.pipe + _snd.mss > _snd.cwnd) {
+                    return 0;
+                }
+                x = std::min(_snd.cwnd - sb.pipe, x);
             } else if (_snd.dupacks >= 3) {
                 // RFC5681 Step 3.5
                 // Sent 1 full-sized segment at most
@@ -578,19 +808,19 @@ class tcp {
         }
         void do_syn_sent() {
             _state = SYN_SENT;
-            _snd.syn_tx_time = clock_type::now();
+            _snd.syn_tx_time = steady_clock_type::now();
             // Send <SYN> to remote
             output();
         }
         void do_syn_received() {
             _state = SYN_RECEIVED;
-            _snd.syn_tx_time = clock_type::now();
+            _snd.syn_tx_time = steady_clock_type::now();
             // Send <SYN,ACK> to remote
             output();
         }
         void do_established() {
             _state = ESTABLISHED;
-            update_rto(_snd.syn_tx_time);
+            update_rto(std::chrono::duration_cast<std::chrono::microseconds>(steady_clock_type::now() - _snd.syn_tx_time));
             _connect_done.set_value();
         }
         void do_reset() {
@@ -623,6 +853,7 @@ class tcp {
             _snd.unacknowledged = _snd.initial;
             _snd.next = _snd.initial + 1;
             _snd.recover = _snd.initial;
+            _snd.high_rxt = _snd.initial;
         }
         void do_local_fin_acked() {
             _snd.unacknowledged += 1;
@@ -662,8 +893,15 @@ class tcp {
     std::uniform_int_distribution<uint16_t> _port_dist{41952, 65535};
     circular_buffer<std::pair<lw_shared_ptr<tcb>, ethernet_address>> _poll_tcbs;
     // queue for packets that do not belong to any tcb
-    circular_buffer<ipv4_traits::l4packet> _packetq;
+    circular_buffer<typename InetTraits::l4packet> _packetq;
     semaphore _queue_space = {212992};
+    tcp_congestion_algorithm _default_congestion = tcp_congestion_algorithm::reno;
+    tcp_tuning _tuning;
+    uint64_t _fast_retransmits = 0;
+    uint64_t _retransmit_timeouts = 0;
+    uint64_t _sack_retransmits = 0;
+    uint64_t _rack_losses = 0;
+    uint64_t _tail_loss_probes = 0;
     metrics::metric_groups _metrics;
 public:
     const inet_type& inet() const {
@@ -713,6 +951,15 @@ class tcp {
         uint16_t local_port() {
             return _tcb->_local_port;
         }
+        /// Switches the connection to another congestion control algorithm.
+        /// The congestion window is kept, the state of the previous
+        /// algorithm is dropped.
+        void set_congestion_control(tcp_congestion_algorithm algo) {
+            _tcb->set_congestion_control(algo);
+        }
+        tcp_congestion_info congestion_info() const noexcept {
+            return _tcb->congestion_info();
+        }
         void shutdown_connect();
         void close_read() noexcept;
         void close_write() noexcept;
@@ -763,6 +1010,12 @@ class tcp {
     listener listen(uint16_t port, size_t queue_length = 100);
     connection connect(socket_address sa);
     const net::hw_features& hw_features() const { return _inet._inet.hw_features(); }
+    /// Sets the congestion control algorithm of the connections created from now on
+    void set_default_congestion_control(tcp_congestion_algorithm algo) noexcept { _default_congestion = algo; }
+    tcp_congestion_algorithm default_congestion_control() const noexcept { return _default_congestion; }
+    /// Sets the loss detection parameters of the connections created from now on
+    void set_tuning(const tcp_tuning& tuning) noexcept { _tuning = tuning; }
+    const tcp_tuning& tuning() const noexcept { return _tuning; }
     future<> poll_tcb(ipaddr to, lw_shared_ptr<tcb> tcb);
     void add_connected_tcb(lw_shared_ptr<tcb> tcbp, uint16_t local_port) {
         auto it = _listening.find(local_port);
@@ -774,6 +1027,20 @@ class tcp {
 private:
     void send_packet_without_tcb(ipaddr from, ipaddr to, packet p);
     void respond_with_reset(tcp_hdr* rth, ipaddr local_ip, ipaddr foreign_ip);
+    // Keeps a device which rebalances its RSS redirection table from moving
+    // the connection to another shard
+    void flow_opened(connid id) {
+        auto netif = _inet._inet.netif();
+        if (netif->dynamic_rss()) {
+            netif->flow_opened(id.hash(netif->rss_key()));
+        }
+    }
+    void flow_closed(connid id) {
+        auto netif = _inet._inet.netif();
+        if (netif->dynamic_rss()) {
+            netif->flow_closed(id.hash(netif->rss_key()));
+        }
+    }
     friend class listener;
 };
 
@@ -783,10 +1050,41 @@ tcp<InetTraits>::tcp(inet_type& inet)
     , _e(_rd()) {
     namespace sm = metrics;
 
-    _metrics.add_group("tcp", {
+    _metrics.add_group(InetTraits::tcp_metrics_group, {
         sm::make_counter("linearizations", [] { return tcp_packet_merger::linearizations(); },
                         sm::description("Counts a number of times a buffer linearization was invoked during the buffers merge process. "
-                                        "Divide it by a total TCP receive packet rate to get an everage number of lineraizations per TCP packet."))
+                                        "Divide it by a total TCP receive packet rate to get an everage number of lineraizations per TCP packet.")),
+        sm::make_counter("fast_retransmits", _fast_retransmits,
+                        sm::description("Counts a number of times a loss was detected by duplicated ACKs")),
+        sm::make_counter("retransmit_timeouts", _retransmit_timeouts,
+                        sm::description("Counts a number of times the retransmission timer expired with unacknowledged data")),
+        sm::make_counter("sack_retransmits", _sack_retransmits,
+                        sm::description("Counts a number of segments retransmitted because the SACK scoreboard deemed them lost")),
+        sm::make_counter("rack_losses", _rack_losses,
+                        sm::description("Counts a number of segments RACK deemed lost")),
+        sm::make_counter("tail_loss_probes", _tail_loss_probes,
+                        sm::description("Counts a number of tail loss probes sent")),
+        sm::make_gauge("congestion_window_bytes", [this] {
+                            uint64_t total = 0;
+                            for (auto& [id, tcb] : _tcbs) {
+                                total += tcb->congestion_info().cwnd;
+                            }
+                            return total;
+                        },
+                        sm::description("Sum of congestion windows of all connections")),
+        sm::make_gauge("smoothed_rtt_ms", [this] {
+                            uint64_t total = 0;
+                            unsigned nr = 0;
+                            for (auto& [id, tcb] : _tcbs) {
+                                auto srtt = tcb->congestion_info().srtt;
+                                if (srtt.count()) {
+                                    total += srtt.count();
+                                    nr++;
+                                }
+                            }
+                            return nr ? double(total) / nr / 1000 : 0.0;
+                        },
+                        sm::description("Average smoothed round-trip time of the connections that measured it, in milliseconds")),
     });
 
     _inet.register_packet_provider([this, tcb_polled = 0u] () mutable {
@@ -829,9 +1127,9 @@ auto tcp<InetTraits>::listen(uint16_t port, size_t queue_length) -> listener {
 template <typename InetTraits>
 auto tcp<InetTraits>::connect(socket_address sa) -> connection {
     connid id;
-    auto src_ip = _inet._inet.host_address();
-    auto dst_ip = ipv4_address(sa);
-    auto dst_port = net::ntoh(sa.u.in.sin_port);
+    auto dst_ip = ipaddr(sa);
+    auto src_ip = _inet._inet.source_address_for(dst_ip);
+    auto dst_port = sa.port();
 
     if (smp::count > 1) {
         do {
@@ -844,6 +1142,7 @@ auto tcp<InetTraits>::connect(socket_address sa) -> connection {
 
     auto tcbp = make_lw_shared<tcb>(*this, id);
     _tcbs.insert({id, tcbp});
+    flow_opened(id);
     tcbp->connect();
     return connection(tcbp);
 }
@@ -873,7 +1172,7 @@ void tcp<InetTraits>::received(packet p, ipaddr from, ipaddr to) {
         return;
     }
 
-    if (!hw_features().rx_csum_offload) {
+    if (!hw_features().rx_csum_offload && !p.offload_info_ref().rx_csum_verified) {
         checksummer csum;
         InetTraits::tcp_pseudo_header_checksum(csum, from, to, p.len());
         csum.sum(p);
@@ -916,6 +1215,7 @@ void tcp<InetTraits>::received(packet p, ipaddr from, ipaddr to) {
                 // NOTE: Ignored for now
                 tcbp = make_lw_shared<tcb>(*this, id);
                 _tcbs.insert({id, tcbp});
+                flow_opened(id);
                 // TODO: we need to remove the tcb and decrease the pending if
                 // it stays SYN_RECEIVED state forever.
                 listener->second->inc_pending();
@@ -947,7 +1247,7 @@ void tcp<InetTraits>::send_packet_without_tcb(ipaddr from, ipaddr to, packet p)
     if (_queue_space.try_wait(p.len())) { // drop packets that do not fit the queue
         // FIXME: future is discarded
         (void)_inet.get_l2_dst_address(to).then([this, to, p = std::move(p)] (ethernet_address e_dst) mutable {
-                _packetq.emplace_back(ipv4_traits::l4packet{to, std::move(p), e_dst, ip_protocol_num::tcp});
+                _packetq.emplace_back(typename InetTraits::l4packet{to, std::move(p), e_dst, ip_protocol_num::tcp});
         });
     }
 }
@@ -968,9 +1268,14 @@ tcp<InetTraits>::tcb::tcb(tcp& t, connid id)
     , _foreign_ip(id.foreign_ip)
     , _local_port(id.local_port)
     , _foreign_port(id.foreign_port)
-    , _delayed_ack([this] { _nr_full_seg_received = 0; output(); })
+    , _rcv_space(t._tuning.initial_receive_buffer, t._tuning.max_receive_buffer)
+    , _ack_policy(t._tuning.max_ack_delay)
+    , _delayed_ack([this] { _nr_full_seg_received = 0; _ack_policy.on_ack_timeout(); output(); })
     , _retransmit([this] { retransmit(); })
-    , _persist([this] { persist(); }) {
+    , _persist([this] { persist(); })
+    , _rack_timer([this] { rack_timeout(); })
+    , _cc(make_tcp_congestion_control(t._default_congestion)) {
+    _option._local_timestamps = t._tuning.timestamps;
 }
 
 template <typename InetTraits>
@@ -1030,9 +1335,14 @@ uint32_t tcp<InetTraits>::tcb::data_segment_acked(tcp_seq seg_ack) {
             && (_snd.unacknowledged + _snd.data.front().p.len() <= seg_ack)) {
         auto acked_bytes = _snd.data.front().p.len();
         _snd.unacknowledged += acked_bytes;
-        // Ignore retransmitted segments when setting the RTO
-        if (_snd.data.front().nr_transmits == 0) {
-            update_rto(_snd.data.front().tx_time);
+        auto now = steady_clock_type::now();
+        // Ignore retransmitted segments when setting the RTO, with
+        // timestamps the echoed value gives the sample instead
+        if (_snd.data.front().nr_transmits == 0 && !_option.timestamps_enabled()) {
+            update_rto(std::chrono::duration_cast<std::chrono::microseconds>(now - _snd.data.front().tx_time));
+        }
+        if (!_snd.data.front().sacked) {
+            rack_update(_snd.data.front(), now);
         }
         update_cwnd(acked_bytes);
         total_acked_bytes += acked_bytes;
@@ -1046,6 +1356,7 @@ uint32_t tcp<InetTraits>::tcb::data_segment_acked(tcp_seq seg_ack) {
         if (!_snd.data.empty()) {
             auto& unacked_seg = _snd.data.front();
             unacked_seg.p.trim_front(acked_bytes);
+            unacked_seg.seq += acked_bytes;
         }
         _snd.unacknowledged = seg_ack;
         update_cwnd(acked_bytes);
@@ -1079,6 +1390,9 @@ template <typename InetTraits>
 void tcp<InetTraits>::tcb::init_from_options(tcp_hdr* th, uint8_t* opt_start, uint8_t* opt_end) {
     // Handle tcp options
     _option.parse(opt_start, opt_end);
+    if (_option._remote_ts_present) {
+        _rcv.ts_recent = _option._remote_ts_val;
+    }
 
     // Remote receive window scale factor
     _snd.window_scale = _option._remote_win_scale;
@@ -1213,6 +1527,15 @@ void tcp<InetTraits>::tcb::input_handle_syn_sent_state(tcp_hdr* th, packet p) {
 
 template <typename InetTraits>
 void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
+    if (sack_enabled() || _option.timestamps_enabled()) {
+        auto opt_len = th->data_offset * 4 - tcp_hdr::len;
+        _option._nr_remote_sack_blocks = 0;
+        _option._remote_ts_present = false;
+        if (opt_len > 0) {
+            auto opt_start = reinterpret_cast<uint8_t*>(p.get_header(0, th->data_offset * 4)) + tcp_hdr::len;
+            _option.parse(opt_start, opt_start + opt_len);
+        }
+    }
     p.trim_front(th->data_offset * 4);
     bool do_output = false;
     bool do_output_data = false;
@@ -1226,6 +1549,12 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
         return output();
     }
 
+    // RFC7323 Section 4.3, the timestamp to echo is taken from the segments
+    // that don't leave a gap
+    if (_option._remote_ts_present && seg_seq <= _rcv.next) {
+        _rcv.ts_recent = _option._remote_ts_val;
+    }
+
     // In the following it is assumed that the segment is the idealized
     // segment that begins at RCV.NXT and does not exceed the window.
     if (seg_seq < _rcv.next) {
@@ -1332,10 +1661,26 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
         if (in_state(ESTABLISHED | CLOSE_WAIT)){
             // When we are in zero window probing phase and packets_out = 0 we bypass "duplicated ack" check
             auto packets_out = _snd.next - _snd.unacknowledged - _snd.zero_window_probing_out;
+            // RFC6675: an ACK SACKing new data counts as a duplicate ACK
+            bool sacked_new_data = _option._nr_remote_sack_blocks && update_sack_scoreboard();
             // If SND.UNA < SEG.ACK =< SND.NXT then, set SND.UNA <- SEG.ACK.
             if (_snd.unacknowledged < seg_ack && seg_ack <= _snd.next) {
+                // RFC7323 Section 4.1, an ACK that advances SND.UNA gives
+                // an RTT sample from the echoed timestamp
+                if (_option.timestamps_enabled() && _option._remote_ts_present && _option._remote_ts_ecr) {
+                    update_rto(std::chrono::microseconds(uint32_t(timestamp_now() - _option._remote_ts_ecr)));
+                }
                 // Remote ACKed data we sent
                 auto acked_bytes = data_segment_acked(seg_ack);
+                if (_rack.tlp_outstanding && seg_ack >= _rack.tlp_end_seq) {
+                    // RFC8985 Section 7.4.2, without D-SACK a repaired
+                    // retransmitted probe means the loss went unnoticed
+                    _rack.tlp_outstanding = false;
+                    if (_rack.tlp_is_retransmit && _snd.dupacks < _dupthresh) {
+                        _snd.ssthresh = _cc->on_loss(_snd.cwnd, flight_size(), _snd.mss, false, clock_type::now());
+                        _snd.cwnd = _snd.ssthresh;
+                    }
+                }
 
                 // If SND.UNA < SEG.ACK =< SND.NXT, the send window should be updated.
                 if (_snd.wl1 < seg_seq || (_snd.wl1 == seg_seq && _snd.wl2 <= seg_ack)) {
@@ -1367,6 +1712,13 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
                         // Exit the fast recovery procedure
                         exit_fast_recovery();
                         set_retransmit_timer();
+                    } else if (sack_enabled()) {
+                        tcp_debug("ack: partial_ack\n");
+                        // RFC6675 keeps cwnd as it is, the scoreboard tells
+                        // what to retransmit next
+                        if (++_snd.partial_ack == 1) {
+                            start_retransmit_timer();
+                        }
                     } else {
                         tcp_debug("ack: partial_ack\n");
                         // Retransmit the first unacknowledged segment
@@ -1398,10 +1750,10 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
                     exit_fast_recovery();
                     set_retransmit_timer();
                 }
-            } else if ((packets_out > 0) && !_snd.data.empty() && seg_len == 0 &&
-                th->f_fin == 0 && th->f_syn == 0 &&
+            } else if ((packets_out > 0) && !_snd.data.empty() &&
                 th->ack == _snd.unacknowledged &&
-                uint32_t(th->window << _snd.window_scale) == _snd.window) {
+                (sacked_new_data || (seg_len == 0 && th->f_fin == 0 && th->f_syn == 0 &&
+                uint32_t(th->window << _snd.window_scale) == _snd.window))) {
                 // Note:
                 // RFC793 states:
                 // If the ACK is a duplicate (SEG.ACK < SND.UNA), it can be ignored
@@ -1411,6 +1763,11 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
                 // Here, We follow RFC5681.
                 _snd.dupacks++;
                 uint32_t smss = _snd.mss;
+                if (_snd.dupacks < _dupthresh && sack_enabled() && sack_front_lost()) {
+                    // RFC6675 Step 4, enough data above the first segment
+                    // was SACKed to consider it lost
+                    _snd.dupacks = _dupthresh;
+                }
                 // 3 duplicated ACKs trigger a fast retransmit
                 if (_snd.dupacks == 1 || _snd.dupacks == 2) {
                     // RFC5681 Step 3.1
@@ -1421,16 +1778,27 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
                     if (seg_ack - 1 > _snd.recover) {
                         _snd.recover = _snd.next - 1;
                         // RFC5681 Step 3.2
-                        _snd.ssthresh = std::max((flight_size() - _snd.limited_transfer) / 2, 2 * smss);
+                        _snd.ssthresh = _cc->on_loss(_snd.cwnd, flight_size() - _snd.limited_transfer, smss, false, clock_type::now());
+                        _tcp._fast_retransmits++;
+                        _snd.high_rxt = _snd.unacknowledged + _snd.data.front().p.len();
                         fast_retransmit();
                     } else {
                         // Do not enter fast retransmit and do not reset ssthresh
                     }
-                    // RFC5681 Step 3.3
-                    _snd.cwnd = _snd.ssthresh + 3 * smss;
+                    if (sack_enabled()) {
+                        // RFC6675 Step 4.2, the rest of recovery is paced
+                        // by the pipe estimate instead of cwnd inflation
+                        _snd.cwnd = _snd.ssthresh;
+                        do_output_data = true;
+                    } else {
+                        // RFC5681 Step 3.3
+                        _snd.cwnd = _snd.ssthresh + 3 * smss;
+                    }
                 } else if (_snd.dupacks > 3) {
                     // RFC5681 Step 3.4
-                    _snd.cwnd += smss;
+                    if (!sack_enabled()) {
+                        _snd.cwnd += smss;
+                    }
                     // RFC5681 Step 3.5
                     do_output_data = true;
                 }
@@ -1442,6 +1810,12 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
                 update_window();
                 do_output_data = true;
             }
+            // RFC8985 Section 6.2, lost segments are told by the time
+            // rather than by the count of duplicate ACKs
+            if (rack_enabled() && rack_detect_loss() && _snd.dupacks < _dupthresh) {
+                rack_enter_recovery();
+                do_output_data = true;
+            }
         }
         // FIN_WAIT_1 STATE
         if (in_state(FIN_WAIT_1)) {
@@ -1505,6 +1879,8 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
             _rcv.next += seg_len;
             auto merged = merge_out_of_order();
             _rcv.window = get_modified_receive_window_size();
+            receive_rtt_measure(seg_len);
+            _ack_policy.on_data_received(steady_clock_type::now(), _rcv.window, _rcv.mss, _rto);
             signal_data_received();
             // Send an acknowledgment of the form:
             // <SEQ=SND.NXT><ACK=RCV.NXT><CTL=ACK>
@@ -1567,7 +1943,7 @@ void tcp<InetTraits>::tcb::input_handle_other_state(tcp_hdr* th, packet p) {
             }
         }
     }
-    if (do_output || (do_output_data && can_send())) {
+    if (do_output || (do_output_data && (can_send() || sack_next_retransmit()))) {
         // Since we will do output, we can canncel scheduled delayed ACK.
         clear_delayed_ack();
         output();
@@ -1587,7 +1963,8 @@ packet tcp<InetTraits>::tcb::get_transmit_packet() {
         // FIXME: Info tap device the size of the splitted packet
         len = _tcp.hw_features().max_packet_len - net::tcp_hdr_len_min - InetTraits::ip_hdr_len_min;
     } else {
-        len = std::min(uint16_t(_tcp.hw_features().mtu - net::tcp_hdr_len_min - InetTraits::ip_hdr_len_min), _snd.mss);
+        // Leave room for the SACK blocks
+        len = segment_payload_limit() - _option.get_size(false, true);
     }
     can_send = std::min(can_send, len);
     // easy case: one small packet
@@ -1624,17 +2001,24 @@ packet tcp<InetTraits>::tcb::get_transmit_packet() {
 }
 
 template <typename InetTraits>
-void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
+void tcp<InetTraits>::tcb::output_one(unacked_segment* retransmit_seg) {
     if (in_state(CLOSED)) {
         return;
     }
 
-    packet p = data_retransmit ? _snd.data.front().p.share() : get_transmit_packet();
+    bool data_retransmit = retransmit_seg;
+    update_local_sack_blocks();
+    packet p = data_retransmit ? retransmit_seg->p.share() : get_transmit_packet();
     packet clone = p.share();  // early clone to prevent share() from calling packet::unuse_internal_data() on header.
     uint16_t len = p.len();
     bool syn_on = syn_needs_on();
     bool ack_on = ack_needs_on();
 
+    if (data_retransmit && !_tcp.hw_features().tx_tso
+            && len + _option.get_size(syn_on, ack_on) > segment_payload_limit()) {
+        // The segment was sent with no room left for the SACK blocks
+        _option._nr_local_sack_blocks = 0;
+    }
     auto options_size = _option.get_size(syn_on, ack_on);
     auto th = p.prepend_uninitialized_header(tcp_hdr::len + options_size);
     auto h = tcp_hdr{};
@@ -1652,7 +2036,7 @@ void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
 
     tcp_seq seq;
     if (data_retransmit) {
-        seq = _snd.unacknowledged;
+        seq = retransmit_seg->seq;
     } else {
         seq = syn_on ? _snd.initial : _snd.next;
         _snd.next += len;
@@ -1660,7 +2044,8 @@ void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
     h.seq = seq;
     h.ack = _rcv.next;
     h.data_offset = (tcp_hdr::len + options_size) / 4;
-    h.window = _rcv.window >> _rcv.window_scale;
+    // RFC 7323, the window of a SYN is never scaled
+    h.window = syn_on ? std::min<uint32_t>(_rcv.window, 0xffff) : _rcv.window >> _rcv.window_scale;
     h.checksum = 0;
 
     // FIXME: does the FIN have to fit in the window?
@@ -1668,6 +2053,10 @@ void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
     h.f_fin = fin_on;
 
     // Add tcp options
+    if (_option._local_timestamps) {
+        _option._local_ts_val = timestamp_now();
+        _option._local_ts_ecr = _rcv.ts_recent;
+    }
     _option.fill(th, &h, options_size);
     h.write(th);
 
@@ -1690,7 +2079,7 @@ void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
         // CSUM offload case.
         //
         if (_tcp.hw_features().tx_tso && len > _snd.mss) {
-            oi.tso_seg_size = _snd.mss;
+            oi.tso_seg_size = _snd.mss - options_size;
         } else {
             pseudo_hdr_seg_len = tcp_hdr::len + options_size + len;
         }
@@ -1715,15 +2104,18 @@ void tcp<InetTraits>::tcb::output_one(bool data_retransmit) {
 
     p.set_offload_info(oi);
 
-    if (!data_retransmit && (len || syn_on || fin_on)) {
-        auto now = clock_type::now();
+    if (data_retransmit) {
+        retransmit_seg->tx_time = steady_clock_type::now();
+        retransmit_seg->lost = false;
+    } else if (len || syn_on || fin_on) {
         if (len) {
+            _ack_policy.on_data_sent(steady_clock_type::now());
             unsigned nr_transmits = 0;
             _snd.data.emplace_back(unacked_segment{std::move(clone),
-                                   len, nr_transmits, now});
+                                   len, nr_transmits, steady_clock_type::now(), seq});
         }
         if (!_retransmit.armed()) {
-            start_retransmit_timer(now);
+            start_retransmit_timer();
         }
     }
 
@@ -1797,9 +2189,16 @@ packet tcp<InetTraits>::tcb::read() {
     for (auto&& q : _rcv.data) {
         p.append(std::move(q));
     }
+    _rcv_space.on_consumed(_rcv.data_size, _rcv.mss, steady_clock_type::now());
     _rcv.data_size = 0;
     _rcv.data.clear();
+    auto window = _rcv.window;
     _rcv.window = get_default_receive_window_size();
+    // As Linux's tcp_cleanup_rbuf(), let the peer know when the window at
+    // least doubled, rather than leave it to probe a window which closed
+    if (_rcv.window > window && _rcv.window / 2 >= window && in_state(ESTABLISHED | FIN_WAIT_1 | FIN_WAIT_2)) {
+        output();
+    }
     return p;
 }
 
@@ -1865,6 +2264,13 @@ bool tcp<InetTraits>::tcb::should_send_ack(uint16_t seg_len) {
         return true;
     }
 
+    // Quick ACK mode, or the segment is of a connection in ping-pong mode
+    if (_ack_policy.take_quick_ack()) {
+        _nr_full_seg_received = 0;
+        _delayed_ack.cancel();
+        return true;
+    }
+
     // We've received a full sized segment, ack for every second full sized segment
     if (seg_len == _rcv.mss) {
         if (_nr_full_seg_received++ >= 1) {
@@ -1881,11 +2287,32 @@ bool tcp<InetTraits>::tcb::should_send_ack(uint16_t seg_len) {
 
     // If the timer is not armed, schedule a delayed ACK.
     // The maximum delayed ack timer allowed by RFC1122 is 500ms, most
-    // implementations use 200ms.
-    _delayed_ack.arm(200ms);
+    // implementations use 200ms, the default tcp_tuning::max_ack_delay.
+    _delayed_ack.arm(std::chrono::ceil<lowres_clock::duration>(_ack_policy.ack_timeout()));
     return false;
 }
 
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::receive_rtt_measure(uint32_t seg_len) {
+    auto now = steady_clock_type::now();
+    // The timestamp the peer echoes in a full sized segment is of an ACK
+    // which let it send the segment
+    if (_option._remote_ts_present && _option._remote_ts_ecr && seg_len >= _rcv.mss) {
+        auto rtt = std::chrono::microseconds(uint32_t(timestamp_now() - _option._remote_ts_ecr));
+        if (rtt.count() > 0 && rtt < _rto_max) {
+            _rcv_space.on_rtt_sample(rtt, false);
+        }
+    }
+    if (_rcv.rtt_start && _rcv.next < _rcv.rtt_seq) {
+        return;
+    }
+    if (_rcv.rtt_start) {
+        _rcv_space.on_rtt_sample(std::chrono::duration_cast<std::chrono::microseconds>(now - *_rcv.rtt_start), true);
+    }
+    _rcv.rtt_seq = _rcv.next + _rcv.window;
+    _rcv.rtt_start = now;
+}
+
 template <typename InetTraits>
 void tcp<InetTraits>::tcb::clear_delayed_ack() noexcept {
     _delayed_ack.cancel();
@@ -1931,9 +2358,252 @@ bool tcp<InetTraits>::tcb::merge_out_of_order() {
 
 template <typename InetTraits>
 void tcp<InetTraits>::tcb::insert_out_of_order(tcp_seq seg, packet p) {
+    _rcv.last_out_of_order = seg;
     _rcv.out_of_order.merge(seg, std::move(p));
 }
 
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::update_local_sack_blocks() {
+    auto& map = _rcv.out_of_order.map;
+    _option._nr_local_sack_blocks = 0;
+    if (!sack_enabled() || map.empty()) {
+        return;
+    }
+    auto add_block = [this] (const std::pair<const tcp_seq, packet>& seg) {
+        auto& block = _option._local_sack_blocks[_option._nr_local_sack_blocks++];
+        block = {seg.first.raw, (seg.first + seg.second.len()).raw};
+    };
+    // RFC2018: the first block reports the most recently received segment,
+    // the rest are the blocks closest to the highest received data
+    auto recent = map.upper_bound(_rcv.last_out_of_order);
+    if (recent != map.begin()) {
+        --recent;
+    }
+    add_block(*recent);
+    for (auto it = map.rbegin(); it != map.rend() && _option._nr_local_sack_blocks < _option.max_sack_blocks(); ++it) {
+        if (it->first != recent->first) {
+            add_block(*it);
+        }
+    }
+}
+
+template <typename InetTraits>
+bool tcp<InetTraits>::tcb::update_sack_scoreboard() {
+    bool sacked_new_data = false;
+    for (uint8_t i = 0; i < _option._nr_remote_sack_blocks; i++) {
+        auto left = make_seq(_option._remote_sack_blocks[i].first);
+        auto right = make_seq(_option._remote_sack_blocks[i].second);
+        // Ignore D-SACK blocks and the blocks beyond what was sent
+        if (right <= _snd.unacknowledged || right > _snd.next || left >= right) {
+            continue;
+        }
+        for (auto& seg : _snd.data) {
+            if (seg.seq >= right) {
+                break;
+            }
+            if (!seg.sacked && left <= seg.seq && seg.seq + seg.p.len() <= right) {
+                seg.sacked = true;
+                sacked_new_data = true;
+                rack_update(seg, steady_clock_type::now());
+            }
+        }
+    }
+    return sacked_new_data;
+}
+
+template <typename InetTraits>
+bool tcp<InetTraits>::tcb::sack_front_lost() const noexcept {
+    // RFC6675 IsLost()
+    uint32_t sacked_bytes = 0;
+    unsigned nr_sacked = 0;
+    for (auto& seg : _snd.data) {
+        if (seg.sacked) {
+            sacked_bytes += seg.p.len();
+            nr_sacked++;
+        }
+    }
+    return nr_sacked >= _dupthresh || sacked_bytes > (_dupthresh - 1) * _snd.mss;
+}
+
+template <typename InetTraits>
+auto tcp<InetTraits>::tcb::scan_sack_scoreboard() -> sack_scoreboard {
+    sack_scoreboard sb;
+    uint32_t sacked_above = 0;
+    unsigned nr_sacked_above = 0;
+    bool rack = rack_enabled();
+    for (auto it = _snd.data.rbegin(); it != _snd.data.rend(); ++it) {
+        auto& seg = *it;
+        uint32_t len = seg.p.len();
+        if (seg.sacked) {
+            sacked_above += len;
+            nr_sacked_above++;
+            continue;
+        }
+        if (rack) {
+            // RACK marks the losses itself, the rest is in flight
+            if (seg.lost) {
+                sb.lost = &seg;
+            } else {
+                sb.pipe += len;
+            }
+            continue;
+        }
+        bool lost = nr_sacked_above >= _dupthresh || sacked_above > (_dupthresh - 1) * _snd.mss;
+        bool retransmitted = seg.seq < _snd.high_rxt;
+        // RFC6675 SetPipe()
+        if (!lost) {
+            sb.pipe += len;
+        }
+        if (retransmitted) {
+            sb.pipe += len;
+        } else if (lost) {
+            sb.lost = &seg;
+        } else if (nr_sacked_above) {
+            sb.hole = &seg;
+        }
+    }
+    return sb;
+}
+
+template <typename InetTraits>
+auto tcp<InetTraits>::tcb::sack_next_retransmit() -> unacked_segment* {
+    if (_snd.dupacks < _dupthresh || !sack_enabled()) {
+        return nullptr;
+    }
+    // RFC6675 NextSeg()
+    auto sb = scan_sack_scoreboard();
+    if (sb.pipe + _snd.mss > _snd.cwnd) {
+        return nullptr;
+    }
+    if (sb.lost) {
+        return sb.lost;
+    }
+    // Holes not yet deemed lost only go when there is no new data to send
+    bool can_send_new = _snd.unsent_len && uint32_t(_snd.next - _snd.unacknowledged) < _snd.window;
+    return can_send_new ? nullptr : sb.hole;
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::sack_retransmit(unacked_segment& seg) {
+    seg.nr_transmits++;
+    _snd.high_rxt = seg.seq + seg.p.len();
+    _tcp._sack_retransmits++;
+    output_one(&seg);
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::rack_update(const unacked_segment& seg, steady_clock_type::time_point now) noexcept {
+    auto rtt = std::chrono::duration_cast<std::chrono::microseconds>(now - seg.tx_time);
+    // RFC8985 Section 6.2 Step 2, an ACK of the original transmission of a
+    // retransmitted segment comes too early to be for the retransmission
+    if (seg.nr_transmits && rtt < _rack.min_rtt) {
+        return;
+    }
+    _rack.min_rtt = std::min(_rack.min_rtt, rtt);
+    auto end_seq = seg.seq + seg.p.len();
+    if (!_rack.sampled || seg.tx_time > _rack.xmit_ts
+            || (seg.tx_time == _rack.xmit_ts && end_seq > _rack.end_seq)) {
+        _rack.sampled = true;
+        _rack.xmit_ts = seg.tx_time;
+        _rack.end_seq = end_seq;
+        _rack.rtt = rtt;
+    }
+}
+
+template <typename InetTraits>
+bool tcp<InetTraits>::tcb::rack_detect_loss() {
+    if (!_rack.sampled) {
+        return false;
+    }
+    // RFC8985 Section 6.2 Step 4, a static reordering window of min_rtt / 4
+    auto reo_wnd = _rack.min_rtt / 4;
+    auto now = steady_clock_type::now();
+    bool detected = false;
+    std::chrono::microseconds timeout{0};
+    for (auto& seg : _snd.data) {
+        if (seg.sacked || seg.lost) {
+            continue;
+        }
+        auto end_seq = seg.seq + seg.p.len();
+        bool sent_before = seg.tx_time < _rack.xmit_ts
+                || (seg.tx_time == _rack.xmit_ts && end_seq < _rack.end_seq);
+        if (!sent_before) {
+            continue;
+        }
+        auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(seg.tx_time + _rack.rtt + reo_wnd - now);
+        if (remaining.count() <= 0) {
+            seg.lost = true;
+            detected = true;
+            _tcp._rack_losses++;
+        } else {
+            timeout = std::max(timeout, remaining);
+        }
+    }
+    if (timeout.count()) {
+        _rack_timer.rearm(clock_type::now() + timeout);
+    }
+    return detected;
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::rack_enter_recovery() {
+    auto seg_ack = _snd.unacknowledged;
+    if (seg_ack - 1 > _snd.recover) {
+        _snd.recover = _snd.next - 1;
+        _snd.ssthresh = _cc->on_loss(_snd.cwnd, flight_size(), _snd.mss, false, clock_type::now());
+        _snd.cwnd = _snd.ssthresh;
+        _tcp._fast_retransmits++;
+    }
+    _snd.dupacks = _dupthresh;
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::rack_timeout() {
+    if (!rack_enabled() || !in_state(ESTABLISHED | CLOSE_WAIT | FIN_WAIT_1 | CLOSING | LAST_ACK)) {
+        return;
+    }
+    if (rack_detect_loss()) {
+        if (_snd.dupacks < _dupthresh) {
+            rack_enter_recovery();
+        }
+        output();
+    }
+}
+
+template <typename InetTraits>
+std::optional<std::chrono::microseconds> tcp<InetTraits>::tcb::probe_timeout() const noexcept {
+    // RFC8985 Section 7.2, a probe is scheduled when the connection has
+    // an RTT estimate and is not recovering from a loss already
+    if (!rack_enabled() || _snd.first_rto_sample || _snd.dupacks >= _dupthresh
+            || _rack.tlp_outstanding || _snd.data.empty()) {
+        return std::nullopt;
+    }
+    auto pto = 2 * _snd.srtt;
+    if (_snd.data.size() == 1) {
+        pto += _tcp._tuning.max_ack_delay;
+    }
+    return std::min(pto, _rto);
+}
+
+template <typename InetTraits>
+void tcp<InetTraits>::tcb::tail_loss_probe() {
+    // RFC8985 Section 7.3, send new data if the window allows, otherwise
+    // retransmit the most recently sent segment
+    _rack.tlp_outstanding = true;
+    _tcp._tail_loss_probes++;
+    if (_snd.unsent_len && can_send() > 0) {
+        _rack.tlp_is_retransmit = false;
+        output_one();
+    } else {
+        auto& seg = _snd.data.back();
+        seg.nr_transmits++;
+        _rack.tlp_is_retransmit = true;
+        output_one(&seg);
+    }
+    _rack.tlp_end_seq = _snd.next;
+    start_retransmit_timer();
+}
+
 template <typename InetTraits>
 void tcp<InetTraits>::tcb::trim_receive_data_after_window() {
     abort();
@@ -1989,6 +2659,10 @@ void tcp<InetTraits>::tcb::retransmit() {
         return;
     }
 
+    if (std::exchange(_pto_armed, false)) {
+        return tail_loss_probe();
+    }
+
     // If there are unacked data, retransmit the earliest segment
     auto& unacked_seg = _snd.data.front();
 
@@ -1996,14 +2670,26 @@ void tcp<InetTraits>::tcb::retransmit() {
     // Update ssthresh only for the first retransmit
     uint32_t smss = _snd.mss;
     if (unacked_seg.nr_transmits == 0) {
-        _snd.ssthresh = std::max(flight_size() / 2, 2 * smss);
+        _snd.ssthresh = _cc->on_loss(_snd.cwnd, flight_size(), smss, true, clock_type::now());
     }
+    _tcp._retransmit_timeouts++;
     // RFC6582 Step 4
     _snd.recover = _snd.next - 1;
+    // RFC2018: the receiver may have discarded the data it SACKed
+    clear_sack_scoreboard();
     // Start the slow start process
     _snd.cwnd = smss;
     // End fast recovery
     exit_fast_recovery();
+    _rack.tlp_outstanding = false;
+    if (rack_enabled()) {
+        // RFC8985 Section 6.3, everything in flight is lost and the
+        // scoreboard paces the retransmissions after the first one
+        for (auto& seg : _snd.data) {
+            seg.lost = true;
+        }
+        _snd.dupacks = _dupthresh;
+    }
 
     if (unacked_seg.nr_transmits < _max_nr_retransmit) {
         unacked_seg.nr_transmits++;
@@ -2028,9 +2714,9 @@ void tcp<InetTraits>::tcb::fast_retransmit() {
 }
 
 template <typename InetTraits>
-void tcp<InetTraits>::tcb::update_rto(clock_type::time_point tx_time) {
+void tcp<InetTraits>::tcb::update_rto(std::chrono::microseconds R) {
     // Update RTO according to RFC6298
-    auto R = std::chrono::duration_cast<std::chrono::milliseconds>(clock_type::now() - tx_time);
+    _cc->on_rtt_sample(R, clock_type::now());
     if (_snd.first_rto_sample) {
         _snd.first_rto_sample = false;
         // RTTVAR <- R/2
@@ -2048,22 +2734,14 @@ void tcp<InetTraits>::tcb::update_rto(clock_type::time_point tx_time) {
     // RTO <- SRTT + max(G, K * RTTVAR)
     _rto =  _snd.srtt + std::max(_rto_clk_granularity, 4 * _snd.rttvar);
 
-    // Make sure 1 sec << _rto << 60 sec
-    _rto = std::max(_rto, _rto_min);
+    // Make sure min_rto << _rto << 60 sec
+    _rto = std::max(_rto, _tcp._tuning.min_rto);
     _rto = std::min(_rto, _rto_max);
 }
 
 template <typename InetTraits>
 void tcp<InetTraits>::tcb::update_cwnd(uint32_t acked_bytes) {
-    uint32_t smss = _snd.mss;
-    if (_snd.cwnd < _snd.ssthresh) {
-        // In slow start phase
-        _snd.cwnd += std::min(acked_bytes, smss);
-    } else {
-        // In congestion avoidance phase
-        uint32_t round_up = 1;
-        _snd.cwnd += std::max(round_up, smss * smss / _snd.cwnd);
-    }
+    _cc->on_ack(_snd.cwnd, _snd.ssthresh, _snd.mss, acked_bytes, clock_type::now());
 }
 
 template <typename InetTraits>
@@ -2074,6 +2752,7 @@ void tcp<InetTraits>::tcb::cleanup() {
     _rcv.data_size = 0;
     _rcv.data.clear();
     stop_retransmit_timer();
+    _rack_timer.cancel();
     clear_delayed_ack();
     remove_from_tcbs();
 }
@@ -2086,13 +2765,13 @@ tcp_seq tcp<InetTraits>::tcb::get_isn() {
     //   M is the 4 microsecond timer
     using namespace std::chrono;
     uint32_t hash[4];
-    hash[0] = _local_ip.ip;
-    hash[1] = _foreign_ip.ip;
-    hash[2] = (_local_port << 16) + _foreign_port;
+    uint32_t ports = (_local_port << 16) + _foreign_port;
     gnutls_hash_hd_t md5_hash_handle;
     // GnuTLS digests do not init at all, so this should never fail.
     gnutls_hash_init(&md5_hash_handle, GNUTLS_DIG_MD5);
-    gnutls_hash(md5_hash_handle, hash, 3 * sizeof(hash[0]));
+    gnutls_hash(md5_hash_handle, &_local_ip, sizeof(_local_ip));
+    gnutls_hash(md5_hash_handle, &_foreign_ip, sizeof(_foreign_ip));
+    gnutls_hash(md5_hash_handle, &ports, sizeof(ports));
     gnutls_hash(md5_hash_handle, _isn_secret.key, sizeof(_isn_secret.key));
     // reuse "hash" for the output of digest
     SEASTAR_ASSERT(sizeof(hash) == gnutls_hash_get_len(GNUTLS_DIG_MD5));
@@ -2107,7 +2786,11 @@ template <typename InetTraits>
 std::optional<typename InetTraits::l4packet> tcp<InetTraits>::tcb::get_packet() {
     _poll_active = false;
     if (_packetq.empty()) {
-        output_one();
+        if (auto seg = sack_next_retransmit()) {
+            sack_retransmit(*seg);
+        } else {
+            output_one();
+        }
     }
 
     if (in_state(CLOSED)) {
@@ -2118,10 +2801,12 @@ std::optional<typename InetTraits::l4packet> tcp<InetTraits>::tcb::get_packet()
 
     auto p = std::move(_packetq.front());
     _packetq.pop_front();
-    if (!_packetq.empty() || (_snd.dupacks < 3 && can_send() > 0 && (_snd.window > 0))) {
+    if (!_packetq.empty() || ((_snd.dupacks < 3 || sack_enabled()) && can_send() > 0 && (_snd.window > 0))
+            || sack_next_retransmit()) {
         // If there are packets to send in the queue or tcb is allowed to send
         // more add tcp back to polling set to keep sending. In addition, dupacks >= 3
-        // is an indication that an segment is lost, stop sending more in this case.
+        // is an indication that an segment is lost, stop sending more in this case
+        // unless the SACK scoreboard tells what is still in flight.
         // Finally - we can't send more until window is opened again.
         output();
     }
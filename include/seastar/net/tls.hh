@@ -22,14 +22,18 @@
 
 #ifndef SEASTAR_MODULE
 #include <functional>
+#include <optional>
 #include <unordered_set>
 #include <map>
 #include <any>
+#include <span>
+#include <vector>
 #include <fmt/format.h>
 #endif
 
 #include <seastar/core/future.hh>
 #include <seastar/core/internal/api-level.hh>
+#include <seastar/core/scheduling.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/net/socket_defs.hh>
@@ -50,10 +54,11 @@ class socket_address;
  * Relatively thin SSL wrapper for socket IO.
  * (Can be expanded to other IO forms).
  *
- * The current underlying mechanism is
- * gnutls, however, all interfaces are kept
- * agnostic, so in theory it could be replaced
- * with OpenSSL or similar.
+ * The underlying mechanism is gnutls, or
+ * OpenSSL when built with Seastar_WITH_OSSL.
+ * All interfaces are kept agnostic of it,
+ * except for the syntax of priority strings
+ * and the values of error codes.
  *
  */
 SEASTAR_MODULE_EXPORT
@@ -157,6 +162,33 @@ namespace tls {
      */
     using dn_callback = noncopyable_function<void(session_type type, sstring subject, sstring issuer)>;
 
+    /**
+     * Controls the cache of client sessions,
+     * see certificate_credentials::set_client_session_cache
+     */
+    struct client_session_cache_options {
+        /// Maximum number of servers to keep a session of, the least
+        /// recently used ones are evicted first. Zero disables the cache.
+        size_t max_entries = 256;
+        /// If not empty, cache metrics are exported with this
+        /// name as the "credentials" label. It must not be used by the
+        /// session caches of other credentials of the shard.
+        sstring metrics_name;
+    };
+
+    struct client_session_cache_stats {
+        /// connections that found a session to resume in the cache
+        uint64_t hits = 0;
+        /// connections that didn't
+        uint64_t misses = 0;
+        /// client handshakes that resumed a session
+        uint64_t resumed_handshakes = 0;
+        /// client handshakes that didn't
+        uint64_t full_handshakes = 0;
+        /// servers with a session in the cache
+        uint64_t entries = 0;
+    };
+
     /**
      * Holds certificates and keys.
      *
@@ -193,6 +225,8 @@ namespace tls {
         /**
          * TLS handshake priority string. See gnutls docs and syntax at
          * https://gnutls.org/manual/html_node/Priority-Strings.html
+         * With the OpenSSL backend, this is a cipher list instead, see
+         * https://docs.openssl.org/3.0/man1/openssl-ciphers/
          *
          * Allows specifying order and allowance for handshake alg.
          */
@@ -226,6 +260,40 @@ namespace tls {
          */
         void set_enable_certificate_verification(bool enable);
 
+        /**
+         * Offload record encryption of sessions using these credentials to
+         * the kernel (kTLS), once the handshake is done. Sent data is then
+         * written to the socket as is, without being copied into user space
+         * TLS records. Only works over the posix network stack, on kernels
+         * with the "tls" module, for AES-GCM and ChaCha20-Poly1305 ciphers
+         * in TLS 1.2 and 1.3; other sessions silently keep encrypting in
+         * user space. Received data is always decrypted in user space.
+         * Not supported by the OpenSSL backend, with which enabling it
+         * throws std::invalid_argument.
+         */
+        void set_kernel_tls(bool enable);
+
+        /**
+         * Keeps the sessions of the client connections using these
+         * credentials, by server name (tls_options::server_name), to
+         * resume the next connection to the same server with, instead of
+         * running a full handshake. Only sessions the server issued a
+         * TLS 1.3 ticket for are kept, when their connection is closed,
+         * and each is used once, as tickets are meant to be. Connections
+         * given tls_options::session_resume_data, or no server name,
+         * don't use the cache.
+         *
+         * Like the credentials, the cache belongs to a shard. It is kept
+         * when reloadable credentials are rebuilt.
+         */
+        void set_client_session_cache(const client_session_cache_options&);
+
+        /**
+         * Returns the counters of the client session cache, all zero
+         * unless set_client_session_cache() was called
+         */
+        client_session_cache_stats get_client_session_cache_stats() const;
+
     private:
         class impl;
         friend class session;
@@ -255,6 +323,33 @@ namespace tls {
         NONE, TLS13_SESSION_TICKET
     };
 
+    /**
+     * Controls how the handshakes of server sessions are run,
+     * see server_credentials::set_handshake_options
+     */
+    struct handshake_options {
+        /// Scheduling group to run the handshakes in, so that a burst of
+        /// them doesn't starve request processing. By default handshakes
+        /// run in the group of whoever first uses the connection.
+        std::optional<scheduling_group> sched_group;
+        /// Maximum number of handshakes in progress at once per shard,
+        /// the others wait for their turn. Zero means no limit.
+        size_t max_concurrent = 0;
+        /// If not empty, handshake metrics are exported with this
+        /// name as the "credentials" label. It must not be used by the
+        /// handshake options of other credentials of the shard.
+        sstring metrics_name;
+    };
+
+    struct handshake_stats {
+        uint64_t completed = 0;
+        uint64_t failed = 0;
+        /// handshakes waiting for their turn
+        uint64_t waiting = 0;
+        /// handshakes in progress
+        uint64_t active = 0;
+    };
+
     /**
      * Extending certificates and keys for server usage.
      * More probably goes in here...
@@ -281,13 +376,44 @@ namespace tls {
         */
         void set_session_resume_mode(session_resume_mode);
 
+        /**
+         * Sets session resume mode using the given session ticket key
+         * (see generate_session_resume_key()) instead of a new one.
+         * Credentials sharing a key accept each other's tickets, which
+         * is what lets a client resume on whichever shard it reconnects to.
+        */
+        void set_session_resume_mode(session_resume_mode, std::span<const uint8_t> key);
+
         /**
          * Sets Application-Layer Protocol Name (ALPN) supported by the server,
          * in preference order.
          */
         void set_alpn_protocols(const std::vector<sstring>& protocols);
+
+        /**
+         * Sets the scheduling group and the concurrency limit of the
+         * handshakes of sessions using these credentials. Sessions that
+         * already started keep the previous options. The options are kept
+         * when reloadable credentials are rebuilt.
+         *
+         * \throws std::invalid_argument if the metrics name is used by
+         *         other credentials of this shard
+         */
+        void set_handshake_options(const handshake_options&);
+
+        /**
+         * Returns the handshake counters, all zero unless
+         * set_handshake_options() was called
+         */
+        handshake_stats get_handshake_stats() const;
     };
 
+    /**
+     * Generates a new random session ticket key, to be given to
+     * server_credentials::set_session_resume_mode()
+     */
+    std::vector<uint8_t> generate_session_resume_key();
+
     class reloadable_credentials_base;
     class credentials_builder;
 
@@ -329,6 +455,10 @@ namespace tls {
          * simply call this method again to regenerate the key.
          */
         void set_session_resume_mode(session_resume_mode);
+        /**
+         * Same as above, but uses the given session ticket key.
+         */
+        void set_session_resume_mode(session_resume_mode, std::span<const uint8_t> key);
 
         /**
          * Sets Application-Layer Protocol Name (ALPN) supported by the server,
@@ -336,6 +466,11 @@ namespace tls {
          */
         void set_alpn_protocols(const std::vector<sstring>& protocols);
 
+        /**
+         * Enables kernel TLS offload, see certificate_credentials::set_kernel_tls
+         */
+        void set_kernel_tls(bool enable);
+
         void apply_to(certificate_credentials&) const;
 
         shared_ptr<certificate_credentials> build_certificate_credentials() const;
@@ -354,12 +489,15 @@ namespace tls {
     private:
         friend class reloadable_credentials_base;
 
+        void rotate_session_resume_key();
+
         std::multimap<sstring, std::any> _blobs;
         client_auth _client_auth = client_auth::NONE;
         session_resume_mode _session_resume_mode = session_resume_mode::NONE;
         sstring _priority;
         std::vector<uint8_t> _session_resume_key;
         std::vector<sstring> _alpn_protocols;
+        bool _kernel_tls = false;
     };
 
     using session_data = std::vector<uint8_t>;
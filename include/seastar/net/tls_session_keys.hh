@@ -0,0 +1,74 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/gate.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/net/tls.hh>
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT
+namespace tls {
+
+/**
+ * Keeps the TLS 1.3 session ticket key of server credentials in sync across shards.
+ *
+ * Each shard normally has its own server_credentials, and unless they were built
+ * from one credentials_builder, each gets its own ticket key. A client that
+ * reconnects to another shard then can't resume its session and pays for a
+ * full handshake.
+ *
+ * Run this as sharded<session_resume_keys> and add() the server credentials of
+ * every shard to the local instance. They all get the same key, and rotate()
+ * replaces it on all shards together. If constructed with a rotation period,
+ * the instance start() was called on also rotates the key periodically.
+ */
+class session_resume_keys : public peering_sharded_service<session_resume_keys> {
+    lowres_clock::duration _period;
+    std::vector<uint8_t> _key;
+    std::vector<shared_ptr<server_credentials>> _creds;
+    timer<lowres_clock> _timer;
+    gate _gate;
+
+    void set_key(const std::vector<uint8_t>& key);
+public:
+    explicit session_resume_keys(lowres_clock::duration rotation_period = lowres_clock::duration::zero());
+
+    /// Generates the first key on all shards and starts the periodic rotation,
+    /// if any. Must be called on one shard only.
+    future<> start();
+    future<> stop();
+
+    /// Makes \p creds use the shared key, now and after each rotation
+    void add(shared_ptr<server_credentials> creds);
+
+    /// Replaces the key on all shards. Tickets issued before can't be used anymore.
+    future<> rotate();
+};
+
+}
+
+}
@@ -64,6 +64,13 @@ struct virtio_options : public program_options::option_group {
 
 /// \cond internal
 std::unique_ptr<net::device> create_virtio_net_device(const net::virtio_options& opts, const program_options::value<std::string>& lro);
+
+namespace virtio {
+
+// The offloads of hw that the features negotiated with the host allow
+net::hw_features negotiated_hw_features(net::hw_features hw, uint64_t features) noexcept;
+
+}
 /// \endcond
 
 }
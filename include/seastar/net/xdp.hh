@@ -0,0 +1,71 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <memory>
+#endif
+#include <seastar/net/net.hh>
+#include <seastar/util/program-options.hh>
+
+namespace seastar {
+
+namespace net {
+
+/// AF_XDP configuration.
+///
+/// Every shard owning a hardware queue binds an AF_XDP socket to the queue
+/// with the same index. The XDP program redirecting the packets to the
+/// sockets is loaded separately (e.g. with \c xdp-loader) and has to pin
+/// its \c XSKMAP, the sockets are inserted there by their queue index.
+struct xdp_options : public program_options::option_group {
+    /// \brief Network interface to use with AF_XDP.
+    ///
+    /// Selects the AF_XDP backend of the native stack when set.
+    program_options::value<std::string> xdp_device;
+    /// \brief Path of the pinned \c XSKMAP of the XDP program.
+    ///
+    /// Default: \p /sys/fs/bpf/xsks_map.
+    program_options::value<std::string> xdp_xskmap;
+    /// \brief Size of the AF_XDP rings (must be power-of-two).
+    ///
+    /// Default: 1024.
+    program_options::value<unsigned> xdp_ring_size;
+    /// \brief Use the zero-copy mode of the driver (on / off).
+    ///
+    /// Falls back to the copy mode when the driver doesn't support it.
+    ///
+    /// Default: \p on.
+    program_options::value<std::string> xdp_zero_copy;
+
+    /// \cond internal
+    xdp_options(program_options::option_group* parent_group);
+    /// \endcond
+};
+
+}
+
+/// \cond internal
+std::unique_ptr<net::device> create_xdp_net_device(const net::xdp_options& opts);
+/// \endcond
+
+}
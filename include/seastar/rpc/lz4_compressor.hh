@@ -34,6 +34,8 @@ namespace rpc {
             virtual const sstring& supported() const override;
             virtual std::unique_ptr<rpc::compressor> negotiate(sstring feature, bool is_server) const override;
         };
+    private:
+        lw_shared_ptr<const compression_dictionary> _dict;
     public:
         ~lz4_compressor() {}
         // compress data, leaving head_space empty in returned buffer
@@ -41,6 +43,7 @@ namespace rpc {
         // decompress data
         rcv_buf decompress(rcv_buf data) override;
         sstring name() const override;
+        bool use_dictionary(lw_shared_ptr<const compression_dictionary> dict) override;
     };
 }
 
@@ -23,10 +23,12 @@
 
 #include <unordered_map>
 #include <unordered_set>
+#include <deque>
 #include <list>
 #include <variant>
 #include <boost/intrusive/list.hpp>
 #include <seastar/core/future.hh>
+#include <seastar/core/preallocated_exception.hh>
 #include <seastar/core/seastar.hh>
 #include <seastar/net/api.hh>
 #include <seastar/core/iostream.hh>
@@ -37,8 +39,10 @@
 #include <seastar/core/byteorder.hh>
 #include <seastar/core/shared_future.hh>
 #include <seastar/core/queue.hh>
+#include <seastar/core/timer-set.hh>
 #include <seastar/core/weak_ptr.hh>
 #include <seastar/core/scheduling.hh>
+#include <seastar/core/tracing.hh>
 #include <seastar/util/backtrace.hh>
 #include <seastar/util/log.hh>
 
@@ -111,14 +115,40 @@ struct client_options {
     bool tcp_nodelay = true;
     bool reuseaddr = false;
     compressor::factory* compressor_factory = nullptr;
+    /// Dictionaries the compressor may use, dictionaries sent by servers
+    /// during negotiation are added to it. Must outlive the client.
+    compression_dictionary_registry* compression_dictionaries = nullptr;
     bool send_timeout_data = true;
+    /// Tells the server when a request times out or is cancelled, so that
+    /// its handler can be abandoned, see \ref client_info::request_abort_source()
+    bool send_cancellation = true;
+    /// Sends the tracing context current when a request is made along with
+    /// it, so that its handler runs in a span child of it, see
+    /// \ref tracing::with_span()
+    bool send_trace_context = true;
     connection_id stream_parent = invalid_connection_id;
     /// Configures how this connection is isolated from other connection on the same server.
     ///
     /// \see resource_limits::isolate_connection
     sstring isolation_cookie;
+    /// Metrics of the clients are aggregated per domain, including the
+    /// per-verb round trip latency histograms
     sstring metrics_domain = "default";
     bool send_handler_duration = true;
+    /// Number of connections the client stripes its requests over.
+    ///
+    /// Requests of at least \ref large_request_size bytes are kept off the
+    /// first connection, so that they don't delay the small ones, and all
+    /// requests prefer the connections with fewer large requests in flight
+    /// and then the least loaded ones. All connections share the options,
+    /// including the isolation cookie. Calls passing or returning streams
+    /// always use the first connection.
+    unsigned connections = 1;
+    /// Serialized size from which a request is routed as a large one
+    size_t large_request_size = 64 * 1024;
+    /// Creates the sockets of the additional connections, make_socket()
+    /// is used when not set.
+    std::function<socket ()> socket_factory;
 };
 
 /// @}
@@ -151,6 +181,9 @@ class server;
 
 struct server_options {
     compressor::factory* compressor_factory = nullptr;
+    /// The current dictionary of the registry is offered to the clients
+    /// that support dictionaries. Must outlive the server.
+    const compression_dictionary_registry* compression_dictionaries = nullptr;
     bool tcp_nodelay = true;
     std::optional<streaming_domain_type> streaming_domain;
     server_socket::load_balancing_algorithm load_balancing_algorithm = server_socket::load_balancing_algorithm::default_;
@@ -159,6 +192,9 @@ struct server_options {
     // Returning false will refuse the incoming connection.
     // Returning true will allow the mechanism to proceed.
     std::function<bool(const socket_address&)> filter_connection = {};
+    /// The per-verb latency histograms of the servers are aggregated per
+    /// domain
+    sstring metrics_domain = "default";
 };
 
 /// @}
@@ -181,8 +217,29 @@ enum class protocol_features : uint32_t {
     STREAM_PARENT = 3,
     ISOLATION = 4,
     HANDLER_DURATION = 5,
+    COMPRESSION_DICTIONARY = 6,
+    CANCEL = 7,
+    TRACE_CONTEXT = 8,
+    STREAM_FLOW_CONTROL = 9,
 };
 
+// Verb of the frames that cancel the request with their message id, once
+// protocol_features::CANCEL is negotiated
+constexpr uint64_t cancel_verb = std::numeric_limits<uint64_t>::max();
+// Verb of the frames that carry the tracing context of the request with
+// their message id, which they precede, once protocol_features::TRACE_CONTEXT
+// is negotiated
+constexpr uint64_t trace_context_verb = cancel_verb - 1;
+// Once protocol_features::STREAM_FLOW_CONTROL is negotiated, with the size of
+// the receive window of each side as its le32 data, a stream frame is charged
+// min(length, window) bytes of credit, which the receiver grants back as its
+// source consumes the elements. Besides the frames of an element and the end
+// of stream (-1U), stream frames with the length below grant le32 bytes of
+// credit, and those whose length has the flag below set carry a batch of
+// elements, each framed as on its own.
+constexpr uint32_t stream_credit_frame = -2U;
+constexpr uint32_t stream_batch_flag = uint32_t(1) << 31;
+
 // internal representation of feature data
 using feature_map = std::map<protocol_features, sstring>;
 
@@ -275,6 +332,9 @@ class connection {
     bool _propagate_timeout = false;
     bool _timeout_negotiated = false;
     bool _handler_duration_negotiated = false;
+    bool _cancel_negotiated = false;
+    bool _trace_context_negotiated = false;
+    bool _stream_flow_control = false;
     // stream related fields
     bool _is_stream = false;
     connection_id _id = invalid_connection_id;
@@ -282,11 +342,18 @@ class connection {
     std::unordered_map<connection_id, xshard_connection_ptr> _streams;
     queue<rcv_buf> _stream_queue = queue<rcv_buf>(max_queued_stream_buffers);
     semaphore _stream_sem = semaphore(max_stream_buffers_memory);
+    // Bytes of frames the peer is ready to receive, and its receive window,
+    // once _stream_flow_control is negotiated
+    semaphore _stream_credits = semaphore(0);
+    size_t _stream_window = 0;
+    // Resolves once the last frame passed to send_stream() got its credits
+    future<> _stream_send_ready = make_ready_future<>();
     bool _sink_closed = true;
     bool _source_closed = true;
     // the future holds if sink is already closed
     // if it is not ready it means the sink is been closed
     future<bool> _sink_closed_future = make_ready_future<bool>(false);
+    deleter* _unmarshal_pin = nullptr;
 
     void set_negotiated() noexcept;
 
@@ -305,7 +372,12 @@ class connection {
     }
     future<> stream_close();
     future<> stream_process_incoming(rcv_buf&&);
+    future<> stream_process_batch(rcv_buf&&);
     future<> handle_stream_frame();
+    void negotiate_stream_flow_control(const sstring& window);
+    // Sends the frame of stream elements once the peer has credit for it
+    future<> send_stream(snd_buf frame);
+    void grant_stream_credits(size_t credits);
 
 public:
     connection(connected_socket&& fd, const logger& l, void* s, connection_id id = invalid_connection_id) : connection(l, s, id) {
@@ -359,6 +431,15 @@ class connection {
         return *static_cast<Serializer*>(_serializer);
     }
 
+    // Pins the buffers of the message being unmarshalled, so that
+    // borrowed_buffer arguments can share them; null outside of unmarshall()
+    deleter* unmarshal_pin() const noexcept {
+        return _unmarshal_pin;
+    }
+    void set_unmarshal_pin(deleter* pin) noexcept {
+        _unmarshal_pin = pin;
+    }
+
     template <typename FrameType>
     future<typename FrameType::return_type> read_frame(socket_address info, input_stream<char>& in);
 
@@ -389,14 +470,35 @@ template<typename Serializer, typename... Out>
 class sink_impl : public sink<Out...>::impl {
     // Used on the shard *this lives on.
     alignas (cache_line_size) uint64_t _next_seq_num = 1;
+    // Set once flow control was negotiated, which is before sinks are made.
+    // The elements of _batch are then sent together in a frame by
+    // flush_batch().
+    bool _batching;
+    std::vector<temporary_buffer<char>> _batch;
+    size_t _batch_size = 0;
+    unsigned _batch_elements = 0;
+    timer<> _flush_timer;
 
     // Used on the shard the _conn lives on.
     struct alignas (cache_line_size) {
         uint64_t last_seq_num = 0;
         std::map<uint64_t, deferred_snd_buf> out_of_order_bufs;
     } _remote_state;
+
+    // Sends a frame to the shard of the connection, resolving once there is
+    // memory for it
+    future<> send_frame(snd_buf data);
+    future<> flush_batch();
 public:
-    sink_impl(xshard_connection_ptr con) : sink<Out...>::impl(std::move(con)) { this->_con->get()->_sink_closed = false; }
+    sink_impl(xshard_connection_ptr con)
+        : sink<Out...>::impl(std::move(con))
+        , _batching(this->_con->get()->_stream_flow_control)
+        , _flush_timer([this] {
+            // the error is kept in _ex
+            (void)flush_batch().handle_exception([] (std::exception_ptr) {});
+        }) {
+        this->_con->get()->_sink_closed = false;
+    }
     future<> operator()(const Out&... args) override;
     future<> close() override;
     future<> flush() override;
@@ -413,11 +515,12 @@ class source_impl : public source<In...>::impl {
 
 class client : public rpc::connection, public weakly_referencable<client> {
     socket _socket;
+    // Generation of the messages no reply is awaited to, see reply_slot
     id_type _message_id = 1;
     struct reply_handler_base {
-        timer<rpc_clock_type> t;
         cancellable* pcancel = nullptr;
         rpc_clock_type::time_point start;
+        uint64_t verb = 0;
         virtual void operator()(client&, id_type, rcv_buf data) = 0;
         virtual void timeout() {}
         virtual void cancel() {}
@@ -445,6 +548,7 @@ class client : public rpc::connection, public weakly_referencable<client> {
     public:
         metrics(const client&);
         ~metrics();
+        void account_round_trip(uint64_t verb, rpc_clock_type::duration latency);
     };
 
     void enqueue_zero_frame();
@@ -459,7 +563,7 @@ class client : public rpc::connection, public weakly_referencable<client> {
         }
         virtual void timeout() override {
             reply.done = true;
-            reply.p.set_exception(timeout_error());
+            reply.p.set_exception(preallocated_exception<timeout_error>());
         }
         virtual void cancel() override {
             reply.done = true;
@@ -468,10 +572,43 @@ class client : public rpc::connection, public weakly_referencable<client> {
         virtual ~reply_handler() {}
     };
 private:
-    std::unordered_map<id_type, std::unique_ptr<reply_handler_base>> _outstanding;
+    // The calls awaiting a reply wait in slots, which are reused through a
+    // free list. The message ID of such a call is made of the number of its
+    // slot, in the low slot_bits, and of a generation the slot gets every
+    // time it is reused, so that a reply finds its call with no lookup and a
+    // late reply to the call the slot held before is told apart. Slot 0
+    // stands for the messages no reply is awaited to. The deadlines of all
+    // calls share a timer_set, and a single timer armed to the earliest one.
+    static constexpr unsigned slot_bits = 24;
+    static constexpr id_type slot_mask = (id_type(1) << slot_bits) - 1;
+    static constexpr id_type generation_mask = (id_type(1) << (63 - slot_bits)) - 1;
+    struct reply_slot {
+        using time_point = rpc_clock_type::time_point;
+        using duration = rpc_clock_type::duration;
+        std::unique_ptr<reply_handler_base> handler;
+        time_point deadline;
+        boost::intrusive::list_member_hook<> link;
+        // of the call in the slot, 0 while the slot is free
+        id_type id = 0;
+        id_type generation = 0;
+        uint32_t next_free = 0;
+        bool timed = false;
+        time_point get_timeout() const noexcept { return deadline; }
+        // Only ~timer_set() calls it, and ~client() empties the set first
+        void cancel() noexcept {}
+    };
+    // Slot n is at n - 1
+    std::deque<reply_slot> _reply_slots;
+    uint32_t _free_reply_slot = 0;
+    size_t _waiting_replies = 0;
+    timer_set<reply_slot, &reply_slot::link> _reply_timeouts;
+    timer<rpc_clock_type> _reply_timer{[this] { expire_replies(); }};
     socket_address _server_addr, _local_addr;
     client_options _options;
     weak_ptr<client> _parent; // for stream clients
+    // Additional connections when client_options::connections > 1
+    std::vector<std::unique_ptr<client>> _stripes;
+    unsigned _large_requests = 0;
 
     metrics _metrics;
 
@@ -484,6 +621,15 @@ class client : public rpc::connection, public weakly_referencable<client> {
     // - message payload
     future<std::tuple<int64_t, std::optional<uint32_t>, std::optional<rcv_buf>>>
     read_response_frame_compressed(input_stream<char>& in);
+    // Tells the server that the reply to the request is not awaited anymore
+    void send_cancel(id_type id);
+    // Tells the server the tracing context of the request sent next
+    void send_trace_context(id_type id, const tracing::trace_context& ctx);
+    // Frees the slot of the call, returning its handler, or nullptr if the
+    // call doesn't wait anymore
+    std::unique_ptr<reply_handler_base> take_reply_handler(id_type id) noexcept;
+    void clear_reply_slots() noexcept;
+    void expire_replies();
 public:
     /**
      * Create client object which will attempt to connect to the remote address.
@@ -508,15 +654,25 @@ class client : public rpc::connection, public weakly_referencable<client> {
      */
     client(const logger& l, void* s, socket socket, const socket_address& addr, const socket_address& local = {});
     client(const logger& l, void* s, client_options options, socket socket, const socket_address& addr, const socket_address& local = {});
+    ~client();
 
     stats get_stats() const;
     size_t incoming_queue_length() const noexcept {
-        return _outstanding.size();
+        return _waiting_replies;
     }
 
-    auto next_message_id() { return _message_id++; }
+    /// ID of a message no reply is awaited to
+    id_type next_message_id() noexcept {
+        auto id = _message_id << slot_bits;
+        _message_id = std::max<id_type>((_message_id + 1) & generation_mask, 1);
+        return id;
+    }
+    /// ID of a call, with a slot reserved for wait_for_reply()
+    id_type reserve_reply_slot();
+    /// Connection a request of the given serialized size is sent on, this
+    /// client itself unless it is striped
+    client& pick_connection(size_t request_size) noexcept;
     void wait_for_reply(id_type id, std::unique_ptr<reply_handler_base>&& h, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel);
-    void wait_timed_out(id_type id);
     future<> stop() noexcept;
     void abort_all_streams();
     void deregister_this_stream();
@@ -540,6 +696,7 @@ class client : public rpc::connection, public weakly_referencable<client> {
             o.stream_parent = this->get_connection_id();
             o.send_timeout_data = false;
             o.metrics_domain += "_stream";
+            o.connections = 1;
             auto c = make_shared<client>(_logger, _serializer, o, std::move(socket), _server_addr, _local_addr);
             c->_parent = this->weak_from_this();
             c->_is_stream = true;
@@ -572,12 +729,24 @@ class protocol_base;
 class server {
 private:
     static thread_local std::unordered_map<streaming_domain_type, server*> _servers;
+    struct metrics_domain;
 
 public:
     class connection : public rpc::connection, public enable_shared_from_this<connection> {
         client_info _info;
         connection_id _parent_id = invalid_connection_id;
         std::optional<isolation_config> _isolation_config;
+        // Requests whose handlers took a client_info and are running
+        struct running_request {
+            abort_source as;
+            timer<rpc_clock_type> deadline;
+        };
+        std::unordered_map<int64_t, std::unique_ptr<running_request>> _running_requests;
+        // The context of the trace_context_verb frame just read, with the
+        // message id of the request it is for
+        std::optional<std::pair<int64_t, tracing::trace_context>> _next_trace_context;
+        // Contexts of the requests waiting for their handler to run
+        std::unordered_map<int64_t, tracing::trace_context> _trace_contexts;
     private:
         future<> negotiate_protocol();
         future<std::tuple<std::optional<uint64_t>, uint64_t, int64_t, std::optional<rcv_buf>>>
@@ -620,6 +789,13 @@ class server {
         }
         future<> deregister_this_stream();
         future<> abort_all_streams();
+        /// @private
+        abort_source& start_request(int64_t msg_id, std::optional<rpc_clock_type::time_point> timeout);
+        /// @private
+        void finish_request(int64_t msg_id) noexcept;
+        void abort_request(int64_t msg_id) noexcept;
+        /// @private
+        std::optional<tracing::trace_context> take_trace_context(int64_t msg_id) noexcept;
     };
 private:
     protocol_base& _proto;
@@ -630,6 +806,7 @@ class server {
     promise<> _ss_stopped;
     gate _reply_gate;
     server_options _options;
+    metrics_domain& _metrics_domain;
     bool _shutdown = false;
     uint64_t _next_client_id = 1;
 
@@ -675,6 +852,10 @@ class server {
     gate& reply_gate() {
         return _reply_gate;
     }
+    // Time a request of the verb waited for the resource_limits semaphore
+    void account_queue_time(uint64_t verb, rpc_clock_type::duration latency);
+    // Time the handler of the verb took to produce a reply
+    void account_handler_duration(uint64_t verb, rpc_clock_type::duration latency);
     friend connection;
     friend client;
 };
@@ -893,6 +1074,29 @@ class protocol final : public protocol_base {
     template <typename Func>
     auto register_handler(MsgType t, scheduling_group sg, Func&& func);
 
+    /// Register a handler whose invocations go through an execution stage.
+    ///
+    /// Works like register_handler(), except that the messages admitted for
+    /// the verb (unmarshalling, the handler call and marshalling of the
+    /// reply) are processed by an \ref inheriting_concrete_execution_stage.
+    /// Bursts of messages for the verb are thus handled in batches, with
+    /// better instruction cache locality. The stage keeps the scheduling
+    /// group of the message (see isolation_config) and reports the usual
+    /// execution stage metrics, labeled by \c stage_name and the
+    /// scheduling group: the average batch size of the verb is
+    /// \c function_calls_executed over \c tasks_scheduled.
+    ///
+    /// \param t the verb to register the handler for.
+    /// \param stage_name the name of the execution stage, must be unique.
+    /// \param sg the scheduling group that will be used to invoke the handler
+    ///     in, see register_handler().
+    /// \param func the callable to be called when the verb is invoked by the
+    ///     remote.
+    ///
+    /// \returns a client, see register_handler().
+    template <typename Func>
+    auto register_staged_handler(MsgType t, sstring stage_name, scheduling_group sg, Func&& func);
+
     /// Unregister the handler for the verb.
     ///
     /// Waits for all currently running handlers, then unregisters the handler.
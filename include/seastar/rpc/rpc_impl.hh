@@ -20,12 +20,14 @@
  */
 #pragma once
 
+#include <seastar/core/execution_stage.hh>
 #include <seastar/core/format.hh>
 #include <seastar/core/function_traits.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/when_all.hh>
 #include <seastar/util/assert.hh>
+#include <seastar/util/defer.hh>
 #include <seastar/util/is_smart_ptr.hh>
 #include <seastar/core/simple-stream.hh>
 #include <seastar/net/packet-data-source.hh>
@@ -53,6 +55,23 @@ struct remove_optional<optional<T>> {
 
 struct wait_type {}; // opposite of no_wait_type
 
+// Streams belong to the connection that created them, so calls that pass
+// or return them are not striped over the connections of a client
+template <typename T>
+struct has_stream : std::false_type {};
+
+template <typename... T>
+struct has_stream<sink<T...>> : std::true_type {};
+
+template <typename... T>
+struct has_stream<source<T...>> : std::true_type {};
+
+template <typename... T>
+struct has_stream<future<T...>> : std::disjunction<has_stream<T>...> {};
+
+template <typename... T>
+struct has_stream<tuple<T...>> : std::disjunction<has_stream<T>...> {};
+
 // tags to tell whether we want a const client_info& parameter
 struct do_want_client_info {};
 struct dont_want_client_info {};
@@ -214,8 +233,12 @@ template <typename Serializer, typename Output>
 struct marshall_one {
     template <typename T> struct helper {
         static void doit(Serializer& serializer, Output& out, const T& arg) {
-            using serialize_helper_type = serialize_helper<is_smart_ptr<typename std::remove_reference_t<T>>::value>;
-            serialize_helper_type::serialize(serializer, out, arg);
+            if constexpr (std::is_same_v<T, borrowed_buffer>) {
+                put_borrowed_buffer(arg, out);
+            } else {
+                using serialize_helper_type = serialize_helper<is_smart_ptr<typename std::remove_reference_t<T>>::value>;
+                serialize_helper_type::serialize(serializer, out, arg);
+            }
         }
     };
     template<typename T> struct helper<std::reference_wrapper<const T>> {
@@ -223,6 +246,13 @@ struct marshall_one {
             helper<T>::doit(serializer, out, arg.get());
         }
     };
+    static void put_borrowed_buffer(const borrowed_buffer& arg, Output& out) {
+        uint32_t size = cpu_to_le(uint32_t(arg.size()));
+        out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        for (auto& f : arg.fragments()) {
+            out.write(f.get(), f.size());
+        }
+    }
     static void put_connection_id(const connection_id& cid, Output& out) {
         sstring id = serialize_connection_id(cid);
         out.write(id.c_str(), id.size());
@@ -307,7 +337,11 @@ template<typename Serializer, typename Input>
 struct unmarshal_one {
     template<typename T> struct helper {
         static T doit(connection& c, Input& in) {
-            return read_via_type_marker<T>(c.serializer<Serializer>(), in);
+            if constexpr (std::is_same_v<T, borrowed_buffer>) {
+                return get_borrowed_buffer(c, in);
+            } else {
+                return read_via_type_marker<T>(c.serializer<Serializer>(), in);
+            }
         }
     };
     template<typename T> struct helper<optional<T>> {
@@ -344,6 +378,30 @@ struct unmarshal_one {
             return do_unmarshall<Serializer, Input, T...>(c, in);
         }
     };
+    // Collects views of the fragments of a substream
+    struct fragment_collector {
+        deleter& pin;
+        std::vector<temporary_buffer<char>>& fragments;
+        void write(const char* p, size_t size) {
+            fragments.emplace_back(const_cast<char*>(p), size, pin.share());
+        }
+    };
+    static borrowed_buffer get_borrowed_buffer(connection& c, Input& in) {
+        uint32_t size;
+        in.read(reinterpret_cast<char*>(&size), sizeof(size));
+        size = le_to_cpu(size);
+        auto data = in.read_substream(size);
+        auto pin = c.unmarshal_pin();
+        if (!pin) {
+            temporary_buffer<char> buf(size);
+            data.read(buf.get_write(), size);
+            return borrowed_buffer(std::move(buf));
+        }
+        std::vector<temporary_buffer<char>> fragments;
+        fragment_collector out{*pin, fragments};
+        data.copy_to(out);
+        return borrowed_buffer(std::move(fragments));
+    }
 };
 
 template <typename... T>
@@ -430,8 +488,19 @@ inline std::tuple<T...> do_unmarshall(connection& c, Input& in) {
 
 template <typename Serializer, typename... T>
 inline std::tuple<T...> unmarshall(connection& c, rcv_buf input) {
-    auto in = make_deserializer_stream(input);
-    return do_unmarshall<Serializer, decltype(in), T...>(c, in);
+    if constexpr (std::disjunction_v<std::is_same<T, borrowed_buffer>...>) {
+        // The message outlives the unmarshalling, as long as the
+        // borrowed_buffer arguments reference it
+        auto message = std::make_unique<rcv_buf>(std::move(input));
+        auto in = make_deserializer_stream(*message);
+        auto pin = make_object_deleter(std::move(message));
+        c.set_unmarshal_pin(&pin);
+        auto reset = defer([&c] () noexcept { c.set_unmarshal_pin(nullptr); });
+        return do_unmarshall<Serializer, decltype(in), T...>(c, in);
+    } else {
+        auto in = make_deserializer_stream(input);
+        return do_unmarshall<Serializer, decltype(in), T...>(c, in);
+    }
 }
 
 inline std::exception_ptr unmarshal_exception(rcv_buf& d) {
@@ -506,7 +575,7 @@ struct rcv_reply<Serializer, future<>> : rcv_reply<Serializer, void> {};
 
 template <typename Serializer, typename Ret, typename... InArgs>
 inline auto wait_for_reply(wait_type, std::optional<rpc_clock_type::time_point> timeout, rpc_clock_type::time_point start, cancellable* cancel, rpc::client& dst, id_type msg_id,
-        signature<Ret (InArgs...)>) {
+        uint64_t verb, signature<Ret (InArgs...)>) {
     using reply_type = rcv_reply<Serializer, Ret>;
     auto lambda = [] (reply_type& r, rpc::client& dst, id_type msg_id, rcv_buf data) mutable {
         if (msg_id >= 0) {
@@ -521,6 +590,7 @@ inline auto wait_for_reply(wait_type, std::optional<rpc_clock_type::time_point>
     using handler_type = typename rpc::client::template reply_handler<reply_type, decltype(lambda)>;
     auto r = std::make_unique<handler_type>(std::move(lambda));
     r->start = start;
+    r->verb = verb;
     auto fut = r->reply.p.get_future();
     dst.wait_for_reply(msg_id, std::move(r), timeout, cancel);
     return fut;
@@ -528,13 +598,13 @@ inline auto wait_for_reply(wait_type, std::optional<rpc_clock_type::time_point>
 
 template<typename Serializer, typename... InArgs>
 inline auto wait_for_reply(no_wait_type, std::optional<rpc_clock_type::time_point>, rpc_clock_type::time_point start, cancellable*, rpc::client&, id_type,
-        signature<no_wait_type (InArgs...)>) {  // no_wait overload
+        uint64_t, signature<no_wait_type (InArgs...)>) {  // no_wait overload
     return make_ready_future<>();
 }
 
 template<typename Serializer, typename... InArgs>
 inline auto wait_for_reply(no_wait_type, std::optional<rpc_clock_type::time_point>, rpc_clock_type::time_point, cancellable*, rpc::client&, id_type,
-        signature<future<no_wait_type> (InArgs...)>) {  // future<no_wait> overload
+        uint64_t, signature<future<no_wait_type> (InArgs...)>) {  // future<no_wait> overload
     return make_ready_future<>();
 }
 
@@ -567,12 +637,14 @@ auto send_helper(MsgType xt, signature<Ret (InArgs...)> xsig) {
 
             auto start = rpc_clock_type::now();
             // send message
-            auto msg_id = dst.next_message_id();
             snd_buf data = marshall(dst.template serializer<Serializer>(), request_frame_headroom, args...);
+            constexpr bool striped = !std::disjunction_v<has_stream<Ret>, has_stream<std::decay_t<InArgs>>...>;
+            rpc::client& c = striped ? dst.pick_connection(data.size) : dst;
+            using wait = wait_signature_t<Ret>;
+            auto msg_id = std::is_same_v<wait, wait_type> ? c.reserve_reply_slot() : c.next_message_id();
 
             // prepare reply handler, if return type is now_wait_type this does nothing, since no reply will be sent
-            using wait = wait_signature_t<Ret>;
-            return when_all(dst.request(uint64_t(t), msg_id, std::move(data), timeout, cancel), wait_for_reply<Serializer>(wait(), timeout, start, cancel, dst, msg_id, sig)).then([] (auto r) {
+            return when_all(c.request(uint64_t(t), msg_id, std::move(data), timeout, cancel), wait_for_reply<Serializer>(wait(), timeout, start, cancel, c, msg_id, uint64_t(t), sig)).then([] (auto r) {
                     std::get<0>(r).ignore_ready_future();
                     return std::move(std::get<1>(r)); // return future of wait_for_reply
             });
@@ -664,19 +736,60 @@ auto lref_to_cref(T& x) {
     return std::ref(x);
 }
 
-// Creates lambda to handle RPC message on a server.
+// Creates lambda to process an RPC message on a server, once it was admitted.
 // The lambda unmarshalls all parameters, calls a handler, marshall return values and sends them back to a client
 template <typename Serializer, typename Func, typename Ret, typename... InArgs, typename WantClientInfo, typename WantTimePoint>
-auto recv_helper(signature<Ret (InArgs...)> sig, Func&& func, WantClientInfo, WantTimePoint) {
+auto handle_helper(uint64_t verb, signature<Ret (InArgs...)> sig, Func&& func, WantClientInfo, WantTimePoint) {
     using signature = decltype(sig);
     using wait_style = wait_signature_t<Ret>;
-    return [func = lref_to_cref(std::forward<Func>(func))](shared_ptr<server::connection> client,
+    return [verb, func = lref_to_cref(std::forward<Func>(func))](shared_ptr<server::connection> client,
                                                            std::optional<rpc_clock_type::time_point> timeout,
                                                            int64_t msg_id,
                                                            rcv_buf data,
-                                                           gate::holder guard) mutable {
+                                                           resource_permit permit) mutable {
+        try {
+            auto args = unmarshall<Serializer, InArgs...>(*client, std::move(data));
+            auto start = rpc_clock_type::now();
+            client_info::request_context request{*client, msg_id, timeout};
+            client->info().current_request = &request;
+            auto call = [&] {
+                return apply(func, client->info(), timeout, WantClientInfo(), WantTimePoint(), signature(), std::move(args));
+            };
+            auto trace_context = client->take_trace_context(msg_id);
+            auto f = trace_context || tracing::root_sampling_probability() > 0
+                    ? tracing::with_span(tracing::span(format("rpc.{}", verb), trace_context), call)
+                    : call();
+            client->info().current_request = nullptr;
+            return f.then_wrapped([client, timeout, msg_id, permit = std::move(permit), start, verb, abortable = bool(request.as)] (futurize_t<Ret> ret) mutable {
+                if (abortable) {
+                    client->finish_request(msg_id);
+                }
+                auto handler_duration = rpc_clock_type::now() - start;
+                client->get_server().account_handler_duration(verb, handler_duration);
+                return reply<Serializer>(wait_style(), std::move(ret), msg_id, client, timeout, handler_duration).handle_exception([permit = std::move(permit), client, msg_id] (std::exception_ptr eptr) {
+                    client->get_logger()(client->info(), msg_id, seastar::format("got exception while processing a message: {}", eptr));
+                });
+            });
+        } catch (...) {
+            client->get_logger()(client->info(), msg_id, seastar::format("caught exception while processing a message: {}", std::current_exception()));
+            return make_ready_future();
+        }
+    };
+}
+
+// Creates lambda to handle RPC message on a server.
+// The lambda waits for the resources the message needs and passes it to handle.
+template <typename Serializer, typename Ret, typename Handle>
+auto dispatch_helper(uint64_t verb, Handle&& handle) {
+    using wait_style = wait_signature_t<Ret>;
+    return [verb, handle = std::forward<Handle>(handle)](shared_ptr<server::connection> client,
+                                                  std::optional<rpc_clock_type::time_point> timeout,
+                                                  int64_t msg_id,
+                                                  rcv_buf data,
+                                                  gate::holder guard) mutable {
         auto memory_consumed = client->estimate_request_size(data.size);
         if (memory_consumed > client->max_request_size()) {
+            client->take_trace_context(msg_id);
             auto err = format("request size {:d} large than memory limit {:d}", memory_consumed, client->max_request_size());
             client->get_logger()(client->peer_address(), err);
             // FIXME: future is discarded
@@ -688,32 +801,46 @@ auto recv_helper(signature<Ret (InArgs...)> sig, Func&& func, WantClientInfo, Wa
             return make_ready_future();
         }
         // note: apply is executed asynchronously with regards to networking so we cannot chain futures here by doing "return apply()"
-        auto f = client->wait_for_resources(memory_consumed, timeout).then([client, timeout, msg_id, data = std::move(data), &func, g = std::move(guard)] (auto permit) mutable {
+        auto queued = rpc_clock_type::now();
+        auto f = client->wait_for_resources(memory_consumed, timeout).then([client, timeout, msg_id, data = std::move(data), &handle, g = std::move(guard), verb, queued] (auto permit) mutable {
                 // FIXME: future is discarded
-                (void)try_with_gate(client->get_server().reply_gate(), [client, timeout, msg_id, data = std::move(data), permit = std::move(permit), &func] () mutable {
-                    try {
-                        auto args = unmarshall<Serializer, InArgs...>(*client, std::move(data));
-                        auto start = rpc_clock_type::now();
-                        return apply(func, client->info(), timeout, WantClientInfo(), WantTimePoint(), signature(), std::move(args)).then_wrapped([client, timeout, msg_id, permit = std::move(permit), start] (futurize_t<Ret> ret) mutable {
-                            return reply<Serializer>(wait_style(), std::move(ret), msg_id, client, timeout, rpc_clock_type::now() - start).handle_exception([permit = std::move(permit), client, msg_id] (std::exception_ptr eptr) {
-                                client->get_logger()(client->info(), msg_id, seastar::format("got exception while processing a message: {}", eptr));
-                            });
-                        });
-                    } catch (...) {
-                        client->get_logger()(client->info(), msg_id, seastar::format("caught exception while processing a message: {}", std::current_exception()));
-                        return make_ready_future();
-                    }
+                (void)try_with_gate(client->get_server().reply_gate(), [client, timeout, msg_id, data = std::move(data), permit = std::move(permit), &handle, verb, queued] () mutable {
+                    client->get_server().account_queue_time(verb, rpc_clock_type::now() - queued);
+                    return handle(std::move(client), timeout, msg_id, std::move(data), std::move(permit));
                 }).handle_exception_type([g = std::move(g)] (gate_closed_exception&) {/* ignore */});
         });
 
         if (timeout) {
-            f = f.handle_exception_type([] (semaphore_timed_out&) { /* ignore */ });
+            f = f.handle_exception_type([client, msg_id] (semaphore_timed_out&) {
+                client->take_trace_context(msg_id);
+            });
         }
 
         return f;
     };
 }
 
+template <typename Serializer, typename Func, typename Ret, typename... InArgs, typename WantClientInfo, typename WantTimePoint>
+auto recv_helper(uint64_t verb, signature<Ret (InArgs...)> sig, Func&& func, WantClientInfo wci, WantTimePoint wtp) {
+    return dispatch_helper<Serializer, Ret>(verb, handle_helper<Serializer>(verb, sig, std::forward<Func>(func), wci, wtp));
+}
+
+// Same as recv_helper(), but the admitted messages are processed by an
+// execution stage, so that bursts of them are handled in batches
+template <typename Serializer, typename Func, typename Ret, typename... InArgs, typename WantClientInfo, typename WantTimePoint>
+auto staged_recv_helper(const sstring& stage_name, uint64_t verb, signature<Ret (InArgs...)> sig, Func&& func, WantClientInfo wci, WantTimePoint wtp) {
+    using stage_type = inheriting_concrete_execution_stage<future<>, shared_ptr<server::connection>, std::optional<rpc_clock_type::time_point>,
+            int64_t, rcv_buf, resource_permit>;
+    auto stage = make_lw_shared<stage_type>(stage_name, handle_helper<Serializer>(verb, sig, std::forward<Func>(func), wci, wtp));
+    return dispatch_helper<Serializer, Ret>(verb, [stage] (shared_ptr<server::connection> client,
+                                                   std::optional<rpc_clock_type::time_point> timeout,
+                                                   int64_t msg_id,
+                                                   rcv_buf data,
+                                                   resource_permit permit) {
+        return (*stage)(std::move(client), timeout, msg_id, std::move(data), std::move(permit));
+    });
+}
+
 // helper to create copy constructible lambda from non copy constructible one. std::function<> works only with former kind.
 template<typename Func>
 auto make_copyable_function(Func&& func, std::enable_if_t<!std::is_copy_constructible_v<std::decay_t<Func>>, void*> = nullptr) {
@@ -774,7 +901,20 @@ auto protocol<Serializer, MsgType>::register_handler(MsgType t, scheduling_group
     using clean_sig_type = typename sig_type::clean;
     using want_client_info = typename sig_type::want_client_info;
     using want_time_point = typename sig_type::want_time_point;
-    auto recv = recv_helper<Serializer>(clean_sig_type(), std::forward<Func>(func),
+    auto recv = recv_helper<Serializer>(uint64_t(t), clean_sig_type(), std::forward<Func>(func),
+            want_client_info(), want_time_point());
+    register_receiver(t, rpc_handler{sg, make_copyable_function(std::move(recv)), {}});
+    return make_client(clean_sig_type(), t);
+}
+
+template<typename Serializer, typename MsgType>
+template<typename Func>
+auto protocol<Serializer, MsgType>::register_staged_handler(MsgType t, sstring stage_name, scheduling_group sg, Func&& func) {
+    using sig_type = signature<typename function_traits<Func>::signature>;
+    using clean_sig_type = typename sig_type::clean;
+    using want_client_info = typename sig_type::want_client_info;
+    using want_time_point = typename sig_type::want_time_point;
+    auto recv = staged_recv_helper<Serializer>(stage_name, uint64_t(t), clean_sig_type(), std::forward<Func>(func),
             want_client_info(), want_time_point());
     register_receiver(t, rpc_handler{sg, make_copyable_function(std::move(recv)), {}});
     return make_client(clean_sig_type(), t);
@@ -829,6 +969,50 @@ future<> sink_impl<Serializer, Out...>::operator()(const Out&... args) {
     static_assert(snd_buf::chunk_size >= 4, "send buffer chunk size is too small");
     auto p = data.front().get_write();
     write_le<uint32_t>(p, data.size - 4);
+    if (!_batching) {
+        return send_frame(std::move(data));
+    }
+    if (data.size >= stream_batch_size) {
+        // sent on its own, after the batch it would have joined
+        auto f = flush_batch();
+        return when_all_succeed(std::move(f), send_frame(std::move(data))).discard_result();
+    }
+    auto f = make_ready_future<>();
+    if (_batch_size + data.size > stream_batch_size) {
+        f = flush_batch();
+    }
+    _batch_size += data.size;
+    if (auto* one = std::get_if<temporary_buffer<char>>(&data.bufs)) {
+        _batch.push_back(std::move(*one));
+    } else {
+        for (auto& b : std::get<std::vector<temporary_buffer<char>>>(data.bufs)) {
+            _batch.push_back(std::move(b));
+        }
+    }
+    if (!_batch_elements++) {
+        _flush_timer.arm(stream_flush_window);
+    }
+    return f;
+}
+
+template<typename Serializer, typename... Out>
+future<> sink_impl<Serializer, Out...>::flush_batch() {
+    _flush_timer.cancel();
+    if (!_batch_elements) {
+        return make_ready_future<>();
+    }
+    if (_batch_elements > 1) {
+        temporary_buffer<char> header(4);
+        write_le<uint32_t>(header.get_write(), stream_batch_flag | _batch_size);
+        _batch.insert(_batch.begin(), std::move(header));
+        _batch_size += 4;
+    }
+    _batch_elements = 0;
+    return send_frame(snd_buf(std::exchange(_batch, {}), std::exchange(_batch_size, 0)));
+}
+
+template<typename Serializer, typename... Out>
+future<> sink_impl<Serializer, Out...>::send_frame(snd_buf data) {
     // we do not want to dead lock on huge packets, so let them in
     // but only one at a time
     auto size = std::min(size_t(data.size), max_stream_buffers_memory);
@@ -859,11 +1043,11 @@ future<> sink_impl<Serializer, Out...>::operator()(const Out&... args) {
             }
 
             last_seq_num = seq_num;
-            auto ret_fut = con->send(std::move(local_data), {}, nullptr);
+            auto ret_fut = con->send_stream(std::move(local_data));
             while (!out_of_order_bufs.empty() && out_of_order_bufs.begin()->first == (last_seq_num + 1)) {
                 auto it = out_of_order_bufs.begin();
                 last_seq_num = it->first;
-                auto fut = con->send(std::move(it->second.data), {}, nullptr);
+                auto fut = con->send_stream(std::move(it->second.data));
                 fut.forward_to(std::move(it->second.pr));
                 out_of_order_bufs.erase(it);
             }
@@ -881,34 +1065,40 @@ future<> sink_impl<Serializer, Out...>::operator()(const Out&... args) {
 
 template<typename Serializer, typename... Out>
 future<> sink_impl<Serializer, Out...>::flush() {
-    // wait until everything is sent out before returning.
-    return with_semaphore(this->_sem, max_stream_buffers_memory, [this] {
-        if (this->_ex) {
-            return make_exception_future(this->_ex);
-        }
-        return make_ready_future();
+    return flush_batch().then([this] {
+        // wait until everything is sent out before returning.
+        return with_semaphore(this->_sem, max_stream_buffers_memory, [this] {
+            if (this->_ex) {
+                return make_exception_future(this->_ex);
+            }
+            return make_ready_future();
+        });
     });
 }
 
 template<typename Serializer, typename... Out>
 future<> sink_impl<Serializer, Out...>::close() {
-    return with_semaphore(this->_sem, max_stream_buffers_memory, [this] {
-        return smp::submit_to(this->_con->get_owner_shard(), [this] {
-            connection* con = this->_con->get();
-            if (con->sink_closed()) { // double close, should not happen!
-                return make_exception_future(stream_closed());
-            }
-            future<> f = make_ready_future<>();
-            if (!con->error() && !this->_ex) {
-                snd_buf data = marshall(con->template serializer<Serializer>(), 4);
-                static_assert(snd_buf::chunk_size >= 4, "send buffer chunk size is too small");
-                auto p = data.front().get_write();
-                write_le<uint32_t>(p, -1U); // max len fragment marks an end of a stream
-                f = con->send(std::move(data), {}, nullptr);
-            } else {
-                f = this->_ex ? make_exception_future(this->_ex) : make_exception_future(closed_error());
-            }
-            return f.finally([con] { return con->close_sink(); });
+    // a failure is kept in _ex, which fails the close
+    return flush_batch().then_wrapped([this] (future<> f) {
+        f.ignore_ready_future();
+        return with_semaphore(this->_sem, max_stream_buffers_memory, [this] {
+            return smp::submit_to(this->_con->get_owner_shard(), [this] {
+                connection* con = this->_con->get();
+                if (con->sink_closed()) { // double close, should not happen!
+                    return make_exception_future(stream_closed());
+                }
+                future<> f = make_ready_future<>();
+                if (!con->error() && !this->_ex) {
+                    snd_buf data = marshall(con->template serializer<Serializer>(), 4);
+                    static_assert(snd_buf::chunk_size >= 4, "send buffer chunk size is too small");
+                    auto p = data.front().get_write();
+                    write_le<uint32_t>(p, -1U); // max len fragment marks an end of a stream
+                    f = con->send(std::move(data), {}, nullptr);
+                } else {
+                    f = this->_ex ? make_exception_future(this->_ex) : make_exception_future(closed_error());
+                }
+                return f.finally([con] { return con->close_sink(); });
+            });
         });
     });
 }
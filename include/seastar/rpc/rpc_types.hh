@@ -32,6 +32,7 @@
 #include <stdexcept>
 #include <string>
 #include <any>
+#include <map>
 #include <seastar/util/assert.hh>
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/variant_utils.hh>
@@ -39,6 +40,7 @@
 #include <seastar/core/circular_buffer.hh>
 #include <seastar/core/simple-stream.hh>
 #include <seastar/core/lowres_clock.hh>
+#include <seastar/core/abort_source.hh>
 #include <boost/functional/hash.hpp>
 #include <seastar/core/sharded.hh>
 
@@ -94,12 +96,35 @@ constexpr connection_id invalid_connection_id = connection_id::make_invalid_id()
 std::ostream& operator<<(std::ostream&, const connection_id&);
 
 class server;
+class connection;
 
 struct client_info {
     socket_address addr;
     rpc::server& server;
     connection_id conn_id;
     std::unordered_map<sstring, std::any> user_data;
+    /// @private
+    /// The request whose handler is being called
+    struct request_context {
+        rpc::connection& conn;
+        int64_t msg_id;
+        std::optional<rpc_clock_type::time_point> timeout;
+        abort_source* as = nullptr;
+    };
+    /// @private
+    request_context* current_request = nullptr;
+    /// Returns the abort source of the request being handled
+    ///
+    /// The abort is requested when the request's deadline passes, when the
+    /// client gives up on it (times out or cancels it) and the connection
+    /// negotiated cancellation, or when the connection is dropped. The abort
+    /// source is only set up for the handlers that ask for it, and stays
+    /// valid, across deferring, until the handler's returned future resolves.
+    ///
+    /// The client_info is shared by the requests of the connection, so it
+    /// only knows which request is being handled until the handler first
+    /// defers: get the abort source before that and keep the reference.
+    abort_source& request_abort_source() const;
     template <typename T>
     void attach_auxiliary(const sstring& key, T&& object) {
         user_data.emplace(key, std::any(std::forward<T>(object)));
@@ -267,6 +292,59 @@ struct snd_buf {
     temporary_buffer<char>& front();
 };
 
+/// A byte array that is received without being copied.
+///
+/// When a handler takes a borrowed_buffer argument, or a verb returns one,
+/// its fragments share the buffers the message was read into and keep
+/// them alive, instead of being copied out of the message by the
+/// Serializer. As a consequence holding a borrowed_buffer retains the
+/// whole message, including the memory it is accounted for in the
+/// server's resource_limits.
+///
+/// It is serialized as a little-endian uint32_t size followed by the data,
+/// independently of the Serializer.
+class borrowed_buffer {
+    std::vector<temporary_buffer<char>> _fragments;
+    size_t _size = 0;
+public:
+    borrowed_buffer() = default;
+    explicit borrowed_buffer(temporary_buffer<char> buf) : _size(buf.size()) {
+        if (_size) {
+            _fragments.push_back(std::move(buf));
+        }
+    }
+    explicit borrowed_buffer(std::vector<temporary_buffer<char>> fragments) : _fragments(std::move(fragments)) {
+        for (auto& f : _fragments) {
+            _size += f.size();
+        }
+    }
+    size_t size() const noexcept {
+        return _size;
+    }
+    bool empty() const noexcept {
+        return !_size;
+    }
+    const std::vector<temporary_buffer<char>>& fragments() const noexcept {
+        return _fragments;
+    }
+    std::vector<temporary_buffer<char>> release() && noexcept {
+        _size = 0;
+        return std::move(_fragments);
+    }
+    /// Returns the data as one buffer, copying it only if it is fragmented
+    temporary_buffer<char> linearize() {
+        if (_fragments.size() == 1) {
+            return _fragments.front().share();
+        }
+        temporary_buffer<char> ret(_size);
+        auto p = ret.get_write();
+        for (auto& f : _fragments) {
+            p = std::copy_n(f.get(), f.size(), p);
+        }
+        return ret;
+    }
+};
+
 static inline memory_input_stream<rcv_buf::iterator> make_deserializer_stream(rcv_buf& input) {
     auto* b = std::get_if<temporary_buffer<char>>(&input.bufs);
     if (b) {
@@ -277,6 +355,39 @@ static inline memory_input_stream<rcv_buf::iterator> make_deserializer_stream(rc
     }
 }
 
+/// A pre-trained compression dictionary.
+///
+/// Peers refer to dictionaries by id, so the same id must not be reused
+/// for a different content.
+struct compression_dictionary {
+    uint32_t id;
+    sstring data;
+};
+
+/// Per-shard set of compression dictionaries known to this node.
+///
+/// When configured on both sides of a connection (see
+/// client_options::compression_dictionaries and
+/// server_options::compression_dictionaries) the server offers its current
+/// dictionary during negotiation. A client that doesn't have it yet
+/// receives the dictionary as part of the negotiation and adds it to its
+/// registry, so new dictionaries only need to be installed on the servers.
+class compression_dictionary_registry {
+    std::map<uint32_t, lw_shared_ptr<const compression_dictionary>> _dictionaries;
+    uint32_t _current = 0;
+public:
+    /// Adds a dictionary, the id must be non-zero.
+    void add(uint32_t id, sstring data);
+    /// Makes the dictionary the one offered on new connections, 0 to stop
+    /// offering any. Established connections keep using their dictionary.
+    void set_current(uint32_t id);
+    lw_shared_ptr<const compression_dictionary> current() const;
+    lw_shared_ptr<const compression_dictionary> find(uint32_t id) const;
+    /// Forgets a dictionary, connections using it are not affected.
+    void remove(uint32_t id);
+    std::vector<uint32_t> ids() const;
+};
+
 class compressor {
 public:
     virtual ~compressor() {}
@@ -286,6 +397,9 @@ class compressor {
     virtual rcv_buf decompress(rcv_buf data) = 0;
     virtual sstring name() const = 0;
     virtual future<> close() noexcept { return make_ready_future<>(); };
+    // use the dictionary agreed upon during negotiation for all following
+    // messages, returns false if the algorithm doesn't support dictionaries
+    virtual bool use_dictionary(lw_shared_ptr<const compression_dictionary> dict) { return false; }
 
     // factory to create compressor for a connection
     class factory {
@@ -309,6 +423,11 @@ class connection;
 using xshard_connection_ptr = lw_shared_ptr<foreign_ptr<shared_ptr<connection>>>;
 constexpr size_t max_queued_stream_buffers = 50;
 constexpr size_t max_stream_buffers_memory = 100 * 1024;
+// Once protocol_features::STREAM_FLOW_CONTROL is negotiated, elements smaller
+// than this are coalesced into frames of up to this size, which are sent at
+// the latest stream_flush_window after their first element
+constexpr size_t stream_batch_size = 16 * 1024;
+constexpr std::chrono::microseconds stream_flush_window(200);
 
 /// \addtogroup rpc
 /// @{
@@ -0,0 +1,99 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/sstring.hh>
+#include <seastar/rpc/rpc_types.hh>
+
+#include <memory>
+
+namespace seastar {
+
+namespace rpc {
+
+/// RPC compressor based on zstd.
+///
+/// Available when seastar is built with zstd support (SEASTAR_HAVE_ZSTD).
+/// Messages are compressed with the streaming interface directly from the,
+/// possibly fragmented, send buffer. Both sides can share a pre-trained
+/// dictionary, which is much more efficient for the small messages typical
+/// for RPC; the dictionary is part of the negotiated feature so that
+/// peers with different dictionaries fall back to other compressors.
+///
+/// In adaptive mode messages that are too small or that didn't compress
+/// well recently are sent uncompressed, with an exponential backoff before
+/// the next attempt.
+class zstd_compressor final : public compressor {
+public:
+    struct config {
+        /// zstd compression level
+        int level = 3;
+        /// Raw content of a dictionary (as produced by `zstd --train`), or
+        /// empty to compress without a dictionary
+        sstring dictionary;
+        /// Skip compression for small or incompressible messages
+        bool adaptive = true;
+        /// Messages smaller than this are never compressed in adaptive mode
+        size_t min_compress_size = 128;
+        /// A compressed to uncompressed size ratio above this value is
+        /// considered a failure in adaptive mode
+        float incompressible_ratio = 0.9;
+    };
+    struct dictionary;
+
+    class factory: public rpc::compressor::factory {
+        config _cfg;
+        std::shared_ptr<const dictionary> _dict;
+        sstring _name;
+    public:
+        factory();
+        explicit factory(config cfg);
+        ~factory();
+        virtual const sstring& supported() const override;
+        virtual std::unique_ptr<rpc::compressor> negotiate(sstring feature, bool is_server) const override;
+    };
+private:
+    config _cfg;
+    std::shared_ptr<const dictionary> _dict;
+    sstring _name;
+    // Adaptive mode: messages left to send uncompressed and the length of
+    // the next such run
+    unsigned _skip = 0;
+    unsigned _backoff = 0;
+private:
+    bool should_compress(size_t size);
+    void account(size_t original, size_t compressed);
+public:
+    zstd_compressor(config cfg, std::shared_ptr<const dictionary> dict, sstring name);
+    ~zstd_compressor();
+    // compress data, leaving head_space empty in returned buffer
+    snd_buf compress(size_t head_space, snd_buf data) override;
+    // decompress data
+    rcv_buf decompress(rcv_buf data) override;
+    sstring name() const override;
+    // replaces the dictionary of the factory, if any
+    bool use_dictionary(lw_shared_ptr<const compression_dictionary> dict) override;
+};
+
+}
+
+}
@@ -0,0 +1,140 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <seastar/testing/linux_perf_event.hh>
+#include <seastar/util/backtrace.hh>
+
+namespace seastar {
+
+/// A cache line that loads found in the cache of another core
+struct contended_cache_line {
+    /// Address of the line
+    uintptr_t address = 0;
+    /// Loads that hit the line modified in the cache of another core (HITM),
+    /// the signature of true and false sharing
+    uint64_t hitm = 0;
+    /// Loads served by the cache of a core on another socket
+    uint64_t remote = 0;
+    /// Shards the loads were sampled on
+    std::vector<unsigned> shards;
+    /// Code the loads were sampled at, with the number of samples, most
+    /// sampled first
+    std::vector<std::pair<frame, uint64_t>> sites;
+};
+
+/// The most contended cache lines seen by one or more samplers
+struct cache_contention_report {
+    /// Load samples taken, contended or not
+    uint64_t samples = 0;
+    /// Samples the kernel dropped because they were not drained in time
+    uint64_t lost = 0;
+    /// Most contended first
+    std::vector<contended_cache_line> lines;
+
+    /// Adds up the report of another shard, keeping the \c max_lines most
+    /// contended lines. Lines are identified by their address, which is the
+    /// same on all shards, so that a line shared by shards shows up once.
+    void merge(const cache_contention_report& other, size_t max_lines = 20);
+};
+
+/// Prints the lines with their code sites as shared object and offset, which
+/// seastar-addr2line resolves to symbols like any other seastar backtrace.
+std::ostream& operator<<(std::ostream& os, const cache_contention_report& r);
+
+/// Samples the loads of the current thread that hit a cache line held by
+/// another core, to find true and false sharing without `perf c2c`
+///
+/// Uses the load latency sampling of the CPU (the \c mem-loads event on
+/// Intel, IBS on AMD), through perf_event_open(2) on the calling thread, so
+/// it works for unprivileged processes as long as
+/// \c /proc/sys/kernel/perf_event_paranoid allows user space profiling
+/// (2 or less). Each sample carries the address loaded and where it was
+/// served from, and is attributed to its cache line and code address.
+///
+/// Make one sampler per shard, drain() it periodically and collect the
+/// reports, for instance:
+/// \code
+/// co_await smp::invoke_on_all([] { sampler = std::make_unique<cache_contention_sampler>(); sampler->enable(); });
+/// ...
+/// auto r = co_await smp::map_reduce0([] { sampler->drain(); return sampler->report(); },
+///         cache_contention_report{}, [] (auto a, const auto& b) { a.merge(b); return a; });
+/// \endcode
+class cache_contention_sampler {
+public:
+    struct config {
+        /// Take one sample every that many loads
+        uint64_t sample_period = 1000;
+        /// Only sample loads that took at least that many cycles, to skip
+        /// the ones served by the local caches (Intel only)
+        unsigned min_latency = 30;
+        /// Size of the sample buffer, in pages, a power of 2
+        size_t buffer_pages = 64;
+        /// Lines tracked at most, samples of others are counted but dropped
+        size_t max_lines = 64 * 1024;
+    };
+private:
+    struct line_stats {
+        uint64_t hitm = 0;
+        uint64_t remote = 0;
+        std::unordered_map<uintptr_t, uint64_t> sites;
+    };
+    config _cfg;
+    linux_perf_event _event;
+    void* _mmap = nullptr;
+    size_t _mmap_size = 0;
+    uint64_t _samples = 0;
+    uint64_t _lost = 0;
+    std::unordered_map<uintptr_t, line_stats> _lines;
+
+    void record(uintptr_t ip, uintptr_t addr, uint64_t data_src);
+public:
+    /// Opens the load sampling event of the calling thread, disabled
+    ///
+    /// \throws std::system_error when the CPU or the kernel don't support
+    ///         load sampling, or profiling is not allowed
+    explicit cache_contention_sampler(config cfg);
+    cache_contention_sampler() : cache_contention_sampler(config{}) {}
+    cache_contention_sampler(const cache_contention_sampler&) = delete;
+    ~cache_contention_sampler();
+
+    void enable();
+    void disable();
+    /// Consumes the samples gathered so far. Should be called often enough
+    /// that the sample buffer doesn't fill up, or samples are lost.
+    void drain();
+    /// The lines with the most contended loads on this shard
+    ///
+    /// \param max_lines the number of lines to report
+    /// \param max_sites the number of code sites to report for each line
+    cache_contention_report report(size_t max_lines = 20, size_t max_sites = 5) const;
+    /// Forgets the samples drained so far
+    void reset();
+};
+
+}
@@ -41,6 +41,8 @@ class linux_perf_event {
     linux_perf_event& operator=(linux_perf_event&& x) noexcept;
     ~linux_perf_event();
     uint64_t read();
+    // -1 if the event could not be opened, errno tells why
+    int fd() const noexcept { return _fd; }
     void enable();
     void disable();
 public:
@@ -42,6 +42,8 @@
 
 namespace seastar {
 
+class task;
+
 struct shared_object {
     sstring name;
     uintptr_t begin;
@@ -117,6 +119,7 @@ class simple_backtrace {
 
     size_t hash() const noexcept { return _hash; }
     char delimeter() const noexcept { return _delimeter; }
+    const vector_type& frames() const noexcept { return _frames; }
 
     friend fmt::formatter<simple_backtrace>;
 
@@ -134,22 +137,26 @@ using shared_backtrace = seastar::lw_shared_ptr<simple_backtrace>;
 // Represents a task object inside a tasktrace.
 class task_entry {
     const std::type_info* _task_type;
+    // Where a coroutine resumes, which tells coroutines apart when their
+    // promises all have the same type, 0 for other tasks
+    uintptr_t _resume_address;
 public:
-    task_entry(const std::type_info& ti) noexcept
+    task_entry(const std::type_info& ti, uintptr_t resume_address = 0) noexcept
         : _task_type(&ti)
+        , _resume_address(resume_address)
     { }
 
     friend fmt::formatter<task_entry>;
 
     bool operator==(const task_entry& o) const noexcept {
-        return *_task_type == *o._task_type;
+        return *_task_type == *o._task_type && _resume_address == o._resume_address;
     }
 
     bool operator!=(const task_entry& o) const noexcept {
         return !(*this == o);
     }
 
-    size_t hash() const noexcept { return _task_type->hash_code(); }
+    size_t hash() const noexcept { return _task_type->hash_code() ^ _resume_address; }
 };
 
 // Extended backtrace which consists of a backtrace of the currently running task
@@ -230,6 +237,14 @@ saved_backtrace current_backtrace() noexcept;
 
 tasktrace current_tasktrace() noexcept;
 
+// The chain of tasks waiting for a task to complete, starting with it, as
+// current_tasktrace() reports the tasks waiting for the running one. The
+// task may be one which is not running, e.g. a coroutine suspended on
+// co_await, in which case the trace tells whom its result is awaited by.
+// Coroutines are reported with the address they resume at, which
+// seastar-addr2line symbolizes to the coroutine function.
+tasktrace waiting_tasktrace(task& t) noexcept;
+
 // Collects backtrace only within the currently executing task.
 simple_backtrace current_backtrace_tasklocal() noexcept;
 
@@ -0,0 +1,55 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#ifndef SEASTAR_MODULE
+#include <cstddef>
+#include <cstdint>
+#endif
+
+#include <seastar/util/modules.hh>
+
+namespace seastar {
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
+/// Continues the CRC32C (Castagnoli) checksum \c crc over \c size bytes
+/// at \c data, 0 being the checksum of no data.
+///
+/// The CRC instructions of SSE4.2 or ARMv8 are used when the CPU has them.
+uint32_t crc32c_update(uint32_t crc, const char* data, size_t size) noexcept;
+
+/// Accumulates the CRC32C checksum of data fed in pieces
+class crc32c {
+    uint32_t _crc = 0;
+public:
+    void process(const char* data, size_t size) noexcept {
+        _crc = crc32c_update(_crc, data, size);
+    }
+    uint32_t get() const noexcept {
+        return _crc;
+    }
+};
+
+SEASTAR_MODULE_EXPORT_END
+
+}
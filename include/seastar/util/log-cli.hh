@@ -88,6 +88,23 @@ struct options : public program_options::option_group {
     ///
     /// Default: \p true.
     program_options::value<bool> log_with_color;
+    /// \brief Size of the buffer of each thread for asynchronous logging.
+    ///
+    /// When non zero, log messages are written by a dedicated thread,
+    /// and dropped when the buffer of the thread logging them is full.
+    ///
+    /// Default: \p 0, messages are written by the thread logging them.
+    ///
+    /// \see logger::enable_async().
+    program_options::value<unsigned> logger_async_buffer_size;
+    /// \brief Have the thread writing the log messages format them.
+    ///
+    /// Only has an effect with asynchronous logging.
+    ///
+    /// Default: \p false.
+    ///
+    /// \see logger::set_deferred_formatting().
+    program_options::value<bool> logger_deferred_formatting;
     /// \cond internal
     options(program_options::option_group* parent_group);
     /// \endcond
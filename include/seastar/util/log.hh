@@ -28,7 +28,12 @@
 #include <seastar/util/modules.hh>
 
 #ifndef SEASTAR_MODULE
+#include <array>
 #include <concepts>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <tuple>
 #include <unordered_map>
 #include <exception>
 #include <iosfwd>
@@ -46,6 +51,91 @@ namespace seastar {
 
 SEASTAR_MODULE_EXPORT_BEGIN
 
+SEASTAR_MODULE_EXPORT_END
+
+/// \cond internal
+namespace internal {
+
+/// Formats the arguments encoded by logger::log_deferred(), and returns
+/// the end of the output
+using deferred_log_formatter = log_buf::inserter_iterator (*)(const char* args, log_buf::inserter_iterator);
+
+template <typename T>
+using deferred_log_arg_type = std::decay_t<T>;
+
+template <typename T>
+concept deferred_log_string = std::same_as<T, const char*> || std::same_as<T, char*> || std::same_as<T, std::string>
+        || std::same_as<T, std::string_view> || std::same_as<T, sstring>;
+
+/// The arguments whose formatting can be deferred to another thread: those
+/// formatted from their bytes alone, and strings, which are copied
+template <typename T>
+concept deferred_log_arg = std::is_arithmetic_v<deferred_log_arg_type<T>> || std::is_enum_v<deferred_log_arg_type<T>>
+        || deferred_log_string<deferred_log_arg_type<T>>;
+
+template <typename T>
+size_t deferred_log_arg_size(const T& v) noexcept {
+    if constexpr (deferred_log_string<deferred_log_arg_type<T>>) {
+        return sizeof(uint32_t) + std::string_view(v).size();
+    } else {
+        return sizeof(T);
+    }
+}
+
+template <typename T>
+bool deferred_log_arg_valid(const T& v) noexcept {
+    if constexpr (std::is_pointer_v<deferred_log_arg_type<T>>) {
+        return v != nullptr;
+    } else {
+        return true;
+    }
+}
+
+template <typename T>
+char* write_deferred_log_arg(char* p, const T& v) noexcept {
+    if constexpr (deferred_log_string<deferred_log_arg_type<T>>) {
+        std::string_view s(v);
+        uint32_t size = s.size();
+        std::memcpy(p, &size, sizeof(size));
+        std::memcpy(p + sizeof(size), s.data(), size);
+        return p + sizeof(size) + size;
+    } else {
+        std::memcpy(p, &v, sizeof(v));
+        return p + sizeof(v);
+    }
+}
+
+template <typename T>
+auto read_deferred_log_arg(const char*& p) noexcept {
+    if constexpr (deferred_log_string<deferred_log_arg_type<T>>) {
+        uint32_t size;
+        std::memcpy(&size, p, sizeof(size));
+        std::string_view s(p + sizeof(size), size);
+        p += sizeof(size) + size;
+        return s;
+    } else {
+        deferred_log_arg_type<T> v;
+        std::memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        return v;
+    }
+}
+
+template <typename... Args>
+log_buf::inserter_iterator format_deferred_log(const char* p, log_buf::inserter_iterator it) {
+    auto format = read_deferred_log_arg<std::string_view>(p);
+    // the elements of a braced list are evaluated in order
+    std::tuple<decltype(read_deferred_log_arg<Args>(p))...> args{read_deferred_log_arg<Args>(p)...};
+    return std::apply([&] (const auto&... args) {
+        return fmt::format_to(it, fmt::runtime(format), args...);
+    }, args);
+}
+
+}
+/// \endcond
+
+SEASTAR_MODULE_EXPORT_BEGIN
+
 /// \brief log level used with \see {logger}
 /// used with the logger.do_log method.
 /// Levels are in increasing order. That is if you want to see debug(3) logs you
@@ -93,7 +183,9 @@ class logger {
     static std::ostream* _out;
     static std::atomic<bool> _ostream;
     static std::atomic<bool> _syslog;
+    static std::atomic<bool> _deferred;
     static unsigned _shard_field_width;
+    class async_backend;
 #ifdef SEASTAR_BUILD_SHARED_LIBS
     static thread_local bool silent;
 #else
@@ -202,6 +294,33 @@ class logger {
 
     // We can't use an std::function<> as it potentially allocates.
     void do_log(log_level level, log_writer& writer);
+    internal::log_buf::inserter_iterator print_prefix(internal::log_buf::inserter_iterator it) const;
+
+    // the largest encoding of the arguments of a message whose formatting
+    // is deferred
+    static constexpr size_t max_deferred_size = 1024;
+
+    // queues the arguments for the writer thread to format, returns false
+    // if it doesn't run
+    bool do_log_deferred(log_level level, std::string_view args) noexcept;
+
+    template <typename... Args>
+    bool log_deferred(log_level level, std::string_view format, const Args&... args) noexcept {
+        if (!(internal::deferred_log_arg_valid(args) && ...)) {
+            return false;
+        }
+        internal::deferred_log_formatter formatter = internal::format_deferred_log<Args...>;
+        size_t size = sizeof(formatter) + internal::deferred_log_arg_size(format) + (internal::deferred_log_arg_size(args) + ... + 0);
+        if (size > max_deferred_size) {
+            return false;
+        }
+        std::array<char, max_deferred_size> buf;
+        char* p = buf.data();
+        std::memcpy(p, &formatter, sizeof(formatter));
+        p = internal::write_deferred_log_arg(p + sizeof(formatter), format);
+        ((p = internal::write_deferred_log_arg(p, args)), ...);
+        return do_log_deferred(level, std::string_view(buf.data(), size));
+    }
     void failed_to_log(std::exception_ptr ex,
                        fmt::string_view fmt,
                        compat::source_location loc) noexcept;
@@ -284,6 +403,14 @@ class logger {
     template <typename... Args>
     void log(log_level level, format_info_t<Args...> fmt, Args&&... args) noexcept {
         if (is_enabled(level)) {
+            if constexpr ((internal::deferred_log_arg<Args> && ...)) {
+                if (_deferred.load(std::memory_order_relaxed)) {
+                    fmt::string_view format(fmt.format);
+                    if (log_deferred(level, std::string_view(format.data(), format.size()), args...)) {
+                        return;
+                    }
+                }
+            }
             try {
                 lambda_log_writer writer([&] (internal::log_buf::inserter_iterator it) {
 #ifdef SEASTAR_LOGGER_COMPILE_TIME_FMT
@@ -457,6 +584,41 @@ class logger {
     ///       before syslogd can clear it) but can happen.
     static void set_syslog_enabled(bool enabled) noexcept;
 
+    /// Have the thread writing the log messages format them
+    ///
+    /// Only has an effect with enable_async(). The arguments of the messages
+    /// logged with log() and its shortcuts are copied to the ring of the
+    /// thread instead of being formatted by it, when they are all numbers,
+    /// enums or strings (std::string, std::string_view, sstring and C
+    /// strings), so that logging costs little more than a copy. The writer
+    /// thread then formats them. Messages with other arguments, or whose
+    /// arguments don't fit in 1kB, are formatted by the thread logging them.
+    static void set_deferred_formatting(bool enabled) noexcept;
+
+    /// Write the log messages from a dedicated thread
+    ///
+    /// Each thread that logs appends its messages to a ring of
+    /// \c buffer_size bytes, without locking, and a writer thread writes
+    /// them to the output stream and to syslog. So a slow terminal or
+    /// syslog daemon doesn't stall the reactor. When the ring of a thread
+    /// is full, its messages are dropped and counted, see
+    /// async_dropped_messages().
+    ///
+    /// Messages still queued when the process aborts are lost, unless
+    /// flush_async() was called.
+    static void enable_async(size_t buffer_size);
+
+    /// Write the queued messages, then write the following ones from
+    /// the thread logging them again
+    static void disable_async() noexcept;
+
+    /// Wait until the messages queued so far are written
+    static void flush_async() noexcept;
+
+    /// The number of messages dropped because the ring of their thread
+    /// was full
+    static uint64_t async_dropped_messages() noexcept;
+
     /// Set the width of shard id field in log messages
     ///
     /// \c this_shard_id() is printed as a part of the prefix in logging
@@ -547,6 +709,8 @@ struct logging_settings final {
     bool with_color;
     logger_timestamp_style stdout_timestamp_style = logger_timestamp_style::real;
     logger_ostream_type logger_ostream = logger_ostream_type::cerr;
+    size_t async_buffer_size = 0; ///< when non zero, see logger::enable_async()
+    bool deferred_formatting = false; ///< see logger::set_deferred_formatting()
 };
 
 /// Shortcut for configuring the logging system all at once.
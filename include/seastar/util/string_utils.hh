@@ -31,7 +31,10 @@
 #pragma once
 
 #ifndef SEASTAR_MODULE
+#include <bit>
+#include <cstdint>
 #include <cstring>
+#include <string_view>
 #include <stdio.h>
 #endif
 
@@ -47,17 +50,55 @@ SEASTAR_MODULE_EXPORT_BEGIN
 // Collection of utilities for working with strings .
 //
 
+// ASCII case folding of eight characters at a time, which is what the
+// "C" locale's tolower() does one character at a time
+inline uint64_t ascii_tolower8(uint64_t w) noexcept {
+    constexpr uint64_t ones = 0x0101010101010101;
+    auto heptets = w & (0x7f * ones);
+    auto above_z = heptets + (0x7f - 'Z') * ones;
+    auto from_a = heptets + (0x80 - 'A') * ones;
+    auto upper = ~w & (from_a ^ above_z) & (0x80 * ones);
+    return w | (upper >> 2);
+}
+
+inline uint64_t load_ascii_lower8(const char* p, size_t n = 8) noexcept {
+    uint64_t w = 0;
+    std::memcpy(&w, p, n);
+    return ascii_tolower8(w);
+}
+
 struct case_insensitive_cmp {
-    bool operator()(const sstring& s1, const sstring& s2) const {
-        return std::equal(s1.begin(), s1.end(), s2.begin(), s2.end(),
-                [](char a, char b) { return ::tolower(a) == ::tolower(b); });
+    using is_transparent = void;
+
+    bool operator()(std::string_view s1, std::string_view s2) const noexcept {
+        if (s1.size() != s2.size()) {
+            return false;
+        }
+        size_t i = 0;
+        for (; i + 8 <= s1.size(); i += 8) {
+            if (load_ascii_lower8(s1.data() + i) != load_ascii_lower8(s2.data() + i)) {
+                return false;
+            }
+        }
+        auto tail = s1.size() - i;
+        return !tail || load_ascii_lower8(s1.data() + i, tail) == load_ascii_lower8(s2.data() + i, tail);
     }
 };
 
 struct case_insensitive_hash {
-    size_t operator()(sstring s) const {
-        std::transform(s.begin(), s.end(), s.begin(), ::tolower);
-        return std::hash<sstring>()(s);
+    using is_transparent = void;
+
+    size_t operator()(std::string_view s) const noexcept {
+        constexpr uint64_t mul = 0x9e3779b97f4a7c15;
+        uint64_t h = s.size() * mul;
+        size_t i = 0;
+        for (; i + 8 <= s.size(); i += 8) {
+            h = std::rotl((h ^ load_ascii_lower8(s.data() + i)) * mul, 29);
+        }
+        if (auto tail = s.size() - i) {
+            h = std::rotl((h ^ load_ascii_lower8(s.data() + i, tail)) * mul, 29);
+        }
+        return h ^ (h >> 32);
     }
 };
 
@@ -0,0 +1,112 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/abort_source.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/http/connection_factory.hh>
+#include <seastar/websocket/common.hh>
+
+namespace seastar::experimental::websocket {
+
+/// \addtogroup websocket
+/// @{
+
+/*!
+ * \brief a client WebSocket connection
+ */
+class client_connection : public connection {
+    sstring _host;
+    sstring _resource;
+    sstring _key;
+
+public:
+    /*!
+     * \param fd established socket used for communication
+     * \param host value of the Host header of the upgrade request
+     * \param resource requested resource, e.g. "/feed"
+     * \param subprotocol requested subprotocol, or an empty string for none
+     * \param handler handler of the connection
+     */
+    client_connection(connected_socket&& fd, sstring host, sstring resource, sstring subprotocol, handler_t handler);
+
+    /*!
+     * \brief perform the opening handshake and serve the connection
+     *
+     * Resolves once the connection is closed, fails if the handshake does.
+     */
+    future<> process();
+
+protected:
+    future<> read_loop();
+    future<> send_http_upgrade_request();
+    future<> read_http_upgrade_response();
+};
+
+/*!
+ * \brief a WebSocket client
+ *
+ * Opens connections to a WebSocket server, using the transport
+ * of \ref http::experimental::client. The messages received are read by
+ * the handler from its input stream, and it sends messages by writing
+ * to its output stream, each flushed buffer becoming a binary message.
+ * Writes wait while the connection doesn't keep up with the data.
+ */
+class client {
+    std::unique_ptr<http::experimental::connection_factory> _new_connections;
+    sstring _host;
+public:
+    /*!
+     * \param addr address of the server
+     * \param host value of the Host header, the address if empty
+     */
+    explicit client(socket_address addr, sstring host = {});
+    /*!
+     * \param addr address of the server
+     * \param creds credentials for the TLS connections
+     * \param host server name, used for the Host header and for TLS
+     */
+    client(socket_address addr, shared_ptr<tls::certificate_credentials> creds, sstring host);
+    /*!
+     * \param f factory of the connections to the server
+     * \param host value of the Host header
+     */
+    client(std::unique_ptr<http::experimental::connection_factory> f, sstring host);
+
+    /*!
+     * \brief Connect to the server and serve the connection with a handler
+     *
+     * The connection is closed once the handler returns, or when the
+     * server closes it. The handler's input stream ends in the latter case.
+     *
+     * \param resource requested resource, e.g. "/feed"
+     * \param handler handler of the connection
+     * \param subprotocol requested subprotocol, or an empty string for none
+     * \param as abort source to cancel establishing the connection
+     * \return a future resolved once the connection is closed
+     */
+    future<> connect(sstring resource, handler_t handler, sstring subprotocol = "", abort_source* as = nullptr);
+};
+
+/// @}
+
+}
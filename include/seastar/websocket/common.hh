@@ -24,6 +24,7 @@
 #include <seastar/core/seastar.hh>
 #include <seastar/core/iostream.hh>
 #include <seastar/core/queue.hh>
+#include <seastar/core/semaphore.hh>
 #include <seastar/net/api.hh>
 #include <seastar/util/log.hh>
 #include <seastar/websocket/parser.hh>
@@ -35,11 +36,76 @@ extern sstring magic_key_suffix;
 using handler_t = std::function<future<>(input_stream<char>&, output_stream<char>&)>;
 
 class server;
+class permessage_deflate;
 
 /// \defgroup websocket WebSocket
 /// \addtogroup websocket
 /// @{
 
+/*!
+ * \brief Settings of the permessage-deflate extension
+ * https://datatracker.ietf.org/doc/html/rfc7692
+ */
+struct permessage_deflate_options {
+    /// zlib compression level, from 1 (fastest) to 9 (smallest), -1 is zlib's default
+    int compression_level = -1;
+    /// Start each sent message with an empty compression window. Compresses
+    /// repetitive message streams worse, but doesn't keep the window between messages.
+    bool no_context_takeover = false;
+    /// Messages shorter than this are sent uncompressed
+    size_t min_message_size = 64;
+};
+
+/*!
+ * \brief A data message framed once, to be sent to many server connections
+ *
+ * The frame header and the payload are laid out in a single buffer, which
+ * each connection sends by reference instead of framing and copying the
+ * message again. When made with compression options, the message is also
+ * compressed once, starting from an empty window so that any peer can
+ * inflate it, and that frame goes to the connections which negotiated
+ * permessage-deflate with the default window size. The other connections
+ * are sent the plain frame.
+ */
+class broadcast_frame {
+    temporary_buffer<char> _plain;
+    // Empty when the message is not compressed
+    temporary_buffer<char> _compressed;
+
+    broadcast_frame(temporary_buffer<char> plain, temporary_buffer<char> compressed) noexcept
+        : _plain(std::move(plain)), _compressed(std::move(compressed)) {}
+    friend class connection;
+public:
+    /*!
+     * \param opcode type of the message, TEXT or BINARY
+     * \param payload the message
+     * \param compression compress the message as well, with these settings,
+     * unless it's shorter than their \c min_message_size
+     */
+    broadcast_frame(opcodes opcode, const temporary_buffer<char>& payload,
+            std::optional<permessage_deflate_options> compression = std::nullopt);
+
+    /*!
+     * \brief A frame sharing the buffers of this one
+     */
+    broadcast_frame share();
+    /*!
+     * \brief A frame referring to the buffers of this one, which are only
+     * kept alive by \c d. Allows sending a frame from other shards than the
+     * one which made it, see \ref broadcast().
+     */
+    broadcast_frame borrow(deleter d) const;
+
+    /// Size of the plain frame, header included
+    size_t size() const noexcept {
+        return _plain.size();
+    }
+    /// Whether the frame was compressed as well
+    bool compressed() const noexcept {
+        return !_compressed.empty();
+    }
+};
+
 /*!
  * \brief an error in handling a WebSocket connection
  */
@@ -53,7 +119,7 @@ class exception : public std::exception {
 };
 
 /*!
- * \brief a server WebSocket connection
+ * \brief a WebSocket connection, the common part of the server and client side
  */
 class connection : public boost::intrusive::list_base_hook<> {
 protected:
@@ -123,6 +189,9 @@ class connection : public boost::intrusive::list_base_hook<> {
     input_stream<char> _read_buf;
     output_stream<char> _write_buf;
     bool _done = false;
+    bool _close_sent = false;
+    // Frames sent by clients are masked
+    bool _client_side;
 
     websocket_parser _websocket_parser;
     queue <temporary_buffer<char>> _input_buffer;
@@ -132,22 +201,18 @@ class connection : public boost::intrusive::list_base_hook<> {
 
     sstring _subprotocol;
     handler_t _handler;
+    // Set once permessage-deflate is negotiated
+    std::unique_ptr<permessage_deflate> _deflate;
+    // Frames are written one at a time, see send_frame()
+    semaphore _send_lock{1};
+    bool _write_closed = false;
 public:
     /*!
      * \param fd established socket used for communication
+     * \param client_side whether this is the client end of the connection
      */
-    connection(connected_socket&& fd)
-        : _fd(std::move(fd))
-        , _read_buf(_fd.input())
-        , _write_buf(_fd.output())
-        , _input_buffer{PIPE_SIZE}
-        , _output_buffer{PIPE_SIZE}
-    {
-        _input = input_stream<char>{data_source{
-                std::make_unique<connection_source_impl>(&_input_buffer)}};
-        _output = output_stream<char>{data_sink{
-                std::make_unique<connection_sink_impl>(&_output_buffer)}};
-    }
+    connection(connected_socket&& fd, bool client_side = false);
+    ~connection();
 
     /*!
      * \brief close the socket
@@ -157,11 +222,33 @@ class connection : public boost::intrusive::list_base_hook<> {
 
 protected:
     future<> read_one();
+    /*!
+     * \brief Passes a chunk of a data message's payload to the handler,
+     * decompressing it if needed.
+     */
+    future<> handle_data(temporary_buffer<char> buff);
+    /*!
+     * \brief Sends what the handler writes to its output stream, until the
+     * connection is closed. The handler closing the stream closes the connection.
+     */
     future<> response_loop();
     /*!
-     * \brief Packs buff in websocket frame and sends it to the client.
+     * \brief Accepts the first of the permessage-deflate offers from a
+     * Sec-WebSocket-Extensions header that can be served with \c opts.
+     * \return the extension response, or an empty string if none is accepted
+     */
+    sstring negotiate_permessage_deflate(std::string_view offers, const permessage_deflate_options& opts);
+    /*!
+     * \brief Packs buff in websocket frame and sends it to the peer.
+     * Data messages are compressed when permessage-deflate was negotiated,
+     * frames sent by a client are masked.
      */
     future<> send_data(opcodes opcode, temporary_buffer<char>&& buff);
+    /*!
+     * \brief Sends a frame framed for broadcast, after the frames already
+     * being sent. Server side only, as frames sent by a client are masked.
+     */
+    future<> send_frame(broadcast_frame frame);
 };
 
 std::string sha1_base64(std::string_view source);
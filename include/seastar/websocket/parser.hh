@@ -64,7 +64,7 @@ struct frame_header {
     }
     // Returns length of the rest of the header.
     uint64_t get_rest_of_header_length() {
-        size_t next_read_length = sizeof(uint32_t); // Masking key
+        size_t next_read_length = masked ? sizeof(uint32_t) : 0; // Masking key
         if (length == 126) {
             next_read_length += sizeof(uint16_t);
         } else if (length == 127) {
@@ -86,6 +86,24 @@ struct frame_header {
     }
 };
 
+/*!
+ * \brief XORs \c n bytes at \c data with the masking \c key, in place.
+ *
+ * \c offset is the position of \c data in the payload, so that a payload
+ * can be unmasked a chunk at a time.
+ */
+void apply_mask(char* data, size_t n, uint32_t key, uint64_t offset = 0) noexcept;
+
+/*!
+ * \brief Incremental parser of websocket frames, fed with the data read
+ * from the connection (see input_stream::consume()).
+ *
+ * Each stop hands out a part of a frame's payload in result(), unmasked
+ * in place in the buffers it was read into. Payloads of data frames are
+ * handed out in chunks as they arrive, end_of_frame() tells whether a
+ * chunk is the last one of its frame. Payloads of control frames are
+ * handed out whole.
+ */
 class websocket_parser {
     enum class parsing_state : uint8_t {
         flags_and_payload_data,
@@ -110,6 +128,12 @@ class websocket_parser {
     uint64_t _consumed_payload_length = 0;
     uint32_t _masking_key;
     buff_t _result;
+    // RSV1 marks compressed messages once permessage-deflate is negotiated
+    bool _allow_compression = false;
+    // Whether the data message the current frame belongs to is compressed
+    bool _message_compressed = false;
+    // Frames sent by clients are masked, frames sent by servers are not
+    bool _masked_frames;
 
     static future<consumption_result_t> dont_stop() {
         return make_ready_future<consumption_result_t>(continue_consuming{});
@@ -120,23 +144,42 @@ class websocket_parser {
     uint64_t remaining_payload_length() const {
         return _payload_length - _consumed_payload_length;
     }
-
-    // Removes mask from payload given in p.
-    void remove_mask(buff_t& p, size_t n) {
-        char *payload = p.get_write();
-        for (uint64_t i = 0, j = 0; i < n; ++i, j = (j + 1) % 4) {
-            payload[i] ^= static_cast<char>(((_masking_key << (j * 8)) >> 24));
-        }
+    bool is_control_frame() const {
+        return _header->opcode & 0x8;
     }
+    bool check_header();
+    future<consumption_result_t> parse_control_payload(temporary_buffer<char> data);
 public:
-    websocket_parser() : _state(parsing_state::flags_and_payload_data),
+    /*!
+     * \param masked_frames whether frames are expected to be masked, which is
+     * the case for the frames a server receives, but not for a client
+     */
+    explicit websocket_parser(bool masked_frames = true)
+                       : _state(parsing_state::flags_and_payload_data),
                          _cstate(connection_state::valid),
-                         _masking_key(0) {}
+                         _masking_key(0),
+                         _masked_frames(masked_frames) {}
     future<consumption_result_t> operator()(temporary_buffer<char> data);
     bool is_valid() { return _cstate == connection_state::valid; }
     bool eof() { return _cstate == connection_state::closed; }
     opcodes opcode() const;
     buff_t result();
+    /// Whether result() completes the payload of the current frame
+    bool end_of_frame() const {
+        return _state != parsing_state::payload;
+    }
+    /// Whether result() completes the payload of the current message
+    bool end_of_message() const {
+        return end_of_frame() && _header && _header->fin;
+    }
+    /// Whether the current data message is compressed (permessage-deflate)
+    bool compressed() const {
+        return _message_compressed;
+    }
+    /// Accept compressed messages, once permessage-deflate is negotiated
+    void set_compression(bool allow) {
+        _allow_compression = allow;
+    }
 };
 
 /// @}
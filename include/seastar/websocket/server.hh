@@ -28,6 +28,7 @@
 #include <seastar/core/sstring.hh>
 #include <seastar/core/gate.hh>
 #include <seastar/core/queue.hh>
+#include <seastar/core/sharded.hh>
 #include <seastar/core/when_all.hh>
 #include <seastar/websocket/common.hh>
 
@@ -43,6 +44,9 @@ class server_connection : public connection {
 
     server& _server;
     http_request_parser _http_parser;
+    // Set once the upgrade reply is sent, broadcasts are sent from then on
+    bool _upgraded = false;
+    gate _broadcasts;
 
 public:
     /*!
@@ -65,6 +69,11 @@ class server_connection : public connection {
     future<> read_loop();
     future<> read_http_upgrade_request();
     void on_new_connection();
+    // Sends a broadcast frame, if the connection is established. Failures
+    // are left to the connection's own processing.
+    future<> send_broadcast(broadcast_frame frame);
+
+    friend class server;
 };
 
 /*!
@@ -77,6 +86,7 @@ class server {
     std::vector<server_socket> _listeners;
     boost::intrusive::list<server_connection> _connections;
     std::map<std::string, handler_t> _handlers;
+    std::optional<permessage_deflate_options> _deflate_options;
     gate _task_gate;
 public:
     /*!
@@ -106,12 +116,46 @@ class server {
      */
     void register_handler(const std::string& name, handler_t handler);
 
+    /*!
+     * \brief Accept the permessage-deflate extension when clients offer it
+     * \param opts settings of the compression of sent messages
+     */
+    void enable_permessage_deflate(permessage_deflate_options opts = {});
+
+    /*!
+     * \brief Sends a message to all the established connections of the server
+     *
+     * Each connection sends the frame after the messages it's already
+     * sending, and before those sent afterwards. Connections which close
+     * meanwhile are skipped.
+     * \param frame the message, see \ref broadcast_frame
+     * \return a future resolved once the frame was sent on every connection
+     */
+    future<> broadcast(broadcast_frame frame);
+
+    /*!
+     * \brief The compression settings of the server, to make the \ref
+     * broadcast_frame "frames" it broadcasts with
+     */
+    const std::optional<permessage_deflate_options>& deflate_options() const noexcept {
+        return _deflate_options;
+    }
+
     friend class server_connection;
 protected:
     void accept(server_socket &listener);
     future<stop_iteration> accept_one(server_socket &listener);
 };
 
+/*!
+ * \brief Sends a message to all the established connections of the servers
+ * of all shards
+ *
+ * The frame is made once, and the other shards send the memory of the
+ * calling shard rather than a copy, which they release once done.
+ */
+future<> broadcast(sharded<server>& servers, broadcast_frame frame);
+
 /// }@
 
 }
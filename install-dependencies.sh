@@ -44,10 +44,13 @@ debian_packages=(
     libpciaccess-dev
     libprotobuf-dev
     libsctp-dev
+    libssl-dev
     libtool
     liburing-dev
     libxml2-dev
     libyaml-cpp-dev
+    libzstd-dev
+    zlib1g-dev
     make
     meson
     ninja-build
@@ -91,11 +94,13 @@ redhat_packages=(
     liburing-devel
     libxml2-devel
     lksctp-tools-devel
+    libzstd-devel
     lz4-devel
     make
     meson
     numactl-devel
     openssl
+    openssl-devel
     protobuf-compiler
     protobuf-devel
     python3
@@ -106,6 +111,7 @@ redhat_packages=(
     valgrind-devel
     xfsprogs-devel
     yaml-cpp-devel
+    zlib-devel
     "${transitive[@]}"
 )
 
@@ -196,6 +202,8 @@ arch_packages=(
     valgrind
     xfsprogs
     yaml-cpp
+    zlib
+    zstd
 )
 
 opensuse_packages=(
@@ -227,12 +235,15 @@ opensuse_packages=(
     meson
     ninja
     openssl
+    libopenssl-devel
     protobuf-devel
     python3-PyYAML
     ragel
     stow
     xfsprogs-devel
     yaml-cpp-devel
+    libzstd-devel
+    zlib-devel
 )
 
 case "$ID" in
@@ -469,6 +469,18 @@ def create_enum_wrapper(model_name, name, values):
                      enum_name=enum_name,
                      value=values[0])
 
+    case_clauses = "\n".join(
+        Template('''if (s == "$enum_entry") { w.v = $enum_name::$enum_entry; return w; }''').substitute(
+            enum_name=enum_name, enum_entry=enum_entry) for enum_entry in values)
+    res += Template("""
+    static $wrapper from_json_string(std::string_view s) {
+        $wrapper w;
+        $case_clauses
+        throw json::parse_error("unknown $name value");
+    }""").substitute(wrapper=wrapper,
+                     name=name,
+                     case_clauses=indent_body(case_clauses, 2))
+
     res += Template("""
     typedef typename std::underlying_type<$enum_name>::type pos_type;
     $wrapper& operator++() {
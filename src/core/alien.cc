@@ -57,13 +57,80 @@ message_queue::lf_queue::maybe_wakeup() {
     remote->wakeup();
 }
 
+void message_queue::set_max_pending(size_t max_pending) noexcept {
+    _flow.max_pending.store(max_pending, std::memory_order_relaxed);
+}
+
+bool message_queue::has_room(size_t nr) const noexcept {
+    auto max_pending = _flow.max_pending.load(std::memory_order_relaxed);
+    auto queued = _flow.queued.load();
+    // A batch larger than the bound gets in once the queue is empty
+    return !max_pending || queued <= 0 || size_t(queued) + nr <= max_pending;
+}
+
+void message_queue::wait_for_room(size_t nr) {
+    while (!has_room(nr)) {
+        auto queued = _flow.queued.load();
+        // Pairs with process_incoming(): either it sees us blocked and
+        // notifies, or we see the count it lowered and don't wait
+        _flow.blocked.fetch_add(1);
+        if (!has_room(nr)) {
+            _flow.queued.wait(queued);
+        }
+        _flow.blocked.fetch_sub(1);
+    }
+}
+
+void message_queue::queued(size_t nr) noexcept {
+    _sent.value.fetch_add(nr, std::memory_order_relaxed);
+    if (_flow.queued.fetch_add(nr) <= 0) {
+        _pending.maybe_wakeup();
+    }
+}
+
 void message_queue::submit_item(std::unique_ptr<message_queue::work_item> item) {
+    wait_for_room(1);
+    if (!_pending.push(item.get())) {
+        throw std::bad_alloc();
+    }
+    item.release();
+    queued(1);
+}
+
+bool message_queue::try_submit_item(std::unique_ptr<message_queue::work_item>& item) {
+    if (!has_room(1)) {
+        return false;
+    }
     if (!_pending.push(item.get())) {
         throw std::bad_alloc();
     }
     item.release();
-    _pending.maybe_wakeup();
-    ++_sent.value;
+    queued(1);
+    return true;
+}
+
+void message_queue::submit_items(std::vector<std::unique_ptr<message_queue::work_item>>& items) {
+    wait_for_room(items.size());
+    size_t pushed = 0;
+    while (pushed < items.size() && _pending.push(items[pushed].get())) {
+        items[pushed++].release();
+    }
+    if (pushed) {
+        queued(pushed);
+    }
+    // Whatever could not be pushed stays in the batch
+    items.erase(items.begin(), items.begin() + pushed);
+    if (!items.empty()) {
+        throw std::bad_alloc();
+    }
+}
+
+batch::~batch() {
+    try {
+        flush();
+    } catch (...) {
+        seastar_logger.error("alien::batch: dropping {} messages that could not be sent: {}", _messages.size(), std::current_exception());
+    }
 }
 
 bool message_queue::pure_poll_rx() const {
@@ -107,6 +174,10 @@ size_t message_queue::process_incoming() {
     });
     _received += nr;
     _last_rcv_batch = nr;
+    _flow.queued.fetch_sub(nr);
+    if (_flow.blocked.load()) {
+        _flow.queued.notify_all();
+    }
     return nr;
 }
 
@@ -150,6 +221,12 @@ bool instance::pure_poll_queues() {
     return queue.pure_poll_rx();
 }
 
+void instance::set_max_pending(size_t max_pending) noexcept {
+    for (unsigned i = 0; i < _qs.get_deleter().count; i++) {
+        _qs[i].set_max_pending(max_pending);
+    }
+}
+
 instance* internal::default_instance;
 
 }
@@ -0,0 +1,535 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <compare>
+#include <cstring>
+#include <limits>
+#include <list>
+#include <map>
+#include <stdexcept>
+#include <vector>
+#include <boost/intrusive/list.hpp>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/cached_file.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/layered_file.hh>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/core/print.hh>
+#endif
+
+namespace seastar {
+
+namespace bi = boost::intrusive;
+
+class block_cache::impl {
+public:
+    struct key {
+        uint64_t file;
+        uint64_t index;
+        auto operator<=>(const key&) const = default;
+    };
+private:
+    struct block {
+        key k;
+        temporary_buffer<char> data;
+        // resolved when the read of the block completes
+        shared_promise<> ready;
+        bool loaded = false;
+        // in _t2 rather than _t1
+        bool frequent = false;
+        bi::list_member_hook<> hook;
+
+        explicit block(key k) noexcept : k(k) {}
+    };
+    using block_list = bi::list<block, bi::member_hook<block, bi::list_member_hook<>, &block::hook>>;
+
+    block_cache_config _cfg;
+    size_t _capacity_blocks;
+    stats _stats;
+    size_t _used = 0;
+    uint64_t _next_file = 0;
+    // the blocks being read and the cached ones, only the latter are in
+    // _t1 or _t2. A block that was dropped while it was being read is no
+    // longer here, and is not cached when the read completes.
+    std::map<key, lw_shared_ptr<block>> _blocks;
+    // Cached blocks, most recent first. With LRU eviction, all are in _t1.
+    // With ARC, _t1 has the blocks read once since they were cached, _t2
+    // the ones read again.
+    block_list _t1;
+    block_list _t2;
+    // ARC ghost lists, the keys of the blocks recently evicted from _t1
+    // and _t2, most recent first
+    std::list<key> _b1;
+    std::list<key> _b2;
+    struct ghost {
+        bool frequent;
+        std::list<key>::iterator it;
+    };
+    std::map<key, ghost> _ghosts;
+    // ARC target size of _t1, in blocks
+    size_t _p = 0;
+    memory::reclaimer _reclaimer;
+    metrics::metric_groups _metrics;
+
+    size_t cached_blocks() const noexcept {
+        return _t1.size() + _t2.size();
+    }
+
+    void unlink(block& b) noexcept {
+        (b.frequent ? _t2 : _t1).erase(block_list::s_iterator_to(b));
+        _used -= b.data.size();
+    }
+
+    void drop_ghost(std::list<key>& l) noexcept {
+        _ghosts.erase(l.back());
+        l.pop_back();
+    }
+
+    // evicts the least recent block of l, remembering it in ghosts
+    void evict_lru(block_list& l, std::list<key>* ghosts) noexcept {
+        auto& b = l.back();
+        auto k = b.k;
+        unlink(b);
+        _blocks.erase(k);
+        if (!ghosts) {
+            return;
+        }
+        try {
+            ghosts->push_front(k);
+            _ghosts.emplace(k, ghost{ghosts == &_b2, ghosts->begin()});
+        } catch (...) {
+            // a ghost less only makes ARC adapt less accurately
+            if (!ghosts->empty() && ghosts->front() == k) {
+                ghosts->pop_front();
+            }
+        }
+        // bound the history, which evictions by the reclaimer make grow
+        if (_ghosts.size() > _capacity_blocks) {
+            drop_ghost(_b1.size() >= _b2.size() ? _b1 : _b2);
+        }
+    }
+
+    // ARC REPLACE: evicts a block of _t1 or of _t2, as _p tells
+    void replace(bool hit_in_b2) noexcept {
+        if (_cfg.eviction == block_cache_eviction::lru) {
+            evict_lru(_t1, nullptr);
+        } else if (!_t1.empty() && (_t1.size() > _p || (hit_in_b2 && _t1.size() == _p) || _t2.empty())) {
+            evict_lru(_t1, &_b1);
+        } else {
+            evict_lru(_t2, &_b2);
+        }
+    }
+
+    void evict_one() noexcept {
+        replace(false);
+        ++_stats.evictions;
+    }
+
+    // caches a block which was just read
+    void admit(block& b) {
+        auto g = _ghosts.find(b.k);
+        if (_cfg.eviction == block_cache_eviction::arc && g != _ghosts.end()) {
+            // a block evicted too early: grow the list it was evicted from
+            bool frequent = g->second.frequent;
+            if (!frequent) {
+                _p = std::min(_capacity_blocks, _p + std::max<size_t>(_b2.size() / _b1.size(), 1));
+                _b1.erase(g->second.it);
+            } else {
+                _p -= std::min(_p, std::max<size_t>(_b1.size() / _b2.size(), 1));
+                _b2.erase(g->second.it);
+            }
+            _ghosts.erase(g);
+            if (cached_blocks() >= _capacity_blocks) {
+                replace(frequent);
+                ++_stats.evictions;
+            }
+            b.frequent = true;
+            _t2.push_front(b);
+        } else {
+            if (_cfg.eviction == block_cache_eviction::arc) {
+                if (_t1.size() + _b1.size() >= _capacity_blocks) {
+                    if (_t1.size() < _capacity_blocks) {
+                        drop_ghost(_b1);
+                    } else {
+                        evict_lru(_t1, nullptr);
+                        ++_stats.evictions;
+                    }
+                } else if (cached_blocks() + _b1.size() + _b2.size() >= 2 * _capacity_blocks && !_b2.empty()) {
+                    drop_ghost(_b2);
+                }
+            }
+            while (cached_blocks() >= _capacity_blocks) {
+                evict_one();
+            }
+            _t1.push_front(b);
+        }
+        _used += b.data.size();
+    }
+
+    void touch(block& b) noexcept {
+        if (_cfg.eviction == block_cache_eviction::lru || b.frequent) {
+            auto& l = b.frequent ? _t2 : _t1;
+            l.erase(block_list::s_iterator_to(b));
+            l.push_front(b);
+        } else {
+            _t1.erase(block_list::s_iterator_to(b));
+            b.frequent = true;
+            _t2.push_front(b);
+        }
+    }
+
+    memory::reclaiming_result reclaim(memory::reclaimer::request r) noexcept {
+        size_t freed = 0;
+        while (freed < r.bytes_to_reclaim && cached_blocks()) {
+            auto before = _used;
+            replace(false);
+            freed += before - _used;
+            ++_stats.reclaimed;
+        }
+        return freed ? memory::reclaiming_result::reclaimed_something : memory::reclaiming_result::reclaimed_nothing;
+    }
+
+    void setup_metrics(const sstring& name) {
+        namespace sm = seastar::metrics;
+        auto cache_label = sm::label("cache");
+        _metrics.add_group("block_cache", {
+            sm::make_counter("hits", _stats.hits, sm::description("Block lookups served from memory"), {cache_label(name)}),
+            sm::make_counter("misses", _stats.misses, sm::description("Block lookups that read the underlying file"), {cache_label(name)}),
+            sm::make_counter("coalesced", _stats.coalesced, sm::description("Block lookups that waited for the read of another one"), {cache_label(name)}),
+            sm::make_counter("evictions", _stats.evictions, sm::description("Blocks evicted to make room for others"), {cache_label(name)}),
+            sm::make_counter("reclaimed", _stats.reclaimed, sm::description("Blocks evicted because the shard was low on memory"), {cache_label(name)}),
+            sm::make_counter("invalidations", _stats.invalidations, sm::description("Blocks dropped by writes, truncations or closes"), {cache_label(name)}),
+            sm::make_gauge("bytes", [this] { return _used; }, sm::description("Memory used by the cached blocks"), {cache_label(name)}),
+            sm::make_gauge("blocks", [this] { return cached_blocks(); }, sm::description("Number of cached blocks"), {cache_label(name)}),
+        });
+    }
+public:
+    impl(sstring name, block_cache_config cfg)
+        : _cfg(cfg)
+        , _capacity_blocks(std::max<size_t>(cfg.capacity / std::max<size_t>(cfg.block_size, 1), 1))
+        , _reclaimer([this] (memory::reclaimer::request r) { return reclaim(r); }, memory::reclaimer_scope::async, cfg.reclaimer_priority)
+    {
+        if (!_cfg.block_size) {
+            throw std::invalid_argument("block_cache block size must not be zero");
+        }
+        setup_metrics(name);
+    }
+
+    ~impl() {
+        clear();
+    }
+
+    const block_cache_config& config() const noexcept {
+        return _cfg;
+    }
+
+    const stats& get_stats() const noexcept {
+        return _stats;
+    }
+
+    size_t memory_used() const noexcept {
+        return _used;
+    }
+
+    uint64_t new_file() noexcept {
+        return _next_file++;
+    }
+
+    /// Returns the block of file at index, reading it from f if needed.
+    /// The block is shorter than the block size at the end of the file.
+    future<temporary_buffer<char>> get(uint64_t file_id, file& f, uint64_t index) {
+        auto k = key{file_id, index};
+        auto it = _blocks.find(k);
+        if (it != _blocks.end()) {
+            auto b = it->second;
+            if (b->loaded) {
+                ++_stats.hits;
+                touch(*b);
+                return make_ready_future<temporary_buffer<char>>(b->data.share());
+            }
+            ++_stats.coalesced;
+            return b->ready.get_shared_future().then([b] {
+                return b->data.share();
+            });
+        }
+        ++_stats.misses;
+        auto b = make_lw_shared<block>(k);
+        _blocks.emplace(k, b);
+        return f.dma_read_bulk<char>(index * _cfg.block_size, _cfg.block_size).then_wrapped([this, b] (future<temporary_buffer<char>> fut) {
+            auto it = _blocks.find(b->k);
+            bool current = it != _blocks.end() && it->second == b;
+            if (fut.failed()) {
+                auto ex = fut.get_exception();
+                if (current) {
+                    _blocks.erase(it);
+                }
+                b->ready.set_exception(ex);
+                return make_exception_future<temporary_buffer<char>>(std::move(ex));
+            }
+            b->data = fut.get();
+            b->loaded = true;
+            b->ready.set_value();
+            if (current) {
+                if (b->data.size() < _cfg.block_size) {
+                    // the end of the file, which may grow past it without
+                    // a write to this block, e.g. by a truncation
+                    _blocks.erase(it);
+                } else {
+                    try {
+                        admit(*b);
+                    } catch (...) {
+                        _blocks.erase(it);
+                    }
+                }
+            }
+            return make_ready_future<temporary_buffer<char>>(b->data.share());
+        });
+    }
+
+    /// Drops the blocks of a file from first to last, included
+    void invalidate(uint64_t file_id, uint64_t first, uint64_t last) noexcept {
+        auto it = _blocks.lower_bound(key{file_id, first});
+        auto end = _blocks.upper_bound(key{file_id, last});
+        while (it != end) {
+            auto& b = *it->second;
+            if (b.hook.is_linked()) {
+                unlink(b);
+                ++_stats.invalidations;
+            }
+            it = _blocks.erase(it);
+        }
+    }
+
+    void clear() noexcept {
+        for (auto& [k, b] : _blocks) {
+            if (b->hook.is_linked()) {
+                unlink(*b);
+            }
+        }
+        _blocks.clear();
+        _ghosts.clear();
+        _b1.clear();
+        _b2.clear();
+        _p = 0;
+    }
+};
+
+block_cache::block_cache(sstring name, block_cache_config cfg)
+    : _impl(std::make_unique<impl>(std::move(name), cfg))
+{
+}
+
+block_cache::~block_cache() = default;
+
+const block_cache_config& block_cache::config() const noexcept {
+    return _impl->config();
+}
+
+const block_cache::stats& block_cache::get_stats() const noexcept {
+    return _impl->get_stats();
+}
+
+size_t block_cache::memory_used() const noexcept {
+    return _impl->memory_used();
+}
+
+void block_cache::clear() noexcept {
+    _impl->clear();
+}
+
+class cached_file_impl : public layered_file_impl {
+    block_cache::impl& _cache;
+    uint64_t _id;
+    size_t _block_size;
+    gate _gate;
+
+    uint64_t first_block(uint64_t pos) const noexcept {
+        return pos / _block_size;
+    }
+    uint64_t last_block(uint64_t pos, uint64_t len) const noexcept {
+        return (pos + std::max<uint64_t>(len, 1) - 1) / _block_size;
+    }
+
+    void invalidate(uint64_t pos, uint64_t len) noexcept {
+        _cache.invalidate(_id, first_block(pos), last_block(pos, len));
+    }
+
+    // reads the blocks covering [pos, pos + len), concurrently
+    future<std::vector<temporary_buffer<char>>> get_blocks(uint64_t pos, size_t len) {
+        std::vector<future<temporary_buffer<char>>> blocks;
+        auto last = last_block(pos, len);
+        blocks.reserve(last - first_block(pos) + 1);
+        for (auto i = first_block(pos); i <= last; ++i) {
+            blocks.push_back(_cache.get(_id, _underlying_file, i));
+        }
+        return when_all_succeed(std::move(blocks));
+    }
+
+    // calls copy(offset, data, size) for each part of [pos, pos + len)
+    // that is in the file, returns the bytes copied
+    template <typename Copy>
+    size_t copy_from_blocks(const std::vector<temporary_buffer<char>>& blocks, uint64_t pos, size_t len, Copy copy) const {
+        size_t done = 0;
+        for (auto& b : blocks) {
+            auto in_block = (pos + done) % _block_size;
+            if (in_block >= b.size()) {
+                break;
+            }
+            auto n = std::min(len - done, b.size() - in_block);
+            copy(done, b.get() + in_block, n);
+            done += n;
+            if (b.size() < _block_size) {
+                // end of file
+                break;
+            }
+        }
+        return done;
+    }
+
+    future<size_t> do_read(uint64_t pos, size_t len, std::function<void(size_t, const char*, size_t)> copy) {
+        if (!len) {
+            co_return 0;
+        }
+        auto holder = _gate.hold();
+        auto blocks = co_await get_blocks(pos, len);
+        co_return copy_from_blocks(blocks, pos, len, copy);
+    }
+
+    template <typename Func>
+    auto invalidating(uint64_t pos, uint64_t len, Func&& func) {
+        // blocks read while the operation is in progress may predate it
+        invalidate(pos, len);
+        return func().finally([this, pos, len] {
+            invalidate(pos, len);
+        });
+    }
+public:
+    cached_file_impl(file f, block_cache& cache)
+        : layered_file_impl(std::move(f))
+        , _cache(cache.get_impl())
+        , _id(_cache.new_file())
+        , _block_size(cache.config().block_size)
+    {
+        if (_block_size % _disk_read_dma_alignment) {
+            throw std::invalid_argument(format("block_cache block size {} is not a multiple of the file read alignment {}",
+                    _block_size, _disk_read_dma_alignment));
+        }
+    }
+
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, io_intent* intent) override {
+        return invalidating(pos, len, [=, this] {
+            return _underlying_file.dma_write(pos, reinterpret_cast<const char*>(buffer), len, intent);
+        });
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) override {
+        size_t len = 0;
+        for (auto& v : iov) {
+            len += v.iov_len;
+        }
+        return invalidating(pos, len, [=, this, iov = std::move(iov)] () mutable {
+            return _underlying_file.dma_write(pos, std::move(iov), intent);
+        });
+    }
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, io_intent*) override {
+        return do_read(pos, len, [buffer] (size_t offset, const char* data, size_t n) {
+            std::memcpy(static_cast<char*>(buffer) + offset, data, n);
+        });
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, io_intent*) override {
+        size_t len = 0;
+        for (auto& v : iov) {
+            len += v.iov_len;
+        }
+        return do_read(pos, len, [iov = std::move(iov)] (size_t offset, const char* data, size_t n) {
+            // find the iovec at offset, then scatter
+            auto v = iov.begin();
+            while (offset >= v->iov_len) {
+                offset -= v->iov_len;
+                ++v;
+            }
+            while (n) {
+                auto part = std::min(n, v->iov_len - offset);
+                std::memcpy(static_cast<char*>(v->iov_base) + offset, data, part);
+                data += part;
+                n -= part;
+                offset = 0;
+                ++v;
+            }
+        });
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, io_intent*) override {
+        auto holder = _gate.hold();
+        // the caller owns the buffer and may write to it, so it is a copy
+        // rather than a share of the cached blocks
+        auto buf = temporary_buffer<uint8_t>::aligned(_memory_dma_alignment, range_size);
+        auto n = co_await read_dma(offset, buf.get_write(), range_size, nullptr);
+        buf.trim(n);
+        co_return buf;
+    }
+
+    virtual future<> flush() override {
+        return _underlying_file.flush();
+    }
+    virtual future<struct stat> stat() override {
+        return _underlying_file.stat();
+    }
+    virtual future<> truncate(uint64_t length) override {
+        return invalidating(length, std::numeric_limits<uint64_t>::max() - length, [this, length] {
+            return _underlying_file.truncate(length);
+        });
+    }
+    virtual future<> discard(uint64_t offset, uint64_t length) override {
+        return invalidating(offset, length, [this, offset, length] {
+            return _underlying_file.discard(offset, length);
+        });
+    }
+    virtual future<> allocate(uint64_t position, uint64_t length) override {
+        return _underlying_file.allocate(position, length);
+    }
+    virtual future<uint64_t> size() override {
+        return _underlying_file.size();
+    }
+    virtual future<> close() override {
+        co_await _gate.close();
+        _cache.invalidate(_id, 0, std::numeric_limits<uint64_t>::max());
+        co_await _underlying_file.close();
+    }
+    virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)> next) override {
+        return _underlying_file.list_directory(std::move(next));
+    }
+};
+
+file make_cached_file(file f, block_cache& cache) {
+    return file(make_shared<cached_file_impl>(std::move(f), cache));
+}
+
+}
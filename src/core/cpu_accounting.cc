@@ -0,0 +1,245 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/cpu_accounting.hh>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/task.hh>
+#endif
+
+namespace seastar {
+
+namespace cpu_accounting {
+
+namespace internal {
+
+struct tag_state {
+    const sstring* name = nullptr;
+    std::chrono::steady_clock::duration runtime{0};
+    uint64_t switches = 0;
+    // Fibers the tag is current for, see with_tag()
+    unsigned users = 0;
+    // Slot of the tag in the shard's table while it has users, 0 otherwise
+    uint8_t slot = 0;
+};
+
+}
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// The tags of the shard, and those which tasks may refer to through their
+// tag slot, slot 0 standing for none. A slot's generation changes whenever
+// its tag is released, and tasks carry it along with the slot, so that a
+// task which outlived the fibers of its tag is not charged to the next tag
+// in the slot. Freed slots are reused in the order they were freed, so
+// that the 8-bit generation takes long to come around.
+struct tag_slot {
+    internal::tag_state* state = nullptr;
+    uint8_t generation = 0;
+};
+
+struct tag_table {
+    std::unordered_map<sstring, internal::tag_state> tags;
+    std::array<tag_slot, 256> slots{};
+    unsigned used_slots = 1;
+    std::deque<uint8_t> free;
+    // What the time since the last switch is charged to
+    internal::tag_state* charged = nullptr;
+    clock_type::time_point charged_since;
+    size_t exported_tags = 10;
+    std::vector<const internal::tag_state*> exported;
+};
+
+thread_local tag_table table;
+
+uint16_t make_handle(uint8_t slot) noexcept {
+    return uint16_t(table.slots[slot].generation) << 8 | slot;
+}
+
+internal::tag_state* state_of(uint16_t handle) noexcept {
+    auto& s = table.slots[handle & 0xff];
+    return s.generation == handle >> 8 ? s.state : nullptr;
+}
+
+tag_usage to_usage(const internal::tag_state& st) {
+    return tag_usage{*st.name, std::chrono::duration_cast<std::chrono::nanoseconds>(st.runtime), st.switches};
+}
+
+// Charges the time so far to the current tag, for it to be up to date
+void charge_current() noexcept {
+    if (table.charged) {
+        auto now = clock_type::now();
+        table.charged->runtime += now - table.charged_since;
+        table.charged_since = now;
+    }
+}
+
+// The n tags which used the most time, in decreasing order
+std::vector<const internal::tag_state*> top_states(size_t n) {
+    charge_current();
+    std::vector<const internal::tag_state*> states;
+    states.reserve(table.tags.size());
+    for (auto& [name, st] : table.tags) {
+        states.push_back(&st);
+    }
+    n = std::min(n, states.size());
+    std::partial_sort(states.begin(), states.begin() + n, states.end(), [] (const internal::tag_state* a, const internal::tag_state* b) {
+        return a->runtime > b->runtime;
+    });
+    states.resize(n);
+    return states;
+}
+
+}
+
+namespace internal {
+
+void switch_tag(uint16_t slot) noexcept {
+    auto next = state_of(slot);
+    if (next == table.charged) {
+        return;
+    }
+    auto now = clock_type::now();
+    if (table.charged) {
+        table.charged->runtime += now - table.charged_since;
+    }
+    if (next) {
+        next->switches++;
+    }
+    table.charged = next;
+    table.charged_since = now;
+}
+
+tag_state* enter_tag(const sstring& tag, uint16_t& previous) noexcept {
+    tag_state* st;
+    try {
+        auto it = table.tags.try_emplace(tag).first;
+        st = &it->second;
+        st->name = &it->first;
+        if (!st->slot) {
+            if (!table.free.empty()) {
+                st->slot = table.free.front();
+                table.free.pop_front();
+            } else if (table.used_slots < table.slots.size()) {
+                st->slot = table.used_slots++;
+            } else {
+                return nullptr;
+            }
+            table.slots[st->slot].state = st;
+        }
+    } catch (...) {
+        // runs in the tag of the caller
+        return nullptr;
+    }
+    st->users++;
+    auto& current = *seastar::internal::current_cpu_tag_slot_ptr();
+    previous = current;
+    current = make_handle(st->slot);
+    switch_tag(current);
+    return st;
+}
+
+void exit_tag(uint16_t previous) noexcept {
+    *seastar::internal::current_cpu_tag_slot_ptr() = previous;
+    switch_tag(previous);
+}
+
+void release_tag(tag_state* st) noexcept {
+    if (--st->users) {
+        return;
+    }
+    table.slots[st->slot].state = nullptr;
+    table.slots[st->slot].generation++;
+    try {
+        table.free.push_back(st->slot);
+    } catch (...) {
+        // the slot is lost
+    }
+    st->slot = 0;
+}
+
+void export_top_tags(metrics::metric_groups& mg) {
+    auto top = top_states(table.exported_tags);
+    // In the same order whenever the set is the same, so that it is only
+    // registered again when it changed
+    std::ranges::sort(top);
+    if (top == table.exported) {
+        return;
+    }
+    namespace sm = seastar::metrics;
+    auto tag_label = sm::label("tag");
+    std::vector<sm::metric_definition> defs;
+    for (auto st : top) {
+        defs.emplace_back(sm::make_counter("tag_runtime_ms", [st] { return st->runtime / std::chrono::milliseconds(1); },
+                sm::description("Reactor time of the tasks which ran in the CPU accounting tag, in milliseconds. "
+                        "Only the tags which used the most time on the shard are exported"),
+                {tag_label(*st->name)}));
+    }
+    mg.clear();
+    mg.add_group("cpu_accounting", std::move(defs));
+    table.exported = std::move(top);
+}
+
+}
+
+const sstring* current_tag() noexcept {
+    auto st = state_of(*seastar::internal::current_cpu_tag_slot_ptr());
+    return st ? st->name : nullptr;
+}
+
+std::optional<tag_usage> usage(const sstring& tag) {
+    charge_current();
+    auto it = table.tags.find(tag);
+    if (it == table.tags.end()) {
+        return std::nullopt;
+    }
+    return to_usage(it->second);
+}
+
+std::vector<tag_usage> top(size_t n) {
+    std::vector<tag_usage> ret;
+    for (auto st : top_states(n)) {
+        ret.push_back(to_usage(*st));
+    }
+    return ret;
+}
+
+void set_exported_tags(size_t n) noexcept {
+    table.exported_tags = n;
+}
+
+}
+
+}
@@ -0,0 +1,169 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <random>
+#include <system_error>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/internal/cpu_profiler.hh>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/core/scheduling.hh>
+#endif
+
+namespace seastar::internal {
+
+using namespace std::chrono_literals;
+
+cpu_profiler::cpu_profiler()
+        : _rand_state(std::random_device()() | 1) {
+    struct sigevent sev = {};
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = signal_number();
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+    sev.sigev_notify_thread_id = syscall(SYS_gettid);
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &_timer) == -1) {
+        throw std::system_error(errno, std::system_category(), "timer_create() failed");
+    }
+
+    namespace sm = seastar::metrics;
+    _metrics.add_group("cpu_profiler", {
+        sm::make_counter("samples", [this] { return _samples; },
+                sm::description("Total number of backtraces sampled by the CPU profiler")),
+        sm::make_counter("dropped_samples", [this] { return _dropped.load(std::memory_order_relaxed); },
+                sm::description("Total number of samples dropped by the CPU profiler, for lack of room to keep them")),
+    });
+}
+
+cpu_profiler::~cpu_profiler() {
+    timer_delete(_timer);
+}
+
+void cpu_profiler::arm_timer() noexcept {
+    auto its = posix::to_relative_itimerspec(0s, 0s);
+    if (auto period = _period.count()) {
+        // A random delay averaging the period keeps the samples from
+        // following periodic work in lockstep (xorshift64)
+        _rand_state ^= _rand_state << 13;
+        _rand_state ^= _rand_state >> 7;
+        _rand_state ^= _rand_state << 17;
+        its = posix::to_relative_itimerspec(std::chrono::nanoseconds(period / 2 + _rand_state % period), 0s);
+    }
+    timer_settime(_timer, 0, &its, nullptr);
+}
+
+void cpu_profiler::set_period(std::chrono::nanoseconds period) {
+    if (period.count() && !_ring) {
+        _ring = std::make_unique<sample[]>(ring_size);
+    }
+    _period = period;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    arm_timer();
+}
+
+void cpu_profiler::on_signal(uintptr_t pc, bool stalled) noexcept {
+    if (!_period.count()) {
+        // raced with set_period(0)
+        return;
+    }
+    auto head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_relaxed) == ring_size) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        simple_backtrace::vector_type frames;
+        backtrace([&] (frame f) {
+            if (frames.size() < frames.capacity()) {
+                frames.push_back(f);
+            }
+        });
+        // Skip the frames of the signal handler: frames are one byte into
+        // their instruction, and the one of the interrupted code points
+        // to the instruction itself
+        auto interrupted = std::find_if(frames.begin(), frames.end(), [pc] (const frame& f) {
+            return f.so->begin + f.addr + 1 == pc;
+        });
+        if (interrupted != frames.end()) {
+            frames.erase(frames.begin(), interrupted);
+        }
+        auto& s = _ring[head % ring_size];
+        s.backtrace = simple_backtrace(std::move(frames));
+        s.sg_id = scheduling_group_index(current_scheduling_group());
+        s.stalled = stalled;
+        std::atomic_signal_fence(std::memory_order_release);
+        _head.store(head + 1, std::memory_order_relaxed);
+    }
+    arm_timer();
+}
+
+void cpu_profiler::drain() {
+    auto head = _head.load(std::memory_order_relaxed);
+    std::atomic_signal_fence(std::memory_order_acquire);
+    for (auto tail = _tail.load(std::memory_order_relaxed); tail != head; ++tail) {
+        auto& s = _ring[tail % ring_size];
+        ++_samples;
+        auto i = _backtraces.find(s);
+        if (i == _backtraces.end()) {
+            if (_backtraces.size() == max_backtraces) {
+                // Nobody reads the profile: start over rather than
+                // dropping everything from now on
+                _dropped.fetch_add(_aggregated, std::memory_order_relaxed);
+                _backtraces.clear();
+                _aggregated = 0;
+            }
+            i = _backtraces.emplace(s, 0).first;
+        }
+        ++i->second;
+        ++_aggregated;
+        // The slot can be reused by the signal handler from now on
+        std::atomic_signal_fence(std::memory_order_release);
+        _tail.store(tail + 1, std::memory_order_relaxed);
+    }
+}
+
+std::vector<cpu_profile_entry> cpu_profiler::profile() {
+    drain();
+    std::vector<cpu_profile_entry> ret;
+    ret.reserve(_backtraces.size());
+    for (auto& [s, samples] : _backtraces) {
+        ret.push_back(cpu_profile_entry{
+            .backtrace = s.backtrace,
+            .scheduling_group = scheduling_group_from_index(s.sg_id).name(),
+            .stalled = s.stalled,
+            .samples = samples,
+        });
+    }
+    _backtraces.clear();
+    _aggregated = 0;
+    return ret;
+}
+
+}
@@ -0,0 +1,320 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#include <atomic>
+#include <limits>
+#include <optional>
+#include <vector>
+#include <boost/lockfree/spsc_queue.hpp>
+module seastar;
+#else
+#include <seastar/core/cross_shard_channel.hh>
+#include <seastar/core/cacheline.hh>
+#include <seastar/core/pipe.hh>
+#include <seastar/core/smp.hh>
+#include <atomic>
+#include <limits>
+#include <optional>
+#include <vector>
+#include <boost/lockfree/spsc_queue.hpp>
+#endif
+
+namespace seastar {
+
+namespace {
+
+// Shared by the two ends of a channel, and freed by the last of them, of
+// the messages they send each other, or of the buffers the source handed
+// out, to let it go. It holds the producer's buffers, so it is freed on the
+// producer shard.
+struct channel_state {
+    struct descriptor {
+        char* data;
+        size_t size;
+        uint32_t slot;
+    };
+    static constexpr uint32_t eos_slot = std::numeric_limits<uint32_t>::max();
+
+    const shard_id producer;
+    const shard_id consumer;
+    const cross_shard_channel_config cfg;
+    std::atomic<unsigned> refs{2};
+
+    // buffers put into the sink, with room for the end of stream
+    boost::lockfree::spsc_queue<descriptor> to_consumer;
+    // slots of the buffers the source released
+    boost::lockfree::spsc_queue<uint32_t> to_producer;
+
+    alignas(cache_line_size) std::atomic<bool> consumer_waiting{false};
+    std::atomic<bool> consumer_closed{false};
+    alignas(cache_line_size) std::atomic<bool> producer_waiting{false};
+
+    // Used on the producer shard: the buffers the source may hold, by slot
+    alignas(cache_line_size) std::vector<temporary_buffer<char>> slots;
+    std::vector<uint32_t> free_slots;
+    size_t bytes = 0;
+    std::optional<promise<>> space;
+
+    // Used on the consumer shard
+    alignas(cache_line_size) std::optional<promise<>> data;
+
+    channel_state(shard_id to, cross_shard_channel_config c)
+            : producer(this_shard_id())
+            , consumer(to)
+            , cfg(c)
+            , to_consumer(cfg.max_buffers + 1)
+            , to_producer(cfg.max_buffers)
+            , slots(cfg.max_buffers) {
+        free_slots.reserve(cfg.max_buffers);
+        for (uint32_t i = cfg.max_buffers; i; --i) {
+            free_slots.push_back(i - 1);
+        }
+    }
+
+    void release() noexcept {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (this_shard_id() == producer) {
+                delete this;
+            } else {
+                (void)smp::submit_to(producer, [this] () noexcept {
+                    delete this;
+                });
+            }
+        }
+    }
+
+    template <typename Func>
+    void wake(std::atomic<bool>& waiting, shard_id shard, Func func) noexcept {
+        // pairs with the fence of the waiting side, between setting the
+        // flag and looking at the ring again
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed) && waiting.exchange(false, std::memory_order_relaxed)) {
+            refs.fetch_add(1, std::memory_order_relaxed);
+            (void)smp::submit_to(shard, [this, func = std::move(func)] () noexcept {
+                func();
+                release();
+            });
+        }
+    }
+
+    static void fulfil(std::optional<promise<>>& p) noexcept {
+        if (p) {
+            auto pr = std::move(*p);
+            p.reset();
+            pr.set_value();
+        }
+    }
+
+    void wake_consumer() noexcept {
+        wake(consumer_waiting, consumer, [this] () noexcept { fulfil(data); });
+    }
+
+    void wake_producer() noexcept {
+        wake(producer_waiting, producer, [this] () noexcept { fulfil(space); });
+    }
+
+    // On the consumer shard
+    void returned(uint32_t slot) noexcept {
+        to_producer.push(slot);
+        wake_producer();
+    }
+
+    // On the producer shard, destroys the buffers the source released
+    void reap() noexcept {
+        uint32_t slot;
+        while (to_producer.pop(slot)) {
+            free_slot(slot);
+        }
+        // A closed source won't get the buffers still in the ring
+        if (consumer_closed.load(std::memory_order_acquire)) {
+            descriptor d;
+            while (to_consumer.pop(d)) {
+                if (d.slot != eos_slot) {
+                    free_slot(d.slot);
+                }
+            }
+        }
+    }
+
+    void free_slot(uint32_t slot) noexcept {
+        bytes -= slots[slot].size();
+        slots[slot] = {};
+        free_slots.push_back(slot);
+    }
+};
+
+class channel_sink_impl final : public data_sink_impl {
+    channel_state* _st;
+
+    bool has_room(size_t size) const noexcept {
+        return !_st->free_slots.empty() && (!_st->bytes || _st->bytes + size <= _st->cfg.max_bytes);
+    }
+
+    template <typename Pred>
+    future<> wait(Pred pred) {
+        _st->reap();
+        if (pred()) {
+            return make_ready_future<>();
+        }
+        _st->producer_waiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        _st->reap();
+        if (pred()) {
+            _st->producer_waiting.store(false, std::memory_order_relaxed);
+            return make_ready_future<>();
+        }
+        _st->space.emplace();
+        return _st->space->get_future().then([this, pred] {
+            return wait(pred);
+        });
+    }
+
+    bool consumer_closed() const noexcept {
+        return _st->consumer_closed.load(std::memory_order_acquire);
+    }
+public:
+    explicit channel_sink_impl(channel_state* st) noexcept : _st(st) {}
+    ~channel_sink_impl() {
+        _st->release();
+    }
+
+    virtual future<> put(net::packet data) override {
+        return fallback_put(std::move(data));
+    }
+    virtual future<> put(std::vector<temporary_buffer<char>> data) override {
+        return do_with(std::move(data), [this] (std::vector<temporary_buffer<char>>& data) {
+            return do_for_each(data, [this] (temporary_buffer<char>& buf) {
+                return put(std::move(buf));
+            });
+        });
+    }
+    virtual future<> put(temporary_buffer<char> buf) override {
+        if (buf.empty()) {
+            return make_ready_future<>();
+        }
+        auto size = buf.size();
+        return wait([this, size] { return consumer_closed() || has_room(size); }).then([this, buf = std::move(buf)] () mutable {
+            if (consumer_closed()) {
+                return make_exception_future<>(broken_pipe_exception());
+            }
+            auto slot = _st->free_slots.back();
+            _st->free_slots.pop_back();
+            _st->bytes += buf.size();
+            _st->to_consumer.push(channel_state::descriptor{buf.get_write(), buf.size(), slot});
+            _st->slots[slot] = std::move(buf);
+            _st->wake_consumer();
+            return make_ready_future<>();
+        });
+    }
+    virtual future<> close() override {
+        if (!consumer_closed()) {
+            _st->to_consumer.push(channel_state::descriptor{nullptr, 0, channel_state::eos_slot});
+            _st->wake_consumer();
+        }
+        return wait([this] { return _st->free_slots.size() == _st->cfg.max_buffers; });
+    }
+    virtual size_t buffer_size() const noexcept override {
+        return std::min<size_t>(_st->cfg.max_bytes, 128 * 1024);
+    }
+};
+
+class channel_source_impl final : public data_source_impl {
+    channel_state* _st;
+    bool _eos = false;
+    bool _closed = false;
+
+    future<temporary_buffer<char>> make_buffer(const channel_state::descriptor& d) {
+        if (d.slot == channel_state::eos_slot) {
+            _eos = true;
+            return make_ready_future<temporary_buffer<char>>();
+        }
+        // The buffer keeps the state alive, as the sink may be destroyed
+        // before the buffer is released
+        _st->refs.fetch_add(1, std::memory_order_relaxed);
+        return make_ready_future<temporary_buffer<char>>(temporary_buffer<char>(d.data, d.size,
+                make_deleter([st = _st, slot = d.slot] {
+                    st->returned(slot);
+                    st->release();
+                })));
+    }
+
+    void do_close() noexcept {
+        if (std::exchange(_closed, true)) {
+            return;
+        }
+        channel_state::descriptor d;
+        while (_st->to_consumer.pop(d)) {
+            if (d.slot != channel_state::eos_slot) {
+                _st->to_producer.push(d.slot);
+            }
+        }
+        _st->consumer_closed.store(true, std::memory_order_release);
+        _st->wake_producer();
+    }
+public:
+    explicit channel_source_impl(channel_state* st) noexcept : _st(st) {}
+    ~channel_source_impl() {
+        do_close();
+        _st->release();
+    }
+
+    virtual future<temporary_buffer<char>> get() override {
+        if (_eos || _closed) {
+            return make_ready_future<temporary_buffer<char>>();
+        }
+        channel_state::descriptor d;
+        if (_st->to_consumer.pop(d)) {
+            return make_buffer(d);
+        }
+        _st->consumer_waiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_st->to_consumer.pop(d)) {
+            _st->consumer_waiting.store(false, std::memory_order_relaxed);
+            return make_buffer(d);
+        }
+        _st->data.emplace();
+        return _st->data->get_future().then([this] {
+            return get();
+        });
+    }
+    virtual future<> close() override {
+        do_close();
+        return make_ready_future<>();
+    }
+};
+
+}
+
+cross_shard_channel make_cross_shard_channel(shard_id to, cross_shard_channel_config cfg) {
+    if (!cfg.max_buffers || cfg.max_buffers >= channel_state::eos_slot) {
+        throw std::invalid_argument("cross_shard_channel_config::max_buffers out of range");
+    }
+    auto st = std::make_unique<channel_state>(to, cfg);
+    auto sink = std::make_unique<channel_sink_impl>(st.get());
+    auto source = std::make_unique<channel_source_impl>(st.get());
+    // owned by the two ends from now on
+    st.release();
+    return cross_shard_channel{data_sink(std::move(sink)), data_source(std::move(source))};
+}
+
+}
@@ -0,0 +1,225 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <memory>
+module seastar;
+#else
+#include <seastar/core/cross_shard_semaphore.hh>
+#include <seastar/core/smp.hh>
+#include <algorithm>
+#include <cassert>
+#endif
+
+namespace seastar {
+
+cross_shard_semaphore_pool::cross_shard_semaphore_pool(size_t units)
+        : _capacity(units)
+        , _units(units)
+        , _shards(std::make_unique<shard_slot[]>(smp::count)) {
+}
+
+cross_shard_semaphore::cross_shard_semaphore(cross_shard_semaphore_pool& pool, size_t batch)
+        : _pool(pool)
+        , _slot(pool._shards[this_shard_id()])
+        , _batch(batch) {
+    assert(!_slot.sem);
+    _slot.sem = this;
+}
+
+cross_shard_semaphore::~cross_shard_semaphore() {
+    assert(_waiters.empty());
+    stop_waiting();
+    _pool._units.fetch_add(_local.current());
+    _slot.spare.store(0, std::memory_order_relaxed);
+    _slot.sem = nullptr;
+}
+
+future<> cross_shard_semaphore::stop() noexcept {
+    if (auto idle = idle_units()) {
+        return_units(idle);
+    }
+    publish_spare();
+    return _messages.close();
+}
+
+// Units cached here which no local waiter is waiting for
+size_t cross_shard_semaphore::idle_units() const noexcept {
+    auto cached = _local.current();
+    return cached > _waited_units ? cached - _waited_units : 0;
+}
+
+// Units missing from the cache for the first waiter to proceed
+size_t cross_shard_semaphore::deficit() const noexcept {
+    if (_waiters.empty()) {
+        return 0;
+    }
+    auto needed = _waiters.begin()->second;
+    auto cached = _local.current();
+    return needed > cached ? needed - cached : 0;
+}
+
+void cross_shard_semaphore::publish_spare() noexcept {
+    // While the first waiter cannot proceed, the units cached for it are
+    // of no use and can be given back as well
+    _slot.spare.store(deficit() ? _local.current() : idle_units(), std::memory_order_relaxed);
+}
+
+bool cross_shard_semaphore::others_waiting() const noexcept {
+    return _pool._waiting_shards.load() > unsigned(_slot.waiting.load(std::memory_order_relaxed));
+}
+
+// Takes at least \c needed units from the pool, and up to \c _batch
+// more, or none at all
+bool cross_shard_semaphore::refill(size_t needed) noexcept {
+    needed = std::min(needed, _pool._capacity);
+    auto units = _pool._units.load();
+    size_t taken;
+    do {
+        if (units < needed) {
+            return false;
+        }
+        taken = std::min(units, needed + _batch);
+    } while (!_pool._units.compare_exchange_weak(units, units - taken));
+    _stats.refills++;
+    _local.signal(taken);
+    return true;
+}
+
+void cross_shard_semaphore::return_units(size_t units) noexcept {
+    _local.consume(units);
+    _pool._units.fetch_add(units);
+    _stats.returns++;
+    // Pairs with rebalance() on the waiting shard
+    if (others_waiting()) {
+        wake_waiting_shards();
+    }
+}
+
+void cross_shard_semaphore::stop_waiting() noexcept {
+    if (_slot.waiting.exchange(false)) {
+        _pool._waiting_shards.fetch_sub(1);
+    }
+}
+
+void cross_shard_semaphore::poke(unsigned shard) noexcept {
+    auto& slot = _pool._shards[shard];
+    if (slot.poked.exchange(true)) {
+        // Already on its way; the shard clears the flag before rebalancing,
+        // so it will see whatever changed since
+        return;
+    }
+    auto holder = _messages.try_hold();
+    if (!holder) {
+        slot.poked.store(false);
+        return;
+    }
+    _stats.messages_sent++;
+    (void)smp::submit_to(shard, [&pool = _pool, shard] () noexcept {
+        pool._shards[shard].poked.store(false);
+        if (auto sem = pool._shards[shard].sem) {
+            sem->rebalance();
+        }
+    }).handle_exception([&slot, holder = std::move(*holder)] (std::exception_ptr) {
+        slot.poked.store(false);
+    });
+}
+
+void cross_shard_semaphore::wake_waiting_shards() noexcept {
+    for (unsigned s = 0; s < smp::count; ++s) {
+        if (s != this_shard_id() && _pool._shards[s].waiting.load()) {
+            poke(s);
+        }
+    }
+}
+
+void cross_shard_semaphore::rebalance() noexcept {
+    if (deficit()) {
+        // The flag is set before looking at the pool, pairing with
+        // return_units(): either we see the units, or it sees the flag.
+        bool started = !_slot.waiting.exchange(true);
+        if (started) {
+            _pool._waiting_shards.fetch_add(1);
+        }
+        if (!refill(deficit())) {
+            if (others_waiting() && _local.current()) {
+                return_units(_local.current());
+            }
+            if (started) {
+                // Ask the shards sitting on spare units to give them back
+                for (unsigned s = 0; s < smp::count; ++s) {
+                    if (s != this_shard_id() && _pool._shards[s].spare.load(std::memory_order_relaxed)) {
+                        poke(s);
+                    }
+                }
+            }
+        }
+    }
+    if (!deficit()) {
+        stop_waiting();
+        auto idle = idle_units();
+        if (others_waiting()) {
+            if (idle) {
+                return_units(idle);
+            }
+        } else if (idle > 2 * _batch) {
+            return_units(idle - _batch);
+        }
+    }
+    publish_spare();
+}
+
+future<> cross_shard_semaphore::waited(future<> f, uint64_t id, size_t nr) noexcept {
+    return f.then_wrapped([this, id, nr] (future<> f) {
+        _waiters.erase(id);
+        _waited_units -= nr;
+        // A failed wait leaves its units idle, and may have been the
+        // one this shard was waiting on
+        rebalance();
+        return f;
+    });
+}
+
+bool cross_shard_semaphore::try_wait(size_t nr) noexcept {
+    if (_local.try_wait(nr)) {
+        publish_spare();
+        return true;
+    }
+    if (!_waiters.empty()) {
+        return false;
+    }
+    if (refill(nr - _local.current()) && _local.try_wait(nr)) {
+        publish_spare();
+        return true;
+    }
+    return false;
+}
+
+void cross_shard_semaphore::signal(size_t nr) noexcept {
+    _local.signal(nr);
+    rebalance();
+}
+
+}
@@ -25,6 +25,7 @@ module;
 #include <stdexcept>
 module seastar;
 #else
+#include <algorithm>
 #include <seastar/core/execution_stage.hh>
 #include <seastar/core/print.hh>
 #include <seastar/core/make_task.hh>
@@ -99,6 +100,8 @@ execution_stage::~execution_stage()
 execution_stage::execution_stage(execution_stage&& other)
     : _sg(other._sg)
     , _stats(other._stats)
+    , _call_cost(other._call_cost)
+    , _batch_size_limit(other._batch_size_limit)
     , _name(std::move(other._name))
     , _metric_group(std::move(other._metric_group))
 {
@@ -136,10 +139,54 @@ execution_stage::execution_stage(const sstring& name, scheduling_group sg)
                                   [name, &esm = internal::execution_stage_manager::get()] {
                                       return esm.get_stage(name)->get_stats().function_calls_executed;
                                   }),
+             metrics::make_counter("batches_executed",
+                                  metrics::description("Counts batches of function calls executed by execution stages, "
+                                                       "function_calls_executed / batches_executed being the average batch size"),
+                                  { metrics::label_instance("execution_stage", name), },
+                                  [name, &esm = internal::execution_stage_manager::get()] {
+                                      return esm.get_stage(name)->get_stats().batches_executed;
+                                  }),
+             metrics::make_counter("queueing_delay",
+                                  metrics::description("Total time in seconds the oldest function call of each batch spent queued"),
+                                  { metrics::label_instance("execution_stage", name), },
+                                  [name, &esm = internal::execution_stage_manager::get()] {
+                                      return std::chrono::duration<double>(esm.get_stage(name)->get_stats().queueing_delay).count();
+                                  }),
+             metrics::make_counter("execution_time",
+                                  metrics::description("Total time in seconds spent executing function calls"),
+                                  { metrics::label_instance("execution_stage", name), },
+                                  [name, &esm = internal::execution_stage_manager::get()] {
+                                      return std::chrono::duration<double>(esm.get_stage(name)->get_stats().execution_time).count();
+                                  }),
+             metrics::make_gauge("batch_size_limit",
+                                  metrics::description("Number of queued function calls above which they are executed on the spot"),
+                                  { metrics::label_instance("execution_stage", name), },
+                                  [name, &esm = internal::execution_stage_manager::get()] {
+                                      return esm.get_stage(name)->batch_size_limit();
+                                  }),
            });
     undo.cancel();
 }
 
+void execution_stage::executed(sched_clock::time_point start, size_t calls) noexcept {
+    if (!calls) {
+        return;
+    }
+    auto now = sched_clock::now();
+    _stats.function_calls_executed += calls;
+    _stats.batches_executed++;
+    _stats.queueing_delay += start - _oldest_enqueued;
+    _stats.execution_time += now - start;
+    // The calls left behind by a preempted batch count as enqueued when
+    // the batch started
+    _oldest_enqueued = start;
+
+    auto cost = (now - start) / calls;
+    _call_cost = _call_cost.count() ? (_call_cost * 7 + cost) / 8 : cost;
+    auto limit = batch_latency_goal / std::max(_call_cost, sched_clock::duration(1));
+    _batch_size_limit = std::clamp<size_t>(limit, min_batch_size, max_batch_size);
+}
+
 bool execution_stage::flush() noexcept {
     if (_empty || _flush_scheduled) {
         return false;
@@ -143,18 +143,50 @@ class fair_queue::priority_class_data {
     capacity_t _accumulated = 0;
     capacity_t _pure_accumulated = 0;
     fair_queue_entry::container_list_t _queue;
+    // Entries with a deadline, sorted by it, when deadline scheduling is on
+    fair_queue_entry::container_list_t _deadline_queue;
     bool _queued = false;
     bool _plugged = true;
     uint32_t _activations = 0;
+    uint64_t _deadline_requests = 0;
+    uint64_t _deadline_misses = 0;
+    // Groups have no requests of their own, the nested classes and groups
+    // compete for the group's capacity in the _children heap
+    const bool _group;
+    priority_class_data* const _parent;
+    priority_queue _children;
+    capacity_t _last_accumulated = 0;
+    unsigned _nr_children = 0;
 
 public:
-    explicit priority_class_data(uint32_t shares) noexcept : _shares(std::max(shares, 1u)) {}
+    priority_class_data(uint32_t shares, priority_class_data* parent, bool group) noexcept
+            : _shares(std::max(shares, 1u))
+            , _group(group)
+            , _parent(parent)
+    {}
     priority_class_data(const priority_class_data&) = delete;
     priority_class_data(priority_class_data&&) = delete;
 
     void update_shares(uint32_t shares) noexcept {
         _shares = (std::max(shares, 1u));
     }
+
+    bool empty() const noexcept {
+        return _queue.empty() && _deadline_queue.empty();
+    }
+
+    // Deadlines are usually set as a fixed latency target from the time of
+    // queueing, so arriving entries typically go to the back in O(1).
+    void queue_by_deadline(fair_queue_entry& ent) noexcept {
+        if (_deadline_queue.empty() || _deadline_queue.back().deadline() <= ent.deadline()) {
+            _deadline_queue.push_back(ent);
+            return;
+        }
+        auto prev = _deadline_queue.before_begin();
+        for (auto it = _deadline_queue.begin(); it->deadline() <= ent.deadline(); prev = it++) {
+        }
+        _deadline_queue.insert_after(prev, ent);
+    }
 };
 
 bool fair_queue::class_compare::operator() (const priority_class_ptr& lhs, const priority_class_ptr & rhs) const noexcept {
@@ -174,10 +206,19 @@ fair_queue::~fair_queue() {
     }
 }
 
+auto fair_queue::heap_of(priority_class_data& pc) noexcept -> priority_queue& {
+    return pc._parent ? pc._parent->_children : _handles;
+}
+
+auto fair_queue::last_accumulated_of(priority_class_data& pc) noexcept -> capacity_t& {
+    return pc._parent ? pc._parent->_last_accumulated : _last_accumulated;
+}
+
 void fair_queue::push_priority_class(priority_class_data& pc) noexcept {
     SEASTAR_ASSERT(pc._plugged && !pc._queued);
-    _handles.assert_enough_capacity();
-    _handles.push(&pc);
+    auto& heap = heap_of(pc);
+    heap.assert_enough_capacity();
+    heap.push(&pc);
     pc._queued = true;
 }
 
@@ -192,25 +233,30 @@ void fair_queue::push_priority_class_from_idle(priority_class_data& pc) noexcept
         // introduce extra if's for that short corner case, use signed
         // arithmetics and make sure the _accumulated value doesn't grow
         // over signed maximum (see overflow check below)
-        pc._accumulated = std::max<signed_capacity_t>(_last_accumulated - max_deviation, pc._accumulated);
-        _handles.assert_enough_capacity();
-        _handles.push(&pc);
+        pc._accumulated = std::max<signed_capacity_t>(last_accumulated_of(pc) - max_deviation, pc._accumulated);
+        auto& heap = heap_of(pc);
+        heap.assert_enough_capacity();
+        heap.push(&pc);
         pc._queued = true;
         pc._activations++;
+        // A queued class or group always has all its parents queued
+        if (pc._parent) {
+            push_priority_class_from_idle(*pc._parent);
+        }
     }
 }
 
-// ATTN: This can only be called on pc that is from _handles.top()
+// ATTN: This can only be called on pc that is from heap_of(pc).top()
 void fair_queue::pop_priority_class(priority_class_data& pc) noexcept {
     SEASTAR_ASSERT(pc._queued);
     pc._queued = false;
-    _handles.pop();
+    heap_of(pc).pop();
 }
 
 void fair_queue::plug_priority_class(priority_class_data& pc) noexcept {
     SEASTAR_ASSERT(!pc._plugged);
     pc._plugged = true;
-    if (!pc._queue.empty()) {
+    if (!pc.empty()) {
         push_priority_class_from_idle(pc);
     }
 }
@@ -246,21 +292,43 @@ auto fair_queue::grab_capacity(capacity_t cap) noexcept -> void {
     _pending = pending{want_head, cap};
 }
 
-void fair_queue::register_priority_class(class_id id, uint32_t shares) {
+void fair_queue::register_priority_node(class_id id, uint32_t shares, std::optional<class_id> parent_id, bool group) {
     if (id >= _priority_classes.size()) {
         _priority_classes.resize(id + 1);
     } else {
         SEASTAR_ASSERT(!_priority_classes[id]);
     }
 
+    priority_class_data* parent = nullptr;
+    if (parent_id) {
+        SEASTAR_ASSERT(*parent_id < _priority_classes.size() && _priority_classes[*parent_id]);
+        parent = _priority_classes[*parent_id].get();
+        SEASTAR_ASSERT(parent->_group);
+        parent->_children.reserve(parent->_nr_children + 1);
+    }
     _handles.reserve(_nr_classes + 1);
-    _priority_classes[id] = std::make_unique<priority_class_data>(shares);
+    _priority_classes[id] = std::make_unique<priority_class_data>(shares, parent, group);
     _nr_classes++;
+    if (parent) {
+        parent->_nr_children++;
+    }
+}
+
+void fair_queue::register_priority_class(class_id id, uint32_t shares, std::optional<class_id> parent) {
+    register_priority_node(id, shares, parent, false);
+}
+
+void fair_queue::register_priority_group(class_id id, uint32_t shares, std::optional<class_id> parent) {
+    register_priority_node(id, shares, parent, true);
 }
 
 void fair_queue::unregister_priority_class(class_id id) {
     auto& pclass = _priority_classes[id];
     SEASTAR_ASSERT(pclass);
+    SEASTAR_ASSERT(pclass->_nr_children == 0);
+    if (pclass->_parent) {
+        pclass->_parent->_nr_children--;
+    }
     pclass.reset();
     _nr_classes--;
 }
@@ -282,13 +350,18 @@ fair_queue_ticket fair_queue::resources_currently_executing() const {
 
 void fair_queue::queue(class_id id, fair_queue_entry& ent) noexcept {
     priority_class_data& pc = *_priority_classes[id];
+    SEASTAR_ASSERT(!pc._group);
     // We need to return a future in this function on which the caller can wait.
     // Since we don't know which queue we will use to execute the next request - if ours or
     // someone else's, we need a separate promise at this point.
     if (pc._plugged) {
         push_priority_class_from_idle(pc);
     }
-    pc._queue.push_back(ent);
+    if (_config.deadline_scheduling && ent.has_deadline()) {
+        pc.queue_by_deadline(ent);
+    } else {
+        pc._queue.push_back(ent);
+    }
     _queued_capacity += ent.capacity();
 }
 
@@ -338,20 +411,62 @@ fair_queue::clock_type::time_point fair_queue::next_pending_aio() const noexcept
 // Given a task quota of 500us and IO latency goal of 750 us,
 // a CPU-starved shard should still be able to grab at least ~30% of its fair share in the worst case.
 // This is far from ideal, but it's something.
+auto fair_queue::next_queue(priority_class_data& pc, clock_type::time_point now) const noexcept -> fair_queue_entry::container_list_t& {
+    if (pc._deadline_queue.empty()) {
+        return pc._queue;
+    }
+    if (pc._queue.empty() || pc._deadline_queue.front().deadline() <= now + _config.deadline_window) {
+        return pc._deadline_queue;
+    }
+    return pc._queue;
+}
+
+void fair_queue::charge_priority_class(priority_class_data& pc, capacity_t cap) noexcept {
+    // Usually the cost of request is tens to hundreeds of thousands. However, for
+    // unrestricted queue it can be as low as 2k. With large enough shares this
+    // has chances to be translated into zero cost which, in turn, will make the
+    // class show no progress and monopolize the queue.
+    auto cost = std::max(cap / pc._shares, (capacity_t)1);
+    // signed overflow check to make push_priority_class_from_idle math work
+    if (pc._accumulated >= std::numeric_limits<signed_capacity_t>::max() - cost) {
+        auto accumulated = pc._accumulated;
+        for (auto& sibling : _priority_classes) {
+            if (sibling && sibling->_parent == pc._parent) {
+                if (sibling->_queued) {
+                    sibling->_accumulated -= accumulated;
+                } else { // this includes pc
+                    sibling->_accumulated = 0;
+                }
+            }
+        }
+        last_accumulated_of(pc) = 0;
+    }
+    pc._accumulated += cost;
+    pc._pure_accumulated += cap;
+}
+
 void fair_queue::dispatch_requests(std::function<void(fair_queue_entry&)> cb) {
     _group.maybe_replenish_capacity(_group_replenish);
 
     const uint64_t max_unamortized_reservation = _group.per_tick_grab_threshold();
     auto available = reap_pending_capacity();
+    const auto now = clock_type::now();
 
     while (!_handles.empty()) {
-        priority_class_data& h = *_handles.top();
-        if (h._queue.empty() || !h._plugged) {
+        // Descend to the class that's next to dispatch from. Groups that ran
+        // out of active children are dropped on the way down
+        priority_class_data* top = _handles.top();
+        while (top->_group && !top->_children.empty()) {
+            top = top->_children.top();
+        }
+        priority_class_data& h = *top;
+        if (h._group || h.empty() || !h._plugged) {
             pop_priority_class(h);
             continue;
         }
 
-        auto& req = h._queue.front();
+        auto& queue = next_queue(h, now);
+        auto& req = queue.front();
         if (req._capacity <= available.ready_tokens) {
             // We can dispatch the request immediately.
             // We do that after the if-else.
@@ -397,38 +512,35 @@ void fair_queue::dispatch_requests(std::function<void(fair_queue_entry&)> cb) {
 
         available.ready_tokens -= req._capacity;
 
-        _last_accumulated = std::max(h._accumulated, _last_accumulated);
-        pop_priority_class(h);
-        h._queue.pop_front();
+        // The class and all the groups above it are at the tops of their heaps,
+        // and each of them is charged for the request with its own shares
+        for (auto* pc = &h; pc != nullptr; pc = pc->_parent) {
+            auto& last_accumulated = last_accumulated_of(*pc);
+            last_accumulated = std::max(pc->_accumulated, last_accumulated);
+            pop_priority_class(*pc);
+        }
+        queue.pop_front();
 
-        // Usually the cost of request is tens to hundreeds of thousands. However, for
-        // unrestricted queue it can be as low as 2k. With large enough shares this
-        // has chances to be translated into zero cost which, in turn, will make the
-        // class show no progress and monopolize the queue.
         auto req_cap = req._capacity;
-        auto req_cost  = std::max(req_cap / h._shares, (capacity_t)1);
-        // signed overflow check to make push_priority_class_from_idle math work
-        if (h._accumulated >= std::numeric_limits<signed_capacity_t>::max() - req_cost) {
-            for (auto& pc : _priority_classes) {
-                if (pc) {
-                    if (pc->_queued) {
-                        pc->_accumulated -= h._accumulated;
-                    } else { // this includes h
-                        pc->_accumulated = 0;
-                    }
-                }
-            }
-            _last_accumulated = 0;
+        for (auto* pc = &h; pc != nullptr; pc = pc->_parent) {
+            charge_priority_class(*pc, req_cap);
         }
-        h._accumulated += req_cost;
-        h._pure_accumulated += req_cap;
         _queued_capacity -= req_cap;
+        if (req.has_deadline()) {
+            h._deadline_requests++;
+            h._deadline_misses += now > req.deadline();
+        }
 
         cb(req);
 
-        if (h._plugged && !h._queue.empty()) {
+        if (h._plugged && !h.empty()) {
             push_priority_class(h);
         }
+        for (auto* pc = h._parent; pc != nullptr; pc = pc->_parent) {
+            if (!pc->_children.empty()) {
+                push_priority_class(*pc);
+            }
+        }
     }
 
     SEASTAR_ASSERT(_handles.empty() || available.ready_tokens == 0);
@@ -455,6 +567,12 @@ std::vector<seastar::metrics::impl::metric_definition_impl> fair_queue::metrics(
             sm::make_counter("activations",
                     [&pc] { return pc._activations; },
                     sm::description("The number of times the class was woken up from idle")),
+            sm::make_counter("deadline_requests",
+                    [&pc] { return pc._deadline_requests; },
+                    sm::description("The number of dispatched requests that had a deadline")),
+            sm::make_counter("deadline_misses",
+                    [&pc] { return pc._deadline_misses; },
+                    sm::description("The number of requests that were dispatched after their deadline")),
     });
 }
 
@@ -22,11 +22,14 @@
 #pragma once
 
 #include <seastar/core/file.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/core/shared_future.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <atomic>
 #include <deque>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <vector>
 #include <sys/uio.h>
 
@@ -87,8 +90,18 @@ class posix_file_impl : public file_impl {
             uint32_t disk_write_dma_alignment,
             uint32_t disk_overwrite_dma_alignment,
             bool nowait_works);
+    // Queues the discard in the I/O scheduler of the file's device
+    future<> do_discard(uint64_t offset, uint64_t length, bool blockdev) noexcept;
+    io_queue& get_io_queue() const noexcept {
+        return _io_queue;
+    }
+    dev_t device_id() const noexcept {
+        return _device_id;
+    }
 public:
     virtual ~posix_file_impl() override;
+    // Returns the descriptor behind f if it's a posix file, and -1 otherwise
+    static int fd_of(file& f) noexcept;
     future<> flush() noexcept override;
     future<struct stat> stat() noexcept override;
     future<> truncate(uint64_t length) noexcept override;
@@ -111,6 +124,10 @@ class posix_file_impl : public file_impl {
     virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept override = 0;
     virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept override = 0;
     virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, io_intent* intent) noexcept override = 0;
+    virtual future<size_t> write_dma_dsync(uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept override;
+    virtual future<size_t> write_dma_dsync(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept override;
+    // Queued as one I/O chain, with a linked fdatasync for write_durability::data
+    virtual future<size_t> write_dma_ordered(std::vector<ordered_write> writes, write_durability durability, io_intent* intent) noexcept override;
 
     open_flags flags() const {
         return _open_flags;
@@ -145,8 +162,12 @@ class posix_file_impl : public file_impl {
         return read_dma(pos, buffer, len, intent);
     }
 protected:
-    future<size_t> do_write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
-    future<size_t> do_write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    // Writes with RWF_DSYNC, called by write_dma_dsync() when the kernel supports it
+    virtual future<size_t> write_dma_rwf_dsync(uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept = 0;
+    virtual future<size_t> write_dma_rwf_dsync(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept = 0;
+
+    future<size_t> do_write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync = false) noexcept;
+    future<size_t> do_write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync = false) noexcept;
     future<size_t> do_read_dma(uint64_t pos, void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
     future<size_t> do_read_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
     future<temporary_buffer<uint8_t>> do_dma_read_bulk(uint64_t offset, size_t range_size, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
@@ -155,8 +176,14 @@ class posix_file_impl : public file_impl {
 class posix_file_real_impl final : public posix_file_impl {
     future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
     future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
-    future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
-    future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync = false) noexcept;
+    future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync = false) noexcept;
+    virtual future<size_t> write_dma_rwf_dsync(uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept override {
+        return write_dma(pos, buffer, len, internal::maybe_priority_class_ref{}, intent, true);
+    }
+    virtual future<size_t> write_dma_rwf_dsync(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept override {
+        return write_dma(pos, std::move(iov), internal::maybe_priority_class_ref{}, intent, true);
+    }
     future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
 
 public:
@@ -216,6 +243,11 @@ class append_challenged_posix_file_impl final : public posix_file_impl, public e
     unsigned _current_non_size_changing_ops = 0;
     unsigned _current_size_changing_ops = 0;
     const bool _fsync_is_exclusive = true;
+    // Group commit: the flushes requested while one is in flight share a
+    // single follow-up flush, issued when it completes
+    bool _flushing = false;
+    std::optional<shared_promise<>> _next_flush;
+    unsigned _next_flush_waiters = 0;
 
     // Set when the user is closing the file
     enum class state { open, draining, closing, closed };
@@ -238,6 +270,8 @@ class append_challenged_posix_file_impl final : public posix_file_impl, public e
     void enqueue_op(op&& op);
     int truncate_sync(uint64_t len) noexcept;
     void truncate_to_logical_size();
+    future<> do_flush() noexcept;
+    future<> group_flush() noexcept;
     template <typename... T, typename Func>
     future<T...> enqueue(opcode type, uint64_t pos, size_t len, Func&& func) noexcept {
         try {
@@ -265,8 +299,14 @@ class append_challenged_posix_file_impl final : public posix_file_impl, public e
 private:
     future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
     future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
-    future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
-    future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync = false) noexcept;
+    future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync = false) noexcept;
+    virtual future<size_t> write_dma_rwf_dsync(uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept override {
+        return write_dma(pos, buffer, len, internal::maybe_priority_class_ref{}, intent, true);
+    }
+    virtual future<size_t> write_dma_rwf_dsync(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept override {
+        return write_dma(pos, std::move(iov), internal::maybe_priority_class_ref{}, intent, true);
+    }
     future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
 
 public:
@@ -282,6 +322,10 @@ class append_challenged_posix_file_impl final : public posix_file_impl, public e
     virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept override {
         return write_dma(pos, std::move(iov), internal::maybe_priority_class_ref{}, intent);
     }
+    // The writes go through write_dma() one at a time, to track the file size
+    virtual future<size_t> write_dma_ordered(std::vector<ordered_write> writes, write_durability durability, io_intent* intent) noexcept override {
+        return file_impl::write_dma_ordered(std::move(writes), durability, intent);
+    }
     virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, io_intent* intent) noexcept override {
         return dma_read_bulk(offset, range_size, internal::maybe_priority_class_ref{}, intent);
     }
@@ -295,16 +339,42 @@ class append_challenged_posix_file_impl final : public posix_file_impl, public e
 };
 
 class blockdev_file_impl final : public posix_file_impl {
+    // The NVMe namespace of the device, when its I/O is passed through to
+    // the driver (see reactor_options::io_uring_nvme_passthrough)
+    struct nvme_namespace {
+        file_desc fd; // of the generic character device
+        uint32_t nsid;
+        unsigned lba_shift;
+        uint64_t size;
+        size_t max_transfer;
+    };
+    std::optional<nvme_namespace> _nvme;
+
+    static std::optional<nvme_namespace> open_nvme_namespace(int fd, dev_t device_id, open_flags flags) noexcept;
+    // Whether an NVMe command can carry the request, otherwise it goes
+    // through the block layer
+    bool nvme_carries(uint64_t pos, const void* buffer, size_t len, bool write) const noexcept;
+    future<size_t> nvme_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent, bool write, bool fua) noexcept;
+
     future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
     future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
-    future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
-    future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync = false) noexcept;
+    future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync = false) noexcept;
+    virtual future<size_t> write_dma_rwf_dsync(uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept override {
+        return write_dma(pos, buffer, len, internal::maybe_priority_class_ref{}, intent, true);
+    }
+    virtual future<size_t> write_dma_rwf_dsync(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept override {
+        return write_dma(pos, std::move(iov), internal::maybe_priority_class_ref{}, intent, true);
+    }
     future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
 
 public:
     blockdev_file_impl(int fd, open_flags, file_open_options options, dev_t device_id, size_t block_size);
     future<> truncate(uint64_t length) noexcept override;
     future<> discard(uint64_t offset, uint64_t length) noexcept override;
+    future<std::vector<zone_info>> report_zones(uint64_t offset, size_t max_zones) noexcept override;
+    future<> manage_zones(zone_action action, uint64_t offset, uint64_t length) noexcept override;
+    future<uint64_t> zone_append_dma(uint64_t zone_start, const void* buffer, size_t len, io_intent* intent) noexcept override;
     future<uint64_t> size() noexcept override;
     virtual future<> allocate(uint64_t position, uint64_t length) noexcept override;
     virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, io_intent* intent) noexcept override {
@@ -324,4 +394,80 @@ class blockdev_file_impl final : public posix_file_impl {
     }
 };
 
+// A file on a DAX filesystem, such as one on persistent memory, mapped with
+// MAP_SYNC: the parts of requests within the size of the file are copied
+// from and to the mapping by the reactor, without going through the I/O
+// scheduler, though they are accounted in its statistics. The stores are
+// durable once a write completes, see internal::pmem_copy(), and MAP_SYNC
+// made the metadata of the blocks they went to durable before they were
+// written, so flush() only syncs what went through posix_file_impl since.
+//
+// The requests beyond the end of the file go through posix_file_impl, which
+// handles end of file and extends it, so that files written by the reactor
+// are sized with truncate() and allocated with allocate() beforehand. A
+// write to a hole faults the reactor while the filesystem allocates the
+// block. The file must not be shrunk by anything else than this file while
+// it's open. Handles to the file, see dup(), open it without the mapping.
+class dax_file_impl final : public posix_file_impl {
+    const bool _writable;
+    // MAP_SYNC, unless emulated
+    const int _map_flags;
+    char* _map = nullptr;
+    size_t _mapped = 0;
+    // Size of the file the last time it was checked: only [0, _size) of the
+    // mapping is accessed
+    uint64_t _size = 0;
+    // Whether data or metadata changed through posix_file_impl since the
+    // last flush()
+    bool _unsynced = false;
+
+    // Whether [pos, pos + len) is within the file and mapped, mapping more
+    // of the file if it grew
+    bool mapped(uint64_t pos, size_t len) noexcept;
+    void unmap() noexcept;
+    void account(int rw_idx, size_t len) noexcept;
+
+    future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+    future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync = false) noexcept;
+    future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync = false) noexcept;
+    virtual future<size_t> write_dma_rwf_dsync(uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept override {
+        return write_dma(pos, buffer, len, internal::maybe_priority_class_ref{}, intent, true);
+    }
+    virtual future<size_t> write_dma_rwf_dsync(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept override {
+        return write_dma(pos, std::move(iov), internal::maybe_priority_class_ref{}, intent, true);
+    }
+    future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept;
+
+public:
+    dax_file_impl(int fd, open_flags of, bool writable, file_open_options options, const internal::fs_info& fsi, dev_t device_id);
+    ~dax_file_impl();
+    // Whether fd is a file on a DAX filesystem which can be mapped with MAP_SYNC
+    static bool supported(int fd, bool writable) noexcept;
+    // Lets the files of any filesystem be mapped, without MAP_SYNC, for
+    // tests to run the mapping path without a DAX filesystem. The writes
+    // to the mapping are then not durable. Set on the shard opening them.
+    static thread_local bool emulate_for_tests;
+
+    future<> flush() noexcept override;
+    future<> truncate(uint64_t length) noexcept override;
+    virtual future<> allocate(uint64_t position, uint64_t length) noexcept override;
+    virtual future<> close() noexcept override;
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, io_intent* intent) noexcept override {
+        return read_dma(pos, buffer, len, internal::maybe_priority_class_ref{}, intent);
+    }
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept override {
+        return read_dma(pos, std::move(iov), internal::maybe_priority_class_ref{}, intent);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept override {
+        return write_dma(pos, buffer, len, internal::maybe_priority_class_ref{}, intent);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept override {
+        return write_dma(pos, std::move(iov), internal::maybe_priority_class_ref{}, intent);
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, io_intent* intent) noexcept override {
+        return dma_read_bulk(offset, range_size, internal::maybe_priority_class_ref{}, intent);
+    }
+};
+
 }
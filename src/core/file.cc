@@ -25,8 +25,10 @@ module;
 
 #include <algorithm>
 #include <atomic>
+#include <bit>
 #include <coroutine>
 #include <deque>
+#include <filesystem>
 #include <functional>
 #include <memory>
 #include <optional>
@@ -40,7 +42,10 @@ module;
 #include <linux/types.h> // for xfs, below
 #include <linux/fs.h> // BLKBSZGET
 #include <linux/major.h>
+#include <linux/blkzoned.h>
+#include <linux/nvme_ioctl.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <xfs/linux.h>
@@ -66,9 +71,12 @@ module seastar;
 #include <seastar/util/later.hh>
 #include <seastar/util/internal/magic.hh>
 #include <seastar/util/internal/iovec_utils.hh>
+#include <seastar/util/read_first_line.hh>
 #include <seastar/core/io_queue.hh>
 #include <seastar/core/queue.hh>
 #include "core/file-impl.hh"
+#include "core/pmem.hh"
+#include "core/reactor_backend.hh"
 #include "core/syscall_result.hh"
 #include "core/thread_pool.hh"
 #endif
@@ -122,6 +130,7 @@ posix_file_impl::posix_file_impl(int fd, open_flags f, file_open_options options
         , _fd(fd)
 {
     configure_io_lengths();
+    engine()._backend->register_file(_fd);
 }
 
 posix_file_impl::posix_file_impl(int fd, open_flags f, file_open_options options, dev_t device_id, const internal::fs_info& fsi)
@@ -131,6 +140,9 @@ posix_file_impl::posix_file_impl(int fd, open_flags f, file_open_options options
 }
 
 posix_file_impl::~posix_file_impl() {
+    if (_fd != -1) {
+        engine()._backend->unregister_file(_fd);
+    }
     if (_refcount && _refcount->fetch_add(-1, std::memory_order_relaxed) != 1) {
         return;
     }
@@ -190,6 +202,7 @@ posix_file_impl::posix_file_impl(int fd, open_flags f, std::atomic<unsigned>* re
     _disk_write_dma_alignment = disk_write_dma_alignment;
     _disk_overwrite_dma_alignment = disk_overwrite_dma_alignment;
     configure_io_lengths();
+    engine()._backend->register_file(_fd);
 }
 
 future<>
@@ -265,14 +278,15 @@ posix_file_impl::fcntl_short(int op, uintptr_t arg) noexcept {
     return make_ready_future<int>(ret);
 }
 
+future<>
+posix_file_impl::do_discard(uint64_t offset, uint64_t length, bool blockdev) noexcept {
+    return _io_queue.submit_io_discard(internal::priority_class(current_scheduling_group()),
+            internal::io_request::make_discard(_fd, offset, length, blockdev));
+}
+
 future<>
 posix_file_impl::discard(uint64_t offset, uint64_t length) noexcept {
-    auto sr = co_await engine()._thread_pool->submit<syscall_result<int>>(
-            internal::thread_pool_submit_reason::file_operation, [this, offset, length] () mutable {
-        return wrap_syscall<int>(::fallocate(_fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
-            offset, length));
-    });
-    sr.throw_if_error();
+    return do_discard(offset, length, false);
 }
 
 future<>
@@ -283,15 +297,11 @@ posix_file_impl::allocate(uint64_t position, uint64_t length) noexcept {
     if (!supported) {
         co_return;
     }
-    auto sr = co_await engine()._thread_pool->submit<syscall_result<int>>(
-            internal::thread_pool_submit_reason::file_operation, [this, position, length] () mutable {
-        auto ret = ::fallocate(_fd, FALLOC_FL_ZERO_RANGE|FALLOC_FL_KEEP_SIZE, position, length);
-        if (ret == -1 && errno == EOPNOTSUPP) {
-            ret = 0;
-            supported = false; // Racy, but harmless.  At most we issue an extra call or two.
-        }
-        return wrap_syscall<int>(ret);
-    });
+    auto sr = co_await engine().fallocate(_fd, FALLOC_FL_ZERO_RANGE|FALLOC_FL_KEEP_SIZE, position, length);
+    if (sr.result == -1 && sr.error == EOPNOTSUPP) {
+        supported = false; // Racy, but harmless.  At most we issue an extra call or two.
+        co_return;
+    }
     sr.throw_if_error();
 #else
     return make_ready_future<>();
@@ -315,6 +325,7 @@ posix_file_impl::close() noexcept {
     }
     auto fd = _fd;
     _fd = -1;  // Prevent a concurrent close (which is illegal) from closing another file's fd
+    engine()._backend->unregister_file(fd);
     if (_refcount && _refcount->fetch_add(-1, std::memory_order_relaxed) != 1) {
         _refcount = nullptr;
         return make_ready_future<>();
@@ -475,15 +486,15 @@ posix_file_impl::list_directory(std::function<future<> (directory_entry de)> nex
 }
 
 future<size_t>
-posix_file_impl::do_write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref io_priority_class, io_intent* intent) noexcept {
-    auto req = internal::io_request::make_write(_fd, pos, buffer, len, _nowait_works);
+posix_file_impl::do_write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref io_priority_class, io_intent* intent, bool dsync) noexcept {
+    auto req = internal::io_request::make_write(_fd, pos, buffer, len, _nowait_works, dsync);
     return _io_queue.submit_io_write(internal::priority_class(io_priority_class), len, std::move(req), intent);
 }
 
 future<size_t>
-posix_file_impl::do_write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref io_priority_class, io_intent* intent) noexcept {
+posix_file_impl::do_write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref io_priority_class, io_intent* intent, bool dsync) noexcept {
     auto len = internal::sanitize_iovecs(iov, _disk_write_dma_alignment);
-    auto req = internal::io_request::make_writev(_fd, pos, iov, _nowait_works);
+    auto req = internal::io_request::make_writev(_fd, pos, iov, _nowait_works, dsync);
     return _io_queue.submit_io_write(internal::priority_class(io_priority_class), len, std::move(req), intent, std::move(iov));
 }
 
@@ -500,14 +511,78 @@ posix_file_impl::do_read_dma(uint64_t pos, std::vector<iovec> iov, internal::may
     return _io_queue.submit_io_read(internal::priority_class(io_priority_class), len, std::move(req), intent, std::move(iov));
 }
 
+// RWF_DSYNC is honoured by linux-aio since 4.13, io_uring always had it
+static bool rwf_dsync_works = internal::kernel_uname().whitelisted({"4.13"});
+
 future<size_t>
-posix_file_real_impl::write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
-    return posix_file_impl::do_write_dma(pos, buffer, len, pc, intent);
+posix_file_impl::write_dma_dsync(uint64_t pos, const void* buffer, size_t len, io_intent* intent) noexcept {
+    if ((_open_flags & open_flags::dsync) != open_flags{}) {
+        return write_dma(pos, buffer, len, intent);
+    }
+#ifdef RWF_DSYNC
+    if (rwf_dsync_works) {
+        return write_dma_rwf_dsync(pos, buffer, len, intent);
+    }
+#endif
+    return file_impl::write_dma_dsync(pos, buffer, len, intent);
 }
 
 future<size_t>
-posix_file_real_impl::write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
-    return posix_file_impl::do_write_dma(pos, std::move(iov), pc, intent);
+posix_file_impl::write_dma_dsync(uint64_t pos, std::vector<iovec> iov, io_intent* intent) noexcept {
+    if ((_open_flags & open_flags::dsync) != open_flags{}) {
+        return write_dma(pos, std::move(iov), intent);
+    }
+#ifdef RWF_DSYNC
+    if (rwf_dsync_works) {
+        return write_dma_rwf_dsync(pos, std::move(iov), intent);
+    }
+#endif
+    return file_impl::write_dma_dsync(pos, std::move(iov), intent);
+}
+
+future<size_t>
+posix_file_impl::write_dma_ordered(std::vector<ordered_write> writes, write_durability durability, io_intent* intent) noexcept {
+    auto& r = engine();
+    // Files opened with open_flags::dsync have every write stable already
+    bool sync = durability == write_durability::data && (_open_flags & open_flags::dsync) == open_flags{};
+    // The fdatasync is chained to the writes only if it's submitted like
+    // them, see reactor::fdatasync()
+    bool chain_sync = sync && r._cfg.have_aio_fsync && !r._cfg.bypass_fsync;
+    if (writes.empty() || writes.size() + chain_sync > io_queue::max_chain_length) {
+        return file_impl::write_dma_ordered(std::move(writes), durability, intent);
+    }
+    try {
+        std::vector<internal::io_request> reqs;
+        reqs.reserve(writes.size() + chain_sync);
+        for (auto& w : writes) {
+            reqs.push_back(internal::io_request::make_write(_fd, w.pos, w.buffer, w.len, _nowait_works));
+        }
+        if (chain_sync) {
+            ++r._io_stats.fsyncs;
+            reqs.push_back(internal::io_request::make_fdatasync(_fd));
+        }
+        auto f = _io_queue.submit_io_chain(internal::priority_class(internal::maybe_priority_class_ref{}), std::move(reqs), intent);
+        if (sync && !chain_sync) {
+            return f.then([this] (size_t ret) {
+                return flush().then([ret] {
+                    return ret;
+                });
+            });
+        }
+        return f;
+    } catch (...) {
+        return current_exception_as_future<size_t>();
+    }
+}
+
+future<size_t>
+posix_file_real_impl::write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync) noexcept {
+    return posix_file_impl::do_write_dma(pos, buffer, len, pc, intent, dsync);
+}
+
+future<size_t>
+posix_file_real_impl::write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync) noexcept {
+    return posix_file_impl::do_write_dma(pos, std::move(iov), pc, intent, dsync);
 }
 
 future<size_t>
@@ -638,10 +713,80 @@ static bool blockdev_nowait_works(dev_t device_id) {
 }
 
 blockdev_file_impl::blockdev_file_impl(int fd, open_flags f, file_open_options options, dev_t device_id, size_t block_size)
-        : posix_file_impl(fd, f, options, device_id, blockdev_nowait_works(device_id)) {
+        : posix_file_impl(fd, f, options, device_id, blockdev_nowait_works(device_id))
+        , _nvme(open_nvme_namespace(fd, device_id, f)) {
     // FIXME -- configure file_impl::_..._dma_alignment's from block_size
 }
 
+std::optional<blockdev_file_impl::nvme_namespace>
+blockdev_file_impl::open_nvme_namespace(int fd, dev_t device_id, open_flags flags) noexcept {
+    if (!engine()._backend->supports_nvme_passthrough()) {
+        return std::nullopt;
+    }
+    sstring dev;
+    try {
+        dev = std::filesystem::read_symlink(fmt::format("/sys/dev/block/{}:{}", major(device_id), minor(device_id))).filename().native();
+        // Whole namespaces only, the blocks of a partition are not numbered
+        // the way the commands number them
+        unsigned ctrl, ns;
+        int end = 0;
+        if (::sscanf(dev.c_str(), "nvme%un%u%n", &ctrl, &ns, &end) != 2 || size_t(end) != dev.size()) {
+            return std::nullopt;
+        }
+        int lba_size;
+        uint64_t size;
+        if (::ioctl(fd, BLKSSZGET, &lba_size) == -1 || ::ioctl(fd, BLKGETSIZE64, &size) == -1) {
+            throw std::system_error(errno, std::system_category(), "ioctl() on the block device failed");
+        }
+        // The commands can only be sent with the access the file was opened with
+        auto ng = file_desc::open(fmt::format("/dev/ng{}n{}", ctrl, ns), (int(flags) & O_ACCMODE) | O_CLOEXEC);
+        auto nsid = ::ioctl(ng.get(), NVME_IOCTL_ID);
+        if (nsid <= 0) {
+            throw std::system_error(errno, std::system_category(), "ioctl(NVME_IOCTL_ID) failed");
+        }
+        auto max_transfer = read_first_line_as<size_t>(fmt::format("/sys/block/{}/queue/max_hw_sectors_kb", dev)) << 10;
+        seastar_logger.debug("Passing the I/O of {} through to NVMe namespace {}", dev, nsid);
+        return nvme_namespace{
+            .fd = std::move(ng),
+            .nsid = uint32_t(nsid),
+            .lba_shift = unsigned(std::countr_zero(unsigned(lba_size))),
+            .size = size,
+            .max_transfer = max_transfer,
+        };
+    } catch (...) {
+        seastar_logger.warn("Not passing the I/O of {} through to NVMe: {}", dev, std::current_exception());
+        return std::nullopt;
+    }
+}
+
+bool
+blockdev_file_impl::nvme_carries(uint64_t pos, const void* buffer, size_t len, bool write) const noexcept {
+    if (!_nvme || !len) {
+        return false;
+    }
+    auto lba_mask = (uint64_t(1) << _nvme->lba_shift) - 1;
+    // Larger requests would be split by the io_queue, reads past the end are
+    // left to the block layer, which reports them as short
+    auto max_length = std::min<size_t>(_nvme->max_transfer, write ? _write_max_length : _read_max_length);
+    return !((pos | len) & lba_mask) && len <= max_length && pos + len <= _nvme->size
+            && !(reinterpret_cast<uintptr_t>(buffer) & (_memory_dma_alignment - 1));
+}
+
+future<size_t>
+blockdev_file_impl::nvme_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent, bool write, bool fua) noexcept {
+    auto req = internal::io_request::make_nvme(_nvme->fd.get(), _nvme->nsid, _nvme->lba_shift, pos, buffer, len, write, fua);
+    auto& ioq = get_io_queue();
+    auto f = write ? ioq.submit_io_write(internal::priority_class(pc), len, std::move(req), intent)
+            : ioq.submit_io_read(internal::priority_class(pc), len, std::move(req), intent);
+    return f.then([len] (size_t status) {
+        if (status) {
+            return make_exception_future<size_t>(std::system_error(EIO, std::system_category(),
+                    fmt::format("NVMe command failed with status {:#x}", status)));
+        }
+        return make_ready_future<size_t>(len);
+    });
+}
+
 future<>
 blockdev_file_impl::truncate(uint64_t length) noexcept {
     return make_ready_future<>();
@@ -649,14 +794,114 @@ blockdev_file_impl::truncate(uint64_t length) noexcept {
 
 future<>
 blockdev_file_impl::discard(uint64_t offset, uint64_t length) noexcept {
+    return do_discard(offset, length, true);
+}
+
+// The kernel counts zones in 512-byte sectors
+static constexpr unsigned zone_sector_shift = 9;
+
+static zone_type to_zone_type(uint8_t type) noexcept {
+    switch (type) {
+    case BLK_ZONE_TYPE_SEQWRITE_REQ: return zone_type::sequential_write_required;
+    case BLK_ZONE_TYPE_SEQWRITE_PREF: return zone_type::sequential_write_preferred;
+    default: return zone_type::conventional;
+    }
+}
+
+static zone_condition to_zone_condition(uint8_t cond) noexcept {
+    switch (cond) {
+    case BLK_ZONE_COND_NOT_WP: return zone_condition::not_write_pointer;
+    case BLK_ZONE_COND_EMPTY: return zone_condition::empty;
+    case BLK_ZONE_COND_IMP_OPEN: return zone_condition::implicitly_open;
+    case BLK_ZONE_COND_EXP_OPEN: return zone_condition::explicitly_open;
+    case BLK_ZONE_COND_CLOSED: return zone_condition::closed;
+    case BLK_ZONE_COND_READONLY: return zone_condition::read_only;
+    case BLK_ZONE_COND_FULL: return zone_condition::full;
+    default: return zone_condition::offline;
+    }
+}
+
+future<std::vector<zone_info>>
+blockdev_file_impl::report_zones(uint64_t offset, size_t max_zones) noexcept {
+    std::vector<zone_info> ret;
+    // The zones are reported after the header, up to a batch at a time
+    constexpr size_t batch = 128;
+    std::vector<uint64_t> buf((sizeof(blk_zone_report) + batch * sizeof(blk_zone)) / sizeof(uint64_t) + 1);
+    auto report = reinterpret_cast<blk_zone_report*>(buf.data());
+    while (ret.size() < max_zones) {
+        report->sector = offset >> zone_sector_shift;
+        report->nr_zones = std::min(batch, max_zones - ret.size());
+        report->flags = 0;
+        auto sr = co_await engine()._thread_pool->submit<syscall_result<int>>(
+                internal::thread_pool_submit_reason::file_operation, [fd = _fd, report] {
+            return wrap_syscall<int>(::ioctl(fd, BLKREPORTZONE, report));
+        });
+        sr.throw_if_error();
+        if (!report->nr_zones) {
+            break;
+        }
+        bool has_capacity = report->flags & BLK_ZONE_REP_CAPACITY;
+        for (unsigned i = 0; i < report->nr_zones; i++) {
+            auto& z = report->zones[i];
+            ret.push_back(zone_info{
+                .start = z.start << zone_sector_shift,
+                .length = z.len << zone_sector_shift,
+                .capacity = (has_capacity ? z.capacity : z.len) << zone_sector_shift,
+                .write_pointer = z.wp << zone_sector_shift,
+                .type = to_zone_type(z.type),
+                .condition = to_zone_condition(z.cond),
+            });
+        }
+        offset = ret.back().start + ret.back().length;
+    }
+    co_return ret;
+}
+
+future<>
+blockdev_file_impl::manage_zones(zone_action action, uint64_t offset, uint64_t length) noexcept {
+    unsigned long cmd;
+    switch (action) {
+    case zone_action::open: cmd = BLKOPENZONE; break;
+    case zone_action::close: cmd = BLKCLOSEZONE; break;
+    case zone_action::finish: cmd = BLKFINISHZONE; break;
+    case zone_action::reset: cmd = BLKRESETZONE; break;
+    default: throw std::invalid_argument("unknown zone action");
+    }
+    blk_zone_range range{offset >> zone_sector_shift, length >> zone_sector_shift};
     auto sr = co_await engine()._thread_pool->submit<syscall_result<int>>(
-            internal::thread_pool_submit_reason::file_operation, [this, offset, length] () mutable {
-        uint64_t range[2] { offset, length };
-        return wrap_syscall<int>(::ioctl(_fd, BLKDISCARD, &range));
+            internal::thread_pool_submit_reason::file_operation, [fd = _fd, cmd, &range] {
+        return wrap_syscall<int>(::ioctl(fd, cmd, &range));
     });
+    // The write pointers moved, or may have
+    get_io_queue().forget_zones(device_id(), offset, offset + length);
     sr.throw_if_error();
 }
 
+future<uint64_t>
+blockdev_file_impl::zone_append_dma(uint64_t zone_start, const void* buffer, size_t len, io_intent* intent) noexcept {
+    auto load = [this, zone_start] () -> future<std::pair<uint64_t, uint64_t>> {
+        auto zones = co_await report_zones(zone_start, 1);
+        if (zones.empty() || zones[0].start != zone_start || zones[0].type == zone_type::conventional) {
+            throw std::system_error(EINVAL, std::system_category(), format("no sequential zone starts at {}", zone_start));
+        }
+        co_return std::pair(zones[0].write_pointer, zones[0].start + zones[0].capacity);
+    };
+    auto write = [this, buffer, len, intent] (uint64_t pos) -> future<> {
+        // In parts which the io_queue doesn't split, so that they reach the
+        // zone in order
+        size_t off = 0;
+        while (off < len) {
+            auto part = std::min<size_t>(len - off, _write_max_length);
+            auto written = co_await write_dma(pos + off, static_cast<const char*>(buffer) + off, part, internal::maybe_priority_class_ref{}, intent);
+            if (written != part) {
+                throw std::system_error(EIO, std::system_category(), format("short write to the zone at {}", pos));
+            }
+            off += part;
+        }
+    };
+    return get_io_queue().append_to_zone(device_id(), zone_start, len, std::move(load), std::move(write));
+}
+
 future<>
 blockdev_file_impl::allocate(uint64_t position, uint64_t length) noexcept {
     // nothing to do for block device
@@ -664,17 +909,24 @@ blockdev_file_impl::allocate(uint64_t position, uint64_t length) noexcept {
 }
 
 future<size_t>
-blockdev_file_impl::write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
-    return posix_file_impl::do_write_dma(pos, buffer, len, pc, intent);
+blockdev_file_impl::write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync) noexcept {
+    if (nvme_carries(pos, buffer, len, true)) {
+        // Forced unit access stands for O_DSYNC and RWF_DSYNC
+        return nvme_dma(pos, buffer, len, pc, intent, true, dsync || (flags() & open_flags::dsync) == open_flags::dsync);
+    }
+    return posix_file_impl::do_write_dma(pos, buffer, len, pc, intent, dsync);
 }
 
 future<size_t>
-blockdev_file_impl::write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
-    return posix_file_impl::do_write_dma(pos, std::move(iov), pc, intent);
+blockdev_file_impl::write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync) noexcept {
+    return posix_file_impl::do_write_dma(pos, std::move(iov), pc, intent, dsync);
 }
 
 future<size_t>
 blockdev_file_impl::read_dma(uint64_t pos, void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+    if (nvme_carries(pos, buffer, len, false)) {
+        return nvme_dma(pos, buffer, len, pc, intent, false, false);
+    }
     return posix_file_impl::do_read_dma(pos, buffer, len, pc, intent);
 }
 
@@ -893,14 +1145,14 @@ append_challenged_posix_file_impl::read_dma(uint64_t pos, std::vector<iovec> iov
 }
 
 future<size_t>
-append_challenged_posix_file_impl::write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+append_challenged_posix_file_impl::write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync) noexcept {
     internal::intent_reference iref(intent);
     return enqueue<size_t>(
         opcode::write,
         pos,
         len,
-        [this, pos, buffer, len, pc, iref = std::move(iref)] {
-            return posix_file_impl::do_write_dma(pos, buffer, len, pc, iref.retrieve()).then([this, pos] (size_t ret) {
+        [this, pos, buffer, len, pc, dsync, iref = std::move(iref)] {
+            return posix_file_impl::do_write_dma(pos, buffer, len, pc, iref.retrieve(), dsync).then([this, pos] (size_t ret) {
                 commit_size(pos + ret);
                 return make_ready_future<size_t>(ret);
             });
@@ -909,15 +1161,15 @@ append_challenged_posix_file_impl::write_dma(uint64_t pos, const void* buffer, s
 }
 
 future<size_t>
-append_challenged_posix_file_impl::write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+append_challenged_posix_file_impl::write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync) noexcept {
     auto len = internal::iovec_len(iov);
     internal::intent_reference iref(intent);
     return enqueue<size_t>(
         opcode::write,
         pos,
         len,
-        [this, pos, iov = std::move(iov), pc, iref = std::move(iref)] () mutable {
-            return posix_file_impl::do_write_dma(pos, std::move(iov), pc, iref.retrieve()).then([this, pos] (size_t ret) {
+        [this, pos, iov = std::move(iov), pc, dsync, iref = std::move(iref)] () mutable {
+            return posix_file_impl::do_write_dma(pos, std::move(iov), pc, iref.retrieve(), dsync).then([this, pos] (size_t ret) {
                 commit_size(pos + ret);
                 return make_ready_future<size_t>(ret);
             });
@@ -931,7 +1183,7 @@ append_challenged_posix_file_impl::dma_read_bulk(uint64_t offset, size_t range_s
 }
 
 future<>
-append_challenged_posix_file_impl::flush() noexcept {
+append_challenged_posix_file_impl::do_flush() noexcept {
     if ((!_sloppy_size || _logical_size == _committed_size) && !_fsync_is_exclusive) {
         // FIXME: determine if flush can block concurrent reads or writes
         return posix_file_impl::flush();
@@ -951,6 +1203,43 @@ append_challenged_posix_file_impl::flush() noexcept {
     }
 }
 
+// A flush in flight may have started before the writes that the flushes
+// requested meanwhile must cover, so these wait for the next one instead.
+future<>
+append_challenged_posix_file_impl::group_flush() noexcept {
+    _flushing = true;
+    return do_flush().then_wrapped([me = shared_from_this()] (future<> f) {
+        me->_flushing = false;
+        if (me->_next_flush) {
+            auto next = std::move(*me->_next_flush);
+            me->_next_flush.reset();
+            // One fsync serves them all, the first one requested it
+            engine()._io_stats.fsyncs_coalesced += std::exchange(me->_next_flush_waiters, 0) - 1;
+            // The waiters get the result through the shared promise
+            (void)me->group_flush().then_wrapped([next = std::move(next)] (future<> f) mutable {
+                if (f.failed()) {
+                    next.set_exception(f.get_exception());
+                } else {
+                    next.set_value();
+                }
+            });
+        }
+        return f;
+    });
+}
+
+future<>
+append_challenged_posix_file_impl::flush() noexcept {
+    if (!_flushing) {
+        return group_flush();
+    }
+    if (!_next_flush) {
+        _next_flush.emplace();
+    }
+    ++_next_flush_waiters;
+    return _next_flush->get_shared_future();
+}
+
 future<>
 append_challenged_posix_file_impl::allocate(uint64_t position, uint64_t length) noexcept {
     return enqueue<>(
@@ -1033,6 +1322,184 @@ posix_file_handle_impl::to_file() && {
     return ret;
 }
 
+dax_file_impl::dax_file_impl(int fd, open_flags of, bool writable, file_open_options options, const internal::fs_info& fsi, dev_t device_id)
+        : posix_file_impl(fd, of, std::move(options), device_id, fsi)
+        , _writable(writable)
+        , _map_flags(emulate_for_tests ? MAP_SHARED : MAP_SHARED_VALIDATE | MAP_SYNC) {
+    // DAX filesystems copy the data of direct I/O without alignment
+    // constraints, as the mapping does
+    _disk_read_dma_alignment = 1;
+    _disk_write_dma_alignment = 1;
+    _disk_overwrite_dma_alignment = 1;
+    mapped(0, 0);
+}
+
+dax_file_impl::~dax_file_impl() {
+    unmap();
+}
+
+thread_local bool dax_file_impl::emulate_for_tests = false;
+
+bool dax_file_impl::supported(int fd, bool writable) noexcept {
+    if (!internal::pmem_supported()) {
+        return false;
+    }
+    if (emulate_for_tests) {
+        return true;
+    }
+    // Mapping files which aren't on a DAX filesystem with MAP_SYNC fails
+    auto length = ::getpagesize();
+    auto p = ::mmap(nullptr, length, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED_VALIDATE | MAP_SYNC, fd, 0);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    ::munmap(p, length);
+    return true;
+}
+
+bool dax_file_impl::mapped(uint64_t pos, size_t len) noexcept {
+    if (pos + len <= _size) {
+        return true;
+    }
+    // The file may have grown since
+    struct stat st;
+    if (_fd == -1 || ::fstat(_fd, &st) == -1) {
+        return false;
+    }
+    uint64_t size = st.st_size;
+    if (size > _mapped) {
+        // In steps of huge pages, which DAX filesystems map whole
+        auto length = align_up<size_t>(size, size_t(2) << 20);
+        auto p = _map
+                ? ::mremap(_map, _mapped, length, MREMAP_MAYMOVE)
+                : ::mmap(nullptr, length, PROT_READ | (_writable ? PROT_WRITE : 0), _map_flags, _fd, 0);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        _map = static_cast<char*>(p);
+        _mapped = length;
+    }
+    _size = size;
+    return pos + len <= _size;
+}
+
+void dax_file_impl::unmap() noexcept {
+    if (_map) {
+        ::munmap(_map, _mapped);
+        _map = nullptr;
+        _mapped = 0;
+        _size = 0;
+    }
+}
+
+void dax_file_impl::account(int rw_idx, size_t len) noexcept {
+    get_io_queue().account_direct(internal::priority_class(internal::maybe_priority_class_ref{}), internal::io_direction_and_length(rw_idx, len));
+}
+
+future<size_t>
+dax_file_impl::read_dma(uint64_t pos, void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+    if (!mapped(pos, len)) {
+        return do_read_dma(pos, buffer, len, pc, intent);
+    }
+    std::memcpy(buffer, _map + pos, len);
+    account(internal::io_direction_and_length::read_idx, len);
+    return make_ready_future<size_t>(len);
+}
+
+future<size_t>
+dax_file_impl::read_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+    auto len = internal::iovec_len(iov);
+    if (!mapped(pos, len)) {
+        return do_read_dma(pos, std::move(iov), pc, intent);
+    }
+    auto src = _map + pos;
+    for (auto& v : iov) {
+        std::memcpy(v.iov_base, src, v.iov_len);
+        src += v.iov_len;
+    }
+    account(internal::io_direction_and_length::read_idx, len);
+    return make_ready_future<size_t>(len);
+}
+
+future<size_t>
+dax_file_impl::write_dma(uint64_t pos, const void* buffer, size_t len, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync) noexcept {
+    if (!_writable || !mapped(pos, len)) {
+        return do_write_dma(pos, buffer, len, pc, intent, dsync).then([this] (size_t written) {
+            _unsynced = true;
+            return written;
+        });
+    }
+    internal::pmem_copy(_map + pos, buffer, len);
+    account(internal::io_direction_and_length::write_idx, len);
+    return make_ready_future<size_t>(len);
+}
+
+future<size_t>
+dax_file_impl::write_dma(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent, bool dsync) noexcept {
+    auto len = internal::iovec_len(iov);
+    if (!_writable || !mapped(pos, len)) {
+        return do_write_dma(pos, std::move(iov), pc, intent, dsync).then([this] (size_t written) {
+            _unsynced = true;
+            return written;
+        });
+    }
+    auto dst = _map + pos;
+    for (auto& v : iov) {
+        internal::pmem_copy(dst, v.iov_base, v.iov_len);
+        dst += v.iov_len;
+    }
+    account(internal::io_direction_and_length::write_idx, len);
+    return make_ready_future<size_t>(len);
+}
+
+future<temporary_buffer<uint8_t>>
+dax_file_impl::dma_read_bulk(uint64_t offset, size_t range_size, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
+    if (!mapped(offset, range_size)) {
+        return do_dma_read_bulk(offset, range_size, pc, intent);
+    }
+    try {
+        auto buf = temporary_buffer<uint8_t>::aligned(_memory_dma_alignment, range_size);
+        std::memcpy(buf.get_write(), _map + offset, range_size);
+        account(internal::io_direction_and_length::read_idx, range_size);
+        return make_ready_future<temporary_buffer<uint8_t>>(std::move(buf));
+    } catch (...) {
+        return current_exception_as_future<temporary_buffer<uint8_t>>();
+    }
+}
+
+future<>
+dax_file_impl::flush() noexcept {
+    if (!std::exchange(_unsynced, false)) {
+        return make_ready_future<>();
+    }
+    return posix_file_impl::flush().handle_exception([this] (std::exception_ptr ex) {
+        _unsynced = true;
+        return make_exception_future<>(std::move(ex));
+    });
+}
+
+future<>
+dax_file_impl::truncate(uint64_t length) noexcept {
+    // The part cut off is no longer accessed from now on
+    _size = std::min(_size, length);
+    return posix_file_impl::truncate(length).then([this] {
+        _unsynced = true;
+    });
+}
+
+future<>
+dax_file_impl::allocate(uint64_t position, uint64_t length) noexcept {
+    return posix_file_impl::allocate(position, length).then([this] {
+        _unsynced = true;
+    });
+}
+
+future<>
+dax_file_impl::close() noexcept {
+    unmap();
+    return posix_file_impl::close();
+}
+
 // Some kernels can append to xfs filesystems, some cannot; determine
 // from kernel version.
 static
@@ -1128,6 +1595,11 @@ make_file_impl(int fd, file_open_options options, int flags, struct stat st) noe
 
     try {
         const internal::fs_info& fsi = i->second;
+        // Mapping needs the file to be readable
+        if (options.dax && (flags & O_ACCMODE) != O_WRONLY && dax_file_impl::supported(fd, (flags & O_ACCMODE) == O_RDWR)) {
+            return make_ready_future<shared_ptr<file_impl>>(make_shared<dax_file_impl>(fd, open_flags(flags), (flags & O_ACCMODE) == O_RDWR,
+                    std::move(options), fsi, st_dev));
+        }
         if (!fsi.append_challenged || options.append_is_unlikely || ((flags & O_ACCMODE) == O_RDONLY)) {
             return make_ready_future<shared_ptr<file_impl>>(make_shared<posix_file_real_impl>(fd, open_flags(flags), std::move(options), fsi, st_dev));
         }
@@ -1230,6 +1702,66 @@ file::dma_read_bulk_impl(uint64_t offset, size_t range_size, internal::maybe_pri
   }
 }
 
+future<std::vector<temporary_buffer<uint8_t>>>
+file::dma_read_bulk_fragmented_impl(uint64_t offset, size_t range_size, size_t fragment_size, io_intent* intent) {
+    // the file object may go away while reading, its implementation may not
+    auto impl = _file_impl;
+    uint64_t disk_alignment = disk_read_dma_alignment();
+    auto front = offset & (disk_alignment - 1);
+    auto pos = offset - front;
+    auto len = align_up<uint64_t>(front + range_size, disk_alignment);
+    // both alignments are powers of two
+    fragment_size = align_up<size_t>(std::max<size_t>(fragment_size, 1), std::max<size_t>(disk_alignment, memory_dma_alignment()));
+
+    std::vector<temporary_buffer<uint8_t>> bufs;
+    bufs.reserve((len + fragment_size - 1) / fragment_size);
+    for (uint64_t done = 0; done < len; done += fragment_size) {
+        bufs.push_back(temporary_buffer<uint8_t>::aligned(memory_dma_alignment(), std::min<uint64_t>(fragment_size, len - done)));
+    }
+
+    // Like dma_read_bulk(), read on after a short read that ends aligned,
+    // which is not the end of the file
+    uint64_t read = 0;
+    while (read < len) {
+        std::vector<iovec> iov;
+        iov.reserve(bufs.size());
+        uint64_t skip = read;
+        for (auto& b : bufs) {
+            if (skip >= b.size()) {
+                skip -= b.size();
+                continue;
+            }
+            iov.push_back(iovec{b.get_write() + skip, b.size() - skip});
+            skip = 0;
+        }
+        auto n = co_await impl->read_dma(pos + read, std::move(iov), intent);
+        read += n;
+        if (n == 0 || (read & (disk_alignment - 1))) {
+            break;
+        }
+    }
+
+    // keep [front, front + range_size) of what was read
+    auto end = std::min<uint64_t>(read, front + range_size);
+    std::vector<temporary_buffer<uint8_t>> res;
+    res.reserve(bufs.size());
+    uint64_t buf_start = 0;
+    for (auto& b : bufs) {
+        auto buf_end = buf_start + b.size();
+        if (buf_start >= end) {
+            break;
+        }
+        if (buf_end > front) {
+            auto skip = front > buf_start ? front - buf_start : 0;
+            b.trim(std::min(buf_end, end) - buf_start);
+            b.trim_front(skip);
+            res.push_back(std::move(b));
+        }
+        buf_start = buf_end;
+    }
+    co_return res;
+}
+
 future<> file::discard(uint64_t offset, uint64_t length) noexcept {
   try {
     return _file_impl->discard(offset, length);
@@ -1287,6 +1819,65 @@ file::dma_write_impl(uint64_t pos, const uint8_t* buffer, size_t len, internal::
   }
 }
 
+future<size_t> file::dma_write_impl(uint64_t pos, std::vector<iovec> iov, write_durability durability, io_intent* intent) noexcept {
+  try {
+    if (durability == write_durability::data) {
+        return _file_impl->write_dma_dsync(pos, std::move(iov), intent);
+    }
+    return _file_impl->write_dma(pos, std::move(iov), intent);
+  } catch (...) {
+    return current_exception_as_future<size_t>();
+  }
+}
+
+future<size_t>
+file::dma_write_impl(uint64_t pos, const uint8_t* buffer, size_t len, write_durability durability, io_intent* intent) noexcept {
+  try {
+    if (durability == write_durability::data) {
+        return _file_impl->write_dma_dsync(pos, buffer, len, intent);
+    }
+    return _file_impl->write_dma(pos, buffer, len, intent);
+  } catch (...) {
+    return current_exception_as_future<size_t>();
+  }
+}
+
+future<size_t>
+file::dma_write_ordered(std::vector<ordered_write> writes, write_durability durability, io_intent* intent) noexcept {
+  try {
+    return _file_impl->write_dma_ordered(std::move(writes), durability, intent);
+  } catch (...) {
+    return current_exception_as_future<size_t>();
+  }
+}
+
+future<std::vector<zone_info>>
+file::report_zones(uint64_t offset, size_t max_zones) noexcept {
+  try {
+    return _file_impl->report_zones(offset, max_zones);
+  } catch (...) {
+    return current_exception_as_future<std::vector<zone_info>>();
+  }
+}
+
+future<>
+file::manage_zones(zone_action action, uint64_t offset, uint64_t length) noexcept {
+  try {
+    return _file_impl->manage_zones(action, offset, length);
+  } catch (...) {
+    return current_exception_as_future();
+  }
+}
+
+future<uint64_t>
+file::dma_zone_append(uint64_t zone_start, const void* buffer, size_t len, io_intent* intent) noexcept {
+  try {
+    return _file_impl->zone_append_dma(zone_start, buffer, len, intent);
+  } catch (...) {
+    return current_exception_as_future<uint64_t>();
+  }
+}
+
 future<size_t> file::dma_read_impl(uint64_t pos, std::vector<iovec> iov, internal::maybe_priority_class_ref pc, io_intent* intent) noexcept {
   try {
     return _file_impl->read_dma(pos, std::move(iov), intent);
@@ -1335,6 +1926,11 @@ file_impl* file_impl::get_file_impl(file& f) {
     return f._file_impl.get();
 }
 
+int posix_file_impl::fd_of(file& f) noexcept {
+    auto impl = dynamic_cast<posix_file_impl*>(get_file_impl(f));
+    return impl ? impl->_fd : -1;
+}
+
 std::unique_ptr<seastar::file_handle_impl>
 file_impl::dup() {
     throw std::runtime_error("this file type cannot be duplicated");
@@ -1364,6 +1960,49 @@ coroutine::experimental::generator<directory_entry> file_impl::experimental_list
     return make_list_directory_fallback_generator(*this);
 }
 
+static std::system_error zones_not_supported() {
+    return std::system_error(ENOTSUP, std::system_category(), "zones are only supported by block devices");
+}
+
+future<std::vector<zone_info>> file_impl::report_zones(uint64_t offset, size_t max_zones) {
+    return make_exception_future<std::vector<zone_info>>(zones_not_supported());
+}
+
+future<> file_impl::manage_zones(zone_action action, uint64_t offset, uint64_t length) {
+    return make_exception_future<>(zones_not_supported());
+}
+
+future<uint64_t> file_impl::zone_append_dma(uint64_t zone_start, const void* buffer, size_t len, io_intent*) {
+    return make_exception_future<uint64_t>(zones_not_supported());
+}
+
+future<size_t> file_impl::write_dma_dsync(uint64_t pos, const void* buffer, size_t len, io_intent* intent) {
+    auto ret = co_await write_dma(pos, buffer, len, intent);
+    co_await flush();
+    co_return ret;
+}
+
+future<size_t> file_impl::write_dma_dsync(uint64_t pos, std::vector<iovec> iov, io_intent* intent) {
+    auto ret = co_await write_dma(pos, std::move(iov), intent);
+    co_await flush();
+    co_return ret;
+}
+
+future<size_t> file_impl::write_dma_ordered(std::vector<ordered_write> writes, write_durability durability, io_intent* intent) {
+    size_t ret = 0;
+    for (auto& w : writes) {
+        auto len = co_await write_dma(w.pos, w.buffer, w.len, intent);
+        ret += len;
+        if (len < w.len) {
+            break;
+        }
+    }
+    if (durability == write_durability::data) {
+        co_await flush();
+    }
+    co_return ret;
+}
+
 future<int> file_impl::ioctl(uint64_t cmd, void* argp) noexcept {
     return make_exception_future<int>(std::runtime_error("this file type does not support ioctl"));
 }
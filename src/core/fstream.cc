@@ -27,9 +27,11 @@ module;
 #include <fmt/ostream.h>
 #include <malloc.h>
 #include <string.h>
+#include <chrono>
 #include <ratio>
 #include <optional>
 #include <utility>
+#include <vector>
 #include <seastar/util/assert.hh>
 
 #ifdef SEASTAR_MODULE
@@ -42,6 +44,7 @@ module seastar;
 #include <seastar/core/reactor.hh>
 #include <seastar/core/when_all.hh>
 #include <seastar/core/io_intent.hh>
+#include <seastar/util/crc32c.hh>
 #endif
 
 namespace seastar {
@@ -77,15 +80,88 @@ inline internal::maybe_priority_class_ref get_io_priority(const Options& opts) {
     return internal::maybe_priority_class_ref{};
 }
 
+checksum_error::checksum_error(uint64_t block)
+        : std::runtime_error(fmt::format("checksum mismatch in block {}", block)), _block(block) {
+}
+
+// Checksums the consecutive blocks of the data flowing through a file
+// stream. A block is only checksummed if the stream goes through all of
+// it, the last block of the file being the one the stream ends in.
+class block_checksummer {
+    lw_shared_ptr<file_checksums> _sums;
+    uint64_t _pos;
+    crc32c _crc;
+    // whether _crc covers the current block from its start
+    bool _whole;
+public:
+    block_checksummer(lw_shared_ptr<file_checksums> sums, uint64_t pos)
+            : _sums(std::move(sums)), _pos(pos) {
+        if (!_sums->block_size) {
+            throw std::invalid_argument("file_checksums block size must not be zero");
+        }
+        _whole = _pos % _sums->block_size == 0;
+    }
+
+    file_checksums& sums() noexcept {
+        return *_sums;
+    }
+
+    // Feeds the data at the current position, calling on_block(index, checksum)
+    // for each block it completes
+    template <typename Func>
+    void feed(const char* p, size_t size, Func on_block) {
+        auto block_size = _sums->block_size;
+        while (size) {
+            auto now = std::min<uint64_t>(size, block_size - _pos % block_size);
+            if (_whole) {
+                _crc.process(p, now);
+            }
+            _pos += now;
+            p += now;
+            size -= now;
+            if (_pos % block_size == 0) {
+                if (_whole) {
+                    on_block(_pos / block_size - 1, _crc.get());
+                }
+                _crc = {};
+                _whole = true;
+            }
+        }
+    }
+
+    // Ends the data at the current position, completing the block it is in
+    template <typename Func>
+    void finish(Func on_block) {
+        if (_whole && _pos % _sums->block_size) {
+            on_block(_pos / _sums->block_size, _crc.get());
+        }
+        _crc = {};
+        _whole = false;
+    }
+
+    void skip(uint64_t n) noexcept {
+        _pos += n;
+        _crc = {};
+        _whole = _pos % _sums->block_size == 0;
+    }
+
+    uint64_t position() const noexcept {
+        return _pos;
+    }
+};
+
 class file_data_source_impl : public data_source_impl {
     struct issued_read {
         uint64_t _pos;
         uint64_t _size;
         future<temporary_buffer<char>> _ready;
+        // in adaptive mode, so that the read can be cancelled alone
+        std::unique_ptr<io_intent> _intent;
 
-        issued_read(uint64_t pos, uint64_t size, future<temporary_buffer<char>> f)
-            : _pos(pos), _size(size), _ready(std::move(f)) { }
+        issued_read(uint64_t pos, uint64_t size, future<temporary_buffer<char>> f, std::unique_ptr<io_intent> intent = nullptr)
+            : _pos(pos), _size(size), _ready(std::move(f)), _intent(std::move(intent)) { }
     };
+    using clock_type = std::chrono::steady_clock;
 
     reactor& _reactor = engine();
     file _file;
@@ -101,16 +177,71 @@ class file_data_source_impl : public data_source_impl {
     bool _in_slow_start = false;
     io_intent _intent;
     using unused_ratio_target = std::ratio<25, 100>;
+    // adaptive mode state, see file_input_stream_options::adaptive
+    static constexpr unsigned sequential_threshold = 2;
+    unsigned _sequential_reads = 0;
+    // moving averages of the latency of the reads and of the time the
+    // consumer takes to come back for the next buffer
+    clock_type::duration _read_latency{};
+    clock_type::duration _consume_time{};
+    // when the consumer got the last buffer, or its position if it is
+    // still waiting for it
+    clock_type::time_point _ready_at{};
+    std::optional<uint64_t> _awaited_read;
 private:
     size_t minimal_buffer_size() const {
         return std::min(std::max(_options.buffer_size / 4, size_t(8192)), _options.buffer_size);
     }
 
+    static clock_type::duration moving_average(clock_type::duration avg, clock_type::duration sample) {
+        return avg.count() ? (avg * 7 + sample) / 8 : sample;
+    }
+
+    // the reads ahead needed for the next buffers to be ready when the
+    // consumer wants them: as many as buffers are consumed during a read
+    unsigned latency_read_ahead() const {
+        if (!_read_latency.count()) {
+            return 1;
+        }
+        auto consume_time = std::max(_consume_time, clock_type::duration(std::chrono::microseconds(1)));
+        auto depth = (_read_latency + consume_time - clock_type::duration(1)) / consume_time;
+        // read_ahead may be 0, which std::clamp() does not allow as bounds
+        return std::max<uint64_t>(1, std::min<uint64_t>(depth, _options.read_ahead));
+    }
+
+    void adapt_on_get() {
+        auto now = clock_type::now();
+        if (_ready_at != clock_type::time_point{}) {
+            _consume_time = moving_average(_consume_time, now - _ready_at);
+        }
+        if (++_sequential_reads < sequential_threshold) {
+            return;
+        }
+        _current_buffer_size = std::min(_current_buffer_size * 2, _options.buffer_size);
+        _current_read_ahead = std::min(latency_read_ahead(), _options.read_ahead);
+    }
+
+    void adapt_on_random_access() {
+        _sequential_reads = 0;
+        _current_read_ahead = 0;
+        _current_buffer_size = minimal_buffer_size();
+    }
+
+    // Drops a read, cancelling it if it has an intent of its own
+    void drop_read(issued_read& r) {
+        if (r._intent) {
+            r._intent->cancel();
+            // the file may still use the intent until the read resolves
+            r._ready = r._ready.finally([intent = std::move(r._intent)] {});
+        }
+        ignore_read_future(std::move(r._ready));
+    }
+
     void try_increase_read_ahead() {
         // Read-ahead can be increased up to user-specified limit if the
         // consumer has to wait for a buffer and we are not in a slow start
         // phase.
-        if (_current_read_ahead < _options.read_ahead && !_in_slow_start) {
+        if (_current_read_ahead < _options.read_ahead && !_in_slow_start && !_options.adaptive) {
             _current_read_ahead++;
             if (_options.dynamic_adjustments) {
                 auto& h = *_options.dynamic_adjustments;
@@ -213,6 +344,10 @@ class file_data_source_impl : public data_source_impl {
     {
         _options.buffer_size = select_buffer_size(_options.buffer_size, _file.disk_read_max_length());
         _current_buffer_size = _options.buffer_size;
+        if (_options.adaptive) {
+            _options.dynamic_adjustments = nullptr;
+            adapt_on_random_access();
+        }
         // prevent wraparounds
         set_new_buffer_size(after_skip::no);
         _remain = std::min(std::numeric_limits<uint64_t>::max() - _pos, _remain);
@@ -223,6 +358,9 @@ class file_data_source_impl : public data_source_impl {
         SEASTAR_ASSERT(_reads_in_progress == 0);
     }
     virtual future<temporary_buffer<char>> get() override {
+        if (_options.adaptive) {
+            adapt_on_get();
+        }
         if (!_read_buffers.empty() && !_read_buffers.front()._ready.available()) {
             try_increase_read_ahead();
         }
@@ -230,6 +368,15 @@ class file_data_source_impl : public data_source_impl {
         auto ret = std::move(_read_buffers.front());
         _read_buffers.pop_front();
         update_history_consumed(ret._size);
+        if (_options.adaptive) {
+            if (ret._ready.available()) {
+                _ready_at = clock_type::now();
+                _awaited_read.reset();
+            } else {
+                // _ready_at is set when it completes
+                _awaited_read = ret._pos;
+            }
+        }
         _reactor._io_stats.fstream_reads += 1;
         _reactor._io_stats.fstream_read_bytes += ret._size;
         if (!ret._ready.available()) {
@@ -240,11 +387,13 @@ class file_data_source_impl : public data_source_impl {
     }
     virtual future<temporary_buffer<char>> skip(uint64_t n) override {
         uint64_t dropped = 0;
+        bool beyond = false;
         while (n) {
             if (_read_buffers.empty()) {
                 SEASTAR_ASSERT(n <= _remain);
                 _pos += n;
                 _remain -= n;
+                beyond = true;
                 break;
             }
             auto& front = _read_buffers.front();
@@ -257,7 +406,7 @@ class file_data_source_impl : public data_source_impl {
                 });
                 break;
             } else {
-                ignore_read_future(std::move(front._ready));
+                drop_read(front);
                 n -= front._size;
                 dropped += front._size;
                 _reactor._io_stats.fstream_read_aheads_discarded += 1;
@@ -266,6 +415,9 @@ class file_data_source_impl : public data_source_impl {
             }
         }
         update_history_unused(dropped);
+        if (_options.adaptive && (dropped || beyond)) {
+            adapt_on_random_access();
+        }
         return make_ready_future<temporary_buffer<char>>();
     }
     virtual future<> close() override {
@@ -274,6 +426,11 @@ class file_data_source_impl : public data_source_impl {
             _done->set_value();
         }
         _intent.cancel();
+        for (auto& c : _read_buffers) {
+            if (c._intent) {
+                c._intent->cancel();
+            }
+        }
         return _done->get_future().then([this] {
             uint64_t dropped = 0;
             for (auto&& c : _read_buffers) {
@@ -302,6 +459,13 @@ class file_data_source_impl : public data_source_impl {
                 continue;
             }
             ++_reads_in_progress;
+            std::unique_ptr<io_intent> own_intent;
+            io_intent* intent = &_intent;
+            if (_options.adaptive) {
+                own_intent = std::make_unique<io_intent>();
+                intent = own_intent.get();
+            }
+            auto issued_at = _options.adaptive ? clock_type::now() : clock_type::time_point{};
             // if _pos is not dma-aligned, we'll get a short read.  Account for that.
             // Also avoid reading beyond _remain.
             uint64_t align = _file.disk_read_dma_alignment();
@@ -310,9 +474,9 @@ class file_data_source_impl : public data_source_impl {
             auto len = end - start;
             auto actual_size = std::min(end - _pos, _remain);
             _read_buffers.emplace_back(_pos, actual_size, futurize_invoke([&] {
-                    return _file.dma_read_bulk_impl(start, len, get_io_priority(_options), &_intent);
+                    return _file.dma_read_bulk_impl(start, len, get_io_priority(_options), intent);
             }).then_wrapped(
-                    [this, start, pos = _pos, remain = _remain] (future<temporary_buffer<uint8_t>> ret) {
+                    [this, start, pos = _pos, remain = _remain, issued_at] (future<temporary_buffer<uint8_t>> ret) {
                 --_reads_in_progress;
                 if (_done && !_reads_in_progress) {
                     _done->set_value();
@@ -321,6 +485,13 @@ class file_data_source_impl : public data_source_impl {
                     // no games needed
                     return make_exception_future<temporary_buffer<char>>(ret.get_exception());
                 } else {
+                    if (issued_at != clock_type::time_point{}) {
+                        auto now = clock_type::now();
+                        _read_latency = moving_average(_read_latency, now - issued_at);
+                        if (_awaited_read == pos) {
+                            _ready_at = now;
+                        }
+                    }
                     // first or last buffer, need trimming
                     auto tmp = ret.get();
                     auto real_end = start + tmp.size();
@@ -335,21 +506,106 @@ class file_data_source_impl : public data_source_impl {
                     }
                     return make_ready_future<temporary_buffer<char>>(temporary_buffer<char>(reinterpret_cast<char*>(tmp.get_write()), tmp.size(), tmp.release()));
                 }
-            }));
+            }), std::move(own_intent));
             _remain -= end - _pos;
             _pos = end;
         };
     }
 };
 
+// Verifies the data read from a file against its checksums
+class checksummed_data_source_impl : public data_source_impl {
+    data_source _src;
+    block_checksummer _checksummer;
+    uint64_t _end;
+
+    void verify(uint64_t block, uint32_t crc) {
+        auto& sums = _checksummer.sums();
+        if (block < sums.blocks.size()) {
+            if (sums.blocks[block] != crc) {
+                throw checksum_error(block);
+            }
+        } else if (block == sums.blocks.size()) {
+            sums.blocks.push_back(crc);
+            sums.size = _checksummer.position();
+        }
+    }
+
+    temporary_buffer<char> check(temporary_buffer<char> buf) {
+        auto on_block = [this] (uint64_t block, uint32_t crc) { verify(block, crc); };
+        if (buf.empty()) {
+            // a stream that ends before its range did reach the end of file
+            if (_checksummer.position() < _end) {
+                _checksummer.finish(on_block);
+            }
+        } else {
+            _checksummer.feed(buf.get(), buf.size(), on_block);
+            // the end of a short last block is known, which the stream may
+            // stop at without reading to the end of file
+            auto& sums = _checksummer.sums();
+            if (_checksummer.position() == sums.size && sums.size % sums.block_size) {
+                _checksummer.finish(on_block);
+            }
+        }
+        return buf;
+    }
+public:
+    checksummed_data_source_impl(data_source src, lw_shared_ptr<file_checksums> sums, uint64_t offset, uint64_t len)
+            : _src(std::move(src))
+            , _checksummer(std::move(sums), offset)
+            , _end(len > std::numeric_limits<uint64_t>::max() - offset ? std::numeric_limits<uint64_t>::max() : offset + len) {
+    }
+    virtual future<temporary_buffer<char>> get() override {
+        return _src.get().then([this] (temporary_buffer<char> buf) {
+            return check(std::move(buf));
+        });
+    }
+    virtual future<temporary_buffer<char>> skip(uint64_t n) override {
+        _checksummer.skip(n);
+        return _src.skip(n).then([this] (temporary_buffer<char> buf) {
+            return buf.empty() ? std::move(buf) : check(std::move(buf));
+        });
+    }
+    virtual future<> close() override {
+        return _src.close();
+    }
+};
+
 data_source make_file_data_source(file f, uint64_t offset, uint64_t len, file_input_stream_options opt) {
-    return data_source(std::make_unique<file_data_source_impl>(std::move(f), offset, len, std::move(opt)));
+    auto sums = std::move(opt.checksums);
+    auto src = data_source(std::make_unique<file_data_source_impl>(std::move(f), offset, len, std::move(opt)));
+    if (!sums) {
+        return src;
+    }
+    return data_source(std::make_unique<checksummed_data_source_impl>(std::move(src), std::move(sums), offset, len));
 }
 
 data_source make_file_data_source(file f, file_input_stream_options opt) {
     return make_file_data_source(std::move(f), 0, std::numeric_limits<uint64_t>::max(), std::move(opt));
 }
 
+future<> data_sink_impl::put_file(file& f, uint64_t pos, uint64_t len) {
+    return do_with(make_file_input_stream(f, pos, len), uint64_t(0), [this, len] (input_stream<char>& in, uint64_t& sent) {
+        return repeat([this, &in, &sent] {
+            return in.read().then([this, &sent] (temporary_buffer<char> buf) {
+                if (buf.empty()) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                sent += buf.size();
+                return put(std::move(buf)).then([] {
+                    return stop_iteration::no;
+                });
+            });
+        }).then([&sent, len] {
+            if (sent != len) {
+                throw std::runtime_error(format("file ended {} bytes short of the range to write", len - sent));
+            }
+        }).finally([&in] {
+            return in.close();
+        });
+    });
+}
+
 input_stream<char> make_file_input_stream(
         file f, uint64_t offset, uint64_t len, file_input_stream_options options) {
     return input_stream<char>(make_file_data_source(std::move(f), offset, len, std::move(options)));
@@ -367,19 +623,52 @@ input_stream<char> make_file_input_stream(
 
 
 class file_data_sink_impl : public data_sink_impl {
+    using clock_type = std::chrono::steady_clock;
+
     file _file;
     file_output_stream_options _options;
     uint64_t _pos = 0;
     semaphore _write_behind_sem = { _options.write_behind };
     future<> _background_writes_done = make_ready_future<>();
     bool _failed = false;
+    unsigned _write_behind;
+    // adaptive mode state, see file_output_stream_options::adaptive
+    static constexpr uint64_t window_size = 8 << 20;
+    std::vector<temporary_buffer<char>> _gathered;
+    uint64_t _gathered_pos = 0;
+    size_t _gathered_size = 0;
+    size_t _write_size = 0;
+    uint64_t _bytes_written = 0;
+    double _throughput = 0;
+    // the current throughput measurement window, and whether the stream
+    // had to wait for the writes during it
+    clock_type::time_point _window_start{};
+    uint64_t _window_bytes = 0;
+    bool _window_stalled = false;
+    std::optional<block_checksummer> _checksummer;
 public:
     file_data_sink_impl(file f, file_output_stream_options options)
             : _file(std::move(f)), _options(options) {
         _options.buffer_size = select_buffer_size<unsigned>(_options.buffer_size, _file.disk_write_max_length());
+        if (_options.adaptive) {
+            if (!_options.write_behind) {
+                _options.write_behind = 1;
+                _write_behind_sem.signal();
+            }
+            _options.max_write_behind = std::max(_options.max_write_behind, _options.write_behind);
+            _options.max_write_size = std::max(align_down(_options.max_write_size, _options.buffer_size), _options.buffer_size);
+            _write_size = _options.buffer_size;
+        }
+        _write_behind = _options.write_behind;
+        if (_options.checksums) {
+            _options.checksums->blocks.clear();
+            _options.checksums->size = 0;
+            _checksummer.emplace(_options.checksums, 0);
+        }
 	if (_options.write_behind) {
             _write_behind_sem.ensure_space_for_waiters(1); // So that wait() doesn't throw
 	}
+        update_stats();
     }
     future<> put(net::packet data) override { abort(); }
     virtual temporary_buffer<char> allocate_buffer(size_t size) override {
@@ -389,22 +678,38 @@ class file_data_sink_impl : public data_sink_impl {
     virtual future<> put(temporary_buffer<char> buf) override {
         uint64_t pos = _pos;
         _pos += buf.size();
+        if (_checksummer) {
+            _checksummer->feed(buf.get(), buf.size(), [this] (uint64_t, uint32_t crc) { record_checksum(crc); });
+        }
+        if (_options.adaptive) {
+            return gather(pos, std::move(buf));
+        }
         if (!_options.write_behind) {
             return do_put(pos, std::move(buf));
         }
+        return write_behind([this, pos, buf = std::move(buf)] () mutable {
+            return do_put(pos, std::move(buf));
+        });
+    }
+private:
+    template <typename Write>
+    future<> write_behind(Write write) {
         // Write behind strategy:
         //
         // 1. Issue N writes in parallel, using a semaphore to limit to N
         // 2. Collect results in _background_writes_done, merging exception futures
         // 3. If we've already seen a failure, don't issue more writes.
-        return _write_behind_sem.wait().then([this, pos, buf = std::move(buf)] () mutable {
+        if (_write_behind_sem.available_units() <= 0) {
+            _window_stalled = true;
+        }
+        return _write_behind_sem.wait().then([this, write = std::move(write)] () mutable {
             if (_failed) {
                 _write_behind_sem.signal();
                 auto ret = std::move(_background_writes_done);
                 _background_writes_done = make_ready_future<>();
                 return ret;
             }
-            auto this_write_done = do_put(pos, std::move(buf)).finally([this] {
+            auto this_write_done = write().finally([this] {
                 _write_behind_sem.signal();
             });
             _background_writes_done = when_all(std::move(_background_writes_done), std::move(this_write_done))
@@ -425,7 +730,126 @@ class file_data_sink_impl : public data_sink_impl {
             return make_ready_future<>();
         });
     }
-private:
+
+    // Adds the buffer to the next write, which is issued once it is
+    // _write_size long. Only the last buffer can have an unaligned length,
+    // it is written on its own as it is copied anyway.
+    future<> gather(uint64_t pos, temporary_buffer<char> buf) {
+        if ((buf.size() & (_file.disk_write_dma_alignment() - 1)) != 0) {
+            return issue_gathered().then([this, pos, buf = std::move(buf)] () mutable {
+                return write_behind([this, pos, buf = std::move(buf)] () mutable {
+                    auto len = buf.size();
+                    return do_put(pos, std::move(buf)).then([this, len] {
+                        on_written(len);
+                    });
+                });
+            });
+        }
+        if (_gathered.empty()) {
+            _gathered_pos = pos;
+        }
+        _gathered_size += buf.size();
+        _gathered.push_back(std::move(buf));
+        if (_gathered_size < _write_size) {
+            return make_ready_future<>();
+        }
+        return issue_gathered();
+    }
+
+    future<> issue_gathered() {
+        if (_gathered.empty()) {
+            return make_ready_future<>();
+        }
+        _gathered_size = 0;
+        return write_behind([this, pos = _gathered_pos, bufs = std::exchange(_gathered, {})] () mutable {
+            return do_put_gathered(pos, std::move(bufs));
+        });
+    }
+
+    future<> do_put_gathered(uint64_t pos, std::vector<temporary_buffer<char>> bufs) noexcept {
+      try {
+        std::vector<iovec> iov;
+        iov.reserve(bufs.size());
+        size_t len = 0;
+        for (auto& b : bufs) {
+            iov.push_back(iovec{b.get_write(), b.size()});
+            len += b.size();
+        }
+        if (_window_start == clock_type::time_point{}) {
+            _window_start = clock_type::now();
+        }
+        return _file.dma_write_impl(pos, std::move(iov), get_io_priority(_options), nullptr).then(
+                [this, pos, len, bufs = std::move(bufs)] (size_t size) mutable {
+            on_written(size);
+            if (size < len) {
+                // short write, go on with what is left
+                auto skip = size;
+                std::erase_if(bufs, [&skip] (temporary_buffer<char>& b) {
+                    auto trim = std::min(skip, b.size());
+                    b.trim_front(trim);
+                    skip -= trim;
+                    return b.empty();
+                });
+                return do_put_gathered(pos + size, std::move(bufs));
+            }
+            return make_ready_future<>();
+        });
+      } catch (...) {
+          return current_exception_as_future();
+      }
+    }
+
+    // Measures the throughput over windows of written data, growing the
+    // writes if the stream waited for them during the window and the
+    // target is not met
+    void on_written(size_t len) {
+        _bytes_written += len;
+        _window_bytes += len;
+        if (_window_bytes >= std::max<uint64_t>(window_size, 2 * _write_size * _write_behind)) {
+            auto now = clock_type::now();
+            auto elapsed = std::chrono::duration<double>(now - _window_start).count();
+            _throughput = elapsed > 0 ? _window_bytes / elapsed : 0;
+            if (_window_stalled && (!_options.bandwidth_target || _throughput < _options.bandwidth_target)) {
+                grow();
+            }
+            _window_start = now;
+            _window_bytes = 0;
+            _window_stalled = false;
+        }
+        update_stats();
+    }
+
+    void grow() {
+        if (_write_size < _options.max_write_size) {
+            _write_size = std::min<size_t>(_write_size * 2, _options.max_write_size);
+        } else if (_write_behind < _options.max_write_behind) {
+            _write_behind++;
+            _write_behind_sem.signal();
+        }
+    }
+
+    void record_checksum(uint32_t crc) {
+        _checksummer->sums().blocks.push_back(crc);
+        _checksummer->sums().size = _checksummer->position();
+    }
+
+    // records the short last block, which only the end of the stream ends
+    void finish_checksums() {
+        if (_checksummer) {
+            _checksummer->finish([this] (uint64_t, uint32_t crc) { record_checksum(crc); });
+        }
+    }
+
+    void update_stats() {
+        if (_options.stats) {
+            auto& st = *_options.stats;
+            st.bytes_written = _bytes_written;
+            st.throughput = _throughput;
+            st.write_size = _write_size;
+            st.write_behind = _write_behind;
+        }
+    }
+
     future<> do_put(uint64_t pos, temporary_buffer<char> buf) noexcept {
       try {
         // put() must usually be of chunks multiple of file::dma_alignment.
@@ -472,20 +896,27 @@ class file_data_sink_impl : public data_sink_impl {
     future<> wait() noexcept {
         // restore to pristine state; for flush() + close() sequence
         // (we allow either flush, or close, or both)
-        return _write_behind_sem.wait(_options.write_behind).then([this] {
+        return _write_behind_sem.wait(_write_behind).then([this] {
             return std::exchange(_background_writes_done, make_ready_future<>());
-        }).finally([this] {
-            _write_behind_sem.signal(_options.write_behind);
+        }).finally([this, units = _write_behind] {
+            _write_behind_sem.signal(units);
         });
     }
 public:
     virtual future<> flush() override {
-        return wait().then([this] {
+        return issue_gathered().then([this] {
+            return wait();
+        }).then([this] {
             return _file.flush();
         });
     }
     virtual future<> close() noexcept override {
-        return wait().finally([this] {
+        return futurize_invoke([this] {
+            finish_checksums();
+            return issue_gathered();
+        }).finally([this] {
+            return wait();
+        }).finally([this] {
             return _file.close();
         });
     }
@@ -21,12 +21,17 @@
 
 #ifdef SEASTAR_MODULE
 module;
+#include <algorithm>
+#include <array>
 #include <exception>
+#include <new>
 #include <tuple>
 #include <type_traits>
 #include <utility>
 module seastar;
 #else
+#include <seastar/core/align.hh>
+#include <seastar/core/coroutine.hh>
 #include <seastar/core/future.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/thread.hh>
@@ -284,4 +289,188 @@ void internal::future_base::set_coroutine(task& coroutine) noexcept {
     _promise->set_task(&coroutine);
 }
 
+namespace internal {
+
+namespace {
+
+struct coroutine_frame_pool {
+    // Frame sizes are rounded up to a multiple of the granularity, each
+    // multiple up to max_pooled_size has its own free list
+    static constexpr size_t granularity = 32;
+    static constexpr size_t max_pooled_size = 2048;
+    // Bounds the memory a burst of coroutines leaves behind
+    static constexpr size_t max_pooled_frames = 128;
+
+    struct free_frame {
+        free_frame* next;
+    };
+    struct size_class {
+        free_frame* head = nullptr;
+        size_t count = 0;
+    };
+    std::array<size_class, max_pooled_size / granularity> classes;
+    coroutine_frame_stats stats;
+
+    ~coroutine_frame_pool() {
+        for (auto& c : classes) {
+            while (c.head) {
+                ::operator delete(std::exchange(c.head, c.head->next));
+            }
+        }
+    }
+};
+
+thread_local coroutine_frame_pool frame_pool;
+
+}
+
+void* allocate_coroutine_frame(size_t size) {
+    auto& pool = frame_pool;
+    pool.stats.allocations++;
+#ifndef SEASTAR_DEBUG
+    // The sanitizers cannot see through the free lists, so debug builds
+    // allocate each frame on its own
+    if (size <= coroutine_frame_pool::max_pooled_size) {
+        auto idx = (size - 1) / coroutine_frame_pool::granularity;
+        auto& c = pool.classes[idx];
+        if (c.head) {
+            pool.stats.pool_hits++;
+            pool.stats.pooled_bytes -= (idx + 1) * coroutine_frame_pool::granularity;
+            c.count--;
+            return std::exchange(c.head, c.head->next);
+        }
+        return ::operator new((idx + 1) * coroutine_frame_pool::granularity);
+    }
+#endif
+    return ::operator new(size);
+}
+
+void free_coroutine_frame(void* frame, size_t size) noexcept {
+#ifndef SEASTAR_DEBUG
+    if (size <= coroutine_frame_pool::max_pooled_size) {
+        auto& pool = frame_pool;
+        auto idx = (size - 1) / coroutine_frame_pool::granularity;
+        auto& c = pool.classes[idx];
+        if (c.count < coroutine_frame_pool::max_pooled_frames) {
+            c.head = new (frame) coroutine_frame_pool::free_frame{c.head};
+            c.count++;
+            pool.stats.pooled_bytes += (idx + 1) * coroutine_frame_pool::granularity;
+            return;
+        }
+    }
+#endif
+    ::operator delete(frame);
+}
+
+coroutine_frame_stats get_coroutine_frame_stats() noexcept {
+    return frame_pool.stats;
+}
+
+void set_current_task(task* t) noexcept {
+    if (local_engine) {
+        local_engine->set_current_task(t);
+    }
+}
+
+namespace {
+
+struct continuation_arena;
+
+// Precedes each continuation, naming the arena it was carved from, if any
+struct alignas(continuation_alignment) continuation_header {
+    continuation_arena* arena;
+};
+
+struct alignas(continuation_alignment) continuation_arena {
+    // The first arena of a chain has room for this many continuations of
+    // the size of the one starting it, the following ones double up to
+    // max_size
+    static constexpr size_t initial_continuations = 3;
+    static constexpr size_t max_size = 4096;
+
+    size_t size;
+    size_t used = 0;
+    // continuations carved from the arena and not yet freed
+    unsigned live = 0;
+
+    explicit continuation_arena(size_t size) noexcept : size(size) {}
+
+    char* data() noexcept {
+        return reinterpret_cast<char*>(this + 1);
+    }
+};
+
+struct continuation_chain {
+    // The last continuation allocated, the one a chain continues from
+    const char* last = nullptr;
+    size_t last_size = 0;
+    continuation_arena* arena = nullptr;
+    continuation_chain_stats stats;
+};
+
+thread_local continuation_chain chain;
+
+}
+
+void* allocate_continuation(size_t size, const void* chained_to) {
+    auto& c = chain;
+    c.stats.allocations++;
+    size = align_up(size, continuation_alignment);
+    auto total = sizeof(continuation_header) + size;
+    continuation_arena* arena = nullptr;
+    char* mem;
+#ifndef SEASTAR_DEBUG
+    // The sanitizers cannot see through the arenas, so debug builds
+    // allocate each continuation on its own
+    auto p = static_cast<const char*>(chained_to);
+    if (p && c.last && p >= c.last && p < c.last + c.last_size) {
+        arena = c.arena;
+        if (!arena || arena->used + total > arena->size) {
+            auto arena_size = arena ? std::min(arena->size * 2, continuation_arena::max_size)
+                                    : total * continuation_arena::initial_continuations;
+            arena_size = std::max(arena_size, total);
+            arena = new (::operator new(sizeof(continuation_arena) + arena_size)) continuation_arena(arena_size);
+            c.stats.arenas++;
+        }
+        mem = arena->data() + arena->used;
+        arena->used += total;
+        arena->live++;
+        c.stats.chained++;
+    } else
+#endif
+    {
+        mem = static_cast<char*>(::operator new(total));
+    }
+    new (mem) continuation_header{arena};
+    c.arena = arena;
+    c.last = mem + sizeof(continuation_header);
+    c.last_size = size;
+    return mem + sizeof(continuation_header);
+}
+
+void free_continuation(void* p) noexcept {
+    auto& c = chain;
+    if (p == c.last) {
+        c.last = nullptr;
+    }
+    auto header = reinterpret_cast<continuation_header*>(p) - 1;
+    auto arena = header->arena;
+    if (!arena) {
+        ::operator delete(header);
+    } else if (--arena->live == 0) {
+        if (arena == c.arena) {
+            c.arena = nullptr;
+            c.last = nullptr;
+        }
+        arena->~continuation_arena();
+        ::operator delete(arena);
+    }
+}
+
+continuation_chain_stats get_continuation_chain_stats() noexcept {
+    return chain.stats;
+}
+
+}
+
 }
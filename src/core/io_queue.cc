@@ -23,31 +23,46 @@
 module;
 #endif
 
+#include <algorithm>
 #include <array>
 #include <chrono>
+#include <climits>
 #include <cstdint>
+#include <limits>
 #include <mutex>
+#include <optional>
 #include <utility>
 #include <fmt/format.h>
 #include <fmt/ostream.h>
 #include <boost/intrusive/parent_from_member.hpp>
 #include <boost/container/small_vector.hpp>
 #include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <linux/fs.h> // BLKDISCARD
 #include <seastar/util/assert.hh>
 
 #ifdef SEASTAR_MODULE
 module seastar;
 #else
+#include <seastar/core/coroutine.hh>
 #include <seastar/core/file.hh>
 #include <seastar/core/io_queue.hh>
 #include <seastar/core/io_intent.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/core/semaphore.hh>
 #include <seastar/core/when_all.hh>
 #include <seastar/core/metrics.hh>
 #include <seastar/core/internal/io_desc.hh>
 #include <seastar/core/internal/io_sink.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/core/internal/task_tracer.hh>
 #include <seastar/core/io_priority_class.hh>
 #include <seastar/util/log.hh>
+#include <seastar/util/internal/iovec_utils.hh>
+#include "core/reactor_backend.hh"
+#include "core/syscall_result.hh"
+#include "core/thread_pool.hh"
 #endif
 
 namespace seastar {
@@ -91,6 +106,19 @@ struct io_group::priority_class_data {
     }
 };
 
+// The bandwidth budget of a class across all devices, shared by the queues
+// of every shard. Dispatching grabs from it on top of the per-device bucket
+// once the budget is set
+struct io_class_budget {
+    io_group::priority_class_data data;
+    std::atomic<bool> enabled = false;
+};
+
+static io_class_budget& class_budget(internal::priority_class pc) noexcept {
+    static std::array<io_class_budget, max_scheduling_groups()> budgets;
+    return budgets[pc.id()];
+}
+
 class io_queue::priority_class_data {
     io_queue& _queue;
     const internal::priority_class _pc;
@@ -113,14 +141,62 @@ class io_queue::priority_class_data {
     io_queue::clock_type::time_point _activated;
 
     io_group::priority_class_data& _group;
+    io_class_budget& _budget;
     size_t _replenish_head;
+    std::optional<size_t> _budget_head;
     timer<lowres_clock> _replenish;
 
+    // Latency breakdown of the sampled requests, in microseconds. Tells the
+    // time spent in the fair queue from the time it took the kernel to pick
+    // the request up and from the time the disk worked on it
+    struct latency_trace {
+        using histogram = metrics::internal::approximate_exponential_histogram<8, 8 << 20, 4>;
+        histogram queued;
+        histogram pending;
+        histogram disk;
+
+        static uint64_t micros(std::chrono::duration<double> lat) noexcept {
+            return std::chrono::duration_cast<std::chrono::microseconds>(lat).count();
+        }
+    };
+    std::unique_ptr<latency_trace> _trace;
+
+    // The latency target, and the latencies of the requests completed since
+    // the last round of the latency controller, see io_queue::control_latency()
+    std::chrono::microseconds _latency_target{0};
+    double _latency_percentile = 0.99;
+    std::unique_ptr<latency_trace::histogram> _latency_window;
+    // Of the last round, for the metrics
+    uint64_t _latency_quantile = 0;
+    uint64_t _latency_target_misses = 0;
+    // The latency controller lowers the shares down to _min_shares, unless
+    // it's 0, while the targets of the other classes are missed
+    uint32_t _min_shares = 0;
+    uint32_t _dynamic_shares;
+
+    // Whether the tokens grabbed by the last dispatch are still missing
+    // from the device's or the cross-device bucket
+    bool deficient() const noexcept {
+        return _group.tb.deficiency(_replenish_head) > 0 ||
+                (_budget_head && _budget.data.tb.deficiency(*_budget_head) > 0);
+    }
+
+    std::chrono::microseconds replenish_delay() const noexcept {
+        auto delay = _group.tb.duration_for(_group.tb.deficiency(_replenish_head));
+        if (_budget_head) {
+            delay = std::max(delay, _budget.data.tb.duration_for(_budget.data.tb.deficiency(*_budget_head)));
+        }
+        return std::chrono::duration_cast<std::chrono::microseconds>(delay);
+    }
+
     void try_to_replenish() noexcept {
-        _group.tb.replenish(io_queue::clock_type::now());
-        auto delta = _group.tb.deficiency(_replenish_head);
-        if (delta > 0) {
-            _replenish.arm(std::chrono::duration_cast<std::chrono::microseconds>(_group.tb.duration_for(delta)));
+        auto now = io_queue::clock_type::now();
+        _group.tb.replenish(now);
+        if (_budget_head) {
+            _budget.data.tb.replenish(now);
+        }
+        if (deficient()) {
+            _replenish.arm(replenish_delay());
         } else {
             _queue.unthrottle_priority_class(*this);
         }
@@ -129,8 +205,47 @@ class io_queue::priority_class_data {
 public:
     void update_shares(uint32_t shares) noexcept {
         _shares = std::max(shares, 1u);
+        _dynamic_shares = _shares;
     }
 
+    void update_latency_target(std::chrono::microseconds latency, double percentile) {
+        if (latency.count() > 0 && !_latency_window) {
+            _latency_window = std::make_unique<latency_trace::histogram>();
+        } else if (latency.count() <= 0) {
+            _latency_window.reset();
+        }
+        _latency_target = std::max(latency, std::chrono::microseconds(0));
+        _latency_percentile = std::clamp(percentile, 0.0, 1.0);
+    }
+
+    bool has_latency_target() const noexcept {
+        return bool(_latency_window);
+    }
+
+    // Closes the window of the latencies measured since the last call. A
+    // window without completions tells nothing and doesn't count as missed;
+    // requests which take longer than a period count once they complete.
+    bool latency_target_missed() noexcept {
+        if (_latency_window->count() == 0) {
+            return false;
+        }
+        _latency_quantile = _latency_window->quantile(_latency_percentile);
+        bool missed = _latency_quantile > uint64_t(_latency_target.count());
+        _latency_window->clear();
+        _latency_target_misses += missed;
+        return missed;
+    }
+
+    void update_min_shares(uint32_t min_shares) noexcept {
+        _min_shares = min_shares;
+        _dynamic_shares = _shares;
+    }
+
+    uint32_t shares() const noexcept { return _shares; }
+    uint32_t min_shares() const noexcept { return std::min(_min_shares, _shares); }
+    uint32_t dynamic_shares() const noexcept { return _dynamic_shares; }
+    void set_dynamic_shares(uint32_t shares) noexcept { _dynamic_shares = shares; }
+
     void update_bandwidth(uint64_t bandwidth) {
         _group.update_bandwidth(bandwidth);
         io_log.debug("Updated {} class bandwidth to {}MB/s", _pc.id(), bandwidth >> 20);
@@ -147,7 +262,10 @@ class io_queue::priority_class_data {
         , _total_execution_time(0)
         , _starvation_time(0)
         , _group(pg)
+        , _budget(class_budget(pc))
         , _replenish([this] { try_to_replenish(); })
+        , _trace(q.get_config().latency_trace_period != 0 ? std::make_unique<latency_trace>() : nullptr)
+        , _dynamic_shares(shares)
     {
     }
     priority_class_data(const priority_class_data&) = delete;
@@ -171,12 +289,14 @@ class io_queue::priority_class_data {
         }
 
         auto tokens = _group.tokens(dnl.length());
-        auto ph = _group.tb.grab(tokens);
-        auto delta = _group.tb.deficiency(ph);
-        if (delta > 0) {
+        _replenish_head = _group.tb.grab(tokens);
+        _budget_head.reset();
+        if (_budget.enabled.load(std::memory_order_relaxed)) {
+            _budget_head = _budget.data.tb.grab(tokens);
+        }
+        if (deficient()) {
             _queue.throttle_priority_class(*this);
-            _replenish_head = ph;
-            _replenish.arm(std::chrono::duration_cast<std::chrono::microseconds>(_group.tb.duration_for(delta)));
+            _replenish.arm(replenish_delay());
         }
     }
 
@@ -184,8 +304,13 @@ class io_queue::priority_class_data {
         _nr_queued--;
     }
 
-    void on_complete(std::chrono::duration<double> lat) noexcept {
+    // Takes the time the request spent on the disk, and from queueing till
+    // completion
+    void on_complete(std::chrono::duration<double> lat, std::chrono::duration<double> total) noexcept {
         _total_execution_time += lat;
+        if (_latency_window) {
+            _latency_window->add(latency_trace::micros(total));
+        }
         _nr_executing--;
         if (_nr_executing == 0 && _nr_queued != 0) {
             _activated = io_queue::clock_type::now();
@@ -203,32 +328,138 @@ class io_queue::priority_class_data {
         _splits.add(dnl.length());
     }
 
+    void on_direct(io_direction_and_length dnl) noexcept {
+        _rwstat[dnl.rw_idx()].add(dnl.length());
+    }
+
+    void trace_queued(std::chrono::duration<double> lat) noexcept {
+        _trace->queued.add(latency_trace::micros(lat));
+    }
+
+    void trace_executed(std::chrono::duration<double> pending, std::chrono::duration<double> disk) noexcept {
+        _trace->pending.add(latency_trace::micros(pending));
+        _trace->disk.add(latency_trace::micros(disk));
+    }
+
     fair_queue::class_id fq_class() const noexcept { return _pc.id(); }
 
     std::vector<seastar::metrics::impl::metric_definition_impl> metrics();
     metrics::metric_groups metric_groups;
 };
 
-class io_desc_read_write final : public io_completion {
+namespace internal {
+
+// The requests of a chain, queued and completed as one io_desc_read_write,
+// which owns it. They are submitted all at once when the backend links them,
+// and otherwise each once the one before it completed. The result is the
+// length written up to the first short write, which ends the chain; a failed
+// request fails the whole chain, even if the writes before it completed.
+class io_chain {
+    struct link final : public io_completion {
+        io_chain* chain = nullptr;
+        size_t res = 0;
+        std::exception_ptr ex;
+
+        virtual void complete(size_t r) noexcept override {
+            res = r;
+            chain->on_completion(*this);
+        }
+        virtual void set_exception(std::exception_ptr eptr) noexcept override {
+            ex = std::move(eptr);
+            chain->on_completion(*this);
+        }
+    };
+
+    std::vector<io_request> _reqs;
+    // of the parts of split writev requests
+    std::vector<std::vector<::iovec>> _iovecs;
+    std::unique_ptr<link[]> _links;
+    const bool _linked;
+    io_desc_read_write* _desc = nullptr;
+    io_sink* _sink = nullptr;
+    size_t _completed = 0;
+
+    bool short_or_failed(size_t idx) const noexcept {
+        return _links[idx].ex || _links[idx].res < length(_reqs[idx]);
+    }
+
+    void on_completion(link& l) noexcept;
+    void finish() noexcept;
+public:
+    static size_t length(const io_request& req) noexcept {
+        switch (req.opcode()) {
+        case io_request::operation::write:
+            return req.as<io_request::operation::write>().size;
+        case io_request::operation::writev: {
+            auto& op = req.as<io_request::operation::writev>();
+            return iovec_len(op.iovec, op.iov_len);
+        }
+        default:
+            return 0;
+        }
+    }
+
+    io_chain(std::vector<io_request> reqs, std::vector<std::vector<::iovec>> iovecs, bool linked)
+        : _reqs(std::move(reqs))
+        , _iovecs(std::move(iovecs))
+        , _links(std::make_unique<link[]>(_reqs.size()))
+        , _linked(linked)
+    {
+        for (size_t i = 0; i < _reqs.size(); i++) {
+            _links[i].chain = this;
+            if (_linked) {
+                _reqs[i].set_linked(_reqs.size() - 1 - i);
+            }
+        }
+    }
+
+    size_t length() const noexcept {
+        size_t len = 0;
+        for (auto& req : _reqs) {
+            len += length(req);
+        }
+        return len;
+    }
+
+    unsigned syncs() const noexcept {
+        return std::count_if(_reqs.begin(), _reqs.end(), [] (const io_request& req) {
+            return req.opcode() == io_request::operation::fdatasync;
+        });
+    }
+
+    void submit(io_desc_read_write* desc, io_sink& sink) noexcept;
+};
+
+}
+
+class io_desc_read_write final : public io_completion, public internal::cancellable_io {
     io_queue& _ioq;
     io_queue::priority_class_data& _pclass;
+    const bool _traced;
     io_queue::clock_type::time_point _ts;
+    io_queue::clock_type::time_point _submitted;
     const stream_id _stream;
     const io_direction_and_length _dnl;
     const fair_queue_entry::capacity_t _fq_capacity;
     promise<size_t> _pr;
     iovec_keeper _iovs;
+    std::unique_ptr<internal::io_chain> _chain;
     uint64_t _dispatched_polls;
+    std::chrono::duration<double> _queued = {};
+    bool _cancelled_in_kernel = false;
 
 public:
-    io_desc_read_write(io_queue& ioq, io_queue::priority_class_data& pc, stream_id stream, io_direction_and_length dnl, fair_queue_entry::capacity_t cap, iovec_keeper iovs)
+    io_desc_read_write(io_queue& ioq, io_queue::priority_class_data& pc, stream_id stream, io_direction_and_length dnl, fair_queue_entry::capacity_t cap, iovec_keeper iovs,
+            std::unique_ptr<internal::io_chain> chain)
         : _ioq(ioq)
         , _pclass(pc)
+        , _traced(ioq.sample_latency())
         , _ts(io_queue::clock_type::now())
         , _stream(stream)
         , _dnl(dnl)
         , _fq_capacity(cap)
         , _iovs(std::move(iovs))
+        , _chain(std::move(chain))
     {
         io_log.trace("dev {} : req {} queue  len {} capacity {}", _ioq.id(), fmt::ptr(this), _dnl.length(), _fq_capacity);
     }
@@ -237,6 +468,10 @@ class io_desc_read_write final : public io_completion {
         io_log.trace("dev {} : req {} error", _ioq.id(), fmt::ptr(this));
         _pclass.on_error();
         _ioq.complete_request(*this, std::chrono::duration<double>(0.0));
+        if (_cancelled_in_kernel) {
+            // The kernel reports the abort as ECANCELED or EINTR
+            eptr = std::make_exception_ptr(default_io_exception_factory::cancelled());
+        }
         _pr.set_exception(eptr);
         delete this;
     }
@@ -245,7 +480,15 @@ class io_desc_read_write final : public io_completion {
         io_log.trace("dev {} : req {} complete", _ioq.id(), fmt::ptr(this));
         auto now = io_queue::clock_type::now();
         auto delay = std::chrono::duration_cast<std::chrono::duration<double>>(now - _ts);
-        _pclass.on_complete(delay);
+        _pclass.on_complete(delay, _queued + delay);
+        if (_traced) {
+            _pclass.trace_executed(_submitted - _ts, now - _submitted);
+        }
+        if (auto tracer = engine().tracing()) {
+            // _ts is the dispatch time by now
+            tracer->record(_dnl.rw_idx() == io_direction_read ? internal::task_trace_event::kind::io_read : internal::task_trace_event::kind::io_write,
+                    _ts, now, std::min<size_t>(_dnl.length(), std::numeric_limits<uint32_t>::max()));
+        }
         _ioq.complete_request(*this, delay);
         _pr.set_value(res);
         delete this;
@@ -257,10 +500,27 @@ class io_desc_read_write final : public io_completion {
         delete this;
     }
 
+    virtual void cancel_in_kernel() noexcept override {
+        io_log.trace("dev {} : req {} cancel", _ioq.id(), fmt::ptr(this));
+        _cancelled_in_kernel = true;
+        _ioq.cancel_dispatched_request(*this);
+    }
+
+    // For requests the kernel doesn't run on their own, which it can't
+    // abort without aborting others
+    void not_cancellable() noexcept {
+        internal::cancellable_io::unlink();
+    }
+
     void dispatch() noexcept {
         io_log.trace("dev {} : req {} submit", _ioq.id(), fmt::ptr(this));
         auto now = io_queue::clock_type::now();
-        _pclass.on_dispatch(_dnl, std::chrono::duration_cast<std::chrono::duration<double>>(now - _ts));
+        auto queued = std::chrono::duration_cast<std::chrono::duration<double>>(now - _ts);
+        _queued = queued;
+        _pclass.on_dispatch(_dnl, queued);
+        if (_traced) {
+            _pclass.trace_queued(queued);
+        }
         _ts = now;
         _dispatched_polls = engine().polls();
     }
@@ -272,6 +532,111 @@ class io_desc_read_write final : public io_completion {
     fair_queue_entry::capacity_t capacity() const noexcept { return _fq_capacity; }
     stream_id stream() const noexcept { return _stream; }
     uint64_t polls() const noexcept { return _dispatched_polls; }
+    io_queue::clock_type::time_point* submitted_ts() noexcept { return _traced ? &_submitted : nullptr; }
+};
+
+void internal::io_chain::submit(io_desc_read_write* desc, io_sink& sink) noexcept {
+    _desc = desc;
+    _sink = &sink;
+    // The kernel aborts the linked requests on its own
+    desc->not_cancellable();
+    auto nr = _linked ? _reqs.size() : 1;
+    for (size_t i = 0; i < nr; i++) {
+        sink.submit(&_links[i], _reqs[i], i == 0 ? desc->submitted_ts() : nullptr);
+    }
+}
+
+void internal::io_chain::on_completion(link& l) noexcept {
+    size_t idx = &l - _links.get();
+    _completed++;
+    if (!_linked && idx + 1 < _reqs.size() && !short_or_failed(idx)) {
+        _sink->submit(&_links[idx + 1], _reqs[idx + 1]);
+        return;
+    }
+    // The linked requests after a short or failed one complete too, with
+    // ECANCELED
+    if (!_linked || _completed == _reqs.size()) {
+        finish();
+    }
+}
+
+void internal::io_chain::finish() noexcept {
+    size_t written = 0;
+    for (size_t i = 0; i < _reqs.size(); i++) {
+        if (_links[i].ex) {
+            // deletes this
+            _desc->set_exception(_links[i].ex);
+            return;
+        }
+        written += _links[i].res;
+        if (short_or_failed(i)) {
+            break;
+        }
+    }
+    _desc->complete(written);
+}
+
+// Completes the reads merged into a single request. The result is split
+// among them in order of position, the same way separate reads would have
+// ended up short at the end of the file.
+class io_desc_merged_read final : public io_completion {
+    struct part {
+        io_desc_read_write* desc;
+        size_t length;
+    };
+    std::vector<part> _parts;
+    std::vector<::iovec> _iovecs;
+    io_queue::clock_type::time_point _submitted;
+    bool _traced = false;
+
+    void set_submitted(io_desc_read_write* desc) noexcept {
+        if (auto ts = desc->submitted_ts()) {
+            *ts = _submitted;
+        }
+    }
+public:
+    void add(io_desc_read_write* desc, const internal::io_request& req) {
+        size_t length = 0;
+        if (req.opcode() == internal::io_request::operation::read) {
+            auto& op = req.as<internal::io_request::operation::read>();
+            _iovecs.push_back(::iovec{op.addr, op.size});
+            length = op.size;
+        } else {
+            auto& op = req.as<internal::io_request::operation::readv>();
+            _iovecs.insert(_iovecs.end(), op.iovec, op.iovec + op.iov_len);
+            length = internal::iovec_len(op.iovec, op.iov_len);
+        }
+        _parts.push_back(part{desc, length});
+        _traced |= desc->submitted_ts() != nullptr;
+        desc->not_cancellable();
+    }
+
+    size_t iovecs() const noexcept { return _iovecs.size(); }
+
+    internal::io_request make_request(const internal::io_request& first) {
+        auto& op = first.as<internal::io_request::operation::read>();
+        return internal::io_request::make_readv(op.fd, op.pos, _iovecs, op.nowait_works);
+    }
+
+    io_queue::clock_type::time_point* submitted_ts() noexcept { return _traced ? &_submitted : nullptr; }
+
+    virtual void set_exception(std::exception_ptr eptr) noexcept override {
+        for (auto& p : _parts) {
+            set_submitted(p.desc);
+            p.desc->set_exception(eptr);
+        }
+        delete this;
+    }
+
+    virtual void complete(size_t res) noexcept override {
+        for (auto& p : _parts) {
+            auto len = std::min(res, p.length);
+            res -= len;
+            set_submitted(p.desc);
+            p.desc->complete(len);
+        }
+        delete this;
+    }
 };
 
 class queued_io_request : private internal::io_request {
@@ -284,12 +649,13 @@ class queued_io_request : private internal::io_request {
     bool is_cancelled() const noexcept { return !_desc; }
 
 public:
-    queued_io_request(internal::io_request req, io_queue& q, fair_queue_entry::capacity_t cap, io_queue::priority_class_data& pc, io_direction_and_length dnl, iovec_keeper iovs)
+    queued_io_request(internal::io_request req, io_queue& q, fair_queue_entry::capacity_t cap, io_queue::priority_class_data& pc, io_direction_and_length dnl, iovec_keeper iovs,
+            std::unique_ptr<internal::io_chain> chain)
         : io_request(std::move(req))
         , _ioq(q)
         , _stream(_ioq.request_stream(dnl))
         , _fq_entry(cap)
-        , _desc(std::make_unique<io_desc_read_write>(_ioq, pc, _stream, dnl, cap, std::move(iovs)))
+        , _desc(std::make_unique<io_desc_read_write>(_ioq, pc, _stream, dnl, cap, std::move(iovs), std::move(chain)))
     {
     }
 
@@ -302,7 +668,9 @@ class queued_io_request : private internal::io_request {
             return;
         }
 
-        _intent.maybe_dequeue();
+        if (auto cq = _intent.maybe_dequeue()) {
+            cq->track_dispatched(*_desc);
+        }
         _desc->dispatch();
         _ioq.submit_request(_desc.release(), std::move(*this));
         delete this;
@@ -340,7 +708,8 @@ priority_class::priority_class(internal::maybe_priority_class_ref pc) noexcept :
 
 cancellable_queue::cancellable_queue(cancellable_queue&& o) noexcept
         : _first(std::exchange(o._first, nullptr))
-        , _rest(std::move(o._rest)) {
+        , _rest(std::move(o._rest))
+        , _dispatched(std::move(o._dispatched)) {
     if (_first != nullptr) {
         _first->_ref = this;
     }
@@ -350,6 +719,7 @@ cancellable_queue& cancellable_queue::operator=(cancellable_queue&& o) noexcept
     if (this != &o) {
         _first = std::exchange(o._first, nullptr);
         _rest = std::move(o._rest);
+        _dispatched = std::move(o._dispatched);
         if (_first != nullptr) {
             _first->_ref = this;
         }
@@ -362,6 +732,7 @@ cancellable_queue::~cancellable_queue() {
         queued_io_request::from_cq_link(*_first).cancel();
         pop_front();
     }
+    _dispatched.clear_and_dispose([] (cancellable_io* io) { io->cancel_in_kernel(); });
 }
 
 void cancellable_queue::push_back(link& il) noexcept {
@@ -400,11 +771,14 @@ io_intent* intent_reference::retrieve() const {
     return _intent;
 }
 
-void io_sink::submit(io_completion* desc, io_request req) noexcept {
+void io_sink::submit(io_completion* desc, io_request req, std::chrono::steady_clock::time_point* submitted) noexcept {
     try {
-        _pending_io.emplace_back(std::move(req), desc);
+        _pending_io.emplace_back(std::move(req), desc, submitted);
     } catch (...) {
-        desc->set_exception(std::current_exception());
+        // Cancellations have no completion, and are best effort anyway
+        if (desc) {
+            desc->set_exception(std::current_exception());
+        }
     }
 }
 
@@ -516,6 +890,22 @@ sstring io_request::opname() const {
         return "poll remove";
     case io_request::operation::cancel:
         return "cancel";
+    case io_request::operation::openat:
+        return "openat";
+    case io_request::operation::statx:
+        return "statx";
+    case io_request::operation::unlinkat:
+        return "unlinkat";
+    case io_request::operation::renameat:
+        return "renameat";
+    case io_request::operation::fallocate:
+        return "fallocate";
+    case io_request::operation::discard:
+        return "discard";
+    case io_request::operation::chain:
+        return "chain";
+    case io_request::operation::nvme:
+        return "nvme";
     }
     std::abort();
 }
@@ -540,6 +930,20 @@ void io_queue::update_flow_ratio() noexcept {
     }
 }
 
+void io_queue::report_calibration() noexcept {
+    if (_calibration_completions > 0) {
+        _group->calibrate(_calibration_delay / _calibration_completions, _calibration_backlogged);
+    }
+    _calibration_delay = {};
+    _calibration_completions = 0;
+    _calibration_backlogged = false;
+}
+
+bool io_queue::sample_latency() noexcept {
+    auto period = get_config().latency_trace_period;
+    return period != 0 && ++_latency_trace_counter % period == 0;
+}
+
 void io_queue::lower_stall_threshold() noexcept {
     auto new_threshold = _stall_threshold - std::chrono::milliseconds(1);
     _stall_threshold = std::max(_stall_threshold_min, new_threshold);
@@ -550,6 +954,8 @@ io_queue::complete_request(io_desc_read_write& desc, std::chrono::duration<doubl
     _requests_executing--;
     _requests_completed++;
     _streams[desc.stream()].notify_request_finished(desc.capacity());
+    _calibration_delay += delay;
+    _calibration_completions++;
 
     if (delay > _stall_threshold) {
         _stall_threshold *= 2;
@@ -562,6 +968,8 @@ io_queue::complete_request(io_desc_read_write& desc, std::chrono::duration<doubl
 fair_queue::config io_queue::make_fair_queue_config(const config& iocfg, sstring label) {
     fair_queue::config cfg;
     cfg.label = label;
+    cfg.deadline_scheduling = iocfg.deadline_scheduling;
+    cfg.deadline_window = iocfg.deadline_window;
     return cfg;
 }
 
@@ -573,7 +981,9 @@ io_queue::io_queue(io_group_ptr group, internal::io_sink& sink)
     , _averaging_decay_timer([this] {
         update_flow_ratio();
         lower_stall_threshold();
+        report_calibration();
     })
+    , _latency_controller([this] { control_latency(); })
     , _stall_threshold_min(std::max(get_config().stall_threshold, 1ms))
     , _stall_threshold(_stall_threshold_min)
 {
@@ -596,6 +1006,15 @@ io_queue::io_queue(io_group_ptr group, internal::io_sink& sink)
         sm::make_gauge("flow_ratio", [this] { return _flow_ratio; },
                 sm::description("Ratio of dispatch rate to completion rate. Is expected to be 1.0+ growing larger on reactor stalls or (!) disk problems"),
                 { owner_l, mnt_l, group_l }),
+        sm::make_gauge("rate_factor", [this] { return _group->rate_factor(); },
+                sm::description("Factor the configured disk rate is scaled by, as found by the online calibration"),
+                { owner_l, mnt_l, group_l }),
+        sm::make_counter("merged_reads", _merged_reads,
+                sm::description("Reads submitted as part of a merged request with the adjacent read before them"),
+                { owner_l, mnt_l, group_l }),
+        sm::make_counter("merged_discards", _merged_discards,
+                sm::description("Discards submitted as part of a merged request with the adjacent discard before them"),
+                { owner_l, mnt_l, group_l }),
     });
 }
 
@@ -616,9 +1035,36 @@ std::chrono::duration<double> io_group::io_latency_goal() const noexcept {
     return _fgs.front().rate_limit_duration();
 }
 
+// The AIMD loop -- back off quickly when the disk doesn't keep up with the
+// latency goal, and slowly probe for more capacity while the queues have more
+// requests than the current rate lets through.
+void io_group::calibrate(std::chrono::duration<double> latency, bool backlogged) noexcept {
+    if (_config.calibration_min_factor == 1.0 && _config.calibration_max_factor == 1.0) {
+        return;
+    }
+
+    std::lock_guard _(_lock);
+    auto factor = rate_factor();
+    // Each queue of the group reports on its own, so a single report
+    // only moves the factor by its share of the step
+    if (latency > _calibration_target) {
+        factor *= 1.0 - _config.calibration_decrease_step / _nr_queues;
+    } else if (backlogged) {
+        factor += _config.calibration_increase_step / _nr_queues;
+    } else {
+        return;
+    }
+    factor = std::clamp(factor, _config.calibration_min_factor, _config.calibration_max_factor);
+    _rate_factor.store(factor, std::memory_order_relaxed);
+    for (auto& fg : _fgs) {
+        fg.set_rate_factor(factor);
+    }
+}
+
 io_group::io_group(io_queue::config io_cfg, unsigned nr_queues)
     : _config(std::move(io_cfg))
     , _allocated_on(this_shard_id())
+    , _nr_queues(nr_queues)
 {
     auto fg_cfg = make_fair_group_config(_config);
     _fgs.emplace_back(fg_cfg, nr_queues);
@@ -627,6 +1073,7 @@ io_group::io_group(io_queue::config io_cfg, unsigned nr_queues)
     }
 
     auto goal = io_latency_goal();
+    _calibration_target = goal;
     auto lvl = goal > 1.1 * _config.rate_limit_duration ? log_level::warn : log_level::debug;
     seastar_logger.log(lvl, "IO queue uses {:.2f}ms latency goal for {}", goal.count() * 1000, _config.mountpoint);
 
@@ -662,6 +1109,12 @@ io_group::io_group(io_queue::config io_cfg, unsigned nr_queues)
 io_group::~io_group() {
 }
 
+// Supergroups share the fair queue identifiers space with the classes,
+// the latter being scheduling group indices
+static fair_queue::class_id supergroup_fq_class(unsigned index) noexcept {
+    return max_scheduling_groups() + index;
+}
+
 io_queue::~io_queue() {
     // It is illegal to stop the I/O queue with pending requests.
     // Technically we would use a gate to guarantee that. But here, it is not
@@ -677,6 +1130,11 @@ io_queue::~io_queue() {
             }
         }
     }
+    for (auto index : _supergroups) {
+        for (auto&& s : _streams) {
+            s.unregister_priority_class(supergroup_fq_class(index));
+        }
+    }
 }
 
 std::tuple<unsigned, sstring> get_class_info(io_priority_class_id pc) {
@@ -684,9 +1142,14 @@ std::tuple<unsigned, sstring> get_class_info(io_priority_class_id pc) {
     return std::make_tuple(sg.get_shares(), sg.name());
 }
 
+static unsigned get_class_supergroup(io_priority_class_id pc) {
+    auto sg = internal::scheduling_group_from_index(pc);
+    return internal::scheduling_supergroup_index(sg.io_supergroup());
+}
+
 std::vector<seastar::metrics::impl::metric_definition_impl> io_queue::priority_class_data::metrics() {
     namespace sm = seastar::metrics;
-    return std::vector<sm::impl::metric_definition_impl>({
+    auto ret = std::vector<sm::impl::metric_definition_impl>({
             sm::make_counter("total_bytes", [this] {
                     return _rwstat[io_direction_read].bytes + _rwstat[io_direction_write].bytes;
                 }, sm::description("Total bytes passed in the queue")),
@@ -733,8 +1196,28 @@ std::vector<seastar::metrics::impl::metric_definition_impl> io_queue::priority_c
             sm::make_gauge("delay", [this] {
                 return _queue_time.count();
             }, sm::description("random delay time in the queue")),
-            sm::make_gauge("shares", _shares, sm::description("current amount of shares"))
+            sm::make_gauge("shares", _shares, sm::description("current amount of shares")),
+            sm::make_gauge("dynamic_shares", _dynamic_shares, sm::description("Shares the class is scheduled with, below the configured ones while the latency controller lowers them"))
     });
+    if (_latency_window) {
+        ret.push_back(sm::make_gauge("latency_target", [this] {
+                return std::chrono::duration<double>(_latency_target).count();
+            }, sm::description("Latency target of the class, in seconds")));
+        ret.push_back(sm::make_gauge("latency_quantile", [this] {
+                return std::chrono::duration<double>(std::chrono::microseconds(_latency_quantile)).count();
+            }, sm::description("Latency of the class at the percentile of its target over the last period of the latency controller it completed requests in, in seconds")));
+        ret.push_back(sm::make_counter("latency_target_misses", _latency_target_misses,
+                sm::description("Number of periods of the latency controller the class missed its latency target in")));
+    }
+    if (_trace) {
+        ret.push_back(sm::make_histogram("sampled_queue_latency", sm::description("Time the sampled requests spent in the queue, in microseconds"),
+                [this] { return _trace->queued.to_metrics_histogram(); }));
+        ret.push_back(sm::make_histogram("sampled_submit_latency", sm::description("Time from dispatch till the sampled requests were submitted to the kernel, in microseconds"),
+                [this] { return _trace->pending.to_metrics_histogram(); }));
+        ret.push_back(sm::make_histogram("sampled_disk_latency", sm::description("Time from submission till completion of the sampled requests, in microseconds"),
+                [this] { return _trace->disk.to_metrics_histogram(); }));
+    }
+    return ret;
 }
 
 void io_queue::register_stats(sstring name, priority_class_data& pc) {
@@ -785,8 +1268,12 @@ io_queue::priority_class_data& io_queue::find_or_create_class(internal::priority
         //
         // This conveys all the information we need and allows one to easily group all classes from
         // the same I/O queue (by filtering by shard)
+        std::optional<fair_queue::class_id> parent;
+        if (auto index = get_class_supergroup(pc.id()); index != 0) {
+            parent = find_or_create_supergroup(index);
+        }
         for (auto&& s : _streams) {
-            s.register_priority_class(id, shares);
+            s.register_priority_class(id, shares, parent);
         }
         auto& pg = _group->find_or_create_class(pc);
         auto pc_data = std::make_unique<priority_class_data>(pc, shares, *this, pg);
@@ -797,6 +1284,19 @@ io_queue::priority_class_data& io_queue::find_or_create_class(internal::priority
     return *_priority_classes[id];
 }
 
+fair_queue::class_id io_queue::find_or_create_supergroup(unsigned index) {
+    auto id = supergroup_fq_class(index);
+    if (std::find(_supergroups.begin(), _supergroups.end(), index) == _supergroups.end()) {
+        auto shares = internal::scheduling_supergroup_from_index(index).get_shares();
+        _supergroups.reserve(_supergroups.size() + 1);
+        for (auto&& s : _streams) {
+            s.register_priority_group(id, shares);
+        }
+        _supergroups.push_back(index);
+    }
+    return id;
+}
+
 io_group::priority_class_data& io_group::find_or_create_class(internal::priority_class pc) {
     std::lock_guard _(_lock);
 
@@ -856,17 +1356,27 @@ io_queue::request_limits io_queue::get_request_limits() const noexcept {
     return l;
 }
 
-future<size_t> io_queue::queue_one_request(internal::priority_class pc, io_direction_and_length dnl, internal::io_request req, io_intent* intent, iovec_keeper iovs) noexcept {
-    return futurize_invoke([pc = std::move(pc), dnl = std::move(dnl), req = std::move(req), this, intent, iovs = std::move(iovs)] () mutable {
+future<size_t> io_queue::queue_one_request(internal::priority_class pc, io_direction_and_length dnl, internal::io_request req, io_intent* intent, iovec_keeper iovs,
+        std::unique_ptr<internal::io_chain> chain) noexcept {
+    return futurize_invoke([pc = std::move(pc), dnl = std::move(dnl), req = std::move(req), this, intent, iovs = std::move(iovs), chain = std::move(chain)] () mutable {
         // First time will hit here, and then we create the class. It is important
         // that we create the shared pointer in the same shard it will be used at later.
         auto& pclass = find_or_create_class(pc);
         auto cap = request_capacity(dnl);
-        auto queued_req = std::make_unique<queued_io_request>(std::move(req), *this, cap, pclass, std::move(dnl), std::move(iovs));
+        // The disk also flushes its cache or writes through (FUA) for a dsync
+        // write or an fdatasync, which costs about as much as another request
+        auto syncs = chain ? chain->syncs() : unsigned(req.dsync());
+        cap += syncs * request_capacity(io_direction_and_length(io_direction_write, 0));
+        // More than the fair queue grants at once would never be dispatched
+        cap = std::min(cap, _streams[request_stream(dnl)].maximum_capacity());
+        auto queued_req = std::make_unique<queued_io_request>(std::move(req), *this, cap, pclass, std::move(dnl), std::move(iovs), std::move(chain));
         auto fut = queued_req->get_future();
         if (intent != nullptr) {
             auto& cq = intent->find_or_create_cancellable_queue(_id, pc.id());
             queued_req->set_intent(cq);
+            if (intent->has_deadline()) {
+                queued_req->queue_entry().set_deadline(intent->deadline());
+            }
         }
 
         _streams[queued_req->stream()].queue(pclass.fq_class(), queued_req->queue_entry());
@@ -950,19 +1460,322 @@ future<size_t> io_queue::submit_io_write(internal::priority_class pc, size_t len
     return queue_request(std::move(pc), io_direction_and_length(io_direction_write, len), std::move(req), intent, std::move(iovs));
 }
 
+void io_queue::account_direct(internal::priority_class pc, io_direction_and_length dnl) noexcept {
+    auto& r = engine();
+    if (dnl.rw_idx() == io_direction_read) {
+        ++r._io_stats.aio_reads;
+        r._io_stats.aio_read_bytes += dnl.length();
+    } else {
+        ++r._io_stats.aio_writes;
+        r._io_stats.aio_write_bytes += dnl.length();
+    }
+    try {
+        find_or_create_class(pc).on_direct(dnl);
+    } catch (...) {
+        // only the class statistics miss the I/O
+    }
+}
+
+future<> io_queue::submit_io_discard(internal::priority_class pc, internal::io_request req) noexcept {
+    try {
+        auto& op = req.as<internal::io_request::operation::discard>();
+        auto& cfg = get_config();
+        // Discarding is mostly bookkeeping for the device, but large ones
+        // still stall the requests behind them. Chunks of a bounded length
+        // let the fair queue interleave them with the rest of the traffic
+        auto max_length = std::max<size_t>(cfg.max_discard_length, 1 << block_size_shift);
+        std::vector<future<size_t>> chunks;
+        chunks.reserve((op.len + max_length - 1) / max_length);
+        for (uint64_t off = 0; off < op.len; off += max_length) {
+            auto len = std::min<uint64_t>(op.len - off, max_length);
+            auto cost = std::min<size_t>(len * cfg.discard_cost_factor, _group->_max_request_length[io_direction_write]);
+            chunks.push_back(queue_one_request(pc, io_direction_and_length(io_direction_write, cost),
+                    internal::io_request::make_discard(op.fd, op.pos + off, len, op.blockdev), nullptr, {}));
+        }
+        return when_all_succeed(chunks.begin(), chunks.end()).discard_result();
+    } catch (...) {
+        return current_exception_as_future();
+    }
+}
+
+class io_queue::zone_writer {
+public:
+    // Lets a single append run at a time, in the order they were made
+    semaphore turn{1};
+    bool loaded = false;
+    uint64_t write_pointer = 0;
+    uint64_t end = 0;
+};
+
+future<uint64_t> io_queue::append_to_zone(dev_t dev, uint64_t zone_start, size_t len, zone_loader load,
+        noncopyable_function<future<> (uint64_t pos)> write) noexcept {
+    auto& zw = _zones[{dev, zone_start}];
+    if (!zw) {
+        zw = std::make_unique<zone_writer>();
+    }
+    auto& z = *zw;
+    auto units = co_await get_units(z.turn, 1);
+    if (!z.loaded) {
+        std::tie(z.write_pointer, z.end) = co_await load();
+        z.loaded = true;
+    }
+    if (z.write_pointer + len > z.end) {
+        throw std::system_error(ENOSPC, std::system_category(), format("{} bytes don't fit in the zone at {}", len, zone_start));
+    }
+    auto pos = z.write_pointer;
+    try {
+        co_await write(pos);
+    } catch (...) {
+        // Some of the data may have been written
+        z.loaded = false;
+        throw;
+    }
+    z.write_pointer = pos + len;
+    co_return pos;
+}
+
+void io_queue::forget_zones(dev_t dev, uint64_t start, uint64_t end) noexcept {
+    for (auto it = _zones.lower_bound({dev, start}); it != _zones.end() && it->first.first == dev && it->first.second < end; ++it) {
+        it->second->loaded = false;
+    }
+}
+
+future<size_t> io_queue::submit_io_chain(internal::priority_class pc, std::vector<internal::io_request> reqs, io_intent* intent) noexcept {
+    if (reqs.empty() || reqs.size() > max_chain_length) {
+        throw std::invalid_argument(format("I/O chain of {} requests, up to {} can be chained", reqs.size(), max_chain_length));
+    }
+    auto& r = engine();
+    bool linked = r._backend->links_file_io();
+    auto max_length = _group->_max_request_length[io_direction_write];
+    // The fair queue never grants more than this at once, see
+    // fair_queue::dispatch_requests(), so a chain costing more would never
+    // be dispatched
+    auto max_cap = _streams[request_stream(io_direction_and_length(io_direction_write, 0))].maximum_capacity();
+    auto sync_cap = request_capacity(io_direction_and_length(io_direction_write, 0));
+
+    std::vector<std::unique_ptr<internal::io_chain>> chains;
+    std::vector<internal::io_request> chain_reqs;
+    std::vector<std::vector<::iovec>> chain_iovecs;
+    size_t chain_len = 0;
+    unsigned chain_syncs = 0;
+    auto add = [&] (internal::io_request req, size_t len, std::vector<::iovec> iovecs) {
+        unsigned sync = req.opcode() == internal::io_request::operation::fdatasync;
+        auto cap = request_capacity(io_direction_and_length(io_direction_write, chain_len + len)) + (chain_syncs + sync) * sync_cap;
+        if (!chain_reqs.empty() && (cap > max_cap || chain_reqs.size() == max_chain_length)) {
+            chains.push_back(std::make_unique<internal::io_chain>(std::exchange(chain_reqs, {}), std::exchange(chain_iovecs, {}), linked));
+            chain_len = 0;
+            chain_syncs = 0;
+        }
+        chain_reqs.push_back(std::move(req));
+        if (!iovecs.empty()) {
+            chain_iovecs.push_back(std::move(iovecs));
+        }
+        chain_len += len;
+        chain_syncs += sync;
+    };
+    for (auto& req : reqs) {
+        auto len = internal::io_chain::length(req);
+        if (req.opcode() != internal::io_request::operation::fdatasync) {
+            ++r._io_stats.aio_writes;
+            r._io_stats.aio_write_bytes += len;
+        }
+        if (len <= max_length) {
+            add(std::move(req), len, {});
+            continue;
+        }
+        find_or_create_class(pc).on_split(io_direction_and_length(io_direction_write, len));
+        r._io_stats.aio_outsizes++;
+        for (auto& part : req.split(max_length)) {
+            add(std::move(part.req), part.size, std::move(part.iovecs));
+        }
+    }
+    chains.push_back(std::make_unique<internal::io_chain>(std::move(chain_reqs), std::move(chain_iovecs), linked));
+
+    size_t written = 0;
+    for (auto& chain : chains) {
+        auto len = chain->length();
+        auto req = internal::io_request::make_chain(chain.get());
+        auto res = co_await queue_one_request(pc, io_direction_and_length(io_direction_write, len), std::move(req), intent, {}, std::move(chain));
+        written += res;
+        if (res < len) {
+            break;
+        }
+    }
+    co_return written;
+}
+
 void io_queue::poll_io_queue() {
     for (auto&& st : _streams) {
         st.dispatch_requests([] (fair_queue_entry& fqe) {
             queued_io_request::from_fq_entry(fqe).dispatch();
         });
     }
+    if (!_dispatched_reads.empty()) {
+        submit_dispatched_reads();
+    }
+    if (!_dispatched_discards.empty()) {
+        submit_dispatched_discards();
+    }
+    // Requests left in the queue mean the rate, not the workload, is the limit
+    _calibration_backlogged |= _queued_requests != 0;
 }
 
 void io_queue::submit_request(io_desc_read_write* desc, internal::io_request req) noexcept {
     _queued_requests--;
     _requests_executing++;
     _requests_dispatched++;
-    _sink.submit(desc, std::move(req));
+    auto op = req.opcode();
+    if (op == internal::io_request::operation::chain) {
+        req.as<internal::io_request::operation::chain>().chain->submit(desc, _sink);
+        return;
+    }
+    if (op == internal::io_request::operation::discard) {
+        desc->not_cancellable();
+        try {
+            _dispatched_discards.push_back(dispatched_request{desc, std::move(req)});
+        } catch (...) {
+            desc->set_exception(std::current_exception());
+        }
+        return;
+    }
+    if (max_merged_read_length() && (op == internal::io_request::operation::read || op == internal::io_request::operation::readv)) {
+        try {
+            _dispatched_reads.push_back(dispatched_request{desc, std::move(req)});
+            return;
+        } catch (...) {
+            // not merged, no harm
+        }
+    }
+    _sink.submit(desc, std::move(req), desc->submitted_ts());
+}
+
+size_t io_queue::max_merged_read_length() const noexcept {
+    return std::min(get_config().max_merged_read_length, _group->_max_request_length[io_direction_read]);
+}
+
+// Reads of a file dispatched together, like the neighbouring blocks an index
+// lookup touches, are merged into a single readv when they are adjacent. The
+// fair queue accounts for them separately, as they were queued.
+void io_queue::submit_dispatched_reads() noexcept {
+    auto reads = std::exchange(_dispatched_reads, {});
+    auto read_pos = [] (const dispatched_request& r) {
+        // read_op and readv_op share the layout of fd and pos
+        auto& op = r.req.as<internal::io_request::operation::read>();
+        return std::make_pair(op.fd, op.pos);
+    };
+    auto read_length = [] (const dispatched_request& r) {
+        if (r.req.opcode() == internal::io_request::operation::read) {
+            return r.req.as<internal::io_request::operation::read>().size;
+        }
+        auto& op = r.req.as<internal::io_request::operation::readv>();
+        return internal::iovec_len(op.iovec, op.iov_len);
+    };
+    std::stable_sort(reads.begin(), reads.end(), [&] (const dispatched_request& a, const dispatched_request& b) {
+        return read_pos(a) < read_pos(b);
+    });
+
+    auto max_length = max_merged_read_length();
+    auto it = reads.begin();
+    while (it != reads.end()) {
+        auto [fd, pos] = read_pos(*it);
+        auto end = pos + read_length(*it);
+        auto next = std::next(it);
+        while (next != reads.end() && read_pos(*next) == std::make_pair(fd, end) && end + read_length(*next) - pos <= max_length) {
+            end += read_length(*next);
+            ++next;
+        }
+        if (next - it > 1) {
+            try {
+                auto merged = std::make_unique<io_desc_merged_read>();
+                for (auto r = it; r != next; ++r) {
+                    merged->add(r->desc, r->req);
+                }
+                if (merged->iovecs() <= IOV_MAX) {
+                    auto req = merged->make_request(it->req);
+                    auto ts = merged->submitted_ts();
+                    _merged_reads += next - it - 1;
+                    _sink.submit(merged.release(), std::move(req), ts);
+                    it = next;
+                    continue;
+                }
+            } catch (...) {
+                // submit them one by one
+            }
+        }
+        for (; it != next; ++it) {
+            _sink.submit(it->desc, std::move(it->req), it->desc->submitted_ts());
+        }
+    }
+    // keep the capacity for the next poll
+    reads.clear();
+    _dispatched_reads = std::move(reads);
+}
+
+// Neither aio nor io_uring can discard, so the discards run in the syscall
+// thread. The ones dispatched together, like the chunks of a large discard
+// or the extents of a deleted file, are merged into a single call when they
+// are adjacent. The fair queue accounts for them separately, as they were queued.
+void io_queue::submit_dispatched_discards() noexcept {
+    auto discards = std::exchange(_dispatched_discards, {});
+    auto discard_op = [] (const dispatched_request& d) -> const auto& {
+        return d.req.as<internal::io_request::operation::discard>();
+    };
+    std::stable_sort(discards.begin(), discards.end(), [&] (const dispatched_request& a, const dispatched_request& b) {
+        return std::make_pair(discard_op(a).fd, discard_op(a).pos) < std::make_pair(discard_op(b).fd, discard_op(b).pos);
+    });
+
+    auto it = discards.begin();
+    while (it != discards.end()) {
+        auto first = discard_op(*it);
+        auto end = first.pos + first.len;
+        auto next = std::next(it);
+        while (next != discards.end() && discard_op(*next).fd == first.fd && discard_op(*next).pos == end) {
+            end += discard_op(*next).len;
+            ++next;
+        }
+        try {
+            std::vector<io_desc_read_write*> descs;
+            descs.reserve(next - it);
+            auto now = io_queue::clock_type::now();
+            for (auto d = it; d != next; ++d) {
+                if (auto ts = d->desc->submitted_ts()) {
+                    *ts = now;
+                }
+                descs.push_back(d->desc);
+            }
+            _merged_discards += descs.size() - 1;
+            (void)engine()._thread_pool->submit<syscall_result<int>>(internal::thread_pool_submit_reason::file_operation,
+                    [fd = first.fd, blockdev = first.blockdev, pos = first.pos, len = end - first.pos] {
+                if (blockdev) {
+                    uint64_t range[2] { pos, len };
+                    return wrap_syscall<int>(::ioctl(fd, BLKDISCARD, &range));
+                }
+                return wrap_syscall<int>(::fallocate(fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE, pos, len));
+            }).then_wrapped([descs = std::move(descs)] (future<syscall_result<int>> f) {
+                std::exception_ptr ex;
+                if (f.failed()) {
+                    ex = f.get_exception();
+                } else if (auto sr = f.get(); sr.result == -1) {
+                    ex = std::make_exception_ptr(std::system_error(sr.error, std::system_category(), "discard failed"));
+                }
+                for (auto desc : descs) {
+                    if (ex) {
+                        desc->set_exception(ex);
+                    } else {
+                        desc->complete(0);
+                    }
+                }
+            });
+        } catch (...) {
+            for (; it != next; ++it) {
+                it->desc->set_exception(std::current_exception());
+            }
+        }
+        it = next;
+    }
+    // keep the capacity for the next poll
+    discards.clear();
+    _dispatched_discards = std::move(discards);
 }
 
 void io_queue::cancel_request(queued_io_request& req) noexcept {
@@ -970,6 +1783,15 @@ void io_queue::cancel_request(queued_io_request& req) noexcept {
     _streams[req.stream()].notify_request_cancelled(req.queue_entry());
 }
 
+// The kernel completes the request early, with ECANCELED, or as usual if
+// it's too late, its capacity being returned on completion either way. The
+// cancellation is queued after the request, so if the request completes
+// before the kernel gets to it, a request reusing its completion can only
+// be handed over to the kernel after it.
+void io_queue::cancel_dispatched_request(io_desc_read_write& desc) noexcept {
+    _sink.submit(nullptr, internal::io_request::make_cancel(-1, static_cast<io_completion*>(&desc)));
+}
+
 void io_queue::complete_cancelled_request(queued_io_request& req) noexcept {
     _streams[req.stream()].notify_request_finished(req.queue_entry().capacity());
 }
@@ -991,8 +1813,81 @@ void
 io_queue::update_shares_for_class(internal::priority_class pc, size_t new_shares) {
     auto& pclass = find_or_create_class(pc);
     pclass.update_shares(new_shares);
+    apply_shares(pclass);
+}
+
+void io_queue::apply_shares(priority_class_data& pc) noexcept {
+    for (auto&& s : _streams) {
+        s.update_shares_for_class(pc.fq_class(), pc.dynamic_shares());
+    }
+}
+
+void io_queue::update_latency_target_for_class(internal::priority_class pc, std::chrono::microseconds latency, double percentile) {
+    auto& pclass = find_or_create_class(pc);
+    bool had_target = pclass.has_latency_target();
+    pclass.update_latency_target(latency, percentile);
+    if (pclass.has_latency_target() != had_target) {
+        register_stats(std::get<1>(get_class_info(pc.id())), pclass);
+    }
+    if (pclass.has_latency_target()) {
+        if (!_latency_controller.armed()) {
+            _latency_controller.arm_periodic(get_config().latency_control_period);
+        }
+    } else if (std::none_of(_priority_classes.begin(), _priority_classes.end(), [] (auto& pc) { return pc && pc->has_latency_target(); })) {
+        // No target is left to trade the shares for
+        _latency_controller.cancel();
+        for (auto& pc : _priority_classes) {
+            if (pc && pc->dynamic_shares() != pc->shares()) {
+                pc->set_dynamic_shares(pc->shares());
+                apply_shares(*pc);
+            }
+        }
+    }
+}
+
+void io_queue::update_min_shares_for_class(internal::priority_class pc, uint32_t min_shares) {
+    auto& pclass = find_or_create_class(pc);
+    pclass.update_min_shares(min_shares);
+    apply_shares(pclass);
+}
+
+uint32_t io_queue::dynamic_shares_for_class(internal::priority_class pc) {
+    return find_or_create_class(pc).dynamic_shares();
+}
+
+// Trades the bandwidth of the classes which have minimum shares, typically
+// background ones, for the latency of the classes which have a target: the
+// former are multiplicatively backed off while any target is missed, and
+// recover their configured shares gradually while all are met.
+void io_queue::control_latency() noexcept {
+    auto& cfg = get_config();
+    bool missed = false;
+    for (auto& pc : _priority_classes) {
+        if (pc && pc->has_latency_target()) {
+            missed |= pc->latency_target_missed();
+        }
+    }
+    for (auto& pc : _priority_classes) {
+        if (!pc || !pc->min_shares()) {
+            continue;
+        }
+        auto shares = pc->dynamic_shares();
+        auto next = missed
+                ? std::max<uint32_t>(shares * cfg.latency_control_decrease_factor, pc->min_shares())
+                : std::min<uint32_t>(shares * cfg.latency_control_increase_factor + 1, pc->shares());
+        if (next != shares) {
+            io_log.debug("Latency targets {}, {} shares of class {} on {}", missed ? "missed" : "met", next, pc->fq_class(), mountpoint());
+            pc->set_dynamic_shares(next);
+            apply_shares(*pc);
+        }
+    }
+}
+
+void
+io_queue::update_shares_for_supergroup(unsigned index, size_t new_shares) {
+    auto id = find_or_create_supergroup(index);
     for (auto&& s : _streams) {
-        s.update_shares_for_class(pclass.fq_class(), new_shares);
+        s.update_shares_for_class(id, new_shares);
     }
 }
 
@@ -1005,6 +1900,16 @@ future<> io_queue::update_bandwidth_for_class(internal::priority_class pc, uint6
     });
 }
 
+void io_queue::update_bandwidth_budget(internal::priority_class pc, uint64_t bandwidth) {
+    auto& budget = class_budget(pc);
+    bool enabled = bandwidth != std::numeric_limits<uint64_t>::max();
+    if (enabled) {
+        budget.data.update_bandwidth(bandwidth);
+    }
+    budget.enabled.store(enabled, std::memory_order_relaxed);
+    io_log.debug("Updated {} class cross-device bandwidth budget to {}MB/s", pc.id(), bandwidth >> 20);
+}
+
 void
 io_queue::rename_priority_class(internal::priority_class pc, sstring new_name) {
     if (_priority_classes.size() > pc.id() &&
@@ -0,0 +1,195 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/mapped_file.hh>
+#include <seastar/core/file.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/util/defer.hh>
+#include "core/file-impl.hh"
+#include "core/syscall_result.hh"
+#include "core/thread_pool.hh"
+#endif
+
+namespace seastar {
+
+struct mapped_file::mapping {
+    void* addr;
+    size_t length;
+    // Offset of the requested range into the page-aligned mapping
+    size_t skip;
+    // The part of the requested range that was in the file when mapped,
+    // touching the pages past the end of the file raises SIGBUS
+    size_t size;
+    size_t page_size;
+    std::vector<bool> resident;
+
+    // Takes over the mapping of length bytes at addr
+    mapping(void* addr, size_t length, size_t skip, size_t size, size_t page_size)
+            : addr(addr)
+            , length(length)
+            , skip(skip)
+            , size(size)
+            , page_size(page_size)
+            , resident((length + page_size - 1) / page_size)
+    {}
+    mapping(const mapping&) = delete;
+
+    ~mapping() {
+        ::munmap(addr, length);
+    }
+
+    const char* data() const noexcept {
+        return static_cast<const char*>(addr) + skip;
+    }
+
+    // Pages of the mapping the range of the file touches
+    std::pair<size_t, size_t> pages(uint64_t pos, size_t len) const noexcept {
+        return { (skip + pos) / page_size, (skip + pos + len + page_size - 1) / page_size };
+    }
+
+    bool contains(uint64_t pos, size_t len) const noexcept {
+        return pos <= size && len <= size - pos;
+    }
+};
+
+mapped_file::mapped_file(lw_shared_ptr<mapping> m) noexcept : _m(std::move(m)) {}
+mapped_file::mapped_file(mapped_file&&) noexcept = default;
+mapped_file& mapped_file::operator=(mapped_file&&) noexcept = default;
+mapped_file::~mapped_file() = default;
+
+future<mapped_file> mapped_file::map(int fd, uint64_t offset, size_t length) noexcept {
+    size_t page_size = ::getpagesize();
+    auto skip = offset % page_size;
+    struct mapped {
+        void* addr;
+        uint64_t file_size;
+    };
+    auto sr = co_await engine()._thread_pool->submit<syscall_result_extra<mapped>>(
+            internal::thread_pool_submit_reason::file_operation, [fd, offset = offset - skip, length = length + skip] {
+        struct stat st;
+        if (::fstat(fd, &st) == -1) {
+            return syscall_result_extra<mapped>(-1, errno, {MAP_FAILED, 0});
+        }
+        auto addr = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, offset);
+        return syscall_result_extra<mapped>(addr == MAP_FAILED ? -1 : 0, errno, {addr, uint64_t(st.st_size)});
+    });
+    sr.throw_if_error();
+    auto unmap = defer([&] () noexcept { ::munmap(sr.extra.addr, length + skip); });
+    auto size = std::min<uint64_t>(length, sr.extra.file_size - std::min(sr.extra.file_size, offset));
+    auto m = make_lw_shared<mapping>(sr.extra.addr, length + skip, skip, size, page_size);
+    unmap.cancel();
+    co_return mapped_file(std::move(m));
+}
+
+const char* mapped_file::data() const noexcept {
+    return _m->data();
+}
+
+size_t mapped_file::size() const noexcept {
+    return _m->size;
+}
+
+bool mapped_file::resident(uint64_t pos, size_t len) const noexcept {
+    if (!_m->contains(pos, len)) {
+        return false;
+    }
+    auto [first, last] = _m->pages(pos, len);
+    for (auto p = first; p != last; ++p) {
+        if (!_m->resident[p]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+future<> mapped_file::refresh_residency() noexcept {
+    auto m = _m;
+    std::vector<unsigned char> vec(m->resident.size());
+    auto sr = co_await engine()._thread_pool->submit<syscall_result<int>>(
+            internal::thread_pool_submit_reason::file_operation, [addr = m->addr, length = m->length, vec = vec.data()] {
+        return wrap_syscall<int>(::mincore(addr, length, vec));
+    });
+    sr.throw_if_error();
+    for (size_t p = 0; p != vec.size(); ++p) {
+        m->resident[p] = vec[p] & 1;
+    }
+}
+
+future<> mapped_file::prefetch(uint64_t pos, size_t len) noexcept {
+    auto m = _m;
+    if (!m->contains(pos, len)) {
+        throw std::out_of_range("prefetch past the end of the mapping");
+    }
+    auto [first, last] = m->pages(pos, len);
+    auto sr = co_await engine()._thread_pool->submit<syscall_result<int>>(
+            internal::thread_pool_submit_reason::file_operation,
+            [addr = static_cast<char*>(m->addr) + first * m->page_size, length = (last - first) * m->page_size] {
+        return wrap_syscall<int>(::madvise(addr, length, MADV_WILLNEED));
+    });
+    sr.throw_if_error();
+}
+
+future<temporary_buffer<char>> mapped_file::read(uint64_t pos, size_t len) noexcept {
+    auto m = _m;
+    if (!m->contains(pos, len)) {
+        throw std::out_of_range("read past the end of the mapping");
+    }
+    if (!resident(pos, len)) {
+        auto [first, last] = m->pages(pos, len);
+        // Fault the pages in where blocking on the disk doesn't stall the reactor
+        co_await engine()._thread_pool->submit<int>(internal::thread_pool_submit_reason::file_operation,
+                [addr = static_cast<const volatile char*>(m->addr), first, last, page_size = m->page_size] {
+            for (auto p = first; p != last; ++p) {
+                (void)addr[p * page_size];
+            }
+            return 0;
+        });
+        for (auto p = first; p != last; ++p) {
+            m->resident[p] = true;
+        }
+    }
+    co_return temporary_buffer<char>(const_cast<char*>(m->data()) + pos, len, make_deleter([m] {}));
+}
+
+future<mapped_file> file::map(uint64_t offset, size_t length) noexcept {
+    auto fd = posix_file_impl::fd_of(*this);
+    if (fd == -1) {
+        return make_exception_future<mapped_file>(std::runtime_error("this file type cannot be mapped"));
+    }
+    return mapped_file::map(fd, offset, length);
+}
+
+}
@@ -79,6 +79,8 @@ module;
 #include <optional>
 #include <memory_resource>
 #include <thread>
+#include <bit>
+#include <system_error>
 
 #include <seastar/util/assert.hh>
 
@@ -88,6 +90,9 @@ module;
 #include <boost/container/static_vector.hpp>
 
 #include <dlfcn.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
 
 #ifndef SEASTAR_DEFAULT_ALLOCATOR
 #include <new>
@@ -100,9 +105,6 @@ module;
 #include <cstring>
 #include <utility>
 #include <boost/intrusive/list.hpp>
-#include <sys/mman.h>
-#include <sys/syscall.h>
-#include <linux/mempolicy.h>
 
 #endif // !defined(SEASTAR_DEFAULT_ALLOCATOR)
 
@@ -112,15 +114,17 @@ module seastar;
 #include <seastar/core/cacheline.hh>
 #include <seastar/core/memory.hh>
 #include <seastar/core/print.hh>
+#include <seastar/core/scheduling.hh>
 #include <seastar/util/alloc_failure_injector.hh>
 #include <seastar/util/memory_diagnostics.hh>
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/sampler.hh>
 #include <seastar/util/log.hh>
 #include <seastar/core/aligned_buffer.hh>
+#include <seastar/core/align.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
 #ifndef SEASTAR_DEFAULT_ALLOCATOR
 #include <seastar/core/bitops.hh>
-#include <seastar/core/align.hh>
 #include <seastar/core/posix.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/util/backtrace.hh>
@@ -174,6 +178,38 @@ void enable_abort_on_allocation_failure() {
 static std::pmr::polymorphic_allocator<char> static_malloc_allocator{std::pmr::get_default_resource()};;
 std::pmr::polymorphic_allocator<char>* malloc_allocator{&static_malloc_allocator};
 
+static long mbind(void *addr,
+                  unsigned long len,
+                  int mode,
+                  const unsigned long *nodemask,
+                  unsigned long maxnode,
+                  unsigned flags) {
+    return syscall(
+        SYS_mbind,
+        addr,
+        len,
+        mode,
+        nodemask,
+        maxnode,
+        flags
+    );
+}
+
+static long get_mempolicy(int* mode,
+                  unsigned long* nodemask,
+                  unsigned long maxnode,
+                  void* addr,
+                  unsigned long flags) {
+    return syscall(
+        SYS_get_mempolicy,
+        mode,
+        nodemask,
+        maxnode,
+        addr,
+        flags
+    );
+}
+
 namespace internal {
 
 #ifdef __cpp_constinit
@@ -251,7 +287,7 @@ std::atomic<bool> use_transparent_hugepages = true;
 
 namespace alloc_stats {
 
-enum class types { allocs, frees, cross_cpu_frees, reclaims, large_allocs, failed_allocs,
+enum class types { allocs, frees, cross_cpu_frees, cross_cpu_free_batches, reclaims, large_allocs, failed_allocs,
     foreign_mallocs, foreign_frees, foreign_cross_frees, enum_size };
 
 using stats_array = std::array<uint64_t, static_cast<std::size_t>(types::enum_size)>;
@@ -322,6 +358,7 @@ class page_list_link {
     uint32_t _prev;
     uint32_t _next;
     friend class page_list;
+    friend class small_pool; // for stats()
     friend seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar::internal::log_buf::inserter_iterator);
 };
 
@@ -375,7 +412,10 @@ struct free_object {
 struct page {
     bool free;
     uint8_t offset_in_span;
-    uint16_t nr_small_alloc;
+    union {
+        uint16_t nr_small_alloc; // if used in a small_pool
+        uint16_t sched_group; // of a large allocation, valid for head only
+    };
     uint32_t span_size; // in pages, if we're the head or the tail
     page_list_link link;
     small_pool* pool;  // if used in a small_pool
@@ -423,6 +463,7 @@ class page_list {
         }
         _front = ary[_front].link._next;
     }
+    friend class small_pool; // for stats()
     friend seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar::internal::log_buf::inserter_iterator);
 };
 
@@ -438,6 +479,8 @@ class small_pool {
     unsigned _min_free;
     unsigned _max_free;
     unsigned _pages_in_use = 0;
+    uint64_t _allocs = 0;
+    uint64_t _frees = 0;
     // Flag to indicate whether this pool stores sampled allocations.
     // When freeing small allocations this flag is checked to see whether an
     // allocation site pointer is part of the object and the allocation needs
@@ -453,6 +496,8 @@ class small_pool {
     inline void* allocate();
     void deallocate(void* object);
     unsigned object_size() const { return _object_size; }
+    // Walks the span list, so not for the allocation path
+    small_pool_stats stats() const;
     /// See _sampled_pool
     bool is_sampled_pool() const {
 #ifdef SEASTAR_HEAPPROF
@@ -548,20 +593,67 @@ struct cross_cpu_free_item {
     cross_cpu_free_item* next;
 };
 
+// Objects freed on this shard that belong to a single other shard, waiting
+// to be handed over to it in one go.
+struct cross_cpu_free_batch {
+    cross_cpu_free_item* head = nullptr;
+    cross_cpu_free_item* tail = nullptr;
+    unsigned count = 0;
+    bool pending = false; // listed in cpu_pages::xcpu_pending
+};
+
 struct cpu_pages {
     small_pool_array<false> small_pools;
     uint32_t min_free_pages = 20000000 / page_size;
+    uint32_t high_free_pages = 40000000 / page_size;
     char* memory;
     page* pages;
     uint32_t nr_pages;
     uint32_t nr_free_pages;
     uint32_t current_min_free_pages = 0;
+    uint32_t current_high_free_pages = 0;
     size_t large_allocation_warning_threshold = std::numeric_limits<size_t>::max();
     unsigned cpu_id = -1U;
     std::function<void (std::function<void ()>)> reclaim_hook;
-    std::vector<reclaimer*> reclaimers;
+    std::function<void (std::function<void ()>)> background_reclaim_hook;
+    std::vector<reclaimer*> reclaimers; // sorted by decreasing priority
+    // Upper bound on how much a single background reclaim step asks for,
+    // so that each step is short and other work can run in between.
+    static constexpr uint32_t reclaim_step_pages = (1 << 20) / page_size;
+    seastar::metrics::internal::time_estimated_histogram sync_reclaim_latency;
+    seastar::metrics::internal::time_estimated_histogram async_reclaim_latency;
     static constexpr unsigned nr_span_lists = 32;
     page_list free_spans[nr_span_lists];  // contains aligned spans with span_size == 2^idx
+    // Recently freed medium sized spans (16k-1M), by span_size == 2^idx.
+    // They are kept allocated as far as the buddy allocator is concerned, so
+    // they can be handed out again without splitting and merging, but are
+    // accounted as free memory.
+    static constexpr unsigned span_cache_min_idx = log2ceil(std::max<size_t>((16 << 10) / page_size, 1));
+    static constexpr unsigned span_cache_max_idx = log2ceil(std::max<size_t>((1 << 20) / page_size, 1));
+    static constexpr size_t span_cache_bytes_per_idx = 2 << 20;
+    struct span_cache_list {
+        page_list spans;
+        uint32_t count = 0;
+    };
+    span_cache_list span_cache[span_cache_max_idx + 1];
+    // Free memory handed over to the other shards, see lend(). The spans are
+    // released to the OS and look allocated to the buddy allocator, until
+    // this shard borrows memory back.
+    page_list lent_spans;
+    uint32_t nr_lent_pages = 0;
+    // Pages the shard grew by to take over memory lent by the others
+    uint32_t nr_borrowed_pages = 0;
+    // The most pages the shard can grow to, see reserve_page_array()
+    size_t max_pages = 0;
+    bool borrow_on_pressure = false;
+    // Times free memory dropped below the high water mark
+    uint64_t free_memory_shortages = 0;
+    allocate_system_memory_fn sys_alloc;
+    // Flush a batch to its owner once it holds this many objects, without
+    // waiting for the next poll.
+    static constexpr unsigned xcpu_batch_size = 64;
+    std::array<cross_cpu_free_batch, max_cpus> xcpu_batches;
+    boost::container::static_vector<unsigned, max_cpus> xcpu_pending;
     alignas(seastar::cache_line_size) std::atomic<cross_cpu_free_item*> xcpu_freelist;
     static std::atomic<unsigned> cpu_id_gen;
     static cpu_pages* all_cpus[max_cpus];
@@ -575,6 +667,17 @@ struct cpu_pages {
     allocation_site_ptr alloc_site_list_head = nullptr; // For easy traversal of asu.alloc_sites from scylla-gdb.py
     sampler heap_prof_sampler;
     small_pool_array<true> sampled_small_pools;
+    memory_backing_stats backing;
+    // The memory held by the large allocations of each scheduling group, and
+    // its soft limit, see set_scheduling_group_memory_limit()
+    static constexpr uint16_t no_sched_group = std::numeric_limits<uint16_t>::max();
+    struct sched_group_memory {
+        size_t allocated = 0;
+        size_t limit = 0;
+        bool exceeded = false;
+        std::function<void ()> on_exceeded;
+    };
+    std::array<sched_group_memory, max_scheduling_groups()> sched_group_mem;
 
     char* mem() { return memory; }
 
@@ -590,7 +693,13 @@ struct cpu_pages {
     void* allocate_large_aligned(unsigned align_pages, unsigned nr_pages, bool should_sample);
     page* find_and_unlink_span(unsigned nr_pages);
     page* find_and_unlink_span_reclaiming(unsigned n_pages);
+    page* pop_cached_span(unsigned n_pages);
+    bool push_cached_span(pageidx start, uint32_t n_pages);
+    bool drain_span_cache();
     void free_large(void* ptr);
+    void charge_sched_group(void* ptr) noexcept;
+    void uncharge_sched_group(page* span, size_t bytes) noexcept;
+    void check_sched_group_limit(unsigned sg) noexcept;
     bool grow_span(pageidx& start, uint32_t& nr_pages, unsigned idx);
     void free_span(pageidx start, uint32_t nr_pages);
     void free_span_no_merge(pageidx start, uint32_t nr_pages);
@@ -602,6 +711,10 @@ struct cpu_pages {
     static void do_foreign_free(void* ptr);
     void shrink(void* ptr, size_t new_size);
     static void free_cross_cpu(unsigned cpu_id, void* ptr);
+    static void publish_cross_cpu_free(unsigned cpu_id, cross_cpu_free_item* head, cross_cpu_free_item* tail);
+    void batch_cross_cpu_free(unsigned cpu_id, cross_cpu_free_item* p);
+    void flush_cross_cpu_free_batch(unsigned cpu_id);
+    bool flush_cross_cpu_free_batches();
     bool drain_cross_cpu_freelist();
     size_t object_size(void* ptr);
 
@@ -613,12 +726,30 @@ struct cpu_pages {
     bool is_initialized() const;
     bool initialize();
     reclaiming_result run_reclaimers(reclaimer_scope, size_t pages_to_reclaim);
+    reclaiming_result reclaim_to(reclaimer_scope, size_t target, unsigned max_rounds);
     void schedule_reclaim();
+    void reclaim_step();
+    void arm_reclaim() noexcept;
+    uint32_t effective_high_free_pages() const noexcept { return std::max(min_free_pages, high_free_pages); }
+    // Background reclaim starts below this and runs up to the high
+    // watermark. Starting it right below the high watermark would have it
+    // run for every few pages allocated under steady pressure.
+    uint32_t background_reclaim_start_pages() const noexcept {
+        auto high = effective_high_free_pages();
+        return high - (high - min_free_pages) / 2;
+    }
     void set_reclaim_hook(std::function<void (std::function<void ()>)> hook);
+    void set_background_reclaim_hook(std::function<void (std::function<void ()>)> hook);
     void set_min_free_pages(size_t pages);
+    void set_high_free_pages(size_t pages);
     void resize(size_t new_size, allocate_system_memory_fn alloc_sys_mem);
     void do_resize(size_t new_size, allocate_system_memory_fn alloc_sys_mem);
     void replace_memory_backing(allocate_system_memory_fn alloc_sys_mem);
+    void push_lent_span(pageidx start, uint32_t n_pages);
+    size_t lend(size_t n_pages);
+    size_t borrow(size_t n_pages);
+    bool grow(size_t n_pages);
+    void reserve_page_array();
     void check_large_allocation(size_t size);
     void warn_large_allocation(size_t size);
     allocation_site_ptr add_alloc_site(size_t allocated_size);
@@ -632,6 +763,11 @@ struct cpu_pages {
 static thread_local cpu_pages cpu_mem;
 std::atomic<unsigned> cpu_pages::cpu_id_gen;
 cpu_pages* cpu_pages::all_cpus[max_cpus];
+// Pages lent by any shard and not borrowed yet. The spans stay in the
+// address range of the lender, borrowing just moves the physical memory
+// budget: the borrower grows its own range by as much, so every object
+// is still freed to the shard owning its address.
+static std::atomic<size_t> lendable_pages;
 
 static cpu_pages& get_cpu_mem();
 
@@ -788,6 +924,11 @@ cpu_pages::find_and_unlink_span_reclaiming(unsigned n_pages) {
         if (span) {
             return span;
         }
+        // Cached spans may be all that stands between their buddies and a
+        // span large enough, give them back before going to the reclaimers.
+        if (drain_span_cache()) {
+            continue;
+        }
         if (run_reclaimers(reclaimer_scope::sync, n_pages) == reclaiming_result::reclaimed_nothing) {
             return nullptr;
         }
@@ -795,17 +936,68 @@ cpu_pages::find_and_unlink_span_reclaiming(unsigned n_pages) {
 }
 
 void cpu_pages::maybe_reclaim() {
-    if (nr_free_pages < current_min_free_pages) {
+    // current_high_free_pages (where background reclaim starts) >=
+    // current_min_free_pages, and both are zero while a reclaim is already
+    // scheduled.
+    if (nr_free_pages < current_high_free_pages) {
         drain_cross_cpu_freelist();
         if (nr_free_pages < current_min_free_pages) {
+            // Let buddies of cached spans merge, reclaimers are
+            // about to be asked for contiguous memory
+            drain_span_cache();
+            auto start = std::chrono::steady_clock::now();
             run_reclaimers(reclaimer_scope::sync, current_min_free_pages - nr_free_pages);
+            sync_reclaim_latency.add(std::chrono::steady_clock::now() - start);
         }
-        if (nr_free_pages < current_min_free_pages) {
+        if (nr_free_pages < current_high_free_pages) {
             schedule_reclaim();
         }
     }
 }
 
+page*
+cpu_pages::pop_cached_span(unsigned n_pages) {
+    // Allocations are always rounded up to a span of 2^index_of(n_pages)
+    auto idx = index_of(n_pages);
+    if (idx < span_cache_min_idx || idx > span_cache_max_idx || !span_cache[idx].count) {
+        return nullptr;
+    }
+    auto& c = span_cache[idx];
+    page* span = &c.spans.front(pages);
+    c.spans.pop_front(pages);
+    --c.count;
+    nr_free_pages -= span->span_size;
+    return span;
+}
+
+bool
+cpu_pages::push_cached_span(pageidx start, uint32_t n_pages) {
+    auto idx = index_of(n_pages);
+    if (idx < span_cache_min_idx || idx > span_cache_max_idx || n_pages != (1u << idx)) {
+        return false;
+    }
+    auto& c = span_cache[idx];
+    if (c.count >= span_cache_bytes_per_idx / (size_t(n_pages) * page_size)) {
+        return false;
+    }
+    c.spans.push_front(pages, pages[start]);
+    ++c.count;
+    nr_free_pages += n_pages;
+    return true;
+}
+
+bool
+cpu_pages::drain_span_cache() {
+    bool drained = false;
+    for (unsigned idx = span_cache_min_idx; idx <= span_cache_max_idx; ++idx) {
+        while (auto span = pop_cached_span(1u << idx)) {
+            free_span(span - pages, span->span_size);
+            drained = true;
+        }
+    }
+    return drained;
+}
+
 void*
 cpu_pages::allocate_large_and_trim(unsigned n_pages, bool should_sample) {
     // Avoid exercising the reclaimers for requests we'll not be able to satisfy
@@ -813,22 +1005,26 @@ cpu_pages::allocate_large_and_trim(unsigned n_pages, bool should_sample) {
     if (nr_pages && n_pages >= nr_pages) {
         return nullptr;
     }
-    page* span = find_and_unlink_span_reclaiming(n_pages);
+    page* span = pop_cached_span(n_pages);
     if (!span) {
-        return nullptr;
-    }
-    auto span_size = span->span_size;
-    auto span_idx = span - pages;
-    nr_free_pages -= span->span_size;
-    while (span_size >= n_pages * 2) {
-        span_size /= 2;
-        auto other_span_idx = span_idx + span_size;
-        free_span_no_merge(other_span_idx, span_size);
+        span = find_and_unlink_span_reclaiming(n_pages);
+        if (!span) {
+            return nullptr;
+        }
+        auto span_size = span->span_size;
+        auto span_idx = span - pages;
+        nr_free_pages -= span->span_size;
+        while (span_size >= n_pages * 2) {
+            span_size /= 2;
+            auto other_span_idx = span_idx + span_size;
+            free_span_no_merge(other_span_idx, span_size);
+        }
+        auto span_end = &pages[span_idx + span_size - 1];
+        span->free = span_end->free = false;
+        span->span_size = span_end->span_size = span_size;
     }
-    auto span_end = &pages[span_idx + span_size - 1];
-    span->free = span_end->free = false;
-    span->span_size = span_end->span_size = span_size;
     span->pool = nullptr;
+    span->sched_group = no_sched_group;
 #ifdef SEASTAR_HEAPPROF
     if (should_sample) {
         auto alloc_site = add_alloc_site(span->span_size * page_size);
@@ -839,7 +1035,7 @@ cpu_pages::allocate_large_and_trim(unsigned n_pages, bool should_sample) {
     }
 #endif
     maybe_reclaim();
-    return mem() + span_idx * page_size;
+    return mem() + (span - pages) * page_size;
 }
 
 void
@@ -1002,7 +1198,55 @@ void cpu_pages::free_large(void* ptr) {
         remove_alloc_site(alloc_site, span->span_size * page_size);
     }
 #endif
-    free_span(idx, span->span_size);
+    uncharge_sched_group(span, size_t(span->span_size) * page_size);
+    if (!push_cached_span(idx, span->span_size)) {
+        free_span(idx, span->span_size);
+    }
+}
+
+// Only large allocations are charged: the spans of the small pools are
+// shared by the objects of all groups, so there is nowhere to keep the
+// group of each object without growing it.
+void cpu_pages::charge_sched_group(void* ptr) noexcept {
+    page* span = to_page(ptr);
+    auto sg = seastar::internal::scheduling_group_index(current_scheduling_group());
+    span->sched_group = sg;
+    auto& m = sched_group_mem[sg];
+    m.allocated += size_t(span->span_size) * page_size;
+    if (m.limit && !m.exceeded && m.allocated > m.limit) {
+        m.exceeded = true;
+        check_sched_group_limit(sg);
+    }
+}
+
+void cpu_pages::uncharge_sched_group(page* span, size_t bytes) noexcept {
+    if (span->sched_group == no_sched_group) {
+        return;
+    }
+    auto& m = sched_group_mem[span->sched_group];
+    m.allocated -= bytes;
+    if (m.exceeded && m.allocated <= m.limit) {
+        m.exceeded = false;
+    }
+}
+
+// The callback can't run in the middle of an allocation, so it is deferred
+// like background reclaim is
+void cpu_pages::check_sched_group_limit(unsigned sg) noexcept {
+    auto& hook = background_reclaim_hook ? background_reclaim_hook : reclaim_hook;
+    if (!hook) {
+        return;
+    }
+    try {
+        hook([this, sg] {
+            auto& m = sched_group_mem[sg];
+            if (m.exceeded && m.on_exceeded) {
+                m.on_exceeded();
+            }
+        });
+    } catch (...) {
+        // Missing a notification is better than failing the allocation
+    }
 }
 
 size_t cpu_pages::object_size(void* ptr) {
@@ -1030,17 +1274,73 @@ void cpu_pages::free_cross_cpu(unsigned cpu_id, void* ptr) {
         return;
     }
     auto p = reinterpret_cast<cross_cpu_free_item*>(ptr);
+    alloc_stats::increment(alloc_stats::types::cross_cpu_frees);
+    // Reactor threads poll, so they can hold on to the object and hand it
+    // over together with others going to the same shard. Other threads
+    // may never come back for it.
+    if (is_reactor_thread) {
+        get_cpu_mem().batch_cross_cpu_free(cpu_id, p);
+    } else {
+        publish_cross_cpu_free(cpu_id, p, p);
+    }
+}
+
+// Pushes the chain head..tail onto the owner's free list, with a single
+// successful atomic operation on its (contended) head.
+void cpu_pages::publish_cross_cpu_free(unsigned cpu_id, cross_cpu_free_item* head, cross_cpu_free_item* tail) {
     auto& list = all_cpus[cpu_id]->xcpu_freelist;
     auto old = list.load(std::memory_order_relaxed);
     do {
-        p->next = old;
-    } while (!list.compare_exchange_weak(old, p, std::memory_order_release, std::memory_order_relaxed));
-    alloc_stats::increment(alloc_stats::types::cross_cpu_frees);
+        tail->next = old;
+    } while (!list.compare_exchange_weak(old, head, std::memory_order_release, std::memory_order_relaxed));
+    alloc_stats::increment(alloc_stats::types::cross_cpu_free_batches);
+}
+
+void cpu_pages::batch_cross_cpu_free(unsigned cpu_id, cross_cpu_free_item* p) {
+    auto& b = xcpu_batches[cpu_id];
+    p->next = b.head;
+    b.head = p;
+    if (!b.tail) {
+        b.tail = p;
+    }
+    if (!b.pending) {
+        b.pending = true;
+        xcpu_pending.push_back(cpu_id);
+    }
+    if (++b.count == xcpu_batch_size) {
+        flush_cross_cpu_free_batch(cpu_id);
+    }
+}
+
+void cpu_pages::flush_cross_cpu_free_batch(unsigned cpu_id) {
+    auto& b = xcpu_batches[cpu_id];
+    if (!b.head) {
+        return;
+    }
+    // The owner may have exited since the objects were batched
+    if (live_cpus[cpu_id].load(std::memory_order_relaxed)) {
+        publish_cross_cpu_free(cpu_id, b.head, b.tail);
+    }
+    b.head = b.tail = nullptr;
+    b.count = 0;
+}
+
+bool cpu_pages::flush_cross_cpu_free_batches() {
+    if (xcpu_pending.empty()) {
+        return false;
+    }
+    for (auto cpu_id : xcpu_pending) {
+        flush_cross_cpu_free_batch(cpu_id);
+        xcpu_batches[cpu_id].pending = false;
+    }
+    xcpu_pending.clear();
+    return true;
 }
 
 bool cpu_pages::drain_cross_cpu_freelist() {
+    bool flushed = flush_cross_cpu_free_batches();
     if (!xcpu_freelist.load(std::memory_order_relaxed)) {
-        return false;
+        return flushed;
     }
     auto p = xcpu_freelist.exchange(nullptr, std::memory_order_acquire);
     while (p) {
@@ -1189,6 +1489,7 @@ void cpu_pages::shrink(void* ptr, size_t new_size) {
         alloc_site->size += new_size_pages * page_size;
     }
 #endif
+    uncharge_sched_group(span, size_t(old_size_pages - new_size_pages) * page_size);
     span->span_size = new_size_pages;
     span[new_size_pages - 1].free = false;
     span[new_size_pages - 1].span_size = new_size_pages;
@@ -1198,6 +1499,7 @@ void cpu_pages::shrink(void* ptr, size_t new_size) {
 
 cpu_pages::~cpu_pages() {
     if (is_initialized()) {
+        flush_cross_cpu_free_batches();
         live_cpus[cpu_id].store(false, std::memory_order_relaxed);
     }
 }
@@ -1249,6 +1551,55 @@ static allocate_anonymous_memory(void* where, size_t how_much) {
             MAP_PRIVATE | MAP_FIXED);
 }
 
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+static constexpr size_t huge_page_size_1g = size_t(1) << 30;
+
+// Maps [start, end) with explicit hugetlb pages, using the largest page size
+// up to max_page_size that the range alignment and the kernel's hugepage pool
+// allow, and regular (possibly transparent huge) pages for whatever is left.
+static void
+map_hugetlb_range(char* start, char* end, size_t max_page_size, memory_backing_stats& backing) {
+    if (start == end) {
+        return;
+    }
+    if (max_page_size < huge_page_size) {
+        allocate_anonymous_memory(start, end - start).release();
+        maybe_enable_transparent_hugepages(start, end - start);
+        return;
+    }
+    auto smaller = max_page_size == huge_page_size_1g ? huge_page_size : 0;
+    auto a = align_up(start, max_page_size);
+    auto b = align_down(end, max_page_size);
+    if (a >= b) {
+        map_hugetlb_range(start, end, smaller, backing);
+        return;
+    }
+    map_hugetlb_range(start, a, smaller, backing);
+    // Without MAP_NORESERVE the pages are reserved here, so running out of
+    // them fails the mmap() instead of SIGBUSing on first touch
+    auto r = ::mmap(a, b - a, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB | (log2ceil(max_page_size) << MAP_HUGE_SHIFT),
+            -1, 0);
+    if (r == MAP_FAILED) {
+        map_hugetlb_range(a, b, smaller, backing);
+    } else if (max_page_size == huge_page_size_1g) {
+        backing.hugetlb_1g += b - a;
+    } else {
+        backing.hugetlb_2m += b - a;
+    }
+    map_hugetlb_range(b, end, smaller, backing);
+}
+
+static mmap_area
+allocate_hugetlb_memory(void* where, size_t how_much, size_t max_page_size) {
+    auto start = reinterpret_cast<char*>(where);
+    map_hugetlb_range(start, start + how_much, max_page_size, get_cpu_mem().backing);
+    return mmap_area(start, mmap_deleter{how_much});
+}
+
 mmap_area
 allocate_hugetlbfs_memory(file_desc& fd, void* where, size_t how_much) {
     auto pos = fd.size();
@@ -1325,13 +1676,163 @@ void cpu_pages::resize(size_t new_size, allocate_system_memory_fn alloc_memory)
     }
 }
 
+void cpu_pages::push_lent_span(pageidx start, uint32_t n_pages) {
+    auto span = &pages[start];
+    auto span_end = &pages[start + n_pages - 1];
+    span->free = span_end->free = false;
+    span->span_size = span_end->span_size = n_pages;
+    lent_spans.push_front(pages, *span);
+    nr_lent_pages += n_pages;
+}
+
+// Memory is lent and borrowed in whole units of 32MB: releasing them frees
+// memory whether they are backed by transparent or explicit 2MB pages, and
+// every release or mapping is worth its system call.
+static constexpr unsigned lend_unit_idx = log2ceil((size_t(32) << 20) / page_size);
+static constexpr size_t lend_unit_pages = size_t(1) << lend_unit_idx;
+
+size_t cpu_pages::lend(size_t n_pages) {
+    // Releasing a range of a hugetlbfs file takes punching a hole in the file
+    if (backing.hugetlbfs) {
+        return 0;
+    }
+    size_t lent = 0;
+    bool failed = false;
+    for (unsigned idx = nr_span_lists; idx-- > lend_unit_idx && !failed; ) {
+        while (!free_spans[idx].empty() && n_pages - lent >= lend_unit_pages) {
+            auto span = &free_spans[idx].front(pages);
+            pageidx start = span - pages;
+            uint32_t span_size = uint32_t(1) << idx;
+            unlink(free_spans[idx], span);
+            nr_free_pages -= span_size;
+            // Keep the halves we don't need
+            while (span_size > n_pages - lent) {
+                span_size /= 2;
+                free_span_no_merge(start + span_size, span_size);
+            }
+            // Fails for locked memory, in which case there is nothing to gain
+            if (::madvise(mem() + size_t(start) * page_size, size_t(span_size) * page_size, MADV_DONTNEED) != 0) {
+                free_span(start, span_size);
+                failed = true;
+                break;
+            }
+            push_lent_span(start, span_size);
+            lent += span_size;
+        }
+    }
+    lendable_pages.fetch_add(lent, std::memory_order_relaxed);
+    return lent;
+}
+
+size_t cpu_pages::borrow(size_t n_pages) {
+    n_pages = align_up(n_pages, lend_unit_pages);
+    auto avail = lendable_pages.load(std::memory_order_relaxed);
+    size_t take;
+    do {
+        take = std::min(avail, n_pages);
+        if (!take) {
+            return 0;
+        }
+    } while (!lendable_pages.compare_exchange_weak(avail, avail - take, std::memory_order_relaxed));
+
+    // Our own lent spans first, taking them back needs no new mappings
+    size_t got = 0;
+    while (got < take && !lent_spans.empty()) {
+        auto span = &lent_spans.front(pages);
+        lent_spans.pop_front(pages);
+        pageidx start = span - pages;
+        auto span_size = span->span_size;
+        nr_lent_pages -= span_size;
+        while (span_size > take - got) {
+            span_size /= 2;
+            push_lent_span(start + span_size, span_size);
+        }
+        free_span(start, span_size);
+        got += span_size;
+    }
+    if (got < take) {
+        bool grown = false;
+        try {
+            grown = grow(take - got);
+        } catch (...) {
+            seastar_memory_logger.warn("Failed to map {} bytes of borrowed memory: {}", (take - got) * page_size, std::current_exception());
+        }
+        if (grown) {
+            nr_borrowed_pages += take - got;
+            got = take;
+        } else {
+            lendable_pages.fetch_add(take - got, std::memory_order_relaxed);
+        }
+    }
+    return got;
+}
+
+// Extends the range of the shard by n_pages. The page array was sized for
+// the largest range up front, see reserve_page_array(), so it stays where
+// the other shards read it.
+bool cpu_pages::grow(size_t n_pages) {
+    if (!sys_alloc || nr_pages + n_pages > max_pages) {
+        return false;
+    }
+    auto old_nr_pages = nr_pages;
+    auto mmap_start = memory + size_t(old_nr_pages) * page_size;
+    auto mmap_size = n_pages * page_size;
+    sys_alloc(mmap_start, mmap_size).release();
+    maybe_enable_transparent_hugepages(mmap_start, mmap_size);
+    // The array is still zeroed past the old sentinel, so the new one is
+    // not free either
+    nr_pages += n_pages;
+    free_span_unaligned(old_nr_pages, n_pages);
+    return true;
+}
+
+// Moves the page array to the top of the shard's range, sized for the most
+// memory the shard can grow to by borrowing. Once the other shards run, they
+// read the array without synchronization in object_size(), so it must not
+// move anymore. Only the part describing the shard's pages gets backed.
+void cpu_pages::reserve_page_array() {
+    auto range_pages = (size_t(1) << cpu_id_shift) / page_size;
+    auto array_pages = [] (size_t n_pages) {
+        return align_up(sizeof(page) * (n_pages + 1), huge_page_size) / page_size;
+    };
+    // No shard can use more memory than the machine has
+    auto max = size_t(::sysconf(_SC_PHYS_PAGES)) * ::sysconf(_SC_PAGESIZE) / page_size;
+    max = std::min({max, range_pages - array_pages(range_pages), size_t(std::numeric_limits<uint32_t>::max() - 1)});
+    max = std::max<size_t>(max, nr_pages);
+    auto array_start = range_pages - array_pages(max);
+    mmap_anonymous(memory + array_start * page_size, array_pages(max) * page_size,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED | MAP_NORESERVE).release();
+    auto new_page_array = reinterpret_cast<page*>(memory + array_start * page_size);
+    // the sentinel included
+    std::copy(pages, pages + nr_pages + 1, new_page_array);
+    auto old_pages = reinterpret_cast<char*>(pages);
+    auto old_pages_size = align_up(sizeof(page) * (nr_pages + 1), page_size);
+    old_pages_size = size_t(1) << log2ceil(old_pages_size);
+    pages = new_page_array;
+    max_pages = max;
+    auto old_pages_start = (old_pages - memory) / page_size;
+    if (old_pages_start == 0) {
+        // keep page 0 allocated
+        old_pages_start = 1;
+        old_pages_size -= page_size;
+    }
+    if (old_pages_size != 0) {
+        free_span_unaligned(old_pages_start, old_pages_size / page_size);
+    }
+}
+
 reclaiming_result cpu_pages::run_reclaimers(reclaimer_scope scope, size_t n_pages) {
-    auto target = std::max<size_t>(nr_free_pages + n_pages, min_free_pages);
+    return reclaim_to(scope, std::max<size_t>(nr_free_pages + n_pages, min_free_pages), std::numeric_limits<unsigned>::max());
+}
+
+reclaiming_result cpu_pages::reclaim_to(reclaimer_scope scope, size_t target, unsigned max_rounds) {
     reclaiming_result result = reclaiming_result::reclaimed_nothing;
-    while (nr_free_pages < target) {
+    while (nr_free_pages < target && max_rounds--) {
         bool made_progress = false;
         alloc_stats::increment_local(alloc_stats::types::reclaims);
-        for (auto&& r : reclaimers) {
+        for (size_t i = 0; i < reclaimers.size() && nr_free_pages < target; ++i) {
+            // Index rather than iterate, a reclaimer may install or remove reclaimers
+            auto r = reclaimers[i];
             if (r->scope() >= scope) {
                 made_progress |= r->do_reclaim((target - nr_free_pages) * page_size) == reclaiming_result::reclaimed_something;
             }
@@ -1344,19 +1845,48 @@ reclaiming_result cpu_pages::run_reclaimers(reclaimer_scope scope, size_t n_page
     return result;
 }
 
+void cpu_pages::arm_reclaim() noexcept {
+    current_min_free_pages = min_free_pages;
+    current_high_free_pages = background_reclaim_start_pages();
+}
+
 void cpu_pages::schedule_reclaim() {
     current_min_free_pages = 0;
-    reclaim_hook([this] {
-        if (nr_free_pages < min_free_pages) {
-            try {
-                run_reclaimers(reclaimer_scope::async, min_free_pages - nr_free_pages);
-            } catch (...) {
-                current_min_free_pages = min_free_pages;
-                throw;
-            }
+    current_high_free_pages = 0;
+    ++free_memory_shortages;
+    // Below the low watermark reclaim is urgent; above it we are only
+    // getting ahead of demand and can wait for our turn.
+    auto& hook = nr_free_pages < min_free_pages || !background_reclaim_hook ? reclaim_hook : background_reclaim_hook;
+    hook([this] { reclaim_step(); });
+}
+
+// Reclaims at most reclaim_step_pages towards the high watermark, then
+// reschedules itself if more is needed, so that a large deficit is made up
+// in many short steps instead of one long stall.
+void cpu_pages::reclaim_step() {
+    auto high = effective_high_free_pages();
+    // Memory the other shards have no use for is cheaper to take than to
+    // reclaim. Taking it maps memory, so it is left to this step rather than
+    // done in the middle of an allocation.
+    if (borrow_on_pressure && nr_free_pages < high) {
+        borrow(std::min<size_t>(high - nr_free_pages, reclaim_step_pages));
+    }
+    auto result = reclaiming_result::reclaimed_nothing;
+    if (nr_free_pages < high) {
+        auto start = std::chrono::steady_clock::now();
+        try {
+            result = reclaim_to(reclaimer_scope::async, std::min(high, nr_free_pages + reclaim_step_pages), 1);
+        } catch (...) {
+            arm_reclaim();
+            throw;
         }
-        current_min_free_pages = min_free_pages;
-    });
+        async_reclaim_latency.add(std::chrono::steady_clock::now() - start);
+    }
+    if (result == reclaiming_result::reclaimed_something && nr_free_pages < high) {
+        schedule_reclaim();
+        return;
+    }
+    arm_reclaim();
 }
 
 memory::memory_layout cpu_pages::memory_layout() {
@@ -1369,7 +1899,11 @@ memory::memory_layout cpu_pages::memory_layout() {
 
 void cpu_pages::set_reclaim_hook(std::function<void (std::function<void ()>)> hook) {
     reclaim_hook = hook;
-    current_min_free_pages = min_free_pages;
+    arm_reclaim();
+}
+
+void cpu_pages::set_background_reclaim_hook(std::function<void (std::function<void ()>)> hook) {
+    background_reclaim_hook = std::move(hook);
 }
 
 void cpu_pages::set_min_free_pages(size_t pages) {
@@ -1377,6 +1911,20 @@ void cpu_pages::set_min_free_pages(size_t pages) {
         throw std::runtime_error("Number of pages too large");
     }
     min_free_pages = pages;
+    if (current_min_free_pages) {
+        arm_reclaim();
+    }
+    maybe_reclaim();
+}
+
+void cpu_pages::set_high_free_pages(size_t pages) {
+    if (pages > std::numeric_limits<decltype(high_free_pages)>::max()) {
+        throw std::runtime_error("Number of pages too large");
+    }
+    high_free_pages = pages;
+    if (current_high_free_pages) {
+        arm_reclaim();
+    }
     maybe_reclaim();
 }
 
@@ -1440,11 +1988,13 @@ small_pool::pop_free() {
 // falls back to the emergency pool in case malloc() returns nullptr.
 void*
 small_pool::allocate() {
+    ++_allocs;
     return __builtin_expect((bool)_free, true) ? pop_free() : add_more_objects();
 }
 
 void
 small_pool::deallocate(void* object) {
+    ++_frees;
     auto o = reinterpret_cast<free_object*>(object);
     o->next = _free;
     _free = o;
@@ -1454,6 +2004,33 @@ small_pool::deallocate(void* object) {
     }
 }
 
+small_pool_stats
+small_pool::stats() const {
+    // For the small pools, there are two types of free objects:
+    // Pool freelist objects are poitned to by _free and their count is _free_count
+    // Span freelist objects are those removed from the pool freelist when that list
+    // becomes too large: they are instead attached to the spans allocated to this
+    // pool. To count this second category, we iterate over the spans below.
+    uint32_t span_freelist_objs = 0;
+    auto front = _span_list._front;
+    while (front) {
+        auto& span = get_cpu_mem().pages[front];
+        auto capacity_in_objects = span.span_size * page_size / _object_size;
+        span_freelist_objs += capacity_in_objects - span.nr_small_alloc;
+        front = span.link._next;
+    }
+    const size_t free_objs = _free_count + span_freelist_objs; // pool + span free objects
+    const size_t memory = size_t(_pages_in_use) * page_size;
+    return small_pool_stats{
+        .object_size = _object_size,
+        .allocs = _allocs,
+        .frees = _frees,
+        .use_count = memory / _object_size - free_objs,
+        .memory = memory,
+        .unused = free_objs * _object_size,
+    };
+}
+
 void*
 small_pool::add_more_objects() {
     auto goal = (_min_free + _max_free) / 2;
@@ -1538,15 +2115,22 @@ inline void* allocate_large(size_t size, bool should_sample) {
     if ((size_t(size_in_pages) << page_bits) < size) {
         return nullptr; // (size + page_size - 1) caused an overflow
     }
-    return get_cpu_mem().allocate_large(size_in_pages, should_sample);
-
+    auto ptr = get_cpu_mem().allocate_large(size_in_pages, should_sample);
+    if (ptr) {
+        get_cpu_mem().charge_sched_group(ptr);
+    }
+    return ptr;
 }
 
 void* allocate_large_aligned(size_t align, size_t size, bool should_sample) {
     abort_on_underflow(size);
     unsigned size_in_pages = (size + page_size - 1) >> page_bits;
     unsigned align_in_pages = std::max(align, page_size) >> page_bits;
-    return get_cpu_mem().allocate_large_aligned(align_in_pages, size_in_pages, should_sample);
+    auto ptr = get_cpu_mem().allocate_large_aligned(align_in_pages, size_in_pages, should_sample);
+    if (ptr) {
+        get_cpu_mem().charge_sched_group(ptr);
+    }
+    return ptr;
 }
 
 void free_large(void* ptr) {
@@ -1798,16 +2382,27 @@ void set_reclaim_hook(std::function<void (std::function<void ()>)> hook) {
     }
 }
 
-reclaimer::reclaimer(std::function<reclaiming_result ()> reclaim, reclaimer_scope scope)
+void set_background_reclaim_hook(std::function<void (std::function<void ()>)> hook) {
+    if (cpu_mem_ptr) {
+        cpu_mem_ptr->set_background_reclaim_hook(std::move(hook));
+    }
+}
+
+reclaimer::reclaimer(std::function<reclaiming_result ()> reclaim, reclaimer_scope scope, unsigned priority)
     : reclaimer([reclaim = std::move(reclaim)] (request) {
         return reclaim();
-    }, scope) {
+    }, scope, priority) {
 }
 
-reclaimer::reclaimer(std::function<reclaiming_result (request)> reclaim, reclaimer_scope scope)
+reclaimer::reclaimer(std::function<reclaiming_result (request)> reclaim, reclaimer_scope scope, unsigned priority)
     : _reclaim(std::move(reclaim))
-    , _scope(scope) {
-    get_cpu_mem().reclaimers.push_back(this);
+    , _scope(scope)
+    , _priority(priority) {
+    auto& r = get_cpu_mem().reclaimers;
+    auto pos = std::upper_bound(r.begin(), r.end(), _priority, [] (unsigned p, const reclaimer* x) {
+        return p > x->priority();
+    });
+    r.insert(pos, this);
 }
 
 reclaimer::~reclaimer() {
@@ -1831,27 +2426,11 @@ void configure_minimal() {
     init_cpu_mem();
 }
 
-static long mbind(void *addr,
-                  unsigned long len,
-                  int mode,
-                  const unsigned long *nodemask,
-                  unsigned long maxnode,
-                  unsigned flags) {
-    return syscall(
-        SYS_mbind,
-        addr,
-        len,
-        mode,
-        nodemask,
-        maxnode,
-        flags
-    );
-}
-
 internal::numa_layout
 configure(std::vector<resource::memory> m, bool mbind,
         bool transparent_hugepages,
-        optional<std::string> hugetlbfs_path) {
+        optional<std::string> hugetlbfs_path,
+        size_t hugetlb_page_size) {
     // we need to make sure cpu_mem is initialize since configure calls cpu_mem.resize
     // and we might reach configure without ever allocating, hence without ever calling
     // cpu_pages::initialize.
@@ -1876,11 +2455,27 @@ configure(std::vector<resource::memory> m, bool mbind,
         // a shared_ptr to allow sys_alloc to be copied around
         auto fdp = make_lw_shared<file_desc>(file_desc::temporary(*hugetlbfs_path));
         sys_alloc = [fdp] (void* where, size_t how_much) {
+            get_cpu_mem().backing.hugetlbfs += how_much;
             return allocate_hugetlbfs_memory(*fdp, where, how_much);
         };
         get_cpu_mem().replace_memory_backing(sys_alloc);
+    } else if (hugetlb_page_size) {
+        if (hugetlb_page_size != huge_page_size && hugetlb_page_size != huge_page_size_1g) {
+            throw std::invalid_argument(format("Unsupported huge page size {}, must be 2M or 1G", hugetlb_page_size));
+        }
+        sys_alloc = [hugetlb_page_size] (void* where, size_t how_much) {
+            return allocate_hugetlb_memory(where, how_much, hugetlb_page_size);
+        };
+        get_cpu_mem().replace_memory_backing(sys_alloc);
     }
     get_cpu_mem().resize(total, sys_alloc);
+    get_cpu_mem().reserve_page_array();
+    get_cpu_mem().sys_alloc = sys_alloc;
+    auto& backing = get_cpu_mem().backing;
+    if (hugetlb_page_size && backing.hugetlb_1g + backing.hugetlb_2m < total) {
+        seastar_logger.warn("Only {} out of {} bytes of memory are backed by explicit huge pages, "
+                "reserve more of them via /sys/kernel/mm/hugepages", backing.hugetlb_1g + backing.hugetlb_2m, total);
+    }
     size_t pos = 0;
     for (auto&& x : m) {
         unsigned long nodemask = 1UL << x.nodeid;
@@ -1911,7 +2506,7 @@ configure(std::vector<resource::memory> m, bool mbind,
 
 statistics stats() {
     return statistics{alloc_stats::get(alloc_stats::types::allocs), alloc_stats::get(alloc_stats::types::frees), alloc_stats::get(alloc_stats::types::cross_cpu_frees),
-        cpu_mem.nr_pages * page_size, cpu_mem.nr_free_pages * page_size, alloc_stats::get(alloc_stats::types::reclaims), alloc_stats::get(alloc_stats::types::large_allocs),
+        alloc_stats::get(alloc_stats::types::cross_cpu_free_batches), (cpu_mem.nr_pages - cpu_mem.nr_lent_pages) * page_size, cpu_mem.nr_free_pages * page_size, alloc_stats::get(alloc_stats::types::reclaims), alloc_stats::get(alloc_stats::types::large_allocs),
         alloc_stats::get(alloc_stats::types::failed_allocs), alloc_stats::get(alloc_stats::types::foreign_mallocs), alloc_stats::get(alloc_stats::types::foreign_frees),
         alloc_stats::get(alloc_stats::types::foreign_cross_frees)};
 }
@@ -1920,6 +2515,108 @@ size_t free_memory() {
     return get_cpu_mem().nr_free_pages * page_size;
 }
 
+memory_backing_stats backing_stats() noexcept {
+    if (!cpu_mem_ptr) {
+        return {};
+    }
+    auto ret = get_cpu_mem().backing;
+    ret.regular = get_cpu_mem().nr_pages * page_size - ret.hugetlb_2m - ret.hugetlb_1g - ret.hugetlbfs;
+    ret.lent = size_t(get_cpu_mem().nr_lent_pages) * page_size;
+    ret.borrowed = size_t(get_cpu_mem().nr_borrowed_pages) * page_size;
+    // Lent spans are mostly taken from regular memory, they are all the
+    // OS sees when transparent huge pages are used
+    ret.regular -= std::min(ret.regular, ret.lent);
+    return ret;
+}
+
+size_t lend_free_memory(size_t keep_free, size_t max_bytes) {
+    if (!cpu_mem_ptr) {
+        return 0;
+    }
+    auto& cm = get_cpu_mem();
+    cm.drain_cross_cpu_freelist();
+    auto keep = std::max<size_t>(keep_free / page_size, cm.effective_high_free_pages());
+    if (cm.nr_free_pages <= keep) {
+        return 0;
+    }
+    return cm.lend(std::min(cm.nr_free_pages - keep, max_bytes / page_size)) * page_size;
+}
+
+size_t borrow_memory(size_t bytes) {
+    if (!cpu_mem_ptr) {
+        return 0;
+    }
+    return get_cpu_mem().borrow(align_up(bytes, page_size) / page_size) * page_size;
+}
+
+void set_memory_borrowing(bool enabled) {
+    if (cpu_mem_ptr) {
+        cpu_mem_ptr->borrow_on_pressure = enabled;
+    }
+}
+
+size_t lendable_memory() noexcept {
+    return lendable_pages.load(std::memory_order_relaxed) * page_size;
+}
+
+namespace internal {
+
+uint64_t free_memory_shortages() noexcept {
+    return cpu_mem_ptr ? cpu_mem_ptr->free_memory_shortages : 0;
+}
+
+bool is_local(const void* p) noexcept {
+    return cpu_pages::is_local_pointer(const_cast<void*>(p));
+}
+
+}
+
+size_t scheduling_group_memory(scheduling_group sg) noexcept {
+    if (!cpu_mem_ptr) {
+        return 0;
+    }
+    return cpu_mem_ptr->sched_group_mem[seastar::internal::scheduling_group_index(sg)].allocated;
+}
+
+void set_scheduling_group_memory_limit(scheduling_group sg, size_t limit, std::function<void ()> on_exceeded) {
+    if (!cpu_mem_ptr) {
+        return;
+    }
+    auto idx = seastar::internal::scheduling_group_index(sg);
+    auto& m = cpu_mem_ptr->sched_group_mem[idx];
+    m.limit = limit;
+    m.on_exceeded = std::move(on_exceeded);
+    m.exceeded = limit && m.allocated > limit;
+    if (m.exceeded) {
+        cpu_mem_ptr->check_sched_group_limit(idx);
+    }
+}
+
+unsigned small_pool_count() noexcept {
+    // Not set up if running with memory_allocator::standard
+    return cpu_mem_ptr ? small_pool_array<false>::nr_small_pools : 0;
+}
+
+small_pool_stats small_pool_statistics(unsigned idx) noexcept {
+    auto& cm = get_cpu_mem();
+    auto& sp = cm.small_pools[idx];
+    // Pools too small to fit a free_object are never used
+    if (sp.object_size() < sizeof(free_object)) {
+        return small_pool_stats{.object_size = sp.object_size()};
+    }
+    auto ret = sp.stats();
+#ifdef SEASTAR_HEAPPROF
+    // Sampled allocations of the same size class live in a pool of their own
+    auto sampled = cm.sampled_small_pools[idx].stats();
+    ret.allocs += sampled.allocs;
+    ret.frees += sampled.frees;
+    ret.use_count += sampled.use_count;
+    ret.memory += sampled.memory;
+    ret.unused += sampled.unused;
+#endif
+    return ret;
+}
+
 bool drain_cross_cpu_freelist() {
     return get_cpu_mem().drain_cross_cpu_freelist();
 }
@@ -1936,6 +2633,20 @@ void set_min_free_pages(size_t pages) {
     get_cpu_mem().set_min_free_pages(pages);
 }
 
+size_t high_free_memory() {
+    return get_cpu_mem().effective_high_free_pages() * page_size;
+}
+
+void set_high_free_pages(size_t pages) {
+    get_cpu_mem().set_high_free_pages(pages);
+}
+
+seastar::metrics::histogram reclaim_latency_histogram(reclaimer_scope scope) {
+    auto& cpu_mem = get_cpu_mem();
+    auto& h = scope == reclaimer_scope::sync ? cpu_mem.sync_reclaim_latency : cpu_mem.async_reclaim_latency;
+    return h.to_metrics_histogram();
+}
+
 static thread_local int report_on_alloc_failure_suppressed = 0;
 
 class disable_report_on_alloc_failure_temporarily {
@@ -2051,23 +2762,10 @@ seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar
             continue;
         }
 
-        // For the small pools, there are two types of free objects:
-        // Pool freelist objects are poitned to by sp._free and their count is sp._free_count
-        // Span freelist objects are those removed from the pool freelist when that list
-        // becomes too large: they are instead attached to the spans allocated to this
-        // pool. To count this second category, we iterate over the spans below.
-        uint32_t span_freelist_objs = 0;
-        auto front = sp._span_list._front;
-        while (front) {
-            auto& span = get_cpu_mem().pages[front];
-            auto capacity_in_objects = span.span_size * page_size / sp.object_size();
-            span_freelist_objs += capacity_in_objects - span.nr_small_alloc;
-            front = span.link._next;
-        }
-        const auto free_objs = sp._free_count + span_freelist_objs; // pool + span free objects
-        const auto use_count = sp._pages_in_use * page_size / sp.object_size() - free_objs;
-        auto memory = sp._pages_in_use * page_size;
-        const auto unused = free_objs * sp.object_size();
+        const auto st = sp.stats();
+        const auto use_count = st.use_count;
+        const auto memory = st.memory;
+        const auto unused = st.unused;
         const auto wasted_percent = memory ? unused * 100 / memory : 0;
         it = fmt::format_to(it,
                 "{:>5}  {:>5}   {:>5}  {:>5}  {:>5} {:>4}\n",
@@ -2081,6 +2779,12 @@ seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar
     it = fmt::format_to(it, "\nPage spans:\n");
     it = fmt::format_to(it, "index  size  free  used spans\n");
 
+    std::array<uint32_t, cpu_pages::nr_span_lists> span_cache_pages;
+    span_cache_pages.fill(0);
+    for (unsigned i = cpu_pages::span_cache_min_idx; i <= cpu_pages::span_cache_max_idx; i++) {
+        span_cache_pages[i] = get_cpu_mem().span_cache[i].count << i;
+    }
+
     std::array<uint32_t, cpu_pages::nr_span_lists> span_size_histogram;
     span_size_histogram.fill(0);
 
@@ -2103,6 +2807,8 @@ seastar::internal::log_buf::inserter_iterator do_dump_memory_diagnostics(seastar
             free_pages += span.span_size;
             front = span.link._next;
         }
+        // Cached spans are free, even though the buddy allocator sees them as used
+        free_pages += span_cache_pages[i];
         const auto total_spans = span_size_histogram[i];
         const auto total_pages = total_spans * (1 << i);
         it = fmt::format_to(it,
@@ -2637,10 +3343,12 @@ bool is_abort_on_allocation_failure() {
     return false;
 }
 
-reclaimer::reclaimer(std::function<reclaiming_result ()> reclaim, reclaimer_scope) {
+reclaimer::reclaimer(std::function<reclaiming_result ()> reclaim, reclaimer_scope, unsigned priority)
+    : _priority(priority) {
 }
 
-reclaimer::reclaimer(std::function<reclaiming_result (request)> reclaim, reclaimer_scope) {
+reclaimer::reclaimer(std::function<reclaiming_result (request)> reclaim, reclaimer_scope, unsigned priority)
+    : _priority(priority) {
 }
 
 reclaimer::~reclaimer() {
@@ -2649,10 +3357,14 @@ reclaimer::~reclaimer() {
 void set_reclaim_hook(std::function<void (std::function<void ()>)> hook) {
 }
 
+void set_background_reclaim_hook(std::function<void (std::function<void ()>)> hook) {
+}
+
 internal::numa_layout
 configure(std::vector<resource::memory> m, bool mbind,
         bool transparent_hugepages,
-        std::optional<std::string> hugepages_path) {
+        std::optional<std::string> hugepages_path,
+        size_t hugetlb_page_size) {
     return {};
 }
 
@@ -2660,7 +3372,53 @@ void configure_minimal()
 {}
 
 statistics stats() {
-    return statistics{0, 0, 0, 1 << 30, 1 << 30, 0, 0, 0, 0, 0, 0};
+    return statistics{0, 0, 0, 0, 1 << 30, 1 << 30, 0, 0, 0, 0, 0, 0};
+}
+
+memory_backing_stats backing_stats() noexcept {
+    return {};
+}
+
+size_t lend_free_memory(size_t, size_t) {
+    return 0;
+}
+
+size_t borrow_memory(size_t) {
+    return 0;
+}
+
+void set_memory_borrowing(bool) {
+}
+
+size_t lendable_memory() noexcept {
+    return 0;
+}
+
+namespace internal {
+
+uint64_t free_memory_shortages() noexcept {
+    return 0;
+}
+
+bool is_local(const void* p) noexcept {
+    return true;
+}
+
+}
+
+size_t scheduling_group_memory(scheduling_group) noexcept {
+    return 0;
+}
+
+void set_scheduling_group_memory_limit(scheduling_group, size_t, std::function<void ()>) {
+}
+
+unsigned small_pool_count() noexcept {
+    return 0;
+}
+
+small_pool_stats small_pool_statistics(unsigned idx) noexcept {
+    return {};
 }
 
 size_t free_memory() {
@@ -2683,6 +3441,18 @@ void set_min_free_pages(size_t pages) {
     // Ignore, reclaiming not supported for default allocator.
 }
 
+size_t high_free_memory() {
+    return 0;
+}
+
+void set_high_free_pages(size_t pages) {
+    // Ignore, reclaiming not supported for default allocator.
+}
+
+seastar::metrics::histogram reclaim_latency_histogram(reclaimer_scope) {
+    return {};
+}
+
 void set_large_allocation_warning_threshold(size_t) {
     // Ignore, not supported for default allocator.
 }
@@ -2724,4 +3494,143 @@ namespace seastar {
 
 /// \endcond
 
+namespace memory {
+
+arena::arena(size_t chunk_size) noexcept
+    : _next_chunk_size(std::clamp(align_up(chunk_size, page_size), page_size, max_chunk_size))
+{
+}
+
+arena::arena(arena&& x) noexcept
+    : _chunks(std::exchange(x._chunks, nullptr))
+    , _pos(std::exchange(x._pos, nullptr))
+    , _end(std::exchange(x._end, nullptr))
+    , _next_chunk_size(x._next_chunk_size)
+    , _memory(std::exchange(x._memory, 0))
+{
+}
+
+arena& arena::operator=(arena&& x) noexcept {
+    if (this != &x) {
+        this->~arena();
+        new (this) arena(std::move(x));
+    }
+    return *this;
+}
+
+arena::~arena() {
+    free_chunks(_chunks);
+}
+
+void arena::free_chunks(chunk* c) noexcept {
+    while (c) {
+        _memory -= c->size;
+        ::free(std::exchange(c, c->next));
+    }
+}
+
+void* arena::allocate_slow(size_t size, size_t align) {
+    auto header = align_up(sizeof(chunk), align);
+    // Objects too large to share a chunk get one of their own, so that they
+    // don't waste whatever is left of the current one
+    auto oversized = header + size > _next_chunk_size;
+    auto chunk_size = oversized ? align_up(header + size, page_size) : _next_chunk_size;
+    if (chunk_size < size) {
+        throw std::bad_alloc();
+    }
+    // Whole pages, so that the memory comes from spans rather than small pools
+    auto c = reinterpret_cast<chunk*>(::aligned_alloc(std::max(page_size, align), chunk_size));
+    if (!c) {
+        throw std::bad_alloc();
+    }
+    c->size = chunk_size;
+    _memory += chunk_size;
+    auto p = reinterpret_cast<char*>(c) + header;
+    if (oversized && _chunks) {
+        // Keep bumping in the current chunk
+        c->next = _chunks->next;
+        _chunks->next = c;
+        return p;
+    }
+    c->next = _chunks;
+    _chunks = c;
+    _pos = p + size;
+    _end = reinterpret_cast<char*>(c) + chunk_size;
+    _next_chunk_size = std::min(_next_chunk_size * 2, max_chunk_size);
+    return p;
+}
+
+void arena::reset() noexcept {
+    if (!_chunks) {
+        return;
+    }
+    free_chunks(std::exchange(_chunks->next, nullptr));
+    _pos = reinterpret_cast<char*>(_chunks + 1);
+}
+
+// Nodes the process may allocate memory on (its cpuset's mems), or
+// 0 if the kernel can't tell.
+static unsigned long allowed_numa_nodes() noexcept {
+    unsigned long nodemask = 0;
+    if (get_mempolicy(nullptr, &nodemask, std::numeric_limits<unsigned long>::digits, nullptr, MPOL_F_MEMS_ALLOWED) == -1) {
+        return 0;
+    }
+    return nodemask;
+}
+
+void* allocate_numa(size_t size, numa_policy policy) {
+    auto bytes = align_up(std::max<size_t>(size, 1), page_size);
+    auto p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    int mode = MPOL_LOCAL;
+    unsigned long nodemask = 0;
+    switch (policy.get_kind()) {
+    case numa_policy::kind::local:
+        break;
+    case numa_policy::kind::interleave:
+        nodemask = allowed_numa_nodes();
+        // With a single node (or none known) there is nothing to interleave
+        mode = std::popcount(nodemask) > 1 ? MPOL_INTERLEAVE : MPOL_LOCAL;
+        break;
+    case numa_policy::kind::node:
+        // mbind() only looks at maxnode - 1 bits
+        if (policy.node() >= std::numeric_limits<unsigned long>::digits - 1) {
+            ::munmap(p, bytes);
+            throw std::system_error(EINVAL, std::system_category(), format("Unsupported NUMA node {}", policy.node()));
+        }
+        mode = MPOL_PREFERRED;
+        nodemask = 1UL << policy.node();
+        break;
+    }
+    if (mbind(p, bytes, mode, mode == MPOL_LOCAL ? nullptr : &nodemask, std::numeric_limits<unsigned long>::digits, 0) == -1
+            && errno != ENOSYS) { // ENOSYS: no NUMA support, all memory is on the one node
+        auto err = errno;
+        ::munmap(p, bytes);
+        throw std::system_error(err, std::system_category(), "mbind");
+    }
+    // Fault the pages in now, so that placement is settled before the
+    // memory is shared, and readers don't take page faults
+    for (size_t off = 0; off < bytes; off += page_size) {
+        static_cast<volatile char*>(p)[off] = 0;
+    }
+    return p;
+}
+
+void free_numa(void* ptr, size_t size) noexcept {
+    if (ptr) {
+        ::munmap(ptr, align_up(std::max<size_t>(size, 1), page_size));
+    }
+}
+
+void* numa_memory_resource::do_allocate(size_t bytes, size_t alignment) {
+    if (alignment > page_size) {
+        throw std::bad_alloc();
+    }
+    return allocate_numa(bytes, _policy);
+}
+
+}
+
 }
@@ -302,8 +302,8 @@ std::unique_ptr<metric_groups_def> create_metric_groups() {
 metric_groups_impl::metric_groups_impl() {}
 
 metric_groups_impl::~metric_groups_impl() {
-    for (const auto& i : _registration) {
-        unregister_metric(i->info().id);
+    if (_impl) {
+        _impl->remove_registrations(_registration);
     }
 }
 
@@ -334,18 +334,33 @@ metric_groups_impl& metric_groups_impl::add_metric(group_name_type name, const m
     return *this;
 }
 
-metric_groups_impl& metric_groups_impl::add_group(group_name_type name, const std::vector<metric_definition>& l) {
-    for (auto i = l.begin(); i != l.end(); ++i) {
-        add_metric(name, *(i->_impl.get()));
+metric_groups_impl& metric_groups_impl::add_definitions(const group_name_type& name, std::span<const metric_definition> l) {
+    if (_impl == nullptr) {
+        _impl = get_local_impl();
+    }
+    // Marked first, for the metrics registered before a failure
+    _impl->dirty();
+    _registration.reserve(_registration.size() + l.size());
+    // The metrics of a group usually have the same labels, which are only
+    // internalized again when they differ from the previous metric's
+    internalized_labels_ref labels;
+    for (auto& md : l) {
+        auto& def = *md._impl;
+        if (!labels || *labels != def.labels) {
+            labels = _impl->internalize_labels(def.labels);
+        }
+        metric_id id(name, def.name, labels);
+        _registration.push_back(_impl->register_metric(id, def.type, def.f, def.d, def.enabled, def._skip_when_empty, def.aggregate_labels));
     }
     return *this;
 }
 
+metric_groups_impl& metric_groups_impl::add_group(group_name_type name, const std::vector<metric_definition>& l) {
+    return add_definitions(name, l);
+}
+
 metric_groups_impl& metric_groups_impl::add_group(group_name_type name, const std::initializer_list<metric_definition>& l) {
-    for (auto i = l.begin(); i != l.end(); ++i) {
-        add_metric(name, *i);
-    }
-    return *this;
+    return add_definitions(name, std::span<const metric_definition>(l.begin(), l.size()));
 }
 
 bool metric_id::operator<(
@@ -380,6 +395,7 @@ void impl::remove_registration(const metric_id& id) {
     if (i != get_value_map().end()) {
         auto j = i->second.find(id.labels());
         if (j != i->second.end()) {
+            j->second->set_family(nullptr);
             j->second = nullptr;
             i->second.erase(j);
         }
@@ -390,6 +406,26 @@ void impl::remove_registration(const metric_id& id) {
     }
 }
 
+void impl::remove_registrations(const metrics_registration& registrations) {
+    for (auto& rm : registrations) {
+        auto family = rm->family();
+        if (!family) {
+            continue;
+        }
+        rm->set_family(nullptr);
+        auto j = family->find(rm->info().id.labels());
+        if (j != family->end() && j->second == rm) {
+            family->erase(j);
+        }
+        if (family->empty()) {
+            _value_map.erase(_value_map.find(family->info().name));
+        }
+    }
+    if (!registrations.empty()) {
+        dirty();
+    }
+}
+
 void unregister_metric(const metric_id & id) {
     get_local_impl()->remove_registration(id);
 }
@@ -403,6 +439,7 @@ foreign_ptr<values_reference> get_values() {
     auto& res = *(res_ref.get());
     auto& mv = res.values;
     res.metadata = get_local_impl()->metadata();
+    res.metadata_generation = get_local_impl()->metadata_generation();
     auto & functions = get_local_impl()->functions();
     for (auto&& i : functions) {
         value_vector values;
@@ -414,6 +451,50 @@ foreign_ptr<values_reference> get_values() {
     return res_ref;
 }
 
+foreign_ptr<values_reference> get_aggregated_values() {
+    auto& aggregation = get_local_impl()->aggregation();
+    shared_ptr<values_copy> res_ref = ::seastar::make_shared<values_copy>();
+    auto& res = *(res_ref.get());
+    auto& mv = res.values;
+    res.metadata = aggregation.metadata;
+    res.metadata_generation = aggregation.generation;
+    auto& metadata = *get_local_impl()->metadata();
+    auto& functions = get_local_impl()->functions();
+    for (size_t f = 0; f < functions.size(); ++f) {
+        auto& slots = aggregation.slots[f];
+        value_vector values;
+        if (slots.empty()) {
+            for (auto&& v : functions[f]) {
+                values.emplace_back(v());
+            }
+            mv.emplace_back(std::move(values));
+            continue;
+        }
+        enum class state : uint8_t { unset, empty, set };
+        auto& metrics = metadata[f].metrics;
+        values.resize(aggregation.metadata->at(f).metrics.size());
+        std::vector<state> states(values.size(), state::unset);
+        for (size_t i = 0; i < slots.size(); ++i) {
+            auto v = functions[f][i]();
+            auto& value = values[slots[i]];
+            auto& st = states[slots[i]];
+            if (metrics[i].should_skip_when_empty() && v.is_empty()) {
+                // only stands for the series if nothing else does
+                if (st == state::unset) {
+                    value = std::move(v);
+                    st = state::empty;
+                }
+            } else if (st != state::set) {
+                value = std::move(v);
+                st = state::set;
+            } else {
+                value += v;
+            }
+        }
+        mv.emplace_back(std::move(values));
+    }
+    return res_ref;
+}
 
 instance_id_type shard() {
     return to_sstring(this_shard_id());
@@ -459,6 +540,7 @@ void impl::update_metrics_if_needed() {
         // Maybe we didn't use all the original size
         _current_metrics.resize(i);
         _metadata = mt_ref;
+        ++_metadata_generation;
         _dirty = false;
 
         gc_internalized_labels();
@@ -470,40 +552,98 @@ shared_ptr<metric_metadata> impl::metadata() {
     return _metadata;
 }
 
+const series_aggregation& impl::aggregation() {
+    update_metrics_if_needed();
+    if (_aggregation.metadata && _aggregation.generation == _metadata_generation) {
+        return _aggregation;
+    }
+    auto mt_ref = ::seastar::make_shared<metric_metadata>();
+    auto& mt = *mt_ref;
+    std::vector<std::vector<uint32_t>> slots(_metadata->size());
+    mt.reserve(_metadata->size());
+    for (size_t f = 0; f < _metadata->size(); ++f) {
+        auto& family = (*_metadata)[f];
+        metric_metadata_fifo metrics;
+        if (family.mf.aggregate_labels.empty()) {
+            for (auto& m : family.metrics) {
+                metrics.emplace_back(m.id(), m.should_skip_when_empty());
+            }
+            mt.emplace_back(family.mf, std::move(metrics));
+            continue;
+        }
+        std::map<labels_type, uint32_t> index;
+        std::vector<labels_type> labels;
+        // an aggregated series is only skipped when empty if all of its series are
+        std::vector<bool> skip;
+        slots[f].reserve(family.metrics.size());
+        for (auto& m : family.metrics) {
+            auto l = m.labels();
+            for (auto& name : family.mf.aggregate_labels) {
+                l.erase(name);
+            }
+            auto [it, inserted] = index.try_emplace(l, labels.size());
+            if (inserted) {
+                labels.push_back(std::move(l));
+                skip.push_back(true);
+            }
+            if (!m.should_skip_when_empty()) {
+                skip[it->second] = false;
+            }
+            slots[f].push_back(it->second);
+        }
+        auto& first = family.metrics.front();
+        for (size_t i = 0; i < labels.size(); ++i) {
+            metrics.emplace_back(metric_id(first.group_name(), first.name(), internalize_labels(std::move(labels[i]))),
+                    skip_when_empty(skip[i]));
+        }
+        mt.emplace_back(family.mf, std::move(metrics));
+    }
+    _aggregation.metadata = std::move(mt_ref);
+    _aggregation.slots = std::move(slots);
+    _aggregation.generation = _metadata_generation;
+    return _aggregation;
+}
+
 std::vector<std::deque<metric_function>>& impl::functions() {
     update_metrics_if_needed();
     return _current_metrics;
 }
 
 register_ref impl::add_registration(const metric_id& id, const metric_type& type, metric_function f, const description& d, bool enabled, skip_when_empty skip, const std::vector<std::string>& aggregate_labels) {
-    auto rm = ::seastar::make_shared<registered_metric>(id, f, enabled, skip);
+    auto rm = register_metric(id, type, std::move(f), d, enabled, skip, aggregate_labels);
+    dirty();
+    return rm;
+}
+
+register_ref impl::register_metric(const metric_id& id, const metric_type& type, metric_function f, const description& d, bool enabled, skip_when_empty skip, const std::vector<std::string>& aggregate_labels) {
+    auto rm = ::seastar::make_shared<registered_metric>(id, std::move(f), enabled, skip);
     for (auto&& rl : _relabel_configs) {
         apply_relabeling(rl, rm->info());
     }
 
     sstring name = id.full_name();
-    if (_value_map.find(name) != _value_map.end()) {
-        auto& metric = _value_map[name];
+    auto [it, inserted] = _value_map.try_emplace(name);
+    auto& metric = it->second;
+    if (!inserted) {
         if (metric.find(rm->info().id.labels()) != metric.end()) {
             throw double_registration("registering metrics twice for metrics: " + name);
         }
         if (metric.info().type != type.base_type) {
             throw std::runtime_error("registering metrics " + name + " registered with different type.");
         }
-        metric[rm->info().id.internalized_labels()] = rm;
         for (auto&& i : rm->info().id.labels()) {
             _labels.insert(i.first);
         }
     } else {
-        _value_map[name].info().type = type.base_type;
-        _value_map[name].info().d = d;
-        _value_map[name].info().inherit_type = type.type_name;
-        _value_map[name].info().name = id.full_name();
-        _value_map[name].info().aggregate_labels = aggregate_labels;
-        impl::update_aggregate(_value_map[name].info());
-        _value_map[name][rm->info().id.internalized_labels()] = rm;
+        metric.info().type = type.base_type;
+        metric.info().d = d;
+        metric.info().inherit_type = type.type_name;
+        metric.info().name = std::move(name);
+        metric.info().aggregate_labels = aggregate_labels;
+        impl::update_aggregate(metric.info());
     }
-    dirty();
+    metric[rm->info().id.internalized_labels()] = rm;
+    rm->set_family(&metric);
 
     return rm;
 }
@@ -556,6 +696,7 @@ future<metric_relabeling_result> impl::set_relabel_configs(const std::vector<rel
 
 void impl::set_metric_family_configs(const std::vector<metric_family_config>& family_config) {
     _metric_family_configs = family_config;
+    _aggregation = {};
     for (auto& [name, family] : _value_map) {
         for  (const auto& fc : family_config) {
             if (fc.name == name || fc.regex_name.match(name)) {
@@ -603,10 +744,58 @@ relabel_config::relabel_action relabel_config_action(const std::string& action)
     return relabel_config::relabel_action::replace;
 }
 
+// Merges the buckets of b into a, both sparse, in the coarser of their schemas
+static void add_sparse(native_histogram_info& a, const native_histogram_info& b) {
+    if (a.zero_threshold != b.zero_threshold) {
+        throw std::out_of_range("Trying to add sparse histograms with different zero thresholds");
+    }
+    auto schema = std::min(a.schema, b.schema);
+    // bucket i of schema s is in bucket ((i - 1) >> d) + 1 of schema s - d
+    auto downscaled = [schema] (int32_t s, const native_histogram_bucket& bucket) {
+        return native_histogram_bucket{((bucket.index - 1) >> (s - schema)) + 1, bucket.count};
+    };
+    std::vector<native_histogram_bucket> res;
+    res.reserve(a.sparse_buckets.size() + b.sparse_buckets.size());
+    auto add = [&res] (native_histogram_bucket bucket) {
+        if (!res.empty() && res.back().index == bucket.index) {
+            res.back().count += bucket.count;
+        } else {
+            res.push_back(bucket);
+        }
+    };
+    auto i = a.sparse_buckets.begin();
+    auto j = b.sparse_buckets.begin();
+    // downscaling keeps the order of the buckets of each histogram
+    while (i != a.sparse_buckets.end() || j != b.sparse_buckets.end()) {
+        if (j == b.sparse_buckets.end()
+                || (i != a.sparse_buckets.end() && downscaled(a.schema, *i).index <= downscaled(b.schema, *j).index)) {
+            add(downscaled(a.schema, *i++));
+        } else {
+            add(downscaled(b.schema, *j++));
+        }
+    }
+    a.sparse_buckets = std::move(res);
+    a.schema = schema;
+    a.zero_count += b.zero_count;
+}
+
 histogram& histogram::operator+=(const histogram& c) {
     if (c.sample_count == 0) {
         return *this;
     }
+    if (is_sparse() || c.is_sparse()) {
+        if (sample_count == 0) {
+            *this = c;
+            return *this;
+        }
+        if (!is_sparse() || !c.is_sparse()) {
+            throw std::out_of_range("Trying to add a sparse histogram and a histogram with buckets");
+        }
+        add_sparse(*native_histogram, *c.native_histogram);
+        sample_count += c.sample_count;
+        sample_sum += c.sample_sum;
+        return *this;
+    }
     for (size_t i = 0; i < c.buckets.size(); i++) {
         if (buckets.size() <= i) {
             buckets.push_back(c.buckets[i]);
@@ -59,6 +59,7 @@ static void log_error_and_backtrace(logger& logger, const Message& msg) noexcept
 void seastar::on_internal_error(logger& logger, std::string_view msg) {
     log_error_and_backtrace(logger, msg);
     if (abort_on_internal_error.load()) {
+        logger::flush_async();
         abort();
     } else {
         throw_with_backtrace<std::runtime_error>(std::string(msg));
@@ -68,6 +69,7 @@ void seastar::on_internal_error(logger& logger, std::string_view msg) {
 void seastar::on_internal_error(logger& logger, std::exception_ptr ex) {
     log_error_and_backtrace(logger, ex);
     if (abort_on_internal_error.load()) {
+        logger::flush_async();
         abort();
     } else {
         std::rethrow_exception(std::move(ex));
@@ -77,11 +79,13 @@ void seastar::on_internal_error(logger& logger, std::exception_ptr ex) {
 void seastar::on_internal_error_noexcept(logger& logger, std::string_view msg) noexcept {
     log_error_and_backtrace(logger, msg);
     if (abort_on_internal_error.load()) {
+        logger::flush_async();
         abort();
     }
 }
 
 void seastar::on_fatal_internal_error(logger& logger, std::string_view msg) noexcept {
     log_error_and_backtrace(logger, msg);
+    logger::flush_async();
     abort();
 }
@@ -0,0 +1,560 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <ranges>
+#include <string_view>
+#include <vector>
+#include <fmt/format.h>
+
+#include <seastar/core/otlp.hh>
+#include <seastar/core/abort_source.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/metrics_api.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/with_scheduling_group.hh>
+#include <seastar/coroutine/maybe_yield.hh>
+#include <seastar/http/request.hh>
+#include <seastar/json/stream_writer.hh>
+#include <seastar/util/log.hh>
+#include <seastar/util/short_streams.hh>
+
+namespace seastar {
+
+extern seastar::logger seastar_logger;
+
+namespace otlp {
+
+namespace mi = metrics::impl;
+
+namespace {
+
+struct family {
+    sstring description;
+    mi::data_type type;
+    std::map<mi::labels_type, mi::metric_value> series;
+};
+
+// The values of the metrics of all shards, by family name
+using snapshot = std::map<sstring, family>;
+
+sstring unix_nano(std::chrono::system_clock::time_point t) {
+    return to_sstring(std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count());
+}
+
+// 64 bit integers are strings in the JSON encoding of protobuf,
+sstring int64_value(int64_t v) {
+    return to_sstring(v);
+}
+
+// and doubles JSON can't represent
+void write_double(json::stream_writer& w, double v) {
+    if (std::isnan(v)) {
+        w.value("NaN");
+    } else if (std::isinf(v)) {
+        w.value(v > 0 ? "Infinity" : "-Infinity");
+    } else {
+        w.value(v);
+    }
+}
+
+void write_attributes(json::stream_writer& w, const std::map<sstring, sstring>& attributes) {
+    w.begin_array();
+    for (auto& [key, value] : attributes) {
+        w.begin_object();
+        w.key("key");
+        w.value(std::string_view(key));
+        w.key("value");
+        w.begin_object();
+        w.key("stringValue");
+        w.value(std::string_view(value));
+        w.end_object();
+        w.end_object();
+    }
+    w.end_array();
+}
+
+// The counts of the buckets of a histogram with explicit buckets, not
+// cumulative, the last one for the values above the last bound
+std::vector<uint64_t> bucket_counts(const metrics::histogram& h) {
+    std::vector<uint64_t> res;
+    uint64_t last = 0;
+    for (auto& b : h.buckets) {
+        if (std::isinf(b.upper_bound)) {
+            break;
+        }
+        res.push_back(b.count - last);
+        last = b.count;
+    }
+    res.push_back(h.sample_count - last);
+    return res;
+}
+
+bool same_bounds(const metrics::histogram& a, const metrics::histogram& b) {
+    return std::ranges::equal(a.buckets, b.buckets, [] (auto& x, auto& y) {
+        return x.upper_bound == y.upper_bound;
+    });
+}
+
+void write_histogram_point(json::stream_writer& w, const metrics::histogram& h, const metrics::histogram* prev) {
+    if (prev && (prev->sample_count > h.sample_count || !same_bounds(*prev, h))) {
+        // reset, or the buckets changed
+        prev = nullptr;
+    }
+    auto counts = bucket_counts(h);
+    if (prev) {
+        auto prev_counts = bucket_counts(*prev);
+        for (size_t i = 0; i < counts.size(); ++i) {
+            counts[i] -= std::min(counts[i], prev_counts[i]);
+        }
+    }
+    w.key("count");
+    w.value(int64_value(h.sample_count - (prev ? prev->sample_count : 0)));
+    w.key("sum");
+    write_double(w, h.sample_sum - (prev ? prev->sample_sum : 0));
+    w.key("bucketCounts");
+    w.begin_array();
+    for (auto c : counts) {
+        w.value(int64_value(c));
+    }
+    w.end_array();
+    w.key("explicitBounds");
+    w.begin_array();
+    for (size_t i = 0; i + 1 < counts.size(); ++i) {
+        write_double(w, h.buckets[i].upper_bound);
+    }
+    w.end_array();
+}
+
+// The buckets of a sparse histogram in the given coarser or equal schema
+std::vector<metrics::native_histogram_bucket> downscaled(const metrics::native_histogram_info& nh, int32_t schema) {
+    std::vector<metrics::native_histogram_bucket> res;
+    for (auto b : nh.sparse_buckets) {
+        b.index = ((b.index - 1) >> (nh.schema - schema)) + 1;
+        if (!res.empty() && res.back().index == b.index) {
+            res.back().count += b.count;
+        } else {
+            res.push_back(b);
+        }
+    }
+    return res;
+}
+
+// the buckets of h, less those of prev, or nullopt if prev is not an earlier value of h
+std::optional<std::vector<metrics::native_histogram_bucket>> sparse_delta(const metrics::histogram& h, const metrics::histogram& prev) {
+    auto& nh = *h.native_histogram;
+    auto& pnh = *prev.native_histogram;
+    if (prev.sample_count > h.sample_count || pnh.zero_count > nh.zero_count
+            || pnh.zero_threshold != nh.zero_threshold || pnh.schema < nh.schema) {
+        return std::nullopt;
+    }
+    auto prev_buckets = downscaled(pnh, nh.schema);
+    std::vector<metrics::native_histogram_bucket> res;
+    auto p = prev_buckets.begin();
+    for (auto b : nh.sparse_buckets) {
+        if (p != prev_buckets.end() && p->index < b.index) {
+            return std::nullopt;
+        }
+        if (p != prev_buckets.end() && p->index == b.index) {
+            if (p->count > b.count) {
+                return std::nullopt;
+            }
+            b.count -= p->count;
+            ++p;
+        }
+        res.push_back(b);
+    }
+    if (p != prev_buckets.end()) {
+        return std::nullopt;
+    }
+    return res;
+}
+
+void write_exponential_histogram_point(json::stream_writer& w, const metrics::histogram& h, const metrics::histogram* prev) {
+    auto& nh = *h.native_histogram;
+    std::optional<std::vector<metrics::native_histogram_bucket>> delta;
+    if (prev && prev->is_sparse()) {
+        delta = sparse_delta(h, *prev);
+    }
+    if (!delta) {
+        // reset
+        prev = nullptr;
+    }
+    auto& buckets = delta ? *delta : nh.sparse_buckets;
+    w.key("count");
+    w.value(int64_value(h.sample_count - (prev ? prev->sample_count : 0)));
+    w.key("sum");
+    write_double(w, h.sample_sum - (prev ? prev->sample_sum : 0));
+    w.key("scale");
+    w.value(nh.schema);
+    w.key("zeroCount");
+    w.value(int64_value(nh.zero_count - (prev ? prev->native_histogram->zero_count : 0)));
+    w.key("zeroThreshold");
+    write_double(w, nh.zero_threshold);
+    auto first = std::ranges::find_if(buckets, [] (auto& b) { return b.count != 0; });
+    auto last = std::ranges::find_if(buckets.rbegin(), buckets.rend(), [] (auto& b) { return b.count != 0; }).base();
+    if (first < last) {
+        // bucket i of OpenTelemetry is bucket i + 1 of Prometheus
+        w.key("positive");
+        w.begin_object();
+        w.key("offset");
+        w.value(first->index - 1);
+        w.key("bucketCounts");
+        w.begin_array();
+        auto index = first->index;
+        for (auto b = first; b != last; ++b, ++index) {
+            for (; index < b->index; ++index) {
+                w.value(int64_value(0));
+            }
+            w.value(int64_value(b->count));
+        }
+        w.end_array();
+        w.end_object();
+    }
+}
+
+void write_summary_point(json::stream_writer& w, const metrics::histogram& h) {
+    w.key("count");
+    w.value(int64_value(h.sample_count));
+    w.key("sum");
+    write_double(w, h.sample_sum);
+    w.key("quantileValues");
+    w.begin_array();
+    for (auto& b : h.buckets) {
+        w.begin_object();
+        w.key("quantile");
+        write_double(w, b.upper_bound);
+        w.key("value");
+        w.value(double(b.count));
+        w.end_object();
+    }
+    w.end_array();
+}
+
+}
+
+class exporter::impl {
+    config _cfg;
+    http::experimental::client _client;
+    scheduling_group _sg;
+    gate _gate;
+    abort_source _as;
+    semaphore _push_sem{1};
+    std::optional<future<>> _loop;
+    std::chrono::system_clock::time_point _start_time = std::chrono::system_clock::now();
+    // the time and, for delta temporality, the values of the last successful export
+    std::chrono::system_clock::time_point _last_time = _start_time;
+    snapshot _last;
+
+    future<snapshot> collect();
+    future<> write(output_stream<char>& out, const snapshot& current, std::chrono::system_clock::time_point now);
+    future<> run();
+public:
+    template <typename... Args>
+    impl(config cfg, Args&&... client_args)
+        : _cfg(std::move(cfg))
+        , _client(std::forward<Args>(client_args)...)
+        , _sg(_cfg.sched_group.value_or(current_scheduling_group()))
+    {}
+
+    void start() {
+        _loop = with_scheduling_group(_sg, [this] {
+            return run();
+        });
+    }
+    future<> push();
+    future<> stop();
+};
+
+future<snapshot> exporter::impl::collect() {
+    std::vector<foreign_ptr<mi::values_reference>> values(smp::count);
+    co_await parallel_for_each(std::views::iota(0u, smp::count), [this, &values] (unsigned cpu) {
+        return smp::submit_to(cpu, [sg = _sg, aggregate = _cfg.aggregate] {
+            return with_scheduling_group(sg, [aggregate] {
+                return aggregate ? mi::get_aggregated_values() : mi::get_values();
+            });
+        }).then([&values, cpu] (foreign_ptr<mi::values_reference> res) {
+            values[cpu] = std::move(res);
+        });
+    });
+
+    snapshot res;
+    for (auto& shard_values : values) {
+        auto& metadata = *shard_values->metadata;
+        for (size_t i = 0; i < metadata.size(); ++i) {
+            auto& mf = metadata[i].mf;
+            auto& f = res[mf.name];
+            f.description = mf.d.str();
+            f.type = mf.type;
+            const mi::metric_metadata_fifo& metrics = metadata[i].metrics;
+            const mi::value_vector& family_values = shard_values->values[i];
+            for (size_t j = 0; j < family_values.size(); ++j) {
+                auto& value = family_values[j];
+                if (metrics[j].should_skip_when_empty() && value.is_empty()) {
+                    continue;
+                }
+                mi::labels_type labels;
+                for (auto& [key, label_value] : metrics[j].labels()) {
+                    if (std::string_view(key).starts_with("__")
+                            || (_cfg.aggregate && std::ranges::find(mf.aggregate_labels, std::string_view(key)) != mf.aggregate_labels.end())) {
+                        continue;
+                    }
+                    labels.emplace(key, label_value);
+                }
+                auto [it, inserted] = f.series.try_emplace(std::move(labels), value);
+                if (!inserted) {
+                    it->second += value;
+                }
+                co_await coroutine::maybe_yield();
+            }
+        }
+    }
+    co_return res;
+}
+
+future<> exporter::impl::write(output_stream<char>& out, const snapshot& current, std::chrono::system_clock::time_point now) {
+    bool delta = _cfg.temporality == aggregation_temporality::delta;
+    auto start_time = unix_nano(delta ? _last_time : _start_time);
+    auto time = unix_nano(now);
+    json::stream_writer w(out);
+    w.begin_object();
+    w.key("resourceMetrics");
+    w.begin_array();
+    w.begin_object();
+    w.key("resource");
+    w.begin_object();
+    w.key("attributes");
+    write_attributes(w, _cfg.resource_attributes);
+    w.end_object();
+    w.key("scopeMetrics");
+    w.begin_array();
+    w.begin_object();
+    w.key("scope");
+    w.begin_object();
+    w.key("name");
+    w.value("seastar");
+    w.end_object();
+    w.key("metrics");
+    w.begin_array();
+    for (auto& [name, f] : current) {
+        if (f.series.empty()) {
+            continue;
+        }
+        const family* last = nullptr;
+        if (delta) {
+            if (auto it = _last.find(name); it != _last.end()) {
+                last = &it->second;
+            }
+        }
+        bool sparse = f.type == mi::data_type::HISTOGRAM && f.series.begin()->second.get_histogram().is_sparse();
+        w.begin_object();
+        w.key("name");
+        w.value(fmt::format("{}_{}", _cfg.prefix, name));
+        if (!f.description.empty()) {
+            w.key("description");
+            w.value(std::string_view(f.description));
+        }
+        switch (f.type) {
+        case mi::data_type::GAUGE:
+            w.key("gauge");
+            break;
+        case mi::data_type::COUNTER:
+        case mi::data_type::REAL_COUNTER:
+            w.key("sum");
+            break;
+        case mi::data_type::HISTOGRAM:
+            w.key(sparse ? "exponentialHistogram" : "histogram");
+            break;
+        case mi::data_type::SUMMARY:
+            w.key("summary");
+            break;
+        }
+        w.begin_object();
+        if (f.type != mi::data_type::GAUGE && f.type != mi::data_type::SUMMARY) {
+            w.key("aggregationTemporality");
+            w.value(int(_cfg.temporality));
+        }
+        if (f.type == mi::data_type::COUNTER || f.type == mi::data_type::REAL_COUNTER) {
+            w.key("isMonotonic");
+            w.value(true);
+        }
+        w.key("dataPoints");
+        w.begin_array();
+        for (auto& [labels, value] : f.series) {
+            const mi::metric_value* prev = nullptr;
+            if (last) {
+                if (auto it = last->series.find(labels); it != last->series.end() && it->second.type() == value.type()) {
+                    prev = &it->second;
+                }
+            }
+            if (f.type == mi::data_type::HISTOGRAM && value.get_histogram().is_sparse() != sparse) {
+                // a family is either exponential or explicit
+                continue;
+            }
+            w.begin_object();
+            w.key("attributes");
+            write_attributes(w, labels);
+            w.key("startTimeUnixNano");
+            w.value(std::string_view(start_time));
+            w.key("timeUnixNano");
+            w.value(std::string_view(time));
+            switch (value.type()) {
+            case mi::data_type::GAUGE:
+                w.key("asDouble");
+                write_double(w, value.d());
+                break;
+            case mi::data_type::COUNTER: {
+                if (!(std::abs(value.d()) < 0x1p63)) {
+                    // not an int64
+                    w.key("asDouble");
+                    write_double(w, value.d());
+                    break;
+                }
+                auto v = value.i();
+                if (prev && !(std::abs(prev->d()) < 0x1p63)) {
+                    prev = nullptr;
+                }
+                if (prev && prev->i() <= v) {
+                    v -= prev->i();
+                }
+                w.key("asInt");
+                w.value(int64_value(v));
+                break;
+            }
+            case mi::data_type::REAL_COUNTER: {
+                auto v = value.d();
+                if (prev && prev->d() <= v) {
+                    v -= prev->d();
+                }
+                w.key("asDouble");
+                write_double(w, v);
+                break;
+            }
+            case mi::data_type::HISTOGRAM: {
+                auto prev_histogram = prev ? &prev->get_histogram() : nullptr;
+                if (sparse) {
+                    write_exponential_histogram_point(w, value.get_histogram(), prev_histogram);
+                } else {
+                    write_histogram_point(w, value.get_histogram(), prev_histogram);
+                }
+                break;
+            }
+            case mi::data_type::SUMMARY:
+                write_summary_point(w, value.get_histogram());
+                break;
+            }
+            w.end_object();
+            co_await w.maybe_flush();
+            co_await coroutine::maybe_yield();
+        }
+        w.end_array();
+        w.end_object();
+        w.end_object();
+    }
+    w.end_array();
+    w.end_object();
+    w.end_array();
+    w.end_object();
+    w.end_array();
+    w.end_object();
+    co_await w.flush();
+}
+
+future<> exporter::impl::push() {
+    auto holder = _gate.hold();
+    auto units = co_await get_units(_push_sem, 1);
+    auto now = std::chrono::system_clock::now();
+    auto current = co_await collect();
+    auto req = http::request::make("POST", _cfg.host, _cfg.path);
+    req.write_body("json", [this, &current, now] (output_stream<char>& out) {
+        return write(out, current, now);
+    });
+    co_await _client.make_request(std::move(req), [] (const http::reply&, input_stream<char>&& body) {
+        return do_with(std::move(body), [] (input_stream<char>& body) {
+            return util::skip_entire_stream(body);
+        });
+    }, http::reply::status_type::ok, &_as);
+    _last_time = now;
+    if (_cfg.temporality == aggregation_temporality::delta) {
+        _last = std::move(current);
+    }
+}
+
+future<> exporter::impl::run() {
+    while (!_as.abort_requested()) {
+        try {
+            co_await sleep_abortable(_cfg.interval, _as);
+        } catch (const sleep_aborted&) {
+            break;
+        }
+        try {
+            co_await push();
+        } catch (...) {
+            if (!_as.abort_requested()) {
+                seastar_logger.warn("otlp: failed to export metrics: {}", std::current_exception());
+            }
+        }
+    }
+}
+
+future<> exporter::impl::stop() {
+    _as.request_abort();
+    if (_loop) {
+        co_await std::exchange(_loop, std::nullopt).value();
+    }
+    co_await _gate.close();
+    co_await _client.close();
+}
+
+exporter::exporter(socket_address addr, config cfg)
+    : _impl(std::make_unique<impl>(std::move(cfg), addr))
+{}
+
+exporter::exporter(socket_address addr, shared_ptr<tls::certificate_credentials> creds, config cfg)
+    : _impl(std::make_unique<impl>(cfg, addr, std::move(creds), cfg.host))
+{}
+
+exporter::exporter(std::unique_ptr<http::experimental::connection_factory> f, config cfg)
+    : _impl(std::make_unique<impl>(std::move(cfg), std::move(f)))
+{}
+
+exporter::~exporter() = default;
+
+void exporter::start() {
+    _impl->start();
+}
+
+future<> exporter::push() {
+    return _impl->push();
+}
+
+future<> exporter::stop() {
+    return _impl->stop();
+}
+
+}
+
+}
@@ -0,0 +1,143 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <cstdint>
+#include <cstring>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <emmintrin.h>
+#endif
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include "core/pmem.hh"
+#endif
+
+namespace seastar::internal {
+
+#if defined(__x86_64__)
+
+namespace {
+
+constexpr size_t cache_line_size = 64;
+
+enum class write_back { clflush, clflushopt, clwb };
+
+write_back detect_write_back() noexcept {
+    unsigned eax, ebx, ecx, edx;
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        if (ebx & (1u << 24)) {
+            return write_back::clwb;
+        }
+        if (ebx & (1u << 23)) {
+            return write_back::clflushopt;
+        }
+    }
+    return write_back::clflush;
+}
+
+const write_back write_back_insn = detect_write_back();
+
+// Spelled as bytes, not to build the whole file for CPUs which have them
+void write_back_line(const char* p) noexcept {
+    switch (write_back_insn) {
+    case write_back::clwb:
+        // clwb (%rax)
+        asm volatile(".byte 0x66, 0x0f, 0xae, 0x30" : : "a"(p) : "memory");
+        break;
+    case write_back::clflushopt:
+        // clflushopt (%rax)
+        asm volatile(".byte 0x66, 0x0f, 0xae, 0x38" : : "a"(p) : "memory");
+        break;
+    case write_back::clflush:
+        asm volatile("clflush (%0)" : : "r"(p) : "memory");
+        break;
+    }
+}
+
+void store_and_write_back(char* dst, const char* src, size_t len) noexcept {
+    if (!len) {
+        return;
+    }
+    std::memcpy(dst, src, len);
+    auto line = reinterpret_cast<uintptr_t>(dst) & ~(cache_line_size - 1);
+    auto end = reinterpret_cast<uintptr_t>(dst) + len;
+    for (; line < end; line += cache_line_size) {
+        write_back_line(reinterpret_cast<const char*>(line));
+    }
+}
+
+}
+
+bool pmem_supported() noexcept {
+    return true;
+}
+
+void pmem_copy(void* dst, const void* src, size_t len) noexcept {
+    auto d = static_cast<char*>(dst);
+    auto s = static_cast<const char*>(src);
+    // Up to a few lines, writing them back is cheaper than going around the caches
+    if (len < 4 * cache_line_size) {
+        store_and_write_back(d, s, len);
+        _mm_sfence();
+        return;
+    }
+    size_t head = -reinterpret_cast<uintptr_t>(d) & (cache_line_size - 1);
+    store_and_write_back(d, s, head);
+    d += head;
+    s += head;
+    len -= head;
+    for (; len >= cache_line_size; d += cache_line_size, s += cache_line_size, len -= cache_line_size) {
+        auto in = reinterpret_cast<const __m128i*>(s);
+        auto out = reinterpret_cast<__m128i*>(d);
+        auto a = _mm_loadu_si128(in);
+        auto b = _mm_loadu_si128(in + 1);
+        auto c = _mm_loadu_si128(in + 2);
+        auto e = _mm_loadu_si128(in + 3);
+        _mm_stream_si128(out, a);
+        _mm_stream_si128(out + 1, b);
+        _mm_stream_si128(out + 2, c);
+        _mm_stream_si128(out + 3, e);
+    }
+    store_and_write_back(d, s, len);
+    // Orders the non-temporal stores and the write backs before what follows
+    _mm_sfence();
+}
+
+#else
+
+bool pmem_supported() noexcept {
+    return false;
+}
+
+void pmem_copy(void* dst, const void* src, size_t len) noexcept {
+    std::memcpy(dst, src, len);
+}
+
+#endif
+
+}
@@ -0,0 +1,39 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace seastar::internal {
+
+// Whether pmem_copy() can make stores durable on this machine: it needs the
+// cache line write back instructions of x86-64
+bool pmem_supported() noexcept;
+
+// Copies len bytes to a MAP_SYNC mapping of a file on a DAX filesystem, and
+// returns once they reached the persistence domain of the platform. Whole
+// cache lines are written with non-temporal stores, which bypass the CPU
+// caches, the partial ones at the ends with regular stores, which are then
+// written back with clwb (or clflushopt, or clflush on older CPUs).
+void pmem_copy(void* dst, const void* src, size_t len) noexcept;
+
+}
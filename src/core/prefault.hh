@@ -29,6 +29,7 @@
 #include <seastar/core/resource.hh>
 #include <seastar/core/task.hh>
 #include <seastar/core/memory.hh>
+#include <seastar/core/metrics_registration.hh>
 
 namespace seastar::alien {
 
@@ -38,18 +39,38 @@ class instance;
 
 namespace seastar::internal {
 
+// Splits the ranges of a node into up to \c nr_threads shares of about
+// the same size, cut at addresses that are multiples of \c batch_size
+std::vector<std::vector<memory::internal::memory_range>>
+split_prefault_ranges(const std::vector<memory::internal::memory_range>& ranges, size_t nr_threads, size_t batch_size);
+
 // Responsible for pre-faulting in memory so soft page fault latency doesn't impact applications
+//
+// Each NUMA node's memory is split between up to max_threads_per_node
+// threads, pinned to the node's cpus so that the pages are faulted by
+// (and zeroed on) the node they belong to.
 class memory_prefaulter {
+    static constexpr unsigned max_threads_per_node = 8;
+    // don't start a thread for less than this
+    static constexpr size_t min_bytes_per_thread = size_t(1) << 30;
+
     std::atomic<bool> _stop_request = false;
     std::vector<posix_thread> _worker_threads;
-    // Keep this in object scope to avoid allocating in worker thread
-    std::unordered_map<unsigned, std::vector<memory::internal::memory_range>> _layout_by_node_id;
+    // Keep this in object scope to avoid allocating in worker thread;
+    // the ranges of each worker thread
+    std::vector<std::vector<memory::internal::memory_range>> _work;
     std::atomic<unsigned> _active_threads = 0;
+    size_t _total_bytes = 0;
+    std::atomic<size_t> _prefaulted_bytes = 0;
+    std::chrono::steady_clock::time_point _start;
+    metrics::metric_groups _metrics;
 public:
     explicit memory_prefaulter(alien::instance& alien, const resource::resources& res, memory::internal::numa_layout layout);
     ~memory_prefaulter();
+    // Unregisters the metrics, before the reactor goes away
+    void stop_metrics() noexcept;
 private:
-    void work(std::vector<memory::internal::memory_range>& ranges, size_t page_size, std::optional<size_t> huge_page_size_opt);
+    void work(std::vector<memory::internal::memory_range>& ranges, size_t page_size, size_t batch_size);
     void join_threads() noexcept;
 };
 
@@ -25,6 +25,7 @@
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include "proto/metrics2.pb.h"
+#include "proto/profile.pb.h"
 #include <sstream>
 
 #include <seastar/core/metrics_api.hh>
@@ -37,10 +38,23 @@
 #include <boost/range/combine.hpp>
 #include <seastar/core/thread.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/internal/cpu_profiler.hh>
+#include <seastar/core/internal/task_tracer.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/http/exception.hh>
 #include <seastar/util/assert.hh>
+#include <seastar/util/backtrace.hh>
+#include <boost/lexical_cast.hpp>
+#include <fcntl.h>
+#include <algorithm>
 #include <ranges>
 #include <regex>
 #include <string_view>
+#include <unordered_set>
 
 namespace seastar {
 
@@ -160,6 +174,42 @@ static void fill_native_type_histogram(const metrics::histogram& h, ::io::promet
     }
 }
 
+/*!
+ * Fill a sparse native histogram, see metrics::histogram::is_sparse().
+ *
+ * Each bucket-span starts at the bucket that follows the previous span
+ * plus its offset, the first one at bucket 0 plus its offset.
+ */
+static void fill_sparse_native_histogram(const metrics::histogram& h, ::io::prometheus::client::Histogram* mh) {
+    auto& nh = h.native_histogram.value();
+    mh->set_sample_count(h.sample_count);
+    mh->set_sample_sum(h.sample_sum);
+    mh->set_schema(nh.schema);
+    mh->set_zero_threshold(nh.zero_threshold);
+    mh->set_zero_count(nh.zero_count);
+    ::io::prometheus::client::BucketSpan* bucket_span = nullptr;
+    // the bucket following the last span
+    int32_t next_id = 0;
+    int64_t last_count = 0;
+    for (auto& b : nh.sparse_buckets) {
+        if (!bucket_span || b.index != next_id) {
+            bucket_span = mh->add_positive_span();
+            bucket_span->set_offset(b.index - next_id);
+            bucket_span->set_length(0);
+        }
+        bucket_span->set_length(bucket_span->length() + 1);
+        mh->add_positive_delta(int64_t(b.count) - last_count);
+        last_count = b.count;
+        next_id = b.index + 1;
+    }
+    if (!bucket_span && nh.zero_threshold == 0) {
+        // an empty span, to tell an empty native histogram from a conventional one
+        bucket_span = mh->add_positive_span();
+        bucket_span->set_offset(0);
+        bucket_span->set_length(0);
+    }
+}
+
 static void fill_metric(pm::MetricFamily& mf, const metrics::impl::metric_value& c,
         const metrics::impl::labels_type & id, const config& ctx) {
     switch (c.type()) {
@@ -186,7 +236,9 @@ static void fill_metric(pm::MetricFamily& mf, const metrics::impl::metric_value&
         auto mh = add_label(mf.add_metric(), id,ctx)->mutable_histogram();
         mh->set_sample_count(h.sample_count);
         mh->set_sample_sum(h.sample_sum);
-        if (h.native_histogram) {
+        if (h.is_sparse()) {
+            fill_sparse_native_histogram(h, mh);
+        } else if (h.native_histogram) {
             fill_native_type_histogram(h, mh);
         } else {
             fill_old_type_histogram(h, mh);
@@ -401,11 +453,17 @@ class metrics_families_per_shard {
     /** @} */
 };
 
-static future<> get_map_value(metrics_families_per_shard& vec) {
+/*!
+ * \brief gather the values of all shards
+ *
+ * With aggregated, each shard sums its series over the aggregate labels
+ * of their families before they are gathered, see mi::get_aggregated_values().
+ */
+static future<> get_map_value(metrics_families_per_shard& vec, bool aggregated = false) {
     vec.resize(smp::count);
-    return parallel_for_each(std::views::iota(0u, smp::count), [&vec] (auto cpu) {
-        return smp::submit_to(cpu, [] {
-            return mi::get_values();
+    return parallel_for_each(std::views::iota(0u, smp::count), [&vec, aggregated] (auto cpu) {
+        return smp::submit_to(cpu, [aggregated] {
+            return aggregated ? mi::get_aggregated_values() : mi::get_values();
         }).then([&vec, cpu] (auto res) {
             vec[cpu] = std::move(res);
         });
@@ -447,6 +505,8 @@ class metric_family {
 
     void foreach_metric(std::function<void(const mi::metric_value&, const mi::metric_series_metadata&)>&& f);
 
+    void foreach_shard(std::function<void(unsigned, const mi::values_copy&, size_t)>&& f);
+
     bool end() const {
         return !_name || !_family_info;
     }
@@ -562,36 +622,49 @@ class metric_family_iterator {
         return _positions.empty() || _info.end();
     }
 
-    void foreach_metric(std::function<void(const mi::metric_value&, const mi::metric_series_metadata&)>&& f) {
+    /*!
+     * \brief call f for each shard that has the metric family, with the
+     * shard, its values and the position of the family in them
+     */
+    void foreach_shard(std::function<void(unsigned, const mi::values_copy&, size_t)>&& f) {
         // iterating over the shard vector and the position vector
-        for (auto&& i : boost::combine(_positions, _families)) {
-            auto& pos_in_metric_per_shard = boost::get<0>(i);
-            auto& metric_family = boost::get<1>(i);
-            if (pos_in_metric_per_shard >= metric_family->metadata->size()) {
+        for (unsigned shard = 0; shard < _positions.size(); ++shard) {
+            auto pos_in_metric_per_shard = _positions[shard];
+            const mi::values_copy& metric_family = *_families[shard];
+            if (pos_in_metric_per_shard >= metric_family.metadata->size()) {
                 // no more metric family in this shard
                 continue;
             }
-            auto& metadata = metric_family->metadata->at(pos_in_metric_per_shard);
             // the the name is different, that means that on this shard, the metric family
             // does not exist, because everything is sorted by metric family name, this is fine.
-            if (metadata.mf.name == name()) {
-                const mi::value_vector& values = metric_family->values[pos_in_metric_per_shard];
-                const mi::metric_metadata_fifo& metrics_metadata = metadata.metrics;
-                for (auto&& vm : boost::combine(values, metrics_metadata)) {
-                    auto& value = boost::get<0>(vm);
-                    auto& metric_metadata = boost::get<1>(vm);
-                    f(value, metric_metadata);
-                }
+            if (metric_family.metadata->at(pos_in_metric_per_shard).mf.name == name()) {
+                f(shard, metric_family, pos_in_metric_per_shard);
             }
         }
     }
 
+    void foreach_metric(std::function<void(const mi::metric_value&, const mi::metric_series_metadata&)>&& f) {
+        foreach_shard([&f] (unsigned, const mi::values_copy& metric_family, size_t pos) {
+            const mi::value_vector& values = metric_family.values[pos];
+            const mi::metric_metadata_fifo& metrics_metadata = metric_family.metadata->at(pos).metrics;
+            for (auto&& vm : boost::combine(values, metrics_metadata)) {
+                auto& value = boost::get<0>(vm);
+                auto& metric_metadata = boost::get<1>(vm);
+                f(value, metric_metadata);
+            }
+        });
+    }
+
 };
 
 void metric_family::foreach_metric(std::function<void(const mi::metric_value&, const mi::metric_series_metadata&)>&& f) {
     _iterator_state.foreach_metric(std::move(f));
 }
 
+void metric_family::foreach_shard(std::function<void(unsigned, const mi::values_copy&, size_t)>&& f) {
+    _iterator_state.foreach_shard(std::move(f));
+}
+
 class metric_family_range {
     metric_family_iterator _begin;
     metric_family_iterator _end;
@@ -675,6 +748,21 @@ void write_histogram(std::stringstream& s, const config& ctx, const sstring& nam
 
     auto& le = labels["le"];
     auto bucket = name + "_bucket";
+    if (h.is_sparse()) {
+        // the text format has no native histograms, the nonempty buckets
+        // are written as conventional ones
+        auto& nh = h.native_histogram.value();
+        uint64_t count = nh.zero_count;
+        le = fmt::format("{}", nh.zero_threshold);
+        add_name(s, bucket, labels, ctx);
+        s << count << '\n';
+        for (auto& b : nh.sparse_buckets) {
+            count += b.count;
+            le = fmt::format("{}", metrics::native_histogram_info::upper_bound(nh.schema, b.index));
+            add_name(s, bucket, labels, ctx);
+            s << count << '\n';
+        }
+    }
     for (auto  i : h.buckets) {
          le = std::to_string(i.upper_bound);
         add_name(s, bucket, labels, ctx);
@@ -747,6 +835,54 @@ class metric_aggregate_by_labels {
     }
 };
 
+/*!
+ * \brief the rendered names of the series of all shards, as the text
+ * format writes them: name{labels} followed by a space
+ *
+ * The names of the series of a shard only change when the metrics
+ * registered on it change, which changes the generation of its metadata.
+ * So they are rendered on the first scrape that needs them, and the
+ * following scrapes only format the values.
+ *
+ * The names of a family are shared with the scrapes using them, so that
+ * a concurrent scrape seeing a new generation doesn't free them.
+ */
+class series_names_cache {
+    using names = std::vector<sstring>;
+    struct shard_names {
+        uint64_t generation = 0;
+        // by the position of the family in the metadata of the shard
+        std::vector<lw_shared_ptr<const names>> families;
+    };
+    std::vector<shard_names> _shards;
+public:
+    lw_shared_ptr<const names> get(unsigned shard, const mi::values_copy& values, size_t pos, const sstring& name, const config& ctx) {
+        if (_shards.size() <= shard) {
+            _shards.resize(shard + 1);
+        }
+        auto& sn = _shards[shard];
+        if (sn.generation != values.metadata_generation) {
+            sn.generation = values.metadata_generation;
+            sn.families.clear();
+            sn.families.resize(values.metadata->size());
+        }
+        auto& family = sn.families[pos];
+        if (!family) {
+            auto& metrics = values.metadata->at(pos).metrics;
+            names n;
+            n.reserve(metrics.size());
+            std::stringstream s;
+            for (auto& m : metrics) {
+                s.str("");
+                add_name(s, name, m.labels(), ctx);
+                n.emplace_back(s.str());
+            }
+            family = make_lw_shared<const names>(std::move(n));
+        }
+        return family;
+    }
+};
+
 void write_value_as_string(std::stringstream& s, const mi::metric_value& value) noexcept {
     std::string value_str;
     try {
@@ -762,8 +898,14 @@ void write_value_as_string(std::stringstream& s, const mi::metric_value& value)
     }
 }
 
-future<> write_text_representation(output_stream<char>& out, const config& ctx, const metric_family_range& m, bool show_help, bool enable_aggregation, std::function<bool(const mi::labels_type&)> filter) {
-    return seastar::async([&ctx, &out, &m, show_help, enable_aggregation, filter] () mutable {
+/*!
+ * \brief write the metrics in the text format
+ *
+ * When names is set, the names of the series are taken from it rather
+ * than rendered, except for histograms, summaries and aggregated families.
+ */
+future<> write_text_representation(output_stream<char>& out, const config& ctx, const metric_family_range& m, bool show_help, bool enable_aggregation, std::function<bool(const mi::labels_type&)> filter, series_names_cache* names = nullptr) {
+    return seastar::async([&ctx, &out, &m, show_help, enable_aggregation, filter, names] () mutable {
         bool found = false;
         std::stringstream s;
         for (metric_family& metric_family : m) {
@@ -771,32 +913,48 @@ future<> write_text_representation(output_stream<char>& out, const config& ctx,
             found = false;
             metric_aggregate_by_labels aggregated_values(metric_family.metadata().aggregate_labels);
             bool should_aggregate = enable_aggregation && !metric_family.metadata().aggregate_labels.empty();
-            metric_family.foreach_metric([&s, &out, &ctx, &found, &name, &metric_family, &aggregated_values, should_aggregate, show_help, &filter](const mi::metric_value& value, const mi::metric_series_metadata& value_info) mutable {
-                s.clear();
-                s.str("");
-                if ((value_info.should_skip_when_empty() && value.is_empty()) || !filter(value_info.labels())) {
-                    return;
+            auto type = metric_family.metadata().type;
+            bool use_names = names && !should_aggregate && type != mi::data_type::HISTOGRAM && type != mi::data_type::SUMMARY;
+            metric_family.foreach_shard([&] (unsigned shard, const mi::values_copy& values, size_t pos) {
+                lw_shared_ptr<const std::vector<sstring>> series_names;
+                if (use_names) {
+                    series_names = names->get(shard, values, pos, name, ctx);
                 }
-                if (!found) {
-                    if (show_help && metric_family.metadata().d.str() != "") {
-                        s << "# HELP " << name << " " <<  metric_family.metadata().d.str() << '\n';
+                const mi::value_vector& family_values = values.values[pos];
+                const mi::metric_metadata_fifo& metrics_metadata = values.metadata->at(pos).metrics;
+                for (size_t i = 0; i < family_values.size(); ++i) {
+                    const mi::metric_value& value = family_values[i];
+                    const mi::metric_series_metadata& value_info = metrics_metadata[i];
+                    s.clear();
+                    s.str("");
+                    if ((value_info.should_skip_when_empty() && value.is_empty()) || !filter(value_info.labels())) {
+                        continue;
                     }
-                    s << "# TYPE " << name << " " << metric_family.metadata().type << '\n';
-                    found = true;
-                }
-                if (should_aggregate) {
-                    aggregated_values.add(value, value_info.labels());
-                } else if (value.type() == mi::data_type::SUMMARY) {
-                    write_summary(s, ctx, name, value.get_histogram(), value_info.labels());
-                } else if (value.type() == mi::data_type::HISTOGRAM) {
-                    write_histogram(s, ctx, name, value.get_histogram(), value_info.labels());
-                } else {
-                    add_name(s, name, value_info.labels(), ctx);
-                    write_value_as_string(s, value);
-                    s << '\n';
+                    if (!found) {
+                        if (show_help && metric_family.metadata().d.str() != "") {
+                            s << "# HELP " << name << " " <<  metric_family.metadata().d.str() << '\n';
+                        }
+                        s << "# TYPE " << name << " " << type << '\n';
+                        found = true;
+                    }
+                    if (should_aggregate) {
+                        aggregated_values.add(value, value_info.labels());
+                    } else if (value.type() == mi::data_type::SUMMARY) {
+                        write_summary(s, ctx, name, value.get_histogram(), value_info.labels());
+                    } else if (value.type() == mi::data_type::HISTOGRAM) {
+                        write_histogram(s, ctx, name, value.get_histogram(), value_info.labels());
+                    } else {
+                        if (series_names) {
+                            s << (*series_names)[i];
+                        } else {
+                            add_name(s, name, value_info.labels(), ctx);
+                        }
+                        write_value_as_string(s, value);
+                        s << '\n';
+                    }
+                    out.write(s.str()).get();
+                    thread::maybe_yield();
                 }
-                out.write(s.str()).get();
-                thread::maybe_yield();
             });
             if (!aggregated_values.empty()) {
                 for (auto&& h : aggregated_values.get_values()) {
@@ -868,6 +1026,7 @@ bool is_accept_protobuf(const std::string& accept) {
 class metrics_handler : public httpd::handler_base  {
     sstring _prefix;
     config _ctx;
+    series_names_cache _series_names;
     static std::function<bool(const mi::labels_type&)> _true_function;
 
     /*!
@@ -897,6 +1056,13 @@ class metrics_handler : public httpd::handler_base  {
      * It returns true if a metric should be included, or false otherwise.
      * The filters are created from the request query parameters.
      */
+    static bool filters_labels(const http::request& req) {
+        auto& labels = mi::get_local_impl()->get_labels();
+        return std::ranges::any_of(req.query_parameters, [&labels] (auto& qp) {
+            return labels.contains(qp.first);
+        });
+    }
+
     std::function<bool(const mi::labels_type&)> make_filter(const http::request& req) {
         std::unordered_map<sstring, std::regex> matcher;
         auto labels = mi::get_local_impl()->get_labels();
@@ -927,14 +1093,17 @@ class metrics_handler : public httpd::handler_base  {
         bool show_help = req->get_query_param("__help__") != "false";
         bool enable_aggregation = req->get_query_param("__aggregate__") != "false";
         std::function<bool(const mi::labels_type&)> filter = make_filter(*req);
-        rep->write_body(is_protobuf_format ? "proto" : "txt", [this, is_protobuf_format, metric_family_name, prefix, show_help, enable_aggregation, filter] (output_stream<char>&& s) {
+        // the shards can only sum their series if the filter needs none of the labels summed over
+        bool aggregate_on_shards = enable_aggregation && !filters_labels(*req);
+        rep->write_body(is_protobuf_format ? "proto" : "txt", [this, is_protobuf_format, metric_family_name, prefix, show_help, enable_aggregation, aggregate_on_shards, filter] (output_stream<char>&& s) {
             return do_with(metrics_families_per_shard(), output_stream<char>(std::move(s)),
-                    [this, is_protobuf_format, prefix, &metric_family_name, show_help, enable_aggregation, filter] (metrics_families_per_shard& families, output_stream<char>& s) mutable {
-                return get_map_value(families).then([&s, &families, this, is_protobuf_format, prefix, &metric_family_name, show_help, enable_aggregation, filter]() mutable {
+                    [this, is_protobuf_format, prefix, &metric_family_name, show_help, enable_aggregation, aggregate_on_shards, filter] (metrics_families_per_shard& families, output_stream<char>& s) mutable {
+                return get_map_value(families, aggregate_on_shards).then([&s, &families, this, is_protobuf_format, prefix, &metric_family_name, show_help, enable_aggregation, filter]() mutable {
                     return do_with(get_range(families, metric_family_name, prefix),
                             [&s, this, is_protobuf_format, show_help, enable_aggregation, filter](metric_family_range& m) {
                         return (is_protobuf_format) ?  write_protobuf_representation(s, _ctx, m, enable_aggregation, filter) :
-                                write_text_representation(s, _ctx, m, show_help, enable_aggregation, filter);
+                                write_text_representation(s, _ctx, m, show_help, enable_aggregation, filter,
+                                        _ctx.cache_series_names ? &_series_names : nullptr);
                     });
                 }).finally([&s] () mutable {
                     return s.close();
@@ -949,8 +1118,268 @@ std::function<bool(const mi::labels_type&)> metrics_handler::_true_function = []
     return true;
 };
 
+static sstring read_maps() {
+    auto fd = file_desc::open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    sstring ret;
+    std::array<char, 4096> buf;
+    while (auto n = fd.read(buf.data(), buf.size())) {
+        if (!*n) {
+            break;
+        }
+        ret.append(buf.data(), *n);
+    }
+    return ret;
+}
+
+class heap_profile_handler : public httpd::handler_base {
+    // See https://github.com/google/pprof/blob/main/profile/legacy_profile.go
+    static sstring format_profile(const std::unordered_set<memory::allocation_site>& sites) {
+        size_t count = 0;
+        size_t size = 0;
+        for (auto& site : sites) {
+            count += site.count;
+            size += site.size;
+        }
+        // Only the live set is tracked, so the cumulative numbers are zero
+        std::string out = fmt::format("heap profile: {}: {} [0: 0] @ heapprofile\n", count, size);
+        auto it = std::back_inserter(out);
+        for (auto& site : sites) {
+            it = fmt::format_to(it, "{}: {} [0: 0] @", site.count, site.size);
+            for (auto& f : site.backtrace.frames()) {
+                // Frames point one byte into the call instruction, pprof
+                // expects return addresses
+                it = fmt::format_to(it, " {:#x}", f.so->begin + f.addr + 1);
+            }
+            out += '\n';
+        }
+        out += "\nMAPPED_LIBRARIES:\n";
+        out += read_maps();
+        return sstring(out);
+    }
+public:
+    future<std::unique_ptr<http::reply>> handle(const sstring& path,
+        std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) override {
+        auto rate = req->get_query_param("sample_rate");
+        if (!rate.empty()) {
+            size_t sample_rate;
+            try {
+                sample_rate = boost::lexical_cast<size_t>(rate);
+            } catch (const boost::bad_lexical_cast&) {
+                throw httpd::bad_param_exception(fmt::format("Invalid sample_rate: {}", rate));
+            }
+            co_await smp::invoke_on_all([sample_rate] {
+                memory::set_heap_profiling_sampling_rate(sample_rate);
+            });
+        }
+        std::unordered_set<memory::allocation_site> sites;
+        for (auto shard : smp::all_cpus()) {
+            auto profile = co_await smp::submit_to(shard, [] {
+                return memory::sampled_memory_profile();
+            });
+            for (auto& site : profile) {
+                auto [i, inserted] = sites.insert(site);
+                if (!inserted) {
+                    i->count += site.count;
+                    i->size += site.size;
+                }
+            }
+        }
+        rep->write_body("txt", format_profile(sites));
+        co_return rep;
+    }
+};
+
+class cpu_profile_handler : public httpd::handler_base {
+    // The profile of each shard
+    using profile = std::vector<std::vector<internal::cpu_profile_entry>>;
+
+    static future<profile> collect() {
+        profile ret;
+        for (auto shard : smp::all_cpus()) {
+            ret.push_back(co_await smp::submit_to(shard, [] {
+                return internal::cpu_profile();
+            }));
+        }
+        co_return ret;
+    }
+
+    struct mapping {
+        uintptr_t start;
+        uintptr_t end;
+        uint64_t id;
+    };
+
+    // See https://github.com/google/pprof/blob/main/proto/profile.proto
+    static sstring format_profile(const profile& shards, std::chrono::nanoseconds period, std::chrono::nanoseconds duration) {
+        namespace pp = perftools::profiles;
+        pp::Profile p;
+        std::unordered_map<std::string, int64_t> strings;
+        auto str = [&] (std::string s) {
+            auto [i, inserted] = strings.emplace(std::move(s), strings.size());
+            if (inserted) {
+                p.add_string_table(i->first);
+            }
+            return i->second;
+        };
+        str("");
+
+        auto set_value_type = [&] (pp::ValueType* vt, const char* type, const char* unit) {
+            vt->set_type(str(type));
+            vt->set_unit(str(unit));
+        };
+        set_value_type(p.add_sample_type(), "samples", "count");
+        set_value_type(p.add_sample_type(), "cpu", "nanoseconds");
+        set_value_type(p.mutable_period_type(), "cpu", "nanoseconds");
+        p.set_period(period.count());
+        p.set_time_nanos(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+        p.set_duration_nanos(duration.count());
+
+        // The executable mappings, for pprof to symbolize the addresses
+        std::vector<mapping> mappings;
+        auto maps = read_maps();
+        static const std::regex line_re(R"(^([0-9a-f]+)-([0-9a-f]+) ..x. ([0-9a-f]+) \S+ \d+\s+(/.*)$)");
+        for (auto line : std::views::split(std::string_view(maps), '\n')) {
+            std::cmatch m;
+            std::string_view l(line.begin(), line.end());
+            if (!std::regex_match(l.begin(), l.end(), m, line_re)) {
+                continue;
+            }
+            auto* pm = p.add_mapping();
+            pm->set_id(mappings.size() + 1);
+            pm->set_memory_start(std::stoull(m[1].str(), nullptr, 16));
+            pm->set_memory_limit(std::stoull(m[2].str(), nullptr, 16));
+            pm->set_file_offset(std::stoull(m[3].str(), nullptr, 16));
+            pm->set_filename(str(m[4].str()));
+            mappings.push_back(mapping{pm->memory_start(), pm->memory_limit(), pm->id()});
+        }
+
+        std::unordered_map<uintptr_t, uint64_t> locations;
+        auto location = [&] (uintptr_t address) {
+            auto [i, inserted] = locations.emplace(address, locations.size() + 1);
+            if (inserted) {
+                auto* loc = p.add_location();
+                loc->set_id(i->second);
+                loc->set_address(address);
+                auto m = std::ranges::find_if(mappings, [address] (const mapping& m) {
+                    return address >= m.start && address < m.end;
+                });
+                if (m != mappings.end()) {
+                    loc->set_mapping_id(m->id);
+                }
+            }
+            return i->second;
+        };
+
+        auto shard_key = str("shard");
+        auto sg_key = str("scheduling_group");
+        auto stalled_key = str("stalled");
+        auto stalled_value = str("true");
+        for (auto shard : smp::all_cpus()) {
+            for (auto& e : shards[shard]) {
+                auto* s = p.add_sample();
+                for (auto& f : e.backtrace.frames()) {
+                    s->add_location_id(location(f.so->begin + f.addr));
+                }
+                s->add_value(e.samples);
+                s->add_value(e.samples * period.count());
+                auto* l = s->add_label();
+                l->set_key(shard_key);
+                l->set_num(shard);
+                l = s->add_label();
+                l->set_key(sg_key);
+                l->set_str(str(e.scheduling_group));
+                if (e.stalled) {
+                    l = s->add_label();
+                    l->set_key(stalled_key);
+                    l->set_str(stalled_value);
+                }
+            }
+        }
+        return sstring(p.SerializeAsString());
+    }
+public:
+    future<std::unique_ptr<http::reply>> handle(const sstring& path,
+        std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) override {
+        auto parse = [&req] (const char* name) -> std::optional<unsigned> {
+            auto value = req->get_query_param(name);
+            if (value.empty()) {
+                return std::nullopt;
+            }
+            try {
+                return boost::lexical_cast<unsigned>(value);
+            } catch (const boost::bad_lexical_cast&) {
+                throw httpd::bad_param_exception(fmt::format("Invalid {}: {}", name, value));
+            }
+        };
+        auto period_us = parse("period_us");
+        auto seconds = parse("seconds");
+        if (period_us) {
+            co_await smp::invoke_on_all([period = std::chrono::microseconds(*period_us)] {
+                engine().set_cpu_profiler_period(period);
+            });
+        }
+        auto period = engine().get_cpu_profiler_period();
+        std::chrono::nanoseconds duration{0};
+        if (seconds) {
+            // Reading the profile resets it
+            co_await collect();
+            duration = std::chrono::seconds(*seconds);
+            co_await seastar::sleep(duration);
+        }
+        auto shards = co_await collect();
+        rep->write_body("bin", format_profile(shards, period, duration));
+        co_return rep;
+    }
+};
+
+class task_trace_handler : public httpd::handler_base {
+public:
+    future<std::unique_ptr<http::reply>> handle(const sstring& path,
+        std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) override {
+        auto parse = [&req] (const char* name) -> std::optional<unsigned> {
+            auto value = req->get_query_param(name);
+            if (value.empty()) {
+                return std::nullopt;
+            }
+            try {
+                return boost::lexical_cast<unsigned>(value);
+            } catch (const boost::bad_lexical_cast&) {
+                throw httpd::bad_param_exception(fmt::format("Invalid {}: {}", name, value));
+            }
+        };
+        auto seconds = parse("seconds");
+        auto max_events = parse("max_events").value_or(64 * 1024);
+        if (seconds) {
+            co_await smp::invoke_on_all([max_events] {
+                engine().enable_task_tracing(max_events);
+            });
+            co_await seastar::sleep(std::chrono::seconds(*seconds));
+            co_await smp::invoke_on_all([] {
+                engine().disable_task_tracing();
+            });
+        }
+        std::vector<internal::task_trace> shards;
+        for (auto shard : smp::all_cpus()) {
+            shards.push_back(co_await smp::submit_to(shard, [] {
+                return internal::local_task_trace();
+            }));
+        }
+        rep->write_body("json", internal::format_chrome_trace(shards));
+        co_return rep;
+    }
+};
+
 future<> add_prometheus_routes(httpd::http_server& server, config ctx) {
     server._routes.put(httpd::GET, "/metrics", new metrics_handler(ctx));
+    if (ctx.heap_profile) {
+        server._routes.put(httpd::GET, "/debug/pprof/heap", new heap_profile_handler());
+    }
+    if (ctx.cpu_profile) {
+        server._routes.put(httpd::GET, "/debug/pprof/profile", new cpu_profile_handler());
+    }
+    if (ctx.task_trace) {
+        server._routes.put(httpd::GET, "/debug/trace", new task_trace_handler());
+    }
     return make_ready_future<>();
 }
 
@@ -41,9 +41,11 @@ module;
 #include <sys/vfs.h>
 #include <sys/statfs.h>
 #include <sys/statvfs.h>
+#include <sys/sysmacros.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
 #include <sys/inotify.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -103,6 +105,9 @@ module;
 
 #if defined(__x86_64__) || defined(__i386__)
 #include <xmmintrin.h>
+#include <immintrin.h>
+#include <x86intrin.h>
+#include <cpuid.h>
 #endif
 
 #ifdef SEASTAR_HAVE_DPDK
@@ -126,6 +131,8 @@ module seastar;
 #else
 #include <seastar/core/abort_on_ebadf.hh>
 #include <seastar/core/alien.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/cpu_accounting.hh>
 #include <seastar/core/exception_hacks.hh>
 #include <seastar/core/execution_stage.hh>
 #include <seastar/core/io_queue.hh>
@@ -156,6 +163,9 @@ module seastar;
 #include <seastar/core/internal/io_desc.hh>
 #include <seastar/core/internal/uname.hh>
 #include <seastar/core/internal/stall_detector.hh>
+#include <seastar/core/internal/cpu_profiler.hh>
+#include <seastar/core/internal/task_tracer.hh>
+#include <seastar/core/internal/quiescent_state.hh>
 #include <seastar/core/internal/run_in_background.hh>
 #include <seastar/net/native-stack.hh>
 #include <seastar/net/packet.hh>
@@ -176,6 +186,7 @@ module seastar;
 #include "core/reactor_backend.hh"
 #include "core/syscall_result.hh"
 #include "core/thread_pool.hh"
+#include "core/prefault.hh"
 #include "syscall_work_queue.hh"
 #include "cgroup.hh"
 #ifdef SEASTAR_HAVE_DPDK
@@ -201,6 +212,8 @@ struct disk_params {
     uint64_t write_saturation_length = std::numeric_limits<uint64_t>::max();
     bool duplex = false;
     float rate_factor = 1.0;
+    // extra cost of writes when mixed with reads, as measured by iotune
+    float write_interference_factor = 1.0;
 };
 
 }
@@ -231,6 +244,9 @@ struct convert<seastar::disk_params> {
         if (node["rate_factor"]) {
             mp.rate_factor = node["rate_factor"].as<float>();
         }
+        if (node["write_interference_factor"]) {
+            mp.write_interference_factor = std::max(node["write_interference_factor"].as<float>(), 1.0f);
+        }
         return true;
     }
 };
@@ -251,6 +267,24 @@ void reactor::update_shares_for_queues(internal::priority_class pc, uint32_t sha
     }
 }
 
+void reactor::update_latency_target_for_queues(internal::priority_class pc, std::chrono::microseconds latency, double percentile) {
+    for (auto&& q : _io_queues) {
+        q.second->update_latency_target_for_class(pc, latency, percentile);
+    }
+}
+
+void reactor::update_min_shares_for_queues(internal::priority_class pc, uint32_t min_shares) {
+    for (auto&& q : _io_queues) {
+        q.second->update_min_shares_for_class(pc, min_shares);
+    }
+}
+
+void reactor::update_shares_for_supergroup_queues(unsigned index, uint32_t shares) {
+    for (auto&& q : _io_queues) {
+        q.second->update_shares_for_supergroup(index, shares);
+    }
+}
+
 future<> reactor::update_bandwidth_for_queues(internal::priority_class pc, uint64_t bandwidth) {
     return smp::invoke_on_all([pc, bandwidth = bandwidth / _num_io_groups] {
         return parallel_for_each(engine()._io_queues, [pc, bandwidth] (auto& queue) {
@@ -259,6 +293,56 @@ future<> reactor::update_bandwidth_for_queues(internal::priority_class pc, uint6
     });
 }
 
+seastar::shared_ptr<io_queue> reactor::find_disk_io_queue(dev_t devid, unsigned depth) const {
+    if (auto queue = _io_queues.find(devid); queue != _io_queues.end()) {
+        return queue->second;
+    }
+    if (devid == 0 || depth > 4) {
+        return nullptr;
+    }
+    auto parse_dev = [] (const std::filesystem::path& dev_file) {
+        auto dev = read_first_line(dev_file);
+        auto colon = dev.find(':');
+        return makedev(std::stoul(dev.substr(0, colon)), std::stoul(dev.substr(colon + 1)));
+    };
+    auto sysfs = std::filesystem::path(fmt::format("/sys/dev/block/{}:{}", major(devid), minor(devid)));
+    try {
+        // A partition lives in the sysfs directory of its disk
+        if (std::filesystem::exists(sysfs / "partition")) {
+            return find_disk_io_queue(parse_dev(std::filesystem::canonical(sysfs).parent_path() / "dev"), depth + 1);
+        }
+        // Stacked devices share the queue only if all their slaves do
+        seastar::shared_ptr<io_queue> ret;
+        auto slaves = sysfs / "slaves";
+        if (!std::filesystem::is_directory(slaves)) {
+            return nullptr;
+        }
+        for (auto& slave : std::filesystem::directory_iterator(slaves)) {
+            auto queue = find_disk_io_queue(parse_dev(slave.path() / "dev"), depth + 1);
+            if (!queue || (ret && ret != queue)) {
+                return nullptr;
+            }
+            ret = std::move(queue);
+        }
+        return ret;
+    } catch (...) {
+        seastar_logger.debug("Cannot resolve the disk of device {}:{}: {}", major(devid), minor(devid), std::current_exception());
+        return nullptr;
+    }
+}
+
+io_queue& reactor::discover_io_queue(dev_t devid) {
+    auto queue = find_disk_io_queue(devid, 0);
+    if (!queue) {
+        queue = _io_queues.at(0);
+    } else {
+        seastar_logger.debug("Device {}:{} uses the {} queue", major(devid), minor(devid), queue->mountpoint());
+    }
+    // Remember the result, so that sysfs is only looked at once per device
+    _io_queue_aliases.emplace(devid, queue.get());
+    return *queue;
+}
+
 void reactor::rename_queues(internal::priority_class pc, sstring new_name) {
     for (auto&& queue : _io_queues) {
         queue.second->rename_priority_class(pc, new_name);
@@ -451,7 +535,9 @@ future<> pollable_fd_state::write_all(const uint8_t* buffer, size_t size) {
 }
 
 future<> pollable_fd_state::write_all(net::packet& p) {
-    return write_some(p).then([this, &p] (size_t size) {
+    auto threshold = engine()._cfg.zerocopy_send_threshold;
+    auto f = threshold && p.len() >= threshold ? engine()._backend->sendmsg_zerocopy(*this, p) : write_some(p);
+    return std::move(f).then([this, &p] (size_t size) {
         if (p.len() == size) {
             return make_ready_future<>();
         }
@@ -540,6 +626,29 @@ future<size_t> pollable_fd_state::sendto(socket_address addr, const void* buf, s
     });
 }
 
+future<size_t> pollable_fd_state::sendfile(int in_fd, uint64_t offset, size_t len) {
+    maybe_no_more_send();
+    return engine().writeable(*this).then([this, in_fd, offset, len] {
+        // sendfile() blocks reading the file, so it has to run in the
+        // syscall thread. The socket is non-blocking, so it won't block
+        // the syscall thread waiting for the peer.
+        return engine()._thread_pool->submit<syscall_result<ssize_t>>(
+                internal::thread_pool_submit_reason::file_operation, [out_fd = fd.get(), in_fd, offset, len] {
+            ::off_t off = offset;
+            return wrap_syscall<ssize_t>(::sendfile(out_fd, in_fd, &off, len));
+        });
+    }).then([this, in_fd, offset, len] (syscall_result<ssize_t> sr) {
+        if (sr.result == -1 && (sr.error == EAGAIN || sr.error == EWOULDBLOCK)) {
+            return sendfile(in_fd, offset, len);
+        }
+        sr.throw_if_error();
+        if (size_t(sr.result) == len) {
+            speculate_epoll(EPOLLOUT);
+        }
+        return make_ready_future<size_t>(sr.result);
+    });
+}
+
 namespace internal {
 
 #ifdef SEASTAR_BUILD_SHARED_LIBS
@@ -813,16 +922,19 @@ class backtrace_buffer {
         append(p, (buf + sizeof(buf)) - p);
     }
 
+    void append_frame(frame f) noexcept {
+        if (!f.so->name.empty()) {
+            append(f.so->name.c_str(), f.so->name.size());
+            append("+");
+        }
+        append("0x");
+        append_hex(f.addr);
+    }
+
     void append_backtrace() noexcept {
         backtrace([this] (frame f) {
             append("  ");
-            if (!f.so->name.empty()) {
-                append(f.so->name.c_str(), f.so->name.size());
-                append("+");
-            }
-
-            append("0x");
-            append_hex(f.addr);
+            append_frame(f);
             append("\n");
         }, _immediate);
     }
@@ -836,7 +948,53 @@ class backtrace_buffer {
     }
 };
 
-static void print_with_backtrace(backtrace_buffer& buf, bool oneline) noexcept {
+static const char* loop_phase_name(internal::loop_phase phase) noexcept {
+    switch (phase) {
+    case internal::loop_phase::smp: return "smp";
+    case internal::loop_phase::alien: return "alien";
+    case internal::loop_phase::io: return "io";
+    case internal::loop_phase::network: return "network";
+    case internal::loop_phase::timers: return "timers";
+    case internal::loop_phase::other: return "other";
+    case internal::loop_phase::tasks: return "tasks";
+    case internal::loop_phase::count: break;
+    }
+    return "other";
+}
+
+// Appends the chain of tasks waiting for the running one, the async
+// backtrace of what is running. Coroutines are reported with the address
+// they resume at, which seastar-addr2line symbolizes, and other tasks with
+// their mangled type name, since demangling is not async-signal safe.
+static void append_awaited_by(backtrace_buffer& buf, bool oneline) noexcept {
+    if (!local_engine) {
+        return;
+    }
+    task* t = nullptr;
+    if (auto thread = thread_impl::get()) {
+        t = thread->waiting_task();
+    } else if (auto running = local_engine->current_task()) {
+        t = running->waiting_task();
+    }
+    if (!t) {
+        return;
+    }
+    buf.append(oneline ? " Awaited by:" : "Awaited by:\n");
+    constexpr unsigned max_tasks = 16;
+    for (unsigned n = 0; t && n != max_tasks; ++n, t = t->waiting_task()) {
+        buf.append(oneline ? " " : "  ");
+        if (auto addr = internal::coroutine_task::resume_address(*t)) {
+            buf.append_frame(decorate(addr));
+        } else {
+            buf.append(typeid(*t).name());
+        }
+        if (!oneline) {
+            buf.append("\n");
+        }
+    }
+}
+
+static void print_with_backtrace(backtrace_buffer& buf, bool oneline, bool awaited_by = false) noexcept {
     if (local_engine) {
         buf.append(" on shard ");
         buf.append_decimal(this_shard_id());
@@ -848,9 +1006,15 @@ static void print_with_backtrace(backtrace_buffer& buf, bool oneline) noexcept {
   if (!oneline) {
     buf.append(".\nBacktrace:\n");
     buf.append_backtrace();
+    if (awaited_by) {
+        append_awaited_by(buf, oneline);
+    }
   } else {
     buf.append(". Backtrace:");
     buf.append_backtrace_oneline();
+    if (awaited_by) {
+        append_awaited_by(buf, oneline);
+    }
     buf.append("\n");
   }
 }
@@ -939,11 +1103,19 @@ static sstring shorten_name(const sstring& name, size_t length) {
     return shortname;
 }
 
-reactor::task_queue::task_queue(unsigned id, sstring name, sstring shortname, float shares)
+reactor::sched_entity::sched_entity(float shares, task_queue_group* parent, bool is_group) noexcept
         : _shares(std::max(shares, 1.0f))
         , _reciprocal_shares_times_2_power_32((uint64_t(1) << 32) / _shares)
+        , _parent(parent)
+        , _is_group(is_group) {
+}
+
+reactor::task_queue::task_queue(unsigned id, sstring name, sstring shortname, float shares, task_queue_group& group)
+        : sched_entity(shares, &group, false)
         , _id(id)
-        , _ts(now()) {
+        , _ts(now())
+        , _period_start(_ts)
+        , _unthrottle_timer(default_scheduling_group(), [this] { engine().unthrottle(*this); }) {
     rename(name, shortname);
 }
 
@@ -979,6 +1151,19 @@ reactor::task_queue::register_stats() {
                 return _time_spent_on_task_quota_violations / 1ms;
         }, sm::description("Total amount in milliseconds we were in violation of the task quota"),
            {group_label}),
+        sm::make_gauge("cpu_limit", [this] { return _cpu_limit; },
+                sm::description("Fraction of the CPU time this queue is limited to, 0 if unlimited"),
+                {group_label}),
+        sm::make_counter("throttled_time_ms", [this] {
+                return std::chrono::duration_cast<std::chrono::milliseconds>(_throttled_time).count();
+        }, sm::description("Accumulated time this queue was kept from running because it exhausted its CPU limit"),
+           {group_label}),
+        sm::make_counter("throttles", _throttles,
+                sm::description("Number of times this queue exhausted its CPU limit"),
+                {group_label}),
+        sm::make_gauge("memory_bytes", [this] { return memory::scheduling_group_memory(scheduling_group(_id)); },
+                sm::description("Memory held by the large allocations made by this queue"),
+                {group_label}),
     });
 
     register_net_metrics_for_scheduling_group(new_metrics, _id, group_label);
@@ -1007,31 +1192,66 @@ __attribute__((no_sanitize("undefined"))) // multiplication below may overflow;
 #endif
 inline
 int64_t
-reactor::task_queue::to_vruntime(sched_clock::duration runtime) const {
+reactor::sched_entity::to_vruntime(sched_clock::duration runtime) const {
     auto scaled = (runtime.count() * _reciprocal_shares_times_2_power_32) >> 32;
     // Prevent overflow from returning ridiculous values
     return std::max<int64_t>(scaled, 0);
 }
 
 void
-reactor::task_queue::set_shares(float shares) noexcept {
+reactor::sched_entity::set_shares(float shares) noexcept {
     _shares = std::max(shares, 1.0f);
     _reciprocal_shares_times_2_power_32 = (uint64_t(1) << 32) / _shares;
 }
 
 void
 reactor::account_runtime(task_queue& tq, sched_clock::duration runtime) {
-    if (runtime > (2 * _cfg.task_quota)) {
+    if (runtime > (2 * _task_quota)) {
         _stalls_histogram.add(runtime);
-        tq._time_spent_on_task_quota_violations += runtime - _cfg.task_quota;
+        tq._time_spent_on_task_quota_violations += runtime - _task_quota;
     }
     tq._vruntime += tq.to_vruntime(runtime);
     tq._runtime += runtime;
+    // a supergroup is charged by its own shares, so that its queues split
+    // the CPU time the group competes for with its siblings
+    auto& g = *tq._parent;
+    if (g._parent) {
+        g._vruntime += g.to_vruntime(runtime);
+    }
+}
+
+// Picks the task quota for the next window from what the last one observed:
+// late I/O completions and polls delayed past the longest quota call for a
+// shorter one, and so do queues competing for the CPU, each of which waits
+// for the quotas of the others. A shard that kept running out of quota
+// alone gets a longer one to cut the polling overhead.
+bool
+reactor::tune_task_quota() noexcept {
+    auto w = std::exchange(_task_quota_window, {});
+    if (!w.runs) {
+        return false;
+    }
+    bool io_late = false;
+    for (auto& [dev, ioq] : _io_queues) {
+        io_late |= ioq->flow_ratio() > ioq->get_config().flow_ratio_backpressure_threshold;
+    }
+    auto quota = _task_quota;
+    if (io_late || w.max_run > _cfg.task_quota_max) {
+        quota /= 2;
+    } else if (w.preempted_runs * 2 > w.runs) {
+        quota += quota / 4;
+    }
+    auto active_queues = double(w.active_queues) / w.runs;
+    if (active_queues > 1) {
+        quota = std::min(quota, std::chrono::duration_cast<sched_clock::duration>(_cfg.task_quota_max / active_queues));
+    }
+    quota = std::clamp(quota, _cfg.task_quota_min, _cfg.task_quota_max);
+    return std::exchange(_task_quota, quota) != quota;
 }
 
-struct reactor::task_queue::indirect_compare {
-    bool operator()(const task_queue* tq1, const task_queue* tq2) const {
-        return tq1->_vruntime < tq2->_vruntime;
+struct reactor::sched_entity::indirect_compare {
+    bool operator()(const sched_entity* e1, const sched_entity* e2) const {
+        return e1->_vruntime < e2->_vruntime;
     }
 };
 
@@ -1042,8 +1262,11 @@ reactor::reactor(std::shared_ptr<seastar::smp> smp, alien::instance& alien, unsi
     , _notify_eventfd(file_desc::eventfd(0, EFD_CLOEXEC))
     , _task_quota_timer(file_desc::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC))
     , _id(id)
+    , _idle_poll(_cfg.max_poll_time)
+    , _task_quota(_cfg.task_quota_auto ? std::clamp(_cfg.task_quota, _cfg.task_quota_min, _cfg.task_quota_max) : _cfg.task_quota)
     , _cpu_stall_detector(internal::make_cpu_stall_detector())
-    , _thread_pool(std::make_unique<thread_pool>(*this, seastar::format("syscall-{}", id))) {
+    , _cpu_profiler(std::make_unique<internal::cpu_profiler>())
+    , _thread_pool(std::make_unique<thread_pool>(*this, seastar::format("syscall-{}", id), _cfg.syscall_threads, _cfg.syscall_threads_cpu)) {
     /*
      * The _backend assignment is here, not on the initialization list as
      * the chosen backend constructor may want to handle signals and thus
@@ -1051,16 +1274,18 @@ reactor::reactor(std::shared_ptr<seastar::smp> smp, alien::instance& alien, unsi
      */
     _backend = rbs.create(*this);
     *internal::get_scheduling_group_specific_thread_local_data_ptr() = &_scheduling_group_specific_data;
-    _task_queues[0] = std::make_unique<task_queue>(0, "main", "main", 1000);
-    _task_queues[1] = std::make_unique<task_queue>(1, "atexit", "exit", 1000);
+    _task_queue_groups[0] = std::make_unique<task_queue_group>(1000, nullptr);
+    _task_queues[0] = std::make_unique<task_queue>(0, "main", "main", 1000, *_task_queue_groups[0]);
+    _task_queues[1] = std::make_unique<task_queue>(1, "atexit", "exit", 1000, *_task_queue_groups[0]);
     _at_destroy_tasks = _task_queues[1].get();
     set_need_preempt_var(&_preemption_monitor);
-    seastar::thread_impl::init();
+    seastar::thread_impl::init(_cfg.thread_stack_cache, _cfg.thread_stack_mmap);
     _backend->start_tick();
 
     sigset_t mask;
     sigemptyset(&mask);
     sigaddset(&mask, internal::cpu_stall_detector::signal_number());
+    sigaddset(&mask, internal::cpu_profiler::signal_number());
     auto r = ::pthread_sigmask(SIG_UNBLOCK, &mask, NULL);
     SEASTAR_ASSERT(r == 0);
     memory::set_reclaim_hook([this] (std::function<void ()> reclaim_fn) {
@@ -1068,12 +1293,19 @@ reactor::reactor(std::shared_ptr<seastar::smp> smp, alien::instance& alien, unsi
             fn();
         }));
     });
+    memory::set_background_reclaim_hook([this] (std::function<void ()> reclaim_fn) {
+        add_task(make_task(default_scheduling_group(), [fn = std::move(reclaim_fn)] {
+            fn();
+        }));
+    });
+    memory::set_memory_borrowing(_cfg.memory_rebalance);
 }
 
 reactor::~reactor() {
     sigset_t mask;
     sigemptyset(&mask);
     sigaddset(&mask, internal::cpu_stall_detector::signal_number());
+    sigaddset(&mask, internal::cpu_profiler::signal_number());
     auto r = ::pthread_sigmask(SIG_BLOCK, &mask, NULL);
     SEASTAR_ASSERT(r == 0);
 
@@ -1095,6 +1327,7 @@ reactor::~reactor() {
             get_sg_data(tq->_id).specific_vals.clear();
         }
     }
+    seastar::thread_impl::exit();
 }
 
 reactor::sched_stats
@@ -1214,6 +1447,7 @@ void cpu_stall_detector::on_signal() {
             return;
         }
         // no task was processed - report unless supressed
+        _stalled_at = tasks_processed;
         maybe_report();
         _report_at <<= 1;
     } else {
@@ -1222,6 +1456,11 @@ void cpu_stall_detector::on_signal() {
     arm_timer();
 }
 
+bool cpu_stall_detector::in_stall() const noexcept {
+    auto tasks_processed = _last_tasks_processed_seen.load(std::memory_order_relaxed);
+    return tasks_processed && tasks_processed == _stalled_at && engine().tasks_processed() == _stalled_at;
+}
+
 void cpu_stall_detector::report_suppressions(sched_clock::time_point now) {
     if (now > _minute_mark + 60s) {
         if (_reported > _max_reports_per_minute) {
@@ -1443,6 +1682,39 @@ std::unique_ptr<cpu_stall_detector> make_cpu_stall_detector(cpu_stall_detector_c
     }
 }
 
+// Appends where the reactor is stalled and how the time of its loop split
+// between tasks and pollers since the last report, e.g.
+// " in tasks (loop: tasks 92%, smp 3%, io 5%)"
+void cpu_stall_detector::append_loop_phases(backtrace_buffer& buf) noexcept {
+    if (!local_engine) {
+        return;
+    }
+    auto& r = *local_engine;
+    buf.append(" in ");
+    buf.append(loop_phase_name(r._loop_phase));
+    sched_clock::duration total{0};
+    for (size_t i = 0; i < r._loop_phase_time.size(); ++i) {
+        total += r._loop_phase_time[i] - r._loop_phase_time_reported[i];
+    }
+    if (total.count() > 0) {
+        buf.append(" (loop:");
+        const char* sep = " ";
+        for (size_t i = 0; i < r._loop_phase_time.size(); ++i) {
+            auto d = r._loop_phase_time[i] - r._loop_phase_time_reported[i];
+            if (auto pct = uint64_t(d.count() * 100 / total.count())) {
+                buf.append(sep);
+                buf.append(loop_phase_name(internal::loop_phase(i)));
+                buf.append(" ");
+                buf.append_decimal(pct);
+                buf.append("%");
+                sep = ", ";
+            }
+        }
+        buf.append(")");
+    }
+    r._loop_phase_time_reported = r._loop_phase_time;
+}
+
 void cpu_stall_detector::generate_trace() {
     auto delta = reactor::now() - _run_started_at;
 
@@ -1456,10 +1728,11 @@ void cpu_stall_detector::generate_trace() {
     buf.append("Reactor stalled for ");
     buf.append_decimal(uint64_t(delta / 1ms));
     buf.append(" ms");
+    append_loop_phases(buf);
     if (std::uncaught_exceptions() > 0) {
         buf.append(", backtrace omitted (uncaught exception in progress)\n");
     } else {
-        print_with_backtrace(buf, _config.oneline);
+        print_with_backtrace(buf, _config.oneline, true);
     }
     maybe_report_kernel_trace(buf);
 }
@@ -1501,6 +1774,61 @@ reactor::block_notifier(int) {
     engine()._cpu_stall_detector->on_signal();
 }
 
+void
+reactor::cpu_profiler_notifier(int, siginfo_t*, void* context) {
+    uintptr_t pc = 0;
+#if defined(__x86_64__)
+    pc = static_cast<ucontext_t*>(context)->uc_mcontext.gregs[REG_RIP];
+#elif defined(__aarch64__)
+    pc = static_cast<ucontext_t*>(context)->uc_mcontext.pc;
+#endif
+    auto& r = engine();
+    r._cpu_profiler->on_signal(pc, r._cpu_stall_detector->in_stall());
+}
+
+void
+reactor::set_cpu_profiler_period(std::chrono::microseconds period) {
+    _cpu_profiler->set_period(period);
+}
+
+std::chrono::microseconds
+reactor::get_cpu_profiler_period() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(_cpu_profiler->period());
+}
+
+std::vector<internal::cpu_profile_entry>
+internal::cpu_profile() {
+    return engine()._cpu_profiler->profile();
+}
+
+void
+reactor::enable_task_tracing(size_t max_events) {
+    _tracing = nullptr;
+    _task_tracer = std::make_unique<internal::task_tracer>(max_events);
+    _tracing = _task_tracer.get();
+}
+
+void
+reactor::disable_task_tracing() noexcept {
+    _tracing = nullptr;
+}
+
+internal::task_trace
+internal::local_task_trace() {
+    auto& r = engine();
+    if (!r._task_tracer) {
+        return {};
+    }
+    auto ret = r._task_tracer->trace();
+    for (auto& tq : r._task_queues) {
+        if (tq) {
+            ret.scheduling_groups.resize(std::max<size_t>(ret.scheduling_groups.size(), tq->_id + 1));
+            ret.scheduling_groups[tq->_id] = tq->_name;
+        }
+    }
+    return ret;
+}
+
 class network_stack_factory {
     network_stack_entry::factory_func _func;
 
@@ -1520,13 +1848,27 @@ void reactor::configure(const reactor_options& opts) {
     csdc.oneline = opts.blocked_reactor_report_format_oneline.get_value();
     _cpu_stall_detector->update_config(csdc);
 
+    // The signal is already unblocked, so the handler must be in place
+    // before the profiler's timer can fire
+    struct sigaction sa_cpu_profiler = {};
+    sa_cpu_profiler.sa_sigaction = &reactor::cpu_profiler_notifier;
+    sa_cpu_profiler.sa_flags = SA_SIGINFO | SA_RESTART;
+    auto r = sigaction(internal::cpu_profiler::signal_number(), &sa_cpu_profiler, nullptr);
+    SEASTAR_ASSERT(r == 0);
+    _cpu_profiler->set_period(opts.cpu_profiler_period_us.get_value() * 1us);
+
     if (_cfg.no_poll_aio) {
         _aio_eventfd = pollable_fd(file_desc::eventfd(0, 0));
     }
 }
 
 pollable_fd
-reactor::posix_listen(socket_address sa, listen_options opts) {
+reactor::posix_listen(socket_address sa, listen_options opts, bool reuseport) {
+    return pollable_fd(posix_listen_socket(sa, std::move(opts), reuseport));
+}
+
+file_desc
+reactor::posix_listen_socket(socket_address sa, listen_options opts, bool reuseport) {
     auto specific_protocol = (int)(opts.proto);
     if (sa.is_af_unix()) {
         // no type-safe way to create listen_opts with proto=0
@@ -1554,6 +1896,10 @@ reactor::posix_listen(socket_address sa, listen_options opts) {
         fd.setsockopt(SOL_SOCKET, SO_REUSEADDR, 1);
     }
 
+    if (reuseport) {
+        fd.setsockopt(SOL_SOCKET, SO_REUSEPORT, 1);
+    }
+
     if (opts.so_sndbuf) {
         fd.setsockopt(SOL_SOCKET, SO_SNDBUF, *opts.so_sndbuf);
     }
@@ -1581,7 +1927,7 @@ reactor::posix_listen(socket_address sa, listen_options opts) {
         throw std::system_error(s.code(), fmt::format("posix_listen failed for address {}", sa));
     }
 
-    return pollable_fd(std::move(fd));
+    return fd;
 }
 
 void pollable_fd_state::maybe_no_more_recv() {
@@ -1627,6 +1973,18 @@ reactor::make_pollable_fd(socket_address sa, int proto) {
     return pollable_fd(std::move(fd));
 }
 
+pollable_fd
+reactor::adopt_pollable_fd(file_desc fd) {
+    auto flags = ::fcntl(fd.get(), F_GETFL);
+    throw_system_error_on(flags == -1, "fcntl");
+    auto want = _backend->do_blocking_io() ? flags & ~O_NONBLOCK : flags | O_NONBLOCK;
+    if (want != flags) {
+        throw_system_error_on(::fcntl(fd.get(), F_SETFL, want) == -1, "fcntl");
+    }
+    throw_system_error_on(::fcntl(fd.get(), F_SETFD, FD_CLOEXEC) == -1, "fcntl");
+    return pollable_fd(std::move(fd));
+}
+
 future<>
 reactor::posix_connect(pollable_fd pfd, socket_address sa, socket_address local) {
 #ifdef IP_BIND_ADDRESS_NO_PORT
@@ -1727,8 +2085,85 @@ size_t sanitize_iovecs(std::vector<iovec>& iov, size_t disk_alignment) noexcept
 
 }
 
+static struct stat statx_to_stat(const struct ::statx& stx) noexcept {
+    struct stat st = {};
+    st.st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    st.st_ino = stx.stx_ino;
+    st.st_mode = stx.stx_mode;
+    st.st_nlink = stx.stx_nlink;
+    st.st_uid = stx.stx_uid;
+    st.st_gid = stx.stx_gid;
+    st.st_rdev = makedev(stx.stx_rdev_major, stx.stx_rdev_minor);
+    st.st_size = stx.stx_size;
+    st.st_blksize = stx.stx_blksize;
+    st.st_blocks = stx.stx_blocks;
+    st.st_atim = timespec{stx.stx_atime.tv_sec, stx.stx_atime.tv_nsec};
+    st.st_mtim = timespec{stx.stx_mtime.tv_sec, stx.stx_mtime.tv_nsec};
+    st.st_ctim = timespec{stx.stx_ctime.tv_sec, stx.stx_ctime.tv_nsec};
+    return st;
+}
+
+// Same as the thread pool version in open_file_dma(), with the open and
+// the stat submitted through the backend.
+future<file>
+reactor::open_file_dma_async(sstring name, int open_flags, file_open_options options) {
+    open_flags |= O_CLOEXEC;
+    if (_cfg.bypass_fsync) {
+        open_flags &= ~O_DSYNC;
+    }
+    auto mode = static_cast<mode_t>(options.create_permissions);
+    auto sr = co_await submit_file_metadata_op(internal::io_request::make_openat(name.c_str(), open_flags, mode));
+    sr.throw_fs_exception_if_error("open failed", name);
+    int fd = sr.result;
+    auto close_fd = defer([fd] () noexcept { ::close(fd); });
+    // Setting the file flags doesn't block
+    int o_direct_flag = _cfg.kernel_page_cache ? 0 : O_DIRECT;
+    if (::fcntl(fd, F_SETFL, open_flags | o_direct_flag) == -1 && _cfg.strict_o_direct) {
+        auto maybe_ret = wrap_syscall<int>(-1);  // capture errno (should be EINVAL)
+        bool is_tmpfs = false;
+        try {
+            is_tmpfs = (co_await fstatfs(fd)).f_type == internal::fs_magic::tmpfs;
+        } catch (...) {
+        }
+        if (!is_tmpfs) {
+            maybe_ret.throw_fs_exception_if_error("open failed", name);
+        }
+    }
+    struct ::statx stx;
+    sr = co_await submit_file_metadata_op(internal::io_request::make_statx(fd, "", AT_EMPTY_PATH, STATX_BASIC_STATS, &stx));
+    sr.throw_fs_exception_if_error("open failed", name);
+    auto st = statx_to_stat(stx);
+    // The extent size hint can only be set while the file has no extents,
+    // so the ioctls (which have no io_uring counterpart) are skipped when
+    // they would fail anyway.
+    if (options.extent_allocation_size_hint && !_cfg.kernel_page_cache && st.st_blocks == 0) {
+        co_await _thread_pool->submit<syscall_result<int>>(
+                internal::thread_pool_submit_reason::file_operation, [fd, &options] {
+            fsxattr attr = {};
+            int r = ::ioctl(fd, XFS_IOC_FSGETXATTR, &attr);
+            // Ignore error; may be !xfs, and just a hint anyway
+            if (r != -1) {
+                attr.fsx_xflags |= XFS_XFLAG_EXTSIZE;
+                attr.fsx_extsize = std::min(options.extent_allocation_size_hint,
+                                    file_open_options::max_extent_allocation_size_hint);
+                attr.fsx_extsize = align_up<uint32_t>(attr.fsx_extsize, file_open_options::min_extent_size_hint_alignment);
+                r = ::ioctl(fd, XFS_IOC_FSSETXATTR, &attr);
+            }
+            return wrap_syscall<int>(r);
+        });
+    }
+    close_fd.cancel();
+    co_return file(co_await make_file_impl(fd, options, open_flags, st));
+}
+
 future<file>
 reactor::open_file_dma(std::string_view nameref, open_flags flags, file_open_options options) noexcept {
+    if (_backend->submits_file_metadata_ops()) {
+        // Allocating memory for a sstring can throw, hence the futurize_invoke
+        return futurize_invoke([this, nameref, flags, &options] {
+            return open_file_dma_async(sstring(nameref), static_cast<int>(flags), std::move(options));
+        });
+    }
     return do_with(static_cast<int>(flags), std::move(options), [this, nameref] (auto& open_flags, file_open_options& options) {
         sstring name(nameref);
         return _thread_pool->submit<syscall_result_extra<struct stat>>(
@@ -1803,31 +2238,38 @@ reactor::open_file_dma(std::string_view nameref, open_flags flags, file_open_opt
 }
 
 future<>
-reactor::remove_file(std::string_view pathname) noexcept {
-    // Allocating memory for a sstring can throw, hence the futurize_invoke
-    return futurize_invoke([this, pathname] {
-        return _thread_pool->submit<syscall_result<int>>(
-                internal::thread_pool_submit_reason::file_operation, [pathname = sstring(pathname)] {
+reactor::remove_file(std::string_view pathname_view) noexcept {
+    sstring pathname(pathname_view);
+    syscall_result<int> sr{0, 0};
+    if (_backend->submits_file_metadata_ops()) {
+        sr = co_await submit_file_metadata_op(internal::io_request::make_unlinkat(pathname.c_str(), 0));
+        // Like remove(), which removes (empty) directories too
+        if (sr.result == -1 && sr.error == EISDIR) {
+            sr = co_await submit_file_metadata_op(internal::io_request::make_unlinkat(pathname.c_str(), AT_REMOVEDIR));
+        }
+    } else {
+        sr = co_await _thread_pool->submit<syscall_result<int>>(
+                internal::thread_pool_submit_reason::file_operation, [&pathname] {
             return wrap_syscall<int>(::remove(pathname.c_str()));
-        }).then([pathname = sstring(pathname)] (syscall_result<int> sr) {
-            sr.throw_fs_exception_if_error("remove failed", pathname);
-            return make_ready_future<>();
         });
-    });
+    }
+    sr.throw_fs_exception_if_error("remove failed", pathname);
 }
 
 future<>
-reactor::rename_file(std::string_view old_pathname, std::string_view new_pathname) noexcept {
-    // Allocating memory for a sstring can throw, hence the futurize_invoke
-    return futurize_invoke([this, old_pathname, new_pathname] {
-        return _thread_pool->submit<syscall_result<int>>(
-                internal::thread_pool_submit_reason::file_operation, [old_pathname = sstring(old_pathname), new_pathname = sstring(new_pathname)] {
+reactor::rename_file(std::string_view old_pathname_view, std::string_view new_pathname_view) noexcept {
+    sstring old_pathname(old_pathname_view);
+    sstring new_pathname(new_pathname_view);
+    syscall_result<int> sr{0, 0};
+    if (_backend->submits_file_metadata_ops()) {
+        sr = co_await submit_file_metadata_op(internal::io_request::make_renameat(old_pathname.c_str(), new_pathname.c_str(), 0));
+    } else {
+        sr = co_await _thread_pool->submit<syscall_result<int>>(
+                internal::thread_pool_submit_reason::file_operation, [&old_pathname, &new_pathname] {
             return wrap_syscall<int>(::rename(old_pathname.c_str(), new_pathname.c_str()));
-        }).then([old_pathname = sstring(old_pathname), new_pathname = sstring(new_pathname)] (syscall_result<int> sr) {
-            sr.throw_fs_exception_if_error("rename failed",  old_pathname, new_pathname);
-            return make_ready_future<>();
         });
-    });
+    }
+    sr.throw_fs_exception_if_error("rename failed",  old_pathname, new_pathname);
 }
 
 future<>
@@ -2173,36 +2615,42 @@ future<> reactor::chown(std::string_view filepath, uid_t owner, gid_t group) {
 }
 
 future<stat_data>
-reactor::file_stat(std::string_view pathname, follow_symlink follow) noexcept {
-    // Allocating memory for a sstring can throw, hence the futurize_invoke
-    return futurize_invoke([pathname, follow, this] {
-        return _thread_pool->submit<syscall_result_extra<struct stat>>(
-                internal::thread_pool_submit_reason::file_operation, [pathname = sstring(pathname), follow] {
+reactor::file_stat(std::string_view pathname_view, follow_symlink follow) noexcept {
+    sstring pathname(pathname_view);
+    struct stat st;
+    if (_backend->submits_file_metadata_ops()) {
+        struct ::statx stx;
+        auto sr = co_await submit_file_metadata_op(internal::io_request::make_statx(AT_FDCWD, pathname.c_str(),
+                follow ? 0 : AT_SYMLINK_NOFOLLOW, STATX_BASIC_STATS, &stx));
+        sr.throw_fs_exception_if_error("stat failed", pathname);
+        st = statx_to_stat(stx);
+    } else {
+        auto sr = co_await _thread_pool->submit<syscall_result_extra<struct stat>>(
+                internal::thread_pool_submit_reason::file_operation, [&pathname, follow] {
             struct stat st;
             auto stat_syscall = follow ? stat : lstat;
             auto ret = stat_syscall(pathname.c_str(), &st);
             return wrap_syscall(ret, st);
-        }).then([pathname = sstring(pathname)] (syscall_result_extra<struct stat> sr) {
-            sr.throw_fs_exception_if_error("stat failed", pathname);
-            struct stat& st = sr.extra;
-            stat_data sd;
-            sd.device_id = st.st_dev;
-            sd.inode_number = st.st_ino;
-            sd.mode = st.st_mode;
-            sd.type = stat_to_entry_type(st.st_mode);
-            sd.number_of_links = st.st_nlink;
-            sd.uid = st.st_uid;
-            sd.gid = st.st_gid;
-            sd.rdev = st.st_rdev;
-            sd.size = st.st_size;
-            sd.block_size = st.st_blksize;
-            sd.allocated_size = st.st_blocks * 512UL;
-            sd.time_accessed = timespec_to_time_point(st.st_atim);
-            sd.time_modified = timespec_to_time_point(st.st_mtim);
-            sd.time_changed = timespec_to_time_point(st.st_ctim);
-            return make_ready_future<stat_data>(std::move(sd));
         });
-    });
+        sr.throw_fs_exception_if_error("stat failed", pathname);
+        st = sr.extra;
+    }
+    stat_data sd;
+    sd.device_id = st.st_dev;
+    sd.inode_number = st.st_ino;
+    sd.mode = st.st_mode;
+    sd.type = stat_to_entry_type(st.st_mode);
+    sd.number_of_links = st.st_nlink;
+    sd.uid = st.st_uid;
+    sd.gid = st.st_gid;
+    sd.rdev = st.st_rdev;
+    sd.size = st.st_size;
+    sd.block_size = st.st_blksize;
+    sd.allocated_size = st.st_blocks * 512UL;
+    sd.time_accessed = timespec_to_time_point(st.st_atim);
+    sd.time_modified = timespec_to_time_point(st.st_mtim);
+    sd.time_changed = timespec_to_time_point(st.st_ctim);
+    co_return sd;
 }
 
 future<uint64_t>
@@ -2367,7 +2815,7 @@ reactor::touch_directory(std::string_view name, file_permissions permissions) no
 
 future<>
 reactor::fdatasync(int fd) noexcept {
-    ++_fsyncs;
+    ++_io_stats.fsyncs;
     if (_cfg.bypass_fsync) {
         return make_ready_future<>();
     }
@@ -2408,6 +2856,54 @@ reactor::fdatasync(int fd) noexcept {
     });
 }
 
+future<syscall_result<int>>
+reactor::submit_file_metadata_op(internal::io_request req) noexcept {
+    // Does not go through the I/O queue, but has to be deleted
+    struct metadata_io_desc final : public io_completion {
+        promise<syscall_result<int>> _pr;
+    public:
+        virtual void complete(size_t res) noexcept override {
+            _pr.set_value(int(res), 0);
+            delete this;
+        }
+
+        virtual void set_exception(std::exception_ptr eptr) noexcept override {
+            // Report errors like wrap_syscall() does, so that callers
+            // handle them the same whichever way the syscall was run
+            try {
+                std::rethrow_exception(eptr);
+            } catch (const std::system_error& e) {
+                _pr.set_value(-1, e.code().value());
+            } catch (...) {
+                _pr.set_exception(std::current_exception());
+            }
+            delete this;
+        }
+
+        future<syscall_result<int>> get_future() {
+            return _pr.get_future();
+        }
+    };
+
+    return futurize_invoke([this, req] {
+        auto desc = new metadata_io_desc;
+        auto fut = desc->get_future();
+        _io_sink.submit(desc, req);
+        return fut;
+    });
+}
+
+future<syscall_result<int>>
+reactor::fallocate(int fd, int mode, uint64_t position, uint64_t length) noexcept {
+    if (_backend->submits_file_metadata_ops()) {
+        return submit_file_metadata_op(internal::io_request::make_fallocate(fd, mode, position, length));
+    }
+    return _thread_pool->submit<syscall_result<int>>(
+            internal::thread_pool_submit_reason::file_operation, [fd, mode, position, length] {
+        return wrap_syscall<int>(::fallocate(fd, mode, position, length));
+    });
+}
+
 // Note: terminate if arm_highres_timer throws
 // `when` should always be valid
 void reactor::enable_timer(steady_clock_type::time_point when) noexcept
@@ -2416,6 +2912,7 @@ void reactor::enable_timer(steady_clock_type::time_point when) noexcept
     its.it_interval = {};
     its.it_value = to_timespec(when);
     _backend->arm_highres_timer(its);
+    _hrtimer_reprograms++;
 }
 
 
@@ -2539,14 +3036,31 @@ void reactor::register_metrics() {
         return sm::make_counter("io_threaded_fallbacks", std::bind(&thread_pool::count, _thread_pool.get(), r),
                 sm::description("Total number of io-threaded-fallbacks operations"), { reason_label(reason_str), });
     };
+    auto syscall_latency = [this](const sstring& reason_str, internal::thread_pool_submit_reason r) {
+        static auto reason_label = sm::label("reason");
+        return sm::make_histogram("syscall_latency", sm::description("A histogram of the latency of the work done by the syscall threads, in microseconds, from submission to completion"),
+                { reason_label(reason_str), }, [this, r] { return _thread_pool->latency(r); }).set_skip_when_empty();
+    };
 
     _metric_groups.add_group("reactor", {
             sm::make_gauge("tasks_pending", std::bind(&reactor::pending_task_count, this), sm::description("Number of pending tasks in the queue")),
             // total_operations value:DERIVE:0:U
             sm::make_counter("tasks_processed", std::bind(&reactor::tasks_processed, this), sm::description("Total tasks processed")),
             sm::make_counter("polls", _polls, sm::description("Number of times pollers were executed")),
+            sm::make_counter("hrtimer_wakeups", _hrtimer_wakeups, sm::description("Number of times high resolution timers expired")),
+            sm::make_counter("hrtimer_reprograms", _hrtimer_reprograms, sm::description("Number of times the high resolution timer was reprogrammed")),
+            sm::make_counter("timers_coalesced", _timers_coalesced,
+                    sm::description("Number of high resolution timers expiring in the wakeup of another, saving a wakeup each (see timer::set_slack())")),
             sm::make_gauge("timers_pending", std::bind(&decltype(_timers)::size, &_timers), sm::description("Number of tasks in the timer-pending queue")),
+            sm::make_counter("batched_flushes", _flush_batching_stats.flushes,
+                    sm::description("Number of times output streams with batched flushes were flushed from the poller")),
+            sm::make_counter("batched_flush_bytes", _flush_batching_stats.bytes,
+                    sm::description("Bytes written by batched flushes; divided by batched_flushes, the average size of a send")),
+            sm::make_counter("merged_flushes", _flush_batching_stats.merged,
+                    sm::description("Number of output stream flushes merged into a pending batched flush")),
             sm::make_gauge("utilization", [this] { return (1-_load)  * 100; }, sm::description("CPU utilization")),
+            sm::make_gauge("task_quota_ms", [this] { return std::chrono::duration<double, std::milli>(_task_quota).count(); },
+                    sm::description("Max time between polls currently in effect")),
             sm::make_counter("cpu_busy_ms", [this] () -> int64_t { return total_busy_time() / 1ms; },
                     sm::description("Total cpu busy time in milliseconds")),
             sm::make_counter("sleep_time_ms_total", [this] () -> int64_t { return _total_sleep / 1ms; },
@@ -2569,13 +3083,19 @@ void reactor::register_metrics() {
             sm::make_counter("aio_errors", _io_stats.aio_errors, sm::description("Total aio errors")),
             sm::make_histogram("stalls", sm::description("A histogram of reactor stall durations"), [this] {return _stalls_histogram.to_metrics_histogram();}).aggregate({seastar::metrics::shard_label}).set_skip_when_empty(),
             // total_operations value:DERIVE:0:U
-            sm::make_counter("fsyncs", _fsyncs, sm::description("Total number of fsync operations")),
+            sm::make_counter("fsyncs", _io_stats.fsyncs, sm::description("Total number of fsync operations")),
+            // total_operations value:DERIVE:0:U
+            sm::make_counter("fsyncs_coalesced", _io_stats.fsyncs_coalesced,
+                    sm::description("Total number of file flushes that shared an fsync issued for another concurrent flush instead of issuing their own")),
             // total_operations value:DERIVE:0:U
             io_fallback_counter("aio_fallback", internal::thread_pool_submit_reason::aio_fallback),
             // total_operations value:DERIVE:0:U
             io_fallback_counter("file_operation", internal::thread_pool_submit_reason::file_operation),
             // total_operations value:DERIVE:0:U
             io_fallback_counter("process_operation", internal::thread_pool_submit_reason::process_operation),
+            syscall_latency("aio_fallback", internal::thread_pool_submit_reason::aio_fallback),
+            syscall_latency("file_operation", internal::thread_pool_submit_reason::file_operation),
+            syscall_latency("process_operation", internal::thread_pool_submit_reason::process_operation),
     });
 
     _metric_groups.add_group("memory", {
@@ -2583,15 +3103,85 @@ void reactor::register_metrics() {
                     sm::description("Total number of malloc operations")),
             sm::make_counter("free_operations", [] { return memory::stats().frees(); }, sm::description("Total number of free operations")),
             sm::make_counter("cross_cpu_free_operations", [] { return memory::stats().cross_cpu_frees(); }, sm::description("Total number of cross cpu free")),
+            sm::make_counter("cross_cpu_free_batches", [] { return memory::stats().cross_cpu_free_batches(); },
+                    sm::description("Total number of batches in which cross cpu frees were handed over to the owning cpu")),
             sm::make_gauge("malloc_live_objects", [] { return memory::stats().live_objects(); }, sm::description("Number of live objects")),
             sm::make_current_bytes("free_memory", [] { return memory::stats().free_memory(); }, sm::description("Free memory size in bytes")),
             sm::make_current_bytes("total_memory", [] { return memory::stats().total_memory(); }, sm::description("Total memory size in bytes")),
             sm::make_current_bytes("allocated_memory", [] { return memory::stats().allocated_memory(); }, sm::description("Allocated memory size in bytes")),
             sm::make_counter("reclaims_operations", [] { return memory::stats().reclaims(); }, sm::description("Total reclaims operations")),
             sm::make_counter("malloc_failed", [] { return memory::stats().failed_allocations(); }, sm::description("Total count of failed memory allocations")),
-            sm::make_counter("oversized_allocs", [] { return memory::stats().large_allocations(); }, sm::description("Total count of oversized memory allocations"))
+            sm::make_counter("oversized_allocs", [] { return memory::stats().large_allocations(); }, sm::description("Total count of oversized memory allocations")),
+            sm::make_histogram("reclaim_latency", sm::description("A histogram of reclaim latencies in microseconds, by where reclaim ran"),
+                    {sm::label("scope")("sync")}, [] { return memory::reclaim_latency_histogram(memory::reclaimer_scope::sync); }).set_skip_when_empty(),
+            sm::make_histogram("reclaim_latency", sm::description("A histogram of reclaim latencies in microseconds, by where reclaim ran"),
+                    {sm::label("scope")("async")}, [] { return memory::reclaim_latency_histogram(memory::reclaimer_scope::async); }).set_skip_when_empty(),
+    });
+
+    auto backing_label = sm::label("backing");
+    _metric_groups.add_group("memory", {
+            sm::make_current_bytes("backed_memory", [] { return memory::backing_stats().hugetlb_2m; },
+                    sm::description("Memory size in bytes, by kind of pages backing it"), {backing_label("hugetlb_2m")}).set_skip_when_empty(),
+            sm::make_current_bytes("backed_memory", [] { return memory::backing_stats().hugetlb_1g; },
+                    sm::description("Memory size in bytes, by kind of pages backing it"), {backing_label("hugetlb_1g")}).set_skip_when_empty(),
+            sm::make_current_bytes("backed_memory", [] { return memory::backing_stats().hugetlbfs; },
+                    sm::description("Memory size in bytes, by kind of pages backing it"), {backing_label("hugetlbfs")}).set_skip_when_empty(),
+            sm::make_current_bytes("backed_memory", [] { return memory::backing_stats().regular; },
+                    sm::description("Memory size in bytes, by kind of pages backing it"), {backing_label("regular")}).set_skip_when_empty(),
+            sm::make_current_bytes("lent_memory", [] { return memory::backing_stats().lent; },
+                    sm::description("Free memory in bytes handed over to other shards")).set_skip_when_empty(),
+            sm::make_current_bytes("borrowed_memory", [] { return memory::backing_stats().borrowed; },
+                    sm::description("Memory in bytes taken over from other shards")).set_skip_when_empty(),
+    });
+
+    _metric_groups.add_group("coroutines", {
+            sm::make_counter("frame_allocations", [] { return internal::get_coroutine_frame_stats().allocations; },
+                    sm::description("Total number of coroutine frames allocated")),
+            sm::make_counter("frame_pool_hits", [] { return internal::get_coroutine_frame_stats().pool_hits; },
+                    sm::description("Number of coroutine frames reused from the per-shard frame pool")),
+            sm::make_current_bytes("frame_pool_bytes", [] { return internal::get_coroutine_frame_stats().pooled_bytes; },
+                    sm::description("Memory held by the free coroutine frames of the per-shard frame pool")),
     });
 
+    _metric_groups.add_group("continuations", {
+            sm::make_counter("allocations", [] { return internal::get_continuation_chain_stats().allocations; },
+                    sm::description("Total number of continuations allocated")),
+            sm::make_counter("chained", [] { return internal::get_continuation_chain_stats().chained; },
+                    sm::description("Number of continuations carved from the arena of their then() chain")),
+            sm::make_counter("chain_arenas", [] { return internal::get_continuation_chain_stats().arenas; },
+                    sm::description("Number of arenas allocated for then() chains")),
+    });
+
+    std::vector<sm::metric_definition> small_pool_metrics;
+    auto size_class_label = sm::label("size_class");
+    for (unsigned i = 0; i < memory::small_pool_count(); ++i) {
+        auto object_size = memory::small_pool_statistics(i).object_size;
+        // Size classes that are never used are skipped when empty, to keep
+        // the number of series in check
+        std::vector<sm::label_instance> labels{size_class_label(object_size)};
+        small_pool_metrics.emplace_back(sm::make_counter("small_pool_allocs", [i] { return memory::small_pool_statistics(i).allocs; },
+                sm::description("Total number of allocations from the small object pool"), labels).set_skip_when_empty());
+        small_pool_metrics.emplace_back(sm::make_counter("small_pool_frees", [i] { return memory::small_pool_statistics(i).frees; },
+                sm::description("Total number of frees to the small object pool"), labels).set_skip_when_empty());
+        small_pool_metrics.emplace_back(sm::make_gauge("small_pool_live_objects", [i] { return memory::small_pool_statistics(i).use_count; },
+                sm::description("Number of live objects in the small object pool"), labels).set_skip_when_empty());
+        small_pool_metrics.emplace_back(sm::make_current_bytes("small_pool_memory", [i] { return memory::small_pool_statistics(i).memory; },
+                sm::description("Memory held by the small object pool in bytes"), labels).set_skip_when_empty());
+        small_pool_metrics.emplace_back(sm::make_current_bytes("small_pool_unused_memory", [i] { return memory::small_pool_statistics(i).unused; },
+                sm::description("Memory held by the small object pool but not used by live objects, in bytes"), labels).set_skip_when_empty());
+    }
+    _metric_groups.add_group("memory", std::move(small_pool_metrics));
+
+    std::vector<sm::metric_definition> loop_phase_metrics;
+    auto phase_label = sm::label("phase");
+    for (size_t i = 0; i < _loop_phase_time.size(); ++i) {
+        loop_phase_metrics.emplace_back(sm::make_counter("loop_phase_time_ms", [this, i] () -> int64_t { return _loop_phase_time[i] / 1ms; },
+                sm::description("Time the reactor loop spent running tasks and in each kind of poller, in milliseconds. "
+                        "Pollers are timed in a sample of the polls, so their times are estimates"),
+                {phase_label(loop_phase_name(internal::loop_phase(i)))}));
+    }
+    _metric_groups.add_group("reactor", std::move(loop_phase_metrics));
+
     _metric_groups.add_group("reactor", {
             sm::make_counter("logging_failures", [] { return logging_failures; }, sm::description("Total number of logging failures")),
             // total_operations value:DERIVE:0:U
@@ -2600,6 +3190,8 @@ void reactor::register_metrics() {
             sm::make_counter("abandoned_failed_futures", _abandoned_failed_futures, sm::description("Total number of abandoned failed futures, futures destroyed while still containing an exception")),
     });
 
+    _backend->register_metrics(_metric_groups);
+
     _metric_groups.add_group("reactor", {
         sm::make_counter("fstream_reads", _io_stats.fstream_reads,
                 sm::description(
@@ -2646,14 +3238,27 @@ seastar::internal::log_buf::inserter_iterator do_dump_task_queue(seastar::intern
 void reactor::run_tasks(task_queue& tq) {
     // Make sure new tasks will inherit our scheduling group
     *internal::current_scheduling_group_ptr() = scheduling_group(tq._id);
+    auto& trace_slot = *internal::current_trace_slot_ptr();
+    auto& cpu_tag_slot = *internal::current_cpu_tag_slot_ptr();
     auto& tasks = tq._q;
+    auto t_traced = _tracing ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
     while (!tasks.empty()) {
         auto tsk = tasks.front();
         tasks.pop_front();
         STAP_PROBE(seastar, reactor_run_tasks_single_start);
         internal::task_histogram_add_task(*tsk);
         _current_task = tsk;
-        tsk->run_and_dispose();
+        trace_slot = tsk->trace_slot();
+        cpu_tag_slot = tsk->cpu_tag_slot();
+        if (__builtin_expect(cpu_tag_slot != _cpu_tag_charged, false)) {
+            _cpu_tag_charged = cpu_tag_slot;
+            cpu_accounting::internal::switch_tag(cpu_tag_slot);
+        }
+        if (__builtin_expect(_tracing != nullptr, false)) {
+            run_traced_task(*tsk, tq._id);
+        } else {
+            tsk->run_and_dispose();
+        }
         _current_task = nullptr;
         STAP_PROBE(seastar, reactor_run_tasks_single_end);
         ++tq._tasks_processed;
@@ -2675,19 +3280,42 @@ void reactor::run_tasks(task_queue& tq) {
             }
         }
     }
+    // What runs outside of tasks, e.g. timer callbacks, is in no span nor tag
+    trace_slot = 0;
+    cpu_tag_slot = 0;
+    if (_cpu_tag_charged) {
+        _cpu_tag_charged = 0;
+        cpu_accounting::internal::switch_tag(0);
+    }
+    if (_tracing && t_traced != std::chrono::steady_clock::time_point()) {
+        _tracing->record(internal::task_trace_event::kind::scheduling_group, t_traced, std::chrono::steady_clock::now(), tq._id);
+    }
+}
+
+void reactor::run_traced_task(task& t, unsigned sg_index) noexcept {
+    // The task is gone once it ran
+    auto type = &typeid(t);
+    auto waiting = t.waiting_task();
+    auto waiting_type = waiting ? &typeid(*waiting) : nullptr;
+    auto start = std::chrono::steady_clock::now();
+    t.run_and_dispose();
+    // The task may have disabled tracing, or enabled it anew
+    if (_tracing) {
+        _tracing->record(internal::task_trace_event::kind::task, start, std::chrono::steady_clock::now(), sg_index, type, waiting_type);
+    }
 }
 
 namespace {
 
 #ifdef SEASTAR_SHUFFLE_TASK_QUEUE
-void shuffle(task*& t, circular_buffer<task*>& q) {
+void shuffle(task*& t, chunked_deque<task*>& q) {
     static thread_local std::mt19937 gen = std::mt19937(std::default_random_engine()());
     std::uniform_int_distribution<size_t> tasks_dist{0, q.size() - 1};
     auto& to_swap = q[tasks_dist(gen)];
     std::swap(to_swap, t);
 }
 #else
-void shuffle(task*&, circular_buffer<task*>&) {
+void shuffle(task*&, chunked_deque<task*>&) {
 }
 #endif
 
@@ -2754,7 +3382,7 @@ reactor::do_check_lowres_timers() const noexcept {
 class reactor::kernel_submit_work_pollfn final : public simple_pollfn<true> {
     reactor& _r;
 public:
-    kernel_submit_work_pollfn(reactor& r) : _r(r) {}
+    kernel_submit_work_pollfn(reactor& r) : simple_pollfn<true>(internal::loop_phase::io), _r(r) {}
     virtual bool poll() override final {
         return _r._backend->kernel_submit_work();
     }
@@ -2792,7 +3420,7 @@ class reactor::signal_pollfn final : public reactor::pollfn {
 class reactor::batch_flush_pollfn final : public simple_pollfn<true> {
     reactor& _r;
 public:
-    batch_flush_pollfn(reactor& r) : _r(r) {}
+    batch_flush_pollfn(reactor& r) : simple_pollfn<true>(internal::loop_phase::network), _r(r) {}
     virtual bool poll() final override {
         return _r.flush_tcp_batches();
     }
@@ -2801,7 +3429,7 @@ class reactor::batch_flush_pollfn final : public simple_pollfn<true> {
 class reactor::reap_kernel_completions_pollfn final : public reactor::pollfn {
     reactor& _r;
 public:
-    reap_kernel_completions_pollfn(reactor& r) : _r(r) {}
+    reap_kernel_completions_pollfn(reactor& r) : pollfn(internal::loop_phase::io), _r(r) {}
     virtual bool poll() final override {
         return _r.reap_kernel_completions();
     }
@@ -2823,7 +3451,7 @@ class reactor::io_queue_submission_pollfn final : public reactor::pollfn {
     timer<> _nearest_wakeup { [this] { _armed = false; } };
     bool _armed = false;
 public:
-    io_queue_submission_pollfn(reactor& r) : _r(r) {}
+    io_queue_submission_pollfn(reactor& r) : pollfn(internal::loop_phase::io), _r(r) {}
     virtual bool poll() final override {
         return _r.flush_pending_aio();
     }
@@ -2853,6 +3481,9 @@ class reactor::io_queue_submission_pollfn final : public reactor::pollfn {
 // doesn't have any side effects.
 //
 // We'll take care of those items when we wake up for another reason.
+//
+// This is also where objects we freed for other cpus are handed over to
+// them, so the batches don't outlive a poll cycle.
 class reactor::drain_cross_cpu_freelist_pollfn final : public simple_pollfn<true> {
 public:
     virtual bool poll() final override {
@@ -2868,7 +3499,7 @@ class reactor::lowres_timer_pollfn final : public reactor::pollfn {
     timer<> _nearest_wakeup { [this] { _armed = false; } };
     bool _armed = false;
 public:
-    lowres_timer_pollfn(reactor& r) : _r(r) {}
+    lowres_timer_pollfn(reactor& r) : pollfn(internal::loop_phase::timers), _r(r) {}
     virtual bool poll() final override {
         return _r.do_expire_lowres_timers();
     }
@@ -2902,17 +3533,12 @@ class reactor::lowres_timer_pollfn final : public reactor::pollfn {
 class reactor::smp_pollfn final : public reactor::pollfn {
     reactor& _r;
 public:
-    smp_pollfn(reactor& r) : _r(r) {}
+    smp_pollfn(reactor& r) : pollfn(internal::loop_phase::smp), _r(r) {}
     virtual bool poll() final override {
-        // Avoid short-circuiting with `||` since there are side effects
-        // we want to take place (instantiating tasks from the alien queue).
-        // Cast to int to silence gcc -Wbitwise-instead-of-logical.
-        return (int(smp::poll_queues()) |
-                int(_r._alien.poll_queues()));
+        return smp::poll_queues();
     }
     virtual bool pure_poll() final override {
-        return (smp::pure_poll_queues() ||
-                _r._alien.pure_poll_queues());
+        return smp::pure_poll_queues();
     }
     virtual bool try_enter_interrupt_mode() override {
         // systemwide_memory_barrier() is very slow if run concurrently,
@@ -2935,6 +3561,26 @@ class reactor::smp_pollfn final : public reactor::pollfn {
     }
 };
 
+// Registered right after the smp poller, which announces that the reactor
+// sleeps to the alien threads as well
+class reactor::alien_pollfn final : public reactor::pollfn {
+    reactor& _r;
+public:
+    alien_pollfn(reactor& r) : pollfn(internal::loop_phase::alien), _r(r) {}
+    virtual bool poll() final override {
+        return _r._alien.poll_queues();
+    }
+    virtual bool pure_poll() final override {
+        return _r._alien.pure_poll_queues();
+    }
+    virtual bool try_enter_interrupt_mode() override {
+        // The smp poller raised _sleeping and issued the barrier already
+        return !poll();
+    }
+    virtual void exit_interrupt_mode() override final {
+    }
+};
+
 class reactor::execution_stage_pollfn final : public reactor::pollfn {
     internal::execution_stage_manager& _esm;
 public:
@@ -2957,7 +3603,7 @@ class reactor::execution_stage_pollfn final : public reactor::pollfn {
 class reactor::syscall_pollfn final : public reactor::pollfn {
     reactor& _r;
 public:
-    syscall_pollfn(reactor& r) : _r(r) {}
+    syscall_pollfn(reactor& r) : pollfn(internal::loop_phase::io), _r(r) {}
     virtual bool poll() final override {
         return _r._thread_pool->complete();
     }
@@ -3021,20 +3667,20 @@ void reactor::stop_aio_eventfd_loop() {
 inline
 bool
 reactor::have_more_tasks() const {
-    return _active_task_queues.size() + _activating_task_queues.size();
+    return _task_queue_groups[0]->has_tasks();
 }
 
-void reactor::insert_active_task_queue(task_queue* tq) {
-    tq->_active = true;
+void reactor::task_queue_group::insert_active(sched_entity* e) {
+    e->_active = true;
     auto& atq = _active_task_queues;
-    auto less = task_queue::indirect_compare();
-    if (atq.empty() || less(atq.back(), tq)) {
+    auto less = sched_entity::indirect_compare();
+    if (atq.empty() || less(atq.back(), e)) {
         // Common case: idle->working
         // Common case: CPU intensive task queue going to the back
-        atq.push_back(tq);
+        atq.push_back(e);
     } else {
         // Common case: newly activated queue preempting everything else
-        atq.push_front(tq);
+        atq.push_front(e);
         // Less common case: newly activated queue behind something already active
         size_t i = 0;
         while (i + 1 != atq.size() && !less(atq[i], atq[i+1])) {
@@ -3044,20 +3690,32 @@ void reactor::insert_active_task_queue(task_queue* tq) {
     }
 }
 
-reactor::task_queue* reactor::pop_active_task_queue(sched_clock::time_point now) {
-    task_queue* tq = _active_task_queues.front();
+void
+reactor::task_queue_group::insert_activating() {
+    // Quadratic, but since we expect the common cases in insert_active() to dominate, faster
+    for (auto&& e : _activating_task_queues) {
+        insert_active(e);
+    }
+    _activating_task_queues.clear();
+}
+
+reactor::sched_entity* reactor::task_queue_group::pop_active() noexcept {
+    insert_activating();
+    auto* e = _active_task_queues.front();
     _active_task_queues.pop_front();
-    tq->_starvetime += now - tq->_ts;
-    return tq;
+    _last_vruntime = std::max(e->_vruntime, _last_vruntime);
+    return e;
 }
 
-void
-reactor::insert_activating_task_queues() {
-    // Quadratic, but since we expect the common cases in insert_active_task_queue() to dominate, faster
-    for (auto&& tq : _activating_task_queues) {
-        insert_active_task_queue(tq);
+// Picks the entity with the lowest vruntime from the root group down
+reactor::task_queue* reactor::pop_active_task_queue(sched_clock::time_point now) {
+    auto* e = _task_queue_groups[0]->pop_active();
+    if (e->_is_group) {
+        e = static_cast<task_queue_group*>(e)->pop_active();
     }
-    _activating_task_queues.clear();
+    auto* tq = static_cast<task_queue*>(e);
+    tq->_starvetime += now - tq->_ts;
+    return tq;
 }
 
 void reactor::add_task(task* t) noexcept {
@@ -3116,23 +3774,23 @@ reactor::run_some_tasks() {
     lowres_clock::update();
 
     sched_clock::time_point t_run_completed = now();
+    auto t_first_run_started = t_run_completed;
+    auto& root = *_task_queue_groups[0];
+    _task_quota_window.runs++;
+    _task_quota_window.active_queues += root._active_task_queues.size() + root._activating_task_queues.size();
+    _loop_phase = internal::loop_phase::tasks;
     STAP_PROBE(seastar, reactor_run_tasks_start);
     _cpu_stall_detector->start_task_run(t_run_completed);
     do {
         auto t_run_started = t_run_completed;
-        insert_activating_task_queues();
         task_queue* tq = pop_active_task_queue(t_run_started);
-        _last_vruntime = std::max(tq->_vruntime, _last_vruntime);
         run_tasks(*tq);
         t_run_completed = now();
         auto delta = t_run_completed - t_run_started;
         account_runtime(*tq, delta);
         tq->_ts = t_run_completed;
-        if (!tq->_q.empty()) {
-            insert_active_task_queue(tq);
-        } else {
-            tq->_active = false;
-        }
+        charge_cpu_limit(*tq, t_run_completed, delta);
+        requeue(*tq);
         // We must not use internal::scheduler_need_preempt() below,
         // since in debug mode we'll never have two successive calls
         // to internal::scheduler_need_preempt() both return true, so
@@ -3141,6 +3799,10 @@ reactor::run_some_tasks() {
         // Settle on a regular need_preempt(), which will return true in
         // debug mode.
     } while (have_more_tasks() && !need_preempt());
+    _task_quota_window.preempted_runs += have_more_tasks();
+    _task_quota_window.max_run = std::max(_task_quota_window.max_run, t_run_completed - t_first_run_started);
+    _loop_phase_time[size_t(internal::loop_phase::tasks)] += t_run_completed - t_first_run_started;
+    _loop_phase = internal::loop_phase::other;
     _cpu_stall_detector->end_task_run(t_run_completed);
     STAP_PROBE(seastar, reactor_run_tasks_end);
     *internal::current_scheduling_group_ptr() = default_scheduling_group(); // Prevent inheritance from last group run
@@ -3148,7 +3810,8 @@ reactor::run_some_tasks() {
 
 void
 reactor::activate(task_queue& tq) {
-    if (tq._active) {
+    // A throttled queue is activated when its CPU limit period ends
+    if (tq._active || tq._throttled) {
         return;
     }
     // If activate() was called, the task queue is likely network-bound or I/O bound, not CPU-bound. As
@@ -3157,19 +3820,83 @@ reactor::activate(task_queue& tq) {
     // bound later.
     //
     // FIXME: different scheduling groups have different sensitivity to jitter, take advantage
-    tq._vruntime = std::max(_last_vruntime, tq._vruntime);
+    auto& g = *tq._parent;
+    tq._vruntime = std::max(g._last_vruntime, tq._vruntime);
     auto now = reactor::now();
     tq._waittime += now - tq._ts;
     tq._ts = now;
-    _activating_task_queues.push_back(&tq);
+    g._activating_task_queues.push_back(&tq);
+    // A supergroup is active while any of its queues is, the same
+    // advantage limit applies to it among its siblings
+    if (g._parent && !g._active) {
+        g._active = true;
+        g._vruntime = std::max(g._parent->_last_vruntime, g._vruntime);
+        g._parent->_activating_task_queues.push_back(&g);
+    }
+}
+
+// Puts back the queue that just ran, and its supergroup, if they still have tasks
+void
+reactor::requeue(task_queue& tq) {
+    auto& g = *tq._parent;
+    if (!tq._q.empty() && !tq._throttled) {
+        g.insert_active(&tq);
+    } else {
+        tq._active = false;
+    }
+    if (g._parent) {
+        if (g.has_tasks()) {
+            g._parent->insert_active(&g);
+        } else {
+            g._active = false;
+        }
+    }
+}
+
+// Throttles the queue until the end of the current period once it has run
+// for its share of it
+void
+reactor::charge_cpu_limit(task_queue& tq, sched_clock::time_point now, sched_clock::duration runtime) {
+    if (!tq._cpu_limit) {
+        return;
+    }
+    if (now - tq._period_start >= cpu_limit_period) {
+        tq._period_start = now - runtime;
+        tq._period_runtime = {};
+    }
+    tq._period_runtime += runtime;
+    auto quota = std::chrono::duration_cast<sched_clock::duration>(cpu_limit_period * tq._cpu_limit);
+    if (tq._period_runtime >= quota) {
+        tq._throttled = true;
+        tq._throttles++;
+        tq._unthrottle_timer.arm(tq._period_start + cpu_limit_period);
+    }
+}
+
+void
+reactor::unthrottle(task_queue& tq) {
+    auto now = reactor::now();
+    tq._throttled = false;
+    tq._period_start = now;
+    tq._period_runtime = {};
+    if (!tq._q.empty()) {
+        tq._throttled_time += now - tq._ts;
+        // the time spent throttled is not waiting for work
+        tq._ts = now;
+        activate(tq);
+    }
 }
 
 void reactor::service_highres_timer() noexcept {
-    _timers.complete(_expired_timers, [this] () noexcept {
+    auto expired = _timers.complete(_expired_timers, [this] () noexcept {
         if (!_timers.empty()) {
             enable_timer(_timers.get_next_timeout());
         }
     });
+    if (expired) {
+        _hrtimer_wakeups++;
+        _timers_coalesced += expired - 1;
+    }
 }
 
 int reactor::run() noexcept {
@@ -3205,6 +3932,7 @@ int reactor::do_run() {
     // 6. reap kernel events completion: some of the submissions from last step may return immediately.
     //                                   For example if we are dealing with poll() on a fd that has events.
     poller smp_poller(std::make_unique<smp_pollfn>(*this));
+    poller alien_poller(std::make_unique<alien_pollfn>(*this));
 
     poller reap_kernel_completions_poller(std::make_unique<reap_kernel_completions_pollfn>(*this));
     poller io_queue_submission_poller(std::make_unique<io_queue_submission_pollfn>(*this));
@@ -3267,17 +3995,64 @@ int reactor::do_run() {
     });
     load_timer.arm_periodic(1s);
 
-    itimerspec its = seastar::posix::to_relative_itimerspec(_cfg.task_quota, _cfg.task_quota);
+    itimerspec its = seastar::posix::to_relative_itimerspec(_task_quota, _task_quota);
     _task_quota_timer.timerfd_settime(0, its);
     auto& task_quote_itimerspec = its;
 
+    timer<lowres_clock> task_quota_tuning_timer;
+    if (_cfg.task_quota_auto) {
+        task_quota_tuning_timer.set_callback([this, &its] {
+            if (tune_task_quota()) {
+                its = seastar::posix::to_relative_itimerspec(_task_quota, _task_quota);
+                _task_quota_timer.timerfd_settime(0, its);
+            }
+        });
+        task_quota_tuning_timer.arm_periodic(100ms);
+    }
+
     struct sigaction sa_block_notifier = {};
     sa_block_notifier.sa_handler = &reactor::block_notifier;
     sa_block_notifier.sa_flags = SA_RESTART;
     auto r = sigaction(internal::cpu_stall_detector::signal_number(), &sa_block_notifier, nullptr);
     SEASTAR_ASSERT(r == 0);
 
+    timer<lowres_clock> cpu_profiler_timer([this] {
+        _cpu_profiler->drain();
+    });
+    cpu_profiler_timer.arm_periodic(1s);
+
+    metrics::metric_groups cpu_tag_metrics;
+    timer<lowres_clock> cpu_tag_metrics_timer([&cpu_tag_metrics] {
+        cpu_accounting::internal::export_top_tags(cpu_tag_metrics);
+    });
+    cpu_tag_metrics_timer.arm_periodic(10s);
+
+    timer<lowres_clock> tsc_resync_timer([] {
+        internal::tsc_resync();
+    });
+    if (_cfg.tsc_clock) {
+        internal::tsc_resync();
+        tsc_resync_timer.arm_periodic(1s);
+    }
+
+    timer<lowres_clock> memory_lending_timer([shortages = memory::internal::free_memory_shortages()] () mutable {
+        // A shard which ran short of free memory since the last tick would
+        // only borrow back what it lends
+        if (std::exchange(shortages, memory::internal::free_memory_shortages()) != shortages) {
+            return;
+        }
+        // Keep a quarter of the share the shard started with, and release
+        // a bounded amount per tick: releasing memory stalls the reactor
+        auto backing = memory::backing_stats();
+        auto share = memory::stats().total_memory() + backing.lent - backing.borrowed;
+        memory::lend_free_memory(share / 4, 64 << 20);
+    });
+    if (_cfg.memory_rebalance) {
+        memory_lending_timer.arm_periodic(1s);
+    }
+
     bool idle = false;
+    unsigned idle_polls = 0;
 
     auto check_for_work = [this] () {
         return poll_once() || have_more_tasks();
@@ -3285,10 +4060,13 @@ int reactor::do_run() {
     const noncopyable_function<bool()> pure_check_for_work = [this] () {
         return pure_poll_once() || have_more_tasks();
     };
+    _quiescent_epoch = &internal::local_quiescent_epoch();
     while (true) {
+        _quiescent_epoch->pass();
         run_some_tasks();
         if (_stopped) {
             load_timer.cancel();
+            task_quota_tuning_timer.cancel();
             // Final tasks may include sending the last response to cpu 0, so run them
             while (have_more_tasks()) {
                 run_some_tasks();
@@ -3297,6 +4075,7 @@ int reactor::do_run() {
                 run_tasks(*_at_destroy_tasks);
             }
             _finished_running_tasks = true;
+            _quiescent_epoch->idle();
             _smp->arrive_at_event_loop_end();
             if (_id == 0) {
                 _smp->join_all();
@@ -3309,9 +4088,13 @@ int reactor::do_run() {
         lowres_clock::update(); // Don't delay expiring lowres timers
         if (check_for_work()) {
             if (idle) {
+                if (_cfg.idle_poll_adaptive) {
+                    _idle_poll.learn(idle_end - idle_start);
+                }
                 _total_idle += idle_end - idle_start;
                 idle_start = idle_end;
                 idle = false;
+                idle_polls = 0;
             }
         } else {
             idle_end = now();
@@ -3319,6 +4102,11 @@ int reactor::do_run() {
                 idle_start = idle_end;
                 idle = true;
             }
+            // Before idling, help out other shards with whatever they
+            // have queued via smp::submit_stealable_to()
+            if (smp::steal_work()) {
+                continue;
+            }
             bool go_to_sleep = true;
             try {
                 // we can't run check_for_work(), because that can run tasks in the context
@@ -3330,8 +4118,12 @@ int reactor::do_run() {
                 report_exception("Exception while running idle cpu handler", std::current_exception());
             }
             if (go_to_sleep) {
-                internal::cpu_relax();
-                if (idle_end - idle_start > _cfg.max_poll_time) {
+                if (_cfg.idle_poll_adaptive) {
+                    idle_pause(idle_polls++);
+                } else {
+                    internal::cpu_relax();
+                }
+                if (idle_end - idle_start > idle_poll_time()) {
                     // Turn off the task quota timer to avoid spurious wakeups
                     struct itimerspec zero_itimerspec = {};
                     _task_quota_timer.timerfd_settime(0, zero_itimerspec);
@@ -3353,11 +4145,52 @@ int reactor::do_run() {
     // This is needed because the reactor is destroyed from the thread_local destructors. If
     // the I/O queue happens to use any other infrastructure that is also kept this way (for
     // instance, collectd), we will not have any way to guarantee who is destroyed first.
+    _io_queue_aliases.clear();
     _io_queues.clear();
     return _return;
 }
 
 
+std::chrono::nanoseconds
+reactor::idle_poll_time() const noexcept {
+    if (!_cfg.idle_poll_adaptive) {
+        return _cfg.max_poll_time;
+    }
+    return _idle_poll.poll_time();
+}
+
+#if defined(__x86_64__)
+static bool have_waitpkg() noexcept {
+    static const bool have = [] {
+        unsigned a, b, c, d;
+        return __get_cpuid_count(7, 0, &a, &b, &c, &d) && (c & (1u << 5));
+    }();
+    return have;
+}
+
+[[gnu::target("waitpkg")]]
+static void tpause(uint64_t cycles) noexcept {
+    // 0 selects the C0.2 state: slower to wake up than C0.1, but saves more
+    // power; the wait ends early on interrupts
+    _tpause(0, __rdtsc() + cycles);
+}
+#endif
+
+void
+reactor::idle_pause(unsigned polls) noexcept {
+#if defined(__x86_64__)
+    if (have_waitpkg()) {
+        // About a microsecond, short next to the idle poll time
+        tpause(2000);
+        return;
+    }
+#endif
+    // Back off exponentially, to a few microseconds between polls
+    for (unsigned i = 0, n = 1u << std::min(polls, 6u); i < n; i++) {
+        internal::cpu_relax();
+    }
+}
+
 void
 reactor::try_sleep() {
     for (auto i = _pollers.begin(); i != _pollers.end(); ++i) {
@@ -3370,7 +4203,9 @@ reactor::try_sleep() {
         }
     }
 
+    _quiescent_epoch->idle();
     _backend->wait_and_process_events(&_active_sigmask);
+    _quiescent_epoch->pass();
 
     for (auto i = _pollers.rbegin(); i != _pollers.rend(); ++i) {
         (*i)->exit_interrupt_mode();
@@ -3380,9 +4215,23 @@ reactor::try_sleep() {
 bool
 reactor::poll_once() {
     bool work = false;
-    for (auto c : _pollers) {
-        work |= c->poll();
+    if (++_loop_phase_sample != loop_phase_sample_interval) {
+        for (auto c : _pollers) {
+            _loop_phase = c->phase;
+            work |= c->poll();
+        }
+    } else {
+        _loop_phase_sample = 0;
+        auto t = now();
+        for (auto c : _pollers) {
+            _loop_phase = c->phase;
+            work |= c->poll();
+            auto t_polled = now();
+            _loop_phase_time[size_t(c->phase)] += (t_polled - t) * loop_phase_sample_interval;
+            t = t_polled;
+        }
     }
+    _loop_phase = internal::loop_phase::other;
 
     return work;
 }
@@ -3557,7 +4406,17 @@ void smp_message_queue::stop() {
 void smp_message_queue::move_pending() {
     auto begin = _tx.a.pending_fifo.cbegin();
     auto end = _tx.a.pending_fifo.cend();
-    end = _pending.push(begin, end);
+    // Stamp whatever can fit into the ring before it becomes visible
+    // to the remote shard
+    auto now = clock_type::now();
+    std::for_each(begin, begin + std::min(_tx.a.pending_fifo.size(), queue_length), [now] (work_item* wi) {
+        wi->sent_at = now;
+    });
+    auto pushed = _pending.push(begin, end);
+    if (pushed != end) {
+        ++_queue_full;
+    }
+    end = pushed;
     if (begin == end) {
         return;
     }
@@ -3567,6 +4426,25 @@ void smp_message_queue::move_pending() {
     _current_queue_length += nr;
     _last_snt_batch = nr;
     _sent += nr;
+    _occupancy.add(_current_queue_length);
+}
+
+void smp_message_queue::set_min_batch_size(size_t n) noexcept {
+    _min_batch_size = std::clamp(n, min_batch_size, max_batch_size);
+    _batch_size = std::max(_batch_size, _min_batch_size);
+}
+
+void smp_message_queue::adjust_batch_size(clock_type::duration batching, clock_type::duration delivery) noexcept {
+    // Holding requests back only pays off while they would otherwise
+    // sit in the ring anyway. If they wait for the batch to fill up for
+    // longer than the remote shard takes to pick them up, flush sooner,
+    // and if the remote shard is slow to respond, batch more to save on
+    // cross-core traffic and wakeups.
+    if (batching > delivery) {
+        _batch_size = std::max(_batch_size / 2, _min_batch_size);
+    } else if (batching * 2 < delivery) {
+        _batch_size = std::min(_batch_size + 1, max_batch_size);
+    }
 }
 
 bool smp_message_queue::pure_poll_tx() const {
@@ -3589,9 +4467,10 @@ void smp_message_queue::submit_item(shard_id t, smp_timeout_clock::time_point ti
     }
     _tx.a.pending_fifo.push_back(item.get());
     // no exceptions from this point
+    item->queued_at = clock_type::now();
     item.release();
     units_fut.get().release();
-    if (_tx.a.pending_fifo.size() >= batch_size) {
+    if (_tx.a.pending_fifo.size() >= _batch_size) {
         move_pending();
     }
   });
@@ -3671,12 +4550,26 @@ size_t smp_message_queue::process_queue(lf_queue& q, Func process) {
 }
 
 size_t smp_message_queue::process_completions(shard_id t) {
-    auto nr = process_queue<prefetch_cnt*2>(_completed, [t] (work_item* wi) {
+    clock_type::time_point now;
+    clock_type::duration batching{}, delivery{};
+    auto nr = process_queue<prefetch_cnt*2>(_completed, [&] (work_item* wi) {
+        if (now == clock_type::time_point{}) {
+            now = clock_type::now();
+        }
+        _latency.add(std::chrono::duration_cast<std::chrono::nanoseconds>(now - wi->queued_at).count());
+        batching += wi->sent_at - wi->queued_at;
+        delivery += wi->received_at - wi->sent_at;
+        if (auto tracer = engine().tracing()) {
+            tracer->record(internal::task_trace_event::kind::smp_message, wi->queued_at, now, t);
+        }
         wi->complete();
         auto ssg_id = internal::smp_service_group_id(wi->ssg);
         get_smp_service_groups_semaphore(ssg_id, t).signal();
         delete wi;
     });
+    if (nr) {
+        adjust_batch_size(batching / nr, delivery / nr);
+    }
     _current_queue_length -= nr;
     _compl += nr;
     _last_cmpl_batch = nr;
@@ -3690,8 +4583,71 @@ void smp_message_queue::flush_request_batch() {
     }
 }
 
-size_t smp_message_queue::process_incoming() {
-    auto nr = process_queue<prefetch_cnt>(_pending, [] (work_item* wi) {
+void smp_message_queue::queue_destroy(internal::cross_shard_destroy_item* item) noexcept {
+    if (_tx.a.pending_destroys) {
+        _tx.a.pending_destroys_tail->next = item;
+    } else {
+        _tx.a.pending_destroys = item;
+    }
+    _tx.a.pending_destroys_tail = item;
+}
+
+void smp_message_queue::flush_destroy_batch(shard_id t) noexcept {
+    if (!_tx.a.pending_destroys) {
+        return;
+    }
+    // Owns the items, which are deleted with the request on this shard
+    // once the destination shard has destroyed their contents
+    struct destroy_batch {
+        internal::cross_shard_destroy_item* head;
+        explicit destroy_batch(internal::cross_shard_destroy_item* h) noexcept : head(h) {}
+        destroy_batch(destroy_batch&& o) noexcept : head(std::exchange(o.head, nullptr)) {}
+        ~destroy_batch() {
+            while (head) {
+                delete std::exchange(head, head->next);
+            }
+        }
+        void operator()() noexcept {
+            for (auto item = head; item; item = item->next) {
+                item->destroy();
+            }
+        }
+    };
+    _tx.a.pending_destroys_tail = nullptr;
+    internal::run_in_background(submit(t, smp_submit_to_options(), destroy_batch(std::exchange(_tx.a.pending_destroys, nullptr))));
+}
+
+void smp::destroy_on(shard_id t, std::unique_ptr<internal::cross_shard_destroy_item> item) noexcept {
+    auto& q = _qs[t][this_shard_id()];
+    q.queue_destroy(item.release());
+    // The queues may not be polled again
+    if (engine()._stopping) {
+        q.flush_destroy_batch(t);
+    }
+}
+
+void smp::flush_destroy_batches() noexcept {
+    if (!_qs) {
+        return;
+    }
+    for (unsigned i = 0; i < count; i++) {
+        if (i != this_shard_id()) {
+            _qs[i][this_shard_id()].flush_destroy_batch(i);
+        }
+    }
+}
+
+size_t smp_message_queue::process_incoming(shard_id from) {
+    clock_type::time_point now;
+    auto tracer = engine().tracing();
+    auto nr = process_queue<prefetch_cnt>(_pending, [&now, tracer, from] (work_item* wi) {
+        if (now == clock_type::time_point{}) {
+            now = clock_type::now();
+        }
+        wi->received_at = now;
+        if (tracer) {
+            tracer->record(internal::task_trace_event::kind::smp_receive, now, now, from);
+        }
         wi->process();
     });
     _received += nr;
@@ -3716,7 +4672,12 @@ void smp_message_queue::start(unsigned cpuid) {
             // total_operations value:DERIVE:0:U
             sm::make_counter("total_sent_messages", _sent, sm::description("Total number of sent messages"), {sm::shard_label(instance)})(sm::metric_disabled),
             // total_operations value:DERIVE:0:U
-            sm::make_counter("total_completed_messages", _compl, sm::description("Total number of messages completed"), {sm::shard_label(instance)})(sm::metric_disabled)
+            sm::make_counter("total_completed_messages", _compl, sm::description("Total number of messages completed"), {sm::shard_label(instance)})(sm::metric_disabled),
+            sm::make_queue_length("send_batch_size", _batch_size, sm::description("Current number of pending messages that triggers a send"), {sm::shard_label(instance)})(sm::metric_disabled),
+            sm::make_queue_length("pending_send_queue_length", [this] { return _tx.a.pending_fifo.size(); }, sm::description("Number of messages waiting to be sent to the remote shard"), {sm::shard_label(instance)})(sm::metric_disabled),
+            sm::make_counter("send_queue_full", _queue_full, sm::description("Number of times messages could not be sent because the queue was full"), {sm::shard_label(instance)})(sm::metric_disabled),
+            sm::make_histogram("message_latency", sm::description("A histogram of message round trip latencies in nanoseconds, from submission until completion"), {sm::shard_label(instance)}, [this] { return _latency.to_metrics_histogram(); })(sm::metric_disabled).set_skip_when_empty(),
+            sm::make_histogram("send_queue_occupancy", sm::description("A histogram of the number of messages in flight, sampled when messages are sent"), {sm::shard_label(instance)}, [this] { return _occupancy.to_metrics_histogram(); })(sm::metric_disabled).set_skip_when_empty()
     });
 }
 
@@ -3845,16 +4806,34 @@ reactor_options::reactor_options(program_options::option_group* parent_group)
     , poll_mode(*this, "poll-mode", "poll continuously (100% cpu use)")
     , idle_poll_time_us(*this, "idle-poll-time-us", reactor::calculate_poll_time() / 1us,
                 "idle polling time in microseconds (reduce for overprovisioned environments or laptops)")
+    , idle_poll_adaptive(*this, "idle-poll-adaptive", false,
+                "poll an idle shard only for about as long as work usually takes to arrive, up to idle-poll-time-us, waiting in a low power state between polls")
     , poll_aio(*this, "poll-aio", true,
                 "busy-poll for disk I/O (reduces latency and increases throughput)")
     , task_quota_ms(*this, "task-quota-ms", 0.5, "Max time (ms) between polls")
+    , task_quota_auto(*this, "task-quota-auto", false,
+                "Tune the task quota of each shard to its workload, starting from --task-quota-ms")
+    , task_quota_min_ms(*this, "task-quota-min-ms", 0.1, "Lowest task quota (ms) --task-quota-auto may choose")
+    , task_quota_max_ms(*this, "task-quota-max-ms", 2.0, "Highest task quota (ms) --task-quota-auto may choose")
+    , tsc_clock(*this, "tsc-clock", true,
+                "Extrapolate the reactor's clock from the CPU's invariant time stamp counter, calibrated against the monotonic clock,"
+                " when the CPU has one")
     , io_latency_goal_ms(*this, "io-latency-goal-ms", {}, "Max time (ms) io operations must take (1.5 * task-quota-ms if not set)")
     , io_flow_ratio_threshold(*this, "io-flow-rate-threshold", 1.1, "Dispatch rate to completion rate threshold")
     , io_completion_notify_ms(*this, "io-completion-notify-ms", {}, "Threshold in milliseconds over which IO request completion is reported to logs")
+    , io_online_calibration(*this, "io-online-calibration", false, "Adjust the disk rate at runtime based on the observed completion latencies")
+    , io_calibration_min_factor(*this, "io-calibration-min-factor", 0.5, "Lowest factor the online calibration may scale the io-properties rate by")
+    , io_calibration_max_factor(*this, "io-calibration-max-factor", 2.0, "Highest factor the online calibration may scale the io-properties rate by")
+    , io_latency_sample_rate(*this, "io-latency-sample-rate", 0.0, "Fraction of I/O requests to export the latency breakdown of (0 disables)")
+    , io_max_merged_read_length(*this, "io-max-merged-read-length", 0, "Merge adjacent reads dispatched together into requests of up to this many bytes (0 disables)")
+    , io_discard_cost_factor(*this, "io-discard-cost-factor", 0.1, "Cost of discards relative to writes of the same length")
+    , io_deadline_scheduling(*this, "io-deadline-scheduling", false, "Dispatch I/O requests with a deadline ahead of the others of their scheduling group")
     , max_task_backlog(*this, "max-task-backlog", 1000, "Maximum number of task backlog to allow; above this we ignore I/O")
     , blocked_reactor_notify_ms(*this, "blocked-reactor-notify-ms", 25, "threshold in miliseconds over which the reactor is considered blocked if no progress is made")
     , blocked_reactor_reports_per_minute(*this, "blocked-reactor-reports-per-minute", 5, "Maximum number of backtraces reported by stall detector per minute")
     , blocked_reactor_report_format_oneline(*this, "blocked-reactor-report-format-oneline", true, "Print a simplified backtrace on a single line")
+    , cpu_profiler_period_us(*this, "cpu-profiler-period-us", 0,
+                "Average cpu time in microseconds between two backtraces sampled by the CPU profiler of each shard (0 disables it)")
     , relaxed_dma(*this, "relaxed-dma", "allow using buffered I/O if DMA is not available (reduces performance)")
     , linux_aio_nowait(*this, "linux-aio-nowait", aio_nowait_supported,
                 "use the Linux NOWAIT AIO feature, which reduces reactor stalls due to aio (autodetected)")
@@ -3882,6 +4861,37 @@ reactor_options::reactor_options(program_options::option_group* parent_group)
     , reserve_io_control_blocks(*this, "reserve-io-control-blocks", 0,
                 "Reserve this many IOCBs, so it is available to any side application that runs parallel to the seastar appliation."
                 " Takes precedence over --max-networking-io-control-blocks. Only valid for the linux-aio reactor backend (see --reactor-backend).")
+    , io_uring_fixed_buffers(*this, "io-uring-fixed-buffers", false,
+                "Register the shard's memory with io_uring as fixed buffers, avoiding page pinning on every disk read and write."
+                " Pins all of the shard's memory, so requires a sufficient RLIMIT_MEMLOCK. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , io_uring_fixed_files(*this, "io-uring-fixed-files", false,
+                "Register open files with io_uring as fixed files, avoiding a file descriptor lookup on every disk request."
+                " Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , io_uring_sqpoll(*this, "io-uring-sqpoll", false,
+                "Submit io_uring requests through a per-shard kernel polling thread, trading a CPU for fewer system calls."
+                " Requires Linux 5.11 or later. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , io_uring_sqpoll_idle_ms(*this, "io-uring-sqpoll-idle-ms", 10,
+                "Idle time in milliseconds after which the io_uring polling thread goes to sleep (see --io-uring-sqpoll)")
+    , io_uring_sqpoll_pin_sibling(*this, "io-uring-sqpoll-pin-sibling", false,
+                "Pin the io_uring polling thread to a hyperthread sibling of the shard's CPU (see --io-uring-sqpoll)")
+    , io_uring_multishot_net(*this, "io-uring-multishot-net", false,
+                "Use multishot io_uring requests with provided buffers for socket accept and receive, avoiding a readiness"
+                " round-trip per read. Requires Linux 6.0 or later. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , io_uring_nvme_passthrough(*this, "io-uring-nvme-passthrough", false,
+                "Read and write NVMe block devices with NVMe commands on their generic character device (/dev/ngXnY), bypassing the"
+                " block layer. Requires Linux 5.19 or later. Only valid for the io_uring reactor backend (see --reactor-backend).")
+    , zerocopy_send_threshold(*this, "zerocopy-send-threshold", 0,
+                "Send packets of at least this many bytes on TCP sockets without copying them into the kernel (MSG_ZEROCOPY)."
+                " Not supported by the linux-aio reactor backend (see --reactor-backend). 0 means off")
+    , syscall_threads(*this, "syscall-threads", 0,
+                "Number of threads per shard serving each kind of blocking work (aio fallbacks, file and process operations)."
+                " 0 means a single thread per shard serving all of them")
+    , syscall_threads_pin_sibling(*this, "syscall-threads-pin-sibling", false,
+                "Pin the syscall threads of each shard to a hyperthread sibling of the shard's CPU (see --shard-placement)")
+    , thread_stack_cache(*this, "thread-stack-cache", 16,
+                "Number of stacks of each size class kept per shard for reuse by seastar threads (0 disables)")
+    , thread_stack_mmap(*this, "thread-stack-mmap", false,
+                "Map the stacks of seastar threads with mmap(), committing their pages lazily and guarding them against overflow")
 #ifdef SEASTAR_HEAPPROF
     , heapprof(*this, "heapprof", 0, "Enable seastar heap profiling. Sample every ARG bytes. 0 means off")
 #else
@@ -3898,6 +4908,7 @@ smp_options::smp_options(program_options::option_group* parent_group)
     , memory(*this, "memory", std::nullopt, "memory to use, in bytes (ex: 4G) (default: all)")
     , reserve_memory(*this, "reserve-memory", {}, "memory reserved to OS (if --memory not specified)")
     , hugepages(*this, "hugepages", {}, "path to accessible hugetlbfs mount (typically /dev/hugepages/something)")
+    , hugetlb_page_size(*this, "hugetlb-page-size", {}, "back memory with explicit huge pages of this size (2M or 1G), falling back to smaller pages when the kernel runs out of reserved ones")
     , lock_memory(*this, "lock-memory", {}, "lock all memory (prevents swapping)")
     , thread_affinity(*this, "thread-affinity", true, "pin threads to their cpus (disable for overprovisioning)")
 #ifdef SEASTAR_HAVE_HWLOC
@@ -3918,6 +4929,9 @@ smp_options::smp_options(program_options::option_group* parent_group)
 #else
     , allow_cpus_in_remote_numa_nodes(*this, "allow-cpus-in-remote-numa-nodes", program_options::unused{})
 #endif
+    , cross_node_batch_size(*this, "smp-cross-node-batch-size", 0, "minimal number of messages batched together before being sent to a shard on another NUMA node (0: same as within a node)")
+    , shard_placement(*this, "shard-placement", "spread", "how shards are placed on the CPUs: spread (any hardware thread) or one-per-core (leaving the SMT siblings free)")
+    , memory_rebalance(*this, "memory-rebalance", false, "let shards lend their spare free memory to the others and borrow it under memory pressure")
 {
 }
 
@@ -3933,6 +4947,7 @@ thread_local std::unique_ptr<reactor, reactor_deleter> reactor_holder;
 thread_local smp_message_queue** smp::_qs;
 thread_local std::thread::id smp::_tmain;
 unsigned smp::count = 0;
+std::vector<std::optional<shard_id>> smp::_cpu_to_shard;
 
 void smp::start_all_queues()
 {
@@ -4005,6 +5020,8 @@ void smp::cleanup() noexcept {
 void smp::cleanup_cpu() {
     size_t cpuid = this_shard_id();
 
+    // Destructions queued from now on are sent right away
+    flush_destroy_batches();
     if (_qs) {
         for(unsigned i = 0; i < smp::count; i++) {
             _qs[i][cpuid].stop();
@@ -4013,6 +5030,9 @@ void smp::cleanup_cpu() {
     if (_alien._qs) {
         _alien._qs[cpuid].stop();
     }
+    if (cpuid == 0 && _prefaulter) {
+        _prefaulter->stop_metrics();
+    }
 }
 
 void smp::create_thread(std::function<void ()> thread_loop) {
@@ -4119,8 +5139,32 @@ void install_oneshot_signal_handler<SIGSEGV, sigsegv_action>() {
 }
 #endif
 
+void smp::allocate_queues_to(shard_id to, const std::vector<reactor*>& reactors, size_t cross_node_batch_size) {
+    // Runs on the receiving shard, so that the row ends up in its memory and
+    // so on its NUMA node: the receiver polls all of its incoming queues,
+    // while each sender only touches its own queue in the row.
+    auto row = reinterpret_cast<smp_message_queue*>(operator new[] (sizeof(smp_message_queue) * smp::count
+    // smp_message_queue has members with hefty alignment requirements.
+    // if we are reactor thread, or not running with dpdk, doing this
+    // new default aligned seemingly works, as does reordering
+    // dlinit dependencies (ugh). But we should enforce calling out to
+    // aligned_alloc, instead of pure malloc, if possible.
+        , std::align_val_t(alignof(smp_message_queue))
+    ));
+    for (unsigned from = 0; from < smp::count; ++from) {
+        new (&row[from]) smp_message_queue(reactors[from], reactors[to]);
+        if (cross_node_batch_size && _shard_to_numa_node_mapping[from] != _shard_to_numa_node_mapping[to]) {
+            row[from].set_min_batch_size(cross_node_batch_size);
+        }
+    }
+    _qs_owner[to] = row;
+}
+
 void smp::qs_deleter::operator()(smp_message_queue** qs) const {
     for (unsigned i = 0; i < smp::count; i++) {
+        if (!qs[i]) {
+            continue;
+        }
         for (unsigned j = 0; j < smp::count; j++) {
             qs[i][j].~smp_message_queue();
         }
@@ -4138,6 +5182,13 @@ class disk_config_params {
     std::chrono::duration<double> _latency_goal;
     std::chrono::milliseconds _stall_threshold;
     double _flow_ratio_backpressure_threshold;
+    bool _online_calibration = false;
+    double _calibration_min_factor = 1.0;
+    double _calibration_max_factor = 1.0;
+    unsigned _latency_trace_period = 0;
+    size_t _max_merged_read_length = 0;
+    double _discard_cost_factor = 0.1;
+    bool _deadline_scheduling = false;
 
 public:
     explicit disk_config_params(unsigned max_queues) noexcept
@@ -4159,9 +5210,10 @@ class disk_config_params {
     }
 
     double latency_goal_opt(const reactor_options& opts) const {
-        return opts.io_latency_goal_ms ?
-                opts.io_latency_goal_ms.get_value() :
-                opts.task_quota_ms.get_value() * 1.5;
+        if (opts.io_latency_goal_ms) {
+            return opts.io_latency_goal_ms.get_value();
+        }
+        return (opts.task_quota_auto.get_value() ? opts.task_quota_max_ms.get_value() : opts.task_quota_ms.get_value()) * 1.5;
     }
 
     void parse_config(const smp_options& smp_opts, const reactor_options& reactor_opts) {
@@ -4171,6 +5223,24 @@ class disk_config_params {
         _flow_ratio_backpressure_threshold = reactor_opts.io_flow_ratio_threshold.get_value();
         seastar_logger.debug("flow-ratio threshold: {}", _flow_ratio_backpressure_threshold);
         _stall_threshold = reactor_opts.io_completion_notify_ms.defaulted() ? std::chrono::milliseconds::max() : reactor_opts.io_completion_notify_ms.get_value() * 1ms;
+        _online_calibration = reactor_opts.io_online_calibration.get_value();
+        _calibration_min_factor = reactor_opts.io_calibration_min_factor.get_value();
+        _calibration_max_factor = reactor_opts.io_calibration_max_factor.get_value();
+        if (auto rate = reactor_opts.io_latency_sample_rate.get_value(); rate > 0) {
+            if (rate > 1.0) {
+                throw std::runtime_error("io-latency-sample-rate must be within [0, 1]");
+            }
+            _latency_trace_period = std::lround(1.0 / rate);
+        }
+        _max_merged_read_length = reactor_opts.io_max_merged_read_length.get_value();
+        _discard_cost_factor = reactor_opts.io_discard_cost_factor.get_value();
+        if (_discard_cost_factor < 0) {
+            throw std::runtime_error("io-discard-cost-factor must not be negative");
+        }
+        _deadline_scheduling = reactor_opts.io_deadline_scheduling.get_value();
+        if (_online_calibration && (_calibration_min_factor <= 0 || _calibration_min_factor > 1.0 || _calibration_max_factor < 1.0)) {
+            throw std::runtime_error("io-calibration-min-factor must be within (0, 1] and io-calibration-max-factor must be at least 1");
+        }
 
         if (smp_opts.num_io_groups) {
             _num_io_groups = smp_opts.num_io_groups.get_value();
@@ -4252,13 +5322,19 @@ class disk_config_params {
 
         cfg.id = q;
 
+        // In integers, as with no interference factor configured, the
+        // float product would round some ratios differently
+        auto write_to_read_multiplier = [&p] (uint64_t read_rate, uint64_t write_rate) -> unsigned {
+            uint64_t m = (io_queue::read_request_base_count * read_rate) / write_rate;
+            return p.write_interference_factor == 1.0f ? m : m * p.write_interference_factor;
+        };
         if (p.read_bytes_rate != std::numeric_limits<uint64_t>::max()) {
             cfg.blocks_count_rate = (io_queue::read_request_base_count * (unsigned long)per_io_group(p.read_bytes_rate, nr_groups)) >> io_queue::block_size_shift;
-            cfg.disk_blocks_write_to_read_multiplier = (io_queue::read_request_base_count * p.read_bytes_rate) / p.write_bytes_rate;
+            cfg.disk_blocks_write_to_read_multiplier = write_to_read_multiplier(p.read_bytes_rate, p.write_bytes_rate);
         }
         if (p.read_req_rate != std::numeric_limits<uint64_t>::max()) {
             cfg.req_count_rate = io_queue::read_request_base_count * (unsigned long)per_io_group(p.read_req_rate, nr_groups);
-            cfg.disk_req_write_to_read_multiplier = (io_queue::read_request_base_count * p.read_req_rate) / p.write_req_rate;
+            cfg.disk_req_write_to_read_multiplier = write_to_read_multiplier(p.read_req_rate, p.write_req_rate);
         }
         if (p.read_saturation_length != std::numeric_limits<uint64_t>::max()) {
             cfg.disk_read_saturation_length = p.read_saturation_length;
@@ -4276,6 +5352,15 @@ class disk_config_params {
         // be better to sacrifice some IO latency, but allow for larger concurrency
         cfg.block_count_limit_min = (64 << 10) >> io_queue::block_size_shift;
         cfg.stall_threshold = stall_threshold();
+        cfg.latency_trace_period = _latency_trace_period;
+        cfg.max_merged_read_length = _max_merged_read_length;
+        cfg.discard_cost_factor = _discard_cost_factor;
+        cfg.deadline_scheduling = _deadline_scheduling;
+        // Nothing to calibrate against for unconfigured disks
+        if (_online_calibration && q != 0) {
+            cfg.calibration_min_factor = _calibration_min_factor;
+            cfg.calibration_max_factor = _calibration_max_factor;
+        }
 
         return cfg;
     }
@@ -4352,6 +5437,12 @@ unsigned smp::adjust_max_networking_aio_io_control_blocks(unsigned network_iocbs
 
 void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_opts)
 {
+    if (reactor_opts.task_quota_auto.get_value()
+            && !(reactor_opts.task_quota_min_ms.get_value() > 0 && reactor_opts.task_quota_min_ms.get_value() <= reactor_opts.task_quota_max_ms.get_value())) {
+        throw std::runtime_error(format("task-quota-min-ms ({}) must be positive and not above task-quota-max-ms ({})",
+                reactor_opts.task_quota_min_ms.get_value(), reactor_opts.task_quota_max_ms.get_value()));
+    }
+
     bool use_transparent_hugepages = !reactor_opts.overprovisioned;
 
 #ifndef SEASTAR_NO_EXCEPTION_HACK
@@ -4422,8 +5513,19 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
         cpu_set = opts_cpuset;
     }
 
+    auto placement = smp_opts.shard_placement.get_value();
+    if (placement == "one-per-core") {
+        rc.placement = resource::shard_placement::one_per_core;
+    } else if (placement != "spread") {
+        seastar_logger.error("Bad value for --shard-placement: {}, expected spread or one-per-core. Shutting down.", placement);
+        exit(1);
+    }
+
     if (smp_opts.smp) {
         smp::count = smp_opts.smp.get_value();
+    } else if (rc.placement == resource::shard_placement::one_per_core) {
+        rc.cpu_set = cpu_set;
+        smp::count = resource::nr_physical_cores(rc);
     } else {
         smp::count = cpu_set.size();
     }
@@ -4462,6 +5564,13 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
     if (smp_opts.hugepages) {
         hugepages_path = smp_opts.hugepages.get_value();
     }
+    size_t hugetlb_page_size = 0;
+    if (smp_opts.hugetlb_page_size) {
+        if (hugepages_path) {
+            throw std::runtime_error("--hugepages and --hugetlb-page-size are mutually exclusive");
+        }
+        hugetlb_page_size = parse_memory_size(smp_opts.hugetlb_page_size.get_value());
+    }
     auto mlock = false;
     if (smp_opts.lock_memory) {
         mlock = smp_opts.lock_memory.get_value();
@@ -4505,10 +5614,17 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
     std::vector<resource::cpu> allocations = std::move(resources.cpus);
     if (thread_affinity) {
         smp::pin(allocations[0].cpu_id);
+        for (shard_id i = 0; i < allocations.size(); i++) {
+            auto cpu = allocations[i].cpu_id;
+            if (cpu >= _cpu_to_shard.size()) {
+                _cpu_to_shard.resize(cpu + 1);
+            }
+            _cpu_to_shard[cpu] = i;
+        }
     }
     std::optional<memory::internal::numa_layout> layout;
     if (smp_opts.memory_allocator == memory_allocator::seastar) {
-        layout = memory::configure(allocations[0].mem, mbind, use_transparent_hugepages, hugepages_path);
+        layout = memory::configure(allocations[0].mem, mbind, use_transparent_hugepages, hugepages_path, hugetlb_page_size);
     } else {
         // #2148 - if running seastar allocator but options that contradict this, we still need to
         // init memory at least minimally, otherwise a bunch of stuff breaks.
@@ -4516,9 +5632,14 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
         memory::configure_minimal();
     }
 
-    _shard_to_numa_node_mapping.resize(smp::count);
+    _shard_to_numa_node_mapping.reserve(smp::count);
+    _shard_topology.reserve(smp::count);
     for (unsigned i = 0; i < smp::count; i++) {
         _shard_to_numa_node_mapping.push_back(allocations[i].mem.size() > 0 ? allocations[i].mem[0].nodeid : 0);
+        auto& a = allocations[i];
+        _shard_topology.push_back(cpu_topology{a.cpu_id, a.core, a.cache_domain, a.numa_node, a.siblings});
+        seastar_logger.debug("Shard {} on CPU{}, core {}, cache domain {}, NUMA{}, siblings {}",
+                i, a.cpu_id, a.core, a.cache_domain, a.numa_node, a.siblings);
     }
 
     if (reactor_opts.abort_on_seastar_bad_alloc) {
@@ -4538,6 +5659,9 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
 
     reactor_config reactor_cfg = {
         .task_quota = std::chrono::duration_cast<sched_clock::duration>(reactor_opts.task_quota_ms.get_value() * 1ms),
+        .task_quota_auto = reactor_opts.task_quota_auto.get_value(),
+        .task_quota_min = std::chrono::duration_cast<sched_clock::duration>(reactor_opts.task_quota_min_ms.get_value() * 1ms),
+        .task_quota_max = std::chrono::duration_cast<sched_clock::duration>(reactor_opts.task_quota_max_ms.get_value() * 1ms),
         .max_poll_time = [&reactor_opts] () -> std::chrono::nanoseconds {
             if (reactor_opts.poll_mode) {
                 return std::chrono::nanoseconds::max();
@@ -4547,6 +5671,7 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
                 return reactor_opts.idle_poll_time_us.get_value() * 1us;
             }
         }(),
+        .idle_poll_adaptive = reactor_opts.idle_poll_adaptive.get_value(),
         .handle_sigint = !reactor_opts.no_handle_interrupt,
         .auto_handle_sigint_sigterm = reactor_opts._auto_handle_sigint_sigterm,
         .max_networking_aio_io_control_blocks = max_networking_aio_io_control_blocks,
@@ -4554,9 +5679,35 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
         .kernel_page_cache = reactor_opts.kernel_page_cache.get_value(),
         .have_aio_fsync = reactor_opts.aio_fsync.get_value(),
         .max_task_backlog = reactor_opts.max_task_backlog.get_value(),
+        .tsc_clock = reactor_opts.tsc_clock.get_value() && internal::tsc_supported(),
         .strict_o_direct = !reactor_opts.relaxed_dma,
         .bypass_fsync = reactor_opts.unsafe_bypass_fsync.get_value(),
         .no_poll_aio = !reactor_opts.poll_aio.get_value() || (reactor_opts.poll_aio.defaulted() && reactor_opts.overprovisioned),
+        .uring_fixed_buffers = reactor_opts.io_uring_fixed_buffers.get_value(),
+        .uring_fixed_files = reactor_opts.io_uring_fixed_files.get_value(),
+        .uring_sqpoll = reactor_opts.io_uring_sqpoll.get_value(),
+        .uring_sqpoll_idle_ms = reactor_opts.io_uring_sqpoll_idle_ms.get_value(),
+        .uring_sqpoll_pin_sibling = reactor_opts.io_uring_sqpoll_pin_sibling.get_value() && thread_affinity,
+        .uring_multishot_net = reactor_opts.io_uring_multishot_net.get_value(),
+        .uring_nvme_passthrough = reactor_opts.io_uring_nvme_passthrough.get_value(),
+        .zerocopy_send_threshold = reactor_opts.zerocopy_send_threshold.get_value(),
+        .syscall_threads = reactor_opts.syscall_threads.get_value(),
+        .thread_stack_cache = reactor_opts.thread_stack_cache.get_value(),
+        .thread_stack_mmap = reactor_opts.thread_stack_mmap.get_value(),
+        .memory_rebalance = smp_opts.memory_rebalance.get_value(),
+    };
+    if (reactor_cfg.memory_rebalance && reactor_cfg.uring_fixed_buffers) {
+        // Releasing registered memory would leave io_uring with stale pages
+        seastar_logger.warn("--memory-rebalance is not compatible with --io-uring-fixed-buffers, disabling it");
+        reactor_cfg.memory_rebalance = false;
+    }
+    auto syscall_threads_pin_sibling = reactor_opts.syscall_threads_pin_sibling.get_value() && thread_affinity;
+    auto shard_reactor_cfg = [&reactor_cfg, syscall_threads_pin_sibling] (const resource::cpu& allocation) {
+        auto cfg = reactor_cfg;
+        if (syscall_threads_pin_sibling && !allocation.siblings.empty()) {
+            cfg.syscall_threads_cpu = allocation.siblings.front();
+        }
+        return cfg;
     };
 
     // Disable hot polling if sched wakeup granularity is too high
@@ -4660,11 +5811,17 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
     auto backend_selector = reactor_opts.reactor_backend.get_selected_candidate();
     seastar_logger.info("Reactor backend: {}", backend_selector);
 
+    // Every shard fills its own row, see allocate_queues_to()
+    auto cross_node_batch_size = smp_opts.cross_node_batch_size.get_value();
+    _qs_owner = decltype(smp::_qs_owner){new smp_message_queue* [smp::count](), qs_deleter{}};
+    internal::configure_quiescent_epochs(smp::count);
+
     unsigned i;
     auto smp_tmain = smp::_tmain;
     for (i = 1; i < smp::count; i++) {
         auto allocation = allocations[i];
-        create_thread([this, smp_tmain, inited, &reactors_registered, &smp_queues_constructed, &smp_opts, &reactor_opts, &reactors, hugepages_path, i, allocation, assign_io_queues, alloc_io_queues, thread_affinity, heapprof_sampling_rate, mbind, backend_selector, reactor_cfg, &mtx, &layout, use_transparent_hugepages] {
+        auto reactor_cfg = shard_reactor_cfg(allocation);
+        create_thread([this, smp_tmain, inited, &reactors_registered, &smp_queues_constructed, &smp_opts, &reactor_opts, &reactors, hugepages_path, i, allocation, assign_io_queues, alloc_io_queues, thread_affinity, heapprof_sampling_rate, mbind, backend_selector, reactor_cfg, &mtx, &layout, use_transparent_hugepages, cross_node_batch_size, hugetlb_page_size] {
           try {
             // initialize thread_locals that are equal across all reacto threads of this smp instance
             smp::_tmain = smp_tmain;
@@ -4674,7 +5831,7 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
                 smp::pin(allocation.cpu_id);
             }
             if (smp_opts.memory_allocator == memory_allocator::seastar) {
-                auto another_layout = memory::configure(allocation.mem, mbind, use_transparent_hugepages, hugepages_path);
+                auto another_layout = memory::configure(allocation.mem, mbind, use_transparent_hugepages, hugepages_path, hugetlb_page_size);
                 auto guard = std::lock_guard(mtx);
                 *layout = memory::internal::merge(std::move(*layout), std::move(another_layout));
             } else {
@@ -4697,9 +5854,12 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
             reactors[i] = &engine();
             alloc_io_queues(i);
             reactors_registered.wait();
+            allocate_queues_to(i, reactors, cross_node_batch_size);
             smp_queues_constructed.wait();
             // _qs_owner is only initialized here
             _qs = _qs_owner.get();
+            _stealable_qs = _stealable_qs_owner.get();
+            _broadcast_inboxes = _broadcast_inboxes_owner.get();
             start_all_queues();
             assign_io_queues(i);
             inited->wait();
@@ -4715,7 +5875,7 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
     init_default_smp_service_group(0);
     lowres_clock::update();
     try {
-        allocate_reactor(0, backend_selector, reactor_cfg);
+        allocate_reactor(0, backend_selector, shard_reactor_cfg(allocations[0]));
     } catch (const std::exception& e) {
         seastar_logger.error("{}", e.what());
         _exit(1);
@@ -4734,21 +5894,10 @@ void smp::configure(const smp_options& smp_opts, const reactor_options& reactor_
 #endif
 
     reactors_registered.wait();
-    _qs_owner = decltype(smp::_qs_owner){new smp_message_queue* [smp::count], qs_deleter{}};
     _qs = _qs_owner.get();
-    for(unsigned i = 0; i < smp::count; i++) {
-        smp::_qs_owner[i] = reinterpret_cast<smp_message_queue*>(operator new[] (sizeof(smp_message_queue) * smp::count
-        // smp_message_queue has members with hefty alignment requirements.
-        // if we are reactor thread, or not running with dpdk, doing this
-        // new default aligned seemingly works, as does reordering
-        // dlinit dependencies (ugh). But we should enforce calling out to
-        // aligned_alloc, instead of pure malloc, if possible.
-            , std::align_val_t(alignof(smp_message_queue))
-        ));
-        for (unsigned j = 0; j < smp::count; ++j) {
-            new (&smp::_qs_owner[i][j]) smp_message_queue(reactors[j], reactors[i]);
-        }
-    }
+    allocate_queues_to(0, reactors, cross_node_batch_size);
+    setup_stealable_queues(reactors);
+    setup_broadcast_inboxes(reactors);
     _alien._qs = alien::instance::create_qs(reactors);
     smp_queues_constructed.wait();
     start_all_queues();
@@ -4769,12 +5918,15 @@ bool smp::poll_queues() {
             auto& rxq = _qs[this_shard_id()][i];
             rxq.flush_response_batch();
             got += rxq.has_unflushed_responses();
-            got += rxq.process_incoming();
+            got += rxq.process_incoming(i);
             auto& txq = _qs[i][this_shard_id()];
+            txq.flush_destroy_batch(i);
             txq.flush_request_batch();
             got += txq.process_completions(i);
         }
     }
+    got += poll_stealable_queue();
+    got += poll_broadcast_inbox();
     return got != 0;
 }
 
@@ -4785,12 +5937,12 @@ bool smp::pure_poll_queues() {
             rxq.flush_response_batch();
             auto& txq = _qs[i][this_shard_id()];
             txq.flush_request_batch();
-            if (rxq.pure_poll_rx() || txq.pure_poll_tx() || rxq.has_unflushed_responses()) {
+            if (rxq.pure_poll_rx() || txq.pure_poll_tx() || rxq.has_unflushed_responses() || txq._tx.a.pending_destroys) {
                 return true;
             }
         }
     }
-    return false;
+    return pure_poll_stealable_queue() || pure_poll_broadcast_inbox();
 }
 
 __thread reactor* local_engine;
@@ -5005,13 +6157,14 @@ std::chrono::nanoseconds reactor::total_steal_time() {
 }
 
 static std::atomic<unsigned long> s_used_scheduling_group_ids_bitmap{3}; // 0=main, 1=atexit
+static std::atomic<unsigned long> s_used_scheduling_supergroup_ids_bitmap{1}; // 0=root
 static std::atomic<unsigned long> s_next_scheduling_group_specific_key{0};
 
 static
 int
-allocate_scheduling_group_id() noexcept {
+allocate_id(std::atomic<unsigned long>& bitmap) noexcept {
     static_assert(max_scheduling_groups() <= std::numeric_limits<unsigned long>::digits, "more scheduling groups than available bits");
-    auto b = s_used_scheduling_group_ids_bitmap.load(std::memory_order_relaxed);
+    auto b = bitmap.load(std::memory_order_relaxed);
     auto nb = b;
     unsigned i = 0;
     do {
@@ -5020,10 +6173,22 @@ allocate_scheduling_group_id() noexcept {
         }
         i = count_trailing_zeros(~b);
         nb = b | (1ul << i);
-    } while (!s_used_scheduling_group_ids_bitmap.compare_exchange_weak(b, nb, std::memory_order_relaxed));
+    } while (!bitmap.compare_exchange_weak(b, nb, std::memory_order_relaxed));
     return i;
 }
 
+static
+int
+allocate_scheduling_group_id() noexcept {
+    return allocate_id(s_used_scheduling_group_ids_bitmap);
+}
+
+static
+int
+allocate_scheduling_supergroup_id() noexcept {
+    return allocate_id(s_used_scheduling_supergroup_ids_bitmap);
+}
+
 static
 unsigned long
 allocate_scheduling_group_specific_key() noexcept {
@@ -5059,10 +6224,12 @@ reactor::rename_scheduling_group_specific_data(scheduling_group sg) {
 }
 
 future<>
-reactor::init_scheduling_group(seastar::scheduling_group sg, sstring name, sstring shortname, float shares) {
-    return with_shared(_scheduling_group_keys_mutex, [this, sg, name = std::move(name), shortname = std::move(shortname), shares] {
+reactor::init_scheduling_group(seastar::scheduling_group sg, sstring name, sstring shortname, float shares, scheduling_supergroup parent) {
+    return with_shared(_scheduling_group_keys_mutex, [this, sg, name = std::move(name), shortname = std::move(shortname), shares, parent] {
         get_sg_data(sg).queue_is_initialized = true;
-        _task_queues[sg._id] = std::make_unique<task_queue>(sg._id, name, shortname, shares);
+        auto index = internal::scheduling_supergroup_index(parent);
+        _task_queues[sg._id] = std::make_unique<task_queue>(sg._id, name, shortname, shares, *_task_queue_groups[index]);
+        _task_queues[sg._id]->_supergroup = index;
 
         return with_scheduling_group(sg, [this, sg] () {
             auto& sg_data = _scheduling_group_specific_data;
@@ -5123,6 +6290,10 @@ std::span<const unsigned> smp::shard_to_numa_node_mapping() const noexcept {
     return _shard_to_numa_node_mapping;
 }
 
+std::span<const cpu_topology> smp::shard_topology() const noexcept {
+    return _shard_topology;
+}
+
 const smp& reactor::smp() const noexcept {
     return *_smp;
 }
@@ -5150,6 +6321,18 @@ internal::current_scheduling_group_ptr() noexcept {
     static thread_local scheduling_group sg;
     return &sg;
 }
+
+uint32_t*
+internal::current_trace_slot_ptr() noexcept {
+    static thread_local uint32_t slot;
+    return &slot;
+}
+
+uint16_t*
+internal::current_cpu_tag_slot_ptr() noexcept {
+    static thread_local uint16_t slot;
+    return &slot;
+}
 #endif
 
 const sstring&
@@ -5180,12 +6363,81 @@ scheduling_group::set_shares(float shares) noexcept {
     engine().update_shares_for_queues(internal::priority_class(*this), shares);
 }
 
+void
+scheduling_group::set_io_latency_target(std::chrono::microseconds latency, double percentile) {
+    engine().update_latency_target_for_queues(internal::priority_class(*this), latency, percentile);
+}
+
+void
+scheduling_group::set_io_min_shares(float min_shares) {
+    engine().update_min_shares_for_queues(internal::priority_class(*this), min_shares);
+}
+
+float scheduling_group::get_cpu_limit() const noexcept {
+    return engine()._task_queues[_id]->_cpu_limit;
+}
+
+void
+scheduling_group::set_cpu_limit(float fraction) noexcept {
+    auto& tq = *engine()._task_queues[_id];
+    tq._cpu_limit = fraction > 0 && fraction < 1 ? fraction : 0;
+    if (!tq._cpu_limit && tq._throttled) {
+        tq._unthrottle_timer.cancel();
+        engine().unthrottle(tq);
+    }
+}
+
 future<> scheduling_group::update_io_bandwidth(uint64_t bandwidth) const {
     return engine().update_bandwidth_for_queues(internal::priority_class(*this), bandwidth);
 }
 
+future<> scheduling_group::update_io_bandwidth_budget(uint64_t bandwidth) const {
+    return futurize_invoke([pc = internal::priority_class(*this), bandwidth] {
+        io_queue::update_bandwidth_budget(pc, bandwidth);
+    });
+}
+
+scheduling_supergroup scheduling_group::io_supergroup() const noexcept {
+    return internal::scheduling_supergroup_from_index(engine()._task_queues[_id]->_supergroup);
+}
+
+float scheduling_supergroup::get_shares() const noexcept {
+    return engine()._io_supergroup_shares[_id];
+}
+
+void
+scheduling_supergroup::set_shares(float shares) noexcept {
+    SEASTAR_ASSERT(!is_root());
+    shares = std::max(shares, 1.0f);
+    engine()._io_supergroup_shares[_id] = shares;
+    engine()._task_queue_groups[_id]->set_shares(shares);
+    engine().update_shares_for_supergroup_queues(_id, shares);
+}
+
+future<scheduling_supergroup>
+create_scheduling_supergroup(float shares) noexcept {
+    auto aid = allocate_scheduling_supergroup_id();
+    if (aid < 0) {
+        return make_exception_future<scheduling_supergroup>(std::runtime_error("Scheduling supergroup limit exceeded"));
+    }
+    auto sg = scheduling_supergroup(static_cast<unsigned>(aid));
+    shares = std::max(shares, 1.0f);
+    return smp::invoke_on_all([sg, shares] {
+        auto& r = engine();
+        r._io_supergroup_shares[sg._id] = shares;
+        r._task_queue_groups[sg._id] = std::make_unique<reactor::task_queue_group>(shares, r._task_queue_groups[0].get());
+    }).then([sg] {
+        return make_ready_future<scheduling_supergroup>(sg);
+    });
+}
+
 future<scheduling_group>
 create_scheduling_group(sstring name, sstring shortname, float shares) noexcept {
+    return create_scheduling_group(name, shortname, shares, scheduling_supergroup());
+}
+
+future<scheduling_group>
+create_scheduling_group(sstring name, sstring shortname, float shares, scheduling_supergroup parent) noexcept {
     auto aid = allocate_scheduling_group_id();
     if (aid < 0) {
         return make_exception_future<scheduling_group>(std::runtime_error(fmt::format("Scheduling group limit exceeded while creating {}", name)));
@@ -5193,8 +6445,8 @@ create_scheduling_group(sstring name, sstring shortname, float shares) noexcept
     auto id = static_cast<unsigned>(aid);
     SEASTAR_ASSERT(id < max_scheduling_groups());
     auto sg = scheduling_group(id);
-    return smp::invoke_on_all([sg, name, shortname, shares] {
-        return engine().init_scheduling_group(sg, name, shortname, shares);
+    return smp::invoke_on_all([sg, name, shortname, shares, parent] {
+        return engine().init_scheduling_group(sg, name, shortname, shares, parent);
     }).then([sg] {
         return make_ready_future<scheduling_group>(sg);
     });
@@ -5253,6 +6505,16 @@ void add_to_flush_poller(output_stream<char>& os) noexcept {
     engine()._flush_batching.push_back(os);
 }
 
+void account_batch_flush(size_t bytes) noexcept {
+    auto& st = engine()._flush_batching_stats;
+    st.flushes++;
+    st.bytes += bytes;
+}
+
+void account_merged_flush() noexcept {
+    engine()._flush_batching_stats.merged++;
+}
+
 inline
 sched_clock::duration
 timeval_to_duration(::timeval tv) {
@@ -30,15 +30,20 @@ module;
 #include <fcntl.h>
 #include <signal.h>
 #include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
 #include <poll.h>
 #include <sys/syscall.h>
 #include <sys/resource.h>
 #include <boost/container/small_vector.hpp>
+#include <boost/intrusive/list.hpp>
 #include <fmt/core.h>
 #include <seastar/util/assert.hh>
 
 #ifdef SEASTAR_HAVE_URING
 #include <liburing.h>
+#include <linux/nvme_ioctl.h>
 #endif
 
 #ifdef SEASTAR_MODULE
@@ -48,8 +53,12 @@ module seastar;
 #include "core/thread_pool.hh"
 #include "core/syscall_result.hh"
 #include <seastar/core/internal/buffer_allocator.hh>
+#include <seastar/core/circular_buffer.hh>
 #include <seastar/util/internal/iovec_utils.hh>
 #include <seastar/core/internal/uname.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/resource.hh>
 #include <seastar/core/print.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/smp.hh>
@@ -84,12 +93,14 @@ void prepare_iocb(const io_request& req, io_completion* desc, iocb& iocb) {
         const auto& op = req.as<io_request::operation::write>();
         iocb = make_write_iocb(op.fd, op.pos, op.addr, op.size);
         set_nowait(iocb, op.nowait_works);
+        set_dsync(iocb, op.dsync);
         break;
     }
     case io_request::operation::writev: {
         const auto& op = req.as<io_request::operation::writev>();
         iocb = make_writev_iocb(op.fd, op.pos, op.iovec, op.iov_len);
         set_nowait(iocb, op.nowait_works);
+        set_dsync(iocb, op.dsync);
         break;
     }
     case io_request::operation::read: {
@@ -150,9 +161,21 @@ aio_storage_context::iocb_pool::get_one() {
 inline
 void
 aio_storage_context::iocb_pool::put_one(internal::linux_abi::iocb* io) {
+    // Not to be found by find() once its completion is gone
+    set_user_data(*io, nullptr);
     _free_iocbs.push(io);
 }
 
+internal::linux_abi::iocb*
+aio_storage_context::iocb_pool::find(void* user_data) {
+    for (auto& io : _all_iocbs) {
+        if (get_user_data<void>(io) == user_data) {
+            return &io;
+        }
+    }
+    return nullptr;
+}
+
 inline
 unsigned
 aio_storage_context::iocb_pool::outstanding() const {
@@ -199,12 +222,27 @@ aio_storage_context::handle_aio_error(linux_abi::iocb* iocb, int ec) {
 
 extern bool aio_nowait_supported;
 
+// Linux implements io_cancel() for a few drivers only, not for files nor
+// block devices, where it fails with EINVAL and the request completes as
+// usual. The completion of a request it cancels is reported through the
+// ring as well.
+void aio_storage_context::cancel(void* user_data) noexcept {
+    if (auto iocb = _iocb_pool.find(user_data)) {
+        linux_abi::io_event ev;
+        io_cancel(_io_context, iocb, &ev);
+    }
+}
+
 bool
 aio_storage_context::submit_work() {
     bool did_work = false;
 
     _submission_queue.clear();
-    size_t to_submit = _r._io_sink.drain([this] (const internal::io_request& req, io_completion* desc) -> bool {
+    _r._io_sink.drain([this] (const internal::io_request& req, io_completion* desc) -> bool {
+        if (req.opcode() == io_request::operation::cancel) {
+            cancel(req.as<io_request::operation::cancel>().addr);
+            return true;
+        }
         if (!_iocb_pool.has_capacity()) {
             return false;
         }
@@ -218,6 +256,8 @@ aio_storage_context::submit_work() {
         _submission_queue.push_back(&io);
         return true;
     });
+    // Cancellations don't take an iocb
+    size_t to_submit = _submission_queue.size();
 
     if (__builtin_expect(_r._cfg.kernel_page_cache, false)) {
         // linux-aio is not asynchronous when the page cache is used,
@@ -791,8 +831,6 @@ reactor_backend_epoll::task_quota_timer_thread_fn() {
     }
 }
 
-reactor_backend_epoll::~reactor_backend_epoll() = default;
-
 void reactor_backend_epoll::start_tick() {
     _task_quota_timer_thread = std::thread(&reactor_backend_epoll::task_quota_timer_thread_fn, this);
 
@@ -832,6 +870,91 @@ void reactor_backend_epoll::maybe_switch_steady_clock_timers(int timeout, file_d
     }
 }
 
+class epoll_pollable_fd_state : public pollable_fd_state {
+    pollable_fd_state_completion _pollin;
+    pollable_fd_state_completion _pollout;
+    pollable_fd_state_completion _pollrdhup;
+
+    pollable_fd_state_completion* get_desc(int events) {
+        if (events & EPOLLIN) {
+            return &_pollin;
+        }
+        if (events & EPOLLOUT) {
+            return &_pollout;
+        }
+        return &_pollrdhup;
+    }
+
+    enum class zerocopy_mode : uint8_t { unknown, enabled, disabled };
+    // A MSG_ZEROCOPY send whose buffers the kernel may still reference.
+    // The kernel numbers such sends sequentially per socket, and reports
+    // them done in (possibly out of order) ranges on the error queue.
+    struct zerocopy_send {
+        uint32_t id;
+        bool done;
+        net::packet data;
+    };
+    zerocopy_mode _zerocopy = zerocopy_mode::unknown;
+    uint32_t _next_zerocopy_id = 0;
+    circular_buffer<zerocopy_send> _zerocopy_sends;
+public:
+    // Set once forgotten, while waiting for the kernel to release
+    // the buffers of outstanding zero-copy sends
+    bool lingering = false;
+
+    explicit epoll_pollable_fd_state(file_desc fd, speculation speculate)
+        : pollable_fd_state(std::move(fd), std::move(speculate))
+    {}
+    future<> get_completion_future(int event) {
+        auto desc = get_desc(event);
+        *desc = pollable_fd_state_completion{};
+        return desc->get_future();
+    }
+
+    void complete_with(int event) {
+        get_desc(event)->complete_with(event);
+    }
+
+    // Returns whether MSG_ZEROCOPY can be used, enabling it on first use.
+    // Fails for anything but TCP and UDP sockets.
+    bool enable_zerocopy() noexcept {
+        if (_zerocopy == zerocopy_mode::unknown) {
+            int one = 1;
+            auto r = ::setsockopt(fd.get(), SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one));
+            _zerocopy = r == 0 ? zerocopy_mode::enabled : zerocopy_mode::disabled;
+        }
+        return _zerocopy == zerocopy_mode::enabled;
+    }
+    bool has_zerocopy_sends() const noexcept {
+        return !_zerocopy_sends.empty();
+    }
+    void track_zerocopy_send(net::packet data) {
+        _zerocopy_sends.push_back(zerocopy_send{_next_zerocopy_id++, false, std::move(data)});
+    }
+    void complete_zerocopy_sends(uint32_t lo, uint32_t hi, bool copied) noexcept {
+        for (auto& s : _zerocopy_sends) {
+            if (uint32_t(s.id - lo) <= uint32_t(hi - lo)) {
+                s.done = true;
+                s.data = {};
+            }
+        }
+        while (!_zerocopy_sends.empty() && _zerocopy_sends.front().done) {
+            _zerocopy_sends.pop_front();
+        }
+        if (copied) {
+            // The kernel had to copy anyway (e.g. loopback, or a device
+            // without scatter-gather), so we're only paying for notifications
+            _zerocopy = zerocopy_mode::disabled;
+        }
+    }
+};
+
+reactor_backend_epoll::~reactor_backend_epoll() {
+    for (auto* efd : _zerocopy_lingering) {
+        delete efd;
+    }
+}
+
 bool
 reactor_backend_epoll::wait_and_process(int timeout, const sigset_t* active_sigmask) {
     // If we plan to sleep, disable the timer thread steady clock timer (since it won't
@@ -869,6 +992,18 @@ reactor_backend_epoll::wait_and_process(int timeout, const sigset_t* active_sigm
             _steady_clock_timer_deadline = {};
             continue;
         }
+        auto* efd = static_cast<epoll_pollable_fd_state*>(pfd);
+        if (efd->lingering) {
+            reap_lingering(*efd);
+            continue;
+        }
+        if ((evt.events & EPOLLERR) && efd->has_zerocopy_sends()) {
+            // Zero-copy notifications are queued as socket errors. Consume
+            // them and see if anything else is left before waking waiters.
+            drain_zerocopy_notifications(*efd);
+            ::pollfd p = { pfd->fd.get(), short(pfd->events_epoll), 0 };
+            evt.events = ::poll(&p, 1, 0) == 1 ? p.revents : 0;
+        }
         bool has_error = evt.events & (EPOLLHUP | EPOLLERR);
         if (has_error) {
             // treat the events as required events when error occurs, let
@@ -899,35 +1034,6 @@ reactor_backend_epoll::wait_and_process(int timeout, const sigset_t* active_sigm
     return nr;
 }
 
-class epoll_pollable_fd_state : public pollable_fd_state {
-    pollable_fd_state_completion _pollin;
-    pollable_fd_state_completion _pollout;
-    pollable_fd_state_completion _pollrdhup;
-
-    pollable_fd_state_completion* get_desc(int events) {
-        if (events & EPOLLIN) {
-            return &_pollin;
-        }
-        if (events & EPOLLOUT) {
-            return &_pollout;
-        }
-        return &_pollrdhup;
-    }
-public:
-    explicit epoll_pollable_fd_state(file_desc fd, speculation speculate)
-        : pollable_fd_state(std::move(fd), std::move(speculate))
-    {}
-    future<> get_completion_future(int event) {
-        auto desc = get_desc(event);
-        *desc = pollable_fd_state_completion{};
-        return desc->get_future();
-    }
-
-    void complete_with(int event) {
-        get_desc(event)->complete_with(event);
-    }
-};
-
 bool reactor_backend_epoll::reap_kernel_completions() {
     // epoll does not have a separate submission stage, and just
     // calls epoll_ctl everytime it needs, so this method and
@@ -1030,13 +1136,71 @@ future<> reactor_backend_epoll::poll_rdhup(pollable_fd_state& fd) {
 }
 
 void reactor_backend_epoll::forget(pollable_fd_state& fd) noexcept {
+    auto* efd = static_cast<epoll_pollable_fd_state*>(&fd);
+    if (efd->has_zerocopy_sends()) {
+        drain_zerocopy_notifications(*efd);
+    }
+    if (efd->has_zerocopy_sends()) {
+        // The kernel will keep transmitting (and retransmitting) from the
+        // buffers after the socket is closed, so hold on to it until all
+        // notifications are in. An fd with no events only reports errors;
+        // use edge triggering so a socket error doesn't make us spin.
+        ::epoll_event eevt;
+        eevt.events = EPOLLET;
+        eevt.data.ptr = efd;
+        auto ctl = fd.events_epoll ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        try {
+            _zerocopy_lingering.insert(efd);
+            if (::epoll_ctl(_epollfd.get(), ctl, fd.fd.get(), &eevt) == 0) {
+                fd.events_epoll = EPOLLET;
+                fd.events_requested = 0;
+                efd->lingering = true;
+                return;
+            }
+            _zerocopy_lingering.erase(efd);
+        } catch (...) {
+        }
+        seastar_logger.warn("Failed to wait for zero-copy sends of a closed socket, their buffers may be reused early");
+    }
     if (fd.events_epoll) {
         ::epoll_ctl(_epollfd.get(), EPOLL_CTL_DEL, fd.fd.get(), nullptr);
     }
-    auto* efd = static_cast<epoll_pollable_fd_state*>(&fd);
     delete efd;
 }
 
+void reactor_backend_epoll::drain_zerocopy_notifications(epoll_pollable_fd_state& fd) noexcept {
+    while (fd.has_zerocopy_sends()) {
+        alignas(::cmsghdr) char control[CMSG_SPACE(sizeof(::sock_extended_err) + sizeof(::sockaddr_in6))];
+        ::msghdr mh = {};
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+        if (::recvmsg(fd.fd.get(), &mh, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            // EAGAIN: the queue is empty
+            return;
+        }
+        for (auto cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm)) {
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                    && !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            ::sock_extended_err serr;
+            std::memcpy(&serr, CMSG_DATA(cm), sizeof(serr));
+            if (serr.ee_errno == 0 && serr.ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                fd.complete_zerocopy_sends(serr.ee_info, serr.ee_data, serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED);
+            }
+        }
+    }
+}
+
+void reactor_backend_epoll::reap_lingering(epoll_pollable_fd_state& fd) noexcept {
+    drain_zerocopy_notifications(fd);
+    if (!fd.has_zerocopy_sends()) {
+        ::epoll_ctl(_epollfd.get(), EPOLL_CTL_DEL, fd.fd.get(), nullptr);
+        _zerocopy_lingering.erase(&fd);
+        delete &fd;
+    }
+}
+
 future<std::tuple<pollable_fd, socket_address>>
 reactor_backend_epoll::accept(pollable_fd_state& listenfd) {
     return _r.do_accept(listenfd);
@@ -1075,6 +1239,37 @@ reactor_backend_epoll::sendmsg(pollable_fd_state& fd, net::packet& p) {
     return _r.do_sendmsg(fd, p);
 }
 
+future<size_t>
+reactor_backend_epoll::sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p) {
+    auto& efd = static_cast<epoll_pollable_fd_state&>(fd);
+    if (!efd.enable_zerocopy()) {
+        return _r.do_sendmsg(fd, p);
+    }
+    // Notifications of earlier sends may be holding on to socket memory
+    drain_zerocopy_notifications(efd);
+    return writeable(fd).then([this, &efd, &p] {
+        ::msghdr mh = {};
+        mh.msg_iov = reinterpret_cast<iovec*>(p.fragment_array());
+        mh.msg_iovlen = std::min<size_t>(p.nr_frags(), IOV_MAX);
+        auto r = ::sendmsg(efd.fd.get(), &mh, MSG_NOSIGNAL | MSG_ZEROCOPY);
+        if (r == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return sendmsg_zerocopy(efd, p);
+            }
+            if (errno == ENOBUFS) {
+                // Too many notifications outstanding, copy this one
+                return _r.do_sendmsg(efd, p);
+            }
+            return make_exception_future<size_t>(std::system_error(errno, std::system_category()));
+        }
+        efd.track_zerocopy_send(p.share(0, r));
+        if (size_t(r) == p.len()) {
+            efd.speculate_epoll(EPOLLOUT);
+        }
+        return make_ready_future<size_t>(r);
+    });
+}
+
 future<temporary_buffer<char>>
 reactor_backend_epoll::recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba) {
     return _r.do_recv_some(fd, ba);
@@ -1102,9 +1297,19 @@ void reactor_backend_epoll::reset_preemption_monitor() {
 
 #ifdef SEASTAR_HAVE_URING
 
+// Multishot requests and provided buffer rings appeared in liburing 2.2
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_ACCEPT_MULTISHOT)
+#define SEASTAR_HAVE_URING_MULTISHOT
+#endif
+
+// NVMe passthrough needs big sqes and cqes, from liburing 2.2 and Linux 5.19
+#if defined(IORING_SETUP_SQE128) && defined(IORING_SETUP_CQE32) && defined(NVME_URING_CMD_IO)
+#define SEASTAR_HAVE_URING_NVME
+#endif
+
 static
 std::optional<::io_uring>
-try_create_uring(unsigned queue_len, bool throw_on_error) {
+try_create_uring(unsigned queue_len, bool throw_on_error, ::io_uring_params params = {}) {
     auto required_features =
             IORING_FEAT_SUBMIT_STABLE
             | IORING_FEAT_NODROP;
@@ -1128,7 +1333,6 @@ try_create_uring(unsigned queue_len, bool throw_on_error) {
         }
     };
 
-    auto params = ::io_uring_params{};
     ::io_uring ring;
     auto err = ::io_uring_queue_init_params(queue_len, &ring, &params);
     if (err != 0) {
@@ -1205,21 +1409,365 @@ class reactor_backend_uring final : public reactor_backend {
     // issuing too small batches, too high and we require too much locked
     // memory, but otherwise it doesn't matter.
     static constexpr unsigned s_queue_len = 200;
+    // The kernel limits a single registered buffer to 1GB, so the shard's
+    // memory is registered as a series of buffers of this size.
+    static constexpr unsigned s_fixed_buffer_shift = 30;
+    // Upper bound on the registered file table, which is indexed by fd.
+    static constexpr unsigned s_max_fixed_files = 32768;
+    // Buffers provided to the kernel for multishot receives
+    static constexpr unsigned s_nr_provided_buffers = 256;
+    static constexpr size_t s_provided_buffer_size = 16384;
+    // A multishot request is cancelled when this much was received but not
+    // yet consumed, and re-armed once the consumer catches up.
+    static constexpr size_t s_max_multishot_recv_backlog = 1 << 20;
+    static constexpr size_t s_max_multishot_accept_backlog = 128;
     reactor& _r;
     ::io_uring _uring;
     bool _did_work_while_getting_sqe = false;
     bool _has_pending_submissions = false;
     file_desc _hrtimer_timerfd;
     preempt_io_context _preempt_io_context;
+    // Registered buffers cover [_fixed_buffers_start, _fixed_buffers_end);
+    // empty if --io-uring-fixed-buffers is off or registration failed.
+    uintptr_t _fixed_buffers_start = 0;
+    uintptr_t _fixed_buffers_end = 0;
+    struct fixed_file {
+        unsigned refs = 0;
+        bool registered = false;
+    };
+    // Indexed by file descriptor; empty if --io-uring-fixed-files is off
+    // or registration failed.
+    std::vector<fixed_file> _fixed_files;
+    // Number of times submission had to wake up the SQPOLL kernel thread
+    uint64_t _sqpoll_wakeups = 0;
+    // Set if --zerocopy-send-threshold is on and supported
+    bool _zerocopy_send = false;
+    // Set if the kernel can run all the file metadata operations of
+    // io_request (openat, statx, ...), see setup_file_metadata_ops()
+    bool _file_metadata_ops = false;
+
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+    // Ring of buffers the kernel picks from for multishot receives
+    // (IOSQE_BUFFER_SELECT). A buffer that receives data is handed over
+    // to the consumer as is, and its slot is refilled with a new one.
+    class provided_buffer_ring {
+        ::io_uring_buf_ring* _ring;
+        std::vector<temporary_buffer<char>> _bufs;
+        // Slots that could not be refilled due to allocation failure
+        std::vector<unsigned short> _missing;
+    public:
+        static constexpr int group_id = 0;
+        explicit provided_buffer_ring(::io_uring& uring)
+                : _ring(static_cast<::io_uring_buf_ring*>(::aligned_alloc(memory::page_size,
+                        align_up(s_nr_provided_buffers * sizeof(::io_uring_buf), memory::page_size))))
+                , _bufs(s_nr_provided_buffers) {
+            if (!_ring) {
+                throw std::bad_alloc();
+            }
+            std::memset(_ring, 0, s_nr_provided_buffers * sizeof(::io_uring_buf));
+            auto reg = ::io_uring_buf_reg{};
+            reg.ring_addr = reinterpret_cast<uint64_t>(_ring);
+            reg.ring_entries = s_nr_provided_buffers;
+            reg.bgid = group_id;
+            auto r = ::io_uring_register_buf_ring(&uring, &reg, 0);
+            if (r < 0) {
+                ::free(_ring);
+                throw std::system_error(-r, std::system_category(), "registering io_uring provided buffers");
+            }
+            for (unsigned short bid = 0; bid < s_nr_provided_buffers; ++bid) {
+                _bufs[bid] = temporary_buffer<char>(s_provided_buffer_size);
+                provide(bid);
+            }
+        }
+        // The ring memory must outlive the io_uring it is registered with
+        ~provided_buffer_ring() {
+            ::free(_ring);
+        }
+        temporary_buffer<char> take(unsigned short bid, size_t len) noexcept {
+            auto ret = std::move(_bufs[bid]);
+            ret.trim(len);
+            _missing.push_back(bid);
+            refill();
+            return ret;
+        }
+    private:
+        void provide(unsigned short bid) noexcept {
+            ::io_uring_buf_ring_add(_ring, _bufs[bid].get_write(), s_provided_buffer_size, bid, s_nr_provided_buffers - 1, 0);
+            ::io_uring_buf_ring_advance(_ring, 1);
+        }
+        void refill() noexcept {
+            try {
+                while (!_missing.empty()) {
+                    auto bid = _missing.back();
+                    _bufs[bid] = temporary_buffer<char>(s_provided_buffer_size);
+                    _missing.pop_back();
+                    provide(bid);
+                }
+            } catch (...) {
+                // Retried on the next take(); the kernel ends multishot
+                // receives with ENOBUFS if the ring runs dry meanwhile.
+            }
+        }
+    };
+#endif
+
+    // A request that may post several completions (as long as they carry
+    // IORING_CQE_F_MORE), so it needs the cqe flags. Told apart from regular
+    // kernel_completions by the low bit of the cqe user_data.
+    class flagged_completion {
+    public:
+        static constexpr uint64_t tag = 1;
+
+        virtual ~flagged_completion() = default;
+        virtual void complete_with(int res, unsigned flags) noexcept = 0;
+        uint64_t user_data() const noexcept {
+            return reinterpret_cast<uint64_t>(this) | tag;
+        }
+    };
+
+    // A multishot request armed on a socket.
+    //
+    // The object is owned by its fd state. Once orphaned by forget(), it
+    // cancels the request and deletes itself on the final completion.
+    class multishot_completion : public flagged_completion
+            , public boost::intrusive::list_base_hook<boost::intrusive::link_mode<boost::intrusive::auto_unlink>> {
+    protected:
+        reactor_backend_uring& _be;
+        int _fd;
+        bool _armed = false;
+        bool _cancelling = false;
+        bool _orphaned = false;
+    public:
+        multishot_completion(reactor_backend_uring& be, int fd) : _be(be), _fd(fd) {}
+        virtual void complete_with(int res, unsigned flags) noexcept override {
+            if (!(flags & IORING_CQE_F_MORE)) {
+                _armed = false;
+                _cancelling = false;
+            }
+            handle(res, flags);
+            if (_orphaned && !_armed) {
+                delete this;
+            } else if ((_orphaned || (!_armed && wants_more()) || (_armed && backlogged())) && !is_linked()) {
+                // Can't touch the submission ring while completions are
+                // being processed, see service_multishot_requests().
+                _be._multishot_service_queue.push_back(*this);
+            }
+        }
+        void orphan() noexcept {
+            _orphaned = true;
+            if (!_armed) {
+                delete this;
+            } else {
+                cancel();
+            }
+        }
+        void service() noexcept {
+            if (_orphaned || (_armed && backlogged())) {
+                cancel();
+            } else if (!_armed && wants_more()) {
+                arm();
+            }
+        }
+    protected:
+        void arm() noexcept {
+            auto sqe = _be.get_sqe();
+            prepare(sqe);
+            sqe->user_data = user_data();
+            _be._has_pending_submissions = true;
+            _armed = true;
+        }
+        void cancel() noexcept {
+            if (_cancelling || !_armed) {
+                return;
+            }
+            _cancelling = true;
+            // get_sqe() may process completions, which may delete us
+            auto& be = _be;
+            auto data = user_data();
+            auto sqe = be.get_sqe();
+            ::io_uring_prep_cancel(sqe, reinterpret_cast<void*>(data), 0);
+            ::io_uring_sqe_set_data(sqe, nullptr);
+            be._has_pending_submissions = true;
+        }
+        virtual void prepare(::io_uring_sqe* sqe) noexcept = 0;
+        virtual void handle(int res, unsigned flags) noexcept = 0;
+        // Whether a consumer is waiting for the next completion
+        virtual bool wants_more() const noexcept = 0;
+        virtual bool backlogged() const noexcept = 0;
+    };
+
+    // Queues completions of a multishot request until they are consumed
+    template <typename T>
+    class multishot_queue : public multishot_completion {
+    protected:
+        circular_buffer<T> _q;
+        std::optional<promise<T>> _waiter;
+        std::exception_ptr _ex;
+    public:
+        using multishot_completion::multishot_completion;
+        future<T> get() {
+            if (!_q.empty()) {
+                auto ret = std::move(_q.front());
+                _q.pop_front();
+                consumed(ret);
+                return make_ready_future<T>(std::move(ret));
+            }
+            if (_ex) {
+                return make_exception_future<T>(_ex);
+            }
+            if (done()) {
+                return make_ready_future<T>(T());
+            }
+            if (!_armed) {
+                arm();
+            }
+            SEASTAR_ASSERT(!_waiter);
+            return _waiter.emplace().get_future();
+        }
+    protected:
+        void deliver(T v) noexcept {
+            if (_orphaned) {
+                return;
+            }
+            if (_waiter) {
+                _waiter->set_value(std::move(v));
+                _waiter.reset();
+            } else {
+                queued(v);
+                _q.push_back(std::move(v));
+            }
+        }
+        void fail(std::exception_ptr ex) noexcept {
+            _ex = ex;
+            if (_waiter) {
+                _waiter->set_exception(std::move(ex));
+                _waiter.reset();
+            }
+        }
+        // End of stream: the waiter, if any, gets a default-constructed T
+        void finish() noexcept {
+            if (_waiter) {
+                _waiter->set_value(T());
+                _waiter.reset();
+            }
+        }
+        virtual bool wants_more() const noexcept override {
+            return bool(_waiter) && !_ex && !done();
+        }
+        virtual bool done() const noexcept = 0;
+        virtual void queued(const T&) noexcept {}
+        virtual void consumed(const T&) noexcept {}
+    };
+
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+    class multishot_recv final : public multishot_queue<temporary_buffer<char>> {
+        size_t _backlog = 0;
+        bool _eof = false;
+    public:
+        using multishot_queue::multishot_queue;
+    private:
+        virtual void prepare(::io_uring_sqe* sqe) noexcept override {
+            ::io_uring_prep_recv(sqe, _fd, nullptr, 0, 0);
+            sqe->ioprio |= IORING_RECV_MULTISHOT;
+            sqe->flags |= IOSQE_BUFFER_SELECT;
+            sqe->buf_group = provided_buffer_ring::group_id;
+        }
+        virtual void handle(int res, unsigned flags) noexcept override {
+            if (res > 0) {
+                // The buffer has to be taken even if orphaned, to return its slot to the ring
+                deliver(_be._provided_buffers->take(flags >> IORING_CQE_BUFFER_SHIFT, res));
+            } else if (res == 0) {
+                _eof = true;
+                finish();
+            } else if (res != -ENOBUFS && res != -ECANCELED) {
+                // ENOBUFS and ECANCELED just end the request; it is re-armed on demand
+                fail(std::make_exception_ptr(std::system_error(-res, std::system_category())));
+            }
+        }
+        virtual bool done() const noexcept override {
+            return _eof;
+        }
+        virtual bool backlogged() const noexcept override {
+            return _backlog > s_max_multishot_recv_backlog;
+        }
+        virtual void queued(const temporary_buffer<char>& buf) noexcept override {
+            _backlog += buf.size();
+        }
+        virtual void consumed(const temporary_buffer<char>& buf) noexcept override {
+            _backlog -= buf.size();
+        }
+    };
+
+    class multishot_accept final : public multishot_queue<std::tuple<pollable_fd, socket_address>> {
+        pollable_fd_state& _listenfd;
+    public:
+        multishot_accept(reactor_backend_uring& be, pollable_fd_state& listenfd)
+                : multishot_queue(be, listenfd.fd.get()), _listenfd(listenfd) {}
+    private:
+        virtual void prepare(::io_uring_sqe* sqe) noexcept override {
+            // With a single request for many connections there is nowhere
+            // stable to store peer addresses, so they are queried afterwards.
+            ::io_uring_prep_accept(sqe, _fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+        }
+        virtual void handle(int res, unsigned flags) noexcept override {
+            if (res >= 0) {
+                auto fd = file_desc::from_fd(res);
+                if (_orphaned) {
+                    return;
+                }
+                try {
+                    auto sa = fd.get_remote_address();
+                    deliver({pollable_fd(std::move(fd), pollable_fd::speculation(EPOLLOUT)), std::move(sa)});
+                } catch (...) {
+                    // The connection may be gone already; drop it
+                }
+            } else if (res != -ECANCELED && !_orphaned) {
+                auto ex = std::make_exception_ptr(std::system_error(-res, std::system_category()));
+                if (res == -EINVAL) {
+                    try {
+                        // The chances are that we shutting down the connection.
+                        _listenfd.maybe_no_more_recv();
+                    } catch (...) {
+                        ex = std::current_exception();
+                    }
+                }
+                fail(std::move(ex));
+            }
+        }
+        virtual bool done() const noexcept override {
+            return false;
+        }
+        virtual bool backlogged() const noexcept override {
+            return _q.size() > s_max_multishot_accept_backlog;
+        }
+    };
+#endif
 
     class uring_pollable_fd_state : public pollable_fd_state {
         pollable_fd_state_completion _completion_pollin;
         pollable_fd_state_completion _completion_pollout;
         pollable_fd_state_completion _completion_pollrdhup;
     public:
+        // Set if zero-copy sends were refused (not a TCP or UDP socket)
+        bool _zerocopy_unsupported = false;
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        multishot_recv* _multishot_recv = nullptr;
+        multishot_accept* _multishot_accept = nullptr;
+#endif
         explicit uring_pollable_fd_state(file_desc desc, speculation speculate)
                 : pollable_fd_state(std::move(desc), std::move(speculate)) {
         }
+        ~uring_pollable_fd_state() {
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+            if (_multishot_recv) {
+                _multishot_recv->orphan();
+            }
+            if (_multishot_accept) {
+                _multishot_accept->orphan();
+            }
+#endif
+        }
         pollable_fd_state_completion* get_desc(int events) {
             if (events & POLLIN) {
                 return &_completion_pollin;
@@ -1234,6 +1782,51 @@ class reactor_backend_uring final : public reactor_backend {
         }
     };
 
+#ifdef IORING_CQE_F_NOTIF
+    // A zero-copy send. The kernel posts the result of the send, and if that
+    // carries IORING_CQE_F_MORE, a notification once it no longer references
+    // the buffers, which are held until then.
+    class zerocopy_send_completion final : public flagged_completion {
+        uring_pollable_fd_state& _fd;
+        net::packet _p;
+        ::msghdr _mh = {};
+        promise<size_t> _result;
+    public:
+        zerocopy_send_completion(uring_pollable_fd_state& fd, net::packet p)
+                : _fd(fd), _p(std::move(p)) {
+            _mh.msg_iov = reinterpret_cast<iovec*>(_p.fragment_array());
+            _mh.msg_iovlen = std::min<size_t>(_p.nr_frags(), IOV_MAX);
+        }
+        virtual void complete_with(int res, unsigned flags) noexcept override {
+            if (flags & IORING_CQE_F_NOTIF) {
+                delete this;
+                return;
+            }
+            // The fd state can't go away before the result completes
+            if (res == -EOPNOTSUPP) {
+                _fd._zerocopy_unsupported = true;
+                _result.set_value(0);
+            } else if (res < 0) {
+                _result.set_exception(std::make_exception_ptr(std::system_error(-res, std::system_category())));
+            } else {
+                if (size_t(res) == _p.len()) {
+                    _fd.speculate_epoll(EPOLLOUT);
+                }
+                _result.set_value(res);
+            }
+            if (!(flags & IORING_CQE_F_MORE)) {
+                delete this;
+            }
+        }
+        ::msghdr* msghdr() {
+            return &_mh;
+        }
+        future<size_t> get_future() {
+            return _result.get_future();
+        }
+    };
+#endif
+
     // eventfd and timerfd both need an 8-byte read after completion
     class recurring_eventfd_or_timerfd_completion : public fd_kernel_completion {
         bool _armed = false;
@@ -1278,11 +1871,102 @@ class reactor_backend_uring final : public reactor_backend {
 
     hrtimer_completion _hrtimer_completion;
     smp_wakeup_completion _smp_wakeup_completion;
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+    // Set if --io-uring-multishot-net is on and supported
+    std::unique_ptr<provided_buffer_ring> _provided_buffers;
+#endif
+    // Multishot requests that need re-arming or cancelling
+    boost::intrusive::list<multishot_completion, boost::intrusive::constant_time_size<false>> _multishot_service_queue;
 private:
     static file_desc make_timerfd() {
         return file_desc::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC|TFD_NONBLOCK);
     }
 
+    // Returns a hyperthread sibling of the current CPU, if there is one
+    static std::optional<unsigned> sibling_cpu() {
+        auto cpu = ::sched_getcpu();
+        if (cpu < 0) {
+            return std::nullopt;
+        }
+        try {
+            auto siblings = resource::parse_cpuset(read_first_line(
+                    fmt::format("/sys/devices/system/cpu/cpu{}/topology/thread_siblings_list", cpu)));
+            if (siblings) {
+                for (auto sibling : *siblings) {
+                    if (sibling != unsigned(cpu)) {
+                        return sibling;
+                    }
+                }
+            }
+        } catch (...) {
+            seastar_logger.debug("Failed to read CPU topology: {}", std::current_exception());
+        }
+        return std::nullopt;
+    }
+
+    // The flags a ring needs for the requests it's configured to submit
+    static unsigned uring_entry_flags(const reactor_config& cfg) {
+        if (!cfg.uring_nvme_passthrough) {
+            return 0;
+        }
+#ifdef SEASTAR_HAVE_URING_NVME
+        if (kernel_uname().whitelisted({"5.19"})) {
+            return IORING_SETUP_SQE128 | IORING_SETUP_CQE32;
+        }
+        seastar_logger.warn("--io-uring-nvme-passthrough requires Linux 5.19 or later, ignoring");
+#else
+        seastar_logger.warn("--io-uring-nvme-passthrough is not supported by this build's liburing, ignoring");
+#endif
+        return 0;
+    }
+
+    static ::io_uring create_uring(const reactor_config& cfg) {
+        auto entry_flags = uring_entry_flags(cfg);
+        if (cfg.uring_sqpoll) {
+            if (kernel_uname().whitelisted({"5.11"})) {
+                auto params = ::io_uring_params{};
+                params.flags = IORING_SETUP_SQPOLL | entry_flags;
+                params.sq_thread_idle = cfg.uring_sqpoll_idle_ms;
+                if (cfg.uring_sqpoll_pin_sibling) {
+                    if (auto cpu = sibling_cpu()) {
+                        params.flags |= IORING_SETUP_SQ_AFF;
+                        params.sq_thread_cpu = *cpu;
+                    } else {
+                        seastar_logger.warn("No hyperthread sibling found, not pinning the io_uring polling thread");
+                    }
+                }
+                try {
+                    return try_create_uring(s_queue_len, true, params).value();
+                } catch (...) {
+                    seastar_logger.warn("Failed to create io_uring with a polling thread, using a regular ring: {}", std::current_exception());
+                }
+            } else {
+                seastar_logger.warn("--io-uring-sqpoll requires Linux 5.11 or later, ignoring");
+            }
+        }
+        if (entry_flags) {
+            auto params = ::io_uring_params{};
+            params.flags = entry_flags;
+            try {
+                return try_create_uring(s_queue_len, true, params).value();
+            } catch (...) {
+                seastar_logger.warn("Failed to create io_uring with big entries, not passing NVMe I/O through: {}", std::current_exception());
+            }
+        }
+        return try_create_uring(s_queue_len, true).value();
+    }
+
+    // Submits queued sqes. In SQPOLL mode this only enters the kernel
+    // if the polling thread went to sleep and needs to be woken up.
+    int submit() {
+        if ((_uring.flags & IORING_SETUP_SQPOLL)
+                && (__atomic_load_n(_uring.sq.kflags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP)
+                && ::io_uring_sq_ready(&_uring)) {
+            ++_sqpoll_wakeups;
+        }
+        return ::io_uring_submit(&_uring);
+    }
+
     // Can fail if the completion queue is full
     ::io_uring_sqe* try_get_sqe() {
         return ::io_uring_get_sqe(&_uring);
@@ -1292,7 +1976,7 @@ class reactor_backend_uring final : public reactor_backend {
         if (_has_pending_submissions) {
             _has_pending_submissions = false;
             _did_work_while_getting_sqe = false;
-            io_uring_submit(&_uring);
+            submit();
             return true;
         } else {
             return std::exchange(_did_work_while_getting_sqe, false);
@@ -1309,6 +1993,124 @@ class reactor_backend_uring final : public reactor_backend {
         return sqe;
     }
 
+    void setup_fixed_buffers() {
+        memory::memory_layout layout;
+        try {
+            layout = memory::get_memory_layout();
+        } catch (...) {
+            seastar_logger.warn("io_uring fixed buffers require the seastar allocator, not using them");
+            return;
+        }
+        constexpr size_t buffer_size = size_t(1) << s_fixed_buffer_shift;
+        std::vector<::iovec> iovs;
+        for (auto p = layout.start; p < layout.end; p += buffer_size) {
+            iovs.push_back(::iovec{reinterpret_cast<void*>(p), std::min<size_t>(buffer_size, layout.end - p)});
+        }
+        auto r = ::io_uring_register_buffers(&_uring, iovs.data(), iovs.size());
+        if (r < 0) {
+            seastar_logger.warn("Failed to register {} bytes of memory as io_uring fixed buffers, not using them: {}",
+                    layout.end - layout.start, std::system_error(-r, std::system_category()).what());
+            return;
+        }
+        _fixed_buffers_start = layout.start;
+        _fixed_buffers_end = layout.end;
+    }
+
+    void setup_fixed_files() {
+        struct ::rlimit lim;
+        if (::getrlimit(RLIMIT_NOFILE, &lim) == -1) {
+            return;
+        }
+        // Start with an empty (sparse) table; slots are filled in
+        // by register_file() as files are opened.
+        std::vector<int> fds(std::min<rlim_t>(lim.rlim_cur, s_max_fixed_files), -1);
+        auto r = ::io_uring_register_files(&_uring, fds.data(), fds.size());
+        if (r < 0) {
+            seastar_logger.warn("Failed to register io_uring fixed file table, not using it: {}",
+                    std::system_error(-r, std::system_category()).what());
+            return;
+        }
+        _fixed_files.resize(fds.size());
+    }
+
+    void setup_zerocopy_send() {
+#ifdef IORING_CQE_F_NOTIF
+        if (kernel_uname().whitelisted({"6.1"})) {
+            _zerocopy_send = true;
+            return;
+        }
+#endif
+        seastar_logger.warn("--zerocopy-send-threshold requires Linux 6.1 or later with the io_uring reactor backend, ignoring");
+    }
+
+    // The metadata opcodes appeared over several kernel releases (the last
+    // ones in 5.11), and the reactor uses either all of them or none.
+    void setup_file_metadata_ops() {
+        auto probe = ::io_uring_get_probe_ring(&_uring);
+        if (!probe) {
+            return;
+        }
+        auto free_probe = defer([&] () noexcept { ::io_uring_free_probe(probe); });
+        auto ops = {
+                IORING_OP_OPENAT,   // linux 5.6
+                IORING_OP_STATX,
+                IORING_OP_FALLOCATE,
+                IORING_OP_UNLINKAT, // linux 5.11
+                IORING_OP_RENAMEAT,
+                };
+        for (auto op : ops) {
+            if (!io_uring_opcode_supported(probe, op)) {
+                seastar_logger.debug("io_uring opcode {} not supported, running file metadata operations in the syscall thread pool", static_cast<int>(op));
+                return;
+            }
+        }
+        _file_metadata_ops = true;
+    }
+
+    void setup_multishot_net() {
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        if (!kernel_uname().whitelisted({"6.0"})) {
+            seastar_logger.warn("--io-uring-multishot-net requires Linux 6.0 or later, ignoring");
+            return;
+        }
+        try {
+            _provided_buffers = std::make_unique<provided_buffer_ring>(_uring);
+        } catch (...) {
+            seastar_logger.warn("Failed to set up io_uring provided buffers, not using multishot networking: {}", std::current_exception());
+        }
+#else
+        seastar_logger.warn("--io-uring-multishot-net not supported by the liburing version seastar was built with, ignoring");
+#endif
+    }
+
+    // Returns the index of the registered buffer that fully contains
+    // [addr, addr + size), or -1 if there is none.
+    int fixed_buffer_index(const char* addr, size_t size) const noexcept {
+        auto a = reinterpret_cast<uintptr_t>(addr);
+        if (a < _fixed_buffers_start || a + size > _fixed_buffers_end || size == 0) {
+            return -1;
+        }
+        auto first = (a - _fixed_buffers_start) >> s_fixed_buffer_shift;
+        auto last = (a + size - 1 - _fixed_buffers_start) >> s_fixed_buffer_shift;
+        return first == last ? int(first) : -1;
+    }
+
+    // Registered files occupy the slot matching their descriptor, so the
+    // sqe's fd field doesn't change, only its interpretation.
+    void maybe_use_fixed_file(::io_uring_sqe* sqe, int fd) const noexcept {
+        if (size_t(fd) < _fixed_files.size() && _fixed_files[fd].registered) {
+            sqe->flags |= IOSQE_FIXED_FILE;
+        }
+    }
+
+    static void maybe_set_dsync(::io_uring_sqe* sqe, bool dsync) noexcept {
+#ifdef RWF_DSYNC
+        if (dsync) {
+            sqe->rw_flags |= RWF_DSYNC;
+        }
+#endif
+    }
+
     future<> poll(pollable_fd_state& fd, int events) {
         auto sqe = get_sqe();
         ::io_uring_prep_poll_add(sqe, fd.fd.get(), events);
@@ -1319,32 +2121,55 @@ class reactor_backend_uring final : public reactor_backend {
     }
 
     void submit_io_request(const internal::io_request& req, io_completion* completion) {
+        auto link = req.linked();
+        if (link && ::io_uring_sq_space_left(&_uring) <= link) {
+            // A chain is linked within a single submission only, so it
+            // mustn't be cut by the ring filling up halfway through
+            do_flush_submission_ring();
+        }
         auto sqe = get_sqe();
         using o = internal::io_request::operation;
         switch (req.opcode()) {
             case o::read: {
                 const auto& op = req.as<io_request::operation::read>();
-                ::io_uring_prep_read(sqe, op.fd, op.addr, op.size, op.pos);
+                auto buf_index = fixed_buffer_index(op.addr, op.size);
+                if (buf_index >= 0) {
+                    ::io_uring_prep_read_fixed(sqe, op.fd, op.addr, op.size, op.pos, buf_index);
+                } else {
+                    ::io_uring_prep_read(sqe, op.fd, op.addr, op.size, op.pos);
+                }
+                maybe_use_fixed_file(sqe, op.fd);
                 break;
             }
             case o::write: {
                 const auto& op = req.as<io_request::operation::write>();
-                ::io_uring_prep_write(sqe, op.fd, op.addr, op.size, op.pos);
+                auto buf_index = fixed_buffer_index(op.addr, op.size);
+                if (buf_index >= 0) {
+                    ::io_uring_prep_write_fixed(sqe, op.fd, op.addr, op.size, op.pos, buf_index);
+                } else {
+                    ::io_uring_prep_write(sqe, op.fd, op.addr, op.size, op.pos);
+                }
+                maybe_set_dsync(sqe, op.dsync);
+                maybe_use_fixed_file(sqe, op.fd);
                 break;
             }
             case o::readv: {
                 const auto& op = req.as<io_request::operation::readv>();
                 ::io_uring_prep_readv(sqe, op.fd, op.iovec, op.iov_len, op.pos);
+                maybe_use_fixed_file(sqe, op.fd);
                 break;
             }
             case o::writev: {
                 const auto& op = req.as<io_request::operation::writev>();
                 ::io_uring_prep_writev(sqe, op.fd, op.iovec, op.iov_len, op.pos);
+                maybe_set_dsync(sqe, op.dsync);
+                maybe_use_fixed_file(sqe, op.fd);
                 break;
             }
             case o::fdatasync: {
                 const auto& op = req.as<io_request::operation::fdatasync>();
                 ::io_uring_prep_fsync(sqe, op.fd, IORING_FSYNC_DATASYNC);
+                maybe_use_fixed_file(sqe, op.fd);
                 break;
             }
             case o::recv: {
@@ -1377,15 +2202,70 @@ class reactor_backend_uring final : public reactor_backend {
                 ::io_uring_prep_connect(sqe, op.fd, op.sockaddr, op.socklen);
                 break;
             }
+            case o::openat: {
+                const auto& op = req.as<io_request::operation::openat>();
+                ::io_uring_prep_openat(sqe, AT_FDCWD, op.path, op.flags, op.mode);
+                break;
+            }
+            case o::statx: {
+                const auto& op = req.as<io_request::operation::statx>();
+                ::io_uring_prep_statx(sqe, op.fd, op.path, op.flags, op.mask, op.statx);
+                break;
+            }
+            case o::unlinkat: {
+                const auto& op = req.as<io_request::operation::unlinkat>();
+                ::io_uring_prep_unlinkat(sqe, AT_FDCWD, op.path, op.flags);
+                break;
+            }
+            case o::renameat: {
+                const auto& op = req.as<io_request::operation::renameat>();
+                ::io_uring_prep_renameat(sqe, AT_FDCWD, op.oldpath, AT_FDCWD, op.newpath, op.flags);
+                break;
+            }
+            case o::fallocate: {
+                const auto& op = req.as<io_request::operation::fallocate>();
+                ::io_uring_prep_fallocate(sqe, op.fd, op.mode, op.pos, op.len);
+                maybe_use_fixed_file(sqe, op.fd);
+                break;
+            }
+            case o::cancel: {
+                const auto& op = req.as<io_request::operation::cancel>();
+                ::io_uring_prep_cancel(sqe, op.addr, 0);
+                break;
+            }
+            case o::nvme: {
+#ifdef SEASTAR_HAVE_URING_NVME
+                const auto& op = req.as<io_request::operation::nvme>();
+                ::io_uring_prep_rw(IORING_OP_URING_CMD, sqe, op.fd, nullptr, 0, 0);
+                sqe->cmd_op = NVME_URING_CMD_IO;
+                auto cmd = reinterpret_cast<::nvme_uring_cmd*>(sqe->cmd);
+                std::memset(cmd, 0, sizeof(*cmd));
+                cmd->opcode = op.nvme_opcode();
+                cmd->nsid = op.nsid;
+                cmd->addr = reinterpret_cast<uintptr_t>(op.addr);
+                cmd->data_len = op.size;
+                cmd->cdw10 = uint32_t(op.slba());
+                cmd->cdw11 = uint32_t(op.slba() >> 32);
+                cmd->cdw12 = op.cdw12();
+                break;
+#else
+                seastar_logger.error("Invalid operation for iocb: {}", req.opname());
+                abort();
+#endif
+            }
             case o::poll_add:
             case o::poll_remove:
-            case o::cancel:
+            case o::discard:
+            case o::chain:
                 // The reactor does not generate these types of I/O requests yet, so
                 // this path is unreachable. As more features of io_uring are exploited,
                 // we'll utilize more of these opcodes.
                 seastar_logger.error("Invalid operation for iocb: {}", req.opname());
                 abort();
         }
+        if (link) {
+            sqe->flags |= IOSQE_IO_LINK;
+        }
         ::io_uring_sqe_set_data(sqe, completion);
 
         _has_pending_submissions = true;
@@ -1405,9 +2285,26 @@ class reactor_backend_uring final : public reactor_backend {
     void do_process_ready_kernel_completions(::io_uring_cqe** buf, size_t nr) {
         for (auto p = buf; p != buf + nr; ++p) {
             auto cqe = *p;
-            auto completion = reinterpret_cast<kernel_completion*>(cqe->user_data);
-            completion->complete_with(cqe->res);
+            if (cqe->user_data & flagged_completion::tag) {
+                auto completion = reinterpret_cast<flagged_completion*>(cqe->user_data & ~flagged_completion::tag);
+                completion->complete_with(cqe->res, cqe->flags);
+            } else if (auto completion = reinterpret_cast<kernel_completion*>(cqe->user_data)) {
+                completion->complete_with(cqe->res);
+            }
+            // else: a cancellation request, nothing to do
+        }
+    }
+
+    // Returns true if any work was done
+    bool service_multishot_requests() {
+        bool did_work = false;
+        while (!_multishot_service_queue.empty()) {
+            auto& mc = _multishot_service_queue.front();
+            _multishot_service_queue.pop_front();
+            mc.service();
+            did_work = true;
         }
+        return did_work;
     }
 
     // Returns true if completions were processed
@@ -1437,7 +2334,7 @@ class reactor_backend_uring final : public reactor_backend {
 public:
     explicit reactor_backend_uring(reactor& r)
             : _r(r)
-            , _uring(try_create_uring(s_queue_len, true).value())
+            , _uring(create_uring(r._cfg))
             , _hrtimer_timerfd(make_timerfd())
             , _preempt_io_context(_r, _r._task_quota_timer, _hrtimer_timerfd)
             , _hrtimer_completion(_r, _hrtimer_timerfd)
@@ -1446,6 +2343,19 @@ class reactor_backend_uring final : public reactor_backend {
         // expired when it really hasn't, we don't want to block in read(tfd, ...).
         auto tfd = _r._task_quota_timer.get();
         ::fcntl(tfd, F_SETFL, ::fcntl(tfd, F_GETFL) | O_NONBLOCK);
+        if (_r._cfg.uring_fixed_buffers) {
+            setup_fixed_buffers();
+        }
+        if (_r._cfg.uring_fixed_files) {
+            setup_fixed_files();
+        }
+        if (_r._cfg.uring_multishot_net) {
+            setup_multishot_net();
+        }
+        if (_r._cfg.zerocopy_send_threshold) {
+            setup_zerocopy_send();
+        }
+        setup_file_metadata_ops();
     }
     ~reactor_backend_uring() {
         ::io_uring_queue_exit(&_uring);
@@ -1457,7 +2367,8 @@ class reactor_backend_uring final : public reactor_backend {
         bool did_work = false;
         did_work |= _preempt_io_context.service_preempting_io();
         did_work |= queue_pending_file_io();
-        did_work |= ::io_uring_submit(&_uring);
+        did_work |= service_multishot_requests();
+        did_work |= submit();
         return did_work;
     }
     virtual bool kernel_events_can_sleep() const override {
@@ -1467,7 +2378,8 @@ class reactor_backend_uring final : public reactor_backend {
     virtual void wait_and_process_events(const sigset_t* active_sigmask) override {
         _smp_wakeup_completion.maybe_rearm(*this);
         _hrtimer_completion.maybe_rearm(*this);
-        ::io_uring_submit(&_uring);
+        service_multishot_requests();
+        submit();
         bool did_work = false;
         did_work |= _preempt_io_context.service_preempting_io();
         did_work |= std::exchange(_did_work_while_getting_sqe, false);
@@ -1507,6 +2419,15 @@ class reactor_backend_uring final : public reactor_backend {
         delete pfd;
     }
     virtual future<std::tuple<pollable_fd, socket_address>> accept(pollable_fd_state& listenfd) override {
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        if (_provided_buffers) {
+            auto& ufd = static_cast<uring_pollable_fd_state&>(listenfd);
+            if (!ufd._multishot_accept) {
+                ufd._multishot_accept = new multishot_accept(*this, listenfd);
+            }
+            return ufd._multishot_accept->get();
+        }
+#endif
         if (listenfd.take_speculation(POLLIN)) {
             try {
                 listenfd.maybe_no_more_recv();
@@ -1762,6 +2683,25 @@ class reactor_backend_uring final : public reactor_backend {
         auto req = internal::io_request::make_sendmsg(fd.fd.get(), desc->msghdr(), MSG_NOSIGNAL);
         return submit_request(std::move(desc), std::move(req));
     }
+    virtual future<size_t> sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p) override {
+#ifdef IORING_CQE_F_NOTIF
+        auto& ufd = static_cast<uring_pollable_fd_state&>(fd);
+        if (_zerocopy_send && !ufd._zerocopy_unsupported) {
+            auto desc = new zerocopy_send_completion(ufd, p.share());
+            auto sqe = get_sqe();
+            ::io_uring_prep_sendmsg_zc(sqe, fd.fd.get(), desc->msghdr(), MSG_NOSIGNAL);
+            sqe->user_data = desc->user_data();
+            _has_pending_submissions = true;
+            return desc->get_future().then([this, &ufd, &p] (size_t bytes) {
+                if (!bytes && ufd._zerocopy_unsupported) {
+                    return sendmsg(ufd, p);
+                }
+                return make_ready_future<size_t>(bytes);
+            });
+        }
+#endif
+        return sendmsg(fd, p);
+    }
     virtual future<size_t> send(pollable_fd_state& fd, const void* buffer, size_t len) override {
         if (fd.take_speculation(EPOLLOUT)) {
             try {
@@ -1804,6 +2744,15 @@ class reactor_backend_uring final : public reactor_backend {
     }
 
     virtual future<temporary_buffer<char>> recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba) override {
+#ifdef SEASTAR_HAVE_URING_MULTISHOT
+        if (_provided_buffers) {
+            auto& ufd = static_cast<uring_pollable_fd_state&>(fd);
+            if (!ufd._multishot_recv) {
+                ufd._multishot_recv = new multishot_recv(*this, fd.fd.get());
+            }
+            return ufd._multishot_recv->get();
+        }
+#endif
         if (fd.take_speculation(POLLIN)) {
             auto buffer = ba->allocate_buffer();
             try {
@@ -1857,6 +2806,22 @@ class reactor_backend_uring final : public reactor_backend {
         return true;
     }
 
+    virtual bool submits_file_metadata_ops() const noexcept override {
+        return _file_metadata_ops;
+    }
+
+    virtual bool links_file_io() const noexcept override {
+        return true;
+    }
+
+    virtual bool supports_nvme_passthrough() const noexcept override {
+#ifdef SEASTAR_HAVE_URING_NVME
+        return _uring.flags & IORING_SETUP_SQE128;
+#else
+        return false;
+#endif
+    }
+
     virtual void signal_received(int signo, siginfo_t* siginfo, void* ignore) override {
         _r._signals.action(signo, siginfo, ignore);
     }
@@ -1881,6 +2846,34 @@ class reactor_backend_uring final : public reactor_backend {
     virtual pollable_fd_state_ptr make_pollable_fd_state(file_desc fd, pollable_fd::speculation speculate) override {
         return pollable_fd_state_ptr(new uring_pollable_fd_state(std::move(fd), std::move(speculate)));
     }
+    virtual void register_file(int fd) noexcept override {
+        if (size_t(fd) >= _fixed_files.size() || _fixed_files[fd].refs++ != 0) {
+            return;
+        }
+        auto r = ::io_uring_register_files_update(&_uring, fd, &fd, 1);
+        // On failure the file is just used without registration
+        _fixed_files[fd].registered = r == 1;
+    }
+    virtual void unregister_file(int fd) noexcept override {
+        if (size_t(fd) >= _fixed_files.size() || --_fixed_files[fd].refs != 0 || !_fixed_files[fd].registered) {
+            return;
+        }
+        // Queued sqes may still refer to the slot
+        do_flush_submission_ring();
+        int empty = -1;
+        ::io_uring_register_files_update(&_uring, fd, &empty, 1);
+        _fixed_files[fd].registered = false;
+    }
+    virtual void register_metrics(metrics::metric_groups& mg) override {
+        if (!(_uring.flags & IORING_SETUP_SQPOLL)) {
+            return;
+        }
+        namespace sm = seastar::metrics;
+        mg.add_group("reactor", {
+            sm::make_counter("io_uring_sqpoll_wakeups", _sqpoll_wakeups,
+                    sm::description("Total number of times the io_uring submission polling thread was woken up by a system call")),
+        });
+    }
 };
 
 #endif
@@ -35,6 +35,7 @@
 #include <sys/time.h>
 #include <thread>
 #include <stack>
+#include <unordered_set>
 #include <boost/any.hpp>
 #include <boost/program_options.hpp>
 #include <boost/container/static_vector.hpp>
@@ -44,6 +45,11 @@
 namespace seastar {
 
 class reactor;
+class epoll_pollable_fd_state;
+
+namespace metrics {
+class metric_groups;
+}
 
 // FIXME: merge it with storage context below. At this point the
 // main thing to do is unify the iocb list
@@ -71,6 +77,8 @@ class aio_storage_context {
         void put_one(internal::linux_abi::iocb* io);
         unsigned outstanding() const;
         bool has_capacity() const;
+        // The in-flight iocb of a completion, if any
+        internal::linux_abi::iocb* find(void* user_data);
     };
 
     reactor& _r;
@@ -78,6 +86,7 @@ class aio_storage_context {
     boost::container::static_vector<internal::linux_abi::iocb*, max_aio> _submission_queue;
     iocb_pool _iocb_pool;
     size_t handle_aio_error(internal::linux_abi::iocb* iocb, int ec);
+    void cancel(void* user_data) noexcept;
     using pending_aio_retry_t = boost::container::static_vector<internal::linux_abi::iocb*, max_aio>;
     pending_aio_retry_t _pending_aio_retry; // Pending retries iocbs
     pending_aio_retry_t _aio_retries;       // Currently retried iocbs
@@ -206,10 +215,33 @@ class reactor_backend {
     virtual future<size_t> sendmsg(pollable_fd_state& fd, net::packet& p) = 0;
     virtual future<size_t> send(pollable_fd_state& fd, const void* buffer, size_t len) = 0;
     virtual future<temporary_buffer<char>> recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba) = 0;
+    // Like sendmsg(), but lets the kernel send straight from the packet's
+    // buffers. The backend holds on to them until the kernel is done, so
+    // the caller may release the packet as soon as the future resolves.
+    // Backends (or sockets) that can't do that just copy.
+    virtual future<size_t> sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p) {
+        return sendmsg(fd, p);
+    }
 
     virtual bool do_blocking_io() const {
         return false;
     }
+    // Whether the file metadata operations of io_request (openat, statx,
+    // unlinkat, renameat and fallocate) may be submitted to the backend.
+    // Otherwise the reactor runs them in the syscall thread pool.
+    virtual bool submits_file_metadata_ops() const noexcept {
+        return false;
+    }
+    // Whether the file I/O requests with io_request::linked() are run by the
+    // kernel only once the ones before them succeeded. Otherwise the io_queue
+    // submits each of them once the one before it completed.
+    virtual bool links_file_io() const noexcept {
+        return false;
+    }
+    // Whether io_request::make_nvme() commands may be submitted to the backend
+    virtual bool supports_nvme_passthrough() const noexcept {
+        return false;
+    }
     virtual void signal_received(int signo, siginfo_t* siginfo, void* ignore) = 0;
     virtual void start_tick() = 0;
     virtual void stop_tick() = 0;
@@ -219,6 +251,16 @@ class reactor_backend {
     virtual void start_handling_signal() = 0;
 
     virtual pollable_fd_state_ptr make_pollable_fd_state(file_desc fd, pollable_fd::speculation speculate) = 0;
+
+    // Called by posix files when they start and stop using a file descriptor
+    // for disk I/O, so a backend can keep per-file kernel state (such as
+    // io_uring registered files). Calls are paired, but may nest if several
+    // files on the shard share a descriptor.
+    virtual void register_file(int fd) noexcept {}
+    virtual void unregister_file(int fd) noexcept {}
+
+    // Lets a backend export its own metrics along with the reactor's.
+    virtual void register_metrics(metrics::metric_groups& mg) {}
 };
 
 // reactor backend using file-descriptor & epoll, suitable for running on
@@ -249,6 +291,10 @@ class reactor_backend_epoll : public reactor_backend {
     bool wait_and_process(int timeout, const sigset_t* active_sigmask);
     bool complete_hrtimer();
     bool _need_epoll_events = false;
+    // Closed sockets whose zero-copy sends the kernel still references
+    std::unordered_set<epoll_pollable_fd_state*> _zerocopy_lingering;
+    void drain_zerocopy_notifications(epoll_pollable_fd_state& fd) noexcept;
+    void reap_lingering(epoll_pollable_fd_state& fd) noexcept;
 public:
     explicit reactor_backend_epoll(reactor& r);
     virtual ~reactor_backend_epoll() override;
@@ -271,6 +317,7 @@ class reactor_backend_epoll : public reactor_backend {
     virtual future<size_t> recvmsg(pollable_fd_state& fd, const std::vector<iovec>& iov) override;
     virtual future<temporary_buffer<char>> read_some(pollable_fd_state& fd, internal::buffer_allocator* ba) override;
     virtual future<size_t> sendmsg(pollable_fd_state& fd, net::packet& p) override;
+    virtual future<size_t> sendmsg_zerocopy(pollable_fd_state& fd, net::packet& p) override;
     virtual future<size_t> send(pollable_fd_state& fd, const void* buffer, size_t len) override;
     virtual future<temporary_buffer<char>> recv_some(pollable_fd_state& fd, internal::buffer_allocator* ba) override;
 
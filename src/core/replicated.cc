@@ -0,0 +1,137 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/replicated.hh>
+#include <seastar/core/internal/quiescent_state.hh>
+#include <seastar/core/systemwide_memory_barrier.hh>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+static std::unique_ptr<quiescent_epoch[]> quiescent_epochs;
+static unsigned quiescent_epochs_count = 0;
+
+void configure_quiescent_epochs(unsigned shards) {
+    quiescent_epochs = std::make_unique<quiescent_epoch[]>(shards);
+    quiescent_epochs_count = shards;
+}
+
+quiescent_epoch& local_quiescent_epoch() noexcept {
+    return quiescent_epochs[this_shard_id()];
+}
+
+std::vector<uint64_t> sample_quiescent_epochs() {
+    std::vector<uint64_t> ret(quiescent_epochs_count);
+    // Orders the unpublication of what is reclaimed before the sampling,
+    // and whatever a shard did before it went through the epoch sampled,
+    // the references it took included, before the sampling too
+    systemwide_memory_barrier();
+    for (unsigned i = 0; i != quiescent_epochs_count; ++i) {
+        ret[i] = quiescent_epochs[i].value.load(std::memory_order_acquire);
+    }
+    return ret;
+}
+
+bool grace_period_elapsed(const std::vector<uint64_t>& sampled) noexcept {
+    for (unsigned i = 0; i != sampled.size(); ++i) {
+        if (!(sampled[i] & 1) && quiescent_epochs[i].value.load(std::memory_order_acquire) == sampled[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// How often the owner checks whether the retired snapshots can be freed
+static constexpr auto reclaim_period = std::chrono::milliseconds(10);
+
+replicated_base::replicated_base()
+        : _owner(this_shard_id())
+        , _reclaim_timer([this] { reclaim(); })
+{}
+
+replicated_base::~replicated_base() {
+    for (auto& r : _retired) {
+        r.dispose(r.snapshot);
+    }
+}
+
+void replicated_base::prepare_retire() {
+    _retired.emplace_back();
+}
+
+void replicated_base::retire(const void* snapshot, dispose_fn dispose) noexcept {
+    auto& r = _retired.back();
+    r.snapshot = snapshot;
+    r.dispose = dispose;
+    if (!_reclaim_timer.armed()) {
+        _reclaim_timer.arm(reclaim_period);
+    }
+}
+
+void replicated_base::reclaim() noexcept {
+    if (!_retired.back().epochs) {
+        try {
+            auto epochs = make_lw_shared<std::vector<uint64_t>>(sample_quiescent_epochs());
+            for (auto i = _retired.rbegin(); i != _retired.rend() && !i->epochs; ++i) {
+                i->epochs = epochs;
+            }
+        } catch (...) {
+            // sampled on the next attempt
+        }
+    }
+    while (!_retired.empty() && _retired.front().epochs && grace_period_elapsed(*_retired.front().epochs)) {
+        _retired.front().dispose(_retired.front().snapshot);
+        _retired.pop_front();
+    }
+    if (!_retired.empty()) {
+        _reclaim_timer.arm(reclaim_period);
+    } else if (_reclaimed) {
+        _reclaimed->set_value();
+        _reclaimed.reset();
+    }
+}
+
+future<> replicated_base::wait_reclaimed() noexcept {
+    if (_retired.empty()) {
+        return make_ready_future<>();
+    }
+    if (!_reclaimed) {
+        _reclaimed.emplace();
+    }
+    return _reclaimed->get_shared_future();
+}
+
+}
+
+}
@@ -28,6 +28,8 @@ module;
 #include <boost/algorithm/string.hpp>
 #include <boost/range/adaptor/map.hpp>
 #include <boost/range/algorithm/copy.hpp>
+#include <algorithm>
+#include <iterator>
 #include <ranges>
 #include <regex>
 #include <stdlib.h>
@@ -366,6 +368,30 @@ static hwloc_obj_t hwloc_get_ancestor(hwloc_obj_type_t type, hwloc_topology_t to
     return cur;
 }
 
+// The logical index of the ancestor of the given type of the CPU
+static unsigned ancestor_index(hwloc_obj_type_t type, hwloc_topology_t topology, unsigned cpu_id, unsigned fallback) {
+    auto anc = hwloc_get_ancestor(type, topology, cpu_id);
+    return anc ? anc->logical_index : fallback;
+}
+
+// The other PUs of the core of each PU in the topology
+static std::unordered_map<unsigned, std::vector<unsigned>> core_siblings(hwloc_topology_t topology) {
+    std::unordered_map<unsigned, std::vector<unsigned>> ret;
+    for (auto core = hwloc_get_next_obj_by_type(topology, HWLOC_OBJ_CORE, nullptr); core;
+            core = hwloc_get_next_obj_by_type(topology, HWLOC_OBJ_CORE, core)) {
+        std::vector<unsigned> pus;
+        unsigned pu;
+        hwloc_bitmap_foreach_begin(pu, core->cpuset)
+            pus.push_back(pu);
+        hwloc_bitmap_foreach_end();
+        for (auto p : pus) {
+            auto& siblings = ret[p];
+            std::ranges::copy_if(pus, std::back_inserter(siblings), [p] (unsigned s) { return s != p; });
+        }
+    }
+    return ret;
+}
+
 static std::unordered_map<hwloc_obj_t, std::vector<unsigned>> break_cpus_into_groups(hwloc_topology_t topology,
         std::vector<unsigned> cpus, hwloc_obj_type_t type) {
     std::unordered_map<hwloc_obj_t, std::vector<unsigned>> groups;
@@ -581,6 +607,18 @@ resources allocate(configuration& c) {
         }
         abort();
     }
+    // Taken before the topology is narrowed down to one PU per core below
+    auto siblings = core_siblings(topology);
+    if (c.placement == shard_placement::one_per_core) {
+        hwloc_bitmap_zero(bm);
+        for (auto core = hwloc_get_next_obj_by_type(topology, HWLOC_OBJ_CORE, nullptr); core;
+                core = hwloc_get_next_obj_by_type(topology, HWLOC_OBJ_CORE, core)) {
+            hwloc_bitmap_set(bm, hwloc_bitmap_first(core->cpuset));
+        }
+        if (!hwloc_bitmap_iszero(bm) && hwloc_topology_restrict(topology, bm, HWLOC_RESTRICT_FLAG_ADAPT_MISC | HWLOC_RESTRICT_FLAG_ADAPT_IO) == -1) {
+            throw std::runtime_error("failed to restrict the topology to one CPU per core");
+        }
+    }
     unsigned procs = c.cpus;
     if (unsigned available_procs = hwloc_get_nbobjs_by_type(topology, HWLOC_OBJ_PU);
         procs > available_procs) {
@@ -696,6 +734,12 @@ resources allocate(configuration& c) {
         auto node = cpu_to_node.at(cpu_id);
         cpu this_cpu;
         this_cpu.cpu_id = cpu_id;
+        this_cpu.core = ancestor_index(HWLOC_OBJ_CORE, topology, cpu_id, cpu_id);
+        this_cpu.cache_domain = ancestor_index(HWLOC_OBJ_L3CACHE, topology, cpu_id, node->logical_index);
+        this_cpu.numa_node = node->os_index;
+        if (auto i = siblings.find(cpu_id); i != siblings.end()) {
+            this_cpu.siblings = std::move(i->second);
+        }
         size_t remain = mem_per_proc - alloc_from_node(this_cpu, node, topo_used_mem, mem_per_proc);
 
         remains.emplace_back(std::move(this_cpu), remain);
@@ -732,6 +776,17 @@ unsigned nr_processing_units(configuration& c) {
     return hwloc_get_nbobjs_by_type(c.topology.get(), HWLOC_OBJ_PU);
 }
 
+unsigned nr_physical_cores(configuration& c) {
+    auto topology = c.topology.get();
+    std::set<unsigned> cores;
+    for (auto cpu_id : c.cpu_set) {
+        // A PU outside of any core counts as a core of its own
+        auto core = hwloc_get_ancestor(HWLOC_OBJ_CORE, topology, cpu_id);
+        cores.insert(core ? core->logical_index : std::numeric_limits<unsigned>::max() - cpu_id);
+    }
+    return cores.size();
+}
+
 }
 
 }
@@ -772,7 +827,7 @@ resources allocate(configuration& c) {
     constexpr size_t max_mem_per_proc = 1UL << 36;
     auto mem_per_proc = std::min(mem / procs, max_mem_per_proc);
     for (auto cpuid : c.cpu_set) {
-        ret.cpus.push_back(cpu{cpuid, {{mem_per_proc, 0}}});
+        ret.cpus.push_back(cpu{cpuid, {{mem_per_proc, 0}}, cpuid});
     }
 
     ret.ioq_topology.emplace(0, allocate_io_queues(c, ret.cpus));
@@ -783,6 +838,11 @@ unsigned nr_processing_units(configuration&) {
     return ::sysconf(_SC_NPROCESSORS_ONLN);
 }
 
+// Without hwloc the cores are not known, every CPU counts as one
+unsigned nr_physical_cores(configuration& c) {
+    return c.cpu_set.size();
+}
+
 }
 
 }
@@ -23,6 +23,8 @@
 module;
 #endif
 
+#include <algorithm>
+#include <numeric>
 #include <ranges>
 
 #ifdef SEASTAR_MODULE
@@ -30,6 +32,7 @@ module seastar;
 #else
 #include <seastar/core/sharded.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/reactor.hh>
 #endif
 
 namespace seastar {
@@ -42,6 +45,39 @@ sharded_parallel_for_each(unsigned nr_shards, on_each_shard_func on_each_shard)
     return parallel_for_each(std::views::iota(0u, nr_shards), std::move(on_each_shard));
 }
 
+shard_reduction_tree make_shard_reduction_tree(unsigned nr_shards) {
+    auto numa = engine().smp().shard_to_numa_node_mapping();
+    auto node_of = [&numa] (unsigned shard) {
+        return shard < numa.size() ? numa[shard] : 0;
+    };
+    shard_reduction_tree tree;
+    tree.shards.resize(nr_shards);
+    std::iota(tree.shards.begin(), tree.shards.end(), 0u);
+    std::ranges::stable_sort(tree.shards, std::less<>(), node_of);
+    tree.nodes.reserve(nr_shards);
+    for (auto shard : tree.shards) {
+        tree.nodes.push_back(node_of(shard));
+    }
+    return tree;
+}
+
+size_t shard_reduction_tree::split(size_t lo, size_t hi) const noexcept {
+    auto mid = lo + (hi - lo) / 2;
+    if (nodes[lo] == nodes[hi - 1]) {
+        return mid;
+    }
+    // The shards of a node are contiguous, pick the node boundary closest
+    // to the middle
+    size_t best = hi;
+    for (auto i = lo + 1; i != hi; ++i) {
+        auto distance = [mid] (size_t x) { return x > mid ? x - mid : mid - x; };
+        if (nodes[i] != nodes[i - 1] && (best == hi || distance(i) < distance(best))) {
+            best = i;
+        }
+    }
+    return best;
+}
+
 }
 
 }
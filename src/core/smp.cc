@@ -24,6 +24,7 @@ module;
 
 #include <boost/range/algorithm/find_if.hpp>
 #include <atomic>
+#include <mutex>
 #include <vector>
 #include <regex>
 #include <sys/mman.h>
@@ -42,6 +43,8 @@ module seastar;
 #include <seastar/core/on_internal_error.hh>
 #include <seastar/core/posix.hh>
 #include <seastar/core/align.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/metrics.hh>
 #include "prefault.hh"
 #endif
 
@@ -165,6 +168,252 @@ smp_service_group_semaphore& get_smp_service_groups_semaphore(unsigned ssg_id, s
     return smp_service_groups[ssg_id].clients[t];
 }
 
+namespace internal {
+
+// Work submitted with smp::submit_stealable_to() for one shard. The owner
+// takes from it while polling the smp queues, other shards take from it
+// when they run out of work. Contention is low since a shard only looks
+// at somebody else's queue when it is idle, so a mutex is good enough.
+struct alignas(cache_line_size) stealable_queue {
+    // Items are only taken a few at a time by the owner, so that whatever
+    // is left can still be stolen
+    static constexpr size_t owner_batch = 4;
+
+    std::mutex mtx;
+    stealable_work_item* head = nullptr;
+    stealable_work_item* tail = nullptr;
+    std::atomic<size_t> size = 0;
+    reactor* owner = nullptr;
+
+    ~stealable_queue() {
+        while (head) {
+            delete std::exchange(head, head->next);
+        }
+    }
+    void push(stealable_work_item* wi) noexcept {
+        std::lock_guard lock(mtx);
+        wi->next = nullptr;
+        if (tail) {
+            tail->next = wi;
+        } else {
+            head = wi;
+        }
+        tail = wi;
+        size.fetch_add(1, std::memory_order_relaxed);
+    }
+    stealable_work_item* pop() noexcept {
+        auto wi = head;
+        if (wi) {
+            head = wi->next;
+            if (!head) {
+                tail = nullptr;
+            }
+            size.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return wi;
+    }
+    bool empty() const noexcept {
+        return size.load(std::memory_order_relaxed) == 0;
+    }
+};
+
+void stealable_work_item::respond() noexcept {
+    if (origin == this_shard_id()) {
+        complete();
+    } else {
+        // Can't fail, as submit_to() is noexcept and the lambda
+        // does not throw
+        (void)smp::submit_to(origin, [this] {
+            complete();
+        });
+    }
+}
+
+}
+
+namespace internal {
+
+// Nodes of broadcast messages destined to a shard. Any shard can push,
+// only the owner pops, so a lock-free stack is enough; the owner
+// reverses it to preserve the order of broadcasts.
+struct alignas(cache_line_size) broadcast_inbox {
+    std::atomic<broadcast_node*> head = nullptr;
+    reactor* owner = nullptr;
+
+    void push(broadcast_node* n) noexcept {
+        auto h = head.load(std::memory_order_relaxed);
+        do {
+            n->next = h;
+        } while (!head.compare_exchange_weak(h, n, std::memory_order_release, std::memory_order_relaxed));
+    }
+    broadcast_node* pop_all() noexcept {
+        auto h = head.exchange(nullptr, std::memory_order_acquire);
+        broadcast_node* prev = nullptr;
+        while (h) {
+            prev = std::exchange(h, std::exchange(h->next, prev));
+        }
+        return prev;
+    }
+    bool empty() const noexcept {
+        return head.load(std::memory_order_relaxed) == nullptr;
+    }
+};
+
+broadcast_message::broadcast_message(unsigned nr_shards)
+    : origin(this_shard_id())
+    , remaining(nr_shards)
+    , nodes(new broadcast_node[nr_shards])
+{
+    for (unsigned i = 0; i < nr_shards; ++i) {
+        nodes[i].msg = this;
+    }
+}
+
+void broadcast_node::run_and_dispose() noexcept {
+    // The node is owned by the message, which outlives this task
+    (void)msg->invoke().then_wrapped([msg = msg] (future<> f) {
+        msg->shard_done(f.failed() ? f.get_exception() : nullptr);
+    });
+}
+
+void broadcast_message::shard_done(std::exception_ptr e) noexcept {
+    if (e && !failed.exchange(true, std::memory_order_relaxed)) {
+        ex = std::move(e);
+    }
+    // acq_rel orders the write to ex above before complete()
+    if (remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    if (origin == this_shard_id()) {
+        complete();
+    } else {
+        (void)smp::submit_to(origin, [this] {
+            complete();
+        });
+    }
+}
+
+void broadcast_message::complete() noexcept {
+    if (ex) {
+        pr.set_exception(std::move(ex));
+    } else {
+        pr.set_value();
+    }
+    delete this;
+}
+
+}
+
+thread_local internal::stealable_queue* smp::_stealable_qs;
+thread_local internal::broadcast_inbox* smp::_broadcast_inboxes;
+
+void smp::setup_broadcast_inboxes(const std::vector<reactor*>& reactors) {
+    _broadcast_inboxes_owner = std::make_unique<internal::broadcast_inbox[]>(smp::count);
+    for (unsigned i = 0; i < smp::count; ++i) {
+        _broadcast_inboxes_owner[i].owner = reactors[i];
+    }
+    _broadcast_inboxes = _broadcast_inboxes_owner.get();
+}
+
+void smp::post_broadcast(internal::broadcast_message* msg) noexcept {
+    auto me = this_shard_id();
+    for (unsigned i = 0; i < count; ++i) {
+        if (i != me) {
+            _broadcast_inboxes[i].push(&msg->nodes[i]);
+        }
+    }
+    // Wake up after all the pushes, see smp_message_queue::lf_queue::maybe_wakeup()
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    for (unsigned i = 0; i < count; ++i) {
+        if (i != me) {
+            _broadcast_inboxes[i].owner->wakeup();
+        }
+    }
+    schedule(&msg->nodes[me]);
+}
+
+bool smp::poll_broadcast_inbox() noexcept {
+    auto& inbox = _broadcast_inboxes[this_shard_id()];
+    if (inbox.empty()) {
+        return false;
+    }
+    auto n = inbox.pop_all();
+    while (n) {
+        schedule(std::exchange(n, n->next));
+    }
+    return true;
+}
+
+bool smp::pure_poll_broadcast_inbox() noexcept {
+    return !_broadcast_inboxes[this_shard_id()].empty();
+}
+
+void smp::setup_stealable_queues(const std::vector<reactor*>& reactors) {
+    _stealable_qs_owner = std::make_unique<internal::stealable_queue[]>(smp::count);
+    for (unsigned i = 0; i < smp::count; ++i) {
+        _stealable_qs_owner[i].owner = reactors[i];
+    }
+    _stealable_qs = _stealable_qs_owner.get();
+}
+
+void smp::submit_stealable(unsigned t, internal::stealable_work_item* wi) noexcept {
+    auto& q = _stealable_qs[t];
+    q.push(wi);
+    if (t != this_shard_id()) {
+        // Same as smp_message_queue::lf_queue::maybe_wakeup(), the owner
+        // issues the systemwide barrier before going to sleep
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        q.owner->wakeup();
+    }
+}
+
+bool smp::poll_stealable_queue() {
+    auto& q = _stealable_qs[this_shard_id()];
+    if (q.empty()) {
+        return false;
+    }
+    std::lock_guard lock(q.mtx);
+    size_t got = 0;
+    while (got < internal::stealable_queue::owner_batch) {
+        auto wi = q.pop();
+        if (!wi) {
+            break;
+        }
+        schedule(wi);
+        got++;
+    }
+    return got != 0;
+}
+
+bool smp::pure_poll_stealable_queue() noexcept {
+    return !_stealable_qs[this_shard_id()].empty();
+}
+
+bool smp::steal_work() {
+    if (!_stealable_qs) {
+        return false;
+    }
+    // Start with the next shard so that thieves spread over the victims
+    auto me = this_shard_id();
+    for (unsigned i = 1; i < count; ++i) {
+        auto& q = _stealable_qs[(me + i) % count];
+        if (q.empty()) {
+            continue;
+        }
+        std::unique_lock lock(q.mtx, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            continue;
+        }
+        auto wi = q.pop();
+        if (wi) {
+            lock.unlock();
+            schedule(wi);
+            return true;
+        }
+    }
+    return false;
+}
+
 smp::smp(alien::instance& alien)
         : _alien(alien) {
 }
@@ -200,30 +449,93 @@ get_huge_page_size() {
     return std::nullopt;
 }
 
-internal::memory_prefaulter::memory_prefaulter(alien::instance& alien, const resource::resources& res, memory::internal::numa_layout layout) {
+std::vector<std::vector<memory::internal::memory_range>>
+internal::split_prefault_ranges(const std::vector<memory::internal::memory_range>& ranges, size_t nr_threads, size_t batch_size) {
+    size_t total = 0;
+    for (auto& r : ranges) {
+        total += r.end - r.start;
+    }
+    // Rounding up keeps the number of shares at most nr_threads, as each
+    // one but the last holds at least this much
+    auto share = align_up(std::max<size_t>((total + nr_threads - 1) / nr_threads, 1), batch_size);
+    std::vector<std::vector<memory::internal::memory_range>> shares(1);
+    size_t in_share = 0;
+    for (auto r : ranges) {
+        while (r.start < r.end) {
+            if (in_share >= share) {
+                shares.emplace_back();
+                in_share = 0;
+            }
+            // Cut at an address that is a multiple of batch_size, so that
+            // no huge page is split between two threads
+            auto cut = std::min(align_up(r.start + (share - in_share), batch_size), r.end);
+            auto piece = r;
+            piece.end = cut;
+            shares.back().push_back(piece);
+            in_share += cut - r.start;
+            r.start = cut;
+        }
+    }
+    return shares;
+}
+
+internal::memory_prefaulter::memory_prefaulter(alien::instance& alien, const resource::resources& res, memory::internal::numa_layout layout)
+        : _start(std::chrono::steady_clock::now()) {
+    std::unordered_map<unsigned, std::vector<memory::internal::memory_range>> layout_by_node_id;
     for (auto& range : layout.ranges) {
-        _layout_by_node_id[range.numa_node_id].push_back(std::move(range));
+        _total_bytes += range.end - range.start;
+        layout_by_node_id[range.numa_node_id].push_back(std::move(range));
     }
     auto page_size = getpagesize();
-    auto huge_page_size_opt = get_huge_page_size();
-    for (auto& numa_node_id_and_ranges : _layout_by_node_id) {
-        auto& numa_node_id = numa_node_id_and_ranges.first;
-        auto& ranges = numa_node_id_and_ranges.second;
-        posix_thread::attr a;
+    const size_t batch_size = get_huge_page_size().value_or(512*4096);
+    std::vector<std::optional<cpu_set_t>> cpusets;
+    for (auto& [numa_node_id, ranges] : layout_by_node_id) {
+        std::optional<cpu_set_t> cpuset;
+        size_t nr_threads = 1;
         auto i = res.numa_node_id_to_cpuset.find(numa_node_id);
         if (i != res.numa_node_id_to_cpuset.end()) {
-            cpu_set_t cpuset;
-            CPU_ZERO(&cpuset);
+            cpuset.emplace();
+            CPU_ZERO(&*cpuset);
             for (auto cpu : i->second) {
-                CPU_SET(cpu, &cpuset);
+                CPU_SET(cpu, &*cpuset);
+            }
+            size_t node_bytes = 0;
+            for (auto& r : ranges) {
+                node_bytes += r.end - r.start;
             }
-            a.set(cpuset);
+            nr_threads = std::clamp<size_t>(std::min<size_t>(i->second.size(), node_bytes / min_bytes_per_thread), 1, max_threads_per_node);
+        }
+        for (auto& share : internal::split_prefault_ranges(ranges, nr_threads, batch_size)) {
+            _work.push_back(std::move(share));
+            cpusets.push_back(cpuset);
         }
-        _worker_threads.emplace_back(a, [this, &alien, &ranges, page_size, huge_page_size_opt] {
+    }
+
+    namespace sm = seastar::metrics;
+    _metrics.add_group("memory", {
+        sm::make_gauge("prefault_total_bytes", [this] { return _total_bytes; },
+                sm::description("Total size of the memory prefaulted by background threads, when the memory is locked")),
+        sm::make_counter("prefaulted_bytes", [this] { return _prefaulted_bytes.load(std::memory_order_relaxed); },
+                sm::description("Size of the memory prefaulted so far")),
+    });
+
+    for (size_t t = 0; t < _work.size(); ++t) {
+        posix_thread::attr a;
+        if (cpusets[t]) {
+            a.set(*cpusets[t]);
+        }
+        _worker_threads.emplace_back(a, [this, &alien, &ranges = _work[t], page_size, batch_size] {
             ++_active_threads;
-            work(ranges, page_size, huge_page_size_opt);
+            work(ranges, page_size, batch_size);
             if (!--_active_threads) {
-                run_on(alien, 0, [this] () noexcept { join_threads(); });
+                run_on(alien, 0, [this] () noexcept {
+                    if (!_stop_request.load(std::memory_order_relaxed)) {
+                        auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - _start);
+                        seastar_logger.info("Prefaulted {} MiB of memory with {} threads in {:.1f}s",
+                                _prefaulted_bytes.load() >> 20, _worker_threads.size(), elapsed.count());
+                    }
+                    join_threads();
+                });
             }
         });
     }
@@ -235,7 +547,12 @@ internal::memory_prefaulter::join_threads() noexcept {
         t.join();
     }
     _worker_threads.clear();
-    _layout_by_node_id.clear();
+    _work.clear();
+}
+
+void
+internal::memory_prefaulter::stop_metrics() noexcept {
+    _metrics.clear();
 }
 
 internal::memory_prefaulter::~memory_prefaulter() {
@@ -245,12 +562,11 @@ internal::memory_prefaulter::~memory_prefaulter() {
 
 void
 internal::memory_prefaulter::work(std::vector<memory::internal::memory_range>& ranges, size_t page_size,
-        std::optional<size_t> huge_page_size_opt) {
+        size_t batch_size) {
     sched_param param = { .sched_priority = 0 };
     // SCHED_IDLE doesn't work via thread attributes
     pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
     size_t current_range = 0;
-    const size_t batch_size = huge_page_size_opt.value_or(512*4096);
     auto populate_memory_madvise = [works = true] (char* start, char* end) mutable {
 #ifdef MADV_POPULATE_WRITE
         if (works) {
@@ -288,13 +604,14 @@ internal::memory_prefaulter::work(std::vector<memory::internal::memory_range>& r
 #endif
     };
     auto populate_memory = [&] (char* start, char* end) {
-        if (populate_memory_madvise(start, end)) {
-            return;
-        }
-        while (start < end) {
-            fault_in_memory(start);
-            start += page_size;
+        auto len = end - start;
+        if (!populate_memory_madvise(start, end)) {
+            while (start < end) {
+                fault_in_memory(start);
+                start += page_size;
+            }
         }
+        _prefaulted_bytes.fetch_add(len, std::memory_order_relaxed);
     };
     while (!_stop_request.load(std::memory_order_relaxed) && !ranges.empty()) {
         auto& range = ranges[current_range];
@@ -0,0 +1,164 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <bit>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <fmt/format.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/internal/task_tracer.hh>
+#include <seastar/util/log.hh>
+#endif
+
+namespace seastar {
+
+namespace internal {
+
+task_tracer::task_tracer(size_t max_events)
+        : _ring(std::bit_ceil(std::max<size_t>(max_events, 1)))
+{}
+
+task_trace task_tracer::trace() const {
+    task_trace ret;
+    auto size = std::min<uint64_t>(_head, _ring.size());
+    ret.dropped = _head - size;
+    ret.events.reserve(size);
+    for (auto i = _head - size; i != _head; ++i) {
+        ret.events.push_back(_ring[i & (_ring.size() - 1)]);
+    }
+    return ret;
+}
+
+static void append_json_string(std::string& out, std::string_view s) {
+    out += '"';
+    for (auto c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            fmt::format_to(std::back_inserter(out), "\\u{:04x}", unsigned(c));
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// See https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+sstring format_chrome_trace(const std::vector<task_trace>& shards) {
+    uint64_t epoch = std::numeric_limits<uint64_t>::max();
+    for (auto& t : shards) {
+        for (auto& e : t.events) {
+            epoch = std::min(epoch, e.start);
+        }
+    }
+    // Microseconds since the earliest event, as the format wants them
+    auto us = [epoch] (uint64_t ns) {
+        return double(ns - epoch) / 1000;
+    };
+    std::unordered_map<const std::type_info*, std::string> type_names;
+    auto type_name = [&] (const std::type_info* ti) -> const std::string& {
+        auto [i, inserted] = type_names.try_emplace(ti);
+        if (inserted) {
+            i->second = pretty_type_name(*ti);
+        }
+        return i->second;
+    };
+
+    std::string out = R"({"displayTimeUnit":"ns","traceEvents":[)";
+    out += R"({"name":"process_name","ph":"M","pid":0,"args":{"name":"seastar"}})";
+    uint64_t async_id = 0;
+    for (unsigned shard = 0; shard != shards.size(); ++shard) {
+        auto& t = shards[shard];
+        auto sg_name = [&t] (unsigned index) -> std::string_view {
+            return index < t.scheduling_groups.size() ? std::string_view(t.scheduling_groups[index]) : "?";
+        };
+        auto common = [&] (const char* cat, const char* ph, uint64_t ts) {
+            fmt::format_to(std::back_inserter(out), R"(,"cat":"{}","ph":"{}","ts":{:.3f},"pid":0,"tid":{})", cat, ph, us(ts), shard);
+        };
+        fmt::format_to(std::back_inserter(out), R"(,{{"name":"thread_name","ph":"M","pid":0,"tid":{},"args":{{"name":"shard {}","dropped_events":{}}}}})",
+                shard, shard, t.dropped);
+        for (auto& e : t.events) {
+            using kind = task_trace_event::kind;
+            switch (e.what) {
+            case kind::task:
+                out += R"(,{"name":)";
+                append_json_string(out, type_name(e.type));
+                common("task", "X", e.start);
+                fmt::format_to(std::back_inserter(out), R"(,"dur":{:.3f},"args":{{"scheduling_group":)", double(e.end - e.start) / 1000);
+                append_json_string(out, sg_name(e.arg));
+                if (e.waiting) {
+                    out += R"(,"waiting_task":)";
+                    append_json_string(out, type_name(e.waiting));
+                }
+                out += "}}";
+                break;
+            case kind::scheduling_group:
+                out += R"(,{"name":)";
+                append_json_string(out, sg_name(e.arg));
+                common("scheduling_group", "X", e.start);
+                fmt::format_to(std::back_inserter(out), R"(,"dur":{:.3f}}})", double(e.end - e.start) / 1000);
+                break;
+            case kind::io_read:
+            case kind::io_write:
+            case kind::smp_message: {
+                // Async slices, since they overlap each other and the tasks
+                std::string name = e.what == kind::io_read ? "read" : e.what == kind::io_write ? "write" : fmt::format("smp to {}", e.arg);
+                auto cat = e.what == kind::smp_message ? "smp" : "io";
+                ++async_id;
+                fmt::format_to(std::back_inserter(out), R"(,{{"name":"{}")", name);
+                common(cat, "b", e.start);
+                if (e.what == kind::smp_message) {
+                    fmt::format_to(std::back_inserter(out), R"(,"id":{}}})", async_id);
+                } else {
+                    fmt::format_to(std::back_inserter(out), R"(,"id":{},"args":{{"length":{}}}}})", async_id, e.arg);
+                }
+                fmt::format_to(std::back_inserter(out), R"(,{{"name":"{}")", name);
+                common(cat, "e", e.end);
+                fmt::format_to(std::back_inserter(out), R"(,"id":{}}})", async_id);
+                break;
+            }
+            case kind::smp_receive:
+                fmt::format_to(std::back_inserter(out), R"(,{{"name":"smp from {}")", e.arg);
+                common("smp", "i", e.start);
+                out += R"(,"s":"t"})";
+                break;
+            }
+        }
+    }
+    out += "]}";
+    return sstring(out);
+}
+
+}
+
+}
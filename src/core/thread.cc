@@ -33,8 +33,11 @@ module;
 #include <setjmp.h>
 #endif
 #include <stdint.h>
+#include <sys/mman.h>
 #include <valgrind/valgrind.h>
+#include <array>
 #include <exception>
+#include <optional>
 #include <utility>
 #include <boost/intrusive/list.hpp>
 
@@ -42,6 +45,9 @@ module;
 module seastar;
 #else
 #include <seastar/core/thread.hh>
+#include <seastar/core/align.hh>
+#include <seastar/core/bitops.hh>
+#include <seastar/core/memory.hh>
 #include <seastar/core/posix.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/util/assert.hh>
@@ -186,54 +192,210 @@ static size_t get_stack_size(thread_attributes attr) {
 #endif
 }
 
+namespace {
+
+// Stacks of exited threads are kept per shard and handed to the next
+// threads of the same size class, so that short-lived threads don't pay
+// for allocating, and for mmap()ed stacks mapping, a stack each.
+class stack_pool {
+    // Power-of-two size classes from 16KiB to 1MiB. Larger stacks are
+    // allocated and freed as requested.
+    static constexpr unsigned min_class_shift = 14;
+    static constexpr unsigned nr_classes = 7;
+    // A cached stack is linked to the next one through its topmost bytes
+    struct cached_stack {
+        cached_stack* next;
+        int valgrind_id;
+    };
+    struct size_class {
+        cached_stack* head = nullptr;
+        unsigned count = 0;
+    };
+    std::array<size_class, nr_classes> _classes;
+    unsigned _max_cached = 0;
+    bool _mmap = false;
+    // Gives cached heap stacks back when the shard runs low on memory.
+    // mmap()ed stacks live outside the seastar heap and are not reclaimed.
+    std::optional<memory::reclaimer> _reclaimer;
+
+    static std::optional<unsigned> class_of(size_t size) noexcept {
+        auto shift = std::max(log2ceil(size), min_class_shift);
+        if (shift >= min_class_shift + nr_classes) {
+            return std::nullopt;
+        }
+        return shift - min_class_shift;
+    }
+    static size_t class_size(unsigned c) noexcept {
+        return size_t(1) << (c + min_class_shift);
+    }
+    static cached_stack* link_of(char* stack, size_t size) noexcept {
+        return reinterpret_cast<cached_stack*>(stack + size) - 1;
+    }
+public:
+    void configure(unsigned max_cached, bool mmap) {
+        _max_cached = max_cached;
+        _mmap = mmap;
+        if (_max_cached && !_mmap) {
+            _reclaimer.emplace([this] (memory::reclaimer::request r) { return reclaim(r); });
+        } else {
+            _reclaimer.reset();
+        }
+    }
+    bool mmap() const noexcept {
+        return _mmap;
+    }
+    // The size of the stack handed to a thread asking for \c size bytes
+    size_t stack_size(size_t size) const noexcept {
+        if (_max_cached) {
+            if (auto c = class_of(size)) {
+                return class_size(*c);
+            }
+        }
+        return _mmap ? align_up(size, size_t(getpagesize())) : size;
+    }
+    char* get(size_t size, int& valgrind_id) noexcept {
+        auto c = class_of(size);
+        if (!c || size != class_size(*c) || !_classes[*c].head) {
+            return nullptr;
+        }
+        auto& sc = _classes[*c];
+        auto link = std::exchange(sc.head, sc.head->next);
+        sc.count--;
+        valgrind_id = link->valgrind_id;
+        return reinterpret_cast<char*>(link + 1) - size;
+    }
+    bool put(char* stack, size_t size, bool mmapped, int valgrind_id) noexcept {
+        auto c = class_of(size);
+        if (!c || size != class_size(*c) || mmapped != _mmap || _classes[*c].count >= _max_cached) {
+            return false;
+        }
+        auto& sc = _classes[*c];
+        sc.head = new (link_of(stack, size)) cached_stack{sc.head, valgrind_id};
+        sc.count++;
+        return true;
+    }
+    memory::reclaiming_result reclaim(memory::reclaimer::request r) noexcept;
+    void clear() noexcept;
+};
+
+thread_local stack_pool stacks;
+
+char* allocate_stack(size_t stack_size, bool mmapped) {
+    if (mmapped) {
+        // The pages are committed as the thread touches them, and the
+        // page below the stack is left inaccessible to catch overflows.
+        size_t page_size = getpagesize();
+        void* mem = ::mmap(nullptr, stack_size + page_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+        throw_system_error_on(mem == MAP_FAILED, "mmap");
+        auto r = ::mprotect(mem, page_size, PROT_NONE);
+        if (r != 0) {
+            ::munmap(mem, stack_size + page_size);
+            throw_system_error_on(true, "mprotect");
+        }
+        return reinterpret_cast<char*>(mem) + page_size;
+    }
+#ifdef SEASTAR_THREAD_STACK_GUARDS
+    size_t alignment = getpagesize();
+#else
+    size_t alignment = 16; // ABI requirement on x86_64
+#endif
+    void* mem = ::aligned_alloc(alignment, stack_size);
+    if (mem == nullptr) {
+        throw std::bad_alloc();
+    }
+    return reinterpret_cast<char*>(mem);
+}
+
+void free_stack(char* ptr, size_t stack_size, bool mmapped, int valgrind_id) noexcept {
+    VALGRIND_STACK_DEREGISTER(valgrind_id);
+    if (mmapped) {
+        size_t page_size = getpagesize();
+        ::munmap(ptr - page_size, stack_size + page_size);
+    } else {
+        free(ptr);
+    }
+}
+
+memory::reclaiming_result stack_pool::reclaim(memory::reclaimer::request r) noexcept {
+    // Largest stacks first, so that few of them satisfy the request
+    size_t freed = 0;
+    for (unsigned c = nr_classes; c-- > 0 && freed < r.bytes_to_reclaim;) {
+        auto size = class_size(c);
+        auto& sc = _classes[c];
+        while (sc.head && freed < r.bytes_to_reclaim) {
+            auto link = std::exchange(sc.head, sc.head->next);
+            sc.count--;
+            free_stack(reinterpret_cast<char*>(link + 1) - size, size, false, link->valgrind_id);
+            freed += size;
+        }
+    }
+    return freed ? memory::reclaiming_result::reclaimed_something : memory::reclaiming_result::reclaimed_nothing;
+}
+
+void stack_pool::clear() noexcept {
+    for (unsigned c = 0; c < nr_classes; ++c) {
+        auto size = class_size(c);
+        while (auto link = _classes[c].head) {
+            _classes[c].head = link->next;
+            free_stack(reinterpret_cast<char*>(link + 1) - size, size, _mmap, link->valgrind_id);
+        }
+        _classes[c].count = 0;
+    }
+}
+
+}
+
 thread_context::thread_context(thread_attributes attr, noncopyable_function<void ()> func)
         : task(attr.sched_group.value_or(current_scheduling_group()))
-        , _stack(make_stack(get_stack_size(attr)))
+        , _stack(make_stack(stacks.stack_size(get_stack_size(attr))))
         , _func(std::move(func)) {
-    setup(get_stack_size(attr));
+    setup(_stack.get_deleter().size);
     _all_threads.push_front(*this);
 }
 
 thread_context::~thread_context() {
-#ifdef SEASTAR_THREAD_STACK_GUARDS
-    auto mp_result = mprotect(_stack.get(), getpagesize(), PROT_READ | PROT_WRITE);
-    SEASTAR_ASSERT(mp_result == 0);
-#endif
     _all_threads.erase(_all_threads.iterator_to(*this));
 }
 
-thread_context::stack_deleter::stack_deleter(int valgrind_id) : valgrind_id(valgrind_id) {}
+thread_context::stack_deleter::stack_deleter(int valgrind_id, size_t size, bool mmapped)
+        : valgrind_id(valgrind_id), size(size), mmapped(mmapped) {}
 
 thread_context::stack_holder
 thread_context::make_stack(size_t stack_size) {
-#ifdef SEASTAR_THREAD_STACK_GUARDS
-    size_t page_size = getpagesize();
-    size_t alignment = page_size;
-#else
-    size_t alignment = 16; // ABI requirement on x86_64
-#endif
-    void* mem = ::aligned_alloc(alignment, stack_size);
-    if (mem == nullptr) {
-        throw std::bad_alloc();
+    int valgrind_id;
+    bool mmapped = stacks.mmap();
+    char* mem = stacks.get(stack_size, valgrind_id);
+    if (!mem) {
+        mem = allocate_stack(stack_size, mmapped);
+        valgrind_id = VALGRIND_STACK_REGISTER(mem, mem + stack_size);
     }
-    int valgrind_id = VALGRIND_STACK_REGISTER(mem, reinterpret_cast<char*>(mem) + stack_size);
-    auto stack = stack_holder(new (mem) char[stack_size], stack_deleter(valgrind_id));
+    auto stack = stack_holder(new (mem) char[stack_size], stack_deleter(valgrind_id, stack_size, mmapped));
 #ifdef SEASTAR_ASAN_ENABLED
     // Avoid ASAN false positive due to garbage on stack
     std::memset(stack.get(), 0, stack_size);
 #endif
 
 #ifdef SEASTAR_THREAD_STACK_GUARDS
-    auto mp_status = mprotect(stack.get(), page_size, PROT_READ);
-    throw_system_error_on(mp_status != 0, "mprotect");
+    if (!mmapped) {
+        auto mp_status = mprotect(stack.get(), getpagesize(), PROT_READ);
+        throw_system_error_on(mp_status != 0, "mprotect");
+    }
 #endif
 
     return stack;
 }
 
 void thread_context::stack_deleter::operator()(char* ptr) const noexcept {
-    VALGRIND_STACK_DEREGISTER(valgrind_id);
-    free(ptr);
+#ifdef SEASTAR_THREAD_STACK_GUARDS
+    if (!mmapped) {
+        auto mp_result = mprotect(ptr, getpagesize(), PROT_READ | PROT_WRITE);
+        SEASTAR_ASSERT(mp_result == 0);
+    }
+#endif
+    if (!stacks.put(ptr, size, mmapped, valgrind_id)) {
+        free_stack(ptr, size, mmapped, valgrind_id);
+    }
 }
 
 void
@@ -338,10 +500,22 @@ void switch_out(thread_context* from) {
     from->switch_out();
 }
 
-void init() {
+void init(unsigned cached_stacks, bool mmap_stacks) {
     g_unthreaded_context.link = nullptr;
     g_unthreaded_context.thread = nullptr;
     g_current_context = &g_unthreaded_context;
+#ifdef SEASTAR_ASAN_ENABLED
+    // ASan leaves the frames of an exited thread poisoned, reusing its
+    // stack would report false positives
+    cached_stacks = 0;
+#endif
+    stacks.configure(cached_stacks, mmap_stacks);
+}
+
+void exit() {
+    stacks.clear();
+    // Stacks of threads outliving the reactor are freed directly
+    stacks.configure(0, stacks.mmap());
 }
 
 scheduling_group
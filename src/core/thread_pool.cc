@@ -26,7 +26,9 @@ module;
 
 #include <atomic>
 #include <cstdint>
+#include <algorithm>
 #include <array>
+#include <iterator>
 #include <pthread.h>
 #include <signal.h>
 
@@ -40,11 +42,42 @@ module seastar;
 
 namespace seastar {
 
-thread_pool::thread_pool(reactor& r, sstring name) : _reactor(r), _worker_thread([this, name] { work(name); }) {
+thread_pool::worker::worker(thread_pool& pool, sstring thread_name)
+    : thread([&pool, this, thread_name] { pool.work(wq, thread_name); }) {
 }
 
-void thread_pool::work(sstring name) {
+thread_pool::thread_pool(reactor& r, sstring name, unsigned threads_per_reason, std::optional<unsigned> cpu) : _reactor(r), _cpu(cpu) {
+    static constexpr const char* reason_names[] = { "a", "f", "p" };
+    static_assert(std::size(reason_names) == internal::nr_thread_pool_submit_reasons);
+    try {
+        if (threads_per_reason == 0) {
+            _workers.push_back(std::make_unique<worker>(*this, name));
+            for (auto& lane : _lanes) {
+                lane.workers.push_back(_workers.back().get());
+            }
+            return;
+        }
+        _workers.reserve(threads_per_reason * _lanes.size());
+        for (size_t reason = 0; reason < _lanes.size(); ++reason) {
+            _lanes[reason].workers.reserve(threads_per_reason);
+            for (unsigned i = 0; i < threads_per_reason; ++i) {
+                // thread names are limited to 15 characters
+                auto thread_name = threads_per_reason == 1 ? format("{}{}", name, reason_names[reason]) : format("{}{}{}", name, reason_names[reason], i);
+                _workers.push_back(std::make_unique<worker>(*this, std::move(thread_name)));
+                _lanes[reason].workers.push_back(_workers.back().get());
+            }
+        }
+    } catch (...) {
+        stop();
+        throw;
+    }
+}
+
+void thread_pool::work(syscall_work_queue& wq, sstring name) {
     pthread_setname_np(pthread_self(), name.c_str());
+    if (_cpu) {
+        pin_this_thread(*_cpu);
+    }
     sigset_t mask;
     sigfillset(&mask);
     auto r = ::pthread_sigmask(SIG_BLOCK, &mask, NULL);
@@ -52,19 +85,19 @@ void thread_pool::work(sstring name) {
     std::array<syscall_work_queue::work_item*, syscall_work_queue::queue_length> tmp_buf;
     while (true) {
         uint64_t count;
-        auto r = ::read(inter_thread_wq._start_eventfd.get_read_fd(), &count, sizeof(count));
+        auto r = ::read(wq._start_eventfd.get_read_fd(), &count, sizeof(count));
         SEASTAR_ASSERT(r == sizeof(count));
         if (_stopped.load(std::memory_order_relaxed)) {
             break;
         }
         auto end = tmp_buf.data();
-        inter_thread_wq._pending.consume_all([&] (syscall_work_queue::work_item* wi) {
+        wq._pending.consume_all([&] (syscall_work_queue::work_item* wi) {
             *end++ = wi;
         });
         for (auto p = tmp_buf.data(); p != end; ++p) {
             auto wi = *p;
             wi->process();
-            inter_thread_wq._completed.push(wi);
+            wq._completed.push(wi);
 
             // Prevent the following load of _main_thread_idle to be hoisted before the writes to _completed above.
             std::atomic_thread_fence(std::memory_order_seq_cst);
@@ -77,10 +110,24 @@ void thread_pool::work(sstring name) {
     }
 }
 
+unsigned thread_pool::complete() {
+    unsigned nr = 0;
+    for (auto& w : _workers) {
+        nr += w->wq.complete();
+    }
+    return nr;
+}
+
 thread_pool::~thread_pool() {
+    stop();
+}
+
+void thread_pool::stop() noexcept {
     _stopped.store(true, std::memory_order_relaxed);
-    inter_thread_wq._start_eventfd.signal(1);
-    _worker_thread.join();
+    for (auto& w : _workers) {
+        w->wq._start_eventfd.signal(1);
+        w->thread.join();
+    }
 }
 
 }
@@ -22,6 +22,19 @@
 #pragma once
 
 #include "syscall_work_queue.hh"
+#include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/core/metrics_types.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/core/sstring.hh>
+#ifndef SEASTAR_MODULE
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <vector>
+#endif
 
 namespace seastar {
 
@@ -38,8 +51,10 @@ enum class thread_pool_submit_reason : size_t {
     process_operation,
 };
 
+constexpr size_t nr_thread_pool_submit_reasons = static_cast<size_t>(thread_pool_submit_reason::process_operation) + 1;
+
 class submit_metrics {
-    uint64_t _counters[static_cast<size_t>(thread_pool_submit_reason::process_operation) + 1]{};
+    uint64_t _counters[nr_thread_pool_submit_reasons]{};
 
 public:
     void record_reason(thread_pool_submit_reason reason) {
@@ -52,27 +67,69 @@ class submit_metrics {
 };
 } // namespace internal
 
+// Runs the blocking work of a shard. By default a single thread does
+// all of it. If so configured, each submit reason gets workers of its
+// own, so that a slow file system operation does not hold up the aio
+// fallbacks or the process operations, and possibly several of them,
+// so that it does not hold up the other file operations either.
 class thread_pool {
+    using latency_histogram = seastar::metrics::internal::approximate_exponential_histogram<8, 8 << 20, 4>;
+    struct worker {
+        syscall_work_queue wq;
+        // submitted and not completed yet, as seen from the reactor
+        unsigned in_flight = 0;
+        posix_thread thread;
+
+        worker(thread_pool& pool, sstring thread_name);
+    };
+    struct lane {
+        // owned by _workers, shared by all lanes if there is one worker
+        std::vector<worker*> workers;
+        // time from submission to completion, in microseconds
+        latency_histogram latency;
+    };
     reactor& _reactor;
-    internal::submit_metrics metrics;
-    syscall_work_queue inter_thread_wq;
-    posix_thread _worker_thread;
+    std::optional<unsigned> _cpu;
+    internal::submit_metrics _submit_metrics;
+    std::vector<std::unique_ptr<worker>> _workers;
+    std::array<lane, internal::nr_thread_pool_submit_reasons> _lanes;
     std::atomic<bool> _stopped = { false };
     std::atomic<bool> _main_thread_idle = { false };
+
+    // the least busy worker of a lane
+    worker& pick_worker(internal::thread_pool_submit_reason reason) noexcept {
+        auto& workers = _lanes[static_cast<size_t>(reason)].workers;
+        return **std::min_element(workers.begin(), workers.end(), [] (const worker* a, const worker* b) {
+            return a->in_flight < b->in_flight;
+        });
+    }
 public:
-    explicit thread_pool(reactor& r, sstring thread_name);
+    /// \param threads_per_reason the number of threads serving each submit reason,
+    ///        or 0 for a single thread serving all of them
+    /// \param cpu the CPU to pin the threads to, by default they share the CPU of the reactor
+    thread_pool(reactor& r, sstring thread_name, unsigned threads_per_reason = 0, std::optional<unsigned> cpu = std::nullopt);
     ~thread_pool();
     template <typename T, typename Func>
     future<T> submit(internal::thread_pool_submit_reason reason, Func func) noexcept {
-        metrics.record_reason(reason);
-        return inter_thread_wq.submit<T>(std::move(func));
+        _submit_metrics.record_reason(reason);
+        auto& w = pick_worker(reason);
+        ++w.in_flight;
+        auto start = std::chrono::steady_clock::now();
+        return w.wq.submit<T>(std::move(func)).finally([&w, &lane = _lanes[static_cast<size_t>(reason)], start] {
+            --w.in_flight;
+            lane.latency.add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+        });
+    }
+    uint64_t count(internal::thread_pool_submit_reason r) const { return _submit_metrics.count_for(r); }
+    seastar::metrics::histogram latency(internal::thread_pool_submit_reason r) const {
+        return _lanes[static_cast<size_t>(r)].latency.to_metrics_histogram();
     }
-    uint64_t count(internal::thread_pool_submit_reason r) const { return metrics.count_for(r); }
 
-    unsigned complete() { return inter_thread_wq.complete(); }
-    // Before we enter interrupt mode, we must make sure that the syscall thread will properly
+    unsigned complete();
+    size_t threads() const noexcept { return _workers.size(); }
+    // Before we enter interrupt mode, we must make sure that the syscall threads will properly
     // generate signals to wake us up. This means we need to make sure that all modifications to
-    // the pending and completed fields in the inter_thread_wq are visible to all threads.
+    // the pending and completed fields in the work queues are visible to all threads.
     //
     // Simple release-acquire won't do because we also need to serialize all writes that happens
     // before the syscall thread loads this value, so we'll need full seq_cst.
@@ -83,8 +140,8 @@ class thread_pool {
     void exit_interrupt_mode() { _main_thread_idle.store(false, std::memory_order_relaxed); }
 
 private:
-    void work(sstring thread_name);
+    void work(syscall_work_queue& wq, sstring thread_name);
+    void stop() noexcept;
 };
 
-
 }
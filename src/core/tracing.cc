@@ -0,0 +1,327 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <random>
+#include <vector>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/tracing.hh>
+#include <seastar/core/task.hh>
+#endif
+
+namespace seastar {
+
+namespace tracing {
+
+namespace internal {
+
+struct span_state {
+    span_data data;
+    // Slot of the span in the shard's table while it may be current, 0
+    // before it is made current the first time
+    uint16_t slot = 0;
+    bool ended = false;
+};
+
+}
+
+namespace {
+
+// The spans which tasks may refer to through their trace slot, slot 0
+// standing for none. A slot's generation changes whenever its span ends,
+// and tasks carry it along with the slot, so that a task which outlived
+// its span does not find the next span in the slot.
+struct span_slot {
+    internal::span_state* state = nullptr;
+    uint16_t generation = 0;
+};
+
+struct span_table {
+    std::vector<span_slot> spans{span_slot{}};
+    std::deque<uint16_t> free;
+    shared_ptr<span_sink> sink;
+    double root_sampling_probability = 0;
+    std::mt19937_64 random{std::random_device{}()};
+};
+
+thread_local span_table table;
+
+uint32_t make_handle(uint16_t slot) noexcept {
+    return uint32_t(table.spans[slot].generation) << 16 | slot;
+}
+
+internal::span_state* current_span_state() noexcept {
+    auto handle = *seastar::internal::current_trace_slot_ptr();
+    auto slot = handle & 0xffff;
+    if (slot >= table.spans.size() || table.spans[slot].generation != handle >> 16) {
+        return nullptr;
+    }
+    return table.spans[slot].state;
+}
+
+template <size_t N>
+void random_id(std::array<uint8_t, N>& id) {
+    do {
+        for (size_t i = 0; i != N; i += 8) {
+            auto r = table.random();
+            std::copy_n(reinterpret_cast<const uint8_t*>(&r), std::min<size_t>(8, N - i), id.data() + i);
+        }
+    } while (std::ranges::all_of(id, [] (uint8_t b) { return b == 0; }));
+}
+
+template <size_t N>
+bool is_zero(const std::array<uint8_t, N>& id) noexcept {
+    return std::ranges::all_of(id, [] (uint8_t b) { return b == 0; });
+}
+
+int hex_digit(char c) noexcept {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    // Upper case is not allowed by the specification
+    return -1;
+}
+
+template <size_t N>
+bool parse_hex(std::string_view s, std::array<uint8_t, N>& out) noexcept {
+    if (s.size() != 2 * N) {
+        return false;
+    }
+    for (size_t i = 0; i != N; ++i) {
+        auto hi = hex_digit(s[2 * i]);
+        auto lo = hex_digit(s[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        out[i] = hi << 4 | lo;
+    }
+    return true;
+}
+
+char* write_hex(char* out, const uint8_t* p, size_t len) noexcept {
+    static constexpr char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i != len; ++i) {
+        *out++ = digits[p[i] >> 4];
+        *out++ = digits[p[i] & 0xf];
+    }
+    return out;
+}
+
+}
+
+bool trace_context::valid() const noexcept {
+    return !is_zero(trace_id) && !is_zero(span_id);
+}
+
+sstring trace_context::traceparent() const {
+    auto s = uninitialized_string(55);
+    auto p = s.data();
+    *p++ = '0';
+    *p++ = '0';
+    *p++ = '-';
+    p = write_hex(p, trace_id.data(), trace_id.size());
+    *p++ = '-';
+    p = write_hex(p, span_id.data(), span_id.size());
+    *p++ = '-';
+    write_hex(p, &flags, 1);
+    return s;
+}
+
+std::optional<trace_context> trace_context::from_traceparent(std::string_view value) noexcept {
+    // version-trace_id-parent_id-flags, versions past 00 may append fields
+    if (value.size() < 55 || value[2] != '-' || value[35] != '-' || value[52] != '-') {
+        return std::nullopt;
+    }
+    std::array<uint8_t, 1> version, flags;
+    trace_context ctx;
+    if (!parse_hex(value.substr(0, 2), version) || version[0] == 0xff || (version[0] == 0 && value.size() != 55)
+            || (value.size() > 55 && value[55] != '-')
+            || !parse_hex(value.substr(3, 32), ctx.trace_id)
+            || !parse_hex(value.substr(36, 16), ctx.span_id)
+            || !parse_hex(value.substr(53, 2), flags)) {
+        return std::nullopt;
+    }
+    ctx.flags = flags[0];
+    if (!ctx.valid()) {
+        return std::nullopt;
+    }
+    return ctx;
+}
+
+void trace_context::write(char* p) const noexcept {
+    std::copy_n(trace_id.data(), trace_id.size(), reinterpret_cast<uint8_t*>(p));
+    std::copy_n(span_id.data(), span_id.size(), reinterpret_cast<uint8_t*>(p) + 16);
+    p[24] = flags;
+}
+
+std::optional<trace_context> trace_context::read(const char* p) noexcept {
+    trace_context ctx;
+    std::copy_n(reinterpret_cast<const uint8_t*>(p), ctx.trace_id.size(), ctx.trace_id.data());
+    std::copy_n(reinterpret_cast<const uint8_t*>(p) + 16, ctx.span_id.size(), ctx.span_id.data());
+    ctx.flags = p[24];
+    if (!ctx.valid()) {
+        return std::nullopt;
+    }
+    return ctx;
+}
+
+void set_span_sink(shared_ptr<span_sink> sink) noexcept {
+    table.sink = std::move(sink);
+}
+
+void set_root_sampling_probability(double p) noexcept {
+    table.root_sampling_probability = std::clamp(p, 0.0, 1.0);
+}
+
+double root_sampling_probability() noexcept {
+    return table.root_sampling_probability;
+}
+
+span::span(sstring name)
+        : span(std::move(name), current_context() ? std::optional<trace_context>(*current_context()) : std::nullopt)
+{}
+
+span::span(sstring name, const std::optional<trace_context>& parent)
+        : _state(std::make_unique<internal::span_state>())
+{
+    auto& d = _state->data;
+    d.name = std::move(name);
+    if (parent) {
+        d.context.trace_id = parent->trace_id;
+        d.context.flags = parent->flags;
+        d.parent_span_id = parent->span_id;
+    } else {
+        random_id(d.context.trace_id);
+        auto p = table.root_sampling_probability;
+        if (p > 0 && std::uniform_real_distribution<double>(0, 1)(table.random) < p) {
+            d.context.flags |= trace_context::sampled_flag;
+        }
+    }
+    random_id(d.context.span_id);
+    d.start = std::chrono::system_clock::now();
+}
+
+span::span(span&&) noexcept = default;
+
+span& span::operator=(span&& o) noexcept {
+    if (this != &o) {
+        end();
+        _state = std::move(o._state);
+    }
+    return *this;
+}
+
+span::~span() {
+    end();
+}
+
+const trace_context& span::context() const noexcept {
+    return _state->data.context;
+}
+
+void span::set_attribute(sstring key, sstring value) {
+    if (_state && _state->data.context.sampled()) {
+        _state->data.attributes.emplace_back(std::move(key), std::move(value));
+    }
+}
+
+void span::set_failed() noexcept {
+    if (_state) {
+        _state->data.failed = true;
+    }
+}
+
+void span::end() noexcept {
+    if (!_state || _state->ended) {
+        return;
+    }
+    _state->ended = true;
+    if (auto slot = _state->slot) {
+        table.spans[slot].state = nullptr;
+        table.spans[slot].generation++;
+        try {
+            table.free.push_back(slot);
+        } catch (...) {
+            // the slot is lost
+        }
+    }
+    if (_state->data.context.sampled() && table.sink) {
+        _state->data.end = std::chrono::system_clock::now();
+        table.sink->consume(std::move(_state->data));
+    }
+}
+
+uint32_t enter_span(span& s) noexcept {
+    auto& current = *seastar::internal::current_trace_slot_ptr();
+    auto previous = current;
+    auto& st = *s._state;
+    if (!st.slot && !st.ended) {
+        try {
+            if (!table.free.empty()) {
+                st.slot = table.free.front();
+                table.free.pop_front();
+            } else if (table.spans.size() <= std::numeric_limits<uint16_t>::max()) {
+                table.spans.emplace_back();
+                st.slot = table.spans.size() - 1;
+            }
+        } catch (...) {
+            // runs outside of the span
+        }
+        if (st.slot) {
+            table.spans[st.slot].state = &st;
+        }
+    }
+    if (st.slot) {
+        current = make_handle(st.slot);
+    }
+    return previous;
+}
+
+void exit_span(uint32_t previous) noexcept {
+    *seastar::internal::current_trace_slot_ptr() = previous;
+}
+
+const trace_context* current_context() noexcept {
+    auto st = current_span_state();
+    return st ? &st->data.context : nullptr;
+}
+
+void set_attribute(sstring key, sstring value) {
+    if (auto st = current_span_state(); st && st->data.context.sampled()) {
+        st->data.attributes.emplace_back(std::move(key), std::move(value));
+    }
+}
+
+}
+
+}
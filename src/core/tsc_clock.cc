@@ -0,0 +1,131 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/internal/tsc_clock.hh>
+#endif
+
+namespace seastar::internal {
+
+#ifdef SEASTAR_BUILD_SHARED_LIBS
+tsc_calibration*
+current_tsc_calibration() noexcept {
+    static thread_local tsc_calibration calibration;
+    return &calibration;
+}
+#endif
+
+namespace {
+
+// The kernel stops using the counter as its clock source when it finds it
+// unreliable, e.g. not synchronized between the sockets, or unstable under
+// a hypervisor
+bool kernel_clocksource_is(const char* name) noexcept {
+    try {
+        std::ifstream f("/sys/devices/system/clocksource/clocksource0/current_clocksource");
+        std::string current;
+        return f >> current && current == name;
+    } catch (...) {
+        return false;
+    }
+}
+
+}
+
+bool tsc_supported() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    // The invariant TSC runs at a constant rate in all power states, and
+    // is synchronized between the cores
+    unsigned eax, ebx, ecx, edx;
+    return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8)) && kernel_clocksource_is("tsc");
+#elif defined(__aarch64__)
+    // The generic timer always runs at a constant rate
+    return kernel_clocksource_is("arch_sys_counter");
+#else
+    return false;
+#endif
+}
+
+namespace {
+
+struct samples {
+    uint64_t first_counter = 0;
+    int64_t first_ns = 0;
+    int64_t last_ns = 0;
+    bool taken = false;
+};
+
+thread_local samples sampled;
+
+}
+
+void tsc_resync() noexcept {
+    auto counter = read_tsc();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (!sampled.taken) {
+        sampled = {counter, ns, ns, true};
+        return;
+    }
+    auto ticks = counter - sampled.first_counter;
+    auto elapsed = ns - sampled.first_ns;
+    auto period = ns - std::exchange(sampled.last_ns, ns);
+    if (!ticks || elapsed <= 0 || period <= 0) {
+        return;
+    }
+    auto& c = *current_tsc_calibration();
+    // The rate over all the time since the first sample, the more accurate
+    // the longer it is
+    auto mult = uint64_t(((unsigned __int128)elapsed << 32) / ticks);
+    auto base_ns = ns;
+    if (c.get().mult) {
+        // Ahead of steady_clock, the clock continues from where it is, so as
+        // not to go back, and slows down to meet it by the next resync, or
+        // by half if it is further ahead, over the next ones. Behind, it
+        // jumps forward.
+        auto current = std::chrono::duration_cast<std::chrono::nanoseconds>(tsc_now().time_since_epoch()).count();
+        auto ahead = current - ns;
+        if (ahead > 0) {
+            base_ns = current;
+            mult = uint64_t((unsigned __int128)mult * (period - std::min(ahead, period / 2)) / period);
+        }
+    }
+    auto next = 1 - c.current.load(std::memory_order_relaxed);
+    c.slots[next] = {counter, base_ns, mult};
+    c.current.store(next, std::memory_order_release);
+}
+
+}
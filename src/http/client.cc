@@ -29,18 +29,22 @@ module;
 #include <optional>
 #include <stdexcept>
 #include <utility>
+#include <boost/range/irange.hpp>
 
 #ifdef SEASTAR_MODULE
 module seastar;
 #else
 #include <seastar/core/loop.hh>
+#include <seastar/core/gate.hh>
 #include <seastar/core/when_all.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/core/tracing.hh>
 #include <seastar/http/client.hh>
 #include <seastar/http/request.hh>
 #include <seastar/http/reply.hh>
 #include <seastar/http/response_parser.hh>
 #include <seastar/http/internal/content_source.hh>
+#include <seastar/http/internal/http2.hh>
 #include <seastar/util/short_streams.hh>
 #include <seastar/util/string_utils.hh>
 #endif
@@ -156,7 +160,7 @@ future<connection::reply_ptr> connection::recv_reply() {
     });
 }
 
-future<connection::reply_ptr> connection::do_make_request(request& req) {
+future<connection::reply_ptr> connection::send_request(request& req) {
     setup_request(req);
     return send_request_head(req).then([this, &req] {
         return maybe_wait_for_continue(req).then([this, &req] (reply_ptr cont) {
@@ -165,14 +169,23 @@ future<connection::reply_ptr> connection::do_make_request(request& req) {
             }
 
             return write_body(req).then([this] {
-                return _write_buf.flush().then([this] {
-                    return recv_reply();
+                return _write_buf.flush().then([] {
+                    return reply_ptr();
                 });
             });
         });
     });
 }
 
+future<connection::reply_ptr> connection::do_make_request(request& req) {
+    return send_request(req).then([this] (reply_ptr cont) {
+        if (cont) {
+            return make_ready_future<reply_ptr>(std::move(cont));
+        }
+        return recv_reply();
+    });
+}
+
 future<reply> connection::make_request(request req) {
     return do_with(std::move(req), [this] (auto& req) {
         return do_make_request(req).then([] (reply_ptr rep) {
@@ -221,13 +234,15 @@ client::client(std::unique_ptr<connection_factory> f, unsigned max_connections,
         , _max_connections(max_connections)
         , _max_bytes_to_drain(max_bytes_to_drain)
         , _retry(retry)
+        , _idle_timer([this] { evict_idle_connections(); })
 {
 }
 
 future<client::connection_ptr> client::get_connection(abort_source* as) {
     if (!_pool.empty()) {
-        connection_ptr con = _pool.front().shared_from_this();
-        _pool.pop_front();
+        // Most recently used first, so that surplus connections stay idle and get evicted
+        connection_ptr con = _pool.back().shared_from_this();
+        _pool.pop_back();
         http_log.trace("pop http connection {} from pool", con->_fd.local_address());
         return make_ready_future<connection_ptr>(con);
     }
@@ -257,6 +272,7 @@ future<client::connection_ptr> client::make_connection(abort_source* as) {
 future<> client::put_connection(connection_ptr con) {
     if (con->_persistent && (_nr_connections <= _max_connections)) {
         http_log.trace("push http connection {} to pool", con->_fd.local_address());
+        con->_idle_since = lowres_clock::now();
         _pool.push_back(*con);
         _wait_con.signal();
         return make_ready_future<>();
@@ -295,15 +311,124 @@ future<> client::set_maximum_connections(unsigned nr) {
     return shrink_connections();
 }
 
+future<> client::prewarm(unsigned nr, abort_source* as) {
+    nr = std::min(nr, _max_connections > _nr_connections ? _max_connections - _nr_connections : 0u);
+    http_log.debug("prewarming {} connections", nr);
+    return parallel_for_each(boost::irange(0u, nr), [this, as] (unsigned) {
+        if (_http2) {
+            return make_h2_connection(as).discard_result();
+        }
+        return make_connection(as).then([this] (connection_ptr con) {
+            return put_connection(std::move(con));
+        });
+    });
+}
+
+void client::set_idle_timeout(lowres_clock::duration timeout) {
+    _idle_timeout = timeout;
+    _idle_timer.cancel();
+    if (timeout != lowres_clock::duration::zero()) {
+        _idle_timer.arm_periodic(std::max<lowres_clock::duration>(timeout / 2, std::chrono::milliseconds(10)));
+    }
+}
+
+void client::evict_idle_connections() {
+    auto deadline = lowres_clock::now() - _idle_timeout;
+    // The pool is ordered by the time connections were put into it
+    while (!_pool.empty() && _pool.front()._idle_since <= deadline) {
+        connection_ptr con = _pool.front().shared_from_this();
+        _pool.pop_front();
+        _evicted_connections++;
+        http_log.trace("evicting idle connection {}", con->_fd.local_address());
+        (void)try_with_gate(_bg, [con] {
+            return con->close().finally([con] {});
+        }).handle_exception([] (std::exception_ptr) {});
+    }
+}
+
 template <std::invocable<connection&> Fn>
 auto client::with_connection(Fn&& fn, abort_source* as) {
-    return get_connection(as).then([this, fn = std::move(fn)] (connection_ptr con) mutable {
+    auto waited = _pool.empty();
+    auto start = std::chrono::steady_clock::now();
+    return get_connection(as).then([this, fn = std::move(fn), waited, start] (connection_ptr con) mutable {
+        if (waited) {
+            _connection_waits++;
+            _connection_wait_time += std::chrono::steady_clock::now() - start;
+        }
         return fn(*con).finally([this, con = std::move(con)] () mutable {
             return put_connection(std::move(con));
         });
     });
 }
 
+future<client::connection_ptr> client::get_pipelined_connection(abort_source* as) {
+    // Idle connections are better off serving requests in parallel
+    if (_pool.empty()) {
+        for (auto& con : _pipelining) {
+            if (con->_persistent && con->_pipelined < _pipeline_depth) {
+                con->_pipelined++;
+                _pipelined_requests++;
+                return make_ready_future<connection_ptr>(con);
+            }
+        }
+        if (_nr_connections >= _max_connections) {
+            // Wait for a connection to go idle, or to have room for another request
+            auto sub = as ? as->subscribe([this] () noexcept { _wait_con.broadcast(); }) : std::nullopt;
+            return _wait_con.wait().then([this, as, sub = std::move(sub)] {
+                if (as != nullptr && as->abort_requested()) {
+                    return make_exception_future<client::connection_ptr>(as->abort_requested_exception_ptr());
+                }
+                return get_pipelined_connection(as);
+            });
+        }
+    }
+    return get_connection(as).then([this] (connection_ptr con) {
+        con->_pipelined++;
+        _pipelining.push_back(con);
+        // Other requests may go on this connection too
+        _wait_con.broadcast();
+        return con;
+    });
+}
+
+template <std::invocable<connection&> Fn>
+auto client::with_pipelined_connection(Fn&& fn, abort_source* as) {
+    auto waited = _pool.empty();
+    auto start = std::chrono::steady_clock::now();
+    return get_pipelined_connection(as).then([this, fn = std::move(fn), waited, start] (connection_ptr con) mutable {
+        if (waited) {
+            _connection_waits++;
+            _connection_wait_time += std::chrono::steady_clock::now() - start;
+        }
+        return fn(*con).finally([this, con = std::move(con)] () mutable {
+            if (--con->_pipelined != 0) {
+                _wait_con.broadcast();
+                return make_ready_future<>();
+            }
+            std::erase(_pipelining, con);
+            return put_connection(std::move(con));
+        });
+    });
+}
+
+// RFC 9110 Section 9.2.2
+static bool is_idempotent(const request& req) {
+    for (auto method : {"GET", "HEAD", "OPTIONS", "TRACE", "PUT", "DELETE"}) {
+        if (req._method == method) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool client::can_pipeline(const request& req) const {
+    if (_pipeline_depth <= 1 || !req.get_header("Expect").empty()) {
+        return false;
+    }
+    // RFC 9112 Section 9.3.2, non-idempotent requests are not to be pipelined
+    return is_idempotent(req);
+}
+
 template <typename Fn>
 requires std::invocable<Fn, connection&>
 auto client::with_new_connection(Fn&& fn, abort_source* as) {
@@ -338,6 +463,9 @@ static bool is_retryable_exception(std::exception_ptr ex) {
             return false;
         } catch (const httpd::response_parsing_exception&) {
             return true;
+        } catch (const internal::http2::stream_reset& e) {
+            // The server didn't start processing the request
+            return e.code() == internal::http2::error_code::refused_stream;
         } catch (const std::exception& e) {
             try {
                 std::rethrow_if_nested(e);
@@ -354,9 +482,27 @@ static bool is_retryable_exception(std::exception_ptr ex) {
 }
 
 future<> client::make_request(request& req, reply_handler& handle, std::optional<reply::status_type> expected, abort_source* as) {
-    return with_connection([this, &req, &handle, as, expected] (connection& con) {
-        return do_make_request(con, req, handle, as, expected);
-    }, as).handle_exception([this, &req, &handle, as, expected] (std::exception_ptr ex) {
+    if (auto ctx = tracing::current_context(); ctx && !req._headers.contains("traceparent")) {
+        req._headers["traceparent"] = ctx->traceparent();
+    }
+    if (_http2) {
+        return make_h2_request(req, handle, expected, as);
+    }
+    if (can_hedge(req)) {
+        return make_hedged_request(req, handle, expected, as);
+    }
+    return make_h1_request(req, handle, expected, as, can_pipeline(req));
+}
+
+future<> client::make_h1_request(request& req, reply_handler& handle, std::optional<reply::status_type> expected, abort_source* as, bool pipeline) {
+    auto f = pipeline
+            ? with_pipelined_connection([this, &req, &handle, as, expected] (connection& con) {
+                return do_make_request(con, req, handle, as, expected);
+            }, as)
+            : with_connection([this, &req, &handle, as, expected] (connection& con) {
+                return do_make_request(con, req, handle, as, expected);
+            }, as);
+    return std::move(f).handle_exception([this, &req, &handle, as, expected] (std::exception_ptr ex) {
         if (as && as->abort_requested()) {
             return make_exception_future<>(as->abort_requested_exception_ptr());
         }
@@ -374,6 +520,155 @@ future<> client::make_request(request& req, reply_handler& handle, std::optional
     });
 }
 
+static bool is_unexpected_status(const std::exception_ptr& ex) {
+    try {
+        std::rethrow_exception(ex);
+    } catch (const httpd::unexpected_status_error&) {
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+// The replies to the first hedging_window requests after the last estimate
+// make the next one
+static constexpr uint64_t hedging_window = 100;
+
+// The two copies of a hedged request, each with a handler and an abort source
+// of its own. The first copy to get a reply claims the request, so that the
+// handler runs for it alone, and the other copy is aborted.
+class client::hedged_request {
+    client& _client;
+    reply_handler& _handle;
+
+    reply_handler make_handler(unsigned i) {
+        return [this, i] (const reply& rep, input_stream<char>&& in) {
+            if (!claim(i)) {
+                return make_exception_future<>(as[i].abort_requested_exception_ptr());
+            }
+            return _handle(rep, std::move(in));
+        };
+    }
+public:
+    abort_source as[2];
+    reply_handler handles[2];
+    std::chrono::steady_clock::time_point starts[2];
+    std::exception_ptr errors[2];
+    int winner = -1;
+    timer<> hedge_timer;
+    future<> hedge = make_ready_future<>();
+    optimized_optional<abort_source::subscription> sub;
+
+    hedged_request(client& c, reply_handler& handle)
+            : _client(c)
+            , _handle(handle)
+            , handles{make_handler(0), make_handler(1)}
+    {
+    }
+
+    // Retries of the winner call the handler again
+    bool claim(unsigned i) noexcept {
+        if (winner < 0) {
+            winner = i;
+            hedge_timer.cancel();
+            as[1 - i].request_abort();
+            _client.update_hedging_estimate(std::chrono::steady_clock::now() - starts[i]);
+            if (i == 1) {
+                _client._hedge_wins++;
+            }
+        }
+        return winner == int(i);
+    }
+
+    void abort() noexcept {
+        hedge_timer.cancel();
+        as[0].request_abort();
+        as[1].request_abort();
+    }
+
+    void finished(unsigned i, future<> f) noexcept {
+        if (f.failed()) {
+            errors[i] = f.get_exception();
+            // An unexpected status is a reply too
+            if (winner < 0 && is_unexpected_status(errors[i])) {
+                claim(i);
+            }
+        }
+    }
+
+    future<> result(abort_source* user_as) {
+        // Without a winner, neither copy got a reply
+        auto& ex = errors[winner < 0 ? 0 : winner];
+        if (!ex) {
+            return make_ready_future<>();
+        }
+        if (user_as && user_as->abort_requested()) {
+            return make_exception_future<>(user_as->abort_requested_exception_ptr());
+        }
+        return make_exception_future<>(ex);
+    }
+};
+
+void client::set_hedging(std::chrono::steady_clock::duration delay, std::optional<double> percentile) {
+    _hedging_delay = std::max(delay, std::chrono::steady_clock::duration::zero());
+    _hedging_percentile = std::nullopt;
+    if (percentile) {
+        _hedging_percentile = std::clamp(*percentile, 0.0, 1.0);
+    }
+    _hedging_estimate = {};
+    _hedging_latencies.clear();
+}
+
+bool client::can_hedge(const request& req) const {
+    // The copies share the request, and its body writer can only run once
+    return _hedging_delay > std::chrono::steady_clock::duration::zero()
+            && !req.body_writer && req.get_header("Expect").empty() && is_idempotent(req);
+}
+
+std::chrono::steady_clock::duration client::hedging_delay() const noexcept {
+    return std::max(_hedging_delay, _hedging_estimate);
+}
+
+void client::update_hedging_estimate(std::chrono::steady_clock::duration latency) {
+    if (!_hedging_percentile) {
+        return;
+    }
+    _hedging_latencies.add(latency);
+    if (_hedging_latencies.count() >= hedging_window) {
+        _hedging_estimate = std::chrono::microseconds(_hedging_latencies.quantile(*_hedging_percentile));
+        _hedging_latencies.clear();
+    }
+}
+
+future<> client::make_hedged_request(request& req, reply_handler& handle, std::optional<reply::status_type> expected, abort_source* as) {
+    if (as && as->abort_requested()) {
+        return make_exception_future<>(as->abort_requested_exception_ptr());
+    }
+    auto h = seastar::make_lw_shared<hedged_request>(*this, handle);
+    if (as) {
+        h->sub = as->subscribe([&h = *h] () noexcept { h.abort(); });
+    }
+    h->hedge_timer.set_callback([this, &h = *h, &req, expected] {
+        _hedged_requests++;
+        http_log.trace("hedging request {} {}", req._method, req._url);
+        h.starts[1] = std::chrono::steady_clock::now();
+        // Never pipelined, which would queue it behind the first copy
+        h.hedge = make_h1_request(req, h.handles[1], expected, &h.as[1], false).then_wrapped([&h] (future<> f) {
+            h.finished(1, std::move(f));
+        });
+    });
+    h->hedge_timer.arm(hedging_delay());
+    h->starts[0] = std::chrono::steady_clock::now();
+    return make_h1_request(req, h->handles[0], expected, &h->as[0], can_pipeline(req)).then_wrapped([h] (future<> f) {
+        h->finished(0, std::move(f));
+        // Once the first copy is over, the request is not sent again
+        h->hedge_timer.cancel();
+        return std::move(h->hedge);
+    }).then([h, as] {
+        return h->result(as);
+    });
+}
+
 class skip_body_source : public data_source_impl {
 public:
     skip_body_source(reply& rep) {
@@ -393,7 +688,28 @@ class skip_body_source : public data_source_impl {
 
 future<> client::do_make_request(connection& con, request& req, reply_handler& handle, abort_source* as, std::optional<reply::status_type> expected) {
     auto sub = as ? as->subscribe([&con] () noexcept { con.shutdown(); }) : std::nullopt;
-    return con.do_make_request(req).then([this, &con, &req, &handle, expected] (connection::reply_ptr reply) mutable {
+    promise<> sent;
+    promise<> received;
+    auto send_turn = std::exchange(con._send_turn, sent.get_future());
+    auto recv_turn = std::exchange(con._recv_turn, received.get_future());
+    return send_turn.then([&con, &req] {
+        return con.send_request(req);
+    }).then_wrapped([sent = std::move(sent)] (future<connection::reply_ptr> f) mutable {
+        sent.set_value();
+        return f;
+    }).then([&con, recv_turn = std::move(recv_turn)] (connection::reply_ptr cont) mutable {
+        if (cont) {
+            return make_ready_future<connection::reply_ptr>(std::move(cont));
+        }
+        return std::move(recv_turn).then([&con] {
+            // Some previous request broke the connection, or the server
+            // closes it after the previous reply
+            if (!con._persistent) {
+                return make_exception_future<connection::reply_ptr>(std::system_error(ECONNABORTED, std::system_category()));
+            }
+            return con.recv_reply();
+        });
+    }).then([this, &con, &req, &handle, expected] (connection::reply_ptr reply) mutable {
         auto& rep = *reply;
         if (expected.has_value() && rep._status != expected.value()) {
             if (!http_log.is_enabled(log_level::debug)) {
@@ -426,10 +742,194 @@ future<> client::do_make_request(connection& con, request& req, reply_handler& h
     }).handle_exception([&con] (auto ex) mutable {
         con._persistent = false;
         return make_exception_future<>(std::move(ex));
-    }).finally([sub = std::move(sub)] {});
+    }).finally([sub = std::move(sub), received = std::move(received)] () mutable {
+        received.set_value();
+    });
 }
 
-future<> client::close() {
+namespace http2 = internal::http2;
+
+class client::h2_connection : public http2::session {
+    connected_socket _fd;
+    internal::client_ref _ref;
+    future<> _done;
+
+    static http2::settings local_settings() {
+        http2::settings s;
+        s.initial_window_size = 1 << 20;
+        return s;
+    }
+public:
+    h2_connection(connected_socket&& fd, internal::client_ref cr)
+            : session(fd.input(), fd.output(), role::client, local_settings())
+            , _fd(std::move(fd))
+            , _ref(std::move(cr))
+            , _done(run().handle_exception([] (std::exception_ptr ex) {
+                http_log.debug("http2 connection failed: {}", ex);
+            }))
+    {
+    }
+
+    // The connection went away and its session finished
+    bool done() const noexcept {
+        return closed() && _done.available();
+    }
+
+    future<> close() {
+        return shutdown().then([this] {
+            _fd.shutdown_input();
+            return std::move(_done);
+        });
+    }
+};
+
+future<client::h2_connection_ptr> client::get_h2_connection(abort_source* as) {
+    std::erase_if(_h2_connections, [] (const h2_connection_ptr& con) {
+        return con->done();
+    });
+
+    h2_connection_ptr best;
+    for (auto& con : _h2_connections) {
+        if (con->has_capacity()) {
+            return make_ready_future<h2_connection_ptr>(con);
+        }
+        if (!con->closed() && (!best || con->active_streams() < best->active_streams())) {
+            best = con;
+        }
+    }
+
+    if (_nr_connections < _max_connections) {
+        return make_h2_connection(as);
+    }
+    if (best) {
+        // Wait for a stream slot on the least loaded connection
+        return make_ready_future<h2_connection_ptr>(std::move(best));
+    }
+
+    auto sub = as ? as->subscribe([this] () noexcept { _wait_con.broadcast(); }) : std::nullopt;
+    return _wait_con.wait().then([this, as, sub = std::move(sub)] {
+        if (as != nullptr && as->abort_requested()) {
+            return make_exception_future<h2_connection_ptr>(as->abort_requested_exception_ptr());
+        }
+        return get_h2_connection(as);
+    });
+}
+
+future<client::h2_connection_ptr> client::make_h2_connection(abort_source* as) {
+    _total_new_connections++;
+    return _new_connections->make(as).then([this, cr = internal::client_ref(this)] (connected_socket cs) mutable {
+        http_log.trace("created new http2 connection {}", cs.local_address());
+        auto con = seastar::make_shared<h2_connection>(std::move(cs), std::move(cr));
+        _h2_connections.push_back(con);
+        return con;
+    });
+}
+
+future<> client::make_h2_request(request& req, reply_handler& handle, std::optional<reply::status_type> expected, abort_source* as) {
+    return get_h2_connection(as).then([this, &req, &handle, as, expected] (h2_connection_ptr con) {
+        return do_make_h2_request(*con, req, handle, as, expected).finally([con] {});
+    }).handle_exception([this, &req, &handle, as, expected] (std::exception_ptr ex) {
+        if (as && as->abort_requested()) {
+            return make_exception_future<>(as->abort_requested_exception_ptr());
+        }
+
+        if (!_retry || !is_retryable_exception(ex)) {
+            return make_exception_future<>(ex);
+        }
+
+        return make_h2_connection(as).then([this, &req, &handle, as, expected] (h2_connection_ptr con) {
+            return do_make_h2_request(*con, req, handle, as, expected).finally([con] {});
+        });
+    });
+}
+
+future<> client::do_make_h2_request(h2_connection& con, request& req, reply_handler& handle, abort_source* as, std::optional<reply::status_type> expected) {
+    if (req.content_length != 0) {
+        if (!req.body_writer && req.content.empty()) {
+            return make_exception_future<>(std::runtime_error("Request body writer not set and content is empty"));
+        }
+        req._headers["Content-Length"] = to_sstring(req.content_length);
+    }
+
+    http2::header_list headers;
+    headers.emplace_back(":method", req._method);
+    headers.emplace_back(":scheme", req.protocol_name);
+    headers.emplace_back(":authority", req.get_header("Host"));
+    headers.emplace_back(":path", req.format_url());
+    for (const auto& [name, value] : req._headers) {
+        auto lname = http2::header_name(name);
+        if (lname != "host" && lname != "expect" && !http2::is_connection_specific_header(lname)) {
+            headers.emplace_back(std::move(lname), value);
+        }
+    }
+    bool has_body = req.body_writer || !req.content.empty();
+
+    return con.open_stream(std::move(headers), !has_body).then([this, &req, &handle, as, expected, has_body] (lw_shared_ptr<http2::stream> s) {
+        auto sub = as ? as->subscribe([s] () noexcept { (void)s->reset(http2::error_code::cancel); }) : std::nullopt;
+        auto body = make_ready_future<>();
+        if (has_body && req.body_writer) {
+            body = req.body_writer(s->make_output_stream());
+        } else if (has_body) {
+            body = s->send(temporary_buffer<char>(req.content.data(), req.content.size()), true);
+        }
+        return body.handle_exception([s] (std::exception_ptr ex) {
+            // The server may reply early and reset the rest of the upload
+            if (s->headers_received()) {
+                return make_ready_future<>();
+            }
+            return make_exception_future<>(std::move(ex));
+        }).then([s] {
+            return s->wait_headers();
+        }).then([this, s, &req, &handle, expected] {
+            auto reply = std::make_unique<http::reply>();
+            reply->_version = "2.0";
+            for (const auto& [name, value] : s->headers()) {
+                if (name == ":status") {
+                    reply->_status = static_cast<reply::status_type>(strtol(value.c_str(), nullptr, 10));
+                } else if (!name.empty() && name[0] != ':') {
+                    reply->_headers[name] = value;
+                }
+            }
+            reply->content_length = strtol(reply->get_header("Content-Length").c_str(), nullptr, 10);
+            auto& rep = *reply;
+
+            if (expected.has_value() && rep._status != expected.value()) {
+                if (!http_log.is_enabled(log_level::debug)) {
+                    return make_exception_future<>(httpd::unexpected_status_error(rep._status));
+                }
+
+                return do_with(s->make_input_stream(), [reply = std::move(reply)] (auto& in) mutable {
+                    return util::read_entire_stream_contiguous(in).then([reply = std::move(reply)] (auto message) {
+                        http_log.debug("request finished with {}: {}", reply->_status, message);
+                        return make_exception_future<>(httpd::unexpected_status_error(reply->_status));
+                    });
+                });
+            }
+
+            auto in = req._method != "HEAD" ? s->make_input_stream([&rep] (const http2::header_list& trailers) {
+                for (const auto& [name, value] : trailers) {
+                    rep.trailing_headers[name] = value;
+                }
+            }) : input_stream<char>(data_source(std::make_unique<skip_body_source>(rep)));
+            return handle(rep, std::move(in)).finally([reply = std::move(reply)] {});
+        }).finally([this, s, sub = std::move(sub)] {
+            // Whatever the handler didn't read is cancelled, not drained
+            _wait_con.broadcast();
+            if (!s->local_closed() || !s->remote_closed()) {
+                return s->reset(http2::error_code::cancel);
+            }
+            return make_ready_future<>();
+        });
+    });
+}
+
+future<> client::close_h2_connections() {
+    return parallel_for_each(std::exchange(_h2_connections, {}), [] (h2_connection_ptr con) {
+        return con->close().finally([con] {});
+    });
+}
+
+future<> client::close_pool() {
     if (_pool.empty()) {
         return make_ready_future<>();
     }
@@ -438,7 +938,16 @@ future<> client::close() {
     _pool.pop_front();
     http_log.trace("closing connection {}", con->_fd.local_address());
     return con->close().then([this, con] {
-        return close();
+        return close_pool();
+    });
+}
+
+future<> client::close() {
+    _idle_timer.cancel();
+    return close_pool().then([this] {
+        return close_h2_connections();
+    }).then([this] {
+        return _bg.close();
     });
 }
 
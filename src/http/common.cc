@@ -31,6 +31,7 @@ module;
 module seastar;
 #else
 #include <seastar/http/common.hh>
+#include <seastar/core/file.hh>
 #include <seastar/core/iostream-impl.hh>
 #endif
 
@@ -136,6 +137,16 @@ class http_chunked_data_sink_impl : public data_sink_impl {
             return _out.write("\r\n", 2);
         });
     }
+    virtual future<> put_file(file& f, uint64_t pos, uint64_t len) override {
+        if (len == 0) {
+            return make_ready_future<>();
+        }
+        return write_size(len).then([this, &f, pos, len] {
+            return _out.write_file(f, pos, len);
+        }).then([this] {
+            return _out.write("\r\n", 2);
+        });
+    }
     virtual future<> close() override {
         return  make_ready_future<>();
     }
@@ -195,6 +206,17 @@ class http_content_length_data_sink_impl : public data_sink_impl {
             _bytes_written += size;
         });
     }
+    virtual future<> put_file(file& f, uint64_t pos, uint64_t len) override {
+        if (len == 0 || _bytes_written == _limit) {
+            return make_ready_future<>();
+        }
+        if (_bytes_written + len > _limit) {
+            return make_exception_future<>(std::runtime_error(format("body content length overflow: want {} limit {}", _bytes_written + len, _limit)));
+        }
+        return _out.write_file(f, pos, len).then([this, len] {
+            _bytes_written += len;
+        });
+    }
     virtual future<> close() override {
         return make_ready_future<>();
     }
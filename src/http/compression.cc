@@ -0,0 +1,338 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <zlib.h>
+#ifdef SEASTAR_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/http/compression.hh>
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/format.hh>
+#include <seastar/coroutine/maybe_yield.hh>
+#include <seastar/coroutine/switch_to.hh>
+#endif
+
+namespace seastar {
+
+namespace http {
+
+std::string_view to_string(content_encoding enc) noexcept {
+    switch (enc) {
+    case content_encoding::identity: return "identity";
+    case content_encoding::gzip: return "gzip";
+    case content_encoding::deflate: return "deflate";
+    case content_encoding::zstd: return "zstd";
+    }
+    return "identity";
+}
+
+static std::string_view trim(std::string_view s) noexcept {
+    auto b = s.find_first_not_of(" \t");
+    if (b == std::string_view::npos) {
+        return {};
+    }
+    return s.substr(b, s.find_last_not_of(" \t") - b + 1);
+}
+
+static bool iequals(std::string_view a, std::string_view b) noexcept {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [] (char x, char y) {
+        return ::tolower(x) == ::tolower(y);
+    });
+}
+
+content_encoding negotiate_content_encoding(std::string_view accept_encoding,
+        const std::vector<content_encoding>& supported) {
+    static constexpr size_t nr_encodings = size_t(content_encoding::zstd) + 1;
+    std::array<std::optional<double>, nr_encodings> qvalues;
+    std::optional<double> any;
+
+    while (!accept_encoding.empty()) {
+        auto comma = accept_encoding.find(',');
+        auto element = accept_encoding.substr(0, comma);
+        accept_encoding.remove_prefix(comma == std::string_view::npos ? accept_encoding.size() : comma + 1);
+
+        auto semicolon = element.find(';');
+        auto coding = trim(element.substr(0, semicolon));
+        double q = 1;
+        while (semicolon != std::string_view::npos) {
+            element.remove_prefix(semicolon + 1);
+            semicolon = element.find(';');
+            auto param = trim(element.substr(0, semicolon));
+            if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                if (std::from_chars(param.data() + 2, param.data() + param.size(), q).ec != std::errc()) {
+                    q = 0;
+                }
+            }
+        }
+
+        if (coding == "*") {
+            any = q;
+        } else if (iequals(coding, "gzip") || iequals(coding, "x-gzip")) {
+            qvalues[size_t(content_encoding::gzip)] = q;
+        } else if (iequals(coding, "deflate")) {
+            qvalues[size_t(content_encoding::deflate)] = q;
+        } else if (iequals(coding, "zstd")) {
+            qvalues[size_t(content_encoding::zstd)] = q;
+        }
+    }
+
+    auto best = content_encoding::identity;
+    double best_q = 0;
+    for (auto enc : supported) {
+        if (enc == content_encoding::identity) {
+            continue;
+        }
+        // Codings the client doesn't list are only acceptable through "*"
+        auto q = qvalues[size_t(enc)].value_or(any.value_or(0));
+        if (q > best_q) {
+            best = enc;
+            best_q = q;
+        }
+    }
+    return best;
+}
+
+bool is_compressible(std::string_view content_type) noexcept {
+    auto type = trim(content_type.substr(0, content_type.find(';')));
+    if (type.starts_with("text/") || type.ends_with("+json") || type.ends_with("+xml")) {
+        return true;
+    }
+    for (auto t : {"application/json", "application/javascript", "application/x-javascript",
+                   "application/xml", "application/wasm", "image/svg+xml", "image/x-icon"}) {
+        if (iequals(type, t)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+namespace internal {
+
+// Incremental compressor of one body. Each call consumes all the input and
+// appends the output produced so far to \c out.
+class body_compressor {
+public:
+    enum class mode { none, flush, finish };
+    virtual ~body_compressor() = default;
+    virtual void compress(const char* in, size_t len, mode m, std::vector<temporary_buffer<char>>& out) = 0;
+};
+
+class zlib_compressor final : public body_compressor {
+    z_stream _zs = {};
+public:
+    zlib_compressor(content_encoding enc, int level) {
+        // Window bits past 15 select the gzip wrapper, the "deflate" coding
+        // is the zlib format (RFC 9110 Section 8.4.1.2)
+        auto window_bits = enc == content_encoding::gzip ? 15 + 16 : 15;
+        if (deflateInit2(&_zs, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::bad_alloc();
+        }
+    }
+    ~zlib_compressor() {
+        deflateEnd(&_zs);
+    }
+    virtual void compress(const char* in, size_t len, mode m, std::vector<temporary_buffer<char>>& out) override {
+        auto flush = m == mode::finish ? Z_FINISH : m == mode::flush ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+        _zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+        _zs.avail_in = len;
+        auto chunk = std::clamp<size_t>(deflateBound(&_zs, len), 4096, 64 * 1024);
+        for (;;) {
+            temporary_buffer<char> buf(chunk);
+            _zs.next_out = reinterpret_cast<Bytef*>(buf.get_write());
+            _zs.avail_out = chunk;
+            auto r = deflate(&_zs, flush);
+            if (r == Z_STREAM_ERROR) {
+                throw std::runtime_error("deflate failed");
+            }
+            if (auto produced = chunk - _zs.avail_out) {
+                buf.trim(produced);
+                out.push_back(std::move(buf));
+            }
+            // Z_BUF_ERROR means there was nothing left to do
+            if (r == Z_BUF_ERROR || r == Z_STREAM_END || (_zs.avail_out != 0 && m != mode::finish)) {
+                break;
+            }
+        }
+    }
+};
+
+#ifdef SEASTAR_HAVE_ZSTD
+class zstd_body_compressor final : public body_compressor {
+    std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> _cctx;
+public:
+    explicit zstd_body_compressor(int level) : _cctx(ZSTD_createCCtx(), &ZSTD_freeCCtx) {
+        if (!_cctx) {
+            throw std::bad_alloc();
+        }
+        ZSTD_CCtx_setParameter(_cctx.get(), ZSTD_c_compressionLevel, level);
+    }
+    virtual void compress(const char* in, size_t len, mode m, std::vector<temporary_buffer<char>>& out) override {
+        auto directive = m == mode::finish ? ZSTD_e_end : m == mode::flush ? ZSTD_e_flush : ZSTD_e_continue;
+        ZSTD_inBuffer ib{in, len, 0};
+        auto chunk = ZSTD_CStreamOutSize();
+        for (;;) {
+            temporary_buffer<char> buf(chunk);
+            ZSTD_outBuffer ob{buf.get_write(), chunk, 0};
+            auto r = ZSTD_compressStream2(_cctx.get(), &ob, &ib, directive);
+            if (ZSTD_isError(r)) {
+                throw std::runtime_error(format("zstd compression failed: {}", ZSTD_getErrorName(r)));
+            }
+            if (ob.pos) {
+                buf.trim(ob.pos);
+                out.push_back(std::move(buf));
+            }
+            // For flush and end the return value is what remains to be written out
+            if (m == mode::none ? ib.pos == ib.size : r == 0) {
+                break;
+            }
+        }
+    }
+};
+#endif
+
+static std::unique_ptr<body_compressor> make_body_compressor(content_encoding enc, const compression_config& cfg) {
+    switch (enc) {
+    case content_encoding::gzip:
+    case content_encoding::deflate:
+        return std::make_unique<zlib_compressor>(enc, cfg.zlib_level);
+    case content_encoding::zstd:
+#ifdef SEASTAR_HAVE_ZSTD
+        return std::make_unique<zstd_body_compressor>(cfg.zstd_level);
+#else
+        break;
+#endif
+    case content_encoding::identity:
+        break;
+    }
+    throw std::invalid_argument(format("unsupported content encoding {}", to_string(enc)));
+}
+
+// Input is fed to the compressor in slices of that size, so that a large
+// write doesn't hog the reactor
+static constexpr size_t compress_slice = 64 * 1024;
+
+class compressing_data_sink_impl final : public data_sink_impl {
+    output_stream<char> _out;
+    std::unique_ptr<body_compressor> _compressor;
+    scheduling_group _sg;
+    std::vector<temporary_buffer<char>> _pending;
+
+    future<> compress(temporary_buffer<char> buf, body_compressor::mode m) {
+        co_await coroutine::switch_to(_sg);
+        size_t pos = 0;
+        do {
+            auto len = std::min(buf.size() - pos, compress_slice);
+            auto last = pos + len == buf.size();
+            _compressor->compress(buf.get() + pos, len, last ? m : body_compressor::mode::none, _pending);
+            pos += len;
+            for (auto& b : _pending) {
+                co_await _out.write(b.get(), b.size());
+            }
+            _pending.clear();
+            if (!last) {
+                co_await coroutine::maybe_yield();
+            }
+        } while (pos != buf.size());
+    }
+public:
+    compressing_data_sink_impl(output_stream<char> out, std::unique_ptr<body_compressor> compressor, scheduling_group sg)
+            : _out(std::move(out)), _compressor(std::move(compressor)), _sg(sg) {
+    }
+    virtual future<> put(net::packet data) override {
+        return data_sink_impl::fallback_put(std::move(data));
+    }
+    using data_sink_impl::put;
+    virtual future<> put(temporary_buffer<char> buf) override {
+        if (buf.empty()) {
+            return make_ready_future<>();
+        }
+        return compress(std::move(buf), body_compressor::mode::none);
+    }
+    virtual future<> flush() override {
+        return compress({}, body_compressor::mode::flush).then([this] {
+            return _out.flush();
+        });
+    }
+    virtual future<> close() override {
+        return compress({}, body_compressor::mode::finish).finally([this] {
+            return _out.close();
+        });
+    }
+    virtual size_t buffer_size() const noexcept override {
+        return compress_slice;
+    }
+};
+
+} // namespace internal
+
+output_stream<char> make_compressed_output_stream(output_stream<char> out, content_encoding enc,
+        const compression_config& cfg) {
+    output_stream_options opts;
+    opts.trim_to_size = true;
+    return output_stream<char>(data_sink(std::make_unique<internal::compressing_data_sink_impl>(
+            std::move(out), internal::make_body_compressor(enc, cfg), cfg.sched_group)), internal::compress_slice, opts);
+}
+
+future<sstring> compress(sstring content, content_encoding enc, const compression_config& cfg) {
+    auto compressor = internal::make_body_compressor(enc, cfg);
+    co_await coroutine::switch_to(cfg.sched_group);
+    std::vector<temporary_buffer<char>> bufs;
+    size_t pos = 0;
+    do {
+        auto len = std::min(content.size() - pos, internal::compress_slice);
+        auto last = pos + len == content.size();
+        compressor->compress(content.data() + pos, len,
+                last ? internal::body_compressor::mode::finish : internal::body_compressor::mode::none, bufs);
+        pos += len;
+        if (!last) {
+            co_await coroutine::maybe_yield();
+        }
+    } while (pos != content.size());
+
+    size_t size = 0;
+    for (auto& b : bufs) {
+        size += b.size();
+    }
+    sstring ret = uninitialized_string(size);
+    auto p = ret.data();
+    for (auto& b : bufs) {
+        p = std::copy_n(b.get(), b.size(), p);
+    }
+    co_return ret;
+}
+
+} // namespace http
+
+} // namespace seastar
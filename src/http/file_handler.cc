@@ -26,6 +26,9 @@ module;
 #include <algorithm>
 #include <iostream>
 #include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #ifdef SEASTAR_MODULE
 module seastar;
@@ -36,7 +39,9 @@ module seastar;
 #include <seastar/core/fstream.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/app-template.hh>
+#include <seastar/http/compression.hh>
 #include <seastar/http/exception.hh>
+#include <seastar/core/coroutine.hh>
 #endif
 
 namespace seastar {
@@ -93,25 +98,67 @@ output_stream<char> file_interaction_handler::get_stream(std::unique_ptr<http::r
     return std::move(s);
 }
 
+// Finds the precompressed sibling of the file to send, and its coding, if
+// there is one the client accepts
+static future<std::pair<sstring, http::content_encoding>> find_precompressed(sstring file_name, sstring accept_encoding) {
+    static constexpr std::pair<http::content_encoding, std::string_view> siblings[] = {
+        {http::content_encoding::zstd, ".zst"},
+        {http::content_encoding::gzip, ".gz"},
+    };
+    std::vector<http::content_encoding> available;
+    for (auto [enc, suffix] : siblings) {
+        if (co_await file_exists(file_name + sstring(suffix))) {
+            available.push_back(enc);
+        }
+    }
+    auto enc = http::negotiate_content_encoding(accept_encoding, available);
+    for (auto [e, suffix] : siblings) {
+        if (e == enc) {
+            co_return std::make_pair(file_name + sstring(suffix), enc);
+        }
+    }
+    co_return std::make_pair(std::move(file_name), http::content_encoding::identity);
+}
+
 future<std::unique_ptr<http::reply>> file_interaction_handler::read(
         sstring file_name, std::unique_ptr<http::request> req,
         std::unique_ptr<http::reply> rep) {
     sstring extension = get_extension(file_name);
+    if (!precompressed || transformer) {
+        return make_ready_future<std::unique_ptr<http::reply>>(write_file(std::move(file_name), std::move(extension), std::move(req), std::move(rep)));
+    }
+    auto accept_encoding = req->get_header("Accept-Encoding");
+    return find_precompressed(std::move(file_name), std::move(accept_encoding)).then(
+            [this, extension = std::move(extension), req = std::move(req), rep = std::move(rep)] (std::pair<sstring, http::content_encoding> found) mutable {
+        auto& [path, enc] = found;
+        // Which file is sent depends on the Accept-Encoding header
+        rep->add_header("Vary", "Accept-Encoding");
+        if (enc != http::content_encoding::identity) {
+            rep->add_header("Content-Encoding", sstring(http::to_string(enc)));
+        }
+        return write_file(std::move(path), std::move(extension), std::move(req), std::move(rep));
+    });
+}
+
+std::unique_ptr<http::reply> file_interaction_handler::write_file(sstring file_name, sstring extension,
+        std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
     rep->write_body(extension, [req = std::move(req), extension, file_name, this] (output_stream<char>&& s) mutable {
         return do_with(get_stream(std::move(req), extension, std::move(s)),
                 [file_name] (output_stream<char>& os) {
             return open_file_dma(file_name, open_flags::ro).then([&os] (file f) {
-                return do_with(make_file_input_stream(std::move(f)), [&os](input_stream<char>& is) {
-                    return copy(is, os).finally([&os] {
+                return do_with(std::move(f), [&os] (file& f) {
+                    return f.size().then([&os, &f] (uint64_t size) {
+                        return os.write_file(f, 0, size);
+                    }).finally([&os] {
                         return os.close();
-                    }).finally([&is] {
-                        return is.close();
+                    }).finally([&f] {
+                        return f.close();
                     });
                 });
             });
         });
     });
-    return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+    return rep;
 }
 
 bool file_interaction_handler::redirect_if_needed(const http::request& req,
@@ -0,0 +1,1374 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2026 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/format.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/http/internal/http2.hh>
+#include <seastar/net/packet.hh>
+#include <seastar/util/log.hh>
+#endif
+
+namespace seastar {
+
+static logger h2log("http2");
+
+namespace http::internal::http2 {
+
+// Upper bound on a header block reassembled from CONTINUATION frames
+static constexpr size_t max_header_block_size = 256 * 1024;
+
+static uint32_t read_be32(const char* p) noexcept {
+    auto u = reinterpret_cast<const uint8_t*>(p);
+    return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) | (uint32_t(u[2]) << 8) | uint32_t(u[3]);
+}
+
+static uint16_t read_be16(const char* p) noexcept {
+    auto u = reinterpret_cast<const uint8_t*>(p);
+    return (uint16_t(u[0]) << 8) | uint16_t(u[1]);
+}
+
+static void write_be32(char* p, uint32_t v) noexcept {
+    p[0] = char(v >> 24);
+    p[1] = char(v >> 16);
+    p[2] = char(v >> 8);
+    p[3] = char(v);
+}
+
+static void write_be16(char* p, uint16_t v) noexcept {
+    p[0] = char(v >> 8);
+    p[1] = char(v);
+}
+
+frame_header frame_header::decode(const char* p) noexcept {
+    auto u = reinterpret_cast<const uint8_t*>(p);
+    frame_header fh;
+    fh.length = (uint32_t(u[0]) << 16) | (uint32_t(u[1]) << 8) | uint32_t(u[2]);
+    fh.type = frame_type(u[3]);
+    fh.flags = u[4];
+    fh.stream_id = read_be32(p + 5) & 0x7fffffff;
+    return fh;
+}
+
+void frame_header::encode(char* p) const noexcept {
+    p[0] = char(length >> 16);
+    p[1] = char(length >> 8);
+    p[2] = char(length);
+    p[3] = char(type);
+    p[4] = char(flags);
+    write_be32(p + 5, stream_id & 0x7fffffff);
+}
+
+sstring header_name(std::string_view name) {
+    sstring lname(name.data(), name.size());
+    std::transform(lname.begin(), lname.end(), lname.begin(), [] (unsigned char c) { return std::tolower(c); });
+    return lname;
+}
+
+bool is_connection_specific_header(std::string_view name) noexcept {
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+        || name == "transfer-encoding" || name == "upgrade";
+}
+
+// RFC 7541 Appendix B
+struct huffman_code {
+    uint32_t code;
+    uint8_t bits;
+};
+
+static constexpr huffman_code huffman_table[256] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+};
+
+static constexpr huffman_code huffman_eos = {0x3fffffff, 30};
+
+// Binary decoding tree, built once from huffman_table. Inner nodes are
+// indices into nodes, leaves are stored as -(symbol + 1).
+class huffman_decoding_tree {
+    std::vector<std::array<int16_t, 2>> _nodes;
+public:
+    huffman_decoding_tree() {
+        _nodes.push_back({0, 0});
+        for (unsigned sym = 0; sym < 256; sym++) {
+            insert(huffman_table[sym], sym);
+        }
+        insert(huffman_eos, 256);
+    }
+
+    int16_t next(int16_t node, unsigned bit) const noexcept {
+        return _nodes[node][bit];
+    }
+private:
+    void insert(huffman_code hc, unsigned sym) {
+        int16_t node = 0;
+        for (int i = hc.bits - 1; i > 0; i--) {
+            unsigned bit = (hc.code >> i) & 1;
+            if (_nodes[node][bit] == 0) {
+                _nodes.push_back({0, 0});
+                _nodes[node][bit] = _nodes.size() - 1;
+            }
+            node = _nodes[node][bit];
+        }
+        _nodes[node][hc.code & 1] = -int16_t(sym + 1);
+    }
+};
+
+size_t huffman_encoded_size(std::string_view in) noexcept {
+    size_t bits = 0;
+    for (unsigned char c : in) {
+        bits += huffman_table[c].bits;
+    }
+    return (bits + 7) / 8;
+}
+
+void huffman_encode(std::string_view in, std::string& out) {
+    uint64_t acc = 0;
+    unsigned nbits = 0;
+    for (unsigned char c : in) {
+        const auto& hc = huffman_table[c];
+        acc = (acc << hc.bits) | hc.code;
+        nbits += hc.bits;
+        while (nbits >= 8) {
+            nbits -= 8;
+            out.push_back(char(acc >> nbits));
+        }
+        acc &= (uint64_t(1) << nbits) - 1;
+    }
+    if (nbits != 0) {
+        // Padded with the most significant bits of EOS
+        out.push_back(char((acc << (8 - nbits)) | (0xff >> nbits)));
+    }
+}
+
+sstring huffman_decode(std::string_view in) {
+    static const huffman_decoding_tree tree;
+    std::string out;
+    out.reserve(in.size() * 8 / 5);
+    int16_t node = 0;
+    unsigned depth = 0;
+    bool all_ones = true;
+    for (unsigned char c : in) {
+        for (int i = 7; i >= 0; i--) {
+            unsigned bit = (c >> i) & 1;
+            auto next = tree.next(node, bit);
+            depth++;
+            all_ones &= bit;
+            if (next < 0) {
+                unsigned sym = -next - 1;
+                if (sym == 256) {
+                    throw connection_error(error_code::compression_error, "EOS in huffman-encoded string");
+                }
+                out.push_back(char(sym));
+                node = 0;
+                depth = 0;
+                all_ones = true;
+            } else {
+                node = next;
+            }
+        }
+    }
+    if (depth > 7 || !all_ones) {
+        throw connection_error(error_code::compression_error, "invalid huffman padding");
+    }
+    return sstring(out.data(), out.size());
+}
+
+// RFC 7541 Appendix A
+struct static_entry {
+    std::string_view name;
+    std::string_view value;
+};
+
+static constexpr static_entry static_table[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+static constexpr size_t static_table_size = std::size(static_table);
+
+void hpack_table::add(sstring name, sstring value) {
+    size_t size = name.size() + value.size() + entry_overhead;
+    if (size > _max_size) {
+        // RFC 7541 Section 4.4, an entry larger than the table empties it
+        _entries.clear();
+        _size = 0;
+        return;
+    }
+    evict(size);
+    _entries.emplace_front(std::move(name), std::move(value));
+    _size += size;
+}
+
+void hpack_table::set_max_size(size_t size) {
+    _max_size = size;
+    evict(0);
+}
+
+void hpack_table::evict(size_t room) {
+    while (!_entries.empty() && _size + room > _max_size) {
+        const auto& e = _entries.back();
+        _size -= e.first.size() + e.second.size() + entry_overhead;
+        _entries.pop_back();
+    }
+}
+
+static uint64_t decode_int(std::string_view& in, unsigned prefix_bits) {
+    if (in.empty()) {
+        throw connection_error(error_code::compression_error, "truncated integer");
+    }
+    const uint64_t mask = (1u << prefix_bits) - 1;
+    uint64_t v = uint8_t(in[0]) & mask;
+    in.remove_prefix(1);
+    if (v < mask) {
+        return v;
+    }
+    for (unsigned shift = 0; ; shift += 7) {
+        if (in.empty() || shift > 56) {
+            throw connection_error(error_code::compression_error, "malformed integer");
+        }
+        uint8_t b = in[0];
+        in.remove_prefix(1);
+        v += uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return v;
+        }
+    }
+}
+
+static void encode_int(std::string& out, uint8_t first, unsigned prefix_bits, uint64_t v) {
+    const uint64_t mask = (1u << prefix_bits) - 1;
+    if (v < mask) {
+        out.push_back(char(first | v));
+        return;
+    }
+    out.push_back(char(first | mask));
+    v -= mask;
+    while (v >= 0x80) {
+        out.push_back(char((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(char(v));
+}
+
+static sstring decode_string(std::string_view& in) {
+    if (in.empty()) {
+        throw connection_error(error_code::compression_error, "truncated string");
+    }
+    bool huffman = uint8_t(in[0]) & 0x80;
+    auto len = decode_int(in, 7);
+    if (len > in.size()) {
+        throw connection_error(error_code::compression_error, "truncated string");
+    }
+    auto str = in.substr(0, len);
+    in.remove_prefix(len);
+    return huffman ? huffman_decode(str) : sstring(str.data(), str.size());
+}
+
+static void encode_string(std::string& out, std::string_view str) {
+    auto hlen = huffman_encoded_size(str);
+    if (hlen < str.size()) {
+        encode_int(out, 0x80, 7, hlen);
+        huffman_encode(str, out);
+    } else {
+        encode_int(out, 0x00, 7, str.size());
+        out.append(str);
+    }
+}
+
+std::pair<std::string_view, std::string_view> hpack_decoder::lookup(uint64_t idx) const {
+    if (idx == 0) {
+        throw connection_error(error_code::compression_error, "zero header index");
+    }
+    if (idx <= static_table_size) {
+        const auto& e = static_table[idx - 1];
+        return {e.name, e.value};
+    }
+    idx -= static_table_size + 1;
+    if (idx >= _table.entries()) {
+        throw connection_error(error_code::compression_error, "header index out of range");
+    }
+    const auto& e = _table[idx];
+    return {e.first, e.second};
+}
+
+header_list hpack_decoder::decode(std::string_view in) {
+    header_list headers;
+    while (!in.empty()) {
+        uint8_t b = in[0];
+        if (b & 0x80) {
+            // Indexed header field
+            auto [name, value] = lookup(decode_int(in, 7));
+            headers.emplace_back(sstring(name), sstring(value));
+        } else if (b & 0x40) {
+            // Literal with incremental indexing
+            auto idx = decode_int(in, 6);
+            sstring name = idx ? sstring(lookup(idx).first) : decode_string(in);
+            sstring value = decode_string(in);
+            _table.add(name, value);
+            headers.emplace_back(std::move(name), std::move(value));
+        } else if (b & 0x20) {
+            // Dynamic table size update, only allowed at the start of a block
+            if (!headers.empty()) {
+                throw connection_error(error_code::compression_error, "table size update after header field");
+            }
+            auto size = decode_int(in, 5);
+            if (size > _max_table_size) {
+                throw connection_error(error_code::compression_error, "table size update above the limit");
+            }
+            _table.set_max_size(size);
+        } else {
+            // Literal without indexing or never indexed
+            auto idx = decode_int(in, 4);
+            sstring name = idx ? sstring(lookup(idx).first) : decode_string(in);
+            sstring value = decode_string(in);
+            headers.emplace_back(std::move(name), std::move(value));
+        }
+    }
+    return headers;
+}
+
+void hpack_encoder::set_max_table_size(size_t size) {
+    size = std::min(size, max_table_size);
+    if (size != _table.max_size()) {
+        _table.set_max_size(size);
+        _pending_size_update = size;
+    }
+}
+
+void hpack_encoder::encode(const header_list& headers, std::string& out) {
+    if (_pending_size_update) {
+        encode_int(out, 0x20, 5, *_pending_size_update);
+        _pending_size_update.reset();
+    }
+    for (const auto& [name, value] : headers) {
+        encode_header(name, value, out);
+    }
+}
+
+void hpack_encoder::encode_header(std::string_view name, std::string_view value, std::string& out) {
+    size_t name_idx = 0;
+    for (size_t i = 0; i < static_table_size; i++) {
+        if (static_table[i].name == name) {
+            if (static_table[i].value == value) {
+                encode_int(out, 0x80, 7, i + 1);
+                return;
+            }
+            if (!name_idx) {
+                name_idx = i + 1;
+            }
+        }
+    }
+    for (size_t i = 0; i < _table.entries(); i++) {
+        const auto& e = _table[i];
+        if (e.first == name) {
+            if (e.second == value) {
+                encode_int(out, 0x80, 7, static_table_size + 1 + i);
+                return;
+            }
+            if (!name_idx) {
+                name_idx = static_table_size + 1 + i;
+            }
+        }
+    }
+
+    if (name == "authorization" || name == "proxy-authorization") {
+        // Never indexed, so that intermediaries don't compress credentials either
+        encode_int(out, 0x10, 4, name_idx);
+    } else if (name.size() + value.size() + hpack_table::entry_overhead > _table.max_size() / 2) {
+        // Large entries would flush the table for little gain
+        encode_int(out, 0x00, 4, name_idx);
+    } else {
+        encode_int(out, 0x40, 6, name_idx);
+        _table.add(sstring(name), sstring(value));
+    }
+    if (!name_idx) {
+        encode_string(out, name);
+    }
+    encode_string(out, value);
+}
+
+static std::exception_ptr connection_aborted() {
+    return std::make_exception_ptr(std::system_error(ECONNABORTED, std::system_category()));
+}
+
+static temporary_buffer<char> strip_padding(const frame_header& fh, temporary_buffer<char> payload) {
+    if (fh.flags & frame_flags::padded) {
+        if (payload.empty()) {
+            throw connection_error(error_code::frame_size_error, "padded frame without pad length");
+        }
+        size_t pad = uint8_t(payload[0]);
+        payload.trim_front(1);
+        if (pad > payload.size()) {
+            throw connection_error(error_code::protocol_error, "padding exceeds frame payload");
+        }
+        payload.trim(payload.size() - pad);
+    }
+    return payload;
+}
+
+future<> stream::wait_headers() {
+    if (_headers_received) {
+        return make_ready_future<>();
+    }
+    if (_ex) {
+        return make_exception_future<>(_ex);
+    }
+    if (_remote_closed) {
+        return make_exception_future<>(stream_reset(error_code::protocol_error, "stream ended without headers"));
+    }
+    _waiter.emplace();
+    return _waiter->get_future().then([this] {
+        return wait_headers();
+    });
+}
+
+future<temporary_buffer<char>> stream::read() {
+    if (_ex) {
+        return make_exception_future<temporary_buffer<char>>(_ex);
+    }
+    if (!_data.empty()) {
+        auto buf = std::move(_data.front());
+        _data.pop_front();
+        _session.consumed(*this, buf.size());
+        return make_ready_future<temporary_buffer<char>>(std::move(buf));
+    }
+    if (_remote_closed) {
+        return make_ready_future<temporary_buffer<char>>();
+    }
+    _waiter.emplace();
+    return _waiter->get_future().then([this] {
+        return read();
+    });
+}
+
+future<> stream::send(temporary_buffer<char> buf, bool end_stream) {
+    return _session.send_data(*this, std::move(buf), end_stream);
+}
+
+future<> stream::send_headers(header_list headers, bool end_stream) {
+    return _session.send_headers(*this, std::move(headers), end_stream);
+}
+
+future<> stream::reset(error_code code) {
+    return _session.reset_stream(*this, code);
+}
+
+void stream::wake() noexcept {
+    if (_waiter) {
+        auto p = std::move(*_waiter);
+        _waiter.reset();
+        p.set_value();
+    }
+}
+
+void stream::fail(std::exception_ptr ex) noexcept {
+    if (!_ex) {
+        _ex = std::move(ex);
+    }
+    wake();
+}
+
+class stream_source_impl : public data_source_impl {
+    lw_shared_ptr<stream> _s;
+    noncopyable_function<void(const header_list&)> _on_trailers;
+    bool _eof = false;
+public:
+    stream_source_impl(lw_shared_ptr<stream> s, noncopyable_function<void(const header_list&)> on_trailers)
+        : _s(std::move(s)), _on_trailers(std::move(on_trailers)) {
+    }
+
+    virtual future<temporary_buffer<char>> get() override {
+        return _s->read().then([this] (temporary_buffer<char> buf) {
+            if (buf.empty() && !std::exchange(_eof, true) && _on_trailers) {
+                _on_trailers(_s->trailers());
+            }
+            return buf;
+        });
+    }
+};
+
+class stream_sink_impl : public data_sink_impl {
+    lw_shared_ptr<stream> _s;
+public:
+    explicit stream_sink_impl(lw_shared_ptr<stream> s) : _s(std::move(s)) {}
+
+    virtual future<> put(net::packet p) override {
+        return do_with(p.release(), [this] (std::vector<temporary_buffer<char>>& bufs) {
+            return do_for_each(bufs, [this] (temporary_buffer<char>& buf) {
+                return _s->send(std::move(buf), false);
+            });
+        });
+    }
+
+    virtual future<> put(temporary_buffer<char> buf) override {
+        return _s->send(std::move(buf), false);
+    }
+
+    virtual future<> close() override {
+        if (_s->local_closed()) {
+            return make_ready_future<>();
+        }
+        return _s->send(temporary_buffer<char>(), true);
+    }
+
+    virtual size_t buffer_size() const noexcept override {
+        return default_max_frame_size;
+    }
+};
+
+input_stream<char> stream::make_input_stream(noncopyable_function<void(const header_list&)> on_trailers) {
+    return input_stream<char>(data_source(std::make_unique<stream_source_impl>(shared_from_this(), std::move(on_trailers))));
+}
+
+output_stream<char> stream::make_output_stream() {
+    return output_stream<char>(data_sink(std::make_unique<stream_sink_impl>(shared_from_this())));
+}
+
+session::session(input_stream<char> in, output_stream<char> out, role r, settings local, stream_handler on_stream)
+        : _in(std::move(in))
+        , _out(std::move(out))
+        , _role(r)
+        , _local(local)
+        , _decoder(local.header_table_size)
+        , _on_stream(std::move(on_stream))
+        , _next_stream_id(r == role::client ? 1 : 2)
+{
+}
+
+session::~session() = default;
+
+bool session::is_local(uint32_t stream_id) const noexcept {
+    return (stream_id % 2 == 1) == (_role == role::client);
+}
+
+bool session::is_idle(uint32_t stream_id) const noexcept {
+    return is_local(stream_id) ? stream_id >= _next_stream_id : stream_id > _last_peer_stream_id;
+}
+
+future<> session::run() {
+    return with_semaphore(_write_lock, 1, [this] {
+        std::vector<std::pair<setting_id, uint32_t>> params;
+        params.emplace_back(setting_id::header_table_size, _local.header_table_size);
+        if (_role == role::client) {
+            params.emplace_back(setting_id::enable_push, 0);
+        }
+        if (_local.max_concurrent_streams != std::numeric_limits<uint32_t>::max()) {
+            params.emplace_back(setting_id::max_concurrent_streams, _local.max_concurrent_streams);
+        }
+        params.emplace_back(setting_id::initial_window_size, _local.initial_window_size);
+        params.emplace_back(setting_id::max_frame_size, _local.max_frame_size);
+        if (_local.max_header_list_size != std::numeric_limits<uint32_t>::max()) {
+            params.emplace_back(setting_id::max_header_list_size, _local.max_header_list_size);
+        }
+        temporary_buffer<char> payload(params.size() * 6);
+        char* p = payload.get_write();
+        for (auto [id, value] : params) {
+            write_be16(p, uint16_t(id));
+            write_be32(p + 2, value);
+            p += 6;
+        }
+        temporary_buffer<char> update(4);
+        write_be32(update.get_write(), connection_window - default_window_size);
+        _recv_window = connection_window;
+
+        auto preface = _role == role::client ? _out.write(client_preface.data(), client_preface.size()) : make_ready_future<>();
+        return preface.then([this, payload = std::move(payload), update = std::move(update)] () mutable {
+            return write_frame_locked(frame_type::settings, 0, 0, std::move(payload)).then([this, update = std::move(update)] () mutable {
+                return write_frame_locked(frame_type::window_update, 0, 0, std::move(update));
+            });
+        }).then([this] {
+            return _out.flush();
+        });
+    }).then([this] {
+        if (_role == role::client) {
+            return make_ready_future<>();
+        }
+        return _in.read_exactly(client_preface.size()).then([] (temporary_buffer<char> buf) {
+            if (std::string_view(buf.get(), buf.size()) != client_preface) {
+                throw connection_error(error_code::protocol_error, "invalid connection preface");
+            }
+        });
+    }).then([this] {
+        return read_loop();
+    }).handle_exception_type([this] (const connection_error& e) {
+        h2log.debug("connection error: {}", e.what());
+        return shutdown(e.code());
+    }).handle_exception([] (std::exception_ptr ex) {
+        h2log.debug("connection failed: {}", ex);
+    }).finally([this] {
+        _closed = true;
+        fail_all(connection_aborted());
+        return _bg.close().then([this] {
+            return with_semaphore(_write_lock, 1, [this] {
+                return when_all(_in.close(), _out.close()).discard_result();
+            });
+        });
+    });
+}
+
+future<> session::read_loop() {
+    return repeat([this] {
+        return _in.read_exactly(frame_header_size).then([this] (temporary_buffer<char> hdr) {
+            if (hdr.size() < frame_header_size) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            auto fh = frame_header::decode(hdr.get());
+            if (fh.length > _local.max_frame_size) {
+                throw connection_error(error_code::frame_size_error, format("frame of {} bytes exceeds the limit", fh.length));
+            }
+            return _in.read_exactly(fh.length).then([this, fh] (temporary_buffer<char> payload) {
+                if (payload.size() < fh.length) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                return handle_frame(fh, std::move(payload)).then([] {
+                    return stop_iteration::no;
+                });
+            });
+        });
+    });
+}
+
+future<> session::handle_frame(frame_header fh, temporary_buffer<char> payload) {
+    if (_continuation_stream != 0 && fh.type != frame_type::continuation) {
+        throw connection_error(error_code::protocol_error, "header block interrupted");
+    }
+    switch (fh.type) {
+    case frame_type::data:
+        return handle_data(fh, std::move(payload));
+    case frame_type::headers:
+        return handle_headers(fh, std::move(payload));
+    case frame_type::priority:
+        if (fh.stream_id == 0) {
+            throw connection_error(error_code::protocol_error, "PRIORITY on stream 0");
+        }
+        return make_ready_future<>();
+    case frame_type::rst_stream:
+        handle_rst_stream(fh, payload);
+        return make_ready_future<>();
+    case frame_type::settings:
+        return handle_settings(fh, std::move(payload));
+    case frame_type::push_promise:
+        // Clients disable push, servers never receive it
+        throw connection_error(error_code::protocol_error, "unexpected PUSH_PROMISE");
+    case frame_type::ping:
+        if (fh.stream_id != 0) {
+            throw connection_error(error_code::protocol_error, "PING on a stream");
+        }
+        if (fh.length != 8) {
+            throw connection_error(error_code::frame_size_error, "PING must carry 8 bytes");
+        }
+        if (!(fh.flags & frame_flags::ack)) {
+            run_in_background([this, payload = std::move(payload)] () mutable {
+                return write_frame(frame_type::ping, frame_flags::ack, 0, std::move(payload));
+            });
+        }
+        return make_ready_future<>();
+    case frame_type::goaway:
+        handle_goaway(fh, payload);
+        return make_ready_future<>();
+    case frame_type::window_update:
+        handle_window_update(fh, payload);
+        return make_ready_future<>();
+    case frame_type::continuation:
+        if (_continuation_stream == 0 || fh.stream_id != _continuation_stream) {
+            throw connection_error(error_code::protocol_error, "unexpected CONTINUATION");
+        }
+        if (_header_block.size() + payload.size() > max_header_block_size) {
+            throw connection_error(error_code::enhance_your_calm, "header block too large");
+        }
+        _header_block.append(payload.get(), payload.size());
+        if (fh.flags & frame_flags::end_headers) {
+            return handle_header_block(std::exchange(_continuation_stream, 0), _continuation_flags);
+        }
+        return make_ready_future<>();
+    }
+    // Unknown frame types must be ignored
+    return make_ready_future<>();
+}
+
+future<> session::handle_data(frame_header fh, temporary_buffer<char> payload) {
+    if (fh.stream_id == 0) {
+        throw connection_error(error_code::protocol_error, "DATA on stream 0");
+    }
+    // Flow control covers the whole payload, padding included
+    _recv_window -= fh.length;
+    if (_recv_window < 0) {
+        throw connection_error(error_code::flow_control_error, "connection window exceeded");
+    }
+    payload = strip_padding(fh, std::move(payload));
+    size_t padding = fh.length - payload.size();
+
+    auto it = _streams.find(fh.stream_id);
+    if (it == _streams.end() || it->second->_remote_closed) {
+        if (is_idle(fh.stream_id)) {
+            throw connection_error(error_code::protocol_error, "DATA on idle stream");
+        }
+        // A stream we already reset or closed, the data is dropped
+        // but still returned to the connection window
+        consumed(fh.length);
+        return make_ready_future<>();
+    }
+
+    auto s = it->second;
+    s->_recv_window -= fh.length;
+    if (s->_recv_window < 0) {
+        consumed(fh.length);
+        return reset_stream(*s, error_code::flow_control_error);
+    }
+    consumed(*s, padding);
+    if (!payload.empty()) {
+        s->_data.push_back(std::move(payload));
+    }
+    if (fh.flags & frame_flags::end_stream) {
+        s->_remote_closed = true;
+        maybe_close_stream(*s);
+    }
+    s->wake();
+    return make_ready_future<>();
+}
+
+future<> session::handle_headers(frame_header fh, temporary_buffer<char> payload) {
+    if (fh.stream_id == 0) {
+        throw connection_error(error_code::protocol_error, "HEADERS on stream 0");
+    }
+    payload = strip_padding(fh, std::move(payload));
+    if (fh.flags & frame_flags::priority) {
+        if (payload.size() < 5) {
+            throw connection_error(error_code::frame_size_error, "truncated priority");
+        }
+        payload.trim_front(5);
+    }
+    _header_block.assign(payload.get(), payload.size());
+    if (!(fh.flags & frame_flags::end_headers)) {
+        _continuation_stream = fh.stream_id;
+        _continuation_flags = fh.flags;
+        return make_ready_future<>();
+    }
+    return handle_header_block(fh.stream_id, fh.flags);
+}
+
+static bool is_informational(const header_list& headers) {
+    for (const auto& [name, value] : headers) {
+        if (name == ":status") {
+            return value.size() == 3 && value[0] == '1';
+        }
+    }
+    return false;
+}
+
+future<> session::handle_header_block(uint32_t stream_id, uint8_t flags) {
+    // Always decode, the block updates the HPACK state even if the stream is gone
+    auto headers = _decoder.decode(std::exchange(_header_block, {}));
+    bool end_stream = flags & frame_flags::end_stream;
+
+    auto it = _streams.find(stream_id);
+    if (it != _streams.end()) {
+        auto s = it->second;
+        if (s->_remote_closed) {
+            return reset_stream(*s, error_code::stream_closed);
+        }
+        if (!s->_headers_received) {
+            if (_role == role::client && is_informational(headers)) {
+                // 1xx responses precede the final one and are not exposed
+                if (end_stream) {
+                    return reset_stream(*s, error_code::protocol_error);
+                }
+                return make_ready_future<>();
+            }
+            s->_headers = std::move(headers);
+            s->_headers_received = true;
+        } else if (!end_stream) {
+            return reset_stream(*s, error_code::protocol_error);
+        } else {
+            s->_trailers = std::move(headers);
+        }
+        if (end_stream) {
+            s->_remote_closed = true;
+            maybe_close_stream(*s);
+        }
+        s->wake();
+        return make_ready_future<>();
+    }
+
+    if (is_local(stream_id) || !is_idle(stream_id)) {
+        if (is_idle(stream_id)) {
+            throw connection_error(error_code::protocol_error, "HEADERS on idle stream");
+        }
+        // A stream that was already closed or reset
+        return make_ready_future<>();
+    }
+    if (_role == role::client) {
+        throw connection_error(error_code::protocol_error, "server opened a stream");
+    }
+
+    _last_peer_stream_id = stream_id;
+    if (_goaway_sent) {
+        return make_ready_future<>();
+    }
+    auto s = make_lw_shared<stream>(*this, stream_id, _remote.initial_window_size, _local.initial_window_size);
+    s->_headers = std::move(headers);
+    s->_headers_received = true;
+    s->_remote_closed = end_stream;
+    if (_streams.size() >= _local.max_concurrent_streams) {
+        return reset_stream(*s, error_code::refused_stream);
+    }
+    _streams.emplace(stream_id, s);
+    run_in_background([this, s] {
+        return _on_stream(s).handle_exception([this, s] (std::exception_ptr ex) {
+            h2log.debug("stream {} handler failed: {}", s->id(), ex);
+            return reset_stream(*s, error_code::internal_error);
+        });
+    });
+    return make_ready_future<>();
+}
+
+future<> session::handle_settings(frame_header fh, temporary_buffer<char> payload) {
+    if (fh.stream_id != 0) {
+        throw connection_error(error_code::protocol_error, "SETTINGS on a stream");
+    }
+    if (fh.flags & frame_flags::ack) {
+        if (fh.length != 0) {
+            throw connection_error(error_code::frame_size_error, "SETTINGS ack with payload");
+        }
+        return make_ready_future<>();
+    }
+    if (fh.length % 6 != 0) {
+        throw connection_error(error_code::frame_size_error, "malformed SETTINGS");
+    }
+    for (const char* p = payload.get(); p != payload.end(); p += 6) {
+        auto value = read_be32(p + 2);
+        switch (setting_id(read_be16(p))) {
+        case setting_id::header_table_size:
+            _remote.header_table_size = value;
+            _encoder.set_max_table_size(value);
+            break;
+        case setting_id::enable_push:
+            if (value > 1) {
+                throw connection_error(error_code::protocol_error, "invalid SETTINGS_ENABLE_PUSH");
+            }
+            _remote.enable_push = value;
+            break;
+        case setting_id::max_concurrent_streams:
+            _remote.max_concurrent_streams = value;
+            _slots_cv.broadcast();
+            break;
+        case setting_id::initial_window_size: {
+            if (value > max_window_size) {
+                throw connection_error(error_code::flow_control_error, "invalid SETTINGS_INITIAL_WINDOW_SIZE");
+            }
+            int64_t delta = int64_t(value) - _remote.initial_window_size;
+            for (auto& [id, s] : _streams) {
+                s->_send_window += delta;
+                if (s->_send_window > max_window_size) {
+                    throw connection_error(error_code::flow_control_error, "stream window overflow");
+                }
+            }
+            _remote.initial_window_size = value;
+            _window_cv.broadcast();
+            break;
+        }
+        case setting_id::max_frame_size:
+            if (value < default_max_frame_size || value > max_max_frame_size) {
+                throw connection_error(error_code::protocol_error, "invalid SETTINGS_MAX_FRAME_SIZE");
+            }
+            _remote.max_frame_size = value;
+            break;
+        case setting_id::max_header_list_size:
+            _remote.max_header_list_size = value;
+            break;
+        default:
+            // Unknown settings must be ignored
+            break;
+        }
+    }
+    run_in_background([this] {
+        return write_frame(frame_type::settings, frame_flags::ack, 0, temporary_buffer<char>());
+    });
+    return make_ready_future<>();
+}
+
+void session::handle_window_update(frame_header fh, const temporary_buffer<char>& payload) {
+    if (fh.length != 4) {
+        throw connection_error(error_code::frame_size_error, "malformed WINDOW_UPDATE");
+    }
+    uint32_t increment = read_be32(payload.get()) & 0x7fffffff;
+    if (fh.stream_id == 0) {
+        if (increment == 0) {
+            throw connection_error(error_code::protocol_error, "zero connection window increment");
+        }
+        _send_window += increment;
+        if (_send_window > max_window_size) {
+            throw connection_error(error_code::flow_control_error, "connection window overflow");
+        }
+    } else {
+        auto it = _streams.find(fh.stream_id);
+        if (it == _streams.end()) {
+            if (is_idle(fh.stream_id)) {
+                throw connection_error(error_code::protocol_error, "WINDOW_UPDATE on idle stream");
+            }
+            return;
+        }
+        auto s = it->second;
+        s->_send_window += increment;
+        if (increment == 0 || s->_send_window > max_window_size) {
+            (void)reset_stream(*s, increment == 0 ? error_code::protocol_error : error_code::flow_control_error);
+            return;
+        }
+    }
+    _window_cv.broadcast();
+}
+
+void session::handle_rst_stream(frame_header fh, const temporary_buffer<char>& payload) {
+    if (fh.stream_id == 0) {
+        throw connection_error(error_code::protocol_error, "RST_STREAM on stream 0");
+    }
+    if (fh.length != 4) {
+        throw connection_error(error_code::frame_size_error, "malformed RST_STREAM");
+    }
+    if (is_idle(fh.stream_id)) {
+        throw connection_error(error_code::protocol_error, "RST_STREAM on idle stream");
+    }
+    auto it = _streams.find(fh.stream_id);
+    if (it == _streams.end()) {
+        return;
+    }
+    auto s = it->second;
+    auto code = error_code(read_be32(payload.get()));
+    s->fail(std::make_exception_ptr(stream_reset(code, format("stream {} reset by peer with error {}", s->id(), uint32_t(code)))));
+    s->_local_closed = s->_remote_closed = true;
+    close_stream(*s);
+    _window_cv.broadcast();
+}
+
+void session::handle_goaway(frame_header fh, const temporary_buffer<char>& payload) {
+    if (fh.stream_id != 0) {
+        throw connection_error(error_code::protocol_error, "GOAWAY on a stream");
+    }
+    if (fh.length < 8) {
+        throw connection_error(error_code::frame_size_error, "malformed GOAWAY");
+    }
+    auto last_stream_id = read_be32(payload.get()) & 0x7fffffff;
+    auto code = read_be32(payload.get() + 4);
+    h2log.debug("peer sent GOAWAY, last stream {} error {}", last_stream_id, code);
+    _goaway = true;
+    // Streams the peer did not process can be safely retried elsewhere
+    std::vector<lw_shared_ptr<stream>> refused;
+    for (auto& [id, s] : _streams) {
+        if (is_local(id) && id > last_stream_id) {
+            refused.push_back(s);
+        }
+    }
+    for (auto& s : refused) {
+        s->fail(std::make_exception_ptr(stream_reset(error_code::refused_stream, "stream refused by GOAWAY")));
+        s->_local_closed = s->_remote_closed = true;
+        close_stream(*s);
+    }
+    _slots_cv.broadcast();
+    _window_cv.broadcast();
+}
+
+future<> session::write_frame_locked(frame_type type, uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload) {
+    temporary_buffer<char> hdr(frame_header_size);
+    frame_header{uint32_t(payload.size()), type, flags, stream_id}.encode(hdr.get_write());
+    return _out.write(std::move(hdr)).then([this, payload = std::move(payload)] () mutable {
+        if (payload.empty()) {
+            return make_ready_future<>();
+        }
+        return _out.write(std::move(payload));
+    });
+}
+
+future<> session::flush_locked() {
+    // Whoever writes next flushes for us, so back-to-back frames
+    // from several streams go out in one syscall
+    if (_write_lock.waiters() != 0) {
+        return make_ready_future<>();
+    }
+    return _out.flush();
+}
+
+future<> session::write_frame(frame_type type, uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload) {
+    return with_semaphore(_write_lock, 1, [this, type, flags, stream_id, payload = std::move(payload)] () mutable {
+        if (_closed) {
+            return make_exception_future<>(connection_aborted());
+        }
+        return write_frame_locked(type, flags, stream_id, std::move(payload)).then([this] {
+            return flush_locked();
+        });
+    });
+}
+
+future<> session::write_headers_locked(stream& s, const header_list& headers, bool end_stream) {
+    std::string block;
+    _encoder.encode(headers, block);
+    const size_t max = _remote.max_frame_size;
+    const size_t nframes = std::max<size_t>(1, (block.size() + max - 1) / max);
+    temporary_buffer<char> buf(block.size() + nframes * frame_header_size);
+    char* p = buf.get_write();
+    size_t off = 0;
+    for (size_t i = 0; i < nframes; i++) {
+        size_t len = std::min(max, block.size() - off);
+        uint8_t flags = 0;
+        if (i == 0 && end_stream) {
+            flags |= frame_flags::end_stream;
+        }
+        if (i == nframes - 1) {
+            flags |= frame_flags::end_headers;
+        }
+        frame_header{uint32_t(len), i == 0 ? frame_type::headers : frame_type::continuation, flags, s._id}.encode(p);
+        std::memcpy(p + frame_header_size, block.data() + off, len);
+        p += frame_header_size + len;
+        off += len;
+    }
+    return _out.write(std::move(buf));
+}
+
+future<lw_shared_ptr<stream>> session::open_stream(header_list headers, bool end_stream) {
+    return do_with(std::move(headers), [this, end_stream] (header_list& headers) {
+        return repeat_until_value([this, &headers, end_stream] {
+            return _slots_cv.wait([this] { return closed() || has_capacity(); }).then([this, &headers, end_stream] {
+                return with_semaphore(_write_lock, 1, [this, &headers, end_stream] {
+                    using result = std::optional<lw_shared_ptr<stream>>;
+                    if (closed() || _next_stream_id > max_window_size) {
+                        _goaway = true;
+                        return make_exception_future<result>(connection_aborted());
+                    }
+                    if (!has_capacity()) {
+                        // Another opener took the slot while we were waiting for the lock
+                        return make_ready_future<result>();
+                    }
+                    auto s = make_lw_shared<stream>(*this, _next_stream_id, _remote.initial_window_size, _local.initial_window_size);
+                    _next_stream_id += 2;
+                    _local_streams++;
+                    s->_local_closed = end_stream;
+                    _streams.emplace(s->_id, s);
+                    return write_headers_locked(*s, headers, end_stream).then([this] {
+                        return flush_locked();
+                    }).then([s] {
+                        return result(s);
+                    });
+                });
+            });
+        });
+    });
+}
+
+future<> session::send_headers(stream& s, header_list headers, bool end_stream) {
+    return with_semaphore(_write_lock, 1, [this, &s, headers = std::move(headers), end_stream] {
+        if (_closed) {
+            return make_exception_future<>(connection_aborted());
+        }
+        if (s._ex) {
+            return make_exception_future<>(s._ex);
+        }
+        if (end_stream) {
+            s._local_closed = true;
+            maybe_close_stream(s);
+        }
+        return write_headers_locked(s, headers, end_stream).then([this] {
+            return flush_locked();
+        });
+    });
+}
+
+future<> session::send_data(stream& s, temporary_buffer<char> buf, bool end_stream) {
+    if (buf.empty() && !end_stream) {
+        return make_ready_future<>();
+    }
+    return do_with(std::move(buf), [this, &s, end_stream] (temporary_buffer<char>& buf) {
+        return repeat([this, &s, &buf, end_stream] {
+            return _window_cv.wait([this, &s, &buf] {
+                return _closed || s._ex || buf.empty() || (_send_window > 0 && s._send_window > 0);
+            }).then([this, &s, &buf, end_stream] {
+                return with_semaphore(_write_lock, 1, [this, &s, &buf, end_stream] {
+                    if (_closed) {
+                        return make_exception_future<stop_iteration>(connection_aborted());
+                    }
+                    if (s._ex) {
+                        return make_exception_future<stop_iteration>(s._ex);
+                    }
+                    size_t len = std::min<int64_t>({int64_t(buf.size()), _send_window, s._send_window, int64_t(_remote.max_frame_size)});
+                    if (len == 0 && !buf.empty()) {
+                        // Other streams used up the window while we waited for the lock
+                        return make_ready_future<stop_iteration>(stop_iteration::no);
+                    }
+                    auto chunk = buf.share(0, len);
+                    buf.trim_front(len);
+                    _send_window -= len;
+                    s._send_window -= len;
+                    bool last = buf.empty() && end_stream;
+                    if (last) {
+                        s._local_closed = true;
+                        maybe_close_stream(s);
+                    }
+                    return write_frame_locked(frame_type::data, last ? frame_flags::end_stream : 0, s._id, std::move(chunk)).then([this, &buf] {
+                        return flush_locked().then([&buf] {
+                            return stop_iteration(buf.empty());
+                        });
+                    });
+                });
+            });
+        });
+    });
+}
+
+future<> session::send_window_update(uint32_t stream_id, uint32_t increment) {
+    temporary_buffer<char> payload(4);
+    write_be32(payload.get_write(), increment);
+    return write_frame(frame_type::window_update, 0, stream_id, std::move(payload));
+}
+
+future<> session::reset_stream(stream& s, error_code code) {
+    s.fail(std::make_exception_ptr(stream_reset(code, format("stream {} reset with error {}", s._id, uint32_t(code)))));
+    s._local_closed = s._remote_closed = true;
+    close_stream(s);
+    _window_cv.broadcast();
+    if (_closed) {
+        return make_ready_future<>();
+    }
+    temporary_buffer<char> payload(4);
+    write_be32(payload.get_write(), uint32_t(code));
+    return write_frame(frame_type::rst_stream, 0, s._id, std::move(payload)).handle_exception([] (std::exception_ptr ex) {
+        // The connection is going down anyway
+        h2log.trace("failed to send RST_STREAM: {}", ex);
+    });
+}
+
+future<> session::shutdown(error_code code) {
+    _goaway = true;
+    _slots_cv.broadcast();
+    // An error code still goes out after a graceful GOAWAY
+    if ((_goaway_sent && code == error_code::no_error) || _closed) {
+        return make_ready_future<>();
+    }
+    _goaway_sent = true;
+    temporary_buffer<char> payload(8);
+    write_be32(payload.get_write(), _last_peer_stream_id);
+    write_be32(payload.get_write() + 4, uint32_t(code));
+    return write_frame(frame_type::goaway, 0, 0, std::move(payload)).handle_exception([] (std::exception_ptr ex) {
+        h2log.trace("failed to send GOAWAY: {}", ex);
+    });
+}
+
+void session::run_in_background(noncopyable_function<future<>()> fn) {
+    (void)try_with_gate(_bg, std::move(fn)).handle_exception([] (std::exception_ptr ex) {
+        h2log.trace("background operation failed: {}", ex);
+    });
+}
+
+void session::consumed(size_t len) {
+    if (_closed || len == 0) {
+        return;
+    }
+    _recv_unacked += len;
+    if (_recv_unacked >= connection_window / 2) {
+        auto increment = std::exchange(_recv_unacked, 0);
+        _recv_window += increment;
+        run_in_background([this, increment] {
+            return send_window_update(0, increment);
+        });
+    }
+}
+
+void session::consumed(stream& s, size_t len) {
+    consumed(len);
+    if (_closed || len == 0 || s._remote_closed) {
+        return;
+    }
+    s._recv_unacked += len;
+    if (s._recv_unacked >= _local.initial_window_size / 2) {
+        auto increment = std::exchange(s._recv_unacked, 0);
+        s._recv_window += increment;
+        run_in_background([this, id = s._id, increment] {
+            return send_window_update(id, increment);
+        });
+    }
+}
+
+void session::maybe_close_stream(stream& s) {
+    if (s._local_closed && s._remote_closed) {
+        close_stream(s);
+    }
+}
+
+void session::close_stream(stream& s) {
+    auto it = _streams.find(s._id);
+    if (it == _streams.end() || it->second.get() != &s) {
+        return;
+    }
+    _streams.erase(it);
+    if (is_local(s._id)) {
+        _local_streams--;
+        _slots_cv.broadcast();
+    }
+}
+
+void session::fail_all(std::exception_ptr ex) {
+    auto streams = std::exchange(_streams, {});
+    for (auto& [id, s] : streams) {
+        s->fail(ex);
+    }
+    _local_streams = 0;
+    _slots_cv.broadcast();
+    _window_cv.broadcast();
+}
+
+}
+
+}
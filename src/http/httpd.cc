@@ -49,6 +49,7 @@ module seastar;
 #include <seastar/core/print.hh>
 #include <seastar/http/httpd.hh>
 #include <seastar/http/internal/content_source.hh>
+#include <seastar/http/internal/http2.hh>
 #include <seastar/http/reply.hh>
 #include <seastar/util/short_streams.hh>
 #include <seastar/util/log.hh>
@@ -62,6 +63,8 @@ namespace seastar {
 
 logger hlogger("httpd");
 
+namespace http2 = http::internal::http2;
+
 namespace httpd {
 http_stats::http_stats(http_server& server, const sstring& name)
  {
@@ -74,18 +77,37 @@ http_stats::http_stats(http_server& server, const sstring& name)
             sm::make_gauge("connections_current", [&server] { return server.current_connections(); }, sm::description("The current number of open  connections"), labels),
             sm::make_counter("read_errors", [&server] { return server.read_errors(); }, sm::description("The total number of errors while reading http requests"), labels),
             sm::make_counter("reply_errors", [&server] { return server.reply_errors(); }, sm::description("The total number of errors while replying to http"), labels),
-            sm::make_counter("requests_served", [&server] { return server.requests_served(); }, sm::description("The total number of http requests served"), labels)
+            sm::make_counter("requests_served", [&server] { return server.requests_served(); }, sm::description("The total number of http requests served"), labels),
+            sm::make_gauge("requests_in_flight", [&server] { return server.requests_in_flight(); }, sm::description("The current number of http requests admitted and not replied to"), labels),
+            sm::make_counter("requests_shed", [&server] { return server.requests_shed(); }, sm::description("The total number of http requests rejected by a concurrency limit"), labels)
     });
 }
 
+handler_base& handler_base::register_metrics(const sstring& service, const sstring& route) {
+    namespace sm = seastar::metrics;
+    std::vector<sm::label_instance> labels;
+
+    labels.push_back(sm::label_instance("service", service));
+    labels.push_back(sm::label_instance("route", route));
+    _metrics.clear();
+    _metrics.add_group("httpd", {
+            sm::make_counter("route_requests", [this] { return _stats.requests; }, sm::description("The total number of requests replied to by the route"), labels),
+            sm::make_gauge("route_requests_in_flight", [this] { return _stats.in_flight; }, sm::description("The current number of requests of the route admitted and not replied to"), labels),
+            sm::make_counter("route_requests_shed", [this] { return _stats.shed; }, sm::description("The total number of requests rejected by the concurrency limit of the route"), labels),
+            sm::make_histogram("route_latency", [this] { return _stats.latency.to_metrics_histogram(); }, sm::description("The time from admitting a request of the route to its reply being ready"), labels),
+    });
+    return *this;
+}
+
 sstring http_server_control::generate_server_name() {
     static thread_local uint16_t idgen;
     return seastar::format("http-{}", idgen++);
 }
 
 future<> connection::do_response_loop() {
-    return _replies.pop_eventually().then(
-        [this] (std::unique_ptr<http::reply> resp) {
+    return _replies.pop_eventually().then([] (pending_reply resp) {
+        return std::move(resp.reply);
+    }).then([this] (std::unique_ptr<http::reply> resp) {
             if (!resp) {
                 // eof
                 return make_ready_future<>();
@@ -98,6 +120,13 @@ future<> connection::do_response_loop() {
 }
 
 future<> connection::start_response() {
+    if (!_resp->_serialized.empty()) {
+        return _write_buf.write(std::move(_resp->_serialized)).then([this] {
+            return _write_buf.flush();
+        }).then([this] {
+            _resp.reset();
+        });
+    }
     if (_resp->_body_writer) {
         return _resp->write_reply_to_connection(*this).then_wrapped([this] (auto f) {
             if (f.failed()) {
@@ -164,6 +193,9 @@ void connection::on_new_connection() {
     ++_server._current_connections;
     _fd.set_nodelay(true);
     _server._connections.push_back(*this);
+    if (_server._pipeline_depth > 1) {
+        _replies.set_max_size(_server._pipeline_depth);
+    }
 }
 
 future<> connection::read() {
@@ -179,10 +211,36 @@ future<> connection::read() {
     });
 }
 
-static input_stream<char> make_content_stream(http::request* req, input_stream<char>& buf) {
+// Chunked and HTTP/2 request bodies don't have to announce their length,
+// so the limit is enforced on the data as it arrives
+class content_limit_source_impl : public data_source_impl {
+    input_stream<char> _in;
+    size_t _remaining;
+public:
+    content_limit_source_impl(input_stream<char> in, size_t limit)
+        : _in(std::move(in)), _remaining(limit) {
+    }
+
+    virtual future<temporary_buffer<char>> get() override {
+        return _in.read().then([this] (temporary_buffer<char> buf) {
+            if (buf.size() > _remaining) {
+                throw base_exception("Content length limit exceeded", http::reply::status_type::payload_too_large);
+            }
+            _remaining -= buf.size();
+            return buf;
+        });
+    }
+
+    virtual future<> close() override {
+        return _in.close();
+    }
+};
+
+static input_stream<char> make_content_stream(http::request* req, input_stream<char>& buf, size_t limit) {
     // Create an input stream based on the requests body encoding or lack thereof
     if (seastar::internal::case_insensitive_cmp()(req->get_header("Transfer-Encoding"), "chunked")) {
-        return input_stream<char>(data_source(std::make_unique<internal::chunked_source_impl>(buf, req->chunk_extensions, req->trailing_headers)));
+        auto chunked = input_stream<char>(data_source(std::make_unique<internal::chunked_source_impl>(buf, req->chunk_extensions, req->trailing_headers)));
+        return input_stream<char>(data_source(std::make_unique<content_limit_source_impl>(std::move(chunked), limit)));
     } else {
         return input_stream<char>(data_source(std::make_unique<internal::content_length_source_impl>(buf, req->content_length)));
     }
@@ -203,6 +261,78 @@ set_request_content(std::unique_ptr<http::request> req, input_stream<char>* cont
     }
 }
 
+// Hands out the already read prefix of the connection before the rest
+// of it, so that the request parsers see the stream from its start
+class prefixed_source_impl : public data_source_impl {
+    temporary_buffer<char> _prefix;
+    input_stream<char> _in;
+public:
+    prefixed_source_impl(temporary_buffer<char> prefix, input_stream<char> in)
+        : _prefix(std::move(prefix)), _in(std::move(in)) {
+    }
+
+    virtual future<temporary_buffer<char>> get() override {
+        if (!_prefix.empty()) {
+            return make_ready_future<temporary_buffer<char>>(std::move(_prefix));
+        }
+        return _in.read();
+    }
+
+    virtual future<> close() override {
+        return _in.close();
+    }
+};
+
+connection::admission::admission(http_server& server, handler_base* handler) noexcept
+        : _server(&server)
+        , _handler(handler)
+        , _start(std::chrono::steady_clock::now()) {
+    ++_server->_requests_in_flight;
+}
+
+connection::admission::admission(admission&& o) noexcept
+        : _server(std::exchange(o._server, nullptr))
+        , _handler(std::exchange(o._handler, nullptr))
+        , _start(o._start) {
+}
+
+connection::admission::~admission() {
+    if (_server) {
+        --_server->_requests_in_flight;
+        if (_handler) {
+            _handler->release(std::chrono::steady_clock::now() - _start);
+        }
+    }
+}
+
+std::optional<connection::admission> connection::admit(handler_base* handler) {
+    auto limit = _server._max_concurrent_requests;
+    if (limit && _server._requests_in_flight >= limit) {
+        ++_server._requests_shed;
+        return std::nullopt;
+    }
+    if (handler && !handler->try_admit()) {
+        ++_server._requests_shed;
+        return std::nullopt;
+    }
+    return std::make_optional<admission>(_server, handler);
+}
+
+future<> connection::shed_request(std::unique_ptr<http::request> req) {
+    // The body isn't read, so the connection can only go on if there's none
+    if (req->content_length || !req->get_header("Transfer-Encoding").empty() || !req->should_keep_alive()) {
+        _done = true;
+    }
+    return _replies.not_full().then([this, req = std::move(req)] {
+        auto resp = std::make_unique<http::reply>();
+        set_headers(*resp);
+        resp->set_version(req->_version);
+        resp->set_status(http::reply::status_type::service_unavailable, "Too many requests in flight");
+        resp->done();
+        _replies.push(std::move(resp));
+    });
+}
+
 void connection::generate_error_reply_and_close(std::unique_ptr<http::request> req, http::reply::status_type status, const sstring& msg) {
     auto resp = std::make_unique<http::reply>();
     // TODO: Handle HTTP/2.0 when it releases
@@ -255,6 +385,15 @@ future<> connection::read_one() {
             return make_ready_future<>();
         }
 
+        // Admit the request before the body is read, and before the client
+        // is told to send it, so that shedding load costs little
+        auto handler = _server._routes.get_handler(*req);
+        auto adm = admit(handler);
+        if (!adm) {
+            return shed_request(std::move(req));
+        }
+        auto streaming = _server.get_content_streaming() || (handler && handler->streams_content());
+
         auto maybe_reply_continue = [this, req = std::move(req)] () mutable {
             if (req->_version == "1.1" && seastar::internal::case_insensitive_cmp()(req->get_header("Expect"), "100-continue")){
                 return _replies.not_full().then([req = std::move(req), this] () mutable {
@@ -270,12 +409,21 @@ future<> connection::read_one() {
             }
         };
 
-        return maybe_reply_continue().then([this] (std::unique_ptr<http::request> req) {
-            return do_with(make_content_stream(req.get(), _read_buf), sstring(req->_version), std::move(req), [this] (input_stream<char>& content_stream, sstring& version, std::unique_ptr<http::request>& req) {
-                return set_request_content(std::move(req), &content_stream, _server.get_content_streaming()).then([this, &content_stream] (std::unique_ptr<http::request> req) {
+        return maybe_reply_continue().then([this, streaming, adm = std::move(adm)] (std::unique_ptr<http::request> req) mutable {
+            return do_with(make_content_stream(req.get(), _read_buf, _server.get_content_length_limit()), sstring(req->_version), std::move(req), std::move(adm),
+                    [this, streaming] (input_stream<char>& content_stream, sstring& version, std::unique_ptr<http::request>& req, std::optional<admission>& adm) {
+                return set_request_content(std::move(req), &content_stream, streaming).then([this, &content_stream, &adm, streaming] (std::unique_ptr<http::request> req) {
+                    if (!streaming && _server._pipeline_depth > 1) {
+                        // The request was read entirely, so the next one can
+                        // be parsed while this one is being handled
+                        return _replies.not_full().then([this, &adm, req = std::move(req)] () mutable {
+                            _done = dispatch_request(std::move(req), std::move(adm));
+                        });
+                    }
                     return _replies.not_full().then([this, req = std::move(req)] () mutable {
                         return generate_reply(std::move(req));
-                    }).then([this, &content_stream](bool done) {
+                    }).then([this, &content_stream, &adm](bool done) {
+                        adm.reset();
                         _done = done;
                         // If the handler did not read the entire request
                         // content, this connection cannot be reused so we
@@ -301,6 +449,157 @@ future<> connection::read_one() {
 }
 
 future<> connection::process() {
+    if (!_server.get_http2()) {
+        return process_http1();
+    }
+    return detect_http2().then([this] (bool h2) {
+        return h2 ? process_http2() : process_http1();
+    });
+}
+
+future<bool> connection::detect_http2() {
+    return do_with(sstring(), [this] (sstring& prefix) {
+        return repeat([this, &prefix] {
+            return _read_buf.read().then([&prefix] (tmp_buf buf) {
+                if (buf.empty()) {
+                    return stop_iteration::yes;
+                }
+                prefix.append(buf.get(), buf.size());
+                return stop_iteration(prefix.size() >= http2::client_preface.size() || !http2::client_preface.starts_with(prefix));
+            });
+        }).then([this, &prefix] {
+            bool h2 = std::string_view(prefix).starts_with(http2::client_preface);
+            _read_buf = input_stream<char>(data_source(std::make_unique<prefixed_source_impl>(tmp_buf(prefix.data(), prefix.size()), std::move(_read_buf))));
+            return h2;
+        });
+    });
+}
+
+future<> connection::process_http2() {
+    http2::settings local;
+    local.max_concurrent_streams = 128;
+    local.initial_window_size = 1 << 20;
+    auto s = std::make_unique<http2::session>(std::move(_read_buf), std::move(_write_buf), http2::session::role::server, local,
+            [this] (lw_shared_ptr<http2::stream> st) {
+        return handle_http2_stream(std::move(st));
+    });
+    auto f = s->run();
+    return f.finally([s = std::move(s)] {});
+}
+
+future<> connection::handle_http2_stream(lw_shared_ptr<http2::stream> s) {
+    ++_server._requests_served;
+    auto req = std::make_unique<http::request>();
+    req->_version = "2.0";
+    req->_server_address = this->_server_addr;
+    req->_client_address = this->_client_addr;
+    if (_tls) {
+        req->protocol_name = "https";
+    }
+    for (const auto& [name, value] : s->headers()) {
+        if (name == ":method") {
+            req->_method = value;
+        } else if (name == ":path") {
+            req->_url = value;
+        } else if (name == ":authority") {
+            req->_headers["Host"] = value;
+        } else if (name.empty() || name[0] == ':') {
+            continue;
+        } else if (auto it = req->_headers.find(name); it != req->_headers.end()) {
+            // Cookies may be split into separate fields, RFC 9113 Section 8.2.3
+            it->second += (name == "cookie" ? "; " : ", ") + value;
+        } else {
+            req->_headers.emplace(name, value);
+        }
+    }
+
+    auto error_reply = [this, s] (http::reply::status_type status, sstring msg) {
+        auto resp = std::make_unique<http::reply>();
+        set_headers(*resp);
+        resp->set_status(status, std::move(msg));
+        return write_http2_reply(s, std::move(resp));
+    };
+    if (req->_method.empty() || req->_url.empty()) {
+        return error_reply(http::reply::status_type::bad_request, "Can't parse the request");
+    }
+    size_t content_length_limit = _server.get_content_length_limit();
+    req->content_length = strtol(req->get_header("Content-Length").c_str(), nullptr, 10);
+    if (req->content_length > content_length_limit) {
+        return error_reply(http::reply::status_type::payload_too_large,
+                format("Content length limit ({}) exceeded: {}", content_length_limit, req->content_length));
+    }
+
+    auto handler = _server._routes.get_handler(*req);
+    auto adm = admit(handler);
+    if (!adm) {
+        return error_reply(http::reply::status_type::service_unavailable, "Too many requests in flight");
+    }
+
+    auto content = input_stream<char>(data_source(std::make_unique<content_limit_source_impl>(s->make_input_stream(), content_length_limit)));
+    auto streaming = _server.get_content_streaming() || (handler && handler->streams_content());
+    return do_with(std::move(content), std::move(req), std::move(adm), [this, s, error_reply, streaming] (input_stream<char>& content, std::unique_ptr<http::request>& req, std::optional<admission>& adm) {
+        return set_request_content(std::move(req), &content, streaming).then([this, &adm] (std::unique_ptr<http::request> req) {
+            auto resp = std::make_unique<http::reply>();
+            resp->set_version(req->_version);
+            set_headers(*resp);
+            if (req->_method == "HEAD") {
+                resp->skip_body();
+            }
+            sstring url = req->parse_query_param();
+            auto enc = negotiate_encoding(*req);
+            return _server._routes.handle(url, std::move(req), std::move(resp)).then([this, enc] (std::unique_ptr<http::reply> rep) {
+                auto& r = *rep;
+                return compress_reply(r, enc).then([rep = std::move(rep)] () mutable {
+                    return std::move(rep);
+                });
+            }).finally([&adm] {
+                adm.reset();
+            });
+        }).then([this, s] (std::unique_ptr<http::reply> rep) {
+            return write_http2_reply(s, std::move(rep));
+        }).handle_exception_type([error_reply] (const base_exception& e) {
+            return error_reply(e.status(), e.str());
+        });
+    }).then([s] {
+        // The response is complete, the rest of the request body is not needed
+        if (!s->remote_closed()) {
+            return s->reset(http2::error_code::no_error);
+        }
+        return make_ready_future<>();
+    }).handle_exception([this] (std::exception_ptr ex) {
+        _server._respond_errors++;
+        return make_exception_future<>(std::move(ex));
+    });
+}
+
+future<> connection::write_http2_reply(lw_shared_ptr<http2::stream> s, std::unique_ptr<http::reply> rep) {
+    bool has_body = !rep->_skip_body && (rep->_body_writer || !rep->_content.empty());
+    if (!rep->_body_writer) {
+        rep->_headers["Content-Length"] = to_sstring(rep->_content.size());
+    }
+    http2::header_list headers;
+    headers.emplace_back(":status", to_sstring(static_cast<int>(rep->_status)));
+    for (const auto& [name, value] : rep->_headers) {
+        auto lname = http2::header_name(name);
+        if (!http2::is_connection_specific_header(lname)) {
+            headers.emplace_back(std::move(lname), value);
+        }
+    }
+    return s->send_headers(std::move(headers), !has_body).then([s, rep = std::move(rep), has_body] () mutable {
+        if (!has_body) {
+            return make_ready_future<>();
+        }
+        if (rep->_body_writer) {
+            auto& writer = rep->_body_writer;
+            return writer(s->make_output_stream()).finally([rep = std::move(rep)] {});
+        }
+        auto& content = rep->_content;
+        temporary_buffer<char> body(content.data(), content.size(), make_object_deleter(std::move(rep)));
+        return s->send(std::move(body), true);
+    });
+}
+
+future<> connection::process_http1() {
     // Launch read and write "threads" simultaneously:
     return when_all(read(), respond()).then(
             [] (std::tuple<future<>, future<>> joined) {
@@ -319,6 +618,9 @@ future<> connection::process() {
         return _read_buf.close().handle_exception([](std::exception_ptr e) {
             hlogger.debug("Close exception encountered: {}", e);
         });
+    }).finally([this] {
+        // The replies of pipelined requests may have been dropped
+        return _pipelined.close();
     });
 }
 void connection::shutdown() {
@@ -335,6 +637,9 @@ future<> connection::respond() {
         // swallow error
         if (f.failed()) {
             _server._respond_errors++;
+            // The reader may be waiting for room for more replies
+            _done = true;
+            _replies.abort(std::make_exception_ptr(std::logic_error("Failed to respond")));
         }
         f.ignore_ready_future();
         return _write_buf.close();
@@ -351,12 +656,11 @@ void connection::set_headers(http::reply& resp) {
     resp._headers["Date"] = _server._date;
 }
 
-future<bool> connection::generate_reply(std::unique_ptr<http::request> req) {
+future<std::unique_ptr<http::reply>> connection::handle_request(std::unique_ptr<http::request> req) {
     auto resp = std::make_unique<http::reply>();
     resp->set_version(req->_version);
     set_headers(*resp);
-    bool keep_alive = req->should_keep_alive();
-    if (keep_alive && req->_version == "1.0") {
+    if (req->should_keep_alive() && req->_version == "1.0") {
         resp->_headers["Connection"] = "Keep-Alive";
     }
 
@@ -365,15 +669,84 @@ future<bool> connection::generate_reply(std::unique_ptr<http::request> req) {
     if (req->_method == "HEAD") {
         resp->skip_body();
     }
-    return _server._routes.handle(url, std::move(req), std::move(resp)).
-    // Caller guarantees enough room
-    then([this, keep_alive , version = std::move(version)](std::unique_ptr<http::reply> rep) {
+    auto enc = negotiate_encoding(*req);
+    return _server._routes.handle(url, std::move(req), std::move(resp)).then([this, enc] (std::unique_ptr<http::reply> rep) {
+        auto& r = *rep;
+        return compress_reply(r, enc).then([rep = std::move(rep)] () mutable {
+            return std::move(rep);
+        });
+    }).then([version = std::move(version)] (std::unique_ptr<http::reply> rep) {
         rep->set_version(version).done();
+        return rep;
+    });
+}
+
+future<bool> connection::generate_reply(std::unique_ptr<http::request> req) {
+    bool keep_alive = req->should_keep_alive();
+    return handle_request(std::move(req)).then([this, keep_alive] (std::unique_ptr<http::reply> rep) {
+        // Caller guarantees enough room
         this->_replies.push(std::move(rep));
         return make_ready_future<bool>(!keep_alive);
     });
 }
 
+bool connection::dispatch_request(std::unique_ptr<http::request> req, std::optional<admission> adm) {
+    bool keep_alive = req->should_keep_alive();
+    // The content was read into the request, the stream it came from is
+    // gone by the time the handler runs
+    auto content_stream = std::make_unique<input_stream<char>>(data_source(std::make_unique<internal::content_length_source_impl>(_read_buf, 0)));
+    req->content_stream = content_stream.get();
+    // Caller guarantees enough room
+    _replies.push(with_gate(_pipelined, [this, req = std::move(req)] () mutable {
+        return handle_request(std::move(req));
+    }).finally([content_stream = std::move(content_stream), adm = std::move(adm)] {}));
+    return !keep_alive;
+}
+
+http::content_encoding connection::negotiate_encoding(const http::request& req) const {
+    if (!_server._compression) {
+        return http::content_encoding::identity;
+    }
+    return http::negotiate_content_encoding(req.get_header("Accept-Encoding"), _server._compression->encodings);
+}
+
+future<> connection::compress_reply(http::reply& rep, http::content_encoding enc) {
+    if (!_server._compression || rep._headers.contains("Content-Encoding")
+            || !http::is_compressible(rep.get_header("Content-Type"))) {
+        return make_ready_future<>();
+    }
+    // Leave alone replies without a body and partial ones, whose ranges
+    // refer to the unencoded content
+    auto status = static_cast<int>(rep._status);
+    if (status < 200 || status == 204 || status == 206 || status == 304) {
+        return make_ready_future<>();
+    }
+    // The body depends on the Accept-Encoding header even if this client
+    // gets it unencoded, let caches know
+    if (auto it = rep._headers.find("Vary"); it == rep._headers.end()) {
+        rep._headers["Vary"] = "Accept-Encoding";
+    } else if (it->second != "*" && it->second.find("Accept-Encoding") == sstring::npos) {
+        it->second += ", Accept-Encoding";
+    }
+    if (enc == http::content_encoding::identity) {
+        return make_ready_future<>();
+    }
+    const auto& cfg = *_server._compression;
+    if (!rep._body_writer && rep._content.size() < cfg.min_size) {
+        return make_ready_future<>();
+    }
+    rep._headers["Content-Encoding"] = sstring(http::to_string(enc));
+    if (rep._body_writer) {
+        rep._body_writer = [writer = std::move(rep._body_writer), enc, cfg] (output_stream<char>&& out) mutable {
+            return writer(http::make_compressed_output_stream(std::move(out), enc, cfg));
+        };
+        return make_ready_future<>();
+    }
+    return http::compress(std::move(rep._content), enc, cfg).then([&rep] (sstring content) {
+        rep._content = std::move(content);
+    });
+}
+
 void http_server::set_tls_credentials(server_credentials_ptr credentials) {
     _credentials = credentials;
 }
@@ -394,6 +767,43 @@ void http_server::set_content_streaming(bool b) {
     _content_streaming = b;
 }
 
+const std::optional<http::compression_config>& http_server::get_compression() const {
+    return _compression;
+}
+
+void http_server::set_compression(std::optional<http::compression_config> cfg) {
+#ifndef SEASTAR_HAVE_ZSTD
+    if (cfg && std::ranges::count(cfg->encodings, http::content_encoding::zstd)) {
+        throw std::invalid_argument("zstd compression is not supported by this build");
+    }
+#endif
+    _compression = std::move(cfg);
+}
+
+size_t http_server::get_max_concurrent_requests() const {
+    return _max_concurrent_requests;
+}
+
+void http_server::set_max_concurrent_requests(size_t n) {
+    _max_concurrent_requests = n;
+}
+
+size_t http_server::get_pipeline_depth() const {
+    return _pipeline_depth;
+}
+
+void http_server::set_pipeline_depth(size_t depth) {
+    _pipeline_depth = std::max<size_t>(depth, 1);
+}
+
+bool http_server::get_http2() const {
+    return _http2;
+}
+
+void http_server::set_http2(bool b) {
+    _http2 = b;
+}
+
 future<> http_server::listen(socket_address addr, listen_options lo,
             server_credentials_ptr listener_credentials) {
     if (listener_credentials) {
@@ -477,6 +887,12 @@ uint64_t http_server::current_connections() const {
 uint64_t http_server::requests_served() const {
     return _requests_served;
 }
+uint64_t http_server::requests_in_flight() const {
+    return _requests_in_flight;
+}
+uint64_t http_server::requests_shed() const {
+    return _requests_shed;
+}
 uint64_t http_server::read_errors() const {
     return _read_errors;
 }
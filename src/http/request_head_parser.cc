@@ -0,0 +1,190 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <array>
+#include <cstring>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/http/internal/request_head_parser.hh>
+#include <seastar/http/request.hh>
+#endif
+
+namespace seastar {
+
+namespace http {
+
+namespace internal {
+
+const char* find_control_char(const char* p, const char* pe, unsigned char min) noexcept {
+#if defined(__AVX2__)
+    const auto min256 = _mm256_set1_epi8(min);
+    const auto del256 = _mm256_set1_epi8(0x7f);
+    for (; pe - p >= 32; p += 32) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        // v >= min, unsigned
+        auto ok = _mm256_cmpeq_epi8(_mm256_max_epu8(v, min256), v);
+        auto bad = _mm256_andnot_si256(ok, _mm256_set1_epi8(-1));
+        bad = _mm256_or_si256(bad, _mm256_cmpeq_epi8(v, del256));
+        if (auto mask = unsigned(_mm256_movemask_epi8(bad))) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+    const auto min128 = _mm_set1_epi8(min);
+    const auto del128 = _mm_set1_epi8(0x7f);
+    for (; pe - p >= 16; p += 16) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        auto ok = _mm_cmpeq_epi8(_mm_max_epu8(v, min128), v);
+        auto mask = unsigned(~_mm_movemask_epi8(ok) & 0xffff) | unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(v, del128)));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+#elif defined(__ARM_NEON)
+    const auto min128 = vdupq_n_u8(min);
+    const auto del128 = vdupq_n_u8(0x7f);
+    for (; pe - p >= 16; p += 16) {
+        auto v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+        auto bad = vorrq_u8(vcltq_u8(v, min128), vceqq_u8(v, del128));
+        if (vmaxvq_u8(bad)) {
+            // the exact position is found by the scalar loop below
+            break;
+        }
+    }
+#endif
+    for (; p != pe; ++p) {
+        auto c = static_cast<unsigned char>(*p);
+        if (c < min || c == 0x7f) {
+            return p;
+        }
+    }
+    return pe;
+}
+
+// tchar of RFC 9110, section 5.6.2
+static constexpr auto token_chars = [] {
+    std::array<bool, 256> t{};
+    for (int c = '0'; c <= '9'; ++c) {
+        t[c] = true;
+    }
+    for (int c = 'a'; c <= 'z'; ++c) {
+        t[c] = t[c - 'a' + 'A'] = true;
+    }
+    for (unsigned char c : std::string_view("!#$%&'*+-.^_`|~")) {
+        t[c] = true;
+    }
+    return t;
+}();
+
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool is_sp_ht(char c) {
+    return c == ' ' || c == '\t';
+}
+
+const char* parse_request_head(const char* p, const char* pe, request& req) {
+    // request line: method SP uri SP HTTP/d.d CRLF
+    auto start = p;
+    while (p != pe && *p >= 'A' && *p <= 'Z') {
+        ++p;
+    }
+    if (p == start || p == pe || *p != ' ') {
+        return nullptr;
+    }
+    req._method = sstring(start, p);
+    start = ++p;
+    p = find_control_char(p, pe, '!');
+    if (p == start || p == pe || *p != ' ') {
+        return nullptr;
+    }
+    req._url = sstring(start, p);
+    ++p;
+    if (pe - p < 10 || std::memcmp(p, "HTTP/", 5) != 0 || !is_digit(p[5]) || p[6] != '.' || !is_digit(p[7])
+            || p[8] != '\r' || p[9] != '\n') {
+        return nullptr;
+    }
+    req._version = sstring(p + 5, 3);
+    p += 10;
+
+    // headers: name ':' sp_ht* value CRLF, until an empty line
+    while (true) {
+        if (pe - p < 2) {
+            return nullptr;
+        }
+        if (p[0] == '\r') {
+            return p[1] == '\n' ? p + 2 : nullptr;
+        }
+        start = p;
+        while (p != pe && token_chars[static_cast<unsigned char>(*p)]) {
+            ++p;
+        }
+        if (p == start || p == pe || *p != ':') {
+            return nullptr;
+        }
+        sstring name(start, p);
+        ++p;
+        while (p != pe && is_sp_ht(*p)) {
+            ++p;
+        }
+        start = p;
+        // field content is visible characters, obs-text, spaces and tabs
+        while ((p = find_control_char(p, pe, ' ')) != pe && *p == '\t') {
+            ++p;
+        }
+        if (pe - p < 2 || p[0] != '\r' || p[1] != '\n') {
+            return nullptr;
+        }
+        auto end = p;
+        while (end != start && is_sp_ht(end[-1])) {
+            --end;
+        }
+        p += 2;
+        if (p != pe && is_sp_ht(*p)) {
+            // obs-fold, left to the state machine
+            return nullptr;
+        }
+        auto [iter, inserted] = req._headers.try_emplace(std::move(name), start, end);
+        if (!inserted) {
+            // combined as the state machine does, see request_parser.rl
+            iter->second += sstring(",") + sstring(start, end);
+        }
+    }
+}
+
+}
+
+}
+
+}
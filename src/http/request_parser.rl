@@ -25,6 +25,7 @@
 #include <memory>
 #include <unordered_map>
 #include <seastar/http/request.hh>
+#include <seastar/http/internal/request_head_parser.hh>
 
 namespace seastar {
 
@@ -141,6 +142,15 @@ public:
         %% write init;
     }
     char* parse(char* p, char* pe, char* eof) {
+        if (_fsm_cs == start && p != pe) {
+            // A request head that arrives whole in one buffer is parsed
+            // without the state machine, which handles everything else.
+            if (auto end = http::internal::parse_request_head(p, pe, *_req)) {
+                _state = state::done;
+                return p + (end - p);
+            }
+            _req.reset(new http::request());
+        }
         sstring_builder::guard g(_builder, p, pe);
         [[maybe_unused]] auto str = [this, &g, &p] { g.mark_end(p); return get_str(); };
         bool done = false;
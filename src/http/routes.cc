@@ -22,14 +22,29 @@
 #ifdef SEASTAR_MODULE
 module;
 #include <exception>
+#include <limits>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+#include <boost/container/small_vector.hpp>
 module seastar;
 #else
+#include <limits>
+#include <string>
+#include <string_view>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+#include <boost/container/small_vector.hpp>
 #include <seastar/http/routes.hh>
 #include <seastar/http/reply.hh>
 #include <seastar/http/request.hh>
 #include <seastar/http/exception.hh>
 #include <seastar/http/json_path.hh>
+#include <seastar/core/tracing.hh>
 #endif
 
 namespace seastar {
@@ -38,6 +53,190 @@ namespace httpd {
 
 using namespace std;
 
+/*
+ * The match rules made only of str_matcher and param_matcher, which are
+ * all the rules url and path_description make, compiled into a tree of
+ * path segments: a url is matched against all of them with one walk of
+ * the tree, instead of trying the rules one by one.
+ *
+ * A url is split at its slashes, a str_matcher matches one or more
+ * segments, a param_matcher one segment, or the rest of the url. As in
+ * match_rule::get(), a single trailing slash is ignored. The rule with
+ * the smallest cookie wins, like with trying the rules in order; the
+ * rules that can't be compiled are still tried in order, before the
+ * tree's match if their cookie is smaller.
+ */
+class routes::rule_tree {
+    struct segment_hash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const noexcept {
+            return std::hash<std::string_view>()(s);
+        }
+    };
+    static constexpr rule_cookie no_rule = std::numeric_limits<rule_cookie>::max();
+
+    struct target {
+        rule_cookie cookie = no_rule;
+        handler_base* handler = nullptr;
+        // the name of the parameter taking the rest of the url
+        const sstring* param = nullptr;
+
+        void set(rule_cookie c, handler_base* h, const sstring* p = nullptr) {
+            // the first rule added for a path wins
+            if (c < cookie) {
+                cookie = c;
+                handler = h;
+                param = p;
+            }
+        }
+    };
+
+    struct node {
+        std::unordered_map<std::string, std::unique_ptr<node>, segment_hash, std::equal_to<>> segments;
+        std::vector<std::pair<sstring, std::unique_ptr<node>>> params;
+        // rules ending here
+        target end;
+        // rules ending with a parameter taking the rest of the url
+        target rest;
+        // the smallest cookie in the subtree, to skip those that can't win
+        rule_cookie min_cookie = no_rule;
+    };
+
+    // A parameter matched at [begin, end) of the url, including its leading slash
+    struct capture {
+        const sstring* name;
+        size_t begin;
+        size_t end;
+    };
+    using captures = boost::container::small_vector<capture, 8>;
+
+    struct match {
+        rule_cookie cookie = no_rule;
+        handler_base* handler = nullptr;
+        captures params;
+    };
+
+    node _root;
+    // the rules that can't be compiled, in cookie order
+    std::vector<std::pair<rule_cookie, match_rule*>> _other_rules;
+
+    bool compile(rule_cookie cookie, const match_rule& rule) {
+        const auto& matchers = rule.matchers();
+        if (matchers.empty()) {
+            return false;
+        }
+        std::vector<node*> path = { &_root };
+        target* t = nullptr;
+        for (size_t i = 0; i < matchers.size(); ++i) {
+            const matcher& m = *matchers[i];
+            node& n = *path.back();
+            if (typeid(m) == typeid(str_matcher)) {
+                std::string_view str = static_cast<const str_matcher&>(m).str();
+                if (str.empty() || str[0] != '/') {
+                    return false;
+                }
+                // "/a/b" is the segments "a" and "b"
+                while (!str.empty()) {
+                    auto next = std::min(str.find('/', 1), str.size());
+                    auto& child = path.back()->segments[std::string(str.substr(1, next - 1))];
+                    if (!child) {
+                        child = std::make_unique<node>();
+                    }
+                    path.push_back(child.get());
+                    str.remove_prefix(next);
+                }
+            } else if (typeid(m) == typeid(param_matcher)) {
+                auto& pm = static_cast<const param_matcher&>(m);
+                if (pm.entire_path()) {
+                    if (i + 1 != matchers.size()) {
+                        return false;
+                    }
+                    t = &n.rest;
+                    t->set(cookie, rule.handler(), &pm.name());
+                    break;
+                }
+                auto it = std::find_if(n.params.begin(), n.params.end(), [&pm] (const auto& p) {
+                    return p.first == pm.name();
+                });
+                if (it == n.params.end()) {
+                    n.params.emplace_back(pm.name(), std::make_unique<node>());
+                    it = std::prev(n.params.end());
+                }
+                path.push_back(it->second.get());
+            } else {
+                return false;
+            }
+        }
+        if (!t) {
+            path.back()->end.set(cookie, rule.handler());
+        }
+        for (auto n : path) {
+            n->min_cookie = std::min(n->min_cookie, cookie);
+        }
+        return true;
+    }
+
+    // pos is the end of the matched part of the url, at a slash or at its end
+    void find(const node& n, std::string_view url, size_t pos, captures& params, match& best) const {
+        if (n.min_cookie >= best.cookie) {
+            return;
+        }
+        if (n.end.cookie < best.cookie && pos + 1 >= url.size()) {
+            best.cookie = n.end.cookie;
+            best.handler = n.end.handler;
+            best.params = params;
+        }
+        if (n.rest.cookie < best.cookie) {
+            best.cookie = n.rest.cookie;
+            best.handler = n.rest.handler;
+            best.params = params;
+            best.params.push_back({n.rest.param, pos, url.size()});
+        }
+        if (pos >= url.size()) {
+            return;
+        }
+        auto next = std::min(url.find('/', pos + 1), url.size());
+        if (auto it = n.segments.find(url.substr(pos + 1, next - pos - 1)); it != n.segments.end()) {
+            find(*it->second, url, next, params, best);
+        }
+        for (auto& [name, child] : n.params) {
+            params.push_back({&name, pos, next});
+            find(*child, url, next, params, best);
+            params.pop_back();
+        }
+    }
+
+public:
+    explicit rule_tree(const std::map<rule_cookie, match_rule*>& rules) {
+        for (auto& [cookie, rule] : rules) {
+            if (!compile(cookie, *rule)) {
+                _other_rules.emplace_back(cookie, rule);
+            }
+        }
+    }
+
+    // url must start with a slash
+    handler_base* get(const sstring& url, parameters& params) const {
+        match best;
+        captures current;
+        find(_root, url, 0, current, best);
+        for (auto& [cookie, rule] : _other_rules) {
+            if (cookie > best.cookie) {
+                break;
+            }
+            auto handler = rule->get(url, params);
+            if (handler != nullptr) {
+                return handler;
+            }
+            params.clear();
+        }
+        for (auto& p : best.params) {
+            params.set(*p.name, url.substr(p.begin, p.end - p.begin));
+        }
+        return best.handler;
+    }
+};
+
 routes::routes() : _general_handler([this](std::exception_ptr eptr) mutable {
     return exception_reply(eptr);
 }) {}
@@ -90,13 +289,19 @@ future<std::unique_ptr<http::reply> > routes::handle(const sstring& path, std::u
     handler_base* handler = get_handler(str2type(req->_method),
             normalize_url(path), req->param);
     if (handler != nullptr) {
-        try {
-            handler->verify_mandatory_params(*req);
-            auto r =  handler->handle(path, std::move(req), std::move(rep));
-            return r.handle_exception(_general_handler);
-        } catch (...) {
-            rep = exception_reply(std::current_exception());
+        auto parent = tracing::trace_context::from_traceparent(req->get_header("traceparent"));
+        if (parent || tracing::root_sampling_probability() > 0) {
+            tracing::span s(format("{} {}", req->_method, path), parent);
+            s.set_attribute("http.request.method", req->_method);
+            s.set_attribute("url.path", path);
+            return tracing::with_span(std::move(s), [this, handler, &path, req = std::move(req), rep = std::move(rep)] () mutable {
+                return call_handler(handler, path, std::move(req), std::move(rep)).then([] (std::unique_ptr<http::reply> rep) {
+                    tracing::set_attribute("http.response.status_code", to_sstring(int(rep->_status)));
+                    return rep;
+                });
+            });
         }
+        return call_handler(handler, path, std::move(req), std::move(rep));
     } else {
         rep.reset(new http::reply());
         json_exception ex(not_found_exception("Not found"));
@@ -106,6 +311,18 @@ future<std::unique_ptr<http::reply> > routes::handle(const sstring& path, std::u
     return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
 }
 
+future<std::unique_ptr<http::reply>> routes::call_handler(handler_base* handler, const sstring& path,
+        std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+    try {
+        handler->verify_mandatory_params(*req);
+        auto r =  handler->handle(path, std::move(req), std::move(rep));
+        return r.handle_exception(_general_handler);
+    } catch (...) {
+        rep = exception_reply(std::current_exception());
+    }
+    return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+}
+
 sstring routes::normalize_url(const sstring& url) {
     if (url.length() < 2 || url.at(url.length() - 1) != '/') {
         return url;
@@ -120,6 +337,14 @@ handler_base* routes::get_handler(operation_type type, const sstring& url,
         return handler;
     }
 
+    if (!url.empty() && url[0] == '/') {
+        if (!_rule_trees[type]) {
+            _rule_trees[type] = std::make_unique<rule_tree>(_rules[type]);
+        }
+        handler = _rule_trees[type]->get(url, params);
+        return handler != nullptr ? handler : _default_handler;
+    }
+
     for (auto&& rule : _rules[type]) {
         handler = rule.second->get(url, params);
         if (handler != nullptr) {
@@ -130,6 +355,22 @@ handler_base* routes::get_handler(operation_type type, const sstring& url,
     return _default_handler;
 }
 
+void routes::rules_changed(operation_type type) {
+    _rule_trees[type].reset();
+}
+
+handler_base* routes::get_handler(const http::request& req) {
+    auto pos = req._url.find('?');
+    parameters params;
+    return get_handler(str2type(req._method),
+            normalize_url(pos == sstring::npos ? req._url : req._url.substr(0, pos)), params);
+}
+
+bool routes::streams_content(const http::request& req) {
+    auto handler = get_handler(req);
+    return handler != nullptr && handler->streams_content();
+}
+
 routes& routes::add(operation_type type, const url& url,
         handler_base* handler) {
     match_rule* rule = new match_rule(handler);
@@ -171,6 +412,7 @@ routes& routes::put(operation_type type, const sstring& url, handler_base* handl
 }
 
 match_rule* routes::del_cookie(rule_cookie cookie, operation_type type) {
+    rules_changed(type);
     return delete_rule_from(type, cookie, _rules);
 }
 
@@ -0,0 +1,76 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/http/static_handler.hh>
+#include <seastar/http/httpd.hh>
+#include <seastar/http/mime_types.hh>
+#endif
+
+namespace seastar {
+
+namespace httpd {
+
+static_response_handler::static_response_handler(sstring content, sstring type, http::reply::status_type status)
+        : _status(status)
+        , _type(std::move(type))
+        , _content(std::move(content))
+        , _refresh([this] { serialize(); }) {
+    serialize();
+    _refresh.arm_periodic(std::chrono::seconds(1));
+}
+
+void static_response_handler::serialize() {
+    http::reply rep;
+    rep.set_version("1.1").set_status(_status);
+    // The headers connection::set_headers() adds to ordinary replies
+    auto head = seastar::format("{}Content-Type: {}\r\nContent-Length: {}\r\nServer: Seastar httpd\r\nDate: {}\r\n\r\n",
+            rep.response_line(), http::mime_types::extension_to_type(_type), _content.size(), http_server::http_date());
+    temporary_buffer<char> buf(head.size() + _content.size());
+    std::copy(_content.begin(), _content.end(), std::copy(head.begin(), head.end(), buf.get_write()));
+    // Replies in flight keep the previous buffer alive through their shares
+    _serialized = std::move(buf);
+}
+
+future<std::unique_ptr<http::reply>> static_response_handler::handle(const sstring& path,
+        std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+    if (req->_version == "1.1" && !rep->_skip_body) {
+        rep->_serialized = _serialized.share();
+    } else {
+        rep->set_status(_status);
+        rep->write_body(_type, _content);
+    }
+    return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+}
+
+}
+
+}
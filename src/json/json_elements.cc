@@ -186,6 +186,48 @@ future<> json_base::write(output_stream<char>& s) const {
     });
 }
 
+void json_base::write_to(stream_writer& w) const {
+    w.begin_object();
+    for (auto element : _elements) {
+        if (element == nullptr || element->_set == false) {
+            continue;
+        }
+        w.key(element->_name);
+        try {
+            element->write_to(w);
+        } catch (...) {
+            std::throw_with_nested(std::runtime_error(fmt::format("Json generation failed for field: {}", element->_name)));
+        }
+    }
+    w.end_object();
+}
+
+void json_base_element::write_to(stream_writer& w) const {
+    // to_string() isn't const, for no good reason
+    w.raw(const_cast<json_base_element*>(this)->to_string());
+}
+
+value_sink* json_base::on_begin_object() {
+    return this;
+}
+
+value_sink* json_base::on_member(std::string_view key) {
+    for (auto element : _elements) {
+        if (element->_name == key) {
+            return element;
+        }
+    }
+    return nullptr;
+}
+
+void json_base::on_end_object() {
+    for (auto element : _elements) {
+        if (!element->is_verify()) {
+            throw parse_error(fmt::format("missing mandatory element {}", element->_name));
+        }
+    }
+}
+
 bool json_base::is_verify() const {
     for (auto i : _elements) {
         if (!i->is_verify()) {
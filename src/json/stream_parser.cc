@@ -0,0 +1,499 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <bit>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <fmt/format.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/do_with.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/json/stream_parser.hh>
+#endif
+
+namespace seastar {
+
+namespace json {
+
+void value_sink::on_string(std::string_view) {
+    throw parse_error("unexpected string");
+}
+
+void value_sink::on_number(std::string_view) {
+    throw parse_error("unexpected number");
+}
+
+void value_sink::on_bool(bool) {
+    throw parse_error("unexpected boolean");
+}
+
+void value_sink::on_null() {
+}
+
+value_sink* value_sink::on_begin_object() {
+    throw parse_error("unexpected object");
+}
+
+value_sink* value_sink::on_member(std::string_view) {
+    return nullptr;
+}
+
+void value_sink::on_end_object() {
+}
+
+value_sink* value_sink::on_begin_array() {
+    throw parse_error("unexpected array");
+}
+
+value_sink* value_sink::on_element() {
+    return nullptr;
+}
+
+void value_sink::on_end_array() {
+}
+
+static bool is_whitespace(char c) noexcept {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static bool is_number_char(char c) noexcept {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+static bool is_literal_char(char c) noexcept {
+    return c >= 'a' && c <= 'z';
+}
+
+static bool ends_plain_run(char c) noexcept {
+    return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+}
+
+// Returns the position of the first quote, backslash or control character
+// from pos on, or the size of the input. Words of 8 bytes are checked at
+// once: each of the three tests sets the top bit of the bytes that match,
+// and possibly of some following ones, so the lowest bit set is the first
+// match.
+static size_t find_plain_run_end(std::string_view in, size_t pos) noexcept {
+    if constexpr (std::endian::native == std::endian::little) {
+        constexpr uint64_t ones = 0x0101010101010101;
+        constexpr uint64_t highs = 0x8080808080808080;
+        for (; pos + 8 <= in.size(); pos += 8) {
+            uint64_t w;
+            std::memcpy(&w, in.data() + pos, 8);
+            auto quotes = w ^ (ones * '"');
+            auto backslashes = w ^ (ones * '\\');
+            auto m = ((quotes - ones) & ~quotes) | ((backslashes - ones) & ~backslashes) | ((w - ones * 0x20) & ~w);
+            m &= highs;
+            if (m) {
+                return pos + std::countr_zero(m) / 8;
+            }
+        }
+    }
+    while (pos < in.size() && !ends_plain_run(in[pos])) {
+        ++pos;
+    }
+    return pos;
+}
+
+static bool valid_number(std::string_view n) noexcept {
+    size_t i = 0;
+    auto digits = [&] {
+        auto start = i;
+        while (i < n.size() && n[i] >= '0' && n[i] <= '9') {
+            ++i;
+        }
+        return i != start;
+    };
+    if (i < n.size() && n[i] == '-') {
+        ++i;
+    }
+    if (i < n.size() && n[i] == '0') {
+        ++i;
+    } else if (!digits()) {
+        return false;
+    }
+    if (i < n.size() && n[i] == '.') {
+        ++i;
+        if (!digits()) {
+            return false;
+        }
+    }
+    if (i < n.size() && (n[i] == 'e' || n[i] == 'E')) {
+        ++i;
+        if (i < n.size() && (n[i] == '+' || n[i] == '-')) {
+            ++i;
+        }
+        if (!digits()) {
+            return false;
+        }
+    }
+    return i == n.size();
+}
+
+static void append_utf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += char(cp);
+    } else if (cp < 0x800) {
+        out += char(0xc0 | (cp >> 6));
+        out += char(0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+        out += char(0xe0 | (cp >> 12));
+        out += char(0x80 | ((cp >> 6) & 0x3f));
+        out += char(0x80 | (cp & 0x3f));
+    } else {
+        out += char(0xf0 | (cp >> 18));
+        out += char(0x80 | ((cp >> 12) & 0x3f));
+        out += char(0x80 | ((cp >> 6) & 0x3f));
+        out += char(0x80 | (cp & 0x3f));
+    }
+}
+
+stream_parser::stream_parser(value_sink& root, size_t max_depth)
+    : _target(&root)
+    , _max_depth(max_depth)
+{
+}
+
+void stream_parser::fail(const char* what, size_t pos) const {
+    throw parse_error(fmt::format("{} at offset {}", what, _offset + pos));
+}
+
+size_t stream_parser::skip_whitespace(std::string_view in, size_t pos) const noexcept {
+    while (pos < in.size() && is_whitespace(in[pos])) {
+        ++pos;
+    }
+    return pos;
+}
+
+void stream_parser::begin_value() {
+    if (!_stack.empty() && _stack.back().array) {
+        auto sink = _stack.back().sink;
+        _target = sink ? sink->on_element() : nullptr;
+    }
+}
+
+void stream_parser::end_value() {
+    _state = _stack.empty() ? state::done : state::next;
+}
+
+void stream_parser::begin_container(bool array, size_t pos) {
+    if (_stack.size() >= _max_depth) {
+        fail("too deeply nested", pos);
+    }
+    value_sink* sink = nullptr;
+    if (_target) {
+        sink = array ? _target->on_begin_array() : _target->on_begin_object();
+    }
+    _stack.push_back(frame{sink, array});
+    _state = array ? state::first_element : state::first_key;
+}
+
+void stream_parser::end_container(bool array, size_t pos) {
+    if (_stack.empty() || _stack.back().array != array) {
+        fail(array ? "unexpected ]" : "unexpected }", pos);
+    }
+    auto sink = _stack.back().sink;
+    _stack.pop_back();
+    if (sink) {
+        if (array) {
+            sink->on_end_array();
+        } else {
+            sink->on_end_object();
+        }
+    }
+    end_value();
+}
+
+void stream_parser::end_string(std::string_view s) {
+    if (_in_key) {
+        auto sink = _stack.back().sink;
+        _target = sink ? sink->on_member(s) : nullptr;
+        _state = state::colon;
+    } else {
+        if (_target) {
+            _target->on_string(s);
+        }
+        end_value();
+    }
+}
+
+void stream_parser::end_scalar(std::string_view token, size_t pos) {
+    if (_state == state::number) {
+        if (!valid_number(token)) {
+            fail("invalid number", pos);
+        }
+        if (_target) {
+            _target->on_number(token);
+        }
+    } else if (token == "true" || token == "false") {
+        if (_target) {
+            _target->on_bool(token == "true");
+        }
+    } else if (token == "null") {
+        if (_target) {
+            _target->on_null();
+        }
+    } else {
+        fail("invalid literal", pos);
+    }
+    end_value();
+}
+
+size_t stream_parser::parse_escape(std::string_view in, size_t pos) {
+    while (pos < in.size()) {
+        _escape += in[pos++];
+        auto e = _escape[0];
+        if (e != 'u') {
+            static constexpr std::string_view from = "\"\\/bfnrt";
+            static constexpr std::string_view to = "\"\\/\b\f\n\r\t";
+            auto i = from.find(e);
+            if (i == from.npos || _high_surrogate) {
+                fail("invalid escape", pos - 1);
+            }
+            _token += to[i];
+            _escaped = false;
+            return pos;
+        }
+        if (_escape.size() == 5) {
+            uint32_t cp = 0;
+            for (auto c : std::string_view(_escape).substr(1)) {
+                cp <<= 4;
+                if (c >= '0' && c <= '9') {
+                    cp |= c - '0';
+                } else if (c >= 'a' && c <= 'f') {
+                    cp |= c - 'a' + 10;
+                } else if (c >= 'A' && c <= 'F') {
+                    cp |= c - 'A' + 10;
+                } else {
+                    fail("invalid escape", pos - 1);
+                }
+            }
+            if (cp >= 0xd800 && cp < 0xdc00 && !_high_surrogate) {
+                _high_surrogate = cp;
+            } else if (cp >= 0xdc00 && cp < 0xe000 && _high_surrogate) {
+                append_utf8(_token, 0x10000 + ((_high_surrogate - 0xd800) << 10) + (cp - 0xdc00));
+                _high_surrogate = 0;
+            } else if ((cp >= 0xd800 && cp < 0xe000) || _high_surrogate) {
+                fail("unpaired surrogate", pos - 1);
+            } else {
+                append_utf8(_token, cp);
+            }
+            _escaped = false;
+            return pos;
+        }
+    }
+    return pos;
+}
+
+size_t stream_parser::begin_string(std::string_view in, size_t pos) {
+    // Strings which end in this fragment and have no escapes aren't copied
+    auto start = pos + 1;
+    auto end = find_plain_run_end(in, start);
+    if (end < in.size() && in[end] == '"') {
+        end_string(in.substr(start, end - start));
+        return end + 1;
+    }
+    _token.clear();
+    _state = state::string;
+    return start;
+}
+
+size_t stream_parser::parse_string(std::string_view in, size_t pos) {
+    while (pos < in.size()) {
+        if (_escaped) {
+            pos = parse_escape(in, pos);
+            continue;
+        }
+        auto end = find_plain_run_end(in, pos);
+        if (_high_surrogate && end != pos) {
+            fail("unpaired surrogate", pos);
+        }
+        _token.append(in.data() + pos, end - pos);
+        pos = end;
+        if (pos == in.size()) {
+            break;
+        }
+        auto c = in[pos++];
+        if (c == '"') {
+            if (_high_surrogate) {
+                fail("unpaired surrogate", pos - 1);
+            }
+            end_string(_token);
+            return pos;
+        } else if (c == '\\') {
+            _escaped = true;
+            _escape.clear();
+        } else {
+            fail("control character in string", pos - 1);
+        }
+    }
+    return pos;
+}
+
+void stream_parser::feed(std::string_view in) {
+    size_t pos = 0;
+    while (pos < in.size()) {
+        switch (_state) {
+        case state::string:
+            pos = parse_string(in, pos);
+            continue;
+        case state::number:
+        case state::literal: {
+            auto is_token_char = _state == state::number ? is_number_char : is_literal_char;
+            auto end = pos;
+            while (end < in.size() && is_token_char(in[end])) {
+                ++end;
+            }
+            _token.append(in.data() + pos, end - pos);
+            pos = end;
+            if (pos < in.size()) {
+                end_scalar(_token, pos);
+            }
+            continue;
+        }
+        default:
+            break;
+        }
+        pos = skip_whitespace(in, pos);
+        if (pos == in.size()) {
+            break;
+        }
+        auto c = in[pos];
+        switch (_state) {
+        case state::first_element:
+            if (c == ']') {
+                end_container(true, pos++);
+                break;
+            }
+            [[fallthrough]];
+        case state::value:
+            begin_value();
+            if (c == '{' || c == '[') {
+                begin_container(c == '[', pos++);
+            } else if (c == '"') {
+                _in_key = false;
+                pos = begin_string(in, pos);
+            } else if (c == '-' || (c >= '0' && c <= '9') || is_literal_char(c)) {
+                _state = c == '-' || (c >= '0' && c <= '9') ? state::number : state::literal;
+                auto is_token_char = _state == state::number ? is_number_char : is_literal_char;
+                auto end = pos;
+                while (end < in.size() && is_token_char(in[end])) {
+                    ++end;
+                }
+                if (end < in.size()) {
+                    end_scalar(in.substr(pos, end - pos), end);
+                } else {
+                    _token.assign(in.data() + pos, end - pos);
+                }
+                pos = end;
+            } else {
+                fail("unexpected character", pos);
+            }
+            break;
+        case state::first_key:
+            if (c == '}') {
+                end_container(false, pos++);
+                break;
+            }
+            [[fallthrough]];
+        case state::key:
+            if (c != '"') {
+                fail("expected a key", pos);
+            }
+            _in_key = true;
+            pos = begin_string(in, pos);
+            break;
+        case state::colon:
+            if (c != ':') {
+                fail("expected a colon", pos);
+            }
+            _state = state::value;
+            ++pos;
+            break;
+        case state::next:
+            if (c == ',') {
+                _state = _stack.back().array ? state::value : state::key;
+                ++pos;
+            } else if (c == ']' || c == '}') {
+                end_container(c == ']', pos++);
+            } else {
+                fail("expected a comma", pos);
+            }
+            break;
+        case state::done:
+            fail("unexpected character after the value", pos);
+        default:
+            break;
+        }
+    }
+    _offset += in.size();
+}
+
+void stream_parser::finish() {
+    if (_state == state::number || _state == state::literal) {
+        end_scalar(_token, 0);
+    }
+    if (_state != state::done) {
+        fail("unexpected end of input", 0);
+    }
+}
+
+future<> parse(input_stream<char>& in, value_sink& sink, size_t max_depth) {
+    return do_with(stream_parser(sink, max_depth), [&in] (stream_parser& parser) {
+        return repeat([&in, &parser] {
+            return in.read().then([&parser] (temporary_buffer<char> buf) {
+                if (buf.empty()) {
+                    parser.finish();
+                    return stop_iteration::yes;
+                }
+                parser.feed(std::string_view(buf.get(), buf.size()));
+                return stop_iteration::no;
+            });
+        });
+    });
+}
+
+namespace internal {
+
+void parse_json_date_time(std::string_view s, std::tm& d) {
+    // In UTC
+    std::string str(s);
+    d = {};
+    auto end = ::strptime(str.c_str(), "%Y-%m-%dT%H:%M:%S", &d);
+    if (!end || (*end && std::string_view(end) != "Z")) {
+        throw json::parse_error(fmt::format("invalid date {}", s));
+    }
+}
+
+}
+
+}
+
+}
@@ -0,0 +1,200 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string_view>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/json/stream_writer.hh>
+#include <seastar/json/json_elements.hh>
+#endif
+
+namespace seastar {
+
+namespace json {
+
+stream_writer::stream_writer(output_stream<char>& out, size_t chunk_size)
+    : _out(out)
+    , _chunk_size(chunk_size)
+    , _buf(chunk_size)
+{
+}
+
+void stream_writer::next_buffer(size_t n) {
+    if (_pos != 0) {
+        _buf.trim(_pos);
+        _full.push_back(std::move(_buf));
+    }
+    _buf = temporary_buffer<char>(std::max(n, _chunk_size));
+    _pos = 0;
+}
+
+void stream_writer::append(std::string_view s) {
+    while (!s.empty()) {
+        if (_pos == _buf.size()) {
+            next_buffer(1);
+        }
+        size_t n = std::min(s.size(), _buf.size() - _pos);
+        std::memcpy(_buf.get_write() + _pos, s.data(), n);
+        _pos += n;
+        s.remove_prefix(n);
+    }
+}
+
+static inline bool needs_escaping(char c) {
+    return (c >= 0 && c <= 0x1F) || c == '"' || c == '\\';
+}
+
+void stream_writer::write_string(std::string_view s) {
+    static constexpr char hex[] = "0123456789ABCDEF";
+    append('"');
+    while (!s.empty()) {
+        // copy the longest run that needs no escaping at once
+        auto run = std::find_if(s.begin(), s.end(), needs_escaping) - s.begin();
+        append(s.substr(0, run));
+        if (size_t(run) == s.size()) {
+            break;
+        }
+        char c = s[run];
+        s.remove_prefix(run + 1);
+        switch (c) {
+        case '"': append("\\\""); break;
+        case '\\': append("\\\\"); break;
+        case '\b': append("\\b"); break;
+        case '\f': append("\\f"); break;
+        case '\n': append("\\n"); break;
+        case '\r': append("\\r"); break;
+        case '\t': append("\\t"); break;
+        default: {
+            char u[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+            append(std::string_view(u, sizeof(u)));
+        }
+        }
+    }
+    append('"');
+}
+
+void stream_writer::begin_array() {
+    separate();
+    append('[');
+    _nonempty.push_back(false);
+}
+
+void stream_writer::end_array() {
+    _nonempty.pop_back();
+    append(']');
+}
+
+void stream_writer::begin_object() {
+    separate();
+    append('{');
+    _nonempty.push_back(false);
+}
+
+void stream_writer::end_object() {
+    _nonempty.pop_back();
+    append('}');
+}
+
+void stream_writer::key(std::string_view name) {
+    separate();
+    write_string(name);
+    append(':');
+    _after_key = true;
+}
+
+void stream_writer::value(std::string_view s) {
+    separate();
+    write_string(s);
+}
+
+void stream_writer::value(bool b) {
+    raw(b ? "true" : "false");
+}
+
+void stream_writer::value(double d) {
+    if (std::isinf(d)) {
+        throw std::out_of_range("Infinite double value is not supported");
+    } else if (std::isnan(d)) {
+        throw std::invalid_argument("Invalid double value");
+    }
+    write_number(d);
+}
+
+void stream_writer::value(float f) {
+    if (std::isinf(f)) {
+        throw std::out_of_range("Infinite float value is not supported");
+    } else if (std::isnan(f)) {
+        throw std::invalid_argument("Invalid float value");
+    }
+    write_number(f);
+}
+
+void stream_writer::value(const date_time& d) {
+    // the same RFC3339 format as formatter::to_json(const date_time&)
+    separate();
+    constexpr size_t max_size = 50;
+    char* p = reserve(max_size);
+    *p = '"';
+    size_t n = strftime(p + 1, max_size - 2, "%FT%TZ", &d);
+    p[n + 1] = '"';
+    _pos += n + 2;
+}
+
+void stream_writer::null() {
+    raw("null");
+}
+
+void stream_writer::raw(std::string_view json) {
+    separate();
+    append(json);
+}
+
+future<> stream_writer::write_full() {
+    auto full = std::exchange(_full, {});
+    for (auto& buf : full) {
+        co_await _out.write(std::move(buf));
+    }
+}
+
+future<> stream_writer::flush() {
+    if (_pos != 0) {
+        _buf.trim(_pos);
+        _full.push_back(std::exchange(_buf, temporary_buffer<char>(_chunk_size)));
+        _pos = 0;
+    }
+    co_await write_full();
+    co_await _out.flush();
+}
+
+}
+
+}
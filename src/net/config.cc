@@ -46,7 +46,7 @@ namespace seastar {
 namespace net {
 
     // list of supported config keys
-    std::string config_keys[]{ "pci-address", "port-index", "ip", "gateway", "netmask", "dhcp", "lro", "tso", "ufo", "hw-fc", "event-index", "csum-offload","ring-size" };
+    std::string config_keys[]{ "pci-address", "port-index", "ip", "gateway", "netmask", "dhcp", "lro", "tso", "ufo", "hw-fc", "event-index", "csum-offload","ring-size", "rx-interrupt-idle-ms", "rss-rebalance-period-ms" };
 
     std::unordered_map<std::string, device_config>
     parse_config(std::istream& input) {
@@ -147,6 +147,14 @@ struct convert<seastar::net::device_config> {
             dev_cfg.hw_cfg.ring_size = node["ring-size"].as<unsigned>();
         }
 
+        if (node["rx-interrupt-idle-ms"]) {
+            dev_cfg.hw_cfg.rx_interrupt_idle_ms = node["rx-interrupt-idle-ms"].as<unsigned>();
+        }
+
+        if (node["rss-rebalance-period-ms"]) {
+            dev_cfg.hw_cfg.rss_rebalance_period_ms = node["rss-rebalance-period-ms"].as<unsigned>();
+        }
+
         if (node["ip"]) {
             dev_cfg.ip_cfg.ip = node["ip"].as<std::string>();
         }
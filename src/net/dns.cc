@@ -21,6 +21,7 @@
 
 #include <arpa/nameser.h>
 #include <chrono>
+#include <limits>
 
 #include <ares.h>
 #include <boost/lexical_cast.hpp>
@@ -37,7 +38,10 @@
 #include <seastar/core/timer.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/gate.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/metrics.hh>
 #include <seastar/core/print.hh>
+#include <seastar/core/shared_future.hh>
 
 namespace seastar::net {
 
@@ -151,10 +155,35 @@ class dns_resolver::impl
                                         const sstring& domain);
     future<sstring> resolve_addr(inet_address addr);
     future<> close();
+    const cache_stats& get_cache_stats() const noexcept {
+        return _cache_stats;
+    }
 private:
     enum class type {
         none, tcp, udp
     };
+
+    struct resolved_host {
+        hostent host;
+        // the lowest TTL of the records
+        std::chrono::seconds ttl;
+    };
+    future<resolved_host> query_host_by_name(sstring name, int af);
+
+    using cache_key = std::pair<sstring, int>;
+    struct cache_key_hash {
+        size_t operator()(const cache_key& k) const noexcept {
+            return std::hash<sstring>()(k.first) ^ k.second;
+        }
+    };
+    struct cache_entry {
+        shared_promise<hostent> result;
+        // time_point::max() while the query is in flight
+        lowres_clock::time_point expires = lowres_clock::time_point::max();
+        uint64_t id;
+    };
+    void cache_result(const cache_key& key, uint64_t id, future<resolved_host> f) noexcept;
+    void evict_expired(lowres_clock::time_point now) noexcept;
     struct dns_call {
         dns_call(impl & i)
             : _i(i)
@@ -181,6 +210,7 @@ class dns_resolver::impl
     static srv_records make_srv_records(ares_srv_reply* start);
     static hostent make_hostent(const ares_addrinfo* ai);
     static hostent make_hostent(const ::hostent& host);
+    static std::chrono::seconds min_ttl(const ares_addrinfo* ai);
 
     // We need to partially ref-count our socket entries
     // when we have pending reads/writes, so we don't erase the
@@ -278,12 +308,23 @@ class dns_resolver::impl
     timer<> _timer;
     gate _gate;
     bool _closed = false;
+
+    std::chrono::seconds _cache_max_ttl;
+    std::chrono::seconds _negative_cache_ttl;
+    size_t _cache_size;
+    std::unordered_map<cache_key, cache_entry, cache_key_hash> _cache;
+    uint64_t _next_cache_id = 0;
+    cache_stats _cache_stats;
+    metrics::metric_groups _metrics;
 };
 
 dns_resolver::impl::impl(network_stack& stack, const options& opts)
     : _stack(stack)
     , _timeout(opts.timeout ? *opts.timeout : std::chrono::milliseconds(5000) /* from ares private */)
     , _timer(std::bind(&impl::poll_sockets, this))
+    , _cache_max_ttl(opts.cache_max_ttl.value_or(std::chrono::minutes(5)))
+    , _negative_cache_ttl(opts.negative_cache_ttl.value_or(std::chrono::seconds(5)))
+    , _cache_size(opts.cache_size.value_or(1024))
 {
     static const ares_initializer a_init;
 
@@ -362,6 +403,19 @@ dns_resolver::impl::impl(network_stack& stack, const options& opts)
 
     // just in case you need printf-debug.
     // dns_log.set_level(log_level::trace);
+
+    if (_cache_max_ttl.count()) {
+        static thread_local unsigned idgen;
+        namespace sm = seastar::metrics;
+        std::vector<sm::label_instance> labels{sm::label_instance("resolver", format("dns-{}", idgen++))};
+        _metrics.add_group("dns_resolver", {
+            sm::make_counter("cache_hits", _cache_stats.hits, sm::description("Names resolved from the cache"), labels),
+            sm::make_counter("cache_negative_hits", _cache_stats.negative_hits, sm::description("Names found in the cache as not existing"), labels),
+            sm::make_counter("cache_coalesced", _cache_stats.coalesced, sm::description("Names resolved by joining a query in flight for the same name"), labels),
+            sm::make_counter("cache_misses", _cache_stats.misses, sm::description("Names sent to the DNS servers"), labels),
+            sm::make_gauge("cache_entries", [this] { return _cache.size(); }, sm::description("Names in the cache"), labels),
+        });
+    }
 }
 
 dns_resolver::impl::~impl() {
@@ -380,14 +434,6 @@ dns_resolver::impl::resolve_name(sstring name, opt_family family) {
 
 future<hostent>
 dns_resolver::impl::get_host_by_name(sstring name, opt_family family)  {
-    class promise_wrap : public promise<hostent> {
-    public:
-        promise_wrap(sstring s)
-            : name(std::move(s))
-        {}
-        sstring name;
-    };
-
     dns_log.debug("Query name {} ({})", name, family);
 
     if (!family) {
@@ -397,13 +443,112 @@ dns_resolver::impl::get_host_by_name(sstring name, opt_family family)  {
         }
     }
 
+    auto af = family ? int(*family) : AF_UNSPEC;
+    auto uncached = [&] {
+        return query_host_by_name(std::move(name), af).then([] (resolved_host r) {
+            return std::move(r.host);
+        });
+    };
+    if (!_cache_max_ttl.count()) {
+        return uncached();
+    }
+
+    auto now = lowres_clock::now();
+    cache_key key(name, af);
+    if (auto it = _cache.find(key); it != _cache.end()) {
+        auto& e = it->second;
+        if (e.expires > now) {
+            if (!e.result.available()) {
+                _cache_stats.coalesced++;
+            } else if (e.result.failed()) {
+                _cache_stats.negative_hits++;
+            } else {
+                _cache_stats.hits++;
+            }
+            return e.result.get_shared_future();
+        }
+        _cache.erase(it);
+    }
+    _cache_stats.misses++;
+    if (_cache.size() >= _cache_size) {
+        evict_expired(now);
+        if (_cache.size() >= _cache_size) {
+            return uncached();
+        }
+    }
+
+    // The entry goes in first, as the query may complete right away
+    auto id = ++_next_cache_id;
+    auto& e = _cache.emplace(key, cache_entry{.id = id}).first->second;
+    auto f = e.result.get_shared_future();
+    (void)query_host_by_name(std::move(name), af).then_wrapped([this, self = shared_from_this(), key = std::move(key), id] (future<resolved_host> f) mutable {
+        cache_result(key, id, std::move(f));
+    });
+    return f;
+}
+
+void
+dns_resolver::impl::cache_result(const cache_key& key, uint64_t id, future<resolved_host> f) noexcept {
+    auto it = _cache.find(key);
+    if (it == _cache.end() || it->second.id != id) {
+        // Cannot happen while the query is in flight, but let's not
+        // resolve someone else's promise
+        f.ignore_ready_future();
+        return;
+    }
+    auto& e = it->second;
+    auto now = lowres_clock::now();
+    if (f.failed()) {
+        auto ex = f.get_exception();
+        // Only the answers saying the name does not exist are cached
+        bool negative = false;
+        try {
+            std::rethrow_exception(ex);
+        } catch (const std::system_error& err) {
+            negative = err.code().category() == dns::error_category()
+                    && (err.code().value() == ARES_ENOTFOUND || err.code().value() == ARES_ENODATA);
+        } catch (...) {
+        }
+        e.result.set_exception(std::move(ex));
+        if (negative && _negative_cache_ttl.count()) {
+            e.expires = now + _negative_cache_ttl;
+        } else {
+            _cache.erase(it);
+        }
+        return;
+    }
+    auto r = f.get();
+    e.result.set_value(std::move(r.host));
+    auto ttl = std::min(r.ttl, _cache_max_ttl);
+    if (ttl.count() > 0) {
+        e.expires = now + ttl;
+    } else {
+        _cache.erase(it);
+    }
+}
+
+void
+dns_resolver::impl::evict_expired(lowres_clock::time_point now) noexcept {
+    std::erase_if(_cache, [now] (const auto& kv) {
+        return kv.second.expires <= now;
+    });
+}
+
+future<dns_resolver::impl::resolved_host>
+dns_resolver::impl::query_host_by_name(sstring name, int af)  {
+    class promise_wrap : public promise<resolved_host> {
+    public:
+        promise_wrap(sstring s)
+            : name(std::move(s))
+        {}
+        sstring name;
+    };
+
     auto p = new promise_wrap(std::move(name));
     auto f = p->get_future();
 
     dns_call call(*this);
 
-    auto af = family ? int(*family) : AF_UNSPEC;
-
 // The following pragma is needed to work around a false-positive warning
 // in Gcc 11 (see https://gcc.gnu.org/bugzilla/show_bug.cgi?id=96003).
 #pragma GCC diagnostic ignored "-Wnonnull"
@@ -425,7 +570,7 @@ dns_resolver::impl::get_host_by_name(sstring name, opt_family family)  {
             p->set_exception(std::system_error(status, dns::error_category(), p->name));
             break;
         case ARES_SUCCESS:
-            p->set_value(make_hostent(addrinfo));
+            p->set_value(resolved_host{make_hostent(addrinfo), min_ttl(addrinfo)});
             break;
         }
         ares_freeaddrinfo(addrinfo);
@@ -744,6 +889,21 @@ dns_resolver::impl::make_hostent(const ares_addrinfo* ai) {
     return e;
 }
 
+std::chrono::seconds
+dns_resolver::impl::min_ttl(const ares_addrinfo* ai) {
+    if (!ai || !ai->nodes) {
+        return std::chrono::seconds(0);
+    }
+    int ttl = std::numeric_limits<int>::max();
+    for (auto node = ai->nodes; node != nullptr; node = node->ai_next) {
+        ttl = std::min(ttl, node->ai_ttl);
+    }
+    for (auto cname = ai->cnames; cname != nullptr; cname = cname->next) {
+        ttl = std::min(ttl, cname->ttl);
+    }
+    return std::chrono::seconds(std::max(ttl, 0));
+}
+
 hostent
 dns_resolver::impl::make_hostent(const ::hostent& host) {
     hostent e;
@@ -1247,6 +1407,10 @@ future<dns_resolver::srv_records> dns_resolver::get_srv_records(dns_resolver::sr
     return _impl->get_srv_records(proto, service, domain);
 }
 
+const dns_resolver::cache_stats& dns_resolver::get_cache_stats() const noexcept {
+    return _impl->get_cache_stats();
+}
+
 future<> dns_resolver::close() {
     return _impl->close();
 }
@@ -25,6 +25,7 @@ module;
 #endif
 
 #include <cinttypes>
+#include <algorithm>
 #include <atomic>
 #include <iostream>
 #include <vector>
@@ -40,9 +41,13 @@ module;
 #include <rte_ethdev.h>
 #include <rte_cycles.h>
 #include <rte_memzone.h>
+#include <rte_memory.h>
+#include <rte_dev.h>
+#include <rte_errno.h>
 #include <rte_vfio.h>
 
 #include <boost/preprocessor.hpp>
+#include <boost/range/irange.hpp>
 
 #ifdef SEASTAR_MODULE
 module seastar;
@@ -57,6 +62,8 @@ module seastar;
 #include <seastar/core/memory.hh>
 #include <seastar/core/metrics.hh>
 #include <seastar/core/internal/poll.hh>
+#include <seastar/core/internal/pollable_fd.hh>
+#include <seastar/core/loop.hh>
 #include <seastar/core/units.hh>
 #include <seastar/util/assert.hh>
 #include <seastar/util/function_input_iterator.hh>
@@ -69,6 +76,8 @@ module seastar;
 #include <seastar/net/toeplitz.hh>
 #include <seastar/net/native-stack.hh>
 #include "core/vla.hh"
+#include "net/dpdk_extmem.hh"
+#include "net/dpdk_rss.hh"
 #endif
 
 #if RTE_VERSION <= RTE_VERSION_NUM(2,0,0,16)
@@ -351,7 +360,20 @@ class dpdk_device : public device {
     unsigned _home_cpu;
     bool _use_lro;
     bool _enable_fc;
+    // 0 without RX interrupts
+    std::chrono::milliseconds _rx_interrupt_idle;
+    // Written by the shard owning an entry only once _dynamic_rss is set,
+    // see rebalance_rss()
     std::vector<uint8_t> _redir_table;
+    // 0 without rebalancing
+    std::chrono::milliseconds _rss_rebalance_period;
+    timer<> _rss_rebalancer;
+    // Indexed by shard, then by entry of the redirection table, and only
+    // written by their shard: the packets received since the last
+    // rebalancing, and the open flows
+    std::vector<std::vector<uint32_t>> _reta_packets;
+    std::vector<std::vector<uint32_t>> _reta_flows;
+    uint64_t _reta_entries_moved = 0;
     rss_key_type _rss_key;
     port_stats _stats;
     timer<> _stats_collector;
@@ -406,14 +428,35 @@ class dpdk_device : public device {
      */
     void set_hw_flow_control();
 
+    /**
+     * Moves entries of the redirection table from the queues which received
+     * notably more packets than the others over the last period to the ones
+     * which received the least.
+     *
+     * Only entries without open flows are moved, by the shard owning them
+     * so that no flow can be opened meanwhile, which makes the new flows
+     * land on the idle shards while the established ones stay where they
+     * are. The HW table is updated afterwards, forward_dst() taking the
+     * packets the NIC still steers to the former owner to the new one.
+     */
+    future<> rebalance_rss();
+
+    /**
+     * Writes the given entries of _redir_table to the HW redirection table.
+     */
+    void update_rss_table(const std::vector<unsigned>& entries);
+
 public:
     dpdk_device(uint16_t port_idx, uint16_t num_queues, bool use_lro,
-                bool enable_fc)
+                bool enable_fc, std::chrono::milliseconds rx_interrupt_idle,
+                std::chrono::milliseconds rss_rebalance_period)
         : _port_idx(port_idx)
         , _num_queues(num_queues)
         , _home_cpu(this_shard_id())
         , _use_lro(use_lro)
         , _enable_fc(enable_fc)
+        , _rx_interrupt_idle(rx_interrupt_idle)
+        , _rss_rebalance_period(rss_rebalance_period)
         , _stats_plugin_name("network")
         , _stats_plugin_inst(std::string("port") + std::to_string(_port_idx))
         , _xstats(port_idx)
@@ -474,11 +517,15 @@ class dpdk_device : public device {
 
             sm::make_counter("tx_errors", _stats.tx.bad.total,
                             sm::description("Counts a total number of egress errors. A non-zero value usually indicated a problem with a HW or a SW driver."), {sm::shard_label(_stats_plugin_inst)}),
+
+            sm::make_counter("rss_entries_moved", _reta_entries_moved,
+                            sm::description("Counts a number of RSS redirection table entries moved to another queue to even out the load of the queues."), {sm::shard_label(_stats_plugin_inst)}),
         });
     }
 
     ~dpdk_device() {
         _stats_collector.cancel();
+        _rss_rebalancer.cancel();
     }
 
     ethernet_address hw_address() override {
@@ -493,6 +540,10 @@ class dpdk_device : public device {
 
     net::hw_features& hw_features_ref() { return _hw_features; }
 
+    std::chrono::milliseconds rx_interrupt_idle() const {
+        return _rx_interrupt_idle;
+    }
+
     const rte_eth_rxconf* def_rx_conf() const {
         return &_dev_info.default_rxconf;
     }
@@ -511,7 +562,18 @@ class dpdk_device : public device {
     virtual std::unique_ptr<qp> init_local_queue(const program_options::option_group& opts, uint16_t qid) override;
     virtual unsigned hash2qid(uint32_t hash) override {
         SEASTAR_ASSERT(_redir_table.size());
-        return _redir_table[hash & (_redir_table.size() - 1)];
+        return std::atomic_ref(_redir_table[hash & (_redir_table.size() - 1)]).load(std::memory_order_relaxed);
+    }
+    virtual void flow_opened(uint32_t hash) override {
+        ++_reta_flows[this_shard_id()][hash & (_redir_table.size() - 1)];
+    }
+    virtual void flow_closed(uint32_t hash) override {
+        --_reta_flows[this_shard_id()][hash & (_redir_table.size() - 1)];
+    }
+    void count_rx(uint32_t hash) {
+        if (_dynamic_rss) {
+            ++_reta_packets[this_shard_id()][hash & (_redir_table.size() - 1)];
+        }
     }
     uint16_t port_idx() { return _port_idx; }
     bool is_i40e_device() const {
@@ -639,6 +701,9 @@ class dpdk_qp : public net::qp {
                 head->l3_len = oi.ip_hdr_len;
             }
             if (qp.port().hw_features().tx_csum_l4_offload) {
+                if (oi.ipv6 && (oi.protocol == ip_protocol_num::tcp || oi.protocol == ip_protocol_num::udp)) {
+                    head->ol_flags |= RTE_MBUF_F_TX_IPV6;
+                }
                 if (oi.protocol == ip_protocol_num::tcp) {
                     head->ol_flags |= RTE_MBUF_F_TX_TCP_CKSUM;
                     // TODO: Take a VLAN header into an account here
@@ -961,7 +1026,7 @@ class dpdk_qp : public net::qp {
             // devices have a 15.5K limitation on a maximum single fragment
             // size.
             //
-            rte_iova_t iova = rte_mem_virt2iova(va);
+            rte_iova_t iova = qp.dma_mapped(va, buf_len) ? rte_mem_virt2iova(va) : RTE_BAD_IOVA;
 
             if (iova == RTE_BAD_IOVA) {
                 return copy_one_data_buf(qp, m, va, buf_len);
@@ -1175,9 +1240,8 @@ class dpdk_qp : public net::qp {
             // Take completed from the HW first
             tx_buf *pkt = get_one_completed();
             if (pkt) {
-                if (HugetlbfsMemBackend) {
-                    pkt->reset_zc();
-                }
+                // Zero-copy buffers are sent from external memory too
+                pkt->reset_zc();
 
                 return pkt;
             }
@@ -1197,9 +1261,7 @@ class dpdk_qp : public net::qp {
         }
 
         void put(tx_buf* buf) {
-            if (HugetlbfsMemBackend) {
-                buf->reset_zc();
-            }
+            buf->reset_zc();
             _ring.push_back(buf);
         }
 
@@ -1258,10 +1320,12 @@ class dpdk_qp : public net::qp {
     virtual future<> send(packet p) override {
         abort();
     }
-    virtual ~dpdk_qp() {}
+    virtual ~dpdk_qp() {
+        unregister_extmem();
+    }
 
     virtual uint32_t send(circular_buffer<packet>& pb) override {
-        if (HugetlbfsMemBackend) {
+        if (HugetlbfsMemBackend || _extmem) {
             // Zero-copy send
             return _send(pb, [&] (packet&& p) {
                 return tx_buf::from_packet_zc(std::move(p), *this);
@@ -1362,6 +1426,23 @@ class dpdk_qp : public net::qp {
 
     bool init_rx_mbuf_pool();
     bool map_dma();
+    bool register_extmem();
+    void unregister_extmem() noexcept;
+
+    /**
+     * Checks whether the device can DMA the given buffer directly.
+     *
+     * With a hugetlbfs backend all the memory is pinned and translatable.
+     * Otherwise only the shard's memory registered by register_extmem() is,
+     * and anything else (e.g. static data or memory of other shards) has to
+     * be copied.
+     */
+    bool dma_mapped(const char* va, size_t len) const {
+        if (HugetlbfsMemBackend) {
+            return true;
+        }
+        return _extmem && _extmem->contains(va, len);
+    }
     bool rx_gc();
     bool refill_one_cluster(rte_mbuf* head);
 
@@ -1391,6 +1472,27 @@ class dpdk_qp : public net::qp {
      */
     bool poll_rx_once();
 
+    /**
+     * Checks whether a packet is waiting in the RX queue, without receiving
+     * it.
+     */
+    bool rx_pending();
+
+    /**
+     * Sets up the RX interrupt of the queue if the device was configured
+     * with RX interrupts and the PMD supports them.
+     */
+    void init_rx_interrupt();
+
+    /**
+     * Arms the RX interrupt, for the reactor to sleep until a packet
+     * arrives, once the queue was idle for dpdk_device::rx_interrupt_idle().
+     *
+     * @return true if the reactor may sleep.
+     */
+    bool try_enter_rx_interrupt_mode();
+    void exit_rx_interrupt_mode();
+
     /**
      * Translates an rte_mbuf's into net::packet and feeds them to _rx_stream.
      *
@@ -1417,6 +1519,35 @@ class dpdk_qp : public net::qp {
      */
     std::optional<packet> from_mbuf_lro(rte_mbuf* m);
 
+    /**
+     * Translate rte_mbuf's whose data buffers come from the seastar heap
+     * (see init_rx_mbuf_pool()) into the "packet", without copying: the
+     * buffers are handed over to the packet and the mbufs are refilled by
+     * rx_gc().
+     */
+    std::optional<packet> from_heap_mbuf(rte_mbuf* m);
+    std::optional<packet> from_heap_mbuf_lro(rte_mbuf* m);
+
+    // Polls the RX queue, switching it to interrupt mode when the reactor
+    // is about to sleep
+    class rx_pollfn final : public pollfn {
+        dpdk_qp& _qp;
+    public:
+        explicit rx_pollfn(dpdk_qp& qp) : pollfn(internal::loop_phase::network), _qp(qp) {}
+        virtual bool poll() override {
+            return _qp.poll_rx_once();
+        }
+        virtual bool pure_poll() override {
+            return _qp.rx_pending();
+        }
+        virtual bool try_enter_interrupt_mode() override {
+            return _qp.try_enter_rx_interrupt_mode();
+        }
+        virtual void exit_interrupt_mode() override {
+            _qp.exit_rx_interrupt_mode();
+        }
+    };
+
 private:
     dpdk_device* _dev;
     uint16_t _qid;
@@ -1433,6 +1564,14 @@ class dpdk_qp : public net::qp {
     internal::poller _tx_gc_poller;
     std::vector<rte_mbuf*> _tx_burst;
     uint16_t _tx_burst_idx = 0;
+    // A dup of the event fd of the RX interrupt, when in use
+    std::optional<pollable_fd> _rx_intr_fd;
+    // Resolves when the interrupt fires, while the reactor sleeps
+    std::optional<future<>> _rx_intr_wakeup;
+    bool _rx_intr_enabled = false;
+    steady_clock_type::time_point _last_rx;
+    // The shard's memory, when registered as DPDK external memory
+    std::optional<extmem_range> _extmem;
     static constexpr phys_addr_t page_mask = ~(memory::page_size - 1);
 };
 
@@ -1505,6 +1644,10 @@ int dpdk_device::init_port_start()
     /* setting tx offloads for port */
     port_conf.txmode.offloads = _dev_info.default_txconf.offloads;
 
+    if (_rx_interrupt_idle.count()) {
+        port_conf.intr_conf.rxq = 1;
+    }
+
     printf("Port %d: max_rx_queues %d max_tx_queues %d\n",
            _port_idx, _dev_info.max_rx_queues, _dev_info.max_tx_queues);
 
@@ -1559,6 +1702,18 @@ int dpdk_device::init_port_start()
         _redir_table.push_back(0);
     }
 
+    if (_rss_rebalance_period.count()) {
+        // Without proxy queues an entry belongs to a single shard, which
+        // can tell whether it has open flows
+        if (_num_queues > 1 && _dev_info.reta_size && _num_queues == smp::count) {
+            _dynamic_rss = true;
+            _reta_packets.assign(smp::count, std::vector<uint32_t>(_redir_table.size()));
+            _reta_flows.assign(smp::count, std::vector<uint32_t>(_redir_table.size()));
+        } else {
+            printf("Port %d: RSS rebalancing needs a queue per shard and an RSS table, disabled\n", _port_idx);
+        }
+    }
+
     // Set Rx VLAN stripping
     if (_dev_info.rx_offload_capa & RTE_ETH_RX_OFFLOAD_VLAN_STRIP) {
         port_conf.rxmode.offloads |= RTE_ETH_RX_OFFLOAD_VLAN_STRIP;
@@ -1734,6 +1889,18 @@ void dpdk_device::init_port_fini()
         set_rss_table();
     }
 
+    if (_dynamic_rss) {
+        _rss_rebalancer.set_callback([this] {
+            // FIXME: future is discarded
+            (void)rebalance_rss().then_wrapped([this] (future<> f) {
+                // Nothing was moved if it failed, the next round starts afresh
+                f.ignore_ready_future();
+                _rss_rebalancer.arm(_rss_rebalance_period);
+            });
+        });
+        _rss_rebalancer.arm(_rss_rebalance_period);
+    }
+
     // Wait for a link
     check_port_link_status();
 
@@ -1782,7 +1949,13 @@ bool dpdk_qp<HugetlbfsMemBackend>::init_rx_mbuf_pool()
     // memory for DPDK pools and this way significantly reduce the memory needed
     // for the DPDK in this case.
     //
-    if (HugetlbfsMemBackend) {
+    // The same goes for the shard's memory registered as DPDK external
+    // memory. Either way the NIC receives straight into seastar heap
+    // buffers, which become the packets' data as they are, and the mbufs
+    // get fresh buffers: a slow consumer holds on to heap memory only, and
+    // never drains the pool.
+    //
+    if (HugetlbfsMemBackend || _extmem) {
         size_t xmem_size;
 
         _rx_xmem.reset(alloc_mempool_xmem(mbufs_per_queue_rx, mbuf_overhead,
@@ -1876,6 +2049,55 @@ bool dpdk_qp<HugetlbfsMemBackend>::map_dma()
                                       m.start, iova, m.end - m.start) == 0;
 }
 
+// Register the shard's memory as DPDK external memory and map it for the
+// device's DMA, so that Tx can send packets from it without copying even
+// without a hugetlbfs backend. The addresses the device sees are the virtual
+// ones, hence this needs the IOVA as VA mode.
+template <bool HugetlbfsMemBackend>
+bool dpdk_qp<HugetlbfsMemBackend>::register_extmem()
+{
+    if (rte_eal_iova_mode() != RTE_IOVA_VA) {
+        return false;
+    }
+
+    auto m = extmem_range::of_this_shard();
+    auto addr = reinterpret_cast<void*>(m.start);
+    size_t len = m.size();
+
+    if (rte_extmem_register(addr, len, nullptr, 0, memory::page_size) < 0 && rte_errno != EEXIST) {
+        printf("Failed to register memory as DPDK external memory: %s\n", rte_strerror(rte_errno));
+        return false;
+    }
+
+    struct rte_eth_dev_info dev_info;
+    if (rte_eth_dev_info_get(_dev->port_idx(), &dev_info) != 0 ||
+        rte_dev_dma_map(dev_info.device, addr, m.start, len) < 0) {
+        printf("Failed to map external memory for DMA: %s\n", rte_strerror(rte_errno));
+        rte_extmem_unregister(addr, len);
+        return false;
+    }
+
+    _extmem = m;
+    return true;
+}
+
+template <bool HugetlbfsMemBackend>
+void dpdk_qp<HugetlbfsMemBackend>::unregister_extmem() noexcept
+{
+    if (!_extmem) {
+        return;
+    }
+
+    auto addr = reinterpret_cast<void*>(_extmem->start);
+    size_t len = _extmem->size();
+    struct rte_eth_dev_info dev_info;
+    if (rte_eth_dev_info_get(_dev->port_idx(), &dev_info) == 0) {
+        rte_dev_dma_unmap(dev_info.device, addr, _extmem->start, len);
+    }
+    rte_extmem_unregister(addr, len);
+    _extmem.reset();
+}
+
 void dpdk_device::check_port_link_status()
 {
     using namespace std::literals::chrono_literals;
@@ -1921,10 +2143,17 @@ template <bool HugetlbfsMemBackend>
 dpdk_qp<HugetlbfsMemBackend>::dpdk_qp(dpdk_device* dev, uint16_t qid,
                                       const std::string stats_plugin_name)
      : qp(true, stats_plugin_name, qid), _dev(dev), _qid(qid),
-       _rx_gc_poller(reactor::poller::simple([&] { return rx_gc(); })),
+       _rx_gc_poller(internal::make_idle_pollfn([&] { return rx_gc(); }, internal::loop_phase::network)),
        _tx_buf_factory(qid),
-       _tx_gc_poller(reactor::poller::simple([&] { return _tx_buf_factory.gc(); }))
+       _tx_gc_poller(internal::make_idle_pollfn([&] { return _tx_buf_factory.gc(); }, internal::loop_phase::network))
 {
+    // Without a hugetlbfs backend Rx and Tx copy packets between mbufs and
+    // the seastar heap, unless the shard's memory can be handed to the
+    // device directly
+    if (!HugetlbfsMemBackend && register_extmem()) {
+        printf("Port %u queue %u: zero-copy Rx and Tx from external memory\n", _dev->port_idx(), _qid);
+    }
+
     if (!init_rx_mbuf_pool()) {
         rte_exit(EXIT_FAILURE, "Cannot initialize mbuf pools\n");
     }
@@ -1974,7 +2203,79 @@ dpdk_qp<HugetlbfsMemBackend>::dpdk_qp(dpdk_device* dev, uint16_t qid,
 
 template <bool HugetlbfsMemBackend>
 void dpdk_qp<HugetlbfsMemBackend>::rx_start() {
-    _rx_poller = reactor::poller::simple([&] { return poll_rx_once(); });
+    init_rx_interrupt();
+    _rx_poller.emplace(std::make_unique<rx_pollfn>(*this));
+}
+
+template <bool HugetlbfsMemBackend>
+void dpdk_qp<HugetlbfsMemBackend>::init_rx_interrupt() {
+    if (!_dev->rx_interrupt_idle().count()) {
+        return;
+    }
+    // Needed to close the race with a packet arriving as the interrupt is
+    // enabled
+    if (rte_eth_rx_descriptor_status(_dev->port_idx(), _qid, 0) < 0) {
+        printf("Port %u queue %u: no Rx descriptor status, polling continuously\n", _dev->port_idx(), _qid);
+        return;
+    }
+    int fd = rte_eth_dev_rx_intr_ctl_q_get_fd(_dev->port_idx(), _qid);
+    if (fd < 0) {
+        printf("Port %u queue %u: no Rx interrupt, polling continuously\n", _dev->port_idx(), _qid);
+        return;
+    }
+    // DPDK keeps the fd, the dup shares its file description
+    auto intr_fd = file_desc::from_fd(::fcntl(fd, F_DUPFD_CLOEXEC, 0));
+    ::fcntl(intr_fd.get(), F_SETFL, ::fcntl(intr_fd.get(), F_GETFL) | O_NONBLOCK);
+    _rx_intr_fd.emplace(std::move(intr_fd));
+    _last_rx = steady_clock_type::now();
+}
+
+template <bool HugetlbfsMemBackend>
+bool dpdk_qp<HugetlbfsMemBackend>::rx_pending() {
+    if (!_rx_intr_fd) {
+        return poll_rx_once();
+    }
+    return rte_eth_rx_descriptor_status(_dev->port_idx(), _qid, 0) == RTE_ETH_RX_DESC_DONE;
+}
+
+template <bool HugetlbfsMemBackend>
+bool dpdk_qp<HugetlbfsMemBackend>::try_enter_rx_interrupt_mode() {
+    if (!_rx_intr_fd || steady_clock_type::now() - _last_rx < _dev->rx_interrupt_idle()) {
+        return false;
+    }
+    if (rte_eth_dev_rx_intr_enable(_dev->port_idx(), _qid) != 0) {
+        return false;
+    }
+    _rx_intr_enabled = true;
+    // A packet which arrived before the interrupt was enabled doesn't raise it
+    if (rx_pending()) {
+        exit_rx_interrupt_mode();
+        return false;
+    }
+    if (!_rx_intr_wakeup) {
+        _rx_intr_wakeup = _rx_intr_fd->readable();
+    }
+    return true;
+}
+
+template <bool HugetlbfsMemBackend>
+void dpdk_qp<HugetlbfsMemBackend>::exit_rx_interrupt_mode() {
+    if (!_rx_intr_enabled) {
+        return;
+    }
+    rte_eth_dev_rx_intr_disable(_dev->port_idx(), _qid);
+    _rx_intr_enabled = false;
+    if (_rx_intr_wakeup && _rx_intr_wakeup->available()) {
+        _rx_intr_wakeup->ignore_ready_future();
+        _rx_intr_wakeup.reset();
+        // VFIO signals an eventfd, which reads as 8 bytes, UIO a counter of
+        // 4 bytes
+        auto fd = _rx_intr_fd->get_file_desc().get();
+        uint64_t count;
+        if (::read(fd, &count, sizeof(uint64_t)) < 0 && errno == EINVAL) {
+            (void)::read(fd, &count, sizeof(uint32_t));
+        }
+    }
 }
 
 template<>
@@ -2015,6 +2316,10 @@ template<>
 inline std::optional<packet>
 dpdk_qp<false>::from_mbuf(rte_mbuf* m)
 {
+    if (_extmem) {
+        return from_heap_mbuf(m);
+    }
+
     if (!_dev->hw_features_ref().rx_lro || rte_pktmbuf_is_contiguous(m)) {
         //
         // Try to allocate a buffer for packet's data. If we fail - give the
@@ -2044,6 +2349,19 @@ dpdk_qp<false>::from_mbuf(rte_mbuf* m)
 template<>
 inline std::optional<packet>
 dpdk_qp<true>::from_mbuf_lro(rte_mbuf* m)
+{
+    return from_heap_mbuf_lro(m);
+}
+
+template<>
+inline std::optional<packet> dpdk_qp<true>::from_mbuf(rte_mbuf* m)
+{
+    return from_heap_mbuf(m);
+}
+
+template <bool HugetlbfsMemBackend>
+inline std::optional<packet>
+dpdk_qp<HugetlbfsMemBackend>::from_heap_mbuf_lro(rte_mbuf* m)
 {
     _frags.clear();
     _bufs.clear();
@@ -2064,8 +2382,9 @@ dpdk_qp<true>::from_mbuf_lro(rte_mbuf* m)
                           }));
 }
 
-template<>
-inline std::optional<packet> dpdk_qp<true>::from_mbuf(rte_mbuf* m)
+template <bool HugetlbfsMemBackend>
+inline std::optional<packet>
+dpdk_qp<HugetlbfsMemBackend>::from_heap_mbuf(rte_mbuf* m)
 {
     _rx_free_pkts.push_back(m);
     _num_rx_free_segs += m->nb_segs;
@@ -2076,7 +2395,7 @@ inline std::optional<packet> dpdk_qp<true>::from_mbuf(rte_mbuf* m)
         return packet(fragment{data, rte_pktmbuf_data_len(m)},
                       make_free_deleter(data));
     } else {
-        return from_mbuf_lro(m);
+        return from_heap_mbuf_lro(m);
     }
 }
 
@@ -2179,6 +2498,7 @@ void dpdk_qp<HugetlbfsMemBackend>::process_packets(
         (*p).set_offload_info(oi);
         if (m->ol_flags & RTE_MBUF_F_RX_RSS_HASH) {
             (*p).set_rss_hash(m->hash.rss);
+            _dev->count_rx(m->hash.rss);
         }
 
         _dev->l2receive(std::move(*p));
@@ -2187,7 +2507,7 @@ void dpdk_qp<HugetlbfsMemBackend>::process_packets(
     _stats.rx.good.update_pkts_bunch(count);
     _stats.rx.good.update_frags_stats(nr_frags, bytes);
 
-    if (!HugetlbfsMemBackend) {
+    if (!HugetlbfsMemBackend && !_extmem) {
         _stats.rx.good.copy_frags = _stats.rx.good.nr_frags;
         _stats.rx.good.copy_bytes = _stats.rx.good.bytes;
     }
@@ -2205,6 +2525,9 @@ bool dpdk_qp<HugetlbfsMemBackend>::poll_rx_once()
     /* Now process the NIC packets read */
     if (likely(rx_count > 0)) {
         process_packets(buf, rx_count);
+        if (_rx_intr_fd) {
+            _last_rx = steady_clock_type::now();
+        }
     }
 
     return rx_count;
@@ -2239,6 +2562,71 @@ void dpdk_device::set_rss_table()
     }
 }
 
+void dpdk_device::update_rss_table(const std::vector<unsigned>& entries)
+{
+    std::vector<rte_eth_rss_reta_entry64> reta_conf(
+        std::max(1, _dev_info.reta_size / RTE_ETH_RETA_GROUP_SIZE));
+    for (auto i : entries) {
+        auto& x = reta_conf[i / RTE_ETH_RETA_GROUP_SIZE];
+        x.mask |= uint64_t(1) << (i % RTE_ETH_RETA_GROUP_SIZE);
+        x.reta[i % RTE_ETH_RETA_GROUP_SIZE] = std::atomic_ref(_redir_table[i]).load(std::memory_order_relaxed);
+    }
+
+    // Packets keep being forwarded in software if it fails
+    if (rte_eth_dev_rss_reta_update(_port_idx, reta_conf.data(), _dev_info.reta_size)) {
+        printf("Port %d: Failed to update an RSS indirection table\n", _port_idx);
+    }
+}
+
+future<> dpdk_device::rebalance_rss()
+{
+    auto packets = make_lw_shared<std::vector<uint64_t>>(_redir_table.size());
+    auto flows = make_lw_shared<std::vector<uint64_t>>(_redir_table.size());
+    return parallel_for_each(boost::irange(0u, smp::count), [this, packets, flows] (unsigned shard) {
+        return smp::submit_to(shard, [this] {
+            auto& rx = _reta_packets[this_shard_id()];
+            auto counts = std::make_pair(rx, _reta_flows[this_shard_id()]);
+            std::fill(rx.begin(), rx.end(), 0);
+            return counts;
+        }).then([packets, flows] (std::pair<std::vector<uint32_t>, std::vector<uint32_t>> counts) {
+            for (size_t i = 0; i != counts.first.size(); ++i) {
+                (*packets)[i] += counts.first[i];
+                (*flows)[i] += counts.second[i];
+            }
+        });
+    }).then([this, packets, flows] {
+        std::vector<std::vector<std::pair<unsigned, uint8_t>>> moves(_num_queues);
+        for (auto& m : plan_rss_rebalance(_redir_table, *packets, *flows, _num_queues)) {
+            moves[_redir_table[m.first]].push_back(m);
+        }
+        auto moved = make_lw_shared<std::vector<unsigned>>();
+        return parallel_for_each(boost::irange(0u, unsigned(_num_queues)), [this, &moves, moved] (unsigned q) {
+            if (moves[q].empty()) {
+                return make_ready_future<>();
+            }
+            return smp::submit_to(q, [this, moves = std::move(moves[q])] {
+                // A flow may have been opened since the counts were
+                // gathered, or a packet which opens one may be on its way
+                std::vector<unsigned> done;
+                for (auto [entry, to] : moves) {
+                    if (!_reta_flows[this_shard_id()][entry] && !_reta_packets[this_shard_id()][entry]) {
+                        std::atomic_ref(_redir_table[entry]).store(to, std::memory_order_relaxed);
+                        done.push_back(entry);
+                    }
+                }
+                return done;
+            }).then([moved] (std::vector<unsigned> done) {
+                moved->insert(moved->end(), done.begin(), done.end());
+            });
+        }).then([this, moved] {
+            if (!moved->empty()) {
+                update_rss_table(*moved);
+                _reta_entries_moved += moved->size();
+            }
+        });
+    });
+}
+
 std::unique_ptr<qp> dpdk_device::init_local_queue(const program_options::option_group& opts, uint16_t qid) {
     auto net_opts = dynamic_cast<const net::native_stack_options*>(&opts);
     SEASTAR_ASSERT(net_opts);
@@ -2268,7 +2656,9 @@ std::unique_ptr<net::device> create_dpdk_net_device(
                                     uint16_t port_idx,
                                     uint16_t num_queues,
                                     bool use_lro,
-                                    bool enable_fc)
+                                    bool enable_fc,
+                                    std::chrono::milliseconds rx_interrupt_idle,
+                                    std::chrono::milliseconds rss_rebalance_period)
 {
     static bool called = false;
 
@@ -2285,13 +2675,16 @@ std::unique_ptr<net::device> create_dpdk_net_device(
     }
 
     return std::make_unique<dpdk::dpdk_device>(port_idx, num_queues, use_lro,
-                                               enable_fc);
+                                               enable_fc, rx_interrupt_idle,
+                                               rss_rebalance_period);
 }
 
 std::unique_ptr<net::device> create_dpdk_net_device(
                                     const hw_config& hw_cfg)
 {
-    return create_dpdk_net_device(*hw_cfg.port_index, smp::count, hw_cfg.lro, hw_cfg.hw_fc);
+    return create_dpdk_net_device(*hw_cfg.port_index, smp::count, hw_cfg.lro, hw_cfg.hw_fc,
+                                  std::chrono::milliseconds(hw_cfg.rx_interrupt_idle_ms),
+                                  std::chrono::milliseconds(hw_cfg.rss_rebalance_period_ms));
 }
 
 }
@@ -2321,10 +2714,18 @@ dpdk_options::dpdk_options(program_options::option_group* parent_group)
     , hw_fc(*this, "hw-fc",
                 "on",
                 "Enable HW Flow Control (on / off)")
+    , rx_interrupt_idle_ms(*this, "dpdk-rx-interrupt-idle-ms",
+                0,
+                "Switch an idle RX queue to interrupt mode after this many milliseconds, 0 polls continuously")
+    , rss_rebalance_period_ms(*this, "dpdk-rss-rebalance-period-ms",
+                0,
+                "Steer new flows away from overloaded queues by rebalancing the RSS redirection table this often, 0 keeps it fixed")
 #else
     : program_options::option_group(parent_group, "DPDK net options", program_options::unused{})
     , dpdk_port_index(*this, "dpdk-port-index", program_options::unused{})
     , hw_fc(*this, "hw-fc", program_options::unused{})
+    , rx_interrupt_idle_ms(*this, "dpdk-rx-interrupt-idle-ms", program_options::unused{})
+    , rss_rebalance_period_ms(*this, "dpdk-rss-rebalance-period-ms", program_options::unused{})
 #endif
 #if 0
     opts.add_options()
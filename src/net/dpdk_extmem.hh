@@ -0,0 +1,54 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/memory.hh>
+#include <cstddef>
+#include <cstdint>
+
+namespace seastar::dpdk {
+
+// The shard's memory, as registered by a queue as DPDK external memory.
+// The device reaches it at the same addresses (IOVA as VA), so buffers in
+// it are received into and sent from directly, and anything else has to
+// be copied.
+struct extmem_range {
+    uintptr_t start = 0;
+    uintptr_t end = 0;
+
+    static extmem_range of_this_shard() {
+        auto m = memory::get_memory_layout();
+        return {m.start, m.end};
+    }
+
+    size_t size() const noexcept {
+        return end - start;
+    }
+
+    // Whether all of [va, va + len) is in the range
+    bool contains(const void* va, size_t len) const noexcept {
+        auto a = reinterpret_cast<uintptr_t>(va);
+        return a >= start && a <= end && len <= end - a;
+    }
+};
+
+}
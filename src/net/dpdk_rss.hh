@@ -0,0 +1,80 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace seastar::dpdk {
+
+// Below it the loads of the queues are too noisy to act upon
+inline constexpr uint64_t min_rss_rebalance_packets = 10000;
+
+// Returns the entries of the redirection table to move and where to. An
+// overloaded queue gives away the entries it would have to for its share of
+// the packets to be the average, if the traffic were spread evenly over
+// them, up to a quarter of them per round.
+inline std::vector<std::pair<unsigned, uint8_t>>
+plan_rss_rebalance(const std::vector<uint8_t>& reta, const std::vector<uint64_t>& packets,
+                   const std::vector<uint64_t>& flows, unsigned num_queues)
+{
+    std::vector<uint64_t> load(num_queues);
+    std::vector<unsigned> entries(num_queues);
+    for (size_t i = 0; i != reta.size(); ++i) {
+        load[reta[i]] += packets[i];
+        ++entries[reta[i]];
+    }
+
+    std::vector<std::pair<unsigned, uint8_t>> moves;
+    auto total = std::accumulate(load.begin(), load.end(), uint64_t(0));
+    if (total < min_rss_rebalance_packets) {
+        return moves;
+    }
+    auto mean = total / num_queues;
+    for (unsigned q = 0; q != num_queues; ++q) {
+        if (load[q] * 4 <= mean * 5 || entries[q] <= 1) {
+            continue;
+        }
+        auto per_entry = std::max<uint64_t>(load[q] / entries[q], 1);
+        auto budget = std::min<uint64_t>((load[q] - mean + per_entry - 1) / per_entry,
+                                         std::max(entries[q] / 4, 1u));
+        for (size_t i = 0; i != reta.size() && budget; ++i) {
+            if (reta[i] != q || flows[i]) {
+                continue;
+            }
+            auto to = std::min_element(load.begin(), load.end()) - load.begin();
+            if (load[to] + per_entry >= load[q]) {
+                break;
+            }
+            moves.emplace_back(i, to);
+            load[to] += per_entry;
+            load[q] -= per_entry;
+            --budget;
+        }
+    }
+    return moves;
+}
+
+}
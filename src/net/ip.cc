@@ -78,7 +78,12 @@ ipv4::ipv4(interface* netif)
         //
         sm::make_counter("linearizations", [] { return ipv4_packet_merger::linearizations(); },
                         sm::description("Counts a number of times a buffer linearization was invoked during buffers merge process. "
-                                        "Divide it by a total IPv4 receive packet rate to get an average number of lineraizations per packet."))
+                                        "Divide it by a total IPv4 receive packet rate to get an average number of lineraizations per packet.")),
+        sm::make_counter("gro_merged_segments", [this] { return _gro ? _gro->merged_segments() : 0; },
+                        sm::description("Counts a number of received TCP segments merged into the preceding segment of their flow")),
+        sm::make_counter("gro_packets", [this] { return _gro ? _gro->packets() : 0; },
+                        sm::description("Counts a number of TCP packets passed to the TCP layer after receive coalescing. "
+                                        "Divide gro_merged_segments by it to get an average number of segments merged per packet."))
     });
     _frag_timer.set_callback([this] { frag_timeout(); });
 }
@@ -232,7 +237,11 @@ ipv4::handle_received_packet(packet p, ethernet_address from) {
     if (l4) {
         // Trim IP header and pass to upper layer
         p.trim_front(ip_hdr_len);
-        l4->received(std::move(p), h.src_ip, h.dst_ip);
+        if (_gro && h.ip_proto == uint8_t(ip_protocol_num::tcp)) {
+            _gro->receive(std::move(p), h.src_ip, h.dst_ip);
+        } else {
+            l4->received(std::move(p), h.src_ip, h.dst_ip);
+        }
     }
     return make_ready_future<>();
 }
@@ -357,6 +366,43 @@ ipv4_address ipv4::netmask_address() const {
     return _netmask;
 }
 
+void ipv4::set_gro(bool enabled) {
+    // Hardware LRO merges the segments already
+    if (!enabled || hw_features().rx_lro) {
+        if (_gro) {
+            _gro->flush();
+        }
+        _gro_poller.reset();
+        _gro.reset();
+        return;
+    }
+    if (_gro) {
+        return;
+    }
+    _gro.emplace([this] (packet p, ipv4_address from, ipv4_address to) {
+        _tcp.received(std::move(p), from, to);
+    }, !hw_features().rx_csum_offload);
+
+    // Releases the held segments once the poll batch that brought them
+    // is processed
+    struct gro_pollfn final : public pollfn {
+        ipv4_tcp_gro& _gro;
+        explicit gro_pollfn(ipv4_tcp_gro& gro) : pollfn(internal::loop_phase::network), _gro(gro) {}
+        virtual bool poll() override {
+            return _gro.flush();
+        }
+        virtual bool pure_poll() override {
+            return !_gro.empty();
+        }
+        virtual bool try_enter_interrupt_mode() override {
+            return _gro.empty();
+        }
+        virtual void exit_interrupt_mode() override {
+        }
+    };
+    _gro_poller.emplace(std::make_unique<gro_pollfn>(*_gro));
+}
+
 void ipv4::set_packet_filter(ip_packet_filter * f) {
     _packet_filter = f;
 }
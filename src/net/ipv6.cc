@@ -0,0 +1,450 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+module seastar;
+#else
+#include <cstring>
+#include <stdexcept>
+#include <seastar/net/ipv6.hh>
+#include <seastar/net/tcp.hh>
+#include <seastar/net/tcp-stack.hh>
+#include <seastar/core/byteorder.hh>
+#include "net/native-stack-impl.hh"
+#endif
+
+namespace seastar {
+
+namespace net {
+
+namespace {
+
+// Neighbour discovery options (RFC 4861, section 4.6)
+constexpr uint8_t nd_opt_source_link_layer = 1;
+constexpr uint8_t nd_opt_target_link_layer = 2;
+constexpr size_t nd_opt_link_layer_len = 8;
+// ICMPv6 header, 4 bytes of flags or reserved, target address
+constexpr size_t nd_msg_len = sizeof(icmpv6_hdr) + 4 + ipv6_address::size();
+constexpr uint32_t na_flag_solicited = 1u << 30;
+constexpr uint32_t na_flag_override = 1u << 29;
+
+const ipv6_address all_nodes_address(ipv6_address::ipv6_bytes{0xff, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01});
+
+std::optional<ethernet_address> find_link_layer_option(const char* msg, size_t len, uint8_t type) {
+    size_t off = nd_msg_len;
+    while (off + 2 <= len) {
+        auto opt_type = uint8_t(msg[off]);
+        size_t opt_len = uint8_t(msg[off + 1]) * 8;
+        if (opt_len == 0 || off + opt_len > len) {
+            // Malformed, RFC 4861 asks to drop the whole message
+            return std::nullopt;
+        }
+        if (opt_type == type && opt_len == nd_opt_link_layer_len) {
+            return ethernet_address(reinterpret_cast<const uint8_t*>(msg + off + 2));
+        }
+        off += opt_len;
+    }
+    return std::nullopt;
+}
+
+packet make_nd_message(icmpv6_hdr::msg_type type, uint32_t flags, const ipv6_address& target,
+        uint8_t opt_type, ethernet_address mac) {
+    packet p;
+    auto msg = p.prepend_uninitialized_header(nd_msg_len + nd_opt_link_layer_len);
+    std::memset(msg, 0, nd_msg_len + nd_opt_link_layer_len);
+    msg[0] = char(type);
+    write_be<uint32_t>(msg + sizeof(icmpv6_hdr), flags);
+    target.write(msg + sizeof(icmpv6_hdr) + 4);
+    msg[nd_msg_len] = char(opt_type);
+    msg[nd_msg_len + 1] = char(nd_opt_link_layer_len / 8);
+    std::copy(mac.mac.begin(), mac.mac.end(), msg + nd_msg_len + 2);
+    return p;
+}
+
+}
+
+ipv6_tcp::ipv6_tcp(ipv6& inet)
+    : _inet_l4(inet), _tcp(std::make_unique<tcp<ipv6_traits>>(_inet_l4)) {
+}
+
+ipv6_tcp::~ipv6_tcp() {
+}
+
+void ipv6_tcp::received(packet p, ipv6_address from, ipv6_address to) {
+    _tcp->received(std::move(p), from, to);
+}
+
+bool ipv6_tcp::forward(forward_hash& out_hash_data, packet& p, size_t off) {
+    return _tcp->forward(out_hash_data, p, off);
+}
+
+ipv6::ipv6(interface* netif)
+    : _netif(netif)
+    , _hw_features(netif->hw_features())
+    , _link_local(ipv6_link_local_address(netif->hw_address()))
+    , _l3(netif, eth_protocol_num::ipv6, [this] { return get_packet(); })
+    , _tcp(*this)
+{
+    // The segmentation offloads of the devices produce IPv4 headers only
+    _hw_features.tx_tso = false;
+    _hw_features.tx_ufo = false;
+    // FIXME: ignored future
+    (void)_l3.receive(
+        [this](packet p, ethernet_address ea) {
+            return handle_received_packet(std::move(p), ea);
+        },
+        [this](forward_hash& out_hash_data, packet& p, size_t off) {
+            return forward(out_hash_data, p, off);
+        });
+}
+
+bool ipv6::forward(forward_hash& out_hash_data, packet& p, size_t off) {
+    auto iph = p.get_header<ipv6_hdr>(off);
+    if (!iph) {
+        return false;
+    }
+    for (auto b : iph->src_ip.ip) {
+        out_hash_data.push_back(b);
+    }
+    for (auto b : iph->dst_ip.ip) {
+        out_hash_data.push_back(b);
+    }
+    if (iph->next_header == uint8_t(ip_protocol_num::tcp)) {
+        _tcp.forward(out_hash_data, p, off + ipv6_hdr_len);
+    }
+    return true;
+}
+
+bool ipv6::is_my_address(const ipv6_address& a) const {
+    if (a == _link_local || a == all_nodes_address || a == ipv6_solicited_node_address(_link_local)) {
+        return true;
+    }
+    return !_host_address.is_unspecified()
+            && (a == _host_address || a == ipv6_solicited_node_address(_host_address));
+}
+
+bool ipv6::on_link(const ipv6_address& a) const {
+    if (ipv6_is_link_local(a)) {
+        return true;
+    }
+    if (_host_address.is_unspecified()) {
+        return false;
+    }
+    auto bytes = _prefix_len / 8;
+    if (!std::equal(a.ip.begin(), a.ip.begin() + bytes, _host_address.ip.begin())) {
+        return false;
+    }
+    auto bits = _prefix_len % 8;
+    if (!bits) {
+        return true;
+    }
+    uint8_t mask = 0xff << (8 - bits);
+    return !((a.ip[bytes] ^ _host_address.ip[bytes]) & mask);
+}
+
+ipv6_address ipv6::source_address_for(const ipv6_address& to) const {
+    // Scope of a multicast address is its lowest nibble, 2 is link-local
+    if (_host_address.is_unspecified() || ipv6_is_link_local(to)
+            || (ipv6_is_multicast(to) && (to.ip[1] & 0x0f) <= 2)) {
+        return _link_local;
+    }
+    return _host_address;
+}
+
+future<>
+ipv6::handle_received_packet(packet p, ethernet_address from) {
+    auto iph = p.get_header<ipv6_hdr>(0);
+    if (!iph) {
+        return make_ready_future<>();
+    }
+    auto h = ntoh(*iph);
+    if (h.version() != 6) {
+        return make_ready_future<>();
+    }
+    unsigned ip_len = ipv6_hdr_len + h.payload_len;
+    unsigned pkt_len = p.len();
+    if (pkt_len > ip_len) {
+        // Trim extra data in the packet beyond the IP payload
+        p.trim_back(pkt_len - ip_len);
+    } else if (pkt_len < ip_len) {
+        return make_ready_future<>();
+    }
+    if (!is_my_address(h.dst_ip)) {
+        // FIXME: forward
+        return make_ready_future<>();
+    }
+
+    p.trim_front(ipv6_hdr_len);
+    switch (ip_protocol_num(h.next_header)) {
+    case ip_protocol_num::tcp:
+        // Replies are sourced from the address chosen for the peer, which
+        // has to be the one the peer talks to for the checksums to match
+        if (h.dst_ip == source_address_for(h.src_ip)) {
+            if (on_link(h.src_ip)) {
+                learn(from, h.src_ip);
+            }
+            _tcp.received(std::move(p), h.src_ip, h.dst_ip);
+        }
+        break;
+    case ip_protocol_num::icmpv6:
+        icmpv6_received(std::move(p), h.src_ip, h.dst_ip, h.hop_limit, from);
+        break;
+    default:
+        // Extension headers, fragments included, are not supported
+        break;
+    }
+    return make_ready_future<>();
+}
+
+void ipv6::icmpv6_received(packet p, ipv6_address from, ipv6_address to, uint8_t hop_limit, ethernet_address from_mac) {
+    if (!p.get_header<icmpv6_hdr>(0)) {
+        return;
+    }
+    checksummer csum;
+    ipv6_traits::pseudo_header_checksum(csum, from, to, p.len(), ip_protocol_num::icmpv6);
+    csum.sum(p);
+    if (csum.get() != 0) {
+        return;
+    }
+    auto hdr = p.get_header<icmpv6_hdr>(0);
+    switch (hdr->type) {
+    case icmpv6_hdr::msg_type::echo_request:
+        if (ipv6_is_multicast(from) || from.is_unspecified()) {
+            return;
+        }
+        hdr->type = icmpv6_hdr::msg_type::echo_reply;
+        hdr->code = 0;
+        // FIXME: future is discarded
+        (void)get_l2_dst_address(from).then([this, from, p = std::move(p)] (ethernet_address e_dst) mutable {
+            send_icmpv6(from, std::move(p), e_dst, default_hop_limit);
+        }).handle_exception([] (std::exception_ptr) {});
+        break;
+    case icmpv6_hdr::msg_type::neighbor_solicitation:
+        if (hop_limit == nd_hop_limit && hdr->code == 0) {
+            handle_solicitation(p, from, from_mac);
+        }
+        break;
+    case icmpv6_hdr::msg_type::neighbor_advertisement:
+        if (hop_limit == nd_hop_limit && hdr->code == 0) {
+            handle_advertisement(p, from_mac);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void ipv6::handle_solicitation(packet& p, ipv6_address from, ethernet_address from_mac) {
+    if (p.len() < nd_msg_len) {
+        return;
+    }
+    p.linearize();
+    auto msg = p.get_header(0, p.len());
+    auto target = ipv6_address::read(msg + sizeof(icmpv6_hdr) + 4);
+    if (ipv6_is_multicast(target) || target == all_nodes_address || !is_my_address(target)) {
+        return;
+    }
+    auto sll = find_link_layer_option(msg, p.len(), nd_opt_source_link_layer);
+    uint32_t flags = na_flag_override;
+    ipv6_address to = all_nodes_address;
+    ethernet_address e_dst = ipv6_multicast_mac(all_nodes_address);
+    // An unspecified source is a duplicate address detection probe, the
+    // answer goes to all nodes then
+    if (!from.is_unspecified()) {
+        if (sll) {
+            learn(*sll, from);
+        }
+        flags |= na_flag_solicited;
+        to = from;
+        e_dst = sll ? *sll : from_mac;
+    }
+    auto na = make_nd_message(icmpv6_hdr::msg_type::neighbor_advertisement, flags, target,
+            nd_opt_target_link_layer, _netif->hw_address());
+    send_icmpv6(to, std::move(na), e_dst, nd_hop_limit);
+}
+
+void ipv6::handle_advertisement(packet& p, ethernet_address from_mac) {
+    if (p.len() < nd_msg_len) {
+        return;
+    }
+    p.linearize();
+    auto msg = p.get_header(0, p.len());
+    auto target = ipv6_address::read(msg + sizeof(icmpv6_hdr) + 4);
+    if (ipv6_is_multicast(target)) {
+        return;
+    }
+    auto tll = find_link_layer_option(msg, p.len(), nd_opt_target_link_layer);
+    // The resolution might have been started on any shard
+    ndp_learn(tll ? *tll : from_mac, target);
+}
+
+void ipv6::send_icmpv6(ipv6_address to, packet p, ethernet_address e_dst, uint8_t hop_limit) {
+    auto hdr = p.get_header<icmpv6_hdr>(0);
+    hdr->csum = 0;
+    checksummer csum;
+    ipv6_traits::pseudo_header_checksum(csum, source_address_for(to), to, p.len(), ip_protocol_num::icmpv6);
+    csum.sum(p);
+    hdr->csum = csum.get();
+    send(to, ip_protocol_num::icmpv6, std::move(p), e_dst, hop_limit);
+}
+
+void ipv6::send_solicitation(const ipv6_address& target) {
+    auto group = ipv6_solicited_node_address(target);
+    auto ns = make_nd_message(icmpv6_hdr::msg_type::neighbor_solicitation, 0, target,
+            nd_opt_source_link_layer, _netif->hw_address());
+    send_icmpv6(group, std::move(ns), ipv6_multicast_mac(group), nd_hop_limit);
+}
+
+future<ethernet_address> ipv6::get_l2_dst_address(ipv6_address to) {
+    if (ipv6_is_multicast(to)) {
+        return make_ready_future<ethernet_address>(ipv6_multicast_mac(to));
+    }
+    // Figure out where to send the packet to. If it is a directly connected
+    // host, send to it directly, otherwise send to the default gateway.
+    auto dst = on_link(to) || _gw_address.is_unspecified() ? to : _gw_address;
+    auto i = _neighbours.find(dst);
+    if (i != _neighbours.end()) {
+        return make_ready_future<ethernet_address>(i->second);
+    }
+    auto j = _in_progress.find(dst);
+    auto first_request = j == _in_progress.end();
+    auto& res = first_request ? _in_progress[dst] : j->second;
+
+    if (first_request) {
+        res._timeout_timer.set_callback([dst, this, &res] {
+            send_solicitation(dst);
+            for (auto& w : res._waiters) {
+                w.set_exception(ndp_timeout_error());
+            }
+            res._waiters.clear();
+        });
+        res._timeout_timer.arm_periodic(std::chrono::seconds(1));
+        send_solicitation(dst);
+    }
+
+    if (res._waiters.size() >= max_waiters) {
+        return make_exception_future<ethernet_address>(ndp_queue_full_error());
+    }
+
+    res._waiters.emplace_back();
+    return res._waiters.back().get_future();
+}
+
+void ipv6::learn(ethernet_address l2, ipv6_address l3) {
+    _neighbours[l3] = l2;
+    auto i = _in_progress.find(l3);
+    if (i != _in_progress.end()) {
+        auto& res = i->second;
+        res._timeout_timer.cancel();
+        for (auto&& pr : res._waiters) {
+            pr.set_value(l2);
+        }
+        _in_progress.erase(i);
+    }
+}
+
+void ipv6::send(ipv6_address to, ip_protocol_num proto_num, packet p, ethernet_address e_dst, uint8_t hop_limit) {
+    auto payload_len = p.len();
+    auto iph = p.prepend_header<ipv6_hdr>();
+    iph->ver_tc_flow = uint32_t(6) << 28;
+    iph->payload_len = payload_len;
+    iph->next_header = uint8_t(proto_num);
+    iph->hop_limit = hop_limit;
+    iph->src_ip = source_address_for(to);
+    iph->dst_ip = to;
+    *iph = hton(*iph);
+
+    auto& oi = p.offload_info_ref();
+    oi.ip_hdr_len = ipv6_hdr_len;
+    oi.ipv6 = true;
+    _packetq.push_back(l3_protocol::l3packet{eth_protocol_num::ipv6, e_dst, std::move(p)});
+}
+
+std::optional<l3_protocol::l3packet> ipv6::get_packet() {
+    if (_packetq.empty()) {
+        for (size_t i = 0; i < _pkt_providers.size(); i++) {
+            auto l4p = _pkt_providers[_pkt_provider_idx++]();
+            if (_pkt_provider_idx == _pkt_providers.size()) {
+                _pkt_provider_idx = 0;
+            }
+            if (l4p) {
+                auto l4pv = std::move(l4p.value());
+                send(l4pv.to, l4pv.proto_num, std::move(l4pv.p), l4pv.e_dst);
+                break;
+            }
+        }
+    }
+
+    std::optional<l3_protocol::l3packet> p;
+    if (!_packetq.empty()) {
+        p = std::move(_packetq.front());
+        _packetq.pop_front();
+    }
+    return p;
+}
+
+void ipv6::set_host_address(ipv6_address ip) {
+    if (ipv6_is_multicast(ip)) {
+        throw std::invalid_argument("IPv6 host address must not be a multicast address");
+    }
+    _host_address = ip;
+}
+
+ipv6_address ipv6::host_address() const {
+    return _host_address.is_unspecified() ? _link_local : _host_address;
+}
+
+void ipv6::set_gw_address(ipv6_address ip) {
+    _gw_address = ip;
+}
+
+ipv6_address ipv6::gw_address() const {
+    return _gw_address;
+}
+
+void ipv6::set_prefix_length(unsigned len) {
+    if (len > 128) {
+        throw std::invalid_argument(fmt::format("IPv6 prefix length must be at most 128, got {}", len));
+    }
+    _prefix_len = len;
+}
+
+server_socket
+tcpv6_listen(tcp<ipv6_traits>& tcpv6, uint16_t port, listen_options opts) {
+    return server_socket(std::make_unique<native_server_socket_impl<tcp<ipv6_traits>>>(
+            tcpv6, port, opts));
+}
+
+::seastar::socket
+tcpv6_socket(tcp<ipv6_traits>& tcpv6) {
+    return ::seastar::socket(std::make_unique<native_socket_impl<tcp<ipv6_traits>>>(
+            tcpv6));
+}
+
+}
+
+}
@@ -21,8 +21,13 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <seastar/net/stack.hh>
 #include <seastar/net/inet_address.hh>
+#include <seastar/net/tcp-congestion.hh>
 #include <seastar/util/assert.hh>
 #include <seastar/util/log.hh>
 
@@ -76,11 +81,11 @@ native_server_socket_impl<Protocol>::accept() {
         // Save "conn" contents before call below function
         // "conn" is moved in 1st argument, and used in 2nd argument
         // It causes trouble on Arm which passes arguments from left to right
-        auto ip = conn.foreign_ip().ip;
+        auto ip = conn.foreign_ip();
         auto port = conn.foreign_port();
         return make_ready_future<accept_result>(accept_result{
                 connected_socket(std::make_unique<native_connected_socket_impl<Protocol>>(make_lw_shared(std::move(conn)))),
-                make_ipv4_address(ip, port)});
+                socket_address(ip, port)});
     });
 }
 
@@ -135,7 +140,7 @@ class native_socket_impl final : public socket_impl {
         SEASTAR_ASSERT(proto == transport::TCP);
 
         // FIXME: local is ignored since native stack does not support multiple IPs yet
-        SEASTAR_ASSERT(sa.as_posix_sockaddr().sa_family == AF_INET);
+        SEASTAR_ASSERT(sa.as_posix_sockaddr().sa_family == sa_family_t(inet_address(typename Protocol::ipaddr()).in_family()));
 
         _conn = make_lw_shared<typename Protocol::connection>(_proto.connect(sa));
         return _conn->connected().then([conn = _conn]() mutable {
@@ -281,11 +286,25 @@ keepalive_params native_connected_socket_impl<Protocol>::get_keepalive_parameter
 
 template<typename Protocol>
 void native_connected_socket_impl<Protocol>::set_sockopt(int level, int optname, const void* data, size_t len) {
+    if (level == IPPROTO_TCP && optname == TCP_CONGESTION) {
+        auto name = static_cast<const char*>(data);
+        _conn->set_congestion_control(parse_tcp_congestion_algorithm(std::string_view(name, strnlen(name, len))));
+        return;
+    }
     throw std::runtime_error("Setting custom socket options is not supported for native stack");
 }
 
 template<typename Protocol>
 int native_connected_socket_impl<Protocol>::get_sockopt(int level, int optname, void* data, size_t len) const {
+    if (level == IPPROTO_TCP && optname == TCP_CONGESTION) {
+        auto name = tcp_congestion_algorithm_name(_conn->congestion_info().algorithm);
+        auto size = std::min(name.size(), len);
+        std::copy_n(name.data(), size, static_cast<char*>(data));
+        if (size < len) {
+            static_cast<char*>(data)[size++] = '\0';
+        }
+        return size;
+    }
     throw std::runtime_error("Getting custom socket options is not supported for native stack");
 }
 
@@ -30,6 +30,7 @@ module;
 #include <memory>
 #include <optional>
 #include <queue>
+#include <stdexcept>
 
 #include <seastar/util/assert.hh>
 
@@ -45,11 +46,13 @@ module seastar;
 #include "net/native-stack-impl.hh"
 #include <seastar/net/net.hh>
 #include <seastar/net/ip.hh>
+#include <seastar/net/ipv6.hh>
 #include <seastar/net/tcp-stack.hh>
 #include <seastar/net/tcp.hh>
 #include <seastar/net/udp.hh>
 #include <seastar/net/virtio.hh>
 #include <seastar/net/dpdk.hh>
+#include <seastar/net/xdp.hh>
 #include <seastar/net/proxy.hh>
 #include <seastar/net/dhcp.hh>
 #include <seastar/net/config.hh>
@@ -81,11 +84,18 @@ void create_native_net_device(const native_stack_options& opts) {
     std::unique_ptr<device> dev;
 
     if ( deprecated_config_used) {
+#ifdef SEASTAR_HAVE_XDP
+        if (opts.xdp_opts.xdp_device) {
+            dev = create_xdp_net_device(opts.xdp_opts);
+        } else
+#endif
 #ifdef SEASTAR_HAVE_DPDK
         if ( opts.dpdk_pmd) {
              dev = create_dpdk_net_device(opts.dpdk_opts.dpdk_port_index.get_value(), smp::count,
                 !(opts.lro && opts.lro.get_value() == "off"),
-                !(opts.dpdk_opts.hw_fc && opts.dpdk_opts.hw_fc.get_value() == "off"));
+                !(opts.dpdk_opts.hw_fc && opts.dpdk_opts.hw_fc.get_value() == "off"),
+                std::chrono::milliseconds(opts.dpdk_opts.rx_interrupt_idle_ms.get_value()),
+                std::chrono::milliseconds(opts.dpdk_opts.rss_rebalance_period_ms.get_value()));
        } else
 #endif
         dev = create_virtio_net_device(opts.virtio_opts, opts.lro);
@@ -159,6 +169,7 @@ class native_network_stack : public network_stack {
 private:
     interface _netif;
     ipv4 _inet;
+    ipv6 _inet6;
     bool _dhcp = false;
     promise<> _config;
     timer<> _timer;
@@ -189,6 +200,12 @@ class native_network_stack : public network_stack {
     void arp_learn(ethernet_address l2, ipv4_address l3) {
         _inet.learn(l2, l3);
     }
+    void ndp_learn(ethernet_address l2, ipv6_address l3) {
+        _inet6.learn(l2, l3);
+    }
+    virtual bool supports_ipv6() const override {
+        return true;
+    }
     friend class native_server_socket_impl<tcp4>;
 
     class native_network_interface;
@@ -230,8 +247,30 @@ net::datagram_channel native_network_stack::make_bound_datagram_channel(const so
 
 native_network_stack::native_network_stack(const native_stack_options& opts, std::shared_ptr<device> dev)
     : _netif(std::move(dev))
-    , _inet(&_netif) {
+    , _inet(&_netif)
+    , _inet6(&_netif) {
     _inet.get_udp().set_queue_size(opts.udpv4_queue_size.get_value());
+    _inet.set_gro(opts.gro.get_value() != "off");
+    auto congestion = parse_tcp_congestion_algorithm(opts.tcp_congestion_control.get_value());
+    _inet.get_tcp().set_default_congestion_control(congestion);
+    _inet6.get_tcp().set_default_congestion_control(congestion);
+    auto tuning = opts.tcp_datacenter_mode.get_value() ? tcp_tuning::datacenter() : tcp_tuning{};
+    if (!opts.tcp_min_rto_ms.defaulted()) {
+        auto min_rto_ms = opts.tcp_min_rto_ms.get_value();
+        if (!(min_rto_ms > 0)) {
+            throw std::invalid_argument(fmt::format("tcp-min-rto-ms must be positive, got {}", min_rto_ms));
+        }
+        tuning.min_rto = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::duration<float, std::milli>(min_rto_ms));
+    }
+    _inet.get_tcp().set_tuning(tuning);
+    _inet6.get_tcp().set_tuning(tuning);
+    if (opts.host_ipv6_addr) {
+        _inet6.set_host_address(ipv6_address(opts.host_ipv6_addr.get_value()));
+    }
+    if (opts.gw_ipv6_addr) {
+        _inet6.set_gw_address(ipv6_address(opts.gw_ipv6_addr.get_value()));
+    }
+    _inet6.set_prefix_length(opts.ipv6_prefix_length.get_value());
     _dhcp = opts.host_ipv4_addr.defaulted()
             && opts.gw_ipv4_addr.defaulted()
             && opts.netmask_ipv4_addr.defaulted() && opts.dhcp.get_value();
@@ -244,12 +283,38 @@ native_network_stack::native_network_stack(const native_stack_options& opts, std
 
 server_socket
 native_network_stack::listen(socket_address sa, listen_options opts) {
+    if (sa.family() == AF_INET6) {
+        return tcpv6_listen(_inet6.get_tcp(), sa.port(), opts);
+    }
     SEASTAR_ASSERT(sa.family() == AF_INET || sa.is_unspecified());
     return tcpv4_listen(_inet.get_tcp(), ntohs(sa.as_posix_sockaddr_in().sin_port), opts);
 }
 
+// Picks the TCP of the address family being connected to
+class native_dual_stack_socket_impl final : public socket_impl {
+    seastar::socket _v4;
+    seastar::socket _v6;
+public:
+    native_dual_stack_socket_impl(seastar::socket v4, seastar::socket v6)
+        : _v4(std::move(v4)), _v6(std::move(v6)) {}
+    virtual future<connected_socket> connect(socket_address sa, socket_address local, transport proto) override {
+        return (sa.family() == AF_INET6 ? _v6 : _v4).connect(sa, local, proto);
+    }
+    virtual void set_reuseaddr(bool reuseaddr) override {
+        _v4.set_reuseaddr(reuseaddr);
+    }
+    virtual bool get_reuseaddr() const override {
+        return _v4.get_reuseaddr();
+    }
+    virtual void shutdown() override {
+        _v4.shutdown();
+        _v6.shutdown();
+    }
+};
+
 seastar::socket native_network_stack::socket() {
-    return tcpv4_socket(_inet.get_tcp());
+    return seastar::socket(std::make_unique<native_dual_stack_socket_impl>(
+            tcpv4_socket(_inet.get_tcp()), tcpv6_socket(_inet6.get_tcp())));
 }
 
 using namespace std::chrono_literals;
@@ -334,6 +399,15 @@ void arp_learn(ethernet_address l2, ipv4_address l3)
     });
 }
 
+void ndp_learn(ethernet_address l2, ipv6_address l3)
+{
+    // Run ndp_learn on all shard in the background
+    (void)smp::invoke_on_all([l2, l3] {
+        auto & ns = static_cast<native_network_stack&>(engine().net());
+        ns.ndp_learn(l2, l3);
+    });
+}
+
 void create_native_stack(const native_stack_options& opts, std::shared_ptr<device> dev) {
     native_network_stack::ready_promise.set_value(std::unique_ptr<network_stack>(std::make_unique<native_network_stack>(opts, std::move(dev))));
 }
@@ -355,6 +429,15 @@ native_stack_options::native_stack_options()
     , netmask_ipv4_addr(*this, "netmask-ipv4-addr",
                 "255.255.255.0",
                 "static IPv4 netmask to use")
+    , host_ipv6_addr(*this, "host-ipv6-addr",
+                {},
+                "static IPv6 address to use (the link-local address only when unset)")
+    , gw_ipv6_addr(*this, "gw-ipv6-addr",
+                {},
+                "static IPv6 gateway to use")
+    , ipv6_prefix_length(*this, "ipv6-prefix-length",
+                64,
+                "length of the on-link prefix of the static IPv6 address")
     , udpv4_queue_size(*this, "udpv4-queue-size",
                 ipv4_udp::default_queue_size,
                 "Default size of the UDPv4 per-channel packet queue")
@@ -372,8 +455,21 @@ native_stack_options::native_stack_options()
     , lro(*this, "lro",
                 "on",
                 "Enable LRO")
+    , gro(*this, "gro",
+                "on",
+                "Enable software coalescing of received TCP segments")
+    , tcp_congestion_control(*this, "tcp-congestion-control",
+                "reno",
+                "TCP congestion control algorithm (reno, cubic, bbr)")
+    , tcp_datacenter_mode(*this, "tcp-datacenter-mode",
+                false,
+                "Tune TCP loss detection for datacenter round trip times (timestamps, RACK-TLP, 5ms minimum RTO)")
+    , tcp_min_rto_ms(*this, "tcp-min-rto-ms",
+                1000.0f,
+                "Minimum TCP retransmission timeout in milliseconds (default 1000, 5 with --tcp-datacenter-mode)")
     , virtio_opts(this)
     , dpdk_opts(this)
+    , xdp_opts(this)
 {
 }
 
@@ -390,6 +486,10 @@ class native_network_stack::native_network_interface : public net::network_inter
         : _stack(stack)
         , _addresses(1, _stack._inet.host_address())
     {
+        _addresses.emplace_back(_stack._inet6.link_local_address());
+        if (_stack._inet6.host_address() != _stack._inet6.link_local_address()) {
+            _addresses.emplace_back(_stack._inet6.host_address());
+        }
         const auto mac = _stack._inet.netif()->hw_address().mac;
         _hardware_address = std::vector<uint8_t>{mac.cbegin(), mac.cend()};
     }
@@ -424,7 +524,7 @@ class native_network_stack::native_network_interface : public net::network_inter
         return true;
     }
     bool supports_ipv6() const override {
-        return false;
+        return true;
     }
 };
 
@@ -113,7 +113,7 @@ bool qp::poll_tx() {
 
 qp::qp(bool register_copy_stats,
        const std::string stats_plugin_name, uint8_t qid)
-        : _tx_poller(std::make_unique<internal::poller>(reactor::poller::simple([this] { return poll_tx(); })))
+        : _tx_poller(std::make_unique<internal::poller>(internal::make_idle_pollfn([this] { return poll_tx(); }, internal::loop_phase::network)))
         , _stats_plugin_name(stats_plugin_name)
         , _queue_name(std::string("queue") + std::to_string(qid))
 {
@@ -305,6 +305,18 @@ unsigned interface::hash2cpu(uint32_t hash) {
     return _dev->hash2cpu(hash);
 }
 
+bool interface::dynamic_rss() const {
+    return _dev->dynamic_rss();
+}
+
+void interface::flow_opened(uint32_t hash) {
+    _dev->flow_opened(hash);
+}
+
+void interface::flow_closed(uint32_t hash) {
+    _dev->flow_closed(hash);
+}
+
 uint16_t interface::hw_queues_count() {
     return _dev->hw_queues_count();
 }
@@ -0,0 +1,1339 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+// OpenSSL backend of seastar::tls, see tls-impl.hh
+
+#ifdef SEASTAR_WITH_OSSL
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <stdexcept>
+#include <system_error>
+#include <memory>
+#include <span>
+#include <unordered_set>
+
+#include <seastar/util/assert.hh>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <openssl/bio.h>
+#include <openssl/core_names.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/pkcs12.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+
+#include <fmt/core.h>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/core/loop.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/core/print.hh>
+#include <seastar/core/with_timeout.hh>
+#include <seastar/net/tls.hh>
+#include <seastar/net/stack.hh>
+#include "net/tls-impl.hh"
+#endif
+
+namespace seastar {
+
+class ossl_error_category : public std::error_category {
+public:
+    constexpr ossl_error_category() noexcept : std::error_category{} {}
+    const char * name() const noexcept override {
+        return "OpenSSL";
+    }
+    std::string message(int error) const override {
+        char buf[256];
+        ERR_error_string_n(static_cast<unsigned long>(error), buf, sizeof(buf));
+        return buf;
+    }
+};
+
+const std::error_category& tls::error_category() {
+    static const ossl_error_category ec;
+    return ec;
+}
+
+// Takes the most recent error off the thread's error queue, as
+// an error value of tls::error_category(). Library and reason are
+// kept, so that it compares equal to the tls::ERROR_* constants.
+static int ossl_error_code() {
+    auto e = ERR_peek_last_error();
+    ERR_clear_error();
+    if (e == 0) {
+        return int(ERR_PACK(ERR_LIB_SSL, 0, ERR_R_INTERNAL_ERROR));
+    }
+    return int(ERR_PACK(ERR_GET_LIB(e), 0, ERR_GET_REASON(e)));
+}
+
+[[noreturn]] static void throw_ossl_error() {
+    throw std::system_error(ossl_error_code(), tls::error_category());
+}
+
+// Checks an OpenSSL return value.
+// <= 0 -> error.
+static void ossl_chk(int res) {
+    if (res <= 0) {
+        throw_ossl_error();
+    }
+}
+
+namespace {
+
+template<auto F>
+struct ossl_deleter {
+    template<typename T>
+    void operator()(T* p) const noexcept {
+        F(p);
+    }
+};
+
+using bio_ptr = std::unique_ptr<BIO, ossl_deleter<BIO_free>>;
+using x509_ptr = std::unique_ptr<X509, ossl_deleter<X509_free>>;
+using x509_crl_ptr = std::unique_ptr<X509_CRL, ossl_deleter<X509_CRL_free>>;
+using pkey_ptr = std::unique_ptr<EVP_PKEY, ossl_deleter<EVP_PKEY_free>>;
+using pkcs12_ptr = std::unique_ptr<PKCS12, ossl_deleter<PKCS12_free>>;
+using ssl_ctx_ptr = std::unique_ptr<SSL_CTX, ossl_deleter<SSL_CTX_free>>;
+using ssl_ptr = std::unique_ptr<SSL, ossl_deleter<SSL_free>>;
+using ssl_session_ptr = std::unique_ptr<SSL_SESSION, ossl_deleter<SSL_SESSION_free>>;
+using general_names_ptr = std::unique_ptr<GENERAL_NAMES, ossl_deleter<GENERAL_NAMES_free>>;
+
+// the stack functions are macros
+void x509_stack_free(STACK_OF(X509)* s) {
+    sk_X509_pop_free(s, X509_free);
+}
+void x509_stack_free_shallow(STACK_OF(X509)* s) {
+    sk_X509_free(s);
+}
+
+bio_ptr make_bio(const tls::blob& b) {
+    bio_ptr bio(BIO_new_mem_buf(b.data(), b.size()));
+    if (!bio) {
+        throw std::bad_alloc();
+    }
+    return bio;
+}
+
+std::vector<x509_ptr> read_certs(const tls::blob& b, tls::x509_crt_format fmt) {
+    auto bio = make_bio(b);
+    std::vector<x509_ptr> res;
+    if (fmt == tls::x509_crt_format::PEM) {
+        while (auto* c = PEM_read_bio_X509(bio.get(), nullptr, nullptr, nullptr)) {
+            res.emplace_back(c);
+        }
+    } else if (auto* c = d2i_X509_bio(bio.get(), nullptr)) {
+        res.emplace_back(c);
+    }
+    if (res.empty()) {
+        throw_ossl_error();
+    }
+    ERR_clear_error(); // end of input
+    return res;
+}
+
+std::vector<x509_crl_ptr> read_crls(const tls::blob& b, tls::x509_crt_format fmt) {
+    auto bio = make_bio(b);
+    std::vector<x509_crl_ptr> res;
+    if (fmt == tls::x509_crt_format::PEM) {
+        while (auto* c = PEM_read_bio_X509_CRL(bio.get(), nullptr, nullptr, nullptr)) {
+            res.emplace_back(c);
+        }
+    } else if (auto* c = d2i_X509_CRL_bio(bio.get(), nullptr)) {
+        res.emplace_back(c);
+    }
+    if (res.empty()) {
+        throw_ossl_error();
+    }
+    ERR_clear_error(); // end of input
+    return res;
+}
+
+pkey_ptr read_key(const tls::blob& b, tls::x509_crt_format fmt) {
+    auto bio = make_bio(b);
+    pkey_ptr key(fmt == tls::x509_crt_format::PEM
+            ? PEM_read_bio_PrivateKey(bio.get(), nullptr, nullptr, nullptr)
+            : d2i_PrivateKey_bio(bio.get(), nullptr));
+    if (!key) {
+        throw_ossl_error();
+    }
+    return key;
+}
+
+sstring name_to_string(const X509_NAME* name) {
+    bio_ptr bio(BIO_new(BIO_s_mem()));
+    if (!bio) {
+        throw std::bad_alloc();
+    }
+    // RFC 4514 (like gnutls_x509_crt_get_dn), but keep UTF-8 as is
+    if (X509_NAME_print_ex(bio.get(), name, 0, XN_FLAG_RFC2253 & ~ASN1_STRFLGS_ESC_MSB) < 0) {
+        throw_ossl_error();
+    }
+    char* data;
+    auto len = BIO_get_mem_data(bio.get(), &data);
+    return sstring(data, len);
+}
+
+}
+
+class tls::dh_params::impl {
+public:
+    // Parameters are picked by OpenSSL to match the certificate
+    // key, regardless of the level.
+    impl(level)
+    {}
+    impl(const blob& pkcs3, x509_crt_format fmt)
+        : _params([&] {
+            auto bio = make_bio(pkcs3);
+            pkey_ptr p(fmt == x509_crt_format::PEM
+                    ? PEM_read_bio_Parameters(bio.get(), nullptr)
+                    : d2i_KeyParams_bio(EVP_PKEY_DH, nullptr, bio.get()));
+            if (!p) {
+                throw_ossl_error();
+            }
+            return p;
+        }())
+    {}
+    ~impl() = default;
+
+    // null when the parameters are chosen automatically
+    EVP_PKEY* get() const {
+        return _params.get();
+    }
+private:
+    pkey_ptr _params;
+};
+
+tls::dh_params::dh_params(level lvl) : _impl(std::make_unique<impl>(lvl))
+{}
+
+tls::dh_params::dh_params(const blob& b, x509_crt_format fmt)
+        : _impl(std::make_unique<impl>(b, fmt)) {
+}
+
+tls::dh_params::~dh_params() {
+}
+
+tls::dh_params::dh_params(dh_params&&) noexcept = default;
+tls::dh_params& tls::dh_params::operator=(dh_params&&) noexcept = default;
+
+class tls::x509_cert::impl {
+public:
+    impl(const blob& b, x509_crt_format fmt)
+        : _cert(std::move(read_certs(b, fmt).front()))
+    {}
+
+    X509* get() const {
+        return _cert.get();
+    }
+
+private:
+    x509_ptr _cert;
+};
+
+tls::x509_cert::x509_cert(shared_ptr<impl> impl)
+        : _impl(std::move(impl)) {
+}
+
+tls::x509_cert::x509_cert(const blob& b, x509_crt_format fmt)
+        : x509_cert(::seastar::make_shared<impl>(b, fmt)) {
+}
+
+class tls::certificate_credentials::impl::backend {
+public:
+    explicit backend(certificate_credentials::impl& owner)
+            : _owner(owner)
+            , _ctx(SSL_CTX_new(TLS_method()))
+    {
+        if (!_ctx) {
+            throw_ossl_error();
+        }
+        auto* ctx = _ctx.get();
+        SSL_CTX_set_app_data(ctx, this);
+        SSL_CTX_set_options(ctx, SSL_OP_NO_RENEGOTIATION);
+        // Sessions are resumed from tickets only (see session_resume_mode),
+        // and those are made from the ticket key by ticket_key_cb
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+        static const unsigned char sid_ctx[] = "seastar";
+        ossl_chk(SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1));
+        ossl_chk(SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, &ticket_key_cb));
+        SSL_CTX_set_alpn_select_cb(ctx, &alpn_select_cb, this);
+        ossl_chk(SSL_CTX_set_dh_auto(ctx, 1));
+    }
+
+    operator SSL_CTX*() const {
+        return _ctx.get();
+    }
+
+private:
+    friend class certificate_credentials::impl;
+
+    void set_ticket_key(std::span<const uint8_t> key) {
+        unsigned char md[SHA512_DIGEST_LENGTH];
+        SHA512(key.data(), key.size(), md);
+        std::copy_n(md, _ticket_aes_key.size(), _ticket_aes_key.begin());
+        std::copy_n(md + _ticket_aes_key.size(), _ticket_hmac_key.size(), _ticket_hmac_key.begin());
+        SHA256(key.data(), key.size(), md);
+        std::copy_n(md, _ticket_key_name.size(), _ticket_key_name.begin());
+        OPENSSL_cleanse(md, sizeof(md));
+        _has_ticket_key = true;
+    }
+
+    // Tickets are encrypted with keys derived from the session resume key
+    // alone, so that every shard and node sharing it accepts them.
+    static int ticket_key_cb(SSL* ssl, unsigned char key_name[16], unsigned char* iv, EVP_CIPHER_CTX* cctx, EVP_MAC_CTX* hctx, int enc) {
+        auto* b = static_cast<backend*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+        if (!b->_has_ticket_key) {
+            return enc ? -1 : 0;
+        }
+        if (enc) {
+            std::copy(b->_ticket_key_name.begin(), b->_ticket_key_name.end(), key_name);
+            if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) <= 0) {
+                return -1;
+            }
+        } else if (!std::equal(b->_ticket_key_name.begin(), b->_ticket_key_name.end(), key_name)) {
+            // not ours, or of a previous key: do a full handshake
+            return 0;
+        }
+        OSSL_PARAM params[] = {
+            OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, b->_ticket_hmac_key.data(), b->_ticket_hmac_key.size()),
+            OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0),
+            OSSL_PARAM_construct_end(),
+        };
+        if (!EVP_MAC_CTX_set_params(hctx, params)) {
+            return -1;
+        }
+        if (!EVP_CipherInit_ex(cctx, EVP_aes_256_cbc(), nullptr, b->_ticket_aes_key.data(), iv, enc)) {
+            return -1;
+        }
+        return 1;
+    }
+
+    // Picks the first of our protocols, in our order of preference,
+    // that the client offers
+    static int alpn_select_cb(SSL*, const unsigned char** out, unsigned char* outlen, const unsigned char* in, unsigned int inlen, void* arg) {
+        auto* b = static_cast<backend*>(arg);
+        for (const auto& p : b->_owner._alpn_protocols) {
+            for (unsigned i = 0; i < inlen; i += 1 + in[i]) {
+                auto len = in[i];
+                if (i + 1 + len <= inlen && len == p.size() && std::equal(p.begin(), p.end(), in + i + 1)) {
+                    *out = in + i + 1;
+                    *outlen = len;
+                    return SSL_TLSEXT_ERR_OK;
+                }
+            }
+        }
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+
+    certificate_credentials::impl& _owner;
+    ssl_ctx_ptr _ctx;
+    bool _has_ticket_key = false;
+    std::array<unsigned char, 16> _ticket_key_name;
+    std::array<unsigned char, 32> _ticket_aes_key;
+    std::array<unsigned char, 32> _ticket_hmac_key;
+};
+
+tls::certificate_credentials::impl::impl()
+        : _backend(std::make_unique<backend>(*this)) {
+}
+
+tls::certificate_credentials::impl::~impl() {
+}
+
+void tls::certificate_credentials::impl::set_x509_trust(const blob& b, x509_crt_format fmt) {
+    auto* store = SSL_CTX_get_cert_store(*_backend);
+    for (auto& c : read_certs(b, fmt)) {
+        ossl_chk(X509_STORE_add_cert(store, c.get()));
+    }
+}
+
+void tls::certificate_credentials::impl::set_x509_crl(const blob& b, x509_crt_format fmt) {
+    auto* store = SSL_CTX_get_cert_store(*_backend);
+    for (auto& c : read_crls(b, fmt)) {
+        ossl_chk(X509_STORE_add_crl(store, c.get()));
+    }
+    ossl_chk(X509_STORE_set_flags(store, X509_V_FLAG_CRL_CHECK));
+}
+
+static void use_cert_and_key(SSL_CTX* ctx, X509* cert, EVP_PKEY* key, STACK_OF(X509)* chain) {
+    ossl_chk(SSL_CTX_use_cert_and_key(ctx, cert, key, chain, 1));
+}
+
+void tls::certificate_credentials::impl::set_x509_key(const blob& cert, const blob& key, x509_crt_format fmt) {
+    auto certs = read_certs(cert, fmt);
+    auto k = read_key(key, fmt);
+    std::unique_ptr<STACK_OF(X509), ossl_deleter<x509_stack_free_shallow>> chain(sk_X509_new_null());
+    if (!chain) {
+        throw std::bad_alloc();
+    }
+    for (auto i = std::next(certs.begin()); i != certs.end(); ++i) {
+        if (!sk_X509_push(chain.get(), i->get())) {
+            throw std::bad_alloc();
+        }
+    }
+    use_cert_and_key(*_backend, certs.front().get(), k.get(), chain.get());
+}
+
+void tls::certificate_credentials::impl::set_simple_pkcs12(const blob& b, x509_crt_format fmt,
+        const sstring& password) {
+    auto bio = make_bio(b);
+    pkcs12_ptr p12;
+    if (fmt == x509_crt_format::PEM) {
+        char* name = nullptr;
+        char* header = nullptr;
+        unsigned char* data = nullptr;
+        long len = 0;
+        ossl_chk(PEM_read_bio(bio.get(), &name, &header, &data, &len));
+        const unsigned char* p = data;
+        p12.reset(d2i_PKCS12(nullptr, &p, len));
+        OPENSSL_free(name);
+        OPENSSL_free(header);
+        OPENSSL_free(data);
+    } else {
+        p12.reset(d2i_PKCS12_bio(bio.get(), nullptr));
+    }
+    if (!p12) {
+        throw_ossl_error();
+    }
+    EVP_PKEY* key = nullptr;
+    X509* cert = nullptr;
+    STACK_OF(X509)* ca = nullptr;
+    ossl_chk(PKCS12_parse(p12.get(), password.c_str(), &key, &cert, &ca));
+    pkey_ptr key_holder(key);
+    x509_ptr cert_holder(cert);
+    std::unique_ptr<STACK_OF(X509), ossl_deleter<x509_stack_free>> ca_holder(ca);
+    if (!cert || !key) {
+        throw std::invalid_argument("PKCS12 data has no certificate and key");
+    }
+    use_cert_and_key(*_backend, cert, key, ca);
+}
+
+void tls::certificate_credentials::impl::set_dh_params(const tls::dh_params& dh) {
+    auto* params = dh._impl->get();
+    if (!params) {
+        ossl_chk(SSL_CTX_set_dh_auto(*_backend, 1));
+        return;
+    }
+    ossl_chk(EVP_PKEY_up_ref(params));
+    if (SSL_CTX_set0_tmp_dh_pkey(*_backend, params) <= 0) {
+        EVP_PKEY_free(params);
+        throw_ossl_error();
+    }
+}
+
+future<> tls::certificate_credentials::impl::set_system_trust() {
+    return async([this] {
+        ossl_chk(SSL_CTX_set_default_verify_paths(*_backend));
+        _load_system_trust = false; // should only do once, for whatever reason
+    });
+}
+
+void tls::certificate_credentials::impl::set_session_resume_key(std::span<const uint8_t> key) {
+    if (key.empty()) {
+        auto k = generate_session_resume_key();
+        _backend->set_ticket_key(k);
+        OPENSSL_cleanse(k.data(), k.size());
+    } else {
+        _backend->set_ticket_key(key);
+    }
+}
+
+void tls::certificate_credentials::impl::set_kernel_tls(bool enable) {
+    if (enable) {
+        throw std::invalid_argument("Kernel TLS offload is not supported by the OpenSSL backend");
+    }
+}
+
+void tls::certificate_credentials::impl::set_priority_string(const sstring& prio) {
+    try {
+        ossl_chk(SSL_CTX_set_cipher_list(*_backend, prio.c_str()));
+    } catch (...) {
+        std::throw_with_nested(std::invalid_argument(std::string("Could not set priority: ") + prio.c_str()));
+    }
+}
+
+tls::server_credentials::server_credentials()
+{}
+
+std::vector<uint8_t> tls::generate_session_resume_key() {
+    std::vector<uint8_t> key(64);
+    ossl_chk(RAND_bytes(key.data(), key.size()));
+    return key;
+}
+
+std::vector<uint8_t> tls::derive_session_resume_key(std::span<const uint8_t> old_key) {
+    static constexpr std::string_view label = "seastar session resume key rotation";
+    std::vector<uint8_t> key(SHA512_DIGEST_LENGTH);
+    size_t len = 0;
+    if (!EVP_Q_mac(nullptr, "HMAC", nullptr, "SHA512", nullptr, old_key.data(), old_key.size(),
+            reinterpret_cast<const unsigned char*>(label.data()), label.size(), key.data(), key.size(), &len)) {
+        throw_ossl_error();
+    }
+    key.resize(old_key.size());
+    return key;
+}
+
+namespace tls {
+
+/**
+ * Session wraps an OpenSSL SSL object, and is the
+ * actual conduit for an TLS/SSL data flow.
+ *
+ * OpenSSL does its IO through a BIO of ours (see bio_method),
+ * which reads from the input we fetched from the connected_socket,
+ * and collects the records it writes until we put them to the
+ * socket. Thus OpenSSL calls never block, they ask to be retried
+ * once there is more input instead.
+ */
+class session : public session_impl {
+public:
+    enum class type {
+        CLIENT, SERVER,
+    };
+
+    session(type t, shared_ptr<tls::certificate_credentials> creds,
+            std::unique_ptr<net::connected_socket_impl> sock, tls_options options = {})
+            : _type(t), _sock(std::move(sock)), _creds(creds->_impl),
+                    _in(_sock->source()), _out(_sock->sink()),
+                    _handshake_ctl(t == type::SERVER ? _creds->get_handshake_control() : nullptr),
+                    _in_sem(1), _out_sem(1), _options(std::move(options)),
+                    _ssl(SSL_new(_creds->get_backend())) {
+        if (!_ssl) {
+            throw_ossl_error();
+        }
+        auto* ssl = _ssl.get();
+        SSL_set_app_data(ssl, this);
+
+        auto* bio = BIO_new(bio_method());
+        if (!bio) {
+            throw_ossl_error();
+        }
+        BIO_set_data(bio, this);
+        BIO_set_init(bio, 1);
+        SSL_set_bio(ssl, bio, bio);
+
+        int mode = SSL_VERIFY_PEER;
+        if (_type == type::SERVER) {
+            SSL_set_accept_state(ssl);
+            switch (_creds->get_client_auth()) {
+                case client_auth::NONE:
+                default:
+                    mode = SSL_VERIFY_NONE;
+                    break;
+                case client_auth::REQUEST:
+                    break;
+                case client_auth::REQUIRE:
+                    mode |= SSL_VERIFY_FAIL_IF_NO_PEER_CERT;
+                    break;
+            }
+            // Maybe set up server session ticket support
+            switch (_creds->get_session_resume_mode()) {
+                case session_resume_mode::NONE:
+                default:
+                    SSL_set_options(ssl, SSL_OP_NO_TICKET);
+                    SSL_set_num_tickets(ssl, 0);
+                    break;
+                case session_resume_mode::TLS13_SESSION_TICKET:
+                    break;
+            }
+        } else {
+            SSL_set_connect_state(ssl);
+            if (!_options.server_name.empty()) {
+                in6_addr addr;
+                auto name = _options.server_name.c_str();
+                if (::inet_pton(AF_INET, name, &addr) == 1 || ::inet_pton(AF_INET6, name, &addr) == 1) {
+                    ossl_chk(X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), name));
+                } else {
+                    ossl_chk(SSL_set_tlsext_host_name(ssl, name));
+                    ossl_chk(SSL_set1_host(ssl, name));
+                }
+            }
+        }
+        // Verification aborts the handshake, so the peer immediately knows we bailed
+        SSL_set_verify(ssl, mode, &verify_wrapper);
+
+        if (_type == type::CLIENT && !_options.server_name.empty() && _options.session_resume_data.empty()) {
+            _session_cache = _creds->get_client_session_cache();
+            if (_session_cache) {
+                _options.session_resume_data = _session_cache->take(_options.server_name);
+            }
+        }
+        // if we are a client, check if we have a session ticket to unpack.
+        if (_type == type::CLIENT && !_options.session_resume_data.empty()) {
+            const unsigned char* p = _options.session_resume_data.data();
+            ssl_session_ptr s(d2i_SSL_SESSION(nullptr, &p, _options.session_resume_data.size()));
+            if (!s) {
+                throw_ossl_error();
+            }
+            ossl_chk(SSL_set_session(ssl, s.get()));
+        }
+        _options.session_resume_data.clear(); // no need to keep around
+
+        // ALPN setup. The server side selects in alpn_select_cb
+        if (_type == type::CLIENT && !_options.alpn_protocols.empty()) {
+            std::vector<unsigned char> wire;
+            for (const auto& p : _options.alpn_protocols) {
+                if (p.empty() || p.size() > 255) {
+                    throw std::invalid_argument(fmt::format("Invalid ALPN protocol name: {}", p));
+                }
+                wire.push_back(p.size());
+                wire.insert(wire.end(), p.begin(), p.end());
+            }
+            // the one function here returning 0 on success
+            if (SSL_set_alpn_protos(ssl, wire.data(), wire.size()) != 0) {
+                throw_ossl_error();
+            }
+        }
+    }
+
+    typedef temporary_buffer<char> buf_type;
+
+    future<> do_handshake() {
+        if (_connected) {
+            return make_ready_future<>();
+        }
+        ERR_clear_error();
+        auto res = SSL_do_handshake(*this);
+        if (res == 1) {
+            _connected = true;
+            if (_session_cache) {
+                _session_cache->handshake_done(SSL_session_reused(*this) != 0);
+            }
+            // The last flight, and server session tickets
+            return send_batch();
+        }
+        switch (SSL_get_error(*this, res)) {
+        case SSL_ERROR_WANT_READ:
+            // Send what we have before waiting for the peer to answer it
+            return send_batch().then([this] {
+                return wait_for_input();
+            }).then([this] {
+                return do_handshake();
+            });
+        default:
+            std::exception_ptr ep;
+            if (_verify_error) {
+                ep = std::exchange(_verify_error, nullptr);
+            } else if (ERR_GET_REASON(ERR_peek_last_error()) == SSL_R_PEER_DID_NOT_RETURN_A_CERTIFICATE) {
+                ERR_clear_error();
+                ep = std::make_exception_ptr(verification_error("No certificate was found"));
+            } else {
+                ep = std::make_exception_ptr(std::system_error(ossl_error_code(), error_category()));
+            }
+            // Send the alert OpenSSL made for the handshake error to the peer.
+            // Return to the caller the original handshake error. If sending
+            // *also* failed, ignore that.
+            return send_batch().then_wrapped([ep = std::move(ep)] (future<> f) {
+                f.ignore_ready_future();
+                return make_exception_future<>(ep);
+            });
+        }
+    }
+
+    future<> handshake() {
+        // maybe load system certificates before handshake, in case we
+        // have not done so yet...
+        if (_creds->need_load_system_trust()) {
+            return _creds->maybe_load_system_trust().then([this] {
+               return handshake();
+            });
+        }
+        if (_handshake_ctl) {
+            // The first handshake goes through admission, callers
+            // that come meanwhile wait for it
+            auto ctl = std::exchange(_handshake_ctl, nullptr);
+            _admitted_handshake.emplace(ctl->run([this] {
+                return locked_handshake();
+            }).finally([me = shared_from_this()] {}));
+        }
+        if (_admitted_handshake) {
+            auto f = _admitted_handshake->get_future();
+            if (_admitted_handshake->available()) {
+                _admitted_handshake.reset();
+            }
+            return f;
+        }
+        return locked_handshake();
+    }
+    future<> locked_handshake() {
+        // acquire both semaphores to sync both read & write
+        return with_semaphore(_in_sem, 1, [this] {
+            return with_semaphore(_out_sem, 1, [this] {
+                return do_handshake().handle_exception([this](auto ep) {
+                    if (!_error) {
+                        _error = ep;
+                    }
+                    return make_exception_future<>(_error);
+                });
+            });
+        });
+    }
+
+    size_t in_avail() const {
+        return _input.size();
+    }
+    bool eof() const {
+        return _eof;
+    }
+    future<> wait_for_input() {
+        if (!_input.empty()) {
+            return make_ready_future<>();
+        }
+        return _in.get().then([this](buf_type buf) {
+            _eof |= buf.empty();
+           _input = std::move(buf);
+        }).handle_exception([this](auto ep) {
+           _error = ep;
+           return make_exception_future(ep);
+        });
+    }
+    // Writes the records OpenSSL produced so far
+    future<> send_batch() {
+        if (_batch.len() == 0) {
+            return make_ready_future<>();
+        }
+        return _out.put(std::exchange(_batch, net::packet())).handle_exception([this](auto ep) {
+           _error = ep;
+           return make_exception_future(ep);
+        });
+    }
+    // Records written while reading, e.g. a TLS 1.3 key update
+    // response, go out in the background behind any ongoing write
+    void maybe_send_batch_in_background() {
+        if (_batch.len() == 0 || _shutdown) {
+            return;
+        }
+        engine().run_in_background(with_semaphore(_out_sem, 1, [this] {
+            return send_batch();
+        }).handle_exception([me = shared_from_this()](std::exception_ptr) {}));
+    }
+
+    static session * from_ssl(const SSL* ssl) {
+        return static_cast<session *>(SSL_get_app_data(ssl));
+    }
+    static int verify_wrapper(int preverify_ok, X509_STORE_CTX* ctx) {
+        auto* ssl = static_cast<SSL*>(X509_STORE_CTX_get_ex_data(ctx, SSL_get_ex_data_X509_STORE_CTX_idx()));
+        return from_ssl(ssl)->verify(preverify_ok, ctx);
+    }
+    static int bio_write(BIO* bio, const char* data, size_t len, size_t* written) {
+        return static_cast<session *>(BIO_get_data(bio))->push(data, len, written);
+    }
+    static int bio_read(BIO* bio, char* dst, size_t len, size_t* readbytes) {
+        return static_cast<session *>(BIO_get_data(bio))->pull(bio, dst, len, readbytes);
+    }
+    static long bio_ctrl(BIO*, int cmd, long, void*) {
+        switch (cmd) {
+        case BIO_CTRL_FLUSH:
+            // see send_batch
+            return 1;
+        default:
+            return 0;
+        }
+    }
+    static BIO_METHOD* bio_method() {
+        static const std::unique_ptr<BIO_METHOD, ossl_deleter<BIO_meth_free>> method([] {
+            auto* m = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "seastar");
+            if (!m) {
+                throw std::bad_alloc();
+            }
+            BIO_meth_set_write_ex(m, &bio_write);
+            BIO_meth_set_read_ex(m, &bio_read);
+            BIO_meth_set_ctrl(m, &bio_ctrl);
+            return m;
+        }());
+        return method.get();
+    }
+
+    // The chain and, for clients, the host name are checked by OpenSSL.
+    // We add the DN callback, and keep the error to report it with
+    // the certificate that failed.
+    int verify(int preverify_ok, X509_STORE_CTX* ctx) noexcept {
+        if (!_creds->_enable_certificate_verification) {
+            return 1;
+        }
+        auto* cert = X509_STORE_CTX_get_current_cert(ctx);
+        try {
+            if (!preverify_ok) {
+                sstring msg = X509_verify_cert_error_string(X509_STORE_CTX_get_error(ctx));
+                // If possible, include issuer/subject info on the cert that failed verification.
+                if (cert) {
+                    msg += fmt::format(" (Issuer=[{}], Subject=[{}])",
+                            name_to_string(X509_get_issuer_name(cert)), name_to_string(X509_get_subject_name(cert)));
+                }
+                throw verification_error(msg);
+            }
+            if (X509_STORE_CTX_get_error_depth(ctx) == 0 && _creds->_dn_callback && cert) {
+                // if the user registered a DN (Distinguished Name) callback
+                // then extract subject and issuer from the (leaf) peer certificate and invoke the callback
+                auto t = _type == type::CLIENT ? session_type::CLIENT : session_type::SERVER;
+                _creds->_dn_callback(t, name_to_string(X509_get_subject_name(cert)), name_to_string(X509_get_issuer_name(cert)));
+            }
+            return 1;
+        } catch (...) {
+            _verify_error = std::current_exception();
+            return 0;
+        }
+    }
+
+    future<temporary_buffer<char>> get() override {
+        if (_error) {
+            return make_exception_future<temporary_buffer<char>>(_error);
+        }
+        if (_shutdown || eof()) {
+            return make_ready_future<temporary_buffer<char>>();
+        }
+        if (!_connected) {
+            return handshake().then(std::bind(&session::get, this));
+        }
+        return with_semaphore(_in_sem, 1, std::bind(&session::do_get, this));
+    }
+
+    future<temporary_buffer<char>> do_get() {
+        // OpenSSL might have stuff in its buffers.
+        size_t avail = SSL_pending(*this);
+        if (avail == 0) {
+            // or we might...
+            avail = in_avail();
+        }
+        if (avail != 0) {
+            // typically, unencrypted data can get smaller (padding),
+            // but not larger.
+            temporary_buffer<char> buf(avail);
+            size_t n = 0;
+            ERR_clear_error();
+            auto res = SSL_read_ex(*this, buf.get_write(), buf.size(), &n);
+            maybe_send_batch_in_background();
+            if (res <= 0) {
+                switch (SSL_get_error(*this, res)) {
+                case SSL_ERROR_WANT_READ:
+                    // Assume we got this because we read to little underlying
+                    // data to finish a tls packet, or only got non-data records.
+                    // Our input buffer should be empty now, so just go again
+                    return do_get();
+                case SSL_ERROR_ZERO_RETURN:
+                    // close_notify
+                    _eof = true;
+                    return make_ready_future<temporary_buffer<char>>();
+                default:
+                    _error = std::make_exception_ptr(std::system_error(ossl_error_code(), error_category()));
+                    return make_exception_future<temporary_buffer<char>>(_error);
+                }
+            }
+            buf.trim(n);
+            return make_ready_future<temporary_buffer<char>>(std::move(buf));
+        }
+        if (eof()) {
+            return make_ready_future<temporary_buffer<char>>();
+        }
+        // No input? wait for out buffers to fill...
+        return wait_for_input().then([this] {
+            return do_get();
+        });
+    }
+
+    typedef net::fragment* frag_iter;
+
+    // Largest plaintext of a single record
+    static constexpr size_t max_record_size = SSL3_RT_MAX_PLAIN_LENGTH;
+    // Upper bound of plaintext encrypted before the records are written out
+    static constexpr size_t max_batch_size = 128 * 1024;
+
+    // Packs the fragments into full size records regardless of how the
+    // packet is fragmented: small ones are gathered in _staging, large
+    // ones are encrypted in place. The records are collected into a
+    // single packet (see push), written with one put per max_batch_size
+    // of data.
+    future<> do_put(frag_iter i, frag_iter e) {
+        return do_for_each(i, e, [this](net::fragment& f) {
+            try {
+                encrypt(f.base, f.size);
+            } catch (...) {
+                _error = std::current_exception();
+                return make_exception_future<>(_error);
+            }
+            return _batch.len() >= max_batch_size ? send_batch() : make_ready_future<>();
+        }).then([this] {
+            try {
+                encrypt_staged();
+            } catch (...) {
+                _error = std::current_exception();
+                return make_exception_future<>(_error);
+            }
+            return send_batch();
+        });
+    }
+    void encrypt(const char* p, size_t n) {
+        if (n >= max_record_size) {
+            encrypt_staged();
+            write(p, n);
+            return;
+        }
+        while (n != 0) {
+            auto c = std::min(n, max_record_size - _staging.size());
+            _staging.insert(_staging.end(), p, p + c);
+            p += c;
+            n -= c;
+            if (_staging.size() == max_record_size) {
+                encrypt_staged();
+            }
+        }
+    }
+    void encrypt_staged() {
+        if (!_staging.empty()) {
+            write(_staging.data(), _staging.size());
+            _staging.clear();
+        }
+    }
+    void write(const char* p, size_t n) {
+        size_t written;
+        ERR_clear_error();
+        // push never blocks, so the whole buffer is written
+        if (SSL_write_ex(*this, p, n, &written) <= 0) {
+            throw std::system_error(ossl_error_code(), error_category());
+        }
+    }
+    future<> put(net::packet p) override {
+        if (_error) {
+            return make_exception_future<>(_error);
+        }
+        if (_shutdown) {
+            return make_exception_future<>(std::system_error(EPIPE, std::system_category()));
+        }
+        if (!_connected) {
+            return handshake().then([this, p = std::move(p)]() mutable {
+               return put(std::move(p));
+            });
+        }
+
+        auto i = p.fragments().begin();
+        auto e = p.fragments().end();
+        return with_semaphore(_out_sem, 1, std::bind(&session::do_put, this, i, e)).finally([p = std::move(p)] {});
+    }
+
+    int pull(BIO* bio, char* dst, size_t len, size_t* readbytes) {
+        BIO_clear_retry_flags(bio);
+        *readbytes = 0;
+        if (eof()) {
+            return 0;
+        }
+        // If we have data in buffers, we can complete.
+        // Otherwise, ask OpenSSL to retry once we got some.
+        if (_input.empty()) {
+            BIO_set_retry_read(bio);
+            return 0;
+        }
+        auto n = std::min(len, _input.size());
+        memcpy(dst, _input.get(), n);
+        _input.trim_front(n);
+        *readbytes = n;
+        return 1;
+    }
+    int push(const char* data, size_t len, size_t* written) {
+        // Records, sent together by send_batch()
+        temporary_buffer<char> buf(data, len);
+        _batch = net::packet(std::move(_batch), std::move(buf));
+        *written = len;
+        return 1;
+    }
+
+    operator SSL*() const {
+        return _ssl.get();
+    }
+
+    future<> do_shutdown() {
+        if (_error || !_connected) {
+            return make_ready_future();
+        }
+        // We only send "bye" alert, letting a "normal" (either pending, or subsequent)
+        // read deal with reading the expected EOF alert.
+        ERR_clear_error();
+        if (SSL_shutdown(*this) < 0) {
+            _error = std::make_exception_ptr(std::system_error(ossl_error_code(), error_category()));
+            return make_exception_future(_error);
+        }
+        return send_batch();
+    }
+    future<> wait_for_eof() {
+        if (!_options.wait_for_eof_on_shutdown) {
+            return make_ready_future();
+        }
+
+        // read records until we get an eof alert
+        // since this call could time out, we must not ac
+        return with_semaphore(_in_sem, 1, [this] {
+            if (_error || !_connected) {
+                return make_ready_future();
+            }
+            return repeat([this] {
+                if (eof()) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                return do_get().then([](auto buf) {
+                   return make_ready_future<stop_iteration>(stop_iteration::no);
+                });
+            });
+        });
+    }
+    future<> shutdown() {
+        // first, make sure any pending write is done.
+        // bye handshake is a flush operation, but this
+        // allows us to not pay extra attention to output state
+        //
+        // we only send a simple "bye" alert packet. Then we
+        // read from input until we see EOF. Any other reader
+        // before us will get it instead of us, and mark _eof = true
+        // in which case we will be no-op.
+        return with_semaphore(_out_sem, 1,
+                        std::bind(&session::do_shutdown, this)).then(
+                        std::bind(&session::wait_for_eof, this)).finally([me = shared_from_this()] {});
+        // note moved finally clause above. It is theorethically possible
+        // that we could complete do_shutdown just before the close calls
+        // below, get pre-empted, have "close()" finish, get freed, and
+        // then call wait_for_eof on stale pointer.
+    }
+    void close() noexcept override {
+        // only do once.
+        if (!std::exchange(_shutdown, true)) {
+            maybe_cache_session();
+            auto me = shared_from_this();
+            // running in background. try to bye-handshake us nicely, but after 10s we forcefully close.
+            engine().run_in_background(with_timeout(timer<>::clock::now() + std::chrono::seconds(10), shutdown()).finally([this] {
+                _eof = true;
+                try {
+                    (void)_in.close().handle_exception([](std::exception_ptr) {}); // should wake any waiters
+                } catch (...) {
+                }
+                try {
+                    (void)_out.close().handle_exception([](std::exception_ptr) {});
+                } catch (...) {
+                }
+                // make sure to wait for handshake attempt to leave semaphores. Must be in same order as
+                // handshake aqcuire, because in worst case, we get here while a reader is attempting
+                // re-handshake.
+                return with_semaphore(_in_sem, 1, [this] {
+                    return with_semaphore(_out_sem, 1, [] {});
+                });
+            }).then_wrapped([me = std::move(me)](future<> f) { // must keep object alive until here.
+                f.ignore_ready_future();
+            }));
+        }
+    }
+    // helper for sink
+    future<> flush() noexcept override {
+        return with_semaphore(_out_sem, 1, [this] {
+            return _out.flush();
+        });
+    }
+
+    seastar::net::connected_socket_impl& socket() const override {
+        return *_sock;
+    }
+
+    // helper routine.
+    template<typename Func, typename... Args>
+    auto state_checked_access(Func&& f, Args&& ...args) {
+        using future_type = typename futurize<std::invoke_result_t<Func, Args...>>::type;
+        using result_t = typename future_type::value_type;
+        if (_error) {
+            return make_exception_future<result_t>(_error);
+        }
+        if (_shutdown) {
+            return make_exception_future<result_t>(std::system_error(ENOTCONN, std::system_category()));
+        }
+        if (!_connected) {
+            return handshake().then([this, f = std::move(f), ...args = std::forward<Args>(args)]() mutable {
+                // always recurse, in case malicious api caller does a shutdown while the above handshake is
+                // happening. I.e. misuses the api.
+                return session::state_checked_access(std::move(f), std::forward<Args>(args)...);
+            });
+        }
+        return futurize_invoke(f, std::forward<Args>(args)...);
+    }
+
+    future<bool> is_resumed() override {
+        return state_checked_access([this] {
+            return SSL_session_reused(*this) != 0;
+        });
+    }
+    session_data resume_data() {
+        /**
+         * Session ticket data is not available just because handshake
+         * was done. First off, of course other part must support it,
+         * but we also (mostly?) need to actually transfer data before
+         * the ticket is received.
+         */
+        ssl_session_ptr s(SSL_get1_session(*this));
+        if (!s || !SSL_SESSION_is_resumable(s.get())) {
+            return session_data{};
+        }
+        auto len = i2d_SSL_SESSION(s.get(), nullptr);
+        if (len <= 0) {
+            throw_ossl_error();
+        }
+        session_data res(len);
+        auto* p = res.data();
+        i2d_SSL_SESSION(s.get(), &p);
+        return res;
+    }
+    // Keeps the session for the next connection to the server to resume,
+    // once the ticket had its chance to arrive
+    void maybe_cache_session() noexcept {
+        if (!_session_cache || !_connected || _error) {
+            return;
+        }
+        try {
+            _session_cache->put(_options.server_name, resume_data());
+        } catch (...) {
+            // only costs the next connection a full handshake
+        }
+    }
+    future<session_data> get_session_resume_data() override {
+        return state_checked_access([this] {
+            return resume_data();
+        });
+    }
+    future<std::optional<session_dn>> get_distinguished_name() override {
+        return state_checked_access([this] {
+            return extract_dn_information();
+        });
+    }
+    future<std::vector<subject_alt_name>> get_alt_name_information(std::unordered_set<subject_alt_name_type> types) override {
+        return state_checked_access([this](std::unordered_set<subject_alt_name_type> types) {
+            std::vector<subject_alt_name> res;
+
+            auto* peer = SSL_get0_peer_certificate(*this);
+            if (!peer) {
+                return res;
+            }
+            general_names_ptr names(static_cast<GENERAL_NAMES*>(X509_get_ext_d2i(peer, NID_subject_alt_name, nullptr, nullptr)));
+            if (!names) {
+                return res;
+            }
+            auto to_sstring = [](const ASN1_STRING* s) {
+                return sstring(reinterpret_cast<const char*>(ASN1_STRING_get0_data(s)), ASN1_STRING_length(s));
+            };
+            for (int i = 0; i < sk_GENERAL_NAME_num(names.get()); ++i) {
+                auto* name = sk_GENERAL_NAME_value(names.get(), i);
+                subject_alt_name v;
+                switch (name->type) {
+                    case GEN_DNS:
+                        v.type = subject_alt_name_type::dnsname;
+                        break;
+                    case GEN_EMAIL:
+                        v.type = subject_alt_name_type::rfc822name;
+                        break;
+                    case GEN_URI:
+                        v.type = subject_alt_name_type::uri;
+                        break;
+                    case GEN_IPADD:
+                        v.type = subject_alt_name_type::ipaddress;
+                        break;
+                    case GEN_OTHERNAME:
+                        v.type = subject_alt_name_type::othername;
+                        break;
+                    case GEN_DIRNAME:
+                        v.type = subject_alt_name_type::dn;
+                        break;
+                    default:
+                        continue;
+                }
+
+                if (!types.empty() && !types.count(v.type)) {
+                    continue;
+                }
+
+                switch (v.type) {
+                    case subject_alt_name_type::ipaddress:
+                    {
+                        auto* ip = name->d.iPAddress;
+                        auto size = size_t(ASN1_STRING_length(ip));
+                        union {
+                            char c;
+                            ::in_addr in;
+                            ::in6_addr in6;
+                        } tmp;
+
+                        if (size == sizeof(::in_addr)) {
+                            memcpy(&tmp.c, ASN1_STRING_get0_data(ip), size);
+                            v.value = net::inet_address(tmp.in);
+                        } else if (size == sizeof(::in6_addr)) {
+                            memcpy(&tmp.c, ASN1_STRING_get0_data(ip), size);
+                            v.value = net::inet_address(tmp.in6);
+                        } else {
+                            throw std::runtime_error(fmt::format("Unexpected size {} for ipaddress alt name value", size));
+                        }
+                        break;
+                    }
+                    case subject_alt_name_type::othername:
+                    {
+                        // the DER encoded value, as gnutls reports it
+                        unsigned char* der = nullptr;
+                        auto len = i2d_ASN1_TYPE(name->d.otherName->value, &der);
+                        if (len < 0) {
+                            throw_ossl_error();
+                        }
+                        v.value = sstring(reinterpret_cast<const char*>(der), len);
+                        OPENSSL_free(der);
+                        break;
+                    }
+                    case subject_alt_name_type::dn:
+                        v.value = name_to_string(name->d.directoryName);
+                        break;
+                    default:
+                        v.value = to_sstring(name->d.ia5);
+                        break;
+                }
+
+                res.emplace_back(std::move(v));
+            }
+            return res;
+        }, std::move(types));
+    }
+
+    future<std::vector<certificate_data>> get_peer_certificate_chain() override {
+        return state_checked_access([this] {
+            auto res = std::vector<certificate_data>{};
+            auto add = [&res](X509* cert) {
+                auto len = i2d_X509(cert, nullptr);
+                if (len <= 0) {
+                    throw_ossl_error();
+                }
+                res.emplace_back(len);
+                auto* p = res.back().data();
+                i2d_X509(cert, &p);
+            };
+            auto* chain = SSL_get_peer_cert_chain(*this);
+            // on the server side, the chain does not include the peer's own certificate
+            if (_type == type::SERVER) {
+                if (auto* leaf = SSL_get0_peer_certificate(*this)) {
+                    add(leaf);
+                }
+            }
+            if (chain) {
+                for (int i = 0; i < sk_X509_num(chain); ++i) {
+                    add(sk_X509_value(chain, i));
+                }
+            }
+            return res;
+        });
+    }
+
+    future<std::optional<sstring>> get_selected_alpn_protocol() override {
+        return state_checked_access([this]() -> std::optional<sstring> {
+            const unsigned char* data = nullptr;
+            unsigned int len = 0;
+            SSL_get0_alpn_selected(*this, &data, &len);
+            if (len == 0) {
+                return std::nullopt;
+            }
+            return {{reinterpret_cast<const char*>(data), len}};
+        });
+    }
+
+private:
+    std::optional<session_dn> extract_dn_information() const {
+        auto* peer_leaf_cert = SSL_get0_peer_certificate(*this);
+        if (!peer_leaf_cert) {
+            return std::nullopt;
+        }
+        return session_dn{.subject=name_to_string(X509_get_subject_name(peer_leaf_cert)),
+                          .issuer=name_to_string(X509_get_issuer_name(peer_leaf_cert))};
+    }
+
+    type _type;
+
+    std::unique_ptr<net::connected_socket_impl> _sock;
+    shared_ptr<tls::certificate_credentials::impl> _creds;
+    data_source _in;
+    data_sink _out;
+    // Handshake admission, given up once the first handshake attempt starts
+    lw_shared_ptr<handshake_control> _handshake_ctl;
+    std::optional<shared_future<>> _admitted_handshake;
+    // Set for clients using the cache of their credentials
+    lw_shared_ptr<client_session_cache> _session_cache;
+    // Records written by OpenSSL, see push
+    net::packet _batch;
+    // Plaintext gathered into a full record, see do_put
+    std::vector<char> _staging;
+    // Set by verify() when it fails the handshake
+    std::exception_ptr _verify_error;
+
+    semaphore _in_sem, _out_sem;
+
+    tls_options _options;
+
+    bool _eof = false;
+    bool _shutdown = false;
+    bool _connected = false;
+    std::exception_ptr _error;
+
+    buf_type _input;
+
+    ssl_ptr _ssl;
+};
+
+shared_ptr<session_impl> make_client_session(shared_ptr<certificate_credentials> creds, std::unique_ptr<net::connected_socket_impl> sock, tls_options options) {
+    return seastar::make_shared<session>(session::type::CLIENT, std::move(creds), std::move(sock), std::move(options));
+}
+
+shared_ptr<session_impl> make_server_session(shared_ptr<server_credentials> creds, std::unique_ptr<net::connected_socket_impl> sock) {
+    return seastar::make_shared<session>(session::type::SERVER, std::move(creds), std::move(sock));
+}
+
+}
+
+}
+
+const int seastar::tls::ERROR_UNKNOWN_COMPRESSION_ALGORITHM = ERR_PACK(ERR_LIB_SSL, 0, SSL_R_UNSUPPORTED_COMPRESSION_ALGORITHM);
+const int seastar::tls::ERROR_UNKNOWN_CIPHER_TYPE = ERR_PACK(ERR_LIB_SSL, 0, SSL_R_UNKNOWN_CIPHER_TYPE);
+const int seastar::tls::ERROR_INVALID_SESSION = ERR_PACK(ERR_LIB_SSL, 0, SSL_R_INVALID_SESSION_ID);
+const int seastar::tls::ERROR_UNEXPECTED_HANDSHAKE_PACKET = ERR_PACK(ERR_LIB_SSL, 0, SSL_R_UNEXPECTED_MESSAGE);
+const int seastar::tls::ERROR_UNKNOWN_CIPHER_SUITE = ERR_PACK(ERR_LIB_SSL, 0, SSL_R_NO_SHARED_CIPHER);
+const int seastar::tls::ERROR_UNKNOWN_ALGORITHM = ERR_PACK(ERR_LIB_SSL, 0, SSL_R_UNKNOWN_DIGEST);
+const int seastar::tls::ERROR_UNSUPPORTED_SIGNATURE_ALGORITHM = ERR_PACK(ERR_LIB_SSL, 0, SSL_R_NO_SUITABLE_SIGNATURE_ALGORITHM);
+const int seastar::tls::ERROR_SAFE_RENEGOTIATION_FAILED = ERR_PACK(ERR_LIB_SSL, 0, SSL_R_RENEGOTIATION_MISMATCH);
+const int seastar::tls::ERROR_UNSAFE_RENEGOTIATION_DENIED = ERR_PACK(ERR_LIB_SSL, 0, SSL_R_UNSAFE_LEGACY_RENEGOTIATION_DISABLED);
+const int seastar::tls::ERROR_UNKNOWN_SRP_USERNAME = ERR_PACK(ERR_LIB_SSL, 0, SSL_R_INVALID_SRP_USERNAME);
+const int seastar::tls::ERROR_PREMATURE_TERMINATION = ERR_PACK(ERR_LIB_SSL, 0, SSL_R_UNEXPECTED_EOF_WHILE_READING);
+const int seastar::tls::ERROR_PUSH = ERR_PACK(ERR_LIB_BIO, 0, BIO_R_BROKEN_PIPE);
+const int seastar::tls::ERROR_PULL = ERR_PACK(ERR_LIB_BIO, 0, BIO_R_TRANSFER_ERROR);
+const int seastar::tls::ERROR_UNEXPECTED_PACKET = ERR_PACK(ERR_LIB_SSL, 0, SSL_R_UNEXPECTED_RECORD);
+const int seastar::tls::ERROR_UNSUPPORTED_VERSION = ERR_PACK(ERR_LIB_SSL, 0, SSL_R_UNSUPPORTED_PROTOCOL);
+const int seastar::tls::ERROR_NO_CIPHER_SUITES = ERR_PACK(ERR_LIB_SSL, 0, SSL_R_NO_CIPHERS_AVAILABLE);
+const int seastar::tls::ERROR_DECRYPTION_FAILED = ERR_PACK(ERR_LIB_SSL, 0, SSL_R_DECRYPTION_FAILED);
+const int seastar::tls::ERROR_MAC_VERIFY_FAILED = ERR_PACK(ERR_LIB_SSL, 0, SSL_R_DECRYPTION_FAILED_OR_BAD_RECORD_MAC);
+
+#endif
@@ -28,11 +28,15 @@ module;
 #include <cctype>
 #include <cstdint>
 #include <functional>
+#include <iterator>
 #include <memory>
+#include <new>
+#include <utility>
 
 #ifdef SEASTAR_MODULE
 module seastar;
 #else
+#include <seastar/core/memory.hh>
 #include <seastar/core/print.hh>
 #include <seastar/core/smp.hh>
 #include <seastar/net/packet.hh>
@@ -47,6 +51,71 @@ namespace net {
 
 static_assert(std::is_nothrow_move_constructible_v<packet>);
 
+namespace {
+
+// The fragment counts of the pooled impls, by class. Larger impls are not
+// pooled.
+constexpr size_t pooled_nr_frags[] = { 4, 8, 16, 32 };
+// What a shard keeps around per class, at most
+constexpr size_t max_pooled_impls = 128;
+
+struct free_impl {
+    free_impl* next;
+};
+
+struct impl_pool {
+    free_impl* head = nullptr;
+    size_t size = 0;
+
+    impl_pool() = default;
+    impl_pool(const impl_pool&) = delete;
+    ~impl_pool() {
+        while (head) {
+            ::operator delete(std::exchange(head, head->next));
+        }
+    }
+};
+
+// Impls freed on another shard than the one which allocated them go back
+// to the allocator, which returns them to their shard
+thread_local impl_pool impl_pools[std::size(pooled_nr_frags)];
+
+}
+
+std::unique_ptr<packet::impl> packet::impl::allocate(size_t nr_frags) {
+    nr_frags = std::max(nr_frags, default_nr_frags);
+    uint8_t pool_class = std::ranges::find_if(pooled_nr_frags, [nr_frags] (size_t n) { return n >= nr_frags; }) - std::begin(pooled_nr_frags);
+    void* p = nullptr;
+    if (pool_class != std::size(pooled_nr_frags)) {
+        nr_frags = pooled_nr_frags[pool_class];
+        auto& pool = impl_pools[pool_class];
+        if (pool.head) {
+            p = std::exchange(pool.head, pool.head->next);
+            --pool.size;
+        }
+    } else {
+        SEASTAR_ASSERT(nr_frags == uint16_t(nr_frags));
+        pool_class = no_pool;
+    }
+    uint32_t storage_size = nr_frags * sizeof(fragment) + internal_data_size;
+    if (!p) {
+        p = ::operator new(sizeof(impl) + storage_size);
+    }
+    return std::unique_ptr<impl>(new (p) impl(storage_size, pool_class));
+}
+
+void packet::impl::operator delete(impl* p, std::destroying_delete_t) noexcept {
+    auto pool_class = p->_pool_class;
+    p->~impl();
+    if (pool_class != no_pool && impl_pools[pool_class].size < max_pooled_impls && memory::internal::is_local(p)) {
+        auto& pool = impl_pools[pool_class];
+        pool.head = new (p) free_impl{pool.head};
+        ++pool.size;
+    } else {
+        ::operator delete(p);
+    }
+}
+
 void packet::linearize(size_t at_frag, size_t desired_size) {
     _impl->unuse_internal_data();
     size_t nr_frags = 0;
@@ -23,20 +23,30 @@
 module;
 #endif
 
+#include <algorithm>
 #include <chrono>
 #include <cstring>
+#include <deque>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <random>
+#include <utility>
 #include <variant>
 
+#include <fcntl.h>
 #include <unistd.h>
+#include <linux/filter.h>
 #include <linux/if.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 #include <arpa/inet.h>
 #include <net/route.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <netinet/sctp.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <seastar/util/assert.hh>
 
@@ -45,12 +55,28 @@ module seastar;
 #else
 #include <seastar/core/loop.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/core/internal/poll.hh>
 #include <seastar/net/posix-stack.hh>
 #include <seastar/net/net.hh>
+#include <seastar/net/socket_handoff.hh>
 #include <seastar/net/packet.hh>
 #include <seastar/net/api.hh>
 #include <seastar/net/inet_address.hh>
 #include <seastar/util/std-compat.hh>
+#include <seastar/util/log.hh>
+#include "core/file-impl.hh"
+#include "net/tls-impl.hh"
+#endif
+
+#ifndef EPIOCSPARAMS
+// Linux 6.9 UAPI, not in the older headers
+struct epoll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
 #endif
 
 namespace std {
@@ -115,6 +141,80 @@ class posix_connected_socket_operations {
     }
 };
 
+static logger posix_stack_log("posix-stack");
+
+// Drives the NAPI busy polling of the shard's sockets from the reactor.
+// The sockets are added to an epoll instance of their own that is never
+// waited on, polling it with a zero timeout runs a round of the busy poll
+// loop on the NAPI instance the sockets' packets come from.
+class busy_poller {
+    file_desc _epfd;
+    unsigned _usecs;
+    unsigned _budget;
+    bool _sockopt_failed = false;
+    std::unique_ptr<internal::poller> _poller;
+
+    struct busy_pollfn final : public pollfn {
+        busy_poller& _bp;
+        explicit busy_pollfn(busy_poller& bp) : pollfn(internal::loop_phase::network), _bp(bp) {}
+        virtual bool poll() override {
+            return _bp.poll();
+        }
+        virtual bool pure_poll() override {
+            return false;
+        }
+        // The sockets wake the reactor up as usual while it sleeps
+        virtual bool try_enter_interrupt_mode() override {
+            return true;
+        }
+        virtual void exit_interrupt_mode() override {
+        }
+    };
+public:
+    busy_poller(unsigned usecs, unsigned budget)
+        : _epfd(file_desc::epoll_create(EPOLL_CLOEXEC))
+        , _usecs(usecs)
+        , _budget(budget) {
+        epoll_params params = {};
+        params.busy_poll_usecs = usecs;
+        params.busy_poll_budget = budget;
+        params.prefer_busy_poll = 1;
+        if (::ioctl(_epfd.get(), EPIOCSPARAMS, &params) == -1) {
+            posix_stack_log.info("Can't set the epoll busy poll parameters ({}), the net.core.busy_poll sysctl applies",
+                    std::system_error(errno, std::system_category()).what());
+        }
+        _poller = std::make_unique<internal::poller>(std::make_unique<busy_pollfn>(*this));
+    }
+    void add(file_desc& fd) noexcept {
+        try {
+            fd.setsockopt(SOL_SOCKET, SO_BUSY_POLL, int(_usecs));
+            fd.setsockopt(SOL_SOCKET, SO_PREFER_BUSY_POLL, 1);
+            fd.setsockopt(SOL_SOCKET, SO_BUSY_POLL_BUDGET, int(_budget));
+        } catch (std::system_error& e) {
+            if (!std::exchange(_sockopt_failed, true)) {
+                posix_stack_log.warn("Can't enable busy polling on sockets: {}", e.what());
+            }
+        }
+        epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLET;
+        ::epoll_ctl(_epfd.get(), EPOLL_CTL_ADD, fd.get(), &ev);
+    }
+    bool poll() noexcept {
+        // Takes the events too so that the ready list is empty, the kernel
+        // only busy polls when there are none
+        std::array<epoll_event, 64> events;
+        return ::epoll_wait(_epfd.get(), events.data(), events.size(), 0) > 0;
+    }
+};
+
+static thread_local busy_poller* local_busy_poller;
+
+static void busy_poll_add(sa_family_t family, pollable_fd& fd) noexcept {
+    if (local_busy_poller && family != AF_UNIX) {
+        local_busy_poller->add(fd.get_file_desc());
+    }
+}
+
 thread_local posix_ap_server_socket_impl::port_map_t posix_ap_server_socket_impl::ports{};
 thread_local posix_ap_server_socket_impl::sockets_map_t posix_ap_server_socket_impl::sockets{};
 thread_local posix_ap_server_socket_impl::conn_map_t posix_ap_server_socket_impl::conn_q{};
@@ -234,23 +334,54 @@ static void shutdown_socket_fd(pollable_fd& fd, int how) noexcept {
     }
 }
 
+// Hands out the data a connection received on the shard it moved from
+// before reading from the socket
+class unread_data_source_impl final : public data_source_impl {
+    temporary_buffer<char> _unread;
+    data_source _src;
+public:
+    unread_data_source_impl(temporary_buffer<char> unread, data_source src)
+        : _unread(std::move(unread)), _src(std::move(src)) {
+    }
+    virtual future<temporary_buffer<char>> get() override {
+        if (!_unread.empty()) {
+            return make_ready_future<temporary_buffer<char>>(std::move(_unread));
+        }
+        return _src.get();
+    }
+    virtual future<> close() override {
+        return _src.close();
+    }
+};
+
 class posix_connected_socket_impl final : public connected_socket_impl {
     pollable_fd _fd;
     const posix_connected_socket_operations* _ops;
     conntrack::handle _handle;
     std::pmr::polymorphic_allocator<char>* _allocator;
+    // Received on the shard the connection was migrated from, and not
+    // consumed there
+    temporary_buffer<char> _unread;
 private:
     explicit posix_connected_socket_impl(sa_family_t family, int protocol, pollable_fd fd, std::pmr::polymorphic_allocator<char>* allocator=memory::malloc_allocator) :
-        _fd(std::move(fd)), _ops(get_posix_connected_socket_ops(family, protocol)), _allocator(allocator) {}
+        _fd(std::move(fd)), _ops(get_posix_connected_socket_ops(family, protocol)), _allocator(allocator) {
+        busy_poll_add(family, _fd);
+    }
     explicit posix_connected_socket_impl(sa_family_t family, int protocol, pollable_fd fd, conntrack::handle&& handle,
         std::pmr::polymorphic_allocator<char>* allocator=memory::malloc_allocator) : _fd(std::move(fd))
-                , _ops(get_posix_connected_socket_ops(family, protocol)), _handle(std::move(handle)), _allocator(allocator) {}
+                , _ops(get_posix_connected_socket_ops(family, protocol)), _handle(std::move(handle)), _allocator(allocator) {
+        busy_poll_add(family, _fd);
+    }
 public:
     virtual data_source source() override {
         return source(connected_socket_input_stream_config());
     }
     virtual data_source source(connected_socket_input_stream_config csisc) override {
-        return data_source(std::make_unique<posix_data_source_impl>(_fd, csisc, _allocator));
+        auto src = data_source(std::make_unique<posix_data_source_impl>(_fd, csisc, _allocator));
+        if (_unread) {
+            return data_source(std::make_unique<unread_data_source_impl>(std::move(_unread), std::move(src)));
+        }
+        return src;
     }
     virtual data_sink sink() override {
         return data_sink(std::make_unique< posix_data_sink_impl>(_fd));
@@ -294,6 +425,9 @@ class posix_connected_socket_impl final : public connected_socket_impl {
     future<> wait_input_shutdown() override {
         return _fd.poll_rdhup();
     }
+    int native_fd() const noexcept override {
+        return _fd.get_file_desc().get();
+    }
 
     friend class posix_server_socket_impl;
     friend class posix_ap_server_socket_impl;
@@ -301,6 +435,9 @@ class posix_connected_socket_impl final : public connected_socket_impl {
     friend class posix_network_stack;
     friend class posix_ap_network_stack;
     friend class posix_socket_impl;
+    friend connected_socket adopt_connected_socket(handoff_socket s);
+    friend future<> migrate_connected_socket(connected_socket cs, input_stream<char> in, shard_id to,
+            noncopyable_function<future<> (connected_socket)> func) noexcept;
 };
 
 static void resolve_outgoing_address(socket_address& a) {
@@ -508,7 +645,7 @@ posix_server_socket_impl::accept() {
     return _lfd.accept().then([this] (std::tuple<pollable_fd, socket_address> fd_sa) {
         auto& fd = std::get<0>(fd_sa);
         auto& sa = std::get<1>(fd_sa);
-        auto cth = [this, &sa] {
+        auto cth = [this, &fd, &sa] {
             switch(_lba) {
             case server_socket::load_balancing_algorithm::connection_distribution:
                 return _conntrack.get_handle();
@@ -516,6 +653,11 @@ posix_server_socket_impl::accept() {
                 return _conntrack.get_handle(ntoh(sa.as_posix_sockaddr_in().sin_port) % smp::count);
             case server_socket::load_balancing_algorithm::fixed:
                 return _conntrack.get_handle(_fixed_cpu);
+            case server_socket::load_balancing_algorithm::incoming_cpu: {
+                auto cpu = fd.get_file_desc().getsockopt<int>(SOL_SOCKET, SO_INCOMING_CPU);
+                auto shard = cpu >= 0 ? smp::shard_of_cpu(cpu) : std::nullopt;
+                return shard ? _conntrack.get_handle(*shard) : _conntrack.get_handle();
+            }
             default: abort();
             }
         } ();
@@ -689,6 +831,40 @@ posix_data_sink_impl::put(packet p) {
     return _fd.write_all(_p).then([this] { _p.reset(); });
 }
 
+future<>
+posix_data_sink_impl::put_file(file& f, uint64_t pos, uint64_t len) {
+    auto in_fd = posix_file_impl::fd_of(f);
+    if (in_fd == -1) {
+        return data_sink_impl::put_file(f, pos, len);
+    }
+    return do_with(pos, len, [this, &f, in_fd] (uint64_t& pos, uint64_t& len) {
+        return do_until([&len] { return len == 0; }, [this, in_fd, &pos, &len] {
+            // sendfile() transfers at most 0x7ffff000 bytes at a time
+            return _fd.sendfile(in_fd, pos, std::min<uint64_t>(len, 0x7ffff000)).then([&pos, &len] (size_t sent) {
+                if (!sent) {
+                    throw std::runtime_error(format("file ended {} bytes short of the range to write", len));
+                }
+                auto sg_id = internal::scheduling_group_index(current_scheduling_group());
+                bytes_sent[sg_id] += sent;
+                pos += sent;
+                len -= sent;
+            });
+        }).handle_exception([this, &f, &pos, &len] (std::exception_ptr ep) {
+            try {
+                std::rethrow_exception(ep);
+            } catch (const std::system_error& e) {
+                // The kernel refuses to splice from some files, such as
+                // O_DIRECT ones at unaligned offsets. Copy the rest instead.
+                if (e.code() == std::error_code(EINVAL, std::system_category())) {
+                    return data_sink_impl::put_file(f, pos, len);
+                }
+            } catch (...) {
+            }
+            return make_exception_future<>(std::move(ep));
+        });
+    });
+}
+
 future<>
 posix_data_sink_impl::close() {
     _fd.shutdown(SHUT_WR);
@@ -699,8 +875,102 @@ void posix_data_sink_impl::on_batch_flush_error() noexcept {
     shutdown_socket_fd(_fd, SHUT_RD);
 }
 
+// The incoming_cpu load balancing with pinned shards gives every shard a
+// listening socket of its own in one SO_REUSEPORT group. The sockets are
+// created together by the first shard to listen, so that the index of each
+// in the group is its shard, and a classic BPF program attached to the
+// group picks the socket of the shard running on the CPU that received the
+// connection. The other shards take their sockets from here when they
+// listen.
+namespace {
+
+struct reuseport_group {
+    std::vector<std::optional<file_desc>> sockets;
+    unsigned taken = 0;
+};
+
+std::mutex reuseport_groups_mutex;
+std::unordered_map<std::tuple<int, socket_address>, reuseport_group> reuseport_groups;
+
+// Maps the CPU of the connection to the index of its shard's socket. A CPU
+// with no shard gets an index past the group, the kernel falls back to the
+// hash of the connection then.
+std::optional<std::vector<sock_filter>> make_cpu_steering_program() {
+    std::vector<sock_filter> prog;
+    prog.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, uint32_t(SKF_AD_OFF + SKF_AD_CPU)));
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (auto shard = smp::shard_of_cpu(cpu)) {
+            prog.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, cpu, 0, 1));
+            prog.push_back(BPF_STMT(BPF_RET | BPF_K, *shard));
+        }
+    }
+    prog.push_back(BPF_STMT(BPF_RET | BPF_K, 0xffffffff));
+    // No thread affinity, or too many shards for a program
+    if (prog.size() == 2 || prog.size() > BPF_MAXINSNS) {
+        return std::nullopt;
+    }
+    return prog;
+}
+
+std::optional<pollable_fd> listen_steered_by_cpu(int protocol, socket_address sa, const listen_options& opt) {
+    if (opt.lba != server_socket::load_balancing_algorithm::incoming_cpu) {
+        return std::nullopt;
+    }
+    static const auto prog = make_cpu_steering_program();
+    if (!prog) {
+        return std::nullopt;
+    }
+    auto key = std::make_tuple(protocol, sa);
+    std::lock_guard<std::mutex> guard(reuseport_groups_mutex);
+    auto it = reuseport_groups.find(key);
+    if (it == reuseport_groups.end()) {
+        // Until it is published, the group owns the sockets, and closes
+        // those created so far if setting up the others fails
+        reuseport_group group;
+        group.sockets.reserve(smp::count);
+        for (unsigned i = 0; i < smp::count; i++) {
+            file_desc socket = engine().posix_listen_socket(sa, opt, true);
+            // The rest go to the port the kernel picked for the first one
+            if (i == 0) {
+                sa = socket.get_address();
+            }
+            group.sockets.emplace_back(std::move(socket));
+        }
+        sock_fprog fprog = {static_cast<unsigned short>(prog->size()), const_cast<sock_filter*>(prog->data())};
+        group.sockets[0]->setsockopt(SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, fprog);
+        it = reuseport_groups.emplace(key, std::move(group)).first;
+    }
+    auto& socket = it->second.sockets[this_shard_id()];
+    if (!socket) {
+        // This shard listens twice before the others took their sockets.
+        // Close the group rather than leave the port bound to sockets
+        // nobody may ever accept from.
+        reuseport_groups.erase(it);
+        throw std::system_error(EADDRINUSE, std::system_category());
+    }
+    file_desc taken = std::move(*socket);
+    socket.reset();
+    if (++it->second.taken == smp::count) {
+        reuseport_groups.erase(it);
+    }
+    return pollable_fd(std::move(taken));
+}
+
+}
+
 posix_network_stack::posix_network_stack(const program_options::option_group& opts, std::pmr::polymorphic_allocator<char>* allocator)
         : _reuseport(engine().posix_reuseport_available()), _allocator(allocator) {
+    auto posix_opts = dynamic_cast<const posix_stack_options*>(&opts);
+    if (posix_opts && posix_opts->busy_poll_us.get_value()) {
+        _busy_poller = std::make_unique<busy_poller>(posix_opts->busy_poll_us.get_value(), posix_opts->busy_poll_budget.get_value());
+        local_busy_poller = _busy_poller.get();
+    }
+}
+
+posix_network_stack::~posix_network_stack() {
+    if (local_busy_poller == _busy_poller.get()) {
+        local_busy_poller = nullptr;
+    }
 }
 
 server_socket
@@ -714,6 +984,9 @@ posix_network_stack::listen(socket_address sa, listen_options opt) {
         return server_socket(std::make_unique<posix_server_socket_impl>(0, sa, engine().posix_listen(sa, opt), opt.lba, opt.fixed_cpu, _allocator));
     }
     auto protocol = static_cast<int>(opt.proto);
+    if (auto fd = listen_steered_by_cpu(protocol, sa, opt)) {
+        return server_socket(std::make_unique<posix_reuseport_server_socket_impl>(protocol, sa, std::move(*fd), _allocator));
+    }
     return _reuseport ?
         server_socket(std::make_unique<posix_reuseport_server_socket_impl>(protocol, sa, engine().posix_listen(sa, opt), _allocator))
         :
@@ -739,23 +1012,93 @@ posix_ap_network_stack::listen(socket_address sa, listen_options opt) {
         return server_socket(std::make_unique<posix_ap_server_socket_impl>(0, sa, _allocator));
     }
     auto protocol = static_cast<int>(opt.proto);
+    if (auto fd = listen_steered_by_cpu(protocol, sa, opt)) {
+        return server_socket(std::make_unique<posix_reuseport_server_socket_impl>(protocol, sa, std::move(*fd), _allocator));
+    }
     return _reuseport ?
         server_socket(std::make_unique<posix_reuseport_server_socket_impl>(protocol, sa, engine().posix_listen(sa, opt), _allocator))
         :
         server_socket(std::make_unique<posix_ap_server_socket_impl>(protocol, sa, _allocator));
 }
 
+// The protocol the posix stack created the socket with
+static int handoff_socket_protocol(file_desc& fd, const socket_address& sa) {
+    return sa.is_af_unix() ? 0 : fd.getsockopt<int>(SOL_SOCKET, SO_PROTOCOL);
+}
+
+server_socket adopt_server_socket(handoff_socket s, listen_options opt) {
+    if (!s.fd.getsockopt<int>(SOL_SOCKET, SO_ACCEPTCONN)) {
+        throw std::invalid_argument(seastar::format("handed off socket {} isn't listening", s.name));
+    }
+    auto sa = s.fd.get_address();
+    auto protocol = handoff_socket_protocol(s.fd, sa);
+    // The sender had a socket per shard, each accepting its own connections
+    bool reuseport = !sa.is_af_unix() && s.fd.getsockopt<int>(SOL_SOCKET, SO_REUSEPORT);
+    auto lfd = engine().adopt_pollable_fd(std::move(s.fd));
+    if (reuseport) {
+        return server_socket(std::make_unique<posix_reuseport_server_socket_impl>(protocol, sa, std::move(lfd)));
+    }
+    return server_socket(std::make_unique<posix_server_socket_impl>(protocol, sa, std::move(lfd), opt.lba, opt.fixed_cpu));
+}
+
+connected_socket adopt_connected_socket(handoff_socket s) {
+    if (s.fd.getsockopt<int>(SOL_SOCKET, SO_ACCEPTCONN)) {
+        throw std::invalid_argument(seastar::format("handed off socket {} is listening", s.name));
+    }
+    auto sa = s.fd.get_address();
+    auto protocol = handoff_socket_protocol(s.fd, sa);
+    auto fd = engine().adopt_pollable_fd(std::move(s.fd));
+    return connected_socket(std::unique_ptr<connected_socket_impl>(
+            new posix_connected_socket_impl(sa.family(), protocol, std::move(fd))));
+}
+
+future<> migrate_connected_socket(connected_socket cs, input_stream<char> in, shard_id to,
+        noncopyable_function<future<> (connected_socket)> func) noexcept {
+    auto csi = get_impl::get(std::move(cs));
+    auto impl = dynamic_cast<posix_connected_socket_impl*>(csi.get());
+    if (!impl) {
+        return make_exception_future<>(std::invalid_argument("only connections of the posix network stack can be migrated"));
+    }
+    // The source is dropped rather than closed, which would shut the
+    // connection down
+    auto unread = std::move(in).detach_buffered().second;
+    int r = ::fcntl(impl->_fd.get_file_desc().get(), F_DUPFD_CLOEXEC, 0);
+    if (r == -1) {
+        return make_exception_future<>(std::system_error(errno, std::system_category(), "fcntl"));
+    }
+    auto fd = file_desc::from_fd(r);
+    auto handle = std::move(impl->_handle);
+    // Unregisters the descriptor from this shard and closes it, the
+    // connection lives on in the duplicate
+    csi.reset();
+    auto f = handle.retarget(to);
+    return f.then([to, fd = std::move(fd), unread = std::move(unread), handle = std::move(handle), func = std::move(func)] () mutable {
+        return smp::submit_to(to, [&fd, &unread, &handle, &func] {
+            auto sa = fd.get_address();
+            auto protocol = handoff_socket_protocol(fd, sa);
+            // Copied, to be freed on this shard
+            temporary_buffer<char> data(unread.get(), unread.size());
+            auto pfd = engine().adopt_pollable_fd(std::move(fd));
+            auto impl = std::unique_ptr<posix_connected_socket_impl>(
+                    new posix_connected_socket_impl(sa.family(), protocol, std::move(pfd), std::move(handle)));
+            impl->_unread = std::move(data);
+            return func(connected_socket(std::move(impl)));
+        });
+    });
+}
+
+// Room for the destination address and the GRO segment size of a datagram
 struct cmsg_with_pktinfo {
-    struct cmsghdrcmh;
-    union {
-        struct in_pktinfo pktinfo;
-        struct in6_pktinfo pkt6info;
-    };
+    alignas(struct cmsghdr) char buf[CMSG_SPACE(sizeof(struct in6_pktinfo)) + CMSG_SPACE(sizeof(int))];
 };
 
 class posix_datagram_channel : public datagram_channel_impl {
 private:
     static constexpr int MAX_DATAGRAM_SIZE = 65507;
+    // Datagrams taken off the socket by one recvmmsg()
+    static constexpr size_t MAX_RECV_BATCH = 32;
+    // Datagrams the kernel segments out of one message (UDP_MAX_SEGMENTS)
+    static constexpr size_t MAX_GSO_SEGMENTS = 64;
     struct recv_ctx {
         struct msghdr _hdr;
         struct iovec _iov;
@@ -789,6 +1132,29 @@ class posix_datagram_channel : public datagram_channel_impl {
             _iov.iov_len = MAX_DATAGRAM_SIZE;
         }
     };
+    struct batch_recv_slot {
+        std::unique_ptr<char[]> _buffer;
+        struct iovec _iov;
+        socket_address _src_addr;
+        cmsg_with_pktinfo _cmsg;
+
+        void prepare(struct msghdr& hdr, bool use_pktinfo) {
+            if (!_buffer) {
+                _buffer = std::make_unique<char[]>(MAX_DATAGRAM_SIZE);
+            }
+            _iov.iov_base = _buffer.get();
+            _iov.iov_len = MAX_DATAGRAM_SIZE;
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.msg_iov = &_iov;
+            hdr.msg_iovlen = 1;
+            hdr.msg_name = &_src_addr.u.sa;
+            hdr.msg_namelen = sizeof(_src_addr.u.sas);
+            if (use_pktinfo) {
+                hdr.msg_control = &_cmsg;
+                hdr.msg_controllen = sizeof(_cmsg);
+            }
+        }
+    };
     struct send_ctx {
         struct msghdr _hdr;
         std::vector<struct iovec> _iovecs;
@@ -827,23 +1193,49 @@ class posix_datagram_channel : public datagram_channel_impl {
             if (engine().posix_reuseport_available()) {
                 fd.setsockopt(SOL_SOCKET, SO_REUSEPORT, 1);
             }
+            // Coalesced datagrams are split again in queue_received()
+            int one = 1;
+            ::setsockopt(fd.get(), SOL_UDP, UDP_GRO, &one, sizeof(one));
         }
 
         return fd;
     }
 
+    static bool supports_gso(file_desc& fd, sa_family_t family) {
+        int segment = 0;
+        socklen_t len = sizeof(segment);
+        return is_inet(family) && ::getsockopt(fd.get(), SOL_UDP, UDP_SEGMENT, &segment, &len) == 0;
+    }
+
     pollable_fd _fd;
     socket_address _address;
     recv_ctx _recv;
     send_ctx _send;
+    std::vector<batch_recv_slot> _batch_slots;
+    std::vector<struct mmsghdr> _batch_hdrs;
+    // Datagrams received but not returned yet, like the segments of a GRO
+    // coalesced one
+    std::deque<datagram> _pending;
+    bool _use_pktinfo;
+    bool _gso;
     bool _closed;
+
+    void queue_received(const struct msghdr& hdr, const socket_address& src, temporary_buffer<char> buf);
+    datagram pop_pending() {
+        auto d = std::move(_pending.front());
+        _pending.pop_front();
+        return d;
+    }
+    future<> receive_some(size_t max);
+    future<> send_messages(std::vector<outgoing_datagram>& datagrams, size_t first);
 public:
     /// Creates a channel that is not bound to any socket address. The channel
     /// can be used to communicate with adressess that belong to the \param
     /// family.
     posix_datagram_channel(sa_family_t family)
-        : _recv(is_inet(family)), _closed(false) {
+        : _recv(is_inet(family)), _use_pktinfo(is_inet(family)), _closed(false) {
         auto fd = create_socket(family);
+        _gso = supports_gso(fd, family);
 
         _address = fd.get_address();
         _fd = std::move(fd);
@@ -852,8 +1244,9 @@ class posix_datagram_channel : public datagram_channel_impl {
     /// Creates a channel that is bound to the specified local address. It can be used to
     /// communicate with addresses that belong to the family of \param local.
     posix_datagram_channel(socket_address local)
-        : _recv(is_inet(local.family())), _closed(false) {
+        : _recv(is_inet(local.family())), _use_pktinfo(is_inet(local.family())), _closed(false) {
         auto fd = create_socket(local.family());
+        _gso = supports_gso(fd, local.family());
         fd.bind(local.u.sa, local.addr_length);
 
         _address = fd.get_address();
@@ -864,6 +1257,8 @@ class posix_datagram_channel : public datagram_channel_impl {
     virtual future<datagram> receive() override;
     virtual future<> send(const socket_address& dst, const char *msg) override;
     virtual future<> send(const socket_address& dst, packet p) override;
+    virtual future<std::vector<datagram>> receive_batch(size_t max) override;
+    virtual future<> send_batch(std::vector<outgoing_datagram> datagrams) override;
     virtual void shutdown_input() override {
         _fd.shutdown(SHUT_RD, pollable_fd::shutdown_kernel_only::no);
     }
@@ -872,6 +1267,7 @@ class posix_datagram_channel : public datagram_channel_impl {
     }
     virtual void close() override {
         _closed = true;
+        _pending.clear();
         _fd = {};
     }
     virtual bool is_closed() const override { return _closed; }
@@ -953,33 +1349,202 @@ class posix_datagram : public datagram_impl {
     virtual packet& get_data() override { return _p; }
 };
 
+void
+posix_datagram_channel::queue_received(const struct msghdr& hdr, const socket_address& src, temporary_buffer<char> buf) {
+    std::optional<socket_address> dst;
+    size_t segment = buf.size();
+    for (auto* cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(const_cast<struct msghdr*>(&hdr), cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+            dst = ipv4_addr(copy_reinterpret_cast<in_pktinfo>(CMSG_DATA(cmsg)).ipi_addr, _address.port());
+        } else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO) {
+            dst = ipv6_addr(copy_reinterpret_cast<in6_pktinfo>(CMSG_DATA(cmsg)).ipi6_addr, _address.port());
+        } else if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            segment = std::max(copy_reinterpret_cast<int>(CMSG_DATA(cmsg)), 1);
+        }
+    }
+    auto sg_id = internal::scheduling_group_index(current_scheduling_group());
+    bytes_received[sg_id] += buf.size();
+    if (buf.empty()) {
+        _pending.emplace_back(std::make_unique<posix_datagram>(src, dst ? *dst : _address, packet()));
+        return;
+    }
+    for (size_t off = 0; off < buf.size(); off += segment) {
+        auto seg = buf.share(off, std::min(segment, buf.size() - off));
+        auto frag = fragment{seg.get_write(), seg.size()};
+        _pending.emplace_back(std::make_unique<posix_datagram>(src, dst ? *dst : _address, packet(frag, seg.release())));
+    }
+}
+
 future<datagram>
 posix_datagram_channel::receive() {
+    if (!_pending.empty()) {
+        return make_ready_future<datagram>(pop_pending());
+    }
     _recv.prepare();
     return _fd.recvmsg(&_recv._hdr).then([this] (size_t size) {
-        std::optional<socket_address> dst;
-        for (auto* cmsg = CMSG_FIRSTHDR(&_recv._hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&_recv._hdr, cmsg)) {
-            if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
-                dst = ipv4_addr(copy_reinterpret_cast<in_pktinfo>(CMSG_DATA(cmsg)).ipi_addr, _address.port());
-                break;
-            } else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO) {
-                dst = ipv6_addr(copy_reinterpret_cast<in6_pktinfo>(CMSG_DATA(cmsg)).ipi6_addr, _address.port());
-                break;
-            }
-        }
-        auto sg_id = internal::scheduling_group_index(current_scheduling_group());
-        bytes_received[sg_id] += size;
-        return make_ready_future<datagram>(datagram(std::make_unique<posix_datagram>(
-            _recv._src_addr, dst ? *dst : _address, packet(fragment{_recv._buffer, size}, make_deleter([buf = _recv._buffer] { delete[] buf; })))));
+        auto buf = temporary_buffer<char>(_recv._buffer, size, make_deleter([buf = _recv._buffer] { delete[] buf; }));
+        queue_received(_recv._hdr, _recv._src_addr, std::move(buf));
+        return make_ready_future<datagram>(pop_pending());
     }).handle_exception([p = _recv._buffer](auto ep) {
         delete[] p;
         return make_exception_future<datagram>(std::move(ep));
     });
 }
 
+future<>
+posix_datagram_channel::receive_some(size_t max) {
+    max = std::min(max, MAX_RECV_BATCH);
+    if (_batch_slots.size() < max) {
+        _batch_slots.resize(max);
+        _batch_hdrs.resize(max);
+    }
+    for (size_t i = 0; i < max; i++) {
+        _batch_slots[i].prepare(_batch_hdrs[i].msg_hdr, _use_pktinfo);
+    }
+    return repeat([this, max] {
+        auto r = ::recvmmsg(_fd.get_file_desc().get(), _batch_hdrs.data(), max, MSG_DONTWAIT, nullptr);
+        if (r < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return _fd.readable().then([] { return stop_iteration::no; });
+            }
+            return make_exception_future<stop_iteration>(std::system_error(errno, std::system_category(), "recvmmsg"));
+        }
+        if (r == 0) {
+            // shut down: like recvmsg(), deliver an empty datagram
+            queue_received(msghdr{}, _batch_slots[0]._src_addr, temporary_buffer<char>());
+        }
+        for (int i = 0; i < r; i++) {
+            auto& slot = _batch_slots[i];
+            auto size = _batch_hdrs[i].msg_len;
+            auto buf = temporary_buffer<char>(slot._buffer.get(), size, make_deleter([p = slot._buffer.release()] { delete[] p; }));
+            queue_received(_batch_hdrs[i].msg_hdr, slot._src_addr, std::move(buf));
+        }
+        return make_ready_future<stop_iteration>(stop_iteration::yes);
+    });
+}
+
+future<std::vector<datagram>>
+posix_datagram_channel::receive_batch(size_t max) {
+    auto f = _pending.empty() ? receive_some(max) : make_ready_future<>();
+    return f.then([this, max] {
+        std::vector<datagram> ret;
+        ret.reserve(std::min(max, _pending.size()));
+        while (!_pending.empty() && ret.size() < max) {
+            ret.push_back(pop_pending());
+        }
+        return ret;
+    });
+}
+
+future<>
+posix_datagram_channel::send_messages(std::vector<outgoing_datagram>& datagrams, size_t first) {
+    struct gso_cmsg {
+        alignas(struct cmsghdr) char buf[CMSG_SPACE(sizeof(uint16_t))];
+    };
+    // A message carries one datagram, or with GSO a run of datagrams to the
+    // same destination all of the size of the first but the last, which the
+    // kernel segments
+    std::vector<struct mmsghdr> hdrs;
+    std::vector<size_t> firsts;
+    std::vector<struct iovec> iovecs;
+    std::vector<gso_cmsg> cmsgs;
+    size_t niov = 0;
+    for (size_t i = first; i < datagrams.size(); i++) {
+        niov += datagrams[i].data.nr_frags();
+    }
+    iovecs.reserve(niov);
+    cmsgs.reserve(datagrams.size() - first);
+    for (size_t i = first; i < datagrams.size(); ) {
+        auto& d = datagrams[i];
+        auto segment = d.data.len();
+        auto total = segment;
+        size_t end = i + 1;
+        while (_gso && segment > 0 && end < datagrams.size() && end - i < MAX_GSO_SEGMENTS
+                && datagrams[end].dst == d.dst && datagrams[end - 1].data.len() == segment
+                && datagrams[end].data.len() > 0 && datagrams[end].data.len() <= segment
+                && total + datagrams[end].data.len() <= MAX_DATAGRAM_SIZE) {
+            total += datagrams[end++].data.len();
+        }
+        struct mmsghdr h;
+        memset(&h, 0, sizeof(h));
+        h.msg_hdr.msg_name = &d.dst.u.sa;
+        h.msg_hdr.msg_namelen = d.dst.addr_length;
+        h.msg_hdr.msg_iov = iovecs.data() + iovecs.size();
+        for (auto j = i; j < end; j++) {
+            for (auto& f : datagrams[j].data.fragments()) {
+                iovecs.push_back({f.base, f.size});
+            }
+        }
+        h.msg_hdr.msg_iovlen = iovecs.data() + iovecs.size() - h.msg_hdr.msg_iov;
+        if (end - i > 1) {
+            auto& c = cmsgs.emplace_back();
+            memset(&c, 0, sizeof(c));
+            h.msg_hdr.msg_control = c.buf;
+            h.msg_hdr.msg_controllen = sizeof(c.buf);
+            auto* cmsg = CMSG_FIRSTHDR(&h.msg_hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t seg = segment;
+            memcpy(CMSG_DATA(cmsg), &seg, sizeof(seg));
+        }
+        hdrs.push_back(h);
+        firsts.push_back(i);
+        i = end;
+    }
+    return do_with(std::move(hdrs), std::move(firsts), std::move(iovecs), std::move(cmsgs), size_t(0),
+            [this, &datagrams] (auto& hdrs, auto& firsts, auto&, auto&, size_t& sent) {
+        return repeat([this, &datagrams, &hdrs, &firsts, &sent] {
+            if (sent == hdrs.size()) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            auto r = ::sendmmsg(_fd.get_file_desc().get(), hdrs.data() + sent, std::min<size_t>(hdrs.size() - sent, UIO_MAXIOV), MSG_DONTWAIT);
+            if (r >= 0) {
+                sent += r;
+                return make_ready_future<stop_iteration>(stop_iteration::no);
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return _fd.writeable().then([] { return stop_iteration::no; });
+            }
+            if (errno == EIO && _gso && hdrs[sent].msg_hdr.msg_controllen) {
+                // The device cannot segment: resend the rest one datagram
+                // per message
+                _gso = false;
+                return send_messages(datagrams, firsts[sent]).then([] { return stop_iteration::yes; });
+            }
+            return make_exception_future<stop_iteration>(std::system_error(errno, std::system_category(), "sendmmsg"));
+        });
+    });
+}
+
+future<>
+posix_datagram_channel::send_batch(std::vector<outgoing_datagram> datagrams) {
+    size_t len = 0;
+    for (auto& d : datagrams) {
+        resolve_outgoing_address(d.dst);
+        len += d.data.len();
+    }
+    auto sg_id = internal::scheduling_group_index(current_scheduling_group());
+    bytes_sent[sg_id] += len;
+    return do_with(std::move(datagrams), [this] (std::vector<outgoing_datagram>& datagrams) {
+        return send_messages(datagrams, 0);
+    });
+}
+
+posix_stack_options::posix_stack_options()
+    : program_options::option_group(nullptr, "Posix")
+    , busy_poll_us(*this, "busy-poll-us",
+                0,
+                "Busy poll the NIC queues of the sockets for up to this many microseconds (0 = off)")
+    , busy_poll_budget(*this, "busy-poll-budget",
+                8,
+                "Packets processed in a round of socket busy polling")
+{
+}
+
 network_stack_entry register_posix_stack() {
     return network_stack_entry{
-        "posix", std::make_unique<program_options::option_group>(nullptr, "Posix"),
+        "posix", std::make_unique<posix_stack_options>(),
         [](const program_options::option_group& ops) {
             return smp::main_thread() ? posix_network_stack::create(ops)
                                       : posix_ap_network_stack::create(ops);
@@ -0,0 +1,560 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include <seastar/net/shm_socket.hh>
+#include <seastar/net/stack.hh>
+#include <seastar/core/condition-variable.hh>
+#include <seastar/core/internal/pollable_fd.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/shared_ptr.hh>
+
+namespace seastar {
+
+namespace net {
+
+namespace {
+
+constexpr uint32_t shm_magic = 0x53484d31; // "SHM1"
+constexpr size_t shm_header_size = 4096;
+constexpr size_t shm_min_ring_size = 4096;
+constexpr size_t shm_max_read_size = 128 * 1024;
+constexpr unsigned shm_nr_fds = 3;
+
+// One direction of a connection. The positions are free running byte
+// counters, the offset in the ring is the position modulo its size.
+struct shm_ring {
+    alignas(64) std::atomic<uint64_t> head; // written by the producer
+    alignas(64) std::atomic<uint64_t> tail; // written by the consumer
+    alignas(64) std::atomic<uint32_t> producer_waiting;
+    std::atomic<uint32_t> consumer_waiting;
+    // the producer won't write anymore
+    std::atomic<uint32_t> closed;
+    // the consumer won't read anymore
+    std::atomic<uint32_t> aborted;
+};
+
+// Lives at the start of the segment, followed by the data of both
+// rings, each ring_size bytes long. The atomics are shared between
+// processes so they must not be implemented with locks.
+struct shm_segment {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t ring_size;
+    // rings[0] carries data from the client to the server, rings[1] from
+    // the server to the client
+    shm_ring rings[2];
+};
+
+static_assert(sizeof(shm_segment) <= shm_header_size);
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+// Buffers of the message carrying the file descriptors of a connection
+// from the client to the server
+struct fd_message {
+    char byte = 0;
+    iovec iov;
+    msghdr hdr;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * shm_nr_fds)];
+
+    fd_message() {
+        iov.iov_base = &byte;
+        iov.iov_len = 1;
+        std::memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_iov = &iov;
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = control;
+        hdr.msg_controllen = sizeof(control);
+    }
+};
+
+std::system_error make_errno_error(int err, const char* what) {
+    return std::system_error(err, std::system_category(), what);
+}
+
+// Both sides of a connection are the same, except for which ring is read
+// and which eventfd wakes up which side.
+class shm_connection : public enable_lw_shared_from_this<shm_connection> {
+    mmap_area _area;
+    size_t _size;
+    shm_ring& _rx;
+    shm_ring& _tx;
+    char* _rx_data;
+    char* _tx_data;
+    // signalled by the peer
+    pollable_fd _wakeup;
+    // signals the peer
+    file_desc _peer_wakeup;
+    // the rendezvous connection, reports the peer going away
+    pollable_fd _control;
+    socket_address _local;
+    socket_address _remote;
+    condition_variable _changed;
+    uint64_t _eventfd_value = 0;
+    bool _input_shutdown = false;
+    bool _output_shutdown = false;
+    bool _peer_gone = false;
+    bool _stopped = false;
+private:
+    void signal_peer() noexcept {
+        ::eventfd_write(_peer_wakeup.get(), 1);
+    }
+    void copy_out(char* dst, uint64_t pos, size_t len) noexcept {
+        size_t off = pos & (_size - 1);
+        size_t first = std::min(len, _size - off);
+        std::memcpy(dst, _rx_data + off, first);
+        std::memcpy(dst + first, _rx_data, len - first);
+    }
+    void copy_in(const char* src, uint64_t pos, size_t len) noexcept {
+        size_t off = pos & (_size - 1);
+        size_t first = std::min(len, _size - off);
+        std::memcpy(_tx_data + off, src, first);
+        std::memcpy(_tx_data, src + first, len - first);
+    }
+    // Sleeps until the peer signals us, unless the condition changed after
+    // the peer was told that we're waiting (the flag is checked by the peer
+    // after it updated the ring).
+    template <typename Ready>
+    future<> wait(std::atomic<uint32_t>& waiting, Ready ready) {
+        waiting.store(1, std::memory_order_seq_cst);
+        if (ready()) {
+            waiting.store(0, std::memory_order_relaxed);
+            return make_ready_future<>();
+        }
+        return _changed.wait().finally([&waiting] {
+            waiting.store(0, std::memory_order_relaxed);
+        });
+    }
+public:
+    shm_connection(mmap_area area, size_t size, bool is_server, file_desc wakeup, file_desc peer_wakeup, pollable_fd control)
+        : _area(std::move(area))
+        , _size(size)
+        , _rx(reinterpret_cast<shm_segment*>(_area.get())->rings[is_server ? 0 : 1])
+        , _tx(reinterpret_cast<shm_segment*>(_area.get())->rings[is_server ? 1 : 0])
+        , _rx_data(_area.get() + shm_header_size + (is_server ? 0 : size))
+        , _tx_data(_area.get() + shm_header_size + (is_server ? size : 0))
+        , _wakeup(std::move(wakeup))
+        , _peer_wakeup(std::move(peer_wakeup))
+        , _control(std::move(control))
+        , _local(_control.get_file_desc().get_address())
+        , _remote(_control.get_file_desc().get_remote_address())
+    {}
+
+    void start() {
+        // FIXME: future is discarded
+        (void)repeat([self = shared_from_this()] {
+            return self->_wakeup.read_some(reinterpret_cast<char*>(&self->_eventfd_value), sizeof(self->_eventfd_value)).then([self] (size_t) {
+                self->_changed.broadcast();
+                return self->_stopped ? stop_iteration::yes : stop_iteration::no;
+            });
+        }).handle_exception([] (std::exception_ptr) {});
+        // The peer never writes to the rendezvous connection after the
+        // handshake, it only becomes readable when the peer closed it
+        // FIXME: future is discarded
+        (void)_control.readable().then_wrapped([self = shared_from_this()] (future<> f) {
+            f.ignore_ready_future();
+            self->_peer_gone = true;
+            self->_changed.broadcast();
+        });
+    }
+
+    // Wakes up the background loops, they release the connection once done
+    void stop() noexcept {
+        if (_stopped) {
+            return;
+        }
+        shutdown_output();
+        shutdown_input();
+        _stopped = true;
+        ::eventfd_write(_wakeup.get_file_desc().get(), 1);
+        ::shutdown(_control.get_file_desc().get(), SHUT_RDWR);
+        _changed.broken(std::make_exception_ptr(make_errno_error(ECONNABORTED, "shm connection closed")));
+    }
+
+    future<temporary_buffer<char>> read() {
+        return repeat_until_value([this] () -> future<std::optional<temporary_buffer<char>>> {
+            if (_input_shutdown) {
+                return make_ready_future<std::optional<temporary_buffer<char>>>(temporary_buffer<char>());
+            }
+            auto tail = _rx.tail.load(std::memory_order_relaxed);
+            auto head = _rx.head.load(std::memory_order_acquire);
+            if (head != tail) {
+                size_t len = std::min<uint64_t>(head - tail, shm_max_read_size);
+                temporary_buffer<char> buf(len);
+                copy_out(buf.get_write(), tail, len);
+                _rx.tail.store(tail + len, std::memory_order_release);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (_rx.producer_waiting.load(std::memory_order_relaxed)) {
+                    signal_peer();
+                }
+                return make_ready_future<std::optional<temporary_buffer<char>>>(std::move(buf));
+            }
+            if (_rx.closed.load(std::memory_order_acquire)) {
+                // the peer may have written more before closing
+                if (_rx.head.load(std::memory_order_acquire) != tail) {
+                    return make_ready_future<std::optional<temporary_buffer<char>>>();
+                }
+                return make_ready_future<std::optional<temporary_buffer<char>>>(temporary_buffer<char>());
+            }
+            if (_peer_gone) {
+                return make_exception_future<std::optional<temporary_buffer<char>>>(make_errno_error(ECONNRESET, "shm peer went away"));
+            }
+            return wait(_rx.consumer_waiting, [this, tail] {
+                return _rx.head.load(std::memory_order_seq_cst) != tail || _rx.closed.load(std::memory_order_seq_cst);
+            }).then([] {
+                return std::optional<temporary_buffer<char>>();
+            });
+        });
+    }
+
+    future<> write(const char* data, size_t len) {
+        return repeat([this, data, len] () mutable -> future<stop_iteration> {
+            if (!len) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            if (_output_shutdown || _tx.aborted.load(std::memory_order_relaxed) || _peer_gone) {
+                return make_exception_future<stop_iteration>(make_errno_error(EPIPE, "shm connection closed"));
+            }
+            auto head = _tx.head.load(std::memory_order_relaxed);
+            auto tail = _tx.tail.load(std::memory_order_acquire);
+            size_t space = _size - (head - tail);
+            if (space) {
+                size_t n = std::min(space, len);
+                copy_in(data, head, n);
+                _tx.head.store(head + n, std::memory_order_release);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (_tx.consumer_waiting.load(std::memory_order_relaxed)) {
+                    signal_peer();
+                }
+                data += n;
+                len -= n;
+                return make_ready_future<stop_iteration>(stop_iteration::no);
+            }
+            return wait(_tx.producer_waiting, [this, tail] {
+                return _tx.tail.load(std::memory_order_seq_cst) != tail || _tx.aborted.load(std::memory_order_seq_cst);
+            }).then([] {
+                return stop_iteration::no;
+            });
+        });
+    }
+
+    void shutdown_input() noexcept {
+        if (!_input_shutdown) {
+            _input_shutdown = true;
+            _rx.aborted.store(1, std::memory_order_seq_cst);
+            signal_peer();
+            _changed.broadcast();
+        }
+    }
+
+    void shutdown_output() noexcept {
+        if (!_output_shutdown) {
+            _output_shutdown = true;
+            _tx.closed.store(1, std::memory_order_seq_cst);
+            signal_peer();
+            _changed.broadcast();
+        }
+    }
+
+    future<> wait_input_shutdown() {
+        return repeat([this] {
+            if (_input_shutdown || _peer_gone || _rx.closed.load(std::memory_order_acquire)) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            return wait(_rx.consumer_waiting, [this] {
+                return bool(_rx.closed.load(std::memory_order_seq_cst));
+            }).then([] {
+                return stop_iteration::no;
+            });
+        }).handle_exception_type([] (const std::system_error&) {});
+    }
+
+    const socket_address& local_address() const noexcept { return _local; }
+    const socket_address& remote_address() const noexcept { return _remote; }
+};
+
+// Owned by the socket and its streams, stops the connection when the last
+// of them is gone
+class shm_endpoint {
+    lw_shared_ptr<shm_connection> _conn;
+public:
+    explicit shm_endpoint(lw_shared_ptr<shm_connection> conn) noexcept : _conn(std::move(conn)) {}
+    ~shm_endpoint() {
+        _conn->stop();
+    }
+    shm_connection& operator*() const noexcept { return *_conn; }
+    shm_connection* operator->() const noexcept { return _conn.get(); }
+};
+
+class shm_data_source_impl final : public data_source_impl {
+    lw_shared_ptr<shm_endpoint> _ep;
+public:
+    explicit shm_data_source_impl(lw_shared_ptr<shm_endpoint> ep) noexcept : _ep(std::move(ep)) {}
+    virtual future<temporary_buffer<char>> get() override {
+        return (*_ep)->read();
+    }
+    virtual future<> close() override {
+        (*_ep)->shutdown_input();
+        return make_ready_future<>();
+    }
+};
+
+class shm_data_sink_impl final : public data_sink_impl {
+    lw_shared_ptr<shm_endpoint> _ep;
+public:
+    explicit shm_data_sink_impl(lw_shared_ptr<shm_endpoint> ep) noexcept : _ep(std::move(ep)) {}
+    virtual future<> put(packet p) override {
+        return do_with(std::move(p), [this] (packet& p) {
+            return do_for_each(p.fragment_array(), p.fragment_array() + p.nr_frags(), [this] (fragment f) {
+                return (*_ep)->write(f.base, f.size);
+            });
+        });
+    }
+    virtual future<> close() override {
+        (*_ep)->shutdown_output();
+        return make_ready_future<>();
+    }
+    virtual bool can_batch_flushes() const noexcept override { return true; }
+    virtual void on_batch_flush_error() noexcept override {
+        (*_ep)->shutdown_output();
+    }
+};
+
+class shm_connected_socket_impl final : public connected_socket_impl {
+    lw_shared_ptr<shm_endpoint> _ep;
+public:
+    explicit shm_connected_socket_impl(lw_shared_ptr<shm_connection> conn)
+        : _ep(make_lw_shared<shm_endpoint>(std::move(conn))) {}
+    virtual data_source source() override {
+        return data_source(std::make_unique<shm_data_source_impl>(_ep));
+    }
+    virtual data_sink sink() override {
+        return data_sink(std::make_unique<shm_data_sink_impl>(_ep));
+    }
+    virtual void shutdown_input() override {
+        (*_ep)->shutdown_input();
+    }
+    virtual void shutdown_output() override {
+        (*_ep)->shutdown_output();
+    }
+    virtual void set_nodelay(bool nodelay) override {}
+    virtual bool get_nodelay() const override {
+        return true;
+    }
+    virtual void set_keepalive(bool keepalive) override {}
+    virtual bool get_keepalive() const override {
+        return false;
+    }
+    virtual void set_keepalive_parameters(const keepalive_params&) override {}
+    virtual keepalive_params get_keepalive_parameters() const override {
+        return tcp_keepalive_params{std::chrono::seconds(0), std::chrono::seconds(0), 0};
+    }
+    virtual void set_sockopt(int level, int optname, const void* data, size_t len) override {
+        throw std::runtime_error("Setting custom socket options is not supported for shared-memory sockets");
+    }
+    virtual int get_sockopt(int level, int optname, void* data, size_t len) const override {
+        throw std::runtime_error("Getting custom socket options is not supported for shared-memory sockets");
+    }
+    virtual socket_address local_address() const noexcept override {
+        return (*_ep)->local_address();
+    }
+    virtual socket_address remote_address() const noexcept override {
+        return (*_ep)->remote_address();
+    }
+    virtual future<> wait_input_shutdown() override {
+        return (*_ep)->wait_input_shutdown();
+    }
+};
+
+connected_socket make_shm_connected_socket(mmap_area area, size_t ring_size, bool is_server,
+        file_desc wakeup, file_desc peer_wakeup, pollable_fd control) {
+    auto conn = make_lw_shared<shm_connection>(std::move(area), ring_size, is_server,
+            std::move(wakeup), std::move(peer_wakeup), std::move(control));
+    conn->start();
+    return connected_socket(std::make_unique<shm_connected_socket_impl>(std::move(conn)));
+}
+
+// Validates the handshake of a client and creates the server side of the
+// connection
+future<connected_socket> shm_accept(pollable_fd control) {
+    auto msg = std::make_unique<fd_message>();
+    auto f = control.recvmsg(&msg->hdr);
+    return f.then([control = std::move(control), msg = std::move(msg)] (size_t n) mutable {
+        std::vector<file_desc> fds;
+        for (auto* c = CMSG_FIRSTHDR(&msg->hdr); c; c = CMSG_NXTHDR(&msg->hdr, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+                auto nr = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for (size_t i = 0; i < nr; i++) {
+                    int fd;
+                    std::memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+                    fds.push_back(file_desc::from_fd(fd));
+                    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+                }
+            }
+        }
+        if (n != 1 || (msg->hdr.msg_flags & MSG_CTRUNC) || fds.size() != shm_nr_fds) {
+            throw std::runtime_error("invalid shared-memory connection handshake");
+        }
+        auto total = fds[0].size();
+        if (total < shm_header_size + 2 * shm_min_ring_size) {
+            throw std::runtime_error("shared-memory segment is too small");
+        }
+        auto area = fds[0].map_shared_rw(total, 0);
+        auto seg = reinterpret_cast<const shm_segment*>(area.get());
+        auto ring_size = seg->ring_size;
+        if (seg->magic != shm_magic || !std::has_single_bit(ring_size) || ring_size < shm_min_ring_size
+                || total != shm_header_size + 2 * ring_size) {
+            throw std::runtime_error("invalid shared-memory segment");
+        }
+        auto f = control.write_all(&msg->byte, 1);
+        return f.then([control = std::move(control), area = std::move(area), ring_size, fds = std::move(fds), msg = std::move(msg)] () mutable {
+            return make_shm_connected_socket(std::move(area), ring_size, true, std::move(fds[1]), std::move(fds[2]), std::move(control));
+        });
+    });
+}
+
+class shm_server_socket_impl final : public server_socket_impl {
+    pollable_fd _listener;
+    socket_address _sa;
+public:
+    shm_server_socket_impl(pollable_fd listener, socket_address sa) noexcept
+        : _listener(std::move(listener)), _sa(sa) {}
+    // Clients that fail the handshake are dropped, only the errors of the
+    // listener itself are reported
+    virtual future<accept_result> accept() override {
+        return repeat_until_value([this] {
+            return _listener.accept().then([] (std::tuple<pollable_fd, socket_address> res) {
+                auto& [fd, remote] = res;
+                return shm_accept(std::move(fd)).then_wrapped([remote = std::move(remote)] (future<connected_socket> f) {
+                    if (f.failed()) {
+                        f.ignore_ready_future();
+                        return std::optional<accept_result>();
+                    }
+                    return std::optional<accept_result>(accept_result{f.get(), remote});
+                });
+            });
+        });
+    }
+    virtual void abort_accept() override {
+        _listener.shutdown(SHUT_RD);
+    }
+    virtual socket_address local_address() const override {
+        return _sa;
+    }
+};
+
+class shm_socket_impl final : public socket_impl {
+    shm_options _opts;
+    std::optional<pollable_fd> _fd;
+public:
+    explicit shm_socket_impl(shm_options opts) noexcept : _opts(opts) {}
+    virtual future<connected_socket> connect(socket_address sa, socket_address, transport) override {
+        if (!sa.is_af_unix()) {
+            return make_exception_future<connected_socket>(std::invalid_argument("shared-memory sockets connect to unix-domain addresses"));
+        }
+        return futurize_invoke([this, sa] {
+            _fd = engine().make_pollable_fd(sa, 0);
+            return engine().posix_connect(*_fd, sa, socket_address{});
+        }).then([this] {
+            auto ring_size = std::bit_ceil(std::max(_opts.ring_size, shm_min_ring_size));
+            auto total = shm_header_size + 2 * ring_size;
+            int memfd = ::memfd_create("seastar-shm", MFD_CLOEXEC);
+            throw_system_error_on(memfd == -1, "memfd_create");
+            auto segment_fd = file_desc::from_fd(memfd);
+            segment_fd.truncate(total);
+            auto area = segment_fd.map_shared_rw(total, 0);
+            auto seg = new (area.get()) shm_segment();
+            seg->magic = shm_magic;
+            seg->ring_size = ring_size;
+            auto server_wakeup = file_desc::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            auto client_wakeup = file_desc::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+            auto msg = std::make_unique<fd_message>();
+            auto c = CMSG_FIRSTHDR(&msg->hdr);
+            c->cmsg_level = SOL_SOCKET;
+            c->cmsg_type = SCM_RIGHTS;
+            c->cmsg_len = CMSG_LEN(sizeof(int) * shm_nr_fds);
+            int fds[shm_nr_fds] = { segment_fd.get(), server_wakeup.get(), client_wakeup.get() };
+            std::memcpy(CMSG_DATA(c), fds, sizeof(fds));
+
+            auto f = _fd->sendmsg(&msg->hdr);
+            // The descriptors are sent when sendmsg() completes
+            return f.then([this, msg = std::move(msg), segment_fd = std::move(segment_fd)] (size_t) mutable {
+                // The server acknowledges the handshake with the same byte
+                msg->byte = 0;
+                auto f = _fd->read_some(&msg->byte, 1);
+                return f.then([msg = std::move(msg)] (size_t n) {
+                    if (n != 1) {
+                        throw make_errno_error(ECONNREFUSED, "shared-memory handshake refused");
+                    }
+                });
+            }).then([this, area = std::move(area), ring_size, server_wakeup = std::move(server_wakeup), client_wakeup = std::move(client_wakeup)] () mutable {
+                auto control = std::move(*_fd);
+                _fd.reset();
+                return make_shm_connected_socket(std::move(area), ring_size, false,
+                        std::move(client_wakeup), std::move(server_wakeup), std::move(control));
+            });
+        });
+    }
+    virtual void set_reuseaddr(bool reuseaddr) override {}
+    virtual bool get_reuseaddr() const override {
+        return false;
+    }
+    virtual void shutdown() override {
+        if (_fd) {
+            _fd->shutdown(SHUT_RDWR);
+        }
+    }
+};
+
+}
+
+server_socket shm_listen(socket_address sa) {
+    if (!sa.is_af_unix()) {
+        throw std::invalid_argument("shared-memory sockets listen on unix-domain addresses");
+    }
+    return server_socket(std::make_unique<shm_server_socket_impl>(engine().posix_listen(sa), sa));
+}
+
+socket shm_socket(shm_options opts) {
+    return socket(std::make_unique<shm_socket_impl>(opts));
+}
+
+future<connected_socket> shm_connect(socket_address sa, shm_options opts) {
+    return do_with(shm_socket(opts), [sa] (socket& s) {
+        return s.connect(sa);
+    });
+}
+
+}
+
+}
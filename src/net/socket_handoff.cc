@@ -0,0 +1,262 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#include <cstring>
+#include <optional>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <seastar/net/socket_handoff.hh>
+#include <seastar/net/stack.hh>
+#include <seastar/core/internal/pollable_fd.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/reactor.hh>
+#include "net/tls-impl.hh"
+
+namespace seastar {
+
+namespace net {
+
+namespace {
+
+constexpr uint32_t handoff_magic = 0x48444f31; // "HDO1"
+constexpr uint32_t handoff_max_name_size = 4096;
+
+// Precedes the name of each socket, whose descriptor comes along with its
+// first byte. The list ends with a header with \c last set, and no socket.
+struct handoff_header {
+    uint32_t magic;
+    uint32_t last;
+    uint32_t shard;
+    uint32_t name_size;
+};
+
+// Buffers of the message carrying a header, and the descriptor of a socket
+struct handoff_message {
+    handoff_header header;
+    iovec iov;
+    msghdr hdr;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+
+    handoff_message() {
+        std::memset(&header, 0, sizeof(header));
+        iov.iov_base = &header;
+        iov.iov_len = sizeof(header);
+        std::memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_iov = &iov;
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = control;
+        hdr.msg_controllen = sizeof(control);
+    }
+};
+
+file_desc dup_socket(int fd, const sstring& name) {
+    if (fd < 0) {
+        throw std::invalid_argument(seastar::format("socket {} has no descriptor to hand off", name));
+    }
+    int r = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    throw_system_error_on(r == -1, "fcntl");
+    return file_desc::from_fd(r);
+}
+
+future<> read_exactly(pollable_fd& fd, char* p, size_t size) {
+    if (!size) {
+        return make_ready_future<>();
+    }
+    return fd.read_some(p, size).then([&fd, p, size] (size_t n) {
+        if (!n) {
+            throw std::runtime_error("socket handoff connection closed early");
+        }
+        return read_exactly(fd, p + n, size - n);
+    });
+}
+
+// Sends a socket, or the end of the list if there is none
+future<> send_socket(pollable_fd& fd, const handoff_socket* s) {
+    auto msg = std::make_unique<handoff_message>();
+    msg->header.magic = handoff_magic;
+    if (s) {
+        msg->header.shard = s->shard;
+        msg->header.name_size = s->name.size();
+        auto c = CMSG_FIRSTHDR(&msg->hdr);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int));
+        int sfd = s->fd.get();
+        std::memcpy(CMSG_DATA(c), &sfd, sizeof(int));
+    } else {
+        msg->header.last = 1;
+        msg->hdr.msg_control = nullptr;
+        msg->hdr.msg_controllen = 0;
+    }
+    auto f = fd.sendmsg(&msg->hdr);
+    return f.then([&fd, msg = std::move(msg), s] (size_t n) mutable {
+        // the descriptor went with the first byte, the rest is plain data
+        auto p = reinterpret_cast<const char*>(&msg->header);
+        auto f = fd.write_all(p + n, sizeof(handoff_header) - n);
+        return f.then([&fd, msg = std::move(msg), s] {
+            if (!s) {
+                return make_ready_future<>();
+            }
+            return fd.write_all(s->name.data(), s->name.size());
+        });
+    });
+}
+
+// Receives a socket, or nothing at the end of the list
+future<std::optional<handoff_socket>> receive_socket(pollable_fd& fd) {
+    auto msg = std::make_unique<handoff_message>();
+    auto f = fd.recvmsg(&msg->hdr);
+    return f.then([&fd, msg = std::move(msg)] (size_t n) mutable {
+        std::optional<file_desc> sfd;
+        for (auto* c = CMSG_FIRSTHDR(&msg->hdr); c; c = CMSG_NXTHDR(&msg->hdr, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+                auto nr = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for (size_t i = 0; i < nr; i++) {
+                    int fd;
+                    std::memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+                    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+                    // more than one is a protocol error, closed on the way out
+                    auto d = file_desc::from_fd(fd);
+                    if (!sfd) {
+                        sfd = std::move(d);
+                    }
+                }
+            }
+        }
+        if (!n) {
+            throw std::runtime_error("socket handoff connection closed early");
+        }
+        auto p = reinterpret_cast<char*>(&msg->header);
+        auto f = read_exactly(fd, p + n, sizeof(handoff_header) - n);
+        return f.then([&fd, msg = std::move(msg), sfd = std::move(sfd)] () mutable {
+            auto& h = msg->header;
+            if (h.magic != handoff_magic || (msg->hdr.msg_flags & MSG_CTRUNC) || h.last != !sfd || h.name_size > handoff_max_name_size) {
+                throw std::runtime_error("invalid socket handoff message");
+            }
+            if (h.last) {
+                return make_ready_future<std::optional<handoff_socket>>();
+            }
+            auto s = std::make_unique<handoff_socket>(handoff_socket{uninitialized_string(h.name_size), h.shard, std::move(*sfd)});
+            auto f = read_exactly(fd, s->name.data(), s->name.size());
+            return f.then([s = std::move(s)] {
+                return std::optional<handoff_socket>(std::move(*s));
+            });
+        });
+    });
+}
+
+future<> send_sockets(pollable_fd fd, std::vector<handoff_socket> sockets) {
+    return do_with(std::move(fd), std::move(sockets), char(0), [] (pollable_fd& fd, std::vector<handoff_socket>& sockets, char& ack) {
+        return do_for_each(sockets, [&fd] (const handoff_socket& s) {
+            return send_socket(fd, &s);
+        }).then([&fd] {
+            return send_socket(fd, nullptr);
+        }).then([&fd, &ack] {
+            // the receiver owns the sockets once it acknowledged them
+            return fd.read_some(&ack, 1);
+        }).then([] (size_t n) {
+            if (n != 1) {
+                throw std::runtime_error("socket handoff not acknowledged");
+            }
+        });
+    });
+}
+
+// Sockets are only handed off to processes of the same user
+bool same_user(pollable_fd& fd) {
+    auto cred = fd.get_file_desc().getsockopt<ucred>(SOL_SOCKET, SO_PEERCRED);
+    return cred.uid == ::geteuid();
+}
+
+}
+
+handoff_socket make_handoff_socket(sstring name, server_socket& ss) {
+    auto impl = get_impl::maybe_get_ptr(ss);
+    auto fd = dup_socket(impl ? impl->native_fd() : -1, name);
+    return handoff_socket{std::move(name), this_shard_id(), std::move(fd)};
+}
+
+handoff_socket make_handoff_socket(sstring name, connected_socket& cs) {
+    auto impl = get_impl::maybe_get_ptr(cs);
+    auto fd = dup_socket(impl ? impl->native_fd() : -1, name);
+    return handoff_socket{std::move(name), this_shard_id(), std::move(fd)};
+}
+
+future<> serve_handoff(socket_address sa, noncopyable_function<future<std::vector<handoff_socket>>()> collect) {
+    if (!sa.is_af_unix()) {
+        return make_exception_future<>(std::invalid_argument("sockets are handed off over unix-domain addresses"));
+    }
+    return futurize_invoke([sa] {
+        return engine().posix_listen(sa);
+    }).then([collect = std::move(collect)] (pollable_fd listener) mutable {
+        return do_with(std::move(listener), std::move(collect), [] (pollable_fd& listener, auto& collect) {
+            return repeat_until_value([&listener] {
+                return listener.accept().then([] (std::tuple<pollable_fd, socket_address> res) {
+                    auto& fd = std::get<0>(res);
+                    if (!same_user(fd)) {
+                        return std::optional<pollable_fd>();
+                    }
+                    return std::optional<pollable_fd>(std::move(fd));
+                });
+            }).then([&collect] (pollable_fd fd) {
+                return collect().then([fd = std::move(fd)] (std::vector<handoff_socket> sockets) mutable {
+                    return send_sockets(std::move(fd), std::move(sockets));
+                });
+            });
+        });
+    });
+}
+
+future<std::vector<handoff_socket>> request_handoff(socket_address sa) {
+    if (!sa.is_af_unix()) {
+        return make_exception_future<std::vector<handoff_socket>>(std::invalid_argument("sockets are handed off over unix-domain addresses"));
+    }
+    return futurize_invoke([sa] {
+        auto fd = engine().make_pollable_fd(sa, 0);
+        return engine().posix_connect(fd, sa, socket_address{}).then([fd] () mutable {
+            if (!same_user(fd)) {
+                throw std::system_error(EPERM, std::system_category(), "socket handoff peer is of another user");
+            }
+            return do_with(std::move(fd), std::vector<handoff_socket>(), [] (pollable_fd& fd, std::vector<handoff_socket>& sockets) {
+                return repeat([&fd, &sockets] {
+                    return receive_socket(fd).then([&sockets] (std::optional<handoff_socket> s) {
+                        if (!s) {
+                            return stop_iteration::yes;
+                        }
+                        sockets.push_back(std::move(*s));
+                        return stop_iteration::no;
+                    });
+                }).then([&fd] {
+                    static const char ack = 0;
+                    return fd.write_all(&ack, 1);
+                }).then([&sockets] {
+                    return std::move(sockets);
+                });
+            });
+        });
+    });
+}
+
+}
+
+}
@@ -23,6 +23,7 @@
 module;
 #endif
 
+#include <algorithm>
 #include <memory>
 #include <type_traits>
 #include <utility>
@@ -31,8 +32,11 @@ module;
 #ifdef SEASTAR_MODULE
 module seastar;
 #else
+#include <seastar/core/do_with.hh>
+#include <seastar/core/loop.hh>
 #include <seastar/core/metrics_api.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/core/timer.hh>
 #include <seastar/net/stack.hh>
 #include <seastar/net/inet_address.hh>
 #endif
@@ -80,6 +84,30 @@ future<> net::datagram_channel::send(const socket_address& dst, packet p) {
     return _impl->send(dst, std::move(p));
 }
 
+future<std::vector<net::datagram>> net::datagram_channel::receive_batch(size_t max) {
+    return _impl->receive_batch(max);
+}
+
+future<> net::datagram_channel::send_batch(std::vector<outgoing_datagram> datagrams) {
+    return _impl->send_batch(std::move(datagrams));
+}
+
+future<std::vector<net::datagram>> net::datagram_channel_impl::receive_batch(size_t) {
+    return receive().then([] (datagram d) {
+        std::vector<datagram> ret;
+        ret.push_back(std::move(d));
+        return ret;
+    });
+}
+
+future<> net::datagram_channel_impl::send_batch(std::vector<outgoing_datagram> datagrams) {
+    return do_with(std::move(datagrams), [this] (std::vector<outgoing_datagram>& datagrams) {
+        return do_for_each(datagrams, [this] (outgoing_datagram& d) {
+            return send(d.dst, std::move(d.data));
+        });
+    });
+}
+
 bool net::datagram_channel::is_closed() const {
     return _impl->is_closed();
 }
@@ -201,6 +229,123 @@ void socket::shutdown() {
     _si->shutdown();
 }
 
+namespace {
+
+// The state of a connect_any() call, kept alive by its attempts in flight
+class connect_race : public enable_lw_shared_from_this<connect_race> {
+    std::vector<socket_address> _addrs;
+    connect_any_options _opts;
+    std::vector<socket> _sockets;
+    std::vector<bool> _connecting;
+    promise<connected_socket> _pr;
+    timer<> _next_attempt;
+    size_t _next = 0;
+    size_t _in_flight = 0;
+    bool _done = false;
+    std::exception_ptr _error;
+
+    void attempt_done(size_t idx, future<connected_socket> f) noexcept {
+        _connecting[idx] = false;
+        _in_flight--;
+        if (_done) {
+            // Lost the race; a connection established anyway is closed
+            // when dropped
+            f.ignore_ready_future();
+            return;
+        }
+        if (f.failed()) {
+            _error = f.get_exception();
+            if (_next < _addrs.size()) {
+                start_next();
+            } else if (!_in_flight) {
+                _done = true;
+                _pr.set_exception(std::move(_error));
+            }
+            return;
+        }
+        _done = true;
+        _next_attempt.cancel();
+        for (size_t i = 0; i < _next; ++i) {
+            if (_connecting[i]) {
+                _sockets[i].shutdown();
+            }
+        }
+        _pr.set_value(f.get());
+    }
+public:
+    connect_race(std::vector<socket_address> addrs, connect_any_options opts)
+        : _addrs(std::move(addrs))
+        , _opts(std::move(opts))
+        , _sockets(_addrs.size())
+        , _connecting(_addrs.size())
+        , _next_attempt([this] { start_next(); })
+    {}
+
+    future<connected_socket> get_future() noexcept {
+        return _pr.get_future();
+    }
+
+    void start_next() noexcept {
+        if (_done || _next == _addrs.size()) {
+            return;
+        }
+        auto idx = _next++;
+        _in_flight++;
+        _connecting[idx] = true;
+        auto f = futurize_invoke([&] {
+            _sockets[idx] = engine().net().socket();
+            return _sockets[idx].connect(_addrs[idx], _opts.local, _opts.proto);
+        });
+        (void)f.then_wrapped([self = shared_from_this(), idx] (future<connected_socket> f) {
+            self->attempt_done(idx, std::move(f));
+        });
+        if (!_done && _next < _addrs.size()) {
+            _next_attempt.rearm(timer<>::clock::now() + _opts.attempt_delay);
+        }
+    }
+};
+
+// Alternates address families, starting with the family of the first
+// address, keeping the order of the addresses within each family
+std::vector<socket_address> interleave_families(std::vector<socket_address> addrs) {
+    auto first_family = addrs.front().family();
+    auto second = std::stable_partition(addrs.begin(), addrs.end(), [first_family] (const socket_address& a) {
+        return a.family() == first_family;
+    });
+    std::vector<socket_address> ret;
+    ret.reserve(addrs.size());
+    auto a = addrs.begin();
+    auto b = second;
+    while (a != second || b != addrs.end()) {
+        if (a != second) {
+            ret.push_back(*a++);
+        }
+        if (b != addrs.end()) {
+            ret.push_back(*b++);
+        }
+    }
+    return ret;
+}
+
+}
+
+future<connected_socket> connect_any(std::vector<socket_address> addrs, connect_any_options opts) {
+    if (addrs.empty()) {
+        return make_exception_future<connected_socket>(std::invalid_argument("connect_any: no address to connect to"));
+    }
+    if (addrs.size() == 1) {
+        return engine().connect(addrs.front(), opts.local, opts.proto);
+    }
+    try {
+        auto race = make_lw_shared<connect_race>(interleave_families(std::move(addrs)), std::move(opts));
+        auto f = race->get_future();
+        race->start_next();
+        return f;
+    } catch (...) {
+        return current_exception_as_future<connected_socket>();
+    }
+}
+
 server_socket::server_socket() noexcept {
 }
 
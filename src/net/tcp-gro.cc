@@ -0,0 +1,142 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/net/tcp-gro.hh>
+#include <seastar/net/ip.hh>
+#include <seastar/net/ip_checksum.hh>
+#include <seastar/core/byteorder.hh>
+#endif
+
+namespace seastar {
+
+namespace net {
+
+namespace {
+
+constexpr uint8_t tcp_flag_psh = 0x08;
+constexpr uint8_t tcp_flag_ack = 0x10;
+
+}
+
+ipv4_tcp_gro::ipv4_tcp_gro(deliver_fn deliver, bool verify_csum)
+    : _deliver(std::move(deliver))
+    , _verify_csum(verify_csum) {
+    _flows.reserve(max_flows);
+    _flushing.reserve(max_flows);
+}
+
+void ipv4_tcp_gro::release(std::vector<flow>::iterator it) {
+    auto f = std::move(*it);
+    _flows.erase(it);
+    _packets++;
+    _deliver(std::move(f.p), f.from, f.to);
+}
+
+void ipv4_tcp_gro::receive(packet p, ipv4_address from, ipv4_address to) {
+    auto th = p.get_header(0, tcp_hdr_len_min);
+    uint16_t hdr_len = th ? (uint8_t(th[12]) >> 4) * 4 : 0;
+    if (hdr_len < tcp_hdr_len_min || p.len() < hdr_len) {
+        // Malformed, leave it to the tcp to drop
+        _packets++;
+        _deliver(std::move(p), from, to);
+        return;
+    }
+    if (_verify_csum) {
+        checksummer csum;
+        ipv4_traits::tcp_pseudo_header_checksum(csum, from, to, p.len());
+        csum.sum(p);
+        if (csum.get() != 0) {
+            return;
+        }
+        p.offload_info_ref().rx_csum_verified = true;
+    }
+    th = p.get_header(0, hdr_len);
+    auto src_port = read_be<uint16_t>(th);
+    auto dst_port = read_be<uint16_t>(th + 2);
+    auto seq = read_be<uint32_t>(th + 4);
+    auto ack = read_be<uint32_t>(th + 8);
+    auto flags = uint8_t(th[13]);
+    uint32_t data_len = p.len() - hdr_len;
+    bool mergeable = data_len && (flags & ~tcp_flag_psh) == tcp_flag_ack;
+
+    auto it = std::find_if(_flows.begin(), _flows.end(), [&] (const flow& f) {
+        return f.src_port == src_port && f.dst_port == dst_port && f.from == from && f.to == to;
+    });
+    if (it != _flows.end()) {
+        auto& f = *it;
+        auto fh = f.p.get_header(0, f.hdr_len);
+        if (mergeable && seq == f.next_seq && ack == f.ack && hdr_len == f.hdr_len
+                && std::equal(th + tcp_hdr_len_min, th + hdr_len, fh + tcp_hdr_len_min)
+                && f.p.len() + data_len <= max_segment_len) {
+            // The latest window update wins
+            std::copy_n(th + 14, 2, fh + 14);
+            fh[13] |= flags & tcp_flag_psh;
+            p.trim_front(hdr_len);
+            f.p.append(std::move(p));
+            f.next_seq += data_len;
+            _merged_segments++;
+            // The sender wants the data delivered now
+            if (flags & tcp_flag_psh) {
+                release(it);
+            }
+            return;
+        }
+        release(it);
+    }
+    if (!mergeable || (flags & tcp_flag_psh)) {
+        _packets++;
+        _deliver(std::move(p), from, to);
+        return;
+    }
+    if (_flows.size() == max_flows) {
+        release(_flows.begin());
+    }
+    _flows.push_back(flow{from, to, src_port, dst_port, seq + data_len, ack, hdr_len, std::move(p)});
+}
+
+bool ipv4_tcp_gro::flush() {
+    if (_flows.empty()) {
+        return false;
+    }
+    std::swap(_flows, _flushing);
+    for (auto& f : _flushing) {
+        _packets++;
+        _deliver(std::move(f.p), f.from, f.to);
+    }
+    _flushing.clear();
+    return true;
+}
+
+}
+
+}
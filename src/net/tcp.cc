@@ -21,14 +21,20 @@
 
 #ifdef SEASTAR_MODULE
 module;
+#include <algorithm>
 #include <compare>
 #include <atomic>
+#include <cmath>
 #include <cstdint>
 #include <memory>
 #include <utility>
 module seastar;
 #else
+#include <algorithm>
+#include <cmath>
+#include <fmt/core.h>
 #include <seastar/net/tcp.hh>
+#include <seastar/net/tcp-congestion.hh>
 #include <seastar/net/tcp-stack.hh>
 #include <seastar/net/ip.hh>
 #include <seastar/core/align.hh>
@@ -44,6 +50,8 @@ namespace net {
 void tcp_option::parse(uint8_t* beg1, uint8_t* end1) {
     const char* beg = reinterpret_cast<const char*>(beg1);
     const char* end = reinterpret_cast<const char*>(end1);
+    _nr_remote_sack_blocks = 0;
+    _remote_ts_present = false;
     while (beg < end) {
         auto kind = option_kind(*beg);
         if (kind != option_kind::nop && kind != option_kind::eol) {
@@ -70,6 +78,29 @@ void tcp_option::parse(uint8_t* beg1, uint8_t* end1) {
             _sack_received = true;
             beg += option_len::sack;
             break;
+        case option_kind::timestamps: {
+            auto ts = timestamps::read(beg);
+            _timestamps_received = true;
+            _remote_ts_present = true;
+            _remote_ts_val = ts.t1;
+            _remote_ts_ecr = ts.t2;
+            beg += option_len::timestamps;
+            break;
+        }
+        case option_kind::sack_blocks: {
+            auto len = uint8_t(beg[1]);
+            if (len < sack_blocks::len(1)) {
+                return;
+            }
+            auto nr = std::min<uint8_t>((len - 2) / 8, sack_blocks::max_blocks);
+            for (uint8_t i = 0; i < nr; i++) {
+                auto block = beg + 2 + 8 * i;
+                _remote_sack_blocks[i] = {read_be<uint32_t>(block), read_be<uint32_t>(block + 4)};
+            }
+            _nr_remote_sack_blocks = nr;
+            beg += len;
+            break;
+        }
         case option_kind::nop:
             beg += option_len::nop;
             break;
@@ -110,6 +141,38 @@ uint8_t tcp_option::fill(void* h, const tcp_hdr* th, uint8_t options_size) {
             off += win_scale.len;
             size += win_scale.len;
         }
+        if (_sack_received || !ack_on) {
+            auto sack = tcp_option::sack();
+            sack.write(off);
+            off += sack.len;
+            size += sack.len;
+        }
+        if (_local_timestamps && (_timestamps_received || !ack_on)) {
+            auto ts = tcp_option::timestamps();
+            ts.t1 = _local_ts_val;
+            ts.t2 = ack_on ? _local_ts_ecr : 0;
+            ts.write(off);
+            off += ts.len;
+            size += ts.len;
+        }
+    } else if (timestamps_enabled()) {
+        auto ts = tcp_option::timestamps();
+        ts.t1 = _local_ts_val;
+        ts.t2 = _local_ts_ecr;
+        ts.write(off);
+        off += ts.len;
+        size += ts.len;
+    }
+    if (!syn_on && _nr_local_sack_blocks) {
+        auto len = sack_blocks::len(_nr_local_sack_blocks);
+        off[0] = static_cast<uint8_t>(sack_blocks::kind);
+        off[1] = len;
+        for (uint8_t i = 0; i < _nr_local_sack_blocks; i++) {
+            write_be<uint32_t>(off + 2 + 8 * i, _local_sack_blocks[i].first);
+            write_be<uint32_t>(off + 6 + 8 * i, _local_sack_blocks[i].second);
+        }
+        off += len;
+        size += len;
     }
     if (size > 0) {
         // Insert NOP option
@@ -138,6 +201,17 @@ uint8_t tcp_option::get_size(bool syn_on, bool ack_on) {
         if (_win_scale_received || !ack_on) {
             size += option_len::win_scale;
         }
+        if (_sack_received || !ack_on) {
+            size += option_len::sack;
+        }
+        if (_local_timestamps && (_timestamps_received || !ack_on)) {
+            size += option_len::timestamps;
+        }
+    } else if (timestamps_enabled()) {
+        size += option_len::timestamps;
+    }
+    if (!syn_on && _nr_local_sack_blocks) {
+        size += sack_blocks::len(_nr_local_sack_blocks);
     }
     if (size > 0) {
         size += option_len::eol;
@@ -147,6 +221,261 @@ uint8_t tcp_option::get_size(bool syn_on, bool ack_on) {
     return size;
 }
 
+void tcp_receive_space::on_rtt_sample(std::chrono::microseconds rtt, bool upper_bound) noexcept {
+    if (!_rtt.count()) {
+        _rtt = rtt;
+    } else if (upper_bound) {
+        _rtt = std::min(_rtt, rtt);
+    } else {
+        _rtt = _rtt * 7 / 8 + rtt / 8;
+    }
+}
+
+bool tcp_receive_space::on_consumed(size_t len, uint16_t mss, clock_type::time_point now) noexcept {
+    _consumed += len;
+    if (!_rtt.count()) {
+        return false;
+    }
+    if (!_measured_at) {
+        _measured_consumed = _consumed - len;
+        _measured_at = now;
+    }
+    if (now - *_measured_at < _rtt) {
+        return false;
+    }
+    size_t copied = _consumed - _measured_consumed;
+    _measured_consumed = _consumed;
+    _measured_at = now;
+    if (copied <= _space) {
+        return false;
+    }
+    // A window in flight and one to absorb the application falling behind,
+    // with room for the headers of the segments
+    auto wanted = 2 * copied + 16 * size_t(mss);
+    // While the rate keeps growing fast, as in slow start, more so
+    if (copied >= _space + _space / 4) {
+        wanted += wanted * std::min(copied - _space, _space) / _space;
+    }
+    _space = copied;
+    wanted = std::min(wanted, _max);
+    if (wanted <= _buffer) {
+        return false;
+    }
+    _buffer = wanted;
+    return true;
+}
+
+void tcp_ack_policy::enter_quick_ack(uint32_t window, uint16_t mss) noexcept {
+    _quick_acks = std::clamp<uint32_t>(window / (2 * std::max<uint32_t>(mss, 1)), 2, max_quick_acks);
+    _pingpong = false;
+    _ato = min_delay();
+}
+
+void tcp_ack_policy::on_data_received(clock_type::time_point now, uint32_t window, uint16_t mss, std::chrono::microseconds rto) noexcept {
+    if (!_ato.count()) {
+        enter_quick_ack(window, mss);
+    } else {
+        auto interval = std::chrono::duration_cast<std::chrono::microseconds>(now - _last_received);
+        if (interval <= min_delay() / 2) {
+            _ato = _ato / 2 + min_delay() / 2;
+        } else if (interval < _ato) {
+            _ato = std::min(_ato / 2 + interval, rto);
+        } else if (interval > rto) {
+            // The sender restarts from a small window after being idle
+            enter_quick_ack(window, mss);
+        }
+    }
+    _last_received = now;
+}
+
+void tcp_ack_policy::on_data_sent(clock_type::time_point now) noexcept {
+    if (_ato.count() && now - _last_received < _ato) {
+        _pingpong = true;
+    }
+}
+
+void tcp_ack_policy::on_ack_timeout() noexcept {
+    if (_pingpong) {
+        // No response went out in time to carry the ACK
+        _pingpong = false;
+        _ato = min_delay();
+    } else {
+        _ato = std::min(_ato * 2, _max_delay);
+    }
+}
+
+bool tcp_ack_policy::take_quick_ack() noexcept {
+    if (!_quick_acks || _pingpong) {
+        return false;
+    }
+    --_quick_acks;
+    return true;
+}
+
+tcp_congestion_algorithm parse_tcp_congestion_algorithm(std::string_view name) {
+    if (name == "reno") {
+        return tcp_congestion_algorithm::reno;
+    } else if (name == "cubic") {
+        return tcp_congestion_algorithm::cubic;
+    } else if (name == "bbr") {
+        return tcp_congestion_algorithm::bbr;
+    }
+    throw std::invalid_argument(fmt::format("Unknown TCP congestion control algorithm: {}", name));
+}
+
+std::string_view tcp_congestion_algorithm_name(tcp_congestion_algorithm algo) noexcept {
+    switch (algo) {
+    case tcp_congestion_algorithm::reno: return "reno";
+    case tcp_congestion_algorithm::cubic: return "cubic";
+    case tcp_congestion_algorithm::bbr: return "bbr";
+    }
+    return "unknown";
+}
+
+std::unique_ptr<tcp_congestion_control> make_tcp_congestion_control(tcp_congestion_algorithm algo) {
+    switch (algo) {
+    case tcp_congestion_algorithm::reno: return std::make_unique<tcp_reno>();
+    case tcp_congestion_algorithm::cubic: return std::make_unique<tcp_cubic>();
+    case tcp_congestion_algorithm::bbr: return std::make_unique<tcp_bbr>();
+    }
+    throw std::invalid_argument("Unknown TCP congestion control algorithm");
+}
+
+void tcp_reno::on_ack(uint32_t& cwnd, uint32_t ssthresh, uint32_t mss, uint32_t acked_bytes, clock_type::time_point now) noexcept {
+    if (cwnd < ssthresh) {
+        // In slow start phase
+        cwnd += std::min(acked_bytes, mss);
+    } else {
+        // In congestion avoidance phase
+        uint32_t round_up = 1;
+        cwnd += std::max(round_up, mss * mss / cwnd);
+    }
+}
+
+uint32_t tcp_reno::on_loss(uint32_t cwnd, uint32_t flight_size, uint32_t mss, bool timeout, clock_type::time_point now) noexcept {
+    return std::max(flight_size / 2, 2 * mss);
+}
+
+void tcp_cubic::on_ack(uint32_t& cwnd, uint32_t ssthresh, uint32_t mss, uint32_t acked_bytes, clock_type::time_point now) noexcept {
+    if (cwnd < ssthresh) {
+        cwnd += std::min(acked_bytes, mss);
+        return;
+    }
+
+    // The window function is defined in segments, RFC8312 Section 4.1
+    double w = double(cwnd) / mss;
+    if (!_epoch_start) {
+        _epoch_start = now;
+        if (w < _w_max) {
+            _k = std::cbrt((_w_max - w) / c);
+        } else {
+            _k = 0;
+            _w_max = w;
+        }
+        _w_est = w;
+        _credit = 0;
+    }
+
+    auto t = std::chrono::duration<double>(now - *_epoch_start).count();
+    if (_min_rtt != std::chrono::microseconds::max()) {
+        t += std::chrono::duration<double>(_min_rtt).count();
+    }
+    double target = c * std::pow(t - _k, 3) + _w_max;
+    target = std::clamp(target, w, 1.5 * w);
+
+    // TCP-friendly region, RFC8312 Section 4.2
+    _w_est += 3 * (1 - beta) / (1 + beta) * (double(acked_bytes) / mss) / w;
+    target = std::max(target, _w_est);
+
+    // Grow by (target - cwnd) / cwnd per acknowledged segment, keeping
+    // the fractions of a byte around so that slow growth is not lost
+    _credit += (target - w) / w * acked_bytes;
+    auto inc = uint32_t(_credit);
+    _credit -= inc;
+    cwnd += inc;
+}
+
+void tcp_cubic::on_rtt_sample(std::chrono::microseconds rtt, clock_type::time_point now) noexcept {
+    _min_rtt = std::min(_min_rtt, rtt);
+}
+
+uint32_t tcp_cubic::on_loss(uint32_t cwnd, uint32_t flight_size, uint32_t mss, bool timeout, clock_type::time_point now) noexcept {
+    double w = double(cwnd) / mss;
+    // Fast convergence, RFC8312 Section 4.6
+    if (w < _w_max) {
+        _w_max = w * (1 + beta) / 2;
+    } else {
+        _w_max = w;
+    }
+    _epoch_start.reset();
+    return std::max(uint32_t(cwnd * beta), 2 * mss);
+}
+
+double tcp_bbr::max_bw() const noexcept {
+    return *std::max_element(_bw_samples.begin(), _bw_samples.end());
+}
+
+uint32_t tcp_bbr::target_cwnd(uint32_t mss) const noexcept {
+    if (_min_rtt == std::chrono::microseconds::max()) {
+        return 0;
+    }
+    auto bdp = max_bw() * std::chrono::duration<double>(_min_rtt).count();
+    return std::max(uint32_t(cwnd_gain * bdp), 4 * mss);
+}
+
+void tcp_bbr::end_round(clock_type::time_point now) noexcept {
+    auto duration = std::max(std::chrono::duration<double>(now - _round_start).count(), 1e-3);
+    _bw_samples[_round++ % bw_window_rounds] = (_delivered - _round_start_delivered) / duration;
+    _round_start = now;
+    _round_start_delivered = _delivered;
+
+    if (!_filled_pipe) {
+        auto bw = max_bw();
+        if (bw >= _full_bw * full_bw_growth) {
+            _full_bw = bw;
+            _full_bw_count = 0;
+        } else if (++_full_bw_count >= full_bw_rounds) {
+            _filled_pipe = true;
+        }
+    }
+}
+
+void tcp_bbr::on_ack(uint32_t& cwnd, uint32_t ssthresh, uint32_t mss, uint32_t acked_bytes, clock_type::time_point now) noexcept {
+    _delivered += acked_bytes;
+    // A round lasts for one round trip propagation time
+    if (_min_rtt != std::chrono::microseconds::max()
+            && now - _round_start >= std::max<std::chrono::microseconds>(_min_rtt, std::chrono::milliseconds(1))) {
+        end_round(now);
+    }
+
+    if (!_filled_pipe) {
+        // Startup, grow exponentially until the bandwidth stops growing
+        cwnd += acked_bytes;
+    } else {
+        cwnd = std::min(cwnd + acked_bytes, target_cwnd(mss));
+    }
+}
+
+void tcp_bbr::on_rtt_sample(std::chrono::microseconds rtt, clock_type::time_point now) noexcept {
+    if (_min_rtt == std::chrono::microseconds::max()) {
+        _round_start = now;
+        _round_start_delivered = _delivered;
+    }
+    if (rtt <= _min_rtt || now - _min_rtt_stamp > min_rtt_window) {
+        _min_rtt = rtt;
+        _min_rtt_stamp = now;
+    }
+}
+
+uint32_t tcp_bbr::on_loss(uint32_t cwnd, uint32_t flight_size, uint32_t mss, bool timeout, clock_type::time_point now) noexcept {
+    // The model, not the loss, tells how much data is in the pipe
+    auto target = target_cwnd(mss);
+    if (target == 0) {
+        return std::max(flight_size / 2, 2 * mss);
+    }
+    return std::max(target, 2 * mss);
+}
+
 ipv4_tcp::ipv4_tcp(ipv4& inet)
 	: _inet_l4(inet), _tcp(std::make_unique<tcp<ipv4_traits>>(_inet_l4)) {
 }
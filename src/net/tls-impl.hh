@@ -0,0 +1,451 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright 2015 Cloudius Systems
+ */
+
+#pragma once
+
+// Glue between the backend independent part of seastar::tls (tls.cc) and
+// the TLS library backend (gnutls.cc, or ossl.cc when built with
+// Seastar_WITH_OSSL). Exactly one backend is compiled in; it defines the
+// members declared here as "implemented by the backend".
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <seastar/core/format.hh>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/core/with_scheduling_group.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/net/stack.hh>
+#include <seastar/net/tls.hh>
+
+namespace seastar {
+
+class net::get_impl {
+public:
+    static std::unique_ptr<connected_socket_impl> get(connected_socket s) {
+        return std::move(s._csi);
+    }
+
+    static connected_socket_impl* maybe_get_ptr(connected_socket& s) {
+        if (s._csi) {
+            return s._csi.get();
+        }
+        return nullptr;
+    }
+
+    static server_socket_impl* maybe_get_ptr(server_socket& s) {
+        return s._ssi.get();
+    }
+};
+
+namespace tls {
+
+struct file_info {
+    sstring filename;
+    std::chrono::system_clock::time_point modified;
+};
+
+struct file_result {
+    temporary_buffer<char> buf;
+    file_info file;
+    operator temporary_buffer<char>&&() && {
+        return std::move(buf);
+    }
+};
+
+future<file_result> read_fully(const sstring& name, const sstring& what);
+
+// The metrics name of credentials, which must be unique among those of a
+// shard exporting the same metrics, since registering them twice fails.
+// Empty names export nothing and are not reserved.
+class metrics_name_reservation {
+    std::unordered_set<sstring>* _in_use = nullptr;
+    sstring _name;
+public:
+    metrics_name_reservation() noexcept = default;
+    metrics_name_reservation(std::unordered_set<sstring>& in_use, const sstring& name) {
+        if (name.empty()) {
+            return;
+        }
+        if (!in_use.insert(name).second) {
+            throw std::invalid_argument(format("TLS metrics name \"{}\" is already used by other credentials", name));
+        }
+        _in_use = &in_use;
+        _name = name;
+    }
+    metrics_name_reservation(metrics_name_reservation&& o) noexcept
+        : _in_use(std::exchange(o._in_use, nullptr)), _name(std::move(o._name)) {}
+    metrics_name_reservation& operator=(metrics_name_reservation&& o) noexcept {
+        if (this != &o) {
+            release();
+            _in_use = std::exchange(o._in_use, nullptr);
+            _name = std::move(o._name);
+        }
+        return *this;
+    }
+    ~metrics_name_reservation() {
+        release();
+    }
+    const sstring& name() const noexcept {
+        return _name;
+    }
+    void release() noexcept {
+        if (_in_use) {
+            _in_use->erase(_name);
+            _in_use = nullptr;
+        }
+    }
+};
+
+// Admission and accounting of server handshakes, see handshake_options.
+// Sessions keep a reference, so that reloading credentials doesn't
+// affect the handshakes in progress.
+class handshake_control {
+    // Unset to run the handshakes in the group of their caller
+    std::optional<scheduling_group> _sg;
+    semaphore _sem;
+    handshake_stats _stats;
+    metrics::internal::time_estimated_histogram _latency;
+    metrics_name_reservation _metrics_name;
+    metrics::metric_groups _metrics;
+
+    static std::unordered_set<sstring>& metrics_names_in_use() {
+        static thread_local std::unordered_set<sstring> names;
+        return names;
+    }
+public:
+    explicit handshake_control(const handshake_options& opts)
+        : _sg(opts.sched_group)
+        , _sem(opts.max_concurrent != 0 ? opts.max_concurrent : semaphore::max_counter())
+        , _metrics_name(metrics_names_in_use(), opts.metrics_name)
+    {
+        if (!opts.metrics_name.empty()) {
+            namespace sm = seastar::metrics;
+            std::vector<sm::label_instance> labels = { sm::label("credentials")(opts.metrics_name) };
+            _metrics.add_group("tls", {
+                sm::make_counter("handshakes", [this] { return _stats.completed; },
+                        sm::description("Number of completed server handshakes"), labels),
+                sm::make_counter("handshake_errors", [this] { return _stats.failed; },
+                        sm::description("Number of failed server handshakes"), labels),
+                sm::make_gauge("handshake_queue_length", [this] { return _stats.waiting; },
+                        sm::description("Number of server handshakes waiting for the concurrency limit"), labels),
+                sm::make_gauge("active_handshakes", [this] { return _stats.active; },
+                        sm::description("Number of server handshakes in progress"), labels),
+                sm::make_histogram("handshake_latency", [this] { return _latency.to_metrics_histogram(); },
+                        sm::description("Time from the start of a server handshake, including the time it waited, to its completion"), labels),
+            });
+        }
+    }
+
+    const handshake_stats& stats() const noexcept {
+        return _stats;
+    }
+
+    const sstring& metrics_name() const noexcept {
+        return _metrics_name.name();
+    }
+
+    // Stops exporting the metrics, for other options to take the name over
+    // while sessions still use these
+    void unregister_metrics() noexcept {
+        _metrics.clear();
+        _metrics_name.release();
+    }
+
+    future<> run(noncopyable_function<future<>()> handshake) {
+        auto start = std::chrono::steady_clock::now();
+        ++_stats.waiting;
+        auto admit = [this, handshake = std::move(handshake)] () mutable {
+            return with_semaphore(_sem, 1, [this, handshake = std::move(handshake)] () mutable {
+                --_stats.waiting;
+                ++_stats.active;
+                return futurize_invoke(handshake).finally([this] {
+                    --_stats.active;
+                });
+            });
+        };
+        auto f = _sg ? with_scheduling_group(*_sg, std::move(admit)) : admit();
+        return f.then_wrapped([this, start] (future<> f) {
+            if (f.failed()) {
+                ++_stats.failed;
+            } else {
+                ++_stats.completed;
+                _latency.add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start));
+            }
+            return f;
+        });
+    }
+};
+
+// Sessions of client connections, kept to resume later connections to
+// the same server with, see certificate_credentials::set_client_session_cache.
+// Sessions keep a reference, so that reloading credentials doesn't lose it.
+class client_session_cache {
+    struct entry {
+        sstring server_name;
+        session_data data;
+    };
+    size_t _max_entries;
+    // most recently stored first
+    std::list<entry> _lru;
+    std::unordered_map<sstring, std::list<entry>::iterator> _index;
+    client_session_cache_stats _stats;
+    metrics_name_reservation _metrics_name;
+    metrics::metric_groups _metrics;
+
+    static std::unordered_set<sstring>& metrics_names_in_use() {
+        static thread_local std::unordered_set<sstring> names;
+        return names;
+    }
+public:
+    explicit client_session_cache(const client_session_cache_options& opts)
+        : _max_entries(opts.max_entries)
+        , _metrics_name(metrics_names_in_use(), opts.metrics_name)
+    {
+        if (!opts.metrics_name.empty()) {
+            namespace sm = seastar::metrics;
+            std::vector<sm::label_instance> labels = { sm::label("credentials")(opts.metrics_name) };
+            _metrics.add_group("tls", {
+                sm::make_counter("client_session_cache_hits", [this] { return _stats.hits; },
+                        sm::description("Number of client connections that found a session to resume in the cache"), labels),
+                sm::make_counter("client_session_cache_misses", [this] { return _stats.misses; },
+                        sm::description("Number of client connections that found no session to resume in the cache"), labels),
+                sm::make_counter("client_resumed_handshakes", [this] { return _stats.resumed_handshakes; },
+                        sm::description("Number of client handshakes that resumed a session"), labels),
+                sm::make_counter("client_full_handshakes", [this] { return _stats.full_handshakes; },
+                        sm::description("Number of client handshakes that didn't resume a session"), labels),
+                sm::make_gauge("client_session_cache_entries", [this] { return _index.size(); },
+                        sm::description("Number of servers with a session in the cache"), labels),
+            });
+        }
+    }
+
+    const sstring& metrics_name() const noexcept {
+        return _metrics_name.name();
+    }
+
+    // Stops exporting the metrics, for another cache to take the name over
+    // while sessions still use this one
+    void unregister_metrics() noexcept {
+        _metrics.clear();
+        _metrics_name.release();
+    }
+
+    client_session_cache_stats stats() const noexcept {
+        auto s = _stats;
+        s.entries = _index.size();
+        return s;
+    }
+
+    // A session to resume a connection to server_name with, or nothing.
+    // Tickets are single use, so the session leaves the cache.
+    session_data take(const sstring& server_name) {
+        auto it = _index.find(server_name);
+        if (it == _index.end()) {
+            ++_stats.misses;
+            return {};
+        }
+        ++_stats.hits;
+        auto data = std::move(it->second->data);
+        _lru.erase(it->second);
+        _index.erase(it);
+        return data;
+    }
+
+    void put(const sstring& server_name, session_data data) {
+        if (data.empty() || !_max_entries) {
+            return;
+        }
+        auto it = _index.find(server_name);
+        if (it != _index.end()) {
+            _lru.erase(it->second);
+            _index.erase(it);
+        } else if (_index.size() == _max_entries) {
+            _index.erase(_lru.back().server_name);
+            _lru.pop_back();
+        }
+        _lru.push_front(entry{server_name, std::move(data)});
+        _index.emplace(server_name, _lru.begin());
+    }
+
+    void handshake_done(bool resumed) noexcept {
+        ++(resumed ? _stats.resumed_handshakes : _stats.full_handshakes);
+    }
+};
+
+class certificate_credentials::impl {
+public:
+    // Library specific state, defined by the backend
+    class backend;
+
+    // implemented by the backend
+    impl();
+    ~impl();
+
+    void set_x509_trust(const blob&, x509_crt_format);
+    void set_x509_crl(const blob&, x509_crt_format);
+    void set_x509_key(const blob& cert, const blob& key, x509_crt_format);
+    void set_simple_pkcs12(const blob&, x509_crt_format, const sstring& password);
+    void set_dh_params(const tls::dh_params&);
+    future<> set_system_trust();
+    void set_priority_string(const sstring&);
+    void set_kernel_tls(bool enable);
+
+    backend& get_backend() const {
+        return *_backend;
+    }
+
+    void set_client_auth(client_auth ca) {
+        _client_auth = ca;
+    }
+    client_auth get_client_auth() const {
+        return _client_auth;
+    }
+    void set_session_resume_mode(session_resume_mode m, std::span<const uint8_t> key = {}) {
+        _session_resume_mode = m;
+        // (re-)generate session key
+        if (m != session_resume_mode::NONE) {
+            set_session_resume_key(key);
+        }
+    }
+    session_resume_mode get_session_resume_mode() const {
+        return _session_resume_mode;
+    }
+
+    void set_dn_verification_callback(dn_callback cb) {
+        _dn_callback = std::move(cb);
+    }
+
+    void set_enable_certificate_verification(bool enable) {
+        _enable_certificate_verification = enable;
+    }
+
+    void set_alpn_protocols(const std::vector<sstring>& protocols) {
+        _alpn_protocols = protocols;
+    }
+
+    bool get_kernel_tls() const {
+        return _kernel_tls;
+    }
+
+    void set_handshake_options(const handshake_options& opts) {
+        // The new options may reuse the metrics name of the previous ones,
+        // which otherwise keep theirs until the new ones are in place
+        if (_handshake && _handshake->metrics_name() == opts.metrics_name) {
+            _handshake->unregister_metrics();
+        }
+        auto prev = std::exchange(_handshake, make_lw_shared<handshake_control>(opts));
+        if (prev) {
+            prev->unregister_metrics();
+        }
+    }
+    lw_shared_ptr<handshake_control> get_handshake_control() const {
+        return _handshake;
+    }
+
+    void set_client_session_cache(const client_session_cache_options& opts) {
+        // As in set_handshake_options()
+        if (_session_cache && _session_cache->metrics_name() == opts.metrics_name) {
+            _session_cache->unregister_metrics();
+        }
+        auto prev = std::exchange(_session_cache, make_lw_shared<client_session_cache>(opts));
+        if (prev) {
+            prev->unregister_metrics();
+        }
+    }
+    lw_shared_ptr<client_session_cache> get_client_session_cache() const {
+        return _session_cache;
+    }
+
+private:
+    friend class credentials_builder;
+    friend class session;
+
+    // implemented by the backend, an empty key means a new random one
+    void set_session_resume_key(std::span<const uint8_t> key);
+
+    bool need_load_system_trust() const {
+        return _load_system_trust;
+    }
+    future<> maybe_load_system_trust() {
+        return with_semaphore(_system_trust_sem, 1, [this] {
+            if (!_load_system_trust) {
+                return make_ready_future();
+            }
+            return set_system_trust();
+        });
+    }
+
+    std::unique_ptr<backend> _backend;
+    client_auth _client_auth = client_auth::NONE;
+    session_resume_mode _session_resume_mode = session_resume_mode::NONE;
+    bool _load_system_trust = false;
+    semaphore _system_trust_sem {1};
+    dn_callback _dn_callback;
+    bool _enable_certificate_verification = true;
+    std::vector<sstring> _alpn_protocols;
+    bool _kernel_tls = false;
+    lw_shared_ptr<handshake_control> _handshake;
+    lw_shared_ptr<client_session_cache> _session_cache;
+};
+
+/**
+ * The TLS data flow of a connection, implemented by the backend's
+ * session class. Owned through session_ref (see tls.cc), the last
+ * of which closes the session.
+ */
+class session_impl : public enable_shared_from_this<session_impl> {
+public:
+    virtual ~session_impl() {}
+
+    virtual future<temporary_buffer<char>> get() = 0;
+    virtual future<> put(net::packet) = 0;
+    virtual future<> flush() noexcept = 0;
+    virtual void close() noexcept = 0;
+    virtual net::connected_socket_impl& socket() const = 0;
+
+    virtual future<std::optional<session_dn>> get_distinguished_name() = 0;
+    virtual future<std::vector<subject_alt_name>> get_alt_name_information(std::unordered_set<subject_alt_name_type>) = 0;
+    virtual future<std::vector<certificate_data>> get_peer_certificate_chain() = 0;
+    virtual future<bool> is_resumed() = 0;
+    virtual future<session_data> get_session_resume_data() = 0;
+    virtual future<std::optional<sstring>> get_selected_alpn_protocol() = 0;
+};
+
+// implemented by the backend
+shared_ptr<session_impl> make_client_session(shared_ptr<certificate_credentials>, std::unique_ptr<net::connected_socket_impl>, tls_options);
+shared_ptr<session_impl> make_server_session(shared_ptr<server_credentials>, std::unique_ptr<net::connected_socket_impl>);
+
+// Derives the next session ticket key from the current one, see
+// credentials_builder::rotate_session_resume_key. Implemented by the backend.
+std::vector<uint8_t> derive_session_resume_key(std::span<const uint8_t> key);
+
+}
+}
@@ -29,6 +29,7 @@ module;
 #include <memory>
 #include <queue>
 #include <string>
+#include <utility>
 #include <vector>
 #include <fcntl.h>
 #include <seastar/net/virtio-interface.hh>
@@ -69,6 +70,17 @@ phys virt_to_phys(void* p) {
     return reinterpret_cast<uintptr_t>(p);
 }
 
+net::hw_features negotiated_hw_features(net::hw_features hw, uint64_t features) noexcept {
+    bool csum = features & VIRTIO_NET_F_CSUM;
+    hw.tx_csum_l4_offload &= csum;
+    hw.rx_csum_offload &= bool(features & VIRTIO_NET_F_GUEST_CSUM);
+    // Segmentation offloads need the checksum offload, virtio 1.1 5.1.3.1
+    hw.tx_tso &= csum && (features & VIRTIO_NET_F_HOST_TSO4);
+    hw.tx_ufo &= csum && (features & VIRTIO_NET_F_HOST_UFO);
+    hw.rx_lro &= bool(features & VIRTIO_NET_F_GUEST_TSO4);
+    return hw;
+}
+
 class device : public net::device {
 private:
     net::hw_features _hw_features;
@@ -131,6 +143,12 @@ class device : public net::device {
         return _features;
     }
 
+    // Drops the offloads the host didn't accept
+    void set_negotiated_features(uint64_t features) {
+        _features = features;
+        _hw_features = negotiated_hw_features(_hw_features, features);
+    }
+
     virtual std::unique_ptr<net::qp> init_local_queue(const program_options::option_group& opts, uint16_t qid) override;
 };
 
@@ -286,6 +304,9 @@ class vring {
     semaphore _available_descriptors = { 0 };
     int _free_head = -1;
     int _free_last = -1;
+    // Buffers were posted since the last kick. The kick is left to the
+    // poller so that all the posts of a poll iteration share one.
+    bool _kick_pending = false;
     reactor::poller _poller;
 public:
 
@@ -379,8 +400,13 @@ vring<BufferChain, Completion>::vring(ring_config conf, Completion complete)
     , _avail_event(reinterpret_cast<std::atomic<uint16_t>*>(&_used._shared->_used_elements[conf.size]))
     , _used_event(reinterpret_cast<std::atomic<uint16_t>*>(&_avail._shared->_ring[conf.size]))
     , _poller(reactor::poller::simple([this] {
-        return do_complete();
-    }))
+        bool work = do_complete();
+        if (std::exchange(_kick_pending, false)) {
+            kick();
+            work = true;
+        }
+        return work;
+    }, internal::loop_phase::network))
 {
     setup();
 }
@@ -421,7 +447,7 @@ void vring<BufferChain, Completion>::post(Iterator begin, Iterator end) {
         _avail._avail_added_since_kick++;
     }
     _avail._shared->_idx.store(_avail._head, std::memory_order_release);
-    kick();
+    _kick_pending = true;
 }
 
 template <typename BufferChain, typename Completion>
@@ -813,6 +839,7 @@ qp_vhost::qp_vhost(device *dev, const native_stack_options& opts)
     _vhost_fd.ioctl(VHOST_GET_FEATURES, vhost_supported_features);
     vhost_supported_features &= _dev->features();
     _vhost_fd.ioctl(VHOST_SET_FEATURES, vhost_supported_features);
+    _dev->set_negotiated_features(vhost_supported_features);
     if (vhost_supported_features & VIRTIO_NET_F_MRG_RXBUF) {
         _header_len = sizeof(net_hdr_mrg);
     } else {
@@ -0,0 +1,469 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+#ifdef SEASTAR_HAVE_XDP
+#include <linux/bpf.h>
+#include <linux/ethtool.h>
+#include <linux/if_xdp.h>
+#include <linux/sockios.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/net/xdp.hh>
+#include <seastar/net/native-stack.hh>
+#include <seastar/net/toeplitz.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/internal/poll.hh>
+#include <seastar/util/log.hh>
+#ifdef SEASTAR_HAVE_XDP
+#include "net/xdp_ring.hh"
+#endif
+#endif
+
+namespace seastar {
+
+namespace net {
+
+xdp_options::xdp_options(program_options::option_group* parent_group)
+#ifdef SEASTAR_HAVE_XDP
+    : program_options::option_group(parent_group, "AF_XDP net options")
+    , xdp_device(*this, "xdp-device", {},
+                "Network interface to use with AF_XDP")
+    , xdp_xskmap(*this, "xdp-xskmap",
+                "/sys/fs/bpf/xsks_map",
+                "Path of the pinned XSKMAP the XDP program redirects the packets with")
+    , xdp_ring_size(*this, "xdp-ring-size",
+                1024,
+                "AF_XDP ring size (must be power-of-two)")
+    , xdp_zero_copy(*this, "xdp-zero-copy",
+                "on",
+                "Use the zero-copy mode of the driver (on / off)")
+#else
+    : program_options::option_group(parent_group, "AF_XDP net options", program_options::unused{})
+    , xdp_device(*this, "xdp-device", program_options::unused{})
+    , xdp_xskmap(*this, "xdp-xskmap", program_options::unused{})
+    , xdp_ring_size(*this, "xdp-ring-size", program_options::unused{})
+    , xdp_zero_copy(*this, "xdp-zero-copy", program_options::unused{})
+#endif
+{
+}
+
+}
+
+#ifdef SEASTAR_HAVE_XDP
+
+using namespace net;
+
+namespace xdp {
+
+static logger xdp_log("xdp");
+
+// The UMEM is split into page sized frames, each holds one packet
+static constexpr uint32_t frame_size = 4096;
+// RX frames are filled past the headroom the kernel reserves for XDP
+static constexpr uint32_t rx_headroom = XDP_PACKET_HEADROOM;
+static constexpr uint32_t rx_batch = 64;
+// ETH_RSS_HASH_TOP of the kernel, not in the UAPI headers
+static constexpr uint8_t rss_hash_toeplitz = 1;
+
+static int bpf(int cmd, bpf_attr& attr) noexcept {
+    return ::syscall(__NR_bpf, cmd, &attr, sizeof(attr));
+}
+
+struct device_config {
+    std::string ifname;
+    unsigned ifindex;
+    std::string xskmap;
+    uint32_t ring_size;
+    bool zero_copy;
+};
+
+class device;
+
+class qp : public net::qp {
+    device* _dev;
+    uint16_t _qid;
+    uint32_t _ring_size;
+    file_desc _fd;
+    mmap_area _umem;
+    ring<uint64_t> _fill;
+    ring<uint64_t> _comp;
+    ring<xdp_desc> _rx;
+    ring<xdp_desc> _tx;
+    std::vector<uint64_t> _free_frames;
+    // Frames held by the received packets
+    uint32_t _lent_frames = 0;
+    std::optional<reactor::poller> _rx_poller;
+
+    void bind(const device_config& cfg);
+    void insert_into_xskmap(const device_config& cfg);
+    void recycle(uint64_t frame) noexcept {
+        _free_frames.push_back(frame);
+    }
+    void refill();
+    void reclaim_tx();
+    void kick_tx();
+    bool poll_rx_once();
+public:
+    qp(device* dev, uint16_t qid, const device_config& cfg);
+    virtual future<> send(packet p) override {
+        abort();
+    }
+    virtual uint32_t send(circular_buffer<packet>& pb) override;
+    virtual void rx_start() override;
+};
+
+class device : public net::device {
+    device_config _cfg;
+    ethernet_address _hw_address;
+    net::hw_features _hw_features;
+    uint16_t _num_queues;
+    std::vector<uint8_t> _rss_key;
+    std::vector<uint32_t> _redir_table;
+
+    void set_rss_table(file_desc& sock, ifreq& ifr);
+public:
+    explicit device(const xdp_options& opts);
+    virtual ethernet_address hw_address() override {
+        return _hw_address;
+    }
+    virtual net::hw_features hw_features() override {
+        return _hw_features;
+    }
+    virtual rss_key_type rss_key() const override {
+        if (_rss_key.empty()) {
+            return default_rsskey_40bytes;
+        }
+        return rss_key_type(_rss_key.data(), _rss_key.size());
+    }
+    virtual uint16_t hw_queues_count() override {
+        return _num_queues;
+    }
+    virtual unsigned hash2qid(uint32_t hash) override {
+        if (_redir_table.empty()) {
+            return hash % _num_queues;
+        }
+        return _redir_table[hash % _redir_table.size()] % _num_queues;
+    }
+    virtual std::unique_ptr<net::qp> init_local_queue(const program_options::option_group& opts, uint16_t qid) override {
+        return std::make_unique<qp>(this, qid, _cfg);
+    }
+};
+
+device::device(const xdp_options& opts) {
+    _cfg.ifname = opts.xdp_device.get_value();
+    _cfg.ifindex = ::if_nametoindex(_cfg.ifname.c_str());
+    throw_system_error_on(_cfg.ifindex == 0, "if_nametoindex");
+    _cfg.xskmap = opts.xdp_xskmap.get_value();
+    _cfg.ring_size = opts.xdp_ring_size.get_value();
+    if (_cfg.ring_size == 0 || (_cfg.ring_size & (_cfg.ring_size - 1))) {
+        throw std::invalid_argument("xdp-ring-size must be a power of two");
+    }
+    _cfg.zero_copy = opts.xdp_zero_copy.get_value() == "on";
+
+    auto sock = file_desc::socket(AF_INET, SOCK_DGRAM);
+    ifreq ifr = {};
+    std::strncpy(ifr.ifr_name, _cfg.ifname.c_str(), IFNAMSIZ - 1);
+    sock.ioctl(SIOCGIFHWADDR, ifr);
+    _hw_address = ethernet_address(reinterpret_cast<const uint8_t*>(ifr.ifr_hwaddr.sa_data));
+    sock.ioctl(SIOCGIFMTU, ifr);
+    // There are no offloads over AF_XDP and a packet has to fit a frame
+    _hw_features.mtu = std::min<uint32_t>(ifr.ifr_mtu, frame_size - rx_headroom - eth_hdr_len);
+
+    ethtool_channels channels = {};
+    channels.cmd = ETHTOOL_GCHANNELS;
+    ifr.ifr_data = reinterpret_cast<char*>(&channels);
+    unsigned nic_queues = 1;
+    try {
+        sock.ioctl(SIOCETHTOOL, ifr);
+        nic_queues = std::max({channels.combined_count, channels.rx_count, 1u});
+    } catch (std::system_error& e) {
+        xdp_log.warn("{}: can't get the number of queues, using one: {}", _cfg.ifname, e.what());
+    }
+    _num_queues = std::min<unsigned>(nic_queues, smp::count);
+    set_rss_table(sock, ifr);
+}
+
+// Spreads the NIC RSS over the queues the shards bind to, and keeps the key
+// and the table so that the connections the stack opens hash to the shard
+// that opens them
+void device::set_rss_table(file_desc& sock, ifreq& ifr) {
+    ethtool_rxfh head = {};
+    head.cmd = ETHTOOL_GRSSH;
+    ifr.ifr_data = reinterpret_cast<char*>(&head);
+    try {
+        sock.ioctl(SIOCETHTOOL, ifr);
+    } catch (std::system_error& e) {
+        xdp_log.warn("{}: can't get the RSS configuration: {}", _cfg.ifname, e.what());
+        return;
+    }
+    if (head.indir_size == 0) {
+        return;
+    }
+    auto words = (sizeof(ethtool_rxfh) + head.indir_size * sizeof(uint32_t) + head.key_size + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+    std::vector<uint32_t> buf(words);
+    auto rxfh = reinterpret_cast<ethtool_rxfh*>(buf.data());
+    *rxfh = head;
+    rxfh->cmd = ETHTOOL_GRSSH;
+    ifr.ifr_data = reinterpret_cast<char*>(rxfh);
+    sock.ioctl(SIOCETHTOOL, ifr);
+    if (rxfh->hfunc && !(rxfh->hfunc & rss_hash_toeplitz)) {
+        xdp_log.warn("{}: the NIC doesn't use the Toeplitz hash, connections will be forwarded between shards", _cfg.ifname);
+        return;
+    }
+
+    auto indir = rxfh->rss_config;
+    auto key = reinterpret_cast<uint8_t*>(rxfh->rss_config + rxfh->indir_size);
+    for (unsigned i = 0; i < rxfh->indir_size; i++) {
+        indir[i] = i % _num_queues;
+    }
+    rxfh->cmd = ETHTOOL_SRSSH;
+    rxfh->hfunc = 0;
+    unsigned key_size = rxfh->key_size;
+    // Keep the key the NIC has
+    rxfh->key_size = 0;
+    try {
+        sock.ioctl(SIOCETHTOOL, ifr);
+    } catch (std::system_error& e) {
+        xdp_log.warn("{}: can't set the RSS indirection table, the packets of the queues with no shard are lost: {}",
+                _cfg.ifname, e.what());
+        // Go on with the table the NIC has
+        rxfh->cmd = ETHTOOL_GRSSH;
+        rxfh->key_size = key_size;
+        sock.ioctl(SIOCETHTOOL, ifr);
+    }
+    _redir_table.assign(indir, indir + rxfh->indir_size);
+    _rss_key.assign(key, key + key_size);
+    _rss_table_bits = std::lround(std::log2(_redir_table.size()));
+}
+
+qp::qp(device* dev, uint16_t qid, const device_config& cfg)
+    : net::qp(true, "xdp", qid)
+    , _dev(dev)
+    , _qid(qid)
+    , _ring_size(cfg.ring_size)
+    , _fd(file_desc::socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC))
+    // Room for the fill and RX rings and for the TX ring
+    , _umem(mmap_anonymous(nullptr, size_t(4) * _ring_size * frame_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_POPULATE)) {
+    xdp_umem_reg reg = {};
+    reg.addr = reinterpret_cast<uintptr_t>(_umem.get());
+    reg.len = size_t(4) * _ring_size * frame_size;
+    reg.chunk_size = frame_size;
+    _fd.setsockopt(SOL_XDP, XDP_UMEM_REG, reg);
+    _fd.setsockopt(SOL_XDP, XDP_UMEM_FILL_RING, int(2 * _ring_size));
+    _fd.setsockopt(SOL_XDP, XDP_UMEM_COMPLETION_RING, int(_ring_size));
+    _fd.setsockopt(SOL_XDP, XDP_RX_RING, int(_ring_size));
+    _fd.setsockopt(SOL_XDP, XDP_TX_RING, int(_ring_size));
+
+    auto off = _fd.getsockopt<xdp_mmap_offsets>(SOL_XDP, XDP_MMAP_OFFSETS);
+    _fill = ring<uint64_t>(_fd, off.fr, 2 * _ring_size, XDP_UMEM_PGOFF_FILL_RING);
+    _comp = ring<uint64_t>(_fd, off.cr, _ring_size, XDP_UMEM_PGOFF_COMPLETION_RING);
+    _rx = ring<xdp_desc>(_fd, off.rx, _ring_size, XDP_PGOFF_RX_RING);
+    _tx = ring<xdp_desc>(_fd, off.tx, _ring_size, XDP_PGOFF_TX_RING);
+
+    _free_frames.reserve(4 * _ring_size);
+    for (uint64_t f = 4 * _ring_size; f-- > 0; ) {
+        _free_frames.push_back(f * frame_size);
+    }
+    refill();
+    bind(cfg);
+    insert_into_xskmap(cfg);
+}
+
+void qp::bind(const device_config& cfg) {
+    sockaddr_xdp sxdp = {};
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = cfg.ifindex;
+    sxdp.sxdp_queue_id = _qid;
+    sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP | (cfg.zero_copy ? XDP_ZEROCOPY : XDP_COPY);
+    auto r = ::bind(_fd.get(), reinterpret_cast<sockaddr*>(&sxdp), sizeof(sxdp));
+    if (r == -1 && cfg.zero_copy && errno == EOPNOTSUPP) {
+        xdp_log.warn("{}: queue {}: the driver has no zero-copy mode, copying the packets", cfg.ifname, _qid);
+        sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_COPY;
+        r = ::bind(_fd.get(), reinterpret_cast<sockaddr*>(&sxdp), sizeof(sxdp));
+    }
+    throw_system_error_on(r == -1, "bind");
+}
+
+void qp::insert_into_xskmap(const device_config& cfg) {
+    bpf_attr attr = {};
+    attr.pathname = reinterpret_cast<uintptr_t>(cfg.xskmap.c_str());
+    auto map_fd = bpf(BPF_OBJ_GET, attr);
+    throw_system_error_on(map_fd == -1, "BPF_OBJ_GET");
+    auto map = file_desc::from_fd(map_fd);
+
+    uint32_t key = _qid;
+    uint32_t value = _fd.get();
+    attr = {};
+    attr.map_fd = map.get();
+    attr.key = reinterpret_cast<uintptr_t>(&key);
+    attr.value = reinterpret_cast<uintptr_t>(&value);
+    attr.flags = BPF_ANY;
+    throw_system_error_on(bpf(BPF_MAP_UPDATE_ELEM, attr) == -1, "BPF_MAP_UPDATE_ELEM");
+}
+
+// Gives the free frames to the kernel to receive into, keeping a ring worth
+// of them for the TX
+void qp::refill() {
+    uint32_t spare = _free_frames.size() > _ring_size ? _free_frames.size() - _ring_size : 0;
+    auto n = _fill.reserve(spare);
+    auto idx = _fill.prod();
+    for (uint32_t i = 0; i < n; i++) {
+        _fill[idx + i] = _free_frames.back();
+        _free_frames.pop_back();
+    }
+    if (n) {
+        _fill.submit(n);
+    }
+}
+
+void qp::reclaim_tx() {
+    auto n = _comp.peek(_ring_size);
+    auto idx = _comp.cons();
+    for (uint32_t i = 0; i < n; i++) {
+        recycle(_comp[idx + i]);
+    }
+    if (n) {
+        _comp.release(n);
+    }
+}
+
+void qp::kick_tx() {
+    if (!_tx.needs_wakeup()) {
+        return;
+    }
+    auto r = ::sendto(_fd.get(), nullptr, 0, MSG_DONTWAIT, nullptr, 0);
+    // The kernel is busy with the ring already
+    if (r == -1 && errno != EAGAIN && errno != EBUSY && errno != ENOBUFS && errno != ENETDOWN) {
+        throw_system_error_on(true, "sendto");
+    }
+}
+
+uint32_t qp::send(circular_buffer<packet>& pb) {
+    reclaim_tx();
+    auto n = _tx.reserve(std::min<size_t>(pb.size(), _free_frames.size()));
+    auto idx = _tx.prod();
+    uint32_t queued = 0;
+    uint64_t nr_frags = 0, bytes = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        auto p = std::move(pb.front());
+        pb.pop_front();
+        // Can't happen with no TSO, the MTU keeps the packets in a frame
+        if (p.len() > frame_size) {
+            continue;
+        }
+        auto frame = _free_frames.back();
+        _free_frames.pop_back();
+        // The stack's buffers aren't in the UMEM, so they are copied over
+        auto dst = _umem.get() + frame;
+        for (auto& f : p.fragments()) {
+            dst = std::copy_n(f.base, f.size, dst);
+        }
+        auto& desc = _tx[idx + queued++];
+        desc.addr = frame;
+        desc.len = p.len();
+        desc.options = 0;
+        nr_frags += p.nr_frags();
+        bytes += p.len();
+    }
+    if (queued) {
+        _tx.submit(queued);
+        _stats.tx.good.update_copy_stats(nr_frags, bytes);
+        _stats.tx.good.update_frags_stats(nr_frags, bytes);
+    }
+    if (n) {
+        kick_tx();
+    }
+    return n;
+}
+
+bool qp::poll_rx_once() {
+    auto n = _rx.peek(rx_batch);
+    auto idx = _rx.cons();
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        auto& desc = _rx[idx + i];
+        auto frame = desc.addr - desc.addr % frame_size;
+        auto data = _umem.get() + desc.addr;
+        bytes += desc.len;
+        // The frames are lent to the packets while enough of them are left
+        // to receive into, the rest is copied and the frame is reused at
+        // once
+        if (_lent_frames < _ring_size) {
+            _lent_frames++;
+            _dev->l2receive(packet(fragment{data, desc.len}, make_deleter([this, frame] {
+                _lent_frames--;
+                recycle(frame);
+            })));
+        } else {
+            _stats.rx.good.update_copy_stats(1, desc.len);
+            _dev->l2receive(packet(data, desc.len));
+            recycle(frame);
+        }
+    }
+    if (n) {
+        _rx.release(n);
+        _stats.rx.good.update_pkts_bunch(n);
+        _stats.rx.good.update_frags_stats(n, bytes);
+    }
+    refill();
+    if (!n && _fill.needs_wakeup()) {
+        ::recvfrom(_fd.get(), nullptr, 0, MSG_DONTWAIT, nullptr, nullptr);
+    }
+    return n;
+}
+
+void qp::rx_start() {
+    _rx_poller = reactor::poller::simple([this] { return poll_rx_once(); }, internal::loop_phase::network);
+}
+
+}
+
+std::unique_ptr<net::device> create_xdp_net_device(const net::xdp_options& opts) {
+    return std::make_unique<xdp::device>(opts);
+}
+
+#endif // SEASTAR_HAVE_XDP
+
+}
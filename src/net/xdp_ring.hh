@@ -0,0 +1,103 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/posix.hh>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <linux/if_xdp.h>
+#include <sys/mman.h>
+
+namespace seastar::xdp {
+
+// One of the single producer single consumer rings shared with the kernel,
+// the indexes are free running and wrap around the power-of-two size
+template <typename Desc>
+class ring {
+    mmap_area _map;
+    uint32_t* _producer = nullptr;
+    uint32_t* _consumer = nullptr;
+    uint32_t* _flags = nullptr;
+    Desc* _descs = nullptr;
+    uint32_t _size = 0;
+    uint32_t _cached_prod = 0;
+    uint32_t _cached_cons = 0;
+
+    static uint32_t load(uint32_t* p) noexcept {
+        return std::atomic_ref<uint32_t>(*p).load(std::memory_order_acquire);
+    }
+    static void store(uint32_t* p, uint32_t v) noexcept {
+        std::atomic_ref<uint32_t>(*p).store(v, std::memory_order_release);
+    }
+public:
+    ring() = default;
+    ring(file_desc& fd, const xdp_ring_offset& off, uint32_t size, off_t pgoff)
+        : ring(fd.map(off.desc + size * sizeof(Desc), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pgoff), off, size) {
+    }
+    // Over memory laid out as the kernel lays out the ring mapping
+    ring(mmap_area map, const xdp_ring_offset& off, uint32_t size)
+        : _map(std::move(map))
+        , _producer(reinterpret_cast<uint32_t*>(_map.get() + off.producer))
+        , _consumer(reinterpret_cast<uint32_t*>(_map.get() + off.consumer))
+        , _flags(reinterpret_cast<uint32_t*>(_map.get() + off.flags))
+        , _descs(reinterpret_cast<Desc*>(_map.get() + off.desc))
+        , _size(size)
+        , _cached_prod(load(_producer))
+        , _cached_cons(load(_consumer)) {
+    }
+    Desc& operator[](uint32_t idx) noexcept {
+        return _descs[idx & (_size - 1)];
+    }
+    bool needs_wakeup() const noexcept {
+        return std::atomic_ref<uint32_t>(*_flags).load(std::memory_order_relaxed) & XDP_RING_NEED_WAKEUP;
+    }
+
+    // Producer side, the fill and TX rings
+    uint32_t reserve(uint32_t n) noexcept {
+        if (_size - (_cached_prod - _cached_cons) < n) {
+            _cached_cons = load(_consumer);
+        }
+        return std::min(n, _size - (_cached_prod - _cached_cons));
+    }
+    uint32_t prod() const noexcept { return _cached_prod; }
+    void submit(uint32_t n) noexcept {
+        _cached_prod += n;
+        store(_producer, _cached_prod);
+    }
+
+    // Consumer side, the RX and completion rings
+    uint32_t peek(uint32_t n) noexcept {
+        if (_cached_prod - _cached_cons < n) {
+            _cached_prod = load(_producer);
+        }
+        return std::min(n, _cached_prod - _cached_cons);
+    }
+    uint32_t cons() const noexcept { return _cached_cons; }
+    void release(uint32_t n) noexcept {
+        _cached_cons += n;
+        store(_consumer, _cached_cons);
+    }
+};
+
+}
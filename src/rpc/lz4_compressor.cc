@@ -40,6 +40,21 @@ std::unique_ptr<rpc::compressor> lz4_compressor::factory::negotiate(sstring feat
     return feature == supported() ? std::make_unique<lz4_compressor>() : nullptr;
 }
 
+bool lz4_compressor::use_dictionary(lw_shared_ptr<const compression_dictionary> dict) {
+    _dict = std::move(dict);
+    return true;
+}
+
+namespace {
+
+struct compression_stream_deleter {
+    void operator()(LZ4_stream_t* stream) const noexcept {
+        LZ4_freeStream(stream);
+    }
+};
+
+}
+
 // Reusable contiguous buffers needed for LZ4 compression and decompression functions.
 class reusable_buffer {
     static constexpr size_t chunk_size = 128 * 1024;
@@ -134,7 +149,15 @@ snd_buf lz4_compressor::compress(size_t head_space, snd_buf data) {
         auto src_size = data.size;
         auto src = reusable_buffer_decompressed_data.prepare(data.bufs, data.size);
 
-        auto size = LZ4_compress_default(src, dst + head_space, src_size, LZ4_compressBound(src_size));
+        int size;
+        if (_dict) {
+            // LZ4_loadDict() resets the stream, so messages remain independent
+            static thread_local auto stream = std::unique_ptr<LZ4_stream_t, compression_stream_deleter>(LZ4_createStream());
+            LZ4_loadDict(stream.get(), _dict->data.data(), _dict->data.size());
+            size = LZ4_compress_fast_continue(stream.get(), src, dst + head_space, src_size, LZ4_compressBound(src_size), 1);
+        } else {
+            size = LZ4_compress_default(src, dst + head_space, src_size, LZ4_compressBound(src_size));
+        }
         if (size == 0) {
             throw std::runtime_error("RPC frame LZ4 compression failure");
         }
@@ -160,7 +183,10 @@ rcv_buf lz4_compressor::decompress(rcv_buf data) {
         src_size -= sizeof(uint32_t);
 
         auto dst = reusable_buffer_compressed_data.with_reserved<rcv_buf>(dst_size, [&] (char* dst) {
-            if (LZ4_decompress_safe(src, dst, src_size, dst_size) < 0) {
+            auto ret = _dict
+                    ? LZ4_decompress_safe_usingDict(src, dst, src_size, dst_size, _dict->data.data(), _dict->data.size())
+                    : LZ4_decompress_safe(src, dst, src_size, dst_size);
+            if (ret < 0) {
                 throw std::runtime_error("RPC frame LZ4 decompression failure");
             }
             return dst_size;
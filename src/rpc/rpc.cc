@@ -5,6 +5,7 @@
 #include <seastar/core/print.hh>
 #include <seastar/core/future-util.hh>
 #include <seastar/core/metrics.hh>
+#include <seastar/core/internal/estimated_histogram.hh>
 #include <seastar/util/assert.hh>
 #include <boost/range/adaptor/map.hpp>
 #include <boost/range/adaptor/transformed.hpp>
@@ -72,6 +73,75 @@ namespace rpc {
       }
   }
 
+  void compression_dictionary_registry::add(uint32_t id, sstring data) {
+      if (!id) {
+          throw std::invalid_argument("compression dictionary id must not be zero");
+      }
+      _dictionaries[id] = make_lw_shared<const compression_dictionary>(id, std::move(data));
+  }
+
+  void compression_dictionary_registry::set_current(uint32_t id) {
+      if (id && !_dictionaries.contains(id)) {
+          throw std::invalid_argument(format("unknown compression dictionary {}", id));
+      }
+      _current = id;
+  }
+
+  lw_shared_ptr<const compression_dictionary> compression_dictionary_registry::current() const {
+      return find(_current);
+  }
+
+  lw_shared_ptr<const compression_dictionary> compression_dictionary_registry::find(uint32_t id) const {
+      auto it = _dictionaries.find(id);
+      return it == _dictionaries.end() ? nullptr : it->second;
+  }
+
+  void compression_dictionary_registry::remove(uint32_t id) {
+      _dictionaries.erase(id);
+      if (_current == id) {
+          _current = 0;
+      }
+  }
+
+  std::vector<uint32_t> compression_dictionary_registry::ids() const {
+      std::vector<uint32_t> ret;
+      ret.reserve(_dictionaries.size());
+      for (auto& d : _dictionaries) {
+          ret.push_back(d.first);
+      }
+      return ret;
+  }
+
+  // COMPRESSION_DICTIONARY feature data:
+  // - sent by a client: le32 ids of the dictionaries it has
+  // - returned by a server: le32 id of the dictionary to use, followed by
+  //   its content if the client didn't list it
+  static sstring serialize_dictionary_ids(const std::vector<uint32_t>& ids) {
+      sstring ret = uninitialized_string(ids.size() * sizeof(uint32_t));
+      auto p = ret.data();
+      for (auto id : ids) {
+          write_le<uint32_t>(p, id);
+          p += sizeof(uint32_t);
+      }
+      return ret;
+  }
+
+  static std::vector<uint32_t> deserialize_dictionary_ids(const sstring& s) {
+      std::vector<uint32_t> ret;
+      for (size_t off = 0; off + sizeof(uint32_t) <= s.size(); off += sizeof(uint32_t)) {
+          ret.push_back(read_le<uint32_t>(s.data() + off));
+      }
+      return ret;
+  }
+
+  // STREAM_FLOW_CONTROL feature data: le32 size of the receive window of
+  // the side that sends it
+  static sstring serialize_stream_window() {
+      sstring ret = uninitialized_string(sizeof(uint32_t));
+      write_le<uint32_t>(ret.data(), max_stream_buffers_memory);
+      return ret;
+  }
+
   // Make a copy of a remote buffer. No data is actually copied, only pointers and
   // a deleter of a new buffer takes care of deleting the original buffer
   template<typename T> // T is either snd_buf or rcv_buf
@@ -194,6 +264,7 @@ namespace rpc {
       if (_negotiated) {
           _negotiated->set_exception(ex);
       }
+      _stream_credits.broken(ex);
       return when_all(std::move(_outgoing_queue_ready), std::move(_sink_closed_future)).then([this] (std::tuple<future<>, future<bool>> res){
           // _outgoing_queue_ready might be exceptional if queue drain or
           // _negotiated abortion set it such
@@ -499,11 +570,13 @@ namespace rpc {
       }
   }
 
+  // The frame of a stream keeps the length it was sent with, which tells the
+  // end of stream, credit and batch frames apart
   struct stream_frame {
       using opt_buf_type = std::optional<rcv_buf>;
       using return_type = opt_buf_type;
       struct header_type {
-          bool eos;
+          uint32_t length;
       };
       static size_t header_size() {
           return 4;
@@ -515,17 +588,71 @@ namespace rpc {
           return std::nullopt;
       }
       static std::pair<uint32_t, header_type> decode_header(const char* ptr) {
-          auto size = read_le<uint32_t>(ptr);
-          return size != -1U ? std::make_pair(size, header_type{false}) : std::make_pair(0U, header_type{true});
+          auto length = read_le<uint32_t>(ptr);
+          if (length == -1U) {
+              return std::make_pair(0U, header_type{length});
+          } else if (length == stream_credit_frame) {
+              return std::make_pair(4U, header_type{length});
+          }
+          return std::make_pair(length & ~stream_batch_flag, header_type{length});
       }
       static auto make_value(const header_type& t, rcv_buf data) {
-          if (t.eos) {
-              data.size = -1U;
-          }
+          data.size = t.length;
           return data;
       }
   };
 
+  // Reads a rcv_buf front to back, sharing its fragments
+  class rcv_buf_cursor {
+      std::vector<temporary_buffer<char>> _frags;
+      size_t _next = 0;
+  public:
+      explicit rcv_buf_cursor(rcv_buf&& b) {
+          if (auto* one = std::get_if<temporary_buffer<char>>(&b.bufs)) {
+              _frags.push_back(std::move(*one));
+          } else {
+              _frags = std::move(std::get<std::vector<temporary_buffer<char>>>(b.bufs));
+          }
+      }
+      bool empty() noexcept {
+          while (_next != _frags.size() && _frags[_next].empty()) {
+              ++_next;
+          }
+          return _next == _frags.size();
+      }
+      // std::nullopt if fewer bytes are left
+      std::optional<rcv_buf> read(uint32_t size) {
+          std::vector<temporary_buffer<char>> parts;
+          for (auto left = size; left; ) {
+              if (empty()) {
+                  return std::nullopt;
+              }
+              auto& f = _frags[_next];
+              auto n = std::min<size_t>(left, f.size());
+              parts.push_back(f.share(0, n));
+              f.trim_front(n);
+              left -= n;
+          }
+          if (parts.size() == 1) {
+              return rcv_buf(std::move(parts.front()));
+          }
+          return rcv_buf(std::move(parts), size);
+      }
+      std::optional<uint32_t> read_le32() {
+          auto b = read(4);
+          if (!b) {
+              return std::nullopt;
+          }
+          char raw[4];
+          auto p = raw;
+          rcv_buf_cursor in(std::move(*b));
+          for (auto& f : in._frags) {
+              p = std::copy_n(f.get(), f.size(), p);
+          }
+          return read_le<uint32_t>(raw);
+      }
+  };
+
   future<std::optional<rcv_buf>>
   connection::read_stream_frame_compressed(input_stream<char>& in) {
       return read_frame_compressed<stream_frame>(peer_address(), _compressor, in);
@@ -553,26 +680,102 @@ namespace rpc {
       });
   }
 
+  future<> connection::stream_process_batch(rcv_buf&& batch) {
+      // the credits of the frame are granted back as its elements are consumed
+      auto size = std::min(size_t(batch.size), max_stream_buffers_memory);
+      std::vector<rcv_buf> elements;
+      rcv_buf_cursor in(std::move(batch));
+      while (!in.empty()) {
+          // elements may be empty, as those of a sink<> are
+          auto length = in.read_le32();
+          auto element = length.has_value() && *length < stream_batch_flag ? in.read(*length) : std::nullopt;
+          if (!element) {
+              _logger(peer_address(), "malformed batch of stream elements");
+              _error = true;
+              return make_ready_future<>();
+          }
+          elements.push_back(std::move(*element));
+      }
+      return get_units(_stream_sem, size).then([this, elements = std::move(elements)] (semaphore_units<>&& su) mutable {
+          for (auto& e : elements) {
+              e.su = &e == &elements.back() ? std::move(su) : su.split(std::min(su.count(), size_t(e.size) + 4));
+          }
+          return do_with(std::move(elements), [this] (std::vector<rcv_buf>& elements) {
+              return do_for_each(elements, [this] (rcv_buf& e) {
+                  return _stream_queue.push_eventually(std::move(e));
+              });
+          });
+      });
+  }
+
   future<> connection::handle_stream_frame() {
       return read_stream_frame_compressed(_read_buf).then([this] (std::optional<rcv_buf> data) {
           if (!data) {
               _error = true;
               return make_ready_future<>();
           }
+          if (data->size == stream_credit_frame) {
+              _stream_credits.signal(*rcv_buf_cursor(std::move(*data)).read_le32());
+              return make_ready_future<>();
+          }
+          if (data->size != -1U && (data->size & stream_batch_flag)) {
+              data->size &= ~stream_batch_flag;
+              return stream_process_batch(std::move(*data));
+          }
           return stream_process_incoming(std::move(*data));
       });
   }
 
+  void connection::negotiate_stream_flow_control(const sstring& window) {
+      if (window.size() != sizeof(uint32_t) || !read_le<uint32_t>(window.data())) {
+          throw std::runtime_error("RPC peer sent a malformed stream window");
+      }
+      _stream_flow_control = true;
+      _stream_window = read_le<uint32_t>(window.data());
+      _stream_credits.signal(_stream_window);
+  }
+
+  future<> connection::send_stream(snd_buf frame) {
+      if (!_stream_flow_control) {
+          return send(std::move(frame));
+      }
+      // Frames wait for their credits one after another, and are queued for
+      // sending before the next one may get its own, to keep their order
+      auto credits = std::min(size_t(frame.size) - 4, _stream_window);
+      promise<> charged;
+      auto prev = std::exchange(_stream_send_ready, charged.get_future());
+      return prev.then([this, credits] {
+          return _stream_credits.wait(credits);
+      }).then_wrapped([this, frame = std::move(frame), charged = std::move(charged)] (future<> f) mutable {
+          auto ret = f.failed() ? std::move(f) : send(std::move(frame));
+          charged.set_value();
+          return ret;
+      });
+  }
+
+  void connection::grant_stream_credits(size_t credits) {
+      temporary_buffer<char> frame(8);
+      write_le<uint32_t>(frame.get_write(), stream_credit_frame);
+      write_le<uint32_t>(frame.get_write() + 4, credits);
+      // A failure breaks the stream, which its sink and source report
+      (void)send(snd_buf(std::move(frame))).handle_exception([] (std::exception_ptr) {});
+  }
+
   future<> connection::stream_receive(circular_buffer<foreign_ptr<std::unique_ptr<rcv_buf>>>& bufs) {
       return _stream_queue.not_empty().then([this, &bufs] {
-          bool eof = !_stream_queue.consume([&bufs] (rcv_buf&& b) {
+          size_t credits = 0;
+          bool eof = !_stream_queue.consume([&bufs, &credits] (rcv_buf&& b) {
               if (b.size == -1U) { // max fragment length marks an end of a stream
                   return false;
               } else {
+                  credits += b.su ? b.su->count() : 0;
                   bufs.push_back(make_foreign(std::make_unique<rcv_buf>(std::move(b))));
                   return true;
               }
           });
+          if (_stream_flow_control && credits) {
+              grant_stream_credits(credits);
+          }
           if (eof && !bufs.empty()) {
               SEASTAR_ASSERT(_stream_queue.empty());
               _stream_queue.push(rcv_buf(-1U)); // push eof marker back for next read to notice it
@@ -651,8 +854,36 @@ namespace rpc {
   };
 
   future<> client::request(uint64_t type, int64_t msg_id, snd_buf buf, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel) {
+      if (_trace_context_negotiated) {
+          if (auto ctx = tracing::current_context()) {
+              send_trace_context(msg_id, *ctx);
+          }
+      }
       request_frame_with_timeout::encode_header(type, msg_id, buf);
-      return send(std::move(buf), timeout, cancel);
+      if (buf.size < _options.large_request_size) {
+          return send(std::move(buf), timeout, cancel);
+      }
+      _large_requests++;
+      return send(std::move(buf), timeout, cancel).finally([this] {
+          _large_requests--;
+      });
+  }
+
+  client& client::pick_connection(size_t request_size) noexcept {
+      if (_stripes.empty()) {
+          return *this;
+      }
+      auto load = [] (const client& c) {
+          return std::make_pair(c._large_requests, c.outgoing_queue_length() + c.incoming_queue_length());
+      };
+      // Large requests stay off the first connection while others are alive
+      client* best = request_size < _options.large_request_size ? this : nullptr;
+      for (auto& c : _stripes) {
+          if (!c->error() && (!best || load(*c) < load(*best))) {
+              best = c.get();
+          }
+      }
+      return best ? *best : *this;
   }
 
   void
@@ -676,10 +907,34 @@ namespace rpc {
           case protocol_features::HANDLER_DURATION:
               _handler_duration_negotiated = true;
               break;
+          case protocol_features::CANCEL:
+              _cancel_negotiated = true;
+              break;
+          case protocol_features::TRACE_CONTEXT:
+              _trace_context_negotiated = true;
+              break;
           case protocol_features::CONNECTION_ID: {
               _id = deserialize_connection_id(e.second);
               break;
           }
+          case protocol_features::STREAM_FLOW_CONTROL:
+              negotiate_stream_flow_control(e.second);
+              break;
+          case protocol_features::COMPRESSION_DICTIONARY: {
+              if (e.second.size() < sizeof(uint32_t) || !_compressor || !_options.compression_dictionaries) {
+                  throw std::runtime_error("RPC server responded with an unexpected compression dictionary");
+              }
+              auto& dictionaries = *_options.compression_dictionaries;
+              auto id = read_le<uint32_t>(e.second.data());
+              if (e.second.size() > sizeof(uint32_t)) {
+                  dictionaries.add(id, e.second.substr(sizeof(uint32_t)));
+              }
+              auto dict = dictionaries.find(id);
+              if (!dict || !_compressor->use_dictionary(std::move(dict))) {
+                  throw std::runtime_error(format("RPC server responded with compression dictionary {} - unsupported", id));
+              }
+              break;
+          }
           default:
               // nothing to do
               ;
@@ -780,28 +1035,136 @@ namespace rpc {
       stats res = _stats;
       res.wait_reply = incoming_queue_length();
       res.pending = outgoing_queue_length();
+      for (auto& c : _stripes) {
+          auto st = c->get_stats();
+          res.replied += st.replied;
+          res.pending += st.pending;
+          res.exception_received += st.exception_received;
+          res.sent_messages += st.sent_messages;
+          res.wait_reply += st.wait_reply;
+          res.timeout += st.timeout;
+          res.delay_samples += st.delay_samples;
+          res.delay_total += st.delay_total;
+      }
       return res;
   }
 
+  id_type client::reserve_reply_slot() {
+      uint32_t n = _free_reply_slot;
+      if (n) {
+          _free_reply_slot = _reply_slots[n - 1].next_free;
+      } else {
+          if (_reply_slots.size() == slot_mask) {
+              throw std::runtime_error("too many rpc calls waiting for a reply");
+          }
+          _reply_slots.emplace_back();
+          n = _reply_slots.size();
+      }
+      auto& slot = _reply_slots[n - 1];
+      slot.generation = (slot.generation + 1) & generation_mask;
+      slot.id = (slot.generation << slot_bits) | n;
+      _waiting_replies++;
+      return slot.id;
+  }
+
+  std::unique_ptr<client::reply_handler_base> client::take_reply_handler(id_type id) noexcept {
+      auto n = id & slot_mask;
+      if (n == 0 || size_t(n) > _reply_slots.size() || _reply_slots[n - 1].id != id) {
+          return nullptr;
+      }
+      auto& slot = _reply_slots[n - 1];
+      if (slot.timed) {
+          _reply_timeouts.remove(slot);
+          slot.timed = false;
+      }
+      slot.id = 0;
+      slot.next_free = _free_reply_slot;
+      _free_reply_slot = n;
+      _waiting_replies--;
+      return std::move(slot.handler);
+  }
+
+  void client::clear_reply_slots() noexcept {
+      for (auto& slot : _reply_slots) {
+          if (slot.id) {
+              take_reply_handler(slot.id);
+          }
+      }
+  }
+
+  client::~client() {
+      clear_reply_slots();
+  }
+
   void client::wait_for_reply(id_type id, std::unique_ptr<reply_handler_base>&& h, std::optional<rpc_clock_type::time_point> timeout, cancellable* cancel) {
+      auto& slot = _reply_slots[(id & slot_mask) - 1];
       if (timeout) {
-          h->t.set_callback(std::bind(std::mem_fn(&client::wait_timed_out), this, id));
-          h->t.arm(timeout.value());
+          slot.deadline = *timeout;
+          slot.timed = true;
+          if (_reply_timeouts.insert(slot)) {
+              _reply_timer.rearm(*timeout);
+          }
       }
       if (cancel) {
           cancel->cancel_wait = [this, id] {
-              _outstanding[id]->cancel();
-              _outstanding.erase(id);
+              take_reply_handler(id)->cancel();
+              send_cancel(id);
           };
           h->pcancel = cancel;
           cancel->wait_back_pointer = &h->pcancel;
       }
-      _outstanding.emplace(id, std::move(h));
+      slot.handler = std::move(h);
+  }
+
+  void client::expire_replies() {
+      auto expired = _reply_timeouts.expire(rpc_clock_type::now());
+      while (!expired.empty()) {
+          auto& slot = expired.front();
+          expired.pop_front();
+          slot.timed = false;
+          auto id = slot.id;
+          _stats.timeout++;
+          take_reply_handler(id)->timeout();
+          send_cancel(id);
+      }
+      if (!_reply_timeouts.empty()) {
+          _reply_timer.arm(_reply_timeouts.get_next_timeout());
+      }
+  }
+
+  // The cancel frame is a request frame of the cancel_verb, with the message
+  // ID of the request to cancel and no payload. No reply is sent to it.
+  void client::send_cancel(id_type id) {
+      if (!_cancel_negotiated || _error) {
+          return;
+      }
+      try {
+          snd_buf buf(request_frame_with_timeout::raw_header_size);
+          request_frame_with_timeout::encode_header(cancel_verb, id, buf);
+          (void)send(std::move(buf)).handle_exception([] (std::exception_ptr) {
+              // the connection is going away, and the request with it
+          });
+      } catch (...) {
+          // the server runs the handler to completion, no harm
+      }
   }
-  void client::wait_timed_out(id_type id) {
-      _stats.timeout++;
-      _outstanding[id]->timeout();
-      _outstanding.erase(id);
+
+  // The trace context frame is a request frame of the trace_context_verb,
+  // with the message ID of the request it precedes and the context as
+  // payload, see tracing::trace_context::write(). No reply is sent to it.
+  // Frames are sent in order, so that the server gets the context right
+  // before the request, unless the request times out while queued.
+  void client::send_trace_context(id_type id, const tracing::trace_context& ctx) {
+      try {
+          snd_buf buf(request_frame_with_timeout::raw_header_size + tracing::trace_context::serialized_size);
+          ctx.write(buf.front().get_write() + request_frame_with_timeout::raw_header_size);
+          request_frame_with_timeout::encode_header(trace_context_verb, id, buf);
+          (void)send(std::move(buf)).handle_exception([] (std::exception_ptr) {
+              // the request fails the same way
+          });
+      } catch (...) {
+          // the request is handled outside of the trace
+      }
   }
 
   future<> client::stop() noexcept {
@@ -811,7 +1174,14 @@ namespace rpc {
       } catch(...) {
           log_exception(*this, log_level::error, "fail to shutdown connection while stopping", std::current_exception());
       }
-      return _stopped.get_future();
+      if (_stripes.empty()) {
+          return _stopped.get_future();
+      }
+      return parallel_for_each(_stripes, [] (std::unique_ptr<client>& c) {
+          return c->stop();
+      }).then([this] {
+          return _stopped.get_future();
+      });
   }
 
   void client::abort_all_streams() {
@@ -853,13 +1223,28 @@ namespace rpc {
   }
 
   struct client::metrics::domain {
+      sstring name;
       metrics::domain_list_t list;
       stats dead;
+      std::unordered_map<uint64_t, seastar::metrics::internal::time_estimated_histogram> round_trip;
       seastar::metrics::metric_groups metric_groups;
 
       static thread_local std::unordered_map<sstring, domain> all;
       static domain& find_or_create(sstring name);
 
+      seastar::metrics::internal::time_estimated_histogram& round_trip_for(uint64_t verb) {
+          auto [it, inserted] = round_trip.try_emplace(verb);
+          if (inserted) {
+              namespace sm = seastar::metrics;
+              metric_groups.add_group("rpc_client", {
+                    sm::make_histogram("round_trip_latency", [&h = it->second] { return h.to_metrics_histogram(); },
+                            sm::description("Latency of the requests as observed by the clients"),
+                            { sm::label("domain")(name), sm::label("verb")(verb) }).set_skip_when_empty(),
+              });
+          }
+          return it->second;
+      }
+
       stats::counter_type count_all(stats::counter_type stats::* field) noexcept {
           stats::counter_type res = dead.*field;
           for (const auto& m : list) {
@@ -877,6 +1262,7 @@ namespace rpc {
       }
 
       domain(sstring name)
+          : name(name)
       {
           namespace sm = seastar::metrics;
           auto domain_l = sm::label("domain")(name);
@@ -923,6 +1309,10 @@ namespace rpc {
       _domain.list.push_back(*this);
   }
 
+  void client::metrics::account_round_trip(uint64_t verb, rpc_clock_type::duration latency) {
+      _domain.round_trip_for(verb).add(latency);
+  }
+
   client::metrics::~metrics() {
       _domain.dead.replied += _c._stats.replied;
       _domain.dead.exception_received += _c._stats.exception_received;
@@ -936,6 +1326,15 @@ namespace rpc {
   : rpc::connection(l, s), _socket(std::move(socket)), _server_addr(addr), _local_addr(local), _options(ops), _metrics(*this)
   {
        _socket.set_reuseaddr(ops.reuseaddr);
+      if (ops.connections > 1 && !ops.stream_parent) {
+          client_options stripe_options = ops;
+          stripe_options.connections = 1;
+          _stripes.reserve(ops.connections - 1);
+          for (unsigned i = 1; i < ops.connections; i++) {
+              auto sock = ops.socket_factory ? ops.socket_factory() : make_socket();
+              _stripes.push_back(std::make_unique<client>(l, s, stripe_options, std::move(sock), addr, local));
+          }
+      }
       // Run client in the background.
       // Communicate result via _stopped.
       // The caller has to call client::stop() to synchronize.
@@ -950,6 +1349,9 @@ namespace rpc {
           feature_map features;
           if (_options.compressor_factory) {
               features[protocol_features::COMPRESS] = _options.compressor_factory->supported();
+              if (_options.compression_dictionaries) {
+                  features[protocol_features::COMPRESSION_DICTIONARY] = serialize_dictionary_ids(_options.compression_dictionaries->ids());
+              }
           }
           if (_options.send_timeout_data) {
               features[protocol_features::TIMEOUT] = "";
@@ -957,8 +1359,15 @@ namespace rpc {
           if (_options.send_handler_duration) {
               features[protocol_features::HANDLER_DURATION] = "";
           }
+          if (_options.send_cancellation) {
+              features[protocol_features::CANCEL] = "";
+          }
+          if (_options.send_trace_context) {
+              features[protocol_features::TRACE_CONTEXT] = "";
+          }
           if (_options.stream_parent) {
               features[protocol_features::STREAM_PARENT] = serialize_connection_id(_options.stream_parent);
+              features[protocol_features::STREAM_FLOW_CONTROL] = serialize_stream_window();
           }
           if (!_options.isolation_cookie.empty()) {
               features[protocol_features::ISOLATION] = _options.isolation_cookie;
@@ -974,14 +1383,13 @@ namespace rpc {
                   return read_response_frame_compressed(_read_buf).then([this] (response_frame::return_type msg_id_and_data) {
                       auto& msg_id = std::get<0>(msg_id_and_data);
                       auto& data = std::get<2>(msg_id_and_data);
-                      auto it = _outstanding.find(std::abs(msg_id));
+                      std::unique_ptr<reply_handler_base> handler;
                       if (!data) {
                           _error = true;
-                      } else if (it != _outstanding.end()) {
-                          auto handler = std::move(it->second);
+                      } else if ((handler = take_reply_handler(std::abs(msg_id)))) {
                           auto ht = std::get<1>(msg_id_and_data);
-                          _outstanding.erase(it);
                           (*handler)(*this, msg_id, std::move(data.value()));
+                          _metrics.account_round_trip(handler->verb, rpc_clock_type::now() - handler->start);
                           if (ht) {
                               _stats.delay_samples++;
                               _stats.delay_total += (rpc_clock_type::now() - handler->start) - std::chrono::microseconds(*ht);
@@ -998,7 +1406,7 @@ namespace rpc {
                               log_exception(*this, log_level::info, "ignoring error response", std::current_exception());
                           }
                       } else {
-                          // we get a reply for a message id not in _outstanding
+                          // we get a reply for a message id no call waits for
                           // this can happened if the message id is timed out already
                           get_logger()(peer_address(), log_level::debug, "got a reply for an expired message id");
                       }
@@ -1029,7 +1437,7 @@ namespace rpc {
           _error = true;
           return stop_send_loop(ep).then_wrapped([this] (future<> f) {
               f.ignore_ready_future();
-              _outstanding.clear();
+              clear_reply_slots();
               if (is_stream()) {
                   deregister_this_stream();
               } else {
@@ -1074,6 +1482,21 @@ namespace rpc {
               }
           }
           break;
+          case protocol_features::COMPRESSION_DICTIONARY: {
+              // COMPRESS is ordered before, so the compressor is known
+              auto dictionaries = get_server()._options.compression_dictionaries;
+              auto dict = dictionaries ? dictionaries->current() : nullptr;
+              if (dict && _compressor && _compressor->use_dictionary(dict)) {
+                  auto known = deserialize_dictionary_ids(e.second);
+                  sstring reply = uninitialized_string(sizeof(uint32_t));
+                  write_le<uint32_t>(reply.data(), dict->id);
+                  if (std::find(known.begin(), known.end(), dict->id) == known.end()) {
+                      reply += dict->data;
+                  }
+                  ret[protocol_features::COMPRESSION_DICTIONARY] = std::move(reply);
+              }
+          }
+          break;
           case protocol_features::TIMEOUT:
               _timeout_negotiated = true;
               ret[protocol_features::TIMEOUT] = "";
@@ -1082,6 +1505,14 @@ namespace rpc {
               _handler_duration_negotiated = true;
               ret[protocol_features::HANDLER_DURATION] = "";
               break;
+          case protocol_features::CANCEL:
+              _cancel_negotiated = true;
+              ret[protocol_features::CANCEL] = "";
+              break;
+          case protocol_features::TRACE_CONTEXT:
+              _trace_context_negotiated = true;
+              ret[protocol_features::TRACE_CONTEXT] = "";
+              break;
           case protocol_features::STREAM_PARENT: {
               if (!get_server()._options.streaming_domain) {
                   f = f.then([] {
@@ -1113,6 +1544,13 @@ namespace rpc {
               }
               break;
           }
+          case protocol_features::STREAM_FLOW_CONTROL:
+              // STREAM_PARENT is ordered before, so a stream is known
+              if (_is_stream) {
+                  negotiate_stream_flow_control(e.second);
+                  ret[protocol_features::STREAM_FLOW_CONTROL] = serialize_stream_window();
+              }
+              break;
           case protocol_features::ISOLATION: {
               auto&& isolation_cookie = e.second;
               struct isolation_function_visitor {
@@ -1224,10 +1662,36 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
                       if (expire && *expire) {
                           timeout = relative_timeout_to_absolute(std::chrono::milliseconds(*expire));
                       }
+                      if (_cancel_negotiated && type == cancel_verb) {
+                          abort_request(msg_id);
+                          return make_ready_future<>();
+                      }
+                      if (_trace_context_negotiated && type == trace_context_verb) {
+                          _next_trace_context.reset();
+                          if (data->size == tracing::trace_context::serialized_size) {
+                              std::array<char, tracing::trace_context::serialized_size> raw;
+                              auto p = raw.data();
+                              std::visit(make_visitor([&p] (const temporary_buffer<char>& b) {
+                                  p = std::copy_n(b.get(), b.size(), p);
+                              }, [&p] (const std::vector<temporary_buffer<char>>& bufs) {
+                                  for (auto& b : bufs) {
+                                      p = std::copy_n(b.get(), b.size(), p);
+                                  }
+                              }), data->bufs);
+                              if (auto ctx = tracing::trace_context::read(raw.data())) {
+                                  _next_trace_context.emplace(msg_id, *ctx);
+                              }
+                          }
+                          return make_ready_future<>();
+                      }
+                      auto trace_context = std::exchange(_next_trace_context, std::nullopt);
                       auto h = get_server()._proto.get_handler(type);
                       if (!h) {
                           return send_unknown_verb_reply(timeout, msg_id, type);
                       }
+                      if (trace_context && trace_context->first == msg_id) {
+                          _trace_contexts.insert(*trace_context);
+                      }
 
                       // If the new method of per-connection scheduling group was used, honor it.
                       // Otherwise, use the old per-handler scheduling group.
@@ -1247,6 +1711,9 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
                       format("server{} connection dropped", is_stream() ? " stream" : "").c_str(), ep);
           }
           _fd.shutdown_input();
+          for (auto& [id, r] : _running_requests) {
+              r->as.request_abort_ex(closed_error());
+          }
           if (is_stream() && (ep || _error)) {
               _stream_queue.abort(std::make_exception_ptr(stream_closed()));
           }
@@ -1269,6 +1736,51 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
       });
   }
 
+  abort_source& client_info::request_abort_source() const {
+      SEASTAR_ASSERT(current_request && "request_abort_source() called after the handler deferred");
+      auto& r = *current_request;
+      if (!r.as) {
+          r.as = &static_cast<server::connection&>(r.conn).start_request(r.msg_id, r.timeout);
+      }
+      return *r.as;
+  }
+
+  abort_source& server::connection::start_request(int64_t msg_id, std::optional<rpc_clock_type::time_point> timeout) {
+      auto r = std::make_unique<running_request>();
+      auto& as = r->as;
+      if (timeout) {
+          r->deadline.set_callback([&as] {
+              as.request_abort_ex(timeout_error());
+          });
+          r->deadline.arm(*timeout);
+      }
+      _running_requests[msg_id] = std::move(r);
+      return as;
+  }
+
+  void server::connection::finish_request(int64_t msg_id) noexcept {
+      _running_requests.erase(msg_id);
+  }
+
+  void server::connection::abort_request(int64_t msg_id) noexcept {
+      if (auto it = _running_requests.find(msg_id); it != _running_requests.end()) {
+          it->second->as.request_abort_ex(canceled_error());
+      }
+  }
+
+  std::optional<tracing::trace_context> server::connection::take_trace_context(int64_t msg_id) noexcept {
+      if (_trace_contexts.empty()) {
+          return std::nullopt;
+      }
+      auto it = _trace_contexts.find(msg_id);
+      if (it == _trace_contexts.end()) {
+          return std::nullopt;
+      }
+      auto ctx = it->second;
+      _trace_contexts.erase(it);
+      return ctx;
+  }
+
   server::connection::connection(server& s, connected_socket&& fd, socket_address&& addr, const logger& l, void* serializer, connection_id id)
           : rpc::connection(std::move(fd), l, serializer, id)
           , _info{.addr{std::move(addr)}, .server{s}, .conn_id{id}} {
@@ -1302,6 +1814,51 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
 
   thread_local std::unordered_map<streaming_domain_type, server*> server::_servers;
 
+  struct server::metrics_domain {
+      struct verb_metrics {
+          seastar::metrics::internal::time_estimated_histogram queue_time;
+          seastar::metrics::internal::time_estimated_histogram handler_duration;
+      };
+
+      sstring name;
+      std::unordered_map<uint64_t, verb_metrics> verbs;
+      seastar::metrics::metric_groups metric_groups;
+
+      static thread_local std::unordered_map<sstring, metrics_domain> all;
+
+      static metrics_domain& find_or_create(sstring name) {
+          return all.try_emplace(name, name).first->second;
+      }
+
+      metrics_domain(sstring name) : name(std::move(name)) {}
+
+      verb_metrics& find_or_create(uint64_t verb) {
+          auto [it, inserted] = verbs.try_emplace(verb);
+          if (inserted) {
+              namespace sm = seastar::metrics;
+              auto& vm = it->second;
+              std::vector<sm::label_instance> labels = { sm::label("domain")(name), sm::label("verb")(verb) };
+              metric_groups.add_group("rpc_server", {
+                    sm::make_histogram("queue_latency", [&vm] { return vm.queue_time.to_metrics_histogram(); },
+                            sm::description("Time requests waited for the memory resources before being handled"), labels).set_skip_when_empty(),
+                    sm::make_histogram("handler_latency", [&vm] { return vm.handler_duration.to_metrics_histogram(); },
+                            sm::description("Time the handlers took to produce a reply"), labels).set_skip_when_empty(),
+              });
+          }
+          return it->second;
+      }
+  };
+
+  thread_local std::unordered_map<sstring, server::metrics_domain> server::metrics_domain::all;
+
+  void server::account_queue_time(uint64_t verb, rpc_clock_type::duration latency) {
+      _metrics_domain.find_or_create(verb).queue_time.add(latency);
+  }
+
+  void server::account_handler_duration(uint64_t verb, rpc_clock_type::duration latency) {
+      _metrics_domain.find_or_create(verb).handler_duration.add(latency);
+  }
+
   server::server(protocol_base* proto, const socket_address& addr, resource_limits limits)
       : server(proto, seastar::listen(addr, listen_options{true}), limits, server_options{})
   {}
@@ -1312,6 +1869,7 @@ future<> server::connection::send_unknown_verb_reply(std::optional<rpc_clock_typ
 
   server::server(protocol_base* proto, server_socket ss, resource_limits limits, server_options opts)
           : _proto(*proto), _ss(std::move(ss)), _limits(limits), _resources_available(limits.max_memory), _options(opts)
+          , _metrics_domain(metrics_domain::find_or_create(_options.metrics_domain))
   {
       if (_options.streaming_domain) {
           if (_servers.find(*_options.streaming_domain) != _servers.end()) {
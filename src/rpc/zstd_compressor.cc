@@ -0,0 +1,378 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_HAVE_ZSTD
+
+#include <seastar/rpc/zstd_compressor.hh>
+#include <seastar/core/byteorder.hh>
+#include <seastar/core/print.hh>
+
+#include <zstd.h>
+
+#include <map>
+
+namespace seastar {
+namespace rpc {
+
+// Compressed message format:
+// A 4 byte little-endian header followed by the payload. The 31 least
+// significant bits of the header contain the uncompressed size of the
+// message. If the most significant bit is set the payload is a single zstd
+// frame, otherwise the payload is the message itself, sent as is because it
+// was too small or didn't compress well.
+
+static constexpr uint32_t compressed_flag = uint32_t(1) << 31;
+static constexpr size_t header_size = sizeof(uint32_t);
+static constexpr size_t max_message_size = compressed_flag - 1;
+
+struct zstd_compressor::dictionary {
+    ZSTD_CDict* cdict;
+    ZSTD_DDict* ddict;
+    dictionary(const sstring& content, int level)
+        : cdict(ZSTD_createCDict(content.data(), content.size(), level))
+        , ddict(ZSTD_createDDict(content.data(), content.size())) {
+        if (!cdict || !ddict) {
+            ZSTD_freeCDict(cdict);
+            ZSTD_freeDDict(ddict);
+            throw std::runtime_error("Failed to load the zstd dictionary");
+        }
+    }
+    dictionary(const dictionary&) = delete;
+    ~dictionary() {
+        ZSTD_freeCDict(cdict);
+        ZSTD_freeDDict(ddict);
+    }
+};
+
+namespace {
+
+struct cctx_deleter {
+    void operator()(ZSTD_CCtx* ctx) const noexcept {
+        ZSTD_freeCCtx(ctx);
+    }
+};
+
+struct dctx_deleter {
+    void operator()(ZSTD_DCtx* ctx) const noexcept {
+        ZSTD_freeDCtx(ctx);
+    }
+};
+
+// Dictionaries trained by zstd carry an id, use a hash of the content for
+// raw ones. Peers negotiate the compressor only if their ids match.
+uint32_t dictionary_id(const sstring& content) {
+    auto id = ZSTD_getDictID_fromDict(content.data(), content.size());
+    if (id) {
+        return id;
+    }
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : content) {
+        hash = (hash ^ c) * 16777619u;
+    }
+    return hash;
+}
+
+void check(size_t ret, const char* what) {
+    if (ZSTD_isError(ret)) {
+        throw std::runtime_error(format("RPC frame ZSTD {} failure: {}", what, ZSTD_getErrorName(ret)));
+    }
+}
+
+template <typename Buffer, typename Func>
+void for_each_fragment(Buffer& data, Func&& func) {
+    if (auto* b = std::get_if<temporary_buffer<char>>(&data.bufs)) {
+        func(*b);
+    } else {
+        for (auto& b : std::get<std::vector<temporary_buffer<char>>>(data.bufs)) {
+            func(b);
+        }
+    }
+}
+
+}
+
+zstd_compressor::factory::factory()
+        : factory(config{}) {
+}
+
+zstd_compressor::factory::factory(config cfg)
+        : _cfg(std::move(cfg))
+        , _name("ZSTD") {
+    if (!_cfg.dictionary.empty()) {
+        _dict = std::make_shared<const dictionary>(_cfg.dictionary, _cfg.level);
+        _name = format("ZSTD_DICT_{:08x}", dictionary_id(_cfg.dictionary));
+        // The dictionary is owned by _dict now
+        _cfg.dictionary = {};
+    }
+}
+
+zstd_compressor::factory::~factory() = default;
+
+const sstring& zstd_compressor::factory::supported() const {
+    return _name;
+}
+
+std::unique_ptr<rpc::compressor> zstd_compressor::factory::negotiate(sstring feature, bool is_server) const {
+    return feature == _name ? std::make_unique<zstd_compressor>(_cfg, _dict, _name) : nullptr;
+}
+
+zstd_compressor::zstd_compressor(config cfg, std::shared_ptr<const dictionary> dict, sstring name)
+        : _cfg(std::move(cfg))
+        , _dict(std::move(dict))
+        , _name(std::move(name)) {
+}
+
+zstd_compressor::~zstd_compressor() = default;
+
+sstring zstd_compressor::name() const {
+    return _name;
+}
+
+bool zstd_compressor::use_dictionary(lw_shared_ptr<const compression_dictionary> dict) {
+    // Digested dictionaries are expensive to build, share them between
+    // the connections of the shard
+    static thread_local std::map<std::pair<uint32_t, int>, std::weak_ptr<const dictionary>> cache;
+    auto& cached = cache[{dict->id, _cfg.level}];
+    _dict = cached.lock();
+    if (!_dict) {
+        std::erase_if(cache, [] (const auto& e) { return e.second.expired(); });
+        _dict = std::make_shared<const dictionary>(dict->data, _cfg.level);
+        cache[{dict->id, _cfg.level}] = _dict;
+    }
+    return true;
+}
+
+bool zstd_compressor::should_compress(size_t size) {
+    if (!_cfg.adaptive) {
+        return true;
+    }
+    if (size < _cfg.min_compress_size) {
+        return false;
+    }
+    if (_skip) {
+        --_skip;
+        return false;
+    }
+    return true;
+}
+
+void zstd_compressor::account(size_t original, size_t compressed) {
+    if (!_cfg.adaptive) {
+        return;
+    }
+    static constexpr unsigned max_backoff = 64;
+    if (compressed > original * _cfg.incompressible_ratio) {
+        _backoff = std::min(std::max(_backoff * 2, 1u), max_backoff);
+        _skip = _backoff;
+    } else {
+        _backoff = 0;
+    }
+}
+
+snd_buf zstd_compressor::compress(size_t head_space, snd_buf data) {
+    if (data.size > max_message_size) {
+        throw std::runtime_error(format("RPC message of {} bytes is too large for ZSTD", data.size));
+    }
+
+    auto send_raw = [&] {
+        temporary_buffer<char> header(head_space + header_size);
+        write_le<uint32_t>(header.get_write() + head_space, data.size);
+        std::vector<temporary_buffer<char>> bufs;
+        auto* b = std::get_if<temporary_buffer<char>>(&data.bufs);
+        if (b) {
+            bufs.reserve(2);
+            bufs.push_back(std::move(header));
+            if (!b->empty()) {
+                bufs.push_back(std::move(*b));
+            }
+        } else {
+            auto& v = std::get<std::vector<temporary_buffer<char>>>(data.bufs);
+            bufs.reserve(v.size() + 1);
+            bufs.push_back(std::move(header));
+            std::move(v.begin(), v.end(), std::back_inserter(bufs));
+        }
+        return snd_buf(std::move(bufs), head_space + header_size + data.size);
+    };
+
+    if (!should_compress(data.size)) {
+        return send_raw();
+    }
+
+    static thread_local auto cctx = std::unique_ptr<ZSTD_CCtx, cctx_deleter>(ZSTD_createCCtx());
+    auto ctx = cctx.get();
+    ZSTD_CCtx_reset(ctx, ZSTD_reset_session_and_parameters);
+    if (_dict) {
+        check(ZSTD_CCtx_refCDict(ctx, _dict->cdict), "compression");
+    } else {
+        check(ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, _cfg.level), "compression");
+    }
+    check(ZSTD_CCtx_setPledgedSrcSize(ctx, data.size), "compression");
+
+    // Output is allocated in snd_buf::chunk_size fragments, or smaller
+    // when the whole compressed message is expected to fit in one.
+    auto bound = ZSTD_compressBound(data.size) + head_space + header_size;
+    std::vector<temporary_buffer<char>> dst;
+    size_t total = 0;
+    ZSTD_outBuffer out{nullptr, 0, 0};
+    auto next_output = [&] {
+        if (!dst.empty()) {
+            dst.back().trim(out.pos);
+        }
+        total += out.pos;
+        auto size = std::min(snd_buf::chunk_size, bound > total ? bound - total : snd_buf::chunk_size);
+        if (dst.empty()) {
+            size = std::max(size, head_space + header_size);
+        }
+        dst.emplace_back(size);
+        out = ZSTD_outBuffer{dst.back().get_write(), size, 0};
+    };
+    next_output();
+    out.pos = head_space + header_size;
+
+    // The message isn't worth compressing once output reaches its size
+    auto limit = head_space + header_size + data.size;
+    bool too_large = false;
+    auto run = [&] (ZSTD_inBuffer& in, ZSTD_EndDirective op) {
+        while (!too_large) {
+            if (out.pos == out.size) {
+                next_output();
+            }
+            auto ret = ZSTD_compressStream2(ctx, &out, &in, op);
+            check(ret, "compression");
+            too_large = total + out.pos >= limit;
+            if (op == ZSTD_e_end ? ret == 0 : in.pos == in.size) {
+                break;
+            }
+        }
+    };
+    for_each_fragment(data, [&] (temporary_buffer<char>& b) {
+        ZSTD_inBuffer in{b.get(), b.size(), 0};
+        run(in, ZSTD_e_continue);
+    });
+    ZSTD_inBuffer empty{nullptr, 0, 0};
+    run(empty, ZSTD_e_end);
+
+    account(data.size, total + out.pos - head_space - header_size);
+    if (too_large) {
+        return send_raw();
+    }
+    dst.back().trim(out.pos);
+    total += out.pos;
+    write_le<uint32_t>(dst.front().get_write() + head_space, compressed_flag | data.size);
+    if (dst.size() == 1) {
+        return snd_buf(std::move(dst.front()));
+    }
+    return snd_buf(std::move(dst), total);
+}
+
+rcv_buf zstd_compressor::decompress(rcv_buf data) {
+    if (data.size < header_size) {
+        return rcv_buf();
+    }
+
+    // Read, possibly fragmented, header and drop it from the input
+    char header_bytes[header_size];
+    size_t copied = 0;
+    auto drop_header = [&] (temporary_buffer<char>& b) {
+        auto n = std::min(b.size(), header_size - copied);
+        std::copy_n(b.get(), n, header_bytes + copied);
+        b.trim_front(n);
+        copied += n;
+    };
+    for_each_fragment(data, drop_header);
+    data.size -= header_size;
+    auto header = read_le<uint32_t>(header_bytes);
+    uint32_t size = header & ~compressed_flag;
+
+    if (!(header & compressed_flag)) {
+        if (size != data.size) {
+            throw std::runtime_error("RPC frame ZSTD size mismatch");
+        }
+        if (auto* v = std::get_if<std::vector<temporary_buffer<char>>>(&data.bufs)) {
+            std::erase_if(*v, [] (const temporary_buffer<char>& b) { return b.empty(); });
+        }
+        return data;
+    }
+
+    static thread_local auto dctx = std::unique_ptr<ZSTD_DCtx, dctx_deleter>(ZSTD_createDCtx());
+    auto ctx = dctx.get();
+    ZSTD_DCtx_reset(ctx, ZSTD_reset_session_and_parameters);
+    if (_dict) {
+        check(ZSTD_DCtx_refDDict(ctx, _dict->ddict), "decompression");
+    }
+
+    // Output fragments are allocated as decompression progresses so that a
+    // corrupted header can't make us allocate more than the input expands to.
+    std::vector<temporary_buffer<char>> dst;
+    size_t allocated = 0;
+    ZSTD_outBuffer out{nullptr, 0, 0};
+    auto next_output = [&] {
+        auto n = std::min<size_t>(snd_buf::chunk_size, size - allocated);
+        dst.emplace_back(n);
+        out = ZSTD_outBuffer{dst.back().get_write(), n, 0};
+        allocated += n;
+    };
+
+    size_t ret = 1;
+    auto run = [&] (ZSTD_inBuffer& in) {
+        while (ret && (in.pos < in.size || !in.size)) {
+            if (out.pos == out.size && allocated < size) {
+                next_output();
+            }
+            auto in_pos = in.pos;
+            auto out_pos = out.pos;
+            ret = ZSTD_decompressStream(ctx, &out, &in);
+            check(ret, "decompression");
+            if (in.pos == in_pos && out.pos == out_pos) {
+                // Either the input is truncated or it expands beyond the declared size
+                throw std::runtime_error("RPC frame ZSTD decompression failure");
+            }
+        }
+        if (in.pos < in.size) {
+            throw std::runtime_error("RPC frame ZSTD decompression failure: trailing data");
+        }
+    };
+    for_each_fragment(data, [&] (temporary_buffer<char>& b) {
+        if (!b.empty()) {
+            ZSTD_inBuffer in{b.get(), b.size(), 0};
+            run(in);
+        }
+    });
+    // Flush whatever is buffered in the context
+    ZSTD_inBuffer empty{nullptr, 0, 0};
+    run(empty);
+
+    if (allocated - (out.size - out.pos) != size) {
+        throw std::runtime_error("RPC frame ZSTD decompression failure: size mismatch");
+    }
+    if (dst.empty()) {
+        return rcv_buf();
+    }
+    if (dst.size() == 1) {
+        return rcv_buf(std::move(dst.front()));
+    }
+    return rcv_buf(std::move(dst), size);
+}
+
+}
+}
+
+#endif
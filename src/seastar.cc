@@ -50,6 +50,7 @@ module;
 #include <atomic>
 #include <bitset>
 #include <cassert>
+#include <charconv>
 #include <chrono>
 #include <compare>
 #include <concepts>
@@ -169,13 +170,19 @@ export module seastar;
 #include <seastar/core/bitops.hh>
 #include <seastar/core/bitset-iter.hh>
 #include <seastar/core/byteorder.hh>
+#include <seastar/core/cached_file.hh>
 #include <seastar/core/cacheline.hh>
 #include <seastar/core/checked_ptr.hh>
+#include <seastar/core/chunked_deque.hh>
 #include <seastar/core/chunked_fifo.hh>
+#include <seastar/core/chunked_parallel.hh>
 #include <seastar/core/circular_buffer.hh>
 #include <seastar/core/circular_buffer_fixed_capacity.hh>
 #include <seastar/core/condition-variable.hh>
 #include <seastar/core/coroutine.hh>
+#include <seastar/core/cpu_accounting.hh>
+#include <seastar/core/cross_shard_channel.hh>
+#include <seastar/core/cross_shard_semaphore.hh>
 #include <seastar/core/deleter.hh>
 #include <seastar/core/distributed.hh>
 #include <seastar/core/do_with.hh>
@@ -184,7 +191,9 @@ export module seastar;
 #include <seastar/core/execution_stage.hh>
 #include <seastar/core/expiring_fifo.hh>
 #include <seastar/core/file.hh>
+#include <seastar/core/mapped_file.hh>
 #include <seastar/core/file-types.hh>
+#include <seastar/core/flat_hash_map.hh>
 #include <seastar/core/fsnotify.hh>
 #include <seastar/core/fsqual.hh>
 #include <seastar/core/fstream.hh>
@@ -192,6 +201,7 @@ export module seastar;
 #include <seastar/core/future-util.hh>
 #include <seastar/core/gate.hh>
 #include <seastar/core/idle_cpu_handler.hh>
+#include <seastar/core/intrusive_ptr.hh>
 #include <seastar/core/iostream.hh>
 #include <seastar/core/iostream-impl.hh>
 #include <seastar/core/io_intent.hh>
@@ -208,9 +218,11 @@ export module seastar;
 #include <seastar/core/metrics_api.hh>
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/core/metrics_types.hh>
+// #include <seastar/core/otlp.hh>
 #include <seastar/core/pipe.hh>
 #include <seastar/core/polymorphic_temporary_buffer.hh>
 #include <seastar/core/posix.hh>
+#include <seastar/core/preallocated_exception.hh>
 #include <seastar/core/preempt.hh>
 #include <seastar/core/prefetch.hh>
 #include <seastar/core/print.hh>
@@ -220,6 +232,7 @@ export module seastar;
 #include <seastar/core/reactor.hh>
 #include <seastar/core/reactor_config.hh>
 #include <seastar/core/relabel_config.hh>
+#include <seastar/core/replicated.hh>
 #include <seastar/core/report_exception.hh>
 #include <seastar/core/resource.hh>
 #include <seastar/core/rwlock.hh>
@@ -231,6 +244,7 @@ export module seastar;
 #include <seastar/core/seastar.hh>
 #include <seastar/core/semaphore.hh>
 #include <seastar/core/sharded.hh>
+#include <seastar/core/sharded_router.hh>
 #include <seastar/core/shared_future.hh>
 #include <seastar/core/shared_mutex.hh>
 #include <seastar/core/shared_ptr.hh>
@@ -250,6 +264,7 @@ export module seastar;
 #include <seastar/core/thread.hh>
 #include <seastar/core/timed_out_error.hh>
 #include <seastar/core/timer.hh>
+#include <seastar/core/tracing.hh>
 #include <seastar/core/transfer.hh>
 #include <seastar/core/unaligned.hh>
 #include <seastar/core/units.hh>
@@ -263,6 +278,7 @@ export module seastar;
 #include <seastar/util/alloc_failure_injector.hh>
 #include <seastar/util/backtrace.hh>
 #include <seastar/util/conversions.hh>
+#include <seastar/util/crc32c.hh>
 #include <seastar/util/defer.hh>
 #include <seastar/util/file.hh>
 #include <seastar/util/log-cli.hh>
@@ -280,6 +296,7 @@ export module seastar;
 #include <seastar/net/ip_checksum.hh>
 #include <seastar/net/inet_address.hh>
 #include <seastar/net/ip.hh>
+#include <seastar/net/ipv6.hh>
 #include <seastar/net/ipv4_address.hh>
 #include <seastar/net/native-stack.hh>
 #include <seastar/net/posix-stack.hh>
@@ -287,8 +304,10 @@ export module seastar;
 #include <seastar/net/tcp.hh>
 #include <seastar/net/udp.hh>
 #include <seastar/net/tls.hh>
+#include <seastar/net/tls_session_keys.hh>
 
 #include <seastar/http/common.hh>
+#include <seastar/http/compression.hh>
 #include <seastar/http/client.hh>
 #include <seastar/http/exception.hh>
 #include <seastar/http/file_handler.hh>
@@ -298,21 +317,29 @@ export module seastar;
 #include <seastar/http/response_parser.hh>
 #include <seastar/http/request.hh>
 #include <seastar/http/routes.hh>
+#include <seastar/http/static_handler.hh>
 #include <seastar/http/transformers.hh>
 
 #include <seastar/json/formatter.hh>
 #include <seastar/json/json_elements.hh>
+#include <seastar/json/stream_parser.hh>
+#include <seastar/json/stream_writer.hh>
 
 module : private;
 
 #include <seastar/core/internal/read_state.hh>
 #include <seastar/core/internal/buffer_allocator.hh>
+#include <seastar/core/internal/cpu_profiler.hh>
 #include <seastar/core/internal/io_intent.hh>
+#include <seastar/core/internal/quiescent_state.hh>
 #include <seastar/core/internal/stall_detector.hh>
+#include <seastar/core/internal/task_tracer.hh>
+#include <seastar/core/internal/tsc_clock.hh>
 #include <seastar/core/internal/uname.hh>
 
 #include "core/cgroup.hh"
 #include "core/file-impl.hh"
+#include "core/pmem.hh"
 #include "core/prefault.hh"
 #include "core/program_options.hh"
 #include "core/reactor_backend.hh"
@@ -333,8 +360,16 @@ module : private;
 #include <seastar/net/tcp-stack.hh>
 #include <seastar/net/toeplitz.hh>
 #include <seastar/net/virtio.hh>
+#include <seastar/net/xdp.hh>
 
+#include "net/dpdk_extmem.hh"
+#include "net/dpdk_rss.hh"
 #include "net/native-stack-impl.hh"
+#include "net/tls-impl.hh"
+#ifdef SEASTAR_HAVE_XDP
+#include "net/xdp_ring.hh"
+#endif
 
 #include <seastar/http/url.hh>
 #include <seastar/http/internal/content_source.hh>
+#include <seastar/http/internal/request_head_parser.hh>
@@ -43,6 +43,7 @@ module seastar;
 #include <seastar/core/print.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/core/coroutine.hh>
 #endif
 
 namespace seastar {
@@ -132,6 +133,22 @@ std::ostream& operator<<(std::ostream& out, const task_entry& e) {
     return out;
 }
 
+static void append_waiting_tasks(task* tsk, tasktrace::vector_type& prev, size_t& hash) noexcept {
+    while (tsk && prev.size() < prev.max_size()) {
+        shared_backtrace bt = tsk->get_backtrace();
+        hash *= 31;
+        if (bt) {
+            hash ^= bt->hash();
+            prev.push_back(bt);
+        } else {
+            task_entry e(typeid(*tsk), internal::coroutine_task::resume_address(*tsk));
+            hash ^= e.hash();
+            prev.push_back(e);
+        }
+        tsk = tsk->waiting_task();
+    }
+}
+
 tasktrace current_tasktrace() noexcept {
     auto main = current_backtrace_tasklocal();
 
@@ -147,24 +164,19 @@ tasktrace current_tasktrace() noexcept {
             tsk = local_engine->current_task();
         }
 
-        while (tsk && prev.size() < prev.max_size()) {
-            shared_backtrace bt = tsk->get_backtrace();
-            hash *= 31;
-            if (bt) {
-                hash ^= bt->hash();
-                prev.push_back(bt);
-            } else {
-                const std::type_info& ti = typeid(*tsk);
-                prev.push_back(task_entry(ti));
-                hash ^= ti.hash_code();
-            }
-            tsk = tsk->waiting_task();
-        }
+        append_waiting_tasks(tsk, prev, hash);
     }
 
     return tasktrace(std::move(main), std::move(prev), hash, current_scheduling_group());
 }
 
+tasktrace waiting_tasktrace(task& t) noexcept {
+    tasktrace::vector_type prev;
+    size_t hash = 0;
+    append_waiting_tasks(&t, prev, hash);
+    return tasktrace(simple_backtrace(), std::move(prev), hash, t.group());
+}
+
 saved_backtrace current_backtrace() noexcept {
     return current_tasktrace();
 }
@@ -219,6 +231,9 @@ auto formatter<seastar::tasktrace>::format(const seastar::tasktrace& b, format_c
 
 auto formatter<seastar::task_entry>::format(const seastar::task_entry& e, format_context& ctx) const
     -> decltype(ctx.out()) {
+    if (e._resume_address) {
+        return fmt::format_to(ctx.out(), "coroutine at {}", seastar::decorate(e._resume_address));
+    }
     return fmt::format_to(ctx.out(), "{}", seastar::pretty_type_name(*e._task_type));
 }
 
@@ -0,0 +1,123 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#ifdef SEASTAR_MODULE
+module;
+#endif
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#ifdef SEASTAR_MODULE
+module seastar;
+#else
+#include <seastar/util/crc32c.hh>
+#endif
+
+namespace seastar {
+
+namespace {
+
+// the reflected Castagnoli polynomial
+constexpr uint32_t polynomial = 0x82f63b78;
+
+constexpr std::array<uint32_t, 256> make_table() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (crc & 1 ? polynomial : 0);
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+constexpr auto table = make_table();
+
+uint32_t crc32c_sw(uint32_t crc, const unsigned char* p, size_t size) noexcept {
+    while (size--) {
+        crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hw(uint32_t crc, const unsigned char* p, size_t size) noexcept {
+    uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, p += 8) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        crc64 = _mm_crc32_u64(crc64, v);
+    }
+    crc = crc64;
+    while (size--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+
+const bool has_hw_crc = __builtin_cpu_supports("sse4.2");
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+
+uint32_t crc32c_hw(uint32_t crc, const unsigned char* p, size_t size) noexcept {
+    for (; size >= 8; size -= 8, p += 8) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        crc = __crc32cd(crc, v);
+    }
+    while (size--) {
+        crc = __crc32cb(crc, *p++);
+    }
+    return crc;
+}
+
+constexpr bool has_hw_crc = true;
+
+#else
+
+uint32_t crc32c_hw(uint32_t crc, const unsigned char* p, size_t size) noexcept {
+    return crc32c_sw(crc, p, size);
+}
+
+constexpr bool has_hw_crc = false;
+
+#endif
+
+}
+
+uint32_t crc32c_update(uint32_t crc, const char* data, size_t size) noexcept {
+    auto p = reinterpret_cast<const unsigned char*>(data);
+    crc = ~crc;
+    crc = has_hw_crc ? crc32c_hw(crc, p, size) : crc32c_sw(crc, p, size);
+    return ~crc;
+}
+
+}
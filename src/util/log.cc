@@ -23,6 +23,7 @@
 module;
 #endif
 
+#include <cstring>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -32,6 +33,9 @@ module;
 #include <system_error>
 #include <chrono>
 #include <algorithm>
+#include <bit>
+#include <thread>
+#include <vector>
 
 #include <fmt/core.h>
 #include <fmt/chrono.h>
@@ -42,6 +46,7 @@ module;
 #include <boost/program_options.hpp>
 #include <boost/range/adaptor/map.hpp>
 #include <cxxabi.h>
+#include <sys/mman.h>
 #include <syslog.h>
 #include <unistd.h>
 
@@ -297,6 +302,7 @@ std::istream& operator>>(std::istream& in, log_level& level) {
 std::ostream* logger::_out = &std::cerr;
 std::atomic<bool> logger::_ostream = { true };
 std::atomic<bool> logger::_syslog = { false };
+std::atomic<bool> logger::_deferred = { false };
 unsigned logger::_shard_field_width = 1;
 #ifdef SEASTAR_BUILD_SHARED_LIBS
 thread_local bool logger::silent = false;
@@ -316,6 +322,333 @@ logger::~logger() {
 
 static thread_local std::array<char, 8192> static_log_buf;
 
+static int syslog_level(log_level level) {
+    static array_map<int, 20> level_map = {
+            { int(log_level::debug), LOG_DEBUG },
+            { int(log_level::info), LOG_INFO },
+            { int(log_level::trace), LOG_DEBUG },  // no LOG_TRACE
+            { int(log_level::warn), LOG_WARNING },
+            { int(log_level::error), LOG_ERR },
+    };
+    return level_map[int(level)];
+}
+
+namespace {
+
+enum class log_target : uint8_t { ostream, syslog };
+
+/*
+ * A ring of log records, appended to by the thread that owns it and
+ * consumed by the writer thread, without locks.
+ *
+ * A record is a header followed by the message and a terminating nul,
+ * padded to the alignment of the header. A record never wraps around the
+ * end of the buffer: a header with a zero size marks the end of the
+ * records, the next one being at the start of the buffer.
+ *
+ * The message of a deferred record is the length of the prefix, the
+ * prefix, and the arguments encoded by logger::log_deferred().
+ */
+class log_ring {
+    struct header {
+        uint32_t size; // of the whole record
+        uint32_t len; // of the message
+        uint8_t level;
+        log_target target;
+        bool deferred;
+    };
+    static constexpr size_t align = 16;
+    static_assert(sizeof(header) <= align);
+
+    char* _buf;
+    size_t _capacity;
+    // only written by the consumer
+    alignas(64) std::atomic<size_t> _head = 0;
+    // only written by the producer
+    alignas(64) std::atomic<size_t> _tail = 0;
+    std::atomic<uint64_t> _dropped = 0;
+
+    static size_t record_size(size_t len) noexcept {
+        return (sizeof(header) + len + 1 + align - 1) & ~(align - 1);
+    }
+public:
+    explicit log_ring(size_t capacity) : _capacity(std::bit_ceil(std::max(capacity, size_t(4096)))) {
+        // not allocated with malloc, so that the writer thread can free it
+        // whatever the allocator of the shard
+        auto p = ::mmap(nullptr, _capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            throw std::system_error(errno, std::system_category(), "mmap of the asynchronous log buffer");
+        }
+        _buf = static_cast<char*>(p);
+    }
+    ~log_ring() {
+        ::munmap(_buf, _capacity);
+    }
+    log_ring(const log_ring&) = delete;
+
+    // called by the producer, returns false when the message is dropped.
+    // The message is the concatenation of the parts.
+    bool push(log_target target, log_level level, bool deferred, std::initializer_list<std::string_view> parts) noexcept {
+        size_t len = 0;
+        for (auto part : parts) {
+            len += part.size();
+        }
+        auto size = record_size(len);
+        auto tail = _tail.load(std::memory_order_relaxed);
+        auto head = _head.load(std::memory_order_acquire);
+        auto pos = tail & (_capacity - 1);
+        size_t pad = pos + size > _capacity ? _capacity - pos : 0;
+        if (size > _capacity / 2 || tail + pad + size - head > _capacity) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (pad) {
+            new (_buf + pos) header{0, 0, uint8_t(level), target, deferred};
+            pos = 0;
+        }
+        new (_buf + pos) header{uint32_t(size), uint32_t(len), uint8_t(level), target, deferred};
+        auto text = _buf + pos + sizeof(header);
+        for (auto part : parts) {
+            text = std::copy(part.begin(), part.end(), text);
+        }
+        *text = '\0';
+        _tail.store(tail + pad + size, std::memory_order_release);
+        return true;
+    }
+
+    // called by the consumer, calls func(target, level, deferred, msg) for each record
+    template <typename Func>
+    void drain(Func&& func) {
+        auto head = _head.load(std::memory_order_relaxed);
+        auto tail = _tail.load(std::memory_order_acquire);
+        while (head != tail) {
+            auto pos = head & (_capacity - 1);
+            auto h = reinterpret_cast<const header*>(_buf + pos);
+            if (h->size == 0) {
+                head += _capacity - pos;
+                continue;
+            }
+            func(h->target, log_level(h->level), h->deferred, std::string_view(_buf + pos + sizeof(header), h->len));
+            head += h->size;
+            // let the producer reuse the record
+            _head.store(head, std::memory_order_release);
+        }
+        _head.store(head, std::memory_order_release);
+    }
+
+    uint64_t take_dropped() noexcept {
+        return _dropped.exchange(0, std::memory_order_relaxed);
+    }
+};
+
+}
+
+/*
+ * Drains the rings of the threads logging, from a thread of its own.
+ *
+ * The rings are registered once per thread, under a mutex, and then
+ * appended to without locking. The producers bump _seq after each
+ * message, which the writer waits on when the rings are empty.
+ */
+class logger::async_backend {
+    std::mutex _mutex;
+    std::vector<std::shared_ptr<log_ring>> _rings;
+    // a copy of _rings, for the writer to drain them without the mutex
+    std::vector<std::shared_ptr<log_ring>> _draining;
+    // changes each time the backend is enabled, so that the threads
+    // register new rings
+    std::atomic<uint64_t> _epoch = 0;
+    std::atomic<bool> _enabled = false;
+    std::atomic<bool> _stopping = false;
+    size_t _ring_size = 0;
+    std::thread _thread;
+    std::atomic<uint64_t> _seq = 0;
+    // the value of _seq before the last time all rings were drained
+    std::atomic<uint64_t> _drained = 0;
+    std::atomic<uint64_t> _dropped = 0;
+    // where the writer formats deferred records
+    internal::log_buf _formatted;
+
+    struct thread_ring {
+        uint64_t epoch = 0;
+        std::shared_ptr<log_ring> ring;
+    };
+    static thread_local thread_ring _local;
+
+    log_ring* local_ring() {
+        auto epoch = _epoch.load(std::memory_order_acquire);
+        if (_local.epoch != epoch) {
+            auto ring = std::make_shared<log_ring>(_ring_size);
+            std::lock_guard<std::mutex> g(_mutex);
+            _rings.push_back(ring);
+            _local = {epoch, std::move(ring)};
+        }
+        return _local.ring.get();
+    }
+
+    void write(log_target target, log_level level, std::string_view msg) {
+        if (target == log_target::ostream) {
+            *_out << msg;
+        } else {
+            // syslog() interprets % characters, so send msg as a parameter
+            syslog(syslog_level(level), "%s", msg.data());
+        }
+    }
+
+    void write_deferred(log_target target, log_level level, std::string_view msg) {
+        uint32_t prefix_len;
+        std::memcpy(&prefix_len, msg.data(), sizeof(prefix_len));
+        auto prefix = msg.substr(sizeof(prefix_len), prefix_len);
+        auto args = msg.substr(sizeof(prefix_len) + prefix_len);
+        _formatted.clear();
+        auto it = _formatted.back_insert_begin();
+        it = std::copy(prefix.begin(), prefix.end(), it);
+        try {
+            internal::deferred_log_formatter format;
+            std::memcpy(&format, args.data(), sizeof(format));
+            it = format(args.data() + sizeof(format), it);
+        } catch (...) {
+            it = fmt::format_to(it, "failed to format log message: {}", std::current_exception());
+        }
+        if (target == log_target::ostream) {
+            *it++ = '\n';
+            write(target, level, _formatted.view());
+        } else {
+            *it++ = '\0';
+            write(target, level, _formatted.data());
+        }
+    }
+
+    // returns whether there were messages
+    bool drain() {
+        {
+            std::lock_guard<std::mutex> g(_mutex);
+            _draining = _rings;
+        }
+        bool found = false;
+        bool ostream = false;
+        for (auto& ring : _draining) {
+            ring->drain([&] (log_target target, log_level level, bool deferred, std::string_view msg) {
+                if (deferred) {
+                    write_deferred(target, level, msg);
+                } else {
+                    write(target, level, msg);
+                }
+                found = true;
+                ostream |= target == log_target::ostream;
+            });
+            if (auto dropped = ring->take_dropped()) {
+                _dropped.fetch_add(dropped, std::memory_order_relaxed);
+                auto msg = fmt::format("{} log messages dropped, the asynchronous log buffer was full", dropped);
+                if (_ostream.load(std::memory_order_relaxed)) {
+                    *_out << msg << '\n';
+                    ostream = true;
+                }
+                if (_syslog.load(std::memory_order_relaxed)) {
+                    write(log_target::syslog, log_level::warn, msg);
+                }
+            }
+        }
+        if (ostream) {
+            _out->flush();
+        }
+        return found;
+    }
+
+    void run() {
+        for (;;) {
+            auto seq = _seq.load(std::memory_order_acquire);
+            bool found = drain();
+            _drained.store(seq, std::memory_order_release);
+            _drained.notify_all();
+            if (!found && _stopping.load(std::memory_order_relaxed)) {
+                break;
+            }
+            if (!found) {
+                _seq.wait(seq, std::memory_order_acquire);
+            }
+        }
+    }
+public:
+    ~async_backend() {
+        stop();
+    }
+
+    void start(size_t ring_size) {
+        stop();
+        _ring_size = ring_size;
+        _stopping.store(false, std::memory_order_relaxed);
+        _epoch.fetch_add(1, std::memory_order_release);
+        _thread = std::thread([this] { run(); });
+        _enabled.store(true, std::memory_order_release);
+    }
+
+    void stop() noexcept {
+        if (!_thread.joinable()) {
+            return;
+        }
+        _enabled.store(false, std::memory_order_release);
+        _stopping.store(true, std::memory_order_relaxed);
+        _seq.fetch_add(1, std::memory_order_release);
+        _seq.notify_one();
+        _thread.join();
+        _draining.clear();
+        std::lock_guard<std::mutex> g(_mutex);
+        _rings.clear();
+    }
+
+    bool enabled() const noexcept {
+        return _enabled.load(std::memory_order_acquire);
+    }
+
+    // returns false when not enabled, so that the caller writes the message
+    bool push(log_target target, log_level level, std::string_view msg) noexcept {
+        return push(target, level, false, {msg});
+    }
+
+    // returns false when not enabled, so that the caller formats the message
+    bool push_deferred(log_target target, log_level level, std::string_view prefix, std::string_view args) noexcept {
+        uint32_t prefix_len = prefix.size();
+        return push(target, level, true, {std::string_view(reinterpret_cast<const char*>(&prefix_len), sizeof(prefix_len)), prefix, args});
+    }
+
+    bool push(log_target target, log_level level, bool deferred, std::initializer_list<std::string_view> parts) noexcept {
+        if (!enabled()) {
+            return false;
+        }
+        try {
+            local_ring()->push(target, level, deferred, parts);
+        } catch (...) {
+            return false;
+        }
+        _seq.fetch_add(1, std::memory_order_release);
+        _seq.notify_one();
+        return true;
+    }
+
+    void flush() noexcept {
+        if (!_enabled.load(std::memory_order_acquire)) {
+            return;
+        }
+        auto seq = _seq.load(std::memory_order_acquire);
+        for (auto drained = _drained.load(std::memory_order_acquire); drained < seq;
+                drained = _drained.load(std::memory_order_acquire)) {
+            _drained.wait(drained, std::memory_order_acquire);
+        }
+    }
+
+    uint64_t dropped() const noexcept {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+    static async_backend& instance() {
+        static async_backend backend;
+        return backend;
+    }
+};
+
+thread_local logger::async_backend::thread_ring logger::async_backend::_local;
+
 bool logger::rate_limit::check() {
     const auto now = clock::now();
     if (now < _next) {
@@ -330,6 +663,14 @@ logger::rate_limit::rate_limit(std::chrono::milliseconds interval)
     : _interval(interval), _next(clock::now())
 { }
 
+internal::log_buf::inserter_iterator
+logger::print_prefix(internal::log_buf::inserter_iterator it) const {
+    if (local_engine) {
+        it = fmt::format_to(it, " [shard {:{}}:{}]", this_shard_id(), _shard_field_width, current_scheduling_group().short_name());
+    }
+    return fmt::format_to(it, " {} - ", _name);
+}
+
 void
 logger::do_log(log_level level, log_writer& writer) {
     bool is_ostream_enabled = _ostream.load(std::memory_order_relaxed);
@@ -338,11 +679,7 @@ logger::do_log(log_level level, log_writer& writer) {
       return;
     }
     auto print_once = [&] (internal::log_buf::inserter_iterator it) {
-      if (local_engine) {
-          it = fmt::format_to(it, " [shard {:{}}:{}]", this_shard_id(), _shard_field_width, current_scheduling_group().short_name());
-      }
-      it = fmt::format_to(it, " {} - ", _name);
-      return writer(it);
+      return writer(print_prefix(it));
     };
 
     // Mainly this protects us from re-entrance via malloc()'s
@@ -356,29 +693,54 @@ logger::do_log(log_level level, log_writer& writer) {
         it = print_timestamp(it);
         it = print_once(it);
         *it++ = '\n';
-        *_out << buf.view();
-        _out->flush();
+        if (!async_backend::instance().push(log_target::ostream, level, buf.view())) {
+            *_out << buf.view();
+            _out->flush();
+        }
     }
     if (is_syslog_enabled) {
         internal::log_buf buf(static_log_buf.data(), static_log_buf.size());
         auto it = buf.back_insert_begin();
         it = print_once(it);
         *it = '\0';
-        static array_map<int, 20> level_map = {
-                { int(log_level::debug), LOG_DEBUG },
-                { int(log_level::info), LOG_INFO },
-                { int(log_level::trace), LOG_DEBUG },  // no LOG_TRACE
-                { int(log_level::warn), LOG_WARNING },
-                { int(log_level::error), LOG_ERR },
-        };
-        // NOTE: syslog() can block, which will stall the reactor thread.
-        //       this should be rare (will have to fill the pipe buffer
-        //       before syslogd can clear it) but can happen.  If it does,
-        //       we'll have to implement some internal buffering (which
-        //       still means the problem can happen, just less frequently).
-        // syslog() interprets % characters, so send msg as a parameter
-        syslog(level_map[int(level)], "%s", buf.data());
+        if (!async_backend::instance().push(log_target::syslog, level, buf.data())) {
+            // NOTE: syslog() can block, which will stall the reactor thread.
+            //       this should be rare (will have to fill the pipe buffer
+            //       before syslogd can clear it) but can happen.  If it does,
+            //       enable_async() moves the calls to a thread of their own.
+            // syslog() interprets % characters, so send msg as a parameter
+            syslog(syslog_level(level), "%s", buf.data());
+        }
+    }
+}
+
+bool
+logger::do_log_deferred(log_level level, std::string_view args) noexcept {
+    auto& backend = async_backend::instance();
+    if (!backend.enabled()) {
+        return false;
     }
+    bool is_ostream_enabled = _ostream.load(std::memory_order_relaxed);
+    bool is_syslog_enabled = _syslog.load(std::memory_order_relaxed);
+    silencer be_silent;
+    try {
+        if (is_ostream_enabled) {
+            internal::log_buf buf(static_log_buf.data(), static_log_buf.size());
+            auto it = buf.back_insert_begin();
+            it = fmt::format_to(it, "{} ", wrapped_log_level{level});
+            it = print_timestamp(it);
+            print_prefix(it);
+            backend.push_deferred(log_target::ostream, level, buf.view(), args);
+        }
+        if (is_syslog_enabled) {
+            internal::log_buf buf(static_log_buf.data(), static_log_buf.size());
+            print_prefix(buf.back_insert_begin());
+            backend.push_deferred(log_target::syslog, level, buf.view(), args);
+        }
+    } catch (...) {
+        ++logging_failures;
+    }
+    return true;
 }
 
 void logger::failed_to_log(std::exception_ptr ex,
@@ -414,6 +776,31 @@ logger::set_syslog_enabled(bool enabled) noexcept {
     _syslog.store(enabled, std::memory_order_relaxed);
 }
 
+void
+logger::set_deferred_formatting(bool enabled) noexcept {
+    _deferred.store(enabled, std::memory_order_relaxed);
+}
+
+void
+logger::enable_async(size_t buffer_size) {
+    async_backend::instance().start(buffer_size);
+}
+
+void
+logger::disable_async() noexcept {
+    async_backend::instance().stop();
+}
+
+void
+logger::flush_async() noexcept {
+    async_backend::instance().flush();
+}
+
+uint64_t
+logger::async_dropped_messages() noexcept {
+    return async_backend::instance().dropped();
+}
+
 void
 logger::set_shard_field_width(unsigned width) noexcept {
     _shard_field_width = width;
@@ -505,6 +892,12 @@ void apply_logging_settings(const logging_settings& s) {
     }
     logger::set_syslog_enabled(s.syslog_enabled);
     logger::set_with_color(s.with_color);
+    logger::set_deferred_formatting(s.deferred_formatting);
+    if (s.async_buffer_size) {
+        logger::enable_async(s.async_buffer_size);
+    } else {
+        logger::disable_async();
+    }
 
     switch (s.stdout_timestamp_style) {
     case logger_timestamp_style::none:
@@ -594,6 +987,12 @@ options::options(program_options::option_group* parent_group)
             "Send log output to: none|stdout|stderr")
     , log_to_syslog(*this, "log-to-syslog", false, "Send log output to syslog.")
     , log_with_color(*this, "log-with-color", isatty(STDOUT_FILENO), "Print colored tag prefix in log message written to ostream")
+    , logger_async_buffer_size(*this, "logger-async-buffer-size", 0,
+            "Size in bytes of the buffer of each thread for asynchronous logging, 0 to write log messages from the thread logging them. "
+            "With asynchronous logging, a dedicated thread writes the messages, which are dropped when the buffer is full")
+    , logger_deferred_formatting(*this, "logger-deferred-formatting", false,
+            "With asynchronous logging, copy the arguments of log messages and have the writer thread format them, "
+            "when they are numbers, enums or strings")
 {
 }
 
@@ -625,6 +1024,8 @@ logging_settings extract_settings(const options& opts) {
         opts.log_with_color.get_value(),
         opts.logger_stdout_timestamps.get_value(),
         opts.logger_ostream_type.get_value(),
+        opts.logger_async_buffer_size.get_value(),
+        opts.logger_deferred_formatting.get_value(),
     };
 }
 
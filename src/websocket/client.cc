@@ -0,0 +1,155 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright 2024 ScyllaDB
+ */
+
+#include <seastar/websocket/client.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/http/request.hh>
+#include <seastar/http/reply.hh>
+#include <seastar/http/response_parser.hh>
+#include <seastar/util/string_utils.hh>
+
+#include <random>
+
+namespace seastar::experimental::websocket {
+
+client_connection::client_connection(connected_socket&& fd, sstring host, sstring resource, sstring subprotocol, handler_t handler)
+    : connection(std::move(fd), true)
+    , _host(std::move(host))
+    , _resource(std::move(resource))
+{
+    _subprotocol = std::move(subprotocol);
+    _handler = std::move(handler);
+}
+
+future<> client_connection::process() {
+    std::exception_ptr ex;
+    try {
+        co_await send_http_upgrade_request();
+        co_await read_http_upgrade_response();
+    } catch (...) {
+        ex = std::current_exception();
+    }
+    if (ex) {
+        co_await when_all(_read_buf.close(), _write_buf.close());
+        std::rethrow_exception(std::move(ex));
+    }
+    co_await when_all_succeed(read_loop(), response_loop()).discard_result();
+}
+
+future<> client_connection::send_http_upgrade_request() {
+    // https://datatracker.ietf.org/doc/html/rfc6455#section-4.1
+    std::random_device rd;
+    char nonce[16];
+    for (auto& c : nonce) {
+        c = std::uniform_int_distribution<int>(0, 255)(rd);
+    }
+    _key = encode_base64(std::string_view(nonce, sizeof(nonce)));
+
+    auto req = http::request::make("GET", _host, _resource);
+    req._version = "1.1";
+    req._headers["Upgrade"] = "websocket";
+    req._headers["Connection"] = "Upgrade";
+    req._headers["Sec-WebSocket-Key"] = _key;
+    req._headers["Sec-WebSocket-Version"] = "13";
+    if (!_subprotocol.empty()) {
+        req._headers["Sec-WebSocket-Protocol"] = _subprotocol;
+    }
+    co_await _write_buf.write(req.request_line());
+    co_await req.write_request_headers(_write_buf);
+    co_await _write_buf.write("\r\n", 2);
+    co_await _write_buf.flush();
+}
+
+future<> client_connection::read_http_upgrade_response() {
+    http_response_parser parser;
+    parser.init();
+    co_await _read_buf.consume(parser);
+    if (parser.eof()) {
+        throw websocket::exception("Connection closed during the upgrade");
+    }
+    if (parser.failed()) {
+        throw websocket::exception("Incorrect upgrade response");
+    }
+    auto resp = parser.get_parsed_response();
+    if (resp->_status != http::reply::status_type::switching_protocols) {
+        throw websocket::exception(fmt::format("Upgrade refused with status {}", int(resp->_status)));
+    }
+    if (!seastar::internal::case_insensitive_cmp()(resp->get_header("Upgrade"), "websocket")) {
+        throw websocket::exception("Upgrade header missing");
+    }
+    if (resp->get_header("Sec-WebSocket-Accept") != sha1_base64(_key + magic_key_suffix)) {
+        throw websocket::exception("Incorrect Sec-WebSocket-Accept");
+    }
+    // No extensions are offered, so none may be selected
+    if (!resp->get_header("Sec-WebSocket-Extensions").empty()) {
+        throw websocket::exception("Unexpected extension");
+    }
+    if (resp->get_header("Sec-WebSocket-Protocol") != _subprotocol) {
+        throw websocket::exception("Subprotocol not accepted");
+    }
+    websocket_logger.debug("Connected to {}{}", _host, _resource);
+}
+
+future<> client_connection::read_loop() {
+    return when_all_succeed(
+        _handler(_input, _output).then_wrapped([this] (future<> f) {
+            // Closing the output stream sends the close frame, see response_loop()
+            if (f.failed()) {
+                auto ex = f.get_exception();
+                return close(true).handle_exception([] (auto ignored) {}).finally([this] {
+                    shutdown_input();
+                }).then([ex = std::move(ex)] () mutable {
+                    return make_exception_future<>(std::move(ex));
+                });
+            }
+            return _output.close();
+        }),
+        do_until([this] {return _done;}, [this] {return read_one();})
+    ).discard_result().finally([this] {
+        return _read_buf.close();
+    });
+}
+
+client::client(socket_address addr, sstring host)
+        : client(std::make_unique<http::experimental::basic_connection_factory>(addr),
+                host.empty() ? seastar::format("{}", addr) : std::move(host))
+{
+}
+
+client::client(socket_address addr, shared_ptr<tls::certificate_credentials> creds, sstring host)
+        : client(std::make_unique<http::experimental::tls_connection_factory>(std::move(addr), std::move(creds), host), host)
+{
+}
+
+client::client(std::unique_ptr<http::experimental::connection_factory> f, sstring host)
+        : _new_connections(std::move(f))
+        , _host(std::move(host))
+{
+}
+
+future<> client::connect(sstring resource, handler_t handler, sstring subprotocol, abort_source* as) {
+    auto fd = co_await _new_connections->make(as);
+    client_connection conn(std::move(fd), _host, std::move(resource), std::move(subprotocol), std::move(handler));
+    co_await conn.process();
+}
+
+}
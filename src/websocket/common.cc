@@ -24,14 +24,236 @@
 #include <seastar/core/when_all.hh>
 #include <seastar/util/assert.hh>
 #include <seastar/util/defer.hh>
+#include <seastar/core/loop.hh>
 #include <gnutls/crypto.h>
 #include <gnutls/gnutls.h>
+#include <zlib.h>
+
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <system_error>
+#include <unordered_set>
+#include <sys/random.h>
+
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/trim.hpp>
 
 namespace seastar::experimental::websocket {
 
 sstring magic_key_suffix = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 logger websocket_logger("websocket");
 
+/*!
+ * \brief zlib streams of a connection using permessage-deflate.
+ * https://datatracker.ietf.org/doc/html/rfc7692#section-7.2
+ */
+class permessage_deflate {
+    // Appended to each message before inflating, removed after deflating
+    static constexpr char tail[] = { '\x00', '\x00', '\xff', '\xff' };
+    // Size of the buffers decompressed data is handed out in
+    static constexpr size_t chunk_size = 16 * 1024;
+
+    z_stream _deflate = {};
+    z_stream _inflate = {};
+    int _window_bits;
+    bool _no_context_takeover;
+    size_t _min_message_size;
+    // Compressed data being inflated, see decompress_some()
+    temporary_buffer<char> _input;
+    bool _tail_pending = false;
+public:
+    permessage_deflate(int level, int window_bits, bool no_context_takeover, size_t min_message_size)
+            : _window_bits(window_bits)
+            , _no_context_takeover(no_context_takeover)
+            , _min_message_size(min_message_size) {
+        // negative window bits make a raw deflate stream
+        if (deflateInit2(&_deflate, level, Z_DEFLATED, -window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::bad_alloc();
+        }
+        if (inflateInit2(&_inflate, -MAX_WBITS) != Z_OK) {
+            deflateEnd(&_deflate);
+            throw std::bad_alloc();
+        }
+    }
+    ~permessage_deflate() {
+        deflateEnd(&_deflate);
+        inflateEnd(&_inflate);
+    }
+    permessage_deflate(const permessage_deflate&) = delete;
+
+    bool should_compress(size_t message_size) const noexcept {
+        return message_size >= _min_message_size;
+    }
+
+    // Whether the peer can inflate messages compressed with the default window
+    bool full_window() const noexcept {
+        return _window_bits == MAX_WBITS;
+    }
+
+    // Starts the next message with an empty window, once the peer was sent a
+    // message compressed by another stream: its window no longer matches ours.
+    void forget_window() noexcept {
+        if (!_no_context_takeover) {
+            deflateReset(&_deflate);
+        }
+    }
+
+    temporary_buffer<char> compress(const temporary_buffer<char>& in) {
+        // sync flushing adds an empty stored block to the bound for Z_FINISH
+        size_t capacity = deflateBound(&_deflate, in.size()) + 16;
+        temporary_buffer<char> out(capacity);
+        _deflate.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.get()));
+        _deflate.avail_in = in.size();
+        _deflate.next_out = reinterpret_cast<Bytef*>(out.get_write());
+        _deflate.avail_out = capacity;
+        auto res = ::deflate(&_deflate, Z_SYNC_FLUSH);
+        if (res != Z_OK || _deflate.avail_in != 0 || _deflate.avail_out == 0) {
+            throw websocket::exception(fmt::format("deflate failed: {}", res));
+        }
+        out.trim(capacity - _deflate.avail_out - sizeof(tail));
+        if (_no_context_takeover) {
+            deflateReset(&_deflate);
+        }
+        return out;
+    }
+
+    // Sets the next chunk of a compressed message to decompress_some(),
+    // last tells whether it ends the message.
+    void set_input(temporary_buffer<char> in, bool last) {
+        _input = std::move(in);
+        _inflate.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(_input.get()));
+        _inflate.avail_in = _input.size();
+        _tail_pending = last;
+    }
+
+    // Returns the next chunk of decompressed data, or an empty
+    // buffer once the input was decompressed.
+    temporary_buffer<char> decompress_some() {
+        temporary_buffer<char> out(chunk_size);
+        _inflate.next_out = reinterpret_cast<Bytef*>(out.get_write());
+        _inflate.avail_out = out.size();
+        while (_inflate.avail_out != 0) {
+            if (_inflate.avail_in == 0) {
+                if (!_tail_pending) {
+                    break;
+                }
+                _inflate.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(tail));
+                _inflate.avail_in = sizeof(tail);
+                _tail_pending = false;
+            }
+            auto res = ::inflate(&_inflate, Z_SYNC_FLUSH);
+            if (res == Z_STREAM_END) {
+                // The sender ended the message with a final block,
+                // the next message starts a new stream.
+                inflateReset(&_inflate);
+                _inflate.avail_in = 0;
+                _tail_pending = false;
+                break;
+            }
+            if (res == Z_BUF_ERROR) {
+                // no progress possible, all input is consumed
+                break;
+            }
+            if (res != Z_OK) {
+                throw websocket::exception(fmt::format("inflate failed: {}", _inflate.msg ? _inflate.msg : "unknown error"));
+            }
+        }
+        if (_inflate.avail_in == 0 && !_tail_pending) {
+            _input = {};
+        }
+        out.trim(out.size() - _inflate.avail_out);
+        return out;
+    }
+};
+
+// Writes the header of an unmasked frame carrying size bytes, returns its size
+static size_t write_frame_header(char* header, uint8_t first, size_t size) {
+    header[0] = first;
+    if ((126 <= size) && (size <= std::numeric_limits<uint16_t>::max())) {
+        header[1] = 0x7E;
+        write_be<uint16_t>(header + 2, size);
+        return 2 + sizeof(uint16_t);
+    } else if (std::numeric_limits<uint16_t>::max() < size) {
+        header[1] = 0x7F;
+        write_be<uint64_t>(header + 2, size);
+        return 2 + sizeof(uint64_t);
+    }
+    header[1] = uint8_t(size);
+    return 2;
+}
+
+// Masking keys must not be predictable by the application (RFC 6455,
+// section 10.3), so they come from the kernel's CSPRNG, a batch at a time
+static uint32_t next_masking_key() {
+    static thread_local std::array<uint32_t, 256> keys;
+    static thread_local size_t next = keys.size();
+    if (next == keys.size()) {
+        auto p = reinterpret_cast<char*>(keys.data());
+        size_t left = sizeof(keys);
+        while (left) {
+            auto r = ::getrandom(p, left, 0);
+            if (r < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::system_category(), "getrandom");
+            }
+            p += r;
+            left -= r;
+        }
+        next = 0;
+    }
+    return keys[next++];
+}
+
+static temporary_buffer<char> make_frame(uint8_t first, const temporary_buffer<char>& payload) {
+    char header[10];
+    size_t header_size = write_frame_header(header, first, payload.size());
+    temporary_buffer<char> frame(header_size + payload.size());
+    std::copy_n(header, header_size, frame.get_write());
+    std::copy_n(payload.get(), payload.size(), frame.get_write() + header_size);
+    return frame;
+}
+
+broadcast_frame::broadcast_frame(opcodes opcode, const temporary_buffer<char>& payload,
+        std::optional<permessage_deflate_options> compression)
+    : _plain(make_frame(0x80 | opcode, payload)) {
+    if (compression && payload.size() >= compression->min_message_size) {
+        permessage_deflate deflate(compression->compression_level, MAX_WBITS, true, compression->min_message_size);
+        _compressed = make_frame(0x80 | opcode | 1 << frame_header::RSV1, deflate.compress(payload));
+    }
+}
+
+broadcast_frame broadcast_frame::share() {
+    return broadcast_frame(_plain.share(), _compressed.share());
+}
+
+broadcast_frame broadcast_frame::borrow(deleter d) const {
+    auto borrowed = [&d] (const temporary_buffer<char>& buf) {
+        return temporary_buffer<char>(const_cast<char*>(buf.get()), buf.size(), d.share());
+    };
+    return broadcast_frame(borrowed(_plain), borrowed(_compressed));
+}
+
+connection::connection(connected_socket&& fd, bool client_side)
+    : _fd(std::move(fd))
+    , _read_buf(_fd.input())
+    , _write_buf(_fd.output())
+    , _client_side(client_side)
+    , _websocket_parser(!client_side)
+    , _input_buffer{PIPE_SIZE}
+    , _output_buffer{PIPE_SIZE}
+{
+    _input = input_stream<char>{data_source{
+            std::make_unique<connection_source_impl>(&_input_buffer)}};
+    _output = output_stream<char>{data_sink{
+            std::make_unique<connection_sink_impl>(&_output_buffer)}};
+}
+
+connection::~connection() {
+}
+
 future<> connection::handle_ping() {
     // TODO
     return make_ready_future<>();
@@ -43,28 +265,54 @@ future<> connection::handle_pong() {
 }
 
 future<> connection::send_data(opcodes opcode, temporary_buffer<char>&& buff) {
-    char header[10] = {'\x80', 0};
-    size_t header_size = 2;
-
-    header[0] += opcode;
+    // Compressing under the lock keeps the window in the order messages are sent
+    return with_semaphore(_send_lock, 1, [this, opcode, buff = std::move(buff)] () mutable {
+        char header[10];
+        uint8_t first = 0x80 | opcode;
+        if (_deflate && (opcode == opcodes::TEXT || opcode == opcodes::BINARY) && _deflate->should_compress(buff.size())) {
+            buff = _deflate->compress(buff);
+            first |= 1 << frame_header::RSV1;
+        }
+        size_t header_size = write_frame_header(header, first, buff.size());
 
-    if ((126 <= buff.size()) && (buff.size() <= std::numeric_limits<uint16_t>::max())) {
-        header[1] = 0x7E;
-        write_be<uint16_t>(header + 2, buff.size());
-        header_size += sizeof(uint16_t);
-    } else if (std::numeric_limits<uint16_t>::max() < buff.size()) {
-        header[1] = 0x7F;
-        write_be<uint64_t>(header + 2, buff.size());
-        header_size += sizeof(uint64_t);
-    } else {
-        header[1] = uint8_t(buff.size());
-    }
+        scattered_message<char> msg;
+        if (_client_side) {
+            // https://datatracker.ietf.org/doc/html/rfc6455#section-5.3
+            // The payload is copied, the buffer may be shared with the handler.
+            uint32_t key = next_masking_key();
+            header[1] |= 1 << frame_header::MASKED;
+            auto masked = temporary_buffer<char>(buff.size());
+            std::copy_n(buff.get(), buff.size(), masked.get_write());
+            apply_mask(masked.get_write(), masked.size(), key);
+            char key_bytes[4];
+            write_be<uint32_t>(key_bytes, key);
+            msg.append(sstring(header, header_size) + sstring(key_bytes, 4));
+            msg.append(std::move(masked));
+        } else {
+            msg.append(sstring(header, header_size));
+            msg.append(std::move(buff));
+        }
+        return _write_buf.write(std::move(msg)).then([this] {
+            return _write_buf.flush();
+        });
+    });
+}
 
-    scattered_message<char> msg;
-    msg.append(sstring(header, header_size));
-    msg.append(std::move(buff));
-    return _write_buf.write(std::move(msg)).then([this] {
-        return _write_buf.flush();
+future<> connection::send_frame(broadcast_frame frame) {
+    SEASTAR_ASSERT(!_client_side);
+    return with_semaphore(_send_lock, 1, [this, frame = std::move(frame)] () mutable {
+        if (_close_sent || _write_closed) {
+            return make_ready_future<>();
+        }
+        bool compressed = _deflate && frame.compressed() && _deflate->full_window();
+        if (compressed) {
+            _deflate->forget_window();
+        }
+        scattered_message<char> msg;
+        msg.append(compressed ? std::move(frame._compressed) : std::move(frame._plain));
+        return _write_buf.write(std::move(msg)).then([this] {
+            return _write_buf.flush();
+        });
     });
 }
 
@@ -73,10 +321,18 @@ future<> connection::response_loop() {
         // FIXME: implement error handling
         return _output_buffer.pop_eventually().then([this] (
                 temporary_buffer<char> buf) {
+            if (buf.empty()) {
+                // The output stream was closed, by the handler or by close()
+                return _done ? make_ready_future<>() : close(true);
+            }
             return send_data(opcodes::BINARY, std::move(buf));
         });
     }).finally([this]() {
-        return _write_buf.close();
+        // after the frame being sent, if any
+        return with_semaphore(_send_lock, 1, [this] {
+            _write_closed = true;
+            return _write_buf.close();
+        });
     });
 }
 
@@ -86,7 +342,7 @@ void connection::shutdown_input() {
 
 future<> connection::close(bool send_close) {
     return [this, send_close]() {
-        if (send_close) {
+        if (send_close && !std::exchange(_close_sent, true)) {
             return send_data(opcodes::CLOSE, temporary_buffer<char>(0));
         } else {
             return make_ready_future<>();
@@ -108,7 +364,7 @@ future<> connection::read_one() {
             case opcodes::CONTINUATION:
             case opcodes::TEXT:
             case opcodes::BINARY:
-                return _input_buffer.push_eventually(_websocket_parser.result());
+                return handle_data(_websocket_parser.result());
             case opcodes::CLOSE:
                 websocket_logger.debug("Received close frame.");
                 // datatracker.ietf.org/doc/html/rfc6455#section-5.5.1
@@ -131,6 +387,98 @@ future<> connection::read_one() {
     });
 }
 
+future<> connection::handle_data(temporary_buffer<char> buff) {
+    if (_deflate && _websocket_parser.compressed()) {
+        _deflate->set_input(std::move(buff), _websocket_parser.end_of_message());
+        return repeat([this] {
+            auto data = _deflate->decompress_some();
+            if (data.empty()) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            return _input_buffer.push_eventually(std::move(data)).then([] {
+                return stop_iteration::no;
+            });
+        });
+    }
+    // Empty frames carry no data, and an empty buffer reads as end of stream
+    if (buff.empty()) {
+        return make_ready_future<>();
+    }
+    return _input_buffer.push_eventually(std::move(buff));
+}
+
+sstring connection::negotiate_permessage_deflate(std::string_view offers, const permessage_deflate_options& opts) {
+    // https://datatracker.ietf.org/doc/html/rfc7692#section-7.1
+    std::vector<std::string> extensions;
+    boost::split(extensions, offers, [] (char c) { return c == ','; });
+    for (auto& extension : extensions) {
+        std::vector<std::string> params;
+        boost::split(params, extension, [] (char c) { return c == ';'; });
+        for (auto& p : params) {
+            boost::trim(p);
+        }
+        if (params[0] != "permessage-deflate") {
+            continue;
+        }
+        bool acceptable = true;
+        bool server_no_context_takeover = opts.no_context_takeover;
+        bool client_no_context_takeover = false;
+        int server_max_window_bits = MAX_WBITS;
+        std::unordered_set<std::string> seen;
+        for (auto p = params.begin() + 1; p != params.end() && acceptable; ++p) {
+            auto eq = p->find('=');
+            auto name = boost::trim_copy(p->substr(0, eq));
+            auto value = eq == std::string::npos ? std::string() : boost::trim_copy(p->substr(eq + 1));
+            if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+                value = value.substr(1, value.size() - 2);
+            }
+            if (!seen.insert(name).second) {
+                acceptable = false;
+            } else if (name == "server_no_context_takeover" && value.empty()) {
+                server_no_context_takeover = true;
+            } else if (name == "client_no_context_takeover" && value.empty()) {
+                client_no_context_takeover = true;
+            } else if (name == "server_max_window_bits" || name == "client_max_window_bits") {
+                if (value.empty()) {
+                    // only a client_max_window_bits hint may come without a value;
+                    // we inflate with the largest window anyway
+                    acceptable = name == "client_max_window_bits";
+                    continue;
+                }
+                int bits = 0;
+                auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), bits);
+                if (ec != std::errc() || ptr != value.data() + value.size() || bits < 8 || bits > MAX_WBITS) {
+                    acceptable = false;
+                } else if (name == "server_max_window_bits") {
+                    // zlib can't make raw deflate streams with 256 byte windows
+                    acceptable = bits > 8;
+                    server_max_window_bits = bits;
+                }
+            } else {
+                acceptable = false;
+            }
+        }
+        if (!acceptable) {
+            continue;
+        }
+        sstring response = "permessage-deflate";
+        if (server_no_context_takeover) {
+            response += "; server_no_context_takeover";
+        }
+        if (client_no_context_takeover) {
+            response += "; client_no_context_takeover";
+        }
+        if (server_max_window_bits != MAX_WBITS) {
+            response += fmt::format("; server_max_window_bits={}", server_max_window_bits);
+        }
+        _deflate = std::make_unique<permessage_deflate>(opts.compression_level, server_max_window_bits,
+                server_no_context_takeover, opts.min_message_size);
+        _websocket_parser.set_compression(true);
+        return response;
+    }
+    return "";
+}
+
 std::string sha1_base64(std::string_view source) {
     unsigned char hash[20];
     SEASTAR_ASSERT(sizeof(hash) == gnutls_hash_get_len(GNUTLS_DIG_SHA1));
@@ -20,6 +20,11 @@
 #include <seastar/core/byteorder.hh>
 #include <seastar/util/assert.hh>
 
+#include <cstring>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 namespace seastar::experimental::websocket {
 
 opcodes websocket_parser::opcode() const {
@@ -30,10 +35,100 @@ opcodes websocket_parser::opcode() const {
     }
 }
 
+void apply_mask(char* data, size_t n, uint32_t key, uint64_t offset) noexcept {
+    // The key, rotated to start at the byte data is at in the payload.
+    uint8_t k[4];
+    for (unsigned j = 0; j < 4; ++j) {
+        k[j] = key >> (24 - 8 * ((offset + j) % 4));
+    }
+    size_t i = 0;
+    // The loops below advance by multiples of 4, so that the key stays in phase.
+#if defined(__AVX2__) || defined(__SSE2__)
+    if (n >= 16) {
+        uint8_t pattern[32];
+        for (unsigned j = 0; j < sizeof(pattern); ++j) {
+            pattern[j] = k[j % 4];
+        }
+#ifdef __AVX2__
+        auto m256 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pattern));
+        for (; i + 32 <= n; i += 32) {
+            auto p = reinterpret_cast<__m256i*>(data + i);
+            _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), m256));
+        }
+#endif
+        auto m128 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern));
+        for (; i + 16 <= n; i += 16) {
+            auto p = reinterpret_cast<__m128i*>(data + i);
+            _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), m128));
+        }
+    }
+#endif
+    uint64_t m64;
+    std::memcpy(&m64, k, 4);
+    std::memcpy(reinterpret_cast<char*>(&m64) + 4, k, 4);
+    for (; i + 8 <= n; i += 8) {
+        uint64_t v;
+        std::memcpy(&v, data + i, 8);
+        v ^= m64;
+        std::memcpy(data + i, &v, 8);
+    }
+    for (; i < n; ++i) {
+        data[i] ^= k[i % 4];
+    }
+}
+
 websocket_parser::buff_t websocket_parser::result() {
     return std::move(_result);
 }
 
+bool websocket_parser::check_header() {
+    // https://datatracker.ietf.org/doc/html/rfc6455#section-5.1
+    // Clients must close the connection if data is masked,
+    // servers must close it if data isn't masked.
+    if ((_header->masked != _masked_frames) ||
+        // RSV2 and RSV3 must be 0
+        (_header->rsv2 | _header->rsv3) ||
+        // Opcode must be known.
+        (!_header->is_opcode_known())) {
+        return false;
+    }
+    if (is_control_frame()) {
+        // https://datatracker.ietf.org/doc/html/rfc6455#section-5.5
+        // Control frames are neither fragmented nor compressed.
+        return !_header->rsv1 && _header->fin && _header->length <= 125;
+    }
+    if (_header->opcode == opcodes::CONTINUATION) {
+        return !_header->rsv1;
+    }
+    // https://datatracker.ietf.org/doc/html/rfc7692#section-6
+    // RSV1 is set on the first frame of a compressed message.
+    if (_header->rsv1 && !_allow_compression) {
+        return false;
+    }
+    _message_compressed = _header->rsv1;
+    return true;
+}
+
+future<websocket_parser::consumption_result_t> websocket_parser::parse_control_payload(
+        temporary_buffer<char> data) {
+    // Control frames are short, and handled whole.
+    auto n = std::min<uint64_t>(data.size(), remaining_payload_length());
+    _buffer.append(data.get(), n);
+    data.trim_front(n);
+    _consumed_payload_length += n;
+    if (remaining_payload_length() != 0) {
+        return websocket_parser::dont_stop();
+    }
+    _result = temporary_buffer<char>(_buffer.data(), _buffer.size());
+    _buffer = {};
+    if (_masking_key) {
+        apply_mask(_result.get_write(), _result.size(), _masking_key);
+    }
+    _consumed_payload_length = 0;
+    _state = parsing_state::flags_and_payload_data;
+    return websocket_parser::stop(std::move(data));
+}
+
 future<websocket_parser::consumption_result_t> websocket_parser::operator()(
         temporary_buffer<char> data) {
     if (data.size() == 0) {
@@ -55,13 +150,7 @@ future<websocket_parser::consumption_result_t> websocket_parser::operator()(
             _header = std::make_unique<frame_header>(_buffer.data());
             _buffer = {};
 
-            // https://datatracker.ietf.org/doc/html/rfc6455#section-5.1
-            // We must close the connection if data isn't masked.
-            if ((!_header->masked) ||
-                // RSVX must be 0
-                (_header->rsv1 | _header->rsv2 | _header->rsv3) ||
-                // Opcode must be known.
-                (!_header->is_opcode_known())) {
+            if (!check_header()) {
                 _cstate = connection_state::error;
                 return websocket_parser::stop(std::move(data));
             }
@@ -87,8 +176,9 @@ future<websocket_parser::consumption_result_t> websocket_parser::operator()(
                 _payload_length = consume_be<uint64_t>(input);
             }
 
-            _masking_key = consume_be<uint32_t>(input);
+            _masking_key = _header->masked ? consume_be<uint32_t>(input) : 0;
             _buffer = {};
+            _consumed_payload_length = 0;
             _state = parsing_state::payload;
         } else {
             _buffer.append(data.get(), data.size());
@@ -96,39 +186,31 @@ future<websocket_parser::consumption_result_t> websocket_parser::operator()(
         }
     }
     if (_state == parsing_state::payload) {
-        if (data.size() < remaining_payload_length()) {
-            // data has insufficient data to complete the frame - consume data.size() bytes
-            if (_result.empty()) {
-                _result = temporary_buffer<char>(remaining_payload_length());
-                _consumed_payload_length = 0;
-            }
-            std::copy(data.begin(), data.end(), _result.get_write() + _consumed_payload_length);
-            _consumed_payload_length += data.size();
+        if (is_control_frame()) {
+            return parse_control_payload(std::move(data));
+        }
+        auto n = std::min<uint64_t>(data.size(), remaining_payload_length());
+        if (n == 0 && remaining_payload_length() != 0) {
             return websocket_parser::dont_stop();
+        }
+        // Hand out the payload in the buffers it came in, unmasked in place.
+        // A frame split over several buffers is handed out in as many chunks.
+        if (n == data.size()) {
+            _result = std::move(data);
+            data = temporary_buffer<char>(0);
         } else {
-            // data has sufficient data to complete the frame - consume remaining_payload_length()
-            auto consumed_bytes = remaining_payload_length();
-            if (_result.empty()) {
-                // Try to avoid memory copies in case when network packets contain one or more full
-                // websocket frames.
-                if (consumed_bytes == data.size()) {
-                    _result = std::move(data);
-                    data = temporary_buffer<char>(0);
-                } else {
-                    _result = data.share();
-                    _result.trim(consumed_bytes);
-                    data.trim_front(consumed_bytes);
-                }
-            } else {
-                std::copy(data.begin(), data.begin() + consumed_bytes,
-                          _result.get_write() + _consumed_payload_length);
-                data.trim_front(consumed_bytes);
-            }
-            remove_mask(_result, _payload_length);
+            _result = data.share(0, n);
+            data.trim_front(n);
+        }
+        if (_masking_key) {
+            apply_mask(_result.get_write(), n, _masking_key, _consumed_payload_length);
+        }
+        _consumed_payload_length += n;
+        if (remaining_payload_length() == 0) {
             _consumed_payload_length = 0;
             _state = parsing_state::flags_and_payload_data;
-            return websocket_parser::stop(std::move(data));
         }
+        return websocket_parser::stop(std::move(data));
     }
     _cstate = connection_state::error;
     return websocket_parser::stop(std::move(data));
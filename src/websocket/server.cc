@@ -22,11 +22,14 @@
 #include <seastar/websocket/server.hh>
 #include <seastar/core/gate.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/sharded.hh>
 #include <seastar/util/defer.hh>
 #include <seastar/util/log.hh>
 #include <seastar/core/scattered_message.hh>
 #include <seastar/http/request.hh>
 
+#include <ranges>
+
 namespace seastar::experimental::websocket {
 
 static sstring http_upgrade_reply_template =
@@ -103,6 +106,19 @@ void server_connection::on_new_connection() {
 future<> server_connection::process() {
     return when_all_succeed(read_loop(), response_loop()).discard_result().handle_exception([] (const std::exception_ptr& e) {
         websocket_logger.debug("Processing failed: {}", e);
+    }).finally([this] {
+        return _broadcasts.close();
+    });
+}
+
+future<> server_connection::send_broadcast(broadcast_frame frame) {
+    if (!_upgraded) {
+        return make_ready_future<>();
+    }
+    return try_with_gate(_broadcasts, [this, frame = std::move(frame)] () mutable {
+        return send_frame(std::move(frame));
+    }).handle_exception([] (std::exception_ptr e) {
+        websocket_logger.debug("Broadcast failed: {}", e);
     });
 }
 
@@ -143,14 +159,25 @@ future<> server_connection::read_http_upgrade_request() {
     std::string sha1_output = sha1_base64(sha1_input);
     websocket_logger.debug("SHA1 output: {} of size {}", sha1_output, sha1_output.size());
 
+    sstring extensions;
+    if (_server._deflate_options) {
+        extensions = negotiate_permessage_deflate(req->get_header("Sec-WebSocket-Extensions"), *_server._deflate_options);
+        websocket_logger.debug("Sec-WebSocket-Extensions: {}", extensions);
+    }
+
     co_await _write_buf.write(http_upgrade_reply_template);
     co_await _write_buf.write(sha1_output);
     if (!_subprotocol.empty()) {
         co_await _write_buf.write("\r\nSec-WebSocket-Protocol: ", 26);
         co_await _write_buf.write(_subprotocol);
     }
+    if (!extensions.empty()) {
+        co_await _write_buf.write("\r\nSec-WebSocket-Extensions: ", 28);
+        co_await _write_buf.write(extensions);
+    }
     co_await _write_buf.write("\r\n\r\n", 4);
     co_await _write_buf.flush();
+    _upgraded = true;
 }
 
 future<> server_connection::read_loop() {
@@ -176,4 +203,28 @@ void server::register_handler(const std::string& name, handler_t handler) {
     _handlers[name] = handler;
 }
 
+void server::enable_permessage_deflate(permessage_deflate_options opts) {
+    _deflate_options = opts;
+}
+
+future<> server::broadcast(broadcast_frame frame) {
+    // The frame is shared with every connection before this returns
+    return parallel_for_each(_connections, [&frame] (server_connection& conn) {
+        return conn.send_broadcast(frame.share());
+    });
+}
+
+future<> broadcast(sharded<server>& servers, broadcast_frame frame) {
+    auto origin = make_lw_shared<broadcast_frame>(std::move(frame));
+    return parallel_for_each(std::views::iota(0u, smp::count), [&servers, origin] (shard_id shard) {
+        if (shard == this_shard_id()) {
+            return servers.local().broadcast(origin->share());
+        }
+        return servers.invoke_on(shard, [origin = make_foreign(origin)] (server& s) mutable {
+            auto& frame = *origin;
+            return s.broadcast(frame.borrow(make_object_deleter(std::move(origin))));
+        });
+    });
+}
+
 }
@@ -28,6 +28,9 @@ struct alloc_bench {
 
     static constexpr size_t small_alloc_size = 8;
     static constexpr size_t large_alloc_size = 32000;
+    static constexpr size_t medium_alloc_size_32k = 32 << 10;
+    static constexpr size_t medium_alloc_size_64k = 64 << 10;
+    static constexpr size_t medium_alloc_size_128k = 128 << 10;
     static constexpr size_t MAX_POINTERS = 1000;
 
     enum alloc_test_flags : uint8_t {
@@ -97,6 +100,30 @@ PERF_TEST_F(alloc_bench, alloc_only_large) { return alloc_test<large_alloc_size,
 PERF_TEST_F(alloc_bench, free_only_large ) { return alloc_test<large_alloc_size, MEASURE_FREE, c_funcs>(); }
 PERF_TEST_F(alloc_bench, alloc_free_large) { return alloc_test<large_alloc_size, MEASURE_BOTH, c_funcs>(); }
 
+// Medium sizes, as used by file_input_stream buffers and TLS records, are
+// served from the recently freed span cache
+PERF_TEST_F(alloc_bench, alloc_free_32k)   { return alloc_test<medium_alloc_size_32k, MEASURE_BOTH, c_funcs>(); }
+PERF_TEST_F(alloc_bench, alloc_free_64k)   { return alloc_test<medium_alloc_size_64k, MEASURE_BOTH, c_funcs>(); }
+PERF_TEST_F(alloc_bench, alloc_free_128k)  { return alloc_test<medium_alloc_size_128k, MEASURE_BOTH, c_funcs>(); }
+
+// A single buffer allocated and freed in a loop, the common pattern of a
+// stream reading ahead one buffer at a time
+template <size_t alloc_size>
+static size_t single_alloc_and_free_loop() {
+    constexpr size_t iters = 1000;
+    for (size_t i = 0; i < iters; ++i) {
+        auto ptr = malloc(alloc_size);
+        perf_tests::do_not_optimize(ptr);
+        free(ptr);
+    }
+    return iters;
+}
+
+PERF_TEST(alloc_bench_single, alloc_free_loop_32k)  { return single_alloc_and_free_loop<32 << 10>(); }
+PERF_TEST(alloc_bench_single, alloc_free_loop_64k)  { return single_alloc_and_free_loop<64 << 10>(); }
+PERF_TEST(alloc_bench_single, alloc_free_loop_128k) { return single_alloc_and_free_loop<128 << 10>(); }
+PERF_TEST(alloc_bench_single, alloc_free_loop_1m)   { return single_alloc_and_free_loop<1 << 20>(); }
+
 // this test doesn't serve much value. It should take about 10 times as the
 // single alloc test above. If not, something is wrong.
 PERF_TEST_F(alloc_bench, single_alloc_and_free_small_many)
@@ -0,0 +1,323 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#include <seastar/testing/cache_contention_sampler.hh>
+#include <seastar/core/cacheline.hh>
+#include <seastar/core/shard_id.hh>
+
+#include <fmt/ostream.h>
+#include <fmt/ranges.h>
+
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace seastar {
+
+namespace {
+
+struct load_event {
+    uint32_t type;
+    uint64_t config = 0;
+    uint64_t config1 = 0;
+    // Events of the core PMU need precise_ip for the data address
+    bool core_pmu;
+};
+
+std::optional<std::string> read_sysfs(const std::string& path) {
+    std::ifstream f(path);
+    std::string s;
+    if (!f || !std::getline(f, s)) {
+        return std::nullopt;
+    }
+    return s;
+}
+
+std::optional<uint32_t> pmu_type(const std::string& pmu) {
+    auto s = read_sysfs("/sys/bus/event_source/devices/" + pmu + "/type");
+    uint32_t type;
+    if (!s || std::from_chars(s->data(), s->data() + s->size(), type).ec != std::errc()) {
+        return std::nullopt;
+    }
+    return type;
+}
+
+// Sets the bits of a term of an event, as its format file lays them out,
+// e.g. "config:0-7" or "config1:0-15"
+bool set_term(load_event& ev, const std::string& pmu, std::string_view term, uint64_t value) {
+    auto format = read_sysfs("/sys/bus/event_source/devices/" + pmu + "/format/" + std::string(term));
+    if (!format) {
+        return false;
+    }
+    std::string_view f = *format;
+    auto colon = f.find(':');
+    auto field = f.substr(0, colon);
+    auto bits = f.substr(colon + 1);
+    unsigned lo = 0, hi = 0;
+    auto r = std::from_chars(bits.data(), bits.data() + bits.size(), lo);
+    hi = lo;
+    if (r.ptr != bits.data() + bits.size() && *r.ptr == '-') {
+        std::from_chars(r.ptr + 1, bits.data() + bits.size(), hi);
+    }
+    auto mask = (hi - lo == 63 ? ~uint64_t(0) : ((uint64_t(1) << (hi - lo + 1)) - 1)) << lo;
+    auto& target = field == "config1" ? ev.config1 : ev.config;
+    target = (target & ~mask) | ((value << lo) & mask);
+    return true;
+}
+
+// The mem-loads event of the core PMU, "event=0xcd,umask=0x1,ldlat=3" on
+// Intel, with the latency threshold replaced
+std::optional<load_event> core_load_event(const std::string& pmu, unsigned min_latency) {
+    auto type = pmu_type(pmu);
+    auto desc = read_sysfs("/sys/bus/event_source/devices/" + pmu + "/events/mem-loads");
+    if (!type || !desc) {
+        return std::nullopt;
+    }
+    load_event ev{.type = *type, .core_pmu = true};
+    std::string_view d = *desc;
+    while (!d.empty()) {
+        auto comma = d.find(',');
+        auto t = d.substr(0, comma);
+        d.remove_prefix(comma == std::string_view::npos ? d.size() : comma + 1);
+        auto eq = t.find('=');
+        uint64_t value = 1;
+        if (eq != std::string_view::npos) {
+            auto v = t.substr(eq + 1);
+            int base = 10;
+            if (v.starts_with("0x")) {
+                v.remove_prefix(2);
+                base = 16;
+            }
+            std::from_chars(v.data(), v.data() + v.size(), value, base);
+        }
+        if (!set_term(ev, pmu, t.substr(0, eq), value)) {
+            return std::nullopt;
+        }
+    }
+    set_term(ev, pmu, "ldlat", min_latency);
+    return ev;
+}
+
+std::optional<load_event> find_load_event(unsigned min_latency) {
+    // "cpu_core" are the big cores of hybrid parts
+    for (auto pmu : {"cpu", "cpu_core"}) {
+        if (auto ev = core_load_event(pmu, min_latency)) {
+            return ev;
+        }
+    }
+    // AMD instruction based sampling, which reports the data source of
+    // loads from Linux 6.1 on
+    if (auto type = pmu_type("ibs_op")) {
+        return load_event{.type = *type, .core_pmu = false};
+    }
+    return std::nullopt;
+}
+
+}
+
+cache_contention_sampler::cache_contention_sampler(config cfg)
+        : _cfg(cfg)
+        , _event([&] {
+    auto ev = find_load_event(cfg.min_latency);
+    if (!ev) {
+        throw std::system_error(ENOTSUP, std::system_category(), "no load sampling event on this CPU");
+    }
+    ::perf_event_attr attr{};
+    attr.type = ev->type;
+    attr.size = sizeof(attr);
+    attr.config = ev->config;
+    attr.config1 = ev->config1;
+    attr.sample_period = cfg.sample_period;
+    attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_ADDR | PERF_SAMPLE_DATA_SRC;
+    attr.disabled = 1;
+    // IBS can't filter by privilege level
+    attr.exclude_kernel = ev->core_pmu;
+    attr.exclude_hv = ev->core_pmu;
+    attr.precise_ip = ev->core_pmu ? 2 : 0;
+    linux_perf_event e(attr, 0, -1, -1, 0);
+    if (e.fd() == -1) {
+        throw std::system_error(errno, std::system_category(), "perf_event_open() failed, "
+                "try setting /proc/sys/kernel/perf_event_paranoid to 2 or less");
+    }
+    return e;
+}()) {
+    _mmap_size = (_cfg.buffer_pages + 1) * ::getpagesize();
+    _mmap = ::mmap(nullptr, _mmap_size, PROT_READ | PROT_WRITE, MAP_SHARED, _event.fd(), 0);
+    if (_mmap == MAP_FAILED) {
+        throw std::system_error(errno, std::system_category(), "mmap() of the sample buffer failed");
+    }
+}
+
+cache_contention_sampler::~cache_contention_sampler() {
+    ::munmap(_mmap, _mmap_size);
+}
+
+void cache_contention_sampler::enable() {
+    _event.enable();
+}
+
+void cache_contention_sampler::disable() {
+    _event.disable();
+}
+
+void cache_contention_sampler::drain() {
+    auto mp = static_cast<::perf_event_mmap_page*>(_mmap);
+    auto data = static_cast<const char*>(_mmap) + ::getpagesize();
+    size_t mask = _cfg.buffer_pages * ::getpagesize() - 1;
+    auto head = __atomic_load_n(&mp->data_head, __ATOMIC_ACQUIRE);
+    auto tail = mp->data_tail;
+    // Records are 8 byte aligned, but may wrap around the end of the buffer
+    auto copy = [&] (uint64_t pos, void* to, size_t len) {
+        auto p = static_cast<char*>(to);
+        for (size_t i = 0; i != len; ++i) {
+            p[i] = data[(pos + i) & mask];
+        }
+    };
+    while (tail + sizeof(::perf_event_header) <= head) {
+        ::perf_event_header h;
+        copy(tail, &h, sizeof(h));
+        if (h.type == PERF_RECORD_SAMPLE) {
+            // In sample_type bit order
+            uint64_t v[3];
+            copy(tail + sizeof(h), v, sizeof(v));
+            record(v[0], v[1], v[2]);
+        } else if (h.type == PERF_RECORD_LOST) {
+            uint64_t v[2]; // id, lost
+            copy(tail + sizeof(h), v, sizeof(v));
+            _lost += v[1];
+        }
+        tail += h.size;
+    }
+    __atomic_store_n(&mp->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+void cache_contention_sampler::record(uintptr_t ip, uintptr_t addr, uint64_t data_src) {
+    ++_samples;
+    ::perf_mem_data_src src{.val = data_src};
+    bool hitm = src.mem_snoop & PERF_MEM_SNOOP_HITM;
+    bool remote = src.mem_lvl & (PERF_MEM_LVL_REM_CCE1 | PERF_MEM_LVL_REM_CCE2);
+    if ((!hitm && !remote) || !addr) {
+        return;
+    }
+    auto line = addr & ~uintptr_t(cache_line_size - 1);
+    auto i = _lines.find(line);
+    if (i == _lines.end()) {
+        if (_lines.size() >= _cfg.max_lines) {
+            return;
+        }
+        i = _lines.emplace(line, line_stats{}).first;
+    }
+    i->second.hitm += hitm;
+    i->second.remote += remote;
+    ++i->second.sites[ip];
+}
+
+static uint64_t contention(const contended_cache_line& l) {
+    return l.hitm + l.remote;
+}
+
+static void sort_and_trim(cache_contention_report& r, size_t max_lines) {
+    std::ranges::sort(r.lines, std::greater<>{}, contention);
+    if (r.lines.size() > max_lines) {
+        r.lines.resize(max_lines);
+    }
+}
+
+cache_contention_report cache_contention_sampler::report(size_t max_lines, size_t max_sites) const {
+    cache_contention_report r{.samples = _samples, .lost = _lost};
+    r.lines.reserve(_lines.size());
+    for (auto& [address, stats] : _lines) {
+        r.lines.push_back(contended_cache_line{address, stats.hitm, stats.remote, {this_shard_id()}, {}});
+    }
+    sort_and_trim(r, max_lines);
+    for (auto& l : r.lines) {
+        std::vector<std::pair<uintptr_t, uint64_t>> sites(_lines.at(l.address).sites.begin(), _lines.at(l.address).sites.end());
+        std::ranges::sort(sites, std::greater<>{}, &std::pair<uintptr_t, uint64_t>::second);
+        sites.resize(std::min(sites.size(), max_sites));
+        for (auto& [ip, count] : sites) {
+            l.sites.emplace_back(decorate(ip), count);
+        }
+    }
+    return r;
+}
+
+void cache_contention_sampler::reset() {
+    _samples = 0;
+    _lost = 0;
+    _lines.clear();
+}
+
+void cache_contention_report::merge(const cache_contention_report& other, size_t max_lines) {
+    samples += other.samples;
+    lost += other.lost;
+    std::map<uintptr_t, contended_cache_line> by_address;
+    for (auto r : std::initializer_list<const cache_contention_report*>{this, &other}) {
+        for (auto& l : r->lines) {
+            auto& m = by_address[l.address];
+            m.address = l.address;
+            m.hitm += l.hitm;
+            m.remote += l.remote;
+            for (auto s : l.shards) {
+                if (std::ranges::find(m.shards, s) == m.shards.end()) {
+                    m.shards.push_back(s);
+                }
+            }
+            for (auto& [f, count] : l.sites) {
+                auto i = std::ranges::find(m.sites, f, &std::pair<frame, uint64_t>::first);
+                if (i == m.sites.end()) {
+                    m.sites.emplace_back(f, count);
+                } else {
+                    i->second += count;
+                }
+            }
+        }
+    }
+    lines.clear();
+    for (auto& [address, l] : by_address) {
+        std::ranges::sort(l.shards);
+        std::ranges::sort(l.sites, std::greater<>{}, &std::pair<frame, uint64_t>::second);
+        lines.push_back(std::move(l));
+    }
+    sort_and_trim(*this, max_lines);
+}
+
+std::ostream& operator<<(std::ostream& os, const cache_contention_report& r) {
+    fmt::print(os, "{} load samples, {} lost, {} contended cache lines\n", r.samples, r.lost, r.lines.size());
+    for (auto& l : r.lines) {
+        fmt::print(os, "cache line 0x{:x}: {} HITM, {} remote, shards {}\n", l.address, l.hitm, l.remote, fmt::join(l.shards, ","));
+        for (auto& [f, count] : l.sites) {
+            fmt::print(os, "  {:>8} {}\n", count, f);
+        }
+    }
+    return os;
+}
+
+}
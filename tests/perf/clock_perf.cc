@@ -0,0 +1,65 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/core/internal/tsc_clock.hh>
+#include <chrono>
+#include <thread>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+// Compares reading steady_clock, which the reactor did several times per
+// task, with the time extrapolated from the CPU's time stamp counter. Where
+// the CPU has no invariant counter, tsc_now reads steady_clock too.
+
+struct clocks {
+    static constexpr size_t reads = 1000;
+
+    clocks() {
+        // Calibrated by the reactor already with --tsc-clock, this makes
+        // sure it is without
+        internal::tsc_resync();
+        std::this_thread::sleep_for(10ms);
+        internal::tsc_resync();
+    }
+
+    template <typename Func>
+    static size_t read(Func now) {
+        for (size_t i = 0; i < reads; i++) {
+            perf_tests::do_not_optimize(now());
+        }
+        return reads;
+    }
+};
+
+PERF_TEST_F(clocks, steady_clock) {
+    return read([] { return std::chrono::steady_clock::now(); });
+}
+
+PERF_TEST_F(clocks, tsc_now) {
+    return read([] { return internal::tsc_now(); });
+}
+
+PERF_TEST_F(clocks, read_tsc) {
+    return read([] { return internal::read_tsc(); });
+}
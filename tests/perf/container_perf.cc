@@ -23,8 +23,11 @@
 #include <boost/container/deque.hpp>
 #include <boost/container/options.hpp>
 #include <seastar/testing/perf_tests.hh>
+#include <seastar/core/chunked_deque.hh>
 #include <seastar/core/chunked_fifo.hh>
 #include <seastar/core/circular_buffer.hh>
+#include <seastar/core/intrusive_ptr.hh>
+#include <seastar/core/shared_ptr.hh>
 
 using trivial_elem = int;
 
@@ -51,6 +54,11 @@ struct fifo_traits {
     using type = chunked_fifo<T>;
 };
 
+struct deque_traits {
+    template <typename T>
+    using type = chunked_deque<T>;
+};
+
 struct circ_traits {
     template <typename T>
     using type = circular_buffer<T>;
@@ -165,10 +173,35 @@ size_t erase_front_bench(size_t size) {
     return size / 2;
 }
 
+// Fills a queue from empty and drains it, as a task queue does
+template <typename Traits>
+size_t fill_drain_bench(size_t size) {
+    using container = Traits::template type<trivial_elem>;
+    container c;
+    auto outer = outer_loops(size);
+
+    perf_tests::start_measuring_time();
+    for (size_t o = 0; o < outer; o++) {
+        for (size_t i = 0; i < size; i++) {
+            c.push_back(trivial_elem(i));
+        }
+        while (!c.empty()) {
+            perf_tests::do_not_optimize(c.front());
+            c.pop_front();
+        }
+    }
+    perf_tests::stop_measuring_time();
+    return outer * size;
+}
+
 PERF_TEST_F(container_perf, erase_trivial_chunked_fifo) {
     return erase_front_bench<fifo_traits, trivial_elem>(big_size);
 }
 
+PERF_TEST_F(container_perf, erase_trivial_chunked_deque) {
+    return erase_front_bench<deque_traits, trivial_elem>(big_size);
+}
+
 PERF_TEST_F(container_perf, erase_trivial_circular_buffer) {
     return erase_bench<circ_traits, trivial_elem>(big_size);
 }
@@ -181,6 +214,10 @@ PERF_TEST_F(container_perf, clear_nontrivial_chunked_fifo) {
     return clear_bench<fifo_traits, nontrivial_elem>(big_size);
 }
 
+PERF_TEST_F(container_perf, clear_nontrivial_chunked_deque) {
+    return clear_bench<deque_traits, nontrivial_elem>(big_size);
+}
+
 PERF_TEST_F(container_perf, clear_nontrivial_circular_buffer) {
     return clear_bench<circ_traits, nontrivial_elem>(big_size);
 }
@@ -193,6 +230,10 @@ PERF_TEST_F(container_perf, clear_trivial_chunked_fifo) {
     return clear_bench<fifo_traits, trivial_elem>(big_size);
 }
 
+PERF_TEST_F(container_perf, clear_trivial_chunked_deque) {
+    return clear_bench<deque_traits, trivial_elem>(big_size);
+}
+
 PERF_TEST_F(container_perf, clear_trivial_circular_buffer) {
     return clear_bench<circ_traits, trivial_elem>(big_size);
 }
@@ -205,6 +246,10 @@ PERF_TEST_F(container_perf, iter_big_chunked_fifo) {
     return iteration_bench<fifo_traits>(big_size);
 }
 
+PERF_TEST_F(container_perf, iter_big_chunked_deque) {
+    return iteration_bench<deque_traits>(big_size);
+}
+
 PERF_TEST_F(container_perf, iter_big_circular_buffer) {
     return iteration_bench<circ_traits>(big_size);
 }
@@ -213,6 +258,10 @@ PERF_TEST_F(container_perf, iter_big_boost_deque) {
     return iteration_bench<boost_deque_traits>(big_size);
 }
 
+PERF_TEST_F(container_perf, index_big_chunked_deque) {
+    return index_bench<deque_traits>(big_size);
+}
+
 PERF_TEST_F(container_perf, index_big_circular_buffer) {
     return index_bench<circ_traits>(big_size);
 }
@@ -225,6 +274,10 @@ PERF_TEST_F(container_perf, iter_small_chunked_fifo) {
     return iteration_bench<fifo_traits>(small_size);
 }
 
+PERF_TEST_F(container_perf, iter_small_chunked_deque) {
+    return iteration_bench<deque_traits>(small_size);
+}
+
 PERF_TEST_F(container_perf, iter_small_circular_buffer) {
     return iteration_bench<circ_traits>(small_size);
 }
@@ -233,3 +286,113 @@ PERF_TEST_F(container_perf, iter_small_boost_deque) {
     return iteration_bench<boost_deque_traits>(small_size);
 }
 
+
+PERF_TEST_F(container_perf, fill_drain_big_chunked_fifo) {
+    return fill_drain_bench<fifo_traits>(big_size);
+}
+
+PERF_TEST_F(container_perf, fill_drain_big_chunked_deque) {
+    return fill_drain_bench<deque_traits>(big_size);
+}
+
+PERF_TEST_F(container_perf, fill_drain_big_circular_buffer) {
+    return fill_drain_bench<circ_traits>(big_size);
+}
+
+PERF_TEST_F(container_perf, fill_drain_big_boost_deque) {
+    return fill_drain_bench<boost_deque_traits>(big_size);
+}
+
+struct ptr_payload {
+    int x = 0;
+};
+
+struct esft_payload : enable_shared_from_this<esft_payload> {
+    int x = 0;
+};
+
+struct intrusive_payload : intrusive_refcounted<intrusive_payload> {
+    int x = 0;
+};
+
+struct lw_shared_ptr_traits {
+    static auto make() { return make_lw_shared<ptr_payload>(); }
+};
+
+struct shared_ptr_traits {
+    static auto make() { return make_shared<ptr_payload>(); }
+};
+
+struct shared_ptr_esft_traits {
+    static auto make() { return make_shared<esft_payload>(); }
+};
+
+struct intrusive_ptr_traits {
+    static auto make() { return make_intrusive<intrusive_payload>(); }
+};
+
+// Takes and drops references to one object, as packets passed
+// between layers do
+template <typename Traits>
+size_t ptr_copy_bench() {
+    auto p = Traits::make();
+    std::vector<decltype(p)> refs(total_iters);
+
+    perf_tests::start_measuring_time();
+    for (auto& r : refs) {
+        r = p;
+    }
+    for (auto& r : refs) {
+        r = nullptr;
+    }
+    perf_tests::stop_measuring_time();
+    return total_iters;
+}
+
+template <typename Traits>
+size_t ptr_make_bench() {
+    std::vector<decltype(Traits::make())> ptrs(total_iters);
+
+    perf_tests::start_measuring_time();
+    for (auto& p : ptrs) {
+        p = Traits::make();
+        perf_tests::do_not_optimize(p->x);
+    }
+    for (auto& p : ptrs) {
+        p = nullptr;
+    }
+    perf_tests::stop_measuring_time();
+    return total_iters;
+}
+
+PERF_TEST_F(container_perf, ptr_copy_lw_shared_ptr) {
+    return ptr_copy_bench<lw_shared_ptr_traits>();
+}
+
+PERF_TEST_F(container_perf, ptr_copy_shared_ptr) {
+    return ptr_copy_bench<shared_ptr_traits>();
+}
+
+PERF_TEST_F(container_perf, ptr_copy_shared_ptr_esft) {
+    return ptr_copy_bench<shared_ptr_esft_traits>();
+}
+
+PERF_TEST_F(container_perf, ptr_copy_intrusive_ptr) {
+    return ptr_copy_bench<intrusive_ptr_traits>();
+}
+
+PERF_TEST_F(container_perf, ptr_make_lw_shared_ptr) {
+    return ptr_make_bench<lw_shared_ptr_traits>();
+}
+
+PERF_TEST_F(container_perf, ptr_make_shared_ptr) {
+    return ptr_make_bench<shared_ptr_traits>();
+}
+
+PERF_TEST_F(container_perf, ptr_make_shared_ptr_esft) {
+    return ptr_make_bench<shared_ptr_esft_traits>();
+}
+
+PERF_TEST_F(container_perf, ptr_make_intrusive_ptr) {
+    return ptr_make_bench<intrusive_ptr_traits>();
+}
@@ -113,6 +113,16 @@ PERF_TEST_F(chain, then_value)
     return f.then([] { return scale; });
 }
 
+// Most chains are short, they share one arena past their first continuation
+PERF_TEST_F(chain, then_value_short)
+{
+    static constexpr int depth = 4;
+    promise<> p;
+    auto f = do_then(p.get_future(), depth);
+    p.set_value();
+    return f.then([] { return depth; });
+}
+
 PERF_TEST_F(chain, await_value)
 {
     promise<> p;
@@ -0,0 +1,67 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/http/request_parser.hh>
+
+using namespace seastar;
+
+struct http_request_parsing {
+    // a typical small GET from a browser
+    static constexpr std::string_view small_get =
+        "GET /api/v1/items?limit=20 HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+        "Accept-Language: en-US,en;q=0.5\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Connection: keep-alive\r\n"
+        "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark\r\n"
+        "\r\n";
+    static constexpr size_t iterations = 1000;
+
+    http_request_parser parser;
+
+    // Parses the request in buffers of at most chunk bytes
+    size_t parse(size_t chunk) {
+        for (size_t i = 0; i < iterations; ++i) {
+            parser.init();
+            for (size_t pos = 0; pos < small_get.size(); pos += chunk) {
+                auto n = std::min(chunk, small_get.size() - pos);
+                if (parser(temporary_buffer<char>(small_get.data() + pos, n)).get().has_value()) {
+                    break;
+                }
+            }
+            perf_tests::do_not_optimize(parser.get_parsed_request());
+        }
+        return iterations;
+    }
+};
+
+// The whole head in one buffer, parsed by the vectorized fast path
+PERF_TEST_F(http_request_parsing, small_get_whole) {
+    return parse(small_get.size());
+}
+
+// Split over two buffers, parsed by the state machine
+PERF_TEST_F(http_request_parsing, small_get_split) {
+    return parse(small_get.size() / 2 + 1);
+}
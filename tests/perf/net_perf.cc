@@ -0,0 +1,417 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+/*
+ * End-to-end network benchmarks. A server and its clients run on every shard
+ * of one process, and talk over the loopback interface through the network
+ * stack the process is started with: --network-stack posix (the default),
+ * or native where it is available.
+ *
+ * tcp_rr      every connection sends a message and waits for it to be echoed
+ * tcp_stream  every connection sends messages one way, as fast as it can
+ * tls_rr      tcp_rr over TLS (needs --cert and --key)
+ * tls_stream  tcp_stream over TLS (needs --cert and --key)
+ * httpd       http::experimental::client GETs a short reply from httpd
+ *
+ * After a warmup, every test reports the requests (or messages) per second,
+ * the throughput, the latency percentiles for the request/response tests,
+ * and the reactor busy time per request summed over all shards, which is
+ * the CPU cost of the client and the server together.
+ */
+
+#include <seastar/core/seastar.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/app-template.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/loop.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/net/api.hh>
+#include <seastar/net/tls.hh>
+#include <seastar/http/httpd.hh>
+#include <seastar/http/client.hh>
+#include <seastar/http/request.hh>
+#include <seastar/http/function_handlers.hh>
+#include <seastar/util/defer.hh>
+#include <fmt/core.h>
+#include <array>
+#include <bit>
+#include <optional>
+#include <ranges>
+#include <vector>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+using clock_type = std::chrono::steady_clock;
+
+// Latencies in usec, in buckets of 1/16th of a power of two
+class latency_histogram {
+    static constexpr unsigned sub_bucket_bits = 4;
+    static constexpr unsigned sub_buckets = 1 << sub_bucket_bits;
+    std::array<uint64_t, 64 * sub_buckets> _buckets = {};
+    uint64_t _count = 0;
+
+    static unsigned bucket_of(uint64_t usec) noexcept {
+        if (usec < sub_buckets) {
+            return usec;
+        }
+        unsigned shift = std::bit_width(usec) - 1 - sub_bucket_bits;
+        return (shift + 1) * sub_buckets + ((usec >> shift) - sub_buckets);
+    }
+
+    static uint64_t value_of(unsigned bucket) noexcept {
+        if (bucket < sub_buckets) {
+            return bucket;
+        }
+        unsigned shift = bucket / sub_buckets - 1;
+        return ((uint64_t(bucket % sub_buckets + sub_buckets + 1)) << shift) - 1;
+    }
+
+public:
+    void add(clock_type::duration latency) noexcept {
+        _buckets[bucket_of(std::chrono::duration_cast<std::chrono::microseconds>(latency).count())]++;
+        _count++;
+    }
+
+    latency_histogram& operator+=(const latency_histogram& o) noexcept {
+        for (unsigned i = 0; i < _buckets.size(); i++) {
+            _buckets[i] += o._buckets[i];
+        }
+        _count += o._count;
+        return *this;
+    }
+
+    uint64_t count() const noexcept {
+        return _count;
+    }
+
+    uint64_t quantile(double q) const noexcept {
+        uint64_t seen = 0;
+        for (unsigned i = 0; i < _buckets.size(); i++) {
+            seen += _buckets[i];
+            if (seen > 0 && seen >= q * _count) {
+                return value_of(i);
+            }
+        }
+        return 0;
+    }
+};
+
+struct test_config {
+    bool tls = false;
+    bool echo = true;
+    size_t size = 64;
+    unsigned connections = 16;
+    uint16_t port = 10000;
+    shared_ptr<tls::server_credentials> server_creds;
+    shared_ptr<tls::certificate_credentials> client_creds;
+};
+
+struct client_stats {
+    uint64_t requests = 0;
+    uint64_t bytes = 0;
+    latency_histogram latencies;
+
+    client_stats& operator+=(const client_stats& o) {
+        requests += o.requests;
+        bytes += o.bytes;
+        latencies += o.latencies;
+        return *this;
+    }
+};
+
+class stream_server {
+    test_config _cfg;
+    std::optional<server_socket> _listener;
+    gate _connections;
+
+    future<> handle(connected_socket s) {
+        auto in = s.input();
+        auto out = s.output();
+        std::exception_ptr ex;
+        try {
+            while (true) {
+                auto buf = co_await in.read_exactly(_cfg.size);
+                if (buf.size() < _cfg.size) {
+                    break;
+                }
+                if (_cfg.echo) {
+                    co_await out.write(std::move(buf));
+                    co_await out.flush();
+                }
+            }
+        } catch (...) {
+            ex = std::current_exception();
+        }
+        co_await out.close();
+        co_await in.close();
+        if (ex) {
+            fmt::print("server connection failed: {}\n", ex);
+        }
+    }
+
+public:
+    explicit stream_server(test_config cfg) : _cfg(std::move(cfg)) {}
+
+    future<> start() {
+        listen_options lo;
+        lo.reuse_address = true;
+        auto addr = socket_address(ipv4_addr("127.0.0.1", _cfg.port));
+        _listener = _cfg.tls ? tls::listen(_cfg.server_creds, addr, lo) : seastar::listen(addr, lo);
+        (void)keep_doing([this] {
+            return _listener->accept().then([this] (accept_result ar) {
+                (void)with_gate(_connections, [this, s = std::move(ar.connection)] () mutable {
+                    return handle(std::move(s));
+                });
+            });
+        }).handle_exception([] (std::exception_ptr) {
+            // the listener was aborted by stop()
+        });
+        return make_ready_future<>();
+    }
+
+    future<> stop() {
+        if (_listener) {
+            _listener->abort_accept();
+        }
+        return _connections.close();
+    }
+};
+
+class stream_client {
+    test_config _cfg;
+    client_stats _stats;
+
+    future<connected_socket> connect() {
+        auto addr = socket_address(ipv4_addr("127.0.0.1", _cfg.port));
+        if (_cfg.tls) {
+            return tls::connect(_cfg.client_creds, addr, tls::tls_options{.server_name = "localhost"});
+        }
+        return seastar::connect(addr);
+    }
+
+    future<> run_connection(clock_type::time_point measure, clock_type::time_point end) {
+        auto s = co_await connect();
+        auto in = s.input();
+        auto out = s.output();
+        auto msg = temporary_buffer<char>(_cfg.size);
+        std::fill_n(msg.get_write(), msg.size(), 'x');
+        std::exception_ptr ex;
+        try {
+            while (clock_type::now() < end) {
+                auto start = clock_type::now();
+                co_await out.write(msg.share());
+                if (_cfg.echo) {
+                    co_await out.flush();
+                    auto reply = co_await in.read_exactly(_cfg.size);
+                    if (reply.size() < _cfg.size) {
+                        throw std::runtime_error("server closed the connection");
+                    }
+                }
+                auto now = clock_type::now();
+                if (start >= measure) {
+                    _stats.requests++;
+                    _stats.bytes += _cfg.size;
+                    if (_cfg.echo) {
+                        _stats.latencies.add(now - start);
+                    }
+                }
+            }
+            co_await out.flush();
+        } catch (...) {
+            ex = std::current_exception();
+        }
+        co_await out.close();
+        co_await in.close();
+        if (ex) {
+            std::rethrow_exception(ex);
+        }
+    }
+
+public:
+    explicit stream_client(test_config cfg) : _cfg(std::move(cfg)) {}
+
+    future<> run(clock_type::time_point measure, clock_type::time_point end) {
+        return parallel_for_each(std::views::iota(0u, _cfg.connections), [this, measure, end] (unsigned) {
+            return run_connection(measure, end);
+        });
+    }
+
+    client_stats stats() const {
+        return _stats;
+    }
+};
+
+class http_client {
+    test_config _cfg;
+    http::experimental::client _client;
+    client_stats _stats;
+
+public:
+    explicit http_client(test_config cfg)
+            : _cfg(std::move(cfg))
+            , _client(socket_address(ipv4_addr("127.0.0.1", _cfg.port)))
+    {}
+
+    future<> run_requests(clock_type::time_point measure, clock_type::time_point end) {
+        while (clock_type::now() < end) {
+            auto start = clock_type::now();
+            size_t size = 0;
+            co_await _client.make_request(http::request::make("GET", "localhost", "/"), [&size] (const http::reply& rep, input_stream<char>&& in) {
+                return do_with(std::move(in), [&size] (input_stream<char>& in) {
+                    return in.read_exactly(2).then([&size] (temporary_buffer<char> buf) {
+                        size = buf.size();
+                    });
+                });
+            }, http::reply::status_type::ok);
+            if (start >= measure) {
+                _stats.requests++;
+                _stats.bytes += size;
+                _stats.latencies.add(clock_type::now() - start);
+            }
+        }
+    }
+
+    future<> run(clock_type::time_point measure, clock_type::time_point end) {
+        return parallel_for_each(std::views::iota(0u, _cfg.connections), [this, measure, end] (unsigned) {
+            return run_requests(measure, end);
+        });
+    }
+
+    future<> stop() {
+        return _client.close();
+    }
+
+    client_stats stats() const {
+        return _stats;
+    }
+};
+
+static future<std::chrono::nanoseconds> total_busy_time() {
+    return map_reduce(std::views::iota(0u, smp::count), [] (unsigned shard) {
+        return smp::submit_to(shard, [] {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(engine().total_busy_time());
+        });
+    }, std::chrono::nanoseconds(0), std::plus<std::chrono::nanoseconds>());
+}
+
+static void report(const sstring& name, const client_stats& st, std::chrono::duration<double> elapsed, std::chrono::nanoseconds busy) {
+    auto rate = st.requests / elapsed.count();
+    fmt::print("{:<12} {:>12.0f} req/s {:>10.1f} MiB/s", name, rate, st.bytes / elapsed.count() / (1 << 20));
+    if (st.latencies.count()) {
+        fmt::print("  p50 {:>6} us  p99 {:>6} us  p99.9 {:>6} us", st.latencies.quantile(0.5), st.latencies.quantile(0.99), st.latencies.quantile(0.999));
+    }
+    fmt::print("  {:.2f} us busy/req\n", st.requests ? std::chrono::duration<double, std::micro>(busy).count() / st.requests : 0.);
+}
+
+// Runs the clients on every shard against the server, which is already up
+template <typename Client>
+static void run_test(const sstring& name, test_config cfg, std::chrono::duration<double> warmup, std::chrono::duration<double> duration) {
+    sharded<Client> clients;
+    clients.start(cfg).get();
+    auto stop_clients = defer([&clients] () noexcept { clients.stop().get(); });
+
+    auto measure = clock_type::now() + std::chrono::duration_cast<clock_type::duration>(warmup);
+    auto end = measure + std::chrono::duration_cast<clock_type::duration>(duration);
+    auto done = clients.invoke_on_all([measure, end] (Client& c) {
+        return c.run(measure, end);
+    });
+    seastar::sleep(std::chrono::duration_cast<std::chrono::microseconds>(warmup)).get();
+    auto busy_start = total_busy_time().get();
+    done.get();
+    auto busy = total_busy_time().get() - busy_start;
+
+    auto st = clients.map_reduce0(std::mem_fn(&Client::stats), client_stats{}, [] (client_stats a, const client_stats& b) {
+        return a += b;
+    }).get();
+    report(name, st, duration, busy);
+}
+
+int main(int ac, char** av) {
+    namespace bpo = boost::program_options;
+    app_template app;
+    app.add_options()
+        ("test", bpo::value<std::vector<sstring>>()->default_value({"tcp_rr", "tcp_stream", "httpd"}, "tcp_rr tcp_stream httpd"),
+            "tests to run: tcp_rr, tcp_stream, tls_rr, tls_stream, httpd")
+        ("size", bpo::value<size_t>()->default_value(64), "message size for the tcp and tls tests")
+        ("connections", bpo::value<unsigned>()->default_value(16), "connections (or concurrent requests for httpd) per shard")
+        ("duration", bpo::value<unsigned>()->default_value(10), "seconds to measure each test for")
+        ("warmup", bpo::value<unsigned>()->default_value(2), "seconds to warm up each test for")
+        ("port", bpo::value<uint16_t>()->default_value(10000), "loopback port to listen on")
+        ("cert", bpo::value<sstring>(), "server certificate file (PEM) for the tls tests")
+        ("key", bpo::value<sstring>(), "server key file (PEM) for the tls tests")
+        ("ca", bpo::value<sstring>(), "trust file (PEM) for the tls clients, the certificate itself by default")
+        ;
+
+    return app.run(ac, av, [&app] {
+        return seastar::async([&app] {
+            auto& opts = app.configuration();
+            auto duration = std::chrono::seconds(opts["duration"].as<unsigned>());
+            auto warmup = std::chrono::seconds(opts["warmup"].as<unsigned>());
+            test_config cfg;
+            cfg.size = opts["size"].as<size_t>();
+            cfg.connections = opts["connections"].as<unsigned>();
+            cfg.port = opts["port"].as<uint16_t>();
+
+            fmt::print("{} shards, {} connections per shard, {} byte messages\n", smp::count, cfg.connections, cfg.size);
+            for (auto& test : opts["test"].as<std::vector<sstring>>()) {
+                auto tcfg = cfg;
+                if (test.starts_with("tls_")) {
+                    if (!opts.count("cert") || !opts.count("key")) {
+                        fmt::print("{:<12} skipped, needs --cert and --key\n", test);
+                        continue;
+                    }
+                    tcfg.tls = true;
+                    tcfg.server_creds = make_shared<tls::server_credentials>();
+                    tcfg.server_creds->set_x509_key_file(opts["cert"].as<sstring>(), opts["key"].as<sstring>(), tls::x509_crt_format::PEM).get();
+                    tcfg.client_creds = make_shared<tls::certificate_credentials>();
+                    auto ca = opts.count("ca") ? opts["ca"].as<sstring>() : opts["cert"].as<sstring>();
+                    tcfg.client_creds->set_x509_trust_file(ca, tls::x509_crt_format::PEM).get();
+                }
+                if (test == "tcp_rr" || test == "tls_rr" || test == "tcp_stream" || test == "tls_stream") {
+                    tcfg.echo = test.ends_with("_rr");
+                    sharded<stream_server> server;
+                    server.start(tcfg).get();
+                    auto stop_server = defer([&server] () noexcept { server.stop().get(); });
+                    server.invoke_on_all(&stream_server::start).get();
+                    run_test<stream_client>(test, tcfg, warmup, duration);
+                } else if (test == "httpd") {
+                    httpd::http_server_control server;
+                    server.start("net_perf").get();
+                    auto stop_server = defer([&server] () noexcept { server.stop().get(); });
+                    server.set_routes([] (httpd::routes& r) {
+                        r.add(httpd::operation_type::GET, httpd::url("/"), new httpd::function_handler([] (httpd::const_req req) {
+                            return sstring("ok");
+                        }, "txt"));
+                    }).get();
+                    listen_options lo;
+                    lo.reuse_address = true;
+                    server.listen(socket_address(ipv4_addr("127.0.0.1", tcfg.port)), lo).get();
+                    run_test<http_client>(test, tcfg, warmup, duration);
+                } else {
+                    fmt::print("{:<12} unknown test\n", test);
+                }
+            }
+        });
+    });
+}
@@ -0,0 +1,94 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/net/packet.hh>
+#include <array>
+
+using namespace seastar;
+
+// Builds packets the way the network stack and RPC do: a payload, a few
+// headers prepended to it, and sometimes more fragments appended.
+
+struct packet_perf {
+    static constexpr size_t iterations = 1000;
+
+    std::array<char, 64> small_payload = {};
+    std::array<char, 1500> large_payload = {};
+
+    net::fragment small() noexcept {
+        return net::fragment{small_payload.data(), small_payload.size()};
+    }
+    net::fragment large() noexcept {
+        return net::fragment{large_payload.data(), large_payload.size()};
+    }
+};
+
+// Copies a small payload, and prepends a TCP, an IP and an Ethernet header
+PERF_TEST_F(packet_perf, small_with_headers) {
+    for (size_t i = 0; i != iterations; ++i) {
+        net::packet p(small());
+        p.prepend_uninitialized_header(20);
+        p.prepend_uninitialized_header(20);
+        p.prepend_uninitialized_header(14);
+        perf_tests::do_not_optimize(p);
+    }
+    return iterations;
+}
+
+// A frame header, then a few buffers of arguments, as an RPC message
+PERF_TEST_F(packet_perf, rpc_message) {
+    for (size_t i = 0; i != iterations; ++i) {
+        net::packet p;
+        for (int j = 0; j != 3; ++j) {
+            p = net::packet(std::move(p), small(), deleter());
+        }
+        p.prepend_uninitialized_header(28);
+        perf_tests::do_not_optimize(p);
+    }
+    return iterations;
+}
+
+// A payload of many fragments, more than the small impls hold
+PERF_TEST_F(packet_perf, many_fragments) {
+    for (size_t i = 0; i != iterations; ++i) {
+        net::packet p;
+        for (int j = 0; j != 16; ++j) {
+            p = net::packet(std::move(p), large(), deleter());
+        }
+        p.prepend_uninitialized_header(54);
+        perf_tests::do_not_optimize(p);
+    }
+    return iterations;
+}
+
+// Shares a packet and destroys the copy, as retransmission queues do
+PERF_TEST_F(packet_perf, share) {
+    net::packet p;
+    for (int j = 0; j != 4; ++j) {
+        p = net::packet(std::move(p), large(), deleter());
+    }
+    for (size_t i = 0; i != iterations; ++i) {
+        auto s = p.share(100, 3000);
+        perf_tests::do_not_optimize(s);
+    }
+    return iterations;
+}
@@ -21,6 +21,7 @@
 
 #include <seastar/testing/perf_tests.hh>
 
+#include <cmath>
 #include <cstdio>
 #include <fstream>
 #include <regex>
@@ -31,6 +32,7 @@
 #include <boost/range/algorithm.hpp>
 
 #include <fmt/ostream.h>
+#include <yaml-cpp/yaml.h>
 
 #include <seastar/core/app-template.hh>
 #include <seastar/core/thread.hh>
@@ -180,8 +182,74 @@ struct result {
     double tasks = 0.;
     double inst = 0.;
     double cycles = 0.;
+
+    // per-run values, for baselines and comparisons
+    std::vector<double> time_runs;
+    std::vector<double> allocs_runs;
+    std::vector<double> tasks_runs;
+    std::vector<double> inst_runs;
+    std::vector<double> cycles_runs;
+};
+
+// The metrics saved in baselines and compared against them, all of them
+// per iteration, and all of them worse when higher
+static const std::vector<std::pair<std::string, std::vector<double> result::*>> sampled_metrics{
+    {"time",   &result::time_runs},
+    {"allocs", &result::allocs_runs},
+    {"tasks",  &result::tasks_runs},
+    {"inst",   &result::inst_runs},
+    {"cycles", &result::cycles_runs},
 };
 
+static double median_of(std::vector<double> v) {
+    if (v.empty()) {
+        return 0.;
+    }
+    boost::range::sort(v);
+    return v[v.size() / 2];
+}
+
+// Two-sided p-value of the Mann-Whitney U test for the samples coming from
+// the same distribution, with the normal approximation corrected for ties
+static double mann_whitney_p(const std::vector<double>& a, const std::vector<double>& b) {
+    std::vector<std::pair<double, bool>> all;
+    for (auto x : a) {
+        all.emplace_back(x, true);
+    }
+    for (auto x : b) {
+        all.emplace_back(x, false);
+    }
+    boost::range::sort(all);
+    double n1 = a.size();
+    double n2 = b.size();
+    double n = n1 + n2;
+    double rank_sum = 0.;
+    double ties = 0.;
+    for (size_t i = 0; i < all.size();) {
+        size_t j = i;
+        while (j < all.size() && all[j].first == all[i].first) {
+            j++;
+        }
+        // ranks i+1..j share their average
+        double rank = (i + 1 + j) / 2.;
+        for (size_t k = i; k < j; k++) {
+            if (all[k].second) {
+                rank_sum += rank;
+            }
+        }
+        double t = j - i;
+        ties += t * t * t - t;
+        i = j;
+    }
+    double u = rank_sum - n1 * (n1 + 1) / 2;
+    double sigma = std::sqrt(n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1))));
+    if (sigma == 0.) {
+        return 1.;
+    }
+    double z = std::max(std::fabs(u - n1 * n2 / 2) - 0.5, 0.) / sigma;
+    return std::erfc(z / std::sqrt(2.));
+}
+
 
 struct duration {
     double value;
@@ -346,6 +414,83 @@ class json_printer final : public result_printer {
     }
 };
 
+// Saves the per-run values of every test, to be compared against later
+class baseline_printer final : public result_printer {
+    std::string _output_file;
+    std::unordered_map<std::string,
+                       std::unordered_map<std::string,
+                                          std::unordered_map<std::string, std::vector<double>>>> _root;
+public:
+    explicit baseline_printer(const std::string& file) : _output_file(file) { }
+
+    ~baseline_printer() {
+        std::ofstream out(_output_file);
+        out << json::formatter::to_json(_root);
+    }
+
+    virtual void print_configuration(const config&) override { }
+
+    virtual void print_result(const result& r) override {
+        auto& result = _root["results"][r.test_name];
+        for (auto& [name, runs] : sampled_metrics) {
+            result[name] = r.*runs;
+        }
+    }
+};
+
+// Compares every test against a baseline, and reports the metrics whose
+// change is statistically significant
+class comparison_printer final : public result_printer {
+    std::unordered_map<std::string, std::unordered_map<std::string, std::vector<double>>> _baseline;
+    double _significance;
+    unsigned _regressions = 0;
+public:
+    comparison_printer(const std::string& file, double significance) : _significance(significance) {
+        // JSON is YAML, as far as the baselines go
+        auto doc = YAML::LoadFile(file);
+        for (auto&& test : doc["results"]) {
+            auto& metrics = _baseline[test.first.as<std::string>()];
+            for (auto&& metric : test.second) {
+                metrics[metric.first.as<std::string>()] = metric.second.as<std::vector<double>>();
+            }
+        }
+    }
+
+    unsigned regressions() const noexcept {
+        return _regressions;
+    }
+
+    virtual void print_configuration(const config& c) override {
+        if (c.number_of_runs < 5) {
+            fmt::print("warning: {} runs are too few for the comparison to find significant changes\n", c.number_of_runs);
+        }
+    }
+
+    virtual void print_result(const result& r) override {
+        auto test = _baseline.find(r.test_name);
+        if (test == _baseline.end()) {
+            fmt::print("{:<{}} not in the baseline\n", r.test_name, name_column_length());
+            return;
+        }
+        for (auto& [name, runs] : sampled_metrics) {
+            auto base = test->second.find(name);
+            if (base == test->second.end() || base->second.empty() || (r.*runs).empty()) {
+                continue;
+            }
+            auto before = median_of(base->second);
+            auto after = median_of(r.*runs);
+            auto p = mann_whitney_p(base->second, r.*runs);
+            if (p >= _significance || before == after) {
+                continue;
+            }
+            bool regression = after > before;
+            _regressions += regression;
+            fmt::print("{:<{}} {:>6} {} {:.3f} -> {:.3f} ({:+.1f}%, p={:.4f})\n", r.test_name, name_column_length(), name,
+                    regression ? "regressed" : "improved ", before, after, before ? (after - before) * 100 / before : 0., p);
+        }
+    }
+};
+
 class markdown_printer final : public result_printer {
     std::FILE* _output = nullptr;
 
@@ -431,10 +576,14 @@ void performance_test::do_run(const config& conf)
 
                 total_iterations += _single_run_iterations;
 
-                r.allocs += double(rr.stats.allocations) / _single_run_iterations;
-                r.tasks += double(rr.stats.tasks_executed) / _single_run_iterations;
-                r.inst += double(rr.stats.instructions_retired) / _single_run_iterations;
-                r.cycles += double(rr.stats.cpu_cycles_retired) / _single_run_iterations;
+                r.allocs_runs.push_back(double(rr.stats.allocations) / _single_run_iterations);
+                r.tasks_runs.push_back(double(rr.stats.tasks_executed) / _single_run_iterations);
+                r.inst_runs.push_back(double(rr.stats.instructions_retired) / _single_run_iterations);
+                r.cycles_runs.push_back(double(rr.stats.cpu_cycles_retired) / _single_run_iterations);
+                r.allocs += r.allocs_runs.back();
+                r.tasks += r.tasks_runs.back();
+                r.inst += r.inst_runs.back();
+                r.cycles += r.cycles_runs.back();
             });
         }).get();
     }
@@ -442,6 +591,7 @@ void performance_test::do_run(const config& conf)
     r.test_name = name();
     r.total_iterations = total_iterations;
     r.runs = conf.number_of_runs;
+    r.time_runs = results;
 
     auto mid = conf.number_of_runs / 2;
 
@@ -534,6 +684,11 @@ int main(int ac, char** av)
         ("no-stdout", "do not print to stdout")
         ("json-output", bpo::value<std::string>(), "output json file")
         ("md-output", bpo::value<std::string>(), "output markdown file")
+        ("baseline-output", bpo::value<std::string>(), "save the results of every run to a json baseline file")
+        ("compare", bpo::value<std::string>(), "report the significant changes against a json baseline file")
+        ("significance", bpo::value<double>()->default_value(0.05),
+            "p-value below which a change against the baseline is significant")
+        ("fail-on-regression", "exit with an error if any test regressed against the baseline")
         ("list", "list available tests")
         ;
 
@@ -558,7 +713,7 @@ int main(int ac, char** av)
                 for (auto&& t : all_tests()) {
                     fmt::print("\t{}\n", t->name());
                 }
-                return;
+                return 0;
             }
 
             if (!app.configuration().count("no-stdout")) {
@@ -577,6 +732,22 @@ int main(int ac, char** av)
                 ));
             }
 
+            if (app.configuration().count("baseline-output")) {
+                conf.printers.emplace_back(std::make_unique<baseline_printer>(
+                    app.configuration()["baseline-output"].as<std::string>()
+                ));
+            }
+
+            comparison_printer* comparison = nullptr;
+            if (app.configuration().count("compare")) {
+                auto cp = std::make_unique<comparison_printer>(
+                    app.configuration()["compare"].as<std::string>(),
+                    app.configuration()["significance"].as<double>()
+                );
+                comparison = cp.get();
+                conf.printers.emplace_back(std::move(cp));
+            }
+
             if (!conf.random_seed) {
                 conf.random_seed = std::random_device()();
             }
@@ -586,6 +757,12 @@ int main(int ac, char** av)
             }).get();
 
             run_all(tests_to_run, conf);
+
+            if (comparison && comparison->regressions() && app.configuration().count("fail-on-regression")) {
+                fmt::print("{} regressions against the baseline\n", comparison->regressions());
+                return 1;
+            }
+            return 0;
         });
     });
 }
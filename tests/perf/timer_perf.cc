@@ -0,0 +1,132 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#include <seastar/testing/perf_tests.hh>
+#include <seastar/core/timer-set.hh>
+#include <seastar/core/timer-wheel.hh>
+#include <chrono>
+#include <random>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// Compares timer_set and timer_wheel holding a million armed timeouts,
+// like per-request deadlines which are mostly cancelled before they fire.
+
+struct perf_clock {
+    using duration = std::chrono::nanoseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<perf_clock, duration>;
+    static time_point now() noexcept { return {}; }
+};
+
+struct perf_timer {
+    using clock = perf_clock;
+    using duration = clock::duration;
+    using time_point = clock::time_point;
+
+    boost::intrusive::list_member_hook<> link;
+    time_point timeout;
+    bool _expired = false;
+
+    time_point get_timeout() const noexcept { return timeout; }
+    // The sets are cleared before they are destroyed
+    void cancel() noexcept {}
+};
+
+template <typename Set>
+struct timers {
+    static constexpr size_t armed = 1'000'000;
+    static constexpr size_t batch = 1000;
+
+    Set set;
+    std::vector<perf_timer> background;
+    std::vector<perf_timer> foreground;
+    perf_clock::time_point now;
+    std::default_random_engine rnd;
+
+    perf_clock::duration random_timeout() {
+        return std::uniform_int_distribution<int64_t>(1, 600'000)(rnd) * 1ms;
+    }
+
+    timers() : background(armed), foreground(batch), now(1s) {
+        set.expire(now);
+        for (auto& t : background) {
+            t.timeout = now + random_timeout();
+            set.insert(t);
+        }
+        for (auto& t : foreground) {
+            t.timeout = now + random_timeout();
+        }
+    }
+
+    ~timers() {
+        set.clear();
+    }
+
+    size_t arm_cancel() {
+        perf_tests::start_measuring_time();
+        for (auto& t : foreground) {
+            set.insert(t);
+        }
+        for (auto& t : foreground) {
+            set.remove(t);
+        }
+        perf_tests::stop_measuring_time();
+        return foreground.size();
+    }
+
+    // Advances the clock by a millisecond, rearming the timers which
+    // expired so that the number of armed timers stays the same
+    size_t expire() {
+        now += 1ms;
+        perf_tests::start_measuring_time();
+        auto expired = set.expire(now);
+        perf_tests::stop_measuring_time();
+        while (!expired.empty()) {
+            auto& t = expired.front();
+            expired.pop_front();
+            t.timeout = now + random_timeout();
+            set.insert(t);
+        }
+        return 1;
+    }
+};
+
+struct timer_set_perf : timers<seastar::timer_set<perf_timer, &perf_timer::link>> {};
+struct timer_wheel_perf : timers<seastar::timer_wheel<perf_timer, &perf_timer::link>> {};
+
+PERF_TEST_F(timer_set_perf, arm_cancel) {
+    return arm_cancel();
+}
+
+PERF_TEST_F(timer_wheel_perf, arm_cancel) {
+    return arm_cancel();
+}
+
+PERF_TEST_F(timer_set_perf, expire) {
+    return expire();
+}
+
+PERF_TEST_F(timer_wheel_perf, expire) {
+    return expire();
+}
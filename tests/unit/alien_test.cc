@@ -84,6 +84,25 @@ int main(int argc, char** argv)
         for (auto& count : counts) {
             total += count.get();
         }
+        // test for alien::batch, sending to a bounded queue
+        app.alien().set_max_pending(4);
+        std::vector<std::future<int>> batched;
+        {
+            alien::batch batch(app.alien(), 0, 3, std::chrono::hours(1));
+            for (int i = 0; i < 10; i++) {
+                batched.push_back(batch.submit_to([i] {
+                    return seastar::make_ready_future<int>(i);
+                }));
+            }
+            // the last message is sent by the destructor
+            if (batch.size() != 1) {
+                throw std::runtime_error("batch did not send full batches");
+            }
+        }
+        for (auto& b : batched) {
+            total += b.get();
+        }
+        app.alien().set_max_pending(0);
         // i am done. dismiss the engine
         ::eventfd_write(alien_done, ALIEN_DONE);
         return std::make_tuple(answer.get(), total);
@@ -123,7 +142,7 @@ int main(int argc, char** argv)
         return 1;
     }
     const auto shards = std::views::iota(0u, smp::count);
-    auto expected = std::accumulate(std::begin(shards), std::end(shards), 0);
+    auto expected = std::accumulate(std::begin(shards), std::end(shards), 0) + 45;
     if (total != expected) {
         std::cerr << "Bad total: " << total << " != " << expected << std::endl;
         return 1;
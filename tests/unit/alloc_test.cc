@@ -20,17 +20,23 @@
  */
 
 #include <seastar/core/memory.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/with_scheduling_group.hh>
 #include <seastar/core/shard_id.hh>
 #include <seastar/core/smp.hh>
 #include <seastar/core/temporary_buffer.hh>
 #include <seastar/testing/perf_tests.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
+#include <seastar/util/later.hh>
 #include <seastar/util/log.hh>
 #include <seastar/util/memory_diagnostics.hh>
 
+#include <algorithm>
 #include <memory>
+#include <memory_resource>
 #include <new>
+#include <string>
 #include <vector>
 #include <future>
 #include <iostream>
@@ -100,6 +106,171 @@ SEASTAR_TEST_CASE(test_live_objects_counter_with_cross_cpu_free) {
     });
 }
 
+SEASTAR_TEST_CASE(test_cross_cpu_frees_are_batched) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    if (smp::count < 2) {
+        return make_ready_future<>();
+    }
+    return smp::submit_to(1, [] {
+        auto ret = std::vector<std::unique_ptr<int>>(1000);
+        for (auto& o : ret) {
+            o = std::make_unique<int>(0);
+        }
+        return ret;
+    }).then([] (auto&& vec) {
+        memory::drain_cross_cpu_freelist();
+        auto before = memory::stats();
+        vec.clear();
+        memory::drain_cross_cpu_freelist();
+        auto after = memory::stats();
+        BOOST_REQUIRE_EQUAL(after.cross_cpu_frees() - before.cross_cpu_frees(), 1000);
+        auto batches = after.cross_cpu_free_batches() - before.cross_cpu_free_batches();
+        BOOST_REQUIRE_GT(batches, 0);
+        BOOST_REQUIRE_LT(batches, 100);
+    });
+#else
+    return make_ready_future<>();
+#endif
+}
+
+SEASTAR_TEST_CASE(test_medium_span_reuse) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    for (size_t size : {32 << 10, 64 << 10, 128 << 10, 1 << 20}) {
+        auto p = malloc(size);
+        BOOST_REQUIRE(p);
+        free(p);
+        // Recently freed spans are cached and handed out again
+        auto q = malloc(size);
+        BOOST_REQUIRE_EQUAL(p, q);
+        free(q);
+    }
+#endif
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_memory_lending) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    static constexpr size_t unit = 32 << 20;
+    static constexpr size_t amount = 8 * unit;
+    auto lend = [] {
+        auto total = memory::stats().total_memory();
+        auto lent = memory::lend_free_memory(0, amount);
+        BOOST_REQUIRE_LE(lent, amount);
+        BOOST_REQUIRE_EQUAL(lent % unit, 0);
+        BOOST_REQUIRE_EQUAL(memory::backing_stats().lent, lent);
+        BOOST_REQUIRE_EQUAL(memory::stats().total_memory(), total - lent);
+        return lent;
+    };
+
+    // Lent memory is taken back by the lender, a whole unit at a time
+    auto lent = lend();
+    BOOST_REQUIRE_GE(lent, unit);
+    BOOST_REQUIRE_GE(memory::lendable_memory(), lent);
+    BOOST_REQUIRE_EQUAL(memory::borrow_memory(1), unit);
+    BOOST_REQUIRE_EQUAL(memory::borrow_memory(lent), lent - unit);
+    BOOST_REQUIRE_EQUAL(memory::backing_stats().lent, 0);
+    BOOST_REQUIRE_EQUAL(memory::lendable_memory(), 0);
+
+    if (smp::count < 2) {
+        co_return;
+    }
+    // Or taken over by another shard, which grows by as much, while the
+    // objects it already had stay readable by the others
+    auto obj = std::make_unique<char[]>(100);
+    auto obj_size = ::malloc_usable_size(obj.get());
+    lent = co_await smp::submit_to(1, [&] { return lend(); });
+    auto total = memory::stats().total_memory();
+    auto end = memory::get_memory_layout().end;
+    auto borrowed = memory::borrow_memory(lent);
+    BOOST_REQUIRE_EQUAL(borrowed, lent);
+    BOOST_REQUIRE_EQUAL(memory::stats().total_memory(), total + borrowed);
+    BOOST_REQUIRE_EQUAL(memory::backing_stats().borrowed, borrowed);
+    BOOST_REQUIRE_EQUAL(memory::get_memory_layout().end, end + borrowed);
+    co_await smp::submit_to(1, [&] {
+        BOOST_REQUIRE_EQUAL(::malloc_usable_size(obj.get()), obj_size);
+    });
+
+    // Memory going back and forth doesn't grow the shards any further: each
+    // takes its own lent spans back first
+    end = memory::get_memory_layout().end;
+    auto end1 = co_await smp::submit_to(1, [] { return memory::get_memory_layout().end; });
+    for (int i = 0; i < 3; ++i) {
+        auto back = memory::lend_free_memory(0, borrowed);
+        co_await smp::submit_to(1, [back] {
+            BOOST_REQUIRE_EQUAL(memory::borrow_memory(back), back);
+            memory::lend_free_memory(0, back);
+        });
+        memory::borrow_memory(memory::lendable_memory());
+    }
+    BOOST_REQUIRE_EQUAL(memory::get_memory_layout().end, end);
+    co_await smp::submit_to(1, [end1] {
+        BOOST_REQUIRE_EQUAL(memory::get_memory_layout().end, end1);
+        memory::borrow_memory(memory::lendable_memory());
+    });
+    BOOST_REQUIRE_EQUAL(memory::lendable_memory(), 0);
+
+    // Under pressure, a shard borrows in the background before reclaiming
+    lent = co_await smp::submit_to(1, [&] { return lend(); });
+    auto high = memory::high_free_memory();
+    auto borrowed_before = memory::backing_stats().borrowed;
+    memory::set_memory_borrowing(true);
+    memory::set_high_free_pages(memory::free_memory() / memory::page_size + 1);
+    for (int i = 0; i < 100 && memory::backing_stats().borrowed == borrowed_before; ++i) {
+        co_await yield();
+    }
+    memory::set_memory_borrowing(false);
+    memory::set_high_free_pages(high / memory::page_size);
+    BOOST_REQUIRE_EQUAL(memory::backing_stats().borrowed, borrowed_before + unit);
+    BOOST_REQUIRE_EQUAL(memory::lendable_memory(), lent - unit);
+    co_await smp::submit_to(1, [] {
+        memory::borrow_memory(memory::lendable_memory());
+    });
+#else
+    co_return;
+#endif
+}
+
+SEASTAR_TEST_CASE(test_scheduling_group_memory) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    static constexpr size_t size = 1 << 20;
+    auto sg = co_await create_scheduling_group("memory", 100);
+    BOOST_REQUIRE_EQUAL(memory::scheduling_group_memory(sg), 0);
+
+    unsigned exceeded = 0;
+    memory::set_scheduling_group_memory_limit(sg, size * 2, [&exceeded] { exceeded++; });
+    std::vector<void*> bufs;
+    co_await with_scheduling_group(sg, [&bufs] {
+        for (int i = 0; i < 4; i++) {
+            bufs.push_back(malloc(size));
+        }
+        // Small allocations are not charged
+        bufs.push_back(malloc(16));
+    });
+    BOOST_REQUIRE_GE(memory::scheduling_group_memory(sg), size * 4);
+    BOOST_REQUIRE_LT(memory::scheduling_group_memory(sg), size * 5);
+    while (!exceeded) {
+        co_await yield();
+    }
+    BOOST_REQUIRE_EQUAL(exceeded, 1);
+
+    // Charged until freed, in whatever group
+    free(bufs.back());
+    bufs.pop_back();
+    free(bufs.back());
+    bufs.pop_back();
+    BOOST_REQUIRE_GE(memory::scheduling_group_memory(sg), size * 2);
+    BOOST_REQUIRE_LT(memory::scheduling_group_memory(sg), size * 3);
+    for (auto p : bufs) {
+        free(p);
+    }
+    BOOST_REQUIRE_EQUAL(memory::scheduling_group_memory(sg), 0);
+    memory::set_scheduling_group_memory_limit(sg, 0, {});
+    co_await destroy_scheduling_group(sg);
+#else
+    co_return;
+#endif
+}
+
 SEASTAR_TEST_CASE(test_aligned_alloc) {
     for (size_t align = sizeof(void*); align <= 65536; align <<= 1) {
         for (size_t size = align; size <= align * 2; size <<= 1) {
@@ -157,6 +328,147 @@ SEASTAR_TEST_CASE(test_memory_diagnostics) {
     return make_ready_future<>();
 }
 
+SEASTAR_TEST_CASE(test_small_pool_statistics) {
+#ifdef SEASTAR_DEFAULT_ALLOCATOR
+    BOOST_REQUIRE_EQUAL(memory::small_pool_count(), 0);
+#else
+    constexpr size_t size = 200;
+    auto find_pool = [] {
+        for (unsigned i = 0; i < memory::small_pool_count(); ++i) {
+            if (memory::small_pool_statistics(i).object_size >= size) {
+                return i;
+            }
+        }
+        BOOST_FAIL("no small pool found");
+        return 0u;
+    };
+    auto idx = find_pool();
+    auto before = memory::small_pool_statistics(idx);
+    std::vector<std::unique_ptr<char[]>> objs;
+    for (unsigned i = 0; i < 1000; ++i) {
+        objs.emplace_back(new char[size]);
+    }
+    auto during = memory::small_pool_statistics(idx);
+    BOOST_REQUIRE_GE(during.allocs - before.allocs, 1000);
+    BOOST_REQUIRE_GE(during.use_count, 1000);
+    BOOST_REQUIRE_GE(during.memory, during.use_count * during.object_size);
+    BOOST_REQUIRE_GE(during.memory - during.use_count * during.object_size, during.unused);
+    objs.clear();
+    auto after = memory::small_pool_statistics(idx);
+    BOOST_REQUIRE_GE(after.frees - during.frees, 1000);
+    BOOST_REQUIRE_LE(after.use_count, during.use_count - 1000);
+#endif
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_arena) {
+    memory::arena a;
+    BOOST_REQUIRE_EQUAL(a.memory_held(), 0);
+    std::vector<std::pair<char*, size_t>> objs;
+    for (size_t size = 1; size < 100000; size = size * 3 + 1) {
+        for (size_t align = 1; align <= 4096; align <<= 3) {
+            auto p = static_cast<char*>(a.allocate(size, align));
+            BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(p) % align, 0);
+            ::memset(p, objs.size(), size);
+            objs.emplace_back(p, size);
+        }
+    }
+    // Nothing overlaps
+    for (size_t i = 0; i < objs.size(); ++i) {
+        auto [p, size] = objs[i];
+        BOOST_REQUIRE(std::all_of(p, p + size, [i] (char c) { return c == char(i); }));
+    }
+    auto held = a.memory_held();
+    BOOST_REQUIRE_GT(held, 0);
+    a.reset();
+    BOOST_REQUIRE_LE(a.memory_held(), held);
+    BOOST_REQUIRE_GT(a.memory_held(), 0);
+
+    memory::arena_resource mr(a);
+    std::pmr::vector<std::pmr::string> v(&mr);
+    for (int i = 0; i < 1000; ++i) {
+        v.emplace_back(fmt::format("a string too long for the small string optimization {}", i));
+    }
+    BOOST_REQUIRE_EQUAL(v[999], "a string too long for the small string optimization 999");
+    BOOST_REQUIRE(v.get_allocator().resource()->is_equal(mr));
+    return make_ready_future<>();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_reclaimer_priority) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    std::vector<int> order;
+    auto make_reclaimer = [&order] (int id, unsigned priority) {
+        return std::make_unique<memory::reclaimer>([&order, id] {
+            order.push_back(id);
+            return memory::reclaiming_result::reclaimed_nothing;
+        }, memory::reclaimer_scope::sync, priority);
+    };
+    auto low = make_reclaimer(0, 10);
+    auto high = make_reclaimer(1, 200);
+    auto normal = make_reclaimer(2, memory::reclaimer::default_priority);
+
+    auto old_min_free_pages = memory::min_free_memory() / memory::page_size;
+    // Falling below the low watermark reclaims synchronously, highest priority first
+    memory::set_min_free_pages(memory::free_memory() / memory::page_size + 1);
+    memory::set_min_free_pages(old_min_free_pages);
+    BOOST_REQUIRE_GE(order.size(), 3);
+    BOOST_REQUIRE_EQUAL(order[0], 1);
+    BOOST_REQUIRE_EQUAL(order[1], 2);
+    BOOST_REQUIRE_EQUAL(order[2], 0);
+    BOOST_REQUIRE_GT(memory::reclaim_latency_histogram(memory::reclaimer_scope::sync).sample_count, 0);
+    BOOST_REQUIRE_GE(memory::high_free_memory(), memory::min_free_memory());
+    // Let the background reclaim that was scheduled run while the reclaimers are alive
+    yield().get();
+#endif
+}
+
+SEASTAR_THREAD_TEST_CASE(test_background_reclaim_hysteresis) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    unsigned calls = 0;
+    memory::reclaimer r([&calls] {
+        ++calls;
+        return memory::reclaiming_result::reclaimed_nothing;
+    }, memory::reclaimer_scope::async);
+    auto old_high_free_pages = memory::high_free_memory() / memory::page_size;
+    auto min_free_pages = memory::min_free_memory() / memory::page_size;
+    auto free_pages = memory::free_memory() / memory::page_size;
+    BOOST_REQUIRE_GT(free_pages, min_free_pages);
+
+    // Just below the high watermark, reclaim has no reason to run yet
+    memory::set_high_free_pages(free_pages + 1);
+    yield().get();
+    BOOST_REQUIRE_EQUAL(calls, 0);
+    // It starts halfway down to the low watermark
+    memory::set_high_free_pages(2 * free_pages - min_free_pages + 512);
+    yield().get();
+    BOOST_REQUIRE_GT(calls, 0);
+    memory::set_high_free_pages(old_high_free_pages);
+    yield().get();
+#endif
+}
+
+SEASTAR_TEST_CASE(test_allocate_numa) {
+    for (auto policy : {memory::numa_policy::local(), memory::numa_policy::interleave(), memory::numa_policy::on_node(0)}) {
+        constexpr size_t size = 3 * memory::page_size + 1;
+        auto p = static_cast<char*>(memory::allocate_numa(size, policy));
+        BOOST_REQUIRE(std::all_of(p, p + size, [] (char c) { return c == 0; }));
+        ::memset(p, 1, size);
+        memory::free_numa(p, size);
+    }
+
+    memory::numa_memory_resource numa_mr(memory::numa_policy::interleave());
+    std::pmr::monotonic_buffer_resource mr(&numa_mr);
+    std::pmr::vector<std::pmr::string> v(&mr);
+    for (int i = 0; i < 1000; ++i) {
+        v.emplace_back(fmt::format("a string too long for the small string optimization {}", i));
+    }
+    BOOST_REQUIRE_EQUAL(v[999], "a string too long for the small string optimization 999");
+    BOOST_REQUIRE(numa_mr.is_equal(memory::numa_memory_resource(memory::numa_policy::local())));
+
+    BOOST_REQUIRE_THROW(memory::allocate_numa(1, memory::numa_policy::on_node(1000)), std::system_error);
+    return make_ready_future<>();
+}
+
 SEASTAR_THREAD_TEST_CASE(test_cross_thread_realloc) {
     // Tests that realloc seems to do the right thing with various sizes of
     // buffer, including cases where the initial allocation is on another
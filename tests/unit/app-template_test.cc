@@ -21,9 +21,12 @@
 
 #define BOOST_TEST_MODULE app_template
 
+#include <filesystem>
+#include <fstream>
 #include <string>
 #include <boost/test/unit_test.hpp>
 #include <seastar/core/app-template.hh>
+#include <seastar/core/loop.hh>
 #include <seastar/core/sleep.hh>
 
 using namespace seastar;
@@ -61,6 +64,68 @@ BOOST_AUTO_TEST_CASE(app_standard_memory_allocator) {
     BOOST_CHECK_EQUAL(actual_status, expected_status);
 }
 
+BOOST_AUTO_TEST_CASE(reject_inverted_task_quota_bounds) {
+    app_template::seastar_options opts;
+    opts.smp_opts.smp.set_value(1);
+    opts.reactor_opts.task_quota_auto.set_value(true);
+    opts.reactor_opts.task_quota_min_ms.set_value(2.0);
+    opts.reactor_opts.task_quota_max_ms.set_value(1.0);
+    app_template app{std::move(opts)};
+    std::string prog_name{"prog"};
+    char* args[] = {prog_name.data()};
+    bool ran = false;
+    int status = app.run(std::size(args), std::data(args), [&ran] {
+        ran = true;
+        return make_ready_future();
+    });
+    BOOST_CHECK_EQUAL(status, 1);
+    BOOST_CHECK(!ran);
+}
+
+// The syscall threads of shard 0 alive in this process
+static unsigned count_syscall_threads() {
+    unsigned nr = 0;
+    for (auto& task : std::filesystem::directory_iterator("/proc/self/task")) {
+        std::string comm;
+        std::ifstream(task.path() / "comm") >> comm;
+        nr += comm.starts_with("syscall-0");
+    }
+    return nr;
+}
+
+// The threads name themselves once started, so wait a bit for them
+static unsigned syscall_threads_with(std::optional<unsigned> syscall_threads, unsigned expected) {
+    app_template::seastar_options opts;
+    opts.smp_opts.smp.set_value(1);
+    if (syscall_threads) {
+        opts.reactor_opts.syscall_threads.set_value(*syscall_threads);
+    }
+    app_template app{std::move(opts)};
+    std::string prog_name{"prog"};
+    char* args[] = {prog_name.data()};
+    unsigned nr = 0;
+    unsigned tries = 0;
+    int status = app.run(std::size(args), std::data(args), [&nr, &tries, expected] {
+        return do_until([&nr, &tries, expected] {
+            nr = count_syscall_threads();
+            return nr == expected || ++tries == 100;
+        }, [] {
+            return seastar::sleep(10ms);
+        });
+    });
+    BOOST_REQUIRE_EQUAL(status, 0);
+    return nr;
+}
+
+BOOST_AUTO_TEST_CASE(syscall_thread_pool_sizing) {
+    // one thread serves all kinds of work by default
+    BOOST_CHECK_EQUAL(syscall_threads_with(std::nullopt, 1), 1);
+    BOOST_CHECK_EQUAL(syscall_threads_with(0, 1), 1);
+    // otherwise each of the three kinds gets that many
+    BOOST_CHECK_EQUAL(syscall_threads_with(1, 3), 3);
+    BOOST_CHECK_EQUAL(syscall_threads_with(2, 6), 6);
+}
+
 BOOST_AUTO_TEST_CASE(return_0_for_func_returning_void) {
     app_template app;
     std::string prog_name{"prog"};
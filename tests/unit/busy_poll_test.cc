@@ -0,0 +1,96 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+// Run with --busy-poll-us 50 (see CMakeLists.txt)
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/core/seastar.hh>
+#include <seastar/core/posix.hh>
+#include <seastar/net/api.hh>
+#include <seastar/net/unix_address.hh>
+
+#include <sys/socket.h>
+
+using namespace seastar;
+
+static constexpr int busy_poll_us = 50;
+
+// Raising SO_BUSY_POLL above net.core.busy_read needs CAP_NET_ADMIN
+static bool can_busy_poll() {
+    auto fd = file_desc::socket(AF_INET, SOCK_STREAM, 0);
+    int val = busy_poll_us;
+    return ::setsockopt(fd.get(), SOL_SOCKET, SO_BUSY_POLL, &val, sizeof(val)) == 0;
+}
+
+// The default, from net.core.busy_read
+static int default_busy_poll(int family) {
+    auto fd = file_desc::socket(family, SOCK_STREAM, 0);
+    int val = -1;
+    socklen_t len = sizeof(val);
+    ::getsockopt(fd.get(), SOL_SOCKET, SO_BUSY_POLL, &val, &len);
+    return val;
+}
+
+static int busy_poll_of(const connected_socket& s) {
+    int val = -1;
+    s.get_sockopt(SOL_SOCKET, SO_BUSY_POLL, &val, sizeof(val));
+    return val;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_busy_poll_sockets) {
+    auto listener = seastar::listen(socket_address(ipv4_addr("127.0.0.1", 0)), listen_options{.reuse_address = true});
+    auto accepted = listener.accept();
+    auto client = seastar::connect(listener.local_address()).get();
+    auto server = accepted.get().connection;
+
+    if (can_busy_poll()) {
+        BOOST_REQUIRE_EQUAL(busy_poll_of(client), busy_poll_us);
+        BOOST_REQUIRE_EQUAL(busy_poll_of(server), busy_poll_us);
+    } else {
+        fmt::print("Can't set SO_BUSY_POLL, only checking traffic\n");
+    }
+
+    // The shard's pollfn runs alongside the usual readiness notification
+    auto out = client.output();
+    auto in = server.input();
+    for (int i = 0; i < 100; ++i) {
+        auto msg = fmt::format("message {}", i);
+        out.write(msg).get();
+        out.flush().get();
+        auto buf = in.read_exactly(msg.size()).get();
+        BOOST_REQUIRE_EQUAL(std::string_view(buf.get(), buf.size()), msg);
+    }
+    out.close().get();
+    BOOST_REQUIRE(in.read().get().empty());
+    in.close().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_busy_poll_skips_unix_sockets) {
+    auto addr = socket_address(unix_domain_addr(std::string("\0busy_poll_test", 15)));
+    auto listener = seastar::listen(addr);
+    auto accepted = listener.accept();
+    auto client = seastar::connect(addr).get();
+    auto server = accepted.get().connection;
+    BOOST_REQUIRE_EQUAL(busy_poll_of(client), default_busy_poll(AF_UNIX));
+    BOOST_REQUIRE_EQUAL(busy_poll_of(server), default_busy_poll(AF_UNIX));
+}
@@ -0,0 +1,118 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/core/chunked_deque.hh>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <random>
+#include <ranges>
+
+using namespace seastar;
+
+static_assert(std::ranges::random_access_range<chunked_deque<int>>);
+static_assert(std::ranges::random_access_range<const chunked_deque<int>>);
+
+BOOST_AUTO_TEST_CASE(test_chunked_deque_both_ends) {
+    chunked_deque<int, 4> d;
+    BOOST_REQUIRE(d.empty());
+    for (int i = 0; i < 10; ++i) {
+        d.push_back(i);
+        d.push_front(-i - 1);
+    }
+    BOOST_REQUIRE_EQUAL(d.size(), 20);
+    BOOST_REQUIRE_EQUAL(d.front(), -10);
+    BOOST_REQUIRE_EQUAL(d.back(), 9);
+    for (int i = 0; i < 20; ++i) {
+        BOOST_REQUIRE_EQUAL(d[i], i - 10);
+    }
+    BOOST_REQUIRE(std::ranges::is_sorted(d));
+
+    auto& ref = d[10];
+    for (int i = 0; i < 9; ++i) {
+        d.pop_front();
+        d.pop_back();
+        d.push_back(100);
+        d.pop_back();
+    }
+    // References survive pushes and pops elsewhere
+    BOOST_REQUIRE_EQUAL(&ref, &d[1]);
+    BOOST_REQUIRE_EQUAL(d.size(), 2);
+    d.clear();
+    BOOST_REQUIRE(d.empty());
+    d.push_front(1);
+    BOOST_REQUIRE_EQUAL(d.back(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_chunked_deque_random) {
+    chunked_deque<std::unique_ptr<int>, 8> d;
+    std::deque<int> ref;
+    std::default_random_engine rnd(std::random_device{}());
+    for (int i = 0; i < 100000; ++i) {
+        switch (rnd() % 5) {
+        case 0:
+            d.push_back(std::make_unique<int>(i));
+            ref.push_back(i);
+            break;
+        case 1:
+            d.emplace_front(std::make_unique<int>(i));
+            ref.push_front(i);
+            break;
+        case 2:
+            if (!ref.empty()) {
+                BOOST_REQUIRE_EQUAL(*d.front(), ref.front());
+                d.pop_front();
+                ref.pop_front();
+            }
+            break;
+        case 3:
+            if (!ref.empty()) {
+                BOOST_REQUIRE_EQUAL(*d.back(), ref.back());
+                d.pop_back();
+                ref.pop_back();
+            }
+            break;
+        default:
+            if (!ref.empty()) {
+                auto idx = rnd() % ref.size();
+                BOOST_REQUIRE_EQUAL(*d[idx], ref[idx]);
+            }
+        }
+        BOOST_REQUIRE_EQUAL(d.size(), ref.size());
+    }
+    BOOST_REQUIRE(std::ranges::equal(d, ref, {}, [] (auto& p) { return *p; }));
+}
+
+BOOST_AUTO_TEST_CASE(test_chunked_deque_as_std_queue) {
+    std::queue<int, chunked_deque<int>> q;
+    for (int i = 0; i < 1000; ++i) {
+        q.push(i);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        BOOST_REQUIRE_EQUAL(q.front(), i);
+        q.pop();
+    }
+    BOOST_REQUIRE(q.empty());
+}
@@ -1,7 +1,9 @@
 #include <seastar/core/reactor.hh>
 #include <seastar/testing/random.hh>
 #include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
 #include <seastar/testing/test_runner.hh>
+#include <seastar/core/with_timeout.hh>
 #include <seastar/net/ip.hh>
 
 using namespace seastar;
@@ -73,3 +75,23 @@ SEASTAR_TEST_CASE(test_accept_after_abort) {
         });
     });
 }
+
+SEASTAR_THREAD_TEST_CASE(test_connect_any) {
+    std::default_random_engine& rnd = testing::local_random_engine;
+    auto distr = std::uniform_int_distribution<uint16_t>(12000, 65000);
+    auto port = distr(rnd);
+    auto sa = make_ipv4_address({"127.0.0.1", port});
+    auto refused = make_ipv4_address({"127.0.0.1", uint16_t(port + 1)});
+    auto listener = engine().net().listen(sa, listen_options());
+    auto accepted = listener.accept();
+
+    // A failed attempt starts the next one right away, without waiting
+    // for the attempt delay
+    auto conn = with_timeout(lowres_clock::now() + std::chrono::seconds(30),
+            connect_any({refused, sa}, {.attempt_delay = std::chrono::minutes(1)})).get();
+    BOOST_REQUIRE(conn);
+    accepted.get();
+
+    BOOST_REQUIRE_THROW(connect_any({refused, refused}).get(), std::system_error);
+    BOOST_REQUIRE_THROW(connect_any({}).get(), std::invalid_argument);
+}
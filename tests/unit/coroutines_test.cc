@@ -20,12 +20,15 @@
  */
 
 #include <exception>
+#include <limits>
 #include <numeric>
 #include <ranges>
 
 #include <seastar/core/circular_buffer.hh>
 #include <seastar/core/coroutine.hh>
 #include <seastar/core/future-util.hh>
+#include <seastar/core/preallocated_exception.hh>
+#include <seastar/core/reactor.hh>
 #include <seastar/core/sleep.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/coroutine/all.hh>
@@ -33,8 +36,10 @@
 #include <seastar/coroutine/switch_to.hh>
 #include <seastar/coroutine/parallel_for_each.hh>
 #include <seastar/coroutine/as_future.hh>
+#include <seastar/coroutine/batched_generator.hh>
 #include <seastar/coroutine/exception.hh>
 #include <seastar/coroutine/generator.hh>
+#include <seastar/coroutine/try_future.hh>
 #include <seastar/testing/random.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/util/later.hh>
@@ -45,9 +50,11 @@ using seastar::create_scheduling_group;
 using seastar::current_scheduling_group;
 using seastar::default_scheduling_group;
 using seastar::future;
+using seastar::is_preallocated_exception;
 using seastar::make_exception_future;
 using seastar::make_ready_future;
 using seastar::need_preempt;
+using seastar::preallocated_exception;
 using seastar::promise;
 using seastar::scheduling_group;
 using seastar::semaphore;
@@ -504,6 +511,37 @@ SEASTAR_TEST_CASE(test_coroutine_return_exception_ptr) {
     });
 }
 
+SEASTAR_TEST_CASE(test_try_future) {
+    auto fail_later = [] {
+        return yield().then([] {
+            return make_exception_future<int>(preallocated_exception<semaphore_timed_out>());
+        });
+    };
+    co_await check_coroutine_throws<std::runtime_error>([] (int& counter) -> future<int> {
+        counter_ref ref{counter};
+        co_return co_await coroutine::try_future(make_exception_future<int>(std::runtime_error("threw")));
+    });
+    co_await check_coroutine_throws<semaphore_timed_out>([&] (int& counter) -> future<int> {
+        counter_ref ref{counter};
+        co_return co_await coroutine::try_future(fail_later());
+    });
+    co_await check_coroutine_throws<semaphore_timed_out>([&] (int& counter) -> future<> {
+        counter_ref ref{counter};
+        co_await coroutine::try_future_without_preemption_check(fail_later().discard_result());
+    });
+
+    // the exception is the one the awaited future failed with
+    auto f = co_await coroutine::as_future([&] () -> future<int> {
+        co_return co_await coroutine::try_future(fail_later()) + 1;
+    }());
+    BOOST_REQUIRE(is_preallocated_exception<semaphore_timed_out>(f.get_exception()));
+
+    auto v = co_await coroutine::try_future(yield().then([] { return 41; }));
+    BOOST_REQUIRE_EQUAL(v, 41);
+    BOOST_REQUIRE_EQUAL(co_await coroutine::try_future(make_ready_future<int>(42)), 42);
+    co_await coroutine::try_future(make_ready_future<>());
+}
+
 SEASTAR_TEST_CASE(test_maybe_yield) {
     int var = 0;
     bool done = false;
@@ -1018,3 +1056,133 @@ SEASTAR_TEST_CASE(test_lambda_coroutine_in_continuation) {
     }));
     BOOST_REQUIRE_EQUAL(sin1, sin2);
 }
+
+SEASTAR_TEST_CASE(test_coroutine_frame_pool) {
+    auto coro = [] (int x) -> future<int> {
+        co_await yield();
+        co_return x + 1;
+    };
+    auto before = seastar::internal::get_coroutine_frame_stats();
+    for (int i = 0; i < 10; ++i) {
+        BOOST_REQUIRE_EQUAL(co_await coro(i), i + 1);
+    }
+    auto after = seastar::internal::get_coroutine_frame_stats();
+    BOOST_REQUIRE_GE(after.allocations - before.allocations, 10);
+#ifndef SEASTAR_DEBUG
+    // All but the first frame are recycled
+    BOOST_REQUIRE_GE(after.pool_hits - before.pool_hits, 9);
+#endif
+}
+
+future<int> nested_coroutine(int depth) {
+    if (!depth) {
+        co_await yield();
+        co_return 0;
+    }
+    co_return co_await nested_coroutine(depth - 1) + 1;
+}
+
+SEASTAR_TEST_CASE(test_nested_coroutine_symmetric_transfer) {
+    // Once the innermost coroutine is resumed, the ones waiting for it
+    // complete within the same task rather than one task per level
+    uint64_t fewest_tasks = std::numeric_limits<uint64_t>::max();
+    for (int i = 0; i < 3; ++i) {
+        auto before = seastar::engine().get_sched_stats().tasks_processed;
+        BOOST_REQUIRE_EQUAL(co_await nested_coroutine(20), 20);
+        auto tasks = seastar::engine().get_sched_stats().tasks_processed - before;
+        fewest_tasks = std::min(fewest_tasks, tasks);
+    }
+#ifndef SEASTAR_DEBUG
+    BOOST_REQUIRE_LT(fewest_tasks, 10);
+#endif
+}
+
+future<uintptr_t> awaited_leaf(seastar::tasktrace& trace) {
+    co_await yield();
+    trace = seastar::current_tasktrace();
+    co_return seastar::internal::coroutine_task::resume_address(*seastar::engine().current_task());
+}
+
+future<> awaiting_coroutine(int depth, seastar::tasktrace& trace) {
+    if (depth) {
+        co_await awaiting_coroutine(depth - 1, trace);
+        co_return;
+    }
+    auto leaf = co_await awaited_leaf(trace);
+    // Resumed by symmetric transfer from the leaf, which is gone
+    auto running = seastar::engine().current_task();
+    BOOST_REQUIRE(running);
+    auto resume = seastar::internal::coroutine_task::resume_address(*running);
+    BOOST_REQUIRE_NE(resume, 0);
+    BOOST_REQUIRE_NE(resume, leaf);
+#ifndef SEASTAR_TASK_BACKTRACE
+    BOOST_REQUIRE_NE(fmt::format("{}", seastar::waiting_tasktrace(*running)).find("coroutine at"), std::string::npos);
+#endif
+}
+
+SEASTAR_TEST_CASE(test_coroutine_tasktrace) {
+    seastar::tasktrace trace;
+    co_await awaiting_coroutine(3, trace);
+#ifndef SEASTAR_TASK_BACKTRACE
+    // The leaf, the 4 levels awaiting it and this test
+    auto s = fmt::format("{}", trace);
+    size_t coroutines = 0;
+    for (auto pos = s.find("coroutine at"); pos != std::string::npos; pos = s.find("coroutine at", pos + 1)) {
+        ++coroutines;
+    }
+    BOOST_REQUIRE_GE(coroutines, 6);
+#endif
+}
+
+coroutine::experimental::batched_generator<int>
+counting_batches(coroutine::experimental::batch_config, int count, bool fail) {
+    for (int i = 0; i < count; ++i) {
+        if (i % 100 == 0) {
+            co_await yield();
+        }
+        co_yield i;
+    }
+    if (fail) {
+        throw std::runtime_error("counting failed");
+    }
+}
+
+SEASTAR_TEST_CASE(test_batched_generator) {
+    for (size_t lookahead : {1, 3}) {
+        auto gen = counting_batches({.batch_size = 64, .lookahead = lookahead}, 1000, false);
+        int expected = 0;
+        size_t batches = 0;
+        while (true) {
+            auto batch = co_await gen();
+            if (batch.empty()) {
+                break;
+            }
+            BOOST_REQUIRE_LE(batch.size(), 64);
+            for (int v : batch) {
+                BOOST_REQUIRE_EQUAL(v, expected++);
+            }
+            ++batches;
+        }
+        BOOST_REQUIRE_EQUAL(expected, 1000);
+        // 15 full batches and the remaining 40 values
+        BOOST_REQUIRE_EQUAL(batches, 16);
+        BOOST_REQUIRE((co_await gen()).empty());
+    }
+}
+
+SEASTAR_TEST_CASE(test_batched_generator_exception) {
+    auto gen = counting_batches({.batch_size = 64}, 100, true);
+    // The values produced before the failure are delivered first
+    int expected = 0;
+    try {
+        while (true) {
+            auto batch = co_await gen();
+            BOOST_REQUIRE(!batch.empty());
+            for (int v : batch) {
+                BOOST_REQUIRE_EQUAL(v, expected++);
+            }
+        }
+    } catch (const std::runtime_error&) {
+    }
+    BOOST_REQUIRE_EQUAL(expected, 100);
+}
@@ -0,0 +1,131 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#include <vector>
+
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/cpu_accounting.hh>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/testing/test_case.hh>
+#include <seastar/util/later.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+namespace {
+
+// Keeps the reactor busy for d, within a single task
+void spin(std::chrono::steady_clock::duration d) {
+    auto end = std::chrono::steady_clock::now() + d;
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+}
+
+SEASTAR_TEST_CASE(test_tag_propagation) {
+    BOOST_REQUIRE(!cpu_accounting::current_tag());
+    co_await cpu_accounting::with_tag("tenant-a", [] () -> future<> {
+        BOOST_REQUIRE_EQUAL(*cpu_accounting::current_tag(), "tenant-a");
+        co_await yield();
+        BOOST_REQUIRE_EQUAL(*cpu_accounting::current_tag(), "tenant-a");
+        co_await yield().then([] {
+            BOOST_REQUIRE_EQUAL(*cpu_accounting::current_tag(), "tenant-a");
+            return cpu_accounting::with_tag("tenant-b", [] {
+                BOOST_REQUIRE_EQUAL(*cpu_accounting::current_tag(), "tenant-b");
+                return yield().then([] {
+                    BOOST_REQUIRE_EQUAL(*cpu_accounting::current_tag(), "tenant-b");
+                });
+            });
+        });
+        BOOST_REQUIRE_EQUAL(*cpu_accounting::current_tag(), "tenant-a");
+        auto remote = co_await smp::submit_to((this_shard_id() + 1) % smp::count, [] {
+            auto tag = cpu_accounting::current_tag();
+            return tag ? *tag : sstring();
+        });
+        BOOST_REQUIRE_EQUAL(remote, "tenant-a");
+    });
+    BOOST_REQUIRE(!cpu_accounting::current_tag());
+}
+
+SEASTAR_TEST_CASE(test_tag_runtime) {
+    co_await cpu_accounting::with_tag("light", [] {
+        return yield().then([] {
+            spin(1ms);
+        });
+    });
+    co_await cpu_accounting::with_tag("heavy", [] () -> future<> {
+        spin(10ms);
+        co_await yield();
+        spin(10ms);
+    });
+    // Charged on the shard it runs on
+    co_await smp::submit_to((this_shard_id() + 1) % smp::count, [] {
+        return cpu_accounting::with_tag("remote", [] {
+            spin(5ms);
+        });
+    });
+
+    auto heavy = cpu_accounting::usage("heavy");
+    auto light = cpu_accounting::usage("light");
+    BOOST_REQUIRE(heavy && light);
+    BOOST_REQUIRE(heavy->runtime >= 20ms);
+    BOOST_REQUIRE(light->runtime >= 1ms);
+    BOOST_REQUIRE(light->runtime < heavy->runtime);
+    BOOST_REQUIRE(!cpu_accounting::usage("none"));
+
+    auto top = cpu_accounting::top(2);
+    BOOST_REQUIRE_GE(top.size(), 2u);
+    BOOST_REQUIRE(top[0].runtime >= top[1].runtime);
+    BOOST_REQUIRE(top[0].runtime >= heavy->runtime);
+
+    auto remote = co_await smp::submit_to((this_shard_id() + 1) % smp::count, [] {
+        auto u = cpu_accounting::usage("remote");
+        return u ? u->runtime : std::chrono::nanoseconds(0);
+    });
+    BOOST_REQUIRE(remote >= 5ms);
+}
+
+SEASTAR_TEST_CASE(test_tag_slot_reuse) {
+    promise<> p;
+    future<bool> saw_tag = make_ready_future<bool>(false);
+    co_await cpu_accounting::with_tag("released", [&] {
+        saw_tag = p.get_future().then([] {
+            return cpu_accounting::current_tag() != nullptr;
+        });
+        return make_ready_future();
+    });
+    // One of these takes the slot of the tag which was released
+    shared_promise<> hold;
+    std::vector<future<>> live;
+    for (int i = 0; i < 50; ++i) {
+        live.push_back(cpu_accounting::with_tag(format("live-{}", i), [&hold] {
+            return hold.get_shared_future();
+        }));
+    }
+    // A task of the released tag must not be charged to the tag reusing its slot
+    p.set_value();
+    BOOST_REQUIRE(!co_await std::move(saw_tag));
+    hold.set_value();
+    co_await when_all_succeed(live.begin(), live.end());
+}
@@ -24,12 +24,14 @@
 
 #include <seastar/core/do_with.hh>
 #include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/do_with.hh>
 #include <seastar/core/when_all.hh>
 #include <seastar/net/dns.hh>
 #include <seastar/net/inet_address.hh>
+#include <seastar/util/defer.hh>
 
 using namespace seastar;
 using namespace seastar::net;
@@ -165,6 +167,8 @@ SEASTAR_TEST_CASE(test_parallel_resolve_name,
                   *enable_if_with_networking()) {
     dns_resolver::options opts;
     opts.use_tcp_query = true;
+    // queries for the same name would be joined otherwise
+    opts.cache_max_ttl = std::chrono::seconds(0);
 
     auto d = ::make_lw_shared<dns_resolver>(std::move(opts));
     return when_all(
@@ -180,6 +184,7 @@ SEASTAR_TEST_CASE(test_parallel_resolve_name,
 SEASTAR_TEST_CASE(test_parallel_resolve_name_udp,
                   *enable_if_with_networking()) {
     dns_resolver::options opts;
+    opts.cache_max_ttl = std::chrono::seconds(0);
 
     auto d = ::make_lw_shared<dns_resolver>(std::move(opts));
     return when_all(
@@ -191,3 +196,27 @@ SEASTAR_TEST_CASE(test_parallel_resolve_name_udp,
         d->resolve_name("www.google.com")
     ).finally([d](auto&...) {}).discard_result();
 }
+
+SEASTAR_THREAD_TEST_CASE(test_resolve_cached,
+                         *enable_if_with_networking()) {
+    dns_resolver d;
+    auto close = defer([&d] () noexcept { d.close().get(); });
+
+    // Concurrent queries for a name are joined, and later ones
+    // answered from the cache
+    auto [a1, a2] = when_all_succeed(
+        d.resolve_name(seastar_name, inet_address::family::INET),
+        d.resolve_name(seastar_name, inet_address::family::INET)
+    ).get();
+    BOOST_REQUIRE_EQUAL(a1, a2);
+    BOOST_REQUIRE_EQUAL(d.get_cache_stats().misses, 1);
+    BOOST_REQUIRE_EQUAL(d.get_cache_stats().coalesced, 1);
+    BOOST_REQUIRE_EQUAL(d.resolve_name(seastar_name, inet_address::family::INET).get(), a1);
+    BOOST_REQUIRE_EQUAL(d.get_cache_stats().hits, 1);
+
+    // So are names which do not exist
+    for (int i = 0; i < 2; ++i) {
+        BOOST_REQUIRE_THROW(d.get_host_by_name("apa.ninja.gnu", inet_address::family::INET).get(), std::system_error);
+    }
+    BOOST_REQUIRE_EQUAL(d.get_cache_stats().negative_hits, 1);
+}
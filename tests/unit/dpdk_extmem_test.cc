@@ -0,0 +1,101 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/core/smp.hh>
+
+#include "net/dpdk_extmem.hh"
+
+#include <memory>
+#include <vector>
+#include <cstdlib>
+
+using namespace seastar;
+using dpdk::extmem_range;
+
+SEASTAR_TEST_CASE(test_extmem_range_bounds) {
+    extmem_range r{0x10000, 0x30000};
+    auto p = [] (uintptr_t a) { return reinterpret_cast<const void*>(a); };
+    BOOST_REQUIRE_EQUAL(r.size(), 0x20000);
+    BOOST_REQUIRE(r.contains(p(0x10000), 0x20000));
+    BOOST_REQUIRE(r.contains(p(0x2f000), 0x1000));
+    BOOST_REQUIRE(r.contains(p(0x30000), 0));
+    BOOST_REQUIRE(!r.contains(p(0x2f000), 0x1001));
+    BOOST_REQUIRE(!r.contains(p(0xf000), 0x2000));
+    BOOST_REQUIRE(!r.contains(p(0x30000), 1));
+    // a length that wraps the address around
+    BOOST_REQUIRE(!r.contains(p(0x20000), ~size_t(0)));
+    // nothing is registered
+    BOOST_REQUIRE(!extmem_range{}.contains(p(0x10000), 1));
+    return make_ready_future<>();
+}
+
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+
+// What Tx sends without copying: packets built in the shard's own memory
+SEASTAR_THREAD_TEST_CASE(test_extmem_covers_shard_memory) {
+    auto r = extmem_range::of_this_shard();
+    for (size_t size : {64, 2048, 64 << 10, 4 << 20}) {
+        auto buf = std::make_unique<char[]>(size);
+        BOOST_REQUIRE(r.contains(buf.get(), size));
+    }
+    // but not static data
+    static const char banner[] = "HTTP/1.1 200 OK\r\n";
+    BOOST_REQUIRE(!r.contains(banner, sizeof(banner)));
+}
+
+// What Rx receives into without copying: the mbufs' data buffers and the
+// mempool memory, allocated as dpdk_qp's refill_rx_mbuf() and
+// alloc_mempool_xmem() do
+SEASTAR_THREAD_TEST_CASE(test_extmem_covers_rx_buffers) {
+    auto r = extmem_range::of_this_shard();
+    constexpr size_t mbuf_data_size = 2048;
+    std::vector<std::unique_ptr<char, decltype(&::free)>> bufs;
+    for (int i = 0; i < 1024; ++i) {
+        char* data;
+        BOOST_REQUIRE_EQUAL(posix_memalign((void**)&data, mbuf_data_size, mbuf_data_size), 0);
+        bufs.emplace_back(data, ::free);
+        BOOST_REQUIRE(r.contains(data, mbuf_data_size));
+    }
+    constexpr size_t xmem_size = 8 << 20;
+    char* xmem;
+    BOOST_REQUIRE_EQUAL(posix_memalign((void**)&xmem, memory::page_size, xmem_size), 0);
+    bufs.emplace_back(xmem, ::free);
+    BOOST_REQUIRE(r.contains(xmem, xmem_size));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_extmem_excludes_other_shards) {
+    if (smp::count < 2) {
+        return;
+    }
+    auto r = extmem_range::of_this_shard();
+    // Memory of another shard, like a packet forwarded from it, is copied
+    auto [in_ours, in_theirs] = smp::submit_to(1, [r] {
+        auto buf = std::make_unique<char[]>(4096);
+        return std::make_pair(r.contains(buf.get(), 4096), extmem_range::of_this_shard().contains(buf.get(), 4096));
+    }).get();
+    BOOST_REQUIRE(!in_ours);
+    BOOST_REQUIRE(in_theirs);
+}
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+
+#include "net/dpdk_rss.hh"
+
+#include <algorithm>
+
+using namespace seastar::dpdk;
+
+// A redirection table spreading the entries over the queues round-robin,
+// as set_rss_table() does
+static std::vector<uint8_t> round_robin_reta(size_t size, unsigned num_queues) {
+    std::vector<uint8_t> reta(size);
+    for (size_t i = 0; i < size; ++i) {
+        reta[i] = i % num_queues;
+    }
+    return reta;
+}
+
+static std::vector<uint64_t> queue_loads(const std::vector<uint8_t>& reta, const std::vector<uint64_t>& packets, unsigned num_queues) {
+    std::vector<uint64_t> load(num_queues);
+    for (size_t i = 0; i < reta.size(); ++i) {
+        load[reta[i]] += packets[i];
+    }
+    return load;
+}
+
+BOOST_AUTO_TEST_CASE(test_no_rebalance_on_little_traffic) {
+    auto reta = round_robin_reta(128, 4);
+    std::vector<uint64_t> packets(reta.size()), flows(reta.size());
+    // All of it on queue 0, but too little to tell
+    for (size_t i = 0; i < reta.size(); i += 4) {
+        packets[i] = min_rss_rebalance_packets / 64;
+    }
+    BOOST_REQUIRE(plan_rss_rebalance(reta, packets, flows, 4).empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_no_rebalance_on_even_load) {
+    auto reta = round_robin_reta(128, 4);
+    std::vector<uint64_t> packets(reta.size(), 1000), flows(reta.size());
+    // Within a quarter above the average
+    for (size_t i = 0; i < reta.size(); i += 4) {
+        packets[i] = 1200;
+    }
+    BOOST_REQUIRE(plan_rss_rebalance(reta, packets, flows, 4).empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_rebalance_moves_to_least_loaded) {
+    constexpr unsigned num_queues = 4;
+    auto reta = round_robin_reta(128, num_queues);
+    std::vector<uint64_t> packets(reta.size()), flows(reta.size());
+    for (size_t i = 0; i < reta.size(); ++i) {
+        // Queue 0 is swamped, queue 3 idle
+        packets[i] = reta[i] == 0 ? 10000 : reta[i] == 3 ? 0 : 1000;
+    }
+    auto moves = plan_rss_rebalance(reta, packets, flows, num_queues);
+    BOOST_REQUIRE(!moves.empty());
+    // Up to a quarter of the entries of the queue per round
+    BOOST_REQUIRE_LE(moves.size(), 128 / num_queues / 4);
+    BOOST_REQUIRE_EQUAL(moves.front().second, 3);
+    for (auto [entry, to] : moves) {
+        BOOST_REQUIRE_EQUAL(reta[entry], 0);
+        BOOST_REQUIRE_NE(to, 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_rebalance_keeps_open_flows) {
+    constexpr unsigned num_queues = 2;
+    auto reta = round_robin_reta(64, num_queues);
+    std::vector<uint64_t> packets(reta.size()), flows(reta.size());
+    for (size_t i = 0; i < reta.size(); ++i) {
+        packets[i] = reta[i] == 0 ? 10000 : 100;
+    }
+    // All but the last entry of queue 0 have connections open
+    for (size_t i = 0; i < reta.size() - 2; i += 2) {
+        flows[i] = 1;
+    }
+    auto moves = plan_rss_rebalance(reta, packets, flows, num_queues);
+    BOOST_REQUIRE_EQUAL(moves.size(), 1);
+    BOOST_REQUIRE_EQUAL(moves[0].first, reta.size() - 2);
+    BOOST_REQUIRE_EQUAL(moves[0].second, 1);
+
+    // and nothing moves once they all have
+    flows[reta.size() - 2] = 1;
+    BOOST_REQUIRE(plan_rss_rebalance(reta, packets, flows, num_queues).empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_rebalance_converges) {
+    constexpr unsigned num_queues = 4;
+    auto reta = round_robin_reta(128, num_queues);
+    std::vector<uint64_t> packets(reta.size()), flows(reta.size());
+    for (size_t i = 0; i < reta.size(); ++i) {
+        packets[i] = reta[i] == 0 ? 4000 : 1000;
+    }
+    auto spread = [&] {
+        auto load = queue_loads(reta, packets, num_queues);
+        auto [min, max] = std::minmax_element(load.begin(), load.end());
+        return *max - *min;
+    };
+    auto initial = spread();
+    for (int round = 0; round < 100; ++round) {
+        auto moves = plan_rss_rebalance(reta, packets, flows, num_queues);
+        if (moves.empty()) {
+            break;
+        }
+        for (auto [entry, to] : moves) {
+            reta[entry] = to;
+        }
+    }
+    BOOST_REQUIRE(plan_rss_rebalance(reta, packets, flows, num_queues).empty());
+    BOOST_REQUIRE_LT(spread(), initial / 2);
+    // Every queue keeps entries of its own
+    auto load = queue_loads(reta, packets, num_queues);
+    BOOST_REQUIRE(std::ranges::none_of(load, [] (uint64_t l) { return l == 0; }));
+}
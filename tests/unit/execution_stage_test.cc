@@ -279,6 +279,35 @@ SEASTAR_TEST_CASE(test_stage_stats) {
     });
 }
 
+SEASTAR_TEST_CASE(test_stage_batch_size_adapts_to_call_cost) {
+    return seastar::async([] {
+        auto cheap = seastar::make_execution_stage("cheap", [] { });
+        auto expensive = seastar::make_execution_stage("expensive", [] {
+            auto end = sched_clock::now() + std::chrono::microseconds(100);
+            while (sched_clock::now() < end) { }
+        });
+
+        auto fs = std::vector<future<>>();
+        for (auto i = 0u; i < 100; i++) {
+            fs.emplace_back(cheap());
+            fs.emplace_back(expensive());
+        }
+        for (auto& f : fs) {
+            f.get();
+        }
+
+        for (auto* stage : {static_cast<execution_stage*>(&cheap), static_cast<execution_stage*>(&expensive)}) {
+            auto& stats = stage->get_stats();
+            BOOST_REQUIRE_EQUAL(stats.function_calls_executed, 100u);
+            BOOST_REQUIRE_GE(stats.batches_executed, 1u);
+            BOOST_REQUIRE_LE(stats.batches_executed, stats.function_calls_executed);
+            BOOST_REQUIRE(stats.execution_time > sched_clock::duration::zero());
+        }
+        BOOST_REQUIRE_EQUAL(expensive.batch_size_limit(), execution_stage::min_batch_size);
+        BOOST_REQUIRE_GT(cheap.batch_size_limit(), expensive.batch_size_limit());
+    });
+}
+
 SEASTAR_TEST_CASE(test_unique_stage_names_are_enforced) {
     return seastar::async([] {
         {
@@ -455,3 +455,99 @@ SEASTAR_THREAD_TEST_CASE(test_fair_queue_random_run) {
     auto expected_error = std::max(1, int(round(reqs * 0.05)));
     env.verify(format("random_run ({:d} requests)", reqs), {1, 1}, expected_error);
 }
+
+// Requests with a deadline overtake the bulk requests of their class,
+// earliest deadline first, when deadline scheduling is on.
+SEASTAR_THREAD_TEST_CASE(test_fair_queue_deadline_scheduling) {
+    fair_group::config gcfg;
+    gcfg.rate_limit_duration = std::chrono::microseconds(100);
+    fair_group fg(gcfg, 1);
+    fair_queue::config qcfg;
+    qcfg.deadline_scheduling = true;
+    qcfg.deadline_window = std::chrono::milliseconds(5);
+    fair_queue fq(fg, qcfg);
+    fg.replenish_capacity(fair_group::clock_type::now() + std::chrono::days(1));
+    fq.register_priority_class(0, 100);
+
+    std::vector<unsigned> order;
+    std::vector<std::unique_ptr<request>> reqs;
+    auto cap = fq.tokens_capacity(1.0 / 1'000'000);
+    auto queue = [&] (unsigned index, std::optional<fair_queue_entry::clock_type::time_point> deadline) {
+        auto req = std::make_unique<request>(cap, index, [&order] (request& r) { order.push_back(r.index); });
+        if (deadline) {
+            req->fqent.set_deadline(*deadline);
+        }
+        fq.queue(0, req->fqent);
+        reqs.push_back(std::move(req));
+    };
+    auto now = fair_queue_entry::clock_type::now();
+    for (unsigned i = 0; i < 4; ++i) {
+        queue(i, std::nullopt);
+    }
+    queue(4, now + 2ms);
+    queue(5, now - 1ms); // already missed
+    queue(6, now + 1h); // too far away to overtake anyone
+
+    while (order.size() < reqs.size()) {
+        fg.replenish_capacity(fg.replenished_ts() + std::chrono::microseconds(10));
+        fq.dispatch_requests([&] (fair_queue_entry& ent) {
+            auto& r = *boost::intrusive::get_parent_from_member(&ent, &request::fqent);
+            order.push_back(r.index);
+            fq.notify_request_finished(ent.capacity());
+        });
+    }
+    BOOST_REQUIRE_EQUAL(order, (std::vector<unsigned>{5, 4, 0, 1, 2, 3, 6}));
+    fq.unregister_priority_class(0);
+}
+
+// The group competes with the top-level class as a whole and its share
+// is split between its children. Expected a:b:c = 4:1:3
+SEASTAR_THREAD_TEST_CASE(test_fair_queue_priority_groups) {
+    fair_group::config gcfg;
+    gcfg.rate_limit_duration = std::chrono::microseconds(100);
+    fair_group fg(gcfg, 1);
+    fair_queue fq(fg, fair_queue::config{});
+    fg.replenish_capacity(fair_group::clock_type::now() + std::chrono::days(1));
+
+    const fair_queue::class_id g = 0, a = 1, b = 2, c = 3;
+    fq.register_priority_group(g, 100);
+    fq.register_priority_class(a, 100);
+    fq.register_priority_class(b, 100, g);
+    fq.register_priority_class(c, 300, g);
+
+    std::vector<unsigned> results(4, 0);
+    std::vector<std::unique_ptr<request>> reqs;
+    auto cap = fq.tokens_capacity(1.0 / 1'000'000);
+    for (unsigned i = 0; i < 400; ++i) {
+        for (auto id : {a, b, c}) {
+            auto req = std::make_unique<request>(cap, id, [] (request&) {});
+            fq.queue(id, req->fqent);
+            reqs.push_back(std::move(req));
+        }
+    }
+
+    unsigned dispatched = 0;
+    auto dispatch = [&] {
+        fg.replenish_capacity(fg.replenished_ts() + std::chrono::microseconds(10));
+        fq.dispatch_requests([&] (fair_queue_entry& ent) {
+            auto& r = *boost::intrusive::get_parent_from_member(&ent, &request::fqent);
+            results[r.index]++;
+            dispatched++;
+            fq.notify_request_finished(ent.capacity());
+        });
+    };
+    while (dispatched < 400) {
+        dispatch();
+    }
+    fmt::print("priority_groups: a = {}, b = {}, c = {}\n", results[a], results[b], results[c]);
+    BOOST_REQUIRE_CLOSE(double(results[a]), 4.0 * results[b], 10);
+    BOOST_REQUIRE_CLOSE(double(results[c]), 3.0 * results[b], 10);
+
+    while (dispatched < reqs.size()) {
+        dispatch();
+    }
+    fq.unregister_priority_class(c);
+    fq.unregister_priority_class(b);
+    fq.unregister_priority_class(a);
+    fq.unregister_priority_class(g);
+}
@@ -35,13 +35,18 @@
 #include <seastar/core/thread.hh>
 #include <seastar/core/stall_sampler.hh>
 #include <seastar/core/aligned_buffer.hh>
+#include <seastar/core/cached_file.hh>
 #include <seastar/core/io_intent.hh>
+#include <seastar/core/io_queue.hh>
+#include <seastar/core/when_all.hh>
 #include <seastar/util/assert.hh>
 #include <seastar/util/tmp_file.hh>
 #include <seastar/util/alloc_failure_injector.hh>
 #include <seastar/util/closeable.hh>
 #include <seastar/util/internal/magic.hh>
 #include <seastar/util/internal/iovec_utils.hh>
+#include <seastar/util/defer.hh>
+#include "core/file-impl.hh"
 
 #include <boost/range/adaptor/transformed.hpp>
 #include <iostream>
@@ -328,6 +333,89 @@ SEASTAR_THREAD_TEST_CASE(test_sanitize_iovecs) {
     }
 }
 
+SEASTAR_TEST_CASE(test_file_metadata_errors) {
+  return tmp_dir::do_with_thread([] (tmp_dir& t) {
+    sstring filename = (t.get_path() / "testfile.tmp").native();
+    sstring other = (t.get_path() / "other.tmp").native();
+    auto is_enoent = [] (const std::filesystem::filesystem_error& e) {
+        return e.code() == std::errc::no_such_file_or_directory;
+    };
+
+    BOOST_CHECK_EXCEPTION(open_file_dma(filename, open_flags::ro).get(), std::filesystem::filesystem_error, is_enoent);
+    BOOST_CHECK_EXCEPTION(file_stat(filename).get(), std::filesystem::filesystem_error, is_enoent);
+    BOOST_CHECK_EXCEPTION(rename_file(filename, other).get(), std::filesystem::filesystem_error, is_enoent);
+    BOOST_CHECK_EXCEPTION(remove_file(filename).get(), std::filesystem::filesystem_error, is_enoent);
+
+    auto f = open_file_dma(filename, open_flags::rw | open_flags::create | open_flags::exclusive).get();
+    f.allocate(0, 4096).get();
+    f.close().get();
+    BOOST_CHECK_EXCEPTION(open_file_dma(filename, open_flags::rw | open_flags::create | open_flags::exclusive).get(),
+            std::filesystem::filesystem_error, [] (const std::filesystem::filesystem_error& e) {
+        return e.code() == std::errc::file_exists;
+    });
+    rename_file(filename, other).get();
+    BOOST_REQUIRE(!file_exists(filename).get());
+    BOOST_REQUIRE(file_stat(other).get().type == directory_entry_type::regular);
+    remove_file(other).get();
+    BOOST_REQUIRE(!file_exists(other).get());
+  });
+}
+
+SEASTAR_TEST_CASE(test_discard_through_io_queue) {
+  return tmp_dir::do_with_thread([] (tmp_dir& t) {
+    sstring filename = (t.get_path() / "testfile.tmp").native();
+    auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+    auto close_f = deferred_close(f);
+    auto bs = f.disk_write_dma_alignment();
+    auto buf = allocate_aligned_buffer<char>(4 * bs, f.memory_dma_alignment());
+    std::fill_n(buf.get(), 4 * bs, 'x');
+    BOOST_REQUIRE_EQUAL(f.dma_write(0, buf.get(), 4 * bs).get(), 4 * bs);
+
+    // adjacent discards dispatched together end up in one call
+    when_all_succeed(f.discard(bs, bs), f.discard(2 * bs, bs)).get();
+
+    BOOST_REQUIRE_EQUAL(f.dma_read(0, buf.get(), 4 * bs).get(), 4 * bs);
+    BOOST_REQUIRE(std::all_of(buf.get(), buf.get() + bs, [] (char c) { return c == 'x'; }));
+    BOOST_REQUIRE(std::all_of(buf.get() + bs, buf.get() + 3 * bs, [] (char c) { return c == 0; }));
+    BOOST_REQUIRE(std::all_of(buf.get() + 3 * bs, buf.get() + 4 * bs, [] (char c) { return c == 'x'; }));
+  });
+}
+
+SEASTAR_TEST_CASE(test_file_map) {
+  return tmp_dir::do_with_thread([] (tmp_dir& t) {
+    sstring filename = (t.get_path() / "testfile.tmp").native();
+    auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+    auto close_f = deferred_close(f);
+    auto bs = f.disk_write_dma_alignment();
+    auto buf = allocate_aligned_buffer<char>(4 * bs, f.memory_dma_alignment());
+    for (size_t i = 0; i < 4 * bs; i++) {
+        buf.get()[i] = char(i % 251);
+    }
+    BOOST_REQUIRE_EQUAL(f.dma_write(0, buf.get(), 4 * bs).get(), 4 * bs);
+    f.flush().get();
+
+    // the range need not start at a page
+    auto m = f.map(bs + 10, 2 * bs).get();
+    BOOST_REQUIRE_EQUAL(m.size(), 2 * bs);
+    m.prefetch(0, m.size()).get();
+    auto data = m.read(5, bs).get();
+    BOOST_REQUIRE(std::equal(data.begin(), data.end(), buf.get() + bs + 15));
+    BOOST_REQUIRE(m.resident(5, bs));
+    m.refresh_residency().get();
+    BOOST_REQUIRE(std::equal(m.data(), m.data() + m.size(), buf.get() + bs + 10));
+    BOOST_REQUIRE(!m.resident(m.size(), 1));
+    BOOST_REQUIRE_THROW(m.read(m.size() - 1, 2).get(), std::out_of_range);
+
+    // a range reaching past the end of the file is cut at the end
+    auto tail = f.map(3 * bs, 4 * bs).get();
+    BOOST_REQUIRE_EQUAL(tail.size(), bs);
+    BOOST_REQUIRE(std::equal(tail.data(), tail.data() + tail.size(), buf.get() + 3 * bs));
+    BOOST_REQUIRE_THROW(tail.read(bs, 1).get(), std::out_of_range);
+    auto past = f.map(5 * bs, bs).get();
+    BOOST_REQUIRE_EQUAL(past.size(), 0);
+  });
+}
+
 SEASTAR_TEST_CASE(test_chmod) {
   return tmp_dir::do_with_thread([] (tmp_dir& t) {
     auto oflags = open_flags::rw | open_flags::create;
@@ -536,6 +624,79 @@ SEASTAR_TEST_CASE(test_file_write_lifetime_method) {
     });
 }
 
+static void do_test_file_dax(tmp_dir& t) {
+    sstring filename = (t.get_path() / "testfile.tmp").native();
+    file_open_options options;
+    options.dax = true;
+    auto f = open_file_dma(filename, open_flags::rw | open_flags::create, options).get();
+    auto close_f = deferred_close(f);
+
+    constexpr size_t size = 1 << 20;
+    // DAX files have no alignment constraints
+    auto block = std::max<size_t>(f.disk_write_dma_alignment(), 4096);
+    f.truncate(size).get();
+    f.allocate(0, size).get();
+
+    auto wbuf = allocate_aligned_buffer<char>(block, f.memory_dma_alignment());
+    for (size_t i = 0; i < block; i++) {
+        wbuf.get()[i] = char(i * 7);
+    }
+    // within the file
+    BOOST_REQUIRE_EQUAL(f.dma_write(block, wbuf.get(), block).get(), block);
+    // extending it
+    BOOST_REQUIRE_EQUAL(f.dma_write(size, wbuf.get(), block).get(), block);
+    f.flush().get();
+    BOOST_REQUIRE_EQUAL(f.size().get(), size + block);
+
+    for (auto pos : {uint64_t(block), uint64_t(size)}) {
+        auto rbuf = f.dma_read<char>(pos, block).get();
+        BOOST_REQUIRE_EQUAL(rbuf.size(), block);
+        BOOST_REQUIRE(std::equal(rbuf.begin(), rbuf.end(), wbuf.get()));
+    }
+    auto zeros = f.dma_read<char>(0, block).get();
+    BOOST_REQUIRE(std::all_of(zeros.begin(), zeros.end(), [] (char c) { return c == 0; }));
+    // short at the end of the file
+    auto tail = f.dma_read<char>(size, 2 * block).get();
+    BOOST_REQUIRE_EQUAL(tail.size(), block);
+
+    if (f.disk_write_dma_alignment() != 1) {
+        return;
+    }
+    // Through the mapping, at any offset and length
+    const char bytes[] = "seastar";
+    BOOST_REQUIRE_EQUAL(f.dma_write(block + 5, bytes, 7).get(), 7);
+    char rbytes[9];
+    BOOST_REQUIRE_EQUAL(f.dma_read(block + 4, rbytes, 9).get(), 9);
+    BOOST_REQUIRE_EQUAL(rbytes[0], wbuf.get()[4]);
+    BOOST_REQUIRE_EQUAL(std::string_view(rbytes + 1, 7), "seastar");
+    BOOST_REQUIRE_EQUAL(rbytes[8], wbuf.get()[12]);
+    f.flush().get();
+
+    // The mapping is the file
+    auto g = open_file_dma(filename, open_flags::ro).get();
+    auto close_g = deferred_close(g);
+    auto through_file = g.dma_read<char>(block, block).get();
+    BOOST_REQUIRE_EQUAL(std::string_view(through_file.get() + 5, 7), "seastar");
+    BOOST_REQUIRE(std::equal(through_file.begin() + 12, through_file.end(), wbuf.get() + 12));
+}
+
+// Runs through the mapping if the temporary directory is on a DAX
+// filesystem, and through the I/O scheduler otherwise
+SEASTAR_TEST_CASE(test_file_dax) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        do_test_file_dax(t);
+    });
+}
+
+// Runs through the mapping wherever the test runs
+SEASTAR_TEST_CASE(test_file_dax_emulated) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        dax_file_impl::emulate_for_tests = true;
+        auto reset = defer([] () noexcept { dax_file_impl::emulate_for_tests = false; });
+        do_test_file_dax(t);
+    });
+}
+
 SEASTAR_TEST_CASE(test_file_fcntl) {
     return tmp_dir::do_with_thread([] (tmp_dir& t) {
         auto oflags = open_flags::rw | open_flags::create;
@@ -649,6 +810,114 @@ SEASTAR_TEST_CASE(test_underlying_file) {
     });
 }
 
+SEASTAR_TEST_CASE(test_dma_read_bulk_fragmented) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        static constexpr size_t fragment_size = 8192;
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+        auto close_f = deferred_close(f);
+        size_t aligned_size = 8 * fragment_size;
+        auto contents = temporary_buffer<char>::aligned(f.memory_dma_alignment(), aligned_size);
+        for (size_t i = 0; i < aligned_size; ++i) {
+            contents.get_write()[i] = char(i * 13 + i / 509);
+        }
+        BOOST_REQUIRE_EQUAL(f.dma_write(0, contents.get(), aligned_size).get(), aligned_size);
+        // a file size that is not aligned
+        size_t file_size = aligned_size - 1000;
+        f.truncate(file_size).get();
+
+        auto check_read = [&] (uint64_t pos, size_t len) {
+            auto bufs = f.dma_read_bulk_fragmented<char>(pos, len, fragment_size).get();
+            size_t total = 0;
+            for (auto& b : bufs) {
+                BOOST_REQUIRE_GT(b.size(), 0u);
+                BOOST_REQUIRE_LE(b.size(), fragment_size);
+                BOOST_REQUIRE(std::equal(b.begin(), b.end(), contents.begin() + pos + total));
+                total += b.size();
+            }
+            BOOST_REQUIRE_EQUAL(total, std::min(len, file_size - std::min<size_t>(pos, file_size)));
+        };
+
+        check_read(0, file_size);
+        check_read(100, 3 * fragment_size + 7);
+        check_read(fragment_size - 1, 2);
+        check_read(file_size - 10, 100);
+        check_read(file_size + 4096, 100);
+    });
+}
+
+SEASTAR_TEST_CASE(test_cached_file) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        static constexpr size_t block_size = 16 * 1024;
+        static constexpr size_t file_size = 4 * block_size;
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+        auto contents = temporary_buffer<char>::aligned(f.memory_dma_alignment(), file_size);
+        for (size_t i = 0; i < file_size; ++i) {
+            contents.get_write()[i] = char(i * 7 + i / 251);
+        }
+        BOOST_REQUIRE_EQUAL(f.dma_write(0, contents.get(), file_size).get(), file_size);
+
+        block_cache cache("test", block_cache_config{.capacity = 3 * block_size, .block_size = block_size});
+        auto cf = make_cached_file(f, cache);
+        auto close_cf = deferred_close(cf);
+        auto& stats = cache.get_stats();
+
+        auto check_read = [&] (uint64_t pos, size_t len) {
+            auto buf = cf.dma_read_bulk<char>(pos, len).get();
+            BOOST_REQUIRE_EQUAL(buf.size(), std::min(len, file_size - pos));
+            BOOST_REQUIRE(std::equal(buf.begin(), buf.end(), contents.begin() + pos));
+        };
+
+        // an unaligned read spanning blocks 0 to 2
+        check_read(100, 2 * block_size + 1000);
+        BOOST_REQUIRE_EQUAL(stats.misses, 3);
+        check_read(block_size + 10, 100);
+        BOOST_REQUIRE_EQUAL(stats.hits, 1);
+        BOOST_REQUIRE_EQUAL(cache.memory_used(), 3 * block_size);
+
+        // concurrent reads of the last block share the read of the underlying file
+        auto r1 = cf.dma_read_bulk<char>(3 * block_size, block_size);
+        auto r2 = cf.dma_read_bulk<char>(3 * block_size + 512, 512);
+        auto buf1 = r1.get();
+        auto buf2 = r2.get();
+        BOOST_REQUIRE(std::equal(buf1.begin(), buf1.end(), contents.begin() + 3 * block_size));
+        BOOST_REQUIRE(std::equal(buf2.begin(), buf2.end(), contents.begin() + 3 * block_size + 512));
+        BOOST_REQUIRE_EQUAL(stats.misses, 4);
+        BOOST_REQUIRE_EQUAL(stats.coalesced, 1);
+        BOOST_REQUIRE_EQUAL(stats.evictions, 1);
+        BOOST_REQUIRE_LE(cache.memory_used(), 3 * block_size);
+
+        // reads past the end are short
+        check_read(file_size - 10, 100);
+
+        // writes through the cached file are seen by its reads
+        check_read(0, block_size);
+        std::fill_n(contents.get_write(), 4096, 'x');
+        BOOST_REQUIRE_EQUAL(cf.dma_write(0, contents.get(), 4096).get(), 4096);
+        BOOST_REQUIRE_GE(stats.invalidations, 1);
+        check_read(0, block_size);
+
+        // writing to a buffer read does not change the cached block
+        auto scribbled = cf.dma_read_bulk<char>(0, 512).get();
+        std::fill_n(scribbled.get_write(), scribbled.size(), 'y');
+        check_read(0, 512);
+
+        cache.clear();
+        BOOST_REQUIRE_EQUAL(cache.memory_used(), 0);
+        check_read(0, file_size);
+
+        // a short last block is not kept, so growing the file past it is seen
+        cf.truncate(file_size + 100).get();
+        auto tail = cf.dma_read_bulk<char>(file_size, block_size).get();
+        BOOST_REQUIRE_EQUAL(tail.size(), 100);
+        cf.truncate(file_size + block_size).get();
+        tail = cf.dma_read_bulk<char>(file_size, block_size).get();
+        BOOST_REQUIRE_EQUAL(tail.size(), block_size);
+        BOOST_REQUIRE(std::all_of(tail.begin(), tail.end(), [] (char c) { return c == 0; }));
+    });
+}
+
 SEASTAR_TEST_CASE(test_file_stat_method_with_file) {
     return tmp_dir::do_with_thread([] (tmp_dir& t) {
         auto oflags = open_flags::rw | open_flags::create | open_flags::truncate;
@@ -817,6 +1086,96 @@ SEASTAR_TEST_CASE(test_destruct_append_challenged_file_after_read) {
     });
 }
 
+SEASTAR_TEST_CASE(test_append_challenged_file_concurrent_flushes) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto buf = allocate_aligned_buffer<unsigned char>(4096, 4096);
+        std::fill(buf.get(), buf.get() + 4096, 0);
+
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+        auto close_f = deferred_close(f);
+        constexpr unsigned nr_flushes = 10;
+        for (unsigned i = 0; i < nr_flushes; ++i) {
+            f.dma_write(i * 4096, buf.get(), 4096).get();
+        }
+
+        auto fs = file_system_at(t.get_path().native()).get();
+        auto fsyncs = engine().get_io_stats().fsyncs;
+        auto coalesced = engine().get_io_stats().fsyncs_coalesced;
+        std::vector<future<>> flushes;
+        for (unsigned i = 0; i < nr_flushes; ++i) {
+            flushes.push_back(f.flush());
+        }
+        when_all_succeed(flushes.begin(), flushes.end()).get();
+        auto issued = engine().get_io_stats().fsyncs - fsyncs;
+        auto shared = engine().get_io_stats().fsyncs_coalesced - coalesced;
+        // Every flush either issues an fsync or shares one
+        BOOST_REQUIRE_EQUAL(issued + shared, nr_flushes);
+        if (fs == fs_type::xfs || fs == fs_type::ext4 || fs == fs_type::btrfs) {
+            // The first flush is issued, and the rest share its follow-up
+            BOOST_REQUIRE_EQUAL(issued, 2);
+            BOOST_REQUIRE_EQUAL(shared, nr_flushes - 2);
+        } else if (fs == fs_type::tmpfs) {
+            // Not append-challenged, nothing to coalesce
+            BOOST_REQUIRE_EQUAL(shared, 0);
+        }
+        BOOST_REQUIRE_EQUAL(f.size().get(), nr_flushes * 4096);
+    });
+}
+
+SEASTAR_TEST_CASE(test_dma_write_durability) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        static constexpr size_t alignment = 4096;
+        auto wbuf = allocate_aligned_buffer<char>(alignment, alignment);
+        std::fill_n(wbuf.get(), alignment, char(42));
+
+        auto filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+        auto close_f = deferred_close(f);
+        BOOST_REQUIRE_EQUAL(f.dma_write(0, wbuf.get(), alignment, write_durability::data).get(), alignment);
+        std::vector<iovec> iovecs{iovec{wbuf.get(), alignment}};
+        BOOST_REQUIRE_EQUAL(f.dma_write(alignment, std::move(iovecs), write_durability::data).get(), alignment);
+        BOOST_REQUIRE_EQUAL(f.dma_write(2 * alignment, wbuf.get(), alignment, write_durability::none).get(), alignment);
+
+        auto rbuf = f.dma_read<char>(0, 3 * alignment).get();
+        BOOST_REQUIRE_EQUAL(rbuf.size(), 3 * alignment);
+        BOOST_REQUIRE(std::all_of(rbuf.begin(), rbuf.end(), [] (char c) { return c == 42; }));
+    });
+}
+
+SEASTAR_TEST_CASE(test_dma_write_ordered) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        static constexpr size_t alignment = 4096;
+        auto buf1 = allocate_aligned_buffer<char>(alignment, alignment);
+        std::fill_n(buf1.get(), alignment, char(1));
+        auto buf2 = allocate_aligned_buffer<char>(alignment, alignment);
+        std::fill_n(buf2.get(), alignment, char(2));
+
+        auto filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create).get();
+        auto close_f = deferred_close(f);
+        // the overlapping writes land in order
+        std::vector<ordered_write> writes{{0, buf1.get(), alignment}, {alignment, buf1.get(), alignment}, {0, buf2.get(), alignment}};
+        BOOST_REQUIRE_EQUAL(f.dma_write_ordered(writes, write_durability::data).get(), 3 * alignment);
+        auto rbuf = f.dma_read<char>(0, 2 * alignment).get();
+        BOOST_REQUIRE_EQUAL(rbuf.size(), 2 * alignment);
+        BOOST_REQUIRE(std::all_of(rbuf.begin(), rbuf.begin() + alignment, [] (char c) { return c == 2; }));
+        BOOST_REQUIRE(std::all_of(rbuf.begin() + alignment, rbuf.end(), [] (char c) { return c == 1; }));
+
+        // too many to chain, written one at a time
+        writes.clear();
+        for (size_t i = 0; i <= io_queue::max_chain_length; i++) {
+            writes.push_back({0, i % 2 ? buf1.get() : buf2.get(), alignment});
+        }
+        BOOST_REQUIRE_EQUAL(f.dma_write_ordered(writes).get(), writes.size() * alignment);
+        auto last = *static_cast<const char*>(writes.back().buffer);
+        rbuf = f.dma_read<char>(0, alignment).get();
+        BOOST_REQUIRE(std::all_of(rbuf.begin(), rbuf.end(), [last] (char c) { return c == last; }));
+
+        BOOST_REQUIRE_EQUAL(f.dma_write_ordered({}).get(), 0);
+    });
+}
+
 SEASTAR_TEST_CASE(test_dma_iovec) {
     return tmp_dir::do_with_thread([] (tmp_dir& t) {
         static constexpr size_t alignment = 4096;
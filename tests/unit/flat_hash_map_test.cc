@@ -0,0 +1,158 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+#include <seastar/core/flat_hash_map.hh>
+
+using namespace seastar;
+
+static_assert(std::ranges::forward_range<flat_hash_map<int, int>>);
+
+BOOST_AUTO_TEST_CASE(test_flat_hash_map_basic) {
+    flat_hash_map<std::string, int> m;
+    BOOST_REQUIRE(m.empty());
+    BOOST_REQUIRE(m.begin() == m.end());
+    BOOST_REQUIRE(m.find("a") == m.end());
+
+    BOOST_REQUIRE(m.try_emplace("a", 1).second);
+    BOOST_REQUIRE(!m.try_emplace("a", 2).second);
+    BOOST_REQUIRE(m.insert({"b", 2}).second);
+    m["c"] = 3;
+    BOOST_REQUIRE_EQUAL(m.size(), 3);
+    BOOST_REQUIRE_EQUAL(m.at("a"), 1);
+    BOOST_REQUIRE_EQUAL(m["b"], 2);
+    BOOST_REQUIRE(m.contains("c"));
+    BOOST_REQUIRE_THROW(m.at("d"), std::out_of_range);
+
+    BOOST_REQUIRE_EQUAL(m.erase("b"), 1);
+    BOOST_REQUIRE_EQUAL(m.erase("b"), 0);
+    BOOST_REQUIRE_EQUAL(m.size(), 2);
+    int sum = 0;
+    for (auto& [k, v] : m) {
+        sum += v;
+    }
+    BOOST_REQUIRE_EQUAL(sum, 4);
+
+    auto copy = m;
+    m.clear();
+    BOOST_REQUIRE(m.empty());
+    BOOST_REQUIRE_EQUAL(copy.size(), 2);
+    BOOST_REQUIRE_EQUAL(copy.at("c"), 3);
+}
+
+BOOST_AUTO_TEST_CASE(test_flat_hash_map_grows_incrementally) {
+    flat_hash_map<int, std::unique_ptr<int>> m;
+    size_t rehashing_inserts = 0;
+    for (int i = 0; i < 100000; ++i) {
+        auto capacity = m.capacity();
+        m.try_emplace(i, std::make_unique<int>(i));
+        if (m.rehash_in_progress()) {
+            rehashing_inserts++;
+            // Elements left in the old table are still found
+            BOOST_REQUIRE(m.contains(i / 2));
+        }
+        BOOST_REQUIRE(m.capacity() == capacity || m.capacity() == capacity * 2 || capacity == 0);
+    }
+    BOOST_REQUIRE_GT(rehashing_inserts, 0);
+    BOOST_REQUIRE_EQUAL(m.size(), 100000);
+    size_t seen = 0;
+    for (auto& [k, v] : m) {
+        BOOST_REQUIRE_EQUAL(k, *v);
+        seen++;
+    }
+    BOOST_REQUIRE_EQUAL(seen, 100000);
+}
+
+BOOST_AUTO_TEST_CASE(test_flat_hash_map_emplace_own_key) {
+    flat_hash_map<std::string, int> m;
+    int i = 0;
+    while (!m.rehash_in_progress()) {
+        m.try_emplace(std::to_string(i), i);
+        i++;
+    }
+    // The keys are the ones of the elements, which a rehash moves
+    auto size = m.size();
+    for (int j = 0; j < i && m.rehash_in_progress(); ++j) {
+        auto& key = m.find(std::to_string(j))->first;
+        auto [it, inserted] = m.try_emplace(key, -1);
+        BOOST_REQUIRE(!inserted);
+        BOOST_REQUIRE_EQUAL(it->first, std::to_string(j));
+        BOOST_REQUIRE_EQUAL(m[m.find(std::to_string(j))->first], j);
+        BOOST_REQUIRE_EQUAL(m.size(), size);
+        // and a new one, for the rehash to go on
+        m.try_emplace(std::to_string(i), i);
+        i++;
+        size++;
+    }
+    BOOST_REQUIRE(!m.contains(""));
+}
+
+BOOST_AUTO_TEST_CASE(test_flat_hash_map_random) {
+    flat_hash_map<uint64_t, uint64_t> m;
+    std::unordered_map<uint64_t, uint64_t> ref;
+    std::default_random_engine rnd(std::random_device{}());
+    std::uniform_int_distribution<uint64_t> keys(0, 20000);
+    for (int i = 0; i < 200000; ++i) {
+        auto k = keys(rnd);
+        switch (rnd() % 3) {
+        case 0:
+            m[k] = i;
+            ref[k] = i;
+            break;
+        case 1:
+            BOOST_REQUIRE_EQUAL(m.erase(k), ref.erase(k));
+            break;
+        default: {
+            auto it = m.find(k);
+            auto rit = ref.find(k);
+            BOOST_REQUIRE_EQUAL(it == m.end(), rit == ref.end());
+            if (it != m.end()) {
+                BOOST_REQUIRE_EQUAL(it->second, rit->second);
+            }
+        }
+        }
+        BOOST_REQUIRE_EQUAL(m.size(), ref.size());
+    }
+    for (auto it = m.begin(); it != m.end(); ) {
+        BOOST_REQUIRE_EQUAL(ref.at(it->first), it->second);
+        m.erase(it++);
+    }
+    BOOST_REQUIRE(m.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_flat_hash_map_reserve) {
+    flat_hash_map<int, int> m;
+    m.reserve(1000);
+    auto capacity = m.capacity();
+    BOOST_REQUIRE_GE(capacity - capacity / 8, 1000);
+    for (int i = 0; i < 1000; ++i) {
+        m[i] = i;
+    }
+    BOOST_REQUIRE_EQUAL(m.capacity(), capacity);
+    BOOST_REQUIRE(!m.rehash_in_progress());
+}
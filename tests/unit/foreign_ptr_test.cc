@@ -173,3 +173,56 @@ SEASTAR_THREAD_TEST_CASE(foreign_ptr_destroy_test) {
     BOOST_REQUIRE_EQUAL(done[1].get_future().get(), true);
     BOOST_REQUIRE_EQUAL(done[0].get_future().get(), false);
 }
+
+SEASTAR_THREAD_TEST_CASE(foreign_ptr_batched_destroy_test) {
+    if (smp::count == 1) {
+        std::cerr << "Skipping multi-cpu foreign_ptr tests. Run with --smp=2 to test multi-cpu delete and reset.";
+        return;
+    }
+
+    using namespace std::chrono_literals;
+
+    static thread_local unsigned destroyed = 0;
+    struct counted : dummy {
+        ~counted() { ++destroyed; }
+    };
+
+    auto ptrs = smp::submit_to(1, [] {
+        destroyed = 0;
+        std::vector<foreign_ptr<std::unique_ptr<counted>>> ptrs;
+        for (int i = 0; i < 1000; ++i) {
+            ptrs.push_back(make_foreign(std::make_unique<counted>()));
+        }
+        return ptrs;
+    }).get();
+    ptrs.clear();
+
+    // The destructions are shipped to shard 1 when the queues are polled
+    auto deadline = lowres_clock::now() + 10s;
+    while (smp::submit_to(1, [] { return destroyed; }).get() != 1000) {
+        BOOST_REQUIRE(lowres_clock::now() < deadline);
+        seastar::sleep(1ms).get();
+    }
+}
+
+SEASTAR_THREAD_TEST_CASE(foreign_ptr_batched_destroy_order_test) {
+    if (smp::count == 1) {
+        std::cerr << "Skipping multi-cpu foreign_ptr tests. Run with --smp=2 to test multi-cpu delete and reset.";
+        return;
+    }
+
+    static thread_local bool destroyed = false;
+    struct flagged : dummy {
+        ~flagged() { destroyed = true; }
+    };
+
+    for (int i = 0; i < 100; ++i) {
+        auto p = smp::submit_to(1, [] {
+            destroyed = false;
+            return make_foreign(std::make_unique<flagged>());
+        }).get();
+        p.reset();
+        // A message sent after the destruction was queued must not overtake it
+        BOOST_REQUIRE(smp::submit_to(1, [] { return destroyed; }).get());
+    }
+}
@@ -21,6 +21,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <limits>
 #include <numeric>
 #include <seastar/core/fstream.hh>
 #include <seastar/core/smp.hh>
@@ -32,6 +33,7 @@
 #include <seastar/testing/random.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/test_runner.hh>
+#include <seastar/testing/thread_test_case.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/print.hh>
 #include <seastar/util/assert.hh>
@@ -42,6 +44,7 @@
 #include "mock_file.hh"
 #include <boost/range/irange.hpp>
 #include <seastar/util/closeable.hh>
+#include <seastar/util/crc32c.hh>
 #include <seastar/util/alloc_failure_injector.hh>
 
 using namespace seastar;
@@ -539,6 +542,212 @@ SEASTAR_TEST_CASE(test_fstream_slow_start) {
     });
 }
 
+SEASTAR_TEST_CASE(test_fstream_adaptive) {
+    return seastar::async([] {
+        static constexpr size_t file_size = 16 * 1024 * 1024;
+        static constexpr size_t buffer_size = 256 * 1024;
+        static constexpr size_t read_ahead = 4;
+
+        auto mock_file = make_shared<mock_read_only_file>(file_size);
+
+        file_input_stream_options options{};
+        options.buffer_size = buffer_size;
+        options.read_ahead = read_ahead;
+        options.adaptive = true;
+
+        auto in = make_file_input_stream(file(mock_file), 0, file_size, options);
+        auto close_in = deferred_close(in);
+
+        size_t last_read_size = 0;
+        mock_file->set_read_size_verifier([&] (size_t length) {
+            BOOST_CHECK_LE(length, buffer_size);
+            last_read_size = length;
+        });
+
+        // Nothing is known of the access pattern yet: a small buffer, no read-ahead
+        mock_file->set_allowed_read_requests(1);
+        auto buf = in.read().get();
+        BOOST_CHECK_LT(buf.size(), buffer_size);
+        uint64_t total_read = buf.size();
+
+        // Sequential reads grow the buffers up to buffer_size
+        while (buf.size() < buffer_size) {
+            BOOST_REQUIRE_LT(total_read, file_size / 2);
+            mock_file->set_allowed_read_requests(read_ahead + 1);
+            buf = in.read().get();
+            total_read += buf.size();
+        }
+        BOOST_CHECK_EQUAL(last_read_size, buffer_size);
+
+        // Skipping past the reads ahead is taken as random access
+        mock_file->set_allowed_read_requests(std::numeric_limits<size_t>::max());
+        in.skip(buffer_size * (read_ahead + 2)).get();
+        buf = in.read().get();
+        BOOST_CHECK_GT(buf.size(), 0u);
+        BOOST_CHECK_LT(last_read_size, buffer_size);
+    });
+}
+
+SEASTAR_TEST_CASE(test_fstream_adaptive_write) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        static constexpr size_t buffer_size = 64 * 1024;
+        static constexpr size_t file_size = 32 * 1024 * 1024 + 100;
+
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create | open_flags::truncate).get();
+        file_output_stream_options opts;
+        opts.buffer_size = buffer_size;
+        opts.adaptive = true;
+        opts.max_write_size = 16 * buffer_size;
+        opts.max_write_behind = 4;
+        opts.stats = make_lw_shared<file_output_stream_stats>();
+        auto out = make_file_output_stream(std::move(f), opts).get();
+        BOOST_REQUIRE_EQUAL(opts.stats->write_size, buffer_size);
+
+        std::vector<char> buf(4096);
+        for (size_t written = 0; written < file_size; written += buf.size()) {
+            auto len = std::min(buf.size(), file_size - written);
+            std::fill_n(buf.begin(), len, char(written / buf.size()));
+            out.write(buf.data(), len).get();
+        }
+        out.close().get();
+
+        BOOST_REQUIRE_EQUAL(opts.stats->bytes_written, file_size);
+        BOOST_REQUIRE_GE(opts.stats->write_size, buffer_size);
+        BOOST_REQUIRE_LE(opts.stats->write_size, opts.max_write_size);
+        BOOST_REQUIRE_LE(opts.stats->write_behind, opts.max_write_behind);
+        BOOST_REQUIRE_GT(opts.stats->throughput, 0);
+
+        f = open_file_dma(filename, open_flags::ro).get();
+        auto close_f = deferred_close(f);
+        BOOST_REQUIRE_EQUAL(f.size().get(), file_size);
+        auto in = make_file_input_stream(f);
+        auto close_in = deferred_close(in);
+        size_t read = 0;
+        while (auto rbuf = in.read().get()) {
+            for (size_t i = 0; i < rbuf.size(); ++i) {
+                BOOST_REQUIRE_EQUAL(rbuf[i], char((read + i) / buf.size()));
+            }
+            read += rbuf.size();
+        }
+        BOOST_REQUIRE_EQUAL(read, file_size);
+    });
+}
+
+SEASTAR_THREAD_TEST_CASE(test_fstream_adaptive_write_grows) {
+    static constexpr size_t buffer_size = 64 * 1024;
+    static constexpr size_t file_size = 40 * 1024 * 1024;
+
+    // Slow enough for the stream to wait for each write
+    auto mock = seastar::make_shared<mock_write_only_file>(std::chrono::milliseconds(1));
+    file_output_stream_options opts;
+    opts.buffer_size = buffer_size;
+    opts.adaptive = true;
+    opts.max_write_size = 8 * buffer_size;
+    opts.max_write_behind = 2;
+    opts.stats = make_lw_shared<file_output_stream_stats>();
+    auto out = make_file_output_stream(file(mock), opts).get();
+    std::vector<char> buf(4096);
+    for (size_t written = 0; written < file_size; written += buf.size()) {
+        out.write(buf.data(), buf.size()).get();
+    }
+    out.close().get();
+
+    // The writes double up to the largest, and then more go in parallel
+    auto& writes = mock->writes();
+    BOOST_REQUIRE(!writes.empty());
+    BOOST_REQUIRE_EQUAL(writes.front(), buffer_size);
+    BOOST_REQUIRE(std::is_sorted(writes.begin(), writes.end() - 1));
+    BOOST_REQUIRE_EQUAL(*std::max_element(writes.begin(), writes.end()), opts.max_write_size);
+    BOOST_REQUIRE_EQUAL(opts.stats->write_size, opts.max_write_size);
+    BOOST_REQUIRE_EQUAL(opts.stats->write_behind, opts.max_write_behind);
+    BOOST_REQUIRE_EQUAL(std::accumulate(writes.begin(), writes.end(), size_t(0)), file_size);
+}
+
+SEASTAR_TEST_CASE(test_fstream_checksums) {
+    return tmp_dir::do_with_thread([] (tmp_dir& t) {
+        BOOST_REQUIRE_EQUAL(crc32c_update(0, "123456789", 9), 0xe3069283);
+
+        static constexpr size_t block_size = 4096;
+        static constexpr size_t file_size = 3 * block_size + 100;
+        std::vector<char> data(file_size);
+        std::iota(data.begin(), data.end(), 0);
+
+        sstring filename = (t.get_path() / "testfile.tmp").native();
+        auto f = open_file_dma(filename, open_flags::rw | open_flags::create | open_flags::truncate).get();
+        file_output_stream_options opts;
+        opts.checksums = make_lw_shared<file_checksums>();
+        opts.checksums->block_size = block_size;
+        auto out = make_file_output_stream(std::move(f), opts).get();
+        // writes straddling the blocks
+        for (size_t pos = 0; pos < file_size; pos += 1000) {
+            out.write(data.data() + pos, std::min<size_t>(1000, file_size - pos)).get();
+        }
+        out.close().get();
+
+        auto& blocks = opts.checksums->blocks;
+        BOOST_REQUIRE_EQUAL(blocks.size(), 4);
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            auto len = std::min(block_size, file_size - i * block_size);
+            BOOST_REQUIRE_EQUAL(blocks[i], crc32c_update(0, data.data() + i * block_size, len));
+        }
+        BOOST_REQUIRE_EQUAL(opts.checksums->size, file_size);
+
+        // a flush in the middle of a block does not end it
+        f = open_file_dma(filename, open_flags::rw | open_flags::truncate).get();
+        file_output_stream_options flushed_opts;
+        flushed_opts.checksums = make_lw_shared<file_checksums>();
+        flushed_opts.checksums->block_size = 2 * block_size;
+        out = make_file_output_stream(std::move(f), flushed_opts).get();
+        out.write(data.data(), block_size).get();
+        out.flush().get();
+        out.write(data.data() + block_size, file_size - block_size).get();
+        out.close().get();
+        BOOST_REQUIRE(flushed_opts.checksums->blocks == std::vector<uint32_t>({
+                crc32c_update(0, data.data(), 2 * block_size),
+                crc32c_update(0, data.data() + 2 * block_size, file_size - 2 * block_size)}));
+
+        auto read_all = [&] (uint64_t offset, lw_shared_ptr<file_checksums> sums, uint64_t len = std::numeric_limits<uint64_t>::max()) {
+            auto f = open_file_dma(filename, open_flags::ro).get();
+            auto close_f = deferred_close(f);
+            file_input_stream_options in_opts;
+            in_opts.buffer_size = 1024;
+            in_opts.checksums = std::move(sums);
+            auto in = make_file_input_stream(f, offset, len, in_opts);
+            auto close_in = deferred_close(in);
+            while (in.read().get()) {
+            }
+        };
+
+        // reads verify the blocks, and record those that are not known
+        auto sums = make_lw_shared<file_checksums>(*opts.checksums);
+        sums->blocks.resize(2);
+        read_all(0, sums);
+        BOOST_REQUIRE(sums->blocks == blocks);
+
+        // the first block is only partly read, so is not verified
+        sums = make_lw_shared<file_checksums>(*opts.checksums);
+        sums->blocks[0] ^= 1;
+        read_all(1, sums);
+
+        sums->blocks[2] ^= 1;
+        BOOST_REQUIRE_EXCEPTION(read_all(0, sums), checksum_error, [] (const checksum_error& e) {
+            return e.block() == 0;
+        });
+        sums->blocks[0] ^= 1;
+        BOOST_REQUIRE_EXCEPTION(read_all(0, sums), checksum_error, [] (const checksum_error& e) {
+            return e.block() == 2;
+        });
+
+        // the short last block is verified by a read that stops at its end
+        sums = make_lw_shared<file_checksums>(*opts.checksums);
+        sums->blocks[3] ^= 1;
+        BOOST_REQUIRE_EXCEPTION(read_all(0, sums, file_size), checksum_error, [] (const checksum_error& e) {
+            return e.block() == 3;
+        });
+    });
+}
+
 #ifdef SEASTAR_ENABLE_ALLOC_FAILURE_INJECTION
 
 SEASTAR_TEST_CASE(test_close_error) {
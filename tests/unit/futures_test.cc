@@ -23,6 +23,7 @@
 #include <cstddef>
 #include <forward_list>
 #include <iterator>
+#include <numeric>
 #include <ranges>
 #include <stdexcept>
 #include <type_traits>
@@ -33,6 +34,7 @@
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/future-util.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/chunked_parallel.hh>
 #include <seastar/core/sleep.hh>
 #include <seastar/core/smp.hh>
 #include <seastar/core/stream.hh>
@@ -2148,6 +2150,43 @@ SEASTAR_THREAD_TEST_CASE(test_max_concurrent_for_each) {
     BOOST_REQUIRE_EQUAL(sum, 28);
 }
 
+SEASTAR_THREAD_TEST_CASE(test_chunked_parallel) {
+    std::vector<int64_t> v(100000);
+    std::iota(v.begin(), v.end(), 0);
+    const int64_t sum = int64_t(v.size()) * (v.size() - 1) / 2;
+
+    for (bool across_shards : {false, true}) {
+        BOOST_TEST_MESSAGE("across shards: " << across_shards);
+        chunked_parallel_options opts{.chunk_size = 1000, .across_shards = across_shards};
+
+        std::vector<int64_t> w(v.size());
+        chunked_parallel_transform(v, w.begin(), [] (int64_t x) { return 2 * x; }, opts).get();
+        for (size_t i = 0; i < v.size(); i++) {
+            BOOST_REQUIRE_EQUAL(w[i], 2 * v[i]);
+        }
+        chunked_parallel_for_each(w, [] (int64_t& x) { x /= 2; }, opts).get();
+        BOOST_REQUIRE(w == v);
+
+        BOOST_REQUIRE_EQUAL(chunked_parallel_reduce(v, int64_t(0), std::plus<int64_t>(), opts).get(), sum);
+        // The chunks are reduced in order, so the reduction needn't be commutative
+        auto s = chunked_parallel_transform_reduce(v, sstring(), std::plus<sstring>(), [] (int64_t x) {
+            return x % 10000 == 0 ? to_sstring(x / 10000) : sstring();
+        }, opts).get();
+        BOOST_REQUIRE_EQUAL(s, "0123456789");
+    }
+
+    BOOST_TEST_MESSAGE("empty range");
+    std::vector<int> empty;
+    BOOST_REQUIRE_EQUAL(chunked_parallel_reduce(empty, 7, std::plus<int>()).get(), 7);
+
+    BOOST_TEST_MESSAGE("exceptions are propagated");
+    BOOST_REQUIRE_THROW(chunked_parallel_for_each(v, [] (int64_t x) {
+        if (x == 54321) {
+            throw expected_exception();
+        }
+    }).get(), expected_exception);
+}
+
 SEASTAR_THREAD_TEST_CASE(test_for_each_set) {
     std::bitset<32> s;
     s.set(4);
@@ -2288,3 +2327,28 @@ SEASTAR_THREAD_TEST_CASE(test_foreign_promise_set_value) {
 
     BOOST_REQUIRE_EQUAL(getter.get(), other_shard);
 }
+
+SEASTAR_TEST_CASE(test_then_chain_arena) {
+    promise<int> p;
+    auto before = internal::get_continuation_chain_stats();
+    auto f = p.get_future().then([] (int v) {
+        return v + 1;
+    }).then([] (int v) {
+        return v * 2;
+    }).then([] (int v) {
+        return make_ready_future<int>(v + 3);
+    }).then_wrapped([] (future<int> f) {
+        return f.get() * 10;
+    }).then([] (int v) {
+        return v - 1;
+    });
+    auto after = internal::get_continuation_chain_stats();
+    BOOST_REQUIRE_EQUAL(after.allocations - before.allocations, 5);
+#ifndef SEASTAR_DEBUG
+    // All but the first continuation were carved from the chain's arenas
+    BOOST_REQUIRE_EQUAL(after.chained - before.chained, 4);
+    BOOST_REQUIRE_LT(after.arenas - before.arenas, 4);
+#endif
+    p.set_value(1);
+    BOOST_REQUIRE_EQUAL(co_await std::move(f), 69);
+}
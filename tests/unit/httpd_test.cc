@@ -4,6 +4,7 @@
 
 #include <seastar/http/function_handlers.hh>
 #include <seastar/http/httpd.hh>
+#include <seastar/http/static_handler.hh>
 #include <seastar/http/handlers.hh>
 #include <seastar/http/matcher.hh>
 #include <seastar/http/matchrules.hh>
@@ -21,19 +22,24 @@
 #include <seastar/testing/thread_test_case.hh>
 #include "loopback_socket.hh"
 #include <boost/algorithm/string.hpp>
+#include <boost/range/irange.hpp>
 #include <seastar/core/thread.hh>
 #include <seastar/util/noncopyable_function.hh>
 #include <seastar/http/json_path.hh>
 #include <seastar/http/response_parser.hh>
 #include <sstream>
 #include <seastar/core/shared_future.hh>
+#include <seastar/core/sleep.hh>
 #include <seastar/http/client.hh>
+#include <seastar/http/compression.hh>
+#include <seastar/http/internal/http2.hh>
 #include <seastar/http/url.hh>
 #include <seastar/util/assert.hh>
 #include <seastar/util/later.hh>
 #include <seastar/util/short_streams.hh>
 #include <seastar/util/closeable.hh>
 #include <seastar/net/tls.hh>
+#include <zlib.h>
 
 using namespace seastar;
 using namespace httpd;
@@ -123,6 +129,64 @@ SEASTAR_TEST_CASE(test_match_rule_order)
     return make_ready_future<>();
 }
 
+// matches "/" followed by anything, like no rule the tree can compile
+struct any_matcher : public matcher {
+    virtual size_t match(const sstring& url, size_t ind, parameters& param) override {
+        return url.length();
+    }
+};
+
+SEASTAR_TEST_CASE(test_match_rule_tree)
+{
+    parameters param;
+    routes route;
+
+    handl* by_param = new handl();
+    route.add(operation_type::GET, url("/a").remainder("path"), by_param);
+    handl* by_str = new handl();
+    route.add(operation_type::GET, url("/a/b"), by_str);
+    handl* by_seg = new handl();
+    auto rule = new match_rule(by_seg);
+    rule->add_str("/d").add_param("x").add_str("/e");
+    route.add(rule, operation_type::GET);
+
+    // the rule added first wins, whether it is more specific or not
+    BOOST_REQUIRE_EQUAL(route.get_handler(GET, "/a/b", param), by_param);
+    BOOST_REQUIRE_EQUAL(param.path("path"), "/b");
+    param.clear();
+    BOOST_REQUIRE_EQUAL(route.get_handler(GET, "/a", param), by_param);
+    BOOST_REQUIRE_EQUAL(param.path("path"), "");
+    param.clear();
+
+    BOOST_REQUIRE_EQUAL(route.get_handler(GET, "/d/1/e", param), by_seg);
+    BOOST_REQUIRE_EQUAL(param.path("x"), "/1");
+    param.clear();
+    // a trailing slash is ignored
+    BOOST_REQUIRE_EQUAL(route.get_handler(GET, "/d/1/e/", param), by_seg);
+    param.clear();
+    BOOST_REQUIRE_EQUAL(route.get_handler(GET, "/d/1/e/f", param), nullptr);
+    BOOST_REQUIRE_EQUAL(route.get_handler(GET, "/de/1/e", param), nullptr);
+    BOOST_REQUIRE(!param.exists("x"));
+
+    handl* any = new handl();
+    auto any_rule = new match_rule(any);
+    any_rule->add_matcher(new any_matcher());
+    route.add(any_rule, operation_type::GET);
+    handl* late = new handl();
+    route.add(operation_type::GET, url("/f"), late);
+
+    // a rule that can't be compiled keeps its place in the order
+    BOOST_REQUIRE_EQUAL(route.get_handler(GET, "/d/1/e", param), by_seg);
+    param.clear();
+    BOOST_REQUIRE_EQUAL(route.get_handler(GET, "/f", param), any);
+    BOOST_REQUIRE_EQUAL(route.get_handler(PUT, "/f", param), nullptr);
+
+    delete route.del_cookie(0, operation_type::GET);
+    BOOST_REQUIRE_EQUAL(route.get_handler(GET, "/a/b", param), by_str);
+
+    return make_ready_future<>();
+}
+
 SEASTAR_TEST_CASE(test_put_drop_rule)
 {
     routes rts;
@@ -1442,11 +1506,13 @@ struct echo_string_handler : public echo_handler {
  * Checks if the server responds to the request equivalent to the concatenation of all req_parts with a reply containing
  * the resp_parts strings, assuming that the content streaming is set to stream and the /test route is handled by handl
  * */
-future<> check_http_reply (std::vector<sstring>&& req_parts, std::vector<std::string>&& resp_parts, bool stream, handler_base* handl) {
-    return seastar::async([req_parts = std::move(req_parts), resp_parts = std::move(resp_parts), stream, handl] {
+future<> check_http_reply (std::vector<sstring>&& req_parts, std::vector<std::string>&& resp_parts, bool stream, handler_base* handl,
+        size_t content_length_limit = std::numeric_limits<size_t>::max()) {
+    return seastar::async([req_parts = std::move(req_parts), resp_parts = std::move(resp_parts), stream, handl, content_length_limit] {
         loopback_connection_factory lcf(1);
         http_server server("test");
         server.set_content_streaming(stream);
+        server.set_content_length_limit(content_length_limit);
         loopback_socket_impl lsi(lcf);
         httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
         future<> client = seastar::async([req_parts = std::move(req_parts), resp_parts = std::move(resp_parts), &lsi] {
@@ -1791,6 +1857,27 @@ SEASTAR_TEST_CASE(test_bad_chunk_length) {
     }, {"400 Bad Request", "Can't parse chunk size and extensions"}, true, new echo_stream_handler());
 }
 
+SEASTAR_TEST_CASE(test_handler_content_streaming) {
+    // The server doesn't stream content, but the handler asks for it
+    auto handler = new echo_stream_handler();
+    handler->stream_content();
+    return check_http_reply({
+        "GET /test HTTP/1.1\r\nHost: test\r\nTransfer-Encoding: chunked\r\n\r\n",
+        "a\r\n1234567890\r\n",
+        "a\r\n1234521345\r\n",
+        "0\r\n\r\n"
+    }, {"200 OK", "12345678901234521345"}, false, handler);
+}
+
+SEASTAR_TEST_CASE(test_chunked_content_length_limit) {
+    return check_http_reply({
+        "GET /test HTTP/1.1\r\nHost: test\r\nTransfer-Encoding: chunked\r\n\r\n",
+        "a\r\n1234567890\r\n",
+        "a\r\n1234521345\r\n",
+        "0\r\n\r\n"
+    }, {"413 Payload Too Large", "Content length limit exceeded"}, false, new echo_string_handler(), 15);
+}
+
 SEASTAR_TEST_CASE(case_insensitive_header) {
     std::unique_ptr<seastar::http::request> req = std::make_unique<seastar::http::request>();
     req->_headers["conTEnt-LengtH"] = "17";
@@ -2178,3 +2265,454 @@ SEASTAR_TEST_CASE(test_client_close_connection) {
         }
     });
 }
+
+SEASTAR_TEST_CASE(test_http2_hpack) {
+    namespace h2 = http::internal::http2;
+    auto hex = [] (const std::string& s) {
+        std::string res;
+        for (unsigned char c : s) {
+            res += fmt::format("{:02x}", c);
+        }
+        return res;
+    };
+
+    std::string out;
+    h2::huffman_encode("www.example.com", out);
+    BOOST_REQUIRE_EQUAL(hex(out), "f1e3c2e5f23a6ba0ab90f4ff");
+    BOOST_REQUIRE_EQUAL(h2::huffman_decode(out), "www.example.com");
+
+    std::string all;
+    for (int c = 0; c < 256; c++) {
+        all.push_back(char(c));
+    }
+    out.clear();
+    h2::huffman_encode(all, out);
+    BOOST_REQUIRE_EQUAL(h2::huffman_decode(out), sstring(all.data(), all.size()));
+    // Padding longer than 7 bits
+    BOOST_REQUIRE_THROW(h2::huffman_decode("\xff\xff"), h2::connection_error);
+
+    // RFC 7541 Appendix C.4, requests with Huffman coding sharing the dynamic table
+    std::vector<std::pair<h2::header_list, std::string>> requests = {
+        {{{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"}},
+            "828684418cf1e3c2e5f23a6ba0ab90f4ff"},
+        {{{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"}, {"cache-control", "no-cache"}},
+            "828684be5886a8eb10649cbf"},
+        {{{":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"}, {":authority", "www.example.com"}, {"custom-key", "custom-value"}},
+            "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"},
+    };
+    h2::hpack_encoder enc;
+    h2::hpack_decoder dec;
+    for (auto& [headers, expected] : requests) {
+        std::string block;
+        enc.encode(headers, block);
+        BOOST_REQUIRE_EQUAL(hex(block), expected);
+        BOOST_REQUIRE(dec.decode(block) == headers);
+    }
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_http2_client_server) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        server.set_http2(true);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+
+        server._routes.put(GET, "/test", new function_handler([] (const_req req) {
+            return sstring(req.get_query_param("v"));
+        }, "txt"));
+        server._routes.put(POST, "/echo", new function_handler([] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+            rep->write_body("txt", [content = std::move(req->content)] (output_stream<char>&& out) mutable {
+                return do_with(std::move(out), std::move(content), [] (output_stream<char>& out, sstring& content) {
+                    return out.write(content).then([&out] {
+                        return out.close();
+                    });
+                });
+            });
+            return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+        }, "txt"));
+        server.do_accepts(0).get();
+
+        auto cln = http::experimental::client(std::make_unique<loopback_http_factory>(lcf), 1);
+        cln.set_http2(true);
+
+        parallel_for_each(boost::irange(0, 32), [&cln] (int i) {
+            auto req = http::request::make("GET", "test", "/test");
+            req.query_parameters["v"] = to_sstring(i);
+            return cln.make_request(std::move(req), [i] (const http::reply& rep, input_stream<char>&& in) {
+                BOOST_REQUIRE_EQUAL(rep._version, "2.0");
+                return util::read_entire_stream_contiguous(in).then([i] (sstring body) {
+                    BOOST_REQUIRE_EQUAL(body, to_sstring(i));
+                });
+            }, http::reply::status_type::ok);
+        }).get();
+        // All requests shared one connection
+        BOOST_REQUIRE_EQUAL(cln.connections_nr(), 1);
+        BOOST_REQUIRE_EQUAL(cln.total_new_connections_nr(), 1);
+
+        // Larger than the initial flow control windows of both sides
+        sstring payload(256 * 1024, 'x');
+        auto req = http::request::make("POST", "test", "/echo");
+        req.write_body("txt", payload);
+        cln.make_request(std::move(req), [&payload] (const http::reply& rep, input_stream<char>&& in) {
+            return util::read_entire_stream_contiguous(in).then([&payload] (sstring body) {
+                BOOST_REQUIRE(body == payload);
+            });
+        }, http::reply::status_type::ok).get();
+
+        cln.close().get();
+
+        // Plain HTTP/1.1 clients keep working
+        auto cln1 = http::experimental::client(std::make_unique<loopback_http_factory>(lcf));
+        auto req1 = http::request::make("GET", "test", "/test");
+        req1.query_parameters["v"] = "h1";
+        cln1.make_request(std::move(req1), [] (const http::reply& rep, input_stream<char>&& in) {
+            BOOST_REQUIRE_EQUAL(rep._version, "1.1");
+            return util::read_entire_stream_contiguous(in).then([] (sstring body) {
+                BOOST_REQUIRE_EQUAL(body, "h1");
+            });
+        }, http::reply::status_type::ok).get();
+        cln1.close().get();
+
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_negotiate_content_encoding) {
+    using enc = http::content_encoding;
+    std::vector<enc> supported = {enc::zstd, enc::gzip, enc::deflate};
+    BOOST_REQUIRE(http::negotiate_content_encoding("", supported) == enc::identity);
+    BOOST_REQUIRE(http::negotiate_content_encoding("gzip, deflate", supported) == enc::gzip);
+    BOOST_REQUIRE(http::negotiate_content_encoding("deflate;q=0.9, GZIP;q=0.5", supported) == enc::deflate);
+    BOOST_REQUIRE(http::negotiate_content_encoding("x-gzip", supported) == enc::gzip);
+    BOOST_REQUIRE(http::negotiate_content_encoding("gzip;q=0, br", supported) == enc::identity);
+    BOOST_REQUIRE(http::negotiate_content_encoding("*", supported) == enc::zstd);
+    BOOST_REQUIRE(http::negotiate_content_encoding("*;q=0.5, zstd;q=0", supported) == enc::gzip);
+    BOOST_REQUIRE(http::negotiate_content_encoding("zstd", {enc::gzip}) == enc::identity);
+    BOOST_REQUIRE(http::is_compressible("application/json"));
+    BOOST_REQUIRE(http::is_compressible("text/html; charset=utf-8"));
+    BOOST_REQUIRE(!http::is_compressible("image/png"));
+    return make_ready_future<>();
+}
+
+static sstring gunzip(const sstring& in) {
+    z_stream zs = {};
+    BOOST_REQUIRE_EQUAL(inflateInit2(&zs, 15 + 16), Z_OK);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = in.size();
+    sstring out;
+    int r;
+    do {
+        char buf[4096];
+        zs.next_out = reinterpret_cast<Bytef*>(buf);
+        zs.avail_out = sizeof(buf);
+        r = inflate(&zs, Z_NO_FLUSH);
+        BOOST_REQUIRE(r == Z_OK || r == Z_STREAM_END);
+        out.append(buf, sizeof(buf) - zs.avail_out);
+    } while (r != Z_STREAM_END);
+    inflateEnd(&zs);
+    return out;
+}
+
+SEASTAR_TEST_CASE(test_reply_compression) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        http::compression_config cfg;
+        cfg.encodings = {http::content_encoding::gzip};
+        server.set_compression(cfg);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+
+        sstring payload;
+        for (int i = 0; i < 10000; i++) {
+            payload += format("{{\"key\": {}, \"value\": \"some value\"}},", i);
+        }
+        server._routes.put(GET, "/string", new function_handler([&payload] (const_req req) {
+            return payload;
+        }, "json"));
+        server._routes.put(GET, "/small", new function_handler([] (const_req req) {
+            return sstring("{}");
+        }, "json"));
+        server._routes.put(GET, "/stream", new function_handler([&payload] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+            rep->write_body("json", [&payload] (output_stream<char>& out) -> future<> {
+                for (size_t pos = 0; pos < payload.size(); pos += 1000) {
+                    co_await out.write(payload.data() + pos, std::min<size_t>(1000, payload.size() - pos));
+                    co_await out.flush();
+                }
+            });
+            return make_ready_future<std::unique_ptr<http::reply>>(std::move(rep));
+        }, "json"));
+        server.do_accepts(0).get();
+
+        auto cln = http::experimental::client(std::make_unique<loopback_http_factory>(lcf));
+        auto get = [&cln] (sstring path, sstring accept_encoding) {
+            auto req = http::request::make("GET", "test", path);
+            if (!accept_encoding.empty()) {
+                req._headers["Accept-Encoding"] = accept_encoding;
+            }
+            std::pair<sstring, sstring> ret;
+            cln.make_request(std::move(req), [&ret] (const http::reply& rep, input_stream<char>&& in) {
+                BOOST_REQUIRE_EQUAL(rep.get_header("Vary"), "Accept-Encoding");
+                ret.first = rep.get_header("Content-Encoding");
+                return util::read_entire_stream_contiguous(in).then([&ret] (sstring body) {
+                    ret.second = std::move(body);
+                });
+            }, http::reply::status_type::ok).get();
+            return ret;
+        };
+
+        for (auto path : {"/string", "/stream"}) {
+            auto [enc, body] = get(path, "gzip, deflate");
+            BOOST_REQUIRE_EQUAL(enc, "gzip");
+            BOOST_REQUIRE_LT(body.size(), payload.size() / 4);
+            BOOST_REQUIRE(gunzip(body) == payload);
+
+            // The client doesn't accept any of the server's codings
+            std::tie(enc, body) = get(path, "br");
+            BOOST_REQUIRE_EQUAL(enc, "");
+            BOOST_REQUIRE(body == payload);
+        }
+        auto [enc, body] = get("/small", "gzip");
+        BOOST_REQUIRE_EQUAL(enc, "");
+        BOOST_REQUIRE_EQUAL(body, "{}");
+
+        cln.close().get();
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_http_pipelining) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        server.set_pipeline_depth(4);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+
+        unsigned running = 0;
+        unsigned max_running = 0;
+        server._routes.put(GET, "/test", new function_handler([&] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+            max_running = std::max(++running, max_running);
+            // Later requests complete first
+            auto v = std::stoi(req->get_query_param("v"));
+            return sleep(std::chrono::milliseconds(10 * (8 - v % 8))).then([&running, v, rep = std::move(rep)] () mutable {
+                --running;
+                rep->write_body("txt", to_sstring(v));
+                return std::move(rep);
+            });
+        }, "txt"));
+        server.do_accepts(0).get();
+
+        auto cln = http::experimental::client(std::make_unique<loopback_http_factory>(lcf), 1);
+        cln.set_pipeline_depth(4);
+
+        parallel_for_each(boost::irange(0, 16), [&cln] (int i) {
+            auto req = http::request::make("GET", "test", "/test");
+            req.query_parameters["v"] = to_sstring(i);
+            return cln.make_request(std::move(req), [i] (const http::reply& rep, input_stream<char>&& in) {
+                return util::read_entire_stream_contiguous(in).then([i] (sstring body) {
+                    BOOST_REQUIRE_EQUAL(body, to_sstring(i));
+                });
+            }, http::reply::status_type::ok);
+        }).get();
+        BOOST_REQUIRE_EQUAL(cln.total_new_connections_nr(), 1);
+        BOOST_REQUIRE_GT(cln.pipelined_requests_nr(), 0);
+        BOOST_REQUIRE_GT(max_running, 1);
+        BOOST_REQUIRE_LE(max_running, 4);
+
+        cln.close().get();
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_http_hedging) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+
+        // The first request gets stuck, the ones after it don't
+        unsigned requests = 0;
+        promise<> unblock;
+        auto handler = [&] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+            auto f = requests++ == 0 ? unblock.get_future() : make_ready_future<>();
+            return f.then([n = requests, rep = std::move(rep)] () mutable {
+                rep->write_body("txt", to_sstring(n));
+                return std::move(rep);
+            });
+        };
+        server._routes.put(GET, "/test", new function_handler(handler, "txt"));
+        server._routes.put(POST, "/test", new function_handler(handler, "txt"));
+        server.do_accepts(0).get();
+
+        auto cln = http::experimental::client(std::make_unique<loopback_http_factory>(lcf));
+        cln.set_hedging(std::chrono::milliseconds(10));
+        auto make_request = [&cln] (sstring method) {
+            sstring ret;
+            unsigned calls = 0;
+            cln.make_request(http::request::make(std::move(method), "test", "/test"), [&] (const http::reply& rep, input_stream<char>&& in) {
+                calls++;
+                return util::read_entire_stream_contiguous(in).then([&ret] (sstring body) {
+                    ret = std::move(body);
+                });
+            }, http::reply::status_type::ok).get();
+            BOOST_REQUIRE_EQUAL(calls, 1);
+            return ret;
+        };
+
+        // The copy sent after the delay replies, the stuck one is cancelled
+        BOOST_REQUIRE_EQUAL(make_request("GET"), "2");
+        BOOST_REQUIRE_EQUAL(cln.hedged_requests_nr(), 1);
+        BOOST_REQUIRE_EQUAL(cln.hedge_wins_nr(), 1);
+
+        // Replies within the delay don't make copies
+        BOOST_REQUIRE_EQUAL(make_request("GET"), "3");
+        BOOST_REQUIRE_EQUAL(cln.hedged_requests_nr(), 1);
+
+        // Non-idempotent requests are never sent twice
+        unblock.set_value();
+        requests = 0;
+        unblock = promise<>();
+        auto f = seastar::async([&] {
+            BOOST_REQUIRE_EQUAL(make_request("POST"), "1");
+        });
+        sleep(std::chrono::milliseconds(50)).get();
+        BOOST_REQUIRE_EQUAL(requests, 1);
+        unblock.set_value();
+        f.get();
+        BOOST_REQUIRE_EQUAL(cln.hedged_requests_nr(), 1);
+
+        cln.close().get();
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_request_shedding) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+
+        promise<> unblock;
+        auto slow = new function_handler([&unblock] (std::unique_ptr<http::request> req, std::unique_ptr<http::reply> rep) {
+            return unblock.get_future().then([rep = std::move(rep)] () mutable {
+                rep->write_body("txt", sstring("slow"));
+                return std::move(rep);
+            });
+        }, "txt");
+        slow->max_concurrency(1).register_metrics("test", "slow");
+        server._routes.put(GET, "/slow", slow);
+        auto fast = new function_handler([] (const_req req) {
+            return "fast";
+        }, "txt");
+        server._routes.put(GET, "/fast", fast);
+        server.do_accepts(0).get();
+
+        auto cln = http::experimental::client(std::make_unique<loopback_http_factory>(lcf), 2);
+        auto get = [&cln] (sstring path, http::reply::status_type expected) {
+            return cln.make_request(http::request::make("GET", "test", std::move(path)), [] (const http::reply& rep, input_stream<char>&& in) {
+                return util::skip_entire_stream(in);
+            }, expected);
+        };
+
+        auto first = get("/slow", http::reply::status_type::ok);
+        while (slow->stats().in_flight == 0) {
+            yield().get();
+        }
+        // The route is at its limit, other routes are not
+        get("/slow", http::reply::status_type::service_unavailable).get();
+        get("/fast", http::reply::status_type::ok).get();
+        BOOST_REQUIRE_EQUAL(slow->stats().shed, 1);
+        BOOST_REQUIRE_EQUAL(server.requests_in_flight(), 1);
+
+        // So is the server
+        server.set_max_concurrent_requests(1);
+        get("/fast", http::reply::status_type::service_unavailable).get();
+        BOOST_REQUIRE_EQUAL(server.requests_shed(), 2);
+
+        unblock.set_value();
+        first.get();
+        get("/fast", http::reply::status_type::ok).get();
+        BOOST_REQUIRE_EQUAL(slow->stats().requests, 1);
+        BOOST_REQUIRE_EQUAL(slow->stats().in_flight, 0);
+        BOOST_REQUIRE_EQUAL(fast->stats().requests, 2);
+        BOOST_REQUIRE_EQUAL(server.requests_in_flight(), 0);
+
+        cln.close().get();
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_static_response_handler) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        server._routes.put(GET, "/health", new static_response_handler("{\"status\": \"up\"}", "json"));
+        server._routes.put(GET, "/gone", new static_response_handler("gone", "txt", http::reply::status_type::gone));
+        server.do_accepts(0).get();
+
+        auto cln = http::experimental::client(std::make_unique<loopback_http_factory>(lcf), 1);
+        for (int i = 0; i < 3; i++) {
+            cln.make_request(http::request::make("GET", "test", "/health"), [] (const http::reply& rep, input_stream<char>&& in) {
+                BOOST_REQUIRE_EQUAL(rep.get_header("Content-Type"), "application/json");
+                BOOST_REQUIRE_EQUAL(rep.get_header("Server"), "Seastar httpd");
+                BOOST_REQUIRE(!rep.get_header("Date").empty());
+                return util::read_entire_stream_contiguous(in).then([] (sstring body) {
+                    BOOST_REQUIRE_EQUAL(body, "{\"status\": \"up\"}");
+                });
+            }, http::reply::status_type::ok).get();
+        }
+        cln.make_request(http::request::make("GET", "test", "/gone"), [] (const http::reply& rep, input_stream<char>&& in) {
+            return util::read_entire_stream_contiguous(in).then([] (sstring body) {
+                BOOST_REQUIRE_EQUAL(body, "gone");
+            });
+        }, http::reply::status_type::gone).get();
+        // The responses went over a single connection
+        BOOST_REQUIRE_EQUAL(cln.total_new_connections_nr(), 1);
+
+        cln.close().get();
+        server.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_client_prewarm_and_idle_eviction) {
+    return seastar::async([] {
+        loopback_connection_factory lcf(1);
+        http_server server("test");
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        server._routes.put(GET, "/test", new function_handler([] (const_req req) {
+            return "ok";
+        }, "txt"));
+        server.do_accepts(0).get();
+
+        auto cln = http::experimental::client(std::make_unique<loopback_http_factory>(lcf), 2 /* max connections */);
+        // Limited by the maximum number of connections
+        cln.prewarm(3).get();
+        BOOST_REQUIRE_EQUAL(cln.connections_nr(), 2);
+        BOOST_REQUIRE_EQUAL(cln.idle_connections_nr(), 2);
+        BOOST_REQUIRE_EQUAL(cln.total_new_connections_nr(), 2);
+
+        auto get = [&cln] {
+            return cln.make_request(http::request::make("GET", "test", "/test"), [] (const http::reply& rep, input_stream<char>&& in) {
+                return util::skip_entire_stream(in);
+            }, http::reply::status_type::ok);
+        };
+
+        // Served by the prewarmed connections without waiting
+        when_all_succeed(get(), get()).get();
+        BOOST_REQUIRE_EQUAL(cln.total_new_connections_nr(), 2);
+        BOOST_REQUIRE_EQUAL(cln.connection_waits_nr(), 0);
+
+        cln.set_idle_timeout(std::chrono::milliseconds(50));
+        sleep(std::chrono::milliseconds(300)).get();
+        BOOST_REQUIRE_EQUAL(cln.evicted_connections_nr(), 2);
+        BOOST_REQUIRE_EQUAL(cln.idle_connections_nr(), 0);
+
+        get().get();
+        BOOST_REQUIRE_EQUAL(cln.total_new_connections_nr(), 3);
+        BOOST_REQUIRE_EQUAL(cln.connection_waits_nr(), 1);
+
+        cln.close().get();
+        server.stop().get();
+    });
+}
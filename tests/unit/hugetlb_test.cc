@@ -0,0 +1,68 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+// Run with --hugetlb-page-size 2M (see CMakeLists.txt). The machine may
+// have no huge pages reserved, in which case the memory falls back to
+// regular pages, and everything here must hold either way.
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/core/memory.hh>
+#include <seastar/core/smp.hh>
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace seastar;
+
+SEASTAR_THREAD_TEST_CASE(test_backing_stats_cover_memory) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    smp::invoke_on_all([] {
+        auto backing = memory::backing_stats();
+        fmt::print("shard {}: {} bytes in 2M pages, {} in 1G pages, {} in regular pages\n",
+                this_shard_id(), backing.hugetlb_2m, backing.hugetlb_1g, backing.regular);
+        BOOST_REQUIRE_EQUAL(backing.hugetlb_2m + backing.hugetlb_1g + backing.hugetlbfs + backing.regular,
+                memory::stats().total_memory());
+        // Never larger pages than asked for, nor hugetlbfs files
+        BOOST_REQUIRE_EQUAL(backing.hugetlb_1g, 0);
+        BOOST_REQUIRE_EQUAL(backing.hugetlbfs, 0);
+    }).get();
+#endif
+}
+
+SEASTAR_THREAD_TEST_CASE(test_touch_hugetlb_memory) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    // The pages are reserved at mmap() time, so touching all of the
+    // memory that can be allocated must not fault
+    auto chunk = size_t(4) << 20;
+    auto budget = memory::stats().free_memory() / 2;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    for (size_t allocated = 0; allocated + chunk <= budget; allocated += chunk) {
+        chunks.emplace_back(new char[chunk]);
+        std::memset(chunks.back().get(), 0x5a, chunk);
+    }
+    for (auto& c : chunks) {
+        BOOST_REQUIRE_EQUAL(c[chunk - 1], 0x5a);
+    }
+#endif
+}
@@ -0,0 +1,124 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+// Run with --idle-poll-adaptive (see CMakeLists.txt)
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/core/internal/idle_poll.hh>
+#include <seastar/core/internal/poll.hh>
+#include <seastar/core/metrics_api.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/smp.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+using internal::idle_poll_estimator;
+
+SEASTAR_TEST_CASE(test_idle_poll_learns_short_periods) {
+    idle_poll_estimator e(200us);
+    // Nothing learnt yet
+    BOOST_REQUIRE(e.poll_time() == 0ns);
+    for (int i = 0; i < 100; ++i) {
+        e.learn(10us);
+    }
+    BOOST_REQUIRE_GT(e.average(), 9us);
+    BOOST_REQUIRE_LE(e.average(), 10us);
+    BOOST_REQUIRE(e.poll_time() == e.average() * 2);
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_idle_poll_sleeps_on_long_periods) {
+    idle_poll_estimator e(200us);
+    for (int i = 0; i < 100; ++i) {
+        e.learn(150us);
+    }
+    // Polling twice as long would pass the limit
+    BOOST_REQUIRE(e.poll_time() == 0ns);
+    // and work coming quickly again brings polling back
+    for (int i = 0; i < 100; ++i) {
+        e.learn(5us);
+    }
+    BOOST_REQUIRE_GT(e.poll_time(), 0ns);
+    BOOST_REQUIRE_LE(e.poll_time(), 20us);
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_idle_poll_single_long_sleep) {
+    idle_poll_estimator e(200us);
+    for (int i = 0; i < 100; ++i) {
+        e.learn(10us);
+    }
+    // A long sleep counts as the limit only, and does not stop polling
+    e.learn(10s);
+    BOOST_REQUIRE_LE(e.average(), 34us);
+    BOOST_REQUIRE_GT(e.poll_time(), 0ns);
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_idle_poll_disabled_polling) {
+    idle_poll_estimator e(0us);
+    e.learn(1us);
+    BOOST_REQUIRE(e.poll_time() == 0ns);
+    return make_ready_future<>();
+}
+
+// The shards keep being woken up by work, whether it comes while they poll
+// or after they went to sleep
+SEASTAR_THREAD_TEST_CASE(test_idle_poll_adaptive_wakeups) {
+    auto other = (this_shard_id() + 1) % smp::count;
+    for (auto gap : {0us, 5us, 50us, 1000us, 20000us}) {
+        for (int i = 0; i < 20; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            seastar::sleep(gap).get();
+            smp::submit_to(other, [gap] {
+                return seastar::sleep(gap);
+            }).get();
+            BOOST_REQUIRE_GE(std::chrono::steady_clock::now() - start, 2 * gap);
+        }
+    }
+}
+
+static int64_t sleep_time_ms() {
+    const auto& values = metrics::impl::get_value_map();
+    return values.at("reactor_sleep_time_ms_total").begin()->second->get_function()().i();
+}
+
+// A poller made by make_idle_pollfn() keeps the reactor awake while it
+// finds work, and lets it sleep once it does not
+SEASTAR_THREAD_TEST_CASE(test_idle_pollfn_lets_reactor_sleep) {
+    unsigned busy = 1000;
+    unsigned polls = 0;
+    internal::poller idle_poller(internal::make_idle_pollfn([&] {
+        ++polls;
+        if (busy) {
+            --busy;
+            return true;
+        }
+        return false;
+    }));
+    auto before = sleep_time_ms();
+    seastar::sleep(300ms).get();
+    BOOST_REQUIRE_EQUAL(busy, 0);
+    BOOST_REQUIRE_GT(polls, 1000);
+    BOOST_REQUIRE_GE(sleep_time_ms() - before, 150);
+}
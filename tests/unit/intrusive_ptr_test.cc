@@ -0,0 +1,118 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/core/intrusive_ptr.hh>
+#include <seastar/core/weak_ptr.hh>
+#include <unordered_set>
+
+using namespace seastar;
+
+static_assert(sizeof(intrusive_ptr<int>) == sizeof(int*));
+
+static int destroyed = 0;
+
+struct counted : intrusive_refcounted<counted> {
+    int value;
+    explicit counted(int v) : value(v) {}
+    ~counted() { ++destroyed; }
+};
+
+BOOST_AUTO_TEST_CASE(test_intrusive_ptr_counts) {
+    destroyed = 0;
+    {
+        auto p = make_intrusive<counted>(3);
+        BOOST_REQUIRE_EQUAL(p.use_count(), 1);
+        auto q = p;
+        BOOST_REQUIRE_EQUAL(p.use_count(), 2);
+        BOOST_REQUIRE(p == q);
+        auto r = std::move(q);
+        BOOST_REQUIRE(!q);
+        BOOST_REQUIRE_EQUAL(r->value, 3);
+        BOOST_REQUIRE_EQUAL(p.use_count(), 2);
+
+        // A reference made from the object itself shares the count
+        auto s = r->shared_from_this();
+        intrusive_ptr<const counted> c = s;
+        BOOST_REQUIRE_EQUAL(p.use_count(), 4);
+        r.reset();
+        s = nullptr;
+        c = {};
+        BOOST_REQUIRE_EQUAL(p.use_count(), 1);
+        BOOST_REQUIRE_EQUAL(destroyed, 0);
+
+        std::unordered_set<intrusive_ptr<counted>> set;
+        set.insert(p);
+        BOOST_REQUIRE(set.contains(p));
+    }
+    BOOST_REQUIRE_EQUAL(destroyed, 1);
+}
+
+static int disposed = 0;
+
+struct pooled;
+
+struct pooled_disposer {
+    void operator()(pooled* p) const noexcept;
+};
+
+struct pooled : intrusive_refcounted<pooled, pooled_disposer> {};
+
+void pooled_disposer::operator()(pooled* p) const noexcept {
+    ++disposed;
+    delete p;
+}
+
+BOOST_AUTO_TEST_CASE(test_intrusive_ptr_custom_deleter) {
+    disposed = 0;
+    auto p = make_intrusive<pooled>();
+    auto q = p;
+    p.reset();
+    BOOST_REQUIRE_EQUAL(disposed, 0);
+    q.reset();
+    BOOST_REQUIRE_EQUAL(disposed, 1);
+}
+
+struct base : intrusive_refcounted<base> {
+    virtual ~base() = default;
+};
+
+struct derived : base, weakly_referencable<derived> {};
+
+BOOST_AUTO_TEST_CASE(test_intrusive_ptr_weak_and_derived) {
+    auto d = make_intrusive<derived>();
+    intrusive_ptr<base> b = d;
+    auto w = d->weak_from_this();
+    BOOST_REQUIRE_EQUAL(b.use_count(), 2);
+    BOOST_REQUIRE(static_pointer_cast<derived>(b) == d);
+
+    // Weak references do not keep the object alive, but can be
+    // turned back into strong ones while it is
+    d.reset();
+    BOOST_REQUIRE(w);
+    auto again = intrusive_ptr<derived>(w.get());
+    BOOST_REQUIRE_EQUAL(again.use_count(), 2);
+    again.reset();
+    b.reset();
+    BOOST_REQUIRE(!w);
+}
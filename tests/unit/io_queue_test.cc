@@ -20,6 +20,7 @@
  * Copyright (C) 2021 ScyllaDB
  */
 
+#include <seastar/core/coroutine.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/sleep.hh>
 #include <seastar/testing/random.hh>
@@ -33,7 +34,9 @@
 #include <seastar/core/io_intent.hh>
 #include <seastar/core/internal/io_request.hh>
 #include <seastar/core/internal/io_sink.hh>
+#include <sys/sysmacros.h>
 #include <seastar/util/assert.hh>
+#include <seastar/util/defer.hh>
 #include <seastar/util/internal/iovec_utils.hh>
 
 using namespace seastar;
@@ -76,8 +79,8 @@ struct io_queue_for_tests {
     io_queue queue;
     timer<> kicker;
 
-    io_queue_for_tests()
-        : group(std::make_shared<io_group>(io_queue::config{0}, 1))
+    explicit io_queue_for_tests(io_queue::config cfg = io_queue::config{0})
+        : group(std::make_shared<io_group>(std::move(cfg), 1))
         , sink()
         , queue(group, sink)
         , kicker([this] { kick(); })
@@ -94,6 +97,14 @@ struct io_queue_for_tests {
     future<size_t> queue_request(internal::priority_class pc, internal::io_direction_and_length dnl, internal::io_request req, io_intent* intent, iovec_keeper iovs) noexcept {
         return queue.queue_request(pc, dnl, std::move(req), intent, std::move(iovs));
     }
+
+    void control_latency() {
+        queue.control_latency();
+    }
+
+    bool latency_controller_armed() const {
+        return queue._latency_controller.armed();
+    }
 };
 
 internal::priority_class get_default_pc() {
@@ -325,6 +336,143 @@ SEASTAR_THREAD_TEST_CASE(test_io_cancellation) {
     when_all_succeed(finished.begin(), finished.end()).get();
 }
 
+SEASTAR_THREAD_TEST_CASE(test_dispatched_io_cancellation) {
+    io_queue_for_tests tio;
+    io_intent cancelled, completed;
+    int val = 1;
+
+    auto write = [&] (uint64_t pos, io_intent& intent) {
+        return tio.queue_request(get_default_pc(), internal::io_direction_and_length(internal::io_direction_and_length::write_idx, 1),
+                fake_file::make_write_req(pos, &val), &intent, {});
+    };
+    auto f_cancelled = write(0, cancelled);
+    auto f_completed = write(1, completed);
+
+    seastar::sleep(std::chrono::milliseconds(500)).get();
+    tio.queue.poll_io_queue();
+    std::vector<io_completion*> dispatched;
+    tio.sink.drain([&] (const internal::io_request& rq, io_completion* desc) -> bool {
+        BOOST_REQUIRE(rq.opcode() == internal::io_request::operation::write);
+        dispatched.push_back(desc);
+        return true;
+    });
+    BOOST_REQUIRE_EQUAL(dispatched.size(), 2);
+
+    // The kernel is asked to abort only the requests still in flight
+    dispatched[1]->complete_with(1);
+    BOOST_REQUIRE_EQUAL(f_completed.get(), 1);
+    completed.cancel();
+    cancelled.cancel();
+    std::vector<void*> cancels;
+    tio.sink.drain([&] (const internal::io_request& rq, io_completion* desc) -> bool {
+        BOOST_REQUIRE(rq.opcode() == internal::io_request::operation::cancel);
+        BOOST_REQUIRE(desc == nullptr);
+        cancels.push_back(rq.as<internal::io_request::operation::cancel>().addr);
+        return true;
+    });
+    BOOST_REQUIRE(cancels == std::vector<void*>{dispatched[0]});
+
+    dispatched[0]->complete_with(-ECANCELED);
+    BOOST_REQUIRE_THROW(f_cancelled.get(), cancelled_error);
+}
+
+// The deadline of an intent reaches the fair queue, so its requests
+// overtake the earlier ones of their class
+SEASTAR_THREAD_TEST_CASE(test_intent_deadline) {
+    io_queue::config cfg{0};
+    cfg.deadline_scheduling = true;
+    io_queue_for_tests tio(cfg);
+    io_intent urgent;
+    urgent.set_deadline(std::chrono::steady_clock::now());
+    int val = 1;
+
+    std::vector<future<size_t>> writes;
+    for (uint64_t pos = 0; pos < 4; pos++) {
+        writes.push_back(tio.queue_request(get_default_pc(), internal::io_direction_and_length(internal::io_direction_and_length::write_idx, 1),
+                fake_file::make_write_req(pos, &val), nullptr, {}));
+    }
+    writes.push_back(tio.queue_request(get_default_pc(), internal::io_direction_and_length(internal::io_direction_and_length::write_idx, 1),
+            fake_file::make_write_req(4, &val), &urgent, {}));
+
+    seastar::sleep(std::chrono::milliseconds(500)).get();
+    tio.queue.poll_io_queue();
+    std::vector<uint64_t> order;
+    tio.sink.drain([&] (const internal::io_request& rq, io_completion* desc) -> bool {
+        order.push_back(rq.as<internal::io_request::operation::write>().pos);
+        desc->complete_with(1);
+        return true;
+    });
+    BOOST_REQUIRE(order == std::vector<uint64_t>({4, 0, 1, 2, 3}));
+    when_all_succeed(writes.begin(), writes.end()).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_latency_target_shares) {
+    io_queue::config cfg{0};
+    // The test runs the controller itself
+    cfg.latency_control_period = std::chrono::hours(1);
+    io_queue_for_tests tio(cfg);
+    auto fg = internal::priority_class(create_scheduling_group("fg", 100).get());
+    auto bg = internal::priority_class(create_scheduling_group("bg", 100).get());
+    tio.queue.update_latency_target_for_class(fg, std::chrono::microseconds(1), 0.99);
+    BOOST_REQUIRE(tio.latency_controller_armed());
+    tio.queue.update_min_shares_for_class(bg, 10);
+    int val = 1;
+
+    auto queue_write = [&] {
+        return tio.queue_request(fg, internal::io_direction_and_length(internal::io_direction_and_length::write_idx, 1),
+                fake_file::make_write_req(0, &val), nullptr, {});
+    };
+    auto complete_after = [&] (future<size_t> write, std::chrono::milliseconds delay) {
+        seastar::sleep(delay).get();
+        tio.queue.poll_io_queue();
+        tio.sink.drain([] (const internal::io_request&, io_completion* desc) -> bool {
+            desc->complete_with(1);
+            return true;
+        });
+        BOOST_REQUIRE_EQUAL(write.get(), 1);
+    };
+
+    complete_after(queue_write(), std::chrono::milliseconds(10));
+    // The target is missed, the background class backs off
+    tio.control_latency();
+    BOOST_REQUIRE_EQUAL(tio.queue.dynamic_shares_for_class(bg), 70);
+    BOOST_REQUIRE_EQUAL(tio.queue.dynamic_shares_for_class(fg), 100);
+
+    // A period without completions tells nothing, even with a request
+    // pending, and doesn't count as a miss
+    auto write = queue_write();
+    tio.control_latency();
+    BOOST_REQUIRE_EQUAL(tio.queue.dynamic_shares_for_class(bg), 78);
+    // The request counts once it completes
+    complete_after(std::move(write), std::chrono::milliseconds(10));
+    tio.control_latency();
+    BOOST_REQUIRE_EQUAL(tio.queue.dynamic_shares_for_class(bg), 54);
+
+    // Idle, the target is met and the shares recover gradually
+    tio.control_latency();
+    BOOST_REQUIRE_GT(tio.queue.dynamic_shares_for_class(bg), 54);
+    BOOST_REQUIRE_LT(tio.queue.dynamic_shares_for_class(bg), 100);
+    for (int i = 0; i < 50; i++) {
+        tio.control_latency();
+    }
+    BOOST_REQUIRE_EQUAL(tio.queue.dynamic_shares_for_class(bg), 100);
+
+    // Setting the shares restores them at once
+    complete_after(queue_write(), std::chrono::milliseconds(10));
+    tio.control_latency();
+    BOOST_REQUIRE_EQUAL(tio.queue.dynamic_shares_for_class(bg), 70);
+    tio.queue.update_shares_for_class(bg, 200);
+    BOOST_REQUIRE_EQUAL(tio.queue.dynamic_shares_for_class(bg), 200);
+
+    // And so does clearing the last target, which stops the controller
+    complete_after(queue_write(), std::chrono::milliseconds(10));
+    tio.control_latency();
+    BOOST_REQUIRE_EQUAL(tio.queue.dynamic_shares_for_class(bg), 140);
+    tio.queue.update_latency_target_for_class(fg, std::chrono::microseconds(0), 0.99);
+    BOOST_REQUIRE(!tio.latency_controller_armed());
+    BOOST_REQUIRE_EQUAL(tio.queue.dynamic_shares_for_class(bg), 200);
+}
+
 SEASTAR_TEST_CASE(test_request_buffer_split) {
     auto ensure = [] (const std::vector<internal::io_request::part>& parts, const internal::io_request& req, int idx, uint64_t pos, size_t size, uintptr_t mem) {
         BOOST_REQUIRE(parts[idx].req.opcode() == req.opcode());
@@ -510,3 +658,316 @@ SEASTAR_TEST_CASE(test_request_iovec_split) {
 
     return make_ready_future<>();
 }
+
+SEASTAR_THREAD_TEST_CASE(test_online_calibration) {
+    io_queue::config cfg{0};
+    cfg.calibration_min_factor = 0.5;
+    cfg.calibration_max_factor = 2.0;
+    io_group group(cfg, 1);
+    auto goal = group.io_latency_goal();
+    BOOST_REQUIRE_EQUAL(group.rate_factor(), 1.0);
+
+    // Completions within the goal don't mean much unless the rate is the limit
+    group.calibrate(goal / 2, false);
+    BOOST_REQUIRE_EQUAL(group.rate_factor(), 1.0);
+
+    group.calibrate(goal / 2, true);
+    BOOST_REQUIRE_GT(group.rate_factor(), 1.0);
+    for (int i = 0; i < 1000; i++) {
+        group.calibrate(goal / 2, true);
+    }
+    BOOST_REQUIRE_EQUAL(group.rate_factor(), 2.0);
+    BOOST_REQUIRE_LT(group.io_latency_goal(), goal);
+
+    group.calibrate(goal * 2, true);
+    BOOST_REQUIRE_LT(group.rate_factor(), 2.0);
+    for (int i = 0; i < 1000; i++) {
+        group.calibrate(goal * 2, false);
+    }
+    BOOST_REQUIRE_EQUAL(group.rate_factor(), 0.5);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_sink_submission_timestamp) {
+    struct noop_completion final : public io_completion {
+        virtual void complete(size_t) noexcept override {}
+        virtual void set_exception(std::exception_ptr) noexcept override {}
+    } completion;
+
+    internal::io_sink sink;
+    int val = 0;
+    std::chrono::steady_clock::time_point submitted;
+    sink.submit(&completion, fake_file::make_write_req(0, &val), &submitted);
+    sink.submit(&completion, fake_file::make_write_req(1, &val));
+
+    auto before = std::chrono::steady_clock::now();
+    BOOST_REQUIRE_EQUAL(sink.drain([] (const internal::io_request&, io_completion*) { return false; }), 0);
+    BOOST_REQUIRE(submitted >= before);
+
+    before = std::chrono::steady_clock::now();
+    unsigned consumed = 0;
+    BOOST_REQUIRE_EQUAL(sink.drain([&] (const internal::io_request&, io_completion*) {
+        // The timestamp is already set when the kernel gets the request
+        BOOST_REQUIRE(submitted >= before);
+        consumed++;
+        return true;
+    }), 2);
+    BOOST_REQUIRE_EQUAL(consumed, 2);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_nvme_request_flow) {
+    io_queue_for_tests tio;
+    std::vector<char> buf(16 << 10);
+
+    // 4KiB blocks, 4 of them written from block 3, then 1 read from block 2^32
+    auto wr = tio.queue_request(get_default_pc(), internal::io_direction_and_length(internal::io_direction_and_length::write_idx, 16 << 10),
+            internal::io_request::make_nvme(7, 1, 12, 3 << 12, buf.data(), 16 << 10, true, true), nullptr, {});
+    auto rd = tio.queue_request(get_default_pc(), internal::io_direction_and_length(internal::io_direction_and_length::read_idx, 4 << 10),
+            internal::io_request::make_nvme(7, 1, 12, uint64_t(1) << 44, buf.data(), 4 << 10, false), nullptr, {});
+
+    seastar::sleep(std::chrono::milliseconds(500)).get();
+    tio.queue.poll_io_queue();
+    unsigned consumed = 0;
+    tio.sink.drain([&] (const internal::io_request& rq, io_completion* desc) -> bool {
+        BOOST_REQUIRE(rq.opcode() == internal::io_request::operation::nvme);
+        BOOST_REQUIRE_EQUAL(rq.opname(), "nvme");
+        const auto& op = rq.as<internal::io_request::operation::nvme>();
+        BOOST_REQUIRE_EQUAL(op.fd, 7);
+        BOOST_REQUIRE_EQUAL(op.nsid, 1u);
+        BOOST_REQUIRE_EQUAL(op.addr, buf.data());
+        if (op.write) {
+            // Queued whole, with forced unit access standing for dsync
+            BOOST_REQUIRE(rq.is_write() && !rq.is_read() && rq.dsync());
+            BOOST_REQUIRE_EQUAL(op.size, 16u << 10);
+            BOOST_REQUIRE_EQUAL(op.nvme_opcode(), 0x01);
+            BOOST_REQUIRE_EQUAL(op.slba(), 3u);
+            BOOST_REQUIRE_EQUAL(op.cdw12(), 3u | (1u << 30));
+            desc->complete_with(0);
+        } else {
+            BOOST_REQUIRE(rq.is_read() && !rq.is_write() && !rq.dsync());
+            BOOST_REQUIRE_EQUAL(op.nvme_opcode(), 0x02);
+            BOOST_REQUIRE_EQUAL(op.slba(), uint64_t(1) << 32);
+            BOOST_REQUIRE_EQUAL(op.cdw12(), 0u);
+            // An NVMe status, e.g. an unrecovered read error
+            desc->complete_with(0x281);
+        }
+        consumed++;
+        return true;
+    });
+    BOOST_REQUIRE_EQUAL(consumed, 2);
+
+    // The status is handed back as is, for the file to turn into an error
+    BOOST_REQUIRE_EQUAL(wr.get(), 0);
+    BOOST_REQUIRE_EQUAL(rd.get(), 0x281);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_large_io_chain_flow) {
+    io_queue::config cfg{0};
+    // as --io-properties would set them, a 128k write takes half of the
+    // capacity granted at once
+    cfg.blocks_count_rate = (256 << 20) >> io_queue::block_size_shift;
+    cfg.req_count_rate = 100000;
+    io_queue_for_tests tio(cfg);
+    auto max_write = tio.queue.get_request_limits().max_write;
+
+    // Two writes longer than a request can be, and an fdatasync: the chain
+    // costs more than the fair queue grants at once
+    std::vector<std::vector<int>> bufs(2, std::vector<int>(2 * max_write / sizeof(int)));
+    bufs[0][0] = 13;
+    bufs[1][0] = 42;
+    std::vector<internal::io_request> reqs;
+    reqs.push_back(internal::io_request::make_write(0, 0, bufs[0].data(), 2 * max_write, false));
+    reqs.push_back(internal::io_request::make_write(0, 2 * max_write, bufs[1].data(), 2 * max_write, false));
+    reqs.push_back(internal::io_request::make_fdatasync(0));
+    auto f = tio.queue.submit_io_chain(get_default_pc(), std::move(reqs), nullptr);
+
+    std::vector<uint64_t> executed;
+    for (int i = 0; i < 100 && !f.available(); i++) {
+        seastar::sleep(std::chrono::milliseconds(10)).get();
+        tio.queue.poll_io_queue();
+        tio.sink.drain([&] (const internal::io_request& rq, io_completion* desc) -> bool {
+            if (rq.opcode() == internal::io_request::operation::fdatasync) {
+                executed.push_back(std::numeric_limits<uint64_t>::max());
+                desc->complete_with(0);
+                return true;
+            }
+            const auto& op = rq.as<internal::io_request::operation::write>();
+            BOOST_REQUIRE_LE(op.size, max_write);
+            executed.push_back(op.pos);
+            desc->complete_with(op.size);
+            return true;
+        });
+    }
+    BOOST_REQUIRE_EQUAL(f.get(), 4 * max_write);
+    // In order, the fdatasync after all the writes
+    BOOST_REQUIRE(executed == std::vector<uint64_t>({0, max_write, 2 * max_write, 3 * max_write, std::numeric_limits<uint64_t>::max()}));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_adjacent_reads_merge) {
+    io_queue::config cfg{0};
+    cfg.max_merged_read_length = 64 << 10;
+    io_queue_for_tests tio(cfg);
+
+    static constexpr size_t len = 512;
+    std::vector<std::vector<char>> bufs(4, std::vector<char>(len));
+    std::vector<future<size_t>> reads;
+    // three adjacent reads, queued out of order, and one further away
+    for (uint64_t pos : {len, uint64_t(0), 2 * len, 8 * len}) {
+        auto& buf = bufs[reads.size()];
+        reads.push_back(tio.queue_request(get_default_pc(), internal::io_direction_and_length(internal::io_direction_and_length::read_idx, len),
+                internal::io_request::make_read(0, pos, buf.data(), len, false), nullptr, {}));
+    }
+
+    seastar::sleep(std::chrono::milliseconds(500)).get();
+    tio.queue.poll_io_queue();
+    unsigned submitted = 0;
+    tio.sink.drain([&] (const internal::io_request& rq, io_completion* desc) -> bool {
+        submitted++;
+        if (rq.opcode() == internal::io_request::operation::readv) {
+            const auto& op = rq.as<internal::io_request::operation::readv>();
+            BOOST_REQUIRE_EQUAL(op.pos, 0);
+            BOOST_REQUIRE_EQUAL(op.iov_len, 3);
+            for (unsigned i = 0; i < op.iov_len; i++) {
+                std::fill_n(reinterpret_cast<char*>(op.iovec[i].iov_base), op.iovec[i].iov_len, char('a' + i));
+            }
+            // a short read, as at the end of the file
+            desc->complete_with(2 * len + 100);
+        } else {
+            const auto& op = rq.as<internal::io_request::operation::read>();
+            BOOST_REQUIRE_EQUAL(op.pos, 8 * len);
+            desc->complete_with(len);
+        }
+        return true;
+    });
+    BOOST_REQUIRE_EQUAL(submitted, 2);
+
+    BOOST_REQUIRE_EQUAL(reads[0].get(), len);
+    BOOST_REQUIRE_EQUAL(bufs[0][0], 'b');
+    BOOST_REQUIRE_EQUAL(reads[1].get(), len);
+    BOOST_REQUIRE_EQUAL(bufs[1][0], 'a');
+    BOOST_REQUIRE_EQUAL(reads[2].get(), 100);
+    BOOST_REQUIRE_EQUAL(bufs[2][0], 'c');
+    BOOST_REQUIRE_EQUAL(reads[3].get(), len);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_zone_append_order) {
+    io_queue_for_tests tio;
+    const dev_t dev = 1;
+    const uint64_t zone = 1 << 20;
+    unsigned loads = 0;
+    auto load = [&] {
+        loads++;
+        return make_ready_future<std::pair<uint64_t, uint64_t>>(zone + 100, zone + 200);
+    };
+
+    unsigned in_flight = 0;
+    std::vector<uint64_t> written;
+    bool fail = false;
+    auto write = [&] (uint64_t pos) -> future<> {
+        BOOST_REQUIRE_EQUAL(in_flight++, 0);
+        // the later appends finish their writes sooner
+        co_await seastar::sleep(std::chrono::milliseconds(10 - written.size()));
+        in_flight--;
+        if (fail) {
+            throw std::runtime_error("write failed");
+        }
+        written.push_back(pos);
+    };
+
+    std::vector<future<uint64_t>> appends;
+    for (unsigned i = 0; i < 5; i++) {
+        appends.push_back(tio.queue.append_to_zone(dev, zone, 10, load, write));
+    }
+    for (unsigned i = 0; i < 5; i++) {
+        BOOST_REQUIRE_EQUAL(appends[i].get(), zone + 100 + 10 * i);
+    }
+    BOOST_REQUIRE(written == std::vector<uint64_t>({zone + 100, zone + 110, zone + 120, zone + 130, zone + 140}));
+    BOOST_REQUIRE_EQUAL(loads, 1);
+
+    // the write pointer is loaded again after a failure, and once forgotten
+    fail = true;
+    BOOST_REQUIRE_THROW(tio.queue.append_to_zone(dev, zone, 10, load, write).get(), std::runtime_error);
+    fail = false;
+    BOOST_REQUIRE_EQUAL(tio.queue.append_to_zone(dev, zone, 10, load, write).get(), zone + 100);
+    BOOST_REQUIRE_EQUAL(loads, 2);
+
+    // past the capacity
+    BOOST_REQUIRE_THROW(tio.queue.append_to_zone(dev, zone, 91, load, write).get(), std::system_error);
+    BOOST_REQUIRE_EQUAL(tio.queue.append_to_zone(dev, zone, 90, load, write).get(), zone + 110);
+    BOOST_REQUIRE_EQUAL(loads, 2);
+
+    tio.queue.forget_zones(dev, 0, zone + 1);
+    BOOST_REQUIRE_EQUAL(tio.queue.append_to_zone(dev, zone, 10, load, write).get(), zone + 100);
+    BOOST_REQUIRE_EQUAL(loads, 3);
+    // other zones and devices are independent
+    tio.queue.forget_zones(dev, zone + 1, zone * 2);
+    tio.queue.forget_zones(dev + 1, 0, zone * 2);
+    BOOST_REQUIRE_EQUAL(tio.queue.append_to_zone(dev, zone, 10, load, write).get(), zone + 110);
+    BOOST_REQUIRE_EQUAL(loads, 3);
+}
+
+// A device without a queue of its own is resolved once, to the queue of
+// its disk or to the default one, and keeps resolving to it
+SEASTAR_THREAD_TEST_CASE(test_io_queue_alias) {
+    auto& default_queue = engine().get_io_queue(0);
+    auto unknown = makedev(4095, 4095);
+    BOOST_REQUIRE_EQUAL(&engine().get_io_queue(unknown), &default_queue);
+    BOOST_REQUIRE_EQUAL(&engine().get_io_queue(unknown), &default_queue);
+    BOOST_REQUIRE_EQUAL(&engine().get_io_queue(0), &default_queue);
+}
+
+// The budget caps the class over all the queues together, while each of
+// them alone is unlimited
+SEASTAR_THREAD_TEST_CASE(test_cross_device_bandwidth_budget) {
+    io_queue_for_tests disk1, disk2;
+    auto pc = internal::priority_class(create_scheduling_group("budget", 100).get());
+    constexpr uint64_t budget = 10 << 20;
+    io_queue::update_bandwidth_budget(pc, budget);
+    auto lift = defer([pc] () noexcept {
+        io_queue::update_bandwidth_budget(pc, std::numeric_limits<uint64_t>::max());
+    });
+
+    auto len = disk1.queue.get_request_limits().max_write;
+    // Twice the bucket's burst and a second's worth of budget
+    auto nr = 2 * (20 << 20) / len;
+    int val = 1;
+    std::vector<future<size_t>> writes;
+    for (size_t i = 0; i < nr; i++) {
+        auto& disk = i % 2 ? disk2 : disk1;
+        writes.push_back(disk.queue_request(pc, internal::io_direction_and_length(internal::io_direction_and_length::write_idx, len),
+                fake_file::make_write_req(0, &val), nullptr, {}));
+    }
+
+    uint64_t dispatched[2] = {0, 0};
+    auto poll = [&] {
+        for (auto* disk : {&disk1, &disk2}) {
+            disk->queue.poll_io_queue();
+            disk->sink.drain([&] (const internal::io_request&, io_completion* desc) -> bool {
+                dispatched[disk == &disk2] += len;
+                desc->complete_with(len);
+                return true;
+            });
+        }
+    };
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() < start + std::chrono::seconds(1)) {
+        poll();
+        seastar::sleep(std::chrono::milliseconds(5)).get();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    // The burst, and what the budget allows meanwhile
+    auto allowed = budget + budget * elapsed + 2 * len;
+    BOOST_REQUIRE_LE(dispatched[0] + dispatched[1], allowed);
+    BOOST_REQUIRE_GT(dispatched[0], 0);
+    BOOST_REQUIRE_GT(dispatched[1], 0);
+    BOOST_REQUIRE_LT(dispatched[0] + dispatched[1], nr * len);
+
+    // Lifting the budget lets the rest through
+    lift.cancel();
+    io_queue::update_bandwidth_budget(pc, std::numeric_limits<uint64_t>::max());
+    for (int i = 0; i < 400 && dispatched[0] + dispatched[1] < nr * len; i++) {
+        seastar::sleep(std::chrono::milliseconds(5)).get();
+        poll();
+    }
+    BOOST_REQUIRE_EQUAL(dispatched[0] + dispatched[1], nr * len);
+    when_all_succeed(writes.begin(), writes.end()).get();
+}
@@ -19,6 +19,8 @@
 /*
  * Copyright (C) 2016 ScyllaDB.
  */
+#include <map>
+#include <numeric>
 #include <vector>
 
 #include <seastar/core/do_with.hh>
@@ -27,6 +29,8 @@
 #include <seastar/core/vector-data-sink.hh>
 #include <seastar/json/formatter.hh>
 #include <seastar/json/json_elements.hh>
+#include <seastar/json/stream_parser.hh>
+#include <seastar/json/stream_writer.hh>
 #include <seastar/testing/thread_test_case.hh>
 
 using namespace seastar;
@@ -175,3 +179,181 @@ SEASTAR_THREAD_TEST_CASE(formatter_write) {
     });
 #endif
 }
+
+SEASTAR_THREAD_TEST_CASE(test_stream_writer) {
+    // small chunks, so that values span several of them
+    formatter_check_expected(R"({"s":"a\"b\\c\n\u001F","i":-42,"u":18446744073709551615,"d":0.1,"b":true,"n":null,"a":[1,[],{}]})", [] (auto& out) {
+        json::stream_writer w(out, 4);
+        w.begin_object();
+        w.key("s");
+        w.value("a\"b\\c\n\x1f");
+        w.key("i");
+        w.value(-42);
+        w.key("u");
+        w.value(std::numeric_limits<uint64_t>::max());
+        w.key("d");
+        w.value(0.1);
+        w.key("b");
+        w.value(true);
+        w.key("n");
+        w.null();
+        w.key("a");
+        w.begin_array();
+        w.value(1);
+        w.begin_array();
+        w.end_array();
+        w.begin_object();
+        w.end_object();
+        w.end_array();
+        w.end_object();
+        w.flush().get();
+    });
+
+    formatter_check_expected(R"([{"1":2},{"3":4}])", [] (auto& out) {
+        json::stream_writer w(out);
+        w.write(std::vector<std::map<int, int>>({{{1, 2}}, {{3, 4}}}));
+        w.flush().get();
+    });
+
+    formatter_check_expected(R"({"subject":"foo","values":[1,2,3]})", [] (auto& out) {
+        object_json obj;
+        obj.subject = "foo";
+        obj.values.push(1);
+        obj.values.push(2);
+        obj.values.push(3);
+        json::stream_writer w(out, 8);
+        w.write(obj);
+        w.flush().get();
+    });
+
+    formatter_check_expected("[1]", [] (auto& out) {
+        json::stream_writer w(out);
+        w.begin_array();
+        BOOST_REQUIRE_THROW(w.value(std::numeric_limits<double>::infinity()), std::out_of_range);
+        BOOST_REQUIRE_THROW(w.value(std::nan("")), std::invalid_argument);
+        w.value(1);
+        w.end_array();
+        w.flush().get();
+    });
+}
+
+SEASTAR_THREAD_TEST_CASE(test_stream_value) {
+    std::vector<int> values(10000);
+    std::iota(values.begin(), values.end(), 0);
+    sstring expected = formatter::to_json(values);
+    formatter_check_expected(expected, [&values] (auto& out) {
+        json::stream_value(values)(std::move(out)).get();
+    }, false);
+
+    std::map<sstring, int> m = {{"a", 1}, {"b", 2}};
+    formatter_check_expected(R"({"a":1,"b":2})", [&m] (auto& out) {
+        json::stream_value(m)(std::move(out)).get();
+    }, false);
+}
+
+struct nested_json : public json_base {
+    json_element<object_json> object;
+    json_list<object_json> objects;
+    json_list<sstring> strings;
+    json_element<double> d;
+    json_element<bool> b;
+
+    void register_params() {
+      add(&object, "object", true);
+      add(&objects, "objects");
+      add(&strings, "strings");
+      add(&d, "d");
+      add(&b, "b");
+    }
+
+    nested_json() { register_params(); }
+};
+
+// Parses the json fed in fragments of the given size
+static void parse_in_fragments(value_sink& sink, std::string_view s, size_t fragment_size) {
+    json::stream_parser parser(sink);
+    for (size_t pos = 0; pos < s.size(); pos += fragment_size) {
+        parser.feed(s.substr(pos, fragment_size));
+    }
+    parser.finish();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_stream_parser) {
+    // "é" and "😀", escaped
+    std::string_view json = R"( {"unknown": {"a": [1, {"b": null}], "c": "\"}"},
+        "object": {"subject": "a\"b\\c\n\u00e9\ud83d\ude00", "values": [1, -2, 3]},
+        "objects": [{"subject": "x"}, {"values": []}],
+        "strings": ["plain string, longer than a word", ""],
+        "d": -1.5e3, "b": true} )";
+    for (size_t fragment_size : {size_t(1), size_t(3), size_t(8), json.size()}) {
+        nested_json obj;
+        parse_in_fragments(obj, json, fragment_size);
+        BOOST_REQUIRE_EQUAL(obj.object().subject(), "a\"b\\c\né\U0001F600");
+        BOOST_REQUIRE(obj.object().values._elements == std::vector<long>({1, -2, 3}));
+        BOOST_REQUIRE_EQUAL(obj.objects._elements.size(), 2);
+        BOOST_REQUIRE_EQUAL(obj.objects._elements[0].subject(), "x");
+        BOOST_REQUIRE(!obj.objects._elements[0].values._set);
+        BOOST_REQUIRE(obj.objects._elements[1].values._set);
+        BOOST_REQUIRE(obj.strings._elements == std::vector<sstring>({"plain string, longer than a word", ""}));
+        BOOST_REQUIRE_EQUAL(obj.d(), -1500);
+        BOOST_REQUIRE_EQUAL(obj.b(), true);
+    }
+
+    // What the formatter writes parses back
+    object_json written;
+    written.subject = "\x01 \t\"";
+    written.values.push(std::numeric_limits<long>::min());
+    object_json read;
+    parse_in_fragments(read, formatter::to_json(written), 2);
+    BOOST_REQUIRE_EQUAL(read.subject(), written.subject());
+    BOOST_REQUIRE(read.values._elements == written.values._elements);
+
+    auto fails = [] (std::string_view s) {
+        nested_json obj;
+        BOOST_REQUIRE_THROW(parse_in_fragments(obj, s, 1), json::parse_error);
+        nested_json obj2;
+        BOOST_REQUIRE_THROW(parse_in_fragments(obj2, s, s.size()), json::parse_error);
+    };
+    fails(R"({"object": {}})" "x");
+    fails(R"({"object": {}, })");
+    fails(R"({"object": {"subject": 1}})");
+    fails(R"({"object": {"values": [1.5]}})");
+    fails(R"({"object": {"values": [01]}})");
+    fails(R"({"object": {"subject": "\ud83d"}})");
+    fails(R"({"object": {"subject": "a)" "\n" R"("}})");
+    fails(R"({"object": {}, "b": tru})");
+    fails(R"({"object": {}])");
+    fails(R"({"object": {})");
+    // the mandatory element is missing
+    fails(R"({"d": 1})");
+
+    nested_json deep;
+    BOOST_REQUIRE_THROW(parse_in_fragments(deep, std::string(100, '[') + std::string(100, ']'), 7), json::parse_error);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_parse_stream) {
+    class fragments_source_impl : public data_source_impl {
+        std::vector<temporary_buffer<char>> _bufs;
+    public:
+        explicit fragments_source_impl(std::vector<temporary_buffer<char>> bufs) : _bufs(std::move(bufs)) {
+            std::ranges::reverse(_bufs);
+        }
+        virtual future<temporary_buffer<char>> get() override {
+            if (_bufs.empty()) {
+                return make_ready_future<temporary_buffer<char>>();
+            }
+            auto buf = std::move(_bufs.back());
+            _bufs.pop_back();
+            return make_ready_future<temporary_buffer<char>>(std::move(buf));
+        }
+    };
+    std::vector<temporary_buffer<char>> bufs;
+    for (auto s : {R"({"subj)", R"(ect": "fo)", R"(o", "values": [12)", R"(3]})"}) {
+        bufs.emplace_back(s, strlen(s));
+    }
+    auto in = input_stream<char>(data_source(std::make_unique<fragments_source_impl>(std::move(bufs))));
+    object_json obj;
+    json::parse(in, obj).get();
+    BOOST_REQUIRE_EQUAL(obj.subject(), "foo");
+    BOOST_REQUIRE(obj.values._elements == std::vector<long>({123}));
+}
@@ -22,6 +22,10 @@
 #include <seastar/testing/test_case.hh>
 #include <seastar/util/log.hh>
 
+#include <sstream>
+#include <vector>
+#include <fmt/ranges.h>
+
 using namespace seastar;
 
 SEASTAR_TEST_CASE(log_buf_realloc) {
@@ -112,3 +116,58 @@ SEASTAR_TEST_CASE(log_buf_clear) {
 
     return make_ready_future<>();
 }
+
+SEASTAR_TEST_CASE(async_logging) {
+    logger log("async_logging_test");
+    std::ostringstream out;
+    logger::set_ostream(out);
+    logger::enable_async(4096);
+
+    for (int i = 0; i < 20; ++i) {
+        log.info("message {}", i);
+    }
+    // more than half the buffer, can't be queued
+    log.info("{}", std::string(3000, 'x'));
+    logger::flush_async();
+
+    auto text = out.str();
+    for (int i = 0; i < 20; ++i) {
+        BOOST_REQUIRE_NE(text.find(fmt::format("async_logging_test - message {}\n", i)), std::string::npos);
+    }
+    BOOST_REQUIRE_LT(text.find("message 11\n"), text.find("message 12\n"));
+    BOOST_REQUIRE_EQUAL(text.find(std::string(3000, 'x')), std::string::npos);
+    BOOST_REQUIRE_NE(text.find("1 log messages dropped"), std::string::npos);
+    BOOST_REQUIRE_EQUAL(logger::async_dropped_messages(), 1);
+
+    logger::disable_async();
+    log.info("synchronous");
+    BOOST_REQUIRE_NE(out.str().find("async_logging_test - synchronous\n"), std::string::npos);
+    logger::set_ostream(std::cerr);
+
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(async_logging_deferred_formatting) {
+    logger log("deferred_logging_test");
+    std::ostringstream out;
+    logger::set_ostream(out);
+    logger::enable_async(4096);
+    logger::set_deferred_formatting(true);
+
+    std::string s = "string";
+    sstring ss = "sstring";
+    log.info("{} {:.2f} {} {} {} {:>4}|", 42, 1.5, s, ss, "literal", 'c');
+    // not deferred
+    log.info("{}", std::vector<int>{1, 2});
+    logger::flush_async();
+
+    auto text = out.str();
+    BOOST_REQUIRE_NE(text.find("deferred_logging_test - 42 1.50 string sstring literal    c|\n"), std::string::npos);
+    BOOST_REQUIRE_NE(text.find("deferred_logging_test - [1, 2]\n"), std::string::npos);
+
+    logger::set_deferred_formatting(false);
+    logger::disable_async();
+    logger::set_ostream(std::cerr);
+
+    return make_ready_future<>();
+}
@@ -0,0 +1,99 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/core/alien.hh>
+#include <seastar/core/internal/poll.hh>
+#include <seastar/core/metrics_api.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+
+#include <chrono>
+#include <thread>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+// The loop time of this shard spent in the phase, in milliseconds
+static int64_t loop_phase_time(sstring phase) {
+    const auto& values = metrics::impl::get_value_map();
+    auto mf = values.find("reactor_loop_phase_time_ms");
+    if (mf != values.end()) {
+        for (auto&& [id, metric] : mf->second) {
+            if (id.labels().at("phase") == phase) {
+                return metric->get_function()().i();
+            }
+        }
+    }
+    throw std::runtime_error(fmt::format("no loop phase {}", phase));
+}
+
+static void spin(std::chrono::microseconds d) {
+    auto end = std::chrono::steady_clock::now() + d;
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+SEASTAR_THREAD_TEST_CASE(test_loop_phase_tasks) {
+    auto before = loop_phase_time("tasks");
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() < start + 200ms) {
+        spin(500us);
+        thread::yield();
+    }
+    BOOST_REQUIRE_GE(loop_phase_time("tasks") - before, 150);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_loop_phase_pollers) {
+    auto before = loop_phase_time("network");
+    auto tasks_before = loop_phase_time("tasks");
+    // A busy poller keeps the reactor from sleeping, and accounts for most
+    // of its loop while the test sleeps. Its time is estimated from a
+    // sample of the polls.
+    auto busy_poller = internal::poller::simple([] {
+        spin(200us);
+        return true;
+    }, internal::loop_phase::network);
+    seastar::sleep(300ms).get();
+    BOOST_REQUIRE_GE(loop_phase_time("network") - before, 150);
+    BOOST_REQUIRE_LT(loop_phase_time("tasks") - tasks_before, 150);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_alien_poller_wakes_reactor) {
+    // The alien queues have a poller of their own, which has to wake the
+    // reactor up from sleep as the smp poller did when it polled them
+    auto& alien = engine().alien();
+    auto shard = this_shard_id();
+    for (int i = 0; i < 3; ++i) {
+        promise<> done;
+        auto sender = std::thread([&alien, shard, &done] {
+            std::this_thread::sleep_for(100ms);
+            alien::run_on(alien, shard, [&done] () noexcept {
+                done.set_value();
+            });
+        });
+        done.get_future().get();
+        sender.join();
+    }
+}
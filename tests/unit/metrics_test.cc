@@ -31,6 +31,7 @@
 #include <seastar/core/io_queue.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/core/internal/estimated_histogram.hh>
+#include <seastar/core/internal/sparse_histogram.hh>
 #include <seastar/testing/random.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
@@ -75,6 +76,50 @@ static std::set<seastar::sstring> get_label_values(seastar::sstring metric_name,
     return labels;
 }
 
+SEASTAR_THREAD_TEST_CASE(test_add_group_bulk) {
+    namespace sm = seastar::metrics;
+    namespace smi = seastar::metrics::impl;
+    auto& value_map = smi::get_value_map();
+    auto tenant = sm::label("tenant");
+    auto make_group = [&] (std::string_view name) {
+        std::vector<sm::metric_definition> defs;
+        for (int i = 0; i < 100; ++i) {
+            defs.emplace_back(sm::make_gauge(fmt::format("gauge_{}", i), [i] { return i; },
+                    sm::description("bulk gauge"), {tenant(name)}));
+        }
+        sm::metric_groups mg;
+        mg.add_group("bulk", defs);
+        return mg;
+    };
+
+    auto a = make_group("a");
+    auto b = make_group("b");
+    for (int i = 0; i < 100; ++i) {
+        BOOST_REQUIRE_EQUAL(value_map.at(fmt::format("bulk_gauge_{}", i)).size(), 2);
+    }
+    // The metrics of a group share their internalized labels
+    auto& family = value_map.at("bulk_gauge_0");
+    auto& other = value_map.at("bulk_gauge_99");
+    for (auto it = family.begin(); it != family.end(); ++it) {
+        auto labels = it->second->info().id.internalized_labels();
+        BOOST_REQUIRE(other.at(labels)->info().id.internalized_labels() == labels);
+    }
+
+    a.clear();
+    for (int i = 0; i < 100; ++i) {
+        auto& f = value_map.at(fmt::format("bulk_gauge_{}", i));
+        BOOST_REQUIRE_EQUAL(f.size(), 1);
+        BOOST_REQUIRE_EQUAL(f.begin()->second->info().id.labels().at("tenant"), "b");
+    }
+    BOOST_REQUIRE(get_label_values("bulk_gauge_7", "tenant") == std::set<seastar::sstring>({"b"}));
+
+    b.clear();
+    BOOST_REQUIRE(value_map.find("bulk_gauge_0") == value_map.end());
+    BOOST_REQUIRE(std::ranges::none_of(*smi::get_local_impl()->metadata(), [] (const auto& mf) {
+        return mf.mf.name.starts_with("bulk_");
+    }));
+}
+
 SEASTAR_THREAD_TEST_CASE(test_renaming_scheuling_groups) {
     // this seams a little bit out of place but the
     // renaming functionality is primarily for statistics
@@ -235,6 +280,75 @@ SEASTAR_THREAD_TEST_CASE(test_metrics_family_aggregate) {
     sm::set_relabel_configs(rl1).get();
 }
 
+SEASTAR_THREAD_TEST_CASE(test_aggregated_values) {
+    namespace sm = seastar::metrics;
+    namespace smi = seastar::metrics::impl;
+    sm::metric_groups app_metrics;
+    sm::label lb("lb");
+    sm::label kind("kind");
+    app_metrics.add_group("test_agg", {
+        sm::make_counter("counter", sm::description("counter"), [] { return 3; })(lb("1"))(kind("a")).aggregate({lb}),
+        sm::make_counter("counter", sm::description("counter"), [] { return 4; })(lb("2"))(kind("a")).aggregate({lb}),
+        sm::make_counter("counter", sm::description("counter"), [] { return 5; })(lb("1"))(kind("b")).aggregate({lb}),
+        sm::make_counter("empty", sm::description("empty"), [] { return 0; })(lb("1"))(sm::skip_when_empty::yes).aggregate({lb}),
+        sm::make_counter("empty", sm::description("empty"), [] { return 0; })(lb("2"))(sm::skip_when_empty::yes).aggregate({lb}),
+        sm::make_counter("partly_empty", sm::description("partly empty"), [] { return 0; })(lb("1"))(sm::skip_when_empty::yes).aggregate({lb}),
+        sm::make_counter("partly_empty", sm::description("partly empty"), [] { return 2; })(lb("2")).aggregate({lb}),
+        sm::make_gauge("gauge", sm::description("gauge"), [] { return 6; })(lb("1")),
+        sm::make_gauge("gauge", sm::description("gauge"), [] { return 7; })(lb("2")),
+    });
+
+    auto values = smi::get_aggregated_values();
+    auto find = [&values] (std::string_view name) -> std::map<smi::labels_type, std::pair<double, bool>> {
+        std::map<smi::labels_type, std::pair<double, bool>> res;
+        auto& metadata = *values->metadata;
+        for (size_t i = 0; i < metadata.size(); ++i) {
+            if (metadata[i].mf.name != name) {
+                continue;
+            }
+            for (size_t j = 0; j < metadata[i].metrics.size(); ++j) {
+                auto& m = metadata[i].metrics[j];
+                res.emplace(m.labels(), std::pair(values->values[i][j].d(), bool(m.should_skip_when_empty())));
+            }
+        }
+        return res;
+    };
+    auto with_shard = [] (smi::labels_type labels) {
+        labels.emplace(sm::shard_label.name(), smi::shard());
+        return labels;
+    };
+
+    auto counter = find("test_agg_counter");
+    BOOST_REQUIRE_EQUAL(counter.size(), 2);
+    BOOST_CHECK_EQUAL(counter.at(with_shard({{"kind", "a"}})).first, 7);
+    BOOST_CHECK_EQUAL(counter.at(with_shard({{"kind", "b"}})).first, 5);
+    BOOST_CHECK(!counter.at(with_shard({{"kind", "a"}})).second);
+
+    auto empty = find("test_agg_empty");
+    BOOST_REQUIRE_EQUAL(empty.size(), 1);
+    BOOST_CHECK_EQUAL(empty.begin()->second.first, 0);
+    BOOST_CHECK(empty.begin()->second.second);
+
+    auto partly_empty = find("test_agg_partly_empty");
+    BOOST_REQUIRE_EQUAL(partly_empty.size(), 1);
+    BOOST_CHECK_EQUAL(partly_empty.begin()->second.first, 2);
+    BOOST_CHECK(!partly_empty.begin()->second.second);
+
+    // not aggregated
+    BOOST_CHECK_EQUAL(find("test_agg_gauge").size(), 2);
+
+    // the aggregate labels can be changed at run time
+    std::vector<sm::metric_family_config> fc(1);
+    fc[0].name = "test_agg_gauge";
+    fc[0].aggregate_labels = { "lb" };
+    sm::set_metric_family_configs(fc);
+    values = smi::get_aggregated_values();
+    auto gauge = find("test_agg_gauge");
+    BOOST_REQUIRE_EQUAL(gauge.size(), 1);
+    BOOST_CHECK_EQUAL(gauge.begin()->second.first, 13);
+    sm::set_metric_family_configs({});
+}
+
 SEASTAR_THREAD_TEST_CASE(test_relabel_drop_label_prevent_runtime_conflicts) {
     using namespace seastar::metrics;
     namespace sm = seastar::metrics;
@@ -389,3 +503,58 @@ SEASTAR_THREAD_TEST_CASE(test_estimated_histogram) {
         BOOST_CHECK_EQUAL(mh.buckets[i].count, 33 + i);
     }
 }
+
+static void check_sparse_buckets(const seastar::metrics::histogram& mh, int32_t schema, std::vector<std::pair<int32_t, uint64_t>> expected) {
+    BOOST_REQUIRE(mh.is_sparse());
+    BOOST_CHECK_EQUAL(mh.native_histogram->schema, schema);
+    auto& buckets = mh.native_histogram->sparse_buckets;
+    BOOST_REQUIRE_EQUAL(buckets.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        BOOST_CHECK_EQUAL(buckets[i].index, expected[i].first);
+        BOOST_CHECK_EQUAL(buckets[i].count, expected[i].second);
+    }
+}
+
+SEASTAR_THREAD_TEST_CASE(test_sparse_histogram) {
+    using namespace seastar::metrics;
+    // with schema 0, bucket i holds (2^(i-1), 2^i]
+    internal::sparse_histogram h(0);
+    for (double v : {0.0, 1.0, 2.0, 3.0, 4.0, 0.25}) {
+        h.add(v);
+    }
+    auto mh = h.to_metrics_histogram();
+    BOOST_CHECK_EQUAL(mh.sample_count, 6);
+    BOOST_CHECK_EQUAL(mh.sample_sum, 10.25);
+    BOOST_CHECK_EQUAL(mh.native_histogram->zero_count, 1);
+    check_sparse_buckets(mh, 0, {{-2, 1}, {0, 1}, {1, 1}, {2, 2}});
+    BOOST_CHECK_EQUAL(native_histogram_info::upper_bound(0, 2), 4);
+    BOOST_CHECK_EQUAL(native_histogram_info::upper_bound(1, 3), std::exp2(1.5));
+
+    // the resolution is halved when the buckets don't fit
+    internal::sparse_histogram h2(1, 0, 2);
+    h2.add(1);
+    h2.add(2);
+    BOOST_CHECK_EQUAL(h2.schema(), 0);
+    check_sparse_buckets(h2.to_metrics_histogram(), 0, {{0, 1}, {1, 1}});
+
+    // merging keeps the coarser schema
+    internal::sparse_histogram h3(1);
+    h3.add(3);
+    check_sparse_buckets(h3.to_metrics_histogram(), 1, {{4, 1}});
+    auto sum = h.to_metrics_histogram() + h3.to_metrics_histogram();
+    BOOST_CHECK_EQUAL(sum.sample_count, 7);
+    BOOST_CHECK_EQUAL(sum.native_histogram->zero_count, 1);
+    check_sparse_buckets(sum, 0, {{-2, 1}, {0, 1}, {1, 1}, {2, 3}});
+    h3.merge(h);
+    BOOST_CHECK_EQUAL(h3.count(), 7);
+    check_sparse_buckets(h3.to_metrics_histogram(), 0, {{-2, 1}, {0, 1}, {1, 1}, {2, 3}});
+
+    // an empty histogram adds nothing, and can be added to
+    histogram empty;
+    BOOST_CHECK_EQUAL((empty + mh).sample_count, 6);
+    BOOST_CHECK_EQUAL((mh + empty).sample_count, 6);
+    internal::approximate_exponential_histogram<128, 1024, 4> dense;
+    dense.add(200);
+    BOOST_CHECK_THROW(mh + dense.to_metrics_histogram(), std::out_of_range);
+    BOOST_CHECK_THROW(internal::sparse_histogram(0, 1).merge(h), std::invalid_argument);
+}
@@ -25,6 +25,7 @@
 
 #include <seastar/testing/seastar_test.hh>
 #include <seastar/core/file.hh>
+#include <seastar/core/sleep.hh>
 #include <seastar/util/assert.hh>
 
 namespace seastar {
@@ -111,4 +112,69 @@ class mock_read_only_file final : public file_impl {
     }
 };
 
+// Records the size of the writes, which complete after a delay
+class mock_write_only_file final : public file_impl {
+    std::chrono::microseconds _latency;
+    std::vector<size_t> _writes;
+    uint64_t _size = 0;
+    bool _closed = false;
+private:
+    future<size_t> do_write(uint64_t pos, size_t len) {
+        BOOST_CHECK(!_closed);
+        _writes.push_back(len);
+        return sleep(_latency).then([this, pos, len] {
+            _size = std::max(_size, pos + len);
+            return len;
+        });
+    }
+public:
+    explicit mock_write_only_file(std::chrono::microseconds latency) noexcept : _latency(latency) {}
+
+    const std::vector<size_t>& writes() const noexcept { return _writes; }
+
+    virtual future<size_t> write_dma(uint64_t pos, const void*, size_t len, io_intent*) noexcept override {
+        return do_write(pos, len);
+    }
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, io_intent*) noexcept override {
+        auto length = boost::accumulate(iov | boost::adaptors::transformed([] (auto&& iov) { return iov.iov_len; }),
+                                        size_t(0), std::plus<size_t>());
+        return do_write(pos, length);
+    }
+    virtual future<size_t> read_dma(uint64_t, void*, size_t, io_intent*) noexcept override {
+        return make_exception_future<size_t>(std::bad_function_call());
+    }
+    virtual future<size_t> read_dma(uint64_t, std::vector<iovec>, io_intent*) noexcept override {
+        return make_exception_future<size_t>(std::bad_function_call());
+    }
+    virtual future<> flush() noexcept override {
+        return make_ready_future<>();
+    }
+    virtual future<struct stat> stat() noexcept override {
+        return make_exception_future<struct stat>(std::bad_function_call());
+    }
+    virtual future<> truncate(uint64_t) noexcept override {
+        return make_exception_future<>(std::bad_function_call());
+    }
+    virtual future<> discard(uint64_t offset, uint64_t length) noexcept override {
+        return make_exception_future<>(std::bad_function_call());
+    }
+    virtual future<> allocate(uint64_t position, uint64_t length) noexcept override {
+        return make_ready_future<>();
+    }
+    virtual future<uint64_t> size() noexcept override {
+        return make_ready_future<uint64_t>(_size);
+    }
+    virtual future<> close() noexcept override {
+        BOOST_CHECK(!_closed);
+        _closed = true;
+        return make_ready_future<>();
+    }
+    virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)>) override {
+        throw std::bad_function_call();
+    }
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t, size_t, io_intent*) noexcept override {
+        return make_exception_future<temporary_buffer<uint8_t>>(std::bad_function_call());
+    }
+};
+
 }
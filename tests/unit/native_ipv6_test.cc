@@ -0,0 +1,69 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <seastar/net/ipv6.hh>
+#include <seastar/core/byteorder.hh>
+#include <boost/test/unit_test.hpp>
+#include <array>
+#include <cstring>
+#include <vector>
+
+using namespace seastar;
+using namespace seastar::net;
+
+BOOST_AUTO_TEST_CASE(test_link_local_address) {
+    ethernet_address mac{0x52, 0x54, 0x00, 0x12, 0x34, 0x56};
+    auto ll = ipv6_link_local_address(mac);
+    BOOST_REQUIRE(ll == ipv6_address("fe80::5054:ff:fe12:3456"));
+    BOOST_REQUIRE(ipv6_is_link_local(ll));
+    BOOST_REQUIRE(!ipv6_is_multicast(ll));
+    BOOST_REQUIRE(!ipv6_is_link_local(ipv6_address("2001:db8::1")));
+}
+
+BOOST_AUTO_TEST_CASE(test_solicited_node_address) {
+    auto group = ipv6_solicited_node_address(ipv6_address("2001:db8::1:2:3"));
+    BOOST_REQUIRE(group == ipv6_address("ff02::1:ff02:3"));
+    BOOST_REQUIRE(ipv6_is_multicast(group));
+    auto mac = ipv6_multicast_mac(group);
+    BOOST_REQUIRE((mac.mac == std::array<uint8_t, 6>{0x33, 0x33, 0xff, 0x02, 0x00, 0x03}));
+}
+
+BOOST_AUTO_TEST_CASE(test_pseudo_header_checksum) {
+    ipv6_address src("2001:db8::1");
+    ipv6_address dst("fe80::5054:ff:fe12:3456");
+    const char payload[] = "odd sized payload";
+    size_t len = sizeof(payload) - 1;
+
+    // The pseudo-header laid out as on the wire, followed by the payload
+    std::vector<char> buf(40 + len);
+    src.write(buf.data());
+    dst.write(buf.data() + 16);
+    write_be<uint32_t>(buf.data() + 32, len);
+    write_be<uint32_t>(buf.data() + 36, uint8_t(ip_protocol_num::tcp));
+    std::memcpy(buf.data() + 40, payload, len);
+
+    checksummer csum;
+    ipv6_traits::tcp_pseudo_header_checksum(csum, src, dst, len);
+    csum.sum(payload, len);
+    BOOST_REQUIRE_EQUAL(csum.get(), ip_checksum(buf.data(), buf.size()));
+}
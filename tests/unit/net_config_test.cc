@@ -89,6 +89,28 @@ BOOST_AUTO_TEST_CASE(test_valid_config_single_device) {
     BOOST_REQUIRE_EQUAL(device_configs.at("eth0").ip_cfg.netmask, "255.255.255.0");
 }
 
+BOOST_AUTO_TEST_CASE(test_rx_interrupt_idle_ms) {
+    std::stringstream ss;
+    ss << "{eth0: {pci-address: 0000:06:00.0, ip: 192.168.100.10, gateway: 192.168.100.1, netmask: "
+          "255.255.255.0, rx-interrupt-idle-ms: 5 } , eth1: {pci-address: 0000:06:00.1, dhcp: true } }";
+    auto device_configs = parse_config(ss);
+
+    BOOST_REQUIRE_EQUAL(device_configs.at("eth0").hw_cfg.rx_interrupt_idle_ms, 5u);
+    // Polls continuously by default
+    BOOST_REQUIRE_EQUAL(device_configs.at("eth1").hw_cfg.rx_interrupt_idle_ms, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_rss_rebalance_period_ms) {
+    std::stringstream ss;
+    ss << "{eth0: {pci-address: 0000:06:00.0, ip: 192.168.100.10, gateway: 192.168.100.1, netmask: "
+          "255.255.255.0, rss-rebalance-period-ms: 100 } , eth1: {pci-address: 0000:06:00.1, dhcp: true } }";
+    auto device_configs = parse_config(ss);
+
+    BOOST_REQUIRE_EQUAL(device_configs.at("eth0").hw_cfg.rss_rebalance_period_ms, 100u);
+    // The table is fixed by default
+    BOOST_REQUIRE_EQUAL(device_configs.at("eth1").hw_cfg.rss_rebalance_period_ms, 0u);
+}
+
 BOOST_AUTO_TEST_CASE(test_unsupported_key) {
     std::stringstream ss;
     ss << "{eth0: { some_not_supported_tag: xxx, pci-address: 0000:06:00.0, ip: 192.168.100.10, "
@@ -0,0 +1,99 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#include "loopback_socket.hh"
+
+#include <seastar/core/internal/sparse_histogram.hh>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/otlp.hh>
+#include <seastar/http/function_handlers.hh>
+#include <seastar/http/httpd.hh>
+#include <seastar/testing/thread_test_case.hh>
+
+using namespace seastar;
+using namespace httpd;
+using namespace std::literals;
+
+namespace {
+
+class loopback_http_factory : public http::experimental::connection_factory {
+    loopback_socket_impl lsi;
+public:
+    explicit loopback_http_factory(loopback_connection_factory& f) : lsi(f) {}
+    virtual future<connected_socket> make(abort_source* as) override {
+        return lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr()));
+    }
+};
+
+void require_contains(const sstring& body, std::string_view s) {
+    BOOST_REQUIRE_MESSAGE(std::ranges::search(body, s), fmt::format("{} not in {}", s, body));
+}
+
+}
+
+SEASTAR_THREAD_TEST_CASE(test_otlp_delta_export) {
+    loopback_connection_factory lcf(1);
+    http_server server("test");
+    httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+    std::vector<sstring> bodies;
+    server._routes.put(POST, "/v1/metrics", new function_handler([&bodies] (const_req req) {
+        bodies.push_back(req.content);
+        return "{}";
+    }, "json"));
+    server.do_accepts(0).get();
+
+    int64_t requests = 5;
+    metrics::internal::sparse_histogram latency(0);
+    latency.add(1);
+    latency.add(2);
+    metrics::metric_groups m;
+    m.add_group("otlptest", {
+        metrics::make_counter("requests", [&requests] { return requests; }, metrics::description("requests")),
+        metrics::make_gauge("level", [] { return 7.5; }, metrics::description("level")),
+        metrics::make_histogram("latency", [&latency] { return latency.to_metrics_histogram(); }, metrics::description("latency")),
+    });
+
+    otlp::config cfg;
+    cfg.host = "test";
+    cfg.resource_attributes["service.name"] = "otlp_test";
+    otlp::exporter e(std::make_unique<loopback_http_factory>(lcf), cfg);
+
+    e.push().get();
+    requests = 8;
+    latency.add(2);
+    e.push().get();
+    e.stop().get();
+    server.stop().get();
+
+    BOOST_REQUIRE_EQUAL(bodies.size(), 2);
+    for (auto& body : bodies) {
+        require_contains(body, R"({"key":"service.name","value":{"stringValue":"otlp_test"}})");
+        require_contains(body, R"("name":"seastar_otlptest_requests","description":"requests","sum":{"aggregationTemporality":1,"isMonotonic":true,"dataPoints":[{"attributes":[{"key":"shard","value":{"stringValue":"0"}}])");
+        require_contains(body, R"("name":"seastar_otlptest_level","description":"level","gauge":{"dataPoints":)");
+        require_contains(body, R"("asDouble":7.5)");
+        require_contains(body, R"("exponentialHistogram":{"aggregationTemporality":1,)");
+    }
+    // the first export has the values so far, the second what changed since
+    require_contains(bodies[0], R"("asInt":"5")");
+    require_contains(bodies[0], R"("count":"2","sum":3,"scale":0,"zeroCount":"0","zeroThreshold":0,"positive":{"offset":-1,"bucketCounts":["1","1"]})");
+    require_contains(bodies[1], R"("asInt":"3")");
+    require_contains(bodies[1], R"("count":"1","sum":2,"scale":0,"zeroCount":"0","zeroThreshold":0,"positive":{"offset":0,"bucketCounts":["1"]})");
+}
@@ -21,6 +21,7 @@
 
 #include <seastar/core/app-template.hh>
 #include <seastar/core/shared_ptr.hh>
+#include <seastar/core/sleep.hh>
 #include <seastar/core/vector-data-sink.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/util/later.hh>
@@ -28,6 +29,8 @@
 #include <seastar/net/packet.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
+#include <deque>
+#include <ranges>
 #include <vector>
 
 using namespace seastar;
@@ -200,3 +203,54 @@ SEASTAR_THREAD_TEST_CASE(test_mixed_mode_write) {
     BOOST_REQUIRE_EQUAL(buf.size(), 1);
     BOOST_REQUIRE_EQUAL(sstring(buf.front().get(), buf.front().size()), "test");
 }
+
+SEASTAR_THREAD_TEST_CASE(test_batched_flushes_coalesce_writers) {
+    // Completes each put only when told to
+    struct batching_sink final : public data_sink_impl {
+        std::vector<net::packet>& _out;
+        std::deque<promise<>>& _in_flight;
+        batching_sink(std::vector<net::packet>& out, std::deque<promise<>>& in_flight) : _out(out), _in_flight(in_flight) {}
+        virtual future<> put(net::packet p) override {
+            _out.push_back(std::move(p));
+            return _in_flight.emplace_back().get_future();
+        }
+        virtual future<> close() override { return make_ready_future<>(); }
+        virtual bool can_batch_flushes() const noexcept override { return true; }
+        virtual void on_batch_flush_error() noexcept override {}
+    };
+
+    auto vec = std::vector<net::packet>{};
+    auto in_flight = std::deque<promise<>>{};
+    auto out = output_stream<char>(data_sink(std::make_unique<batching_sink>(vec, in_flight)), 1024, output_stream_options{.batch_flushes = true});
+    auto poll = [] {
+        // timers expire from the reactor's poll, so the flush poller has run
+        sleep(std::chrono::milliseconds(1)).get();
+    };
+
+    out.write("a", 1).get();
+    out.flush().get();
+    poll();
+    BOOST_REQUIRE_EQUAL(vec.size(), 1);
+    BOOST_REQUIRE_EQUAL(in_flight.size(), 1);
+
+    // A flush requested while one is in flight waits for the next poll
+    // rather than going out as soon as the first one completes, so the
+    // writes made meanwhile go out with it
+    out.write("b", 1).get();
+    out.flush().get();
+    in_flight.front().set_value();
+    in_flight.pop_front();
+    yield().get();
+    BOOST_REQUIRE_EQUAL(vec.size(), 1);
+    out.write("c", 1).get();
+    out.flush().get();
+    poll();
+    BOOST_REQUIRE_EQUAL(vec.size(), 2);
+    vec[1].linearize();
+    BOOST_REQUIRE_EQUAL(sstring(vec[1].frag(0).base, vec[1].len()), "bc");
+
+    in_flight.front().set_value();
+    in_flight.pop_front();
+    out.close().get();
+    BOOST_REQUIRE_EQUAL(vec.size(), 2);
+}
@@ -25,6 +25,8 @@
 #include <boost/test/unit_test.hpp>
 #include <seastar/net/packet.hh>
 #include <array>
+#include <numeric>
+#include <vector>
 
 using namespace seastar;
 using namespace net;
@@ -119,3 +121,40 @@ BOOST_AUTO_TEST_CASE(test_headers_are_contiguous_even_with_many_fragments) {
     BOOST_REQUIRE_EQUAL(p.nr_frags(), 9u);
 }
 
+
+// The fragment array and the internal data share the storage of the impl:
+// headers fill the internal data down from its end, and survive the impl
+// being reallocated for more fragments
+BOOST_AUTO_TEST_CASE(test_internal_data_layout) {
+    std::vector<char> expected(48, 'h');
+    char data[64];
+    std::iota(std::begin(data), std::end(data), 0);
+    expected.insert(expected.end(), std::begin(data), std::end(data));
+
+    packet p(fragment{data, sizeof(data)});
+    std::fill_n(p.prepend_uninitialized_header(48), 48, 'h');
+    // the whole internal data, in one fragment
+    BOOST_REQUIRE_EQUAL(p.nr_frags(), 1u);
+    BOOST_REQUIRE_EQUAL(p.fragments()[0].size, 112u);
+
+    char tail[16];
+    std::fill_n(tail, sizeof(tail), 't');
+    for (int i = 0; i < 40; ++i) {
+        p.append(packet(fragment{tail, sizeof(tail)}));
+        expected.insert(expected.end(), std::begin(tail), std::end(tail));
+    }
+    BOOST_REQUIRE_EQUAL(p.nr_frags(), 41u);
+    BOOST_REQUIRE_EQUAL(p.fragments()[0].size, 112u);
+
+    // no room left in front of the headers, the next one gets a fragment
+    *p.prepend_header<char>() = 'i';
+    expected.insert(expected.begin(), 'i');
+    BOOST_REQUIRE_EQUAL(p.nr_frags(), 42u);
+
+    BOOST_REQUIRE_EQUAL(p.len(), expected.size());
+    auto it = expected.begin();
+    for (auto&& frag : p.fragments()) {
+        BOOST_REQUIRE(std::equal(frag.base, frag.base + frag.size, it));
+        it += frag.size;
+    }
+}
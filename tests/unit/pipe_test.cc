@@ -24,6 +24,10 @@
 #include <seastar/testing/thread_test_case.hh>
 
 #include <seastar/core/pipe.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/core/cross_shard_channel.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/util/later.hh>
 
 using namespace seastar;
 
@@ -49,3 +53,97 @@ SEASTAR_THREAD_TEST_CASE(simple_pipe_test) {
     BOOST_CHECK(f2.available());
     BOOST_REQUIRE_EQUAL(*f2.get(), 42);
 }
+
+SEASTAR_THREAD_TEST_CASE(cross_shard_channel_test) {
+    auto to = (this_shard_id() + 1) % smp::count;
+    auto ch = make_cross_shard_channel(to, cross_shard_channel_config{.max_bytes = 4096, .max_buffers = 4});
+    // Buffers are destroyed on this shard, once the source released them
+    auto me = this_shard_id();
+    unsigned destroyed = 0;
+    auto buffer = [&] (unsigned i) {
+        temporary_buffer<char> buf(i % 3000 + 1);
+        std::fill_n(buf.get_write(), buf.size(), char(i));
+        return temporary_buffer<char>(buf.get_write(), buf.size(), make_deleter([&destroyed, me, buf = std::move(buf)] {
+            BOOST_REQUIRE_EQUAL(this_shard_id(), me);
+            ++destroyed;
+        }));
+    };
+
+    // The source holds at most 4 buffers, so the sink waits for it to read
+    for (unsigned i = 0; i < 4; i++) {
+        ch.sink.put(buffer(i)).get();
+    }
+    auto blocked = ch.sink.put(buffer(4));
+    BOOST_REQUIRE(!blocked.available());
+
+    constexpr unsigned count = 1000;
+    auto received = smp::submit_to(to, [source = std::move(ch.source)] () mutable {
+        return do_with(std::move(source), unsigned(0), [] (data_source& source, unsigned& i) {
+            return repeat([&] {
+                return source.get().then([&] (temporary_buffer<char> buf) {
+                    if (buf.empty()) {
+                        return stop_iteration::yes;
+                    }
+                    BOOST_REQUIRE_EQUAL(buf.size(), i % 3000 + 1);
+                    BOOST_REQUIRE(std::all_of(buf.begin(), buf.end(), [&] (char c) { return c == char(i); }));
+                    ++i;
+                    return stop_iteration::no;
+                });
+            }).then([&i] {
+                return i;
+            });
+        });
+    });
+    blocked.get();
+    for (unsigned i = 5; i < count; i++) {
+        ch.sink.put(buffer(i)).get();
+    }
+    ch.sink.close().get();
+    BOOST_REQUIRE_EQUAL(destroyed, count);
+    BOOST_REQUIRE_EQUAL(received.get(), count);
+}
+
+SEASTAR_THREAD_TEST_CASE(cross_shard_channel_buffer_outlives_sink_test) {
+    auto to = (this_shard_id() + 1) % smp::count;
+    auto me = this_shard_id();
+    unsigned destroyed = 0;
+    auto ch = make_cross_shard_channel(to);
+    temporary_buffer<char> buf(10);
+    std::fill_n(buf.get_write(), buf.size(), 'x');
+    ch.sink.put(temporary_buffer<char>(buf.get_write(), buf.size(), make_deleter([&destroyed, me, buf = std::move(buf)] {
+        BOOST_REQUIRE_EQUAL(this_shard_id(), me);
+        ++destroyed;
+    }))).get();
+
+    // The consumer holds on to the buffer while both ends go away, the sink
+    // without being closed
+    auto held = smp::submit_to(to, [source = std::move(ch.source)] () mutable {
+        return do_with(std::move(source), [] (data_source& source) {
+            return source.get();
+        }).then([] (temporary_buffer<char> buf) {
+            return make_foreign(std::make_unique<temporary_buffer<char>>(std::move(buf)));
+        });
+    }).get();
+    {
+        auto sink = std::move(ch.sink);
+    }
+    smp::submit_to(to, [held = std::move(held)] () mutable {
+        BOOST_REQUIRE_EQUAL(held->size(), 10);
+        BOOST_REQUIRE(std::all_of(held->begin(), held->end(), [] (char c) { return c == 'x'; }));
+        held = {};
+    }).get();
+    while (!destroyed) {
+        yield().get();
+    }
+}
+
+SEASTAR_THREAD_TEST_CASE(cross_shard_channel_closed_source_test) {
+    auto to = (this_shard_id() + 1) % smp::count;
+    auto ch = make_cross_shard_channel(to);
+    ch.sink.put(temporary_buffer<char>(10)).get();
+    smp::submit_to(to, [source = std::move(ch.source)] () mutable {
+        return source.close().finally([source = std::move(source)] {});
+    }).get();
+    BOOST_REQUIRE_THROW(ch.sink.put(temporary_buffer<char>(10)).get(), broken_pipe_exception);
+    ch.sink.close().get();
+}
@@ -0,0 +1,53 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include "core/pmem.hh"
+#include <algorithm>
+
+using namespace seastar;
+
+// pmem_copy() works on any memory, the write backs being no-ops on memory
+// which is not persistent
+BOOST_AUTO_TEST_CASE(test_pmem_copy) {
+    constexpr size_t guard = 128;
+    for (size_t len : {0, 1, 63, 64, 255, 256, 4097}) {
+        // unaligned heads, and so tails
+        for (size_t dst_off : {0, 1, 17, 63}) {
+            for (size_t src_off : {0, 5}) {
+                alignas(64) static char dst[guard + 64 + 4097 + guard];
+                alignas(64) static char src[64 + 4097];
+                std::fill(std::begin(dst), std::end(dst), char(0xa5));
+                for (size_t i = 0; i < len; i++) {
+                    src[src_off + i] = char(i * 31 + len);
+                }
+                auto d = dst + guard + dst_off;
+                internal::pmem_copy(d, src + src_off, len);
+                BOOST_REQUIRE(std::equal(d, d + len, src + src_off));
+                // nothing around the copy is touched
+                BOOST_REQUIRE(std::all_of(dst, d, [] (char c) { return c == char(0xa5); }));
+                BOOST_REQUIRE(std::all_of(d + len, std::end(dst), [] (char c) { return c == char(0xa5); }));
+            }
+        }
+    }
+}
@@ -0,0 +1,82 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/core/align.hh>
+#include "core/prefault.hh"
+
+using namespace seastar;
+using memory::internal::memory_range;
+
+static void check_split(const std::vector<memory_range>& ranges, size_t nr_threads, size_t batch_size) {
+    auto shares = internal::split_prefault_ranges(ranges, nr_threads, batch_size);
+    BOOST_REQUIRE_LE(shares.size(), nr_threads);
+
+    // the shares cover the ranges, in order, and only cut them at
+    // multiples of batch_size
+    std::vector<memory_range> pieces;
+    for (auto& share : shares) {
+        BOOST_REQUIRE(!share.empty());
+        pieces.insert(pieces.end(), share.begin(), share.end());
+    }
+    auto range = ranges.begin();
+    char* pos = range->start;
+    for (auto& p : pieces) {
+        BOOST_REQUIRE(range != ranges.end());
+        BOOST_REQUIRE_EQUAL((void*)p.start, (void*)pos);
+        BOOST_REQUIRE_LT((void*)p.start, (void*)p.end);
+        BOOST_REQUIRE_EQUAL(p.numa_node_id, range->numa_node_id);
+        if (p.end == range->end) {
+            if (++range != ranges.end()) {
+                pos = range->start;
+            }
+        } else {
+            BOOST_REQUIRE_LT((void*)p.end, (void*)range->end);
+            BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(p.end) % batch_size, 0);
+            pos = p.end;
+        }
+    }
+    BOOST_REQUIRE(range == ranges.end());
+}
+
+BOOST_AUTO_TEST_CASE(test_split_prefault_ranges_at_huge_pages) {
+    constexpr size_t huge_page = 2 << 20;
+    // addresses are only compared, never accessed
+    auto at = [] (uintptr_t a) { return reinterpret_cast<char*>(a); };
+    const uintptr_t base = uintptr_t(1) << 40;
+
+    // unaligned starts and ends
+    std::vector<memory_range> ranges = {
+        {at(base + 4096), at(base + 37 * huge_page + 12288), 0},
+        {at(base + 64 * huge_page + 8192), at(base + 101 * huge_page), 0},
+        {at(base + 128 * huge_page), at(base + 128 * huge_page + 4096), 0},
+    };
+    for (size_t nr_threads : {1, 2, 3, 5, 7, 8}) {
+        check_split(ranges, nr_threads, huge_page);
+    }
+
+    // a single range smaller than a huge page is never cut
+    std::vector<memory_range> small = {{at(base + 4096), at(base + 8 * 4096), 0}};
+    BOOST_REQUIRE_EQUAL(internal::split_prefault_ranges(small, 8, huge_page).size(), 1);
+    check_split(small, 8, huge_page);
+}
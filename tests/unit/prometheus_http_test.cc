@@ -51,36 +51,44 @@ struct test_metrics {
     }
 };
 
-future<> test_prometheus_metrics_body() {
-    test_metrics metrics;
-    metrics.setup_metrics();
+// reads a chunked response to the end
+std::string read_response(input_stream<char>& input) {
+    std::string resp_str;
+    while (!std::ranges::search(resp_str, "\r\n0\r\n\r\n"sv)) {
+        auto resp = input.read().get();
+        if (resp.empty()) {
+            break;
+        }
+        resp_str.append(resp.get(), resp.size());
+    }
+    return resp_str;
+}
 
-    co_await seastar::async([] {
+// serves the metrics with ctx and calls scrape with a function
+// returning the response to a GET /metrics
+future<> with_prometheus_server(prometheus::config ctx, std::function<void(std::function<std::string()>)> scrape) {
+    return seastar::async([ctx = std::move(ctx), scrape = std::move(scrape)] {
         loopback_connection_factory lcf(1);
         http_server server("test");
         loopback_socket_impl lsi(lcf);
         httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
 
-        prometheus::config ctx;
         add_prometheus_routes(server, ctx).get();
 
-        future<> client = seastar::async([&lsi] {
+        future<> client = seastar::async([&lsi, &scrape] {
             connected_socket c_socket = lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get();
             input_stream<char> input(c_socket.input());
             auto close_input = deferred_close(input);
             output_stream<char> output(c_socket.output());
             auto close_output = deferred_close(output);
 
-            output.write(sstring("GET /metrics HTTP/1.1\r\nHost: test\r\n\r\n")).get();
-            output.flush().get();
-            auto resp = input.read().get();
-            auto resp_str = std::string(resp.get(), resp.size());
-            BOOST_REQUIRE(std::ranges::search(resp_str, "200 OK"sv));
-
-            BOOST_REQUIRE_MESSAGE(std::ranges::search(resp_str, R"(seastar_aaaa_escaped_label_value_test{shard="0",somekey="special\"\\nvalue"} 10.000000)"sv), "Response: " + resp_str);
-            BOOST_REQUIRE_MESSAGE(std::ranges::search(resp_str, R"(seastar_aaaa_int_test{shard="0"} 10.000000)"sv), "Response: " + resp_str);
-            BOOST_REQUIRE_MESSAGE(std::ranges::search(resp_str, R"(seastar_aaaa_double_test{shard="0"} 1234567654321.000000)"sv), "Response: " + resp_str);
-            BOOST_REQUIRE_MESSAGE(std::ranges::search(resp_str, R"(seastar_aaaa_counter_test{shard="0"} 1234567654321)"sv), "Response: " + resp_str);
+            scrape([&] {
+                output.write(sstring("GET /metrics HTTP/1.1\r\nHost: test\r\n\r\n")).get();
+                output.flush().get();
+                auto resp_str = read_response(input);
+                BOOST_REQUIRE(std::ranges::search(resp_str, "200 OK"sv));
+                return resp_str;
+            });
         });
 
         server.do_accepts(0).get();
@@ -90,8 +98,56 @@ future<> test_prometheus_metrics_body() {
     });
 }
 
+future<> test_prometheus_metrics_body(prometheus::config ctx) {
+    test_metrics metrics;
+    metrics.setup_metrics();
+
+    co_await with_prometheus_server(std::move(ctx), [] (std::function<std::string()> scrape) {
+        // twice, to also read the series names from the cache if enabled
+        for (int i = 0; i < 2; ++i) {
+            auto resp_str = scrape();
+            BOOST_REQUIRE_MESSAGE(std::ranges::search(resp_str, R"(seastar_aaaa_escaped_label_value_test{shard="0",somekey="special\"\\nvalue"} 10.000000)"sv), "Response: " + resp_str);
+            BOOST_REQUIRE_MESSAGE(std::ranges::search(resp_str, R"(seastar_aaaa_int_test{shard="0"} 10.000000)"sv), "Response: " + resp_str);
+            BOOST_REQUIRE_MESSAGE(std::ranges::search(resp_str, R"(seastar_aaaa_double_test{shard="0"} 1234567654321.000000)"sv), "Response: " + resp_str);
+            BOOST_REQUIRE_MESSAGE(std::ranges::search(resp_str, R"(seastar_aaaa_counter_test{shard="0"} 1234567654321)"sv), "Response: " + resp_str);
+        }
+    });
+}
+
 }
 
 SEASTAR_TEST_CASE(test_prometheus_metrics) {
-    return test_prometheus_metrics_body();
+    return test_prometheus_metrics_body(prometheus::config());
+}
+
+SEASTAR_TEST_CASE(test_prometheus_metrics_cached_names) {
+    prometheus::config ctx;
+    ctx.cache_series_names = true;
+    return test_prometheus_metrics_body(std::move(ctx));
+}
+
+SEASTAR_TEST_CASE(test_prometheus_cached_names_follow_registrations) {
+    prometheus::config ctx;
+    ctx.cache_series_names = true;
+    return with_prometheus_server(std::move(ctx), [] (std::function<std::string()> scrape) {
+        int value = 1;
+        metrics::metric_groups m;
+        m.add_group("cccc", {
+            metrics::make_gauge("first", [&value] { return value; }, metrics::description{"first"}),
+        });
+        auto resp_str = scrape();
+        BOOST_REQUIRE_MESSAGE(std::ranges::search(resp_str, R"(seastar_cccc_first{shard="0"} 1.000000)"sv), "Response: " + resp_str);
+
+        value = 2;
+        m.add_group("cccc", {
+            metrics::make_gauge("second", [] { return 3; }, metrics::description{"second"}, {metrics::label("key")("v")}),
+        });
+        resp_str = scrape();
+        BOOST_REQUIRE_MESSAGE(std::ranges::search(resp_str, R"(seastar_cccc_first{shard="0"} 2.000000)"sv), "Response: " + resp_str);
+        BOOST_REQUIRE_MESSAGE(std::ranges::search(resp_str, R"(seastar_cccc_second{key="v",shard="0"} 3.000000)"sv), "Response: " + resp_str);
+
+        m.clear();
+        resp_str = scrape();
+        BOOST_REQUIRE_MESSAGE(!std::ranges::search(resp_str, "seastar_cccc_"sv), "Response: " + resp_str);
+    });
 }
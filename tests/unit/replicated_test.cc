@@ -0,0 +1,103 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <seastar/core/replicated.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/testing/thread_test_case.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+namespace {
+
+struct counted {
+    static inline std::atomic<int> live{0};
+    std::vector<int> values;
+
+    explicit counted(std::vector<int> v) : values(std::move(v)) { ++live; }
+    counted(const counted& o) : values(o.values) { ++live; }
+    ~counted() { --live; }
+};
+
+void wait_for_live(int n) {
+    for (int i = 0; i < 500 && counted::live != n; ++i) {
+        sleep(10ms).get();
+    }
+    BOOST_REQUIRE_EQUAL(counted::live, n);
+}
+
+}
+
+SEASTAR_THREAD_TEST_CASE(test_replicated_publish) {
+    replicated<counted> r(std::vector<int>{1});
+    BOOST_REQUIRE_EQUAL(r.owner(), this_shard_id());
+    smp::invoke_on_all([&r] {
+        BOOST_REQUIRE_EQUAL(r->values.size(), 1);
+    }).get();
+    for (int i = 2; i <= 10; ++i) {
+        r.update([i] (counted& c) { c.values.push_back(i); });
+    }
+    BOOST_REQUIRE_EQUAL(r->values.size(), 10);
+    smp::invoke_on_all([&r] {
+        BOOST_REQUIRE_EQUAL(r->values.size(), 10);
+        BOOST_REQUIRE_EQUAL(r->values.back(), 10);
+    }).get();
+    // The replaced snapshots go once every shard went around its loop
+    wait_for_live(1);
+    r.publish(counted({42}));
+    r.stop().get();
+    BOOST_REQUIRE_EQUAL(counted::live, 0);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_replicated_reader_keeps_snapshot) {
+    if (smp::count < 2) {
+        return;
+    }
+    replicated<counted> r(std::vector<int>{1});
+    std::atomic<bool> reading{false};
+    std::atomic<bool> published{false};
+    auto reader = smp::submit_to(1, [&] {
+        // Holds the snapshot without returning to the reactor
+        auto& snapshot = r.get();
+        reading = true;
+        while (!published) {
+        }
+        return snapshot.values;
+    });
+    while (!reading) {
+        sleep(1ms).get();
+    }
+    r.publish(counted({2}));
+    // Long enough for the owner to try to reclaim the first snapshot
+    sleep(50ms).get();
+    BOOST_REQUIRE_EQUAL(counted::live, 2);
+    published = true;
+    BOOST_REQUIRE(reader.get() == std::vector<int>{1});
+    wait_for_live(1);
+    r.stop().get();
+    BOOST_REQUIRE_EQUAL(counted::live, 0);
+}
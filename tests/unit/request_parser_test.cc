@@ -25,6 +25,7 @@
 #include <seastar/core/temporary_buffer.hh>
 #include <seastar/http/request.hh>
 #include <seastar/http/request_parser.hh>
+#include <seastar/http/internal/request_head_parser.hh>
 #include <seastar/testing/test_case.hh>
 #include <tuple>
 #include <utility>
@@ -57,7 +58,16 @@ SEASTAR_TEST_CASE(test_header_parsing) {
         { "GET /hello HTTP/1.0\r\nHeader : Field\r\n\r\n", false },
         { "GET /hello HTTP/1.0\r\nHeader Field\r\n\r\n", false },
         { "GET /hello HTTP/1.0\r\nHeader@: Field\r\n\r\n", false },
-        { "GET /hello HTTP/1.0\r\nHeader: fiel\r\nd \r\n\r\n", false }
+        { "GET /hello HTTP/1.0\r\nHeader: fiel\r\nd \r\n\r\n", false },
+        // long enough for the vectorized scans
+        { "GET /a/rather/long/path/to/some/resource?with=query&params=1 HTTP/1.1\r\n"
+          "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)\t\r\n\r\n", true,
+          "User-Agent", "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)" },
+        { "GET /hello HTTP/1.0\r\nHeader: a value longer than thirty two bytes\x7f\r\n\r\n", false },
+        { "GET /hello HTTP/1.0\r\nHeader: a value longer than thirty two bytes\x01\r\n\r\n", false },
+        { "GET /hello HTTP/1.0\r\nHeader: a value longer than thirty two bytes\r\r\n\r\n", false },
+        { "get /hello HTTP/1.0\r\n\r\n", false },
+        { "GET /hello HTTP/1.0\n\r\n", false },
     };
 
     http_request_parser parser;
@@ -67,7 +77,53 @@ SEASTAR_TEST_CASE(test_header_parsing) {
         BOOST_REQUIRE_NE(parser.failed(), tset.parsable);
         if (tset.parsable) {
             auto req = parser.get_parsed_request();
-            BOOST_REQUIRE_EQUAL(req->get_header(std::move(tset.header_name)), std::move(tset.header_value));
+            BOOST_REQUIRE_EQUAL(req->get_header(tset.header_name), tset.header_value);
+        }
+
+        // A byte at a time, so that the state machine parses it all
+        parser.init();
+        for (size_t i = 0; i < tset.msg.size() && !parser.failed(); ++i) {
+            if (parser(temporary_buffer<char>(tset.msg.c_str() + i, 1)).get().has_value()) {
+                break;
+            }
+        }
+        BOOST_REQUIRE_NE(parser.failed(), tset.parsable);
+        if (tset.parsable) {
+            auto req = parser.get_parsed_request();
+            BOOST_REQUIRE_EQUAL(req->get_header(tset.header_name), tset.header_value);
+        }
+    }
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_request_line_parsing) {
+    sstring msg = "PUT /some/path?x=1 HTTP/1.1\r\nHost: h\r\n\r\nGET";
+    http_request_parser parser;
+    parser.init();
+    auto rest = parser(temporary_buffer<char>(msg.c_str(), msg.size())).get();
+    BOOST_REQUIRE(rest.has_value());
+    // the next pipelined request is left unconsumed
+    BOOST_REQUIRE_EQUAL(sstring(rest->get(), rest->size()), "GET");
+    auto req = parser.get_parsed_request();
+    BOOST_REQUIRE_EQUAL(req->_method, "PUT");
+    BOOST_REQUIRE_EQUAL(req->_url, "/some/path?x=1");
+    BOOST_REQUIRE_EQUAL(req->_version, "1.1");
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_find_control_char) {
+    for (size_t size = 0; size < 80; ++size) {
+        for (size_t pos = 0; pos <= size; ++pos) {
+            for (char c : { '\r', '\x7f', ' ' }) {
+                std::string s(size, 'x');
+                s[size / 2] = '\x80';
+                if (pos < size && s[pos] == 'x') {
+                    s[pos] = c;
+                }
+                auto expected = std::min(s.find_first_of(std::string_view("\r\x7f", 2)), s.size());
+                auto found = http::internal::find_control_char(s.data(), s.data() + s.size(), ' ');
+                BOOST_REQUIRE_EQUAL(size_t(found - s.data()), expected);
+            }
         }
     }
     return make_ready_future<>();
@@ -27,6 +27,7 @@
 #include <seastar/rpc/lz4_compressor.hh>
 #include <seastar/rpc/lz4_fragmented_compressor.hh>
 #include <seastar/rpc/multi_algo_compressor_factory.hh>
+#include <seastar/rpc/zstd_compressor.hh>
 #include <seastar/testing/random.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
@@ -36,6 +37,7 @@
 #include <seastar/core/distributed.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/core/metrics_api.hh>
+#include <seastar/core/tracing.hh>
 #include <seastar/util/assert.hh>
 #include <seastar/util/defer.hh>
 #include <seastar/util/log.hh>
@@ -405,6 +407,112 @@ SEASTAR_TEST_CASE(test_rpc_connect_multi_compression_algo) {
     });
 }
 
+SEASTAR_THREAD_TEST_CASE(test_rpc_compression_dictionary) {
+    rpc::lz4_compressor::factory factory;
+    rpc::compression_dictionary_registry server_dictionaries;
+    rpc::compression_dictionary_registry client_dictionaries;
+    sstring dictionary = "a message the client and the server exchange a lot";
+    server_dictionaries.add(7, dictionary);
+    server_dictionaries.set_current(7);
+    rpc::server_options so;
+    rpc::client_options co;
+    so.compressor_factory = &factory;
+    so.compression_dictionaries = &server_dictionaries;
+    co.compressor_factory = &factory;
+    co.compression_dictionaries = &client_dictionaries;
+    rpc_test_config cfg;
+    cfg.server_options = so;
+    rpc_test_env<>::do_with_thread(cfg, co, [&] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        env.register_handler(1, [] (sstring s) {
+            return make_ready_future<sstring>(s + s);
+        }).get();
+        auto echo = env.proto().make_client<sstring (sstring)>(1);
+        BOOST_REQUIRE_EQUAL(echo(c1, dictionary).get(), dictionary + dictionary);
+    }).get();
+    // The client got the dictionary it didn't have during negotiation
+    auto dict = client_dictionaries.find(7);
+    BOOST_REQUIRE(dict);
+    BOOST_REQUIRE_EQUAL(dict->data, dictionary);
+    BOOST_REQUIRE_THROW(client_dictionaries.set_current(8), std::invalid_argument);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_rpc_connection_striping) {
+    rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env) {
+        rpc::client_options co;
+        co.connections = 3;
+        co.large_request_size = 1024;
+        co.socket_factory = [&env] { return env.make_socket(); };
+        test_rpc_proto::client c(env.proto(), co, env.make_socket(), ipv4_addr());
+        auto stop = deferred_stop(c);
+        env.register_handler(1, [] (const rpc::client_info& ci, sstring) {
+            return ci.conn_id.id();
+        }).get();
+        auto call = env.proto().make_client<uint64_t (sstring)>(1);
+        sstring small(16, 'a');
+        sstring large(4096, 'a');
+
+        // Small requests use the first connection, large ones the others
+        auto small_conn = call(c, small).get();
+        auto large1 = call(c, large);
+        auto large2 = call(c, large);
+        auto large_conn1 = large1.get();
+        auto large_conn2 = large2.get();
+        BOOST_REQUIRE_NE(small_conn, large_conn1);
+        BOOST_REQUIRE_NE(small_conn, large_conn2);
+        BOOST_REQUIRE_NE(large_conn1, large_conn2);
+        BOOST_REQUIRE_EQUAL(call(c, small).get(), small_conn);
+        BOOST_REQUIRE_EQUAL(c.get_stats().replied, 4);
+    }).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_rpc_staged_handler) {
+    rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env, test_rpc_proto::client& c) {
+        auto square = env.proto().register_staged_handler(1, "rpc_test_square", default_scheduling_group(), [] (int x) {
+            return x * x;
+        });
+        auto unregister = defer([&env] () noexcept { env.proto().unregister_handler(1).get(); });
+
+        std::vector<future<int>> replies;
+        for (int i = 0; i < 10; i++) {
+            replies.push_back(square(c, i));
+        }
+        for (int i = 0; i < 10; i++) {
+            BOOST_REQUIRE_EQUAL(replies[i].get(), i * i);
+        }
+
+        auto stage = internal::execution_stage_manager::get().get_stage(
+                format("rpc_test_square.{}", default_scheduling_group().name()));
+        BOOST_REQUIRE(stage);
+        BOOST_REQUIRE_EQUAL(stage->get_stats().function_calls_executed, 10);
+        BOOST_REQUIRE_GE(stage->get_stats().tasks_scheduled, 1);
+    }).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_rpc_borrowed_buffer) {
+    rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env, test_rpc_proto::client& c) {
+        env.register_handler(1, [] (int tag, rpc::borrowed_buffer buf) {
+            // The blob references the received message instead of a copy
+            BOOST_REQUIRE_EQUAL(tag, 7);
+            return buf;
+        }).get();
+        auto echo = env.proto().make_client<rpc::borrowed_buffer (int, rpc::borrowed_buffer)>(1);
+
+        std::vector<temporary_buffer<char>> fragments;
+        for (char c : {'a', 'b', 'c'}) {
+            temporary_buffer<char> f(300 * 1024);
+            std::fill_n(f.get_write(), f.size(), c);
+            fragments.push_back(std::move(f));
+        }
+        rpc::borrowed_buffer blob(std::move(fragments));
+        auto expected = blob.linearize();
+
+        auto reply = echo(c, 7, blob).get();
+        BOOST_REQUIRE_EQUAL(reply.size(), expected.size());
+        BOOST_REQUIRE(reply.linearize() == expected);
+        BOOST_REQUIRE(echo(c, 7, rpc::borrowed_buffer()).get().empty());
+    }).get();
+}
+
 SEASTAR_TEST_CASE(test_rpc_connect_abort) {
     rpc_test_config cfg;
     rpc_loopback_error_injector::config ecfg;
@@ -464,6 +572,32 @@ SEASTAR_TEST_CASE(test_rpc_cancel) {
     });
 }
 
+SEASTAR_TEST_CASE(test_rpc_trace_context) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        std::optional<tracing::trace_context> seen;
+        env.register_handler(1, [&seen] {
+            seen = tracing::current_context() ? std::optional(*tracing::current_context()) : std::nullopt;
+        }).get();
+        auto call = env.proto().make_client<void ()>(1);
+        call(c1).get();
+        BOOST_REQUIRE(!seen);
+
+        tracing::span s("client", tracing::trace_context::from_traceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01"));
+        auto ctx = s.context();
+        tracing::with_span(std::move(s), [&] {
+            return call(c1);
+        }).get();
+        BOOST_REQUIRE(seen);
+        // The handler runs in a span child of the caller's
+        BOOST_REQUIRE(seen->trace_id == ctx.trace_id);
+        BOOST_REQUIRE(seen->span_id != ctx.span_id);
+        BOOST_REQUIRE(seen->sampled());
+
+        call(c1).get();
+        BOOST_REQUIRE(!seen);
+    });
+}
+
 SEASTAR_TEST_CASE(test_message_to_big) {
     rpc_test_config cfg;
     cfg.resource_limits = {0, 1, 100};
@@ -709,6 +843,96 @@ SEASTAR_TEST_CASE(test_stream_negotiation_error) {
     });
 }
 
+SEASTAR_TEST_CASE(test_stream_flow_control) {
+    rpc::server_options so;
+    so.streaming_domain = rpc::streaming_domain_type(1);
+    rpc_test_config cfg;
+    cfg.server_options = so;
+    return rpc_test_env<>::do_with(cfg, [] (rpc_test_env<>& env) {
+        return seastar::async([&env] {
+            test_rpc_proto::client c(env.proto(), {}, env.make_socket(), ipv4_addr());
+            // Every 1000th element is larger than the receive window, and the
+            // rest are coalesced into batches. The server reads them slower
+            // than they are sent, so the client waits for credits.
+            constexpr int elements = 20000;
+            auto payload = [] (int i) {
+                return sstring(i % 1000 ? i % 100 : 2 * rpc::max_stream_buffers_memory, 'a' + i % 26);
+            };
+            future<> server_done = make_ready_future();
+            env.register_handler(1, [&] (rpc::source<int, sstring> source) {
+                auto sink = source.make_sink<serializer, int>();
+                server_done = seastar::async([source, sink, &payload] () mutable {
+                    int received = 0;
+                    while (auto data = source().get()) {
+                        BOOST_REQUIRE_EQUAL(std::get<0>(*data), received);
+                        BOOST_REQUIRE_EQUAL(std::get<1>(*data), payload(received));
+                        if (++received % 500 == 0) {
+                            sleep(std::chrono::milliseconds(1)).get();
+                        }
+                    }
+                    sink(received).get();
+                    sink.close().get();
+                });
+                return sink;
+            }).get();
+            auto call = env.proto().make_client<rpc::source<int> (rpc::sink<int, sstring>)>(1);
+            auto sink = c.make_stream_sink<serializer, int, sstring>(env.make_socket()).get();
+            auto source = call(c, sink).get();
+            for (int i = 0; i < elements; i++) {
+                sink(i, payload(i)).get();
+            }
+            sink.close().get();
+            auto received = source().get();
+            BOOST_REQUIRE(received);
+            BOOST_REQUIRE_EQUAL(std::get<0>(*received), elements);
+            BOOST_REQUIRE(!source().get());
+            server_done.get();
+            c.stop().get();
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_stream_empty_elements) {
+    rpc::server_options so;
+    so.streaming_domain = rpc::streaming_domain_type(1);
+    rpc_test_config cfg;
+    cfg.server_options = so;
+    return rpc_test_env<>::do_with(cfg, [] (rpc_test_env<>& env) {
+        return seastar::async([&env] {
+            test_rpc_proto::client c(env.proto(), {}, env.make_socket(), ipv4_addr());
+            // The elements of a sink<> have no payload, and are batched
+            // like any others
+            constexpr int elements = 1000;
+            future<> server_done = make_ready_future();
+            env.register_handler(1, [&] (rpc::source<> source) {
+                auto sink = source.make_sink<serializer, int>();
+                server_done = seastar::async([source, sink] () mutable {
+                    int received = 0;
+                    while (source().get()) {
+                        ++received;
+                    }
+                    sink(received).get();
+                    sink.close().get();
+                });
+                return sink;
+            }).get();
+            auto call = env.proto().make_client<rpc::source<int> (rpc::sink<>)>(1);
+            auto sink = c.make_stream_sink<serializer>(env.make_socket()).get();
+            auto source = call(c, sink).get();
+            for (int i = 0; i < elements; i++) {
+                sink().get();
+            }
+            sink.close().get();
+            auto received = source().get();
+            BOOST_REQUIRE(received);
+            BOOST_REQUIRE_EQUAL(std::get<0>(*received), elements);
+            BOOST_REQUIRE(!source().get());
+            server_done.get();
+            c.stop().get();
+        });
+    });
+}
+
 static future<> test_rpc_connection_send_glitch(bool on_client) {
     struct context {
         int limit;
@@ -1276,6 +1500,53 @@ SEASTAR_THREAD_TEST_CASE(test_lz4_fragmented_compressor) {
     test_compressor([] { return std::make_unique<rpc::lz4_fragmented_compressor>(); });
 }
 
+#ifdef SEASTAR_HAVE_ZSTD
+
+SEASTAR_THREAD_TEST_CASE(test_zstd_compressor) {
+    rpc::zstd_compressor::factory factory({.adaptive = false});
+    test_compressor([&] { return factory.negotiate("ZSTD", false); });
+}
+
+SEASTAR_THREAD_TEST_CASE(test_zstd_compressor_adaptive) {
+    rpc::zstd_compressor::factory factory;
+    test_compressor([&] { return factory.negotiate("ZSTD", false); });
+}
+
+SEASTAR_THREAD_TEST_CASE(test_zstd_compressor_dictionary) {
+    rpc::zstd_compressor::factory factory({.level = 1, .dictionary = "some text that appears in the messages", .adaptive = false});
+    BOOST_REQUIRE(factory.supported().starts_with("ZSTD_DICT_"));
+    BOOST_REQUIRE(!factory.negotiate("ZSTD", false));
+    test_compressor([&] { return factory.negotiate(factory.supported(), false); });
+
+    // Peers with different dictionaries don't agree on the feature
+    rpc::zstd_compressor::factory other({.dictionary = "other text"});
+    BOOST_REQUIRE_NE(factory.supported(), other.supported());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_zstd_compressor_skips_incompressible) {
+    rpc::zstd_compressor::factory factory;
+    auto c = factory.negotiate("ZSTD", false);
+    auto random = [] {
+        auto buf = temporary_buffer<char>(4096);
+        auto dist = std::uniform_int_distribution<int>(0, 255);
+        std::generate_n(buf.get_write(), buf.size(), [&] { return char(dist(testing::local_random_engine)); });
+        return rpc::snd_buf(std::move(buf));
+    };
+    auto compressible = [] {
+        auto buf = temporary_buffer<char>(4096);
+        std::fill_n(buf.get_write(), buf.size(), 'a');
+        return rpc::snd_buf(std::move(buf));
+    };
+    // Incompressible and small messages are sent with only the header added
+    BOOST_REQUIRE_EQUAL(c->compress(0, random()).size, 4096 + 4);
+    BOOST_REQUIRE_EQUAL(c->compress(0, rpc::snd_buf(temporary_buffer<char>(16))).size, 16 + 4);
+    // After a failure the next message is not even tried
+    BOOST_REQUIRE_EQUAL(c->compress(0, compressible()).size, 4096 + 4);
+    BOOST_REQUIRE_LT(c->compress(0, compressible()).size, 4096);
+}
+
+#endif
+
 // Test reproducing issue #671: If timeout is time_point::max(), translating
 // it to relative timeout in the sender and then back in the receiver, when
 // these calculations happen across a millisecond boundary, overflowed the
@@ -1606,6 +1877,68 @@ SEASTAR_TEST_CASE(test_rpc_send_timeout) {
     });
 }
 
+SEASTAR_TEST_CASE(test_rpc_reply_slots) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env, test_rpc_proto::client& cln) {
+        env.register_handler(1, [] (int v, int delay_ms) {
+            return seastar::sleep(std::chrono::milliseconds(delay_ms)).then([v] {
+                return v;
+            });
+        }).get();
+        auto call = env.proto().make_client<int (int, int)>(1);
+
+        // The slot of a call which timed out is reused by the next one, and
+        // the late reply to the former doesn't complete the latter
+        BOOST_REQUIRE_THROW(call(cln, std::chrono::milliseconds(50), 1, 300).get(), rpc::timeout_error);
+        BOOST_REQUIRE_EQUAL(cln.get_stats().wait_reply, 0);
+        BOOST_REQUIRE_EQUAL(call(cln, 2, 500).get(), 2);
+
+        // Replies find their calls among many, in whatever order they come
+        std::vector<future<int>> calls;
+        for (int i = 0; i < 1000; i++) {
+            calls.push_back(i % 3 == 0
+                    ? call(cln, std::chrono::milliseconds(20), i, 200)
+                    : call(cln, std::chrono::seconds(10), i, (1000 - i) % 50));
+        }
+        BOOST_REQUIRE_EQUAL(cln.get_stats().wait_reply, 1000);
+        for (int i = 0; i < 1000; i++) {
+            if (i % 3 == 0) {
+                BOOST_REQUIRE_THROW(calls[i].get(), rpc::timeout_error);
+            } else {
+                BOOST_REQUIRE_EQUAL(calls[i].get(), i);
+            }
+        }
+        BOOST_REQUIRE_EQUAL(cln.get_stats().wait_reply, 0);
+    });
+}
+
+SEASTAR_TEST_CASE(test_rpc_handler_abort) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [] (rpc_test_env<>& env, test_rpc_proto::client& c1) {
+        promise<std::exception_ptr> aborted;
+        env.register_handler(1, [&aborted] (rpc::client_info& ci) {
+            auto& as = ci.request_abort_source();
+            return sleep_abortable(std::chrono::seconds(10), as).then_wrapped([&as, &aborted] (future<> f) {
+                aborted.set_value(f.get_exception());
+                return as.abort_requested() ? 0 : 1;
+            });
+        }).get();
+        auto call = env.proto().make_client<int ()>(1);
+
+        // the client cancels the call
+        rpc::cancellable cancel;
+        auto f = call(c1, cancel);
+        sleep(std::chrono::milliseconds(100)).get();
+        cancel.cancel();
+        BOOST_REQUIRE_THROW(f.get(), rpc::canceled_error);
+        BOOST_REQUIRE_THROW(std::rethrow_exception(aborted.get_future().get()), rpc::canceled_error);
+
+        // the deadline passes, the server may see it before the client's
+        // cancellation arrives or after
+        aborted = {};
+        BOOST_REQUIRE_THROW(call(c1, std::chrono::milliseconds(100)).get(), rpc::timeout_error);
+        BOOST_REQUIRE_THROW(std::rethrow_exception(aborted.get_future().get()), rpc::error);
+    });
+}
+
 SEASTAR_TEST_CASE(test_rpc_send_timeout_on_connect) {
     rpc_test_config cfg;
     rpc_loopback_error_injector::config ecfg;
@@ -1676,6 +2009,45 @@ SEASTAR_THREAD_TEST_CASE(test_rpc_metric_domains) {
     BOOST_CHECK_EQUAL(get_metrics("rpc_client_sent_messages", "dom2"), 9);
 }
 
+SEASTAR_THREAD_TEST_CASE(test_rpc_verb_latency_metrics) {
+    rpc::client_options client_opt;
+    client_opt.metrics_domain = "latency";
+    rpc_test_config cfg;
+    cfg.server_options.metrics_domain = "latency";
+    rpc_test_env<>::do_with_thread(cfg, client_opt, [] (rpc_test_env<>& env, test_rpc_proto::client& c) {
+        env.register_handler(1, [] (int v) { return v; }).get();
+        env.register_handler(2, [] (int v) { return sleep(std::chrono::milliseconds(5)).then([v] { return v; }); }).get();
+        auto fast = env.proto().make_client<int (int)>(1);
+        auto slow = env.proto().make_client<int (int)>(2);
+        for (int i = 0; i < 3; i++) {
+            fast(c, i).get();
+        }
+        slow(c, 0).get();
+    }).get();
+
+    auto get_histogram = [] (std::string name, std::string verb) {
+        const auto& values = seastar::metrics::impl::get_value_map();
+        const auto& mf = values.find(name);
+        BOOST_REQUIRE(mf != values.end());
+        for (auto&& mi : mf->second) {
+            auto& labels = mi.first.labels();
+            if (labels.at("domain") == "latency" && labels.at("verb") == verb) {
+                return mi.second->get_function()().get_histogram();
+            }
+        }
+        BOOST_FAIL("cannot find requested metrics");
+        return seastar::metrics::histogram();
+    };
+
+    BOOST_CHECK_EQUAL(get_histogram("rpc_client_round_trip_latency", "1").sample_count, 3);
+    BOOST_CHECK_EQUAL(get_histogram("rpc_client_round_trip_latency", "2").sample_count, 1);
+    BOOST_CHECK_EQUAL(get_histogram("rpc_server_queue_latency", "1").sample_count, 3);
+    BOOST_CHECK_EQUAL(get_histogram("rpc_server_handler_latency", "1").sample_count, 3);
+    auto slow = get_histogram("rpc_server_handler_latency", "2");
+    BOOST_CHECK_EQUAL(slow.sample_count, 1);
+    BOOST_CHECK_GE(slow.sample_sum, 5000);
+}
+
 // Extract a piece of contiguous data from the front of the buffer (and trim the extracted front away).
 template <typename T>
 requires std::is_trivially_copyable_v<T>
@@ -35,6 +35,7 @@
 #include <seastar/core/when_all.hh>
 #include <seastar/core/with_scheduling_group.hh>
 #include <seastar/core/reactor.hh>
+#include <seastar/core/internal/task_tracer.hh>
 #include <seastar/util/later.hh>
 #include <seastar/util/defer.hh>
 
@@ -424,3 +425,122 @@ SEASTAR_THREAD_TEST_CASE(sg_create_check_unique_constructor_invocation) {
         groups = {};
     }).get();
 }
+
+SEASTAR_THREAD_TEST_CASE(sg_supergroup_cpu_shares) {
+    // The two groups of the supergroup split the CPU time the supergroup
+    // gets, which is what a standalone group with the same shares gets
+    auto super = create_scheduling_supergroup(100).get();
+    auto nested1 = create_scheduling_group("nested1", "nst1", 1000, super).get();
+    auto nested2 = create_scheduling_group("nested2", "nst2", 1000, super).get();
+    auto standalone = create_scheduling_group("standalone", "stnd", 100).get();
+    auto destroy = defer([&] () noexcept {
+        for (auto sg : {nested1, nested2, standalone}) {
+            destroy_scheduling_group(sg).get();
+        }
+    });
+
+    bool stop = false;
+    auto burn = [&stop] (scheduling_group sg, uint64_t& slices) {
+        return with_scheduling_group(sg, [&stop, &slices] {
+            return do_until([&stop] { return stop; }, [&slices] {
+                auto start = std::chrono::steady_clock::now();
+                while (std::chrono::steady_clock::now() - start < 100us) {
+                }
+                ++slices;
+                return yield();
+            });
+        });
+    };
+    uint64_t n1 = 0, n2 = 0, ns = 0;
+    auto done = when_all(burn(nested1, n1), burn(nested2, n2), burn(standalone, ns));
+    sleep(500ms).get();
+    stop = true;
+    done.get();
+
+    BOOST_TEST_MESSAGE(format("nested: {} + {}, standalone: {}", n1, n2, ns));
+    BOOST_REQUIRE_GT(ns, 0);
+    auto ratio = double(n1 + n2) / ns;
+    BOOST_REQUIRE_GT(ratio, 0.5);
+    BOOST_REQUIRE_LT(ratio, 2.0);
+    BOOST_REQUIRE_GT(double(n1) / n2, 0.5);
+    BOOST_REQUIRE_LT(double(n1) / n2, 2.0);
+}
+
+SEASTAR_THREAD_TEST_CASE(sg_cpu_limit) {
+    // A limited group is kept to its fraction of the CPU even when
+    // nothing else runs
+    auto sg = create_scheduling_group("limited", "lmtd", 1000).get();
+    auto destroy = defer([&] () noexcept { destroy_scheduling_group(sg).get(); });
+    sg.set_cpu_limit(0.2);
+    BOOST_REQUIRE_EQUAL(sg.get_cpu_limit(), 0.2f);
+
+    bool stop = false;
+    std::chrono::steady_clock::duration busy{};
+    auto done = with_scheduling_group(sg, [&stop, &busy] {
+        return do_until([&stop] { return stop; }, [&busy] {
+            auto start = std::chrono::steady_clock::now();
+            while (std::chrono::steady_clock::now() - start < 100us) {
+            }
+            busy += std::chrono::steady_clock::now() - start;
+            return yield();
+        });
+    });
+    sleep(1s).get();
+    stop = true;
+    done.get();
+    sg.set_cpu_limit(0);
+    BOOST_REQUIRE_EQUAL(sg.get_cpu_limit(), 0.0f);
+
+    BOOST_TEST_MESSAGE(format("busy for {}ms", busy / 1ms));
+    BOOST_REQUIRE_GT(busy, 50ms);
+    BOOST_REQUIRE_LT(busy, 400ms);
+}
+
+SEASTAR_THREAD_TEST_CASE(task_tracing) {
+    auto sg = create_scheduling_group("traced", 100).get();
+    auto destroy = defer([&] () noexcept { destroy_scheduling_group(sg).get(); });
+
+    engine().enable_task_tracing(1024);
+    with_scheduling_group(sg, [] {
+        return yield().then([] {
+            return smp::submit_to((this_shard_id() + 1) % smp::count, [] {});
+        });
+    }).get();
+    engine().disable_task_tracing();
+    BOOST_REQUIRE(!engine().task_tracing_enabled());
+
+    auto trace = internal::local_task_trace();
+    auto sg_index = internal::scheduling_group_index(sg);
+    BOOST_REQUIRE_GT(trace.scheduling_groups.size(), sg_index);
+    BOOST_REQUIRE_EQUAL(trace.scheduling_groups[sg_index], "traced");
+    using kind = internal::task_trace_event::kind;
+    auto count = [&] (kind k) {
+        return std::ranges::count_if(trace.events, [&] (const internal::task_trace_event& e) {
+            return e.what == k && (k == kind::smp_message || e.arg == sg_index);
+        });
+    };
+    BOOST_REQUIRE_GT(count(kind::task), 0);
+    BOOST_REQUIRE_GT(count(kind::scheduling_group), 0);
+    if (smp::count > 1) {
+        BOOST_REQUIRE_EQUAL(count(kind::smp_message), 1);
+    }
+    for (auto& e : trace.events) {
+        BOOST_REQUIRE_LE(e.start, e.end);
+        BOOST_REQUIRE(e.what != kind::task || e.type);
+    }
+
+    auto json = internal::format_chrome_trace({trace});
+    BOOST_REQUIRE(json.starts_with(R"({"displayTimeUnit":"ns","traceEvents":[)"));
+    BOOST_REQUIRE(json.find(R"("scheduling_group":"traced")") != sstring::npos);
+    BOOST_REQUIRE(json.ends_with("]}"));
+
+    // The ring keeps the latest events
+    engine().enable_task_tracing(4);
+    for (int i = 0; i != 10; ++i) {
+        yield().get();
+    }
+    engine().disable_task_tracing();
+    trace = internal::local_task_trace();
+    BOOST_REQUIRE_EQUAL(trace.events.size(), 4);
+    BOOST_REQUIRE_GT(trace.dropped, 0);
+}
@@ -0,0 +1,100 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+
+#include "../../apps/seawreck/latency_histogram.hh"
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+BOOST_AUTO_TEST_CASE(test_empty_histogram) {
+    latency_histogram h;
+    BOOST_REQUIRE_EQUAL(h.total(), 0);
+    BOOST_REQUIRE(h.max() == 0ns);
+    BOOST_REQUIRE(h.percentile(50) == 0ns);
+}
+
+BOOST_AUTO_TEST_CASE(test_small_values_are_exact) {
+    latency_histogram h;
+    for (int i = 1; i <= 100; ++i) {
+        h.record(std::chrono::nanoseconds(i));
+    }
+    BOOST_REQUIRE_EQUAL(h.total(), 100);
+    BOOST_REQUIRE(h.percentile(50) == 50ns);
+    BOOST_REQUIRE(h.percentile(99) == 99ns);
+    BOOST_REQUIRE(h.percentile(100) == 100ns);
+    BOOST_REQUIRE(h.max() == 100ns);
+    // Negative latencies, from a clock going back, count as zero
+    h.record(-5ns);
+    BOOST_REQUIRE(h.percentile(0) == 0ns);
+}
+
+BOOST_AUTO_TEST_CASE(test_relative_error) {
+    // One value per power of two range, and the ones around it
+    for (uint64_t base = 128; base < (uint64_t(1) << 60); base <<= 1) {
+        for (uint64_t v : {base - 1, base, base + base / 3, 2 * base - 1}) {
+            latency_histogram h;
+            h.record(std::chrono::nanoseconds(v));
+            h.record(std::chrono::nanoseconds(4 * v + 4));
+            auto p = uint64_t(h.percentile(50).count());
+            BOOST_REQUIRE_GE(p, v);
+            BOOST_REQUIRE_LE(p - v, v / 64);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_percentiles) {
+    // 1% of the requests are 1000 times slower
+    latency_histogram h;
+    for (int i = 0; i < 9900; ++i) {
+        h.record(1ms);
+    }
+    for (int i = 0; i < 100; ++i) {
+        h.record(1s);
+    }
+    auto near = [] (std::chrono::nanoseconds p, std::chrono::nanoseconds expected) {
+        return p >= expected && p - expected <= expected / 64;
+    };
+    BOOST_REQUIRE(near(h.percentile(50), 1ms));
+    BOOST_REQUIRE(near(h.percentile(99), 1ms));
+    BOOST_REQUIRE(near(h.percentile(99.9), 1s));
+    // never above the largest value recorded
+    BOOST_REQUIRE(h.percentile(99.99) == 1s);
+    BOOST_REQUIRE(h.max() == 1s);
+}
+
+BOOST_AUTO_TEST_CASE(test_merge) {
+    latency_histogram a, b;
+    for (int i = 0; i < 50; ++i) {
+        a.record(10us);
+        b.record(20us);
+    }
+    b.record(5ms);
+    a += b;
+    BOOST_REQUIRE_EQUAL(a.total(), 101);
+    BOOST_REQUIRE(a.max() == 5ms);
+    BOOST_REQUIRE_LE(a.percentile(40).count(), 10000 + 10000 / 64);
+    BOOST_REQUIRE_GE(a.percentile(60).count(), 20000);
+    BOOST_REQUIRE(a.percentile(100) == 5ms);
+}
@@ -26,11 +26,15 @@
 #include <seastar/testing/thread_test_case.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/semaphore.hh>
+#include <seastar/core/cross_shard_semaphore.hh>
+#include <seastar/core/sharded.hh>
+#include <seastar/util/defer.hh>
 #include <seastar/core/do_with.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/core/map_reduce.hh>
 #include <seastar/core/sleep.hh>
 #include <seastar/core/shared_mutex.hh>
+#include <atomic>
 #include <ranges>
 #include <stdexcept>
 
@@ -110,6 +114,25 @@ SEASTAR_THREAD_TEST_CASE(test_semaphore_timeout_2) {
     BOOST_REQUIRE_EQUAL(x, 0);
 }
 
+SEASTAR_THREAD_TEST_CASE(test_semaphore_preallocated_exceptions) {
+    auto sem = semaphore(0);
+    auto f1 = sem.wait(semaphore::clock::now());
+    abort_source as;
+    auto f2 = sem.wait(as);
+    as.request_abort();
+    auto ex1 = f1.get_exception();
+    auto ex2 = f2.get_exception();
+    BOOST_REQUIRE(is_preallocated_exception<semaphore_timed_out>(ex1));
+    BOOST_REQUIRE(is_preallocated_exception<semaphore_aborted>(ex2));
+    BOOST_REQUIRE_THROW(std::rethrow_exception(ex1), semaphore_timed_out);
+    BOOST_REQUIRE_THROW(std::rethrow_exception(ex2), semaphore_aborted);
+
+    auto named = named_semaphore(0, named_semaphore_exception_factory{"sem"});
+    auto ex3 = named.wait(semaphore::clock::now()).get_exception();
+    BOOST_REQUIRE(!is_preallocated_exception<semaphore_timed_out>(ex3));
+    BOOST_REQUIRE_THROW(std::rethrow_exception(ex3), named_semaphore_timed_out);
+}
+
 SEASTAR_THREAD_TEST_CASE(test_semaphore_mix_1) {
     auto sem = semaphore(0);
     int x = 0;
@@ -523,3 +546,72 @@ SEASTAR_THREAD_TEST_CASE(test_immediate_abort_after_move_assign) {
 
     BOOST_REQUIRE_THROW(get_units(sem, 1, as).get(), abort_requested_exception);
 }
+
+SEASTAR_THREAD_TEST_CASE(test_semaphore_wait_nothrow) {
+    auto sem = semaphore(1);
+    BOOST_REQUIRE(sem.wait_nothrow(1s).get() == semaphore_wait_result::acquired);
+
+    auto timed_out = sem.wait_nothrow(3ms);
+    auto acquired = sem.wait_nothrow(semaphore::time_point::max());
+    BOOST_REQUIRE(timed_out.get() == semaphore_wait_result::timed_out);
+    BOOST_REQUIRE(!acquired.available());
+    BOOST_REQUIRE(sem.wait_nothrow(semaphore::clock::now()).get() == semaphore_wait_result::timed_out);
+    sem.signal();
+    BOOST_REQUIRE(acquired.get() == semaphore_wait_result::acquired);
+
+    abort_source as;
+    auto aborted = sem.wait_nothrow(as);
+    auto aborted_ex = sem.wait_nothrow(as);
+    as.request_abort_ex(expected_exception());
+    BOOST_REQUIRE(aborted.get() == semaphore_wait_result::aborted);
+    BOOST_REQUIRE(aborted_ex.get() == semaphore_wait_result::aborted);
+    BOOST_REQUIRE(sem.wait_nothrow(as).get() == semaphore_wait_result::aborted);
+
+    auto broken = sem.wait_nothrow(1s);
+    sem.broken();
+    BOOST_REQUIRE_THROW(broken.get(), broken_semaphore);
+    BOOST_REQUIRE_THROW(sem.wait_nothrow(1s).get(), broken_semaphore);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_cross_shard_semaphore) {
+    cross_shard_semaphore_pool pool(10);
+    sharded<cross_shard_semaphore> sem;
+    sem.start(std::ref(pool), 2).get();
+    auto stop = defer([&] () noexcept { sem.stop().get(); });
+
+    // Acquisitions take a batch more than they need from the pool, and
+    // releases keep it cached
+    BOOST_REQUIRE(sem.local().try_wait(3));
+    BOOST_REQUIRE_EQUAL(sem.local().cached_units(), 2);
+    BOOST_REQUIRE_EQUAL(pool.available_units(), 5);
+    BOOST_REQUIRE(!sem.local().try_wait(8));
+    sem.local().signal(3);
+    BOOST_REQUIRE_EQUAL(sem.local().cached_units(), 2);
+    BOOST_REQUIRE_EQUAL(pool.available_units(), 8);
+
+    // Units cached by a shard are reclaimed for another one needing them
+    sem.invoke_on(smp::count - 1, [] (cross_shard_semaphore& s) {
+        return s.wait(1s, 10).then([&s] {
+            s.signal(10);
+        });
+    }).get();
+
+    std::atomic<size_t> in_use = 0;
+    sem.invoke_on_all([&in_use] (cross_shard_semaphore& s) {
+        return parallel_for_each(std::views::iota(0, 100), [&s, &in_use] (int i) {
+            size_t nr = 1 + i % 3;
+            return s.wait(nr).then([&s, &in_use, nr] {
+                BOOST_REQUIRE_LE(in_use.fetch_add(nr) + nr, 10);
+                return sleep(1ms).then([&s, &in_use, nr] {
+                    in_use.fetch_sub(nr);
+                    s.signal(nr);
+                });
+            });
+        });
+    }).get();
+
+    // Stopping returns the cached units to the pool
+    stop.cancel();
+    sem.stop().get();
+    BOOST_REQUIRE_EQUAL(pool.available_units(), 10);
+}
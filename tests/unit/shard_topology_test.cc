@@ -0,0 +1,108 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+// Run with --shard-placement one-per-core and --syscall-threads-pin-sibling
+// (see CMakeLists.txt). Without hwloc, or on CPUs without SMT, there are no
+// siblings and the syscall threads stay on the CPU of their shard.
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/core/reactor.hh>
+#include <seastar/core/smp.hh>
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+#include <sched.h>
+
+using namespace seastar;
+
+static std::set<unsigned> affinity_of(pid_t tid) {
+    cpu_set_t cs;
+    CPU_ZERO(&cs);
+    BOOST_REQUIRE_EQUAL(sched_getaffinity(tid, sizeof(cs), &cs), 0);
+    std::set<unsigned> ret;
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &cs)) {
+            ret.insert(cpu);
+        }
+    }
+    return ret;
+}
+
+// Shards are pinned unless run with --thread-affinity 0
+static bool shards_pinned() {
+    return affinity_of(0).size() == 1;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_shard_topology) {
+    auto topology = engine().smp().shard_topology();
+    BOOST_REQUIRE_EQUAL(topology.size(), smp::count);
+
+    std::set<unsigned> cpus, cores;
+    for (auto& t : topology) {
+        cpus.insert(t.cpu);
+        cores.insert(t.core);
+        BOOST_REQUIRE(std::ranges::find(t.siblings, t.cpu) == t.siblings.end());
+    }
+    BOOST_REQUIRE_EQUAL(cpus.size(), smp::count);
+    // One shard per core, whose siblings are left free
+    BOOST_REQUIRE_EQUAL(cores.size(), smp::count);
+    for (auto& t : topology) {
+        for (auto s : t.siblings) {
+            BOOST_REQUIRE(!cpus.contains(s));
+        }
+    }
+
+    if (!shards_pinned()) {
+        return;
+    }
+    smp::invoke_on_all([&topology] {
+        BOOST_REQUIRE(affinity_of(0) == std::set<unsigned>{topology[this_shard_id()].cpu});
+    }).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_syscall_threads_pinned_to_sibling) {
+    if (!shards_pinned()) {
+        return;
+    }
+    auto topology = engine().smp().shard_topology();
+    std::set<unsigned> seen;
+    for (auto& task : std::filesystem::directory_iterator("/proc/self/task")) {
+        std::string comm;
+        std::getline(std::ifstream(task.path() / "comm"), comm);
+        // Named syscall-<shard><reason>[<index>] by the thread pool
+        unsigned shard;
+        char reason;
+        if (std::sscanf(comm.c_str(), "syscall-%u%c", &shard, &reason) != 2 || shard >= smp::count) {
+            continue;
+        }
+        auto& t = topology[shard];
+        auto expected = t.siblings.empty() ? t.cpu : t.siblings.front();
+        BOOST_REQUIRE(affinity_of(std::stoi(task.path().filename())) == std::set<unsigned>{expected});
+        seen.insert(shard);
+    }
+    BOOST_REQUIRE_EQUAL(seen.size(), smp::count);
+}
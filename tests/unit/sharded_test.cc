@@ -23,10 +23,13 @@
 
 #include <seastar/core/shard_id.hh>
 #include <seastar/core/sharded.hh>
+#include <seastar/core/sharded_router.hh>
 #include <seastar/core/smp.hh>
 #include <seastar/util/assert.hh>
 
+#include <algorithm>
 #include <ranges>
+#include <vector>
 
 using namespace seastar;
 
@@ -161,6 +164,72 @@ SEASTAR_THREAD_TEST_CASE(invoke_map_returns_future_value_from_thread) {
     s.stop().get();
 }
 
+SEASTAR_THREAD_TEST_CASE(tree_map_reduce_test) {
+    seastar::sharded<mydata> s;
+    s.start().get();
+    auto sum = s.tree_map_reduce([] (mydata& m) {
+        return m.x;
+    }, std::plus<int>()).get();
+    BOOST_REQUIRE_EQUAL(sum, smp::count);
+
+    // Every shard contributes once, whatever the shape of the tree
+    auto shards = s.tree_map_reduce([] (mydata&) {
+        return make_ready_future<std::vector<unsigned>>(std::vector<unsigned>{this_shard_id()});
+    }, [] (std::vector<unsigned> a, std::vector<unsigned> b) {
+        a.insert(a.end(), b.begin(), b.end());
+        return a;
+    }).get();
+    std::ranges::sort(shards);
+    BOOST_REQUIRE(std::ranges::equal(shards, std::views::iota(0u, smp::count)));
+    s.stop().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(consistent_hash_test) {
+    // A new bucket only takes keys from the others, about its share of them
+    for (auto place : {jump_consistent_hash, rendezvous_hash}) {
+        for (unsigned buckets = 1; buckets < 16; buckets++) {
+            unsigned moved = 0;
+            for (uint64_t key = 0; key < 10000; key++) {
+                auto hash = key * 0x9e3779b97f4a7c15ULL;
+                auto before = place(hash, buckets);
+                auto after = place(hash, buckets + 1);
+                BOOST_REQUIRE_LT(after, buckets + 1);
+                if (after != before) {
+                    BOOST_REQUIRE_EQUAL(after, buckets);
+                    moved++;
+                }
+            }
+            BOOST_REQUIRE_LT(moved, 2 * 10000 / (buckets + 1));
+        }
+    }
+}
+
+SEASTAR_THREAD_TEST_CASE(sharded_router_test) {
+    seastar::sharded<mydata> s;
+    s.start().get();
+    sharded_router<mydata, int, std::hash<int>, rendezvous_placement> router(s);
+    // queued without yielding, so sent in a message per shard
+    std::vector<future<unsigned>> batched;
+    for (int key = 0; key < 100; key++) {
+        batched.push_back(router.invoke_batched(key, [] (mydata&) { return make_ready_future<unsigned>(this_shard_id()); }));
+    }
+    for (int key = 0; key < 100; key++) {
+        BOOST_REQUIRE_EQUAL(batched[key].get(), router.shard_of(key));
+    }
+    BOOST_REQUIRE_LE(router.stats().batches, smp::count - 1);
+
+    for (int key = 0; key < 100; key++) {
+        auto shard = router.shard_of(key);
+        BOOST_REQUIRE_LT(shard, smp::count);
+        BOOST_REQUIRE_EQUAL(router.invoke_on(key, [] (mydata&) { return this_shard_id(); }).get(), shard);
+    }
+    auto& stats = router.stats();
+    BOOST_REQUIRE_EQUAL(stats.local + stats.forwarded, 200);
+    BOOST_REQUIRE_EQUAL(stats.forwarding_ratio(), double(stats.forwarded) / 200);
+    router.stop().get();
+    s.stop().get();
+}
+
 SEASTAR_THREAD_TEST_CASE(failed_sharded_start_doesnt_hang) {
     class fail_to_start {
     public:
@@ -0,0 +1,109 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/net/api.hh>
+#include <seastar/net/shm_socket.hh>
+#include <seastar/net/socket_defs.hh>
+#include <seastar/util/defer.hh>
+
+using namespace seastar;
+using namespace std::string_literals;
+
+static socket_address test_address(std::string name) {
+    // abstract namespace, nothing to clean up
+    return socket_address(unix_domain_addr("\0seastar-shm-test-"s + name));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_shm_socket_echo) {
+    auto sa = test_address("echo");
+    auto ss = net::shm_listen(sa);
+    // A small ring makes both sides wait for each other
+    auto payload = sstring(1 << 20, 'x');
+    for (size_t i = 0; i < payload.size(); i++) {
+        payload[i] = char(i * 7);
+    }
+
+    auto server = seastar::async([&ss] {
+        auto ar = ss.accept().get();
+        auto in = ar.connection.input();
+        auto out = ar.connection.output();
+        while (true) {
+            auto buf = in.read().get();
+            if (buf.empty()) {
+                break;
+            }
+            out.write(buf.get(), buf.size()).get();
+            out.flush().get();
+        }
+        out.close().get();
+        in.close().get();
+    });
+
+    auto conn = net::shm_connect(sa, net::shm_options{.ring_size = 4096}).get();
+    auto in = conn.input();
+    auto out = conn.output();
+    auto writer = seastar::async([&out, &payload] {
+        out.write(payload).get();
+        out.flush().get();
+        out.close().get();
+    });
+    sstring echoed;
+    while (true) {
+        auto buf = in.read().get();
+        if (buf.empty()) {
+            break;
+        }
+        echoed.append(buf.get(), buf.size());
+    }
+    writer.get();
+    server.get();
+    in.close().get();
+    BOOST_REQUIRE(echoed == payload);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_shm_socket_peer_gone) {
+    auto sa = test_address("peer_gone");
+    auto ss = net::shm_listen(sa);
+    auto client = net::shm_connect(sa).get();
+    auto server = ss.accept().get();
+
+    auto in = client.input();
+    auto out = client.output();
+    auto read = in.read();
+    // Destroying the server side of the connection wakes up the client
+    server.connection = connected_socket();
+    auto buf = read.get();
+    BOOST_REQUIRE(buf.empty());
+    client.wait_input_shutdown().get();
+    out.close().get();
+    in.close().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_shm_socket_abort_accept) {
+    auto ss = net::shm_listen(test_address("abort_accept"));
+    auto f = ss.accept();
+    ss.abort_accept();
+    BOOST_REQUIRE_THROW(f.get(), std::exception);
+}
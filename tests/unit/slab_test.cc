@@ -21,7 +21,9 @@
  * To compile: g++ -std=c++14 slab_test.cc
  */
 
+#include <algorithm>
 #include <iostream>
+#include <unordered_map>
 #include <seastar/core/slab.hh>
 #include <seastar/util/assert.hh>
 
@@ -149,10 +151,49 @@ static void test_limit_is_violated_by_new_class(const double growth_factor, cons
     std::cout << __FUNCTION__ << " done!\n";
 }
 
+static void test_pages_move_to_starving_class(const double growth_factor, const unsigned slab_limit_size) {
+    bi::list<item, bi::member_hook<item, bi::list_member_hook<>, &item::_cache_link>> _cache;
+    std::unordered_map<item*, size_t> sizes;
+
+    slab_allocator<item> slab(growth_factor, slab_limit_size, max_object_size,
+        [&](item& item_ref) { _cache.erase(_cache.iterator_to(item_ref)); sizes.erase(&item_ref); });
+
+    // All the memory goes to the largest class first...
+    const size_t large_size = max_object_size;
+    for (auto i = 0u; i < slab_limit_size / large_size; i++) {
+        auto item = slab.create(large_size);
+        SEASTAR_ASSERT(item != nullptr);
+        _cache.push_front(*item);
+        sizes[item] = large_size;
+    }
+
+    // ...then the values become small: their class, which has no pages,
+    // takes them from the large one rather than failing or recycling
+    // its own few items.
+    const size_t small_size = 1024;
+    auto per_slab_page = max_object_size / slab.class_size(small_size);
+    for (auto i = 0u; i < per_slab_page * 20; i++) {
+        auto item = slab.create(small_size);
+        SEASTAR_ASSERT(item != nullptr);
+        _cache.push_front(*item);
+        sizes[item] = small_size;
+    }
+
+    size_t small_items = std::count_if(sizes.begin(), sizes.end(), [&] (auto& e) { return e.second == small_size; });
+    auto large_items = sizes.size() - small_items;
+    // the large class keeps one page
+    SEASTAR_ASSERT(large_items == 1);
+    SEASTAR_ASSERT(small_items == per_slab_page * (slab_limit_size / max_object_size - 1));
+
+    _cache.clear();
+    std::cout << __FUNCTION__ << " done!\n";
+}
+
 int main(int ac, char** av) {
     test_allocation_1(1.25, 5*1024*1024);
     test_allocation_2(1.07, 5*1024*1024); // 1.07 is the growth factor used by facebook.
     test_allocation_with_lru(1.25, 5*1024*1024);
     test_limit_is_violated_by_new_class(1.25, 5*1024*1024);
+    test_pages_move_to_starving_class(1.25, 5*1024*1024);
     return 0;
 }
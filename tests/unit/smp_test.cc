@@ -23,6 +23,15 @@
 #include <seastar/core/smp.hh>
 #include <seastar/core/app-template.hh>
 #include <seastar/core/print.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/core/map_reduce.hh>
+#include <seastar/core/metrics_api.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/with_scheduling_group.hh>
+#include <seastar/util/later.hh>
+#include <algorithm>
+#include <atomic>
+#include <functional>
 
 using namespace seastar;
 
@@ -58,6 +67,184 @@ future<bool> test_smp_exception() {
     });
 }
 
+future<bool> test_smp_stealable() {
+    // Queue everything on shard 1 and keep it busy, so that the rest of
+    // the shards get a chance to steal
+    return smp::submit_to(1, [] {
+        std::vector<future<std::pair<unsigned, shard_id>>> res;
+        for (unsigned i = 0; i < 100; ++i) {
+            res.push_back(smp::submit_stealable_to(1, [i] {
+                auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(200);
+                while (std::chrono::steady_clock::now() < end) {
+                }
+                return std::make_pair(i, this_shard_id());
+            }));
+        }
+        return when_all_succeed(res.begin(), res.end()).then([] (std::vector<std::pair<unsigned, shard_id>> res) {
+            unsigned stolen = 0;
+            for (unsigned i = 0; i < res.size(); ++i) {
+                if (res[i].first != i) {
+                    return false;
+                }
+                stolen += res[i].second != 1;
+            }
+            fmt::print("{} of {} items stolen from shard 1\n", stolen, res.size());
+            // Results come back to the submitting shard, wherever they ran
+            return res.size() == 100 && this_shard_id() == 1 && stolen > 0;
+        });
+    });
+}
+
+future<bool> test_smp_stealable_exception() {
+    return smp::submit_stealable_to(1, [] {
+        return make_exception_future<int>(nasty_exception());
+    }).then_wrapped([] (future<int> result) {
+        try {
+            result.get();
+            return false;
+        } catch (nasty_exception&) {
+            return true;
+        } catch (...) {
+            return false;
+        }
+    });
+}
+
+future<bool> test_smp_broadcast() {
+    auto seen = make_lw_shared<std::vector<std::atomic<unsigned>>>(smp::count);
+    return smp::broadcast([seen = seen.get()] {
+        (*seen)[this_shard_id()].fetch_add(1, std::memory_order_relaxed);
+        return yield();
+    }).then([seen] {
+        return std::ranges::all_of(*seen, [] (const std::atomic<unsigned>& n) { return n.load() == 1; });
+    });
+}
+
+future<bool> test_smp_broadcast_exception() {
+    return smp::broadcast([] {
+        if (this_shard_id() == smp::count - 1) {
+            throw nasty_exception();
+        }
+    }).then_wrapped([] (future<> result) {
+        try {
+            result.get();
+            return false;
+        } catch (nasty_exception&) {
+            return true;
+        } catch (...) {
+            return false;
+        }
+    });
+}
+
+future<bool> test_smp_shard_of_cpu() {
+    return map_reduce(smp::all_cpus(), [] (unsigned shard) {
+        return smp::submit_to(shard, [shard] {
+            // Nothing to check when the shards aren't pinned
+            auto s = smp::shard_of_cpu(::sched_getcpu());
+            return !s || *s == shard;
+        });
+    }, true, std::logical_and<bool>());
+}
+
+future<bool> test_smp_scheduling_group() {
+    return create_scheduling_group("smp_test", 100).then([] (scheduling_group sg) {
+        return with_scheduling_group(sg, [sg] {
+            // The caller's group is inherited, unless overridden
+            auto inherited = smp::submit_to(1, [sg] {
+                return current_scheduling_group() == sg;
+            });
+            smp_submit_to_options opts;
+            opts.sched_group = default_scheduling_group();
+            auto overridden = smp::submit_to(1, opts, [] {
+                return current_scheduling_group() == default_scheduling_group();
+            });
+            auto local = smp::submit_to(this_shard_id(), opts, [] {
+                return current_scheduling_group() == default_scheduling_group();
+            });
+            return when_all_succeed(std::move(inherited), std::move(overridden), std::move(local));
+        }).then([sg] (std::tuple<bool, bool, bool> r) {
+            return destroy_scheduling_group(sg).then([r] {
+                return std::get<0>(r) && std::get<1>(r) && std::get<2>(r);
+            });
+        });
+    });
+}
+
+// The smp metrics of this shard's queue to shard t are disabled by
+// default, but still registered
+static metrics::impl::metric_value smp_metric(sstring name, shard_id t) {
+    const auto& values = metrics::impl::get_value_map();
+    auto mf = values.find("smp_" + name);
+    if (mf != values.end()) {
+        auto instance = fmt::format("{}-{}", this_shard_id(), t);
+        for (auto&& [id, metric] : mf->second) {
+            if (id.labels().at("shard") == instance) {
+                return metric->get_function()();
+            }
+        }
+    }
+    throw std::runtime_error(fmt::format("smp metric {} not found", name));
+}
+
+future<bool> test_smp_adaptive_batching() {
+    auto completed = smp_metric("total_completed_messages", 1).ui();
+    auto latencies = smp_metric("message_latency", 1).get_histogram().sample_count;
+    auto initial_batch_size = smp_metric("send_batch_size", 1).ui();
+    // Shard 1 is stalled while the requests queue up in the ring, so they
+    // wait for it far longer than for their batch to fill
+    constexpr unsigned nr = 100;
+    std::vector<future<>> res;
+    res.push_back(smp::submit_to(1, [] {
+        auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(50);
+        while (std::chrono::steady_clock::now() < end) {
+        }
+    }));
+    for (unsigned i = 1; i < nr; ++i) {
+        res.push_back(smp::submit_to(1, [] {}));
+    }
+    co_await when_all_succeed(res.begin(), res.end());
+
+    auto batch_size = smp_metric("send_batch_size", 1).ui();
+    fmt::print("send batch size went from {} to {}\n", initial_batch_size, batch_size);
+    co_return smp_metric("total_completed_messages", 1).ui() - completed >= nr
+            && smp_metric("message_latency", 1).get_histogram().sample_count - latencies >= nr
+            && smp_metric("pending_send_queue_length", 1).ui() == 0
+            && (batch_size > initial_batch_size || batch_size == 32) && batch_size <= 32;
+}
+
+// Checks the queues from this shard to all of the others
+static future<bool> check_queues_from_here(std::vector<unsigned> numa, unsigned cross_node_batch_size) {
+    for (auto to : smp::all_cpus()) {
+        if (to == this_shard_id()) {
+            continue;
+        }
+        if (co_await smp::submit_to(to, [] { return this_shard_id(); }) != to) {
+            co_return false;
+        }
+        // Queues crossing NUMA nodes batch at least that many requests
+        if (cross_node_batch_size && numa[this_shard_id()] != numa[to]
+                && smp_metric("send_batch_size", to).ui() < cross_node_batch_size) {
+            co_return false;
+        }
+    }
+    co_return true;
+}
+
+future<bool> test_smp_queue_matrix(unsigned cross_node_batch_size) {
+    // Each receiving shard allocates the queues from all the others
+    auto mapping = engine().smp().shard_to_numa_node_mapping();
+    if (mapping.size() != smp::count) {
+        return make_ready_future<bool>(false);
+    }
+    std::vector<unsigned> numa(mapping.begin(), mapping.end());
+    return map_reduce(smp::all_cpus(), [numa = std::move(numa), cross_node_batch_size] (shard_id from) {
+        return smp::submit_to(from, [numa, cross_node_batch_size] {
+            return check_queues_from_here(std::move(numa), cross_node_batch_size);
+        });
+    }, true, std::logical_and<bool>());
+}
+
 int tests, fails;
 
 future<>
@@ -70,9 +257,27 @@ report(sstring msg, future<bool>&& result) {
 }
 
 int main(int ac, char** av) {
-    return app_template().run_deprecated(ac, av, [] {
+    app_template app;
+    return app.run_deprecated(ac, av, [&app] {
+       auto cross_node_batch_size = app.configuration()["smp-cross-node-batch-size"].as<unsigned>();
        return report("smp call", test_smp_call()).then([] {
            return report("smp exception", test_smp_exception());
+       }).then([] {
+           return report("smp stealable", test_smp_stealable());
+       }).then([] {
+           return report("smp stealable exception", test_smp_stealable_exception());
+       }).then([] {
+           return report("smp broadcast", test_smp_broadcast());
+       }).then([] {
+           return report("smp broadcast exception", test_smp_broadcast_exception());
+       }).then([] {
+           return report("smp shard of cpu", test_smp_shard_of_cpu());
+       }).then([] {
+           return report("smp scheduling group", test_smp_scheduling_group());
+       }).then([] {
+           return report("smp adaptive batching", test_smp_adaptive_batching());
+       }).then([cross_node_batch_size] {
+           return report("smp queue matrix", test_smp_queue_matrix(cross_node_batch_size));
        }).then([] {
            fmt::print("\n{:d} tests / {:d} failures\n", tests, fails);
            engine().exit(fails ? 1 : 0);
@@ -0,0 +1,145 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/net/api.hh>
+#include <seastar/net/inet_address.hh>
+#include <seastar/net/socket_handoff.hh>
+#include <seastar/net/socket_defs.hh>
+
+using namespace seastar;
+using namespace std::string_literals;
+
+static socket_address test_address(std::string name) {
+    // abstract namespace, nothing to clean up
+    return socket_address(unix_domain_addr("\0seastar-handoff-test-"s + name));
+}
+
+// Both ends of the handoff live in this process, which doesn't change what
+// crosses the unix-domain socket
+static std::vector<net::handoff_socket> hand_off(socket_address sa, std::vector<net::handoff_socket> sockets) {
+    auto served = net::serve_handoff(sa, [&sockets] {
+        return make_ready_future<std::vector<net::handoff_socket>>(std::move(sockets));
+    });
+    auto received = net::request_handoff(sa).get();
+    served.get();
+    return received;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_handoff_listener) {
+    listen_options lo;
+    lo.reuse_address = true;
+    auto old_ss = seastar::listen(socket_address(ipv4_addr("127.0.0.1", 0)), lo);
+    auto addr = old_ss.local_address();
+
+    std::vector<net::handoff_socket> sockets;
+    sockets.push_back(net::make_handoff_socket("http", old_ss));
+    auto received = hand_off(test_address("listener"), std::move(sockets));
+    BOOST_REQUIRE_EQUAL(received.size(), 1);
+    BOOST_REQUIRE_EQUAL(received[0].name, "http");
+    BOOST_REQUIRE_EQUAL(received[0].shard, this_shard_id());
+    old_ss.abort_accept();
+    old_ss = server_socket();
+
+    auto new_ss = net::adopt_server_socket(std::move(received[0]));
+    BOOST_REQUIRE_EQUAL(new_ss.local_address(), addr);
+    auto client = seastar::connect(addr).get();
+    auto ar = new_ss.accept().get();
+
+    auto out = client.output();
+    auto in = ar.connection.input();
+    out.write("hello").get();
+    out.flush().get();
+    auto buf = in.read_exactly(5).get();
+    BOOST_REQUIRE_EQUAL(sstring(buf.get(), buf.size()), "hello");
+    out.close().get();
+    in.close().get();
+
+    BOOST_REQUIRE_THROW(net::adopt_connected_socket(net::make_handoff_socket("http", new_ss)), std::invalid_argument);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_handoff_connection) {
+    auto ss = seastar::listen(socket_address(ipv4_addr("127.0.0.1", 0)));
+    auto client = seastar::connect(ss.local_address()).get();
+    auto ar = ss.accept().get();
+
+    std::vector<net::handoff_socket> sockets;
+    sockets.push_back(net::make_handoff_socket("conn", ar.connection));
+    auto received = hand_off(test_address("connection"), std::move(sockets));
+    BOOST_REQUIRE_EQUAL(received.size(), 1);
+    ar.connection = connected_socket();
+
+    auto conn = net::adopt_connected_socket(std::move(received[0]));
+    BOOST_REQUIRE_EQUAL(conn.remote_address(), ar.remote_address);
+    auto out = conn.output();
+    auto in = client.input();
+    out.write("world").get();
+    out.flush().get();
+    auto buf = in.read_exactly(5).get();
+    BOOST_REQUIRE_EQUAL(sstring(buf.get(), buf.size()), "world");
+    out.close().get();
+    // the connection outlived the socket of the sender
+    BOOST_REQUIRE(in.read().get().empty());
+    in.close().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_migrate_connection) {
+    auto ss = seastar::listen(socket_address(ipv4_addr("127.0.0.1", 0)));
+    auto client = seastar::connect(ss.local_address()).get();
+    auto ar = ss.accept().get();
+
+    auto client_out = client.output();
+    auto client_in = client.input();
+    client_out.write("first second").get();
+    client_out.flush().get();
+
+    auto in = ar.connection.input();
+    auto buf = in.read_exactly(6).get();
+    BOOST_REQUIRE_EQUAL(sstring(buf.get(), buf.size()), "first ");
+    auto to = (this_shard_id() + 1) % smp::count;
+    // What the first shard read past the first word is read on the new one
+    net::migrate_connected_socket(std::move(ar.connection), std::move(in), to, [to] (connected_socket conn) -> future<> {
+        BOOST_REQUIRE_EQUAL(this_shard_id(), to);
+        auto in = conn.input();
+        auto out = conn.output();
+        auto buf = co_await in.read_exactly(6);
+        BOOST_REQUIRE_EQUAL(sstring(buf.get(), buf.size()), "second");
+        co_await out.write("moved");
+        co_await out.close();
+        co_await in.close();
+    }).get();
+
+    buf = client_in.read_exactly(5).get();
+    BOOST_REQUIRE_EQUAL(sstring(buf.get(), buf.size()), "moved");
+    BOOST_REQUIRE(client_in.read().get().empty());
+    client_out.close().get();
+    client_in.close().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_handoff_nothing) {
+    auto received = hand_off(test_address("nothing"), {});
+    BOOST_REQUIRE(received.empty());
+    BOOST_REQUIRE_THROW(net::request_handoff(socket_address(ipv4_addr("127.0.0.1", 1))).get(), std::invalid_argument);
+}
@@ -33,6 +33,10 @@
 #include <seastar/core/sleep.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/when_all.hh>
+#include <seastar/core/file.hh>
+#include <seastar/core/fstream.hh>
+#include <seastar/util/tmp_file.hh>
+#include <seastar/util/defer.hh>
 #include <seastar/net/api.hh>
 #include <seastar/net/posix-stack.hh>
 
@@ -337,3 +341,84 @@ SEASTAR_THREAD_TEST_CASE(socket_bufsize) {
     BOOST_CHECK_LT(recv_default, 20'000'000);
 }
 
+
+SEASTAR_THREAD_TEST_CASE(socket_write_file) {
+    tmp_dir::do_with_thread([] (tmp_dir& t) {
+        // A few MB, so the transfer takes several trips through the socket buffer
+        constexpr size_t size = 4 << 20;
+        constexpr size_t pos = 4096 + 13, len = size - pos - 17;
+        std::vector<char> data(size);
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = char(i * 7 + i / 4096);
+        }
+        auto name = (t.get_path() / "file").native();
+        auto f = open_file_dma(name, open_flags::rw | open_flags::create).get();
+        auto fout = make_file_output_stream(f).get();
+        fout.write(data.data(), data.size()).get();
+        fout.close().get();
+        f = open_file_dma(name, open_flags::ro).get();
+
+        ipv4_addr addr("127.0.0.1", 1234);
+        server_socket ss = seastar::listen(addr, listen_options{.reuse_address = true});
+        connected_socket client = connect(addr).get();
+        connected_socket server = ss.accept().get().connection;
+
+        auto out = server.output();
+        auto in = client.input();
+        auto sent = out.write("head", 4).then([&] {
+            return out.write_file(f, pos, len);
+        }).then([&] {
+            return out.write("tail", 4);
+        }).finally([&] {
+            return out.close();
+        });
+        std::string received;
+        while (auto buf = in.read().get()) {
+            received.append(buf.get(), buf.size());
+        }
+        sent.get();
+        in.close().get();
+        f.close().get();
+        ss.abort_accept();
+
+        BOOST_REQUIRE_EQUAL(received.size(), len + 8);
+        BOOST_REQUIRE_EQUAL(received.substr(0, 4), "head");
+        BOOST_REQUIRE(std::equal(data.begin() + pos, data.begin() + pos + len, received.begin() + 4));
+        BOOST_REQUIRE_EQUAL(received.substr(len + 4), "tail");
+    }).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(datagram_batch) {
+    auto server = make_bound_datagram_channel(ipv4_addr("127.0.0.1", 0));
+    auto client = make_bound_datagram_channel(ipv4_addr("127.0.0.1", 0));
+    auto close = defer([&] () noexcept {
+        server.close();
+        client.close();
+    });
+
+    // Equally sized datagrams to one destination may go out as one GSO
+    // message, and come back as one GRO one: they must still arrive apart
+    constexpr size_t count = 20;
+    std::vector<net::outgoing_datagram> out;
+    for (size_t i = 0; i < count; i++) {
+        auto size = i + 1 < count ? 100 : 42;
+        out.push_back({server.local_address(), net::packet(temporary_buffer<char>(sstring(size, 'a' + i % 26).c_str(), size))});
+    }
+    client.send_batch(std::move(out)).get();
+
+    size_t received = 0;
+    while (received < count) {
+        auto batch = server.receive_batch(8).get();
+        BOOST_REQUIRE(!batch.empty());
+        BOOST_REQUIRE_LE(batch.size(), 8u);
+        for (auto& d : batch) {
+            auto& p = d.get_data();
+            p.linearize();
+            auto data = std::string_view(p.frag(0).base, p.frag(0).size);
+            BOOST_REQUIRE_EQUAL(d.get_src(), client.local_address());
+            BOOST_REQUIRE_EQUAL(data.size(), received + 1 < count ? 100u : 42u);
+            BOOST_REQUIRE(std::all_of(data.begin(), data.end(), [c = char('a' + received % 26)] (char x) { return x == c; }));
+            received++;
+        }
+    }
+}
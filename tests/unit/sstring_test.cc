@@ -25,6 +25,7 @@
 
 #include <boost/test/unit_test.hpp>
 #include <seastar/core/sstring.hh>
+#include <seastar/util/string_utils.hh>
 #include <list>
 #include <fmt/ranges.h>
 #if FMT_VERSION >= FMT_VERSION_OPTIONAL_FORMAT
@@ -327,3 +328,29 @@ BOOST_AUTO_TEST_CASE(test_fmt) {
 }
 
 #endif
+
+BOOST_AUTO_TEST_CASE(test_case_insensitive_cmp_and_hash) {
+    internal::case_insensitive_cmp cmp;
+    internal::case_insensitive_hash hash;
+    std::string all_chars;
+    for (int c = 1; c < 256; ++c) {
+        all_chars.push_back(char(c));
+    }
+    std::string lower = all_chars;
+    for (auto& c : lower) {
+        c = ::tolower(static_cast<unsigned char>(c));
+    }
+    for (size_t len = 0; len <= all_chars.size(); len += 7) {
+        auto a = std::string_view(all_chars).substr(0, len);
+        auto b = std::string_view(lower).substr(0, len);
+        BOOST_REQUIRE(cmp(a, b));
+        BOOST_REQUIRE_EQUAL(hash(a), hash(b));
+    }
+    BOOST_REQUIRE(cmp("Transfer-Encoding", "transfer-encoding"));
+    BOOST_REQUIRE(cmp(sstring("KEEP-ALIVE"), "keep-alive"));
+    BOOST_REQUIRE(!cmp("keep-alive", "keep-alivf"));
+    BOOST_REQUIRE(!cmp("Content-Length", "Content-Lengt"));
+    BOOST_REQUIRE(!cmp("@[`{", "`{@["));
+    BOOST_REQUIRE(!cmp("\xc0", "\xe0"));
+    BOOST_REQUIRE_NE(hash("Content-Type"), hash("Content-Length"));
+}
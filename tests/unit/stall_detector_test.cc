@@ -22,9 +22,11 @@
 #include <boost/test/tools/old/interface.hpp>
 #include <cstddef>
 #include <seastar/core/internal/stall_detector.hh>
+#include <seastar/core/internal/cpu_profiler.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/thread_cputime_clock.hh>
 #include <seastar/core/loop.hh>
+#include <seastar/core/with_scheduling_group.hh>
 #include <seastar/util/later.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
@@ -229,6 +231,34 @@ SEASTAR_THREAD_TEST_CASE(stall_detector_crash) {
 }
 
 
+SEASTAR_THREAD_TEST_CASE(cpu_profiler_attribution) {
+    auto sg = create_scheduling_group("profiled", 100).get();
+    {
+        temporary_stall_detector_settings tsds(10ms, [] {});
+        engine().set_cpu_profiler_period(1ms);
+        with_scheduling_group(sg, [] {
+            spin(50ms);
+        }).get();
+        engine().set_cpu_profiler_period(0us);
+    }
+    uint64_t samples = 0;
+    uint64_t stalled = 0;
+    for (auto& e : internal::cpu_profile()) {
+        if (e.scheduling_group == "profiled") {
+            samples += e.samples;
+            stalled += e.stalled ? e.samples : 0;
+        }
+    }
+    testlog.info("samples: {}, stalled: {}", samples, stalled);
+    BOOST_REQUIRE_GT(samples, 10);
+    BOOST_REQUIRE_GT(stalled, 0);
+    BOOST_REQUIRE_LT(stalled, samples);
+    // Reading the profile starts a new one
+    for (auto& e : internal::cpu_profile()) {
+        BOOST_REQUIRE_NE(e.scheduling_group, "profiled");
+    }
+    destroy_scheduling_group(sg).get();
+}
 
 #else
 
@@ -109,3 +109,65 @@ SEASTAR_TEST_CASE(test_skip_all) {
         BOOST_REQUIRE(to_sstring(empty_inp.read().get()).empty());
     });
 }
+
+SEASTAR_THREAD_TEST_CASE(test_consume_fragmented) {
+    // 7-byte records over 3-byte buffers: every record spans buffers
+    input_stream<char> inp(data_source(std::make_unique<test_source_impl>(3, 52)));
+    std::vector<sstring> records;
+    inp.consume_fragmented([&records] (const input_fragments<char>& data) {
+        BOOST_REQUIRE(!data.eof());
+        if (data.size() < 7) {
+            return make_ready_future<fragmented_consumption_result>(fragmented_consumption_result{0});
+        }
+        auto parts = data.share(0, 7);
+        BOOST_REQUIRE_GT(parts.size(), 1u);
+        sstring rec;
+        for (auto& p : parts) {
+            rec += to_sstring(std::move(p));
+        }
+        BOOST_REQUIRE_EQUAL(data.find(rec[6]), 6u);
+        BOOST_REQUIRE_EQUAL(to_sstring(data.linearize(0, 7)), rec);
+        records.push_back(std::move(rec));
+        return make_ready_future<fragmented_consumption_result>(fragmented_consumption_result{7, stop_iteration(records.size() == 3)});
+    }).get();
+    BOOST_REQUIRE(records == (std::vector<sstring>{"abcdefg", "hijklmn", "opqrstu"}));
+    // What the consumer left is still in the stream
+    BOOST_REQUIRE_EQUAL(to_sstring(inp.read_exactly(5).get()), "vwxyz");
+
+    auto parts = inp.read_exactly_fragmented(10).get();
+    BOOST_REQUIRE_GT(parts.size(), 1u);
+    sstring s;
+    for (auto& p : parts) {
+        s += to_sstring(std::move(p));
+    }
+    BOOST_REQUIRE_EQUAL(s, "abcdefghij");
+
+    size_t left = 0;
+    inp.consume_fragmented([&left] (const input_fragments<char>& data) {
+        left = data.size();
+        return make_ready_future<fragmented_consumption_result>(fragmented_consumption_result{0});
+    }).get();
+    BOOST_REQUIRE(inp.eof());
+    BOOST_REQUIRE_EQUAL(left, 52u - 36);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_consume_fragmented_buffered_records) {
+    // 3 records in a single buffer, consumed one per call
+    input_stream<char> inp(data_source(std::make_unique<test_source_impl>(21, 21)));
+    std::vector<sstring> records;
+    unsigned calls_at_eof = 0;
+    inp.consume_fragmented([&] (const input_fragments<char>& data) {
+        if (data.eof()) {
+            ++calls_at_eof;
+        }
+        if (data.size() < 7) {
+            return make_ready_future<fragmented_consumption_result>(fragmented_consumption_result{0});
+        }
+        records.push_back(to_sstring(data.linearize(0, 7)));
+        return make_ready_future<fragmented_consumption_result>(fragmented_consumption_result{7});
+    }).get();
+    BOOST_REQUIRE(records == (std::vector<sstring>{"abcdefg", "hijklmn", "opqrstu"}));
+    // the records were consumed before the stream was read again
+    BOOST_REQUIRE_EQUAL(calls_at_eof, 1u);
+    BOOST_REQUIRE(inp.eof());
+}
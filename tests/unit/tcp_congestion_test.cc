@@ -0,0 +1,122 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <seastar/net/tcp-congestion.hh>
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace seastar::net;
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr uint32_t mss = 1000;
+using time_point = tcp_congestion_control::clock_type::time_point;
+
+// Acknowledges one window worth of segments per round trip
+void run_rounds(tcp_congestion_control& cc, uint32_t& cwnd, uint32_t ssthresh, time_point& now,
+        std::chrono::milliseconds rtt, unsigned rounds) {
+    for (unsigned r = 0; r < rounds; r++) {
+        now += rtt;
+        cc.on_rtt_sample(rtt, now);
+        auto window = cwnd;
+        for (uint32_t acked = 0; acked < window; acked += mss) {
+            cc.on_ack(cwnd, ssthresh, mss, mss, now);
+        }
+    }
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_algorithm_names) {
+    for (auto algo : {tcp_congestion_algorithm::reno, tcp_congestion_algorithm::cubic, tcp_congestion_algorithm::bbr}) {
+        BOOST_REQUIRE(parse_tcp_congestion_algorithm(tcp_congestion_algorithm_name(algo)) == algo);
+        BOOST_REQUIRE(make_tcp_congestion_control(algo)->algorithm() == algo);
+    }
+    BOOST_REQUIRE_THROW(parse_tcp_congestion_algorithm("vegas"), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(test_reno) {
+    tcp_reno cc;
+    time_point now;
+    uint32_t cwnd = 4 * mss;
+
+    // Slow start doubles the window every round trip
+    run_rounds(cc, cwnd, 64 * mss, now, 10ms, 2);
+    BOOST_REQUIRE_EQUAL(cwnd, 16 * mss);
+
+    // Congestion avoidance adds about a segment per round trip
+    run_rounds(cc, cwnd, 16 * mss, now, 10ms, 1);
+    BOOST_REQUIRE_GT(cwnd, 16 * mss + mss / 2);
+    BOOST_REQUIRE_LE(cwnd, 17 * mss);
+
+    BOOST_REQUIRE_EQUAL(cc.on_loss(cwnd, 20 * mss, mss, false, now), 10 * mss);
+    BOOST_REQUIRE_EQUAL(cc.on_loss(cwnd, 2 * mss, mss, true, now), 2 * mss);
+}
+
+BOOST_AUTO_TEST_CASE(test_cubic_recovers_to_last_max) {
+    tcp_cubic cc;
+    time_point now;
+    uint32_t cwnd = 100 * mss;
+
+    auto ssthresh = cc.on_loss(cwnd, cwnd, mss, false, now);
+    BOOST_REQUIRE_EQUAL(ssthresh, 70 * mss);
+    cwnd = ssthresh;
+
+    // K = cbrt(100 * (1 - 0.7) / 0.4) is about 4.2 seconds, the window
+    // gets back to where the loss happened and plateaus there
+    run_rounds(cc, cwnd, ssthresh, now, 100ms, 20);
+    BOOST_REQUIRE_GT(cwnd, 85 * mss);
+    BOOST_REQUIRE_LT(cwnd, 100 * mss);
+    run_rounds(cc, cwnd, ssthresh, now, 100ms, 20);
+    BOOST_REQUIRE_GE(cwnd, 99 * mss);
+    BOOST_REQUIRE_LT(cwnd, 103 * mss);
+
+    // Past the plateau the window probes for more bandwidth
+    run_rounds(cc, cwnd, ssthresh, now, 100ms, 30);
+    BOOST_REQUIRE_GT(cwnd, 105 * mss);
+}
+
+BOOST_AUTO_TEST_CASE(test_bbr_keeps_window_at_bdp) {
+    tcp_bbr cc;
+    time_point now;
+    uint32_t cwnd = 4 * mss;
+    BOOST_REQUIRE_EQUAL(cc.target_cwnd(mss), 0);
+
+    // The link delivers at most 50 segments per 10ms round trip, so the
+    // delivery rate stops growing once the window exceeds that
+    constexpr uint32_t bdp = 50 * mss;
+    for (unsigned r = 0; r < 30; r++) {
+        now += 10ms;
+        cc.on_rtt_sample(10ms, now);
+        auto delivered = std::min(cwnd, bdp);
+        for (uint32_t acked = 0; acked < delivered; acked += mss) {
+            cc.on_ack(cwnd, 0, mss, mss, now);
+        }
+    }
+
+    BOOST_REQUIRE_EQUAL(cc.target_cwnd(mss), 2 * bdp);
+    BOOST_REQUIRE_EQUAL(cwnd, 2 * bdp);
+    BOOST_REQUIRE_EQUAL(cc.on_loss(cwnd, cwnd, mss, false, now), 2 * bdp);
+}
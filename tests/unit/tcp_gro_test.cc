@@ -0,0 +1,134 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <seastar/net/tcp-gro.hh>
+#include <seastar/net/ip.hh>
+#include <seastar/core/byteorder.hh>
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace seastar;
+using namespace seastar::net;
+
+namespace {
+
+constexpr uint8_t flag_psh = 0x08;
+constexpr uint8_t flag_ack = 0x10;
+
+const ipv4_address client(0x0a000001);
+const ipv4_address server(0x0a000002);
+
+struct delivered {
+    packet p;
+    ipv4_address from;
+};
+
+packet make_segment(uint16_t src_port, uint32_t seq, uint32_t ack, uint8_t flags, size_t data_len, uint16_t window = 100) {
+    std::vector<char> buf(20 + data_len, 'x');
+    std::fill_n(buf.data(), 20, 0);
+    write_be<uint16_t>(buf.data(), src_port);
+    write_be<uint16_t>(buf.data() + 2, 80);
+    write_be<uint32_t>(buf.data() + 4, seq);
+    write_be<uint32_t>(buf.data() + 8, ack);
+    buf[12] = 5 << 4;
+    buf[13] = flags;
+    write_be<uint16_t>(buf.data() + 14, window);
+    return packet(buf.data(), buf.size());
+}
+
+uint32_t seq_of(packet& p) {
+    return read_be<uint32_t>(p.get_header(0, 20) + 4);
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_merges_in_order_segments) {
+    std::vector<delivered> out;
+    ipv4_tcp_gro gro([&] (packet p, ipv4_address from, ipv4_address to) {
+        out.push_back({std::move(p), from});
+    }, false);
+
+    gro.receive(make_segment(1000, 1, 7, flag_ack, 100), client, server);
+    gro.receive(make_segment(1000, 101, 7, flag_ack, 100), client, server);
+    gro.receive(make_segment(1000, 201, 7, flag_ack, 100, 200), client, server);
+    BOOST_REQUIRE(out.empty());
+    BOOST_REQUIRE(gro.flush());
+    BOOST_REQUIRE(gro.empty());
+    BOOST_REQUIRE(!gro.flush());
+
+    BOOST_REQUIRE_EQUAL(out.size(), 1);
+    auto& p = out[0].p;
+    BOOST_REQUIRE_EQUAL(p.len(), 20 + 300);
+    BOOST_REQUIRE_EQUAL(seq_of(p), 1);
+    BOOST_REQUIRE_EQUAL(read_be<uint16_t>(p.get_header(0, 20) + 14), 200);
+    BOOST_REQUIRE_EQUAL(gro.merged_segments(), 2);
+    BOOST_REQUIRE_EQUAL(gro.packets(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_keeps_flow_order) {
+    std::vector<delivered> out;
+    ipv4_tcp_gro gro([&] (packet p, ipv4_address from, ipv4_address to) {
+        out.push_back({std::move(p), from});
+    }, false);
+
+    // Another flow is held separately
+    gro.receive(make_segment(1000, 1, 7, flag_ack, 100), client, server);
+    gro.receive(make_segment(2000, 5000, 7, flag_ack, 100), client, server);
+    // A gap releases the held data before the new segment
+    gro.receive(make_segment(1000, 201, 7, flag_ack, 100), client, server);
+    BOOST_REQUIRE_EQUAL(out.size(), 1);
+    BOOST_REQUIRE_EQUAL(seq_of(out[0].p), 1);
+    // A pure ACK is not held and goes after the data of its flow
+    gro.receive(make_segment(1000, 301, 8, flag_ack, 0), client, server);
+    BOOST_REQUIRE_EQUAL(out.size(), 3);
+    BOOST_REQUIRE_EQUAL(seq_of(out[1].p), 201);
+    BOOST_REQUIRE_EQUAL(out[2].p.len(), 20);
+    // PSH delivers the merged data right away
+    gro.receive(make_segment(2000, 5100, 7, flag_ack | flag_psh, 100), client, server);
+    BOOST_REQUIRE_EQUAL(out.size(), 4);
+    BOOST_REQUIRE_EQUAL(out[3].p.len(), 20 + 200);
+    BOOST_REQUIRE(uint8_t(out[3].p.get_header(0, 20)[13]) & flag_psh);
+    BOOST_REQUIRE(gro.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_verifies_checksum) {
+    std::vector<delivered> out;
+    ipv4_tcp_gro gro([&] (packet p, ipv4_address from, ipv4_address to) {
+        out.push_back({std::move(p), from});
+    }, true);
+
+    auto good = make_segment(1000, 1, 7, flag_ack, 100);
+    checksummer csum;
+    ipv4_traits::tcp_pseudo_header_checksum(csum, client, server, good.len());
+    csum.sum(good);
+    auto sum = csum.get();
+    std::memcpy(good.get_header(0, 20) + 16, &sum, sizeof(sum));
+
+    gro.receive(make_segment(1000, 1, 7, flag_ack, 100), client, server);
+    gro.receive(std::move(good), client, server);
+    gro.flush();
+    BOOST_REQUIRE_EQUAL(out.size(), 1);
+    BOOST_REQUIRE(out[0].p.offload_info_ref().rx_csum_verified);
+}
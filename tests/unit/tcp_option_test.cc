@@ -0,0 +1,132 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <seastar/net/tcp.hh>
+#include <boost/test/unit_test.hpp>
+#include <array>
+
+using namespace seastar::net;
+
+namespace {
+
+// Writes the options of a segment and parses them back on the other side
+uint8_t exchange(tcp_option& from, tcp_option& to, bool syn_on, bool ack_on) {
+    std::array<char, tcp_hdr::len + 40> buf = {};
+    tcp_hdr h = {};
+    h.f_syn = syn_on;
+    h.f_ack = ack_on;
+    auto size = from.get_size(syn_on, ack_on);
+    BOOST_REQUIRE_LE(size, 40);
+    BOOST_REQUIRE_EQUAL(size % tcp_option::align, 0);
+    BOOST_REQUIRE_EQUAL(from.fill(buf.data(), &h, size), size);
+    auto opts = reinterpret_cast<uint8_t*>(buf.data() + tcp_hdr::len);
+    to.parse(opts, opts + size);
+    return size;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(test_sack_permitted_negotiation) {
+    tcp_option client, server;
+    client._local_mss = server._local_mss = 1460;
+
+    // mss, window scale and SACK permitted
+    BOOST_REQUIRE_EQUAL(exchange(client, server, true, false), 12);
+    BOOST_REQUIRE(server._sack_received);
+
+    BOOST_REQUIRE_EQUAL(exchange(server, client, true, true), 12);
+    BOOST_REQUIRE(client._sack_received);
+
+    // Not offered back when the SYN didn't have it
+    tcp_option old_client, silent_server;
+    silent_server._local_mss = 1460;
+    silent_server._mss_received = true;
+    BOOST_REQUIRE_EQUAL(exchange(silent_server, old_client, true, true), 8);
+    BOOST_REQUIRE(!old_client._sack_received);
+}
+
+BOOST_AUTO_TEST_CASE(test_sack_blocks) {
+    tcp_option receiver, sender;
+
+    BOOST_REQUIRE_EQUAL(receiver.get_size(false, true), 0);
+
+    receiver._local_sack_blocks[0] = {3000, 4000};
+    receiver._local_sack_blocks[1] = {1000, 2000};
+    receiver._nr_local_sack_blocks = 2;
+    BOOST_REQUIRE_EQUAL(exchange(receiver, sender, false, true), 20);
+    BOOST_REQUIRE_EQUAL(sender._nr_remote_sack_blocks, 2);
+    BOOST_REQUIRE(sender._remote_sack_blocks[0] == std::make_pair(3000u, 4000u));
+    BOOST_REQUIRE(sender._remote_sack_blocks[1] == std::make_pair(1000u, 2000u));
+
+    for (unsigned i = 0; i < tcp_option::sack_blocks::max_blocks; i++) {
+        receiver._local_sack_blocks[i] = {0xfffff000u + i * 0x1000, 0xfffff800u + i * 0x1000};
+    }
+    receiver._nr_local_sack_blocks = tcp_option::sack_blocks::max_blocks;
+    BOOST_REQUIRE_EQUAL(exchange(receiver, sender, false, true), 36);
+    BOOST_REQUIRE_EQUAL(sender._nr_remote_sack_blocks, tcp_option::sack_blocks::max_blocks);
+    BOOST_REQUIRE(sender._remote_sack_blocks == receiver._local_sack_blocks);
+
+    // A segment without the option carries no blocks
+    receiver._nr_local_sack_blocks = 0;
+    BOOST_REQUIRE_EQUAL(exchange(receiver, sender, false, true), 0);
+    BOOST_REQUIRE_EQUAL(sender._nr_remote_sack_blocks, 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_timestamps) {
+    tcp_option client, server;
+    client._local_mss = server._local_mss = 1460;
+    client._local_timestamps = server._local_timestamps = true;
+
+    // The SYN offers timestamps with nothing to echo yet
+    client._local_ts_val = 100;
+    BOOST_REQUIRE_EQUAL(exchange(client, server, true, false), 20);
+    BOOST_REQUIRE(server._remote_ts_present);
+    BOOST_REQUIRE_EQUAL(server._remote_ts_val, 100);
+    BOOST_REQUIRE_EQUAL(server._remote_ts_ecr, 0);
+
+    server._local_ts_val = 7;
+    server._local_ts_ecr = server._remote_ts_val;
+    BOOST_REQUIRE_EQUAL(exchange(server, client, true, true), 20);
+    BOOST_REQUIRE(client.timestamps_enabled() && server.timestamps_enabled());
+    BOOST_REQUIRE_EQUAL(client._remote_ts_ecr, 100);
+
+    // Every segment carries them, leaving room for three SACK blocks
+    BOOST_REQUIRE_EQUAL(exchange(client, server, false, true), 12);
+    BOOST_REQUIRE_EQUAL(client.max_sack_blocks(), 3);
+    for (unsigned i = 0; i < client.max_sack_blocks(); i++) {
+        client._local_sack_blocks[i] = {1000 * (i + 2), 1000 * (i + 2) + 500};
+    }
+    client._nr_local_sack_blocks = client.max_sack_blocks();
+    BOOST_REQUIRE_EQUAL(exchange(client, server, false, true), 40);
+    BOOST_REQUIRE(server._remote_ts_present);
+    BOOST_REQUIRE_EQUAL(server._nr_remote_sack_blocks, 3);
+
+    // Not used when the peer didn't offer them
+    tcp_option plain, ts_server;
+    plain._local_mss = ts_server._local_mss = 1460;
+    ts_server._local_timestamps = true;
+    exchange(plain, ts_server, true, false);
+    BOOST_REQUIRE_EQUAL(exchange(ts_server, plain, true, true), 12);
+    BOOST_REQUIRE(!ts_server.timestamps_enabled());
+    BOOST_REQUIRE_EQUAL(ts_server.max_sack_blocks(), tcp_option::sack_blocks::max_blocks);
+}
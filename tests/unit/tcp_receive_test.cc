@@ -0,0 +1,156 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <seastar/net/tcp.hh>
+#include <boost/test/unit_test.hpp>
+
+using namespace seastar::net;
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr uint16_t mss = 1460;
+using time_point = tcp_receive_space::clock_type::time_point;
+
+}
+
+BOOST_AUTO_TEST_CASE(test_receive_rtt) {
+    tcp_receive_space space(128 * 1024, 6 * 1024 * 1024);
+    BOOST_REQUIRE_EQUAL(space.rtt().count(), 0);
+
+    // Samples from the time to receive a window only lower the estimate
+    space.on_rtt_sample(10ms, true);
+    space.on_rtt_sample(20ms, true);
+    BOOST_REQUIRE(space.rtt() == 10ms);
+    space.on_rtt_sample(5ms, true);
+    BOOST_REQUIRE(space.rtt() == 5ms);
+
+    // Timestamp samples are smoothed
+    space.on_rtt_sample(13ms, false);
+    BOOST_REQUIRE(space.rtt() == 6ms);
+}
+
+BOOST_AUTO_TEST_CASE(test_receive_space_growth) {
+    tcp_receive_space space(128 * 1024, 6 * 1024 * 1024);
+    time_point now;
+
+    // Nothing to go by before the round trip time is known
+    BOOST_REQUIRE(!space.on_consumed(1024 * 1024, mss, now));
+    BOOST_REQUIRE_EQUAL(space.buffer_size(), 128 * 1024);
+
+    space.on_rtt_sample(10ms, true);
+    BOOST_REQUIRE(!space.on_consumed(64 * 1024, mss, now));
+    now += 5ms;
+    BOOST_REQUIRE(!space.on_consumed(128 * 1024, mss, now));
+
+    // Grows to more than twice what was consumed in a round trip
+    now += 5ms;
+    BOOST_REQUIRE(space.on_consumed(128 * 1024, mss, now));
+    BOOST_REQUIRE_GT(space.buffer_size(), 2 * 320 * 1024);
+
+    // The application keeps up with a steady rate, which the buffer allows
+    auto size = space.buffer_size();
+    for (int i = 0; i != 10; ++i) {
+        now += 10ms;
+        space.on_consumed(320 * 1024, mss, now);
+    }
+    BOOST_REQUIRE_EQUAL(space.buffer_size(), size);
+
+    // Up to the maximum
+    for (uint64_t rate = 1024 * 1024; rate <= 64 * 1024 * 1024; rate *= 2) {
+        now += 10ms;
+        space.on_consumed(rate, mss, now);
+    }
+    BOOST_REQUIRE_EQUAL(space.buffer_size(), 6 * 1024 * 1024);
+}
+
+BOOST_AUTO_TEST_CASE(test_quick_ack) {
+    tcp_ack_policy policy(200ms);
+    time_point now;
+
+    // A new connection acknowledges its first segments right away
+    policy.on_data_received(now, 32 * 1024, mss, 1s);
+    unsigned quick_acks = 0;
+    while (policy.take_quick_ack()) {
+        quick_acks++;
+    }
+    BOOST_REQUIRE_EQUAL(quick_acks, 32 * 1024 / (2 * mss));
+    BOOST_REQUIRE(policy.ack_timeout() == tcp_ack_policy::min_ack_timeout);
+
+    // Segments arriving back to back keep the timeout short
+    for (int i = 0; i != 10; ++i) {
+        now += 1ms;
+        policy.on_data_received(now, 64 * 1024, mss, 1s);
+        BOOST_REQUIRE(!policy.take_quick_ack());
+    }
+    BOOST_REQUIRE(policy.ack_timeout() == tcp_ack_policy::min_ack_timeout);
+
+    // And so does a connection which was idle
+    now += 2s;
+    policy.on_data_received(now, 1024 * 1024, mss, 1s);
+    quick_acks = 0;
+    while (policy.take_quick_ack()) {
+        quick_acks++;
+    }
+    BOOST_REQUIRE_EQUAL(quick_acks, tcp_ack_policy::max_quick_acks);
+}
+
+BOOST_AUTO_TEST_CASE(test_pingpong) {
+    tcp_ack_policy policy(200ms);
+    time_point now;
+
+    // A response shortly after a request, the ACK goes out with it
+    policy.on_data_received(now, 64 * 1024, mss, 1s);
+    now += 1ms;
+    policy.on_data_sent(now);
+    BOOST_REQUIRE(policy.interactive());
+    BOOST_REQUIRE(!policy.take_quick_ack());
+
+    // Until a response is late
+    policy.on_ack_timeout();
+    BOOST_REQUIRE(!policy.interactive());
+    BOOST_REQUIRE(policy.take_quick_ack());
+
+    // ACKs delayed until the timeout make it longer, up to the maximum
+    auto timeout = policy.ack_timeout();
+    policy.on_ack_timeout();
+    BOOST_REQUIRE(policy.ack_timeout() == 2 * timeout);
+    for (int i = 0; i != 10; ++i) {
+        policy.on_ack_timeout();
+    }
+    BOOST_REQUIRE(policy.ack_timeout() == 200ms);
+
+    // A sender which keeps quiet past the timeout is not interactive
+    now += 1s;
+    policy.on_data_sent(now);
+    BOOST_REQUIRE(!policy.interactive());
+}
+
+BOOST_AUTO_TEST_CASE(test_ack_timeout_bound) {
+    // As in tcp_tuning::datacenter()
+    tcp_ack_policy policy(1ms);
+    policy.on_data_received(time_point(), 64 * 1024, mss, 5ms);
+    BOOST_REQUIRE(policy.ack_timeout() == 1ms);
+    policy.on_ack_timeout();
+    BOOST_REQUIRE(policy.ack_timeout() == 1ms);
+}
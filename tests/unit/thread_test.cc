@@ -167,6 +167,25 @@ SEASTAR_TEST_CASE(test_thread_custom_stack_size) {
     });
 }
 
+#ifndef SEASTAR_ASAN_ENABLED
+SEASTAR_TEST_CASE(test_thread_stack_reuse) {
+    auto stack_top = [] (size_t stack_size) {
+        thread_attributes attr;
+        attr.stack_size = stack_size;
+        return async(attr, [] {
+            return reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+        });
+    };
+    // Both stack sizes round up to the 128KiB class, so the second thread
+    // gets the stack the first one left
+    return stack_top(100 * 1024).then([stack_top] (uintptr_t first) {
+        return stack_top(120 * 1024).then([first] (uintptr_t second) {
+            BOOST_REQUIRE_EQUAL(first, second);
+        });
+    });
+}
+#endif
+
 // The test case uses x86_64 specific signal handler info. The test
 // fails with detect_stack_use_after_return=1. We could put it behind
 // a command line option and fork/exec to run it after removing
@@ -25,8 +25,10 @@
 #include <seastar/core/print.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/sleep.hh>
+#include <array>
 #include <chrono>
 #include <iostream>
+#include <vector>
 
 using namespace seastar;
 using namespace std::chrono_literals;
@@ -75,6 +77,8 @@ struct timer_test {
 
         return pr1.get_future().then([this] { return test_timer_cancelling(); }).then([this] {
             return test_timer_with_scheduling_groups();
+        }).then([this] {
+            return test_timer_slack();
         });
     }
 
@@ -122,6 +126,32 @@ struct timer_test {
             destroy_scheduling_group(sg2).get();
         });
     }
+
+    future<> test_timer_slack() {
+        return async([] {
+            // Timers armed a little apart within the slack expire together
+            std::vector<typename Clock::time_point> expired;
+            std::array<timer<Clock>, 4> timers;
+            auto start = Clock::now();
+            for (size_t i = 0; i < timers.size(); ++i) {
+                auto& t = timers[i];
+                t.set_callback([&] { expired.push_back(Clock::now()); });
+                t.set_slack(64ms);
+                t.arm(start + 100ms + i * 1ms);
+                if (t.get_timeout() < start + 100ms + i * 1ms || t.get_timeout() > start + 164ms + i * 1ms) {
+                    BUG();
+                }
+            }
+            if (timers[0].get_timeout() != timers[1].get_timeout() && timers[1].get_timeout() != timers[3].get_timeout()) {
+                BUG();
+            }
+            sleep(300ms).get();
+            if (expired.size() != timers.size()) {
+                BUG();
+            }
+            OK();
+        });
+    }
 };
 
 int main(int ac, char** av) {
@@ -0,0 +1,174 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include <seastar/core/timer-wheel.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+namespace {
+
+struct test_clock {
+    using duration = std::chrono::nanoseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<test_clock, duration>;
+    static time_point now() noexcept { return {}; }
+};
+
+struct test_timer {
+    using clock = test_clock;
+    using duration = clock::duration;
+    using time_point = clock::time_point;
+
+    boost::intrusive::list_member_hook<> link;
+    time_point timeout;
+    bool _expired = false;
+    bool armed = false;
+
+    time_point get_timeout() const noexcept { return timeout; }
+    void cancel() noexcept;
+};
+
+using wheel_t = timer_wheel<test_timer, &test_timer::link>;
+
+wheel_t* current_wheel;
+
+void test_timer::cancel() noexcept {
+    current_wheel->remove(*this);
+    armed = false;
+}
+
+struct wheel_fixture {
+    wheel_t wheel;
+    std::deque<test_timer> timers;
+    test_clock::time_point now;
+
+    wheel_fixture() {
+        current_wheel = &wheel;
+    }
+
+    test_timer& arm(test_clock::time_point timeout) {
+        auto& t = timers.emplace_back();
+        t.timeout = timeout;
+        t.armed = true;
+        wheel.insert(t);
+        return t;
+    }
+
+    test_clock::time_point next_armed() const {
+        auto next = test_clock::time_point::max();
+        for (auto& t : timers) {
+            if (t.armed) {
+                next = std::min(next, t.timeout);
+            }
+        }
+        return next;
+    }
+
+    void advance_to(test_clock::time_point to) {
+        now = to;
+        auto expired = wheel.expire(now);
+        for (auto& t : expired) {
+            BOOST_REQUIRE(t.armed);
+            BOOST_REQUIRE(t.timeout <= now);
+            t.armed = false;
+        }
+        for (auto& t : timers) {
+            BOOST_REQUIRE(!t.armed || t.timeout > now);
+        }
+        if (!wheel.empty()) {
+            BOOST_REQUIRE(wheel.get_next_timeout() == std::max(now, next_armed()));
+        }
+    }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(test_timer_wheel_expires_in_order) {
+    wheel_fixture f;
+    auto t0 = test_clock::time_point(1s);
+    f.advance_to(t0);
+    f.arm(t0 + 3ms);
+    f.arm(t0 + 3ms + 1ns);
+    f.arm(t0 + 5min);
+    f.arm(t0 + 100h);
+    BOOST_REQUIRE_EQUAL(f.wheel.size(), 4);
+    BOOST_REQUIRE(f.wheel.get_next_timeout() == t0 + 3ms);
+
+    f.advance_to(t0 + 3ms);
+    BOOST_REQUIRE_EQUAL(f.wheel.size(), 3);
+    f.advance_to(t0 + 3ms + 1ns);
+    BOOST_REQUIRE_EQUAL(f.wheel.size(), 2);
+    f.advance_to(t0 + 5min - 1ns);
+    BOOST_REQUIRE_EQUAL(f.wheel.size(), 2);
+    f.advance_to(t0 + 200h);
+    BOOST_REQUIRE(f.wheel.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_timer_wheel_past_timeout) {
+    wheel_fixture f;
+    f.advance_to(test_clock::time_point(10s));
+    auto& t = f.arm(test_clock::time_point(1s));
+    BOOST_REQUIRE(f.wheel.get_next_timeout() == test_clock::time_point(10s));
+    f.wheel.remove(t);
+    t.armed = false;
+    BOOST_REQUIRE(f.wheel.empty());
+    f.arm(test_clock::time_point(2s));
+    f.advance_to(test_clock::time_point(10s));
+    BOOST_REQUIRE(f.wheel.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_timer_wheel_random) {
+    wheel_fixture f;
+    std::default_random_engine rnd(std::random_device{}());
+    auto random_delay = [&] () -> test_clock::duration {
+        switch (std::uniform_int_distribution<int>(0, 3)(rnd)) {
+        case 0: return std::chrono::nanoseconds(std::uniform_int_distribution<int64_t>(0, 5'000'000)(rnd));
+        case 1: return std::chrono::microseconds(std::uniform_int_distribution<int64_t>(0, 1'000'000)(rnd));
+        case 2: return std::chrono::milliseconds(std::uniform_int_distribution<int64_t>(0, 600'000)(rnd));
+        default: return std::chrono::hours(std::uniform_int_distribution<int64_t>(0, 10'000)(rnd));
+        }
+    };
+
+    f.advance_to(test_clock::time_point(std::chrono::nanoseconds(std::uniform_int_distribution<int64_t>(0, 1'000'000'000)(rnd))));
+    for (int round = 0; round < 200; ++round) {
+        for (int i = 0; i < 100; ++i) {
+            f.arm(f.now + random_delay() - 1ms);
+        }
+        for (auto& t : f.timers) {
+            if (t.armed && std::uniform_int_distribution<int>(0, 9)(rnd) == 0) {
+                t.cancel();
+            }
+        }
+        f.advance_to(f.now + random_delay() / 100);
+    }
+    f.advance_to(test_clock::time_point::max());
+    BOOST_REQUIRE(f.wheel.empty());
+}
@@ -28,6 +28,7 @@
 #include <seastar/core/reactor.hh>
 #include <seastar/core/loop.hh>
 #include <seastar/core/sharded.hh>
+#include <seastar/core/scheduling.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/gate.hh>
 #include <seastar/core/temporary_buffer.hh>
@@ -37,6 +38,7 @@
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/process.hh>
 #include <seastar/net/tls.hh>
+#include <seastar/net/tls_session_keys.hh>
 #include <seastar/net/dns.hh>
 #include <seastar/net/inet_address.hh>
 #include <seastar/testing/test_case.hh>
@@ -71,6 +73,14 @@ using enable_if_without_networking = boost::unit_test::enable_if<!SEASTAR_TESTIN
 
 using namespace seastar;
 
+// Priority strings are GnuTLS ones, OpenSSL takes a cipher list instead
+// and negotiates TLS 1.3 whenever both ends support it
+static void set_tls13_only(tls::credentials_builder& b) {
+#ifndef SEASTAR_WITH_OSSL
+    b.set_priority_string("SECURE128:+SECURE192:-VERS-TLS-ALL:+VERS-TLS1.3");
+#endif
+}
+
 static future<> connect_to_ssl_addr(::shared_ptr<tls::certificate_credentials> certs, socket_address addr, const sstring& name = {}) {
     return repeat_until_value([=]() mutable {
         return tls::connect(certs, addr, tls::tls_options{.server_name = name}).then([](connected_socket s) {
@@ -168,6 +178,7 @@ SEASTAR_TEST_CASE(test_x509_client_with_builder_system_trust_multiple,
     });
 }
 
+#ifndef SEASTAR_WITH_OSSL
 SEASTAR_TEST_CASE(test_x509_client_with_system_trust_and_priority_strings,
                   *enable_if_with_networking()) {
     static std::vector<sstring> prios( {
@@ -210,6 +221,7 @@ SEASTAR_TEST_CASE(test_x509_client_with_system_trust_and_priority_strings_fail,
         return make_ready_future<>();
     });
 }
+#endif
 
 SEASTAR_TEST_CASE(test_alpn_client_negotiate_h2_with_google,
                   *enable_if_with_networking()) {
@@ -356,6 +368,7 @@ SEASTAR_THREAD_TEST_CASE(test_x509_client_with_builder_multiple) {
     }).get();
 }
 
+#ifndef SEASTAR_WITH_OSSL
 SEASTAR_THREAD_TEST_CASE(test_x509_client_with_priority_strings) {
     static std::vector<sstring> prios( {
         "NORMAL:+ARCFOUR-128", // means normal ciphers plus ARCFOUR-128.
@@ -400,6 +413,24 @@ SEASTAR_THREAD_TEST_CASE(test_x509_client_with_priority_strings_fail) {
         return make_ready_future<>();
     }).get();
 }
+#else
+SEASTAR_THREAD_TEST_CASE(test_x509_client_with_cipher_lists) {
+    static std::vector<sstring> ciphers({
+        "HIGH:!aNULL:!MD5",
+        "ECDHE+AESGCM",
+    });
+    tls::credentials_builder b;
+    https_server server;
+    b.set_x509_trust_file(server.cert(), tls::x509_crt_format::PEM).get();
+    auto addr = server.addr();
+    do_for_each(ciphers, [&b, addr](const sstring& cipher) {
+        b.set_priority_string(cipher);
+        return connect_to_ssl_addr(b.build_certificate_credentials(), addr);
+    }).get();
+    b.set_priority_string("NO-SUCH-CIPHER");
+    BOOST_REQUIRE_THROW(b.build_certificate_credentials(), std::invalid_argument);
+}
+#endif
 
 SEASTAR_TEST_CASE(test_failed_connect) {
     tls::credentials_builder b;
@@ -619,7 +650,8 @@ static future<> run_echo_test(sstring message,
                 sstring client_key = {},
                 bool do_read = true,
                 bool use_dh_params = true,
-                tls::dn_callback distinguished_name_callback = {}
+                tls::dn_callback distinguished_name_callback = {},
+                bool kernel_tls = false
 )
 {
     static const auto port = 4711;
@@ -631,6 +663,7 @@ static future<> run_echo_test(sstring message,
 
     SEASTAR_ASSERT(do_read || loops == 1);
 
+    certs->set_kernel_tls(kernel_tls);
     future<> f = make_ready_future();
 
     if (!client_crt.empty() && !client_key.empty()) {
@@ -767,6 +800,31 @@ SEASTAR_TEST_CASE(test_large_message_x509_client_server) {
     return run_echo_test(std::move(msg), 20, certfile("catest.pem"), "test.scylladb.org");
 }
 
+#ifndef SEASTAR_WITH_OSSL
+SEASTAR_TEST_CASE(test_large_message_x509_client_server_kernel_tls) {
+    // The client sends over kernel TLS where available, the server
+    // decrypts in user space. Falls back to user space TLS otherwise.
+    sstring msg = uninitialized_string(512 * 1024);
+    for (size_t i = 0; i < msg.size(); ++i) {
+        msg[i] = '0' + char(i % 30);
+    }
+    return run_echo_test(std::move(msg), 20, certfile("catest.pem"), "test.scylladb.org",
+        certfile("test.crt"), certfile("test.key"), tls::client_auth::NONE,
+        {}, {}, true, true, {}, /* kernel_tls */ true
+    );
+}
+#else
+SEASTAR_THREAD_TEST_CASE(test_kernel_tls_unsupported) {
+    tls::certificate_credentials certs;
+    BOOST_REQUIRE_THROW(certs.set_kernel_tls(true), std::invalid_argument);
+    certs.set_kernel_tls(false);
+
+    tls::credentials_builder b;
+    b.set_kernel_tls(true);
+    BOOST_REQUIRE_THROW(b.build_certificate_credentials(), std::invalid_argument);
+}
+#endif
+
 SEASTAR_TEST_CASE(test_simple_x509_client_server_fail_client_auth) {
     // Make sure we load our own auth trust pem file, otherwise our certs
     // will not validate
@@ -1614,7 +1672,7 @@ static void do_test_tls13_session_tickets(bool reset_server) {
     b.set_x509_key_file(certfile("test.crt"), certfile("test.key"), tls::x509_crt_format::PEM).get();
     b.set_x509_trust_file(certfile("catest.pem"), tls::x509_crt_format::PEM).get();
     b.set_session_resume_mode(tls::session_resume_mode::TLS13_SESSION_TICKET);
-    b.set_priority_string("SECURE128:+SECURE192:-VERS-TLS-ALL:+VERS-TLS1.3");
+    set_tls13_only(b);
 
     auto creds = b.build_certificate_credentials();
     auto serv = b.build_server_credentials();
@@ -1728,6 +1786,86 @@ SEASTAR_THREAD_TEST_CASE(test_tls13_session_tickets_retain_session_key) {
     do_test_tls13_session_tickets(true);
 }
 
+SEASTAR_THREAD_TEST_CASE(test_tls13_client_session_cache) {
+    tls::credentials_builder b;
+
+    b.set_x509_key_file(certfile("test.crt"), certfile("test.key"), tls::x509_crt_format::PEM).get();
+    b.set_x509_trust_file(certfile("catest.pem"), tls::x509_crt_format::PEM).get();
+    b.set_session_resume_mode(tls::session_resume_mode::TLS13_SESSION_TICKET);
+    set_tls13_only(b);
+
+    auto creds = b.build_certificate_credentials();
+    auto serv = b.build_server_credentials();
+    creds->set_client_session_cache({.max_entries = 1});
+
+    ::listen_options opts;
+    opts.reuse_address = true;
+    opts.set_fixed_cpu(this_shard_id());
+
+    auto addr = ::make_ipv4_address( {0x7f000001, 4712});
+    auto server = tls::listen(serv, addr, opts);
+
+    // Exchanges data both ways, for the ticket to arrive, and closes the
+    // connection, which stores the session in the cache
+    auto connect = [&] (sstring name) {
+        auto sa = server.accept();
+        // only the first name is the one of the certificate
+        auto c = tls::connect(creds, addr, tls::tls_options{.server_name = name, .verify_certificate = name == "test.scylladb.org"}).get();
+        auto s = sa.get();
+
+        auto in = s.connection.input();
+        auto cin = c.input();
+        output_stream<char> out(c.output().detach(), 1024);
+        output_stream<char> sout(s.connection.output().detach(), 1024);
+
+        out.write("nils").get();
+        auto fin = in.read();
+        out.flush().get();
+        fin.get();
+
+        sout.write("banan").get();
+        fin = cin.read();
+        sout.flush().get();
+        fin.get();
+
+        auto resumed = tls::check_session_is_resumed(c).get();
+
+        in.close().get();
+        out.close().get();
+        s.connection.shutdown_input();
+        s.connection.shutdown_output();
+        return resumed;
+    };
+
+    BOOST_REQUIRE(!connect("test.scylladb.org"));
+    auto st = creds->get_client_session_cache_stats();
+    BOOST_REQUIRE_EQUAL(st.misses, 1);
+    BOOST_REQUIRE_EQUAL(st.full_handshakes, 1);
+    BOOST_REQUIRE_EQUAL(st.entries, 1);
+
+    BOOST_REQUIRE(connect("test.scylladb.org"));
+    st = creds->get_client_session_cache_stats();
+    BOOST_REQUIRE_EQUAL(st.hits, 1);
+    BOOST_REQUIRE_EQUAL(st.resumed_handshakes, 1);
+    // the ticket of the resumed session replaced the used one
+    BOOST_REQUIRE_EQUAL(st.entries, 1);
+
+    // Another server name evicts the session, being over capacity
+    BOOST_REQUIRE(!connect("other.scylladb.org"));
+    BOOST_REQUIRE(!connect("test.scylladb.org"));
+    st = creds->get_client_session_cache_stats();
+    BOOST_REQUIRE_EQUAL(st.misses, 3);
+    BOOST_REQUIRE_EQUAL(st.full_handshakes, 3);
+
+    // A new cache of the same credentials takes the metrics name over,
+    // other credentials can't use it
+    creds->set_client_session_cache({.metrics_name = "test"});
+    creds->set_client_session_cache({.metrics_name = "test"});
+    auto other = b.build_certificate_credentials();
+    BOOST_REQUIRE_THROW(other->set_client_session_cache({.metrics_name = "test"}), std::invalid_argument);
+    other->set_client_session_cache({.metrics_name = "other"});
+}
+
 SEASTAR_THREAD_TEST_CASE(test_tls13_session_tickets_invalidated_by_reload) {
     tls::credentials_builder b;
     tmpdir tmp;
@@ -1747,7 +1885,7 @@ SEASTAR_THREAD_TEST_CASE(test_tls13_session_tickets_invalidated_by_reload) {
     b.set_x509_key_file(cert, key, tls::x509_crt_format::PEM).get();
     b.set_x509_trust_file(certfile("catest.pem"), tls::x509_crt_format::PEM).get();
     b.set_session_resume_mode(tls::session_resume_mode::TLS13_SESSION_TICKET);
-    b.set_priority_string("SECURE128:+SECURE192:-VERS-TLS-ALL:+VERS-TLS1.3");
+    set_tls13_only(b);
 
     auto creds = b.build_certificate_credentials();
     auto serv = b.build_reloadable_server_credentials([&p](const std::unordered_set<sstring>&, std::exception_ptr) {
@@ -1852,6 +1990,216 @@ SEASTAR_THREAD_TEST_CASE(test_tls13_session_tickets_invalidated_by_reload) {
 
 }
 
+// Connects, exchanges some data and returns the session ticket
+static tls::session_data tls13_get_session_ticket(shared_ptr<tls::certificate_credentials> creds, server_socket& server, socket_address addr) {
+    auto sa = server.accept();
+    auto c = tls::connect(creds, addr).get();
+    auto s = sa.get();
+
+    auto in = s.connection.input();
+    auto cin = c.input();
+    output_stream<char> out(c.output().detach(), 1024);
+    output_stream<char> sout(s.connection.output().detach(), 1024);
+
+    // write data in both directions. Required for session data to
+    // become available.
+    out.write("nils").get();
+    auto fin = in.read();
+    auto fout = out.flush();
+    fout.get();
+    fin.get();
+
+    sout.write("banan").get();
+    fin = cin.read();
+    fout = sout.flush();
+    fout.get();
+    fin.get();
+
+    auto sess_data = tls::get_session_resume_data(c).get();
+
+    in.close().get();
+    out.close().get();
+    s.connection.shutdown_input();
+    s.connection.shutdown_output();
+    c.shutdown_input();
+    c.shutdown_output();
+    return sess_data;
+}
+
+// Connects with the session ticket and returns whether the session was resumed
+static bool tls13_try_resume_session(shared_ptr<tls::certificate_credentials> creds, server_socket& server, socket_address addr, const tls::session_data& sess_data) {
+    auto sa = server.accept();
+    tls::tls_options tls_opts;
+    tls_opts.session_resume_data = sess_data;
+    auto c = tls::connect(creds, addr, tls_opts).get();
+    auto s = sa.get();
+
+    auto f = tls::check_session_is_resumed(c);
+    auto in = s.connection.input();
+    output_stream<char> out(c.output().detach(), 1024);
+    auto fin = in.read();
+    out.write("nils").get();
+    auto fout = out.flush();
+    fout.get();
+    fin.get();
+    auto resumed = f.get();
+
+    in.close().get();
+    out.close().get();
+    s.connection.shutdown_input();
+    s.connection.shutdown_output();
+    c.shutdown_input();
+    c.shutdown_output();
+    return resumed;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_tls13_session_tickets_shared_keys) {
+    tls::credentials_builder b;
+
+    b.set_x509_key_file(certfile("test.crt"), certfile("test.key"), tls::x509_crt_format::PEM).get();
+    b.set_x509_trust_file(certfile("catest.pem"), tls::x509_crt_format::PEM).get();
+    set_tls13_only(b);
+
+    auto creds = b.build_certificate_credentials();
+
+    sharded<tls::session_resume_keys> keys;
+    keys.start().get();
+    keys.local().start().get();
+
+    // Built independently, like the credentials of two shards would be
+    auto serv1 = b.build_server_credentials();
+    auto serv2 = b.build_server_credentials();
+    keys.local().add(serv1);
+    keys.local().add(serv2);
+
+    ::listen_options opts;
+    opts.reuse_address = true;
+    opts.set_fixed_cpu(this_shard_id());
+    auto addr = ::make_ipv4_address( {0x7f000001, 4712});
+
+    auto server = tls::listen(serv1, addr, opts);
+    auto sess_data = tls13_get_session_ticket(creds, server, addr);
+    BOOST_REQUIRE(!sess_data.empty());
+
+    server = {};
+    server = tls::listen(serv2, addr, opts);
+    BOOST_REQUIRE(tls13_try_resume_session(creds, server, addr, sess_data));
+
+    keys.local().rotate().get();
+    BOOST_REQUIRE(!tls13_try_resume_session(creds, server, addr, sess_data));
+
+    keys.stop().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_server_handshake_options) {
+    tls::credentials_builder b;
+
+    b.set_x509_key_file(certfile("test.crt"), certfile("test.key"), tls::x509_crt_format::PEM).get();
+    b.set_x509_trust_file(certfile("catest.pem"), tls::x509_crt_format::PEM).get();
+
+    auto creds = b.build_certificate_credentials();
+    auto serv = b.build_server_credentials();
+
+    auto sg = create_scheduling_group("tls_handshakes", 100).get();
+    auto destroy_sg = defer([sg] () noexcept { destroy_scheduling_group(sg).get(); });
+    serv->set_handshake_options({ .sched_group = sg, .max_concurrent = 1, .metrics_name = "test" });
+
+    ::listen_options opts;
+    opts.reuse_address = true;
+    opts.set_fixed_cpu(this_shard_id());
+    auto addr = ::make_ipv4_address( {0x7f000001, 4712});
+    auto server = tls::listen(serv, addr, opts);
+
+    constexpr int nr = 4;
+    std::vector<connected_socket> clients;
+    std::vector<connected_socket> servers;
+    for (int i = 0; i < nr; ++i) {
+        auto sa = server.accept();
+        clients.push_back(tls::connect(creds, addr).get());
+        servers.push_back(sa.get().connection);
+    }
+
+    // Handshakes happen on first IO, all at once, but only one is let run at a time
+    parallel_for_each(std::views::iota(0, nr), [&] (int i) {
+        return do_with(servers[i].input(), clients[i].output(), [] (input_stream<char>& in, output_stream<char>& out) {
+            auto f = in.read();
+            return out.write("nils").then([&out] {
+                return out.flush();
+            }).then([f = std::move(f)] () mutable {
+                return std::move(f);
+            }).then([] (temporary_buffer<char> buf) {
+                BOOST_REQUIRE_EQUAL(sstring(buf.get(), buf.size()), "nils");
+            }).finally([&in, &out] {
+                return when_all(in.close(), out.close()).discard_result();
+            });
+        });
+    }).get();
+
+    auto stats = serv->get_handshake_stats();
+    BOOST_REQUIRE_EQUAL(stats.completed, nr);
+    BOOST_REQUIRE_EQUAL(stats.failed, 0);
+    BOOST_REQUIRE_EQUAL(stats.waiting, 0);
+    BOOST_REQUIRE_EQUAL(stats.active, 0);
+
+    for (int i = 0; i < nr; ++i) {
+        servers[i].shutdown_input();
+        servers[i].shutdown_output();
+        clients[i].shutdown_input();
+        clients[i].shutdown_output();
+    }
+
+    // New options of the same credentials take the metrics name over,
+    // other credentials can't use it
+    serv->set_handshake_options({ .max_concurrent = 2, .metrics_name = "test" });
+    auto other = b.build_server_credentials();
+    BOOST_REQUIRE_THROW(other->set_handshake_options({ .metrics_name = "test" }), std::invalid_argument);
+    other->set_handshake_options({ .metrics_name = "other" });
+}
+
+SEASTAR_THREAD_TEST_CASE(test_fragmented_packet_write) {
+    tls::credentials_builder b;
+
+    b.set_x509_key_file(certfile("test.crt"), certfile("test.key"), tls::x509_crt_format::PEM).get();
+    b.set_x509_trust_file(certfile("catest.pem"), tls::x509_crt_format::PEM).get();
+
+    auto creds = b.build_certificate_credentials();
+    auto serv = b.build_server_credentials();
+
+    ::listen_options opts;
+    opts.reuse_address = true;
+    opts.set_fixed_cpu(this_shard_id());
+    auto addr = ::make_ipv4_address( {0x7f000001, 4712});
+    auto server = tls::listen(serv, addr, opts);
+
+    auto sa = server.accept();
+    auto c = tls::connect(creds, addr).get();
+    auto s = sa.get().connection;
+
+    // Many small fragments, more data than fits a single write batch
+    net::packet p;
+    sstring expected;
+    for (int i = 0; p.len() < 300 * 1024; ++i) {
+        auto frag = format("fragment {};", i);
+        expected += frag;
+        p = net::packet(std::move(p), temporary_buffer<char>(frag.data(), frag.size()));
+    }
+
+    auto in = s.input();
+    auto out = c.output();
+    auto fin = in.read_exactly(expected.size());
+    out.write(std::move(p)).get();
+    out.flush().get();
+    auto buf = fin.get();
+    BOOST_REQUIRE(sstring(buf.get(), buf.size()) == expected);
+
+    out.close().get();
+    in.close().get();
+    s.shutdown_input();
+    s.shutdown_output();
+    c.shutdown_input();
+    c.shutdown_output();
+}
+
 SEASTAR_THREAD_TEST_CASE(test_reload_certificates_with_only_shard0_notify) {
     tmpdir tmp;
 
@@ -0,0 +1,150 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2017 ScyllaDB Ltd.
+ */
+
+
+#include <vector>
+
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/tracing.hh>
+#include <seastar/testing/test_case.hh>
+#include <seastar/util/later.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+namespace {
+
+struct collecting_sink : tracing::span_sink {
+    std::vector<tracing::span_data> spans;
+    void consume(tracing::span_data&& s) noexcept override {
+        spans.push_back(std::move(s));
+    }
+};
+
+}
+
+SEASTAR_TEST_CASE(test_traceparent) {
+    auto tp = "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01";
+    auto ctx = tracing::trace_context::from_traceparent(tp);
+    BOOST_REQUIRE(ctx);
+    BOOST_REQUIRE(ctx->sampled());
+    BOOST_REQUIRE_EQUAL(ctx->trace_id[0], 0x4b);
+    BOOST_REQUIRE_EQUAL(ctx->span_id[7], 0xb7);
+    BOOST_REQUIRE_EQUAL(ctx->traceparent(), tp);
+
+    char buf[tracing::trace_context::serialized_size];
+    ctx->write(buf);
+    BOOST_REQUIRE(tracing::trace_context::read(buf) == ctx);
+
+    // Future versions may append fields
+    BOOST_REQUIRE(tracing::trace_context::from_traceparent("01-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00-x"));
+    for (auto bad : {
+            "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01-x",
+            "ff-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01",
+            "00-4BF92F3577B34DA6A3CE929D0E0E4736-00f067aa0ba902b7-01",
+            "00-00000000000000000000000000000000-00f067aa0ba902b7-01",
+            "00-4bf92f3577b34da6a3ce929d0e0e4736-0000000000000000-01",
+            "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7",
+            ""}) {
+        BOOST_REQUIRE(!tracing::trace_context::from_traceparent(bad));
+    }
+    return make_ready_future();
+}
+
+SEASTAR_TEST_CASE(test_span_propagation) {
+    auto sink = make_shared<collecting_sink>();
+    tracing::set_span_sink(sink);
+    auto parent = tracing::trace_context::from_traceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01");
+    BOOST_REQUIRE(!tracing::current_context());
+
+    tracing::span s("outer", parent);
+    auto ctx = s.context();
+    BOOST_REQUIRE(ctx.trace_id == parent->trace_id);
+    BOOST_REQUIRE(ctx.span_id != parent->span_id);
+
+    co_await tracing::with_span(std::move(s), [&ctx] () -> future<> {
+        BOOST_REQUIRE(tracing::current_context() && *tracing::current_context() == ctx);
+        co_await sleep(1ms);
+        BOOST_REQUIRE(tracing::current_context() && *tracing::current_context() == ctx);
+        tracing::set_attribute("key", "value");
+        co_await tracing::with_span(tracing::span("inner"), [&ctx] {
+            return yield().then([&ctx] {
+                auto inner = tracing::current_context();
+                BOOST_REQUIRE(inner && inner->trace_id == ctx.trace_id && inner->span_id != ctx.span_id);
+                throw std::runtime_error("inner");
+            });
+        }).handle_exception([] (auto) {});
+        BOOST_REQUIRE(tracing::current_context() && *tracing::current_context() == ctx);
+    });
+    // Tasks created outside of the span don't see it
+    co_await yield();
+    BOOST_REQUIRE(!tracing::current_context());
+
+    BOOST_REQUIRE_EQUAL(sink->spans.size(), 2);
+    auto& inner = sink->spans[0];
+    auto& outer = sink->spans[1];
+    BOOST_REQUIRE_EQUAL(inner.name, "inner");
+    BOOST_REQUIRE(inner.failed);
+    BOOST_REQUIRE(inner.parent_span_id == ctx.span_id);
+    BOOST_REQUIRE_EQUAL(outer.name, "outer");
+    BOOST_REQUIRE(!outer.failed);
+    BOOST_REQUIRE(outer.context == ctx);
+    BOOST_REQUIRE(outer.parent_span_id == parent->span_id);
+    BOOST_REQUIRE_EQUAL(outer.attributes.size(), 1);
+    BOOST_REQUIRE(outer.end >= outer.start + 1ms);
+    tracing::set_span_sink(nullptr);
+}
+
+SEASTAR_TEST_CASE(test_root_sampling) {
+    auto sink = make_shared<collecting_sink>();
+    tracing::set_span_sink(sink);
+    tracing::set_root_sampling_probability(0);
+    tracing::span("not sampled").end();
+    tracing::set_root_sampling_probability(1);
+    tracing::span("sampled").end();
+    tracing::set_root_sampling_probability(0);
+    BOOST_REQUIRE_EQUAL(sink->spans.size(), 1);
+    BOOST_REQUIRE_EQUAL(sink->spans[0].name, "sampled");
+    BOOST_REQUIRE(sink->spans[0].parent_span_id == tracing::trace_context::span_id_type{});
+    tracing::set_span_sink(nullptr);
+    return make_ready_future();
+}
+
+SEASTAR_TEST_CASE(test_span_slot_reuse) {
+    promise<> p;
+    future<bool> saw_span = make_ready_future<bool>(false);
+    co_await tracing::with_span(tracing::span("ended"), [&] {
+        saw_span = p.get_future().then([] {
+            return tracing::current_context() != nullptr;
+        });
+        return make_ready_future();
+    });
+    // One of these takes the slot of the span which ended
+    std::vector<tracing::span> live;
+    for (int i = 0; i < 100; ++i) {
+        live.emplace_back("live");
+        tracing::exit_span(tracing::enter_span(live.back()));
+    }
+    // A task of the ended span must not run in the span reusing its slot
+    p.set_value();
+    BOOST_REQUIRE(!co_await std::move(saw_span));
+}
@@ -0,0 +1,79 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/core/internal/tsc_clock.hh>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+static bool calibrate() {
+    if (!internal::tsc_supported()) {
+        BOOST_TEST_MESSAGE("The CPU counter is not a usable clock source, skipping");
+        return false;
+    }
+    internal::tsc_resync();
+    std::this_thread::sleep_for(10ms);
+    internal::tsc_resync();
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(test_tsc_clock_calibration) {
+    if (!calibrate()) {
+        return;
+    }
+    std::this_thread::sleep_for(100ms);
+    internal::tsc_resync();
+    auto tsc0 = internal::tsc_now();
+    auto steady0 = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(100ms);
+    auto tsc_elapsed = internal::tsc_now() - tsc0;
+    auto steady_elapsed = std::chrono::steady_clock::now() - steady0;
+    // the rate measured over the first 100ms is within 1% of the actual one
+    BOOST_REQUIRE_LT(std::abs((tsc_elapsed - steady_elapsed).count()), (steady_elapsed / 100).count());
+    // and the clocks are together
+    BOOST_REQUIRE_LT(std::abs((internal::tsc_now() - std::chrono::steady_clock::now()).count()), std::chrono::steady_clock::duration(1ms).count());
+}
+
+BOOST_AUTO_TEST_CASE(test_tsc_clock_monotonic) {
+    if (!calibrate()) {
+        return;
+    }
+    // resyncs, which move the clock towards steady_clock, don't make it go back
+    auto last = internal::tsc_now();
+    for (int i = 0; i < 50; ++i) {
+        auto end = std::chrono::steady_clock::now() + 2ms;
+        while (std::chrono::steady_clock::now() < end) {
+            auto now = internal::tsc_now();
+            BOOST_REQUIRE(now >= last);
+            last = now;
+        }
+        internal::tsc_resync();
+        auto now = internal::tsc_now();
+        BOOST_REQUIRE(now >= last);
+        last = now;
+    }
+}
@@ -0,0 +1,241 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+// Exercises the optional request paths of the io_uring backend. The test is
+// run with the options enabling them (see CMakeLists.txt), which the other
+// backends ignore, so it passes wherever io_uring is not available too.
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/core/aligned_buffer.hh>
+#include <seastar/core/file.hh>
+#include <seastar/core/metrics_api.hh>
+#include <seastar/core/seastar.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/net/api.hh>
+#include <seastar/net/inet_address.hh>
+#include <seastar/util/closeable.hh>
+#include <seastar/util/defer.hh>
+#include <seastar/util/tmp_file.hh>
+
+#include <cstring>
+#include <sys/mman.h>
+
+using namespace seastar;
+
+static void fill(char* buf, size_t size, char seed) {
+    for (size_t i = 0; i < size; ++i) {
+        buf[i] = char(seed + i * 7);
+    }
+}
+
+// Writes buf at pos and reads it back into a buffer of the seastar heap
+static void check_roundtrip(file& f, uint64_t pos, char* buf, size_t size) {
+    BOOST_REQUIRE_EQUAL(f.dma_write(pos, buf, size).get(), size);
+    auto rbuf = allocate_aligned_buffer<char>(size, 4096);
+    BOOST_REQUIRE_EQUAL(f.dma_read(pos, rbuf.get(), size).get(), size);
+    BOOST_REQUIRE(std::memcmp(rbuf.get(), buf, size) == 0);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_fixed_buffers_io) {
+    tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto f = open_file_dma((t.get_path() / "file").native(), open_flags::rw | open_flags::create).get();
+        auto close_f = deferred_close(f);
+
+        // Seastar memory, covered by the registered buffers
+        char seed = 0;
+        for (size_t size : {4096, 128 << 10, 4 << 20}) {
+            auto buf = allocate_aligned_buffer<char>(size, 4096);
+            fill(buf.get(), size, ++seed);
+            check_roundtrip(f, 0, buf.get(), size);
+        }
+
+        // Memory from outside the seastar heap falls back to plain requests
+        constexpr size_t size = 64 << 10;
+        auto mem = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        BOOST_REQUIRE(mem != MAP_FAILED);
+        auto unmap = defer([mem] () noexcept { ::munmap(mem, size); });
+        auto out = static_cast<char*>(mem);
+        fill(out, size, ++seed);
+        check_roundtrip(f, 8 << 20, out, size);
+        // and reads into it too, here of what the last seastar buffer wrote
+        std::memset(out, 0, size);
+        BOOST_REQUIRE_EQUAL(f.dma_read(0, out, size).get(), size);
+        auto expected = allocate_aligned_buffer<char>(size, 4096);
+        fill(expected.get(), size, 3);
+        BOOST_REQUIRE(std::memcmp(out, expected.get(), size) == 0);
+    }).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_fixed_files_shared_descriptor) {
+    tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto path = (t.get_path() / "file").native();
+        auto buf = allocate_aligned_buffer<char>(4096, 4096);
+
+        // A dup()ed file shares the descriptor, which stays registered
+        // until the last of them is closed
+        auto f = open_file_dma(path, open_flags::rw | open_flags::create).get();
+        auto g = f.dup().to_file();
+        fill(buf.get(), 4096, 1);
+        check_roundtrip(f, 0, buf.get(), 4096);
+        f.close().get();
+        fill(buf.get(), 4096, 2);
+        check_roundtrip(g, 4096, buf.get(), 4096);
+        g.close().get();
+
+        // The next files likely get the descriptor, and the slot, back
+        for (int i = 0; i < 3; ++i) {
+            auto h = open_file_dma(path, open_flags::rw).get();
+            auto close_h = deferred_close(h);
+            fill(buf.get(), 4096, 3 + i);
+            check_roundtrip(h, 8192 * i, buf.get(), 4096);
+        }
+    }).get();
+}
+
+// Only registered when the ring was created with a polling thread
+static std::optional<uint64_t> sqpoll_wakeups() {
+    const auto& values = metrics::impl::get_value_map();
+    auto mf = values.find("reactor_io_uring_sqpoll_wakeups");
+    if (mf == values.end() || mf->second.empty()) {
+        return std::nullopt;
+    }
+    return mf->second.begin()->second->get_function()().ui();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_sqpoll_wakeups) {
+    if (!sqpoll_wakeups()) {
+        fmt::print("No io_uring polling thread, skipping\n");
+        return;
+    }
+    tmp_dir::do_with_thread([] (tmp_dir& t) {
+        auto f = open_file_dma((t.get_path() / "file").native(), open_flags::rw | open_flags::create).get();
+        auto close_f = deferred_close(f);
+        auto buf = allocate_aligned_buffer<char>(4096, 4096);
+        for (int i = 0; i < 3; ++i) {
+            // Long past --io-uring-sqpoll-idle-ms, so the polling thread
+            // is asleep and the submission has to wake it up
+            auto before = *sqpoll_wakeups();
+            seastar::sleep(std::chrono::milliseconds(100)).get();
+            fill(buf.get(), 4096, i);
+            check_roundtrip(f, 4096 * i, buf.get(), 4096);
+            BOOST_REQUIRE_GT(*sqpoll_wakeups(), before);
+        }
+    }).get();
+}
+
+static constexpr size_t stream_chunk = 64 << 10;
+
+static future<> send_stream(connected_socket s, size_t size, char seed) {
+    auto out = s.output();
+    std::vector<char> chunk(stream_chunk);
+    for (size_t off = 0; off < size; off += chunk.size()) {
+        fill(chunk.data(), chunk.size(), char(seed + off / chunk.size()));
+        co_await out.write(chunk.data(), chunk.size());
+    }
+    co_await out.flush();
+    co_await out.close();
+}
+
+// Reads until EOF, checking the data send_stream() wrote
+static future<size_t> recv_stream(connected_socket s, char seed, std::chrono::milliseconds stall = {}) {
+    auto in = s.input();
+    std::vector<char> expected(stream_chunk);
+    size_t off = 0;
+    while (auto buf = co_await in.read()) {
+        if (stall.count() && off == 0) {
+            // Let the data pile up past the receive backlog
+            co_await seastar::sleep(stall);
+        }
+        for (size_t i = 0; i < buf.size(); ++i, ++off) {
+            if (off % stream_chunk == 0) {
+                fill(expected.data(), expected.size(), char(seed + off / stream_chunk));
+            }
+            if (buf[i] != expected[off % stream_chunk]) {
+                BOOST_FAIL(fmt::format("Mismatch at offset {}", off));
+            }
+        }
+    }
+    co_await in.close();
+    co_return off;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_multishot_accept_and_recv) {
+    auto listener = seastar::listen(socket_address(ipv4_addr("127.0.0.1", 0)), listen_options{.reuse_address = true});
+    auto addr = listener.local_address();
+    constexpr unsigned nr_conns = 16;
+    // Past the receive backlog, and together far more than the provided
+    // buffers hold, so they are recycled
+    constexpr size_t size = 2 << 20;
+
+    // Connections come in faster than they are accepted
+    std::vector<future<>> senders;
+    for (unsigned i = 0; i < nr_conns; ++i) {
+        senders.push_back(seastar::connect(addr).then([] (connected_socket s) {
+            return send_stream(std::move(s), size, 1);
+        }));
+    }
+    std::vector<future<size_t>> receivers;
+    for (unsigned i = 0; i < nr_conns; ++i) {
+        auto ar = listener.accept().get();
+        BOOST_REQUIRE_EQUAL(ar.remote_address.addr(), addr.addr());
+        // One slow reader, whose receive is cancelled and re-armed
+        auto stall = std::chrono::milliseconds(i == 0 ? 200 : 0);
+        receivers.push_back(recv_stream(std::move(ar.connection), 1, stall));
+    }
+    for (auto& r : when_all_succeed(receivers.begin(), receivers.end()).get()) {
+        BOOST_REQUIRE_EQUAL(r, size);
+    }
+    when_all_succeed(senders.begin(), senders.end()).get();
+
+    // A pending accept is failed by abort_accept()
+    auto f = listener.accept();
+    listener.abort_accept();
+    BOOST_REQUIRE_THROW(f.get(), std::exception);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_multishot_recv_dropped_socket) {
+    auto listener = seastar::listen(socket_address(ipv4_addr("127.0.0.1", 0)), listen_options{.reuse_address = true});
+    auto addr = listener.local_address();
+
+    // The socket is closed while its receive is armed and data is queued
+    auto sender = seastar::connect(addr).then([] (connected_socket s) {
+        return send_stream(std::move(s), 1 << 20, 1).handle_exception([] (std::exception_ptr) {
+            // The peer may reset the connection
+        });
+    });
+    {
+        auto s = listener.accept().get().connection;
+        auto in = s.input();
+        BOOST_REQUIRE(!in.read().get().empty());
+        in.close().get();
+    }
+    sender.get();
+
+    // and the next connection is served as usual
+    auto sender2 = seastar::connect(addr).then([] (connected_socket s) {
+        return send_stream(std::move(s), 1 << 20, 2);
+    });
+    BOOST_REQUIRE_EQUAL(recv_stream(listener.accept().get().connection, 2).get(), 1 << 20);
+    sender2.get();
+}
@@ -0,0 +1,82 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/net/virtio.hh>
+#include <seastar/net/virtio-interface.hh>
+
+using namespace seastar;
+
+static net::hw_features all_offloads() {
+    net::hw_features hw;
+    hw.tx_csum_l4_offload = true;
+    hw.rx_csum_offload = true;
+    hw.rx_lro = true;
+    hw.tx_tso = true;
+    hw.tx_ufo = true;
+    return hw;
+}
+
+static constexpr uint64_t all_features = VIRTIO_NET_F_CSUM | VIRTIO_NET_F_GUEST_CSUM
+        | VIRTIO_NET_F_HOST_TSO4 | VIRTIO_NET_F_GUEST_TSO4 | VIRTIO_NET_F_HOST_UFO;
+
+BOOST_AUTO_TEST_CASE(test_all_offloads_negotiated) {
+    auto hw = virtio::negotiated_hw_features(all_offloads(), all_features);
+    BOOST_REQUIRE(hw.tx_csum_l4_offload);
+    BOOST_REQUIRE(hw.rx_csum_offload);
+    BOOST_REQUIRE(hw.rx_lro);
+    BOOST_REQUIRE(hw.tx_tso);
+    BOOST_REQUIRE(hw.tx_ufo);
+}
+
+BOOST_AUTO_TEST_CASE(test_host_without_tso) {
+    auto hw = virtio::negotiated_hw_features(all_offloads(), all_features & ~uint64_t(VIRTIO_NET_F_HOST_TSO4));
+    BOOST_REQUIRE(!hw.tx_tso);
+    BOOST_REQUIRE(hw.tx_csum_l4_offload);
+    BOOST_REQUIRE(hw.tx_ufo);
+    BOOST_REQUIRE(hw.rx_lro);
+}
+
+BOOST_AUTO_TEST_CASE(test_segmentation_needs_checksum_offload) {
+    auto hw = virtio::negotiated_hw_features(all_offloads(), all_features & ~uint64_t(VIRTIO_NET_F_CSUM));
+    BOOST_REQUIRE(!hw.tx_csum_l4_offload);
+    BOOST_REQUIRE(!hw.tx_tso);
+    BOOST_REQUIRE(!hw.tx_ufo);
+    // The receive side only depends on what the guest accepts
+    BOOST_REQUIRE(hw.rx_csum_offload);
+    BOOST_REQUIRE(hw.rx_lro);
+}
+
+BOOST_AUTO_TEST_CASE(test_offloads_are_never_added) {
+    // Turned off on the command line, they stay off whatever the host says
+    net::hw_features none;
+    auto hw = virtio::negotiated_hw_features(none, all_features);
+    BOOST_REQUIRE(!hw.tx_csum_l4_offload);
+    BOOST_REQUIRE(!hw.rx_csum_offload);
+    BOOST_REQUIRE(!hw.rx_lro);
+    BOOST_REQUIRE(!hw.tx_tso);
+    BOOST_REQUIRE(!hw.tx_ufo);
+
+    hw = virtio::negotiated_hw_features(all_offloads(), 0);
+    BOOST_REQUIRE(!hw.tx_csum_l4_offload && !hw.rx_csum_offload && !hw.rx_lro && !hw.tx_tso && !hw.tx_ufo);
+}
@@ -3,12 +3,15 @@
  */
 
 #include <seastar/websocket/server.hh>
+#include <seastar/websocket/client.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
 #include <seastar/http/response_parser.hh>
 #include <seastar/util/defer.hh>
 #include "loopback_socket.hh"
 
+#include <zlib.h>
+
 using namespace seastar;
 using namespace seastar::experimental;
 using namespace std::literals::string_view_literals;
@@ -227,6 +230,7 @@ SEASTAR_TEST_CASE(test_websocket_parser_split) {
             input_stream<char> in{data_source{std::move(source)}};
 
             std::vector<sstring> results;
+            sstring frame;
 
             while (true) {
                 in.consume(parser).get();
@@ -235,7 +239,11 @@ SEASTAR_TEST_CASE(test_websocket_parser_split) {
                 }
 
                 SEASTAR_ASSERT(parser.is_valid());
-                results.push_back(seastar::to_sstring(parser.result()));
+                // Frames split over buffers are handed out in chunks
+                frame += seastar::to_sstring(parser.result());
+                if (parser.end_of_frame()) {
+                    results.push_back(std::exchange(frame, {}));
+                }
             }
 
             SEASTAR_ASSERT(!parser.is_valid());
@@ -251,3 +259,297 @@ SEASTAR_TEST_CASE(test_websocket_parser_split) {
         }
     });
 }
+
+SEASTAR_TEST_CASE(test_websocket_parser_masked_split) {
+    return seastar::async([] {
+        std::string payload;
+        for (unsigned i = 0; i < 300; ++i) {
+            payload.push_back('a' + i % 26);
+        }
+        const char key[] = "\x12\x34\x56\x78";
+        std::string ws_frame = std::string(
+            "\x82\xfe"  // FIN, opcode, mask, 16 bit payload length
+            "\x01\x2c", // payload len (300)
+            4) + std::string(key, 4);
+        for (unsigned i = 0; i < payload.size(); ++i) {
+            ws_frame.push_back(payload[i] ^ key[i % 4]);
+        }
+
+        for (unsigned split_i = 1; split_i < ws_frame.size(); split_i += 7) {
+            websocket::websocket_parser parser;
+            auto source = std::make_unique<test_source_impl>();
+            source->push_back(ws_frame.substr(0, split_i));
+            source->push_back(ws_frame.substr(split_i));
+            input_stream<char> in{data_source{std::move(source)}};
+
+            std::string result;
+            while (true) {
+                in.consume(parser).get();
+                if (parser.eof()) {
+                    break;
+                }
+                SEASTAR_ASSERT(parser.is_valid());
+                auto chunk = parser.result();
+                result.append(chunk.get(), chunk.size());
+                BOOST_REQUIRE(!parser.end_of_frame() || result.size() == payload.size());
+            }
+            BOOST_REQUIRE_EQUAL(result, payload);
+        }
+    });
+}
+
+SEASTAR_TEST_CASE(test_websocket_apply_mask) {
+    const uint32_t key = 0x12345678;
+    for (size_t n = 0; n < 100; ++n) {
+        for (uint64_t offset = 0; offset < 4; ++offset) {
+            std::string data(n, 'x');
+            websocket::apply_mask(data.data(), data.size(), key, offset);
+            for (size_t i = 0; i < n; ++i) {
+                char k = key >> (24 - 8 * ((offset + i) % 4));
+                BOOST_REQUIRE_EQUAL(data[i], char('x' ^ k));
+            }
+        }
+    }
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_websocket_permessage_deflate) {
+    return seastar::async([] {
+        loopback_connection_factory factory;
+        loopback_socket_impl lsi(factory);
+
+        auto acceptor = factory.get_server_socket().accept();
+        auto connector = lsi.connect(socket_address(), socket_address());
+        connected_socket sock = connector.get();
+        auto input = sock.input();
+        auto output = sock.output();
+
+        websocket::server ws;
+        ws.enable_permessage_deflate();
+        ws.register_handler("echo", [] (input_stream<char>& in, output_stream<char>& out) {
+            return repeat([&in, &out]() {
+                return in.read().then([&out](temporary_buffer<char> f) {
+                    if (f.empty()) {
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
+                    }
+                    return out.write(std::move(f)).then([&out]() {
+                        return out.flush().then([] {
+                            return make_ready_future<stop_iteration>(stop_iteration::no);
+                        });
+                    });
+                });
+            });
+        });
+        websocket::server_connection conn(ws, acceptor.get().connection);
+        future<> serve = conn.process();
+        auto close = defer([&conn, &input, &output, &serve] () noexcept {
+            conn.close().get();
+            input.close().get();
+            output.close().get();
+            serve.get();
+        });
+
+        auto request = build_request("dGhlIHNhbXBsZSBub25jZQ==", "echo");
+        request.insert(request.size() - 2, "Sec-WebSocket-Extensions: x-unknown, permessage-deflate; client_max_window_bits\r\n");
+        output.write(request).get();
+        output.flush().get();
+
+        http_response_parser parser;
+        parser.init();
+        input.consume(parser).get();
+        std::unique_ptr<http::reply> resp = parser.get_parsed_response();
+        SEASTAR_ASSERT(resp);
+        BOOST_REQUIRE_EQUAL(resp->get_header("Sec-WebSocket-Extensions"), "permessage-deflate");
+
+        std::string message;
+        for (int i = 0; i < 100; ++i) {
+            message += "{\"event\":\"update\",\"value\":42}";
+        }
+
+        // Compress the message the way a client does
+        z_stream zs = {};
+        BOOST_REQUIRE_EQUAL(deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY), Z_OK);
+        std::string compressed(message.size() + 64, '\0');
+        zs.next_in = reinterpret_cast<Bytef*>(message.data());
+        zs.avail_in = message.size();
+        zs.next_out = reinterpret_cast<Bytef*>(compressed.data());
+        zs.avail_out = compressed.size();
+        BOOST_REQUIRE_EQUAL(deflate(&zs, Z_SYNC_FLUSH), Z_OK);
+        compressed.resize(compressed.size() - zs.avail_out - 4);
+        deflateEnd(&zs);
+        BOOST_REQUIRE_LT(compressed.size(), 126);
+
+        const char key[] = "\x01\x02\x03\x04";
+        std::string ws_frame = "\xc2"; // FIN, RSV1, BINARY
+        ws_frame.push_back(char(0x80 | compressed.size()));
+        ws_frame.append(key, 4);
+        for (size_t i = 0; i < compressed.size(); ++i) {
+            ws_frame.push_back(compressed[i] ^ key[i % 4]);
+        }
+        output.write(ws_frame).get();
+        output.flush().get();
+
+        // The echo comes back compressed as well
+        auto header = input.read_exactly(2).get();
+        BOOST_REQUIRE_EQUAL(uint8_t(header[0]), 0xc2);
+        BOOST_REQUIRE_LT(uint8_t(header[1]), 126);
+        auto reply = input.read_exactly(uint8_t(header[1])).get();
+        std::string inflated(message.size(), '\0');
+        std::string reply_data(reply.get(), reply.size());
+        reply_data += std::string("\x00\x00\xff\xff", 4);
+        BOOST_REQUIRE_EQUAL(inflateInit2(&zs, -MAX_WBITS), Z_OK);
+        zs.next_in = reinterpret_cast<Bytef*>(reply_data.data());
+        zs.avail_in = reply_data.size();
+        zs.next_out = reinterpret_cast<Bytef*>(inflated.data());
+        zs.avail_out = inflated.size();
+        inflate(&zs, Z_SYNC_FLUSH);
+        BOOST_REQUIRE_EQUAL(zs.avail_out, 0);
+        inflateEnd(&zs);
+        BOOST_REQUIRE_EQUAL(inflated, message);
+    });
+}
+
+SEASTAR_TEST_CASE(test_websocket_broadcast) {
+    return seastar::async([] {
+        loopback_connection_factory factory;
+        loopback_socket_impl lsi(factory);
+
+        websocket::server ws;
+        ws.enable_permessage_deflate();
+        ws.register_handler("echo", [] (input_stream<char>& in, output_stream<char>& out) {
+            return repeat([&in] {
+                return in.read().then([] (temporary_buffer<char> f) {
+                    return f.empty() ? stop_iteration::yes : stop_iteration::no;
+                });
+            });
+        });
+
+        // One client offers permessage-deflate, the other doesn't
+        struct peer {
+            connected_socket sock;
+            input_stream<char> input;
+            output_stream<char> output;
+            std::unique_ptr<websocket::server_connection> conn;
+            future<> serve = make_ready_future<>();
+        };
+        std::vector<peer> peers(2);
+        for (size_t i = 0; i < peers.size(); ++i) {
+            auto& p = peers[i];
+            auto acceptor = factory.get_server_socket().accept();
+            p.sock = lsi.connect(socket_address(), socket_address()).get();
+            p.input = p.sock.input();
+            p.output = p.sock.output();
+            p.conn = std::make_unique<websocket::server_connection>(ws, acceptor.get().connection);
+            p.serve = p.conn->process();
+
+            auto request = build_request("dGhlIHNhbXBsZSBub25jZQ==", "echo");
+            if (i == 0) {
+                request.insert(request.size() - 2, "Sec-WebSocket-Extensions: permessage-deflate\r\n");
+            }
+            p.output.write(request).get();
+            p.output.flush().get();
+            http_response_parser parser;
+            parser.init();
+            p.input.consume(parser).get();
+            BOOST_REQUIRE(parser.get_parsed_response());
+        }
+        auto close = defer([&peers] () noexcept {
+            for (auto& p : peers) {
+                p.conn->close().get();
+                p.input.close().get();
+                p.output.close().get();
+                p.serve.get();
+            }
+        });
+
+        std::string message;
+        for (int i = 0; i < 100; ++i) {
+            message += "{\"event\":\"update\",\"value\":42}";
+        }
+        websocket::broadcast_frame frame(websocket::opcodes::TEXT, temporary_buffer<char>::copy_of(message), ws.deflate_options());
+        BOOST_REQUIRE(frame.compressed());
+        // Twice, so that the second message is compressed from an empty window as well
+        ws.broadcast(frame.share()).get();
+        ws.broadcast(frame.share()).get();
+
+        for (int n = 0; n < 2; ++n) {
+            auto header = peers[0].input.read_exactly(2).get();
+            BOOST_REQUIRE_EQUAL(uint8_t(header[0]), 0xc1);
+            BOOST_REQUIRE_LT(uint8_t(header[1]), 126);
+            auto reply = peers[0].input.read_exactly(uint8_t(header[1])).get();
+            std::string reply_data(reply.get(), reply.size());
+            reply_data += std::string("\x00\x00\xff\xff", 4);
+            std::string inflated(message.size(), '\0');
+            z_stream zs = {};
+            BOOST_REQUIRE_EQUAL(inflateInit2(&zs, -MAX_WBITS), Z_OK);
+            zs.next_in = reinterpret_cast<Bytef*>(reply_data.data());
+            zs.avail_in = reply_data.size();
+            zs.next_out = reinterpret_cast<Bytef*>(inflated.data());
+            zs.avail_out = inflated.size();
+            inflate(&zs, Z_SYNC_FLUSH);
+            BOOST_REQUIRE_EQUAL(zs.avail_out, 0);
+            inflateEnd(&zs);
+            BOOST_REQUIRE_EQUAL(inflated, message);
+
+            auto plain = peers[1].input.read_exactly(frame.size()).get();
+            BOOST_REQUIRE_EQUAL(uint8_t(plain[0]), 0x81);
+            BOOST_REQUIRE_EQUAL(uint8_t(plain[1]), 0x7e);
+            BOOST_REQUIRE_EQUAL(std::string(plain.get() + 4, plain.size() - 4), message);
+        }
+    });
+}
+
+SEASTAR_TEST_CASE(test_websocket_client) {
+    return seastar::async([] {
+        loopback_connection_factory factory;
+        loopback_socket_impl lsi(factory);
+
+        auto acceptor = factory.get_server_socket().accept();
+        auto connector = lsi.connect(socket_address(), socket_address());
+
+        websocket::server ws;
+        ws.register_handler("echo", [] (input_stream<char>& in, output_stream<char>& out) {
+            return repeat([&in, &out]() {
+                return in.read().then([&out](temporary_buffer<char> f) {
+                    if (f.empty()) {
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
+                    }
+                    return out.write(std::move(f)).then([&out]() {
+                        return out.flush().then([] {
+                            return make_ready_future<stop_iteration>(stop_iteration::no);
+                        });
+                    });
+                });
+            });
+        });
+        websocket::server_connection server_conn(ws, acceptor.get().connection);
+        future<> serve = server_conn.process();
+
+        std::vector<sstring> replies;
+        websocket::client_connection client_conn(connector.get(), "localhost", "/", "echo",
+                [&replies] (input_stream<char>& in, output_stream<char>& out) -> future<> {
+            // long enough for a 16 bit payload length
+            const sstring messages[] = { "hello", sstring(300, 'x') };
+            for (auto& message : messages) {
+                co_await out.write(message);
+                co_await out.flush();
+                sstring reply;
+                while (reply.size() < message.size()) {
+                    auto buf = co_await in.read();
+                    if (buf.empty()) {
+                        co_return;
+                    }
+                    reply += to_sstring(std::move(buf));
+                }
+                replies.push_back(std::move(reply));
+            }
+        });
+        // Returning from the handler closes the connection on both ends
+        client_conn.process().get();
+        serve.get();
+
+        BOOST_REQUIRE_EQUAL(replies.size(), 2);
+        BOOST_REQUIRE_EQUAL(replies[0], "hello");
+        BOOST_REQUIRE_EQUAL(replies[1], sstring(300, 'x'));
+    });
+}
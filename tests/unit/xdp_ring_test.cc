@@ -0,0 +1,113 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include "net/xdp_ring.hh"
+
+using namespace seastar;
+
+// Plays the kernel's side of a ring, over memory laid out like its mapping
+struct fake_ring {
+    static constexpr uint32_t size = 8;
+    static constexpr xdp_ring_offset off = {.producer = 0, .consumer = 64, .desc = 192, .flags = 128};
+    char* mem;
+    xdp::ring<uint64_t> r;
+
+    explicit fake_ring(uint32_t start) : fake_ring(mmap_anonymous(nullptr, off.desc + size * sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_PRIVATE), start) {}
+    fake_ring(mmap_area map, uint32_t start) : mem(map.get()), r(started_at(std::move(map), start), off, size) {}
+
+    static mmap_area started_at(mmap_area map, uint32_t start) {
+        *reinterpret_cast<uint32_t*>(map.get() + off.producer) = start;
+        *reinterpret_cast<uint32_t*>(map.get() + off.consumer) = start;
+        return map;
+    }
+    uint32_t& producer() { return *reinterpret_cast<uint32_t*>(mem + off.producer); }
+    uint32_t& consumer() { return *reinterpret_cast<uint32_t*>(mem + off.consumer); }
+    uint32_t& flags() { return *reinterpret_cast<uint32_t*>(mem + off.flags); }
+    uint64_t desc(uint32_t idx) { return reinterpret_cast<uint64_t*>(mem + off.desc)[idx % size]; }
+    void set_desc(uint32_t idx, uint64_t v) { reinterpret_cast<uint64_t*>(mem + off.desc)[idx % size] = v; }
+};
+
+// The indexes are free running, so they are also tested across the wrap
+// around of uint32_t
+static const uint32_t starts[] = {0, 5, uint32_t(-3)};
+
+BOOST_AUTO_TEST_CASE(test_producer_side) {
+    for (auto start : starts) {
+        fake_ring f(start);
+        BOOST_REQUIRE_EQUAL(f.r.prod(), start);
+        // No more than the ring holds
+        BOOST_REQUIRE_EQUAL(f.r.reserve(10), fake_ring::size);
+        for (uint32_t i = 0; i < 6; ++i) {
+            f.r[f.r.prod() + i] = 100 + i;
+        }
+        f.r.submit(6);
+        BOOST_REQUIRE_EQUAL(f.producer(), start + 6);
+        for (uint32_t i = 0; i < 6; ++i) {
+            BOOST_REQUIRE_EQUAL(f.desc(start + i), 100 + i);
+        }
+        BOOST_REQUIRE_EQUAL(f.r.reserve(4), 2);
+
+        // Room is made as the kernel consumes
+        f.consumer() = start + 4;
+        BOOST_REQUIRE_EQUAL(f.r.reserve(8), 6);
+        f.r[f.r.prod()] = 200;
+        f.r.submit(1);
+        BOOST_REQUIRE_EQUAL(f.producer(), start + 7);
+        BOOST_REQUIRE_EQUAL(f.desc(start + 6), 200);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_consumer_side) {
+    for (auto start : starts) {
+        fake_ring f(start);
+        BOOST_REQUIRE_EQUAL(f.r.peek(64), 0);
+
+        for (uint32_t i = 0; i < 5; ++i) {
+            f.set_desc(start + i, 300 + i);
+        }
+        f.producer() = start + 5;
+        BOOST_REQUIRE_EQUAL(f.r.peek(3), 3);
+        BOOST_REQUIRE_EQUAL(f.r.peek(64), 5);
+        BOOST_REQUIRE_EQUAL(f.r.cons(), start);
+        for (uint32_t i = 0; i < 5; ++i) {
+            BOOST_REQUIRE_EQUAL(f.r[f.r.cons() + i], 300 + i);
+        }
+        f.r.release(5);
+        BOOST_REQUIRE_EQUAL(f.consumer(), start + 5);
+        BOOST_REQUIRE_EQUAL(f.r.peek(64), 0);
+
+        // and more once the kernel produced them
+        f.set_desc(start + 5, 400);
+        f.producer() = start + 6;
+        BOOST_REQUIRE_EQUAL(f.r.peek(64), 1);
+        BOOST_REQUIRE_EQUAL(f.r[f.r.cons()], 400);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_needs_wakeup) {
+    fake_ring f(0);
+    BOOST_REQUIRE(!f.r.needs_wakeup());
+    f.flags() = XDP_RING_NEED_WAKEUP;
+    BOOST_REQUIRE(f.r.needs_wakeup());
+}
@@ -0,0 +1,119 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2024 ScyllaDB
+ */
+
+// Run with --zerocopy-send-threshold (see CMakeLists.txt), so that the
+// large packets below are sent without copying where the backend can.
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+
+#include <seastar/core/seastar.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/net/api.hh>
+#include <seastar/net/packet.hh>
+
+#include <memory>
+#include <vector>
+
+using namespace seastar;
+
+static constexpr size_t packet_size = 256 << 10;
+
+static char pattern(size_t off) {
+    return char(off / packet_size + off * 13);
+}
+
+// Each packet owns a heap buffer, and counts its release
+static net::packet make_packet(unsigned idx, lw_shared_ptr<unsigned> released) {
+    auto buf = std::make_unique<std::vector<char>>(packet_size);
+    for (size_t i = 0; i < packet_size; ++i) {
+        (*buf)[i] = pattern(idx * packet_size + i);
+    }
+    auto frag = net::fragment{buf->data(), buf->size()};
+    return net::packet(frag, make_deleter([buf = std::move(buf), released] {
+        ++*released;
+    }));
+}
+
+static future<size_t> receive_all(connected_socket s) {
+    auto in = s.input();
+    size_t off = 0;
+    while (auto buf = co_await in.read()) {
+        for (size_t i = 0; i < buf.size(); ++i, ++off) {
+            if (buf[i] != pattern(off)) {
+                BOOST_FAIL(fmt::format("Mismatch at offset {}", off));
+            }
+        }
+    }
+    co_await in.close();
+    co_return off;
+}
+
+// The kernel reports it is done with the buffers asynchronously
+static void wait_released(const unsigned& released, unsigned expected) {
+    for (int i = 0; i < 500 && released < expected; ++i) {
+        seastar::sleep(std::chrono::milliseconds(10)).get();
+    }
+    BOOST_REQUIRE_EQUAL(released, expected);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_zerocopy_send) {
+    auto listener = seastar::listen(socket_address(ipv4_addr("127.0.0.1", 0)), listen_options{.reuse_address = true});
+    auto receiver = listener.accept().then([] (accept_result ar) {
+        return receive_all(std::move(ar.connection));
+    });
+
+    constexpr unsigned nr_packets = 64;
+    auto released = make_lw_shared<unsigned>(0);
+    auto s = seastar::connect(listener.local_address()).get();
+    auto out = s.output();
+    for (unsigned i = 0; i < nr_packets; ++i) {
+        out.write(make_packet(i, released)).get();
+    }
+    out.flush().get();
+    out.close().get();
+
+    BOOST_REQUIRE_EQUAL(receiver.get(), nr_packets * packet_size);
+    wait_released(*released, nr_packets);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_zerocopy_send_closed_socket) {
+    auto listener = seastar::listen(socket_address(ipv4_addr("127.0.0.1", 0)), listen_options{.reuse_address = true});
+    auto receiver = listener.accept().then([] (accept_result ar) {
+        return receive_all(std::move(ar.connection));
+    });
+
+    // The socket is gone while the kernel may still reference the buffers
+    constexpr unsigned nr_packets = 16;
+    auto released = make_lw_shared<unsigned>(0);
+    {
+        auto s = seastar::connect(listener.local_address()).get();
+        auto out = s.output();
+        for (unsigned i = 0; i < nr_packets; ++i) {
+            out.write(make_packet(i, released)).get();
+        }
+        out.close().get();
+    }
+
+    BOOST_REQUIRE_EQUAL(receiver.get(), nr_packets * packet_size);
+    wait_released(*released, nr_packets);
+}